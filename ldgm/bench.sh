@@ -0,0 +1,9 @@
+#!/bin/bash
+# Measures CPU LDGM parity throughput for every XOR kernel supported by this CPU.
+# usage: bench.sh [frame_size]
+set -e
+
+FRAME_SIZE=${1:-8000000}
+
+./matrix-gen/matrix-gen -c 5 -k 1024 -m 768 -r -s 1 -f /tmp/matrix.bin
+./ldgm-encode -b -t /tmp/matrix.bin -k 1024 -m 768 -f $FRAME_SIZE -w5
@@ -25,8 +25,8 @@
 #include "matrix-generator.h"
  #include "rand_pmms.h"
 
-int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned int column_weight,
-                unsigned int seed,unsigned int extend_rows) 
+int *generate_ldgm_pcm(unsigned int k, unsigned int m, unsigned int column_weight,
+                unsigned int seed, unsigned int extend_rows, int *out_columns)
 {
 
     int random = 0;
@@ -34,7 +34,7 @@ int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned i
 
     if ( ! ( k > 0 && m > 0 && column_weight > 0 && (random > 0 || rfc > 0)  ) ) 
     {
-	return EXIT_FAILURE;
+	return NULL;
     }
 
     char **pc_matrix;
@@ -108,38 +108,53 @@ int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned i
  *     printf ( "\n" );
  */
 
-    int **pcm;
-    pcm = (int**)malloc(m*sizeof(int*));
-    for ( unsigned int i = 0; i < m; i++)
-	pcm[i] = (int*)malloc((max_weight+2) * sizeof(int));
-
-    
     int columns = max_weight + 2;
+    int *pcm = (int*)malloc(m * columns * sizeof(int));
     int counter = 0;
     for ( unsigned int i = 0; i < m; i++ )
     {
+	int *row = pcm + i * columns;
 	for ( unsigned int j = 0; j < k; j++)
 	    if( pc_matrix[i][j])
 	    {
-		pcm[i][counter] = j;
+		row[counter] = j;
 		counter++;
 	    }
 	//add indices from staircase matrix
-	pcm[i][counter] = k + i;
+	row[counter] = k + i;
 	counter++;
 
 	if ( i > 0 )
 	{
-	    pcm[i][counter] = k + i - 1;
+	    row[counter] = k + i - 1;
 	    counter++;
 	}
 
 	if ( counter < columns )
 	    for ( int j = counter; j < columns; j++)
-		pcm[i][j] = -1;
+		row[j] = -1;
 	counter = 0;
     }
 
+    for ( unsigned int i = 0; i < m; i++)
+	free(pc_matrix[i]);
+    free(pc_matrix);
+
+    *out_columns = columns;
+    return pcm;
+}
+
+int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned int column_weight,
+                unsigned int seed,unsigned int extend_rows) 
+{
+    int columns = 0;
+    int *pcm = generate_ldgm_pcm(k, m, column_weight, seed, extend_rows, &columns);
+    if (pcm == NULL)
+    {
+	return EXIT_FAILURE;
+    }
+    m += extend_rows;
+
 /*     for ( int i = 0; i < m; i++)
  *     {
  * 	for ( int j = 0; j < columns; j++)
@@ -161,7 +176,7 @@ int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned i
 	{ 
 	    for ( int j = 0; j < columns; j++)
 	    {
-		int t = pcm[i][j];
+		int t = pcm[i * columns + j];
 		tmp = fwrite(&t, sizeof(int), 1, out);
                 if (tmp != 1)
                     fprintf(stderr, "Cannot write to output file!");
@@ -216,11 +231,6 @@ int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned i
  */
 
 
-    for ( unsigned int i = 0; i < m; i++)
-	free(pc_matrix[i]);
-    free(pc_matrix);
-    for ( unsigned int i = 0; i < m; i++)
-	free(pcm[i]);
     free(pcm);
 
     return EXIT_SUCCESS;
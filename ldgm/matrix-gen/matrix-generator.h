@@ -1,3 +1,11 @@
 int generate_ldgm_matrix(char *fname, unsigned int k, unsigned int m, unsigned int column_weight,
                 unsigned int seed,unsigned int extend_rows);
-
+/**
+ * Generates the compact parity matrix (the content of the matrix file without
+ * the header) in memory.
+ *
+ * @param[out] columns  row length of the compact matrix
+ * @returns    matrix of (m + extend_rows) x columns items (to be freed with free()), NULL on error
+ */
+int *generate_ldgm_pcm(unsigned int k, unsigned int m, unsigned int column_weight,
+                unsigned int seed, unsigned int extend_rows, int *columns);
@@ -19,13 +19,11 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
-#if defined __SSE2__ || _M_IX86_FP == 2
-#include <emmintrin.h>
-#endif
 #include <string.h>
 #include <time.h>
 
 #include "ldgm-session-cpu.h"
+#include "ldgm-xor.h"
 #include "timer-util.h"
 
 using namespace std;
@@ -54,87 +52,6 @@ static inline void *aligned_malloc(size_t size, size_t alignment)
 #endif
 
 
-static char*
-xor_using_sse (char* source, char* dest, int packet_size)
-{
-    // int a = 0;
-    // int II = packet_size % 16;
-    // a=II*16;
-    // // uint64_t* p1 = (uint64_t*) (source);
-    // // uint64_t* p2 = (uint64_t*) (dest);
-
-    // __int128* p1 = (__int128*) (source);
-    // __int128* p2 = (__int128*) (dest);
-
-    // for(int i=0; i<II; i++){
-    //     *p2 ^= *p1;
-    //     p2++;
-    //     p1++;
-    // }
-    // while(a<packet_size){
-    //     *(dest + a) ^= *(source+a);
-    //     a++;
-    // }
-    //First, do as many 128-bit XORs as possible
-    int iter_bytes_16 = 0;
-    int iter_bytes_4 = 0;
-    int iter_bytes_1 = 0;
-#if defined __SSE2__ || _M_IX86_FP == 2
-    iter_bytes_16 = (packet_size/16)*16;
-
-    if ( iter_bytes_16 > 0)
-    {
-
-        //    printf ( "iter_bytes: %d\n", iter_bytes );
-        __m128i* wrd_ptr = (__m128i *)(void *) source;
-        __m128i* wrd_end = (__m128i *)(void *) (source + iter_bytes_16);
-        __m128i* dst_ptr = (__m128i *)(void *) dest;
-
-        //    printf ( "wrd_ptr address: %p\n", wrd_ptr );
-        do
-        {
-            __m128i xmm1 = _mm_loadu_si128(wrd_ptr);
-            __m128i xmm2 = _mm_loadu_si128(dst_ptr);
-
-            xmm1 = _mm_xor_si128(xmm1, xmm2);     //  XOR  4 32-bit words
-            _mm_storeu_si128(dst_ptr, xmm1);
-            ++wrd_ptr;
-            ++dst_ptr;
-
-        } while (wrd_ptr < wrd_end);
-    }
-#endif
-    //Check, whether further XORing is necessary
-    if ( iter_bytes_16 < packet_size )
-    {
-        char *mark_source = source + iter_bytes_16;
-        char *mark_dest = dest + iter_bytes_16;
-
-        iter_bytes_4 = ((packet_size - iter_bytes_16)/4)*4;
-
-        for ( int i = 0; i < (packet_size - iter_bytes_16)/4; i++)
-        {
-            int *s = ((int*)(void *) mark_source) + i;
-            int *d = ((int*)(void *) mark_dest) + i;
-            *d ^= *s;
-        }
-
-        mark_source += iter_bytes_4;
-        mark_dest += iter_bytes_4;
-
-        iter_bytes_1 = packet_size - iter_bytes_16 - iter_bytes_4;
-
-        for ( int i = 0; i < iter_bytes_1; i++)
-        {
-            *(mark_dest + i) ^= *(mark_source+i);
-        }
-    }
-
-//   printf ( "XORed: %d bytes using SSE, %d bytes as ints and %d bytes byte-per-byte.\n",iter_bytes_16, iter_bytes_4, iter_bytes_1);
-
-    return dest;
-}
-
 void *
 LDGM_session_cpu::alloc_buf (int buf_size)
 {
@@ -150,43 +67,57 @@ LDGM_session_cpu::alloc_buf (int buf_size)
 
 void
 LDGM_session_cpu::encode ( char* data_ptr, char* parity_ptr )
+{
+    encode_range(data_ptr, parity_ptr, packet_size, 0, param_m);
+}		/* -----  end of method LDGM_session_cpu::encode  ----- */
+
+void
+LDGM_session_cpu::encode_range ( const char* data_ptr, char* parity_ptr, int symbol_size, int first, int last )
 {
 //    start encoding
-   // printf ( "packet_size: %d\n", this->packet_size );
+   // printf ( "packet_size: %d\n", symbol_size );
 
     char *parity_packet;
 
-	parity_packet = (char *) aligned_malloc(packet_size, 16);
+	parity_packet = (char *) aligned_malloc(symbol_size, 16);
 	if (!parity_packet)
 	{
 		printf ( "Error while using posix_memalign\n" );
 		return;
 	}
-	memset(parity_packet, 0, packet_size);
+	memset(parity_packet, 0, symbol_size);
+    vector<const char *> src(max_row_weight+2);
 
-    for ( int m = 0; m < param_m; ++m) {
+    for ( int m = first; m < last; ++m) {
 //	printf ( "m: %d\n", m );
 
 //	printf ( "max w: %d\n", max_row_weight );
         //Find out which packets to XOR
+        int src_count = 0;
         for ( int k = 0; k < max_row_weight+2; ++k) {
             int idx = pcm[m*(max_row_weight+2) + k];
 //	    printf ( "adept: %d\n", idx );
             if (idx > -1 && idx < param_k) {
 //		printf ( "xoring idx: %d\n", idx );
-                char *ptr = data_ptr + idx*packet_size;
-                parity_packet = xor_using_sse(ptr, parity_packet, packet_size);
+                src[src_count++] = data_ptr + idx*symbol_size;
             }
         }
+        ldgm_xor_n(parity_packet, src.data(), src_count, symbol_size);
 
         //Add the new parity packet to overall parity
-        memcpy ( parity_ptr + m*packet_size, parity_packet, packet_size );
+        memcpy ( parity_ptr + m*symbol_size, parity_packet, symbol_size );
     }
 
 	aligned_free(parity_packet);
 
     return ;
-}		/* -----  end of method LDGM_session_cpu::encode  ----- */
+}		/* -----  end of method LDGM_session_cpu::encode_range  ----- */
+
+void
+LDGM_session_cpu::xor_symbol ( char *dst, const char *src, int symbol_size )
+{
+    ldgm_xor(dst, src, symbol_size);
+}
 
 void
 LDGM_session_cpu::free_out_buf ( char *buf)
@@ -256,7 +187,6 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
     Tanner_graph graph;
 
     int p_size = buf_size/(param_m+param_k);
-    this->packet_size = p_size;
 //    printf ( "p_size %d\n", p_size );
     graph.set_data_size(p_size);
 
@@ -431,8 +361,11 @@ LDGM_session_cpu::decode_frame ( char* received, int buf_size, int* frame_size,
 
     interval.end();
     //printf("time: %e\n",elapsed/1000.0 );
-    this->elapsed_sum2 += interval.elapsed_time_ms();
-    this->no_frames2++;
+    {
+        std::lock_guard<std::mutex> lk(stats_lock);
+        this->elapsed_sum2 += interval.elapsed_time_ms();
+        this->no_frames2++;
+    }
 
     if(this->no_frames==150){
         //printf("TIME: %f ms\n",this->elapsed_sum/(double)this->no_frames );
@@ -447,6 +380,8 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
 {
     map<int, Node>::iterator it_c;
     vector<int> vec;
+    vector<const char *> src;
+    const int packet_size = graph->get_data_size();
 
     //static int recovered = 0;
 
@@ -484,12 +419,13 @@ LDGM_session_cpu::iterate ( Tanner_graph *graph )
                 if ( *j != r_index )
                 {
 //		    printf ( "decode, packet_size: %d\n", packet_size );
-                    char *g_data = (graph->nodes.find(*j))->second.getDataPtr();
-                    //XOR
-                    xor_using_sse(g_data, r_data, packet_size);
+                    src.push_back((graph->nodes.find(*j))->second.getDataPtr());
                     count++;
                 }
             }
+            //XOR
+            ldgm_xor_n(r_data, src.data(), count, packet_size);
+            src.clear();
             /*           //validate recovered packet
              *          for ( int i = 0; i < param_k; ++i) {
              *              if(!memcmp(r_data, lost_ptr + i*packet_size, packet_size)) {
@@ -48,6 +48,19 @@ class LDGM_session_cpu : public LDGM_session
 	void
 	    encode_naive (char*, char*);
 
+	/**
+	 * Computes parity symbols first..last-1 of a block prepared with
+	 * prepare_hdr_frame(). The staircase accumulation starts from zero at
+	 * the first symbol, so unless first == 0, symbol first-1 of the complete
+	 * encoding must be additionally XORed to every symbol of the range (see
+	 * xor_symbol()). Thread-safe.
+	 */
+	void
+	    encode_range (const char *data, char *parity, int symbol_size, int first, int last);
+
+	static void
+	    xor_symbol (char *dst, const char *src, int symbol_size);
+
 	char*                                                                             
 	    decode_frame ( char* received_data, int buf_size, int* frame_size,
 		    std::map<int, int> valid_data );
@@ -120,6 +120,26 @@ LDGM_session::set_pcMatrix ( char* fname)
     return ;
 }               /*  -----  end of method Coding_session::set_pcMatrix  ----- */
 
+void
+LDGM_session::set_pcm ( const int *matrix, unsigned int k, unsigned int m, unsigned int columns )
+{
+    if (columns < 2 || columns > MAX_W) {
+        throw string("Invalid parameter in parity matrix (allowed range [2.." + to_string(MAX_W) + "])!");
+    }
+    if ( k != param_k || m != param_m)
+    {
+        ostringstream oss;
+        oss << "Parity matrix size mismatch\nExpected K = " << param_k << "% M = " << param_m <<
+                "\nReceived K = " << k << ", M = " << m << "\n";
+        throw oss.str();
+    }
+
+    free(pcm);
+    pcm = (int*) malloc(columns*param_m*sizeof(int));
+    memcpy(pcm, matrix, columns*param_m*sizeof(int));
+    this->max_row_weight = columns - 2; //columns stores number of columns in adjacency list
+}
+
 char*
 LDGM_session::encode_frame ( char* frame, int frame_size, int* out_buf_size )
 {   
@@ -222,7 +242,7 @@ LDGM_session::encode_frame ( char* frame, int frame_size, int* out_buf_size )
 }
 
 char*
-LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size )
+LDGM_session::prepare_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size, int *symbol_size )
 {
     int buf_size;
     int ps;
@@ -237,7 +257,7 @@ LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int
 
     ps = buf_size/param_k;
 
-    packet_size = ps;
+    *symbol_size = ps;
 //    printf ( "ps: %d\n", ps );
     buf_size += param_m*ps;
     *out_buf_size = buf_size;
@@ -259,6 +279,21 @@ LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int
     memcpy( ((char*)out_buf) + header_size, my_hdr, my_hdr_size);
     memcpy( ((char*)out_buf) + header_size + my_hdr_size, frame, frame_size);
 
+    return (char*)out_buf;
+}
+
+char*
+LDGM_session::encode_hdr_frame ( char *my_hdr, int my_hdr_size, char* frame, int frame_size, int* out_buf_size )
+{
+    int ps;
+    char *out_buf = prepare_hdr_frame(my_hdr, my_hdr_size, frame, frame_size, out_buf_size, &ps);
+    if (!out_buf)
+    {
+        return NULL;
+    }
+
+    packet_size = ps;
+
 #if 0
     int my_frame_size=my_hdr_size+frame_size;
 
@@ -17,6 +17,7 @@
  */
 
 
+#include <mutex>
 #include <stdint.h>
 
 #include "coding-session.h"
@@ -64,6 +65,15 @@ class LDGM_session : public Coding_session
 	void
 	    set_pcMatrix ( char * matrix );
 
+	/**
+	 * Sets the compact parity matrix from memory (as generated by
+	 * generate_ldgm_pcm()), the matrix is copied.
+	 *
+	 * @param columns row length of the compact matrix
+	 * */
+	void
+	    set_pcm ( const int *matrix, unsigned int k, unsigned int m, unsigned int columns );
+
 	/* ====================  OPERATORS     ======================================= */
 
 	void
@@ -75,6 +85,16 @@ class LDGM_session : public Coding_session
 	char*
 	    encode_hdr_frame( char *hdr, int hdr_size, char* frame, int frame_size, int* out_buf_size );
 
+	/**
+	 * Allocates and fills the buffer as encode_hdr_frame() does but doesn't
+	 * compute the parity. Doesn't modify the session so it can be called
+	 * concurrently.
+	 *
+	 * @param[out] symbol_size size of the symbol of the created block
+	 */
+	char*
+	    prepare_hdr_frame( char *hdr, int hdr_size, char* frame, int frame_size, int* out_buf_size, int *symbol_size );
+
 	virtual void
 	    encode ( char* data, char* parity ) = 0;
 	
@@ -120,6 +140,7 @@ class LDGM_session : public Coding_session
 
 	double elapsed_sum2;
 	long no_frames2;
+	std::mutex stats_lock; ///< guards elapsed_sum2 and no_frames2 for concurrent decode
 
         static const int HEADER_SIZE = 4;
 
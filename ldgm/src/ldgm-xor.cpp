@@ -0,0 +1,205 @@
+/**
+ * @file   ldgm/src/ldgm-xor.cpp
+ * @brief  XOR kernels used for LDGM parity computation and recovery
+ *
+ * x86 kernels are compiled with function target attributes so that they do
+ * not require the whole build to be compiled for AVX2/AVX-512. The kernel is
+ * then picked once according to the CPU features.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#define LDGM_XOR_X86 1
+#include <immintrin.h>
+#endif
+#if defined __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#include "ldgm-xor.h"
+
+static void xor_n_tail(char *dst, const char *const *src, int src_count, int offset, int len)
+{
+    for ( int i = offset; i < len; ++i)
+    {
+        char acc = dst[i];
+        for ( int s = 0; s < src_count; ++s)
+            acc ^= src[s][i];
+        dst[i] = acc;
+    }
+}
+
+static void xor_n_generic(char *dst, const char *const *src, int src_count, int len)
+{
+    int i = 0;
+    for ( ; i + (int) sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t acc;
+        memcpy(&acc, dst + i, sizeof acc);
+        for ( int s = 0; s < src_count; ++s)
+        {
+            uint64_t val;
+            memcpy(&val, src[s] + i, sizeof val);
+            acc ^= val;
+        }
+        memcpy(dst + i, &acc, sizeof acc);
+    }
+    xor_n_tail(dst, src, src_count, i, len);
+}
+
+static bool always_available(void)
+{
+    return true;
+}
+
+/**
+ * Defines XOR kernel processing 2 vectors of type vec_t per iteration.
+ * Each destination block is loaded and stored only once for all sources.
+ */
+#define DEFINE_XOR_KERNEL(name, attr, vec_t, load, store, xor_op) \
+attr static void name(char *dst, const char *const *src, int src_count, int len) \
+{ \
+    const int step = 2 * sizeof(vec_t); \
+    int i = 0; \
+    for ( ; i + step <= len; i += step) \
+    { \
+        vec_t acc0 = load(dst + i); \
+        vec_t acc1 = load(dst + i + sizeof(vec_t)); \
+        for ( int s = 0; s < src_count; ++s) \
+        { \
+            acc0 = xor_op(acc0, load(src[s] + i)); \
+            acc1 = xor_op(acc1, load(src[s] + i + sizeof(vec_t))); \
+        } \
+        store(dst + i, acc0); \
+        store(dst + i + sizeof(vec_t), acc1); \
+    } \
+    for ( ; i + (int) sizeof(vec_t) <= len; i += sizeof(vec_t)) \
+    { \
+        vec_t acc = load(dst + i); \
+        for ( int s = 0; s < src_count; ++s) \
+            acc = xor_op(acc, load(src[s] + i)); \
+        store(dst + i, acc); \
+    } \
+    xor_n_tail(dst, src, src_count, i, len); \
+}
+
+#ifdef LDGM_XOR_X86
+#define SSE2_LOAD(ptr) _mm_loadu_si128((const __m128i *)(const void *) (ptr))
+#define SSE2_STORE(ptr, val) _mm_storeu_si128((__m128i *)(void *) (ptr), val)
+DEFINE_XOR_KERNEL(xor_n_sse2, __attribute__((target("sse2"))), __m128i, SSE2_LOAD, SSE2_STORE, _mm_xor_si128)
+
+#define AVX2_LOAD(ptr) _mm256_loadu_si256((const __m256i *)(const void *) (ptr))
+#define AVX2_STORE(ptr, val) _mm256_storeu_si256((__m256i *)(void *) (ptr), val)
+DEFINE_XOR_KERNEL(xor_n_avx2, __attribute__((target("avx2"))), __m256i, AVX2_LOAD, AVX2_STORE, _mm256_xor_si256)
+
+#define AVX512_LOAD(ptr) _mm512_loadu_si512((const void *) (ptr))
+#define AVX512_STORE(ptr, val) _mm512_storeu_si512((void *) (ptr), val)
+DEFINE_XOR_KERNEL(xor_n_avx512, __attribute__((target("avx512f"))), __m512i, AVX512_LOAD, AVX512_STORE, _mm512_xor_si512)
+
+static bool sse2_available(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static bool avx2_available(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool avx512_available(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif // defined LDGM_XOR_X86
+
+#ifdef __ARM_NEON
+#define NEON_LOAD(ptr) vld1q_u8((const uint8_t *) (ptr))
+#define NEON_STORE(ptr, val) vst1q_u8((uint8_t *) (ptr), val)
+DEFINE_XOR_KERNEL(xor_n_neon, , uint8x16_t, NEON_LOAD, NEON_STORE, veorq_u8)
+#endif
+
+/// ordered from the most preferred
+static const struct ldgm_xor_impl impls[] = {
+#ifdef LDGM_XOR_X86
+    { "avx512", xor_n_avx512, avx512_available },
+    { "avx2", xor_n_avx2, avx2_available },
+    { "sse2", xor_n_sse2, sse2_available },
+#endif
+#ifdef __ARM_NEON
+    { "neon", xor_n_neon, always_available },
+#endif
+    { "generic", xor_n_generic, always_available },
+    { NULL, NULL, NULL },
+};
+
+static const struct ldgm_xor_impl *selected = impls;
+
+static ldgm_xor_func_t select_best(void)
+{
+    for ( selected = impls; !selected->available(); ++selected)
+        ;
+    return selected->xor_n;
+}
+
+ldgm_xor_func_t ldgm_xor_n = select_best();
+
+const struct ldgm_xor_impl *ldgm_xor_get_impls(void)
+{
+    return impls;
+}
+
+const char *ldgm_xor_get_name(void)
+{
+    return selected->name;
+}
+
+bool ldgm_xor_select(const char *name)
+{
+    for ( const struct ldgm_xor_impl *it = impls; it->name != NULL; ++it)
+    {
+        if ( strcmp(it->name, name) == 0 && it->available())
+        {
+            selected = it;
+            ldgm_xor_n = it->xor_n;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file   ldgm/src/ldgm-xor.h
+ * @brief  XOR kernels used for LDGM parity computation and recovery
+ *
+ * The implementation is selected at runtime according to CPU features.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LDGM_XOR_H_
+#define LDGM_XOR_H_
+
+/**
+ * XORs src_count symbols of len bytes from src to dst (dst ^= src[0] ^ ... ).
+ * Buffers do not need to be aligned.
+ */
+typedef void (*ldgm_xor_func_t)(char *dst, const char *const *src, int src_count, int len);
+
+struct ldgm_xor_impl {
+        const char *name;
+        ldgm_xor_func_t xor_n;
+        bool (*available)(void);
+};
+
+/// the fastest implementation available on this CPU (or the one forced by ldgm_xor_select())
+extern ldgm_xor_func_t ldgm_xor_n;
+
+/// @returns all compiled-in implementations (including unavailable ones), terminated by {}
+const struct ldgm_xor_impl *ldgm_xor_get_impls(void);
+/// @returns name of the implementation used by ldgm_xor_n
+const char *ldgm_xor_get_name(void);
+/**
+ * Forces the given implementation
+ * @retval false if not compiled in or not supported by the CPU
+ */
+bool ldgm_xor_select(const char *name);
+
+static inline void ldgm_xor(char *dst, const char *src, int len)
+{
+        ldgm_xor_n(dst, &src, 1, len);
+}
+
+#endif // defined LDGM_XOR_H_
@@ -28,6 +28,7 @@
 
 #include "ldgm-session-cpu.h"
 #include "ldgm-session-gpu.h"
+#include "ldgm-xor.h"
 #include "timer-util.h"
 
 using namespace std;
@@ -46,6 +47,7 @@ void printData ( char *data, int count, int packet_size );
 void fillParityMatrix ( char** matrix, int height, int width );
 int demo( int m, int k, int frame_size, char* matrix_fname, char* data_fname, int cpu, int gpu);
 void demo_gpu();
+int benchmark( int k, int m, int column_weight, int frame_size, char* matrix_fname );
 
 /* 
 * ===  FUNCTION  ======================================================================
@@ -56,18 +58,22 @@ void demo_gpu();
     int
 main ( int argc, char *argv[] )
 {
-    short m, k, column_weight;
+    short m, k, column_weight = 5;
     int frame_size;
 
     opterr = 0;
     int c;
     int gpu = 0;
     int cpu = 0;
+    int bench = 0;
     char fname[32];
     char matrix_fname[32];
 
-    while ( ( c = getopt ( argc, argv, "cf:gk:m:o:t:w:")) != -1 ) {
+    while ( ( c = getopt ( argc, argv, "bcf:gk:m:o:t:w:")) != -1 ) {
 	switch(c) {
+	    case 'b':
+		bench = 1;
+		break;
 	    case 'w':
 		column_weight = atoi ( optarg );
 		break;
@@ -116,6 +122,9 @@ main ( int argc, char *argv[] )
 	}
     }
 
+    if (bench)
+        return benchmark( k, m, column_weight, frame_size, matrix_fname);
+
     demo( k, m, frame_size, matrix_fname, fname, cpu, gpu);
 
     //    demo_gpu();
@@ -329,6 +338,65 @@ demo(int k, int m, int frame_size, char* matrix_fname, char* data_fname, int cpu
 }
 
 
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  benchmark
+ *  Description:  Measures CPU parity throughput with every available XOR kernel
+ *                and checks that all kernels produce the same parity
+ * =====================================================================================
+ */
+    int
+benchmark( int k, int m, int column_weight, int frame_size, char* matrix_fname )
+{
+    LDGM_session_cpu session;
+    session.set_params ( k, m, column_weight);
+    session.set_pcMatrix ( matrix_fname);
+
+    char *data = (char *) malloc(frame_size);
+    for ( int i = 0; i < frame_size; ++i)
+        data[i] = rand() % 256;
+
+    char *reference = NULL;
+    int buf_size = 0;
+    int ret = EXIT_SUCCESS;
+
+    for ( const struct ldgm_xor_impl *it = ldgm_xor_get_impls(); it->name != NULL; ++it)
+    {
+        if ( !ldgm_xor_select(it->name))
+        {
+            printf ( "%-8s not supported by this CPU\n", it->name );
+            continue;
+        }
+
+        char *output = NULL;
+        Timer_util t;
+        t.start();
+        for ( int i = 0; i < ITERATIONS; i++)
+        {
+            session.free_out_buf(output);
+            output = session.encode_frame ( data, frame_size, &buf_size );
+        }
+        t.end();
+
+        if ( !reference )
+        {
+            reference = (char *) malloc(buf_size);
+            memcpy(reference, output, buf_size);
+        }
+        bool match = memcmp(reference, output, buf_size) == 0;
+        if ( !match )
+            ret = EXIT_FAILURE;
+        printf ( "%-8s %8.1f MB/s%s\n", it->name,
+                (double) frame_size * ITERATIONS / t.elapsed_time() / 1000000.0,
+                match ? "" : " (parity MISMATCH)" );
+        session.free_out_buf(output);
+    }
+
+    free(reference);
+    free(data);
+    return ret;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  printData
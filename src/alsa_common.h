@@ -39,6 +39,8 @@
 #define ALSA_COMMON_H
 
 #include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -230,5 +232,52 @@ static const char *alsa_get_pcm_state_name(snd_pcm_state_t state) {
         }
 }
 
+/**
+ * Raises priority of the calling thread to real-time (SCHED_FIFO). Failure
+ * (eg. missing CAP_SYS_NICE or RLIMIT_RTPRIO) is not fatal, only reported.
+ */
+static inline void alsa_set_rt_priority(const char *module_name) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof sp);
+        sp.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (rc != 0) {
+                log_msg(LOG_LEVEL_WARNING, "%sUnable to set real-time priority: %s "
+                                "(check RLIMIT_RTPRIO)\n", module_name, strerror(rc));
+        } else {
+                log_msg(LOG_LEVEL_VERBOSE, "%sRunning with real-time priority %d\n",
+                                module_name, sp.sched_priority);
+        }
+}
+
+/// @returns address of the sample at offset in the mmapped area
+static inline char *alsa_mmap_area_ptr(const snd_pcm_channel_area_t *area, snd_pcm_uframes_t offset) {
+        return (char *) area->addr + (area->first + offset * area->step) / 8;
+}
+
+/**
+ * @returns true if the first ch_count areas form a single interleaved
+ * buffer with exactly ch_count channels (so that it can be accessed directly)
+ */
+static inline bool alsa_mmap_areas_packed(const snd_pcm_channel_area_t *areas, int ch_count, int bps) {
+        for (int i = 0; i < ch_count; ++i) {
+                if (areas[i].addr != areas[0].addr || areas[i].first != areas[0].first + i * bps * 8u
+                                || areas[i].step != ch_count * bps * 8u) {
+                        return false;
+                }
+        }
+        return areas[0].first % 8 == 0;
+}
+
+/// copies frames samples of bps bytes between buffers with arbitrary strides
+static inline void alsa_copy_strided(char *dst, int dst_stride, const char *src, int src_stride,
+                int bps, snd_pcm_uframes_t frames) {
+        for (snd_pcm_uframes_t i = 0; i < frames; ++i) {
+                memcpy(dst, src, bps);
+                dst += dst_stride;
+                src += src_stride;
+        }
+}
+
 #endif // defined ALSA_COMMON_H
 
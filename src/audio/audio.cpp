@@ -90,7 +90,9 @@
 #include "transmit.h"
 #include "pdb.h"
 #include "ug_runtime_error.hpp"
+#include "utils/av_sync.h"
 #include "utils/color_out.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
 #include "utils/sdp.h"
 #include "utils/thread.h"
@@ -186,6 +188,9 @@ struct state_audio {
         bool muted_sender = false;
 
         size_t recv_buf_size = DEFAULT_AUDIO_RECV_BUF_SIZE;
+
+        struct metrics_counter *metric_sent_frames = metrics_counter_register("audio_tx_frames", "Captured audio frames passed to the sender", nullptr);
+        struct metrics_counter *metric_played_frames = metrics_counter_register("audio_playback_frames", "Audio frames passed to the playback device", nullptr);
 };
 
 /** 
@@ -377,6 +382,10 @@ int audio_init(struct state_audio **ret, struct module *parent,
                 size_t len = sizeof(struct rtp *);
                 audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_PUT_NETWORK_DEVICE,
                                         &s->audio_network_device, &len);
+                struct control_state *control = (struct control_state *) get_module(get_root_module(parent), "control");
+                len = sizeof control;
+                audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_PUT_CONTROL_STATE,
+                                        &control, &len);
 
                 s->audio_tx_mode |= MODE_RECEIVER;
         } else {
@@ -669,6 +678,25 @@ static void audio_update_recv_buf(struct state_audio *s, size_t curr_frame_len)
         }
 }
 
+/// reports presentation of the just played received frame to A/V sync
+static void audio_av_sync_report(struct state_audio *s, uint32_t ssrc, const struct pbuf_audio_data *pbuf)
+{
+        const rtcp_sr *sr = rtp_get_sr(s->audio_network_device, ssrc);
+        if (sr == nullptr) {
+                return;
+        }
+        time_ns_t latency = 0;
+        size_t len = sizeof latency;
+        if (!audio_playback_ctl(s->audio_playback_device, AUDIO_PLAYBACK_CTL_QUERY_LATENCY, &latency, &len)) {
+                latency = 0;
+        }
+        // the latency includes the frame just put
+        const struct audio_frame *f = &pbuf->buffer;
+        time_ns_t duration = (time_ns_t) f->data_len / (f->bps * f->ch_count) * NS_IN_SEC / f->sample_rate;
+        av_sync_report(AV_SYNC_AUDIO, av_sync_sender_time(sr->ntp_sec, sr->ntp_frac, sr->rtp_ts, pbuf->rtp_ts),
+                        get_time_in_ns() + max<time_ns_t>(latency - duration, 0));
+}
+
 static void *audio_receiver_thread(void *arg)
 {
         set_thread_name(__func__);
@@ -679,6 +707,7 @@ static void *audio_receiver_thread(void *arg)
         bool playback_supports_multiple_streams;
 
         struct pbuf_audio_data *current_pbuf = NULL;
+        uint32_t current_ssrc = 0;
 
 #ifdef HAVE_JACK_TRANS
         struct pbuf_audio_data jack_pbuf{};
@@ -704,7 +733,9 @@ static void *audio_receiver_thread(void *arg)
 
                 if (s->receiver == NET_NATIVE || s->receiver == NET_STANDARD) {
                         time_ns_t curr_time = get_time_in_ns();
-                        uint32_t ts = (curr_time - s->start_time) / 100'000 * 9; // at 90000 Hz
+                        // same clock as RTP data (native), used for the A/V sync by the receiver
+                        uint32_t ts = s->sender == NET_NATIVE ? get_local_mediatime()
+                                : (curr_time - s->start_time) / 100'000 * 9; // at 90000 Hz
                         rtp_update(s->audio_network_device, curr_time);
                         rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
                         struct timeval timeout;
@@ -759,6 +790,7 @@ static void *audio_receiver_thread(void *arg)
                                         while (pbuf_decode(cp->playout_buffer, curr_time, s->receiver == NET_NATIVE ? decode_audio_frame : decode_audio_frame_mulaw, &dec_state->pbuf_data)) {
 
                                                 current_pbuf = &dec_state->pbuf_data;
+                                                current_ssrc = cp->ssrc;
                                                 decoded = true;
                                         }
                                 }
@@ -813,8 +845,12 @@ static void *audio_receiver_thread(void *arg)
 #endif
                         }
 
+                        metrics_counter_add(s->metric_played_frames, 1);
                         if (!playback_supports_multiple_streams) {
                                 audio_playback_put_frame(s->audio_playback_device, &current_pbuf->buffer);
+                                if (s->receiver == NET_NATIVE && av_sync_enabled()) {
+                                        audio_av_sync_report(s, current_ssrc, current_pbuf);
+                                }
                         } else {
                                 pdb_iter_t it;
                                 cp = pdb_iter_init(s->audio_participants, &it);
@@ -1052,7 +1088,8 @@ static void *audio_sender_thread(void *arg)
 
                 if ((s->audio_tx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
                         time_ns_t curr_time = get_time_in_ns();
-                        uint32_t ts = (curr_time - s->start_time) / 10'0000 * 9; // at 90000 Hz
+                        uint32_t ts = s->sender == NET_NATIVE ? get_local_mediatime() // same clock as RTP data
+                                : (curr_time - s->start_time) / 10'0000 * 9; // at 90000 Hz
                         rtp_update(s->audio_network_device, curr_time);
                         rtp_send_ctrl(s->audio_network_device, ts, 0, curr_time);
 
@@ -1103,6 +1140,7 @@ static void *audio_sender_thread(void *arg)
                         }
                         // COMPRESS
                         process_statistics(s, &bf_n);
+                        metrics_counter_add(s->metric_sent_frames, 1);
                         // SEND
                         if(s->sender == NET_NATIVE) {
                                 audio_frame2 *uncompressed = &bf_n;
@@ -73,6 +73,19 @@ extern "C" {
  * @param[in] struct rtp *
  */
 #define AUDIO_PLAYBACK_PUT_NETWORK_DEVICE   3
+/**
+ * Returns current playback latency - duration of the audio queued in the
+ * playback (internal and device buffers) before the next put frame is played.
+ * Optional, used for A/V synchronization.
+ * @param[out] time_ns_t
+ */
+#define AUDIO_PLAYBACK_CTL_QUERY_LATENCY    4
+/**
+ * Passes control socket state that the playback may use to report its
+ * statistics (optional).
+ * @param[in] struct control_state *
+ */
+#define AUDIO_PLAYBACK_PUT_CONTROL_STATE    5
 /// @}
 
 struct audio_playback_info {
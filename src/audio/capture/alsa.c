@@ -79,6 +79,8 @@ struct state_alsa_capture {
         long long int captured_samples;
 
         bool non_interleaved;
+        bool mmap; ///< read periods directly from mmapped device buffer
+        bool rt_priority_set;
 };
 
 static void audio_cap_alsa_probe(struct device_info **available_devices, int *count, void (**deleter)(void *))
@@ -99,6 +101,7 @@ static void audio_cap_alsa_help(void)
         color_printf(TERM_BOLD "\t-s alsa:opts=<opts>\n\n" TERM_RESET);
         color_printf(TERM_BOLD "\t<opts>" TERM_RESET " can be in format key1=value1:key2=value2, options are:\n");
         color_printf(TERM_BOLD "\t\tframes=<frames>" TERM_RESET " number of audio frames captured at a moment\n");
+        color_printf(TERM_BOLD "\t\tmmap" TERM_RESET " read periods from mmapped device buffer (capture thread gets real-time priority)\n");
 
         printf("\nAvailable ALSA capture devices\n");
         audio_alsa_list_devices();
@@ -153,6 +156,8 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
                 while ((item = strtok_r(opts, ":", &save_ptr)) != NULL) {
                         if (strncmp(item, "frames=", strlen("frames=")) == 0) {
                                 s->frames = atoi(item + strlen("frames="));
+                        } else if (strcmp(item, "mmap") == 0) {
+                                s->mmap = true;
                         } else {
                                 fprintf(stderr, "[ALSA cap.] Unknown option: %s\n", item);
                                 goto error;
@@ -211,7 +216,16 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
                 }
         }
 
-        if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) {
+        if (s->mmap) { // areas are accessed per-channel, so any layout will do
+                if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) {
+                        s->non_interleaved = false;
+                } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_MMAP_NONINTERLEAVED)) {
+                        s->non_interleaved = true;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Device doesn't support mmap access!\n");
+                        goto error;
+                }
+        } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_INTERLEAVED)) {
                 s->non_interleaved = false;
         } else if (!snd_pcm_hw_params_test_access(s->handle, params, SND_PCM_ACCESS_RW_NONINTERLEAVED)) {
                 if (s->frame.ch_count > 1) {
@@ -230,8 +244,13 @@ static void * audio_cap_alsa_init(struct module *parent, const char *cfg)
         /* Set the desired hardware parameters. */
 
         /* Access mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
-                s->non_interleaved ? SND_PCM_ACCESS_RW_NONINTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
+        if (s->mmap) {
+                rc = snd_pcm_hw_params_set_access(s->handle, params,
+                        s->non_interleaved ? SND_PCM_ACCESS_MMAP_NONINTERLEAVED : SND_PCM_ACCESS_MMAP_INTERLEAVED);
+        } else {
+                rc = snd_pcm_hw_params_set_access(s->handle, params,
+                        s->non_interleaved ? SND_PCM_ACCESS_RW_NONINTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED);
+        }
         if (rc < 0) {
                 fprintf(stderr, MOD_NAME "unable to set interleaved mode: %s\n",
                         snd_strerror(rc));
@@ -322,10 +341,106 @@ error:
         return NULL;
 }
 
+/// @retval false unrecoverable error
+static bool mmap_recover(struct state_alsa_capture *s, int err)
+{
+        if (err == -EPIPE) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "overrun occurred\n");
+        } else if (err == -ENODEV) {
+                log_msg(LOG_LEVEL_FATAL, MOD_NAME "Device removed, exiting!\n");
+                exit_uv(EXIT_FAIL_AUDIO);
+                return false;
+        }
+        int rc = snd_pcm_recover(s->handle, err, 1);
+        if (rc < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot recover from error: %s\n", snd_strerror(rc));
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Waits for a period and copies it from the mmapped device buffer straight
+ * to the returned frame (picking only the captured channels).
+ */
+static struct audio_frame *audio_cap_alsa_read_mmap(struct state_alsa_capture *s)
+{
+        if (!s->rt_priority_set) {
+                alsa_set_rt_priority(MOD_NAME);
+                s->rt_priority_set = true;
+        }
+
+        const int bps = s->frame.bps;
+        const int frame_size = bps * s->frame.ch_count;
+        snd_pcm_uframes_t captured = 0;
+        while (captured < s->frames) {
+                if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED) {
+                        int rc = snd_pcm_start(s->handle);
+                        if (rc < 0 && !mmap_recover(s, rc)) {
+                                return NULL;
+                        }
+                }
+                snd_pcm_sframes_t avail = snd_pcm_avail_update(s->handle);
+                if (avail < 0) {
+                        if (!mmap_recover(s, avail)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                if (avail < (snd_pcm_sframes_t) (s->frames - captured)) {
+                        int rc = snd_pcm_wait(s->handle, 1000);
+                        if (rc < 0 && !mmap_recover(s, rc)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+
+                const snd_pcm_channel_area_t *areas;
+                snd_pcm_uframes_t offset;
+                snd_pcm_uframes_t frames = s->frames - captured;
+                int rc = snd_pcm_mmap_begin(s->handle, &areas, &offset, &frames);
+                if (rc < 0) {
+                        if (!mmap_recover(s, rc)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                char *out = s->frame.data + captured * frame_size;
+                if ((int) s->min_device_channels == s->frame.ch_count
+                                && alsa_mmap_areas_packed(areas, s->frame.ch_count, bps)) {
+                        memcpy(out, alsa_mmap_area_ptr(&areas[0], offset), frames * frame_size);
+                } else {
+                        for (int i = 0; i < s->frame.ch_count; ++i) {
+                                alsa_copy_strided(out + i * bps, frame_size, alsa_mmap_area_ptr(&areas[i], offset),
+                                                areas[i].step / 8, bps, frames);
+                        }
+                }
+                snd_pcm_sframes_t committed = snd_pcm_mmap_commit(s->handle, offset, frames);
+                if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+                        if (!mmap_recover(s, committed >= 0 ? -EPIPE : committed)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                captured += frames;
+        }
+
+        s->frame.data_len = captured * frame_size;
+        if (bps == 1) {
+                signed2unsigned(s->frame.data, s->frame.data, s->frame.data_len);
+        }
+        s->captured_samples += captured;
+        return &s->frame;
+}
+
 static struct audio_frame *audio_cap_alsa_read(void *state)
 {
         struct state_alsa_capture *s = (struct state_alsa_capture *) state;
         int rc;
+
+        if (s->mmap) {
+                return audio_cap_alsa_read_mmap(s);
+        }
         char *discard_data;
 
         char *read_ptr[s->min_device_channels];
@@ -52,6 +52,7 @@
 #include "host.h"
 #include "jack_common.h"
 #include "lib_common.h"
+#include "module.h"
 #include "utils/ring_buffer.h"
 #include "utils/macros.h"
 
@@ -69,14 +70,16 @@ struct state_jack_capture {
         struct audio_frame frame;
         jack_client_t *client;
         jack_port_t *input_ports[MAX_PORTS];
-        char *tmp;
 
         sem_t data_sem;
-        struct ring_buffer *data;
+        struct ring_buffer *data; ///< interleaved float samples, written directly by the process callback
         bool can_process;
         bool should_exit;
 
         long int first_channel;
+
+        struct control_state *control;
+        struct jack_xrun_stats stats;
 };
 
 static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg)
@@ -88,22 +91,41 @@ static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg)
         return 0;
 }
 
+/**
+ * Runs in the JACK real-time thread - doesn't allocate or lock, the channels
+ * are interleaved directly to the ring buffer write regions.
+ */
 static int jack_process_callback(jack_nframes_t nframes, void *arg)
 {
         struct state_jack_capture *s = (struct state_jack_capture *) arg;
-        int i;
-        int channel_size = nframes * sizeof(int32_t);
+        const int frame_size = s->frame.ch_count * sizeof(float);
+        const int len = nframes * frame_size;
 
         if (!s->can_process) {
                 return 0;
         }
 
-        for (i = 0; i < s->frame.ch_count; ++i) {
-                jack_default_audio_sample_t *in = s->libjack->port_get_buffer(s->input_ports[i], nframes);
-                mux_channel(s->tmp, (char *) in, sizeof(int32_t), channel_size, s->frame.ch_count, i, 1.0);
+        if (ring_get_available_write_size(s->data) < len) {
+                atomic_fetch_add_explicit(&s->stats.buffer_errors, 1, memory_order_relaxed);
+                return 0;
         }
 
-        ring_buffer_write(s->data, s->tmp, channel_size * s->frame.ch_count);
+        void *ptr1 = NULL;
+        void *ptr2 = NULL;
+        int size1 = 0;
+        int size2 = 0;
+        ring_get_write_regions(s->data, len, &ptr1, &size1, &ptr2, &size2);
+        // ring size is a multiple of the frame size, so no sample is split
+        const int frames1 = size1 / frame_size;
+        for (int i = 0; i < s->frame.ch_count; ++i) {
+                const char *in = s->libjack->port_get_buffer(s->input_ports[i], nframes);
+                remux_channel(ptr1, in, sizeof(float), frames1 * sizeof(float), 1, s->frame.ch_count, 0, i);
+                if (ptr2 != NULL) {
+                        remux_channel(ptr2, in + frames1 * sizeof(float), sizeof(float),
+                                        (nframes - frames1) * sizeof(float), 1, s->frame.ch_count, 0, i);
+                }
+        }
+        ring_advance_write_idx(s->data, len);
         platform_sem_post(&s->data_sem);
 
         return 0;
@@ -230,10 +252,9 @@ static void * audio_cap_jack_init(struct module *parent, const char *cfg)
 
         platform_sem_init(&s->data_sem, 0, 0);
 
-        s->tmp = malloc(s->frame.max_size);
-
         s->data = ring_buffer_init(s->frame.max_size);
-        
+        s->control = (struct control_state *) get_module(get_root_module(parent), "control");
+
         if (s->libjack->set_sample_rate_callback(s->client, jack_samplerate_changed_callback, (void *) s)) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Registring callback problem.\n");
                 goto release_client;
@@ -244,6 +265,10 @@ static void * audio_cap_jack_init(struct module *parent, const char *cfg)
                 goto release_client;
         }
 
+        if (s->libjack->set_xrun_callback(s->client, jack_xrun_callback, &s->stats) != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Xrun callback registration problem.\n");
+        }
+
         if (s->libjack->activate(s->client)) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot activate client.\n");
                 goto release_client;
@@ -294,7 +319,9 @@ static struct audio_frame *audio_cap_jack_read(void *state)
                 platform_sem_post(&s->data_sem);
         }
 
-        float2int((char *) s->frame.data, (char *) s->frame.data, s->frame.max_size);
+        float2int((char *) s->frame.data, (char *) s->frame.data, s->frame.data_len);
+
+        jack_xrun_stats_report(&s->stats, s->control, MOD_NAME, "jack_capture", "overflows");
 
         if(!s->frame.data_len)
                 return NULL;
@@ -307,7 +334,6 @@ static void audio_cap_jack_done(void *state)
         struct state_jack_capture *s = (struct state_jack_capture *) state;
 
         s->libjack->client_close(s->client);
-        free(s->tmp);
         ring_buffer_destroy(s->data);
         free(s->frame.data);
         platform_sem_destroy(&s->data_sem);
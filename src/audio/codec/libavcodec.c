@@ -124,6 +124,36 @@ static void resize_tmp_buffer(unsigned char **tmp_buffer, size_t *cur_size, size
         *cur_size = new_size;
 }
 
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 134, 100)
+#define HAVE_GET_ENCODE_BUFFER 1
+
+static void dummy_free(void *opaque, uint8_t *data) {
+        (void) opaque, (void) data;
+}
+
+/**
+ * Lets the encoder write the packet directly after the already compressed
+ * data in output_channel_data so that it needn't be copied there.
+ */
+static int get_encode_buffer(struct AVCodecContext *ctx, AVPacket *pkt, int flags)
+{
+        struct libavcodec_codec_state *s = ctx->opaque;
+        size_t avail = TMP_DATA_LEN - s->output_channel.data_len;
+        if ((flags & AV_GET_ENCODE_BUFFER_FLAG_REF) != 0 // encoder keeps the reference
+                        || (size_t) pkt->size + AV_INPUT_BUFFER_PADDING_SIZE > avail) {
+                return avcodec_default_get_encode_buffer(ctx, pkt, flags);
+        }
+        uint8_t *data = (uint8_t *) s->output_channel_data + s->output_channel.data_len;
+        pkt->buf = av_buffer_create(data, pkt->size + AV_INPUT_BUFFER_PADDING_SIZE, dummy_free, NULL, 0);
+        if (pkt->buf == NULL) {
+                return AVERROR(ENOMEM);
+        }
+        pkt->data = data;
+        memset(pkt->data + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        return 0;
+}
+#endif
+
 /**
  * @todo
  * Remove and use the global print_libav_error. Dependencies need to be resolved first.
@@ -368,6 +398,13 @@ static bool reinitialize_encoder(struct libavcodec_codec_state *s, struct audio_
                 }
         }
 
+#ifdef HAVE_GET_ENCODE_BUFFER
+        if ((s->codec->capabilities & AV_CODEC_CAP_DR1) != 0) {
+                s->codec_ctx->opaque = s;
+                s->codec_ctx->get_encode_buffer = get_encode_buffer;
+        }
+#endif
+
         /* open it */
         int ret = avcodec_open2(s->codec_ctx, s->codec, NULL);
         if (ret != 0) {
@@ -499,8 +536,10 @@ static audio_channel *libavcodec_compress(void *state, audio_channel * channel)
                                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Output buffer overflow!\n");
                                         return NULL;
                                 }
-				memcpy(s->output_channel_data + s->output_channel.data_len,
-                                                s->pkt->data, s->pkt->size);
+                                char *dst = s->output_channel_data + s->output_channel.data_len;
+                                if ((char *) s->pkt->data != dst) { // not written in place by get_encode_buffer()
+                                        memcpy(dst, s->pkt->data, s->pkt->size);
+                                }
                                 s->output_channel.data_len += s->pkt->size;
                                 av_packet_unref(s->pkt);
                                 ret = avcodec_receive_packet(s->codec_ctx, s->pkt);
@@ -50,15 +50,22 @@
 #include <speex/speex_echo.h>
 
 #include <stdlib.h>
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <memory>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include "tv.h"
 #include "utils/ring_buffer.h"
+#include "utils/thread.h"
 #include "host.h"
 
-#define SAMPLES_PER_FRAME (1 << 9) //512, about 10ms at 48kHz, power of two for easy FFT
+#define BLOCKS_PER_SEC 100 ///< 10 ms blocks
+#define MAX_BLOCK_SAMPLES (192000 / BLOCKS_PER_SEC)
 #define DEFAULT_FILTER_LENGTH (48 * 500)
+#define STATS_INTERVAL_NS (5 * NS_IN_SEC)
 
 #define MOD_NAME "[Echo cancel] "
 
@@ -80,22 +87,45 @@ namespace {
         };
 }
 
+/**
+ * Echo cancellation runs in a dedicated thread. echo_play() (receiver thread)
+ * and echo_cancel() (capture thread) only put the samples to the far end and
+ * near end ring buffers, which are bounded (overflowing samples are dropped),
+ * so that slow processing never blocks the callers. echo_cancel() returns the
+ * samples already processed by the worker.
+ */
 struct echo_cancellation {
         std::unique_ptr<SpeexEchoState, Echo_state_deleter> echo_state;
 
-        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> near_end_ringbuf;
-        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> far_end_ringbuf;
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> near_end_ringbuf; ///< capture -> worker
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> far_end_ringbuf;  ///< receiver -> worker
+        std::unique_ptr<ring_buffer_t, Ring_buf_deleter> out_ringbuf;      ///< worker -> capture
 
         std::unique_ptr<spx_int16_t[]> frame_data;
         struct audio_frame frame;
 
+        int filter_length;
+        int block_samples; ///< samples per processed block (10 ms)
         int requested_delay;
-        int prefill;
+        std::atomic<int> prefill;
+        std::atomic<bool> drop_far; ///< set by capture thread, far end dropped by the worker
         time_point next_expected_near;
 
         std::unique_ptr<struct audio_export, Export_state_deleter> exporter;
 
-        std::mutex lock;
+        std::mutex lock; ///< protects echo state (held by the worker while processing)
+        std::condition_variable cv;
+        bool should_exit;
+        std::thread worker;
+
+        struct {
+                time_ns_t since;
+                int blocks;
+                time_ns_t proc_sum;
+                time_ns_t proc_max;
+                std::atomic<int> near_overflows;
+                std::atomic<int> far_overflows;
+        } stats;
 };
 
 ADD_TO_PARAM("echo-cancel-dump-audio", "* echo-cancel-dump-audio\n"
@@ -103,6 +133,7 @@ ADD_TO_PARAM("echo-cancel-dump-audio", "* echo-cancel-dump-audio\n"
 
 static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps);
 
+/// must be called with s->lock held
 static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int bps)
 {
         UNUSED(bps);
@@ -111,9 +142,14 @@ static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int
         s->frame.ch_count = 1;
         s->frame.sample_rate = sample_rate;
 
-        ring_buffer_flush(s->far_end_ringbuf.get());
+        // the worker doesn't read while the lock is held, so the consumer
+        // side of the far-end buffer may be accessed here
+        ring_advance_read_idx(s->far_end_ringbuf.get(), ring_get_current_size(s->far_end_ringbuf.get()));
         ring_buffer_flush(s->near_end_ringbuf.get());
+        ring_buffer_flush(s->out_ringbuf.get());
 
+        s->block_samples = sample_rate / BLOCKS_PER_SEC;
+        s->echo_state.reset(speex_echo_state_init(s->block_samples, s->filter_length));
         speex_echo_ctl(s->echo_state.get(), SPEEX_ECHO_SET_SAMPLING_RATE, &sample_rate); // should the 3rd parameter be int?
 
         if(get_commandline_param("echo-cancel-dump-audio")){
@@ -123,6 +159,91 @@ static void reconfigure_echo (struct echo_cancellation *s, int sample_rate, int
         }
 }
 
+static void report_stats(struct echo_cancellation *s, time_ns_t now)
+{
+        if (s->stats.since == 0) {
+                s->stats.since = now;
+                return;
+        }
+        if (now - s->stats.since < STATS_INTERVAL_NS) {
+                return;
+        }
+        if (s->stats.blocks > 0) {
+                double avg_us = (double) s->stats.proc_sum / s->stats.blocks / 1000.0;
+                double block_us = 1000.0 * 1000.0 / BLOCKS_PER_SEC;
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Processed %d blocks, avg %.1f us, max %.1f us (%.1f %% of real time), "
+                                "overflows near/far: %d/%d\n", s->stats.blocks, avg_us, s->stats.proc_max / 1000.0,
+                                100.0 * avg_us / block_us, s->stats.near_overflows.exchange(0),
+                                s->stats.far_overflows.exchange(0));
+        }
+        s->stats.since = now;
+        s->stats.blocks = 0;
+        s->stats.proc_sum = s->stats.proc_max = 0;
+}
+
+/// processes all whole blocks in near-end buffer, must be called with s->lock held
+static void process_blocks(struct echo_cancellation *s)
+{
+        const int block_bytes = s->block_samples * 2;
+
+        if (s->drop_far.exchange(false)) {
+                int current = ring_get_current_size(s->far_end_ringbuf.get());
+                //drop only whole blocks
+                current = (current / block_bytes) * block_bytes;
+                ring_advance_read_idx(s->far_end_ringbuf.get(), current);
+        }
+
+        while (ring_get_current_size(s->near_end_ringbuf.get()) >= block_bytes) {
+                if (ring_get_available_write_size(s->out_ringbuf.get()) < block_bytes) {
+                        // capture thread doesn't take the output, drop the block
+                        ring_advance_read_idx(s->near_end_ringbuf.get(), block_bytes);
+                        continue;
+                }
+                spx_int16_t near_arr[MAX_BLOCK_SAMPLES];
+                spx_int16_t far_arr[MAX_BLOCK_SAMPLES];
+                spx_int16_t out_arr[MAX_BLOCK_SAMPLES];
+
+                const void *export_channels[] = {near_arr, far_arr, out_arr, nullptr};
+                time_ns_t t0 = get_time_in_ns();
+                if(ring_get_current_size(s->far_end_ringbuf.get()) >= block_bytes){
+                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), block_bytes);
+                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), block_bytes);
+
+                        speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_arr);
+                } else {
+                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(out_arr), block_bytes);
+                        export_channels[0] = out_arr;
+                        export_channels[1] = out_arr;
+                        export_channels[2] = out_arr;
+                }
+                time_ns_t t1 = get_time_in_ns();
+                s->stats.blocks += 1;
+                s->stats.proc_sum += t1 - t0;
+                s->stats.proc_max = std::max(s->stats.proc_max, t1 - t0);
+
+                if(s->exporter){
+                        audio_export_raw_ch(s->exporter.get(), export_channels, s->block_samples);
+                }
+
+                ring_buffer_write(s->out_ringbuf.get(), reinterpret_cast<char *>(out_arr), block_bytes);
+                report_stats(s, t1);
+        }
+}
+
+static void echo_worker(struct echo_cancellation *s)
+{
+        set_thread_name("echo_cancel");
+        std::unique_lock<std::mutex> lk(s->lock);
+        while (true) {
+                s->cv.wait(lk, [s] { return s->should_exit || (s->block_samples > 0 &&
+                                        ring_get_current_size(s->near_end_ringbuf.get()) >= s->block_samples * 2); });
+                if (s->should_exit) {
+                        return;
+                }
+                process_blocks(s);
+        }
+}
+
 #define TEXTIFY(a) TEXTIFY2(a)
 #define TEXTIFY2(a) #a
 
@@ -137,12 +258,12 @@ struct echo_cancellation * echo_cancellation_init(void)
 {
         struct echo_cancellation *s = new echo_cancellation();
 
-        int filter_length = DEFAULT_FILTER_LENGTH;
+        s->filter_length = DEFAULT_FILTER_LENGTH;
         if(const char *param = get_commandline_param("echo-cancel-filter-length"); param != nullptr){
                 char *end;
                 int len = strtol(param, &end, 10);
                 if(end != param)
-                        filter_length = len;
+                        s->filter_length = len;
         }
 
         if(const char *param = get_commandline_param("echo-cancel-delay"); param != nullptr){
@@ -152,38 +273,42 @@ struct echo_cancellation * echo_cancellation_init(void)
                         s->requested_delay = len;
         }
 
-        s->echo_state.reset(speex_echo_state_init(SAMPLES_PER_FRAME, filter_length));
-
         s->frame.data = NULL;
         s->frame.sample_rate = s->frame.bps = 0;
 
-        const int ringbuf_sample_count = 2 << 15; //should be divisable by SAMPLES_PER_FRAME
+        const int ringbuf_sample_count = 2 << 15;
         constexpr int bps = 2; //TODO: assuming bps to be 2
 
         s->far_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
         s->near_end_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
+        s->out_ringbuf.reset(ring_buffer_init(ringbuf_sample_count * bps));
 
         s->frame_data = std::make_unique<spx_int16_t[]>(ringbuf_sample_count);
         s->frame.data = reinterpret_cast<char *>(s->frame_data.get());
         s->frame.max_size = ringbuf_sample_count * sizeof(s->frame_data[0]);
         static_assert(sizeof(s->frame_data[0]) == bps);
 
-        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples.\n", filter_length);
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Echo cancellation initialized with filter length %d samples.\n", s->filter_length);
 
         s->prefill = 0;
+        s->worker = std::thread(echo_worker, s);
 
         return s;
 }
 
 void echo_cancellation_destroy(struct echo_cancellation *s)
 {
+        {
+                std::lock_guard lk(s->lock);
+                s->should_exit = true;
+        }
+        s->cv.notify_one();
+        s->worker.join();
         delete s;
 }
 
 void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
 {
-        std::lock_guard lk(s->lock);
-
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0) {
@@ -193,17 +318,17 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 return;
         }
 
-        if(s->prefill){
-                int target = std::max(SAMPLES_PER_FRAME, (s->prefill / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME);
+        if(int prefill = s->prefill.exchange(0); prefill != 0){
+                int block_samples = std::max(frame->sample_rate / BLOCKS_PER_SEC, 1);
+                int target = std::max(block_samples, (prefill / block_samples) * block_samples) * 2;
                 int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //buffer can contain small remainder (<SAMPLES_PER_FRAME)
+                //buffer can contain small remainder (<block)
                 int to_fill = target - current;
-                s->prefill = 0;
                 if(to_fill < 0){
-                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Pre fill requested to %d, but the buffer is already %d!\n", target, current);
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Pre fill requested to %d, but the buffer is already %d!\n", target / 2, current / 2);
                 } else {
-                        ring_advance_write_idx(s->far_end_ringbuf.get(), to_fill);
-                        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Pre filling far end with %d samples\n", to_fill);
+                        ring_fill(s->far_end_ringbuf.get(), 0, to_fill);
+                        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Pre filling far end with %d samples\n", to_fill / 2);
                 }
         }
 
@@ -212,7 +337,7 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
 
         if(samples > ringbuf_free_samples){
                 samples = ringbuf_free_samples;
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Far end ringbuf overflow!\n");
+                s->stats.far_overflows++;
         }
 
         if(frame->bps != 2) {
@@ -227,7 +352,7 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
                 int in_bytes1 = (size1 / 2) * frame->bps;
                 change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
                 if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
+                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, size2 / 2 * frame->bps);
                 }
 
                 ring_advance_write_idx(s->far_end_ringbuf.get(), samples * 2);
@@ -238,10 +363,6 @@ void echo_play(struct echo_cancellation *s, struct audio_frame *frame)
 
 struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame *frame)
 {
-        struct audio_frame *res;
-
-        std::lock_guard lk(s->lock);
-
         if(frame->ch_count != 1) {
                 static int prints = 0;
                 if(prints++ % 100 == 0)
@@ -253,6 +374,12 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
 
         if(frame->sample_rate != s->frame.sample_rate ||
                         frame->bps != s->frame.bps) {
+                if (frame->sample_rate % BLOCKS_PER_SEC != 0 || frame->sample_rate / BLOCKS_PER_SEC > MAX_BLOCK_SAMPLES) {
+                        log_msg_once(LOG_LEVEL_ERROR, 0x2e1ec0a1, MOD_NAME "Unsupported sample rate %d Hz, disabling echo cancellation.\n",
+                                        frame->sample_rate);
+                        return frame;
+                }
+                std::lock_guard lk(s->lock);
                 reconfigure_echo(s, frame->sample_rate, frame->bps);
         }
 
@@ -262,7 +389,7 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
         size_t ringbuf_free_samples = ring_get_available_write_size(s->near_end_ringbuf.get()) / 2;
         if(in_frame_samples > ringbuf_free_samples){
                 in_frame_samples = ringbuf_free_samples;
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near end ringbuf overflow\n");
+                s->stats.near_overflows++;
         }
 
         if(s->next_expected_near < steady_clock::now()){
@@ -276,10 +403,7 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 long long delay = std::chrono::duration_cast<std::chrono::microseconds>(diff).count();
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Near samples late by %lldus\n", delay);
 
-                int current = ring_get_current_size(s->far_end_ringbuf.get());
-                //drop only whole frames
-                current = (current / SAMPLES_PER_FRAME) * SAMPLES_PER_FRAME;
-                ring_advance_read_idx(s->far_end_ringbuf.get(), current);
+                s->drop_far = true;
         }
         s->next_expected_near = steady_clock::now() + std::chrono::seconds(1);
 
@@ -295,12 +419,13 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 int in_bytes1 = (size1 / 2) * frame->bps;
                 change_bps(static_cast<char *>(ptr1), 2, frame->data, frame->bps, in_bytes1);
                 if(ptr2){
-                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, frame->data_len - in_bytes1);
+                        change_bps(static_cast<char *>(ptr2), 2, frame->data + in_bytes1, frame->bps, size2 / 2 * frame->bps);
                 }
                 ring_advance_write_idx(s->near_end_ringbuf.get(), in_frame_samples * 2);
         } else {
-                ring_buffer_write(s->near_end_ringbuf.get(), frame->data, frame->data_len);
+                ring_buffer_write(s->near_end_ringbuf.get(), frame->data, in_frame_samples * 2);
         }
+        s->cv.notify_one();
 
         size_t near_end_samples = ring_get_current_size(s->near_end_ringbuf.get()) / 2;
         size_t far_end_samples = ring_get_current_size(s->far_end_ringbuf.get()) / 2;
@@ -313,43 +438,11 @@ struct audio_frame * echo_cancel(struct echo_cancellation *s, struct audio_frame
                 s->prefill = in_frame_samples + s->requested_delay;
         }
 
-        size_t frames_to_process = near_end_samples / SAMPLES_PER_FRAME;
-        if(!frames_to_process){
+        // return what the worker has already processed (whole blocks)
+        int out_len = ring_buffer_read(s->out_ringbuf.get(), s->frame.data, s->frame.max_size);
+        if (out_len == 0) {
                 return NULL;
         }
-
-        size_t out_size = frames_to_process * SAMPLES_PER_FRAME * 2;
-        assert(static_cast<size_t>(s->frame.max_size) >= out_size);
-        s->frame.data_len = out_size;
-        res = &s->frame;
-
-        spx_int16_t *out_ptr = (spx_int16_t *)(void *) s->frame.data;
-        for(size_t i = 0; i < frames_to_process; i++){
-                spx_int16_t near_arr[SAMPLES_PER_FRAME];
-                spx_int16_t far_arr[SAMPLES_PER_FRAME];
-
-                const void *export_channels[] = {near_arr, far_arr, out_ptr, nullptr};
-                if(far_end_samples >= SAMPLES_PER_FRAME){
-                        ring_buffer_read(s->far_end_ringbuf.get(), reinterpret_cast<char *>(far_arr), SAMPLES_PER_FRAME * 2);
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(near_arr), SAMPLES_PER_FRAME * 2);
-
-                        speex_echo_cancellation(s->echo_state.get(), near_arr, far_arr, out_ptr); 
-                        far_end_samples -= SAMPLES_PER_FRAME;
-
-                } else {
-                        ring_buffer_read(s->near_end_ringbuf.get(), reinterpret_cast<char *>(out_ptr), SAMPLES_PER_FRAME * 2);
-                        export_channels[0] = out_ptr;
-                        export_channels[1] = out_ptr;
-                        export_channels[2] = out_ptr;
-                }
-
-                if(s->exporter){
-                        audio_export_raw_ch(s->exporter.get(), export_channels, SAMPLES_PER_FRAME);
-                }
-
-                out_ptr += SAMPLES_PER_FRAME;
-        }
-
-        return res;
+        s->frame.data_len = out_len;
+        return &s->frame;
 }
-
@@ -41,8 +41,12 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <cmath>
+#include <cstdio>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "debug.h"
 #include "module.h"
@@ -65,7 +69,10 @@ struct state_controlport_stats{
         int bps = 0;
         int ch_count = 0;
         int sample_rate = 0;
-                
+
+        std::vector<double> rms;  ///< per channel, preallocated in configure()
+        std::vector<double> peak;
+        std::string report;       ///< reused, keeps capacity
 };
 
 static void usage(){
@@ -93,6 +100,8 @@ static af_result_code configure(void *state,
         s->bps = in_bps;
         s->ch_count = in_ch_count;
         s->sample_rate = in_sample_rate;
+        s->rms.resize(in_ch_count);
+        s->peak.resize(in_ch_count);
 
         return AF_OK;
 }
@@ -127,16 +136,16 @@ static af_result_code filter(void *state, struct audio_frame **frame){
         if(!control_stats_enabled(s->control))
                 return AF_OK;
 
-        std::string report = "ASEND";
+        calculate_rms_all(f, s->rms.data(), s->peak.data());
+
+        s->report = "ASEND";
         for(int i = 0; i < f->ch_count; i++){
-                double rms, peak;
-                rms = calculate_rms(f, i, &peak);
-                double rms_dbfs0 = 20 * log(rms) / log(10);
-                double peak_dbfs0 = 20 * log(peak) / log(10);
-                report += " volrms" + std::to_string(i) + " " + std::to_string(rms_dbfs0);
-                report += " volpeak" + std::to_string(i) + " " + std::to_string(peak_dbfs0);
+                char item[128];
+                snprintf(item, sizeof item, " volrms%d %f volpeak%d %f",
+                                i, 20 * log10(s->rms[i]), i, 20 * log10(s->peak[i]));
+                s->report += item;
         }
-        control_report_stats(s->control, report.c_str());
+        control_report_stats(s->control, s->report.c_str());
 
         return AF_OK;
 }
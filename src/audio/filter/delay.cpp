@@ -109,15 +109,24 @@ static af_result_code init(struct module *parent, const char *cfg, void **state)
         return ret;
 };
 
+/**
+ * The ring is reallocated only when it needs to grow, otherwise the delay
+ * line is adjusted in place (silence appended or the oldest data dropped),
+ * so frame-mode delay with varying frame lengths doesn't reallocate per frame.
+ */
 static void set_delay_size(state_delay *s, int size){
         if(size == s->delay_size)
                 return;
 
         if(size == 0){
                 s->ring.reset();
-        } else {
+        } else if(!s->ring || ring_get_size(s->ring.get()) < size * 2){
                 s->ring.reset(ring_buffer_init(size * 2));
                 ring_fill(s->ring.get(), 0, size);
+        } else if(size > s->delay_size){
+                ring_fill(s->ring.get(), 0, size - s->delay_size);
+        } else {
+                ring_advance_read_idx(s->ring.get(), s->delay_size - size);
         }
         s->delay_size = size;
 }
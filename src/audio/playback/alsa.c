@@ -59,11 +59,14 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/macros.h"
 
 #define BUF_LEN_DEFAULT 60
 #define BUF_LEN_DEFAULT_SYNC 200 // default buffer len for sync API
 #define MOD_NAME "[ALSA play.] "
 #define SCRATCHPAD_SIZE (1024*1024)
+#define MMAP_PERIODS_DEFAULT 3
+#define MMAP_WAIT_TIMEOUT_MS 100
 
 /**
  * Speex jitter buffer use is currently not stable and not ready for production use.
@@ -97,7 +100,8 @@
 typedef enum {
         THREAD = 0,
         SYNC,
-        ASYNC
+        ASYNC,
+        MMAP, ///< mmapped device buffer filled from a real-time thread
 } playback_mode_t;
 
 struct state_alsa_playback {
@@ -115,7 +119,7 @@ struct state_alsa_playback {
         snd_pcm_uframes_t period_size;
         snd_pcm_uframes_t buffer_size;
 
-        // following variables are used only if playback_mode == THREAD
+        // following variables are used only if playback_mode == THREAD or MMAP
         pthread_t thread_id;
 #ifdef USE_SPEEX_JITTER_BUFFER
         JitterBuffer *buf;
@@ -138,6 +142,7 @@ struct state_alsa_playback {
 };
 
 static void audio_play_alsa_write_frame(void *state, const struct audio_frame *frame);
+static bool should_exit_thread(struct state_alsa_playback *s);
 
 static long get_sched_latency_ns(void)
 {
@@ -244,6 +249,134 @@ static void *worker(void *args) {
         }
 }
 
+/**
+ * Fills frames of the mmapped area at offset directly from the audio buffer.
+ * Scratchpad is used only if the area layout differs from the interleaved
+ * audio buffer format.
+ */
+static void mmap_fill(struct state_alsa_playback *s, const snd_pcm_channel_area_t *areas,
+                snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+{
+        const int bps = s->desc.bps;
+        const int ch_count = s->desc.ch_count;
+        const int len = frames * bps * ch_count;
+        const bool direct = alsa_mmap_areas_packed(areas, ch_count, bps);
+        char *data = direct ? alsa_mmap_area_ptr(&areas[0], offset) : s->scratchpad;
+        assert(direct || len <= SCRATCHPAD_SIZE);
+
+#ifdef USE_SPEEX_JITTER_BUFFER
+        int ret = 0; // mmap API not supported with Speex jitter buffer
+#else
+        int ret = audio_buffer_read(s->buf, data, len);
+#endif
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        if (ret > 0) {
+                s->last_audio_read = now;
+        } else if (tv_diff(now, s->last_audio_read) < 2.0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "empty buffer\n");
+        }
+        memset(data + ret, 0, len - ret);
+        if (bps == 1) {
+                signed2unsigned(data, data, len);
+        }
+
+        if (!direct) {
+                for (int i = 0; i < ch_count; ++i) {
+                        alsa_copy_strided(alsa_mmap_area_ptr(&areas[i], offset), areas[i].step / 8,
+                                        data + i * bps, bps * ch_count, bps, frames);
+                }
+        }
+}
+
+/// @retval false unrecoverable error
+static bool mmap_recover(struct state_alsa_playback *s, int err)
+{
+        if (err == -EPIPE) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "underrun occurred\n");
+        } else if (err == -ENODEV) {
+                log_msg(LOG_LEVEL_FATAL, MOD_NAME "Device removed, exiting!\n");
+                exit_uv(EXIT_FAIL_AUDIO);
+                return false;
+        }
+        int rc = snd_pcm_recover(s->handle, err, 1);
+        if (rc < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot recover from error: %s\n", snd_strerror(rc));
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Real-time thread driving the device in mmap mode - waits for a period to
+ * become free and fills it straight from the audio buffer, so that the latency
+ * is given by the device buffer (in periods) and the audio buffer length only.
+ */
+static void *mmap_worker(void *args) {
+        struct state_alsa_playback *s = args;
+
+        alsa_set_rt_priority(MOD_NAME);
+
+        while (!should_exit_thread(s)) {
+                snd_pcm_sframes_t avail = snd_pcm_avail_update(s->handle);
+                if (avail < 0) {
+                        if (!mmap_recover(s, avail)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                if (avail < (snd_pcm_sframes_t) s->period_size) {
+                        int rc = snd_pcm_wait(s->handle, MMAP_WAIT_TIMEOUT_MS);
+                        if (rc < 0 && !mmap_recover(s, rc)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+
+                // whole periods only
+                snd_pcm_uframes_t to_write = avail - avail % s->period_size;
+                while (to_write > 0) {
+                        const snd_pcm_channel_area_t *areas;
+                        snd_pcm_uframes_t offset;
+                        snd_pcm_uframes_t frames = to_write;
+                        int rc = snd_pcm_mmap_begin(s->handle, &areas, &offset, &frames);
+                        if (rc < 0) {
+                                if (!mmap_recover(s, rc)) {
+                                        return NULL;
+                                }
+                                break;
+                        }
+                        mmap_fill(s, areas, offset, frames);
+                        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(s->handle, offset, frames);
+                        if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+                                if (!mmap_recover(s, committed >= 0 ? -EPIPE : committed)) {
+                                        return NULL;
+                                }
+                                break;
+                        }
+                        to_write -= frames;
+                }
+
+                // (re)start once the buffer is full
+                if (to_write == 0 && snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED) {
+                        int rc = snd_pcm_start(s->handle);
+                        if (rc < 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Start error: %s\n", snd_strerror(rc));
+                        }
+                }
+        }
+
+        return NULL;
+}
+
+static bool should_exit_thread(struct state_alsa_playback *s)
+{
+        pthread_mutex_lock(&s->lock);
+        bool ret = s->should_exit_thread;
+        pthread_mutex_unlock(&s->lock);
+        return ret;
+}
+
 static bool audio_play_alsa_query_format(struct state_alsa_playback *s, void *data, size_t *len)
 {
         struct audio_desc desc;
@@ -366,6 +499,26 @@ static bool audio_play_alsa_query_format(struct state_alsa_playback *s, void *da
         return true;
 }
 
+static bool audio_play_alsa_query_latency(struct state_alsa_playback *s, void *data, size_t *len)
+{
+        if (*len < sizeof(time_ns_t) || s->desc.sample_rate == 0) {
+                return false;
+        }
+        snd_pcm_sframes_t frames = 0;
+        if (snd_pcm_delay(s->handle, &frames) < 0) {
+                frames = 0;
+        }
+#ifndef USE_SPEEX_JITTER_BUFFER
+        if (s->buf != NULL) {
+                frames += audio_buffer_get_occupancy(s->buf) / (s->desc.bps * s->desc.ch_count);
+        }
+#endif
+        time_ns_t latency = (time_ns_t) frames * NS_IN_SEC / s->desc.sample_rate;
+        memcpy(data, &latency, sizeof latency);
+        *len = sizeof latency;
+        return true;
+}
+
 static bool audio_play_alsa_ctl(void *state, int request, void *data, size_t *len)
 {
         struct state_alsa_playback *s = (struct state_alsa_playback *) state;
@@ -373,6 +526,8 @@ static bool audio_play_alsa_ctl(void *state, int request, void *data, size_t *le
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return audio_play_alsa_query_format(s, data, len);
+        case AUDIO_PLAYBACK_CTL_QUERY_LATENCY:
+                return audio_play_alsa_query_latency(s, data, len);
         default:
                 return false;
         }
@@ -429,6 +584,8 @@ ADD_TO_PARAM("alsa-playback-buffer", "* alsa-playback-buffer=<len>\n"
                                 "  Buffer length. Can be used to balance robustness and latency, in microseconds.\n");
 ADD_TO_PARAM("alsa-play-period-size", "* alsa-play-period-size=<frames>\n"
                                     "  ALSA playback period size in frames (default is device minimum) .\n");
+ADD_TO_PARAM("alsa-play-periods", "* alsa-play-periods=<n>\n"
+                                    "  Number of periods in ALSA buffer (mmap API only, default " TOSTRING(MMAP_PERIODS_DEFAULT) ").\n");
 /**
  * @todo
  * Consider using snd_pcm_hw_params_set_buffer_time_first() by default, it works fine
@@ -444,7 +601,7 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
         int dir;
         int rc;
 
-        if (s->playback_mode == THREAD && s->thread_started) {
+        if ((s->playback_mode == THREAD || s->playback_mode == MMAP) && s->thread_started) {
                 pthread_mutex_lock(&s->lock);
                 s->should_exit_thread = true;
                 pthread_mutex_unlock(&s->lock);
@@ -485,21 +642,36 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
         /* Set the desired hardware parameters. */
 
         /* Interleaved mode */
-        rc = snd_pcm_hw_params_set_access(s->handle, params,
-                        SND_PCM_ACCESS_RW_INTERLEAVED);
-        if (rc < 0) {
-                log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set interleaved hw access: %s\n",
-                        snd_strerror(rc));
+        if (s->playback_mode == MMAP) {
+                s->non_interleaved = false;
                 rc = snd_pcm_hw_params_set_access(s->handle, params,
-                                SND_PCM_ACCESS_RW_NONINTERLEAVED);
+                                SND_PCM_ACCESS_MMAP_INTERLEAVED);
                 if (rc < 0) {
-                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set non-interleaved hw access: %s\n",
-                                        snd_strerror(rc));
+                        rc = snd_pcm_hw_params_set_access(s->handle, params,
+                                        SND_PCM_ACCESS_MMAP_NONINTERLEAVED);
+                }
+                if (rc < 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set mmap hw access: %s "
+                                        "(use other playback API)\n", snd_strerror(rc));
                         return FALSE;
                 }
-                s->non_interleaved = true;
         } else {
-                s->non_interleaved = false;
+                rc = snd_pcm_hw_params_set_access(s->handle, params,
+                                SND_PCM_ACCESS_RW_INTERLEAVED);
+                if (rc < 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set interleaved hw access: %s\n",
+                                snd_strerror(rc));
+                        rc = snd_pcm_hw_params_set_access(s->handle, params,
+                                        SND_PCM_ACCESS_RW_NONINTERLEAVED);
+                        if (rc < 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "cannot set non-interleaved hw access: %s\n",
+                                                snd_strerror(rc));
+                                return FALSE;
+                        }
+                        s->non_interleaved = true;
+                } else {
+                        s->non_interleaved = false;
+                }
         }
 
         if (desc.bps > 4 || desc.bps < 1) {
@@ -572,7 +744,15 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
 
         unsigned int buf_len;
         int buf_dir = -1;
-        if (get_commandline_param("low-latency-audio") && get_commandline_param("alsa-playback-buffer") == NULL) {
+        if (s->playback_mode == MMAP) {
+                // fix the period (to the minimum) and size the buffer in periods
+                CHECK_OK(snd_pcm_hw_params_set_period_size_first(s->handle, params, &s->period_size, &dir));
+                unsigned int periods = MMAP_PERIODS_DEFAULT;
+                if (get_commandline_param("alsa-play-periods")) {
+                        periods = atoi(get_commandline_param("alsa-play-periods"));
+                }
+                CHECK_OK(snd_pcm_hw_params_set_periods_near(s->handle, params, &periods, &buf_dir));
+        } else if (get_commandline_param("low-latency-audio") && get_commandline_param("alsa-playback-buffer") == NULL) {
                 CHECK_OK(snd_pcm_hw_params_set_buffer_time_first(s->handle, params,
                                 &buf_len, &buf_dir));
                 log_msg(LOG_LEVEL_INFO, MOD_NAME "ALSA driver buffer len set to: %lf ms\n", buf_len / 1000.0);
@@ -604,13 +784,22 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
 
         snd_pcm_hw_params_current(s->handle, params);
         snd_pcm_hw_params_get_buffer_size(params, &s->buffer_size);
+        snd_pcm_hw_params_get_period_size(params, &s->period_size, &dir);
+        if (s->playback_mode == MMAP) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "ALSA driver buffer set to %lu periods of %lu frames (%lf ms)\n",
+                                s->buffer_size / s->period_size, s->period_size,
+                                (double) s->buffer_size / desc.sample_rate * 1000);
+        }
 
-        if (s->playback_mode == THREAD || s->playback_mode == ASYNC) {
+        if (s->playback_mode == THREAD || s->playback_mode == ASYNC || s->playback_mode == MMAP) {
 #ifdef USE_SPEEX_JITTER_BUFFER
 		jitter_buffer_reset(s->buf);
 #else
                 audio_buffer_destroy(s->buf);
                 s->audio_buf_len_ms = get_commandline_param("low-latency-audio") ? 5 : s->sched_latency_ms * 2;
+                if (s->playback_mode == MMAP) { // thread wakes up every period, scheduler latency doesn't apply
+                        s->audio_buf_len_ms = MAX(5, 2 * (long) (s->buffer_size * 1000 / desc.sample_rate + 1));
+                }
                 if (get_commandline_param("audio-buffer-len")) {
                         s->audio_buf_len_ms = atoi(get_commandline_param("audio-buffer-len"));
                 }
@@ -625,6 +814,19 @@ static int audio_play_alsa_reconfigure(void *state, struct audio_desc desc)
                 s->thread_started = true;
         }
 
+        if (s->playback_mode == MMAP) {
+                snd_pcm_sw_params_t *sw_params;
+                snd_pcm_sw_params_alloca(&sw_params);
+                CHECK_OK(snd_pcm_sw_params_current(s->handle, sw_params));
+                CHECK_OK(snd_pcm_sw_params_set_start_threshold(s->handle, sw_params, s->buffer_size));
+                CHECK_OK(snd_pcm_sw_params_set_avail_min(s->handle, sw_params, s->period_size));
+                CHECK_OK(snd_pcm_sw_params(s->handle, sw_params));
+
+                gettimeofday(&s->last_audio_read, NULL);
+                pthread_create(&s->thread_id, NULL, mmap_worker, s);
+                s->thread_started = true;
+        }
+
         if (s->playback_mode == ASYNC) {
                 snd_pcm_sw_params_t *sw_params;
                 CHECK_OK(snd_pcm_sw_params_malloc(&sw_params));
@@ -669,10 +871,11 @@ static void audio_play_alsa_probe(struct device_info **available_devices, int *c
 
 static void audio_play_alsa_help(void) {
         printf("Usage\n");
-        color_printf(TERM_BOLD TERM_FG_RED "\t-r alsa" TERM_FG_RESET "[:<device>] --param alsa-playback-api={thread|async|sync}[,alsa-playback-buffer=[<us>-]<us>][,audio-buffer-len=<ablen>]\n" TERM_RESET);
+        color_printf(TERM_BOLD TERM_FG_RED "\t-r alsa" TERM_FG_RESET "[:<device>] --param alsa-playback-api={thread|async|sync|mmap}[,alsa-playback-buffer=[<us>-]<us>][,audio-buffer-len=<ablen>]\n" TERM_RESET);
         color_printf("where\n");
-        color_printf(TERM_BOLD "\talsa-playback-api={thread|async|sync}\n" TERM_RESET);
-        color_printf("\t\tuse selected API ('thread' is default)\n");
+        color_printf(TERM_BOLD "\talsa-playback-api={thread|async|sync|mmap}\n" TERM_RESET);
+        color_printf("\t\tuse selected API ('thread' is default), 'mmap' fills the mmapped device buffer from a real-time\n"
+                        "\t\tthread, buffer is sized with alsa-play-period-size and alsa-play-periods\n");
         color_printf(TERM_BOLD "\talsa-playback-buffer=[<us>-]<us>\n" TERM_RESET);
         color_printf("\t\tset buffer max and optionally max (thread and async API only)\n");
         color_printf(TERM_BOLD "\taudio-buffer-len=<ablen>\n" TERM_RESET);
@@ -796,7 +999,7 @@ init_local_config_with_workaround(char const * pcm_node_name)
         return lconf;
 }
 
-ADD_TO_PARAM("alsa-playback-api", "* alsa-playback-api={thread|sync|async}\n"
+ADD_TO_PARAM("alsa-playback-api", "* alsa-playback-api={thread|sync|async|mmap}\n"
                                 "  ALSA API.\n");
 static void * audio_play_alsa_init(const char *cfg)
 {
@@ -823,6 +1026,8 @@ static void * audio_play_alsa_init(const char *cfg)
                         s->playback_mode = SYNC;
                 } else if (strcmp(use_api, "async") == 0) {
                         s->playback_mode = ASYNC;
+                } else if (strcmp(use_api, "mmap") == 0) {
+                        s->playback_mode = MMAP;
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown API string \"%s\"!\n", use_api);
                         free(s);
@@ -1005,6 +1210,13 @@ static void audio_play_alsa_put_frame(void *state, const struct audio_frame *fra
                 log_msg(LOG_LEVEL_NOTICE, MOD_NAME "%s\n", alsa_get_pcm_state_name(snd_pcm_state(s->handle)));
         }
 
+#ifndef USE_SPEEX_JITTER_BUFFER
+        if (s->playback_mode == MMAP) {
+                // the buffer is single-producer single-consumer, do not
+                // block the real-time reader
+                audio_buffer_write(s->buf, frame->data, frame->data_len);
+        } else
+#endif
         if (s->playback_mode == THREAD || s->playback_mode == ASYNC) {
                pthread_mutex_lock(&s->lock);
 #ifdef USE_SPEEX_JITTER_BUFFER
@@ -1028,7 +1240,7 @@ static void audio_play_alsa_done(void *state)
 {
         struct state_alsa_playback *s = (struct state_alsa_playback *) state;
 
-        if (s->playback_mode == THREAD && s->thread_started) {
+        if ((s->playback_mode == THREAD || s->playback_mode == MMAP) && s->thread_started) {
                 pthread_mutex_lock(&s->lock);
                 s->should_exit_thread = true;
                 pthread_mutex_unlock(&s->lock);
@@ -71,14 +71,17 @@ struct state_jack_playback {
         jack_port_t *output_port[MAX_PORTS];
         struct audio_desc desc;
         int max_channel_len; ///< maximal length of channel data that is processed at once
-        float *converted; ///< temporery buffer for int2float (put_frame)
+        float *converted; ///< temporery buffer for int2float (put_frame), not used with ring buffer
 
         int jack_ports_count;
         void *data; // audio buffer
         struct audio_buffer_api *buffer_fns;
-        char *tmp; ///< temporary buffer used to demux data
+        char *tmp; ///< buffer to read interleaved data from audio_buffer (not used with ring buffer)
 
         long int first_channel;
+
+        struct control_state *control;
+        struct jack_xrun_stats stats;
 };
 
 static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg);
@@ -103,24 +106,58 @@ static int jack_samplerate_changed_callback(jack_nframes_t nframes, void *arg)
         return 0;
 }
 
+/**
+ * Deinterleaves `len` bytes of data (whole frames) from `in` into the port
+ * buffers, starting at sample `offset`.
+ */
+static void demux_to_ports(struct state_jack_playback *s, jack_default_audio_sample_t **out, int offset, char *in, int len)
+{
+        for (int i = 0; i < s->desc.ch_count; ++i) {
+                demux_channel((char *) (out[i] + offset), in, sizeof(float), len, s->desc.ch_count, i);
+        }
+}
+
+/**
+ * Runs in the JACK real-time thread - doesn't allocate or lock. If the ring
+ * buffer is used, the data are deinterleaved directly from its read regions.
+ */
 static int jack_process_callback(jack_nframes_t nframes, void *arg)
 {
         struct state_jack_playback *s = (struct state_jack_playback *) arg;
-        int len;
-        int req_len = s->desc.ch_count * nframes * sizeof(float);
-        int nframes_available = nframes;
+        const int frame_size = s->desc.ch_count * sizeof(float);
+        const int req_len = nframes * frame_size;
+        jack_default_audio_sample_t *out[MAX_PORTS];
+        int len = 0;
 
-        len = s->buffer_fns->read(s->data, s->tmp, req_len);
-        if (len != req_len) {
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer underflow detected.\n");
-                nframes_available = len / s->desc.ch_count / sizeof(float);
+        for (int i = 0; i < s->desc.ch_count; ++i) {
+                out[i] = s->libjack->port_get_buffer(s->output_port[i], nframes);
+                assert(out[i] != NULL);
         }
 
-        for (int i = 0; i < s->desc.ch_count; ++i) {
-                jack_default_audio_sample_t *out =
-                        s->libjack->port_get_buffer (s->output_port[i], nframes_available);
-                assert(out != NULL);
-                demux_channel((char *) out, s->tmp, sizeof(float), len, s->desc.ch_count, i);
+        if (s->buffer_fns == &ring_buffer_fns) {
+                void *ptr1 = NULL;
+                void *ptr2 = NULL;
+                int size1 = 0;
+                int size2 = 0;
+                len = ring_get_read_regions(s->data, req_len, &ptr1, &size1, &ptr2, &size2);
+                len = len / frame_size * frame_size;
+                size1 = MIN(size1, len); // ring size is a multiple of the frame size
+                demux_to_ports(s, out, 0, ptr1, size1);
+                if (len > size1) {
+                        demux_to_ports(s, out, size1 / frame_size, ptr2, len - size1);
+                }
+                ring_advance_read_idx(s->data, len);
+        } else {
+                len = s->buffer_fns->read(s->data, s->tmp, req_len);
+                demux_to_ports(s, out, 0, s->tmp, len);
+        }
+
+        if (len != req_len) {
+                atomic_fetch_add_explicit(&s->stats.buffer_errors, 1, memory_order_relaxed);
+                int nframes_available = len / frame_size;
+                for (int i = 0; i < s->desc.ch_count; ++i) {
+                        memset(out[i] + nframes_available, 0, (nframes - nframes_available) * sizeof(float));
+                }
         }
 
         return 0;
@@ -225,6 +262,10 @@ static void * audio_play_jack_init(const char *cfg)
                 goto release_client;
         }
 
+        if (s->libjack->set_xrun_callback(s->client, jack_xrun_callback, &s->stats) != 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Xrun callback registration problem.\n");
+        }
+
         s->jack_sample_rate = s->libjack->get_sample_rate (s->client);
         log_msg(LOG_LEVEL_INFO, "JACK sample rate: %d\n", s->jack_sample_rate);
 
@@ -289,6 +330,12 @@ static bool audio_play_jack_ctl(void *state, int request, void *data, size_t *le
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 return audio_play_jack_query_format(s, data, len);
+        case AUDIO_PLAYBACK_PUT_CONTROL_STATE:
+                if (*len != sizeof s->control) {
+                        return false;
+                }
+                memcpy(&s->control, data, sizeof s->control);
+                return true;
         default:
                 return false;
         }
@@ -351,8 +398,12 @@ static int audio_play_jack_reconfigure(void *state, struct audio_desc desc)
         s->desc.sample_rate = desc.sample_rate;
 
         s->max_channel_len = (desc.sample_rate / 1000) * MAX_LEN_MS * sizeof(float);
-        s->tmp = malloc(s->max_channel_len);
-        s->converted = malloc(desc.ch_count * s->max_channel_len);
+        s->tmp = NULL;
+        s->converted = NULL;
+        if (s->buffer_fns != &ring_buffer_fns) {
+                s->tmp = malloc(desc.ch_count * s->max_channel_len);
+                s->converted = malloc(desc.ch_count * s->max_channel_len);
+        }
 
         if (s->libjack->activate(s->client)) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot activate client.\n");
@@ -381,8 +432,29 @@ static void audio_play_jack_put_frame(void *state, const struct audio_frame *fra
                 len = s->max_channel_len * frame->ch_count;
         }
 
-        int2float((char *) s->converted, frame->data, len);
-        s->buffer_fns->write(s->data, (char *) s->converted, len);
+        if (s->buffer_fns == &ring_buffer_fns) {
+                // convert directly to the ring buffer
+                int avail = ring_get_available_write_size(s->data);
+                if (len > avail) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Buffer overflow!\n");
+                        len = avail / (frame->ch_count * frame->bps) * (frame->ch_count * frame->bps);
+                }
+                void *ptr1 = NULL;
+                void *ptr2 = NULL;
+                int size1 = 0;
+                int size2 = 0;
+                ring_get_write_regions(s->data, len, &ptr1, &size1, &ptr2, &size2);
+                int2float(ptr1, frame->data, size1);
+                if (ptr2 != NULL) {
+                        int2float(ptr2, frame->data + size1, size2);
+                }
+                ring_advance_write_idx(s->data, len);
+        } else {
+                int2float((char *) s->converted, frame->data, len);
+                s->buffer_fns->write(s->data, (char *) s->converted, len);
+        }
+
+        jack_xrun_stats_report(&s->stats, s->control, MOD_NAME, "jack_playback", "underruns");
 }
 
 static void audio_play_jack_done(void *state)
@@ -46,28 +46,34 @@
 #include "audio/audio_playback.h"
 #include "audio/codec.h"
 #include "audio/types.h"
+#include "audio/utils.h"
 #include "debug.h"
 #include "lib_common.h"
 #include "module.h"
 #include "rtp/rtp.h"
 #include "transmit.h"
 #include "utils/audio_buffer.h"
+#include "utils/misc.h"
 #include "utils/thread.h"
+#include "utils/worker.h"
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
 
-#define SAMPLE_RATE 48000
+#define DEFAULT_SAMPLE_RATE 48000
 #define BPS     2 /// @todo 4?
-#define CHANNELS 1
+#define DEFAULT_CHANNELS 1
 #define FRAMES_PER_SEC 25
-static_assert(SAMPLE_RATE % FRAMES_PER_SEC == 0, "Sample rate not divisible by frames per sec!");
-#define SAMPLES_PER_FRAME (SAMPLE_RATE / FRAMES_PER_SEC)
+static_assert(1000 % FRAMES_PER_SEC == 0, "Frame duration is not a whole number of milliseconds");
+#define MAX_CHANNELS 16
 
 #define PARTICIPANT_TIMEOUT_S 60
+#define STATS_INTERVAL_S 5
 typedef int16_t sample_type_source;
 typedef int32_t sample_type_mixed;
 static_assert(sizeof(sample_type_source) == BPS, "sample_type source doesn't match BPS");
@@ -122,9 +128,10 @@ static void mixer_dummy_rtp_callback(struct rtp *session [[gnu::unused]], rtp_ev
 }
 
 struct am_participant {
-        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec) {
+        am_participant(struct socket_udp_local *l, struct sockaddr_storage *ss, string const & audio_codec,
+                        int sample_rate, int channels) {
                 assert(l != nullptr && ss != nullptr);
-                m_buffer = audio_buffer_init(SAMPLE_RATE, BPS, CHANNELS, get_commandline_param("low-latency-audio") ? 50 : 5);
+                m_buffer = audio_buffer_init(sample_rate, BPS, channels, get_commandline_param("low-latency-audio") ? 50 : 5);
                 assert(m_buffer != NULL);
                 struct sockaddr *sa = (struct sockaddr *) ss;
                 assert(ss->ss_family == AF_INET || ss->ss_family == AF_INET6);
@@ -140,6 +147,8 @@ struct am_participant {
                         LOG(LOG_LEVEL_ERROR) << "Audio coder init failed!\n";
                         throw 1;
                 }
+                m_frame.init(channels, AC_PCM, BPS, sample_rate);
+                m_samples.resize(sample_rate / FRAMES_PER_SEC * channels);
         }
         ~am_participant() {
                 if (m_tx_session) {
@@ -161,6 +170,8 @@ struct am_participant {
 		m_network_device = std::move(other.m_network_device);
 		m_tx_session = std::move(other.m_tx_session);
 		last_seen = std::move(other.last_seen);
+		m_samples = std::move(other.m_samples);
+		m_frame = std::move(other.m_frame);
 		other.m_audio_coder = nullptr;
 		other.m_buffer = nullptr;
 		other.m_tx_session = nullptr;
@@ -175,22 +186,16 @@ struct am_participant {
         struct rtp *m_network_device;
         struct tx *m_tx_session;
         chrono::steady_clock::time_point last_seen;
-};
 
-template<typename source_t, typename intermediate_t>
-class generic_mix_algo {
-public:
-        virtual ~generic_mix_algo() {}
-        virtual intermediate_t add_to_mix(intermediate_t dst, source_t sample) {
-                return dst + sample;
-        }
+        vector<sample_type_source> m_samples; ///< interleaved samples of current tick, mix-minus after mixing
+        audio_frame2 m_frame;                 ///< uncompressed output (planar)
+};
 
-        virtual intermediate_t get_mixed_without_source_sample(intermediate_t mix, source_t source_sample) {
-                return mix - source_sample;
-        }
+typedef int32_t v8si __attribute__((vector_size(32)));
+typedef int16_t v8hi __attribute__((vector_size(16)));
+#define MIX_LANES 8
 
-        virtual intermediate_t normalize(intermediate_t sample) = 0;
-};
+#pragma GCC diagnostic ignored "-Wpsabi"
 
 /**
  * In this mixer, no normalization takes place. After mixing and substracting each
@@ -198,12 +203,20 @@ public:
  * non-normalized mixed value can be out-of-bounds while resulting value with
  * substracted with substracted source may be ok.
  */
-template<typename source_t, typename intermediate_t>
-class linear_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
-        intermediate_t normalize(intermediate_t sample) override {
-                // clamp the value since linear mixer doesn't normalize values
-                return min<intermediate_t>(max<intermediate_t>(sample, numeric_limits<source_t>::min()), numeric_limits<source_t>::max());
+struct linear_mix_algo {
+        static sample_type_source normalize(sample_type_mixed sample) {
+                return min<sample_type_mixed>(max<sample_type_mixed>(sample, numeric_limits<sample_type_source>::min()),
+                                numeric_limits<sample_type_source>::max());
+        }
+        static v8hi normalize(v8si const &sample) {
+                const v8si lo = v8si{} + numeric_limits<sample_type_source>::min();
+                const v8si hi = v8si{} + numeric_limits<sample_type_source>::max();
+                v8si v = sample;
+                v8si m = v < lo;
+                v = (v & ~m) | (lo & m);
+                m = v > hi;
+                v = (v & ~m) | (hi & m);
+                return __builtin_convertvector(v, v8hi);
         }
 };
 
@@ -214,23 +227,77 @@ public:
  * http://www.voidcn.com/blog/caohongfei881/article/p-3815311.html
  * Threshold is 0.5.
  */
-template<typename source_t, typename intermediate_t>
-class logarithmic_mix_algo : public generic_mix_algo<source_t, intermediate_t> {
-public:
+struct logarithmic_mix_algo {
         static constexpr double t = 0.5;
         static constexpr double alpha = 5.71144;
-        intermediate_t normalize(intermediate_t sample) override {
-		if (sample >= numeric_limits<source_t>::min() / 2 &&
-				sample <= numeric_limits<source_t>::max() / 2) {
+        static sample_type_source normalize(sample_type_mixed sample) {
+		if (sample >= numeric_limits<sample_type_source>::min() / 2 &&
+				sample <= numeric_limits<sample_type_source>::max() / 2) {
 			return sample;
-		} else {
-                        double sample_norm = (double) sample / numeric_limits<source_t>::max();
-                        double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<source_t>::max();
-                        return ret;
+		}
+                double sample_norm = (double) sample / numeric_limits<sample_type_source>::max();
+                double ret = sample_norm / fabs(sample_norm) * (t + (1.0 - t) * log(1.0 + alpha * (fabs(sample_norm) - t) / (2 - t)) / log(1.0 + alpha)) * numeric_limits<sample_type_source>::max();
+                return linear_mix_algo::normalize((sample_type_mixed) ret);
+        }
+        /// below the threshold (the usual case) the samples pass unchanged
+        static v8hi normalize(v8si const &sample) {
+                v8si over = (sample < numeric_limits<sample_type_source>::min() / 2)
+                        | (sample > numeric_limits<sample_type_source>::max() / 2);
+                int any = 0;
+                for (int i = 0; i < MIX_LANES; ++i) {
+                        any |= over[i];
+                }
+                if (!any) {
+                        return __builtin_convertvector(sample, v8hi);
+                }
+                v8hi ret;
+                for (int i = 0; i < MIX_LANES; ++i) {
+                        ret[i] = normalize(sample[i]);
                 }
+                return ret;
         }
 };
 
+enum class mix_algo {
+        linear,
+        logarithmic,
+};
+
+/// mix += src
+static void mix_add(sample_type_mixed *__restrict mix, const sample_type_source *__restrict src, size_t count)
+{
+        size_t i = 0;
+        for ( ; i + MIX_LANES <= count; i += MIX_LANES) {
+                v8si m;
+                v8hi s;
+                memcpy(&m, mix + i, sizeof m);
+                memcpy(&s, src + i, sizeof s);
+                m += __builtin_convertvector(s, v8si);
+                memcpy(mix + i, &m, sizeof m);
+        }
+        for ( ; i < count; ++i) {
+                mix[i] += src[i];
+        }
+}
+
+/// samples = normalize(mix - samples), ie. the mix without the participant's own signal
+template<typename algo>
+static void mix_minus(const sample_type_mixed *__restrict mix, sample_type_source *__restrict samples, size_t count)
+{
+        size_t i = 0;
+        for ( ; i + MIX_LANES <= count; i += MIX_LANES) {
+                v8si m;
+                v8hi s;
+                memcpy(&m, mix + i, sizeof m);
+                memcpy(&s, samples + i, sizeof s);
+                s = algo::normalize(m - __builtin_convertvector(s, v8si));
+                memcpy(samples + i, &s, sizeof s);
+        }
+        for ( ; i < count; ++i) {
+                samples[i] = algo::normalize(mix[i] - samples[i]);
+        }
+}
+
 struct state_audio_mixer final {
         state_audio_mixer(const char *cfg) {
                 if (cfg) {
@@ -244,13 +311,25 @@ struct state_audio_mixer final {
                                 } else if (strncmp(item, "algo=", strlen("algo=")) == 0) {
                                         string algo = item + strlen("algo=");
                                         if (algo == "linear") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new linear_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mixing_algorithm = mix_algo::linear;
                                         } else if (algo == "logarithmic") {
-                                                mixing_algorithm = decltype(mixing_algorithm)(new logarithmic_mix_algo<sample_type_source, sample_type_mixed>());
+                                                mixing_algorithm = mix_algo::logarithmic;
                                         } else {
                                                 LOG(LOG_LEVEL_ERROR) << "Unknown mixing algorithm: " << algo << "\n";
                                                 throw 1;
                                         }
+                                } else if (strncmp(item, "rate=", strlen("rate=")) == 0) {
+                                        sample_rate = atoi(item + strlen("rate="));
+                                        if (sample_rate <= 0 || sample_rate % FRAMES_PER_SEC != 0) {
+                                                LOG(LOG_LEVEL_ERROR) << "Sample rate must be a multiple of " << FRAMES_PER_SEC << "!\n";
+                                                throw 1;
+                                        }
+                                } else if (strncmp(item, "ch=", strlen("ch=")) == 0) {
+                                        channels = atoi(item + strlen("ch="));
+                                        if (channels <= 0 || channels > MAX_CHANNELS) {
+                                                LOG(LOG_LEVEL_ERROR) << "Wrong channel count (1-" << MAX_CHANNELS << ")!\n";
+                                                throw 1;
+                                        }
                                 } else {
                                         LOG(LOG_LEVEL_ERROR) << "Unknown option: " << item << "\n";
                                         throw 1;
@@ -283,18 +362,104 @@ struct state_audio_mixer final {
 
         struct socket_udp_local *recv_socket{};
         string audio_codec{"PCM"};
+        int sample_rate = DEFAULT_SAMPLE_RATE;
+        int channels = DEFAULT_CHANNELS;
 private:
+        void mix();
+        template<typename algo> void send(am_participant &part);
+        void update_stats(chrono::steady_clock::time_point start, chrono::steady_clock::time_point mixed_time);
+
         thread thread_id;
-        unique_ptr<generic_mix_algo<sample_type_source, sample_type_mixed>> mixing_algorithm{new linear_mix_algo<sample_type_source, sample_type_mixed>()};
+        mix_algo mixing_algorithm = mix_algo::linear;
+        vector<sample_type_mixed> mixed; ///< sum of all participants (interleaved)
+        vector<am_participant *> active; ///< participants of the current tick
+
+        struct {
+                chrono::steady_clock::time_point since;
+                int ticks = 0;
+                int overruns = 0;
+                chrono::nanoseconds mix_sum{};
+                chrono::nanoseconds total_sum{};
+                chrono::nanoseconds total_max{};
+        } stats;
 };
 
+/**
+ * Reads current tick of all active participants and sums them. No lock is
+ * needed - audio_buffer is single-producer/single-consumer (put_frame writes)
+ * and participants are removed only by the worker. Buffers are kept across
+ * the ticks so that nothing is allocated once the participants are known.
+ */
+void state_audio_mixer::mix()
+{
+        const size_t sample_count = sample_rate / FRAMES_PER_SEC * channels;
+        mixed.assign(sample_count, 0);
+
+        for (auto *p : active) {
+                char *data = (char *) p->m_samples.data();
+                size_t data_len = sample_count * sizeof(sample_type_source);
+                int ret = audio_buffer_read(p->m_buffer, data, data_len);
+                memset(data + ret, 0, data_len - ret);
+                mix_add(mixed.data(), p->m_samples.data(), sample_count);
+        }
+}
+
+/**
+ * Replaces participant's samples with the mix without its own signal, encodes
+ * and sends them. Participants are processed concurrently (each has own coder
+ * and tx session), without participants_lock - only the worker removes them.
+ */
+template<typename algo>
+void state_audio_mixer::send(am_participant &part)
+{
+        const size_t sample_count = sample_rate / FRAMES_PER_SEC * channels;
+        mix_minus<algo>(mixed.data(), part.m_samples.data(), sample_count);
+        const size_t frames = sample_count / channels;
+        for (int ch = 0; ch < channels; ++ch) {
+                part.m_frame.resize(ch, frames * sizeof(sample_type_source));
+                demux_channel(part.m_frame.get_data(ch), (char *) part.m_samples.data(), sizeof(sample_type_source),
+                                sample_count * sizeof(sample_type_source), channels, ch);
+        }
+
+        audio_frame2 *uncompressed = &part.m_frame;
+        while (audio_frame2 compressed = audio_codec_compress(part.m_audio_coder, uncompressed)) {
+                audio_tx_send(part.m_tx_session, part.m_network_device, &compressed);
+                uncompressed = nullptr;
+        }
+}
+
+void state_audio_mixer::update_stats(chrono::steady_clock::time_point start, chrono::steady_clock::time_point mixed_time)
+{
+        auto end = chrono::steady_clock::now();
+        auto total = end - start;
+        stats.ticks += 1;
+        stats.mix_sum += mixed_time - start;
+        stats.total_sum += total;
+        stats.total_max = max<chrono::nanoseconds>(stats.total_max, total);
+        if (total > chrono::milliseconds(1000 / FRAMES_PER_SEC)) {
+                stats.overruns += 1;
+        }
+        if (end - stats.since < chrono::seconds(STATS_INTERVAL_S)) {
+                return;
+        }
+        if (stats.ticks > 0 && stats.since != chrono::steady_clock::time_point{}) {
+                LOG(stats.overruns > 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE) << "[Audio mixer] "
+                        << active.size() << " participants, tick avg " << duration_cast<microseconds>(stats.total_sum).count() / stats.ticks
+                        << " us (mixing " << duration_cast<microseconds>(stats.mix_sum).count() / stats.ticks
+                        << " us), max " << duration_cast<microseconds>(stats.total_max).count() << " us, "
+                        << stats.overruns << " overruns of " << stats.ticks << " ticks\n";
+        }
+        stats = {};
+        stats.since = end;
+}
+
 void state_audio_mixer::worker()
 {
         set_thread_name(__func__);
         chrono::steady_clock::time_point next_frame_time = chrono::steady_clock::now();
 
-        static_assert(SAMPLES_PER_FRAME * 1000ll % SAMPLE_RATE == 0, "Sample rate is not evenly divisible by number of samples in frame");
-        const chrono::milliseconds interval(SAMPLES_PER_FRAME*1000ll/SAMPLE_RATE);
+        const chrono::milliseconds interval(1000 / FRAMES_PER_SEC);
+        mixed.reserve(sample_rate / FRAMES_PER_SEC * channels);
 
         while (!should_exit) {
                 this_thread::sleep_until(next_frame_time);
@@ -309,7 +474,7 @@ void state_audio_mixer::worker()
 
                 unique_lock<mutex> plk(participants_lock);
                 // check timeouts
-                for (auto it = participants.cbegin(); it != participants.cend(); )
+                for (auto it = participants.begin(); it != participants.end(); )
                 {
                         if (duration_cast<seconds>(now - it->second.last_seen).count() > PARTICIPANT_TIMEOUT_S) {
                                 it = participants.erase(it);
@@ -317,65 +482,39 @@ void state_audio_mixer::worker()
                                 ++it;
                         }
                 }
-
-                size_t data_len_source = SAMPLES_PER_FRAME * sizeof(sample_type_source) * CHANNELS;
-                vector<sample_type_mixed> mixed(SAMPLES_PER_FRAME * CHANNELS);
-                vector<audio_frame2> participant_frames(participants.size());
-                int participant_index = 0;
-
-                // mix all together
+                active.clear();
                 for (auto & p : participants) {
-                        participant_frames[participant_index].init(CHANNELS, AC_PCM, BPS, SAMPLE_RATE);
-                        static_assert(CHANNELS == 1, "Currently only one channel is implemented here.");
-                        participant_frames[participant_index].resize(0, data_len_source);
-                        char *particip_data = participant_frames[participant_index].get_data(0);
-                        int ret = audio_buffer_read(p.second.m_buffer, particip_data, data_len_source);
-                        memset(particip_data, 0, data_len_source - ret);
-
-                        sample_type_source *src = (sample_type_source *)(void *) particip_data;
-                        auto dst = mixed.begin();
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *dst = mixing_algorithm->add_to_mix(*dst, *src);
-                                ++dst;
-                                ++src;
-                        }
-                        participant_index++;
-                }
-
-                // substract each source signal from the mix coming to that participant
-                for (auto & pb : participant_frames) {
-                        auto mix = mixed.begin();
-                        sample_type_source *part = (sample_type_source *)(void *) pb.get_data(0);
-                        for (int i = 0; i < SAMPLES_PER_FRAME * CHANNELS; ++i) {
-                                *part = mixing_algorithm->normalize(mixing_algorithm->get_mixed_without_source_sample(*mix, *part));
-                                ++mix;
-                                ++part;
-                        }
+                        active.push_back(&p.second);
                 }
-
-                // send
-                participant_index = 0;
-                for (auto & p : participants) {
-                        audio_frame2 *uncompressed = &participant_frames[participant_index];
-                        while (audio_frame2 compressed = audio_codec_compress(p.second.m_audio_coder, uncompressed)) {
-                                audio_tx_send(p.second.m_tx_session, p.second.m_network_device, &compressed);
-                                uncompressed = nullptr;
+                plk.unlock();
+                mix();
+                auto mixed_time = chrono::steady_clock::now();
+
+                // mix-minus, encode and send
+                auto send_fn = mixing_algorithm == mix_algo::logarithmic ? &state_audio_mixer::send<logarithmic_mix_algo>
+                        : &state_audio_mixer::send<linear_mix_algo>;
+                int count = active.size();
+                parallel_for(count, 1, min(count, get_cpu_core_count()), [&](int begin, int end) {
+                        for (int i = begin; i < end; ++i) {
+                                (this->*send_fn)(*active[i]);
                         }
+                });
 
-
-                        participant_index++;
-                }
-                plk.unlock();
+                update_stats(now, mixed_time);
         }
 }
 
 static void audio_play_mixer_help()
 {
         printf("Usage:\n"
-               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}]\n"
+               "\t%s -r mixer[:codec=<codec>][:algo={linear|logarithmic}][:rate=<rate>][:ch=<channels>]\n"
                "\n"
                "<codec>\n"
                "\taudio codec to use\n"
+               "<rate>\n"
+               "\tsample rate, eg. 48000 (default) or 96000\n"
+               "<channels>\n"
+               "\tnumber of channels (default %d)\n"
                "linear\n"
                "\tlinear sum of signals (with clamping)\n"
                "logarithmic\n"
@@ -391,7 +530,7 @@ static void audio_play_mixer_help()
                "\ton machine that is a part of the conference, you should use something like:\n"
                "\t\t%s -s <your_capture> -P 5004:5004:5010:5006\n"
                "\tfor the " PACKAGE_NAME " instance that is part of the conference (not mixer!)\n",
-               uv_argv[0], uv_argv[0]);
+               uv_argv[0], DEFAULT_CHANNELS, uv_argv[0]);
 }
 
 static void audio_play_mixer_probe(struct device_info **available_devices, int *count, void (**deleter)(void *))
@@ -423,7 +562,7 @@ static void audio_play_mixer_put_frame(void *state, const struct audio_frame *fr
         auto ss = *(struct sockaddr_storage *) frame->network_source;
 
         if (s->participants.find(ss) == s->participants.end()) {
-                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec});
+                s->participants.emplace(ss, am_participant{s->recv_socket, &ss, s->audio_codec, s->sample_rate, s->channels});
         }
 
         audio_buffer_write(s->participants.at(ss).m_buffer, frame->data, frame->data_len);
@@ -445,7 +584,7 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         switch (request) {
         case AUDIO_PLAYBACK_CTL_QUERY_FORMAT:
                 if (*len >= sizeof(struct audio_desc)) {
-                        struct audio_desc desc { BPS, SAMPLE_RATE, CHANNELS, AC_PCM };
+                        struct audio_desc desc { BPS, s->sample_rate, s->channels, AC_PCM };
                         memcpy(data, &desc, sizeof desc);
                         *len = sizeof desc;
                         return true;
@@ -473,9 +612,10 @@ static bool audio_play_mixer_ctl(void *state, int request, void *data, size_t *l
         }
 }
 
-static int audio_play_mixer_reconfigure(void *state [[gnu::unused]], struct audio_desc desc)
+static int audio_play_mixer_reconfigure(void *state, struct audio_desc desc)
 {
-        audio_desc requested{BPS, SAMPLE_RATE, CHANNELS, AC_PCM};
+        struct state_audio_mixer *s = (struct state_audio_mixer *) state;
+        audio_desc requested{BPS, s->sample_rate, s->channels, AC_PCM};
         assert(desc == requested);
         return TRUE;
 }
@@ -49,9 +49,12 @@
 #include "host.h"
 #include "ug_runtime_error.hpp"
 #include "utils/macros.h"
+#include "utils/misc.h"
 #include "utils/string_view_utils.hpp"
 #include "utils/worker.h"
 
+#include <algorithm>
+
 #ifdef HAVE_SPEEXDSP
 #include <speex/speex_resampler.h>
 #endif // HAVE_SPEEXDSP
@@ -61,6 +64,8 @@
 #endif // HAVE_SOXR
 
 #define DEFAULT_SPEEX_RESAMPLE_QUALITY 10 // in range [0,10] - 10 best
+#define PARALLEL_MIN_CHANNELS 8 ///< process channel groups in parallel from this channel count
+#define CHANNELS_PER_GROUP 4
 #define MOD_NAME "[audio_resampler] "
 
 using namespace std;
@@ -90,6 +95,42 @@ struct resample_prop {
         unsigned bps{0};
 };
 
+#if defined HAVE_SOXR || defined HAVE_SPEEXDSP
+/**
+ * Channel groups processed in parallel, only streams with at least
+ * PARALLEL_MIN_CHANNELS are split (for fewer channels the dispatch costs more
+ * than it saves).
+ */
+static int get_channel_group_count(int nb_channels)
+{
+        if (nb_channels < PARALLEL_MIN_CHANNELS) {
+                return 1;
+        }
+        return min((nb_channels + CHANNELS_PER_GROUP - 1) / CHANNELS_PER_GROUP, get_cpu_core_count());
+}
+
+static int get_group_first_channel(int group, int nb_channels, int group_count)
+{
+        return group * nb_channels / group_count;
+}
+
+/// runs process(group, first_channel, channel_count) for every channel group
+template<typename F>
+static void process_channel_groups(int nb_channels, int group_count, F &&process)
+{
+        if (group_count <= 1) {
+                process(0, 0, nb_channels);
+                return;
+        }
+        parallel_for(group_count, 1, group_count, [&](int begin, int end) {
+                for (int g = begin; g < end; ++g) {
+                        int first = get_group_first_channel(g, nb_channels, group_count);
+                        process(g, first, get_group_first_channel(g + 1, nb_channels, group_count) - first);
+                }
+        });
+}
+#endif // defined HAVE_SOXR || defined HAVE_SPEEXDSP
+
 #ifdef HAVE_SOXR
 class soxr_resampler : public audio_frame2_resampler::impl {
 public:
@@ -99,18 +140,32 @@ public:
                 return ret;
         }
         ~soxr_resampler() {
-                if (resampler) {
-                        soxr_delete(resampler);
-                }
+                destroy();
         }
 
 private:
         bool check_reconfigure(uint32_t original_sample_rate, uint32_t new_sample_rate_num, uint32_t new_sample_rate_den, size_t nb_channels, unsigned bps);
-
-        soxr_t resampler{nullptr};
+        void destroy();
+
+        /// each group of channels has its own resampler so that they can be processed in parallel
+        struct group {
+                soxr_t resampler;
+                size_t odone;
+                soxr_error_t error;
+        };
+        vector<group> groups;
+        vector<const void *> ibuf_ptrs;
+        vector<void *> obuf_ptrs;
         struct resample_prop prop;
 };
 
+void soxr_resampler::destroy() {
+        for (auto &g : groups) {
+                soxr_delete(g.resampler);
+        }
+        groups.clear();
+}
+
 /**
  * @brief This function will create (and destroy) a new resampler if needed.
  * 
@@ -124,7 +179,8 @@ private:
  * @return false Initialisation of the resampler failed
  */
 bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t new_sample_rate_num, uint32_t new_sample_rate_den, size_t nb_channels, unsigned bps) {
-        if (resampler != nullptr && nb_channels == prop.ch_count && bps == prop.bps) {
+        const double io_ratio = (double) original_sample_rate / ((double) new_sample_rate_num / (double) new_sample_rate_den);
+        if (!groups.empty() && nb_channels == prop.ch_count && bps == prop.bps) {
                 if (original_sample_rate != prop.rate_from
                                 || new_sample_rate_num != prop.rate_to_num
                                 || new_sample_rate_den != prop.rate_to_den) {
@@ -132,15 +188,14 @@ bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t n
                         prop.rate_from = original_sample_rate;
                         prop.rate_to_num = new_sample_rate_num;
                         prop.rate_to_den = new_sample_rate_den;
-                        soxr_set_io_ratio(resampler, ((double)prop.rate_from / ((double)new_sample_rate_num / (double)new_sample_rate_den)), 0);
+                        for (auto &g : groups) {
+                                soxr_set_io_ratio(g.resampler, io_ratio, 0);
+                        }
                 }
                 return true;
         }
 
-        if (this->resampler) {
-                soxr_delete((soxr_t)this->resampler);
-        }
-        this->resampler = nullptr;
+        destroy();
 
         /* When creating a var-rate resampler, q_spec must be set as follows: */
         soxr_quality_spec_t q_spec = soxr_quality_spec(SOXR_HQ, SOXR_VR);
@@ -157,18 +212,24 @@ bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t n
                 return false;
         }
 
-        soxr_error_t error;
-        /* The ratio of the given input rate and output rates must equate to the
-         * maximum I/O ratio that will be used. A resample rate of 2 to 1 would be excessive,
-           but provides a sensible ceiling */
-        this->resampler = soxr_create(2, 1, nb_channels, &error, &io_spec, &q_spec, &runtime_spec);
-
-        if (error) {
-                LOG(LOG_LEVEL_ERROR) << "[audio_frame2_resampler] Cannot initialize resampler: " << soxr_strerror(error) << "\n";
-                return false;
+        const int group_count = get_channel_group_count(nb_channels);
+        for (int i = 0; i < group_count; ++i) {
+                unsigned group_channels = get_group_first_channel(i + 1, nb_channels, group_count)
+                        - get_group_first_channel(i, nb_channels, group_count);
+                soxr_error_t error;
+                /* The ratio of the given input rate and output rates must equate to the
+                 * maximum I/O ratio that will be used. A resample rate of 2 to 1 would be excessive,
+                   but provides a sensible ceiling */
+                soxr_t resampler = soxr_create(2, 1, group_channels, &error, &io_spec, &q_spec, &runtime_spec);
+                if (error) {
+                        LOG(LOG_LEVEL_ERROR) << "[audio_frame2_resampler] Cannot initialize resampler: " << soxr_strerror(error) << "\n";
+                        destroy();
+                        return false;
+                }
+                // Immediately change the resample rate to be the correct value for the audio frame
+                soxr_set_io_ratio(resampler, io_ratio, 0);
+                groups.push_back({resampler, 0, nullptr});
         }
-        // Immediately change the resample rate to be the correct value for the audio frame
-        soxr_set_io_ratio((soxr_t)this->resampler, ((double)original_sample_rate / ((double)new_sample_rate_num / (double)new_sample_rate_den)), 0);
 
         // Setup resampler values
         this->prop.rate_from = original_sample_rate;
@@ -176,7 +237,8 @@ bool soxr_resampler::check_reconfigure(uint32_t original_sample_rate, uint32_t n
         this->prop.rate_to_den = new_sample_rate_den;
         this->prop.ch_count = nb_channels;
         this->prop.bps = bps;
-        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Soxr resampler (re)made at " << new_sample_rate_num / new_sample_rate_den << "\n";
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Soxr resampler (re)made at " << new_sample_rate_num / new_sample_rate_den
+                << " (" << group_count << " channel group" << (group_count > 1 ? "s" : "") << ")\n";
         return true;
 }
 
@@ -189,9 +251,8 @@ tuple<bool, audio_frame2> soxr_resampler::resample(audio_frame2 &a, vector<audio
         }
 
         // Initialise the new channels that the resampler is going to write into
-        void * * const obuf_ptrs = (void * *) malloc(sizeof(void *) * a.get_channel_count());
-        void * *       ibuf_ptrs = (void * *) malloc(sizeof(void *) * a.get_channel_count());
-
+        ibuf_ptrs.resize(new_channels.size());
+        obuf_ptrs.resize(new_channels.size());
         for (size_t i = 0; i < new_channels.size(); i++) {
                 // Setup the buffers
                 obuf_ptrs[i] = new_channels[i].data.get();
@@ -200,19 +261,24 @@ tuple<bool, audio_frame2> soxr_resampler::resample(audio_frame2 &a, vector<audio
 
         size_t inlen = a.get_data_len(0) / a.get_bps();
         size_t outlen = new_channels[0].len / a.get_bps();
-        size_t odone = 0;
-        soxr_error_t error;
-        error = soxr_process(resampler, ibuf_ptrs, inlen, NULL, obuf_ptrs, outlen, &odone);
-        if (error) {
-                LOG(LOG_LEVEL_ERROR) << "[audio_frame2_resampler] resampler failed: " << soxr_strerror(error) << "\n";
-                return {false, audio_frame2{}};
+        process_channel_groups(new_channels.size(), groups.size(), [&](int idx, int first, int) {
+                group &g = groups[idx];
+                g.odone = 0;
+                g.error = soxr_process(g.resampler, &ibuf_ptrs[first], inlen, NULL, &obuf_ptrs[first], outlen, &g.odone);
+        });
+        size_t odone = groups[0].odone;
+        for (auto &g : groups) {
+                if (g.error) {
+                        LOG(LOG_LEVEL_ERROR) << "[audio_frame2_resampler] resampler failed: " << soxr_strerror(g.error) << "\n";
+                        return {false, audio_frame2{}};
+                }
+                // all groups have the same ratio and input length so this shouldn't happen
+                odone = min(odone, g.odone);
         }
         for (unsigned int i = 0; i < new_channels.size(); i++) {
                 new_channels[i].len = odone * a.get_bps();
         }
 
-        free(obuf_ptrs); free(ibuf_ptrs);
-
         std::chrono::high_resolution_clock::time_point funcEnd = std::chrono::high_resolution_clock::now();
         long long resamplerDuration = std::chrono::duration_cast<std::chrono::milliseconds>(funcEnd - funcBegin).count();
         LOG(LOG_LEVEL_DEBUG) << "[audio_frame2_resampler] resampler_duration " << resamplerDuration << "\n";
@@ -243,17 +309,36 @@ public:
 private:
         bool check_reconfigure(unsigned original_sample_rate, unsigned new_sample_rate_num, unsigned new_sample_rate_den, unsigned channel_size, unsigned bps);
 
+        struct channel_data {
+                uint32_t in_frames;
+                uint32_t in_frames_orig;
+                uint32_t write_frames;
+                vector<float> in_float; ///< 32-bit samples are processed as float (kept across calls)
+                vector<float> out_float;
+        };
+
         int quality;
         SpeexResamplerState *state{nullptr};
         struct resample_prop prop;
+        int group_count = 1;
+        vector<channel_data> channels;
 };
 
 bool speex_resampler::check_reconfigure(unsigned original_sample_rate, unsigned new_sample_rate_num, unsigned new_sample_rate_den, unsigned nb_channels, unsigned bps) {
         if (state != nullptr && original_sample_rate == prop.rate_from
-                                && new_sample_rate_num == prop.rate_to_num
-                                && new_sample_rate_den == prop.rate_to_den
                                 && nb_channels == prop.ch_count
                                 && bps == prop.bps) {
+                if (new_sample_rate_num != prop.rate_to_num || new_sample_rate_den != prop.rate_to_den) {
+                        // only ratio changed (drift compensation) - keep the filter state to avoid clicks
+                        int err = speex_resampler_set_rate_frac(state, original_sample_rate * new_sample_rate_den,
+                                        new_sample_rate_num, original_sample_rate, new_sample_rate_num);
+                        if (err) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME "Cannot change SpeexDSP resampler rate: " << speex_resampler_strerror(err) << "\n";
+                                return false;
+                        }
+                        prop.rate_to_num = new_sample_rate_num;
+                        prop.rate_to_den = new_sample_rate_den;
+                }
                 return true;
         }
         if (bps != 2 && bps != 4) {
@@ -276,75 +361,53 @@ bool speex_resampler::check_reconfigure(unsigned original_sample_rate, unsigned
         prop.rate_to_den = new_sample_rate_den;
         prop.ch_count = nb_channels;
         prop.bps = bps;
+        group_count = get_channel_group_count(nb_channels);
         LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "SpeexDSP resampler (re)made at " << new_sample_rate_num / new_sample_rate_den << "\n";
         return true;
 }
 
-struct speex_process_channel_data {
-        SpeexResamplerState *state;
-        int channel_idx;
-        void *in;
-        void *out;
-        uint32_t in_frames;
-        uint32_t in_frames_orig;
-        uint32_t write_frames;
-};
-
-static void *speex_process_channel_short(void *arg) {
-        auto *d = (speex_process_channel_data *) arg;
-        speex_resampler_process_int(d->state,
-                        d->channel_idx,
-                        (spx_int16_t *) d->in, &d->in_frames,
-                        (spx_int16_t *) d->out, &d->write_frames);
-        return NULL;
-}
-
-static void *speex_process_channel_int(void *arg) {
-        auto *d = (speex_process_channel_data *) arg;
-        int2float((char *) d->in, (char *) d->in, sizeof(float) * d->in_frames);
-        speex_resampler_process_float(d->state,
-                        d->channel_idx,
-                        (float *) d->in, &d->in_frames,
-                        (float *) d->out, &d->write_frames);
-        float2int((char *) d->out, (char *) d->out, sizeof(float) * d->write_frames);
-        return NULL;
-}
-
 tuple<bool, audio_frame2> speex_resampler::resample(audio_frame2 &a, vector<audio_frame2::channel> &new_channels, int new_sample_rate_num, int new_sample_rate_den) {
         bool ret = check_reconfigure(a.get_sample_rate(), new_sample_rate_num, new_sample_rate_den, a.get_channel_count(), a.get_bps());
         if (!ret) {
                 return {false, audio_frame2{}};
         }
 
-        audio_frame2 remainder;
-        remainder.init(new_channels.size(), AC_PCM, prop.bps, prop.rate_from);
+        const int bps = a.get_bps();
+        channels.resize(new_channels.size());
+        // Speex keeps separate state for each channel so the groups of channels can be processed concurrently
+        process_channel_groups(new_channels.size(), group_count, [&](int, int first, int count) {
+                for (int i = first; i < first + count; ++i) {
+                        channel_data &d = channels[i];
+                        d.in_frames_orig = d.in_frames = a.get_data_len(i) / bps;
+                        d.write_frames = new_channels[i].len / bps;
+                        if (bps == 2) {
+                                speex_resampler_process_int(state, i,
+                                                (const spx_int16_t *)(const void *) a.get_data(i), &d.in_frames,
+                                                (spx_int16_t *)(void *) new_channels[i].data.get(), &d.write_frames);
+                                continue;
+                        }
+                        d.in_float.resize(d.in_frames);
+                        d.out_float.resize(d.write_frames);
+                        int2float((char *) d.in_float.data(), a.get_data(i), a.get_data_len(i));
+                        speex_resampler_process_float(state, i,
+                                        d.in_float.data(), &d.in_frames,
+                                        d.out_float.data(), &d.write_frames);
+                        float2int(new_channels[i].data.get(), (char *) d.out_float.data(), d.write_frames * sizeof(float));
+                }
+        });
 
-        vector <speex_process_channel_data> speex_worker_data(new_channels.size());
-        for (size_t i = 0; i < new_channels.size(); i++) {
-                speex_worker_data.at(i).state = state;
-                speex_worker_data.at(i).channel_idx = i;
-                speex_worker_data.at(i).in = (void *) a.get_data(i);
-                speex_worker_data.at(i).out = (void *) new_channels[i].data.get();
-                speex_worker_data.at(i).in_frames_orig =
-                        speex_worker_data.at(i).in_frames = a.get_data_len(i) / a.get_bps();
-                speex_worker_data.at(i).write_frames = new_channels[i].len / a.get_bps();
-        }
-        if (a.get_bps() == 2) {
-                task_run_parallel(speex_process_channel_short, new_channels.size(), speex_worker_data.data(), sizeof speex_worker_data[0], NULL);
-        } else {
-                task_run_parallel(speex_process_channel_int, new_channels.size(), speex_worker_data.data(), sizeof speex_worker_data[0], NULL);
-        }
+        audio_frame2 remainder;
         for (size_t i = 0; i < new_channels.size(); i++) {
-                if (speex_worker_data.at(i).in_frames != speex_worker_data.at(i).in_frames_orig) {
-                        remainder.append(i, a.get_data(i) + speex_worker_data.at(i).in_frames * a.get_bps(),
-                                        speex_worker_data.at(i).in_frames_orig - speex_worker_data.at(i).in_frames);
+                if (channels[i].in_frames != channels[i].in_frames_orig) {
+                        if (!remainder) {
+                                remainder.init(new_channels.size(), AC_PCM, prop.bps, prop.rate_from);
+                        }
+                        remainder.append(i, a.get_data(i) + channels[i].in_frames * bps,
+                                        (channels[i].in_frames_orig - channels[i].in_frames) * bps);
                 }
-                new_channels[i].len = speex_worker_data.at(i).write_frames * a.get_bps();
+                new_channels[i].len = channels[i].write_frames * bps;
         }
 
-        if (remainder.get_data_len() == 0) {
-                remainder = {};
-        }
         return {true, std::move(remainder)};
 }
 #endif // defined HAVE_SPEEXDSP
@@ -57,6 +57,9 @@ public:
         class impl;
 private:
         std::unique_ptr<impl> m_impl;
+        std::vector<audio_frame2::channel> m_out; ///< output buffers swapped with the resampled frame's ones (reused across calls)
+
+        friend class audio_frame2;
 };
 
 #endif // defined AUDIO_RESAMPLER_HPP_60C123AE_99B1_4726_AA2C_EFDB2C723952
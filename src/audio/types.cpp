@@ -327,12 +327,19 @@ void  audio_frame2::change_bps(int new_bps)
 
 tuple<bool, audio_frame2> audio_frame2::resample_fake(audio_frame2_resampler & resampler_state, int new_sample_rate_num, int new_sample_rate_den)
 {
-        vector<channel> new_channels(channels.size());
+        // output buffers are kept by the resampler and swapped with this frame's ones, so no allocation takes place in steady state
+        vector<channel> &new_channels = resampler_state.m_out;
+        new_channels.resize(channels.size());
         for (size_t i = 0; i < channels.size(); i++) {
-                // allocate new storage + 10 ms headroom
+                // storage + 10 ms headroom
                 size_t new_size = (long long) channels[i].len * new_sample_rate_num / sample_rate / new_sample_rate_den
                         + new_sample_rate_num * this->bps / 100 / new_sample_rate_den;
-                new_channels[i] = {unique_ptr<char []>(new char[new_size]), new_size, new_size, {}};
+                if (new_channels[i].max_len < new_size) {
+                        new_channels[i].data = unique_ptr<char []>(new char[new_size]);
+                        new_channels[i].max_len = new_size;
+                }
+                new_channels[i].len = new_size;
+                new_channels[i].fec_params = {};
         }
 
         auto [ret, remainder] = resampler_state.resample(*this, new_channels, new_sample_rate_num, new_sample_rate_den);
@@ -340,7 +347,7 @@ tuple<bool, audio_frame2> audio_frame2::resample_fake(audio_frame2_resampler & r
                 return {false, audio_frame2{}};
         }
 
-        channels = std::move(new_channels);
+        swap(channels, new_channels);
         return {ret, std::move(remainder)};
 }
 
@@ -48,6 +48,8 @@
 #include <climits>
 #include <cmath>
 #include <cstring>
+#include <type_traits>
+#include <vector>
 
 #include "audio/codec.h"
 #include "audio/types.h"
@@ -60,6 +62,8 @@
 #error "This code will not run with a big-endian machine. Please report a bug to " PACKAGE_BUGREPORT " if you reach here."
 #endif // WORDS_BIGENDIAN
 
+#define MIX_BLOCK 64 ///< samples processed at once by mix_channels_interleaved
+
 using namespace std;
 
 /**
@@ -77,14 +81,9 @@ template<> int32_t load_sample<2>(const char *data) {
 }
 
 template<> int32_t load_sample<3>(const char *data) {
-        int32_t in_value = 0;
-        memcpy(&in_value, data, 3);
-
-        if ((in_value & 1U<<23U) != 0U) { // negative
-                in_value |= 0xFF000000U;
-        }
-
-        return in_value;
+        const auto *d = reinterpret_cast<const unsigned char *>(data);
+        // assemble to upper 24 bits, arithmetic shift sign-extends (branchless so that loops vectorize)
+        return (int32_t) ((uint32_t) d[0] << 8U | (uint32_t) d[1] << 16U | (uint32_t) d[2] << 24U) >> 8;
 }
 
 template<> int32_t load_sample<4>(const char *data) {
@@ -102,14 +101,40 @@ template<> void store_sample<2>(char *data, int32_t val) {
 }
 
 template<> void store_sample<3>(char *data, int32_t val) {
-        val = clamp<int32_t>(val, -(1L<<24), (1L<<24) - 1);
-        memcpy(data, &val, 3);
+        val = clamp<int32_t>(val, -(1L<<23), (1L<<23) - 1);
+        data[0] = (char) (val & 0xFF);
+        data[1] = (char) ((val >> 8) & 0xFF);
+        data[2] = (char) ((val >> 16) & 0xFF);
 }
 
 template<> void store_sample<4>(char *data, int32_t val) {
         *reinterpret_cast<int32_t *>(data) = val;
 }
 
+/// converts scaled sample to int32_t saturating to BPS range
+template<int BPS, typename T> static int32_t saturate(T val) {
+        constexpr T min_val = -(T) (1LL << (BPS * CHAR_BIT - 1));
+        constexpr T max_val = (T) ((1LL << (BPS * CHAR_BIT - 1)) - 1);
+        return (int32_t) clamp(val, min_val, max_val);
+}
+
+/**
+ * Calls f with std::integral_constant<int, bps> so that the per-sample loops
+ * are specialized (and vectorized where possible) for the sample width
+ * instead of switching on bps for every sample.
+ */
+template<typename F> static void bps_dispatch(int bps, F &&f) {
+        switch (bps) {
+        case 1: f(integral_constant<int, 1>{}); return;
+        case 2: f(integral_constant<int, 2>{}); return;
+        case 3: f(integral_constant<int, 3>{}); return;
+        case 4: f(integral_constant<int, 4>{}); return;
+        default:
+                LOG(LOG_LEVEL_FATAL) << "Wrong BPS " << bps << "\n";
+                abort();
+        }
+}
+
 /**
  * @brief Calculates mean and peak RMS from audio samples
  *
@@ -195,6 +220,98 @@ double calculate_rms(audio_frame *frame, int channel, double *peak)
         }
 }
 
+#define RMS_BLOCK_FRAMES 8 ///< sample frames accumulated per position by calculate_rms_all
+
+/**
+ * Accumulates in one pass sums, sums of squares and peaks per position of a
+ * block of RMS_BLOCK_FRAMES sample frames. The block is contiguous, so that
+ * the inner loop vectorizes regardless of the channel count, positions are
+ * folded to channels at the end.
+ */
+template<int BPS>
+static void calculate_rms_all_helper(const char *data, int ch_count, int sample_count,
+                double *rms, double *peak)
+{
+        const int block = ch_count * RMS_BLOCK_FRAMES;
+        thread_local vector<double> sum;
+        thread_local vector<double> sumsq;
+        thread_local vector<uint32_t> max_abs;
+        sum.assign(block, 0.0); // keeps capacity - allocates only on channel count increase
+        sumsq.assign(block, 0.0);
+        max_abs.assign(block, 0);
+        double *s = sum.data();
+        double *sq = sumsq.data();
+        uint32_t *m = max_abs.data();
+
+        const int total = sample_count * ch_count;
+        int i = 0;
+        for ( ; i + block <= total; i += block) {
+                const char *p = data + (size_t) i * BPS;
+                for (int j = 0; j < block; ++j) {
+                        const int32_t v = load_sample<BPS>(p + (size_t) j * BPS);
+                        const double d = v;
+                        s[j] += d;
+                        sq[j] += d * d;
+                        const uint32_t a = v < 0 ? 0U - (uint32_t) v : (uint32_t) v;
+                        m[j] = max(m[j], a);
+                }
+        }
+        for (int j = 0; i < total; ++i, ++j) {
+                const int32_t v = load_sample<BPS>(data + (size_t) i * BPS);
+                s[j] += v;
+                sq[j] += (double) v * v;
+                m[j] = max(m[j], v < 0 ? 0U - (uint32_t) v : (uint32_t) v);
+        }
+
+        const double scale = 1U << (BPS * CHAR_BIT - 1U);
+        for (int ch = 0; ch < ch_count; ++ch) {
+                double ch_sum = 0;
+                double ch_sumsq = 0;
+                uint32_t ch_max = 0;
+                for (int j = ch; j < block; j += ch_count) {
+                        ch_sum += s[j];
+                        ch_sumsq += sq[j];
+                        ch_max = max(ch_max, m[j]);
+                }
+                const double mean = ch_sum / sample_count;
+                const double variance = ch_sumsq / sample_count - mean * mean;
+                rms[ch] = sqrt(max(variance, 0.0)) / scale;
+                peak[ch] = ch_max / scale;
+        }
+}
+
+/**
+ * @brief Calculates mean and peak RMS of all channels in a single pass
+ *
+ * Same values as calculate_rms() for each channel.
+ *
+ * @param[in]  frame   audio frame
+ * @param[out] rms     mean RMS per channel (frame->ch_count items)
+ * @param[out] peak    peak per channel (frame->ch_count items)
+ */
+void calculate_rms_all(const audio_frame *frame, double *rms, double *peak)
+{
+        const int sample_count = frame->data_len / frame->bps / frame->ch_count;
+        if (sample_count == 0) {
+                fill(rms, rms + frame->ch_count, 0.0);
+                fill(peak, peak + frame->ch_count, 0.0);
+                return;
+        }
+        switch (frame->bps) {
+        case 1:
+                return calculate_rms_all_helper<1>(frame->data, frame->ch_count, sample_count, rms, peak);
+        case 2:
+                return calculate_rms_all_helper<2>(frame->data, frame->ch_count, sample_count, rms, peak);
+        case 3:
+                return calculate_rms_all_helper<3>(frame->data, frame->ch_count, sample_count, rms, peak);
+        case 4:
+                return calculate_rms_all_helper<4>(frame->data, frame->ch_count, sample_count, rms, peak);
+        default:
+                LOG(LOG_LEVEL_FATAL) << "Wrong BPS " << frame->bps << "\n";
+                abort();
+        }
+}
+
 bool audio_desc_eq(struct audio_desc a1, struct audio_desc a2) {
         return a1.bps == a2.bps &&
                 a1.sample_rate == a2.sample_rate &&
@@ -262,6 +379,22 @@ int32_t downshift_with_dither(int32_t val, int shift){
 ADD_TO_PARAM(NO_DITHER_PARAM, "* " NO_DITHER_PARAM "\n"
                 "  Disable audio dithering when reducing bit depth\n");
 
+template<int IN_BPS, int OUT_BPS, bool DITHER>
+static void change_bps_tmpl(char *out, const char *in, int samples)
+{
+        for (int i = 0; i < samples; i++) {
+                int32_t val = load_sample<IN_BPS>(in + (ptrdiff_t) i * IN_BPS);
+                if constexpr (IN_BPS < OUT_BPS) {
+                        val = (int32_t) ((uint32_t) val << (OUT_BPS * 8 - IN_BPS * 8));
+                } else if constexpr (DITHER) {
+                        val = downshift_with_dither(val, IN_BPS * 8 - OUT_BPS * 8);
+                } else {
+                        val >>= IN_BPS * 8 - OUT_BPS * 8;
+                }
+                store_sample<OUT_BPS>(out + (ptrdiff_t) i * OUT_BPS, val);
+        }
+}
+
 void change_bps(char *out, int out_bps, const char *in, int in_bps, int in_len /* bytes */) {
         static const bool dither = commandline_params.find(NO_DITHER_PARAM) == commandline_params.end();
         change_bps2(out, out_bps, in, in_bps, in_len, dither);
@@ -277,37 +410,18 @@ void change_bps2(char *out, int out_bps, const char *in, int in_bps, int in_len
                 return;
         }
 
-        if (in_bps < out_bps ) {
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = in_value << (out_bps * 8 - in_bps * 8);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
-                return;
-        }
-
-        // downsampling
-        if (dither) {
-                const int downshift = in_bps * 8 - out_bps * 8;
-                for (int i = 0; i < in_len / in_bps; i++) {
-                        int32_t in_value = format_from_in_bps(in, in_bps);
-                        int32_t out_value = downshift_with_dither(in_value, downshift);
-                        format_to_out_bps(out, out_bps, out_value);
-                        in += in_bps;
-                        out += out_bps;
-                }
-                return;
-        }
-        // no dithering
-        for (int i = 0; i < in_len / in_bps; i++) {
-                int32_t in_value = format_from_in_bps(in, in_bps);
-                int32_t out_value = in_value >> (in_bps * 8 - out_bps * 8);
-                format_to_out_bps(out, out_bps, out_value);
-                in += in_bps;
-                out += out_bps;
-        }
+        const int samples = in_len / in_bps;
+        bps_dispatch(in_bps, [&](auto in_b) {
+                bps_dispatch(out_bps, [&](auto out_b) {
+                        constexpr int IN_BPS = decltype(in_b)::value;
+                        constexpr int OUT_BPS = decltype(out_b)::value;
+                        if (dither && IN_BPS > OUT_BPS) {
+                                change_bps_tmpl<IN_BPS, OUT_BPS, true>(out, in, samples);
+                        } else {
+                                change_bps_tmpl<IN_BPS, OUT_BPS, false>(out, in, samples);
+                        }
+                });
+        });
 }
 
 void copy_channel(char *out, const char *in, int bps, int in_len /* bytes */, int out_channel_count)
@@ -340,93 +454,98 @@ void audio_frame_multiply_channel(struct audio_frame *frame, int new_channel_cou
 
 void demux_channel(char *out, char *in, int bps, int in_len, int in_stream_channels, int pos_in_stream)
 {
-        int samples = in_len / (in_stream_channels * bps);
-        int i;
-
-        assert (bps <= 4);
-
-        in += pos_in_stream * bps;
-
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
-
-                out += bps;
-                in += in_stream_channels * bps;
-
-        }
+        remux_channel(out, in, bps, in_len, in_stream_channels, 1, pos_in_stream, 0);
 }
 
 void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream_channels, int out_stream_channels, int pos_in_stream, int pos_out_stream)
 {
         int samples = in_len / (in_stream_channels * bps);
-        int i;
 
         assert (bps <= 4);
 
         in += pos_in_stream * bps;
         out += pos_out_stream * bps;
 
-        for (i = 0; i < samples; ++i) {
-                memcpy(out, in, bps);
-
-                out += bps * out_stream_channels;
-                in += bps * in_stream_channels;
-
-        }
+        bps_dispatch(bps, [&](auto b) {
+                constexpr int BPS = decltype(b)::value;
+                for (int i = 0; i < samples; ++i) {
+                        memcpy(out + (ptrdiff_t) i * out_stream_channels * BPS, in + (ptrdiff_t) i * in_stream_channels * BPS, BPS);
+                }
+        });
 }
 
 void mux_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
         int samples = in_len / bps;
-        int i;
-        
-        assert (bps <= 4);
 
-        out += pos_in_stream * bps;
+        assert (bps <= 4);
 
         if(scale == 1.0) {
-                for (i = 0; i < samples; ++i) {
-                        memcpy(out, in, bps);
-
-                        in += bps;
-                        out += out_stream_channels * bps;
-
-                }
-        } else {
-                for (i = 0; i < samples; ++i) {
-                        int32_t in_value = format_from_in_bps(in, bps);
-
-                        in_value *= scale;
-
-                        format_to_out_bps(out, bps, in_value);
+                remux_channel(out, in, bps, in_len, 1, out_stream_channels, 0, pos_in_stream);
+                return;
+        }
 
-                        in += bps;
-                        out += out_stream_channels * bps;
+        out += pos_in_stream * bps;
+        bps_dispatch(bps, [&](auto b) {
+                constexpr int BPS = decltype(b)::value;
+                for (int i = 0; i < samples; ++i) {
+                        store_sample<BPS>(out + (ptrdiff_t) i * out_stream_channels * BPS,
+                                        saturate<BPS>(load_sample<BPS>(in + (ptrdiff_t) i * BPS) * scale));
                 }
-        }
+        });
 }
 
 void mux_and_mix_channel(char *out, const char *in, int bps, int in_len, int out_stream_channels, int pos_in_stream, double scale)
 {
-        int i;
-
         assert (bps <= 4);
 
         out += pos_in_stream * bps;
 
-        for(i = 0; i < in_len / bps; i++) {
-                int32_t in_value = format_from_in_bps(in, bps);
-                int32_t out_value = format_from_in_bps(out, bps);
-
-                int32_t new_value = (double)in_value * scale + out_value;
-
-                format_to_out_bps(out, bps, new_value);
+        bps_dispatch(bps, [&](auto b) {
+                constexpr int BPS = decltype(b)::value;
+                for (int i = 0; i < in_len / BPS; i++) {
+                        char *o = out + (ptrdiff_t) i * out_stream_channels * BPS;
+                        store_sample<BPS>(o, saturate<BPS>(load_sample<BPS>(in + (ptrdiff_t) i * BPS) * scale + load_sample<BPS>(o)));
+                }
+        });
+}
 
-                in += bps;
-                out += out_stream_channels * bps;
+template<int BPS>
+static void mix_channels_interleaved_tmpl(char *out, int out_ch_count, const char *const *in, int sample_count,
+                const struct audio_mix_route *routes, int route_count)
+{
+        // float is exact for up to 24 bits
+        using acc_t = conditional_t<BPS == 4, double, float>;
+        thread_local vector<acc_t> acc;
+        acc.resize((size_t) MIX_BLOCK * out_ch_count);
+
+        for (int start = 0; start < sample_count; start += MIX_BLOCK) {
+                const int n = min(MIX_BLOCK, sample_count - start);
+                acc_t *a = acc.data();
+                fill(a, a + n * out_ch_count, 0);
+                for (int r = 0; r < route_count; ++r) {
+                        const char *src = in[routes[r].in_channel] + (ptrdiff_t) start * BPS;
+                        acc_t *dst = a + routes[r].out_channel;
+                        const auto gain = (acc_t) routes[r].gain;
+                        for (int i = 0; i < n; ++i) {
+                                dst[i * out_ch_count] += load_sample<BPS>(src + i * BPS) * gain;
+                        }
+                }
+                char *o = out + (ptrdiff_t) start * out_ch_count * BPS;
+                for (int i = 0; i < n * out_ch_count; ++i) {
+                        store_sample<BPS>(o + (ptrdiff_t) i * BPS, saturate<BPS>(a[i]));
+                }
         }
 }
 
+void mix_channels_interleaved(char *out, int out_ch_count, const char *const *in, int bps, int sample_count,
+                const struct audio_mix_route *routes, int route_count)
+{
+        bps_dispatch(bps, [&](auto b) {
+                mix_channels_interleaved_tmpl<decltype(b)::value>(out, out_ch_count, in, sample_count, routes, route_count);
+        });
+}
+
 template<int BPS>
 static double get_avg_volume_helper(const char *data, int sample_count, int stream_channels, int pos_in_stream)
 {
@@ -470,11 +589,8 @@ void float2int(char *out, const char *in, int len)
         int32_t *outi = (int32_t *)(void *) out;
         int items = len / sizeof(int32_t);
 
-        while(items-- > 0) {
-                float sample = *inf++;
-                if(sample > 1.0) sample = 1.0;
-                if(sample < -1.0) sample = -1.0;
-                *outi++ = sample * INT_MAX_FLT;
+        for (int i = 0; i < items; ++i) {
+                outi[i] = clamp(inf[i], -1.0F, 1.0F) * INT_MAX_FLT;
         }
 }
 
@@ -552,19 +668,8 @@ void format_to_out_bps(char *out, int bps, int32_t out_value) {
 
 void interleaved2noninterleaved(char *out, const char *in, int bps, int in_len, int channel_count)
 {
-        vector<char *> out_ch(channel_count);
         for (int i = 0; i < channel_count; ++i) {
-                out_ch[i] = out + in_len / channel_count * i;
-        }
-
-        int offset = 0;
-        int index = 0;
-        while (offset < in_len) {
-                memcpy(out_ch[index], in, bps);
-                out_ch[index] += bps;
-                index = (index + 1) % channel_count;
-                in += bps;
-                offset += bps;
+                demux_channel(out + in_len / channel_count * i, const_cast<char *>(in), bps, in_len, channel_count, i);
         }
 }
 
@@ -53,6 +53,7 @@
 #ifdef __cplusplus
 double calculate_rms(audio_frame2 *frame, int channel, double *peak);
 double calculate_rms(audio_frame *frame, int channel, double *peak);
+void calculate_rms_all(const audio_frame *frame, double *rms, double *peak);
 void audio_channel_demux(const audio_frame2 *, int, audio_channel*);
 #endif
 
@@ -105,6 +106,24 @@ void remux_channel(char *out, const char *in, int bps, int in_len, int in_stream
 
 void interleaved2noninterleaved(char *out, const char *in, int bps, int in_len /* bytes */, int channel_count);
 
+struct audio_mix_route {
+        int in_channel;
+        int out_channel;
+        double gain;
+};
+
+/**
+ * Mixes non-interleaved channels into an interleaved stream in a single pass
+ * (channel remapping with gain). Output channels without any route are
+ * zeroed, the result is saturated to the bps range.
+ *
+ * @param in           input channels, each with sample_count samples
+ * @param routes       in_channel->out_channel contributions (a channel may
+ *                     occur in multiple routes)
+ */
+void mix_channels_interleaved(char *out, int out_ch_count, const char *const *in, int bps, int sample_count,
+                const struct audio_mix_route *routes, int route_count);
+
 /*
  * Additional function that allosw mixing channels
  *
@@ -42,9 +42,11 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <iomanip>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <utility>
@@ -54,6 +56,7 @@
 #include "host.h"
 #include "DeckLinkAPIVersion.h"
 #include "utils/color_out.h"
+#include "utils/frame_alloc.h"
 #include "utils/macros.h"
 #include "utils/windows.h"
 #include "utils/worker.h"
@@ -898,6 +901,85 @@ const map<BMDVideoConnection, string> &get_connection_string_map() {
         return m;
 }
 
+class bmd_pinnable_allocator : public IDeckLinkMemoryAllocator {
+public:
+        HRESULT STDMETHODCALLTYPE QueryInterface([[maybe_unused]] REFIID iid, LPVOID *ppv) override {
+                *ppv = nullptr;
+                return E_NOINTERFACE;
+        }
+        ULONG STDMETHODCALLTYPE AddRef() override { return ++m_refCount; }
+        ULONG STDMETHODCALLTYPE Release() override {
+                ULONG refCount = --m_refCount;
+                if (refCount == 0) {
+                        delete this;
+                }
+                return refCount;
+        }
+
+        HRESULT STDMETHODCALLTYPE AllocateBuffer(uint32_t bufferSize, void **allocatedBuffer) override {
+                std::lock_guard<std::mutex> lk(m_lock);
+                if (auto it = m_free.lower_bound(bufferSize); it != m_free.end() && it->first <= bufferSize + bufferSize / 8) {
+                        *allocatedBuffer = it->second;
+                        m_free.erase(it);
+                        return S_OK;
+                }
+                *allocatedBuffer = frame_data_alloc_pinnable(bufferSize);
+                if (*allocatedBuffer == nullptr) {
+                        return E_OUTOFMEMORY;
+                }
+                m_size[*allocatedBuffer] = bufferSize;
+                return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE ReleaseBuffer(void *buffer) override {
+                std::lock_guard<std::mutex> lk(m_lock);
+                auto it = m_size.find(buffer);
+                if (it == m_size.end()) {
+                        return E_INVALIDARG;
+                }
+                if (m_committed) {
+                        m_free.emplace(it->second, buffer);
+                } else {
+                        frame_data_free_pinnable(buffer);
+                        m_size.erase(it);
+                }
+                return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE Commit() override {
+                std::lock_guard<std::mutex> lk(m_lock);
+                m_committed = true;
+                return S_OK;
+        }
+        HRESULT STDMETHODCALLTYPE Decommit() override {
+                std::lock_guard<std::mutex> lk(m_lock);
+                m_committed = false;
+                free_unused();
+                return S_OK;
+        }
+
+private:
+        virtual ~bmd_pinnable_allocator() {
+                free_unused();
+        }
+        void free_unused() {
+                for (auto &b : m_free) {
+                        frame_data_free_pinnable(b.second);
+                        m_size.erase(b.second);
+                }
+                m_free.clear();
+        }
+
+        std::atomic<ULONG> m_refCount{1};
+        std::mutex m_lock;
+        bool m_committed = true;
+        map<void *, uint32_t> m_size; ///< all allocated buffers
+        multimap<uint32_t, void *> m_free; ///< buffers available for reuse by size
+};
+
+IDeckLinkMemoryAllocator *bmd_create_pinnable_allocator()
+{
+        return new bmd_pinnable_allocator();
+}
+
 ADD_TO_PARAM(R10K_FULL_OPT, "* " R10K_FULL_OPT "\n"
                 "  Do not do conversion from/to limited range on in/out for R10k on BMD devs.\n");
 
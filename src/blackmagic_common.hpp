@@ -141,6 +141,14 @@ void r10k_limited_to_full(const char *in, char *out, size_t len);
 void r10k_full_to_limited(const char *in, char *out, size_t len);
 void print_bmd_device_profiles(const char *line_prefix);
 const std::map<BMDVideoConnection, std::string> &get_connection_string_map();
+/**
+ * Creates a frame buffer allocator that allocates the buffers with
+ * frame_data_alloc_pinnable() so that they are page-locked when a GPU module
+ * installs the pinning functions (GPU uploads/downloads are then DMA-ed
+ * without a staging copy). Released buffers are kept for reuse until Decommit().
+ * @returns allocator with reference count 1
+ */
+IDeckLinkMemoryAllocator *bmd_create_pinnable_allocator();
 
 std::ostream &operator<<(std::ostream &output, REFIID iid);
 
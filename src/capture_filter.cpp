@@ -41,26 +41,81 @@
 #include "config_win32.h"
 #endif /* HAVE_CONFIG_H */
 
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "capture_filter.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "module.h"
+#include "tv.h"
 #include "utils/color_out.h"
-#include "utils/list.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/synchronized_queue.h"
+#include "utils/thread.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
 #include "video.h"
 
-using namespace std;
+#define MAX_FUSED_FILTERS 16
+#define MOD_NAME "[cap. filter] "
+#define PIPELINE_PARAM "cfilter-pipeline"
 
-struct capture_filter {
-        struct module mod;
-        struct simple_linked_list *filters;
-};
+constexpr int PIPELINE_QUEUE_LEN = 2;
+constexpr time_ns_t STATS_INTERVAL = 5 * NS_IN_SEC;
+
+using namespace std;
 
 struct capture_filter_instance {
+        string name;
         const struct capture_filter_info *functions;
         void *state;
+
+        time_ns_t stats_since = 0;
+        time_ns_t stats_duration = 0;
+        int stats_frames = 0;
+};
+
+struct pipeline_item {
+        struct video_frame *frame;
+        bool writable;
+        bool quit;
+        bool extra; ///< additional frame from capture_filter_info::drain
+};
+
+/// consecutive filters run by a single thread
+struct pipeline_stage {
+        vector<capture_filter_instance *> filters;
+        synchronized_queue<pipeline_item, PIPELINE_QUEUE_LEN> in;
+        thread worker;
+};
+
+struct capture_filter {
+        struct module mod;
+        vector<capture_filter_instance *> filters;
+        video_frame_pool writable_pool; ///< frames handed to in-place filters
+
+        bool pipelined = false;
+        int pipeline_stage_count = 0; ///< requested number of stages (0 - one per filter)
+        vector<unique_ptr<pipeline_stage>> stages;
+        synchronized_queue<pipeline_item, -1> pipeline_out;
+        atomic<int> pipeline_extra{0}; ///< extra frames in pipeline_out
+
+        deque<struct video_frame *> pending; ///< extra frames (non-pipelined)
+        time_ns_t next_release = 0; ///< earliest time to return next frame (if paced)
 };
 
+static void pipeline_stop(struct capture_filter *s);
+
 static int create_filter(struct capture_filter *s, char *cfg)
 {
         bool found = false;
@@ -74,8 +129,8 @@ static int create_filter(struct capture_filter *s, char *cfg)
         for (auto && item : capture_filters) {
                 auto capture_filter_info = static_cast<const struct capture_filter_info*>(item.second);
                 if(strcasecmp(item.first.c_str(), filter_name) == 0) {
-                        struct capture_filter_instance *instance = (struct capture_filter_instance *)
-                                malloc(sizeof(struct capture_filter_instance));
+                        auto *instance = new capture_filter_instance();
+                        instance->name = item.first;
                         instance->functions = capture_filter_info;
                         int ret = capture_filter_info->init(&s->mod, options, &instance->state);
                         if(ret < 0) {
@@ -83,10 +138,10 @@ static int create_filter(struct capture_filter *s, char *cfg)
                                                 filter_name);
                         }
                         if(ret != 0) {
-                                free(instance);
+                                delete instance;
                                 return ret;
                         }
-                        simple_linked_list_append(s->filters, instance);
+                        s->filters.push_back(instance);
                         found = true;
                         break;
                 }
@@ -99,6 +154,15 @@ static int create_filter(struct capture_filter *s, char *cfg)
         return 0;
 }
 
+static void destroy_filter(struct capture_filter_instance *inst)
+{
+        inst->functions->done(inst->state);
+        delete inst;
+}
+
+ADD_TO_PARAM(PIPELINE_PARAM, "* " PIPELINE_PARAM "[=<stages>]\n"
+                "  Run capture filters as a pipeline, each filter (or <stages> groups of\n"
+                "  consecutive filters) in its own thread. Increases latency by a few frames.\n");
 int capture_filter_init(struct module *parent, const char *cfg, struct capture_filter **state)
 {
         if (cfg && (strcasecmp(cfg, "help") == 0 || strcasecmp(cfg, "fullhelp") == 0)) {
@@ -109,16 +173,19 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
                 if (strcasecmp(cfg, "fullhelp") != 0) {
                         printf("(use \"fullhelp\" to show hidden filters)\n");
                 }
+                printf("\nUse \"--param " PIPELINE_PARAM "[=<stages>]\" to run the filters in a pipeline.\n");
                 return 1;
         }
 
-        struct capture_filter *s = (struct capture_filter *) calloc(1, sizeof(struct capture_filter));
+        auto *s = new struct capture_filter();
         char *item, *save_ptr;
-        assert(s);
         char *filter_list_str = NULL,
              *tmp = NULL;
 
-        s->filters = simple_linked_list_init();
+        if (const char *pipeline = get_commandline_param(PIPELINE_PARAM)) {
+                s->pipelined = true;
+                s->pipeline_stage_count = MAX(atoi(pipeline), 0);
+        }
 
         module_init_default(&s->mod);
         s->mod.cls = MODULE_CLASS_FILTER;
@@ -135,7 +202,10 @@ int capture_filter_init(struct module *parent, const char *cfg, struct capture_f
                         if (ret != 0) {
                                 module_done(&s->mod);
                                 free(tmp);
-                                free(s);
+                                for (auto *inst : s->filters) {
+                                        destroy_filter(inst);
+                                }
+                                delete s;
                                 return ret;
                         }
                         filter_list_str = NULL;
@@ -153,40 +223,38 @@ void capture_filter_destroy(struct capture_filter *state)
 {
         struct capture_filter *s = state;
 
-        while(simple_linked_list_size(s->filters) > 0) {
-                struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
-                inst->functions->done(inst->state);
-                free(inst);
-        }
+        pipeline_stop(s);
 
-        simple_linked_list_destroy(s->filters);
+        for (auto *inst : s->filters) {
+                destroy_filter(inst);
+        }
+        for (auto *f : s->pending) {
+                VIDEO_FRAME_DISPOSE(f);
+        }
 
         module_done(&s->mod);
 
-        free(state);
+        delete s;
 }
 
 static struct response *process_message(struct capture_filter *s, struct msg_universal *msg)
 {
         if (strncmp("delete ", msg->text, strlen("delete ")) == 0) {
                 int index = atoi(msg->text + strlen("delete "));
-                struct capture_filter_instance *inst = (struct capture_filter_instance *)
-                        simple_linked_list_remove_index(s->filters, index);
-                if (!inst) {
+                if (index < 0 || index >= (int) s->filters.size()) {
                         fprintf(stderr, "Unable to remove capture filter index %d.\n",
                                         index);
                         return new_response(RESPONSE_INT_SERV_ERR, NULL);
                 } else {
+                        destroy_filter(s->filters[index]);
+                        s->filters.erase(s->filters.begin() + index);
                         printf("Capture filter #%d removed successfully.\n", index);
-                        inst->functions->done(inst->state);
-                        free(inst);
                 }
         } else if (strcmp("flush", msg->text) == 0) {
-                while(simple_linked_list_size(s->filters) > 0) {
-                        struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_pop(s->filters);
-                        inst->functions->done(inst->state);
-                        free(inst);
+                for (auto *inst : s->filters) {
+                        destroy_filter(inst);
                 }
+                s->filters.clear();
         } else if (strcmp("help", msg->text) == 0) {
                 printf("Capture filter control:\n"
                                 "\tflush      - remove all filters\n"
@@ -209,23 +277,291 @@ static struct response *process_message(struct capture_filter *s, struct msg_uni
         return new_response(RESPONSE_OK, NULL);
 }
 
+/**
+ * Copies the frame to a pooled one that can be modified by in-place filters.
+ * Frames coming from capture may be shared (eg. testcard pattern), so the
+ * copy is made once per chain instead of each filter allocating its output.
+ * @returns in if the frame cannot be copied (non-pixel data)
+ */
+static struct video_frame *get_writable_frame(struct capture_filter *s, struct video_frame *in)
+{
+        struct video_frame *out = s->writable_pool.get_disposable_frame(video_desc_from_frame(in));
+        if (vf_is_strided(in)) { // pack the lines
+                for (unsigned int i = 0; i < in->tile_count; ++i) {
+                        const int src_linesize = tile_get_linesize(&in->tiles[i], in->color_spec);
+                        const int dst_linesize = vc_get_linesize(in->tiles[i].width, in->color_spec);
+                        for (unsigned int y = 0; y < in->tiles[i].height; ++y) {
+                                memcpy(out->tiles[i].data + (size_t) y * dst_linesize,
+                                                in->tiles[i].data + (size_t) y * src_linesize, dst_linesize);
+                        }
+                }
+                vf_copy_metadata(out, in);
+                VIDEO_FRAME_DISPOSE(in);
+                return out;
+        }
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                if (in->tiles[i].data_len > out->tiles[i].data_len) {
+                        VIDEO_FRAME_DISPOSE(out);
+                        return in;
+                }
+        }
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                memcpy(out->tiles[i].data, in->tiles[i].data, in->tiles[i].data_len);
+                out->tiles[i].data_len = in->tiles[i].data_len;
+        }
+        vf_copy_metadata(out, in);
+        VIDEO_FRAME_DISPOSE(in);
+        return out;
+}
+
+static bool is_fusable(struct capture_filter_instance *inst, struct video_desc desc)
+{
+        return inst->functions->in_place && inst->functions->fuse_row != nullptr
+                && inst->functions->fuse_prepare(inst->state, desc);
+}
+
+/**
+ * Runs row kernels of the group in a single pass over the frame, rows are
+ * split among worker threads.
+ */
+static void run_fused(struct capture_filter_instance **group, int count, struct video_frame *frame)
+{
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                unsigned char *data = (unsigned char *) frame->tiles[i].data;
+                int linesize = vc_get_linesize(frame->tiles[i].width, frame->color_spec);
+                int height = frame->tiles[i].height;
+                int cpus = get_cpu_core_count();
+                parallel_for(height, std::max(1, height / (4 * cpus)), cpus, [&](int begin, int end) {
+                        for (int y = begin; y < end; ++y) {
+                                for (int j = 0; j < count; ++j) {
+                                        group[j]->functions->fuse_row(group[j]->state, data + (size_t) y * linesize, linesize);
+                                }
+                        }
+                });
+        }
+}
+
+/// accounts filtering time, reported periodically on verbose log level
+static void update_stats(struct capture_filter_instance *inst, time_ns_t duration, bool fused)
+{
+        time_ns_t now = get_time_in_ns();
+        if (inst->stats_since == 0) {
+                inst->stats_since = now;
+        }
+        inst->stats_duration += duration;
+        inst->stats_frames += 1;
+        if (now - inst->stats_since < STATS_INTERVAL) {
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s: %d frames, avg %.3f ms per frame%s\n",
+                        inst->name.c_str(), inst->stats_frames,
+                        inst->stats_duration / 1000000.0 / inst->stats_frames,
+                        fused ? " (fused)" : "");
+        inst->stats_since = now;
+        inst->stats_duration = 0;
+        inst->stats_frames = 0;
+}
+
+/**
+ * Runs filters [begin, end) of the chain
+ * @param[in,out] writable  frame is owned by the chain, see capture_filter_info::in_place
+ * @param[out]    extra     additional frames from capture_filter_info::drain (already passed
+ *                          through the rest of the filters), in output order
+ * @returns NULL if the frame was dropped by a filter
+ */
+static struct video_frame *run_filters(struct capture_filter *s, capture_filter_instance * const *begin,
+                capture_filter_instance * const *end, struct video_frame *frame, bool *writable,
+                vector<pipeline_item> *extra)
+{
+        for (auto *it = begin; it != end; ) {
+                struct capture_filter_instance *inst = *it++;
+                // filters expect contiguous lines (strided frames come eg. from NDI)
+                if ((inst->functions->in_place || vf_is_strided(frame)) && !*writable) {
+                        frame = get_writable_frame(s, frame);
+                        *writable = true;
+                }
+                time_ns_t t0 = get_time_in_ns();
+                if (it != end && is_fusable(inst, video_desc_from_frame(frame))) {
+                        struct capture_filter_instance *group[MAX_FUSED_FILTERS] = { inst };
+                        int count = 1;
+                        while (it != end && count < MAX_FUSED_FILTERS && is_fusable(*it, video_desc_from_frame(frame))) {
+                                group[count++] = *it++;
+                        }
+                        if (count > 1) {
+                                run_fused(group, count, frame);
+                                time_ns_t duration = get_time_in_ns() - t0;
+                                for (int i = 0; i < count; ++i) {
+                                        update_stats(group[i], duration / count, true);
+                                }
+                                continue;
+                        }
+                }
+                struct video_frame *in = frame;
+                frame = inst->functions->filter(inst->state, frame);
+                update_stats(inst, get_time_in_ns() - t0, false);
+                if (inst->functions->drain != nullptr) {
+                        while (struct video_frame *f = inst->functions->drain(inst->state)) {
+                                bool extra_writable = false;
+                                f = run_filters(s, it, end, f, &extra_writable, extra);
+                                if (f != nullptr) {
+                                        extra->push_back({ f, extra_writable, false, true });
+                                }
+                        }
+                }
+                if(!frame) {
+                        return NULL;
+                }
+                // frames created by other filters may share data with the input
+                if (frame != in && !inst->functions->in_place) {
+                        *writable = false;
+                }
+        }
+        return frame;
+}
+
+static void pipeline_worker(struct capture_filter *s, struct pipeline_stage *stage,
+                synchronized_queue<pipeline_item, PIPELINE_QUEUE_LEN> *next)
+{
+        set_thread_name("cap_filter_stage");
+        while (true) {
+                struct pipeline_item item = stage->in.pop();
+                vector<pipeline_item> items;
+                if (!item.quit) {
+                        item.frame = run_filters(s, stage->filters.data(),
+                                        stage->filters.data() + stage->filters.size(),
+                                        item.frame, &item.writable, &items);
+                        if (item.frame != nullptr) {
+                                items.insert(items.begin(), item);
+                        }
+                } else {
+                        items.push_back(item);
+                }
+                for (auto &i : items) {
+                        if (next != nullptr) {
+                                next->push(i);
+                        } else {
+                                s->pipeline_extra += i.extra ? 1 : 0;
+                                s->pipeline_out.push(i);
+                        }
+                }
+                if (item.quit) {
+                        break;
+                }
+        }
+}
+
+/// splits the filters to stages (consecutive groups), each run by own thread
+static void pipeline_start(struct capture_filter *s)
+{
+        int filter_count = s->filters.size();
+        int stage_count = s->pipeline_stage_count == 0 ? filter_count
+                : MIN(s->pipeline_stage_count, filter_count);
+        for (int i = 0; i < stage_count; ++i) {
+                auto stage = make_unique<pipeline_stage>();
+                stage->filters.assign(s->filters.begin() + i * filter_count / stage_count,
+                                s->filters.begin() + (i + 1) * filter_count / stage_count);
+                s->stages.push_back(std::move(stage));
+        }
+        for (int i = 0; i < stage_count; ++i) {
+                auto *next = i + 1 < stage_count ? &s->stages[i + 1]->in : nullptr;
+                s->stages[i]->worker = thread(pipeline_worker, s, s->stages[i].get(), next);
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Running %d filters in %d pipeline stages.\n",
+                        filter_count, stage_count);
+}
+
+/// finishes frames in flight (and drops them) and stops the stage threads
+static void pipeline_stop(struct capture_filter *s)
+{
+        if (s->stages.empty()) {
+                return;
+        }
+        s->stages[0]->in.push({ nullptr, false, true, false });
+        for (auto &stage : s->stages) {
+                stage->worker.join();
+        }
+        s->stages.clear();
+        while (true) {
+                struct pipeline_item item = s->pipeline_out.pop();
+                if (item.quit) {
+                        break;
+                }
+                VIDEO_FRAME_DISPOSE(item.frame);
+        }
+        s->pipeline_extra = 0;
+}
+
+/**
+ * If the chain contains a filter emitting extra frames, spaces the returned
+ * frames at least one frame time (of the output fps) apart, so that the extra
+ * frames don't leave in bursts right after the frame they were created from.
+ */
+static struct video_frame *pace_frame(struct capture_filter *s, struct video_frame *frame)
+{
+        if (frame == nullptr || frame->fps <= 0.0 || none_of(s->filters.begin(), s->filters.end(),
+                                [](capture_filter_instance *inst) { return inst->functions->drain != nullptr; })) {
+                return frame;
+        }
+        time_ns_t now = get_time_in_ns();
+        if (now < s->next_release) {
+                this_thread::sleep_for(chrono::nanoseconds(s->next_release - now));
+                now = s->next_release;
+        }
+        s->next_release = now + (time_ns_t) (NS_IN_SEC_DBL / frame->fps);
+        return frame;
+}
+
+/**
+ * Returns an additional frame produced by a filter emitting more frames than
+ * it receives (see capture_filter_info::drain). May block shortly to space the
+ * frames evenly.
+ * @returns NULL if there is no such frame, the caller should grab a new one
+ */
+struct video_frame *capture_filter_get_pending(struct capture_filter *s)
+{
+        struct video_frame *frame = nullptr;
+        if (s->pipelined) {
+                if (s->pipeline_extra > 0) {
+                        struct pipeline_item item = s->pipeline_out.pop(true);
+                        s->pipeline_extra -= item.extra ? 1 : 0;
+                        frame = item.frame;
+                }
+        } else if (!s->pending.empty()) {
+                frame = s->pending.front();
+                s->pending.pop_front();
+        }
+        return pace_frame(s, frame);
+}
+
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame) {
         struct capture_filter *s = state;
 
         struct message *msg;
         while ((msg = check_message(&s->mod))) {
+                pipeline_stop(s); // restarted with the new chain below
                 struct response *r = process_message(s, (struct msg_universal *) msg);
                 free_message(msg, r);
         }
 
-        for(void *it = simple_linked_list_it_init(s->filters);
-                        it != NULL;
-           ) {
-                struct capture_filter_instance *inst = (struct capture_filter_instance *) simple_linked_list_it_next(&it);
-                frame = inst->functions->filter(inst->state, frame);
-                if(!frame)
-                        return NULL;
+        if (s->pipelined && !s->filters.empty()) {
+                if (s->stages.empty()) {
+                        pipeline_start(s);
+                }
+                s->stages[0]->in.push({ frame, false, false, false });
+                struct pipeline_item out = s->pipeline_out.pop(true);
+                s->pipeline_extra -= out.extra ? 1 : 0;
+                return pace_frame(s, out.frame);
         }
-        return frame;
-}
 
+        bool writable = false;
+        vector<pipeline_item> extra;
+        frame = run_filters(s, s->filters.data(), s->filters.data() + s->filters.size(), frame, &writable, &extra);
+        for (auto &i : extra) {
+                s->pending.push_back(i.frame);
+        }
+        if (frame == nullptr && !s->pending.empty()) {
+                frame = s->pending.front();
+                s->pending.pop_front();
+        }
+        return pace_frame(s, frame);
+}
@@ -38,13 +38,18 @@
 #ifndef CAPTURE_FILTER_H_
 #define CAPTURE_FILTER_H_
 
-#define CAPTURE_FILTER_ABI_VERSION 2
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#define CAPTURE_FILTER_ABI_VERSION 5
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct module;
+struct video_desc;
 
 struct capture_filter_info {
         /// @brief Initializes capture filter
@@ -66,7 +71,30 @@ struct capture_filter_info {
         /// member to manage video_frame lifetime.
         /// This behavior may change towards use of shared_ptr<video_frame>
         /// in future.
+        /// Filters producing a new frame should take it from a per-instance
+        /// video_frame_pool rather than allocating it for every frame.
         struct video_frame *(*filter)(void *state, struct video_frame *f);
+        /// @brief filter may modify the input frame in place and return it
+        /// If set, the chain passes the filter only frames it is allowed to
+        /// write to - the captured frame is copied to a pooled frame once
+        /// for the first in-place filter, subsequent in-place filters then
+        /// don't copy or allocate anything.
+        bool in_place;
+        /// @brief optional (in-place filters only) - checks if frames of desc
+        /// can be processed by fuse_row
+        /// Consecutive filters with a row kernel are fused into a single pass
+        /// over the frame - each row passes all the kernels while it is in
+        /// the cache. Called before each frame, may be NULL.
+        bool (*fuse_prepare)(void *state, struct video_desc desc);
+        /// @brief processes one row in place, keeping the pixel format
+        /// May be called concurrently for different rows.
+        void (*fuse_row)(void *state, unsigned char *row, int linesize);
+        /// @brief optional - returns further output frames for the last input
+        /// For filters emitting more frames than they receive (frame rate
+        /// up-conversion). Called after each filter() until it returns NULL,
+        /// the frames are passed to the rest of the chain and then released
+        /// one per vidcap_grab() evenly spaced according to the frame fps.
+        struct video_frame *(*drain)(void *state);
 };
 
 struct capture_filter;
@@ -79,6 +107,7 @@ struct video_frame;
 int capture_filter_init(struct module *parent, const char *cfg, struct capture_filter **state);
 void capture_filter_destroy(struct capture_filter *state);
 struct video_frame *capture_filter(struct capture_filter *state, struct video_frame *frame);
+struct video_frame *capture_filter_get_pending(struct capture_filter *state);
 
 #ifdef __cplusplus
 }
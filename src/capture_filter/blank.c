@@ -71,6 +71,8 @@ struct state_blank {
 
         struct SwsContext *ctx_downscale,
                           *ctx_upscale;
+        uint8_t *tmp;           ///< downscaled region (pixelization)
+        size_t tmp_len;
 };
 
 static bool parse(struct state_blank *s, char *cfg)
@@ -176,6 +178,7 @@ static void done(void *state)
 
         sws_freeContext(s->ctx_downscale);
         sws_freeContext(s->ctx_upscale);
+        free(s->tmp);
         free(s);
 }
 
@@ -234,7 +237,8 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 width = width / (FACTOR * 3) * (FACTOR * 3);
         }
 
-        if (!video_desc_eq(s->saved_desc,
+        // blanking to black writes just the region, no scaling context needed
+        if (!s->black && !video_desc_eq(s->saved_desc,
                                 video_desc_from_frame(in))) {
 
                 if (av_pixfmt == AV_PIX_FMT_NONE || !sws_isSupportedInput(av_pixfmt) ||
@@ -270,25 +274,27 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 
         int orig_stride = vc_get_linesize(in->tiles[0].width, in->color_spec);
         char *orig = in->tiles[0].data + x * bpp + y * orig_stride;
-        int tmp_stride = vc_get_linesize(width / FACTOR, in->color_spec);
-        size_t tmp_len = tmp_stride * (height / FACTOR);
-        uint8_t *tmp = (uint8_t *) malloc(tmp_len);
-        if (s->black) {
-                if (codec == UYVY) {
-                        unsigned char pattern[] = { 127, 0 };
 
-                        for (size_t i = 0; i < tmp_len; i += get_bpp(codec)) {
-                                memcpy(tmp + i, pattern, get_bpp(codec));
+        if (s->black) {
+                size_t linesize = vc_get_linesize(width, codec);
+                if (!clear_video_buffer((unsigned char *) orig, linesize, orig_stride, height, codec)) {
+                        for (int i = 0; i < height; ++i) {
+                                memset(orig + (size_t) i * orig_stride, 0, linesize);
                         }
-                } else {
-                        memset(tmp, 0, tmp_len);
                 }
-        } else {
-                sws_scale(s->ctx_downscale, (const uint8_t * const *) &orig, &orig_stride, 0, height, &tmp, &tmp_stride);
+                return in;
         }
-        sws_scale(s->ctx_upscale, (const uint8_t * const *) &tmp, &tmp_stride, 0, height / FACTOR, (uint8_t **) &orig, &orig_stride);
 
-        free(tmp);
+        int tmp_stride = vc_get_linesize(width / FACTOR, in->color_spec);
+        size_t tmp_len = tmp_stride * (height / FACTOR);
+        if (s->tmp_len < tmp_len) {
+                free(s->tmp);
+                s->tmp = (uint8_t *) malloc(tmp_len);
+                s->tmp_len = tmp_len;
+        }
+        uint8_t *tmp = s->tmp;
+        sws_scale(s->ctx_downscale, (const uint8_t * const *) &orig, &orig_stride, 0, height, &tmp, &tmp_stride);
+        sws_scale(s->ctx_upscale, (const uint8_t * const *) &tmp, &tmp_stride, 0, height / FACTOR, (uint8_t **) &orig, &orig_stride);
 
         return in;
 }
@@ -297,6 +303,7 @@ static const struct capture_filter_info capture_filter_blank = {
         .init = init,
         .done = done,
         .filter = filter,
+        .in_place = true,
 };
 
 REGISTER_MODULE(blank, &capture_filter_blank, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
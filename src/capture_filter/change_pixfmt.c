@@ -45,6 +45,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -54,6 +55,7 @@
 struct state_capture_filter_change_pixfmt {
         codec_t to_codec;
         void *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        void *pool; ///< output frames (if not using vo_pp_out_buffer)
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -74,6 +76,7 @@ static int init(struct module *parent, const char *cfg, void **state)
                 free(s);
                 return -1;
         }
+        s->pool = video_frame_pool_init((struct video_desc) { 0 }, 0);
 
         *state = s;
         return 0;
@@ -81,7 +84,9 @@ static int init(struct module *parent, const char *cfg, void **state)
 
 static void done(void *state)
 {
-        free(state);
+        struct state_capture_filter_change_pixfmt *s = state;
+        video_frame_pool_destroy(s->pool);
+        free(s);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -95,14 +100,15 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to find decoder!\n");
                 return NULL;
         }
-        struct video_frame *out = vf_alloc_desc(desc);
+        struct video_frame *out = NULL;
         if (s->vo_pp_out_buffer) {
+                out = vf_alloc_desc(desc);
                 out->tiles[0].data = s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
         } else {
-                out->tiles[0].data = malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                out = video_frame_pool_get_disposable_frame_desc(s->pool, desc);
+                vf_copy_metadata(out, in);
         }
-        out->callbacks.dispose = vf_free;
 
         unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
@@ -55,6 +55,8 @@ static struct video_frame *filter(void *state, struct video_frame *in);
 
 struct state_flip {
         char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        unsigned char *line_buf;
+        int line_buf_len;
 };
 
 static int init(struct module *parent, const char *cfg, void **state)
@@ -70,25 +72,41 @@ static int init(struct module *parent, const char *cfg, void **state)
 
 static void done(void *state)
 {
-        free(state);
+        struct state_flip *s = state;
+        free(s->line_buf);
+        free(s);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_flip *s = state;
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = (char *) (malloc(out->tiles[0].data_len));
-                out->callbacks.data_deleter = vf_data_deleter;
+        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
+
+        if (!s->vo_pp_out_buffer) { // in-place
+                if (s->line_buf_len < linesize) {
+                        free(s->line_buf);
+                        s->line_buf = malloc(linesize);
+                        s->line_buf_len = linesize;
+                }
+                unsigned char *top = in_data;
+                unsigned char *bottom = in_data + (in->tiles[0].height - 1) * linesize;
+                while (top < bottom) {
+                        memcpy(s->line_buf, top, linesize);
+                        memcpy(top, bottom, linesize);
+                        memcpy(bottom, s->line_buf, linesize);
+                        top += linesize;
+                        bottom -= linesize;
+                }
+                return in;
         }
+
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        out->tiles[0].data = s->vo_pp_out_buffer;
         out->callbacks.dispose = vf_free;
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
 
-        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
         for (unsigned int y = 0; y < in->tiles[0].height; ++y) {
                 memcpy(out_data + (in->tiles[0].height - y - 1) * linesize, in_data + y * linesize, linesize);
         }
@@ -108,6 +126,7 @@ static const struct capture_filter_info capture_filter_flip = {
         .init = init,
         .done = done,
         .filter = filter,
+        .in_place = true,
 };
 
 REGISTER_MODULE(flip, &capture_filter_flip, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
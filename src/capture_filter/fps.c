@@ -0,0 +1,362 @@
+/**
+ * @file   capture_filter/fps.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  frame rate conversion
+ *
+ * Converts the frame rate either by dropping/duplicating frames (the input
+ * frame nearest to the output frame time is used) or by blending the two
+ * neighbouring input frames. Frames that the blend mode emits more than it
+ * receives are returned through capture_filter_info::drain and the capture
+ * filter chain spaces them evenly.
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_filter.h"
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[fps] "
+#define MAX_OUT_FRAMES 8 ///< max output frames per one input frame
+#define BLEND_BLOCK 16384 ///< bytes processed by one parallel task item
+
+struct module;
+
+enum fps_mode {
+        FPS_DROP,  ///< nearest frame (drop or duplicate)
+        FPS_BLEND, ///< blend of the neighbouring frames
+};
+
+struct state_fps {
+        double fps;
+        enum fps_mode mode;
+        void *pool;
+
+        struct video_desc saved_desc;
+        long long in_count;  ///< input frames since reconfiguration
+        long long out_count; ///< output frames since reconfiguration
+        struct video_frame *prev; ///< copy of the previous input frame (blend)
+
+        struct video_frame *out[MAX_OUT_FRAMES]; ///< output frames of the current input
+        int out_len;
+        int out_pos;
+};
+
+static void usage(void)
+{
+        color_printf("Filter " TBOLD("fps") " converts frame rate of the video, eg. 50p to 60p.\n"
+                     "Unlike " TBOLD("every") " and " TBOLD("ratelimit") " it can also increase it.\n\n");
+        printf("fps usage:\n\n");
+        color_printf(TBOLD("\t--capture-filter fps:<fps>[/<den>][:blend]") " -t <capture>\n\n");
+        color_printf("\t" TBOLD("<fps>[/<den>]") " - output frame rate, eg. 60 or 60000/1001\n");
+        color_printf("\t" TBOLD("blend") "         - blend neighbouring frames (8 and 16-bit formats),\n"
+                     "\t                otherwise nearest frames are dropped or duplicated\n\n");
+}
+
+static int init(struct module *parent, const char *cfg, void **state)
+{
+        UNUSED(parent);
+
+        if (strlen(cfg) == 0 || strcasecmp(cfg, "help") == 0) {
+                usage();
+                return strlen(cfg) == 0 ? -1 : 1;
+        }
+
+        char *endptr = NULL;
+        double fps = strtod(cfg, &endptr);
+        if (*endptr == '/') {
+                fps /= strtod(endptr + 1, &endptr);
+        }
+        if (!isfinite(fps) || fps <= 0.0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong frame rate: %s\n", cfg);
+                return -1;
+        }
+        enum fps_mode mode = FPS_DROP;
+        if (*endptr == ':') {
+                if (strcasecmp(endptr + 1, "blend") == 0) {
+                        mode = FPS_BLEND;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", endptr + 1);
+                        return -1;
+                }
+        } else if (*endptr != '\0') {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong frame rate: %s\n", cfg);
+                return -1;
+        }
+
+        struct state_fps *s = calloc(1, sizeof *s);
+        s->fps = fps;
+        s->mode = mode;
+        s->pool = video_frame_pool_init((struct video_desc) { 0 }, 0);
+        *state = s;
+        return 0;
+}
+
+static void done(void *state)
+{
+        struct state_fps *s = state;
+        for (int i = s->out_pos; i < s->out_len; ++i) {
+                VIDEO_FRAME_DISPOSE(s->out[i]);
+        }
+        vf_free(s->prev);
+        video_frame_pool_destroy(s->pool);
+        free(s);
+}
+
+static void dispose_view(struct video_frame *f) {
+        VIDEO_FRAME_DISPOSE((struct video_frame *) f->callbacks.dispose_udata);
+        vf_free(f);
+}
+
+/// @returns frame sharing data with @p in (which is disposed together with it)
+static struct video_frame *get_view(struct video_frame *in, double fps)
+{
+        struct video_frame *frame = vf_alloc_desc(video_desc_from_frame(in));
+        memcpy(frame->tiles, in->tiles, in->tile_count * sizeof(struct tile));
+        vf_copy_metadata(frame, in);
+        frame->fps = fps;
+        frame->callbacks.dispose = dispose_view;
+        frame->callbacks.dispose_udata = in;
+        return frame;
+}
+
+static struct video_frame *get_copy(struct state_fps *s, const struct video_frame *in)
+{
+        struct video_frame *frame = video_frame_pool_get_disposable_frame_desc(s->pool, s->saved_desc);
+        vf_copy_metadata(frame, in);
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                memcpy(frame->tiles[i].data, in->tiles[i].data, in->tiles[i].data_len);
+                frame->tiles[i].data_len = in->tiles[i].data_len;
+        }
+        frame->fps = s->fps;
+        return frame;
+}
+
+struct blend_data {
+        const unsigned char *a;
+        const unsigned char *b;
+        unsigned char *out;
+        size_t len;
+        unsigned weight; ///< weight of b in 1/256
+        bool wide;       ///< 16-bit samples
+};
+
+static void blend_task(void *udata, int begin, int end)
+{
+        const struct blend_data *d = udata;
+        const size_t start = (size_t) begin * BLEND_BLOCK;
+        const size_t stop = MIN((size_t) end * BLEND_BLOCK, d->len);
+        const int w = d->weight;
+        if (d->wide) {
+                const uint16_t *a = (const uint16_t *)(const void *) (d->a + start);
+                const uint16_t *b = (const uint16_t *)(const void *) (d->b + start);
+                uint16_t *out = (uint16_t *)(void *) (d->out + start);
+                for (size_t i = 0; i < (stop - start) / 2; ++i) {
+                        out[i] = a[i] + (((int32_t) b[i] - a[i]) * w + 128) / 256;
+                }
+                return;
+        }
+        const unsigned char *a = d->a + start;
+        const unsigned char *b = d->b + start;
+        unsigned char *out = d->out + start;
+        for (size_t i = 0; i < stop - start; ++i) {
+                out[i] = a[i] + (((int) b[i] - a[i]) * w + 128) / 256;
+        }
+}
+
+/// @param weight weight of @p b in 1/256 (1..255)
+static struct video_frame *get_blend(struct state_fps *s, const struct video_frame *a, const struct video_frame *b,
+                unsigned weight)
+{
+        struct video_frame *frame = video_frame_pool_get_disposable_frame_desc(s->pool, s->saved_desc);
+        vf_copy_metadata(frame, b);
+        frame->fps = s->fps;
+        for (unsigned i = 0; i < b->tile_count; ++i) {
+                struct blend_data d = { (const unsigned char *) a->tiles[i].data,
+                        (const unsigned char *) b->tiles[i].data, (unsigned char *) frame->tiles[i].data,
+                        b->tiles[i].data_len, weight, get_bits_per_component(b->color_spec) == 16 };
+                int blocks = (d.len + BLEND_BLOCK - 1) / BLEND_BLOCK;
+                int cpus = get_cpu_core_count();
+                task_run_parallel_range(blend_task, &d, blocks, MAX(1, blocks / (4 * cpus)), cpus);
+                frame->tiles[i].data_len = b->tiles[i].data_len;
+        }
+        return frame;
+}
+
+static bool blend_supported(codec_t codec)
+{
+        int bits = get_bits_per_component(codec);
+        return !is_codec_opaque(codec) && (bits == 8 || bits == 16);
+}
+
+static void reconfigure(struct state_fps *s, struct video_frame *in)
+{
+        s->saved_desc = video_desc_from_frame(in);
+        s->in_count = s->out_count = 0;
+        vf_free(s->prev);
+        s->prev = NULL;
+        if (s->mode == FPS_BLEND) {
+                if (blend_supported(in->color_spec)) {
+                        s->prev = vf_alloc_desc_data(s->saved_desc);
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot blend %s, dropping/duplicating frames instead.\n",
+                                        get_codec_name(in->color_spec));
+                }
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Converting %.2f fps to %.2f fps.\n", in->fps, s->fps);
+}
+
+/// output frame times are in input frame units
+static double out_time(const struct state_fps *s, long long k)
+{
+        return (double) k * s->saved_desc.fps / s->fps;
+}
+
+/// drop/duplicate - input j is the nearest one for outputs in [j - 0.5, j + 0.5)
+static void convert_nearest(struct state_fps *s, struct video_frame *in)
+{
+        const double j = s->in_count;
+        for ( ; out_time(s, s->out_count) < j + 0.5; s->out_count++) {
+                if (s->out_len == MAX_OUT_FRAMES) {
+                        continue;
+                }
+                s->out[s->out_len] = s->out_len == 0 ? get_view(in, s->fps) : get_copy(s, in);
+                s->out_len += 1;
+        }
+        if (s->out_len == 0) {
+                VIDEO_FRAME_DISPOSE(in);
+        }
+}
+
+/// blend - input j is the later neighbour of outputs in (j - 1, j]
+static void convert_blend(struct state_fps *s, struct video_frame *in)
+{
+        const double j = s->in_count;
+        bool in_used = false;
+        for ( ; out_time(s, s->out_count) <= j + 1e-6; s->out_count++) {
+                if (s->out_len == MAX_OUT_FRAMES) {
+                        continue;
+                }
+                int weight = s->in_count == 0 ? 256
+                        : (int) lround((out_time(s, s->out_count) - (j - 1)) * 256);
+                struct video_frame *frame = NULL;
+                if (weight >= 256) {
+                        frame = get_view(in, s->fps);
+                        in_used = true;
+                } else if (weight <= 0) {
+                        frame = get_copy(s, s->prev);
+                } else {
+                        frame = get_blend(s, s->prev, in, weight);
+                }
+                s->out[s->out_len++] = frame;
+        }
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                memcpy(s->prev->tiles[i].data, in->tiles[i].data, in->tiles[i].data_len);
+        }
+        vf_copy_metadata(s->prev, in);
+        if (!in_used) {
+                VIDEO_FRAME_DISPOSE(in);
+        }
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        struct state_fps *s = state;
+
+        if (!video_desc_eq(s->saved_desc, video_desc_from_frame(in))) {
+                reconfigure(s, in);
+        }
+        if (s->saved_desc.fps <= 0.0) {
+                return in;
+        }
+
+        for (int i = s->out_pos; i < s->out_len; ++i) { // not drained
+                VIDEO_FRAME_DISPOSE(s->out[i]);
+        }
+        s->out_len = s->out_pos = 0;
+
+        if (s->prev != NULL) {
+                convert_blend(s, in);
+        } else {
+                convert_nearest(s, in);
+        }
+        s->in_count += 1;
+        if (s->out_len == MAX_OUT_FRAMES) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('c', 'f', 'f', 'p'), MOD_NAME
+                                "Too high frame rate ratio, up to %d frames per input frame are produced.\n",
+                                MAX_OUT_FRAMES);
+        }
+
+        if (s->out_len == 0) {
+                return NULL;
+        }
+        s->out_pos = 1;
+        return s->out[0];
+}
+
+static struct video_frame *drain(void *state)
+{
+        struct state_fps *s = state;
+        if (s->out_pos == s->out_len) {
+                return NULL;
+        }
+        return s->out[s->out_pos++];
+}
+
+static const struct capture_filter_info capture_filter_fps = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+        .drain = drain,
+};
+
+REGISTER_MODULE(fps, &capture_filter_fps, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -51,6 +51,7 @@
 #include "lib_common.h"
 #include "rang.hpp"
 #include "utils/color_out.h"
+#include "utils/video_frame_pool.h"
 #include "utils/worker.h"
 #include "video.h"
 #include "video_codec.h"
@@ -69,6 +70,8 @@ struct state_capture_filter_gamma {
 public:
         int out_depth; ///< 0, 8 or 16 (0 menas keep)
         void *vo_pp_out_buffer{}; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+        video_frame_pool pool; ///< output frames if bit depth changes
+        int fuse_depth{}; ///< bit depth of frames processed by fuse_row()
 
         explicit state_capture_filter_gamma(double gamma, int out_depth) : out_depth(out_depth) {
                 for (int i = 0; i <= numeric_limits<uint8_t>::max(); ++i) { // 8->8
@@ -93,7 +96,7 @@ public:
                 }
         }
 
-        void apply_gamma(int in_depth, int out_depth, size_t in_len, void const * __restrict in, void * __restrict out) {
+        void apply_gamma(int in_depth, int out_depth, size_t in_len, void const *in, void *out) { // in may equal out
                 if (in_depth == CHAR_BIT && out_depth == CHAR_BIT) {
                         apply_lut<uint8_t, uint8_t>(in_len, lut8, in, out);
                 } else if (in_depth == 2 * CHAR_BIT && out_depth == 2 * CHAR_BIT) {
@@ -107,6 +110,21 @@ public:
                 }
         }
 
+        /// single-threaded in-place variant used by fused filter chain
+        void apply_gamma_row(int depth, size_t len, void *data) {
+                if (depth == CHAR_BIT) {
+                        auto *p = static_cast<uint8_t *>(data);
+                        for (size_t i = 0; i < len; ++i) {
+                                p[i] = lut8[p[i]];
+                        }
+                } else {
+                        auto *p = static_cast<uint16_t *>(data);
+                        for (size_t i = 0; i < len / sizeof(uint16_t); ++i) {
+                                p[i] = lut16[p[i]];
+                        }
+                }
+        }
+
 private:
         template<typename inT, typename outT>
         struct data {
@@ -205,28 +223,55 @@ static auto filter(void *state, struct video_frame *in) -> video_frame *
         if (s->out_depth != 0) {
                 out_desc.color_spec = s->out_depth == 8 ? RGB : RG48;
         }
-        struct video_frame *out = vf_alloc_desc(out_desc);
+        struct video_frame *out = nullptr;
         if (s->vo_pp_out_buffer != nullptr) {
+                out = vf_alloc_desc(out_desc);
                 out->tiles[0].data = (char *) s->vo_pp_out_buffer;
+                out->callbacks.dispose = vf_free;
+        } else if (out_desc.color_spec == in->color_spec) { // in-place
+                out = in;
         } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+                out = s->pool.get_disposable_frame(out_desc);
+                vf_copy_metadata(out, in);
         }
-        out->callbacks.dispose = vf_free;
 
         try {
                 s->apply_gamma(get_bits_per_component(in->color_spec), get_bits_per_component(out_desc.color_spec), in->tiles[0].data_len, in->tiles[0].data, out->tiles[0].data);
         } catch(...) {
                 LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Only 8-bit and 16-bit codecs are currently supported!\n";
-                vf_free(out);
+                if (out != in) {
+                        VIDEO_FRAME_DISPOSE(out);
+                }
                 out = nullptr;
         }
 
-        VIDEO_FRAME_DISPOSE(in);
+        if (out != in) {
+                VIDEO_FRAME_DISPOSE(in);
+        }
 
         return out;
 }
 
+static auto fuse_prepare(void *state, struct video_desc desc) -> bool
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        if (desc.color_spec != RGB && desc.color_spec != RG48) {
+                return false;
+        }
+        int depth = get_bits_per_component(desc.color_spec);
+        if (s->out_depth != 0 && s->out_depth != depth) {
+                return false;
+        }
+        s->fuse_depth = depth;
+        return true;
+}
+
+static void fuse_row(void *state, unsigned char *row, int linesize)
+{
+        auto *s = static_cast<state_capture_filter_gamma *>(state);
+        s->apply_gamma_row(s->fuse_depth, linesize, row);
+}
+
 static void vo_pp_set_out_buffer(void *state, char *buffer)
 {
         auto *s = (state_capture_filter_gamma *) state;
@@ -237,6 +282,9 @@ static const struct capture_filter_info capture_filter_gamma = {
         .init = init,
         .done = done,
         .filter = filter,
+        .in_place = true,
+        .fuse_prepare = fuse_prepare,
+        .fuse_row = fuse_row,
 };
 
 REGISTER_MODULE(gamma, &capture_filter_gamma, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -73,6 +73,21 @@ static void done(void *state)
         free(state);
 }
 
+static bool fuse_prepare(void *state, struct video_desc desc)
+{
+        UNUSED(state);
+        return desc.color_spec == UYVY;
+}
+
+/// resets chroma of UYVY line
+static void fuse_row(void *state, unsigned char *row, int linesize)
+{
+        UNUSED(state);
+        for (int i = 0; i < linesize; i += 2) {
+                row[i] = 127;
+        }
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_grayscale *s = state;
@@ -81,16 +96,17 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 log_msg(LOG_LEVEL_WARNING, "Cannot create grayscale from other codec than UYVY!\n");
                 return in;
         }
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
+
+        if (!s->vo_pp_out_buffer) { // in-place
+                fuse_row(s, in_data, in->tiles[0].width * in->tiles[0].height * 2);
+                return in;
         }
+
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        out->tiles[0].data = s->vo_pp_out_buffer;
         out->callbacks.dispose = vf_free;
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
 
         for (unsigned int i = 0; i < in->tiles[0].width * in->tiles[0].height; ++i) {
@@ -115,6 +131,9 @@ static const struct capture_filter_info capture_filter_grayscale = {
         .init = init,
         .done = done,
         .filter = filter,
+        .in_place = true,
+        .fuse_prepare = fuse_prepare,
+        .fuse_row = fuse_row,
 };
 
 REGISTER_MODULE(grayscale, &capture_filter_grayscale, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -0,0 +1,167 @@
+/**
+ * @file   capture_filter/latency_probe.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  embeds or extracts capture time for end-to-end latency measurement
+ *
+ * latency_probe_embed stamps the current time to the frames of any capture
+ * device, latency_probe reads the time back from frames captured eg. by a
+ * capture card connected to the receiver display output and reports the
+ * glass-to-glass latency to the control socket.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <cstring>
+#include <iostream>
+
+#include "capture_filter.h"
+#include "debug.h"
+#include "lib_common.h"
+#include "module.h"
+#include "rang.hpp"
+#include "utils/latency_histogram.hpp"
+#include "utils/latency_probe.h"
+#include "video.h"
+#include "video_codec.h"
+
+constexpr const char *MOD_NAME = "[latency_probe] ";
+
+using rang::style;
+using std::cout;
+
+struct state_latency_probe {
+        explicit state_latency_probe(struct control_state *c) : control(c) {}
+        struct control_state *control;
+        latency_histogram glass_latency{"CAPTURE_LATENCY", "glass"}; ///< embedded capture time to this capture
+        bool warned = false;
+};
+
+static auto init_extract(struct module *parent, const char *cfg, void **state) -> int
+{
+        if (strlen(cfg) > 0) {
+                cout << "Reads the capture time embedded in the picture (by " << style::bold << "testcard:probe" << style::reset
+                        << " or capture filter " << style::bold << "latency_probe_embed" << style::reset << ")\n"
+                        "and reports the glass-to-glass latency (CAPTURE_LATENCY glass) to the control socket.\n"
+                        "Intended for a capture card looped from the receiver display output.\n\n"
+                        "usage:\n";
+                cout << style::bold << "\t--capture-filter latency_probe\n" << style::reset;
+                return strcmp(cfg, "help") == 0 ? 1 : -1;
+        }
+        auto *control = (struct control_state *) get_module(get_root_module(parent), "control");
+        *state = new state_latency_probe(control);
+        return 0;
+}
+
+static auto init_embed(struct module *parent, const char *cfg, void **state) -> int
+{
+        UNUSED(parent);
+        if (strlen(cfg) > 0) {
+                cout << "Embeds the capture time to the top-left corner of the picture for end-to-end latency\n"
+                        "measurement, see " << style::bold << "--param decoder-latency-probe" << style::reset
+                        << " and capture filter " << style::bold << "latency_probe" << style::reset << ".\n\n"
+                        "usage:\n";
+                cout << style::bold << "\t--capture-filter latency_probe_embed\n" << style::reset;
+                return strcmp(cfg, "help") == 0 ? 1 : -1;
+        }
+        *state = new state_latency_probe(nullptr);
+        return 0;
+}
+
+static void done(void *state)
+{
+        delete static_cast<state_latency_probe *>(state);
+}
+
+static void warn_unsupported(state_latency_probe *s, const struct video_frame *in)
+{
+        if (!s->warned) {
+                LOG(LOG_LEVEL_WARNING) << MOD_NAME << "Latency probe not supported for " << get_codec_name(in->color_spec)
+                        << " " << in->tiles[0].width << "x" << in->tiles[0].height << "!\n";
+                s->warned = true;
+        }
+}
+
+static auto filter_extract(void *state, struct video_frame *in) -> video_frame *
+{
+        auto *s = static_cast<state_latency_probe *>(state);
+        if (!latency_probe_supported(in->color_spec, in->tiles[0].width, in->tiles[0].height)) {
+                warn_unsupported(s, in);
+                return in;
+        }
+        time_ns_t capture_time = 0;
+        if (latency_probe_extract(in->color_spec, in->tiles[0].width, in->tiles[0].height, in->tiles[0].data, &capture_time)) {
+                s->glass_latency.add(get_time_in_ns() - capture_time);
+                s->glass_latency.report(s->control);
+        }
+        return in;
+}
+
+static auto filter_embed(void *state, struct video_frame *in) -> video_frame *
+{
+        auto *s = static_cast<state_latency_probe *>(state);
+        if (!latency_probe_embed(in->color_spec, in->tiles[0].width, in->tiles[0].height, in->tiles[0].data, get_time_in_ns())) {
+                warn_unsupported(s, in);
+        }
+        return in;
+}
+
+static const struct capture_filter_info capture_filter_latency_probe = {
+        .init = init_extract,
+        .done = done,
+        .filter = filter_extract,
+        .in_place = false,
+        .fuse_prepare = nullptr,
+        .fuse_row = nullptr,
+        .drain = nullptr,
+};
+
+static const struct capture_filter_info capture_filter_latency_probe_embed = {
+        .init = init_embed,
+        .done = done,
+        .filter = filter_embed,
+        .in_place = true,
+        .fuse_prepare = nullptr,
+        .fuse_row = nullptr,
+        .drain = nullptr,
+};
+
+REGISTER_MODULE(latency_probe, &capture_filter_latency_probe, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+REGISTER_MODULE(latency_probe_embed, &capture_filter_latency_probe_embed, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+
+/* vim: set expandtab sw=8: */
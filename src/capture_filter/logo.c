@@ -46,6 +46,7 @@
 #include "lib_common.h"
 #include "utils/macros.h"
 #include "utils/pam.h"
+#include "utils/video_overlay.h"
 #include "video.h"
 #include "video_codec.h"
 
@@ -57,6 +58,11 @@ struct state_capture_filter_logo {
         unsigned int height;
         int x;
         int y;
+
+        struct video_overlay *overlay; ///< logo converted to overlay_codec
+        codec_t overlay_codec;
+        unsigned char *segment;        ///< RGB scratch for other codecs
+        size_t segment_len;
 };
 
 static int init(struct module *parent, const char *cfg, void **state);
@@ -146,6 +152,8 @@ static void done(void *state)
 {
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
+        video_overlay_destroy(s->overlay);
+        free(s->segment);
         free(s->logo);
         free(s);
 }
@@ -154,15 +162,8 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_capture_filter_logo *s = (struct state_capture_filter_logo *)
                 state;
-        decoder_t decoder, coder;
-        decoder = get_decoder_from_to(in->color_spec, RGB);
-        coder = get_decoder_from_to(RGB, in->color_spec);
         int rect_x = s->x;
         int rect_y = s->y;
-        assert(coder != NULL && decoder != NULL);
-
-        if (decoder == NULL || coder == NULL)
-                return in;
 
         if (rect_x < 0 || rect_x + s->width > in->tiles[0].width) {
                 rect_x = in->tiles[0].width - s->width;
@@ -177,11 +178,35 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         if (rect_x < 0 || rect_y < 0)
                 return in;
 
+        if (video_overlay_supports(in->color_spec)) {
+                if (s->overlay == NULL || s->overlay_codec != in->color_spec) {
+                        video_overlay_destroy(s->overlay);
+                        s->overlay = video_overlay_create(s->logo, s->width, s->height, in->color_spec);
+                        s->overlay_codec = in->color_spec;
+                }
+                video_overlay_blend(s->overlay, in->tiles[0].data,
+                                vc_get_linesize(in->tiles[0].width, in->color_spec),
+                                in->tiles[0].width, in->tiles[0].height, rect_x, rect_y);
+                return in;
+        }
+
+        decoder_t decoder = get_decoder_from_to(in->color_spec, RGB);
+        decoder_t coder = get_decoder_from_to(RGB, in->color_spec);
+        assert(coder != NULL && decoder != NULL);
+
+        if (decoder == NULL || coder == NULL)
+                return in;
+
         int dec_width = s->width;
         dec_width = (dec_width  + 1) / get_pf_block_bytes(in->color_spec) * get_pf_block_bytes(in->color_spec);
         int linesize = dec_width * 3;
 
-        unsigned char *segment = (unsigned char *) malloc(linesize * s->height);
+        if (s->segment_len < (size_t) linesize * s->height) {
+                free(s->segment);
+                s->segment_len = (size_t) linesize * s->height;
+                s->segment = malloc(s->segment_len);
+        }
+        unsigned char *segment = s->segment;
 
         for (unsigned int y = 0; y < s->height; ++y) {
                 decoder(segment + y * linesize, (unsigned char *) in->tiles[0].data + (y + rect_y) *
@@ -211,8 +236,6 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                                 vc_get_linesize(s->width, in->color_spec), 0, 8, 16);
         }
 
-        free(segment);
-
         return in;
 }
 
@@ -220,6 +243,9 @@ static const struct capture_filter_info capture_filter_logo = {
         init,
         done,
         filter,
+        true,
+        NULL,
+        NULL,
 };
 
 REGISTER_MODULE(logo, &capture_filter_logo, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
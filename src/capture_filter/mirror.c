@@ -92,6 +92,37 @@ static void mirror_line_UYVY(unsigned char *dst, const unsigned char *src, int l
         }
 }
 
+static void mirror_line_UYVY_in_place(unsigned char *line, int linesize)
+{
+        unsigned char *first = line;
+        unsigned char *last = line + (linesize / 4 - 1) * 4;
+        while (first <= last) {
+                unsigned char a[4];
+                unsigned char b[4];
+                memcpy(a, first, 4);
+                memcpy(b, last, 4);
+                // swap macropixels and the luma samples within them
+                unsigned char a_m[4] = { a[0], a[3], a[2], a[1] };
+                unsigned char b_m[4] = { b[0], b[3], b[2], b[1] };
+                memcpy(first, b_m, 4);
+                memcpy(last, a_m, 4);
+                first += 4;
+                last -= 4;
+        }
+}
+
+static bool fuse_prepare(void *state, struct video_desc desc)
+{
+        UNUSED(state);
+        return desc.color_spec == UYVY;
+}
+
+static void fuse_row(void *state, unsigned char *row, int linesize)
+{
+        UNUSED(state);
+        mirror_line_UYVY_in_place(row, linesize);
+}
+
 static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_mirror *s = state;
@@ -101,19 +132,22 @@ static struct video_frame *filter(void *state, struct video_frame *in)
                 return in;
         }
 
-        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
-        if (s->vo_pp_out_buffer) {
-                out->tiles[0].data = s->vo_pp_out_buffer;
-        } else {
-                out->tiles[0].data = (char *) malloc(out->tiles[0].data_len);
-                out->callbacks.data_deleter = vf_data_deleter;
+        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
+        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+
+        if (!s->vo_pp_out_buffer) { // in-place
+                for (unsigned int y = 0; y < in->tiles[0].height; ++y) {
+                        mirror_line_UYVY_in_place(in_data + y * linesize, linesize);
+                }
+                return in;
         }
+
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in));
+        out->tiles[0].data = s->vo_pp_out_buffer;
         out->callbacks.dispose = vf_free;
 
-        unsigned char *in_data = (unsigned char *) in->tiles[0].data;
         unsigned char *out_data = (unsigned char *) out->tiles[0].data;
 
-        int linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
         for (unsigned int y = 0; y < in->tiles[0].height; ++y) {
                 mirror_line_UYVY(out_data + y * linesize, in_data + y * linesize, linesize);
         }
@@ -133,6 +167,9 @@ static const struct capture_filter_info capture_filter_mirror = {
         .init = init,
         .done = done,
         .filter = filter,
+        .in_place = true,
+        .fuse_prepare = fuse_prepare,
+        .fuse_row = fuse_row,
 };
 
 REGISTER_MODULE(mirror, &capture_filter_mirror, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -55,6 +55,8 @@
 #include "capture_filter/resize_utils.h"
 #include "debug.h"
 #include "lib_common.h"
+#include "utils/video_frame_pool.h"
+#include "utils/video_scaler.h"
 #include "video.h"
 #include "video_codec.h"
 #include "vo_postprocess/capture_filter_wrapper.h"
@@ -89,6 +91,8 @@ struct state_resize {
     struct video_desc saved_desc;
     struct video_desc out_desc;
     char *vo_pp_out_buffer; ///< buffer to write to if we use vo_pp wrapper (otherwise unused)
+    void *pool; ///< output frames (if not using vo_pp_out_buffer)
+    struct video_scaler *scaler; ///< used for codecs supported natively, otherwise OpenCV
 };
 
 static void usage() {
@@ -101,6 +105,8 @@ static void usage() {
                     "\tresize:1/2 - downscale input frame size by scale factor of 2\n"
                     "\tresize:1280x720 - scales input to 1280x720\n"
                     "\tresize:720x576i - scales input to PAL (overrides interlacing setting)\n");
+    printf("\nUYVY, v210, RGB and RGBA are scaled natively keeping the pixel format,\n"
+                    "other formats are converted to RGB.\n");
 }
 
 static int init(struct module * parent, const char *cfg, void **state)
@@ -177,6 +183,8 @@ static int init(struct module * parent, const char *cfg, void **state)
 
     struct state_resize *s = calloc(1, sizeof(struct state_resize));
     s->param = param;
+    s->pool = video_frame_pool_init((struct video_desc) { 0 }, 0);
+    s->scaler = video_scaler_create(VIDEO_SCALER_BICUBIC);
 
     *state = s;
     return 0;
@@ -184,7 +192,49 @@ static int init(struct module * parent, const char *cfg, void **state)
 
 static void done(void *state)
 {
-    free(state);
+    struct state_resize *s = state;
+    video_frame_pool_destroy(s->pool);
+    video_scaler_destroy(s->scaler);
+    free(s);
+}
+
+/**
+ * Scales the tile keeping the pixel format. If the aspect ratio changes, the
+ * picture is letterboxed (the same way as resize_frame() does).
+ */
+static bool resize_native(struct state_resize *s, codec_t codec, const struct tile *in, struct tile *out)
+{
+    int src_linesize = vc_get_linesize(in->width, codec);
+    int dst_linesize = vc_get_linesize(out->width, codec);
+    int x = 0;
+    int y = 0;
+    int width = out->width;
+    int height = out->height;
+
+    if (s->param.mode == USE_DIMENSIONS) {
+        double in_aspect = (double) in->width / in->height;
+        double out_aspect = (double) out->width / out->height;
+        if (in_aspect > out_aspect) {
+            height = out->width / in_aspect;
+            y = (out->height - height) / 2;
+        } else if (in_aspect < out_aspect) {
+            width = out->height * in_aspect;
+            x = (out->width - width) / 2;
+            // the picture must occupy whole pixel blocks
+            int block = codec == v210 ? 6 : codec == UYVY ? 2 : 1;
+            x = x / block * block;
+            width = width / block * block;
+        }
+        if (width != (int) out->width || height != (int) out->height) {
+            clear_video_buffer((unsigned char *) out->data, dst_linesize, dst_linesize, out->height, codec);
+        }
+    }
+
+    // vc_get_linesize() would round v210 to 48-pixel lines
+    size_t x_offset = codec == v210 ? x / 6 * 16 : vc_get_linesize(x, codec);
+    char *dst = out->data + (size_t) y * dst_linesize + x_offset;
+    return video_scaler_scale(s->scaler, codec, in->data, src_linesize, in->width, in->height,
+            dst, dst_linesize, width, height);
 }
 
 static struct video_frame *filter(void *state, struct video_frame *in)
@@ -201,7 +251,9 @@ static struct video_frame *filter(void *state, struct video_frame *in)
             desc.width = in->tiles[0].width * s->param.num / s->param.denom;
             desc.height = in->tiles[0].height * s->param.num / s->param.denom;
         }
-        desc.color_spec = RGB;
+        if (!video_scaler_supports(desc.color_spec)) {
+            desc.color_spec = RGB;
+        }
         if (s->param.force_interlaced) {
                 desc.interlacing = INTERLACED_MERGED;
         } else if (s->param.force_progressive) {
@@ -211,17 +263,21 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         printf("[resize filter] resizing from %dx%d to %dx%d\n", s->saved_desc.width, s->saved_desc.height, s->out_desc.width, s->out_desc.height);
     }
 
-    struct video_frame *frame = vf_alloc_desc(s->out_desc);
+    struct video_frame *frame = NULL;
     if (s->vo_pp_out_buffer) {
+        frame = vf_alloc_desc(s->out_desc);
         frame->tiles[0].data = s->vo_pp_out_buffer;
+        frame->callbacks.dispose = vf_free;
     } else {
-        frame->tiles[0].data = (char *) malloc(frame->tiles[0].data_len);
-        frame->callbacks.data_deleter = vf_data_deleter;
+        frame = video_frame_pool_get_disposable_frame_desc(s->pool, s->out_desc);
+        vf_copy_metadata(frame, in);
     }
 
     for (unsigned int i = 0; i < frame->tile_count; i++) {
         int res;
-        if (s->param.mode == USE_DIMENSIONS) {
+        if (video_scaler_supports(in->color_spec)) {
+            res = resize_native(s, in->color_spec, &in->tiles[i], &frame->tiles[i]) ? 0 : 1;
+        } else if (s->param.mode == USE_DIMENSIONS) {
             res = resize_frame(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, s->param.target_width, s->param.target_height);
         } else {
             res = resize_frame_factor(in->tiles[i].data, in->color_spec, frame->tiles[i].data, in->tiles[i].width, in->tiles[i].height, (double)s->param.num/s->param.denom);
@@ -230,15 +286,13 @@ static struct video_frame *filter(void *state, struct video_frame *in)
         if(res!=0){
             error_msg("\n[RESIZE ERROR] Unable to resize with scale factor configured [%d/%d] in tile number %d\n", s->param.num, s->param.denom, i);
             error_msg("\t\t No scale factor applied at all. No frame returns...\n");
-            vf_free(frame);
+            VIDEO_FRAME_DISPOSE(frame);
             return NULL;
         }
     }
 
     VIDEO_FRAME_DISPOSE(in);
 
-    frame->callbacks.dispose = vf_free;
-
     return frame;
 }
 
@@ -252,6 +306,9 @@ static struct capture_filter_info capture_filter_resize = {
     init,
     done,
     filter,
+    false,
+    NULL,
+    NULL,
 };
 
 REGISTER_MODULE(resize, &capture_filter_resize, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -0,0 +1,265 @@
+/**
+ * @file   capture_filter/skip_static.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  Drops frames identical to the previous one (screen sharing)
+ *
+ * Frame data are split to horizontal bands of BAND_LINES lines and each band
+ * is hashed with the XXH64 round function (4 independent lanes that the
+ * compiler can interleave or vectorize). If no band changed since the last
+ * frame, the frame is dropped so it is neither compressed nor sent, except
+ * for the keepalive frames and the refine frames following a change (letting
+ * interframe codecs converge to the full quality).
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_filter.h"
+
+#include "debug.h"
+#include "lib_common.h"
+#include "tv.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "video.h"
+#include "video_codec.h"
+
+#define BAND_LINES 16
+#define DEFAULT_KEEPALIVE_SEC 1.0
+#define DEFAULT_REFINE 2
+#define MOD_NAME "[skip_static] "
+#define REPORT_INTERVAL_NS (5 * NS_IN_SEC)
+
+struct module;
+
+struct state_skip_static {
+        time_ns_t keepalive;
+        int refine;
+
+        struct video_desc desc;
+        uint64_t *hashes; ///< band hashes of the last frame
+        size_t band_count;
+        time_ns_t last_passed;
+        int refine_left;
+
+        time_ns_t report_since;
+        int frames;
+        int skipped;
+        size_t changed_bands;
+};
+
+static void usage() {
+        color_printf("Filter " TBOLD("skip_static") " drops frames that didn't change since the previous one.\n"
+                     "It is intended for screen sharing, where an idle desktop then consumes\n"
+                     "(almost) no CPU for compression and no bandwidth. Put it as the last filter.\n\n");
+        printf("skip_static usage:\n\n");
+        color_printf(TBOLD("\t--capture-filter skip_static[:keepalive=<sec>][:refine=<n>]") " -t <capture>\n\n");
+        color_printf(TBOLD("\tkeepalive") " - interval of sending an unchanged frame (default %.0f s)\n", DEFAULT_KEEPALIVE_SEC);
+        color_printf(TBOLD("\t   refine") " - number of unchanged frames still passed after a change (default %d)\n", DEFAULT_REFINE);
+        color_printf("\n");
+}
+
+static int init(struct module *parent, const char *cfg, void **state)
+{
+        UNUSED(parent);
+
+        if (strcasecmp(cfg, "help") == 0) {
+                usage();
+                return 1;
+        }
+
+        double keepalive = DEFAULT_KEEPALIVE_SEC;
+        int refine = DEFAULT_REFINE;
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *copy = tmp;
+        while ((item = strtok_r(copy, ":", &save_ptr)) != NULL) {
+                copy = NULL;
+                if (strncmp(item, "keepalive=", strlen("keepalive=")) == 0) {
+                        keepalive = strtod(item + strlen("keepalive="), NULL);
+                } else if (strncmp(item, "refine=", strlen("refine=")) == 0) {
+                        refine = atoi(item + strlen("refine="));
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        free(tmp);
+                        return -1;
+                }
+        }
+        free(tmp);
+        if (keepalive <= 0.0 || refine < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong keepalive or refine value!\n");
+                return -1;
+        }
+
+        struct state_skip_static *s = calloc(1, sizeof *s);
+        s->keepalive = keepalive * NS_IN_SEC_DBL;
+        s->refine = refine;
+        s->report_since = get_time_in_ns();
+        *state = s;
+        return 0;
+}
+
+static void done(void *state)
+{
+        struct state_skip_static *s = state;
+        free(s->hashes);
+        free(s);
+}
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+        acc += input * XXH_PRIME64_2;
+        acc = rotl64(acc, 31);
+        return acc * XXH_PRIME64_1;
+}
+
+/// XXH64 stripe loop with a simplified finalization - not compatible with
+/// XXH64 output, but with the same distribution for change detection
+static uint64_t hash_band(const unsigned char *data, size_t len) {
+        uint64_t acc[4] = { XXH_PRIME64_1 + XXH_PRIME64_2, XXH_PRIME64_2, 0, -XXH_PRIME64_1 };
+        size_t i = 0;
+        for ( ; i + 32 <= len; i += 32) {
+                for (int l = 0; l < 4; ++l) {
+                        uint64_t v;
+                        memcpy(&v, data + i + 8 * l, sizeof v);
+                        acc[l] = xxh64_round(acc[l], v);
+                }
+        }
+        uint64_t h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+        for ( ; i < len; ++i) {
+                h = rotl64(h ^ (data[i] * XXH_PRIME64_3), 11) * XXH_PRIME64_1;
+        }
+        h ^= h >> 33;
+        h *= XXH_PRIME64_2;
+        h ^= h >> 29;
+        return h;
+}
+
+static size_t band_bytes(const struct tile *t, codec_t codec) {
+        return (size_t) BAND_LINES * tile_get_linesize(t, codec);
+}
+
+static void reconfigure(struct state_skip_static *s, struct video_frame *in) {
+        s->desc = video_desc_from_frame(in);
+        s->band_count = 0;
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                size_t band = band_bytes(&in->tiles[i], in->color_spec);
+                s->band_count += (in->tiles[i].data_len + band - 1) / band;
+        }
+        free(s->hashes);
+        s->hashes = calloc(s->band_count, sizeof s->hashes[0]);
+        s->last_passed = 0;
+}
+
+/// updates the stored hashes, @returns number of changed bands
+static size_t update_hashes(struct state_skip_static *s, struct video_frame *in) {
+        size_t changed = 0;
+        size_t idx = 0;
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                const struct tile *t = &in->tiles[i];
+                size_t band = band_bytes(t, in->color_spec);
+                for (size_t off = 0; off < t->data_len; off += band, ++idx) {
+                        uint64_t h = hash_band((unsigned char *) t->data + off, MIN(band, t->data_len - off));
+                        if (h != s->hashes[idx]) {
+                                s->hashes[idx] = h;
+                                changed += 1;
+                        }
+                }
+        }
+        return changed;
+}
+
+static void report(struct state_skip_static *s, time_ns_t now) {
+        if (now - s->report_since < REPORT_INTERVAL_NS) {
+                return;
+        }
+        if (s->frames > 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Skipped %d of %d frames, %.1f %% of bands changed in average.\n",
+                                s->skipped, s->frames, 100.0 * s->changed_bands / s->frames / s->band_count);
+        }
+        s->report_since = now;
+        s->frames = s->skipped = 0;
+        s->changed_bands = 0;
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        struct state_skip_static *s = state;
+
+        if (!video_desc_eq(s->desc, video_desc_from_frame(in)) || s->hashes == NULL) {
+                reconfigure(s, in);
+        }
+
+        time_ns_t now = get_time_in_ns();
+        size_t changed = update_hashes(s, in);
+        s->frames += 1;
+        s->changed_bands += changed;
+        if (changed > 0 || s->last_passed == 0) {
+                s->refine_left = s->refine;
+        } else if (s->refine_left > 0) {
+                s->refine_left -= 1;
+        } else if (now - s->last_passed < s->keepalive) {
+                s->skipped += 1;
+                report(s, now);
+                VIDEO_FRAME_DISPOSE(in);
+                return NULL;
+        }
+        s->last_passed = now;
+        report(s, now);
+        return in;
+}
+
+static const struct capture_filter_info capture_filter_skip_static = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+};
+
+REGISTER_MODULE(skip_static, &capture_filter_skip_static, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
@@ -104,6 +104,11 @@ static struct video_frame *filter(void *state, struct video_frame *in)
 {
         struct state_split *s = state;
 
+        if (s->x == 1) { // horizontal stripes - tiles may reference the input
+                return vf_split_view(in, s->x, s->y);
+        }
+
+        // consumers do not handle tile::linesize, so columns need to be copied
         struct video_desc desc = video_desc_from_frame(in);
         desc.tile_count = s->x * s->y;
         desc.width /= s->x;
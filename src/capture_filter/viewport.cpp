@@ -0,0 +1,289 @@
+/**
+ * @file   capture_filter/viewport.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  viewport-adaptive tiling of 360° (equirectangular) video
+ *
+ * The frame is split to a grid of tiles, each of them is then compressed
+ * by its own compression instance (as any other tiled video). Tiles outside
+ * of the viewport reported by the receiver (pano_gl, openxr_gl) are passed
+ * with reduced detail, so that the compression spends most of the bitrate
+ * on the visible part. The viewport is delivered as RTCP feedback and
+ * forwarded here by the sender (message "viewport <yaw> <pitch> <fov_h>
+ * <fov_v>" to capture.filter.data[viewport]).
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "capture_filter.h"
+#include "debug.h"
+#include "lib_common.h"
+#include "messaging.h"
+#include "module.h"
+#include "utils/color_out.h"
+#include "utils/vf_split.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_codec.h"
+
+#define MOD_NAME "[viewport] "
+#define DEFAULT_COLS 8
+#define DEFAULT_ROWS 4
+#define DEFAULT_LOW_FACTOR 4
+#define DEFAULT_MARGIN 10.0 ///< degrees added around the viewport (head movement until the next report)
+
+struct state_viewport {
+        struct module mod;
+        int cols = DEFAULT_COLS;
+        int rows = DEFAULT_ROWS;
+        int low_factor = DEFAULT_LOW_FACTOR;
+        double margin = DEFAULT_MARGIN;
+
+        bool have_viewport = false; ///< until reported, all tiles are in full quality
+        struct video_viewport viewport{};
+        std::vector<bool> visible;
+        int visible_count = -1;
+
+        video_frame_pool pool;
+        bool warned = false;
+};
+
+static void usage()
+{
+        printf("Splits a 360° (equirectangular) frame to tiles and reduces detail of the tiles\n"
+                        "outside of the viewport reported by the receiver (display pano_gl or openxr_gl).\n\n");
+        color_printf(TERM_BOLD "\tviewport[:<cols>x<rows>][:low=<n>][:margin=<deg>]\n\n" TERM_RESET);
+        printf("\t<cols>x<rows> - tile grid (default %dx%d)\n", DEFAULT_COLS, DEFAULT_ROWS);
+        printf("\tlow           - detail reduction of the tiles outside of the viewport (default %d)\n", DEFAULT_LOW_FACTOR);
+        printf("\tmargin        - margin around the viewport in degrees (default %g)\n", DEFAULT_MARGIN);
+}
+
+static int init(struct module *parent, const char *cfg, void **state)
+{
+        if (strcmp(cfg, "help") == 0) {
+                usage();
+                return 1;
+        }
+        auto *s = new state_viewport();
+        char *tmp = strdup(cfg);
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        char *cur = tmp;
+        while ((item = strtok_r(cur, ":", &save_ptr)) != nullptr) {
+                cur = nullptr;
+                if (strchr(item, 'x') != nullptr && sscanf(item, "%dx%d", &s->cols, &s->rows) == 2) {
+                        continue;
+                }
+                if (strncmp(item, "low=", strlen("low=")) == 0) {
+                        s->low_factor = atoi(item + strlen("low="));
+                } else if (strncmp(item, "margin=", strlen("margin=")) == 0) {
+                        s->margin = atof(item + strlen("margin="));
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        free(tmp);
+                        delete s;
+                        return -1;
+                }
+        }
+        free(tmp);
+        if (s->cols <= 0 || s->rows <= 0 || s->low_factor < 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong tile grid or detail reduction!\n");
+                delete s;
+                return -1;
+        }
+        s->visible.assign(s->cols * s->rows, true);
+
+        module_init_default(&s->mod);
+        s->mod.cls = MODULE_CLASS_DATA;
+        s->mod.name = strdup("viewport");
+        module_register(&s->mod, parent);
+
+        *state = s;
+        return 0;
+}
+
+static void done(void *state)
+{
+        auto *s = static_cast<state_viewport *>(state);
+        module_done(&s->mod);
+        delete s;
+}
+
+/// @returns angle normalized to [-180, 180)
+static double wrap_angle(double deg)
+{
+        deg = fmod(deg + 180.0, 360.0);
+        return deg < 0.0 ? deg + 180.0 : deg - 180.0;
+}
+
+/**
+ * Marks the tiles intersecting the viewport (extended by the margin). The
+ * horizontal extent is widened by 1/cos(latitude) as the meridians converge
+ * towards the poles, if the viewport reaches a pole, whole rows are visible.
+ */
+static void update_visible(struct state_viewport *s)
+{
+        const struct video_viewport &vp = s->viewport;
+        const double lat_hi = vp.pitch + vp.fov_v / 2.0 + s->margin;
+        const double lat_lo = vp.pitch - vp.fov_v / 2.0 - s->margin;
+        const double max_lat = fmax(fabs(lat_hi), fabs(lat_lo));
+        double half_width = 180.0;
+        if (max_lat < 85.0) {
+                half_width = fmin((vp.fov_h / 2.0 + s->margin) / cos(max_lat * M_PI / 180.0), 180.0);
+        }
+        const double tile_half_width = 180.0 / s->cols;
+        int count = 0;
+        for (int r = 0; r < s->rows; ++r) {
+                const double tile_top = 90.0 - 180.0 * r / s->rows;
+                const double tile_bottom = 90.0 - 180.0 * (r + 1) / s->rows;
+                for (int c = 0; c < s->cols; ++c) {
+                        const double tile_center = (c + 0.5) * 360.0 / s->cols - 180.0;
+                        const bool visible = tile_bottom <= lat_hi && tile_top >= lat_lo
+                                && fabs(wrap_angle(tile_center - vp.yaw)) <= half_width + tile_half_width;
+                        s->visible[r * s->cols + c] = visible;
+                        count += visible ? 1 : 0;
+                }
+        }
+        if (count != s->visible_count) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%d of %d tiles in full quality\n", count, s->cols * s->rows);
+                s->visible_count = count;
+        }
+}
+
+static void process_messages(struct state_viewport *s)
+{
+        struct message *msg = nullptr;
+        while ((msg = check_message(&s->mod)) != nullptr) {
+                auto *msg_univ = reinterpret_cast<struct msg_universal *>(msg);
+                struct video_viewport vp{};
+                struct response *r = nullptr;
+                if (sscanf(msg_univ->text, "viewport %f %f %f %f", &vp.yaw, &vp.pitch, &vp.fov_h, &vp.fov_v) == 4) {
+                        s->viewport = vp;
+                        s->have_viewport = true;
+                        update_visible(s);
+                        r = new_response(RESPONSE_OK, nullptr);
+                } else {
+                        r = new_response(RESPONSE_BAD_REQUEST, "expected viewport <yaw> <pitch> <fov_h> <fov_v>");
+                }
+                free_message(msg, r);
+        }
+}
+
+/**
+ * Reduces detail of the tile by replicating every factor-th pixel block and
+ * line. Encoders then spend only a fraction of the bitrate on the tile and
+ * it is cheaper to decode.
+ */
+static void reduce_detail(struct tile *t, codec_t codec, int factor)
+{
+        const size_t block_bytes = get_pf_block_bytes(codec);
+        const size_t linesize = vc_get_linesize(t->width, codec);
+        const size_t blocks = linesize / block_bytes;
+        for (unsigned int y = 0; y < t->height; y += factor) {
+                char *line = t->data + y * linesize;
+                for (size_t b = 0; b < blocks; b += factor) {
+                        for (size_t i = b + 1; i < b + factor && i < blocks; ++i) {
+                                memcpy(line + i * block_bytes, line + b * block_bytes, block_bytes);
+                        }
+                }
+                for (unsigned int i = y + 1; i < y + factor && i < t->height; ++i) {
+                        memcpy(t->data + i * linesize, line, linesize);
+                }
+        }
+}
+
+static bool is_supported(struct state_viewport *s, const struct video_frame *in)
+{
+        const bool supported = in->tile_count == 1 && in->mem_location == CPU_MEM
+                && !is_codec_opaque(in->color_spec)
+                && in->tiles[0].width % (s->cols * get_pf_block_pixels(in->color_spec)) == 0
+                && in->tiles[0].height % s->rows == 0;
+        if (!supported && !s->warned) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot split %s %ux%u to %dx%d tiles, passing unchanged!\n",
+                                get_codec_name(in->color_spec), in->tiles[0].width, in->tiles[0].height,
+                                s->cols, s->rows);
+                s->warned = true;
+        }
+        return supported;
+}
+
+static struct video_frame *filter(void *state, struct video_frame *in)
+{
+        auto *s = static_cast<state_viewport *>(state);
+        process_messages(s);
+        if (!is_supported(s, in)) {
+                return in;
+        }
+
+        struct video_desc desc = video_desc_from_frame(in);
+        desc.tile_count = s->cols * s->rows;
+        desc.width /= s->cols;
+        desc.height /= s->rows;
+        struct video_frame *out = s->pool.get_disposable_frame(desc);
+        vf_split(out, in, s->cols, s->rows, 0);
+        vf_copy_metadata(out, in);
+        VIDEO_FRAME_DISPOSE(in);
+
+        if (s->have_viewport && s->low_factor > 1) {
+                for (unsigned int i = 0; i < out->tile_count; ++i) {
+                        if (!s->visible[i]) {
+                                reduce_detail(&out->tiles[i], out->color_spec, s->low_factor);
+                        }
+                }
+        }
+        return out;
+}
+
+static const struct capture_filter_info capture_filter_viewport = {
+        .init = init,
+        .done = done,
+        .filter = filter,
+        .in_place = false,
+        .fuse_prepare = nullptr,
+        .fuse_row = nullptr,
+        .drain = nullptr,
+};
+
+REGISTER_MODULE(viewport, &capture_filter_viewport, LIBRARY_CLASS_CAPTURE_FILTER, CAPTURE_FILTER_ABI_VERSION);
+
+/* vim: set expandtab sw=8: */
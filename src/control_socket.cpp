@@ -44,9 +44,8 @@
 #include "control_socket.h"
 #include "compat/platform_pipe.h"
 
-#include <condition_variable>
+#include <chrono>
 #include <mutex>
-#include <queue>
 #include <stdio.h>
 #include <string>
 #include <thread>
@@ -57,10 +56,15 @@
 #include "module.h"
 #include "rtp/net_udp.h" // socket_error
 #include "tv.h"
+#include "utils/metrics.h"
 #include "utils/net.h"
+#include "utils/profile_timer.hpp"
 #include "utils/thread.h"
 
 #define MAX_CLIENTS 16
+#define MAX_CLIENT_OUTPUT (4 * 1024 * 1024) ///< slower clients are dropped
+#define MAX_STAT_EVENT_BATCH (1024 * 1024)
+#define STAT_BATCH_INTERVAL_MS 100 ///< stats are coalesced for this time, events sent immediately
 
 #ifdef WIN32
 typedef const char *sso_val_type;
@@ -74,6 +78,9 @@ struct client {
         fd_t fd;
         char buff[1024];
         int buff_len;
+        std::string out; ///< data not yet accepted by the (nonblocking) socket
+        bool drop;       ///< client too slow or broken, will be removed
+        bool close_after_flush;
 
         struct client *prev;
         struct client *next;
@@ -84,8 +91,6 @@ enum connection_type {
         CLIENT
 };
 
-#define MAX_STAT_EVENT_QUEUE 100
-
 struct control_state {
         struct module mod;
         thread control_thread_id;
@@ -102,9 +107,11 @@ struct control_state {
 
         bool started;
 
-        thread stat_event_thread_id;
-        condition_variable stat_event_cv;
-        queue<string> stat_event_queue;
+        /// stats and events not yet handed to clients, guarded by stats_lock
+        string stat_event_batch;
+        bool stat_event_urgent = false; ///< batch contains an event
+        int stat_event_wakeup = 0;      ///< 0 - control thread not woken up yet, 1 - woken up, 2 - woken up for an event
+        unsigned long stat_event_dropped = 0;
 
         bool stats_on;
 };
@@ -116,8 +123,7 @@ static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int
 static int process_msg(struct control_state *s, fd_t client_fd, char *message, struct client *clients);
 static ssize_t write_all(fd_t fd, const void *buf, size_t count);
 static void * control_thread(void *args);
-static void * stat_event_thread(void *args);
-static void send_response(fd_t fd, struct response *resp);
+static void send_response(struct client *clients, fd_t fd, struct response *resp);
 static void print_control_help();
 
 #ifndef MSG_NOSIGNAL
@@ -142,6 +148,68 @@ static ssize_t write_all(fd_t fd, const void *buf, size_t count)
         return count;
 }
 
+static bool socket_would_block()
+{
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+/// writes as much of the buffered output as the socket accepts without blocking
+static void client_flush(struct client *c)
+{
+        size_t sent = 0;
+        while (!c->drop && sent < c->out.size()) {
+                ssize_t ret = send(c->fd, c->out.data() + sent, c->out.size() - sent, MSG_NOSIGNAL);
+                if (ret > 0) {
+                        sent += ret;
+                        continue;
+                }
+                if (ret < 0 && !socket_would_block()) {
+                        socket_error("[control socket] send");
+                        c->drop = true;
+                }
+                break;
+        }
+        c->out.erase(0, sent);
+        if (c->out.empty() && c->close_after_flush) {
+                shutdown(c->fd, SHUT_RDWR);
+                c->close_after_flush = false;
+        }
+}
+
+static void client_write(struct client *c, const char *data, size_t len)
+{
+        if (c->drop) {
+                return;
+        }
+        c->out.append(data, len);
+        client_flush(c);
+        if (c->out.size() > MAX_CLIENT_OUTPUT) {
+                log_msg(LOG_LEVEL_WARNING, "[control socket] Client doesn't read its data, dropping.\n");
+                c->drop = true;
+        }
+}
+
+/**
+ * Sends data to a connected client (buffered), other file descriptors (stdout
+ * for "execute" messages) are written directly.
+ */
+static void client_send(struct client *clients, fd_t fd, const char *data, size_t len)
+{
+        for (struct client *cur = clients; cur != nullptr; cur = cur->next) {
+                if (cur->fd == fd) {
+                        client_write(cur, data, len);
+                        return;
+                }
+        }
+        if (write_all(fd, data, len) < 0) {
+                socket_error("[control socket] Unable to write response");
+        }
+}
+
 static void new_message(struct module *m) {
         control_state *s = (control_state *) m->priv_data;
         if(s->started) {
@@ -295,7 +363,6 @@ void control_start(struct control_state *s)
         platform_pipe_init(s->internal_fd);
 
         s->control_thread_id = thread(control_thread, s);
-        s->stat_event_thread_id = thread(stat_event_thread, s);
 
         log_msg(LOG_LEVEL_NOTICE, "Control socket listening on port %d\n",
                         socket_get_recv_port(s->socket_fd));
@@ -362,33 +429,7 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if (strcasecmp(message, "noop") == 0) {
                 return ret;
         } else if (prefix_matches(message, "stats ") || prefix_matches(message, "event ")) {
-                if (is_internal_port(client_fd)) {
-                        struct client *cur = clients;
-                        char *new_msg = NULL;
-
-                        while (cur) {
-                                if(is_internal_port(cur->fd)) { // skip local FD
-                                        cur = cur->next;
-                                        continue;
-                                }
-                                if (!new_msg) {
-                                        // append <CR><LF> again
-                                        new_msg = (char *) malloc(strlen(message) + 1 + 2);
-                                        strcpy(new_msg, message);
-                                        new_msg[strlen(message)] = '\r';
-                                        new_msg[strlen(message) + 1] = '\n';
-                                        new_msg[strlen(message) + 2] = '\0';
-                                }
-
-                                int ret = write_all(cur->fd, new_msg, strlen(new_msg));
-                                if (ret != (int) strlen(new_msg)) {
-                                        log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event!\n");
-                                }
-                                cur = cur->next;
-                        }
-                        free(new_msg);
-                        return ret;
-                } else if (prefix_matches(message, "stats ")) {
+                if (prefix_matches(message, "stats ")) {
                         const char *toggle = suffix(message, "stats ");
                         if (strcasecmp(toggle, "on") == 0) {
                                 s->stats_on = true;
@@ -559,6 +600,59 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                         append_message_path(path, sizeof(path), path_compress);
                         resp = send_message(s->root_module, path, (struct message *) msg);
                 }
+        } else if (prefix_matches(message, "set-param ")) {
+                char target[32] = "";
+                char param[1024] = ""; // "<key> <value>"
+                char key[64] = "";
+                sscanf(suffix(message, "set-param "), "%31s %1023[^\n]", target, param);
+                sscanf(param, "%63s", key);
+                struct message *msg = NULL;
+                if (strlen(param) <= strlen(key)) {
+                        resp = new_response(RESPONSE_BAD_REQUEST, "usage: set-param <target> <key> <value>");
+                } else if (strcasecmp(target, "receiver") == 0) {
+                        auto *msg_recv = (struct msg_receiver *) new_message(sizeof(struct msg_receiver));
+                        msg_recv->type = RECEIVER_MSG_SET_PARAM;
+                        strncpy(msg_recv->param, param, sizeof msg_recv->param - 1);
+                        enum module_class path_receiver[] = { MODULE_CLASS_RECEIVER, MODULE_CLASS_NONE };
+                        append_message_path(path, sizeof(path), path_receiver);
+                        msg = (struct message *) msg_recv;
+                } else if (strcasecmp(target, "sender") == 0) {
+                        auto *msg_send = (struct msg_sender *) new_message(sizeof(struct msg_sender));
+                        msg_send->type = SENDER_MSG_SET_PARAM;
+                        strncpy(msg_send->param, param, sizeof msg_send->param - 1);
+                        enum module_class path_sender[] = { MODULE_CLASS_SENDER, MODULE_CLASS_NONE };
+                        append_message_path(path, sizeof(path), path_sender);
+                        msg = (struct message *) msg_send;
+                } else if (strcasecmp(target, "tx") == 0 || strcasecmp(target, "decoder") == 0) {
+                        auto *msg_univ = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+                        if (strcasecmp(target, "tx") == 0) {
+                                snprintf(msg_univ->text, sizeof msg_univ->text, MSG_UNIVERSAL_TAG_TX MSG_UNIVERSAL_TAG_SET_PARAM "%s", param);
+                                enum module_class path_tx[] = { MODULE_CLASS_SENDER, MODULE_CLASS_TX, MODULE_CLASS_NONE };
+                                append_message_path(path, sizeof(path), path_tx);
+                        } else {
+                                snprintf(msg_univ->text, sizeof msg_univ->text, MSG_UNIVERSAL_TAG_SET_PARAM "%s", param);
+                                enum module_class path_decoder[] = { MODULE_CLASS_RECEIVER, MODULE_CLASS_DECODER, MODULE_CLASS_NONE };
+                                append_message_path(path, sizeof(path), path_decoder);
+                        }
+                        msg = (struct message *) msg_univ;
+                } else if (strcasecmp(target, "compress") == 0) { // same as "compress param <key>=<value>"
+                        auto *msg_compress = (struct msg_change_compress_data *)
+                                new_message(sizeof(struct msg_change_compress_data));
+                        msg_compress->what = CHANGE_PARAMS;
+                        const char *val = param + strlen(key);
+                        while (isspace(*val)) {
+                                val++;
+                        }
+                        snprintf(msg_compress->config_string, sizeof msg_compress->config_string, "%s=%s", key, val);
+                        enum module_class path_compress[] = { MODULE_CLASS_SENDER, MODULE_CLASS_COMPRESS, MODULE_CLASS_NONE };
+                        append_message_path(path, sizeof(path), path_compress);
+                        msg = (struct message *) msg_compress;
+                } else {
+                        resp = new_response(RESPONSE_NOT_FOUND, "unknown target");
+                }
+                if (msg) {
+                        resp = send_message(s->root_module, path, msg);
+                }
         } else if (prefix_matches(message, "volume ")) {
                 strncpy(path, "audio.receiver", sizeof path);
                 struct msg_receiver *msg = (struct msg_receiver *) new_message(sizeof(struct msg_receiver));
@@ -597,6 +691,37 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
         } else if(strcmp(message, "dump-tree") == 0) {
                 dump_tree(s->root_module, 0);
                 resp = new_response(RESPONSE_OK, NULL);
+        } else if (strcasecmp(message, "metrics") == 0) {
+                char *metrics = metrics_scrape();
+                client_send(clients, client_fd, metrics, strlen(metrics));
+                free(metrics);
+                resp = new_response(RESPONSE_OK, NULL);
+        } else if (prefix_matches(message, "GET /metrics")) { // Prometheus scrape of the control port
+                char *metrics = metrics_scrape();
+                snprintf(buf, sizeof buf, "HTTP/1.0 200 OK\r\n"
+                                "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                                "Content-Length: %zu\r\n\r\n", strlen(metrics));
+                client_send(clients, client_fd, buf, strlen(buf));
+                client_send(clients, client_fd, metrics, strlen(metrics));
+                free(metrics);
+                return CONTROL_CLOSE_HANDLE;
+        } else if (prefix_matches(message, "profile ")) {
+                const char *arg = message + strlen("profile ");
+                if (prefix_matches(arg, "on")) {
+                        int sampling = strlen(arg) > strlen("on") ? atoi(arg + strlen("on")) : 1;
+                        profiler_set_enabled(true, sampling > 0 ? sampling : 1);
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else if (strcasecmp(arg, "off") == 0) {
+                        profiler_set_enabled(false, 1);
+                        resp = new_response(RESPONSE_OK, NULL);
+                } else if (prefix_matches(arg, "dump")) {
+                        double last_sec = strlen(arg) > strlen("dump") ? atof(arg + strlen("dump")) : 0.0;
+                        snprintf(buf, sizeof buf, "ug_profile_%lld.json", (long long) time_since_epoch_in_ms());
+                        resp = profiler_dump(buf, last_sec) ? new_response(RESPONSE_OK, buf)
+                                : new_response(RESPONSE_INT_SERV_ERR, "Unable to write profile");
+                } else {
+                        resp = new_response(RESPONSE_BAD_REQUEST, NULL);
+                }
         } else { // assume message in format "path message"
                 struct msg_universal *msg = (struct msg_universal *)
                         new_message(sizeof(struct msg_universal));
@@ -616,12 +741,12 @@ static int process_msg(struct control_state *s, fd_t client_fd, char *message, s
                 snprintf(buf, sizeof(buf), "(unknown path: %s)", path);
                 resp = new_response(RESPONSE_INT_SERV_ERR, buf);
         }
-        send_response(client_fd, resp);
+        send_response(clients, client_fd, resp);
 
         return ret;
 }
 
-static void send_response(fd_t fd, struct response *resp)
+static void send_response(struct client *clients, fd_t fd, struct response *resp)
 {
         char buffer[1024];
 
@@ -634,10 +759,7 @@ static void send_response(fd_t fd, struct response *resp)
         }
         strcat(buffer, "\r\n");
 
-        ssize_t ret = write_all(fd, buffer, strlen(buffer));
-        if (ret < 0) {
-                socket_error("Unable to write response");
-        }
+        client_send(clients, fd, buffer, strlen(buffer));
 
         free_response(resp);
 }
@@ -678,8 +800,7 @@ static bool parse_msg(char *buffer, int buffer_len, /* out */ char *message, int
  * prepends itself at the head of the list
  */
 static struct client *add_client(struct client *clients, fd_t fd) {
-        struct client *new_client = (struct client *)
-                malloc(sizeof(struct client));
+        struct client *new_client = new client();
         new_client->fd = fd;
         new_client->prev = NULL;
         new_client->next = clients;
@@ -687,10 +808,31 @@ static struct client *add_client(struct client *clients, fd_t fd) {
                 new_client->next->prev = new_client;
         }
         new_client->buff_len = 0;
+        new_client->drop = false;
+        new_client->close_after_flush = false;
 
         return new_client;
 }
 
+/**
+ * closes the client socket and unlinks it from the list
+ * @returns next client
+ */
+static struct client *remove_client(struct client **clients, struct client *cur) {
+        struct client *next = cur->next;
+        CLOSESOCKET(cur->fd);
+        if (cur->prev) {
+                cur->prev->next = cur->next;
+        } else {
+                *clients = cur->next;
+        }
+        if (cur->next) {
+                cur->next->prev = cur->prev;
+        }
+        delete cur;
+        return next;
+}
+
 static void process_messages(struct control_state *s)
 {
         struct message *msg;
@@ -720,7 +862,7 @@ static void process_messages(struct control_state *s)
 
 static void set_socket_nonblock(fd_t fd) {
 #ifdef _WIN32
-    unsigned long ul;
+    unsigned long ul = 1;
     ioctlsocket(fd, FIONBIO, &ul);
 #else
     if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
@@ -729,6 +871,46 @@ static void set_socket_nonblock(fd_t fd) {
 #endif
 }
 
+/**
+ * Hands the pending stats and events to all clients as a single write per
+ * client. Stats are coalesced for STAT_BATCH_INTERVAL_MS, events are sent
+ * immediately.
+ *
+ * @returns milliseconds until the pending batch is due, -1 if nothing pending
+ */
+static long flush_stat_events(struct control_state *s, struct client *clients,
+                chrono::steady_clock::time_point *last_flush)
+{
+        auto now = chrono::steady_clock::now();
+        string batch;
+        unsigned long dropped = 0;
+        {
+                lock_guard<mutex> lk(s->stats_lock);
+                if (s->stat_event_batch.empty()) {
+                        return -1;
+                }
+                long since_last = chrono::duration_cast<chrono::milliseconds>(now - *last_flush).count();
+                if (!s->stat_event_urgent && since_last < STAT_BATCH_INTERVAL_MS) {
+                        return STAT_BATCH_INTERVAL_MS - since_last;
+                }
+                batch.swap(s->stat_event_batch);
+                s->stat_event_urgent = false;
+                s->stat_event_wakeup = 0;
+                dropped = s->stat_event_dropped;
+                s->stat_event_dropped = 0;
+        }
+        if (dropped > 0) {
+                log_msg(LOG_LEVEL_WARNING, "[control socket] %lu stats/event lines dropped!\n", dropped);
+        }
+        for (struct client *cur = clients; cur != nullptr; cur = cur->next) {
+                if (!is_internal_port(cur->fd)) {
+                        client_write(cur, batch.data(), batch.size());
+                }
+        }
+        *last_flush = now;
+        return -1;
+}
+
 ADD_TO_PARAM("control-accept-global", "* control-accept-global\n"
                 "  Open control socket to public network.\n");
 static void * control_thread(void *args)
@@ -752,16 +934,18 @@ static void * control_thread(void *args)
 
         bool should_exit = false;
 
-        struct timeval last_report_sent;
         const int report_interval_sec = 5;
-        gettimeofday(&last_report_sent, NULL);
+        auto last_stat_flush = chrono::steady_clock::now();
 
         while(!should_exit) {
                 process_messages(s);
+                long stat_wait_ms = flush_stat_events(s, clients, &last_stat_flush);
 
                 fd_t max_fd = 0;
                 fd_set fds;
+                fd_set wfds;
                 FD_ZERO(&fds);
+                FD_ZERO(&wfds);
                 if (s->connection_type == SERVER) {
                         FD_SET(s->socket_fd, &fds);
                         max_fd = s->socket_fd + 1;
@@ -771,6 +955,9 @@ static void * control_thread(void *args)
 
                 while(cur) {
                         FD_SET(cur->fd, &fds);
+                        if (!cur->out.empty()) {
+                                FD_SET(cur->fd, &wfds);
+                        }
                         if(cur->fd + 1 > max_fd) {
                                 max_fd = cur->fd + 1;
                         }
@@ -785,10 +972,15 @@ static void * control_thread(void *args)
                 if(clients->next != NULL) { // some remote client
                         timeout_ptr = &timeout;
                 }
+                if (stat_wait_ms >= 0) { // stats batch to be sent
+                        timeout.tv_sec = stat_wait_ms / 1000;
+                        timeout.tv_usec = stat_wait_ms % 1000 * 1000;
+                        timeout_ptr = &timeout;
+                }
 
                 int rc;
 
-                if ((rc = select(max_fd, &fds, NULL, NULL, timeout_ptr)) >= 1) {
+                if ((rc = select(max_fd, &fds, &wfds, NULL, timeout_ptr)) >= 1) {
                         if(s->connection_type == SERVER && FD_ISSET(s->socket_fd, &fds)) {
                                 fd_t fd = accept(s->socket_fd, (struct sockaddr *) &client_addr, &len);
                                 if (fd == INVALID_SOCKET) {
@@ -796,8 +988,8 @@ static void * control_thread(void *args)
                                         continue;
                                 }
 
-                                // all remote sockets are written sequentially so
-                                // we don't want to block if one gets stuck
+                                // output is buffered per client and flushed when
+                                // the socket is writable, never block on a stuck one
                                 set_socket_nonblock(fd);
 
                                 // refuse remote connections by default
@@ -817,6 +1009,9 @@ static void * control_thread(void *args)
                         struct client *cur = clients;
 
                         while(cur) {
+                                if (FD_ISSET(cur->fd, &wfds)) {
+                                        client_flush(cur);
+                                }
                                 if(FD_ISSET(cur->fd, &fds)) {
                                         ssize_t ret = PLATFORM_PIPE_READ(cur->fd, cur->buff + cur->buff_len,
                                                         sizeof(cur->buff) - cur->buff_len);
@@ -824,19 +1019,7 @@ static void * control_thread(void *args)
                                                 fprintf(stderr, "Error reading socket, closing!!!\n");
                                         }
                                         if(ret <= 0) {
-                                                struct client *next;
-                                                CLOSESOCKET(cur->fd);
-                                                if (cur->prev) {
-                                                        cur->prev->next = cur->next;
-                                                } else {
-                                                        clients = cur->next;
-                                                }
-                                                if (cur->next) {
-                                                        cur->next->prev = cur->prev;
-                                                }
-                                                next = cur->next;
-                                                free(cur);
-                                                cur = next;
+                                                cur = remove_client(&clients, cur);
                                                 continue;
                                         }
                                         cur->buff_len += ret;
@@ -857,7 +1040,9 @@ static void * control_thread(void *args)
                                 if(ret == CONTROL_EXIT && is_internal_port(cur->fd)) {
                                         should_exit = true;
                                 } else if(ret == CONTROL_CLOSE_HANDLE) {
-                                        shutdown(cur->fd, SHUT_RDWR);
+                                        // after the response is written
+                                        cur->close_after_flush = true;
+                                        client_flush(cur);
                                 }
                         }
                         if(cur->buff_len == sizeof(cur->buff)) {
@@ -867,19 +1052,25 @@ static void * control_thread(void *args)
 
                         cur = cur->next;
                 }
+
+                cur = clients;
+                while (cur) {
+                        if (cur->drop) {
+                                cur = remove_client(&clients, cur);
+                        } else {
+                                cur = cur->next;
+                        }
+                }
         }
 
         // notify clients about exit
         struct client *cur = clients;
         while(cur) {
-                struct client *tmp = cur;
                 if (!is_internal_port(cur->fd)) {
                         const char *msg = "event exit\r\n";
-                        write_all(cur->fd, msg, strlen(msg));
+                        client_write(cur, msg, strlen(msg));
                 }
-                CLOSESOCKET(cur->fd);
-                cur = cur->next;
-                free(tmp);
+                cur = remove_client(&clients, cur);
         }
 
         platform_pipe_close(s->internal_fd[0]);
@@ -887,30 +1078,6 @@ static void * control_thread(void *args)
         return NULL;
 }
 
-static void *stat_event_thread(void *args)
-{
-        set_thread_name(__func__);
-        struct control_state *s = (struct control_state *) args;
-
-        while (1) {
-                std::unique_lock<std::mutex> lk(s->stats_lock);
-                s->stat_event_cv.wait(lk, [s] { return s->stat_event_queue.size() > 0; });
-                string &line = s->stat_event_queue.front();
-
-                if (line.empty()) {
-                        break;
-                }
-
-                int ret = write_all(s->internal_fd[1], line.c_str(), line.length());
-                s->stat_event_queue.pop();
-                if (ret <= 0) {
-                        fprintf(stderr, "Cannot write stat line!\n");
-                }
-        }
-
-        return NULL;
-}
-
 void control_done(struct control_state *s)
 {
         if(!s) {
@@ -920,12 +1087,6 @@ void control_done(struct control_state *s)
         module_done(&s->mod);
 
         if(s->started) {
-                s->stats_lock.lock();
-                s->stat_event_queue.push({});
-                s->stats_lock.unlock();
-                s->stat_event_cv.notify_one();
-                s->stat_event_thread_id.join();
-
                 int ret = write_all(s->internal_fd[1], "quit\r\n", 6);
                 if (ret > 0) {
                         s->control_thread_id.join();
@@ -943,17 +1104,30 @@ void control_done(struct control_state *s)
         delete s;
 }
 
-static void control_report_stats_event(struct control_state *s, const std::string &report_line)
+/**
+ * Appends the line to the batch delivered by the control thread. Never blocks
+ * on the clients - the control thread is woken up once per batch (and once
+ * more if an event arrives to a batch of stats).
+ */
+static void control_report_stats_event(struct control_state *s, const std::string &report_line, bool urgent)
 {
-        std::unique_lock<std::mutex> lk(s->stats_lock);
-
-        if (s->stat_event_queue.size() < MAX_STAT_EVENT_QUEUE) {
-                s->stat_event_queue.push(report_line);
-        } else {
-                log_msg(LOG_LEVEL_WARNING, "Cannot write stats/event - queue full!!!");
+        int wakeup = urgent ? 2 : 1;
+        {
+                std::lock_guard<std::mutex> lk(s->stats_lock);
+                if (s->stat_event_batch.size() + report_line.size() > MAX_STAT_EVENT_BATCH) {
+                        s->stat_event_dropped += 1;
+                        return;
+                }
+                s->stat_event_batch += report_line;
+                s->stat_event_urgent = s->stat_event_urgent || urgent;
+                if (s->stat_event_wakeup >= wakeup) {
+                        return;
+                }
+                s->stat_event_wakeup = wakeup;
+        }
+        if (s->started && write_all(s->internal_fd[1], "noop\r\n", 6) <= 0) {
+                log_msg(LOG_LEVEL_ERROR, "[control] Cannot write to pipe!\n");
         }
-        lk.unlock();
-        s->stat_event_cv.notify_one();
 }
 
 void control_report_stats(struct control_state *s, const std::string &report_line)
@@ -962,7 +1136,12 @@ void control_report_stats(struct control_state *s, const std::string &report_lin
                 return;
         }
 
-        control_report_stats_event(s, "stats " + report_line + "\r\n");
+        control_report_stats_event(s, "stats " + report_line + "\r\n", false);
+}
+
+void control_report_stats_cstr(struct control_state *s, const char *report_line)
+{
+        control_report_stats(s, report_line);
 }
 
 void control_report_event(struct control_state *s, const std::string &report_line)
@@ -971,7 +1150,7 @@ void control_report_event(struct control_state *s, const std::string &report_lin
                 return;
         }
 
-        control_report_stats_event(s, "event " + report_line + "\r\n");
+        control_report_stats_event(s, "event " + report_line + "\r\n", true);
 }
 
 bool control_stats_enabled(struct control_state *s)
@@ -990,12 +1169,21 @@ static void print_control_help() {
                         "\tfec {audio|video} <fec-string>\n"
                         "\tcompress <new-compress>\n"
                         "\tcompress param <new-compress-param>\n"
+                        "\tset-param {receiver|sender|tx|decoder|compress} <key> <value> - live tuning, keys:\n"
+                                "\t\treceiver: playout-delay <ms>, recv-buf <B>, udp-queue-len <pkts>\n"
+                                "\t\tsender: send-buf <B>, recv-buf <B>\n"
+                                "\t\ttx: tx-pacing <mode> (see \"--param tx-pacing\")\n"
+                                "\t\tdecoder: lavd-thread-count <n> (decompressor is reinitialized)\n"
+                                "\t\tcompress: any parameter of the current compression (eg. threads)\n"
                         "\tvolume {up|down}\n"
                         "\tav-delay <ms>\n"
                         "\tmute\n"
                                 "\t\tthe three items above apply to receiver\n"
                         "\tpostprocess <new_postprocess>|flush\n"
-                        "\tdump-tree\n");
+                        "\tdump-tree\n"
+                        "\tmetrics - pipeline counters in OpenMetrics format (also HTTP GET /metrics)\n"
+                        "\tprofile on [<n>]|off - record every n-th scope timing (Chrome trace events)\n"
+                        "\tprofile dump [<sec>] - write the recorded events (of last <sec> seconds) to a file\n");
         printf("\nOther commands can be issued directly to individual "
                         "modules (see \"dump-tree\"), eg.:\n"
                         "\tcapture.filter mirror\n"
@@ -40,11 +40,17 @@
 
 #define DEFAULT_CONTROL_PORT 5054
 
+#ifdef __cplusplus
 #include <string>
+#else
+#include <stdbool.h>
+#endif
 
 struct control_state;
 struct module;
 
+#ifdef __cplusplus
+
 /**
  * @param[in] force_ip_version IP version to force (4 or 6). Use 0 to
  *                             use default (both 4 and 6 if available)
@@ -55,7 +61,16 @@ void control_start(struct control_state *state);
 void control_done(struct control_state *s);
 void control_report_stats(struct control_state *state, const std::string & stat_line);
 void control_report_event(struct control_state *state, const std::string & event_line);
+extern "C" {
+#endif
+
 bool control_stats_enabled(struct control_state *state);
+/// C-callable variant of control_report_stats()
+void control_report_stats_cstr(struct control_state *state, const char *stat_line);
+
+#ifdef __cplusplus
+}
+#endif
 
 
 #endif // control_socket_h_
@@ -70,6 +70,7 @@
 struct openssl_decrypt {
         EVP_CIPHER_CTX *ctx;
         unsigned char key_hash[16];
+        enum openssl_mode mode; ///< mode the key was set for in ctx
 
         unsigned char ivec[AES_BLOCK_SIZE];
         unsigned char ecount[AES_BLOCK_SIZE];
@@ -125,8 +126,15 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         ciphertext += 16;
         ciphertext_len -= 20;
 
-        CHECK(EVP_CipherInit(decrypt->ctx, cipher, decrypt->key_hash, iv, 0), "Unable to initialize cipher");
-        CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len"); // default IV len is presumably 12 bytes
+        if (mode != decrypt->mode) { // set the key only on mode change, then just IV for every packet
+                decrypt->mode = MODE_AES128_NONE;
+                CHECK(EVP_CipherInit_ex(decrypt->ctx, cipher, NULL, decrypt->key_hash, NULL, 0), "Unable to initialize cipher");
+                if (mode == MODE_AES128_GCM) {
+                        CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len"); // default IV len is presumably 12 bytes
+                }
+                decrypt->mode = mode;
+        }
+        CHECK(EVP_CipherInit_ex(decrypt->ctx, NULL, NULL, NULL, iv, 0), "Unable to set IV");
 
         int out_len = 0;
         if (mode == MODE_AES128_GCM) {
@@ -142,7 +150,7 @@ static int openssl_decrypt(struct openssl_decrypt *decrypt,
         if (mode == MODE_AES128_GCM) {
                 CHECK(EVP_CIPHER_CTX_ctrl(decrypt->ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LEN, (void *) (ciphertext + ciphertext_len)), "GCM set tag");
         }
-        CHECK(EVP_CipherFinal(decrypt->ctx, (unsigned char *) plaintext + out_len, &out_len), "EVP_CipherFinal");
+        CHECK(EVP_CipherFinal_ex(decrypt->ctx, (unsigned char *) plaintext + out_len, &out_len), "EVP_CipherFinal");
         total_len += out_len;
 
         if (mode != MODE_AES128_GCM) {
@@ -69,7 +69,7 @@ struct openssl_decrypt_info {
          * @param[in] ciphertext_len lenght of encrypted text
          * @param[in] aad Aditional Authenticated Data (see openssl_encrypt documentation)
          * @param[in] aad_len length of aad block
-         * @param[out] plaintext otput plaintext
+         * @param[out] plaintext otput plaintext, may be (ciphertext + CRYPTO_PREFIX_LEN) to decrypt in place
          * @retval 0 if checksum doesn't match
          * @retval >0 length of output plaintext
          */
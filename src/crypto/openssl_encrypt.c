@@ -45,6 +45,11 @@
  *
  * Encryption algorithm is set in transmit.cpp, detected on receiver. Required
  * algorightms are currently GCM (default) and CBC.
+ *
+ * The key is set to the cipher context only once in init, for every packet
+ * only the IV is changed. For GCM, the IV is composed of a random per-session
+ * salt and a packet counter (deterministic construction, NIST SP 800-38D),
+ * which avoids calling RAND_bytes() for every packet.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -83,8 +88,12 @@ struct openssl_encrypt {
         const EVP_CIPHER *cipher;
         enum openssl_mode mode;
         unsigned char key_hash[16];
+        unsigned char iv_salt[8]; ///< GCM only
+        uint64_t iv_counter;      ///< GCM only
 };
 
+#define CHECK(action, errmsg) do { int rc = action; if (rc != 1) { log_msg(LOG_LEVEL_ERROR, MOD_NAME errmsg ": %s\n", ERR_error_string(ERR_get_error(), NULL)); return 0; } } while(0)
+
 const void *get_cipher(enum openssl_mode mode) {
         switch (mode) {
                case MODE_AES128_NONE:
@@ -114,6 +123,27 @@ const void *get_cipher(enum openssl_mode mode) {
         return NULL;
 }
 
+static void openssl_encrypt_destroy(struct openssl_encrypt *s)
+{
+        EVP_CIPHER_CTX_free(s->ctx);
+        free(s);
+}
+
+/// sets the key to the context, which is then reused for all packets
+static int openssl_encrypt_setup(struct openssl_encrypt *s)
+{
+        CHECK(EVP_CipherInit_ex(s->ctx, s->cipher, NULL, s->key_hash, NULL, 1), "Cannot initialize cipher");
+        if (s->mode == MODE_AES128_GCM) {
+                /* Set IV length if default 12 bytes (96 bits) is not appropriate */
+                CHECK(EVP_CIPHER_CTX_ctrl(s->ctx, EVP_CTRL_GCM_SET_IVLEN, 16, NULL), "set IV len");
+                if (RAND_bytes(s->iv_salt, sizeof s->iv_salt) != 1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate random bytes!\n");
+                        return 0;
+                }
+        }
+        return 1;
+}
+
 static int openssl_encrypt_init(struct openssl_encrypt **state, const char *passphrase,
                 enum openssl_mode mode)
 {
@@ -136,37 +166,41 @@ static int openssl_encrypt_init(struct openssl_encrypt **state, const char *pass
 
         s->ctx = EVP_CIPHER_CTX_new();
         s->mode = mode;
+        if (!openssl_encrypt_setup(s)) {
+                openssl_encrypt_destroy(s);
+                return -1;
+        }
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Encryption set to mode %d\n", (int) mode);
 
         *state = s;
         return 0;
 }
 
-static void openssl_encrypt_destroy(struct openssl_encrypt *s)
-{
-        EVP_CIPHER_CTX_free(s->ctx);
-        free(s);
-}
-
-#define CHECK(action, errmsg) do { int rc = action; if (rc != 1) { log_msg(LOG_LEVEL_ERROR, MOD_NAME errmsg ": %s\n", ERR_error_string(ERR_get_error(), NULL)); return 0; } } while(0)
-
 static int openssl_encrypt(struct openssl_encrypt *encryption,
                 char *plaintext, int data_len, char *aad, int aad_len, char *ciphertext)
 {
+        uint32_t crc = 0;
+        if (encryption->mode != MODE_AES128_GCM) { // compute before plaintext is overwritten (in-place)
+                crc = crc32buf(aad, aad_len);
+                crc = crc32buf_with_oldcrc(plaintext, data_len, crc);
+        }
+
         memcpy(ciphertext, &data_len, sizeof(uint32_t));
         int total_len = sizeof(uint32_t);
 
         unsigned char ivec[16];
-        if (RAND_bytes(ivec, 8) < 0) {
+        if (encryption->mode == MODE_AES128_GCM) {
+                memcpy(ivec, encryption->iv_salt, sizeof encryption->iv_salt);
+                memcpy(ivec + sizeof encryption->iv_salt, &encryption->iv_counter, sizeof encryption->iv_counter);
+                encryption->iv_counter += 1;
+        } else if (RAND_bytes(ivec, sizeof ivec) != 1) {
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot generate random bytes!\n");
                 return 0;
         }
         memcpy(ciphertext + total_len, ivec, sizeof ivec);
         total_len += sizeof ivec;
 
-        CHECK(EVP_CipherInit(encryption->ctx, encryption->cipher, encryption->key_hash, ivec, 1), "Cannot initialize cipher");
-        /* Set IV length if default 12 bytes (96 bits) is not appropriate */
-        CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof ivec, NULL), "set IV len");
+        CHECK(EVP_CipherInit_ex(encryption->ctx, NULL, NULL, NULL, ivec, 1), "Cannot set IV");
         int out_len = 0;
         if (encryption->mode == MODE_AES128_GCM) {
                 if (aad_len > 0) {
@@ -176,12 +210,10 @@ static int openssl_encrypt(struct openssl_encrypt *encryption,
         CHECK(EVP_CipherUpdate(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) plaintext, data_len), "EVP_CipherUpdate");
         total_len += out_len;
         if (encryption->mode != MODE_AES128_GCM) {
-                uint32_t crc = crc32buf(aad, aad_len);
-                crc = crc32buf_with_oldcrc(plaintext, data_len, crc);
                 CHECK(EVP_CipherUpdate(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len, (unsigned char *) &crc, sizeof crc), "EVP_CipherUpdate CRC");
                 total_len += out_len;
         }
-        CHECK(EVP_CipherFinal(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len), "EVP_CipherFinal");
+        CHECK(EVP_CipherFinal_ex(encryption->ctx, (unsigned char *) ciphertext + total_len, &out_len), "EVP_CipherFinal");
         total_len += out_len;
         if (encryption->mode == MODE_AES128_GCM) {
                 CHECK(EVP_CIPHER_CTX_ctrl(encryption->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LEN, ciphertext + total_len), "GCM get tag");
@@ -191,10 +223,23 @@ static int openssl_encrypt(struct openssl_encrypt *encryption,
         return total_len;
 }
 
+static int openssl_encrypt_batch(struct openssl_encrypt *encryption,
+                struct openssl_encrypt_block *blocks, int count)
+{
+        for (int i = 0; i < count; ++i) {
+                blocks[i].ciphertext_len = openssl_encrypt(encryption, blocks[i].plaintext,
+                                blocks[i].plaintext_len, blocks[i].aad, blocks[i].aad_len,
+                                blocks[i].ciphertext);
+                if (blocks[i].ciphertext_len == 0) {
+                        return i;
+                }
+        }
+        return count;
+}
+
 static int openssl_get_overhead(struct openssl_encrypt *s)
 {
-        return sizeof(uint32_t) /* data_len */ +
-                16 /* nonce + counter */ + (s->mode == MODE_AES128_GCM ? GCM_TAG_LEN : sizeof(uint32_t) /* crc */)
+        return CRYPTO_PREFIX_LEN /* data_len + nonce + counter */ + (s->mode == MODE_AES128_GCM ? GCM_TAG_LEN : sizeof(uint32_t) /* crc */)
                 + (s->mode == MODE_AES128_ECB ? 15 : 0 /* padding */);
 }
 
@@ -203,6 +248,7 @@ static const struct openssl_encrypt_info functions = {
         openssl_encrypt_destroy,
         openssl_encrypt,
         openssl_get_overhead,
+        openssl_encrypt_batch,
 };
 
 REGISTER_MODULE(openssl_encrypt, &functions, LIBRARY_CLASS_UNDEFINED, OPENSSL_ENCRYPT_ABI_VERSION);
@@ -56,8 +56,19 @@ const void *get_cipher(enum openssl_mode mode);
 #define MAX_CRYPTO_EXTRA_DATA 36 // == maximal overhead of available encryptions (datalen+IV+CRC/tag)
 #define MAX_CRYPTO_PAD 15 // ECB needs to be padded
 #define MAX_CRYPTO_EXCEED (MAX_CRYPTO_EXTRA_DATA + MAX_CRYPTO_PAD)
+#define CRYPTO_PREFIX_LEN 20 // data_len + IV preceding the encrypted data
 
-#define OPENSSL_ENCRYPT_ABI_VERSION 1
+#define OPENSSL_ENCRYPT_ABI_VERSION 2
+
+/// block description for openssl_encrypt_info::encrypt_batch
+struct openssl_encrypt_block {
+        char *plaintext;
+        int plaintext_len;
+        char *aad;
+        int aad_len;
+        char *ciphertext;   ///< either distinct buffer or (plaintext - CRYPTO_PREFIX_LEN) to encrypt in place
+        int ciphertext_len; ///< [out] size of written ciphertext
+};
 
 struct openssl_encrypt_info {
         /**
@@ -86,6 +97,7 @@ struct openssl_encrypt_info {
          *                          These data are autheticated only if working in some AE mode
          * @param[in] aad_len       length of AAD text
          * @param[out] ciphertext   resulting ciphertext, can be up to (plaintext_len + MAX_CRYPTO_EXCEED) length
+         *                          May also be (plaintext - CRYPTO_PREFIX_LEN) to encrypt in place.
          * @returns   size of writen ciphertext
          * @retval 0 on error
          */
@@ -99,6 +111,17 @@ struct openssl_encrypt_info {
          * @returns max overhead (must be <= MAX_CRYPTO_EXCEED)
          */
         int (*get_overhead)(struct openssl_encrypt *encryption);
+        /**
+         * Encrypts multiple blocks at once (eg. all packets of a frame),
+         * equivalent to calling encrypt() for each of them.
+         *
+         * @param[in]     encryption state
+         * @param[in,out] blocks     blocks to be encrypted
+         * @param[in]     count      number of blocks
+         * @returns   number of successfully encrypted blocks (stops at first error)
+         */
+        int (*encrypt_batch)(struct openssl_encrypt *encryption,
+                        struct openssl_encrypt_block *blocks, int count);
 };
 
 #endif // OPENSSL_ENCRYPT_H_
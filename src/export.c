@@ -67,6 +67,7 @@ struct exporter {
         bool exporting;
         bool noaudio;
         bool novideo;
+        bool container; ///< use single-file (segmented) video layout
         pthread_mutex_t lock;
 
         long long int limit; ///< number of video frames to record, -1 == unlimited (default)
@@ -83,12 +84,13 @@ static void new_msg(struct module *mod) {
 
 static void usage() {
         color_printf("Usage:\n");
-        color_printf(TERM_BOLD TERM_FG_RED "\t--record" TERM_FG_RESET "[=<dir>[:limit=<n>][:noaudio][:novideo][:override][:paused]]\n" TERM_RESET);
+        color_printf(TERM_BOLD TERM_FG_RED "\t--record" TERM_FG_RESET "[=<dir>[:limit=<n>][:noaudio][:novideo][:override][:paused][:container]]\n" TERM_RESET);
         color_printf("where\n");
         color_printf(TERM_BOLD "\tlimit=<n>" TERM_RESET "         - write at most <n> video frames\n");
         color_printf(TERM_BOLD "\toverride" TERM_RESET "          - export even if it would override existing files in the given directory\n");
         color_printf(TERM_BOLD "\tnoaudio | novideo" TERM_RESET " - do not export audio/video\n");
         color_printf(TERM_BOLD "\tpaused" TERM_RESET "            - use specified directory but do not export immediately (can be started with a key or through control socket)\n");
+        color_printf(TERM_BOLD "\tcontainer" TERM_RESET "         - store video in large segment files with an index instead of a file per frame (faster on network storage)\n");
 }
 
 static bool parse_options(struct exporter *s, char *save_ptr, bool *should_export) {
@@ -105,6 +107,8 @@ static bool parse_options(struct exporter *s, char *save_ptr, bool *should_expor
                         s->override = true;
                 } else if (strstr(item, "paused") == item) {
                         *should_export = false; // start paused
+                } else if (strcmp(item, "container") == 0) {
+                        s->container = true;
                 } else if (strstr(item, "limit=") == item) {
                         s->limit = strtoll(item + strlen("limit="), NULL, 0);
                         if (s->limit < 0) {
@@ -171,7 +175,7 @@ static bool enable_export(struct exporter *s)
         }
 
         if (!s->novideo) {
-                s->video_export = video_export_init(s->dir);
+                s->video_export = video_export_init(s->dir, s->container);
                 if (!s->video_export) {
                         goto error;
                 }
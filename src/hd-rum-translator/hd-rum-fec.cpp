@@ -0,0 +1,155 @@
+/**
+ * @file   hd-rum-translator/hd-rum-fec.cpp
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+#include "debug.h"
+#include "hd-rum-translator/hd-rum-fec.h"
+#include "rtp/rtp_types.h"
+#include "rtp/video_decoders.h"
+#include "video_frame.h"
+
+#define MOD_NAME "[hd-rum-fec] "
+#define RTP_HDR_LEN 12
+#define MAX_FRAME_LEN (64 * 1024 * 1024)
+
+frame_reassembler::~frame_reassembler()
+{
+        reset();
+}
+
+void frame_reassembler::reset()
+{
+        for (auto &t : tiles) {
+                free(t.data);
+        }
+        tiles.clear();
+}
+
+bool frame_reassembler::write(const char *pkt, int len, std::shared_ptr<video_frame> *out)
+{
+        if (len < RTP_HDR_LEN || (pkt[0] & 0xc0) != 0x80 || (pkt[1] & 0x7f) != PT_VIDEO) {
+                return false;
+        }
+        int hdr_len = RTP_HDR_LEN + 4 * (pkt[0] & 0x0f);
+        if ((pkt[0] & 0x10) != 0 && len >= hdr_len + 4) { // extension
+                uint16_t ext_words = 0;
+                memcpy(&ext_words, pkt + hdr_len + 2, sizeof ext_words);
+                hdr_len += 4 + 4 * ntohs(ext_words);
+        }
+        if (len < hdr_len + (int) sizeof(video_payload_hdr_t)) {
+                return false;
+        }
+        bool marker = (pkt[1] & 0x80) != 0;
+
+        video_payload_hdr_t hdr;
+        memcpy(hdr, pkt + hdr_len, sizeof hdr);
+        const char *payload = pkt + hdr_len + sizeof hdr;
+        int payload_len = len - hdr_len - sizeof hdr;
+        unsigned substream = ntohl(hdr[0]) >> 22;
+        uint32_t buf_id = ntohl(hdr[0]) & 0x3fffff;
+        uint32_t offset = ntohl(hdr[1]);
+        uint32_t frame_len = ntohl(hdr[2]);
+
+        if (buf_id != buffer_id) {
+                if (!tiles.empty()) { // previous frame didn't receive its last packet
+                        incomplete += 1;
+                        reset();
+                }
+                buffer_id = buf_id;
+                memcpy(video_hdr, hdr, sizeof hdr);
+        }
+        if (frame_len > MAX_FRAME_LEN || offset > frame_len || (uint32_t) payload_len > frame_len - offset) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Invalid packet (offset %" PRIu32 ", length %d, frame length %" PRIu32 ")!\n",
+                                offset, payload_len, frame_len);
+                return true;
+        }
+        if (substream >= tiles.size()) {
+                tiles.resize(substream + 1);
+        }
+        auto &t = tiles[substream];
+        if (t.data == nullptr) {
+                t.data = (char *) malloc(frame_len);
+                t.len = frame_len;
+        }
+        if (t.len != frame_len) {
+                return true;
+        }
+        memcpy(t.data + offset, payload, payload_len);
+        t.received += payload_len;
+
+        if (!marker) {
+                return true;
+        }
+
+        bool complete = true;
+        for (auto &tl : tiles) {
+                complete = complete && tl.data != nullptr && tl.received >= tl.len;
+        }
+        if (!complete) {
+                incomplete += 1;
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Dropped incomplete frame (%d since last report).\n", incomplete);
+                reset();
+                return true;
+        }
+        incomplete = 0;
+
+        struct video_desc desc{};
+        if (!parse_video_hdr(video_hdr, &desc)) {
+                reset();
+                return true;
+        }
+        desc.tile_count = tiles.size();
+        struct video_frame *f = vf_alloc_desc(desc);
+        for (unsigned i = 0; i < f->tile_count; ++i) {
+                f->tiles[i].data = tiles[i].data;
+                f->tiles[i].data_len = tiles[i].len;
+                tiles[i].data = nullptr;
+        }
+        f->callbacks.data_deleter = vf_data_deleter;
+        tiles.clear();
+        *out = std::shared_ptr<video_frame>(f, vf_free);
+        return true;
+}
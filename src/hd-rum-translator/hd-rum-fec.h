@@ -0,0 +1,83 @@
+/**
+ * @file   hd-rum-translator/hd-rum-fec.h
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  reassembly of forwarded video packets to frames for per-replica FEC
+ *
+ * Forwarding replicas with FEC set (host option -f without -c) don't
+ * get the received packets verbatim. The packets are instead reassembled
+ * to the (still compressed) frame, which is then sent through the replica
+ * output port, that applies the FEC and packetizes the frame again. No
+ * decoding takes place, so only the replicas asking for FEC pay for it.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HD_RUM_FEC_H_5C2E8A41_7B3D_4F69_A0D2_1E8C4B7F3A96
+#define HD_RUM_FEC_H_5C2E8A41_7B3D_4F69_A0D2_1E8C4B7F3A96
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct video_frame;
+
+class frame_reassembler {
+public:
+        frame_reassembler() = default;
+        frame_reassembler(const frame_reassembler &) = delete;
+        frame_reassembler &operator=(const frame_reassembler &) = delete;
+        ~frame_reassembler();
+
+        /**
+         * @param[out] out  set to the completed frame after its last packet
+         *                  was written (otherwise left untouched)
+         * @retval false    packet is not a (plain, unencrypted) video packet
+         *                  and should be forwarded as is
+         */
+        bool write(const char *pkt, int len, std::shared_ptr<video_frame> *out);
+
+private:
+        struct tile {
+                char *data = nullptr;
+                uint32_t len = 0;
+                uint32_t received = 0;
+        };
+        void reset();
+
+        uint32_t buffer_id = UINT32_MAX;
+        uint32_t video_hdr[6]{};
+        std::vector<tile> tiles;
+        int incomplete = 0; ///< frames dropped for lost packets since last report
+};
+
+#endif // defined HD_RUM_FEC_H_5C2E8A41_7B3D_4F69_A0D2_1E8C4B7F3A96
@@ -0,0 +1,283 @@
+/**
+ * @file   hd-rum-translator/hd-rum-offload.cpp
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <mutex>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "debug.h"
+#include "hd-rum-translator/hd-rum-offload.h"
+#include "utils/fs.h"
+#include "utils/net.h"
+
+#define MOD_NAME "[hd-rum-offload] "
+#define BPF_OBJ_PATH "/share/ultragrid/bpf/hd-rum-reflect.bpf.o"
+
+using std::mutex;
+using std::lock_guard;
+using std::string;
+using std::vector;
+
+struct offload_slot {
+        bool used = false;
+        struct sockaddr_in addr{};
+        uint64_t packets = 0; ///< last reported value
+        uint64_t missed = 0;  ///< last reported value
+};
+
+struct hd_rum_offload {
+        struct bpf_object *obj = nullptr;
+        struct bpf_tc_hook hook{};
+        struct bpf_tc_opts opts{};
+        bool hook_created = false;
+        bool attached = false;
+        int conf_fd = -1;
+        int targets_fd = -1;
+        int prime_fd = -1; ///< socket to trigger neighbor resolution
+        uint16_t port = 0;
+
+        mutex lock;
+        vector<offload_slot> slots{HD_RUM_OFFLOAD_MAX_TARGETS};
+};
+
+static bool update_conf(struct hd_rum_offload *s)
+{
+        struct hd_rum_offload_conf conf{};
+        conf.port = htons(s->port);
+        for (unsigned i = 0; i < s->slots.size(); ++i) {
+                if (s->slots[i].used) {
+                        conf.count = i + 1;
+                }
+        }
+        __u32 key = 0;
+        if (bpf_map_update_elem(s->conf_fd, &key, &conf, BPF_ANY) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot update configuration: %s\n", strerror(errno));
+                return false;
+        }
+        return true;
+}
+
+/**
+ * The eBPF program only looks up the neighbor table (it doesn't trigger
+ * the resolution), so an empty datagram is sent to the target from the
+ * userspace to get the neighbor resolved.
+ */
+static void prime_neighbor(struct hd_rum_offload *s, const struct sockaddr_in *addr)
+{
+        if (sendto(s->prime_fd, "", 0, 0, (const struct sockaddr *) addr, sizeof *addr) < 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cannot send to %s: %s\n",
+                                get_sockaddr_str((struct sockaddr *) addr), strerror(errno));
+        }
+}
+
+struct hd_rum_offload *hd_rum_offload_init(const char *ifname, uint16_t port)
+{
+        unsigned ifindex = if_nametoindex(ifname);
+        if (ifindex == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown interface %s!\n", ifname);
+                return nullptr;
+        }
+
+        auto *s = new hd_rum_offload();
+        s->port = port;
+        s->prime_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+        const char *root = get_install_root();
+        string path = string(root ? root : "..") + BPF_OBJ_PATH;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Loading %s\n", path.c_str());
+        struct bpf_program *prog = nullptr;
+        int ret = 0;
+        if ((s->obj = bpf_object__open_file(path.c_str(), nullptr)) == nullptr
+                        || (ret = bpf_object__load(s->obj)) != 0
+                        || (prog = bpf_object__find_program_by_name(s->obj, "hd_rum_reflect")) == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot load eBPF program %s: %s\n", path.c_str(),
+                                strerror(ret != 0 ? -ret : errno));
+                hd_rum_offload_done(s);
+                return nullptr;
+        }
+        s->conf_fd = bpf_object__find_map_fd_by_name(s->obj, "conf");
+        s->targets_fd = bpf_object__find_map_fd_by_name(s->obj, "targets");
+        if (s->conf_fd < 0 || s->targets_fd < 0 || s->prime_fd < 0 || !update_conf(s)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot initialize eBPF maps!\n");
+                hd_rum_offload_done(s);
+                return nullptr;
+        }
+
+        s->hook.sz = sizeof s->hook;
+        s->hook.ifindex = ifindex;
+        s->hook.attach_point = BPF_TC_INGRESS;
+        ret = bpf_tc_hook_create(&s->hook);
+        if (ret != 0 && ret != -EEXIST) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create tc hook on %s: %s\n", ifname, strerror(-ret));
+                hd_rum_offload_done(s);
+                return nullptr;
+        }
+        s->hook_created = ret == 0;
+        s->opts.sz = sizeof s->opts;
+        s->opts.prog_fd = bpf_program__fd(prog);
+        ret = bpf_tc_attach(&s->hook, &s->opts);
+        if (ret != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot attach eBPF program to %s: %s\n", ifname, strerror(-ret));
+                hd_rum_offload_done(s);
+                return nullptr;
+        }
+        s->attached = true;
+
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Forwarding offloaded to kernel on %s.\n", ifname);
+        return s;
+}
+
+int hd_rum_offload_add(struct hd_rum_offload *s, struct sockaddr *addr, socklen_t addrlen)
+{
+        struct sockaddr_in sin{};
+        if (addr->sa_family == AF_INET && addrlen >= sizeof sin) {
+                memcpy(&sin, addr, sizeof sin);
+        } else if (addr->sa_family == AF_INET6 &&
+                        IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *)(void *) addr)->sin6_addr)) {
+                const auto *sin6 = (struct sockaddr_in6 *)(void *) addr;
+                sin.sin_family = AF_INET;
+                sin.sin_port = sin6->sin6_port;
+                memcpy(&sin.sin_addr, &sin6->sin6_addr.s6_addr[12], sizeof sin.sin_addr);
+        } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Only IPv4 targets can be offloaded, %s served from userspace.\n",
+                                get_sockaddr_str(addr));
+                return -1;
+        }
+
+        lock_guard<mutex> lk(s->lock);
+        int slot = 0;
+        while (slot < (int) s->slots.size() && s->slots[slot].used) {
+                slot++;
+        }
+        if (slot == (int) s->slots.size()) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Maximum of %d offloaded targets reached, %s served from userspace.\n",
+                                HD_RUM_OFFLOAD_MAX_TARGETS, get_sockaddr_str(addr));
+                return -1;
+        }
+
+        struct hd_rum_offload_target target{};
+        target.active = 1;
+        target.addr = sin.sin_addr.s_addr;
+        target.port = sin.sin_port;
+        __u32 key = slot;
+        if (bpf_map_update_elem(s->targets_fd, &key, &target, BPF_ANY) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot add target %s: %s\n", get_sockaddr_str(addr), strerror(errno));
+                return -1;
+        }
+        s->slots[slot] = offload_slot{};
+        s->slots[slot].used = true;
+        s->slots[slot].addr = sin;
+        if (!update_conf(s)) {
+                hd_rum_offload_remove(s, slot);
+                return -1;
+        }
+        prime_neighbor(s, &sin);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Target %s offloaded (slot %d).\n", get_sockaddr_str(addr), slot);
+        return slot;
+}
+
+void hd_rum_offload_remove(struct hd_rum_offload *s, int slot)
+{
+        if (slot < 0 || slot >= (int) s->slots.size()) {
+                return;
+        }
+        lock_guard<mutex> lk(s->lock);
+        struct hd_rum_offload_target target{};
+        __u32 key = slot;
+        if (bpf_map_update_elem(s->targets_fd, &key, &target, BPF_ANY) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot remove target: %s\n", strerror(errno));
+        }
+        s->slots[slot].used = false;
+        update_conf(s);
+}
+
+void hd_rum_offload_report(struct hd_rum_offload *s)
+{
+        lock_guard<mutex> lk(s->lock);
+        for (unsigned i = 0; i < s->slots.size(); ++i) {
+                auto &slot = s->slots[i];
+                struct hd_rum_offload_target target{};
+                __u32 key = i;
+                if (!slot.used || bpf_map_lookup_elem(s->targets_fd, &key, &target) != 0) {
+                        continue;
+                }
+                uint64_t packets = target.packets - slot.packets;
+                uint64_t missed = target.missed - slot.missed;
+                log_msg(missed > 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE, MOD_NAME "%s: forwarded %" PRIu64 " packets, %" PRIu64 " failed\n",
+                                get_sockaddr_str((struct sockaddr *) &slot.addr), packets, missed);
+                if (missed > 0) {
+                        prime_neighbor(s, &slot.addr);
+                }
+                slot.packets = target.packets;
+                slot.missed = target.missed;
+        }
+}
+
+void hd_rum_offload_done(struct hd_rum_offload *s)
+{
+        if (s == nullptr) {
+                return;
+        }
+        if (s->attached) {
+                s->opts.flags = s->opts.prog_fd = s->opts.prog_id = 0;
+                bpf_tc_detach(&s->hook, &s->opts);
+        }
+        if (s->hook_created) {
+                s->hook.attach_point = (enum bpf_tc_attach_point) (BPF_TC_INGRESS | BPF_TC_EGRESS);
+                bpf_tc_hook_destroy(&s->hook);
+        }
+        bpf_object__close(s->obj);
+        if (s->prime_fd >= 0) {
+                close(s->prime_fd);
+        }
+        delete s;
+}
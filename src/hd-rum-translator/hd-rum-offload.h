@@ -0,0 +1,99 @@
+/**
+ * @file   hd-rum-translator/hd-rum-offload.h
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  kernel (eBPF) offload of the forwarding replicas
+ *
+ * A tc ingress eBPF program clones the packets received on the reflector
+ * port directly to the forwarding (USE_SOCK) replicas so that they are not
+ * copied to and sent from the userspace. Only IPv4 is supported.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HD_RUM_OFFLOAD_H_7A1C3E52_5B8D_4C6A_9E0F_2D4B6A8C1E3F
+#define HD_RUM_OFFLOAD_H_7A1C3E52_5B8D_4C6A_9E0F_2D4B6A8C1E3F
+
+#include <linux/types.h>
+
+#define HD_RUM_OFFLOAD_MAX_TARGETS 64
+
+/// layout shared with the eBPF program (map "conf", single entry)
+struct hd_rum_offload_conf {
+        __be16 port;   ///< reflector RX port
+        __u16 pad;
+        __u32 count;   ///< number of target slots to be iterated
+};
+
+/// layout shared with the eBPF program (map "targets")
+struct hd_rum_offload_target {
+        __u32 active;
+        __be32 addr;
+        __be16 port;
+        __u16 pad;
+        __u64 packets; ///< updated by the eBPF program
+        __u64 missed;  ///< updated by the eBPF program (eg. unresolved neighbor)
+};
+
+#ifndef HD_RUM_OFFLOAD_BPF
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hd_rum_offload;
+
+/**
+ * Loads the eBPF program and attaches it to ingress of the interface.
+ * @param ifname  interface receiving the reflected stream
+ * @param port    reflector RX port
+ */
+struct hd_rum_offload *hd_rum_offload_init(const char *ifname, uint16_t port);
+/**
+ * @returns slot identifying the target for hd_rum_offload_remove(), -1 if
+ * the address cannot be offloaded (the replica needs to be served from
+ * the userspace)
+ */
+int hd_rum_offload_add(struct hd_rum_offload *s, struct sockaddr *addr, socklen_t addrlen);
+void hd_rum_offload_remove(struct hd_rum_offload *s, int slot);
+/// logs forwarding statistics and refreshes neighbors of the targets with failures
+void hd_rum_offload_report(struct hd_rum_offload *s);
+void hd_rum_offload_done(struct hd_rum_offload *s);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !defined HD_RUM_OFFLOAD_BPF
+
+#endif // defined HD_RUM_OFFLOAD_H_7A1C3E52_5B8D_4C6A_9E0F_2D4B6A8C1E3F
@@ -47,6 +47,8 @@
 
 #include <cinttypes>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <string>
@@ -62,48 +64,97 @@
 
 #include "video_rxtx/ultragrid_rtp.h"
 #include "utils/profile_timer.hpp"
+#include "utils/thread.h"
+#include "utils/video_frame_pool.h"
+#include "utils/video_scaler.h"
 
 namespace {
 struct compress_state_deleter{
         void operator()(struct compress_state *s){ module_done(CAST_MODULE(s)); }
 };
+struct video_scaler_deleter{
+        void operator()(struct video_scaler *s){ video_scaler_destroy(s); }
+};
 }
 
 using namespace std;
 
+#define PORT_QUEUE_LEN 4 ///< compressed frames waiting for a port sender, the oldest is dropped on overflow
+
+/**
+ * Each port is sent from its own thread (through a short queue) so that
+ * a slow port (eg. encrypting one) doesn't delay the other ports of the
+ * worker.
+ */
 struct recompress_output_port {
-        recompress_output_port() = default;
         recompress_output_port(struct module *parent,
                 std::string host, unsigned short rx_port,
                 unsigned short tx_port, int mtu, const char *fec, long long bitrate);
+        ~recompress_output_port();
+        recompress_output_port(const recompress_output_port &) = delete;
+        recompress_output_port &operator=(const recompress_output_port &) = delete;
+
+        void push(shared_ptr<video_frame> frame);
+        void sender();
 
         std::unique_ptr<ultragrid_rtp_video_rxtx> video_rxtx;
         std::string host;
         int tx_port;
+        std::pair<int, int> scale{0, 0}; ///< output size, {0, 0} - full resolution
 
         std::chrono::steady_clock::time_point t0{std::chrono::steady_clock::now()};
         int frames;
+        int dropped = 0;
+        struct recompress_port_stats stats{}; ///< since last recompress_port_get_stats(), guarded by queue_lock
 
         bool active;
+
+        std::mutex queue_lock;
+        std::condition_variable queue_cv;
+        std::deque<shared_ptr<video_frame>> queue;
+        bool should_exit = false;
+        std::thread sender_thread;
 };
 
 struct recompress_worker_ctx {
         std::string compress_cfg;
+        std::pair<int, int> scale{0, 0}; ///< size of frames passed to the compression
         std::unique_ptr<compress_state, compress_state_deleter> compress;
 
         std::mutex ports_mut;
-        std::vector<recompress_output_port> ports;
+        std::vector<std::unique_ptr<recompress_output_port>> ports;
 
         std::thread thread;
 };
 
+/**
+ * Produces the frames for one output size. Shared by all the workers
+ * (compressions) requiring the size so that the frame is scaled only once.
+ */
+struct recompress_scaler {
+        std::unique_ptr<video_scaler, video_scaler_deleter> scaler{video_scaler_create(VIDEO_SCALER_BICUBIC)};
+        video_frame_pool pool;
+        struct video_desc desc{};
+        bool unsupported_reported = false;
+};
+
 struct state_recompress {
         struct module *parent;
         std::mutex mut;
+        /// worker key (see worker_key()) -> worker
         std::map<std::string, recompress_worker_ctx> workers;
         std::vector<std::pair<std::string, int>> index_to_port;
+        std::map<std::pair<int, int>, recompress_scaler> scalers;
 };
 
+static std::string worker_key(const std::string &compress, std::pair<int, int> scale)
+{
+        if (scale.first == 0) {
+                return compress;
+        }
+        return compress + "@" + to_string(scale.first) + "x" + to_string(scale.second);
+}
+
 recompress_output_port::recompress_output_port(struct module *parent,
                 std::string host, unsigned short rx_port,
                 unsigned short tx_port, int mtu, const char *fec, long long bitrate) :
@@ -148,6 +199,34 @@ recompress_output_port::recompress_output_port(struct module *parent,
         }
 
         video_rxtx.reset(dynamic_cast<ultragrid_rtp_video_rxtx *>(rxtx));
+        sender_thread = std::thread(&recompress_output_port::sender, this);
+}
+
+recompress_output_port::~recompress_output_port()
+{
+        {
+                std::lock_guard<std::mutex> lk(queue_lock);
+                should_exit = true;
+        }
+        queue_cv.notify_one();
+        if (sender_thread.joinable()) {
+                sender_thread.join();
+        }
+}
+
+/// called by the worker, never blocks on the port sending
+void recompress_output_port::push(shared_ptr<video_frame> frame)
+{
+        {
+                std::lock_guard<std::mutex> lk(queue_lock);
+                if (queue.size() >= PORT_QUEUE_LEN) {
+                        queue.pop_front();
+                        dropped += 1;
+                        stats.dropped += 1;
+                }
+                queue.push_back(std::move(frame));
+        }
+        queue_cv.notify_one();
 }
 
 static void recompress_port_write(recompress_output_port& port, shared_ptr<video_frame> frame)
@@ -161,18 +240,50 @@ static void recompress_port_write(recompress_output_port& port, shared_ptr<video
         double seconds = chrono::duration_cast<chrono::duration<double>>(now - port.t0).count();
         if(seconds > 5) {
                 double fps = port.frames / seconds;
-                log_msg(LOG_LEVEL_INFO, "[0x%08" PRIx32 "->%s:%d:0x%08" PRIx32 "] %d frames in %g seconds = %g FPS\n",
+                int dropped = 0;
+                {
+                        std::lock_guard<std::mutex> lk(port.queue_lock);
+                        std::swap(dropped, port.dropped);
+                }
+                log_msg(dropped > 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_INFO, "[0x%08" PRIx32 "->%s:%d:0x%08" PRIx32 "] %d frames in %g seconds = %g FPS (%d dropped)\n",
                                 frame->ssrc,
                                 port.host.c_str(), port.tx_port,
                                 port.video_rxtx->get_ssrc(),
-                                port.frames, seconds, fps);
+                                port.frames, seconds, fps, dropped);
                 port.t0 = now;
                 port.frames = 0;
         }
+        {
+                std::lock_guard<std::mutex> lk(port.queue_lock);
+                port.stats.frames += 1;
+                if (frame->compress_start != 0 && frame->compress_end >= frame->compress_start) {
+                        uint64_t latency = frame->compress_end - frame->compress_start;
+                        port.stats.latency_sum_ms += latency;
+                        port.stats.latency_max_ms = std::max(port.stats.latency_max_ms, latency);
+                }
+        }
 
         port.video_rxtx->send(frame);
 }
 
+void recompress_output_port::sender()
+{
+        set_thread_name("recompress_port");
+        while (true) {
+                shared_ptr<video_frame> frame;
+                {
+                        std::unique_lock<std::mutex> lk(queue_lock);
+                        queue_cv.wait(lk, [this] { return should_exit || !queue.empty(); });
+                        if (should_exit) {
+                                return;
+                        }
+                        frame = std::move(queue.front());
+                        queue.pop_front();
+                }
+                recompress_port_write(*this, std::move(frame));
+        }
+}
+
 static void recompress_worker(struct recompress_worker_ctx *ctx){
         PROFILE_FUNC;
         assert(ctx->compress);
@@ -180,23 +291,28 @@ static void recompress_worker(struct recompress_worker_ctx *ctx){
         while(auto frame = compress_pop(ctx->compress.get())){
                 std::lock_guard<std::mutex> lock(ctx->ports_mut);
                 for(auto& port : ctx->ports){
-                        if(port.active)
-                                recompress_port_write(port, frame);
+                        if(port->active)
+                                port->push(frame);
                 }
                 PROFILE_DETAIL("compress_pop");
         }
 }
 
+/// @returns index of the port in the worker, the worker key is stored to key
 static int move_port_to_worker(struct state_recompress *s, const char *compress,
-                recompress_output_port&& port)
+                std::unique_ptr<recompress_output_port> port, std::string *key)
 {
-        auto& worker = s->workers[compress];
+        *key = worker_key(compress, port->scale);
+        auto& worker = s->workers[*key];
         if(!worker.compress){
                 worker.compress_cfg = compress;
+                worker.scale = port->scale;
                 compress_state *cmp = nullptr;
                 int ret = compress_init(s->parent, compress, &cmp);
-                if(ret != 0)
+                if(ret != 0) {
+                        s->workers.erase(*key);
                         return -1;
+                }
                 worker.compress.reset(cmp);
 
                 worker.thread = std::thread(recompress_worker, &worker);
@@ -211,33 +327,48 @@ static int move_port_to_worker(struct state_recompress *s, const char *compress,
 
 int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
 		const char *host, const char *compress, unsigned short rx_port,
-		unsigned short tx_port, int mtu, const char *fec, long long bitrate)
+		unsigned short tx_port, int mtu, const char *fec, long long bitrate,
+		const char *scale)
 {
-        recompress_output_port port;
+        std::unique_ptr<recompress_output_port> port;
+        std::pair<int, int> scale_size{0, 0};
+        if (scale != nullptr) {
+                char *endptr = nullptr;
+                scale_size.first = strtol(scale, &endptr, 10);
+                if (*endptr == 'x') {
+                        scale_size.second = strtol(endptr + 1, &endptr, 10);
+                }
+                if (*endptr != '\0' || scale_size.first <= 0 || scale_size.second <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, "Wrong output size: %s (expected <width>x<height>)\n", scale);
+                        return -1;
+                }
+        }
 
         try{
-                port = recompress_output_port(parent_rep, host, rx_port, tx_port,
+                port = std::make_unique<recompress_output_port>(parent_rep, host, rx_port, tx_port,
                                 mtu, fec, bitrate);
         } catch(...) {
                 return -1;
         }
+        port->scale = scale_size;
 
         std::lock_guard<std::mutex> lock(s->mut);
-        int index_in_worker = move_port_to_worker(s, compress, std::move(port));
+        std::string key;
+        int index_in_worker = move_port_to_worker(s, compress, std::move(port), &key);
         if(index_in_worker < 0)
                 return -1;
 
         int index_of_port = s->index_to_port.size();
-        s->index_to_port.emplace_back(compress, index_in_worker);
+        s->index_to_port.emplace_back(key, index_in_worker);
 
         return index_of_port;
 }
 
 static void extract_port(struct state_recompress *s,
-                const std::string& compress_cfg, int i,
-                recompress_output_port *move_to = nullptr)
+                const std::string& key, int i,
+                std::unique_ptr<recompress_output_port> *move_to = nullptr)
 {
-        auto& worker = s->workers[compress_cfg];
+        auto& worker = s->workers[key];
         {
                 std::unique_lock<std::mutex> lock(worker.ports_mut);
                 if(move_to)
@@ -248,12 +379,12 @@ static void extract_port(struct state_recompress *s,
                         //poison compress
                         compress_frame(worker.compress.get(), nullptr);
                         worker.thread.join();
-                        s->workers.erase(compress_cfg);
+                        s->workers.erase(key);
                 }
         }
 
         for(auto& p : s->index_to_port){
-                if(p.first == compress_cfg && p.second > i)
+                if(p.first == key && p.second > i)
                         p.second--;
         }
 }
@@ -271,7 +402,20 @@ uint32_t recompress_get_port_ssrc(struct state_recompress *s, int idx){
         auto [compress_cfg, i] = s->index_to_port[idx];
 
         std::lock_guard<std::mutex> work_lock(s->workers[compress_cfg].ports_mut);
-        return s->workers[compress_cfg].ports[i].video_rxtx->get_ssrc();
+        return s->workers[compress_cfg].ports[i]->video_rxtx->get_ssrc();
+}
+
+void recompress_port_get_stats(struct state_recompress *s, int index,
+                struct recompress_port_stats *stats)
+{
+        std::lock_guard<std::mutex> lock(s->mut);
+        auto [key, i] = s->index_to_port[index];
+
+        std::lock_guard<std::mutex> work_lock(s->workers[key].ports_mut);
+        auto &port = *s->workers[key].ports[i];
+        std::lock_guard<std::mutex> lk(port.queue_lock);
+        *stats = port.stats;
+        port.stats = {};
 }
 
 void recompress_port_set_active(struct state_recompress *s,
@@ -281,28 +425,29 @@ void recompress_port_set_active(struct state_recompress *s,
         auto [compress_cfg, i] = s->index_to_port[index];
 
         std::unique_lock<std::mutex> worker_lock(s->workers[compress_cfg].ports_mut);
-        s->workers[compress_cfg].ports[i].active = active;
+        s->workers[compress_cfg].ports[i]->active = active;
 }
 
 bool recompress_port_change_compress(struct state_recompress *s, int index,
                 const char *new_compress)
 {
         std::lock_guard<std::mutex> lock(s->mut);
-        auto [old_compress, i] = s->index_to_port[index];
+        auto [old_key, i] = s->index_to_port[index];
 
-        if(old_compress == new_compress)
+        if(s->workers[old_key].compress_cfg == new_compress)
                 return true;
 
-        recompress_output_port port;
-        extract_port(s, old_compress, i, &port);
-        int index_in_worker = move_port_to_worker(s, new_compress, std::move(port));
+        std::unique_ptr<recompress_output_port> port;
+        extract_port(s, old_key, i, &port);
+        std::string new_key;
+        int index_in_worker = move_port_to_worker(s, new_compress, std::move(port), &new_key);
 
         if(index_in_worker < 0){
                 s->index_to_port.erase(s->index_to_port.begin() + index);
                 return false;
         }
 
-        s->index_to_port[index] = {new_compress, index_in_worker};
+        s->index_to_port[index] = {new_key, index_in_worker};
 
         return true;
 }
@@ -310,7 +455,7 @@ bool recompress_port_change_compress(struct state_recompress *s, int index,
 static int worker_get_num_active_ports(const recompress_worker_ctx& worker){
         int ret = 0;
         for(const auto& port : worker.ports){
-                if(port.active)
+                if(port->active)
                         ret++;
         }
         return ret;
@@ -336,12 +481,91 @@ struct state_recompress *recompress_init(struct module *parent) {
         return state;
 }
 
+void recompress_port_send(state_recompress *s, int index, std::shared_ptr<video_frame> frame)
+{
+        std::lock_guard<std::mutex> lock(s->mut);
+        if ((size_t) index >= s->index_to_port.size()) { // port removed after failed compression change
+                return;
+        }
+        auto [key, i] = s->index_to_port[index];
+
+        std::lock_guard<std::mutex> work_lock(s->workers[key].ports_mut);
+        s->workers[key].ports[i]->push(std::move(frame));
+}
+
+/**
+ * Scales frame to the size using the scaler shared by all workers wanting
+ * that size.
+ *
+ * @param src  the smallest already produced frame not smaller than size
+ *             with the same aspect ratio (pyramid), otherwise the input frame
+ * @returns src if the pixel format cannot be scaled natively
+ */
+static shared_ptr<video_frame> scale_frame(struct state_recompress *s, std::pair<int, int> size,
+                const shared_ptr<video_frame> &src)
+{
+        auto &sc = s->scalers[size];
+        struct video_desc desc = video_desc_from_frame(src.get());
+        if (!video_scaler_supports(desc.color_spec)) {
+                if (!sc.unsupported_reported) {
+                        log_msg(LOG_LEVEL_WARNING, "Cannot scale %s to %dx%d, passing full resolution.\n",
+                                        get_codec_name(desc.color_spec), size.first, size.second);
+                        sc.unsupported_reported = true;
+                }
+                return src;
+        }
+        desc.width = size.first;
+        desc.height = size.second;
+        if (!video_desc_eq(desc, sc.desc)) {
+                sc.pool.reconfigure(desc);
+                sc.desc = desc;
+        }
+        auto out = sc.pool.get_frame();
+        vf_copy_metadata(out.get(), src.get());
+        for (unsigned i = 0; i < out->tile_count; ++i) {
+                const struct tile *in = &src->tiles[i];
+                video_scaler_scale(sc.scaler.get(), desc.color_spec,
+                                in->data, vc_get_linesize(in->width, desc.color_spec), in->width, in->height,
+                                out->tiles[i].data, vc_get_linesize(size.first, desc.color_spec), size.first, size.second);
+        }
+        return out;
+}
+
 void recompress_process_async(state_recompress *s, std::shared_ptr<video_frame> frame){
         PROFILE_FUNC;
+        // compute each requested size once, from the largest to the smallest
+        // (without holding the lock, scalers are used only from this thread)
+        std::map<std::pair<int, int>, shared_ptr<video_frame>, std::greater<>> scaled;
+        {
+                std::lock_guard<std::mutex> lock(s->mut);
+                for(const auto& worker : s->workers){
+                        if(worker.second.scale.first != 0 && worker_get_num_active_ports(worker.second) > 0)
+                                scaled[worker.second.scale] = nullptr;
+                }
+        }
+        for (auto it = scaled.begin(); it != scaled.end(); ++it) {
+                const auto &size = it->first;
+                shared_ptr<video_frame> src = frame;
+                for (auto prev = scaled.begin(); prev != it; ++prev) {
+                        auto [w, h] = prev->first;
+                        if (w >= size.first && h >= size.second && prev->second != frame &&
+                                        (long long) w * frame->tiles[0].height == (long long) h * frame->tiles[0].width) {
+                                src = prev->second;
+                        }
+                }
+                it->second = scale_frame(s, size, src);
+        }
+        PROFILE_DETAIL("scale");
+
         std::lock_guard<std::mutex> lock(s->mut);
         for(const auto& worker : s->workers){
-                if(worker_get_num_active_ports(worker.second) > 0)
+                if(worker_get_num_active_ports(worker.second) == 0)
+                        continue;
+                if (worker.second.scale.first == 0) {
                         compress_frame(worker.second.compress.get(), frame);
+                } else if (auto it = scaled.find(worker.second.scale); it != scaled.end()) { // may be just added
+                        compress_frame(worker.second.compress.get(), it->second);
+                }
         }
 }
 
@@ -51,18 +51,34 @@ struct video_frame;
 
 struct state_recompress;
 
+struct recompress_port_stats {
+        int frames;              ///< frames sent
+        int dropped;             ///< frames dropped on the port queue overflow
+        uint64_t latency_sum_ms; ///< sum of compression latencies of the sent frames
+        uint64_t latency_max_ms;
+};
+
 struct state_recompress *recompress_init(struct module *parent);
 void recompress_done(struct state_recompress *state);
 
 uint32_t recompress_get_port_ssrc(struct state_recompress *s, int idx);
 
 
+/**
+ * @param scale  output size "<width>x<height>" or NULL for full resolution,
+ *               frames of the same size are scaled only once for all ports
+ */
 int recompress_add_port(struct state_recompress *s, struct module *parent_rep,
 		const char *host, const char *compress, unsigned short rx_port,
-		unsigned short tx_port, int mtu, const char *fec, long long bitrate);
+		unsigned short tx_port, int mtu, const char *fec, long long bitrate,
+		const char *scale);
 
 void recompress_remove_port(struct state_recompress *s, int index);
 
+/// fills the port statistics since the last call
+void recompress_port_get_stats(struct state_recompress *s, int index,
+                struct recompress_port_stats *stats);
+
 void recompress_port_set_active(struct state_recompress *s,
                 int index, bool active);
 
@@ -79,4 +95,9 @@ int recompress_get_num_active_ports(struct state_recompress *s);
 #include <memory>
 #include <string>
 void recompress_process_async(state_recompress *state, std::shared_ptr<video_frame> frame);
+/**
+ * Sends an already compressed frame through the port (bypassing its
+ * compression), FEC configured for the port is applied.
+ */
+void recompress_port_send(state_recompress *state, int index, std::shared_ptr<video_frame> frame);
 #endif
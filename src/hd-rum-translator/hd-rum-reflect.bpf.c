@@ -0,0 +1,209 @@
+/**
+ * @file   hd-rum-translator/hd-rum-reflect.bpf.c
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  tc ingress eBPF program cloning reflected packets to the targets
+ *
+ * For every active target, the headers of the received packet are
+ * rewritten (addresses, ports, MACs from a FIB lookup) and the packet is
+ * cloned to the egress interface. The original headers are restored at the
+ * end so that the packet is still delivered to the reflector socket (for
+ * transcoding replicas).
+ *
+ * Compiled with: clang -O2 -g -target bpf
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/pkt_cls.h>
+#include <linux/udp.h>
+#include <stddef.h>
+#include <bpf/bpf_endian.h>
+#include <bpf/bpf_helpers.h>
+
+#define HD_RUM_OFFLOAD_BPF
+#include "hd-rum-translator/hd-rum-offload.h"
+
+#ifndef AF_INET
+#define AF_INET 2
+#endif
+
+#define IP_CSUM_OFF   (ETH_HLEN + offsetof(struct iphdr, check))
+#define IP_SRC_OFF    (ETH_HLEN + offsetof(struct iphdr, saddr))
+#define IP_DST_OFF    (ETH_HLEN + offsetof(struct iphdr, daddr))
+#define UDP_OFF       (ETH_HLEN + sizeof(struct iphdr))
+#define UDP_CSUM_OFF  (UDP_OFF + offsetof(struct udphdr, check))
+#define UDP_SPORT_OFF (UDP_OFF + offsetof(struct udphdr, source))
+#define UDP_DPORT_OFF (UDP_OFF + offsetof(struct udphdr, dest))
+#define L4_FLAGS      BPF_F_MARK_MANGLED_0 // keep zero (disabled) UDP checksum
+
+struct {
+        __uint(type, BPF_MAP_TYPE_ARRAY);
+        __uint(max_entries, 1);
+        __type(key, __u32);
+        __type(value, struct hd_rum_offload_conf);
+} conf SEC(".maps");
+
+struct {
+        __uint(type, BPF_MAP_TYPE_ARRAY);
+        __uint(max_entries, HD_RUM_OFFLOAD_MAX_TARGETS);
+        __type(key, __u32);
+        __type(value, struct hd_rum_offload_target);
+} targets SEC(".maps");
+
+struct headers {
+        unsigned char eth[2 * ETH_ALEN]; // dst + src MAC
+        __be32 saddr;
+        __be32 daddr;
+        __be16 sport;
+        __be16 dport;
+};
+
+static __always_inline int rewrite_addr(struct __sk_buff *skb, int off, __be32 *cur, __be32 val)
+{
+        if (*cur == val) {
+                return 0;
+        }
+        if (bpf_l4_csum_replace(skb, UDP_CSUM_OFF, *cur, val, L4_FLAGS | BPF_F_PSEUDO_HDR | sizeof val) < 0 ||
+                        bpf_l3_csum_replace(skb, IP_CSUM_OFF, *cur, val, sizeof val) < 0 ||
+                        bpf_skb_store_bytes(skb, off, &val, sizeof val, 0) < 0) {
+                return -1;
+        }
+        *cur = val;
+        return 0;
+}
+
+static __always_inline int rewrite_port(struct __sk_buff *skb, int off, __be16 *cur, __be16 val)
+{
+        if (*cur == val) {
+                return 0;
+        }
+        if (bpf_l4_csum_replace(skb, UDP_CSUM_OFF, *cur, val, L4_FLAGS | sizeof val) < 0 ||
+                        bpf_skb_store_bytes(skb, off, &val, sizeof val, 0) < 0) {
+                return -1;
+        }
+        *cur = val;
+        return 0;
+}
+
+/// changes the packet headers from cur to want (cur is updated accordingly)
+static __always_inline int rewrite_headers(struct __sk_buff *skb, struct headers *cur, const struct headers *want)
+{
+        if (bpf_skb_store_bytes(skb, 0, want->eth, sizeof want->eth, 0) < 0) {
+                return -1;
+        }
+        __builtin_memcpy(cur->eth, want->eth, sizeof cur->eth);
+        if (rewrite_addr(skb, IP_SRC_OFF, &cur->saddr, want->saddr) < 0 ||
+                        rewrite_addr(skb, IP_DST_OFF, &cur->daddr, want->daddr) < 0 ||
+                        rewrite_port(skb, UDP_SPORT_OFF, &cur->sport, want->sport) < 0 ||
+                        rewrite_port(skb, UDP_DPORT_OFF, &cur->dport, want->dport) < 0) {
+                return -1;
+        }
+        return 0;
+}
+
+SEC("tc")
+int hd_rum_reflect(struct __sk_buff *skb)
+{
+        void *data = (void *)(long) skb->data;
+        void *data_end = (void *)(long) skb->data_end;
+        struct ethhdr *eth = data;
+        struct iphdr *ip = (void *) (eth + 1);
+        struct udphdr *udp = (void *) (ip + 1);
+        if ((void *) (udp + 1) > data_end) {
+                return TC_ACT_OK;
+        }
+        if (eth->h_proto != bpf_htons(ETH_P_IP) || ip->ihl != 5 || ip->protocol != IPPROTO_UDP ||
+                        (ip->frag_off & bpf_htons(0x3FFF)) != 0) { // MF or fragment offset
+                return TC_ACT_OK;
+        }
+        __u32 zero = 0;
+        struct hd_rum_offload_conf *cfg = bpf_map_lookup_elem(&conf, &zero);
+        if (cfg == NULL || cfg->count == 0 || udp->dest != cfg->port) {
+                return TC_ACT_OK;
+        }
+
+        // packet pointers are invalidated by the helpers changing the packet
+        struct headers orig;
+        __builtin_memcpy(orig.eth, eth, sizeof orig.eth);
+        orig.saddr = ip->saddr;
+        orig.daddr = ip->daddr;
+        orig.sport = udp->source;
+        orig.dport = udp->dest;
+        __u16 tot_len = bpf_ntohs(ip->tot_len);
+        __u32 count = cfg->count;
+        struct headers cur = orig;
+
+        for (__u32 i = 0; i < HD_RUM_OFFLOAD_MAX_TARGETS && i < count; ++i) {
+                struct hd_rum_offload_target *t = bpf_map_lookup_elem(&targets, &i);
+                if (t == NULL || !t->active) {
+                        continue;
+                }
+                struct bpf_fib_lookup fib = {};
+                fib.family = AF_INET;
+                fib.l4_protocol = IPPROTO_UDP;
+                fib.tot_len = tot_len;
+                fib.ifindex = skb->ingress_ifindex;
+                fib.ipv4_src = orig.daddr;
+                fib.ipv4_dst = t->addr;
+                fib.sport = orig.dport;
+                fib.dport = t->port;
+                if (bpf_fib_lookup(skb, &fib, sizeof fib, 0) != BPF_FIB_LKUP_RET_SUCCESS) {
+                        __sync_fetch_and_add(&t->missed, 1);
+                        continue;
+                }
+                struct headers want;
+                __builtin_memcpy(want.eth, fib.dmac, ETH_ALEN);
+                __builtin_memcpy(want.eth + ETH_ALEN, fib.smac, ETH_ALEN);
+                want.saddr = orig.daddr; // our address
+                want.daddr = t->addr;
+                want.sport = orig.dport;
+                want.dport = t->port;
+                if (rewrite_headers(skb, &cur, &want) < 0 ||
+                                bpf_clone_redirect(skb, fib.ifindex, 0) < 0) {
+                        __sync_fetch_and_add(&t->missed, 1);
+                        continue;
+                }
+                __sync_fetch_and_add(&t->packets, 1);
+        }
+
+        if (rewrite_headers(skb, &cur, &orig) < 0) {
+                return TC_ACT_SHOT;
+        }
+        return TC_ACT_OK;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL"; // bpf_fib_lookup() is GPL-only
@@ -63,6 +63,10 @@
 #include "host.h"
 #include "hd-rum-translator/hd-rum-recompress.h"
 #include "hd-rum-translator/hd-rum-decompress.h"
+#include "hd-rum-translator/hd-rum-fec.h"
+#ifdef HAVE_HD_RUM_OFFLOAD
+#include "hd-rum-translator/hd-rum-offload.h"
+#endif
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
@@ -71,9 +75,17 @@
 #include "utils/misc.h" // format_in_si_units, unit_evaluate
 #include "tv.h"
 #include "utils/net.h"
+#include "utils/spsc_queue.h" // spsc_waiter
+#include "utils/thread.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -83,6 +95,7 @@ using namespace std;
 constexpr const char *MOD_NAME = "[hd-rum-trans] ";
 
 struct item;
+struct sender_shard;
 
 #define REPLICA_MAGIC 0xd2ff3323
 
@@ -132,44 +145,107 @@ struct replica {
         USE_SOCK,
         RECOMPRESS
     };
-    enum type_t type;
+    std::atomic<type_t> type; ///< changed in place (control thread), read by the senders
     std::shared_ptr<socket_udp> sock;
     sockaddr_storage sockaddr;
     socklen_t sockaddr_len;
+    struct sender_shard *shard = nullptr; ///< sender thread serving this replica (if --send-threads)
+    std::atomic<int> offload_slot{-1}; ///< forwarded by the kernel (if --offload), not sent from userspace
+    /// forwarding replica with FEC - frames are reassembled (by the writer) and sent through its recompress port
+    std::unique_ptr<frame_reassembler> fec_reassembler;
+    /// congestion adaptation (if --adapt) driven by RTCP RRs from the host
+    struct {
+        bool transcoding = false; ///< switched to transcoding by the adaptation (not by the user)
+        int lossy_reports = 0;    ///< consecutive RRs with high loss
+        time_ns_t low_loss_since = 0;
+    } adapt;
+    /// @name statistics (sent from userspace), reported with control_report_stats()
+    /// @{
+    std::atomic<uint64_t> sent_packets{0};
+    std::atomic<uint64_t> sent_bytes{0};
+    std::atomic<uint64_t> send_errors{0}; ///< datagrams not sent (eg. EAGAIN/ENOBUFS)
+    /// @}
+};
+
+/**
+ * Immutable snapshot of the replicas read by the sending threads (the
+ * writer and sender shards). The control thread publishes a new one on
+ * every port addition/removal and reclaims the old one (and the removed
+ * replicas) after all of the readers left it (see synchronize_replicas()).
+ * The indices match the recompress port indices.
+ */
+struct replica_set {
+    vector<replica *> replicas;
+};
+
+/**
+ * Epoch of a thread reading the replica set - odd while the thread holds
+ * a snapshot. A reader never blocks inside, so the reclamation waits at
+ * most for one batch being sent.
+ */
+struct rcu_reader {
+    alignas(SPSC_CACHE_LINE) std::atomic<uint64_t> epoch{0};
+};
+
+/**
+ * Sender thread serving a subset of the forwarding replicas. It reads the
+ * packet queue through its own cursor so that a slow destination doesn't
+ * stall the replicas served by other shards.
+ */
+struct sender_shard {
+    std::thread thread;
+    alignas(SPSC_CACHE_LINE) std::atomic<struct item *> cursor{nullptr}; ///< next item to be sent
+    spsc_waiter data_ready; ///< shard waits here for new packets
+    rcu_reader rcu;
+    int replica_count = 0; ///< replicas assigned (control thread only)
+    uint64_t consumed = 0; ///< packets passed by the cursor
+    std::atomic<uint64_t> depth_max{0}; ///< queue depth high-water mark since the last report
 };
 
 struct hd_rum_translator_state {
     hd_rum_translator_state() {
         init_root_module(&mod);
-        pthread_mutex_init(&qempty_mtx, NULL);
-        pthread_mutex_init(&qfull_mtx, NULL);
-        pthread_cond_init(&qempty_cond, NULL);
-        pthread_cond_init(&qfull_cond, NULL);
     }
     ~hd_rum_translator_state() {
-        pthread_mutex_destroy(&qempty_mtx);
-        pthread_mutex_destroy(&qfull_mtx);
-        pthread_cond_destroy(&qempty_cond);
-        pthread_cond_destroy(&qfull_cond);
         module_done(&mod);
     }
     struct module mod;
     int bufsize = 0;
     struct control_state *control_state = nullptr;
     struct item *queue = nullptr;
-    struct item *qhead = nullptr;
-    struct item *qtail = nullptr;
-    int qempty = 1;
-    int qfull = 0;
-    pthread_mutex_t qempty_mtx;
-    pthread_mutex_t qfull_mtx;
-    pthread_cond_t qempty_cond;
-    pthread_cond_t qfull_cond;
-
-    vector<replica *> replicas;
+    /**
+     * The packet queue is a lock-free ring with a single producer (the
+     * receiver publishing qtail) and multiple consumers (the writer and
+     * sender shards, each with its own cursor). A slot is reused only after
+     * all of the consumers passed it. The waiters sleep (futex) only when
+     * the queue is empty/full.
+     */
+    alignas(SPSC_CACHE_LINE) std::atomic<struct item *> qhead{nullptr}; ///< writer cursor
+    alignas(SPSC_CACHE_LINE) std::atomic<struct item *> qtail{nullptr}; ///< first unpublished item
+    spsc_waiter writer_data_ready; ///< writer waits here for new packets
+    spsc_waiter space_ready;       ///< receiver waits here if the queue is full
+    std::atomic<uint64_t> published_count{0}; ///< packets ever published (for queue depth)
+    uint64_t writer_consumed = 0;
+    std::atomic<uint64_t> writer_depth_max{0}; ///< since the last report
+    time_ns_t stats_interval = NS_IN_SEC; ///< per-replica control socket statistics (0 - disabled)
+    time_ns_t stats_last_report = 0;
+
+    vector<replica *> replicas; ///< current replicas (control thread only)
+    std::atomic<replica_set *> published{new replica_set{}}; ///< replicas seen by the senders
+    rcu_reader writer_rcu;
+    vector<std::unique_ptr<sender_shard>> shards; ///< empty - writer sends to all replicas
     std::shared_ptr<socket_udp> server_socket;
     void *decompress = nullptr;
     struct state_recompress *recompress = nullptr;
+    struct hd_rum_offload *offload = nullptr;
+    std::shared_ptr<socket_udp> rtcp_socket; ///< receives RRs from the hosts (if --adapt)
+    const char *adapt_compress = nullptr;
+
+    /// processes the port messages, RTCP and statistics (off the packet path)
+    std::thread control_thread;
+    std::mutex control_lock;
+    std::condition_variable control_cv;
+    bool control_should_exit = false;
 };
 
 /*
@@ -209,6 +285,8 @@ static void signal_handler(int signal)
 }
 
 #define MAX_PKT_SIZE 10000
+#define WRITER_BATCH 64 ///< max number of queued packets sent to a replica at once
+#define RECV_BATCH 32 ///< max number of packets received at once
 
 #ifdef WIN32
 struct wsa_aux_storage {
@@ -269,6 +347,38 @@ static void qdestroy(struct item *queue)
     free(queue);
 }
 
+/**
+ * Passes forwarding of the replica to the kernel (if --offload is enabled
+ * and the replica is a forwarding one) or takes it back to userspace.
+ */
+static void replica_update_offload(struct hd_rum_translator_state *s, struct replica *r)
+{
+#ifdef HAVE_HD_RUM_OFFLOAD
+    // replicas sharing the server socket must be sent from its port
+    bool offload = s->offload != nullptr && r->type == replica::type_t::USE_SOCK
+            && (s->server_socket == nullptr || r->sock != s->server_socket)
+            && !r->fec_reassembler;
+    if (offload && r->offload_slot < 0) {
+        r->offload_slot = hd_rum_offload_add(s->offload, (sockaddr *) &r->sockaddr, r->sockaddr_len);
+    } else if (!offload && r->offload_slot >= 0) {
+        hd_rum_offload_remove(s->offload, r->offload_slot);
+        r->offload_slot = -1;
+    }
+#else
+    (void) s, (void) r;
+#endif
+}
+
+static void replica_set_type(struct hd_rum_translator_state *s, int index,
+        enum replica::type_t type)
+{
+    struct replica *r = s->replicas[index];
+    r->type = type;
+    replica_update_offload(s, r);
+    recompress_port_set_active(s->recompress, index,
+            r->type == replica::type_t::RECOMPRESS);
+}
+
 #define prefix_matches(x,y) strncasecmp(x, y, strlen(y)) == 0
 static struct response *change_replica_type(struct hd_rum_translator_state *s,
         struct module *mod, struct message *msg, int index)
@@ -278,10 +388,12 @@ static struct response *change_replica_type(struct hd_rum_translator_state *s,
     struct msg_universal *data = (struct msg_universal *) msg;
 
     if (strcasecmp(data->text, "sock") == 0) {
-        r->type = replica::type_t::USE_SOCK;
+        r->adapt = {};
+        replica_set_type(s, index, replica::type_t::USE_SOCK);
         log_msg(LOG_LEVEL_NOTICE, "Output port %d is now forwarding.\n", index);
     } else if (strcasecmp(data->text, "recompress") == 0) {
-        r->type = replica::type_t::RECOMPRESS;
+        r->adapt = {};
+        replica_set_type(s, index, replica::type_t::RECOMPRESS);
         log_msg(LOG_LEVEL_NOTICE, "Output port %d is now transcoding.\n", index);
     } else if (prefix_matches(data->text, "compress ")) {
         if(recompress_port_change_compress(s->recompress, index, data->text + strlen("compress "))){
@@ -294,9 +406,6 @@ static struct response *change_replica_type(struct hd_rum_translator_state *s,
         return new_response(RESPONSE_BAD_REQUEST, NULL);
     }
 
-    recompress_port_set_active(s->recompress, index,
-            r->type == replica::type_t::RECOMPRESS);
-
     return new_response(RESPONSE_OK, NULL);
 }
 
@@ -312,9 +421,376 @@ static VOID CALLBACK wsa_deleter(DWORD /* dwErrorCode */,
 }
 #endif
 
+/// assigns the replica to the shard with the least replicas (if sharding is enabled)
+static void shard_add_replica(struct hd_rum_translator_state *s, struct replica *r)
+{
+    if (s->shards.empty() || r->fec_reassembler) {
+        return;
+    }
+    sender_shard *shard = s->shards[0].get();
+    for (auto &sh : s->shards) {
+        if (sh->replica_count < shard->replica_count) {
+            shard = sh.get();
+        }
+    }
+    shard->replica_count += 1;
+    r->shard = shard; // set before the replica is published
+}
+
+static const struct replica_set *rcu_read_lock(struct hd_rum_translator_state *s, struct rcu_reader *r)
+{
+    r->epoch.fetch_add(1, std::memory_order_seq_cst);
+    return s->published.load(std::memory_order_seq_cst);
+}
+
+static void rcu_read_unlock(struct rcu_reader *r)
+{
+    r->epoch.fetch_add(1, std::memory_order_release);
+}
+
+/// waits until none of the readers holds a replica set published before
+static void synchronize_replicas(struct hd_rum_translator_state *s)
+{
+    std::vector<rcu_reader *> readers{&s->writer_rcu};
+    for (auto &sh : s->shards) {
+        readers.push_back(&sh->rcu);
+    }
+    for (auto *r : readers) {
+        uint64_t epoch = r->epoch.load(std::memory_order_seq_cst);
+        while (epoch % 2 == 1 && r->epoch.load(std::memory_order_acquire) == epoch) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+/// publishes s->replicas to the senders, the previous snapshot is reclaimed
+static void publish_replicas(struct hd_rum_translator_state *s)
+{
+    auto *old = s->published.exchange(new replica_set{s->replicas}, std::memory_order_seq_cst);
+    synchronize_replicas(s);
+    delete old;
+}
+
+/**
+ * @returns true if the item after tail hasn't been consumed yet by the
+ * writer or by any of the sender shards (so tail cannot be published)
+ */
+static bool queue_full(struct hd_rum_translator_state *s, struct item *tail)
+{
+    struct item *next = tail->next;
+    if (next == s->qhead.load(std::memory_order_acquire)) {
+        return true;
+    }
+    for (auto &sh : s->shards) {
+        if (next == sh->cursor.load(std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void notify_queue_consumed(struct hd_rum_translator_state *s)
+{
+    s->space_ready.notify();
+}
+
+/// publishes the items up to (excluding) new_tail to the consumers
+static void queue_publish(struct hd_rum_translator_state *s, struct item *new_tail, int count)
+{
+    s->published_count.fetch_add(count, std::memory_order_relaxed);
+    s->qtail.store(new_tail, std::memory_order_release);
+    s->writer_data_ready.notify();
+    for (auto &sh : s->shards) {
+        sh->data_ready.notify();
+    }
+}
+
+/// accounts the result of sending the first count datagrams of iov to the replica
+static void replica_count_sent(struct replica *r, const struct iovec *iov, int count, int ret)
+{
+    int sent = std::max(ret, 0);
+    uint64_t bytes = 0;
+    for (int i = 0; i < sent; ++i) {
+        bytes += iov[i].iov_len;
+    }
+    r->sent_packets.fetch_add(sent, std::memory_order_relaxed);
+    r->sent_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (sent < count) {
+        r->send_errors.fetch_add(count - sent, std::memory_order_relaxed);
+    }
+}
+
+/// @returns packets published but not yet passed by the consumer
+static uint64_t queue_depth(struct hd_rum_translator_state *s, uint64_t consumed)
+{
+    return s->published_count.load(std::memory_order_relaxed) - consumed;
+}
+
+#ifndef WIN32
+static void sender_shard_run(struct hd_rum_translator_state *s, struct sender_shard *shard)
+{
+    set_thread_name("hd-rum-sender");
+    while (true) {
+        struct item *it = shard->cursor.load(std::memory_order_relaxed);
+        shard->data_ready.wait([s, it] { return s->qtail.load(std::memory_order_acquire) != it; }, 0);
+        struct item *tail = s->qtail.load(std::memory_order_acquire);
+        uint64_t depth = queue_depth(s, shard->consumed);
+        if (depth > shard->depth_max.load(std::memory_order_relaxed)) {
+            shard->depth_max.store(depth, std::memory_order_relaxed);
+        }
+
+        struct iovec iov[WRITER_BATCH];
+        int count = 0;
+        bool quit = false;
+        for ( ; it != tail && count < WRITER_BATCH; it = it->next) {
+            if (it->size == 0) { // poisoned pill
+                quit = true;
+                break;
+            }
+            iov[count].iov_base = it->buf;
+            iov[count].iov_len = it->size;
+            count += 1;
+        }
+        shard->consumed += count;
+
+        const struct replica_set *rs = rcu_read_lock(s, &shard->rcu);
+        for (auto *r : rs->replicas) {
+            if (r->shard == shard && r->type == replica::type_t::USE_SOCK && r->offload_slot < 0 && count > 0) {
+                int ret = udp_sendto_multi(r->sock.get(), iov, count, (sockaddr *) &r->sockaddr, r->sockaddr_len);
+                if (ret < 0) {
+                    perror("Hd-rum-translator send");
+                }
+                replica_count_sent(r, iov, count, ret);
+            }
+        }
+        rcu_read_unlock(&shard->rcu);
+        if (quit) {
+            return;
+        }
+        shard->cursor.store(it, std::memory_order_release);
+        notify_queue_consumed(s);
+    }
+}
+#endif
+
+/**
+ * Sends packets to a forwarding replica with FEC - video packets are
+ * reassembled to frames that are passed to the replica recompress port
+ * (adding the FEC), other packets are forwarded unchanged.
+ */
+static void replica_send_fec(struct hd_rum_translator_state *s, struct replica *r, int index,
+        const struct iovec *iov, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        std::shared_ptr<video_frame> frame;
+        if (!r->fec_reassembler->write((const char *) iov[i].iov_base, iov[i].iov_len, &frame)) {
+            int ret = udp_sendto(r->sock.get(), (char *) iov[i].iov_base, iov[i].iov_len,
+                        (sockaddr *) &r->sockaddr, r->sockaddr_len);
+            if (ret < 0) {
+                perror("Hd-rum-translator send");
+            }
+            replica_count_sent(r, &iov[i], 1, ret < 0 ? -1 : 1);
+        } else if (frame) {
+            recompress_port_send(s->recompress, index, std::move(frame));
+        }
+    }
+}
+
+/**
+ * @param remove_port  remove also the recompress port (not yet removed), it
+ *                     is done only after the senders stopped using the index
+ */
+static void delete_replica(struct hd_rum_translator_state *s, int index, bool remove_port)
+{
+    struct replica *r = s->replicas[index];
+    r->type = replica::type_t::NONE; // stops kernel forwarding
+    replica_update_offload(s, r);
+    if (r->shard != nullptr) {
+        r->shard->replica_count -= 1;
+    }
+    s->replicas.erase(s->replicas.begin() + index);
+    publish_replicas(s);
+    if (remove_port) {
+        recompress_remove_port(s->recompress, index);
+    }
+    delete r;
+}
+
+#define RTCP_SR 200
+#define RTCP_RR 201
+#define ADAPT_LOSS_HIGH 13      ///< RR fraction lost (1/256) considered as congestion (5 %)
+#define ADAPT_LOSS_LOW 3        ///< RR fraction lost (1/256) considered as clean (1 %)
+#define ADAPT_LOSSY_REPORTS 2   ///< consecutive congested RRs to start transcoding
+#define ADAPT_RECOVERY_TIME (10 * NS_IN_SEC) ///< clean period to switch back to forwarding
+
+/**
+ * Switches a forwarding replica to transcoding with s->adapt_compress if
+ * its host reports congestion and back after the loss subsides.
+ */
+static void replica_adapt(struct hd_rum_translator_state *s, int index, int fract_lost)
+{
+    struct replica *r = s->replicas[index];
+    if (r->type == replica::type_t::USE_SOCK) {
+        r->adapt.lossy_reports = fract_lost >= ADAPT_LOSS_HIGH ? r->adapt.lossy_reports + 1 : 0;
+        if (r->adapt.lossy_reports < ADAPT_LOSSY_REPORTS) {
+            return;
+        }
+        if (!recompress_port_change_compress(s->recompress, index, s->adapt_compress)) {
+            log_msg(LOG_LEVEL_ERROR, "Failed to set port %d compression to %s. Port removed.\n",
+                    index, s->adapt_compress);
+            delete_replica(s, index, false);
+            return;
+        }
+        r->adapt = {};
+        r->adapt.transcoding = true;
+        replica_set_type(s, index, replica::type_t::RECOMPRESS);
+        log_msg(LOG_LEVEL_NOTICE, "Output port %d reports %.1f %% loss, transcoding.\n",
+                index, fract_lost * 100.0 / 256);
+    } else if (r->type == replica::type_t::RECOMPRESS && r->adapt.transcoding) {
+        time_ns_t now = get_time_in_ns();
+        if (fract_lost > ADAPT_LOSS_LOW) {
+            r->adapt.low_loss_since = 0;
+            return;
+        }
+        if (r->adapt.low_loss_since == 0) {
+            r->adapt.low_loss_since = now;
+        }
+        if (now - r->adapt.low_loss_since < ADAPT_RECOVERY_TIME) {
+            return;
+        }
+        r->adapt = {};
+        replica_set_type(s, index, replica::type_t::USE_SOCK);
+        log_msg(LOG_LEVEL_NOTICE, "Output port %d loss subsided, forwarding again.\n", index);
+    }
+}
+
+/// compares the addresses (not ports), IPv4-mapped IPv6 addresses match the IPv4 ones
+static bool sockaddr_addr_eq(const struct sockaddr *a, const struct sockaddr *b)
+{
+    auto get_v4 = [](const struct sockaddr *sa, struct in_addr *out) {
+        if (sa->sa_family == AF_INET) {
+            *out = ((const struct sockaddr_in *)(const void *) sa)->sin_addr;
+            return true;
+        }
+        const struct in6_addr *a6 = &((const struct sockaddr_in6 *)(const void *) sa)->sin6_addr;
+        if (sa->sa_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(a6)) {
+            memcpy(out, a6->s6_addr + 12, sizeof *out);
+            return true;
+        }
+        return false;
+    };
+    struct in_addr a4, b4;
+    if (get_v4(a, &a4) && get_v4(b, &b4)) {
+        return a4.s_addr == b4.s_addr;
+    }
+    return a->sa_family == AF_INET6 && b->sa_family == AF_INET6
+            && memcmp(&((const struct sockaddr_in6 *)(const void *) a)->sin6_addr,
+                    &((const struct sockaddr_in6 *)(const void *) b)->sin6_addr, sizeof(struct in6_addr)) == 0;
+}
+
+/**
+ * Reads RTCP packets sent by the hosts to the reflector (port + 1) and
+ * passes the highest fraction lost of the contained report blocks to the
+ * replica with the sender address.
+ */
+static void process_rtcp(struct hd_rum_translator_state *s)
+{
+    if (!s->rtcp_socket) {
+        return;
+    }
+
+    unsigned char buf[1500];
+    struct sockaddr_storage sa;
+    socklen_t sa_len = sizeof sa;
+    struct timeval timeout{};
+    int len = 0;
+    while ((len = udp_recvfrom_timeout(s->rtcp_socket.get(), (char *) buf, sizeof buf, &timeout,
+                    (struct sockaddr *) &sa, &sa_len)) > 0) {
+        int fract_lost = -1;
+        for (int off = 0; off + 8 <= len; ) {
+            unsigned char *pkt = buf + off;
+            int pkt_len = 4 * (((pkt[2] << 8) | pkt[3]) + 1);
+            if ((pkt[0] >> 6) != 2 || off + pkt_len > len) {
+                break;
+            }
+            int rc = pkt[0] & 0x1f;
+            int blocks = pkt[1] == RTCP_SR ? 28 : pkt[1] == RTCP_RR ? 8 : pkt_len;
+            for (int i = 0; i < rc && blocks + (i + 1) * 24 <= pkt_len; ++i) {
+                fract_lost = std::max<int>(fract_lost, pkt[blocks + i * 24 + 4]);
+            }
+            off += pkt_len;
+        }
+        if (fract_lost >= 0) {
+            for (unsigned i = 0; i < s->replicas.size(); ++i) {
+                if (sockaddr_addr_eq((struct sockaddr *) &sa, (struct sockaddr *) &s->replicas[i]->sockaddr)) {
+                    replica_adapt(s, i, fract_lost);
+                    break;
+                }
+            }
+        }
+        sa_len = sizeof sa;
+    }
+}
+
+/**
+ * Reports per-replica statistics to the control socket (if "stats on"),
+ * one line per replica:
+ *
+ *     hd-rum port <idx> <host>:<port> type=<forward|transcode|offload>
+ *         packets=<n> bytes=<n> errors=<n> queue_max=<n> fps=<f> dropped=<n>
+ *         latency_avg_ms=<f> latency_max_ms=<n>
+ *
+ * packets, bytes and errors (datagrams not sent) are totals of the
+ * datagrams forwarded from userspace, the rest is measured since the
+ * previous report: queue_max is the high-water mark of the packets waiting
+ * for the thread sending to the replica, fps, dropped and latency
+ * (compression) relate to the frames sent through the replica output port
+ * (transcoding or FEC).
+ */
+static void report_stats(struct hd_rum_translator_state *s)
+{
+    time_ns_t now = get_time_in_ns();
+    if (s->stats_interval == 0 || !control_stats_enabled(s->control_state)
+            || now - s->stats_last_report < s->stats_interval) {
+        return;
+    }
+    double seconds = (now - s->stats_last_report) / NS_IN_SEC_DBL;
+    bool first = s->stats_last_report == 0;
+    s->stats_last_report = now;
+
+    uint64_t writer_depth = s->writer_depth_max.exchange(0, std::memory_order_relaxed);
+    std::map<sender_shard *, uint64_t> shard_depth;
+    for (auto &sh : s->shards) {
+        shard_depth[sh.get()] = sh->depth_max.exchange(0, std::memory_order_relaxed);
+    }
+
+    for (unsigned i = 0; i < s->replicas.size(); ++i) {
+        struct replica *r = s->replicas[i];
+        struct recompress_port_stats port_stats{};
+        recompress_port_get_stats(s->recompress, i, &port_stats);
+        if (first) { // interval unknown
+            continue;
+        }
+        const char *type = r->offload_slot >= 0 ? "offload"
+                : r->type == replica::type_t::RECOMPRESS ? "transcode" : "forward";
+        std::ostringstream oss;
+        oss << "hd-rum port " << i << " " << r->mod.name << " type=" << type
+                << " packets=" << r->sent_packets.load(std::memory_order_relaxed)
+                << " bytes=" << r->sent_bytes.load(std::memory_order_relaxed)
+                << " errors=" << r->send_errors.load(std::memory_order_relaxed)
+                << " queue_max=" << (r->shard != nullptr ? shard_depth[r->shard] : writer_depth)
+                << " fps=" << port_stats.frames / seconds
+                << " dropped=" << port_stats.dropped
+                << " latency_avg_ms=" << (port_stats.frames > 0 ? (double) port_stats.latency_sum_ms / port_stats.frames : 0.0)
+                << " latency_max_ms=" << port_stats.latency_max_ms;
+        control_report_stats(s->control_state, oss.str());
+    }
+}
+
 static int create_output_port(struct hd_rum_translator_state *s,
         const char *addr, int rx_port, int tx_port, int bufsize, int force_ip_version,
-        const char *compression, int mtu, const char *fec, int bitrate, bool use_server_sock = false)
+        const char *compression, int mtu, const char *fec, int bitrate, const char *scale,
+        bool use_server_sock = false)
 {
         struct replica *rep;
         try {
@@ -331,9 +807,12 @@ static int create_output_port(struct hd_rum_translator_state *s,
         s->replicas.push_back(rep);
 
         rep->type = compression ? replica::type_t::RECOMPRESS : replica::type_t::USE_SOCK;
+        if (!compression && fec != nullptr) {
+            rep->fec_reassembler = std::make_unique<frame_reassembler>();
+        }
         int idx = recompress_add_port(s->recompress, &rep->mod,
                 addr, compression ? compression : "none",
-                0, tx_port, mtu, fec, bitrate);
+                0, tx_port, mtu, fec, bitrate, scale);
         if (idx < 0) {
             fprintf(stderr, "Initializing output port '%s' compression failed!\n", addr);
 
@@ -345,180 +824,265 @@ static int create_output_port(struct hd_rum_translator_state *s,
 
         assert((unsigned) idx == s->replicas.size() - 1);
         recompress_port_set_active(s->recompress, idx, compression != nullptr);
+        replica_update_offload(s, rep);
+        shard_add_replica(s, rep);
+        publish_replicas(s);
 
         return idx;
 }
 
-static void *writer(void *arg)
+/// processes the messages for the replicas and for the reflector (create-port/delete-port)
+static void process_messages(struct hd_rum_translator_state *s)
 {
-    struct hd_rum_translator_state *s =
-        (struct hd_rum_translator_state *) arg;
-
-    while (1) {
-        // first check messages
-        for (unsigned int i = 0; i < s->replicas.size(); i++) {
-            struct message *msg;
-            while ((msg = check_message(&s->replicas[i]->mod))) {
-                struct response *r = change_replica_type(s, &s->replicas[i]->mod, msg, i);
-                free_message(msg, r);
-            }
+    for (unsigned int i = 0; i < s->replicas.size(); i++) {
+        struct message *msg;
+        while ((msg = check_message(&s->replicas[i]->mod))) {
+            struct response *r = change_replica_type(s, &s->replicas[i]->mod, msg, i);
+            free_message(msg, r);
         }
+    }
 
-        struct msg_universal *msg;
-        while ((msg = (struct msg_universal *) check_message(&s->mod))) {
-            struct response *r = NULL;
-            if (strncasecmp(msg->text, "delete-port ", strlen("delete-port ")) == 0) {
-                char *port_spec = msg->text + strlen("delete-port ");
-                int index = -1;
-                if (isdigit(port_spec[0])) {
-                    int i = atoi(port_spec);
-                    if (i >= 0 && i < (int) s->replicas.size()) {
-                        index = i;
-                    } else {
-                        log_msg(LOG_LEVEL_WARNING, "Invalid port index: %d. Not removing.\n", i);
-                    }
+    struct msg_universal *msg;
+    while ((msg = (struct msg_universal *) check_message(&s->mod))) {
+        struct response *r = NULL;
+        if (strncasecmp(msg->text, "delete-port ", strlen("delete-port ")) == 0) {
+            char *port_spec = msg->text + strlen("delete-port ");
+            int index = -1;
+            if (isdigit(port_spec[0])) {
+                int i = atoi(port_spec);
+                if (i >= 0 && i < (int) s->replicas.size()) {
+                    index = i;
                 } else {
-                    int i = 0;
-                    for (auto r : s->replicas) {
-                        if (strcmp(r->mod.name, port_spec) == 0) {
-                            index = i;
-                            break;
-                        }
-                        i++;
-                    }
-                    if (index == -1) {
-                        log_msg(LOG_LEVEL_WARNING, "Unknown port name: %s. Not removing.\n", port_spec);
+                    log_msg(LOG_LEVEL_WARNING, "Invalid port index: %d. Not removing.\n", i);
+                }
+            } else {
+                int i = 0;
+                for (auto r : s->replicas) {
+                    if (strcmp(r->mod.name, port_spec) == 0) {
+                        index = i;
+                        break;
                     }
+                    i++;
                 }
-                if (index >= 0) {
-                    recompress_remove_port(s->recompress, index);
-                    delete s->replicas[index];
-                    s->replicas.erase(s->replicas.begin() + index);
-                    log_msg(LOG_LEVEL_NOTICE, "Deleted output port %d.\n", index);
+                if (index == -1) {
+                    log_msg(LOG_LEVEL_WARNING, "Unknown port name: %s. Not removing.\n", port_spec);
                 }
-            } else if (strncasecmp(msg->text, "create-port", strlen("create-port")) == 0) {
-                // format of parameters is either:
-                // <host>:<port> [<compression>]
-                // or (for compat with older CoUniverse version)
-                // <host> <port> [<compression>]
-                char *host_port, *port_str = NULL, *save_ptr;
-                char *host;
-                int tx_port;
-                strtok_r(msg->text, " ", &save_ptr);
-                host_port = strtok_r(NULL, " ", &save_ptr);
-                if (host_port && (strchr(host_port, ':') != NULL || (port_str = strtok_r(NULL, " ", &save_ptr)) != NULL)) {
-                    if (port_str) {
-                        host = host_port;
-                        tx_port = atoi(port_str);
-                    } else {
-                        tx_port = atoi(strrchr(host_port, ':') + 1);
-                        host = host_port;
-                        *strrchr(host_port, ':') = '\0';
-                    }
-                    // handle square brackets around an IPv6 address
-                    if (host[0] == '[' && host[strlen(host) - 1] == ']') {
-                        host += 1;
-                        host[strlen(host) - 1] = '\0';
-                    }
+            }
+            if (index >= 0) {
+                delete_replica(s, index, true);
+                log_msg(LOG_LEVEL_NOTICE, "Deleted output port %d.\n", index);
+            }
+        } else if (strncasecmp(msg->text, "create-port", strlen("create-port")) == 0) {
+            // format of parameters is either:
+            // <host>:<port> [<compression> [<width>x<height>]]
+            // or (for compat with older CoUniverse version)
+            // <host> <port> [<compression> [<width>x<height>]]
+            char *host_port, *port_str = NULL, *save_ptr;
+            char *host;
+            int tx_port;
+            strtok_r(msg->text, " ", &save_ptr);
+            host_port = strtok_r(NULL, " ", &save_ptr);
+            if (host_port && (strchr(host_port, ':') != NULL || (port_str = strtok_r(NULL, " ", &save_ptr)) != NULL)) {
+                if (port_str) {
+                    host = host_port;
+                    tx_port = atoi(port_str);
                 } else {
-                    const char *err_msg = "wrong format";
-                    log_msg(LOG_LEVEL_ERROR, "%s\n", err_msg);
-                    free_message((struct message *) msg, new_response(RESPONSE_BAD_REQUEST, err_msg));
-                    continue;
+                    tx_port = atoi(strrchr(host_port, ':') + 1);
+                    host = host_port;
+                    *strrchr(host_port, ':') = '\0';
                 }
-                char *compress = strtok_r(NULL, " ", &save_ptr);
-
-                int idx = create_output_port(s,
-                        host, 0, tx_port, s->bufsize, false,
-                        compress, 1500, nullptr, RATE_UNLIMITED, s->server_socket != nullptr);
-
-                if(idx < 0) {
-                    free_message((struct message *) msg, new_response(RESPONSE_INT_SERV_ERR, "Cannot create output port."));
-                    continue;
+                // handle square brackets around an IPv6 address
+                if (host[0] == '[' && host[strlen(host) - 1] == ']') {
+                    host += 1;
+                    host[strlen(host) - 1] = '\0';
                 }
+            } else {
+                const char *err_msg = "wrong format";
+                log_msg(LOG_LEVEL_ERROR, "%s\n", err_msg);
+                free_message((struct message *) msg, new_response(RESPONSE_BAD_REQUEST, err_msg));
+                continue;
+            }
+            char *compress = strtok_r(NULL, " ", &save_ptr);
+            char *scale = compress ? strtok_r(NULL, " ", &save_ptr) : nullptr;
 
-                if(compress)
-                    log_msg(LOG_LEVEL_NOTICE, "Created new transcoding output port %s:%d:0x%08" PRIx32 ".\n", host, tx_port, recompress_get_port_ssrc(s->recompress, idx));
-                else
-                    log_msg(LOG_LEVEL_NOTICE, "Created new forwarding output port %s:%d.\n", host, tx_port);
+            int idx = create_output_port(s,
+                    host, 0, tx_port, s->bufsize, false,
+                    compress, 1500, nullptr, RATE_UNLIMITED, scale, s->server_socket != nullptr);
 
-            } else {
-                r = new_response(RESPONSE_BAD_REQUEST, NULL);
+            if(idx < 0) {
+                free_message((struct message *) msg, new_response(RESPONSE_INT_SERV_ERR, "Cannot create output port."));
+                continue;
             }
 
-            free_message((struct message *) msg, r ? r : new_response(RESPONSE_OK, NULL));
+            if(compress)
+                log_msg(LOG_LEVEL_NOTICE, "Created new transcoding output port %s:%d:0x%08" PRIx32 ".\n", host, tx_port, recompress_get_port_ssrc(s->recompress, idx));
+            else
+                log_msg(LOG_LEVEL_NOTICE, "Created new forwarding output port %s:%d.\n", host, tx_port);
+
+        } else {
+            r = new_response(RESPONSE_BAD_REQUEST, NULL);
         }
 
-        // then process incoming packets
-        while (s->qhead != s->qtail) {
-            if(s->qhead->size == 0) { // poisoned pill
+        free_message((struct message *) msg, r ? r : new_response(RESPONSE_OK, NULL));
+    }
+}
+
+static void writer_update_depth(struct hd_rum_translator_state *s)
+{
+    uint64_t depth = queue_depth(s, s->writer_consumed);
+    if (depth > s->writer_depth_max.load(std::memory_order_relaxed)) {
+        s->writer_depth_max.store(depth, std::memory_order_relaxed);
+    }
+}
+
+static void *writer(void *arg)
+{
+    struct hd_rum_translator_state *s =
+        (struct hd_rum_translator_state *) arg;
+
+    while (1) {
+#ifdef WIN32
+        // process incoming packets
+        struct item *head = nullptr;
+        while ((head = s->qhead.load(std::memory_order_relaxed)) != s->qtail.load(std::memory_order_acquire)) {
+            if(head->size == 0) { // poisoned pill
                 return NULL;
             }
 
             // pass it for transcoding if needed
             if (recompress_get_num_active_ports(s->recompress) > 0) {
-                ssize_t ret = hd_rum_decompress_write(s->decompress, s->qhead->buf, s->qhead->size);
+                ssize_t ret = hd_rum_decompress_write(s->decompress, head->buf, head->size);
                 if (ret < 0) {
                     perror("hd_rum_decompress_write");
                 }
             }
 
             // distribute it to output ports that don't need transcoding
-#ifdef WIN32
             // send it asynchronously in MSW (performance optimalization)
             SleepEx(0, TRUE); // allow system to call our completion routines in APC
+            const struct replica_set *rs = rcu_read_lock(s, &s->writer_rcu);
+            const auto &replicas = rs->replicas;
             int ref = 0;
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ref++;
+            for (unsigned int i = 0; i < replicas.size(); i++) {
+                if(replicas[i]->type == replica::type_t::USE_SOCK) {
+                    if (replicas[i]->fec_reassembler) {
+                        struct iovec iov = { head->buf, (size_t) head->size };
+                        replica_send_fec(s, replicas[i], i, &iov, 1);
+                    } else {
+                        ref++;
+                    }
                 }
             }
-            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) s->qhead->buf + OFFSET);
+            struct wsa_aux_storage *aux = (struct wsa_aux_storage *)(void *) ((char *) head->buf + OFFSET);
             memset(aux, 0, sizeof *aux);
             aux->overlapped = (WSAOVERLAPPED *) calloc(ref, sizeof(WSAOVERLAPPED));
             aux->ref = ref;
             int overlapped_idx = 0;
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    aux->overlapped[overlapped_idx].hEvent = s->qhead->buf;
-                    ssize_t ret = udp_sendto_wsa_async(s->replicas[i]->sock.get(), s->qhead->buf, s->qhead->size,
-                                    wsa_deleter, &aux->overlapped[overlapped_idx], (sockaddr *) &s->replicas[i]->sockaddr, s->replicas[i]->sockaddr_len);
+            for (unsigned int i = 0; i < replicas.size(); i++) {
+                if(replicas[i]->type == replica::type_t::USE_SOCK && !replicas[i]->fec_reassembler) {
+                    aux->overlapped[overlapped_idx].hEvent = head->buf;
+                    ssize_t ret = udp_sendto_wsa_async(replicas[i]->sock.get(), head->buf, head->size,
+                                    wsa_deleter, &aux->overlapped[overlapped_idx], (sockaddr *) &replicas[i]->sockaddr, replicas[i]->sockaddr_len);
                     if (ret < 0) {
                         perror("Hd-rum-translator send");
                     }
+                    struct iovec iov = { head->buf, (size_t) head->size };
+                    replica_count_sent(replicas[i], &iov, 1, ret < 0 ? -1 : 1);
                     overlapped_idx += 1;
                 }
             }
+            rcu_read_unlock(&s->writer_rcu);
             // reallocate the buffer since the last one will be freeed automaticaly
-            s->qhead->buf = (char *) malloc(SIZE);
+            head->buf = (char *) malloc(SIZE);
+            writer_update_depth(s);
+            s->writer_consumed += 1;
+            s->qhead.store(head->next, std::memory_order_release);
+            notify_queue_consumed(s);
+        }
 #else
-            for (unsigned int i = 0; i < s->replicas.size(); i++) {
-                if(s->replicas[i]->type == replica::type_t::USE_SOCK) {
-                    ssize_t ret = udp_sendto(s->replicas[i]->sock.get(), s->qhead->buf, s->qhead->size, (sockaddr *) &s->replicas[i]->sockaddr, s->replicas[i]->sockaddr_len);
+        // process incoming packets - a batch of them is sent to every
+        // replica with one udp_sendto_multi() call (sendmmsg/GSO)
+        struct item *tail = nullptr;
+        while ((tail = s->qtail.load(std::memory_order_acquire)) != s->qhead.load(std::memory_order_relaxed)) {
+            struct iovec iov[WRITER_BATCH];
+            int count = 0;
+            bool quit = false;
+            writer_update_depth(s);
+            struct item *it = s->qhead.load(std::memory_order_relaxed);
+            for ( ; it != tail && count < WRITER_BATCH; it = it->next) {
+                if (it->size == 0) { // poisoned pill
+                    quit = true;
+                    break;
+                }
+                // pass it for transcoding if needed
+                if (recompress_get_num_active_ports(s->recompress) > 0) {
+                    ssize_t ret = hd_rum_decompress_write(s->decompress, it->buf, it->size);
                     if (ret < 0) {
-                        perror("Hd-rum-translator send");
+                        perror("hd_rum_decompress_write");
                     }
                 }
+                iov[count].iov_base = it->buf;
+                iov[count].iov_len = it->size;
+                count += 1;
             }
-#endif
-            s->qhead = s->qhead->next;
 
-            pthread_mutex_lock(&s->qfull_mtx);
-            s->qfull = 0;
-            pthread_cond_signal(&s->qfull_cond);
-            pthread_mutex_unlock(&s->qfull_mtx);
+            // distribute it to output ports that don't need transcoding
+            // (sender shards do that if enabled, except of the replicas with FEC)
+            const struct replica_set *rs = rcu_read_lock(s, &s->writer_rcu);
+            const auto &replicas = rs->replicas;
+            for (unsigned int i = 0; i < replicas.size() && count > 0; i++) {
+                if (replicas[i]->type != replica::type_t::USE_SOCK || replicas[i]->offload_slot >= 0) {
+                    continue;
+                }
+                if (replicas[i]->fec_reassembler) {
+                    replica_send_fec(s, replicas[i], i, iov, count);
+                } else if (s->shards.empty()) {
+                    int ret = udp_sendto_multi(replicas[i]->sock.get(), iov, count, (sockaddr *) &replicas[i]->sockaddr, replicas[i]->sockaddr_len);
+                    if (ret < 0) {
+                        perror("Hd-rum-translator send");
+                    }
+                    replica_count_sent(replicas[i], iov, count, ret);
+                }
+            }
+            rcu_read_unlock(&s->writer_rcu);
+            s->writer_consumed += count;
+            if (quit) {
+                return NULL;
+            }
+            s->qhead.store(it, std::memory_order_release);
+            notify_queue_consumed(s);
         }
+#endif
 
-        pthread_mutex_lock(&s->qempty_mtx);
-        if (s->qempty)
-            pthread_cond_wait(&s->qempty_cond, &s->qempty_mtx);
-        s->qempty = 1;
-        pthread_mutex_unlock(&s->qempty_mtx);
+        struct item *head = s->qhead.load(std::memory_order_relaxed);
+        s->writer_data_ready.wait([s, head] { return s->qtail.load(std::memory_order_acquire) != head; }, 0);
     }
 
     return NULL;
 }
 
+#define CONTROL_POLL_INTERVAL_MS 100
+
+/**
+ * Handles everything that changes the replicas (port messages, RTCP driven
+ * adaptation) so that creating a port (socket setup, compression init) or
+ * removing it (joining its threads) doesn't stall the packet forwarding.
+ */
+static void control_thread_run(struct hd_rum_translator_state *s)
+{
+    set_thread_name("hd-rum-control");
+    std::unique_lock<std::mutex> lk(s->control_lock);
+    while (!s->control_should_exit) {
+        lk.unlock();
+        process_messages(s);
+        process_rtcp(s);
+        report_stats(s);
+        lk.lock();
+        s->control_cv.wait_for(lk, std::chrono::milliseconds(CONTROL_POLL_INTERVAL_MS),
+                [s] { return s->control_should_exit; });
+    }
+}
+
 static void usage(const char *progname) {
         col() << SBOLD(SRED(progname) <<
             " [global_opts] buffer_size port [host1_options] host1 [[host2_options] host2] ...") << "\n";
@@ -529,6 +1093,11 @@ static void usage(const char *progname) {
                 SBOLD("\t\t--conference <width>:<height>[:fps]") << " - enable combining of multiple inputs, increases latency\n" <<
                 SBOLD("\t\t--conference-compression <compression>") << " - compression for conference participants\n" <<
                 SBOLD("\t\t--capture-filter <cfg_string>") << " - apply video capture filter to incoming video\n" <<
+                SBOLD("\t\t--send-threads <n>") << " - distribute forwarding replicas among <n> sender threads (default: 0 - sent by the writer thread)\n" <<
+                SBOLD("\t\t--offload <ifname>") << " - forward to IPv4 hosts without compression directly in the kernel (eBPF on ingress of <ifname>, Linux only)\n" <<
+                SBOLD("\t\t--adapt <compression>") << " - transcode to forwarding hosts reporting congestion (RTCP RR to <port>+1) with <compression>\n"
+                        "\t\t                        (eg. libavcodec:bitrate=5M), forward again when the loss subsides\n" <<
+                SBOLD("\t\t--stats-interval <sec>") << " - interval of per-port statistics reported to the control port (default: 1, 0 - disable)\n" <<
                 SBOLD("\t\t--param") << " - additional parameters\n" <<
                 SBOLD("\t\t--help\n") <<
                 SBOLD("\t\t--verbose\n") <<
@@ -536,10 +1105,12 @@ static void usage(const char *progname) {
         col() << "\tand " << SUNDERLINE("hostX_options") << " may be:\n" <<
                 SBOLD("\t\t-P [<rx_port>:]<tx_port>") << " - TX port to be used (optionally also RX)\n" <<
                 SBOLD("\t\t-c <compression>") << " - compression\n" <<
+                SBOLD("\t\t-f <fec>") << " - FEC that will be used for transmission (without '-c' added to the forwarded frames\n"
+                        "\t\t             without decoding, eg. only for the hosts on lossy links)\n" <<
                 "\t\tFollowing options will be used only if " << SUNDERLINE("'-c'") << " parameter is set:\n" <<
                 SBOLD("\t\t-m <mtu>") << " - MTU size\n" <<
                 SBOLD("\t\t-l <limiting_bitrate>") << " - bitrate to be shaped to\n" <<
-                SBOLD("\t\t-f <fec>") << " - FEC that will be used for transmission.\n" <<
+                SBOLD("\t\t-s <width>x<height>") << " - output size (scaled once for all hosts with the same size)\n" <<
                 SBOLD("\t\t-4/-6") << " - force IPv4/IPv6\n";
         printf("\tPlease note that blending and capture filter is used only for host for which\n"
                "\tcompression is specified (transcoding is active). If compression is not\n"
@@ -556,6 +1127,7 @@ struct host_opts {
     char *fec;
     int64_t bitrate;
     int force_ip_version;
+    char *scale;
 };
 
 struct cmdline_parameters {
@@ -570,6 +1142,10 @@ struct cmdline_parameters {
     const char *capture_filter = NULL;
     bool verbose = false;
     const char *conference_compression = nullptr;
+    int send_threads = 0;
+    const char *offload_if = nullptr;
+    const char *adapt_compress = nullptr;
+    double stats_interval = 1.0;
 };
 
 static bool needs_argument(const char *opt) {
@@ -612,6 +1188,30 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
             parsed->server_port = atoi(item);
         } else if(strcmp(argv[start_index], "--capture-filter") == 0) {
             parsed->capture_filter = argv[++start_index];
+        } else if(strcmp(argv[start_index], "--send-threads") == 0) {
+            parsed->send_threads = atoi(argv[++start_index]);
+#ifdef WIN32
+            LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Sender threads are not supported in Windows!\n";
+            return -1;
+#endif
+            if (parsed->send_threads < 0) {
+                LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Wrong number of sender threads: " << argv[start_index] << "\n";
+                return -1;
+            }
+        } else if(strcmp(argv[start_index], "--offload") == 0) {
+            parsed->offload_if = argv[++start_index];
+#ifndef HAVE_HD_RUM_OFFLOAD
+            LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Kernel offload is not compiled in!\n";
+            return -1;
+#endif
+        } else if(strcmp(argv[start_index], "--stats-interval") == 0) {
+            parsed->stats_interval = atof(argv[++start_index]);
+            if (parsed->stats_interval < 0.0) {
+                LOG(LOG_LEVEL_FATAL) << MOD_NAME << "Wrong statistics interval: " << argv[start_index] << "\n";
+                return -1;
+            }
+        } else if(strcmp(argv[start_index], "--adapt") == 0) {
+            parsed->adapt_compress = argv[++start_index];
         } else if(strcmp(argv[start_index], "-h") == 0 || strcmp(argv[start_index], "--help") == 0) {
             usage(argv[0]);
             return 1;
@@ -697,6 +1297,9 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
                 case 'f':
                     parsed->hosts[host_idx].fec = argv[i + 1];
                     break;
+                case 's':
+                    parsed->hosts[host_idx].scale = argv[i + 1];
+                    break;
                 case 'l':
                     if (strcmp(argv[i + 1], "unlimited") == 0) {
                         parsed->hosts[host_idx].bitrate = RATE_UNLIMITED;
@@ -733,6 +1336,17 @@ static int parse_fmt(int argc, char **argv, struct cmdline_parameters *parsed)
 }
 
 static void hd_rum_translator_deinit(struct hd_rum_translator_state *s) {
+    if (s->control_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(s->control_lock);
+            s->control_should_exit = true;
+        }
+        s->control_cv.notify_one();
+        s->control_thread.join();
+    }
+#ifdef HAVE_HD_RUM_OFFLOAD
+    hd_rum_offload_done(s->offload);
+#endif
     if(s->decompress) {
         hd_rum_decompress_done(s->decompress);
     }
@@ -743,6 +1357,7 @@ static void hd_rum_translator_deinit(struct hd_rum_translator_state *s) {
     for (unsigned int i = 0; i < s->replicas.size(); i++) {
         delete s->replicas[i];
     }
+    delete s->published.load();
 
     control_done(s->control_state);
 
@@ -892,7 +1507,6 @@ int main(int argc, char **argv)
     int qsize;
     socket_udp *sock_in = nullptr;
     pthread_t thread;
-    int err = 0;
     int i;
     struct cmdline_parameters params = {};
 
@@ -969,6 +1583,10 @@ int main(int argc, char **argv)
     if (!state.qhead) {
         EXIT(EXIT_FAILURE);
     }
+    for (int i = 0; i < params.send_threads; ++i) {
+        state.shards.emplace_back(std::make_unique<sender_shard>());
+        state.shards.back()->cursor = state.queue;
+    }
 
     /* input socket */
     if ((sock_in = udp_init_if("localhost", NULL, params.port, 0, 255, false, false)) == NULL) {
@@ -982,6 +1600,24 @@ int main(int argc, char **argv)
 
     printf("listening on *:%d\n", params.port);
 
+#ifdef HAVE_HD_RUM_OFFLOAD
+    if (params.offload_if != nullptr) {
+        state.offload = hd_rum_offload_init(params.offload_if, params.port);
+        if (state.offload == nullptr) {
+            EXIT(EXIT_FAILURE);
+        }
+    }
+#endif
+
+    state.stats_interval = params.stats_interval * NS_IN_SEC;
+    if (params.adapt_compress != nullptr) {
+        state.adapt_compress = params.adapt_compress;
+        state.rtcp_socket = std::shared_ptr<socket_udp>(udp_init("localhost", params.port + 1, 0, 255, 0, false), udp_exit);
+        if (!state.rtcp_socket) {
+            fprintf(stderr, "Cannot initialize RTCP socket on port %d!\n", params.port + 1);
+            EXIT(EXIT_FAILURE);
+        }
+    }
 
     if (params.control_port != -1) {
         if (control_init(params.control_port, params.control_connection_type, &state.control_state, &state.mod, 0) != 0) {
@@ -1023,7 +1659,8 @@ int main(int argc, char **argv)
 
         int idx = create_output_port(&state,
                 h.addr, rx_port, tx_port, state.bufsize, h.force_ip_version,
-                h.compression, h.mtu, h.compression ? h.fec : nullptr, h.bitrate);
+                h.compression, h.mtu, h.fec, h.bitrate,
+                h.compression ? h.scale : nullptr);
         if(idx < 0) {
             EXIT(EXIT_FAILURE);
         }
@@ -1033,6 +1670,15 @@ int main(int argc, char **argv)
         fprintf(stderr, "cannot create writer thread\n");
         EXIT(2);
     }
+    state.control_thread = std::thread(control_thread_run, &state);
+#ifndef WIN32
+    for (auto &sh : state.shards) {
+        sh->thread = std::thread(sender_shard_run, &state, sh.get());
+    }
+    if (!state.shards.empty()) {
+        printf("using %zu sender threads\n", state.shards.size());
+    }
+#endif
 
     uint64_t received_data = 0;
     struct timeval t0;
@@ -1050,73 +1696,87 @@ int main(int argc, char **argv)
     register_should_exit_callback(&state.mod, hd_rum_translator_should_exit_callback, const_cast<bool *>(&should_exit));
     /* main loop */
     while (!should_exit) {
-        while (state.qtail->next != state.qhead && !should_exit) {
-            struct timeval timeout = { 1, 0 };
+        // collect free items - received packets are written directly to them
+        struct item *slots[RECV_BATCH];
+        struct item *tail = state.qtail.load(std::memory_order_relaxed);
+        int free_slots = 0;
+        for (struct item *it = tail; free_slots < RECV_BATCH && !queue_full(&state, it); it = it->next) {
+            slots[free_slots++] = it;
+        }
+        if (free_slots == 0) {
+            state.space_ready.wait([&state, tail] { return !queue_full(&state, tail); }, 0);
+            continue;
+        }
 
-            struct sockaddr_storage sin = {};
-            socklen_t addrlen = sizeof(sin);
-            state.qtail->size = udp_recvfrom_timeout(sock_in, state.qtail->buf, SIZE, &timeout, (sockaddr *) &sin, &addrlen);
-            if(state.qtail->size <= 0)
-                break;
+        char *bufs[RECV_BATCH];
+        int lens[RECV_BATCH];
+        struct sockaddr_storage sin[RECV_BATCH];
+        socklen_t addrlens[RECV_BATCH];
+        for (int j = 0; j < free_slots; ++j) {
+            bufs[j] = slots[j]->buf;
+            addrlens[j] = sizeof sin[j];
+        }
+        struct timeval timeout = { 1, 0 };
+        int count = udp_recvfrom_multi(sock_in, bufs, SIZE, lens, free_slots, &timeout, sin, addrlens);
+        if (count <= 0) {
+            continue;
+        }
 
-            struct timeval t;
-            gettimeofday(&t, NULL);
+        struct timeval t;
+        gettimeofday(&t, NULL);
 
-            if(params.out_conf.mode == CONFERENCE){
-                    participant_mgr.tick(sin, addrlen);
+        int published = 0;
+        for (int j = 0; j < count; ++j) {
+            if (lens[j] == 0) { // would be taken as the poisoned pill
+                continue;
             }
-
-            received_data += state.qtail->size;
-
-            state.qtail = state.qtail->next;
-
-            pthread_mutex_lock(&state.qempty_mtx);
-            state.qempty = 0;
-            pthread_cond_signal(&state.qempty_cond);
-            pthread_mutex_unlock(&state.qempty_mtx);
-
-            double seconds = tv_diff(t, t0);
-            if (seconds > 5.0) {
-                unsigned long long int cur_data = (received_data - last_data);
-                unsigned long long int bps = cur_data / seconds;
-                char tim_str[20];
-                time_t tim = time(NULL);
-                struct tm *tmp = localtime(&tim);
-                if (tmp) {
-                    strftime(tim_str, sizeof(tim_str), "%F %T", tmp);
-                }
-                log_msg(LOG_LEVEL_INFO, "[%s] Received %llu bytes in %g seconds = %sbps\n", tim_str, cur_data, seconds, format_in_si_units(bps * 8));
-                t0 = t;
-                last_data = received_data;
+            if (published != j) { // compact - the items are not published yet
+                std::swap(slots[published]->buf, slots[j]->buf);
+            }
+            slots[published]->size = lens[j];
+            if(params.out_conf.mode == CONFERENCE){
+                    participant_mgr.tick(sin[j], addrlens[j]);
             }
+            received_data += lens[j];
+            published += 1;
         }
-
-        if (state.qtail->size <= 0)
+        if (published == 0) {
             continue;
-
-        pthread_mutex_lock(&state.qfull_mtx);
-        if (state.qfull)
-            pthread_cond_wait(&state.qfull_cond, &state.qfull_mtx);
-        state.qfull = 1;
-        pthread_mutex_unlock(&state.qfull_mtx);
-    }
-
-    if (state.qtail->size < 0 && !should_exit) {
-        printf("read: %s\n", strerror(err));
-        EXIT(2);
+        }
+        queue_publish(&state, slots[published - 1]->next, published);
+
+        double seconds = tv_diff(t, t0);
+        if (seconds > 5.0) {
+            unsigned long long int cur_data = (received_data - last_data);
+            unsigned long long int bps = cur_data / seconds;
+            char tim_str[20];
+            time_t tim = time(NULL);
+            struct tm *tmp = localtime(&tim);
+            if (tmp) {
+                strftime(tim_str, sizeof(tim_str), "%F %T", tmp);
+            }
+            log_msg(LOG_LEVEL_INFO, "[%s] Received %llu bytes in %g seconds = %sbps\n", tim_str, cur_data, seconds, format_in_si_units(bps * 8));
+#ifdef HAVE_HD_RUM_OFFLOAD
+            if (state.offload != nullptr) {
+                hd_rum_offload_report(state.offload);
+            }
+#endif
+            t0 = t;
+            last_data = received_data;
+        }
     }
 
     // pass poisoned pill to the worker
-    state.qtail->size = 0;
-    state.qtail = state.qtail->next;
-
-    pthread_mutex_lock(&state.qempty_mtx);
-    state.qempty = 0;
-    pthread_cond_signal(&state.qempty_cond);
-    pthread_mutex_unlock(&state.qempty_mtx);
+    struct item *tail = state.qtail.load(std::memory_order_relaxed);
+    state.space_ready.wait([&state, tail] { return !queue_full(&state, tail); }, 0);
+    tail->size = 0;
+    queue_publish(&state, tail->next, 1);
 
     alarm(5);
     pthread_join(thread, NULL);
+    for (auto &sh : state.shards) {
+        sh->thread.join();
+    }
 
     hd_rum_translator_deinit(&state);
     udp_exit(sock_in);
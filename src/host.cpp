@@ -74,9 +74,11 @@
 #include "video_compress.h"
 #include "video_display.h"
 #include "capture_filter.h"
+#include "tv.h"
 #include "video.h"
 
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <getopt.h>
 #include <iomanip>
@@ -347,8 +349,35 @@ static bool parse_opts_set_logging(int argc, char *argv[])
         return true;
 }
 
+static time_ns_t startup_start_ns;
+static std::atomic<bool> startup_event_reported[STARTUP_FIRST_DISPLAYED + 1];
+
+/// logs the duration of the startup phase begun at phase_start_ns (get_time_in_ns())
+void startup_report_phase(const char *phase, long long phase_start_ns)
+{
+        time_ns_t now = get_time_in_ns();
+        log_msg(LOG_LEVEL_VERBOSE, "[startup] %s initialized in %.1f ms (%.1f ms since start)\n", phase,
+                        (double) (now - phase_start_ns) / NS_IN_MS, (double) (now - startup_start_ns) / NS_IN_MS);
+}
+
+/**
+ * Logs time-to-first-frame, only the first occurrence of the event is
+ * reported (may be called for every frame).
+ */
+void startup_report_event(enum startup_event event)
+{
+        if (startup_event_reported[event].load(std::memory_order_relaxed)
+                        || startup_event_reported[event].exchange(true)) {
+                return;
+        }
+        log_msg(LOG_LEVEL_INFO, "[startup] First frame %s %.1f ms after start\n",
+                        event == STARTUP_FIRST_CAPTURED ? "captured" : "displayed",
+                        (double) (get_time_in_ns() - startup_start_ns) / NS_IN_MS);
+}
+
 struct init_data *common_preinit(int argc, char *argv[])
 {
+        startup_start_ns = get_time_in_ns();
         uv_argc = argc;
         uv_argv = argv;
 
@@ -414,8 +443,10 @@ struct init_data *common_preinit(int argc, char *argv[])
         com_initialize(&init.com_initialized, nullptr);
 #endif
 
+        auto *ret = new init_data{init};
         if (strstr(argv[0], "run_tests") == nullptr) {
-                open_all("ultragrid_*.so", init.opened_libs); // load modules
+                // modules opened later on demand are added to the list as well
+                open_all("ultragrid_*.so", ret->opened_libs);
         }
 
         srand48((getpid() * 42) ^ get_time_in_ns());
@@ -426,7 +457,7 @@ struct init_data *common_preinit(int argc, char *argv[])
 
         load_libgcc();
 
-        return new init_data{init};
+        return ret;
 }
 
 struct state_root {
@@ -833,6 +864,7 @@ static struct {
 void register_param(const char *param, const char *doc)
 {
         assert(param != NULL && doc != NULL);
+        register_library_param(param);
         for (unsigned int i = 0; i < sizeof params / sizeof params[0]; ++i) {
                 if (params[i].param == NULL) {
                         params[i].param = param;
@@ -853,13 +885,14 @@ bool validate_param(const char *param)
 {
         for (unsigned int i = 0; i < sizeof params / sizeof params[0]; ++i) {
                 if (params[i].param == NULL) {
-                        return false;
+                        break;
                 }
                 if (strcmp(params[i].param, param) == 0) {
                         return true;
                 }
         }
-        return false;
+        // param may be registered by a module not opened yet
+        return load_module_for_param(param) && validate_param(param);
 }
 
 
@@ -910,6 +943,7 @@ bool parse_params(const char *optarg, bool preinit)
 
 void print_param_doc()
 {
+        load_all_modules();
         for (unsigned int i = 0; i < sizeof params / sizeof params[0]; ++i) {
                 if (params[i].doc != NULL) {
                         puts(params[i].doc);
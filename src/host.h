@@ -129,6 +129,14 @@ struct init_data;
 struct init_data *common_preinit(int argc, char *argv[]);
 void common_cleanup(struct init_data *init_data);
 
+// startup timing (relative to common_preinit())
+enum startup_event {
+        STARTUP_FIRST_CAPTURED,  ///< first frame grabbed from a capture device
+        STARTUP_FIRST_DISPLAYED, ///< first frame passed to a display
+};
+void startup_report_phase(const char *phase, long long phase_start_ns);
+void startup_report_event(enum startup_event event);
+
 // root module management
 void init_root_module(struct module *root_mod);
 void register_should_exit_callback(struct module *mod, void (*callback)(void *), void *udata);
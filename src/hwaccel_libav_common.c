@@ -47,8 +47,12 @@
 #include "config_win32.h"
 #endif
 
+#include <assert.h>
+
 #include "hwaccel_libav_common.h"
+#include "hwaccel_rpi4.h" // av_frame_wrapper
 #include "libavcodec/lavc_common.h"
+#include "video_frame.h"
 
 void hwaccel_state_init(struct hw_accel_state *hwaccel){
         hwaccel->type = HWACCEL_NONE;
@@ -128,4 +132,44 @@ void transfer_frame(struct hw_accel_state *s, AVFrame *frame){
         av_frame_unref(frame);
         av_frame_move_ref(frame, s->tmp_frame);
 }
+
+static void lavc_hw_frame_data_deleter(struct video_frame *frame)
+{
+        AVFrame *hw_frame = (AVFrame *)(void *) frame->tiles[0].data;
+        av_frame_free(&hw_frame);
+}
+
+struct video_frame *vf_alloc_lavc_hw_frame(struct video_desc desc, const AVFrame *hw_frame)
+{
+        assert(hw_frame->hw_frames_ctx != NULL);
+        assert(desc.tile_count == 1);
+        AVFrame *ref = av_frame_clone(hw_frame);
+        if (ref == NULL) {
+                return NULL;
+        }
+        struct video_frame *frame = vf_alloc_desc(desc);
+        frame->mem_location = LAVC_HW_MEM;
+        frame->tiles[0].data = (char *) ref;
+        frame->tiles[0].data_len = 0;
+        frame->callbacks.data_deleter = lavc_hw_frame_data_deleter;
+        return frame;
+}
+
+void av_frame_wrapper_recycle_callback(struct video_frame *frame)
+{
+        for (unsigned i = 0; i < frame->tile_count; i++) {
+                av_frame_wrapper *wrapper = (av_frame_wrapper *)(void *) frame->tiles[i].data;
+                av_frame_free(&wrapper->av_frame);
+        }
+
+        frame->callbacks.recycle = NULL;
+}
+
+void av_frame_wrapper_copy_callback(struct video_frame *frame)
+{
+        for (unsigned i = 0; i < frame->tile_count; i++) {
+                av_frame_wrapper *wrapper = (av_frame_wrapper *)(void *) frame->tiles[i].data;
+                wrapper->av_frame = av_frame_clone(wrapper->av_frame);
+        }
+}
 #endif
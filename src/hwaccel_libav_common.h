@@ -124,6 +124,31 @@ int create_hw_frame_ctx(AVBufferRef *device_ref,
  */
 void transfer_frame(struct hw_accel_state *s, AVFrame *frame);
 
+/**
+ * @brief Wraps hw surface to a video_frame with LAVC_HW_MEM location
+ *
+ * Intended for capturers producing hw surfaces - the frame can then be passed
+ * to the libavcodec encoder without download (or is downloaded and converted
+ * to desc.color_spec if the encoder doesn't accept the surfaces).
+ *
+ * @param desc     frame description, color_spec is the UG equivalent of the
+ *                 surface sw_format
+ * @param hw_frame frame with hw_frames_ctx, the returned frame holds its own
+ *                 reference released by vf_free()
+ */
+struct video_frame *vf_alloc_lavc_hw_frame(struct video_desc desc, const AVFrame *hw_frame);
+
+/**
+ * @brief Releases AVFrames held by av_frame_wrapper tiles (recycle callback)
+ */
+void av_frame_wrapper_recycle_callback(struct video_frame *frame);
+
+/**
+ * @brief Makes av_frame_wrapper tiles of a copied frame hold own references
+ * (copy callback)
+ */
+void av_frame_wrapper_copy_callback(struct video_frame *frame);
+
 #endif //HWACC_COMMON_IMPL
 
 #ifdef __cplusplus
@@ -176,7 +176,6 @@ int vaapi_init(struct AVCodecContext *s,
                 struct hw_accel_state *state,
                 codec_t out_codec)
 {
-        (void)(out_codec);
         struct vaapi_ctx *ctx = calloc(1, sizeof(struct vaapi_ctx));
         if(!ctx){
                 return -1;
@@ -220,7 +219,7 @@ int vaapi_init(struct AVCodecContext *s,
                 goto fail;
         }
         state->type = HWACCEL_VAAPI;
-        state->copy = true;
+        state->copy = out_codec != HW_VAAPI;
         state->ctx = ctx;
         state->uninit = vaapi_uninit;
 
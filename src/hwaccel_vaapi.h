@@ -78,6 +78,11 @@ struct vaapi_ctx{
 
 void vaapi_uninit(struct hw_accel_state *s);
 int vaapi_create_context(struct vaapi_ctx *ctx, AVCodecContext *codec_ctx);
+/**
+ * @brief Initializes VA-API hw. acceleration
+ *
+ * @param out_codec Expected output codec. If not HW_VAAPI copy mode is used.
+ */
 int vaapi_init(struct AVCodecContext *s,
                 struct hw_accel_state *state,
                 codec_t out_codec);
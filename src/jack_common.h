@@ -44,11 +44,14 @@
 #endif // ! defined __cplusplus
 
 #include <jack/jack.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "compat/dlfunc.h"
+#include "control_socket.h"
 #include "debug.h"
+#include "tv.h"
 #include "types.h"
 
 #if defined (__linux__) && defined (_GNU_SOURCE)
@@ -87,6 +90,9 @@ typedef int (*jack_set_process_callback_t)(jack_client_t *client,
 typedef int (*jack_set_sample_rate_callback_t)(jack_client_t *client,
                 JackSampleRateCallback srate_callback,
                 void *arg) JACK_OPTIONAL_WEAK_EXPORT;
+typedef int (*jack_set_xrun_callback_t)(jack_client_t *client,
+                JackXRunCallback xrun_callback,
+                void *arg) JACK_OPTIONAL_WEAK_EXPORT;
 
 struct libjack_connection {
         LIB_HANDLE  libjack; ///< lib connection
@@ -105,6 +111,7 @@ struct libjack_connection {
         jack_port_register_t            port_register;
         jack_set_process_callback_t     set_process_callback;
         jack_set_sample_rate_callback_t set_sample_rate_callback;
+        jack_set_xrun_callback_t        set_xrun_callback;
 };
 
 static void close_libjack(struct libjack_connection *s)
@@ -140,6 +147,7 @@ static bool load_jack_symbols(struct libjack_connection *s)
         JACK_DLSYM(port_name);
         JACK_DLSYM(port_register);
         JACK_DLSYM(set_process_callback);
+        JACK_DLSYM(set_xrun_callback);
         return true;
 }
 
@@ -257,6 +265,55 @@ static inline struct device_info *audio_jack_probe(const char *client_name,
         return available_devices;
 }
 
+#define JACK_STATS_INTERVAL_NS (5 * NS_IN_SEC)
+
+/**
+ * Counters updated from the JACK threads (atomically, without locks) and
+ * reported from an UG thread by jack_xrun_stats_report().
+ */
+struct jack_xrun_stats {
+        atomic_int xruns;         ///< reported by JACK (xrun callback)
+        atomic_int buffer_errors; ///< module ring buffer overflows (capture) or underruns (playback)
+        int reported_xruns;
+        int reported_buffer_errors;
+        time_ns_t last_report;
+};
+
+static inline int jack_xrun_callback(void *arg)
+{
+        struct jack_xrun_stats *st = (struct jack_xrun_stats *) arg;
+        atomic_fetch_add_explicit(&st->xruns, 1, memory_order_relaxed);
+        return 0;
+}
+
+/**
+ * Logs new xruns/buffer errors and sends the counters to control socket (if
+ * stats are enabled). Rate-limited, may be called for every frame.
+ */
+static inline void jack_xrun_stats_report(struct jack_xrun_stats *st, struct control_state *control,
+                const char *mod_name, const char *stat_name, const char *buffer_error_name)
+{
+        time_ns_t now = get_time_in_ns();
+        if (now - st->last_report < JACK_STATS_INTERVAL_NS) {
+                return;
+        }
+        st->last_report = now;
+        int xruns = atomic_load_explicit(&st->xruns, memory_order_relaxed);
+        int buffer_errors = atomic_load_explicit(&st->buffer_errors, memory_order_relaxed);
+        if (xruns != st->reported_xruns || buffer_errors != st->reported_buffer_errors) {
+                log_msg(LOG_LEVEL_WARNING, "%s%d xruns, %d buffer %s in last %d seconds.\n", mod_name,
+                                xruns - st->reported_xruns, buffer_errors - st->reported_buffer_errors,
+                                buffer_error_name, (int) (JACK_STATS_INTERVAL_NS / NS_IN_SEC));
+        }
+        st->reported_xruns = xruns;
+        st->reported_buffer_errors = buffer_errors;
+
+        if (control_stats_enabled(control)) {
+                char line[128];
+                snprintf(line, sizeof line, "%s xruns %d %s %d", stat_name, xruns, buffer_error_name, buffer_errors);
+                control_report_stats_cstr(control, line);
+        }
+}
 
 #endif //JACK_COMMON_H
 
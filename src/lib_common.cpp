@@ -45,10 +45,15 @@
 #include <dlfcn.h>
 #include <glob.h>
 #include <libgen.h>
+#include <sys/stat.h>
 #endif
 
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <sstream>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
@@ -78,6 +83,38 @@ const map<enum library_class, library_class_info_t> library_class_info = {
 
 static map<string, string> lib_errors;
 
+#define MODULE_INDEX_NAME "modules.idx"
+
+/**
+ * Module index (LIB_DIR/ultragrid/modules.idx) maps module names and params
+ * to the library files providing them so that only the libraries actually
+ * needed are opened. It is generated with "uv --module-index" from the build
+ * and installed alongside the modules. If it is missing or outdated, all
+ * modules are opened at startup as before.
+ */
+static struct module_index {
+        struct entry {
+                string file;
+                bool hidden;
+        };
+        bool valid = false;
+        string dir;
+        vector<string> files;                      ///< all libraries found in dir
+        map<enum library_class, map<string, entry>> modules;
+        map<string, string> params;                ///< param -> file
+        set<string> unregistered;                  ///< files that registered no module during index generation
+        set<string> opened;                        ///< files already dlopen()ed (or tried to)
+        list<void *> *handles = nullptr;
+} module_index;
+
+/// library file being currently opened (to record module origin for the index)
+static const char *loading_lib;
+
+static auto &get_param_origins() {
+        static map<string, string> param_origins;
+        return param_origins;
+}
+
 #ifdef BUILD_LIBRARIES
 static void push_basename_entry(char ***binarynames, const char *bnc, size_t * templates) {
 	char * alt_v0 = strdup(bnc);
@@ -171,6 +208,84 @@ static int running_from_path(char * uv_argv[]) {
 }
 #endif
 
+#ifdef BUILD_LIBRARIES
+static void open_module_file(const string &file) {
+        if (!module_index.opened.insert(file).second) {
+                return;
+        }
+        string path = module_index.dir + "/" + file;
+        loading_lib = file.c_str();
+        void *handle = dlopen(path.c_str(), RTLD_NOW|RTLD_GLOBAL);
+        loading_lib = nullptr;
+        if (!handle) {
+                const char *error = dlerror();
+                verbose_msg("Library %s opening warning: %s \n", path.c_str(), error);
+                if (error) {
+                        lib_errors.emplace(file, error);
+                }
+                return;
+        }
+        if (module_index.handles != nullptr) {
+                module_index.handles->push_back(handle);
+        }
+}
+
+/**
+ * @retval true index is present and up-to-date with the libraries in dir
+ */
+static bool read_module_index() {
+        string path = module_index.dir + "/" MODULE_INDEX_NAME;
+        ifstream in(path);
+        struct stat index_st{};
+        if (!in || stat(path.c_str(), &index_st) != 0) {
+                verbose_msg("Module index %s not found, opening all modules.\n", path.c_str());
+                return false;
+        }
+        set<string> indexed;
+        string line;
+        while (getline(in, line)) {
+                istringstream iss(line);
+                string type;
+                iss >> type;
+                if (type == "module") {
+                        int cls = 0;
+                        int hidden = 0;
+                        string name;
+                        string file;
+                        iss >> cls >> hidden >> name >> file;
+                        module_index.modules[static_cast<enum library_class>(cls)][name] = { file, hidden != 0 };
+                } else if (type == "param") {
+                        string name;
+                        string file;
+                        iss >> name >> file;
+                        module_index.params[name] = file;
+                } else if (type == "file") {
+                        string file;
+                        int modules = 0;
+                        iss >> file >> modules;
+                        indexed.insert(file);
+                        if (modules == 0) {
+                                module_index.unregistered.insert(file);
+                        }
+                }
+        }
+
+        for (auto const &file : module_index.files) {
+                struct stat st{};
+                if (indexed.find(file) == indexed.end() ||
+                                (stat((module_index.dir + "/" + file).c_str(), &st) == 0 && st.st_mtime > index_st.st_mtime)) {
+                        log_msg(LOG_LEVEL_VERBOSE, "Module index %s is outdated (%s), opening all modules.\n",
+                                        path.c_str(), file.c_str());
+                        module_index.modules.clear();
+                        module_index.params.clear();
+                        module_index.unregistered.clear();
+                        return false;
+                }
+        }
+        return true;
+}
+#endif
+
 void open_all(const char *pattern, list<void *> &libs) {
 #ifdef BUILD_LIBRARIES
         char path[512];
@@ -180,40 +295,94 @@ void open_all(const char *pattern, list<void *> &libs) {
         if (!running_from_path(uv_argv)) {
                 char *tmp = strdup(uv_argv[0]);
                 char *dir = dirname(tmp);
-                snprintf(path, sizeof(path), "%s/../lib/ultragrid/%s", dir, pattern);
+                snprintf(path, sizeof(path), "%s/../lib/ultragrid", dir);
                 free(tmp);
         } else {
-                snprintf(path, sizeof(path), LIB_DIR "/ultragrid/%s", pattern);
+                snprintf(path, sizeof(path), LIB_DIR "/ultragrid");
         }
+        module_index.dir = path;
+        module_index.handles = &libs;
 
+        snprintf(path + strlen(path), sizeof path - strlen(path), "/%s", pattern);
         glob(path, 0, NULL, &glob_buf);
-
         for(unsigned int i = 0; i < glob_buf.gl_pathc; ++i) {
-                void *handle = dlopen(glob_buf.gl_pathv[i], RTLD_NOW|RTLD_GLOBAL);
-                if (!handle) {
-                        char *error = dlerror();
-                        verbose_msg("Library %s opening warning: %s \n", glob_buf.gl_pathv[i],
-                                        error);
-                        char *filename = basename(glob_buf.gl_pathv[i]);
-                        if (filename && error) {
-                                lib_errors.emplace(filename, error);
-                        }
-                        continue;
-                }
-                libs.push_back(handle);
+                module_index.files.push_back(basename(glob_buf.gl_pathv[i]));
         }
-
         globfree(&glob_buf);
+
+        module_index.valid = read_module_index();
+        if (module_index.valid) {
+                verbose_msg("Module index found, modules will be opened on demand.\n");
+                return;
+        }
+        load_all_modules();
 #else
         UNUSED(libs);
         UNUSED(pattern);
 #endif
 }
 
+void load_all_modules() {
+#ifdef BUILD_LIBRARIES
+        for (auto const &file : module_index.files) {
+                open_module_file(file);
+        }
+#endif
+}
+
+/**
+ * Opens libraries providing modules of class cls (or the module name if given)
+ * according to the module index.
+ */
+static void load_indexed_modules(enum library_class cls, const char *name = nullptr) {
+#ifdef BUILD_LIBRARIES
+        if (!module_index.valid) {
+                return;
+        }
+        auto it_cls = module_index.modules.find(cls);
+        if (it_cls != module_index.modules.end()) {
+                for (auto const &mod : it_cls->second) {
+                        if (name == nullptr || strcasecmp(mod.first.c_str(), name) == 0) {
+                                open_module_file(mod.second.file);
+                        }
+                }
+        }
+        // modules that didn't register while indexing (eg. run-time condition)
+        for (auto const &file : module_index.unregistered) {
+                open_module_file(file);
+        }
+#else
+        UNUSED(cls);
+        UNUSED(name);
+#endif
+}
+
+bool load_module_for_param(const char *param) {
+#ifdef BUILD_LIBRARIES
+        auto it = module_index.params.find(param);
+        if (!module_index.valid || it == module_index.params.end() ||
+                        module_index.opened.find(it->second) != module_index.opened.end()) {
+                return false;
+        }
+        open_module_file(it->second);
+        return true;
+#else
+        UNUSED(param);
+        return false;
+#endif
+}
+
+void register_library_param(const char *param) {
+        if (loading_lib != nullptr) {
+                get_param_origins()[param] = loading_lib;
+        }
+}
+
 struct lib_info {
         const void *data;
         int abi_version;
         bool hidden;
+        string file; ///< library the module was registered from (empty if built-in)
 };
 
 // http://stackoverflow.com/questions/1801892/making-mapfind-operation-case-insensitive
@@ -251,12 +420,16 @@ void register_library(const char *name, const void *data, enum library_class cls
         if (map.find(name) != map.end()) {
                 LOG(LOG_LEVEL_ERROR) << "Module \"" << name << "\" (class " << cls << ") multiple initialization!\n";
         }
-        map[name] = {data, abi_version, static_cast<bool>(hidden)};
+        map[name] = {data, abi_version, static_cast<bool>(hidden), loading_lib ? loading_lib : ""};
 }
 
 const void *load_library(const char *name, enum library_class cls, int abi_version)
 {
         auto it_cls = get_libmap().find(cls);
+        if (it_cls == get_libmap().end() || it_cls->second.find(name) == it_cls->second.end()) {
+                load_indexed_modules(cls, name);
+                it_cls = get_libmap().find(cls);
+        }
         if (it_cls != get_libmap().end()) {
                 auto it_module = it_cls->second.find(name);
                 if (it_module != it_cls->second.end()) {
@@ -294,9 +467,26 @@ const void *load_library(const char *name, enum library_class cls, int abi_versi
  * @param full  include hidden modules
  */
 void list_modules(enum library_class cls, int abi_version, bool full) {
-        const auto & class_set = get_libraries_for_class(cls, abi_version, full);
-        for (auto && item : class_set) {
-                col() << "\t" << SBOLD(item.first.c_str()) << "\n";
+        set<string, ci_less> names;
+        auto it = get_libmap().find(cls);
+        if (it != get_libmap().end()) {
+                for (auto && item : it->second) {
+                        if (item.second.abi_version == abi_version && (full || !item.second.hidden)) {
+                                names.insert(item.first);
+                        }
+                }
+        }
+        // listing is served from the index without opening the modules
+        auto it_idx = module_index.modules.find(cls);
+        if (it_idx != module_index.modules.end()) {
+                for (auto && item : it_idx->second) {
+                        if (full || !item.second.hidden) {
+                                names.insert(item.first);
+                        }
+                }
+        }
+        for (auto && name : names) {
+                col() << "\t" << SBOLD(name.c_str()) << "\n";
         }
 }
 
@@ -306,6 +496,8 @@ void list_modules(enum library_class cls, int abi_version, bool full) {
 bool list_all_modules() {
         bool ret = true;
 
+        load_all_modules(); // to report the errors of all modules
+
         auto& libraries = get_libmap();
         for (auto cls_it = library_class_info.begin(); cls_it != library_class_info.end();
                         ++cls_it) {
@@ -334,6 +526,7 @@ bool list_all_modules() {
 map<string, const void *> get_libraries_for_class(enum library_class cls, int abi_version, bool include_hidden)
 {
         map<string, const void *> ret;
+        load_indexed_modules(cls);
         auto& libraries = get_libmap();
         auto it = libraries.find(cls);
         if (it != libraries.end()) {
@@ -353,3 +546,44 @@ map<string, const void *> get_libraries_for_class(enum library_class cls, int ab
         return ret;
 }
 
+
+/**
+ * Opens all modules and writes the index mapping the modules and their
+ * params to the library files.
+ */
+bool write_module_index(const char *filename)
+{
+        load_all_modules();
+
+        map<string, int> files; // file -> registered modules
+        for (auto const &file : module_index.opened) {
+                files[file] = 0;
+        }
+        ostringstream oss;
+        oss << "# UltraGrid module index generated by \"uv --module-index\"\n";
+        for (auto const &cls : get_libmap()) {
+                for (auto const &mod : cls.second) {
+                        if (mod.second.file.empty()) {
+                                continue;
+                        }
+                        files[mod.second.file] += 1;
+                        oss << "module " << cls.first << " " << mod.second.hidden << " "
+                                << mod.first << " " << mod.second.file << "\n";
+                }
+        }
+        for (auto const &param : get_param_origins()) {
+                oss << "param " << param.first << " " << param.second << "\n";
+        }
+        for (auto const &file : files) {
+                oss << "file " << file.first << " " << file.second << "\n";
+        }
+
+        ofstream out(filename);
+        out << oss.str();
+        if (!out) {
+                log_msg(LOG_LEVEL_ERROR, "Unable to write module index %s\n", filename);
+                return false;
+        }
+        log_msg(LOG_LEVEL_INFO, "Module index with %zu libraries written to %s\n", files.size(), filename);
+        return true;
+}
@@ -88,6 +88,13 @@ const void *load_library(const char *name, enum library_class, int abi_version);
 void register_library(const char *name, const void *info, enum library_class, int abi_version, int hidden);
 void list_modules(enum library_class, int abi_version, bool full);
 bool list_all_modules();
+void load_all_modules(void);
+/// opens the module registering param (according to module index)
+/// @retval true  module was opened
+bool load_module_for_param(const char *param);
+/// records that param is registered by the module being opened (for module index)
+void register_library_param(const char *param);
+bool write_module_index(const char *filename);
 #ifdef __cplusplus
 }
 #endif
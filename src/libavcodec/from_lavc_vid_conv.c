@@ -58,11 +58,13 @@
 
 #include "color.h"
 #include "host.h"
+#include "hwaccel_libav_common.h"
 #include "hwaccel_vdpau.h"
 #include "hwaccel_rpi4.h"
 #include "libavcodec/from_lavc_vid_conv.h"
 #include "libavcodec/lavc_common.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
+#include "utils/simd_lanes.h"
 #include "video.h"
 
 #ifdef __SSE3__
@@ -2030,6 +2032,25 @@ static void av_vdpau_to_ug_vdpau(char * __restrict dst_buffer, AVFrame * __restr
 }
 #endif
 
+#ifdef HWACC_VAAPI
+static void av_vaapi_to_ug_vaapi(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        UNUSED(width);
+        UNUSED(height);
+        UNUSED(pitch);
+        UNUSED(rgb_shift);
+
+        struct video_frame_callbacks *callbacks = in_frame->opaque;
+
+        av_frame_wrapper *out = (av_frame_wrapper *)(void *) dst_buffer;
+        out->av_frame = av_frame_clone(in_frame);
+
+        callbacks->recycle = av_frame_wrapper_recycle_callback;
+        callbacks->copy = av_frame_wrapper_copy_callback;
+}
+#endif
+
 #ifdef HWACC_RPI4
 static void av_rpi4_8_to_ug(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
                 int width, int height, int pitch, const int * __restrict rgb_shift)
@@ -2183,6 +2204,23 @@ static void vuyx_to_y416(char * __restrict dst_buffer, AVFrame * __restrict in_f
         vuyax_to_y416(dst_buffer, in_frame, width, height, pitch, false);
 }
 
+#ifdef PIXFMT_SIMD_X86
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_SSE4
+#include "libavcodec/from_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_AVX2
+#include "libavcodec/from_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_AVX512
+#include "libavcodec/from_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#endif // defined PIXFMT_SIMD_X86
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_NEON
+#include "libavcodec/from_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#endif // defined PIXFMT_SIMD_NEON_ENABLED
+
 typedef void av_to_uv_convert_f(char * __restrict dst_buffer, AVFrame * __restrict in_frame, int width, int height, int pitch, const int * __restrict rgb_shift);
 typedef av_to_uv_convert_f *av_to_uv_convert_fp;
 
@@ -2323,6 +2361,9 @@ static const struct av_to_uv_conversion av_to_uv_conversions[] = {
         // HW acceleration
         {AV_PIX_FMT_VDPAU, HW_VDPAU, av_vdpau_to_ug_vdpau},
 #endif
+#ifdef HWACC_VAAPI
+        {AV_PIX_FMT_VAAPI, HW_VAAPI, av_vaapi_to_ug_vaapi},
+#endif
 #ifdef HWACC_RPI4
         {AV_PIX_FMT_RPI4_8, RPI4_8, av_rpi4_8_to_ug},
 #endif
@@ -2330,6 +2371,64 @@ static const struct av_to_uv_conversion av_to_uv_conversions[] = {
 #define AV_TO_UV_CONVERSION_COUNT (sizeof av_to_uv_conversions / sizeof av_to_uv_conversions[0])
 static const struct av_to_uv_conversion *av_to_uv_conversions_end = av_to_uv_conversions + AV_TO_UV_CONVERSION_COUNT;
 
+struct av_to_uv_simd_conversion {
+        av_to_uv_convert_fp scalar;
+        av_to_uv_convert_fp convert;
+        const char *impl;
+        bool (*available)(void);
+};
+
+#if P210_PRESENT
+#define SIMD_CONVERSION_P210(isa) { p210le_to_v210, p210le_to_v210_ ## isa, #isa, isa ## _available },
+#else
+#define SIMD_CONVERSION_P210(isa)
+#endif
+#define SIMD_CONVERSIONS(isa) \
+        { yuv420p10le_to_v210, yuv420p10le_to_v210_ ## isa, #isa, isa ## _available }, \
+        { yuv422p10le_to_v210, yuv422p10le_to_v210_ ## isa, #isa, isa ## _available }, \
+        { p010le_to_v210, p010le_to_v210_ ## isa, #isa, isa ## _available }, \
+        SIMD_CONVERSION_P210(isa) \
+        { yuv444p10le_to_y416, yuv444p10le_to_y416_ ## isa, #isa, isa ## _available }, \
+        { yuv444p12le_to_y416, yuv444p12le_to_y416_ ## isa, #isa, isa ## _available }, \
+        { yuv444p16le_to_y416, yuv444p16le_to_y416_ ## isa, #isa, isa ## _available }, \
+        { gbrp10le_to_r10k, gbrp10le_to_r10k_ ## isa, #isa, isa ## _available }, \
+        { gbrp12le_to_r10k, gbrp12le_to_r10k_ ## isa, #isa, isa ## _available }, \
+        { gbrp16le_to_r10k, gbrp16le_to_r10k_ ## isa, #isa, isa ## _available }
+
+/// SIMD variants of the above conversions, ordered by preference
+static const struct av_to_uv_simd_conversion av_to_uv_simd_conversions[] = {
+#ifdef PIXFMT_SIMD_X86
+        SIMD_CONVERSIONS(avx512),
+        SIMD_CONVERSIONS(avx2),
+        SIMD_CONVERSIONS(sse4),
+#endif
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+        SIMD_CONVERSIONS(neon),
+#endif
+        { NULL, NULL, NULL, NULL },
+};
+#undef SIMD_CONVERSIONS
+#undef SIMD_CONVERSION_P210
+
+/**
+ * @returns SIMD variant of the scalar conversion in given implementation
+ * (see get_decoder_from_to_impl()) or the scalar conversion itself if there
+ * is none usable
+ */
+static av_to_uv_convert_fp get_simd_conversion(av_to_uv_convert_fp scalar, const char *impl)
+{
+        if (impl != NULL && strcmp(impl, "scalar") == 0) {
+                return scalar;
+        }
+        const bool any = impl == NULL || strcmp(impl, "auto") == 0;
+        for (const struct av_to_uv_simd_conversion *it = av_to_uv_simd_conversions; it->convert != NULL; ++it) {
+                if (it->scalar == scalar && (any || strcmp(it->impl, impl) == 0) && it->available()) {
+                        return it->convert;
+                }
+        }
+        return scalar;
+}
+
 static void set_decoder_mapped_to_uv(av_to_uv_convert_t *ret, decoder_t dec,
                 codec_t dst_pixfmt) {
         struct av_to_uv_convert_state_priv *priv = (void *) ret->priv_data;
@@ -2382,6 +2481,10 @@ static decoder_t get_av_and_uv_conversion(enum AVPixelFormat av_codec, codec_t u
 }
 
 av_to_uv_convert_t get_av_to_uv_conversion(int av_codec, codec_t uv_codec) {
+        return get_av_to_uv_conversion_impl(av_codec, uv_codec, get_commandline_param("pixfmt-conv-impl"));
+}
+
+av_to_uv_convert_t get_av_to_uv_conversion_impl(int av_codec, codec_t uv_codec, const char *impl) {
         av_to_uv_convert_t ret = { .valid = false };
         struct av_to_uv_convert_state_priv *priv = (void *) ret.priv_data;
 
@@ -2405,7 +2508,7 @@ av_to_uv_convert_t get_av_to_uv_conversion(int av_codec, codec_t uv_codec) {
                         conversions < av_to_uv_conversions_end; conversions++) {
                 if (conversions->av_codec == av_codec &&
                                 conversions->uv_codec == uv_codec) {
-                        priv->convert = conversions->convert;
+                        priv->convert = get_simd_conversion(conversions->convert, impl);
                         ret.valid = true;
                         watch_pixfmt_degrade(MOD_NAME, av_pixfmt_get_desc(av_codec), get_pixfmt_desc(uv_codec));
                         return ret;
@@ -2420,7 +2523,7 @@ av_to_uv_convert_t get_av_to_uv_conversion(int av_codec, codec_t uv_codec) {
                 return ret;
         }
         priv->dec = dec;
-        priv->convert = av_convert;
+        priv->convert = get_simd_conversion(av_convert, impl);
         priv->src_pixfmt = intermediate;
         priv->dst_pixfmt = uv_codec;
         ret.valid = true;
@@ -2536,7 +2639,7 @@ enum AVPixelFormat pick_av_convertible_to_ug(codec_t color_spec, av_to_uv_conver
                         av_conv->valid = true;
                         struct av_to_uv_convert_state_priv *priv = (void *) av_conv->priv_data;
                         memset(priv, 0, sizeof *priv);
-                        priv->convert = c->convert;
+                        priv->convert = get_simd_conversion(c->convert, get_commandline_param("pixfmt-conv-impl"));
                         return c->av_codec;
                 }
         }
@@ -59,6 +59,12 @@ typedef struct av_to_uv_convert_state {
 void av_to_uv_convert(const av_to_uv_convert_t *state, char * __restrict dst_buffer, AVFrame * __restrict in_frame, int width, int height, int pitch, const int * __restrict rgb_shift);
 
 av_to_uv_convert_t get_av_to_uv_conversion(int av_codec, codec_t uv_codec);
+/**
+ * Same as get_av_to_uv_conversion() but uses SIMD implementation impl of the
+ * conversion ("scalar", "sse4", "avx2", "avx512", "neon"; NULL or "auto" for
+ * the best supported), scalar conversion is used if impl is not available.
+ */
+av_to_uv_convert_t get_av_to_uv_conversion_impl(int av_codec, codec_t uv_codec, const char *impl);
 codec_t get_best_ug_codec_to_av(const enum AVPixelFormat *fmt, bool use_hwaccel);
 enum AVPixelFormat lavd_get_av_to_ug_codec(const enum AVPixelFormat *fmt, codec_t c, bool use_hwaccel);
 enum AVPixelFormat pick_av_convertible_to_ug(codec_t color_spec, av_to_uv_convert_t *av_conv);
@@ -0,0 +1,325 @@
+/**
+ * @file   libavcodec/from_lavc_vid_conv_simd.h
+ * @brief  SIMD implementations of selected AVFrame to UltraGrid conversions
+ *
+ * Included by from_lavc_vid_conv.c once for every instruction set with
+ * PIXFMT_SIMD_ISA set (see utils/simd_lanes.h). Each lane converts a block
+ * of pixels of a row; input planes are loaded with per-lane strides, so that
+ * the same code serves 1, 2 or 4 lanes.
+ *
+ * The number of lanes is chosen so that no load exceeds the row of the
+ * respective plane, the rest of the row is converted by a scalar loop with
+ * the same arithmetic as the original (scalar) conversion, so the output is
+ * identical for samples in the valid range of the pixel format.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FROM_LAVC_VID_CONV_SIMD_COMMON
+#define FROM_LAVC_VID_CONV_SIMD_COMMON
+#define Z 0x80 // shuffle index producing zero byte (both PSHUFB and TBL)
+
+/**
+ * v210 words carry 10-bit fields at bits 0, 10 and 20 - tables below pick
+ * zero-extended 16-bit samples for the field at bit 0/10/20 of 4 words
+ * (6 pixels) from planar Y, Cb and Cr:
+ * w0 = Cb0 Y0 Cr0, w1 = Y1 Cb1 Y2, w2 = Cr1 Y3 Cb2, w3 = Y4 Cr2 Y5
+ */
+static const uint8_t v210_pack_y[3][16] = {
+        { Z, Z, Z, Z, 2, 3, Z, Z, Z, Z, Z, Z, 8, 9, Z, Z },
+        { 0, 1, Z, Z, Z, Z, Z, Z, 6, 7, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, 4, 5, Z, Z, Z, Z, Z, Z, 10, 11, Z, Z },
+};
+static const uint8_t v210_pack_cb[3][16] = {
+        { 0, 1, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, 2, 3, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 4, 5, Z, Z, Z, Z, Z, Z },
+};
+static const uint8_t v210_pack_cr[3][16] = {
+        { Z, Z, Z, Z, Z, Z, Z, Z, 2, 3, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 4, 5, Z, Z },
+        { 0, 1, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z },
+};
+/// the same for interleaved CbCr (P010, P210) - Cb0 Cr0 Cb1 Cr1 Cb2 Cr2
+static const uint8_t v210_pack_cbcr[3][16] = {
+        { 0, 1, Z, Z, Z, Z, Z, Z, 6, 7, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, 4, 5, Z, Z, Z, Z, Z, Z, 10, 11, Z, Z },
+        { 2, 3, Z, Z, Z, Z, Z, Z, 8, 9, Z, Z, Z, Z, Z, Z },
+};
+
+/// planar samples of 2 pixels (0-1 or 2-3 of the lane) to Y416 (U Y V A)
+static const uint8_t y416_pack_u[2][16] = {
+        { 0, 1, Z, Z, Z, Z, Z, Z, 2, 3, Z, Z, Z, Z, Z, Z },
+        { 4, 5, Z, Z, Z, Z, Z, Z, 6, 7, Z, Z, Z, Z, Z, Z },
+};
+static const uint8_t y416_pack_y[2][16] = {
+        { Z, Z, 0, 1, Z, Z, Z, Z, Z, Z, 2, 3, Z, Z, Z, Z },
+        { Z, Z, 4, 5, Z, Z, Z, Z, Z, Z, 6, 7, Z, Z, Z, Z },
+};
+static const uint8_t y416_pack_v[2][16] = {
+        { Z, Z, Z, Z, 0, 1, Z, Z, Z, Z, Z, Z, 2, 3, Z, Z },
+        { Z, Z, Z, Z, 4, 5, Z, Z, Z, Z, Z, Z, 6, 7, Z, Z },
+};
+static const uint16_t y416_pack_alpha[8] = { 0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF };
+
+/// zero-extends 4 16-bit samples to 32 bits
+static const uint8_t zext_16_32[16] = { 0, 1, Z, Z, 2, 3, Z, Z, 4, 5, Z, Z, 6, 7, Z, Z };
+static const uint8_t bswap_32[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+#undef Z
+
+/**
+ * @returns number of lanes (multiple of vec_lanes) so that the last lane
+ *          reading load_bytes from (lane * lane_bytes) stays within row_bytes
+ */
+static inline int from_lavc_simd_lanes(int row_bytes, int lane_bytes, int load_bytes, int vec_lanes)
+{
+        if (row_bytes < load_bytes) {
+                return 0;
+        }
+        int lanes = (row_bytes - load_bytes) / lane_bytes + 1;
+        return lanes - lanes % vec_lanes;
+}
+
+/// scalar v210 packing of pixel groups [first, last) (shift 0 - planar 10-bit, 6 - P010)
+static inline void v210_pack_groups(uint32_t * __restrict dst, const uint16_t * __restrict y, const uint16_t * __restrict cb,
+                const uint16_t * __restrict cr, int chroma_step, unsigned shift, int first, int last)
+{
+        for (int x = first; x < last; ++x) {
+                const uint16_t *py = y + 6 * x;
+                const uint16_t *pcb = cb + 3 * chroma_step * x;
+                const uint16_t *pcr = cr + 3 * chroma_step * x;
+                uint32_t *d = dst + 4 * x;
+                d[0] = (uint32_t) (pcb[0] >> shift) | (uint32_t) (py[0] >> shift) << 10 | (uint32_t) (pcr[0] >> shift) << 20;
+                d[1] = (uint32_t) (py[1] >> shift) | (uint32_t) (pcb[chroma_step] >> shift) << 10 | (uint32_t) (py[2] >> shift) << 20;
+                d[2] = (uint32_t) (pcr[chroma_step] >> shift) | (uint32_t) (py[3] >> shift) << 10 | (uint32_t) (pcb[2 * chroma_step] >> shift) << 20;
+                d[3] = (uint32_t) (py[4] >> shift) | (uint32_t) (pcr[2 * chroma_step] >> shift) << 10 | (uint32_t) (py[5] >> shift) << 20;
+        }
+}
+#endif // !defined FROM_LAVC_VID_CONV_SIMD_COMMON
+
+#include "utils/simd_lanes.h"
+
+/// 16-bit shifts by a constant that may be 0 (not allowed by NEON immediate shifts)
+#define V_SRLI16_0(a, n) ((n) == 0 ? (a) : V_SRLI16(a, (n) == 0 ? 1 : (n)))
+#define V_SLLI16_0(a, n) ((n) == 0 ? (a) : V_SLLI16(a, (n) == 0 ? 1 : (n)))
+
+/**
+ * Packs one row to v210. Lane converts 6 pixels to 4 words.
+ *
+ * @param chroma_step 1 for planar chroma, 2 for interleaved CbCr (cr = cb + 1)
+ * @param shift       right shift of the samples (6 for MSB-aligned P010)
+ */
+SIMD_FUNC __attribute__((always_inline)) inline void SIMD_FN(v210_pack_row)(uint32_t * __restrict dst, const uint16_t * __restrict y, const uint16_t * __restrict cb,
+                const uint16_t * __restrict cr, int width, int chroma_step, int shift)
+{
+        const int groups = width / 6;
+        const int chroma_bytes = chroma_step == 1 ? (width + 1) / 2 * 2 : (width + 1) / 2 * 4;
+        int lanes = MIN(from_lavc_simd_lanes(width * 2, 12, 16, V_LANES),
+                        from_lavc_simd_lanes(chroma_bytes, 6 * chroma_step, 16, V_LANES));
+        lanes = MIN(lanes, groups - groups % V_LANES);
+        VEC sy[3], sc[3], scr[3];
+        for (int i = 0; i < 3; ++i) {
+                sy[i] = V_CONST(v210_pack_y[i]);
+                sc[i] = V_CONST(chroma_step == 1 ? v210_pack_cb[i] : v210_pack_cbcr[i]);
+                scr[i] = V_CONST(v210_pack_cr[i]);
+        }
+        const unsigned char *s_y = (const unsigned char *) y;
+        const unsigned char *s_cb = (const unsigned char *) cb;
+        const unsigned char *s_cr = (const unsigned char *) cr;
+        unsigned char *d = (unsigned char *) dst;
+        for (int l = 0; l < lanes; l += V_LANES) {
+                VEC vy = V_LOAD(s_y, 12);
+                VEC vc = V_LOAD(s_cb, 6 * chroma_step);
+                VEC f[3];
+                if (shift == 6) {
+                        vy = V_SRLI16(vy, 6);
+                        vc = V_SRLI16(vc, 6);
+                }
+                if (chroma_step == 1) {
+                        VEC vcr = V_LOAD(s_cr, 6);
+                        for (int i = 0; i < 3; ++i) {
+                                f[i] = V_OR(V_OR(V_SHUF(vy, sy[i]), V_SHUF(vc, sc[i])), V_SHUF(vcr, scr[i]));
+                        }
+                } else {
+                        for (int i = 0; i < 3; ++i) {
+                                f[i] = V_OR(V_SHUF(vy, sy[i]), V_SHUF(vc, sc[i]));
+                        }
+                }
+                V_STORE_LANES(d, 16, V_OR(V_OR(f[0], V_SLLI32(f[1], 10)), V_SLLI32(f[2], 20)));
+                s_y += V_LANES * 12;
+                s_cb += V_LANES * 6 * chroma_step;
+                s_cr += V_LANES * 6 * chroma_step;
+                d += V_LANES * 16;
+        }
+        v210_pack_groups(dst, y, cb, cr, chroma_step, shift, lanes, groups);
+}
+
+/**
+ * Converts one row of planar 4:4:4 to Y416. Lane converts 4 pixels.
+ */
+SIMD_FUNC __attribute__((always_inline)) inline void SIMD_FN(yuv444p_y416_row)(uint16_t * __restrict dst, const uint16_t * __restrict y, const uint16_t * __restrict cb,
+                const uint16_t * __restrict cr, int width, int depth)
+{
+        const int lanes = from_lavc_simd_lanes(width * 2, 8, 16, V_LANES);
+        VEC su[2], sy[2], sv[2];
+        for (int i = 0; i < 2; ++i) {
+                su[i] = V_CONST(y416_pack_u[i]);
+                sy[i] = V_CONST(y416_pack_y[i]);
+                sv[i] = V_CONST(y416_pack_v[i]);
+        }
+        const VEC alpha = V_CONST(y416_pack_alpha);
+        for (int l = 0; l < lanes; l += V_LANES) {
+                VEC vu = V_SLLI16_0(V_LOAD((const unsigned char *) (cb + 4 * l), 8), 16 - depth);
+                VEC vy = V_SLLI16_0(V_LOAD((const unsigned char *) (y + 4 * l), 8), 16 - depth);
+                VEC vv = V_SLLI16_0(V_LOAD((const unsigned char *) (cr + 4 * l), 8), 16 - depth);
+                for (int i = 0; i < 2; ++i) {
+                        VEC out = V_OR(V_OR(V_SHUF(vu, su[i]), V_SHUF(vy, sy[i])), V_OR(V_SHUF(vv, sv[i]), alpha));
+                        V_STORE_LANES((unsigned char *) (dst + 16 * l) + 16 * i, 32, out);
+                }
+        }
+        for (int x = 4 * lanes; x < width; ++x) {
+                dst[4 * x] = cb[x] << (16U - depth);
+                dst[4 * x + 1] = y[x] << (16U - depth);
+                dst[4 * x + 2] = cr[x] << (16U - depth);
+                dst[4 * x + 3] = 0xFFFFU;
+        }
+}
+
+/**
+ * Converts one row of planar GBR to R10k. Lane converts 4 pixels.
+ */
+SIMD_FUNC __attribute__((always_inline)) inline void SIMD_FN(gbrp_r10k_row)(unsigned char * __restrict dst, const uint16_t * __restrict g, const uint16_t * __restrict b,
+                const uint16_t * __restrict r, int width, int depth)
+{
+        const int lanes = from_lavc_simd_lanes(width * 2, 8, 16, V_LANES);
+        const VEC zext = V_CONST(zext_16_32);
+        const VEC bswap = V_CONST(bswap_32);
+        const VEC pad = V_SET1_32(0x3);
+        for (int l = 0; l < lanes; l += V_LANES) {
+                VEC vg = V_SHUF(V_SRLI16_0(V_LOAD((const unsigned char *) (g + 4 * l), 8), depth - 10), zext);
+                VEC vb = V_SHUF(V_SRLI16_0(V_LOAD((const unsigned char *) (b + 4 * l), 8), depth - 10), zext);
+                VEC vr = V_SHUF(V_SRLI16_0(V_LOAD((const unsigned char *) (r + 4 * l), 8), depth - 10), zext);
+                VEC w = V_OR(V_OR(V_SLLI32(vr, 22), V_SLLI32(vg, 12)), V_OR(V_SLLI32(vb, 2), pad));
+                V_STORE_LANES(dst + 16 * l, 16, V_SHUF(w, bswap));
+        }
+        for (int x = 4 * lanes; x < width; ++x) {
+                unsigned char *d = dst + 4 * x;
+                d[0] = r[x] >> (depth - 8U);
+                d[1] = ((r[x] >> (depth - 10U)) & 0x3U) << 6U | g[x] >> (depth - 6U);
+                d[2] = ((g[x] >> (depth - 10U)) & 0xFU) << 4U | b[x] >> (depth - 4U);
+                d[3] = ((b[x] >> (depth - 10U)) & 0x3FU) << 2U | 0x3U;
+        }
+}
+
+#define ROW16(frame, plane, y) ((const uint16_t *)(const void *) ((frame)->data[plane] + (ptrdiff_t) (frame)->linesize[plane] * (y)))
+
+SIMD_FUNC void SIMD_FN(yuv420p10le_to_v210)(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        (void) rgb_shift;
+        for (int y = 0; y < height / 2 * 2; ++y) {
+                SIMD_FN(v210_pack_row)((uint32_t *)(void *) (dst_buffer + (ptrdiff_t) y * pitch), ROW16(in_frame, 0, y),
+                                ROW16(in_frame, 1, y / 2), ROW16(in_frame, 2, y / 2), width, 1, 0);
+        }
+}
+
+SIMD_FUNC void SIMD_FN(yuv422p10le_to_v210)(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        (void) rgb_shift;
+        for (int y = 0; y < height; ++y) {
+                SIMD_FN(v210_pack_row)((uint32_t *)(void *) (dst_buffer + (ptrdiff_t) y * pitch), ROW16(in_frame, 0, y),
+                                ROW16(in_frame, 1, y), ROW16(in_frame, 2, y), width, 1, 0);
+        }
+}
+
+SIMD_FUNC void SIMD_FN(p010le_to_v210)(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        (void) rgb_shift;
+        for (int y = 0; y < height / 2 * 2; ++y) {
+                const uint16_t *cbcr = ROW16(in_frame, 1, y / 2);
+                SIMD_FN(v210_pack_row)((uint32_t *)(void *) (dst_buffer + (ptrdiff_t) y * pitch), ROW16(in_frame, 0, y),
+                                cbcr, cbcr + 1, width, 2, 6);
+        }
+}
+
+#if P210_PRESENT
+SIMD_FUNC void SIMD_FN(p210le_to_v210)(char * __restrict dst_buffer, AVFrame * __restrict in_frame,
+                int width, int height, int pitch, const int * __restrict rgb_shift)
+{
+        (void) rgb_shift;
+        for (int y = 0; y < height; ++y) {
+                const uint16_t *cbcr = ROW16(in_frame, 1, y);
+                SIMD_FN(v210_pack_row)((uint32_t *)(void *) (dst_buffer + (ptrdiff_t) y * pitch), ROW16(in_frame, 0, y),
+                                cbcr, cbcr + 1, width, 2, 6);
+        }
+}
+#endif
+
+#define SIMD_YUV444P_TO_Y416(depth) \
+SIMD_FUNC void SIMD_FN(yuv444p ## depth ## le_to_y416)(char * __restrict dst_buffer, AVFrame * __restrict in_frame, \
+                int width, int height, int pitch, const int * __restrict rgb_shift) \
+{ \
+        (void) rgb_shift; \
+        for (int y = 0; y < height; ++y) { \
+                SIMD_FN(yuv444p_y416_row)((uint16_t *)(void *) (dst_buffer + (ptrdiff_t) y * pitch), ROW16(in_frame, 0, y), \
+                                ROW16(in_frame, 1, y), ROW16(in_frame, 2, y), width, depth); \
+        } \
+}
+SIMD_YUV444P_TO_Y416(10)
+SIMD_YUV444P_TO_Y416(12)
+SIMD_YUV444P_TO_Y416(16)
+#undef SIMD_YUV444P_TO_Y416
+
+#define SIMD_GBRP_TO_R10K(depth) \
+SIMD_FUNC void SIMD_FN(gbrp ## depth ## le_to_r10k)(char * __restrict dst_buffer, AVFrame * __restrict in_frame, \
+                int width, int height, int pitch, const int * __restrict rgb_shift) \
+{ \
+        (void) rgb_shift; \
+        for (int y = 0; y < height; ++y) { \
+                SIMD_FN(gbrp_r10k_row)((unsigned char *) dst_buffer + (ptrdiff_t) y * pitch, ROW16(in_frame, 0, y), \
+                                ROW16(in_frame, 1, y), ROW16(in_frame, 2, y), width, depth); \
+        } \
+}
+SIMD_GBRP_TO_R10K(10)
+SIMD_GBRP_TO_R10K(12)
+SIMD_GBRP_TO_R10K(16)
+#undef SIMD_GBRP_TO_R10K
+
+#undef ROW16
+#undef V_SRLI16_0
+#undef V_SLLI16_0
+#define SIMD_LANES_UNDEF
+#include "utils/simd_lanes.h"
+#undef SIMD_LANES_UNDEF
@@ -59,12 +59,10 @@
 #include "libavcodec/to_lavc_vid_conv.h"
 #include "utils/macros.h" // OPTIMIZED_FOR
 #include "utils/parallel_conv.h"
+#include "utils/simd_lanes.h"
 #include "utils/worker.h"
 #include "video.h"
 
-#ifdef __SSE3__
-#include "pmmintrin.h"
-#endif
 
 #define MOD_NAME "[to_lavc_vid_conv] "
 
@@ -193,67 +191,7 @@ static void uyvy_to_nv12(AVFrame * __restrict out_frame, const unsigned char * _
                 unsigned char *dst_y2 = out_frame->data[0] + out_frame->linesize[0] * (y + 1);
                 unsigned char *dst_cbcr = out_frame->data[1] + out_frame->linesize[1] * y / 2;
 
-                int x = 0;
-#ifdef __SSE3__
-                __m128i yuv;
-                __m128i yuv2;
-                __m128i y1;
-                __m128i y2;
-                __m128i y3;
-                __m128i y4;
-                __m128i uv;
-                __m128i uv2;
-                __m128i uv3;
-                __m128i uv4;
-                __m128i ymask = _mm_set1_epi32(0xFF00FF00);
-                __m128i dsty;
-                __m128i dsty2;
-                __m128i dstuv;
-
-                for (; x < (width - 15); x += 16){
-                        yuv = _mm_lddqu_si128((__m128i const*)(const void *) src);
-                        yuv2 = _mm_lddqu_si128((__m128i const*)(const void *) src2);
-                        src += 16;
-                        src2 += 16;
-
-                        y1 = _mm_and_si128(ymask, yuv);
-                        y1 = _mm_bsrli_si128(y1, 1);
-                        y2 = _mm_and_si128(ymask, yuv2);
-                        y2 = _mm_bsrli_si128(y2, 1);
-
-                        uv = _mm_andnot_si128(ymask, yuv);
-                        uv2 = _mm_andnot_si128(ymask, yuv2);
-
-                        uv = _mm_avg_epu8(uv, uv2);
-
-                        yuv = _mm_lddqu_si128((__m128i const*)(const void *) src);
-                        yuv2 = _mm_lddqu_si128((__m128i const*)(const void *) src2);
-                        src += 16;
-                        src2 += 16;
-
-                        y3 = _mm_and_si128(ymask, yuv);
-                        y3 = _mm_bsrli_si128(y3, 1);
-                        y4 = _mm_and_si128(ymask, yuv2);
-                        y4 = _mm_bsrli_si128(y4, 1);
-
-                        uv3 = _mm_andnot_si128(ymask, yuv);
-                        uv4 = _mm_andnot_si128(ymask, yuv2);
-
-                        uv3 = _mm_avg_epu8(uv3, uv4);
-
-                        dsty = _mm_packus_epi16(y1, y3);
-                        dsty2 = _mm_packus_epi16(y2, y4);
-                        dstuv = _mm_packus_epi16(uv, uv3);
-                        _mm_storeu_si128((__m128i *)(void *) dst_y, dsty);
-                        _mm_storeu_si128((__m128i *)(void *) dst_y2, dsty2);
-                        _mm_storeu_si128((__m128i *)(void *) dst_cbcr, dstuv);
-                        dst_y += 16;
-                        dst_y2 += 16;
-                        dst_cbcr += 16;
-                }
-#endif
-
-                OPTIMIZED_FOR (; x < width - 1; x += 2) {
+                OPTIMIZED_FOR (int x = 0; x < width - 1; x += 2) {
                         *dst_cbcr++ = (*src++ + *src2++) / 2;
                         *dst_y++ = *src++;
                         *dst_y2++ = *src2++;
@@ -1238,6 +1176,23 @@ static void rg48_to_gbrp12le(AVFrame * __restrict out_frame, const unsigned char
         }
 }
 
+#ifdef PIXFMT_SIMD_X86
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_SSE4
+#include "libavcodec/to_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_AVX2
+#include "libavcodec/to_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_AVX512
+#include "libavcodec/to_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#endif // defined PIXFMT_SIMD_X86
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_NEON
+#include "libavcodec/to_lavc_vid_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#endif // defined PIXFMT_SIMD_NEON_ENABLED
+
 static void to_lavc_memcpy_data(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height) __attribute__((unused)); // defined below
 
 //
@@ -1314,6 +1269,49 @@ static const struct uv_to_av_conversion *get_uv_to_av_conversions() {
         return uv_to_av_conversions;
 }
 
+struct uv_to_av_simd_conversion {
+        pixfmt_callback_t scalar;
+        pixfmt_callback_t func;
+        const char *impl;
+        bool (*available)(void);
+};
+
+#define SIMD_CONVERSIONS(isa) \
+        { v210_to_yuv422p10le, v210_to_yuv422p10le_ ## isa, #isa, isa ## _available }, \
+        { uyvy_to_nv12, uyvy_to_nv12_ ## isa, #isa, isa ## _available }, \
+        { uyvy_to_yuv420p, uyvy_to_yuv420p_ ## isa, #isa, isa ## _available }, \
+        { r10k_to_gbrp10le, r10k_to_gbrp10le_ ## isa, #isa, isa ## _available }, \
+        { r10k_to_gbrp16le, r10k_to_gbrp16le_ ## isa, #isa, isa ## _available }
+
+/// SIMD variants of the conversions, ordered by preference
+static const struct uv_to_av_simd_conversion uv_to_av_simd_conversions[] = {
+#ifdef PIXFMT_SIMD_X86
+        SIMD_CONVERSIONS(avx512),
+        SIMD_CONVERSIONS(avx2),
+        SIMD_CONVERSIONS(sse4),
+#endif
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+        SIMD_CONVERSIONS(neon),
+#endif
+        { NULL, NULL, NULL, NULL },
+};
+#undef SIMD_CONVERSIONS
+
+/// @returns SIMD variant of the conversion as selected by --param pixfmt-conv-impl (or the scalar one)
+static pixfmt_callback_t get_simd_callback(pixfmt_callback_t scalar) {
+        const char *impl = get_commandline_param("pixfmt-conv-impl");
+        if (impl != NULL && strcmp(impl, "scalar") == 0) {
+                return scalar;
+        }
+        const bool any = impl == NULL || strcmp(impl, "auto") == 0;
+        for (const struct uv_to_av_simd_conversion *it = uv_to_av_simd_conversions; it->func != NULL; ++it) {
+                if (it->scalar == scalar && (any || strcmp(it->impl, impl) == 0) && it->available()) {
+                        return it->func;
+                }
+        }
+        return scalar;
+}
+
 void get_av_pixfmt_details(enum AVPixelFormat av_codec, enum AVColorSpace *colorspace, enum AVColorRange *color_range)
 {
         const struct AVPixFmtDescriptor *avd = av_pix_fmt_desc_get(av_codec);
@@ -1395,7 +1393,7 @@ static pixfmt_callback_t select_pixfmt_callback(enum AVPixelFormat fmt, codec_t
 
         for (const struct uv_to_av_conversion *c = get_uv_to_av_conversions(); c->src != VIDEO_CODEC_NONE; c++) { // FFMPEG conversion needed
                 if (c->src == src && c->dst == fmt) {
-                        return c->func;
+                        return get_simd_callback(c->func);
                 }
         }
 
@@ -1526,7 +1524,6 @@ int get_available_pix_fmts(codec_t in_codec, struct to_lavc_req_prop req_prop,
 
 struct to_lavc_vid_conv {
         struct AVFrame     *out_frame;
-        struct AVFrame    **out_frame_parts; ///< out_frame slices for parallel conversion
         int                 thread_count;
         struct AVFrame     *tmp_frame; ///< dummy input buffer pointers' wrapper
         codec_t             in_pixfmt;
@@ -1534,6 +1531,13 @@ struct to_lavc_vid_conv {
         codec_t             decoded_codec;
         decoder_t           decoder;
         pixfmt_callback_t   pixfmt_conv_callback;
+        bool                zero_copy; ///< input may be referenced by the returned frame
+};
+
+/// input buffer wrapped by tmp_frame
+struct input_ref {
+        void (*release)(void *udata);
+        void *udata;
 };
 
 static void to_lavc_memcpy_data(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
@@ -1557,10 +1561,6 @@ struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int
         struct to_lavc_vid_conv *s = (struct to_lavc_vid_conv *) calloc(1, sizeof *s);
         s->in_pixfmt = in_pixfmt;
         s->thread_count = thread_count;
-        s->out_frame_parts = (struct AVFrame **) calloc(thread_count, sizeof *s->out_frame_parts);
-        for (int i = 0; i < thread_count; i++) {
-                s->out_frame_parts[i] = av_frame_alloc();
-        }
         s->out_frame = av_frame_alloc();
         if (!s->out_frame) {
                 log_msg(LOG_LEVEL_ERROR, "Could not allocate video frame\n");
@@ -1583,27 +1583,6 @@ struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int
                 return NULL;
         }
 
-        // conversion needed
-        if (get_ug_to_av_pixfmt(in_pixfmt) == AV_PIX_FMT_NONE
-                        || get_ug_to_av_pixfmt(in_pixfmt) != out_pixfmt) {
-                for (ptrdiff_t i = 0; i < thread_count; ++i) {
-                        int chunk_size = height / s->thread_count & ~1;
-                        s->out_frame_parts[i]->data[0] = s->out_frame->data[0] + i * s->out_frame->linesize[0] *
-                                chunk_size;
-
-                        if (av_pix_fmt_desc_get(out_pixfmt)->log2_chroma_h == 1) { // eg. 4:2:0
-                                chunk_size /= 2;
-                        }
-                        s->out_frame_parts[i]->data[1] = s->out_frame->data[1] + i * s->out_frame->linesize[1] *
-                                chunk_size;
-                        s->out_frame_parts[i]->data[2] = s->out_frame->data[2] + i * s->out_frame->linesize[2] *
-                                chunk_size;
-                        s->out_frame_parts[i]->linesize[0] = s->out_frame->linesize[0];
-                        s->out_frame_parts[i]->linesize[1] = s->out_frame->linesize[1];
-                        s->out_frame_parts[i]->linesize[2] = s->out_frame->linesize[2];
-                }
-        }
-
         if (get_ug_to_av_pixfmt(in_pixfmt) != AV_PIX_FMT_NONE
                         && out_pixfmt == get_ug_to_av_pixfmt(in_pixfmt)) {
                 s->decoded_codec = in_pixfmt;
@@ -1624,111 +1603,202 @@ struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int
         s->decoded = (unsigned char *) malloc((long) vc_get_linesize(width, s->decoded_codec) * height);
 
         s->pixfmt_conv_callback = select_pixfmt_callback(out_pixfmt, s->decoded_codec);
+        const char *zero_copy = get_commandline_param("lavc-zero-copy");
+        s->zero_copy = zero_copy == NULL || strcmp(zero_copy, "no") != 0;
 
         return s;
 };
 
-// frame has some linesizes as mapped ultragrid equivalent pixfmt
-static bool same_linesizes(codec_t codec, AVFrame *frame)
+/**
+ * Gets linesizes and line counts of planes of the UltraGrid buffer (planes
+ * of planar pixfmts are contiguous).
+ *
+ * @returns plane count
+ */
+static int get_uv_layout(codec_t codec, int width, int height, int linesize[AV_NUM_DATA_POINTERS], int lines[AV_NUM_DATA_POINTERS])
 {
         if (!codec_is_planar(codec)) {
-                return vc_get_linesize(frame->width, codec) == frame->linesize[0];
+                linesize[0] = vc_get_linesize(width, codec);
+                lines[0] = height;
+                return 1;
         }
         assert(get_bits_per_component(codec) == 8);
         int sub[8];
         codec_get_planes_subsampling(codec, sub);
-        for (ptrdiff_t i = 0; i < 4; ++i) {
-                if (sub[2 * i] == 0) {
-                        return true;
-                }
-                if (frame->linesize[i] != (frame->width + sub[2 * i] - 1) / sub[2 * i]) {
-                        return false;
-                }
+        int i = 0;
+        for ( ; i < 4 && sub[2 * i] != 0; ++i) {
+                linesize[i] = (width + sub[2 * i] - 1) / sub[2 * i];
+                lines[i] = (height + sub[2 * i + 1] - 1) / sub[2 * i + 1];
         }
-        return true;
+        return i;
 }
 
 struct pixfmt_conv_task_data {
         pixfmt_callback_t callback;
         AVFrame *out_frame;
         const unsigned char *in_data;
-        int width;
-        int height;
+        int in_linesize;
+        int log2_chroma_h;
 };
 
-static void *pixfmt_conv_task(void *arg) {
+/// converts rows [begin, end) over a view of out_frame starting at row begin
+static void pixfmt_conv_rows(void *arg, int begin, int end) {
         struct pixfmt_conv_task_data *data = (struct pixfmt_conv_task_data *) arg;
-        data->callback(data->out_frame, data->in_data, data->width, data->height);
-        return NULL;
+        AVFrame part = { .opaque = data->out_frame->opaque };
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && data->out_frame->data[plane] != NULL; ++plane) {
+                int rows = plane == 1 || plane == 2 ? begin >> data->log2_chroma_h : begin;
+                part.data[plane] = data->out_frame->data[plane] + (ptrdiff_t) rows * data->out_frame->linesize[plane];
+                part.linesize[plane] = data->out_frame->linesize[plane];
+        }
+        data->callback(&part, data->in_data + (size_t) begin * data->in_linesize, data->out_frame->width, end - begin);
+}
+
+ADD_TO_PARAM("lavc-zero-copy", "* lavc-zero-copy=no\n"
+                "  Always copy the frame for the libavcodec encoder even if its layout\n"
+                "  allows passing it directly.\n");
+
+/// data of frames passed to the encoder as is should be aligned for libavcodec SIMD code
+#define ZERO_COPY_ALIGN 16
+
+static bool can_wrap(const struct to_lavc_vid_conv *s, const unsigned char *data, const int *linesize, int planes)
+{
+        if (!s->zero_copy || (uintptr_t) data % ZERO_COPY_ALIGN != 0) {
+                return false;
+        }
+        for (int i = 0; i < planes; ++i) {
+                if (linesize[i] % ZERO_COPY_ALIGN != 0) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+static void release_input_ref(void *opaque, uint8_t *data)
+{
+        UNUSED(data);
+        struct input_ref *ref = opaque;
+        ref->release(ref->udata);
+        free(ref);
+}
+
+/**
+ * Wraps the UltraGrid buffer to reference-counted tmp_frame, so that
+ * avcodec_send_frame() just references it instead of making a copy.
+ */
+static AVFrame *wrap_input(struct to_lavc_vid_conv *s, unsigned char *data, const int *linesize, int planes,
+                void (*release)(void *udata), void *udata)
+{
+        to_lavc_vid_conv_release_input(s);
+        size_t size = (size_t) linesize[0] * s->out_frame->height;
+        if (planes > 1) {
+                size = vc_get_datalen(s->out_frame->width, s->out_frame->height, s->decoded_codec);
+        }
+        struct input_ref *ref = malloc(sizeof *ref);
+        ref->release = release;
+        ref->udata = udata;
+        AVFrame *frame = s->tmp_frame;
+        frame->buf[0] = av_buffer_create(data, size, release_input_ref, ref, AV_BUFFER_FLAG_READONLY);
+        if (frame->buf[0] == NULL) {
+                free(ref);
+                return NULL;
+        }
+        memcpy(frame->linesize, linesize, planes * sizeof linesize[0]);
+        if (planes > 1) {
+                buf_get_planes(s->out_frame->width, s->out_frame->height, s->decoded_codec, (char *) data, (char **) frame->data);
+        } else {
+                frame->data[0] = data;
+        }
+        return frame;
+}
+
+void to_lavc_vid_conv_release_input(struct to_lavc_vid_conv *s)
+{
+        av_buffer_unref(&s->tmp_frame->buf[0]);
 }
 
 /// @return AVFrame with converted data (if needed); valid until next to_lavc_vid_conv()
 ///         call or to_lavc_vid_conv_destroy()
 struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *s, char *in_data) {
+        return to_lavc_vid_conv_zero_copy(s, in_data, 0, NULL, NULL);
+}
+
+struct AVFrame *to_lavc_vid_conv_zero_copy(struct to_lavc_vid_conv *s, char *in_data, int in_linesize,
+                void (*release)(void *udata), void *udata) {
         int ret = 0;
         unsigned char *decoded = NULL;
         if ((ret = av_frame_make_writable(s->out_frame)) != 0) {
                 print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot make frame writable", ret);
+                if (release != NULL) {
+                        release(udata);
+                }
                 return NULL;
         }
+        // frame->pts is incremented by the caller in whichever frame is returned
+        const int64_t pts = MAX(s->out_frame->pts, s->tmp_frame->pts);
 
         time_ns_t t0 = get_time_in_ns();
-        if (s->decoder != vc_memcpy) {
-                int src_linesize = vc_get_linesize(s->out_frame->width, s->in_pixfmt);
-                int dst_linesize = vc_get_linesize(s->out_frame->width, s->decoded_codec);
-                parallel_pix_conv(s->out_frame->height, (char *) s->decoded, dst_linesize, in_data, src_linesize, s->decoder, s->thread_count);
+        // packed UltraGrid pixfmt usable by the encoder with matching linesize - decode directly to the frame
+        const bool decode_to_frame = s->pixfmt_conv_callback == NULL && !codec_is_planar(s->decoded_codec)
+                && s->out_frame->linesize[0] == vc_get_linesize(s->out_frame->width, s->decoded_codec);
+        const int src_linesize = in_linesize != 0 && !codec_is_planar(s->in_pixfmt) ? in_linesize
+                : vc_get_linesize(s->out_frame->width, s->in_pixfmt);
+        int decoded_linesize = vc_get_linesize(s->out_frame->width, s->decoded_codec);
+        // pixfmt_conv_callback expects contiguous lines - strided input is packed by the decoder (vc_memcpy)
+        if (s->decoder != vc_memcpy || (s->pixfmt_conv_callback != NULL && src_linesize != decoded_linesize)) {
+                if (decode_to_frame) {
+                        parallel_pix_conv(s->out_frame->height, (char *) s->out_frame->data[0], s->out_frame->linesize[0],
+                                        in_data, src_linesize, s->decoder, s->thread_count);
+                } else {
+                        parallel_pix_conv(s->out_frame->height, (char *) s->decoded, decoded_linesize, in_data, src_linesize, s->decoder, s->thread_count);
+                }
                 decoded = s->decoded;
         } else {
                 decoded = (unsigned char *) in_data;
+                decoded_linesize = src_linesize;
         }
 
         time_ns_t t1 = get_time_in_ns();
         AVFrame *frame = s->out_frame;
         if (s->pixfmt_conv_callback != NULL) {
-                struct pixfmt_conv_task_data data[s->thread_count];
-                for(int i = 0; i < s->thread_count; ++i) {
-                        data[i].callback = s->pixfmt_conv_callback;
-                        data[i].out_frame = s->out_frame_parts[i];
-
-                        size_t height = s->out_frame->height / s->thread_count & ~1; // height needs to be even
-                        if (i < s->thread_count - 1) {
-                                data[i].height = height;
-                        } else { // we are last so we need to do the rest
-                                data[i].height = s->out_frame->height -
-                                        height * (s->thread_count - 1);
+                struct pixfmt_conv_task_data data = { s->pixfmt_conv_callback, s->out_frame, decoded,
+                        decoded_linesize, av_pix_fmt_desc_get(s->out_frame->format)->log2_chroma_h };
+                size_t row_bytes = data.in_linesize;
+                for (int plane = 0; plane < AV_NUM_DATA_POINTERS && s->out_frame->data[plane] != NULL; ++plane) {
+                        row_bytes += s->out_frame->linesize[plane];
+                }
+                // chunk height needs to be even
+                task_run_parallel_range(pixfmt_conv_rows, &data, s->out_frame->height,
+                                parallel_conv_chunk_rows(row_bytes, 2), s->thread_count);
+        } else if (s->decoder == vc_memcpy || !decode_to_frame) { // no pixel format conversion needed
+                int linesize[AV_NUM_DATA_POINTERS] = { 0 };
+                int lines[AV_NUM_DATA_POINTERS] = { 0 };
+                int planes = get_uv_layout(s->decoded_codec, s->out_frame->width, s->out_frame->height, linesize, lines);
+                if (planes == 1) {
+                        linesize[0] = decoded_linesize;
+                }
+                if (release != NULL && decoded == (unsigned char *) in_data && can_wrap(s, decoded, linesize, planes)) {
+                        frame = wrap_input(s, decoded, linesize, planes, release, udata);
+                        if (frame != NULL) {
+                                release = NULL; // released with the frame
+                        } else {
+                                frame = s->out_frame;
                         }
-                        data[i].width = s->out_frame->width;
-                        data[i].in_data = decoded + i * height *
-                                vc_get_linesize(s->out_frame->width, s->decoded_codec);
                 }
-                task_run_parallel(pixfmt_conv_task, s->thread_count, data, sizeof data[0], NULL);
-        } else { // no pixel format conversion needed
-                if (codec_is_planar(s->decoded_codec) && !same_linesizes(s->decoded_codec, s->out_frame)) {
-                        assert(get_bits_per_component(s->decoded_codec) == 8);
-                        int sub[8];
-                        codec_get_planes_subsampling(s->decoded_codec, sub);
+                if (frame == s->out_frame) {
                         const unsigned char *in = decoded;
-                        for (ptrdiff_t i = 0; i < 4; ++i) {
-                                if (sub[2 * i] == 0) {
-                                        break;
-                                }
-                                int linesize = (s->out_frame->width + sub[2 * i] - 1) / sub[2 * i];
-                                int lines = (s->out_frame->height + sub[2 * i + 1] - 1) / sub[2 * i + 1];
-                                for (ptrdiff_t y = 0; y < lines; ++y) {
-                                        memcpy(s->out_frame->data[i] + y * s->out_frame->linesize[i], in, linesize);
-                                        in += linesize;
+                        for (int i = 0; i < planes; ++i) {
+                                size_t len = MIN(linesize[i], s->out_frame->linesize[i]);
+                                for (ptrdiff_t y = 0; y < lines[i]; ++y) {
+                                        memcpy(s->out_frame->data[i] + y * s->out_frame->linesize[i], in, len);
+                                        in += linesize[i];
                                 }
                         }
-                } else { // just set pointers to input buffer
-                        frame = s->tmp_frame;
-                        memcpy(frame->linesize, s->out_frame->linesize, sizeof frame->linesize);
-                        if (codec_is_planar(s->decoded_codec)) {
-                                buf_get_planes(s->out_frame->width, s->out_frame->height, s->decoded_codec, (char *) decoded, (char **) frame->data);
-                        } else {
-                                frame->data[0] = (uint8_t *) decoded;
-                        }
                 }
         }
+        if (release != NULL) {
+                release(udata);
+        }
+        frame->pts = pts;
         time_ns_t t2 = get_time_in_ns();
         log_msg(LOG_LEVEL_DEBUG2, MOD_NAME "duration uv pixfmt change: %f ms, av foramt change: %f ms\n",
                 (t1 - t0) / MS_IN_SEC_DBL, (t2 - t1) / MS_IN_SEC_DBL);
@@ -1740,10 +1810,6 @@ void to_lavc_vid_conv_destroy(struct to_lavc_vid_conv **s_p) {
         if (s == NULL) {
                 return;
         }
-        for (int i = 0; i < s->thread_count; i++) {
-                av_frame_free(&s->out_frame_parts[i]);
-        }
-        free(s->out_frame_parts);
         av_frame_free(&s->out_frame);
         av_frame_free(&s->tmp_frame);
         free(s->decoded);
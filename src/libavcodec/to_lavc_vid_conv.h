@@ -48,6 +48,22 @@ extern "C" {
 struct to_lavc_vid_conv;
 struct to_lavc_vid_conv *to_lavc_vid_conv_init(codec_t in_pixfmt, int width, int height, enum AVPixelFormat out_pixfmt, int thread_count);
 struct AVFrame *to_lavc_vid_conv(struct to_lavc_vid_conv *state, char *in_data);
+/**
+ * Same as to_lavc_vid_conv() but if in_data can be passed to the encoder as
+ * is, the returned frame references it instead of a copy. In that case
+ * in_data must stay valid until release(udata) is called, which happens
+ * after the last reference to the frame is dropped (the encoder may keep
+ * it after avcodec_send_frame()), otherwise release is called before return.
+ *
+ * Call to_lavc_vid_conv_release_input() after passing the frame to the
+ * encoder to drop the reference held by state.
+ *
+ * @param in_linesize  distance of in_data lines (tile::linesize), 0 - contiguous;
+ *                     ignored for planar input
+ */
+struct AVFrame *to_lavc_vid_conv_zero_copy(struct to_lavc_vid_conv *state, char *in_data, int in_linesize,
+                void (*release)(void *udata), void *udata);
+void to_lavc_vid_conv_release_input(struct to_lavc_vid_conv *state);
 void to_lavc_vid_conv_destroy(struct to_lavc_vid_conv **state);
 
 struct to_lavc_req_prop {
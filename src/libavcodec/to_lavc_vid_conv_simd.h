@@ -0,0 +1,327 @@
+/**
+ * @file   libavcodec/to_lavc_vid_conv_simd.h
+ * @brief  SIMD implementations of selected UltraGrid to AVFrame conversions
+ *
+ * Included by to_lavc_vid_conv.c once for every instruction set with
+ * PIXFMT_SIMD_ISA set (see utils/simd_lanes.h), the structure follows
+ * from_lavc_vid_conv_simd.h. Output is identical to the scalar conversions.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TO_LAVC_VID_CONV_SIMD_COMMON
+#define TO_LAVC_VID_CONV_SIMD_COMMON
+#define Z 0x80 // shuffle index producing zero byte (both PSHUFB and TBL)
+
+/**
+ * v210 unpacking - fields of the 4 words (6 pixels) masked to 10 bits are
+ * A = Cb0 Y1 Cr1 Y4 (bits 0-9), B = Y0 Cb1 Y3 Cr2 (10-19) and
+ * C = Cr0 Y2 Cb2 Y5 (20-29); tables pick 16-bit Y0-Y5 and Cb0-Cb2 (bytes
+ * 0-5) with Cr0-Cr2 (bytes 8-13)
+ */
+static const uint8_t v210_unpack_y[3][16] = {
+        { Z, Z, 4, 5, Z, Z, Z, Z, 12, 13, Z, Z, Z, Z, Z, Z },
+        { 0, 1, Z, Z, Z, Z, 8, 9, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, 4, 5, Z, Z, Z, Z, 12, 13, Z, Z, Z, Z },
+};
+static const uint8_t v210_unpack_cbcr[3][16] = {
+        { 0, 1, Z, Z, Z, Z, Z, Z, Z, Z, 8, 9, Z, Z, Z, Z },
+        { Z, Z, 4, 5, Z, Z, Z, Z, Z, Z, Z, Z, 12, 13, Z, Z },
+        { Z, Z, Z, Z, 8, 9, Z, Z, 0, 1, Z, Z, Z, Z, Z, Z },
+};
+static const uint32_t v210_unpack_mask[4] = { 0x3FF, 0x3FF, 0x3FF, 0x3FF };
+
+/// UYVY - odd bytes (Y) and even bytes (CbCr) of the first and second half of 32 bytes
+static const uint8_t uyvy_unpack_y[2][16] = {
+        { 1, 3, 5, 7, 9, 11, 13, 15, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 1, 3, 5, 7, 9, 11, 13, 15 },
+};
+static const uint8_t uyvy_unpack_cbcr[2][16] = {
+        { 0, 2, 4, 6, 8, 10, 12, 14, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 0, 2, 4, 6, 8, 10, 12, 14 },
+};
+/// interleaved CbCr to Cb (bytes 0-7) and Cr (8-15)
+static const uint8_t cbcr_deinterleave[16] = { 0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15 };
+
+/// low halves of 32-bit values of the first and second vector to 16-bit
+static const uint8_t pack_32_16[2][16] = {
+        { 0, 1, 4, 5, 8, 9, 12, 13, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 0, 1, 4, 5, 8, 9, 12, 13 },
+};
+static const uint8_t bswap_32_to_lavc[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+#undef Z
+
+/**
+ * @returns number of lanes (multiple of vec_lanes) so that the last lane
+ *          accessing access_bytes at (lane * lane_bytes) stays within row_bytes
+ */
+static inline int to_lavc_simd_lanes(int row_bytes, int lane_bytes, int access_bytes, int vec_lanes)
+{
+        if (row_bytes < access_bytes) {
+                return 0;
+        }
+        int lanes = (row_bytes - access_bytes) / lane_bytes + 1;
+        return lanes - lanes % vec_lanes;
+}
+#endif // !defined TO_LAVC_VID_CONV_SIMD_COMMON
+
+#include "utils/simd_lanes.h"
+
+#define V_SLLI16_0(a, n) ((n) == 0 ? (a) : V_SLLI16(a, (n) == 0 ? 1 : (n)))
+
+SIMD_FUNC void SIMD_FN(v210_to_yuv422p10le)(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        // lane reads 16 B of v210 and writes 16 B to Y (12 used) and Cb, Cr (6 used) each,
+        // stores must not exceed the samples written by the scalar conversion
+        const int groups = width / 6;
+        const int lanes = MIN(to_lavc_simd_lanes(groups * 12, 12, 16, V_LANES),
+                        to_lavc_simd_lanes(groups * 6, 6, 16, V_LANES));
+        VEC sy[3], sc[3];
+        for (int i = 0; i < 3; ++i) {
+                sy[i] = V_CONST(v210_unpack_y[i]);
+                sc[i] = V_CONST(v210_unpack_cbcr[i]);
+        }
+        const VEC mask = V_CONST(v210_unpack_mask);
+
+        for (int y = 0; y < height; ++y) {
+                const unsigned char *src = in_data + (ptrdiff_t) y * vc_get_linesize(width, v210);
+                unsigned char *dst_y = out_frame->data[0] + (ptrdiff_t) out_frame->linesize[0] * y;
+                unsigned char *dst_cb = out_frame->data[1] + (ptrdiff_t) out_frame->linesize[1] * y;
+                unsigned char *dst_cr = out_frame->data[2] + (ptrdiff_t) out_frame->linesize[2] * y;
+                for (int l = 0; l < lanes; l += V_LANES) {
+                        VEC in = V_LOAD(src, 16);
+                        VEC a = V_AND(in, mask);
+                        VEC b = V_AND(V_SRLI32(in, 10), mask);
+                        VEC c = V_AND(V_SRLI32(in, 20), mask);
+                        VEC ys = V_OR(V_OR(V_SHUF(a, sy[0]), V_SHUF(b, sy[1])), V_SHUF(c, sy[2]));
+                        VEC cbcr = V_OR(V_OR(V_SHUF(a, sc[0]), V_SHUF(b, sc[1])), V_SHUF(c, sc[2]));
+                        V_STORE_LANES(dst_y, 12, ys);
+                        V_STORE_LANES(dst_cb, 6, cbcr);
+                        V_STORE_LANES(dst_cr, 6, V_BSRLI8(cbcr));
+                        src += V_LANES * 16;
+                        dst_y += V_LANES * 12;
+                        dst_cb += V_LANES * 6;
+                        dst_cr += V_LANES * 6;
+                }
+                const uint32_t *s = (const uint32_t *)(const void *) src;
+                uint16_t *d_y = (uint16_t *)(void *) dst_y;
+                uint16_t *d_cb = (uint16_t *)(void *) dst_cb;
+                uint16_t *d_cr = (uint16_t *)(void *) dst_cr;
+                for (int x = lanes; x < groups; ++x) {
+                        uint32_t w0 = *s++;
+                        uint32_t w1 = *s++;
+                        uint32_t w2 = *s++;
+                        uint32_t w3 = *s++;
+                        *d_y++ = (w0 >> 10) & 0x3ff;
+                        *d_y++ = w1 & 0x3ff;
+                        *d_y++ = (w1 >> 20) & 0x3ff;
+                        *d_y++ = (w2 >> 10) & 0x3ff;
+                        *d_y++ = w3 & 0x3ff;
+                        *d_y++ = (w3 >> 20) & 0x3ff;
+                        *d_cb++ = w0 & 0x3ff;
+                        *d_cb++ = (w1 >> 10) & 0x3ff;
+                        *d_cb++ = (w2 >> 20) & 0x3ff;
+                        *d_cr++ = (w0 >> 20) & 0x3ff;
+                        *d_cr++ = w2 & 0x3ff;
+                        *d_cr++ = (w3 >> 10) & 0x3ff;
+                }
+        }
+}
+
+/**
+ * Converts 2 UYVY rows - lane reads 32 B (16 pixels) of each, Y of both rows
+ * and averaged CbCr are returned in the respective vectors.
+ */
+SIMD_FUNC __attribute__((always_inline)) inline void SIMD_FN(uyvy_unpack_2_rows)(const unsigned char *src, const unsigned char *src2,
+                VEC *y1, VEC *y2, VEC *cbcr)
+{
+        const VEC sy0 = V_CONST(uyvy_unpack_y[0]);
+        const VEC sy1 = V_CONST(uyvy_unpack_y[1]);
+        const VEC sc0 = V_CONST(uyvy_unpack_cbcr[0]);
+        const VEC sc1 = V_CONST(uyvy_unpack_cbcr[1]);
+        VEC a0 = V_LOAD(src, 32);
+        VEC a1 = V_LOAD(src + 16, 32);
+        VEC b0 = V_LOAD(src2, 32);
+        VEC b1 = V_LOAD(src2 + 16, 32);
+        *y1 = V_OR(V_SHUF(a0, sy0), V_SHUF(a1, sy1));
+        *y2 = V_OR(V_SHUF(b0, sy0), V_SHUF(b1, sy1));
+        *cbcr = V_OR(V_SHUF(V_HADDU8(a0, b0), sc0), V_SHUF(V_HADDU8(a1, b1), sc1));
+}
+
+SIMD_FUNC void SIMD_FN(uyvy_to_nv12)(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        const int lanes = width / 16 - width / 16 % V_LANES;
+        for (int y = 0; y < height; y += 2) {
+                const unsigned char *src = in_data + (ptrdiff_t) y * (width * 2);
+                const unsigned char *src2 = in_data + (ptrdiff_t) (y + 1) * (width * 2);
+                unsigned char *dst_y = out_frame->data[0] + (ptrdiff_t) out_frame->linesize[0] * y;
+                unsigned char *dst_y2 = out_frame->data[0] + (ptrdiff_t) out_frame->linesize[0] * (y + 1);
+                unsigned char *dst_cbcr = out_frame->data[1] + (ptrdiff_t) out_frame->linesize[1] * (y / 2);
+                for (int l = 0; l < lanes; l += V_LANES) {
+                        VEC y1, y2, cbcr;
+                        SIMD_FN(uyvy_unpack_2_rows)(src, src2, &y1, &y2, &cbcr);
+                        V_STORE_LANES(dst_y, 16, y1);
+                        V_STORE_LANES(dst_y2, 16, y2);
+                        V_STORE_LANES(dst_cbcr, 16, cbcr);
+                        src += V_LANES * 32;
+                        src2 += V_LANES * 32;
+                        dst_y += V_LANES * 16;
+                        dst_y2 += V_LANES * 16;
+                        dst_cbcr += V_LANES * 16;
+                }
+                for (int x = lanes * 16; x < width - 1; x += 2) {
+                        *dst_cbcr++ = (*src++ + *src2++) / 2;
+                        *dst_y++ = *src++;
+                        *dst_y2++ = *src2++;
+                        *dst_cbcr++ = (*src++ + *src2++) / 2;
+                        *dst_y++ = *src++;
+                        *dst_y2++ = *src2++;
+                }
+        }
+}
+
+SIMD_FUNC void SIMD_FN(uyvy_to_yuv420p)(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        const int src_linesize = ((width + 1) & ~1) * 2;
+        // Cb and Cr stores write 16 B, 8 B used
+        const int lanes = MIN(width / 16 - width / 16 % V_LANES, to_lavc_simd_lanes(width / 2, 8, 16, V_LANES));
+        const VEC deinterleave = V_CONST(cbcr_deinterleave);
+        int y = 0;
+        for (; y < height - 1; y += 2) {
+                const unsigned char *src = in_data + (ptrdiff_t) y * src_linesize;
+                const unsigned char *src2 = in_data + (ptrdiff_t) (y + 1) * src_linesize;
+                unsigned char *dst_y = out_frame->data[0] + (ptrdiff_t) out_frame->linesize[0] * y;
+                unsigned char *dst_y2 = out_frame->data[0] + (ptrdiff_t) out_frame->linesize[0] * (y + 1);
+                unsigned char *dst_cb = out_frame->data[1] + (ptrdiff_t) out_frame->linesize[1] * (y / 2);
+                unsigned char *dst_cr = out_frame->data[2] + (ptrdiff_t) out_frame->linesize[2] * (y / 2);
+                for (int l = 0; l < lanes; l += V_LANES) {
+                        VEC y1, y2, cbcr;
+                        SIMD_FN(uyvy_unpack_2_rows)(src, src2, &y1, &y2, &cbcr);
+                        cbcr = V_SHUF(cbcr, deinterleave);
+                        V_STORE_LANES(dst_y, 16, y1);
+                        V_STORE_LANES(dst_y2, 16, y2);
+                        V_STORE_LANES(dst_cb, 8, cbcr);
+                        V_STORE_LANES(dst_cr, 8, V_BSRLI8(cbcr));
+                        src += V_LANES * 32;
+                        src2 += V_LANES * 32;
+                        dst_y += V_LANES * 16;
+                        dst_y2 += V_LANES * 16;
+                        dst_cb += V_LANES * 8;
+                        dst_cr += V_LANES * 8;
+                }
+                int x = lanes * 16;
+                for (; x < width - 1; x += 2) {
+                        *dst_cb++ = (*src++ + *src2++) / 2;
+                        *dst_y++ = *src++;
+                        *dst_y2++ = *src2++;
+                        *dst_cr++ = (*src++ + *src2++) / 2;
+                        *dst_y++ = *src++;
+                        *dst_y2++ = *src2++;
+                }
+                if (x < width) {
+                        *dst_cb++ = (*src++ + *src2++) / 2;
+                        *dst_y++ = *src++;
+                        *dst_y2++ = *src2++;
+                        *dst_cr++ = (*src++ + *src2++) / 2;
+                }
+        }
+        if (y < height) { // last odd row - scalar
+                AVFrame last = { .opaque = out_frame->opaque };
+                for (int plane = 0; plane < 3; ++plane) {
+                        last.data[plane] = out_frame->data[plane] + (ptrdiff_t) out_frame->linesize[plane] * (plane == 0 ? y : y / 2);
+                        last.linesize[plane] = out_frame->linesize[plane];
+                }
+                uyvy_to_yuv420p(&last, in_data + (ptrdiff_t) y * src_linesize, width, 1);
+        }
+}
+
+/**
+ * R10k to planar GBR - lane reads 32 B (8 pixels) and writes 16 B to every plane
+ */
+SIMD_FUNC __attribute__((always_inline)) inline void SIMD_FN(r10k_to_gbrpXXle)(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data,
+                int width, int height, int depth)
+{
+        const int lanes = width / 8 - width / 8 % V_LANES;
+        const VEC bswap = V_CONST(bswap_32_to_lavc);
+        const VEC pack0 = V_CONST(pack_32_16[0]);
+        const VEC pack1 = V_CONST(pack_32_16[1]);
+        const VEC mask = V_SET1_32(0x3FF);
+        const int src_linesize = vc_get_linesize(width, R10k);
+        for (int y = 0; y < height; ++y) {
+                const unsigned char *src = in_data + (ptrdiff_t) y * src_linesize;
+                unsigned char *dst_g = out_frame->data[0] + (ptrdiff_t) out_frame->linesize[0] * y;
+                unsigned char *dst_b = out_frame->data[1] + (ptrdiff_t) out_frame->linesize[1] * y;
+                unsigned char *dst_r = out_frame->data[2] + (ptrdiff_t) out_frame->linesize[2] * y;
+                for (int l = 0; l < lanes; l += V_LANES) {
+                        VEC w0 = V_SHUF(V_LOAD(src, 32), bswap);
+                        VEC w1 = V_SHUF(V_LOAD(src + 16, 32), bswap);
+                        VEC r = V_OR(V_SHUF(V_SRLI32(w0, 22), pack0), V_SHUF(V_SRLI32(w1, 22), pack1));
+                        VEC g = V_OR(V_SHUF(V_AND(V_SRLI32(w0, 12), mask), pack0), V_SHUF(V_AND(V_SRLI32(w1, 12), mask), pack1));
+                        VEC b = V_OR(V_SHUF(V_AND(V_SRLI32(w0, 2), mask), pack0), V_SHUF(V_AND(V_SRLI32(w1, 2), mask), pack1));
+                        V_STORE_LANES(dst_r, 16, V_SLLI16_0(r, depth - 10));
+                        V_STORE_LANES(dst_g, 16, V_SLLI16_0(g, depth - 10));
+                        V_STORE_LANES(dst_b, 16, V_SLLI16_0(b, depth - 10));
+                        src += V_LANES * 32;
+                        dst_g += V_LANES * 16;
+                        dst_b += V_LANES * 16;
+                        dst_r += V_LANES * 16;
+                }
+                uint16_t *d_g = (uint16_t *)(void *) dst_g;
+                uint16_t *d_b = (uint16_t *)(void *) dst_b;
+                uint16_t *d_r = (uint16_t *)(void *) dst_r;
+                for (int x = lanes * 8; x < width; ++x) {
+                        unsigned char w0 = *src++;
+                        unsigned char w1 = *src++;
+                        unsigned char w2 = *src++;
+                        unsigned char w3 = *src++;
+                        *d_r++ = (w0 << 2U | w1 >> 6U) << (depth - 10U);
+                        *d_g++ = ((w1 & 0x3FU) << 4U | w2 >> 4U) << (depth - 10U);
+                        *d_b++ = ((w2 & 0xFU) << 6U | w3 >> 2U) << (depth - 10U);
+                }
+        }
+}
+
+SIMD_FUNC void SIMD_FN(r10k_to_gbrp10le)(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        SIMD_FN(r10k_to_gbrpXXle)(out_frame, in_data, width, height, 10);
+}
+
+SIMD_FUNC void SIMD_FN(r10k_to_gbrp16le)(AVFrame * __restrict out_frame, const unsigned char * __restrict in_data, int width, int height)
+{
+        SIMD_FN(r10k_to_gbrpXXle)(out_frame, in_data, width, height, 16);
+}
+
+#undef V_SLLI16_0
+#define SIMD_LANES_UNDEF
+#include "utils/simd_lanes.h"
+#undef SIMD_LANES_UNDEF
@@ -62,9 +62,11 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <cstdlib>
+#include <future>
 #ifndef _WIN32
 #include <execinfo.h>
 #endif // defined WIN32
@@ -79,6 +81,7 @@
 #include <string.h>
 #include <thread>
 #include <tuple>
+#include <vector>
 
 #include "compat/misc.h"
 #include "control_socket.h"
@@ -98,6 +101,7 @@
 #include "utils/misc.h"
 #include "utils/nat.h"
 #include "utils/net.h"
+#include "utils/numa_placement.h"
 #include "utils/sdp.h"
 #include "utils/string.h"
 #include "utils/string_view_utils.hpp"
@@ -137,6 +141,7 @@ static constexpr const char *DEFAULT_AUDIO_CODEC = "PCM";
 #define OPT_IMPORT (('I' << 8) | 'M')
 #define OPT_LIST_MODULES (('L' << 8) | 'M')
 #define OPT_MCAST_IF (('M' << 8) | 'I')
+#define OPT_MODULE_INDEX (('M' << 8) | 'X')
 #define OPT_PIX_FMTS (('P' << 8) | 'F')
 #define OPT_PIXFMT_CONV_POLICY (('P' << 8) | 'C')
 #define OPT_RTSP_SERVER (('R' << 8) | 'S')
@@ -150,6 +155,18 @@ static constexpr const char *DEFAULT_AUDIO_CODEC = "PCM";
 using namespace std;
 using namespace std::chrono;
 
+struct state_uv;
+
+/// capture device with its own sender (one per -t with multi-input)
+struct capture_input {
+        struct state_uv *uv;
+        struct vidcap *capture_device;
+        video_rxtx *rxtx;
+        bool send_sdi_audio; ///< embedded audio is sent from the first input only
+        pthread_t thread_id;
+        bool thread_started;
+};
+
 struct state_uv {
         uint32_t magic = state_magic;
         state_uv() noexcept {
@@ -168,6 +185,9 @@ struct state_uv {
         struct module root_module;
 
         video_rxtx *state_video_rxtx{};
+        /// inputs other than the first one (--param multi-input), created
+        /// all before the capture threads are started (not reallocated)
+        vector<capture_input> extra_inputs;
 
         static void should_exit_capture_callback(void *udata) {
                 auto *s = (state_uv *) udata;
@@ -229,6 +249,8 @@ static void usage(const char *exec_path, bool full = false)
         if (full) {
                 print_help_item("--verbose[=<level>]", {"print verbose messages (optionally specify level [0-" + to_string(LOG_LEVEL_MAX) + "])"});
                 print_help_item("--list-modules", {"prints list of modules"});
+                print_help_item("--module-index <file>", {"writes index of modules (lib/ultragrid/modules.idx) so that",
+                                "only the modules being used are opened"});
                 print_help_item("--control-port <port>[:0|1]", {"set control port (default port: " + to_string(DEFAULT_CONTROL_PORT) + ")",
                                 "connection types: 0- Server (default), 1- Client"});
                 print_help_item("-x, --protocol <proto>", {"transmission protocol to use (see `-x help`)"});
@@ -299,42 +321,173 @@ static void print_fps(const char *prefix, steady_clock::time_point *t0, int *fra
         }
 }
 
+#define MULTI_INPUT_PARAM "multi-input"
+ADD_TO_PARAM(MULTI_INPUT_PARAM, "* " MULTI_INPUT_PARAM "\n"
+                "  Each -t is an independent input with its own compression and sender (instead of\n"
+                "  the first one only), ports of n-th input are shifted by 4*n (sender only, ultragrid_rtp)\n");
+#define MULTI_INPUT_PORT_STEP 4 ///< video and audio RTP+RTCP
+
+#define STARTUP_PARALLEL_PARAM "startup-parallel"
+ADD_TO_PARAM(STARTUP_PARALLEL_PARAM, "* " STARTUP_PARALLEL_PARAM "\n"
+                "  Initialize video capture concurrently with audio and display (device probing\n"
+                "  overlaps), do not use if the capture uses resources of the display (eg. GL)\n");
+
+#define CAPTURE_RING_PARAM "capture-ring"
+ADD_TO_PARAM(CAPTURE_RING_PARAM, "* " CAPTURE_RING_PARAM "=<n>\n"
+                "  Copy frames of capture modules not having own frame pool to a ring of <n> buffers\n"
+                "  so that the capture doesn't wait for compression/sending (frames are dropped if all are in use)\n");
+namespace {
+/**
+ * Decouples capture modules that reuse a single buffer (frame without
+ * dispose callback) from the downstream processing. The captured frame is
+ * copied to a free ring buffer and the capture may continue immediately.
+ */
+class capture_ring {
+public:
+        explicit capture_ring(int size) : size(size) {}
+
+        static bool is_supported(const video_frame *f) {
+                return !is_codec_opaque(f->color_spec) && !codec_is_const_size(f->color_spec);
+        }
+
+        /// @returns copy of f or nullptr if the frame was dropped (all buffers in use)
+        shared_ptr<video_frame> put(video_frame *f) {
+                time_ns_t now = get_time_in_ns();
+                if (last_grab != 0 && f->fps > 0 && now - last_grab > 1.5 * NS_IN_SEC_DBL / f->fps) {
+                        late += 1;
+                }
+                last_grab = now;
+
+                struct video_desc desc = video_desc_from_frame(f);
+                struct video_frame *out = nullptr;
+                {
+                        lock_guard<mutex> lk(pool->lock);
+                        while (out == nullptr && !pool->free_frames.empty()) {
+                                struct video_frame *candidate = pool->free_frames.back();
+                                pool->free_frames.pop_back();
+                                if (video_desc_eq(video_desc_from_frame(candidate), desc)) {
+                                        out = candidate;
+                                } else {
+                                        vf_free(candidate);
+                                        allocated -= 1;
+                                }
+                        }
+                }
+                if (out == nullptr) {
+                        if (allocated >= size) {
+                                dropped += 1;
+                                report(now);
+                                return {};
+                        }
+                        out = vf_alloc_desc_data(desc);
+                        allocated += 1;
+                }
+
+                vf_copy_metadata(out, f);
+                for (unsigned i = 0; i < f->tile_count; ++i) {
+                        out->tiles[i].data_len = min(f->tiles[i].data_len, out->tiles[i].data_len);
+                        memcpy(out->tiles[i].data, f->tiles[i].data, out->tiles[i].data_len);
+                }
+                copied += 1;
+                report(now);
+
+                return shared_ptr<video_frame>(out, [pool = pool](struct video_frame *frame) {
+                                lock_guard<mutex> lk(pool->lock);
+                                pool->free_frames.push_back(frame);
+                        });
+        }
+
+private:
+        struct frame_pool {
+                mutex lock;
+                vector<struct video_frame *> free_frames;
+                ~frame_pool() {
+                        for (auto *f : free_frames) {
+                                vf_free(f);
+                        }
+                }
+        };
+
+        void report(time_ns_t now) {
+                if (last_report == 0) {
+                        last_report = now;
+                        return;
+                }
+                if (now - last_report < 5 * NS_IN_SEC) {
+                        return;
+                }
+                log_msg(dropped > 0 || late > 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE,
+                                "[capture] Ring of %d buffers: %d frames passed, %d dropped (downstream too slow), %d captured late\n",
+                                size, copied, dropped, late);
+                copied = dropped = late = 0;
+                last_report = now;
+        }
+
+        shared_ptr<frame_pool> pool = make_shared<frame_pool>(); ///< shared with frames in flight
+        int size;
+        int allocated = 0;
+        int copied = 0;
+        int dropped = 0;
+        int late = 0; ///< frames arriving later than 1.5x frame time after the previous one
+        time_ns_t last_grab = 0;
+        time_ns_t last_report = 0;
+};
+} // end of anonymous namespace
+
 /**
  * This function captures video and possibly compresses it.
  * It then delegates sending to another thread.
  *
- * @param[in] arg pointer to UltraGrid (root) module
+ * @param[in] arg pointer to capture_input
  */
 static void *capture_thread(void *arg)
 {
         set_thread_name(__func__);
 
-        struct state_uv *uv = (struct state_uv *) arg;
+        auto *in = (struct capture_input *) arg;
+        struct state_uv *uv = in->uv;
         assert(uv->magic == state_uv::state_magic);
         struct wait_obj *wait_obj = wait_obj_init();
         steady_clock::time_point t0 = steady_clock::now();
         int frames = 0;
-        char *print_fps_prefix = vidcap_get_fps_print_prefix(uv->capture_device) ? strdupa(vidcap_get_fps_print_prefix(uv->capture_device)) : NULL;
+        char *print_fps_prefix = vidcap_get_fps_print_prefix(in->capture_device) ? strdupa(vidcap_get_fps_print_prefix(in->capture_device)) : NULL;
         if (print_fps_prefix && print_fps_prefix[strlen(print_fps_prefix) - 1] == ' ') { // trim trailing ' '
                 print_fps_prefix[strlen(print_fps_prefix) - 1] = '\0';
         }
+        unique_ptr<capture_ring> ring;
+        if (const char *ring_size = get_commandline_param(CAPTURE_RING_PARAM)) {
+                if (atoi(ring_size) > 0) {
+                        ring = make_unique<capture_ring>(atoi(ring_size));
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, "[capture] Wrong capture ring size %s, ignoring!\n", ring_size);
+                }
+        }
 
         while (!uv->should_exit_capture) {
                 /* Capture and transmit video... */
                 struct audio_frame *audio = nullptr;
-                struct video_frame *tx_frame = vidcap_grab(uv->capture_device, &audio);
+                struct video_frame *tx_frame = vidcap_grab(in->capture_device, &audio);
 
                 if (audio != nullptr) {
-                        audio_sdi_send(uv->audio, audio);
+                        if (in->send_sdi_audio) {
+                                audio_sdi_send(uv->audio, audio);
+                        }
                         AUDIO_FRAME_DISPOSE(audio);
                 }
 
                 if (tx_frame != NULL) {
+                        startup_report_event(STARTUP_FIRST_CAPTURED);
                         print_fps(print_fps_prefix, &t0, &frames);
                         //tx_frame = vf_get_copy(tx_frame);
                         bool wait_for_cur_uncompressed_frame;
                         shared_ptr<video_frame> frame;
-                        if (!tx_frame->callbacks.dispose) {
+                        if (!tx_frame->callbacks.dispose && ring && capture_ring::is_supported(tx_frame)) {
+                                wait_for_cur_uncompressed_frame = false;
+                                frame = ring->put(tx_frame);
+                                if (!frame) {
+                                        continue;
+                                }
+                        } else if (!tx_frame->callbacks.dispose) {
                                 wait_obj_reset(wait_obj);
                                 wait_for_cur_uncompressed_frame = true;
                                 frame = shared_ptr<video_frame>(tx_frame, [wait_obj](struct video_frame *) {
@@ -345,7 +498,7 @@ static void *capture_thread(void *arg)
                                 frame = shared_ptr<video_frame>(tx_frame, tx_frame->callbacks.dispose);
                         }
 
-                        uv->state_video_rxtx->send(std::move(frame)); // std::move really important here (!)
+                        in->rxtx->send(std::move(frame)); // std::move really important here (!)
 
                         // wait for frame frame to be processed, eg. by compress
                         // or sender (uncompressed video). Grab invalidates previous frame
@@ -460,11 +613,12 @@ static void copy_sv_to_c_buf(char (&dest)[N], std::string_view sv){
 
                 if(key == "help"){
                         col() << "Usage:\n" <<
-                                "\tuv " << TBOLD("-Nholepunch:room=<room>:(server=<host> | coord_srv=<host:port>:stun_srv=<host:port>)[:client_name=<name>] \n") <<
+                                "\tuv " << TBOLD("-Nholepunch:room=<room>:(server=<host> | coord_srv=<host:port>:stun_srv=<host:port>)[:client_name=<name>][:turn_srv=<host:port>:turn_user=<u>:turn_pass=<p>] \n") <<
                                 "\twhere\n"
                                 "\t\t" << TBOLD("server") << " - used if both stun & coord server are on the same host on standard ports (3478, 12558)\n"
                                 "\t\t" << TBOLD("room") << " - name of room to join\n"
                                 "\t\t" << TBOLD("client_name") << " - name to identify as to the coord server, if not specified hostname is used\n"
+                                "\t\t" << TBOLD("turn_srv") << " - TURN server to gather also relayed candidates (if direct connection is not possible)\n"
                                 "\n";
                         return false;
                 }
@@ -501,6 +655,23 @@ static void copy_sv_to_c_buf(char (&dest)[N], std::string_view sv){
 
                         punch_c->stun_srv_port = 3478;
                         punch_c->coord_srv_port = 12558;
+                } else if(key == "turn_srv"){
+                        copy_sv_to_c_buf(punch_c->turn_srv_addr, val);
+
+                        token = tokenize(sv, ':');
+                        if(token.empty()){
+                                log_msg(LOG_LEVEL_ERROR, "Missing TURN server port.\n");
+                                return false;
+                        }
+
+                        if(!parse_num(token, punch_c->turn_srv_port)){
+                                log_msg(LOG_LEVEL_ERROR, "Failed to parse TURN server port.\n");
+                                return false;
+                        }
+                } else if(key == "turn_user"){
+                        copy_sv_to_c_buf(punch_c->turn_user, val);
+                } else if(key == "turn_pass"){
+                        copy_sv_to_c_buf(punch_c->turn_pass, val);
                 } else if(key == "room"){
                         copy_sv_to_c_buf(punch_c->room_name, val);
                 } else if(key == "client_name"){
@@ -740,6 +911,7 @@ static int parse_options(int argc, char *argv[], struct ug_options *opt) {
                 {"playback",               required_argument, 0, OPT_IMPORT},
                 {"list-modules",           no_argument,       0, OPT_LIST_MODULES},
                 {"mcast-if",               required_argument, 0, OPT_MCAST_IF},
+                {"module-index",           required_argument, 0, OPT_MODULE_INDEX},
                 {"param",                  required_argument, 0, OPT_PARAM},
                 {"conv-policy",            required_argument, 0, OPT_PIXFMT_CONV_POLICY},
                 {"pix-fmts",               no_argument,       0, OPT_PIX_FMTS},
@@ -967,6 +1139,8 @@ static int parse_options(int argc, char *argv[], struct ug_options *opt) {
                         break;
                 case OPT_LIST_MODULES:
                         return list_all_modules() ? 1 : -EXIT_FAILURE;
+                case OPT_MODULE_INDEX:
+                        return write_module_index(optarg) ? 1 : -EXIT_FAILURE;
                 case OPT_START_PAUSED:
                         opt->start_paused = true;
                         break;
@@ -1249,6 +1423,45 @@ static bool help_in_argv(char **argv) {
 
 #define EXIT(expr) { int rc = expr; common_cleanup(init); return rc; }
 
+/**
+ * Initializes the capture device(s).
+ *
+ * @returns -1 on success, exit status otherwise
+ */
+static int init_capture(struct state_uv *uv, const struct ug_options *opt)
+{
+        time_ns_t phase_start = get_time_in_ns();
+        int ret = initialize_video_capture(&uv->root_module, opt->vidcap_params_head, &uv->capture_device);
+        if (ret < 0) {
+                printf("Unable to open capture device: %s\n",
+                                vidcap_params_get_driver(opt->vidcap_params_head));
+                return EXIT_FAIL_CAPTURE;
+        }
+        if (ret > 0) {
+                return EXIT_SUCCESS;
+        }
+        log_msg(LOG_LEVEL_DEBUG, "Video capture initialized-%s\n", vidcap_params_get_driver(opt->vidcap_params_head));
+
+        if (get_commandline_param(MULTI_INPUT_PARAM) != nullptr) {
+                if (strcmp(opt->video_protocol, "ultragrid_rtp") != 0 || opt->video_rxtx_mode != MODE_SENDER) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Multi-input is supported only for ultragrid_rtp sender!\n");
+                        return EXIT_FAIL_USAGE;
+                }
+                for (auto *it = vidcap_params_get_next(opt->vidcap_params_head); it != opt->vidcap_params_tail; it = vidcap_params_get_next(it)) {
+                        capture_input in{};
+                        in.uv = uv;
+                        if (initialize_video_capture(&uv->root_module, it, &in.capture_device) != 0) {
+                                log_msg(LOG_LEVEL_ERROR, "Unable to open capture device: %s\n", vidcap_params_get_driver(it));
+                                return EXIT_FAIL_CAPTURE;
+                        }
+                        uv->extra_inputs.push_back(in);
+                }
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Using %zu independent inputs.\n", uv->extra_inputs.size() + 1);
+        }
+        startup_report_phase("video capture", phase_start);
+        return -1;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -1262,12 +1475,17 @@ int main(int argc, char *argv[])
                   capture_thread_id;
         bool receiver_thread_started = false,
              capture_thread_started = false;
+        capture_input main_input{};
         unsigned display_flags = 0;
         struct control_state *control = NULL;
         struct exporter *exporter = NULL;
         int ret;
 
         time_ns_t start_time = get_time_in_ns();
+        time_ns_t phase_start = 0;
+        bool parallel_init = false;
+        int capture_status = -1;
+        std::future<int> capture_init_done;
 
         struct ug_nat_traverse *nat_traverse = nullptr;
 
@@ -1319,6 +1537,11 @@ int main(int argc, char *argv[])
                 col() << TBOLD("Network protocol : ") << video_rxtx::get_long_name(opt.video_protocol) << "\n";
                 col() << TBOLD("Audio FEC        : ") << opt.audio.fec_cfg << "\n";
                 col() << TBOLD("Video FEC        : ") << opt.requested_video_fec << "\n";
+                char numa_summary[1024];
+                if ((opt.video_rxtx_mode & MODE_RECEIVER) != 0
+                                && numa_placement_init(opt.requested_receiver, numa_summary, sizeof numa_summary)) {
+                        col() << TBOLD("NUMA placement   : ") << numa_summary << "\n";
+                }
                 col() << "\n";
         }
 
@@ -1328,10 +1551,12 @@ int main(int argc, char *argv[])
                 EXIT(EXIT_FAILURE);
         }
 
+        phase_start = get_time_in_ns();
         if (control_init(opt.control_port, opt.connection_type, &control, &uv.root_module, opt.force_ip_version) != 0) {
                 LOG(LOG_LEVEL_FATAL) << "Error: Unable to initialize remote control!\n";
                 EXIT(EXIT_FAIL_CONTROL_SOCK);
         }
+        startup_report_phase("control socket", phase_start);
 
         if(!opt.nat_traverse_config
                         || strncmp(opt.nat_traverse_config, "holepunch", strlen("holepunch")) != 0){
@@ -1342,6 +1567,35 @@ int main(int argc, char *argv[])
                 }
         }
 
+        /* Pass embedded/analog/AESEBU flags to selected vidcap
+         * device. */
+        if (audio_capture_get_vidcap_flags(opt.audio.send_cfg)) {
+                int index = audio_capture_get_vidcap_index(opt.audio.send_cfg);
+                int i = 0;
+                for (auto *vidcap_params_it = opt.vidcap_params_head; vidcap_params_it != opt.vidcap_params_tail; vidcap_params_it = vidcap_params_get_next(vidcap_params_it)) {
+                        if (index == i || index == -1) {
+                                unsigned int orig_flags =
+                                        vidcap_params_get_flags(vidcap_params_it);
+                                vidcap_params_set_flags(vidcap_params_it, orig_flags
+                                                | audio_capture_get_vidcap_flags(opt.audio.send_cfg));
+                        }
+                        i++;
+                }
+                if (index >= i) {
+                        LOG(LOG_LEVEL_ERROR) << "Entered index for non-existing vidcap (audio).\n";
+                        exit_uv(EXIT_FAIL_CAPTURE);
+                        goto cleanup;
+                }
+        }
+
+        // the capture depends only on the options above - it may be (optionally)
+        // initialized concurrently with audio and display (probing of the devices)
+        parallel_init = get_commandline_param(STARTUP_PARALLEL_PARAM) != nullptr && !show_help;
+        if (parallel_init) {
+                capture_init_done = std::async(std::launch::async, init_capture, &uv, &opt);
+        }
+
+        phase_start = get_time_in_ns();
         ret = audio_init (&uv.audio, &uv.root_module, &opt.audio,
                         opt.requested_encryption,
                         opt.force_ip_version, opt.requested_mcast_if,
@@ -1353,9 +1607,11 @@ int main(int argc, char *argv[])
         }
 
         display_flags |= audio_get_display_flags(uv.audio);
+        startup_report_phase("audio", phase_start);
 
         // Display initialization should be prior to modules that may use graphic card (eg. GLSL) in order
         // to initalize shared resource (X display) first
+        phase_start = get_time_in_ns();
         ret =
              initialize_video_display(&uv.root_module, opt.requested_display, opt.display_cfg, display_flags, opt.postprocess, &uv.display_device);
         if (ret < 0) {
@@ -1368,39 +1624,13 @@ int main(int argc, char *argv[])
                 goto cleanup;
         }
         log_msg(LOG_LEVEL_DEBUG, "Display initialized-%s\n", opt.requested_display);
+        startup_report_phase("display", phase_start);
 
-        /* Pass embedded/analog/AESEBU flags to selected vidcap
-         * device. */
-        if (audio_capture_get_vidcap_flags(opt.audio.send_cfg)) {
-                int index = audio_capture_get_vidcap_index(opt.audio.send_cfg);
-                int i = 0;
-                for (auto *vidcap_params_it = opt.vidcap_params_head; vidcap_params_it != opt.vidcap_params_tail; vidcap_params_it = vidcap_params_get_next(vidcap_params_it)) {
-                        if (index == i || index == -1) {
-                                unsigned int orig_flags =
-                                        vidcap_params_get_flags(vidcap_params_it);
-                                vidcap_params_set_flags(vidcap_params_it, orig_flags
-                                                | audio_capture_get_vidcap_flags(opt.audio.send_cfg));
-                        }
-                        i++;
-                }
-                if (index >= i) {
-                        LOG(LOG_LEVEL_ERROR) << "Entered index for non-existing vidcap (audio).\n";
-                        exit_uv(EXIT_FAIL_CAPTURE);
-                        goto cleanup;
-                }
-        }
-
-        ret = initialize_video_capture(&uv.root_module, opt.vidcap_params_head, &uv.capture_device);
-        if (ret < 0) {
-                printf("Unable to open capture device: %s\n",
-                                vidcap_params_get_driver(opt.vidcap_params_head));
-                exit_uv(EXIT_FAIL_CAPTURE);
-                goto cleanup;
-        } else if(ret > 0) {
-                exit_uv(EXIT_SUCCESS);
+        capture_status = parallel_init ? capture_init_done.get() : init_capture(&uv, &opt);
+        if (capture_status != -1) {
+                exit_uv(capture_status);
                 goto cleanup;
         }
-        log_msg(LOG_LEVEL_DEBUG, "Video capture initialized-%s\n", vidcap_params_get_driver(opt.vidcap_params_head));
 
         signal(SIGINT, signal_handler);
         signal(SIGTERM, signal_handler);
@@ -1480,6 +1710,7 @@ int main(int argc, char *argv[])
 
                 sdp_set_properties(opt.requested_receiver, opt.video_rxtx_mode & MODE_SENDER && strcasecmp(opt.video_protocol, "sdp") == 0, opt.audio.send_port != 0 && strcasecmp(opt.audio.proto, "sdp") == 0);
 
+                phase_start = get_time_in_ns();
                 uv.state_video_rxtx = video_rxtx::create(opt.video_protocol, params);
                 if (!uv.state_video_rxtx) {
                         if (strcmp(opt.video_protocol, "help") != 0) {
@@ -1489,6 +1720,22 @@ int main(int argc, char *argv[])
                         }
                 }
 
+                // multi-input - senders of the other inputs differ only in the capture and ports
+                for (size_t i = 0; i < uv.extra_inputs.size(); ++i) {
+                        auto in_params = params;
+                        const int port_offset = MULTI_INPUT_PORT_STEP * (int) (i + 1);
+                        in_params["capture_device"].ptr = uv.extra_inputs[i].capture_device;
+                        in_params["display_device"].ptr = nullptr;
+                        in_params["rx_port"].i = opt.video_rx_port == 0 ? 0 : opt.video_rx_port + port_offset;
+                        in_params["tx_port"].i = opt.video_tx_port == 0 ? 0 : opt.video_tx_port + port_offset;
+                        uv.extra_inputs[i].rxtx = video_rxtx::create(opt.video_protocol, in_params);
+                        if (uv.extra_inputs[i].rxtx == nullptr) {
+                                throw string("Cannot create RX/TX for input ") + to_string(i + 1);
+                        }
+                }
+
+                startup_report_phase("video RX/TX", phase_start);
+
                 if ((opt.video_rxtx_mode & MODE_RECEIVER) != 0U) {
                         if (!uv.state_video_rxtx->supports_receiving()) {
                                 fprintf(stderr, "Selected RX/TX mode doesn't support receiving.\n");
@@ -1508,15 +1755,24 @@ int main(int argc, char *argv[])
                 }
 
                 if ((opt.video_rxtx_mode & MODE_SENDER) != 0U) {
+                        main_input = { &uv, uv.capture_device, uv.state_video_rxtx, true, {}, false };
                         if (pthread_create
                                         (&capture_thread_id, NULL, capture_thread,
-                                         (void *) &uv) != 0) {
+                                         (void *) &main_input) != 0) {
                                 perror("Unable to create capture thread!\n");
                                 exit_uv(EXIT_FAILURE);
                                 goto cleanup;
                         } else {
                                 capture_thread_started = true;
                         }
+                        for (auto &in : uv.extra_inputs) {
+                                if (pthread_create(&in.thread_id, NULL, capture_thread, (void *) &in) != 0) {
+                                        perror("Unable to create capture thread!\n");
+                                        exit_uv(EXIT_FAILURE);
+                                        goto cleanup;
+                                }
+                                in.thread_started = true;
+                        }
                 }
 
                 if(audio_get_display_flags(uv.audio)) {
@@ -1537,6 +1793,7 @@ int main(int argc, char *argv[])
 
                 control_start(control);
                 kc.start();
+                startup_report_phase("UltraGrid", start_time);
 
                 display_run_mainloop(uv.display_device);
 
@@ -1559,6 +1816,9 @@ int main(int argc, char *argv[])
         }
 
 cleanup:
+        if (capture_init_done.valid()) { // initialization failed elsewhere
+                capture_init_done.wait();
+        }
         if (strcmp("none", opt.requested_display) != 0 &&
                         receiver_thread_started)
                 pthread_join(receiver_thread_id, NULL);
@@ -1567,11 +1827,21 @@ cleanup:
                         && capture_thread_started) {
                 pthread_join(capture_thread_id, NULL);
         }
+        for (auto &in : uv.extra_inputs) {
+                if (in.thread_started) {
+                        pthread_join(in.thread_id, NULL);
+                }
+        }
 
         /* also wait for audio threads */
         audio_join(uv.audio);
         if (uv.state_video_rxtx)
                 uv.state_video_rxtx->join();
+        for (auto &in : uv.extra_inputs) {
+                if (in.rxtx) {
+                        in.rxtx->join();
+                }
+        }
 
         export_destroy(exporter);
 
@@ -1586,6 +1856,10 @@ cleanup:
         if(uv.audio)
                 audio_done(uv.audio);
         delete uv.state_video_rxtx;
+        for (auto &in : uv.extra_inputs) {
+                delete in.rxtx;
+                vidcap_done(in.capture_device);
+        }
 
         if (uv.capture_device)
                 vidcap_done(uv.capture_device);
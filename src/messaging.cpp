@@ -103,6 +103,13 @@ void free_message_for_child(void *m, struct response *r) {
 
 }
 
+/// mod->msg_queue_lock must be held
+static void msg_queue_append(struct module *mod, struct message *msg)
+{
+        simple_linked_list_append(mod->msg_queue, msg);
+        __atomic_store_n(&mod->msg_queue_len, simple_linked_list_size(mod->msg_queue), __ATOMIC_RELAXED);
+}
+
 /**
  * Stores message to module message box. If new_message callback is present it is called. Otherwise it
  * may take a long time until module reads the message therefore setting timeout_ms is strongly
@@ -203,16 +210,16 @@ static struct response *send_message_common(struct module *root, const char *con
         //pthread_mutex_guard guard(receiver->lock, lock_guard_retain_ownership_t());
 
         pthread_mutex_lock(&receiver->msg_queue_lock);
-        int size = simple_linked_list_size(receiver->msg_queue);
+        struct message *dropped = nullptr;
+        if (simple_linked_list_size(receiver->msg_queue) >= MAX_MESSAGES) {
+                dropped = (struct message *) simple_linked_list_pop(receiver->msg_queue);
+        }
+        msg_queue_append(receiver, msg);
         pthread_mutex_unlock(&receiver->msg_queue_lock);
-        if (size >= MAX_MESSAGES) {
-                struct message *m = (struct message *) simple_linked_list_pop(receiver->msg_queue);
-                free_message(m, new_response(RESPONSE_INT_SERV_ERR, "Too many unprocessed messages"));
+        if (dropped != nullptr) {
+                free_message(dropped, new_response(RESPONSE_INT_SERV_ERR, "Too many unprocessed messages"));
                 printf("Dropping some messages for %s - queue full.\n", const_path);
         }
-        pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
-        pthread_mutex_unlock(&receiver->msg_queue_lock);
 
         if (receiver->new_message) {
                 receiver->new_message(receiver);
@@ -283,13 +290,13 @@ void module_check_undelivered_messages(struct module *node)
 void module_store_message(struct module *node, struct message *m)
 {
         pthread_mutex_guard guard(node->msg_queue_lock);
-        simple_linked_list_append(node->msg_queue, m);
+        msg_queue_append(node, m);
 }
 
 struct response *send_message_to_receiver(struct module *receiver, struct message *msg)
 {
         pthread_mutex_lock(&receiver->msg_queue_lock);
-        simple_linked_list_append(receiver->msg_queue, msg);
+        msg_queue_append(receiver, msg);
         pthread_mutex_unlock(&receiver->msg_queue_lock);
 
         pthread_mutex_guard guard(receiver->lock);
@@ -391,12 +398,23 @@ const char *response_status_to_text(int status)
         return NULL;
 }
 
+/**
+ * Called from the modules' processing loops so the common case (no message)
+ * doesn't take the lock. A message appended concurrently may be seen first
+ * by the next call.
+ */
 struct message *check_message(struct module *mod)
 {
+        if (__atomic_load_n(&mod->msg_queue_len, __ATOMIC_RELAXED) == 0) {
+                return NULL;
+        }
+
         pthread_mutex_guard guard(mod->msg_queue_lock);
 
         if(simple_linked_list_size(mod->msg_queue) > 0) {
-                return (struct message *) simple_linked_list_pop(mod->msg_queue);
+                auto *msg = (struct message *) simple_linked_list_pop(mod->msg_queue);
+                __atomic_store_n(&mod->msg_queue_len, simple_linked_list_size(mod->msg_queue), __ATOMIC_RELAXED);
+                return msg;
         } else {
                 return NULL;
         }
@@ -105,6 +105,10 @@ enum msg_sender_type {
         SENDER_MSG_CHANGE_FEC,
         SENDER_MSG_QUERY_VIDEO_MODE,
         SENDER_MSG_RESET_SSRC,
+        SENDER_MSG_SET_PARAM,
+        SENDER_MSG_ADD_CLIENT,    ///< add RTSP client (paused), response text is the local RTP port
+        SENDER_MSG_PLAY_CLIENT,
+        SENDER_MSG_REMOVE_CLIENT,
 };
 
 struct msg_sender {
@@ -117,6 +121,12 @@ struct msg_sender {
                 };
                 char receiver[128];
                 char fec_cfg[1024];
+                char param[1024]; ///< "<key> <value>" (SENDER_MSG_SET_PARAM)
+                struct { ///< SENDER_MSG_*_CLIENT
+                        unsigned client_id;
+                        int client_port;
+                        char client_addr[128];
+                };
         };
 };
 
@@ -127,6 +137,7 @@ enum msg_receiver_type {
         RECEIVER_MSG_INCREASE_VOLUME,
         RECEIVER_MSG_DECREASE_VOLUME,
         RECEIVER_MSG_MUTE,
+        RECEIVER_MSG_SET_PARAM,
 };
 struct msg_receiver {
         struct message m;
@@ -135,6 +146,7 @@ struct msg_receiver {
                 uint16_t new_rx_port;
                 struct video_desc new_desc;
                 char postprocess_cfg[1024];
+                char param[1024]; ///< "<key> <value>" (RECEIVER_MSG_SET_PARAM)
         };
 };
 
@@ -171,6 +183,7 @@ struct msg_universal {
 };
 
 #define MSG_UNIVERSAL_TAG_TX "TX_msg "
+#define MSG_UNIVERSAL_TAG_SET_PARAM "set-param " ///< followed by "<key> <value>"
 
 struct response *new_response(int status, const char *optional_message);
 void free_response(struct response *r);
@@ -125,6 +125,7 @@ struct module {
 
         pthread_mutex_t msg_queue_lock; // protects msg_queue
         struct simple_linked_list *msg_queue;
+        int msg_queue_len; ///< written under msg_queue_lock, read without it by check_message()
 
         struct simple_linked_list *msg_queue_childs; ///< messages for childern that were not delivered
 
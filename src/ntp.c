@@ -35,3 +35,17 @@ void ntp64_time(uint32_t * ntp_sec, uint32_t * ntp_frac)
         tmp = now.tv_usec;
         *ntp_frac = (tmp << 12) + (tmp << 8) - ((tmp * 3650) >> 6);
 }
+
+/// converts 64-bit NTP timestamp to nanoseconds since Unix epoch
+int64_t ntp64_to_unix_ns(uint32_t ntp_sec, uint32_t ntp_frac)
+{
+        return ((int64_t) ntp_sec - SECS_BETWEEN_1900_1970) * 1000000000 +
+                (int64_t) (((uint64_t) ntp_frac * 1000000000) >> 32);
+}
+
+/// converts nanoseconds since Unix epoch to 64-bit NTP timestamp
+void unix_ns_to_ntp64(int64_t ns, uint32_t *ntp_sec, uint32_t *ntp_frac)
+{
+        *ntp_sec = ns / 1000000000 + SECS_BETWEEN_1900_1970;
+        *ntp_frac = (((uint64_t) (ns % 1000000000)) << 32) / 1000000000;
+}
@@ -15,8 +15,8 @@
  * Copyright (c) 1999-2000 University College London
  * Copyright (c) 2005-2016 CESNET z.s.p.o.
  *
- * Largely based on common/src/btree.c revision 1.7 from the UCL 
- * Robust-Audio Tool v4.2.25. Code is based on the algorithm in:
+ * Originally based on common/src/btree.c revision 1.7 from the UCL
+ * Robust-Audio Tool v4.2.25 (now a hash table). Code was based on the algorithm in:
  *  
  *   Introduction to Algorithms by Corman, Leisserson, and Rivest,
  *   MIT Press / McGraw Hill, 1990.
@@ -70,185 +70,118 @@
 #include "pdb.h"
 
 #define PDB_MAGIC	0x10101010
-#define PDB_NODE_MAGIC	0x01010101
+#define PDB_INITIAL_CAPACITY 16 ///< must be power of 2
 
-typedef struct s_pdb_node {
+enum pdb_slot_state {
+        SLOT_EMPTY = 0,
+        SLOT_USED,
+        SLOT_DELETED, ///< tombstone - keeps probe chains (and running iterators) intact
+};
+
+struct pdb_slot {
         uint32_t key;
-        void *data;
-        struct s_pdb_node *parent;
-        struct s_pdb_node *left;
-        struct s_pdb_node *right;
-        uint32_t magic;
-} pdb_node_t;
+        enum pdb_slot_state state;
+        struct pdb_e *data;
+};
 
+/*
+ * The database is an open-addressed (linear probing) hash table keyed by
+ * SSRC. Removal leaves a tombstone and table is not rehashed while an
+ * iteration is in progress, so iterators stay valid when participants are
+ * added or removed meanwhile.
+ */
 struct pdb {
-        pdb_node_t *root;
+        struct pdb_slot *slots;
+        unsigned capacity;
+        unsigned count;     ///< used slots
+        unsigned deleted;   ///< tombstones
+        int iterating;      ///< number of iterations in progress
         uint32_t magic;
-        int count;
         volatile int *delay_ms;
 };
 
 /*****************************************************************************/
-/* Debugging functions...                                                    */
+/* Utility functions                                                         */
 /*****************************************************************************/
 
-#define BTREE_MAGIC      0x10101010
-#define BTREE_NODE_MAGIC 0x01010101
-
-#ifdef DEBUG
-static
-#ifndef HAVE_MACOSX
-__thread
-#endif
-int pdb_count;
-
-static void pdb_validate_node(pdb_node_t * node, pdb_node_t * parent)
-{
-        assert(node->magic == BTREE_NODE_MAGIC);
-        assert(node->parent == parent);
-        pdb_count++;
-        if (node->left != NULL) {
-                pdb_validate_node(node->left, node);
-        }
-        if (node->right != NULL) {
-                pdb_validate_node(node->right, node);
-        }
-}
-#endif
-
 static void pdb_validate(struct pdb *t)
 {
-        assert(t->magic == BTREE_MAGIC);
+        assert(t->magic == PDB_MAGIC);
 #ifdef DEBUG
-        pdb_count = 0;
-        if (t->root != NULL) {
-                pdb_validate_node(t->root, NULL);
+        unsigned used = 0, deleted = 0;
+        for (unsigned i = 0; i < t->capacity; ++i) {
+                used += t->slots[i].state == SLOT_USED;
+                deleted += t->slots[i].state == SLOT_DELETED;
         }
-        assert(pdb_count == t->count);
+        assert(used == t->count && deleted == t->deleted);
 #endif
 }
 
-/*****************************************************************************/
-/* Utility functions                                                         */
-/*****************************************************************************/
-
-static pdb_node_t *pdb_min(pdb_node_t * x)
+static inline unsigned pdb_hash(uint32_t key, unsigned capacity)
 {
-        if (x == NULL) {
-                return NULL;
-        }
-        while (x->left) {
-                x = x->left;
-        }
-        return x;
+        return (key * 2654435761U) & (capacity - 1);
 }
 
-static pdb_node_t *pdb_successor(pdb_node_t * x)
+/// @returns slot holding key or NULL
+static struct pdb_slot *pdb_search(struct pdb *db, uint32_t key)
 {
-        pdb_node_t *y;
-
-        if (x->right != NULL) {
-                return pdb_min(x->right);
-        }
-
-        y = x->parent;
-        while (y != NULL && x == y->right) {
-                x = y;
-                y = y->parent;
-        }
-
-        return y;
-}
-
-static pdb_node_t *pdb_search(pdb_node_t * x, uint32_t key)
-{
-        while (x != NULL && key != x->key) {
-                if (key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
+        for (unsigned i = pdb_hash(key, db->capacity), n = 0; n < db->capacity; i = (i + 1) & (db->capacity - 1), ++n) {
+                struct pdb_slot *slot = &db->slots[i];
+                if (slot->state == SLOT_EMPTY) {
+                        return NULL;
+                }
+                if (slot->state == SLOT_USED && slot->key == key) {
+                        return slot;
                 }
         }
-        return x;
+        return NULL;
 }
 
-static void pdb_insert_node(struct pdb *tree, pdb_node_t * z)
+/// @returns first empty or deleted slot for key (key must not be present)
+static struct pdb_slot *pdb_free_slot(struct pdb *db, uint32_t key)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        y = NULL;
-        x = tree->root;
-        while (x != NULL) {
-                y = x;
-                assert(z->key != x->key);
-                if (z->key < x->key) {
-                        x = x->left;
-                } else {
-                        x = x->right;
+        for (unsigned i = pdb_hash(key, db->capacity), n = 0; n < db->capacity; i = (i + 1) & (db->capacity - 1), ++n) {
+                if (db->slots[i].state != SLOT_USED) {
+                        return &db->slots[i];
                 }
         }
-
-        z->parent = y;
-        if (y == NULL) {
-                tree->root = z;
-        } else if (z->key < y->key) {
-                y->left = z;
-        } else {
-                y->right = z;
-        }
-        tree->count++;
-        pdb_validate(tree);
+        return NULL;
 }
 
-static pdb_node_t *pdb_delete_node(struct pdb *tree, pdb_node_t * z)
+static bool pdb_rehash(struct pdb *db, unsigned new_capacity)
 {
-        pdb_node_t *x, *y;
-
-        pdb_validate(tree);
-        if (z->left == NULL || z->right == NULL) {
-                y = z;
-        } else {
-                y = pdb_successor(z);
-        }
-
-        if (y->left != NULL) {
-                x = y->left;
-        } else {
-                x = y->right;
+        struct pdb_slot *old = db->slots;
+        unsigned old_capacity = db->capacity;
+        struct pdb_slot *slots = calloc(new_capacity, sizeof *slots);
+        if (slots == NULL) {
+                return false;
         }
-
-        if (x != NULL) {
-                x->parent = y->parent;
-        }
-
-        if (y->parent == NULL) {
-                tree->root = x;
-        } else if (y == y->parent->left) {
-                y->parent->left = x;
-        } else {
-                y->parent->right = x;
+        db->slots = slots;
+        db->capacity = new_capacity;
+        db->deleted = 0;
+        for (unsigned i = 0; i < old_capacity; ++i) {
+                if (old[i].state == SLOT_USED) {
+                        *pdb_free_slot(db, old[i].key) = old[i];
+                }
         }
-
-        z->key = y->key;
-        z->data = y->data;
-
-        tree->count--;
-
-        pdb_validate(tree);
-        return y;
+        free(old);
+        return true;
 }
 
 /*****************************************************************************/
 
 struct pdb *pdb_init(volatile int *delay_ms)
 {
-        struct pdb *db = malloc(sizeof(struct pdb));
+        struct pdb *db = calloc(1, sizeof(struct pdb));
         if (db != NULL) {
                 db->magic = PDB_MAGIC;
-                db->count = 0;
-                db->root = NULL;
+                db->capacity = PDB_INITIAL_CAPACITY;
+                db->slots = calloc(db->capacity, sizeof db->slots[0]);
                 db->delay_ms = delay_ms;
+                if (db->slots == NULL) {
+                        free(db);
+                        return NULL;
+                }
         }
         return db;
 }
@@ -258,18 +191,17 @@ void pdb_destroy(struct pdb **db_p)
         struct pdb *db = *db_p;
 
         pdb_validate(db);
-        if (db->root != NULL) {
-                pdb_iter_t it;
-                struct pdb_e *cp = pdb_iter_init(db, &it);
-                while (cp != NULL) {
-                        struct pdb_e *item = NULL;
-                        pdb_remove(db, cp->ssrc, &item);
-                        cp = pdb_iter_next(&it);
-                        pdb_destroy_item(item);
-                }
-                pdb_iter_done(&it);
+        pdb_iter_t it;
+        struct pdb_e *cp = pdb_iter_init(db, &it);
+        while (cp != NULL) {
+                struct pdb_e *item = NULL;
+                pdb_remove(db, cp->ssrc, &item);
+                cp = pdb_iter_next(&it);
+                pdb_destroy_item(item);
         }
+        pdb_iter_done(&it);
 
+        free(db->slots);
         free(db);
         *db_p = NULL;
 }
@@ -301,30 +233,40 @@ int pdb_add(struct pdb *db, uint32_t ssrc)
         /* Add an item to the participant database, indexed by ssrc. */
         /* Returns 0 on success, 1 if the participant is already in  */
         /* the database, 2 for other failures.                       */
-        pdb_node_t *x;
         struct pdb_e *i;
 
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
-        if (x != NULL) {
+        if (pdb_search(db, ssrc) != NULL) {
                 debug_msg("Item already exists - ssrc %x\n", ssrc);
                 return 1;
         }
 
+        // keep load factor below 3/4, but do not rehash under running iterators unless full
+        unsigned load = db->count + db->deleted + 1;
+        if ((load * 4 > db->capacity * 3 && db->iterating == 0) || load >= db->capacity) {
+                unsigned new_capacity = (db->count + 1) * 4 > db->capacity * 2 ? db->capacity * 2 : db->capacity;
+                if (!pdb_rehash(db, new_capacity)) {
+                        debug_msg("Unable to grow database - ssrc %x\n", ssrc);
+                        return 2;
+                }
+        }
+
         i = pdb_create_item(ssrc, db->delay_ms);
         if (i == NULL) {
                 debug_msg("Unable to create database entry - ssrc %x\n", ssrc);
                 return 2;
         }
 
-        x = (pdb_node_t *) malloc(sizeof(pdb_node_t));
-        x->key = ssrc;
-        x->data = i;
-        x->parent = NULL;
-        x->left = NULL;
-        x->right = NULL;
-        x->magic = BTREE_NODE_MAGIC;
-        pdb_insert_node(db, x);
+        struct pdb_slot *slot = pdb_free_slot(db, ssrc);
+        assert(slot != NULL);
+        if (slot->state == SLOT_DELETED) {
+                db->deleted--;
+        }
+        slot->key = ssrc;
+        slot->data = i;
+        slot->state = SLOT_USED;
+        db->count++;
+        pdb_validate(db);
         debug_msg("Added participant %x\n", ssrc);
         return 0;
 }
@@ -333,10 +275,8 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
 {
         /* Return a pointer to the item indexed by ssrc, or NULL if   */
         /* the item is not present in the database.                   */
-        pdb_node_t *x;
-
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
+        struct pdb_slot *x = pdb_search(db, ssrc);
         if (x != NULL) {
                 return x->data;
         }
@@ -346,24 +286,20 @@ struct pdb_e *pdb_get(struct pdb *db, uint32_t ssrc)
 int pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item)
 {
         /* Remove the item indexed by ssrc. Return zero on success.   */
-        pdb_node_t *x;
-
         pdb_validate(db);
-        x = pdb_search(db->root, ssrc);
+        struct pdb_slot *x = pdb_search(db, ssrc);
         if (x == NULL) {
-                debug_msg("Item not on tree - ssrc %ul\n", ssrc);
+                debug_msg("Item not in database - ssrc %ul\n", ssrc);
                 *item = NULL;
                 return 1;
         }
 
-        /* Note value that gets freed is not necessarily the the same as node
-         * that gets removed from tree since there is an optimization to avoid
-         * pointer updates in tree which means sometimes we just copy key and
-         * data from one node to another.  
-         */
         *item = x->data;
-        x = pdb_delete_node(db, x);
-        free(x);
+        x->data = NULL;
+        x->state = SLOT_DELETED;
+        db->count--;
+        db->deleted++;
+        pdb_validate(db);
         return 0;
 }
 
@@ -386,31 +322,41 @@ void pdb_destroy_item(struct pdb_e *item)
         }
 }
 
+
 /* 
  * Iterator functions 
  */
 
-struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
+static struct pdb_e *pdb_iter_find(pdb_iter_t *it)
 {
-        if (db->root == NULL) {
-                return NULL;    /* The database is empty */
+        while (it->idx < it->db->capacity) {
+                if (it->db->slots[it->idx].state == SLOT_USED) {
+                        return it->db->slots[it->idx].data;
+                }
+                it->idx++;
         }
-        *it = (pdb_node_t *) pdb_min(db->root);
-        return ((pdb_node_t *) *it)->data;
+        return NULL;
+}
+
+struct pdb_e *pdb_iter_init(struct pdb *db, pdb_iter_t *it)
+{
+        it->db = db;
+        it->idx = 0;
+        db->iterating++;
+        return pdb_iter_find(it);
 }
 
 struct pdb_e *pdb_iter_next(pdb_iter_t *it)
 {
-        assert(*it != NULL);
-        *it = (pdb_node_t *)pdb_successor((pdb_node_t *)*it);
-        if (*it == NULL) {
-                return NULL;
-        }
-        return ((pdb_node_t *) *it)->data;
+        assert(it->db != NULL);
+        it->idx++;
+        return pdb_iter_find(it);
 }
 
 void pdb_iter_done(pdb_iter_t *it)
 {
-        *it = NULL;
+        if (it->db != NULL) {
+                it->db->iterating--;
+                it->db = NULL;
+        }
 }
-
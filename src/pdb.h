@@ -103,10 +103,14 @@ struct pdb_e        *pdb_get(struct pdb *db, uint32_t ssrc);
 int                  pdb_remove(struct pdb *db, uint32_t ssrc, struct pdb_e **item);
 void                 pdb_destroy_item(struct pdb_e *item);
 
-typedef void *pdb_iter_t;
 /*
- * Iterator for the database.
- */ 
+ * Iterator for the database. Participants may be added or removed while
+ * iterating, every started iteration must be finished with pdb_iter_done().
+ */
+typedef struct {
+        struct pdb *db;
+        unsigned idx;
+} pdb_iter_t;
 struct pdb_e        *pdb_iter_init(struct pdb *db, pdb_iter_t *it);
 struct pdb_e        *pdb_iter_next(pdb_iter_t *it);
 void                 pdb_iter_done(pdb_iter_t *it);
@@ -59,10 +59,12 @@
 #include "config_win32.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include "color.h"
 #include "compat/qsort_s.h"
 #include "debug.h"
+#include "host.h"
 #include "pixfmt_conv.h"
 #include "utils/macros.h" // to_fourcc, OPTIMEZED_FOR, CLAMP
 #include "video_codec.h"
@@ -71,12 +73,37 @@
 #include "tmmintrin.h"
 #endif
 
+#include "utils/simd_lanes.h"
+
 #ifdef WORDS_BIGENDIAN
 #define BYTE_SWAP(x) (3 - x)
 #else
 #define BYTE_SWAP(x) x
 #endif
 
+#if defined __GNUC__
+#define SHIFT_SPECIALIZED_INLINE static inline __attribute__((always_inline))
+#else
+#define SHIFT_SPECIALIZED_INLINE static inline
+#endif
+/**
+ * Defines decoder name() calling the inlined name_shifts() with the shifts
+ * being compile-time constants if the default ones (DEFAULT_RGB_SHIFT_INIT)
+ * are requested, which is almost always. The shifts and alpha mask then fold
+ * to constants and the compiler can vectorize the loop, other shifts use the
+ * generic variant.
+ */
+#define DEFINE_SHIFT_SPECIALIZED_DECODER(name) \
+        void name(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, \
+                        int rshift, int gshift, int bshift) \
+        { \
+                if (rshift == DEFAULT_R_SHIFT && gshift == DEFAULT_G_SHIFT && bshift == DEFAULT_B_SHIFT) { \
+                        name##_shifts(dst, src, dst_len, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT); \
+                } else { \
+                        name##_shifts(dst, src, dst_len, rshift, gshift, bshift); \
+                } \
+        }
+
 /**
  * @brief Converts v210 to UYVY
  * @param[out] dst     4-byte aligned output buffer where UYVY will be stored
@@ -208,8 +235,8 @@ static void vc_copylineYUYV(unsigned char * __restrict dst, const unsigned char
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
+SHIFT_SPECIALIZED_INLINE void
+vc_copyliner10k_shifts(unsigned char * __restrict dst, const unsigned char * __restrict src, int len, int rshift,
                 int gshift, int bshift)
 {
         struct {
@@ -276,6 +303,8 @@ vc_copyliner10k(unsigned char * __restrict dst, const unsigned char * __restrict
         }
 }
 
+static DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copyliner10k)
+
 static void
 vc_copyliner10ktoRG48(unsigned char * __restrict dst, const unsigned char * __restrict src, int dstlen, int rshift,
                 int gshift, int bshift) {
@@ -409,8 +438,8 @@ vc_copylineR12LtoRGB(unsigned char * __restrict dst, const unsigned char * __res
  * @param[in]  gshift  destination green shift
  * @param[in]  bshift  destination blue shift
  */
-static void
-vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
+SHIFT_SPECIALIZED_INLINE void
+vc_copylineR12L_shifts(unsigned char *dst, const unsigned char *src, int dstlen, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -488,6 +517,8 @@ vc_copylineR12L(unsigned char *dst, const unsigned char *src, int dstlen, int rs
         }
 }
 
+static DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copylineR12L)
+
 /**
  * @brief Changes color channels' order in RGBA
  *
@@ -726,7 +757,7 @@ static void vc_copylineRGB(unsigned char * __restrict dst, const unsigned char *
  * In opposite to the defined semantic of {r,g,b}shift, here instead of destination
  * shifts the shifts define the source codec properties.
  */
-static void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
+SHIFT_SPECIALIZED_INLINE void vc_copylineRGBAtoRGBwithShift(unsigned char * __restrict dst2, const unsigned char * __restrict src2, int dst_len, int rshift, int gshift, int bshift)
 {
 	register const uint32_t * src = (const uint32_t *)(const void *) src2;
 	register uint32_t * dst = (uint32_t *)(void *) dst2;
@@ -829,7 +860,7 @@ void vc_copylineUYVYtoGrayscale(unsigned char * __restrict dst, const unsigned c
  * @brief Converts RGB to RGBA
  * @copydetails vc_copyliner10k
  */
-void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+SHIFT_SPECIALIZED_INLINE void vc_copylineRGBtoRGBA_shifts(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         register unsigned int r, g, b;
         register uint32_t *d = (uint32_t *)(void *) dst;
@@ -844,6 +875,8 @@ void vc_copylineRGBtoRGBA(unsigned char * __restrict dst, const unsigned char *
         }
 }
 
+DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copylineRGBtoRGBA)
+
 /**
  * @brief Converts RGB(A) into UYVY
  *
@@ -965,7 +998,7 @@ static void vc_copylineUYVYtoRG48(unsigned char * __restrict dst, const unsigned
  * @param[out] dst     output buffer for RGBA
  * @param[in]  src     input buffer with UYVY
  */
-static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+SHIFT_SPECIALIZED_INLINE void vc_copylineUYVYtoRGBA_shifts(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift) {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
         uint32_t *dst32 = (uint32_t *)(void *) dst;
@@ -993,6 +1026,8 @@ static void vc_copylineUYVYtoRGBA(unsigned char * __restrict dst, const unsigned
         }
 }
 
+static DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copylineUYVYtoRGBA)
+
 /**
  * @brief Converts UYVY to RGB using SSE.
  * Uses Rec. 709 with standard SDI ceiling and floor
@@ -1672,7 +1707,7 @@ static void vc_copylineY416toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineY416toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+SHIFT_SPECIALIZED_INLINE void vc_copylineY416toRGBA_shifts(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) src % 2 == 0);
@@ -1698,6 +1733,8 @@ static void vc_copylineY416toRGBA(unsigned char * __restrict dst, const unsigned
         }
 }
 
+static DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copylineY416toRGBA)
+
 static void vc_copylineRG48toR10k(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
@@ -1735,7 +1772,7 @@ static void vc_copylineRG48toRGB(unsigned char * __restrict dst, const unsigned
         }
 }
 
-static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+SHIFT_SPECIALIZED_INLINE void vc_copylineRG48toRGBA_shifts(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
                 int gshift, int bshift)
 {
         assert((uintptr_t) dst % sizeof(uint32_t) == 0);
@@ -1747,6 +1784,8 @@ static void vc_copylineRG48toRGBA(unsigned char * __restrict dst, const unsigned
         }
 }
 
+static DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copylineRG48toRGBA)
+
 /**
  * @brief Converts RGB to UYVY.
  * @copydetails vc_copylinev210
@@ -2175,8 +2214,8 @@ void vc_memcpy(unsigned char * __restrict dst, const unsigned char * __restrict
  * @brief Converts DPX10 to RGBA
  * @copydetails vc_copyliner10k
  */
-static void
-vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
+SHIFT_SPECIALIZED_INLINE void
+vc_copylineDPX10toRGBA_shifts(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift, int gshift, int bshift)
 {
         
         register const unsigned int *in = (const unsigned int *)(const void *) src;
@@ -2196,6 +2235,8 @@ vc_copylineDPX10toRGBA(unsigned char * __restrict dst, const unsigned char * __r
         }
 }
 
+static DEFINE_SHIFT_SPECIALIZED_DECODER(vc_copylineDPX10toRGBA)
+
 /**
  * @brief Converts DPX10 to RGB.
  * @copydetails vc_copylinev210
@@ -2565,12 +2606,64 @@ static void vc_copylineY416toV210(unsigned char * __restrict dst, const unsigned
         }
 }
 
+#ifdef PIXFMT_SIMD_X86
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_SSE4
+#include "pixfmt_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_AVX2
+#include "pixfmt_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_AVX512
+#include "pixfmt_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#endif // defined PIXFMT_SIMD_X86
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+#define PIXFMT_SIMD_ISA PIXFMT_SIMD_NEON
+#include "pixfmt_conv_simd.h"
+#undef PIXFMT_SIMD_ISA
+#endif // defined PIXFMT_SIMD_NEON_ENABLED
+
 struct decoder_item {
         decoder_t decoder;
         codec_t in;
         codec_t out;
 };
 
+struct simd_decoder_item {
+        decoder_t decoder;
+        codec_t in;
+        codec_t out;
+        const char *impl;
+        bool (*available)(void);
+};
+
+#define SIMD_DECODERS(isa) \
+        { vc_copylinev210_ ## isa,       v210,  UYVY, #isa, isa ## _available }, \
+        { vc_copylineUYVYtoV210_ ## isa, UYVY,  v210, #isa, isa ## _available }, \
+        { vc_copylineV210toY216_ ## isa, v210,  Y216, #isa, isa ## _available }, \
+        { vc_copylineV210toY416_ ## isa, v210,  Y416, #isa, isa ## _available }, \
+        { vc_copylineY216toV210_ ## isa, Y216,  v210, #isa, isa ## _available }, \
+        { vc_copylineY216toUYVY_ ## isa, Y216,  UYVY, #isa, isa ## _available }, \
+        { vc_copylineUYVYtoY216_ ## isa, UYVY,  Y216, #isa, isa ## _available }, \
+        { vc_copyliner10ktoRG48_ ## isa, R10k,  RG48, #isa, isa ## _available }, \
+        { vc_copylineRG48toR10k_ ## isa, RG48,  R10k, #isa, isa ## _available }, \
+        { vc_copylineR12LtoRG48_ ## isa, R12L,  RG48, #isa, isa ## _available }, \
+        { vc_copylineRG48toR12L_ ## isa, RG48,  R12L, #isa, isa ## _available }, \
+        { vc_copylineRGBAtoUYVY_ ## isa, RGBA,  UYVY, #isa, isa ## _available }
+
+/// SIMD variants of decoders, ordered by preference
+static const struct simd_decoder_item simd_decoders[] = {
+#ifdef PIXFMT_SIMD_X86
+        SIMD_DECODERS(avx512),
+        SIMD_DECODERS(avx2),
+        SIMD_DECODERS(sse4),
+#endif
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+        SIMD_DECODERS(neon),
+#endif
+        { NULL, VIDEO_CODEC_NONE, VIDEO_CODEC_NONE, NULL, NULL },
+};
+
 static const struct decoder_item decoders[] = {
         { vc_copylineDVS10,       DVS10, UYVY },
         { vc_copylinev210,        v210,  UYVY },
@@ -2629,17 +2722,40 @@ static const struct decoder_item decoders[] = {
         { vc_copylineV210toY416,  v210,  Y416 },
 };
 
+ADD_TO_PARAM("pixfmt-conv-impl",
+                "* pixfmt-conv-impl=scalar|sse4|avx2|avx512|neon\n"
+                "  Use given implementation of the SIMD-accelerated pixel format conversions\n"
+                "  (default is the best one supported by the CPU).\n");
 /**
  * Returns line decoder for specifiedn input and output codec.
  *
  * If in == out, vc_memcpy is returned.
  */
 decoder_t get_decoder_from_to(codec_t in, codec_t out) {
+        decoder_t ret = get_decoder_from_to_impl(in, out, get_commandline_param("pixfmt-conv-impl"));
+        return ret != NULL ? ret : get_decoder_from_to_impl(in, out, "scalar");
+}
+
+decoder_t get_decoder_from_to_impl(codec_t in, codec_t out, const char *impl)
+{
         if (in == out &&
                         (out != RGBA && out != RGB)) { // vc_copylineRGB[A] may change shift
                 return vc_memcpy;
         }
 
+        const bool any = impl == NULL || strcmp(impl, "auto") == 0;
+        if (impl == NULL || strcmp(impl, "scalar") != 0) {
+                for (const struct simd_decoder_item *it = simd_decoders; it->decoder != NULL; ++it) {
+                        if (it->in == in && it->out == out && (any || strcmp(it->impl, impl) == 0)
+                                        && it->available()) {
+                                return it->decoder;
+                        }
+                }
+                if (!any) {
+                        return NULL;
+                }
+        }
+
         for (unsigned int i = 0; i < sizeof(decoders)/sizeof(struct decoder_item); ++i) {
                 if (decoders[i].in == in && decoders[i].out == out) {
                         return decoders[i].decoder;
@@ -87,6 +87,14 @@ typedef decoder_func_t *decoder_t;
 
 decoder_t        get_decoder_from_to(codec_t in, codec_t out) __attribute__((const));
 decoder_t        get_best_decoder_from(codec_t in, const codec_t *out_candidates, codec_t *out);
+/**
+ * Returns line decoder of given implementation - "scalar", "sse4", "avx2",
+ * "avx512" or "neon", NULL or "auto" selects the best one supported by the
+ * CPU (falling back to scalar).
+ *
+ * @retval NULL the conversion is not available in given implementation
+ */
+decoder_t        get_decoder_from_to_impl(codec_t in, codec_t out, const char *impl);
 
 decoder_func_t vc_copylineRGBA;
 decoder_func_t vc_copylineToRGBA_inplace;
@@ -0,0 +1,401 @@
+/**
+ * @file   pixfmt_conv_simd.h
+ * @brief  SIMD implementations of selected line converters (pixfmt_conv.c internal)
+ *
+ * The file is included by pixfmt_conv.c once for every instruction set with
+ * PIXFMT_SIMD_ISA set to one of PIXFMT_SIMD_{SSE4,AVX2,AVX512,NEON}. The
+ * kernels are written in terms of lane-local operations over 128-bit lanes
+ * (utils/simd_lanes.h),
+ * so that the same code serves 1, 2 or 4 lanes. Every lane converts its own
+ * block of pixels, which is loaded from and stored to the line at (lane
+ * index * block size).
+ *
+ * The end of the line (at least 16 B and one block of the scalar converter)
+ * is converted by the scalar function - loads and stores of a lane may exceed
+ * its block by a few bytes. The output is thus always identical to the scalar
+ * one.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PIXFMT_CONV_SIMD_COMMON
+#define PIXFMT_CONV_SIMD_COMMON
+#define Z 0x80 // shuffle index producing zero byte (both PSHUFB and TBL)
+
+/**
+ * @returns number of lanes to be processed by SIMD (multiple of vec_lanes * group_lanes)
+ *
+ * At least one scalar block (and 16 B) is left to the scalar converter, which
+ * thus overwrites bytes that the last lane stored past its block.
+ *
+ * @param out_lane    bytes written by one lane
+ * @param group_lanes number of lanes forming a block of the scalar converter
+ */
+static int simd_lane_count(int dst_len, int out_lane, int group_lanes, int vec_lanes)
+{
+        const int slack = MAX(16, out_lane * group_lanes);
+        if (dst_len <= slack) {
+                return 0;
+        }
+        const int step = vec_lanes * group_lanes;
+        int lanes = (dst_len - slack) / out_lane;
+        return lanes - lanes % step;
+}
+
+/// shuffle indices fetching the 16-bit window containing 10-bit field of v210
+static const uint8_t v210_y216_a[16] = { 1, 2, 0, 1, 4, 5, 2, 3, 6, 7, 5, 6, 9, 10, 8, 9 };
+static const uint8_t v210_y216_b[16] = { 12, 13, 10, 11, 14, 15, 13, 14, Z, Z, Z, Z, Z, Z, Z, Z };
+/// masks selecting 16-bit lanes whose field is at bit 0, 10 and 20 of the v210 word
+static const uint16_t v210_y216_a_s0[8] = { 0, 0xFFC0, 0xFFC0, 0, 0, 0, 0, 0xFFC0 };
+static const uint16_t v210_y216_a_s1[8] = { 0xFFC0, 0, 0, 0, 0, 0xFFC0, 0xFFC0, 0 };
+static const uint16_t v210_y216_a_s2[8] = { 0, 0, 0, 0xFFC0, 0xFFC0, 0, 0, 0 };
+static const uint16_t v210_y216_b_s0[8] = { 0xFFC0, 0, 0, 0, 0, 0, 0, 0 };
+static const uint16_t v210_y216_b_s1[8] = { 0, 0, 0, 0xFFC0, 0, 0, 0, 0 };
+static const uint16_t v210_y216_b_s2[8] = { 0, 0xFFC0, 0xFFC0, 0, 0, 0, 0, 0 };
+
+static const uint8_t v210_y416[3][16] = {
+        { 0, 1, 1, 2, 2, 3, Z, Z, 0, 1, 4, 5, 2, 3, Z, Z },
+        { 5, 6, 6, 7, 8, 9, Z, Z, 5, 6, 9, 10, 8, 9, Z, Z },
+        { 10, 11, 12, 13, 13, 14, Z, Z, 10, 11, 14, 15, 13, 14, Z, Z },
+};
+static const uint16_t v210_y416_s0[3][8] = {
+        { 0xFFC0, 0, 0, 0, 0xFFC0, 0xFFC0, 0, 0 },
+        { 0, 0, 0xFFC0, 0, 0, 0, 0xFFC0, 0 },
+        { 0, 0xFFC0, 0, 0, 0, 0, 0, 0 },
+};
+static const uint16_t v210_y416_s1[3][8] = {
+        { 0, 0xFFC0, 0, 0, 0, 0, 0, 0 },
+        { 0xFFC0, 0, 0, 0, 0xFFC0, 0xFFC0, 0, 0 },
+        { 0, 0, 0xFFC0, 0, 0, 0, 0xFFC0, 0 },
+};
+static const uint16_t v210_y416_s2[3][8] = {
+        { 0, 0, 0xFFC0, 0, 0, 0, 0xFFC0, 0 },
+        { 0, 0xFFC0, 0, 0, 0, 0, 0, 0 },
+        { 0xFFC0, 0, 0, 0, 0xFFC0, 0xFFC0, 0, 0 },
+};
+static const uint16_t y416_alpha[8] = { 0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF };
+
+/// Y216 (2 chunks - bytes 0-15 and 8-23) to v210 fields at 3 positions of a word
+static const uint8_t y216_v210[3][2][16] = {
+        { { 2, 3, Z, Z, 4, 5, Z, Z, 14, 15, Z, Z, Z, Z, Z, Z }, { Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 8, 9, Z, Z } },
+        { { 0, 1, Z, Z, 10, 11, Z, Z, 12, 13, Z, Z, Z, Z, Z, Z }, { Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 14, 15, Z, Z } },
+        { { 6, 7, Z, Z, 8, 9, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z }, { Z, Z, Z, Z, Z, Z, Z, Z, 10, 11, Z, Z, 12, 13, Z, Z } },
+};
+static const uint8_t r10k_rg48_a[16] = { 1, 0, 2, 1, 3, 2, 5, 4, 6, 5, 7, 6, 9, 8, 10, 9 };
+static const uint8_t r10k_rg48_b[16] = { 11, 10, 13, 12, 14, 13, 15, 14, Z, Z, Z, Z, Z, Z, Z, Z };
+/// masks of 16-bit lanes with R, G and B windows
+static const uint16_t r10k_rg48_a_r[8] = { 0xFFC0, 0, 0, 0xFFC0, 0, 0, 0xFFC0, 0 };
+static const uint16_t r10k_rg48_a_g[8] = { 0, 0xFFC0, 0, 0, 0xFFC0, 0, 0, 0xFFC0 };
+static const uint16_t r10k_rg48_a_b[8] = { 0, 0, 0xFFC0, 0, 0, 0xFFC0, 0, 0 };
+static const uint16_t r10k_rg48_b_r[8] = { 0, 0xFFC0, 0, 0, 0, 0, 0, 0 };
+static const uint16_t r10k_rg48_b_g[8] = { 0, 0, 0xFFC0, 0, 0, 0, 0, 0 };
+static const uint16_t r10k_rg48_b_b[8] = { 0xFFC0, 0, 0, 0xFFC0, 0, 0, 0, 0 };
+
+/// RG48 (2 chunks of 2 pixels) to words G|R<<16 and B
+static const uint8_t rg48_r10k_gr[2][16] = {
+        { 2, 3, 0, 1, 8, 9, 6, 7, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 2, 3, 0, 1, 8, 9, 6, 7 },
+};
+static const uint8_t rg48_r10k_b[2][16] = {
+        { 4, 5, Z, Z, 10, 11, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 4, 5, Z, Z, 10, 11, Z, Z },
+};
+static const uint8_t bswap32[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+
+static const uint8_t compact_3of4[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, Z, Z, Z, Z };
+static const uint8_t expand_3to4[16] = { 0, 1, 2, Z, 3, 4, 5, Z, 6, 7, 8, Z, 9, 10, 11, Z };
+
+static const uint8_t y216_uyvy[2][16] = {
+        { 3, 1, 7, 5, 11, 9, 15, 13, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 3, 1, 7, 5, 11, 9, 15, 13 },
+};
+static const uint8_t uyvy_y216[2][16] = {
+        { Z, 1, Z, 0, Z, 3, Z, 2, Z, 5, Z, 4, Z, 7, Z, 6 },
+        { Z, 9, Z, 8, Z, 11, Z, 10, Z, 13, Z, 12, Z, 15, Z, 14 },
+};
+/// bytes Y, U, V of pixel dwords to UYVY
+static const uint8_t yuv_uyvy[2][16] = {
+        { 1, 0, 2, 4, 9, 8, 10, 12, Z, Z, Z, Z, Z, Z, Z, Z },
+        { Z, Z, Z, Z, Z, Z, Z, Z, 1, 0, 2, 4, 9, 8, 10, 12 },
+};
+#undef Z
+#endif // !defined PIXFMT_CONV_SIMD_COMMON
+
+#include "utils/simd_lanes.h"
+
+/// prologue of the kernel - lane_out is a number of bytes one lane writes
+#define SIMD_KERNEL_BEGIN(lane_in, lane_out, group_lanes) \
+        const int lanes = simd_lane_count(dst_len, lane_out, group_lanes, V_LANES); \
+        const unsigned char *s = src; \
+        unsigned char *d = dst; \
+        for (int l = 0; l < lanes; l += V_LANES, s += V_LANES * (lane_in), d += V_LANES * (lane_out)) {
+/// converts the rest with the scalar converter
+#define SIMD_KERNEL_END(lane_in, lane_out, scalar) \
+        } \
+        scalar(d, s, dst_len - lanes * (lane_out), rshift, gshift, bshift);
+
+/// the 10-bit fields selected by windows w (16-bit) shifted at bit 0, 10 or 20 of the word to 16 MSBs
+#define V_UNPACK10(w, s0, s1, s2) V_OR(V_OR(V_AND(V_SLLI16(w, 6), s0), V_AND(V_SLLI16(w, 4), s1)), \
+                V_AND(V_SLLI16(w, 2), s2))
+/// packs 16-bit values in 32-bit lanes (MSB aligned, zero extended) of a, b and c to v210 word
+#define V_PACK10(a, b, c) V_OR(V_OR(V_SRLI32(a, 6), V_SLLI32(V_SRLI32(b, 6), 10)), \
+                V_SLLI32(V_SRLI32(c, 6), 20))
+
+SIMD_FUNC void SIMD_FN(vc_copylinev210)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC m0 = V_SET1_32(0xFF);
+        const VEC m1 = V_SET1_32(0xFF00);
+        const VEC m2 = V_SET1_32(0xFF0000);
+        const VEC compact = V_CONST(compact_3of4);
+        SIMD_KERNEL_BEGIN(16, 12, 1)
+                VEC x = V_LOAD(s, 16);
+                VEC t = V_OR(V_OR(V_AND(V_SRLI32(x, 2), m0), V_AND(V_SRLI32(x, 4), m1)), V_AND(V_SRLI32(x, 6), m2));
+                V_STORE_LANES(d, 12, V_SHUF(t, compact));
+        SIMD_KERNEL_END(16, 12, vc_copylinev210)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineUYVYtoV210)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC m0 = V_SET1_32(0x3FC);
+        const VEC m1 = V_SET1_32(0xFF000);
+        const VEC m2 = V_SET1_32(0x3FC00000);
+        const VEC expand = V_CONST(expand_3to4);
+        SIMD_KERNEL_BEGIN(12, 16, 1)
+                VEC x = V_SHUF(V_LOAD(s, 12), expand);
+                x = V_OR(V_OR(V_AND(V_SLLI32(x, 2), m0), V_AND(V_SLLI32(x, 4), m1)), V_AND(V_SLLI32(x, 6), m2));
+                V_STORE_LANES(d, 16, x);
+        SIMD_KERNEL_END(12, 16, vc_copylineUYVYtoV210)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineV210toY216)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC sh_a = V_CONST(v210_y216_a);
+        const VEC sh_b = V_CONST(v210_y216_b);
+        const VEC a_s0 = V_CONST(v210_y216_a_s0);
+        const VEC a_s1 = V_CONST(v210_y216_a_s1);
+        const VEC a_s2 = V_CONST(v210_y216_a_s2);
+        const VEC b_s0 = V_CONST(v210_y216_b_s0);
+        const VEC b_s1 = V_CONST(v210_y216_b_s1);
+        const VEC b_s2 = V_CONST(v210_y216_b_s2);
+        SIMD_KERNEL_BEGIN(16, 24, 1)
+                VEC x = V_LOAD(s, 16);
+                VEC a = V_SHUF(x, sh_a);
+                VEC b = V_SHUF(x, sh_b);
+                a = V_UNPACK10(a, a_s0, a_s1, a_s2);
+                b = V_UNPACK10(b, b_s0, b_s1, b_s2);
+                for (int k = 0; k < V_LANES; ++k) { // b overlaps next lane
+                        SIMD_FN(store_lane)(d + k * 24, a, k);
+                        SIMD_FN(store_lane)(d + k * 24 + 16, b, k);
+                }
+        SIMD_KERNEL_END(16, 24, vc_copylineV210toY216)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineV210toY416)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        VEC sh[3], s0[3], s1[3], s2[3];
+        for (int i = 0; i < 3; ++i) {
+                sh[i] = V_CONST(v210_y416[i]);
+                s0[i] = V_CONST(v210_y416_s0[i]);
+                s1[i] = V_CONST(v210_y416_s1[i]);
+                s2[i] = V_CONST(v210_y416_s2[i]);
+        }
+        const VEC alpha = V_CONST(y416_alpha);
+        SIMD_KERNEL_BEGIN(16, 48, 1)
+                VEC x = V_LOAD(s, 16);
+                for (int i = 0; i < 3; ++i) {
+                        VEC w = V_SHUF(x, sh[i]);
+                        w = V_OR(V_UNPACK10(w, s0[i], s1[i], s2[i]), alpha);
+                        V_STORE_LANES(d + 16 * i, 48, w);
+                }
+        SIMD_KERNEL_END(16, 48, vc_copylineV210toY416)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineY216toV210)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        VEC sh[3][2];
+        for (int i = 0; i < 3; ++i) {
+                sh[i][0] = V_CONST(y216_v210[i][0]);
+                sh[i][1] = V_CONST(y216_v210[i][1]);
+        }
+        SIMD_KERNEL_BEGIN(24, 16, 1)
+                VEC c0 = V_LOAD(s, 24);
+                VEC c1 = V_LOAD(s + 8, 24);
+                VEC f[3];
+                for (int i = 0; i < 3; ++i) {
+                        f[i] = V_OR(V_SHUF(c0, sh[i][0]), V_SHUF(c1, sh[i][1]));
+                }
+                V_STORE_LANES(d, 16, V_PACK10(f[0], f[1], f[2]));
+        SIMD_KERNEL_END(24, 16, vc_copylineY216toV210)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineY216toUYVY)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC sh0 = V_CONST(y216_uyvy[0]);
+        const VEC sh1 = V_CONST(y216_uyvy[1]);
+        SIMD_KERNEL_BEGIN(32, 16, 1)
+                VEC x = V_OR(V_SHUF(V_LOAD(s, 32), sh0), V_SHUF(V_LOAD(s + 16, 32), sh1));
+                V_STORE_LANES(d, 16, x);
+        SIMD_KERNEL_END(32, 16, vc_copylineY216toUYVY)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineUYVYtoY216)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC sh0 = V_CONST(uyvy_y216[0]);
+        const VEC sh1 = V_CONST(uyvy_y216[1]);
+        SIMD_KERNEL_BEGIN(16, 32, 1)
+                VEC x = V_LOAD(s, 16);
+                V_STORE_LANES(d, 32, V_SHUF(x, sh0));
+                V_STORE_LANES(d + 16, 32, V_SHUF(x, sh1));
+        SIMD_KERNEL_END(16, 32, vc_copylineUYVYtoY216)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copyliner10ktoRG48)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC sh_a = V_CONST(r10k_rg48_a);
+        const VEC sh_b = V_CONST(r10k_rg48_b);
+        const VEC a_r = V_CONST(r10k_rg48_a_r);
+        const VEC a_g = V_CONST(r10k_rg48_a_g);
+        const VEC a_b = V_CONST(r10k_rg48_a_b);
+        const VEC b_r = V_CONST(r10k_rg48_b_r);
+        const VEC b_g = V_CONST(r10k_rg48_b_g);
+        const VEC b_b = V_CONST(r10k_rg48_b_b);
+        SIMD_KERNEL_BEGIN(16, 24, 1)
+                VEC x = V_LOAD(s, 16);
+                // big-endian 10-bit R, G, B at bits 22, 12, 2 - windows with the value shifted by 6, 4, 2
+                VEC a = V_SHUF(x, sh_a);
+                VEC b = V_SHUF(x, sh_b);
+                a = V_OR(V_OR(V_AND(a, a_r), V_AND(V_SLLI16(a, 2), a_g)), V_AND(V_SLLI16(a, 4), a_b));
+                b = V_OR(V_OR(V_AND(b, b_r), V_AND(V_SLLI16(b, 2), b_g)), V_AND(V_SLLI16(b, 4), b_b));
+                for (int k = 0; k < V_LANES; ++k) { // b overlaps next lane
+                        SIMD_FN(store_lane)(d + k * 24, a, k);
+                        SIMD_FN(store_lane)(d + k * 24 + 16, b, k);
+                }
+        SIMD_KERNEL_END(16, 24, vc_copyliner10ktoRG48)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineRG48toR10k)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC gr0 = V_CONST(rg48_r10k_gr[0]);
+        const VEC gr1 = V_CONST(rg48_r10k_gr[1]);
+        const VEC b0 = V_CONST(rg48_r10k_b[0]);
+        const VEC b1 = V_CONST(rg48_r10k_b[1]);
+        const VEC bswap = V_CONST(bswap32);
+        const VEC m_r = V_SET1_32((int) 0xFFC00000U);
+        const VEC m_gb = V_SET1_32(0xFFC0);
+        const VEC pad = V_SET1_32(0x3);
+        SIMD_KERNEL_BEGIN(24, 16, 1)
+                VEC c0 = V_LOAD(s, 24);
+                VEC c1 = V_LOAD(s + 12, 24);
+                VEC gr = V_OR(V_SHUF(c0, gr0), V_SHUF(c1, gr1));
+                VEC b = V_OR(V_SHUF(c0, b0), V_SHUF(c1, b1));
+                VEC w = V_OR(V_OR(V_AND(gr, m_r), V_SLLI32(V_AND(gr, m_gb), 6)), V_OR(V_SRLI32(V_AND(b, m_gb), 4), pad));
+                V_STORE_LANES(d, 16, V_SHUF(w, bswap));
+        SIMD_KERNEL_END(24, 16, vc_copylineRG48toR10k)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineR12LtoRG48)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC expand = V_CONST(expand_3to4);
+        const VEC m_lo = V_SET1_32(0xFFF0);
+        const VEC m_hi = V_SET1_32((int) 0xFFF00000U);
+        SIMD_KERNEL_BEGIN(12, 16, 3)
+                // 24 bits of two consecutive 12-bit values per 32-bit lane
+                VEC x = V_SHUF(V_LOAD(s, 12), expand);
+                x = V_OR(V_AND(V_SLLI32(x, 4), m_lo), V_AND(V_SLLI32(x, 8), m_hi));
+                V_STORE_LANES(d, 16, x);
+        SIMD_KERNEL_END(12, 16, vc_copylineR12LtoRG48)
+}
+
+SIMD_FUNC void SIMD_FN(vc_copylineRG48toR12L)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC compact = V_CONST(compact_3of4);
+        const VEC m_lo = V_SET1_32(0xFFF);
+        const VEC m_hi = V_SET1_32(0xFFF000);
+        SIMD_KERNEL_BEGIN(16, 12, 3)
+                VEC x = V_LOAD(s, 16);
+                x = V_OR(V_AND(V_SRLI32(x, 4), m_lo), V_AND(V_SRLI32(x, 8), m_hi));
+                V_STORE_LANES(d, 12, V_SHUF(x, compact));
+        SIMD_KERNEL_END(16, 12, vc_copylineRG48toR12L)
+}
+
+/// @sa vc_copylineToUYVY709 - computes the same in 32-bit lanes (pixel per lane)
+SIMD_FUNC void SIMD_FN(vc_copylineRGBAtoUYVY)(unsigned char * __restrict dst, const unsigned char * __restrict src, int dst_len, int rshift,
+                int gshift, int bshift)
+{
+        const VEC m8 = V_SET1_32(0xFF);
+        const VEC y_r = V_SET1_32(11993), y_g = V_SET1_32(40239), y_b = V_SET1_32(4063), y_off = V_SET1_32(1 << 20);
+        const VEC u_r = V_SET1_32(-6619), u_g = V_SET1_32(-22151), u_b = V_SET1_32(28770);
+        const VEC v_r = V_SET1_32(28770), v_g = V_SET1_32(-26149), v_b = V_SET1_32(-2621);
+        const VEC uv_off = V_SET1_32(1 << 23);
+        const VEC zero = V_SET1_32(0);
+        const VEC max = V_SET1_32((1 << 24) - 1);
+        const VEC sh0 = V_CONST(yuv_uyvy[0]);
+        const VEC sh1 = V_CONST(yuv_uyvy[1]);
+        SIMD_KERNEL_BEGIN(32, 16, 1)
+                VEC out[2];
+                for (int j = 0; j < 2; ++j) {
+                        VEC x = V_LOAD(s + 16 * j, 32);
+                        VEC r = V_AND(x, m8);
+                        VEC g = V_AND(V_SRLI32(x, 8), m8);
+                        VEC b = V_AND(V_SRLI32(x, 16), m8);
+                        VEC y = V_ADD32(V_ADD32(V_MULLO32(r, y_r), V_MULLO32(g, y_g)), V_ADD32(V_MULLO32(b, y_b), y_off));
+                        VEC u = V_ADD32(V_ADD32(V_MULLO32(r, u_r), V_MULLO32(g, u_g)), V_MULLO32(b, u_b));
+                        VEC v = V_ADD32(V_ADD32(V_MULLO32(r, v_r), V_MULLO32(g, v_g)), V_MULLO32(b, v_b));
+                        // sum of the pixel pair divided by 2 (rounding toward zero as in C)
+                        u = V_ADD32(u, V_SWAP32(u));
+                        v = V_ADD32(v, V_SWAP32(v));
+                        u = V_ADD32(V_SRAI32(V_ADD32(u, V_SRLI32(u, 31)), 1), uv_off);
+                        v = V_ADD32(V_SRAI32(V_ADD32(v, V_SRLI32(v, 31)), 1), uv_off);
+                        y = V_SRLI32(V_MIN32(V_MAX32(y, zero), max), 16);
+                        u = V_SRLI32(V_MIN32(V_MAX32(u, zero), max), 16);
+                        v = V_SRLI32(V_MIN32(V_MAX32(v, zero), max), 16);
+                        out[j] = V_OR(V_OR(y, V_SLLI32(u, 8)), V_SLLI32(v, 16));
+                }
+                V_STORE_LANES(d, 16, V_OR(V_SHUF(out[0], sh0), V_SHUF(out[1], sh1)));
+        SIMD_KERNEL_END(32, 16, vc_copylineRGBAtoUYVY)
+}
+
+#define SIMD_LANES_UNDEF
+#include "utils/simd_lanes.h"
+#undef SIMD_LANES_UNDEF
@@ -229,6 +229,9 @@ struct state_audio_decoder {
 
         audio_frame2 resample_remainder;
         std::atomic_uint64_t req_resample_to{0}; // hi 32 - numerator; lo 32 - denominator
+
+        vector<audio_mix_route> mix_routes; ///< decoded->output channel mapping (kept to avoid reallocations)
+        vector<const char *> mix_inputs;
 };
 
 constexpr double VOL_UP = 1.1;
@@ -643,6 +646,7 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 // (it is maximal substream number + 1 in packet with m-bit)
                 return FALSE;
         }
+        const uint32_t rtp_ts = cdata->data->ts;
 
         DEBUG_TIMER_START(audio_decode);
         audio_frame2 received_frame;
@@ -806,39 +810,44 @@ int decode_audio_frame(struct coded_data *cdata, void *pbuf_data, struct pbuf_st
                 decompressed.change_bps(s->buffer.bps);
         }
 
+        if (s->buffer.data_len == 0) {
+                s->rtp_ts = rtp_ts;
+        }
         size_t new_data_len = s->buffer.data_len + decompressed.get_data_len(0) * s->buffer.ch_count;
         if ((size_t) s->buffer.max_size < new_data_len) {
                 s->buffer.max_size = new_data_len;
                 s->buffer.data = (char *) realloc(s->buffer.data, new_data_len);
         }
 
-        memset(s->buffer.data + s->buffer.data_len, 0, new_data_len - s->buffer.data_len);
-
-        if (!decoder->muted) {
-                // there is a mapping for channel
+        if (decoder->muted) {
+                memset(s->buffer.data + s->buffer.data_len, 0, new_data_len - s->buffer.data_len);
+        } else {
+                // remap, scale and interleave all channels in one pass over the output
+                decoder->mix_routes.clear();
+                decoder->mix_inputs.resize(decompressed.get_channel_count());
                 for(int channel = 0; channel < decompressed.get_channel_count(); ++channel) {
+                        decoder->mix_inputs[channel] = decompressed.get_data(channel);
                         if(decoder->channel_remapping) {
                                 if(channel < decoder->channel_map.size) {
                                         for(int i = 0; i < decoder->channel_map.sizes[channel]; ++i) {
                                                 int new_position = decoder->channel_map.map[channel][i];
                                                 if (new_position >= s->buffer.ch_count)
                                                         continue;
-                                                mux_and_mix_channel(s->buffer.data + s->buffer.data_len,
-                                                                decompressed.get_data(channel),
-                                                                decompressed.get_bps(), decompressed.get_data_len(channel),
-                                                                s->buffer.ch_count, new_position,
-                                                                decoder->scale.at(decoder->fixed_scale ? 0 : new_position).scale);
+                                                decoder->mix_routes.push_back({ channel, new_position,
+                                                                decoder->scale.at(decoder->fixed_scale ? 0 : new_position).scale });
                                         }
                                 }
                         } else {
                                 if (channel >= s->buffer.ch_count)
                                         continue;
-                                mux_and_mix_channel(s->buffer.data + s->buffer.data_len, decompressed.get_data(channel),
-                                                decompressed.get_bps(),
-                                                decompressed.get_data_len(channel), s->buffer.ch_count, channel,
-                                                decoder->scale.at(decoder->fixed_scale ? 0 : input_channels).scale);
+                                decoder->mix_routes.push_back({ channel, channel,
+                                                decoder->scale.at(decoder->fixed_scale ? 0 : input_channels).scale });
                         }
                 }
+                mix_channels_interleaved(s->buffer.data + s->buffer.data_len, s->buffer.ch_count,
+                                decoder->mix_inputs.data(), s->buffer.bps,
+                                decompressed.get_data_len(0) / s->buffer.bps,
+                                decoder->mix_routes.data(), decoder->mix_routes.size());
         }
         s->buffer.data_len = new_data_len;
 
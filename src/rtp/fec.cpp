@@ -48,6 +48,7 @@
 #include "debug.h"
 #include "rtp/fec.h"
 #include "rtp/ldgm.h"
+#include "rtp/rlc.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "ug_runtime_error.hpp"
@@ -55,29 +56,53 @@
 
 using namespace std;
 
+/// parses "LDGM percents <mtu_len> <data_len> <loss_pct>" config
+static void parse_ldgm_percents(const char *c_str, int *mtu_len, int *data_len, double *loss_pct)
+{
+        char *str = strdup(c_str);
+        char *ptr = str + strlen("LDGM percents ");
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        item = strtok_r(ptr, " ", &save_ptr);
+        assert (item != nullptr);
+        *mtu_len = stoi(item);
+        assert(*mtu_len > 0);
+        item = strtok_r(nullptr, " ", &save_ptr);
+        assert (item != nullptr);
+        *data_len = stoi(item);
+        assert(*data_len > 0);
+        item = strtok_r(nullptr, " ", &save_ptr);
+        assert (item != nullptr);
+        *loss_pct = stof(item);
+        assert(*loss_pct > 0.0);
+        free(str);
+}
+
+bool fec::prepare_config(const char *c_str) noexcept
+{
+        if (strncmp(c_str, "LDGM percents ", strlen("LDGM percents ")) != 0) {
+                return true;
+        }
+        try {
+                int mtu_len = 0;
+                int data_len = 0;
+                double loss_pct = 0.0;
+                parse_ldgm_percents(c_str, &mtu_len, &data_len, &loss_pct);
+                return ldgm::prepare(mtu_len, data_len, loss_pct);
+        } catch (...) {
+                return true; // let create_from_config() report the error
+        }
+}
+
 fec *fec::create_from_config(const char *c_str) noexcept
 {
         try {
                 if (strncmp(c_str, "LDGM percents ", strlen("LDGM percents ")) == 0) {
-                        char *str = strdup(c_str);
-                        char *ptr = str + strlen("LDGM percents ");
-                        char *save_ptr = nullptr;
-                        char *item = nullptr;
-                        item = strtok_r(ptr, " ", &save_ptr);
-                        assert (item != nullptr);
-                        int mtu_len = stoi(item);
-                        assert(mtu_len > 0);
-                        item = strtok_r(nullptr, " ", &save_ptr);
-                        assert (item != nullptr);
-                        int data_len = stoi(item);
-                        assert(data_len > 0);
-                        item = strtok_r(nullptr, " ", &save_ptr);
-                        assert (item != nullptr);
-                        double loss_pct = stof(item);
-                        assert(loss_pct > 0.0);
-                        fec *ret = new ldgm(mtu_len, data_len, loss_pct);
-                        free(str);
-                        return ret;
+                        int mtu_len = 0;
+                        int data_len = 0;
+                        double loss_pct = 0.0;
+                        parse_ldgm_percents(c_str, &mtu_len, &data_len, &loss_pct);
+                        return new ldgm(mtu_len, data_len, loss_pct);
                 }
                 if (strncmp(c_str, "LDGM cfg ", strlen("LDGM cfg ")) == 0) {
                         return new ldgm(c_str + strlen("LDGM cfg "));
@@ -85,6 +110,9 @@ fec *fec::create_from_config(const char *c_str) noexcept
                 if (strncmp(c_str, "RS cfg ", strlen("RS cfg ")) == 0) {
                         return new rs(c_str + strlen("rs cfg "));
                 }
+                if (strncmp(c_str, "RLC cfg ", strlen("RLC cfg ")) == 0) {
+                        return new rlc(c_str + strlen("RLC cfg "));
+                }
                 throw ug_runtime_error("Unrecognized FEC configuration!");
         } catch (string const &s) {
                 LOG(LOG_LEVEL_ERROR) << s << "\n";
@@ -108,6 +136,8 @@ fec *fec::create_from_desc(struct fec_desc desc) noexcept
                                 return new ldgm(desc.k, desc.m, desc.c, desc.seed);
                         case FEC_RS:
                                 return new rs(desc.k, desc.k + desc.m);
+                        case FEC_RLC:
+                                return new rlc(desc.k, desc.m, desc.c, desc.seed);
                         default:
                                 abort();
                 }
@@ -136,6 +166,8 @@ int fec::pt_from_fec_type(enum tx_media_type media_type, enum fec_type fec_type,
                         return encrypted ? PT_ENCRYPT_VIDEO_LDGM : PT_VIDEO_LDGM;
                 case FEC_RS:
                         return encrypted ? PT_ENCRYPT_VIDEO_RS : PT_VIDEO_RS;
+                case FEC_RLC:
+                        return encrypted ? PT_ENCRYPT_VIDEO_RLC : PT_VIDEO_RLC;
                 default: break;
                 }
         } else {
@@ -162,6 +194,9 @@ enum fec_type fec::fec_type_from_pt(int pt) throw()
         case PT_VIDEO_RS:
         case PT_ENCRYPT_VIDEO_RS:
                 return FEC_RS;
+        case PT_VIDEO_RLC:
+        case PT_ENCRYPT_VIDEO_RLC:
+                return FEC_RLC;
         default:
                 abort();
         }
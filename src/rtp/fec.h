@@ -40,6 +40,7 @@
 
 #include "audio/types.h"
 #include "types.h"
+#include "rtp/received_ranges.h"
 
 #ifdef __cplusplus
 #include <map>
@@ -62,9 +63,27 @@ struct fec {
          */
         virtual bool decode(char *in, int in_len, char **out, int *out_len,
                         const std::map<int, int> &) = 0;
+        /**
+         * Variant of decode() taking received ranges (used by video decoder).
+         * Default implementation converts ranges to a map.
+         */
+        virtual bool decode(char *in, int in_len, char **out, int *out_len,
+                        const received_ranges &r) {
+                return decode(in, in_len, out, out_len, r.to_map());
+        }
+        /// @returns true if decode() may be called concurrently for distinct buffers
+        virtual bool thread_safe_decode() const {
+                return false;
+        }
         virtual ~fec() {}
 
         static fec *create_from_config(const char *str) noexcept;
+        /**
+         * Starts preparation of the state for create_from_config() in
+         * background if it would be lengthy (LDGM matrix generation).
+         * @returns true if create_from_config() can be called without blocking
+         */
+        static bool prepare_config(const char *str) noexcept;
         static fec *create_from_desc(struct fec_desc) noexcept;
         static int pt_from_fec_type(enum tx_media_type media_type, enum fec_type fec_type, bool encrypted) throw();
         static enum fec_type fec_type_from_pt(int pt) throw();
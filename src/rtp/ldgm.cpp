@@ -49,11 +49,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <unistd.h>
 #include <sys/types.h>
 
+#include <condition_variable>
 #include <limits>
+#include <list>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
 
 #include "debug.h"
 #include "host.h"
@@ -69,6 +74,8 @@
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
+#include "utils/misc.h" // get_cpu_core_count
+#include "utils/worker.h"
 #include "video.h"
 
 using namespace std;
@@ -138,20 +145,116 @@ const configuration_t suggested_configurations[] = {
 #define MIN_C 2 // reasonable minimum
 #define MAX_C 63 // from packet format
 #define MAX_K (1<<13) - 1
+#define MIN_PARITY_RANGE 16 ///< minimal count of parity symbols encoded by one worker
+
+#define MATRIX_CACHE_SIZE 8 ///< parity matrices kept in memory
 
-static bool file_exists(char *filename);
 static void usage(void);
 
-static bool file_exists(char *filename)
-{
-        struct stat sb;
-        if (stat(filename, &sb)) {
-                perror("stat");
+namespace {
+/// compact parity matrix as produced by generate_ldgm_pcm()
+struct ldgm_matrix {
+        unique_ptr<int, void (*)(void *)> pcm{nullptr, free};
+        unsigned int m;
+        int columns;
+};
+
+using ldgm_matrix_key = tuple<unsigned int, unsigned int, unsigned int, unsigned int>; ///< k, m, c, seed
+
+/**
+ * In-process LRU cache of the generated parity matrices. The matrices are
+ * generated in memory (no files are written or read) either synchronously
+ * by get() or in background by prefetch() so that the data path doesn't
+ * stall while the parameters are being changed.
+ */
+class ldgm_matrix_cache {
+public:
+        static ldgm_matrix_cache &get_instance() {
+                // not destroyed - background generation may still be running at exit
+                static auto *instance = new ldgm_matrix_cache;
+                return *instance;
+        }
+
+        /// @returns the matrix, generated if not cached (waits for a running background generation)
+        shared_ptr<const ldgm_matrix> get(ldgm_matrix_key key) {
+                unique_lock<mutex> lk(m_lock);
+                m_cv.wait(lk, [&]{ return m_pending.count(key) == 0; });
+                if (auto ret = find(key)) {
+                        return ret;
+                }
+                m_pending.insert(key);
+                lk.unlock();
+                auto ret = generate(key);
+                lk.lock();
+                finish(key, ret);
+                return ret;
+        }
+
+        /// starts generation in background if the matrix is not cached
+        /// @returns true if the matrix is ready
+        bool prefetch(ldgm_matrix_key key) {
+                lock_guard<mutex> lk(m_lock);
+                if (find(key)) {
+                        return true;
+                }
+                if (m_pending.count(key) == 0) {
+                        m_pending.insert(key);
+                        task_run_async_detached(prefetch_task, new ldgm_matrix_key(key));
+                }
                 return false;
         }
 
-        return true;
-}
+private:
+        static void *prefetch_task(void *arg) {
+                unique_ptr<ldgm_matrix_key> key(static_cast<ldgm_matrix_key *>(arg));
+                auto &cache = get_instance();
+                auto matrix = generate(*key);
+                lock_guard<mutex> lk(cache.m_lock);
+                cache.finish(*key, matrix);
+                return nullptr;
+        }
+
+        static shared_ptr<const ldgm_matrix> generate(ldgm_matrix_key key) {
+                auto [k, m, c, seed] = key;
+                auto ret = make_shared<ldgm_matrix>();
+                ret->pcm.reset(generate_ldgm_pcm(k, m, c, seed, 0, &ret->columns));
+                ret->m = m;
+                if (!ret->pcm) {
+                        return nullptr;
+                }
+                log_msg(LOG_LEVEL_VERBOSE, "[LDGM] Generated matrix k = %u, m = %u, c = %u, seed = %u.\n", k, m, c, seed);
+                return ret;
+        }
+
+        /// @pre m_lock is held
+        shared_ptr<const ldgm_matrix> find(ldgm_matrix_key key) {
+                for (auto it = m_lru.begin(); it != m_lru.end(); ++it) {
+                        if (it->first == key) {
+                                m_lru.splice(m_lru.begin(), m_lru, it);
+                                return it->second;
+                        }
+                }
+                return nullptr;
+        }
+
+        /// @pre m_lock is held
+        void finish(ldgm_matrix_key key, shared_ptr<const ldgm_matrix> matrix) {
+                m_pending.erase(key);
+                if (matrix) {
+                        m_lru.emplace_front(key, std::move(matrix));
+                        if (m_lru.size() > MATRIX_CACHE_SIZE) {
+                                m_lru.pop_back();
+                        }
+                }
+                m_cv.notify_all();
+        }
+
+        mutex m_lock;
+        condition_variable m_cv;
+        list<pair<ldgm_matrix_key, shared_ptr<const ldgm_matrix>>> m_lru; ///< most recently used first
+        set<ldgm_matrix_key> m_pending; ///< being generated
+};
+} // end of anonymous namespace
 
 void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
 {
@@ -162,45 +265,19 @@ void ldgm::set_params(unsigned int k, unsigned int m, unsigned int c, unsigned i
 
         m_coding_session->set_params(k, m, c);
 
-        char filename[512];
-        char path[256];
-
-        int res;
-
-#ifdef WIN32
-        TCHAR tmpPath[MAX_PATH];
-        UINT ret = GetTempPath(MAX_PATH, tmpPath);
-        if(ret == 0 || ret > MAX_PATH) {
-                fprintf(stderr, "Unable to get temporary directory name.\n");
+        auto matrix = ldgm_matrix_cache::get_instance().get({k, m, c, seed});
+        if (!matrix) {
+                fprintf(stderr, "[LDGM] Unable to initialize LDGM matrix.\n");
                 throw 1;
         }
-        snprintf(path, 256, "%s\\ultragrid\\", tmpPath);
-#else
-        snprintf(path, 256, "/var/tmp/ultragrid-%d/", (int) getuid());
-#endif
-
-        res = platform_mkdir(path);
-        if(res != 0) {
-                if(errno != EEXIST) {
-                        perror("mkdir");
-                        fprintf(stderr, "[LDGM] Unable to create data directory.\n");
-                        throw 1;
-                }
-        }
-        snprintf(filename, 512, "%s/ldgm_matrix-%u-%u-%u-%u.bin", path, k, m, c, seed);
-        if(!file_exists(filename)) {
-                int ret = generate_ldgm_matrix(filename, k, m, c, seed, 0);
-                if(ret != 0) {
-                        fprintf(stderr, "[LDGM] Unable to initialize LDGM matrix.\n");
-                        throw 1;
-                }
-        }
 
-        m_coding_session->set_pcMatrix(filename);
+        m_coding_session->set_pcm(matrix->pcm.get(), k, matrix->m, matrix->columns);
 }
 
 ADD_TO_PARAM("ldgm-device", "* ldgm-device={CPU|GPU}\n"
                 "  specify whether use CPU or GPU for LDGM\n");
+ADD_TO_PARAM("ldgm-threads", "* ldgm-threads=<n>\n"
+                "  number of workers used for CPU LDGM encoding (default: CPU core count, 1 - single-threaded)\n");
 
 void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed)
 {
@@ -223,7 +300,12 @@ void ldgm::init(unsigned int k, unsigned int m, unsigned int c, unsigned int see
 
                 }
         } else {
-                m_coding_session = unique_ptr<LDGM_session>(new LDGM_session_cpu());
+                m_cpu_session = new LDGM_session_cpu();
+                m_coding_session = unique_ptr<LDGM_session>(m_cpu_session);
+                m_threads = get_cpu_core_count();
+                if (get_commandline_param("ldgm-threads")) {
+                        m_threads = atoi(get_commandline_param("ldgm-threads"));
+                }
         }
 
         set_params(k, m, c, seed);
@@ -245,6 +327,10 @@ bool ldgm::decode(char *frame, int size, char **out, int *out_size, const map<in
         }
 }
 
+bool ldgm::thread_safe_decode() const {
+        return m_cpu_session != nullptr;
+}
+
 //////////////////////////////////
 // ENCODER
 //////////////////////////////////
@@ -321,12 +407,19 @@ ldgm::ldgm(const char *cfg)
         init(k, m, c);
 }
 
-ldgm::ldgm(int packet_size, int frame_size, double max_expected_loss)
+/**
+ * Selects the parameters from the suggested configurations.
+ *
+ * @param quiet  do not print the selection (used when only preparing the matrix)
+ * @throws string if there is no suitable configuration
+ */
+static void select_params(int packet_size, int frame_size, double max_expected_loss, bool quiet,
+                unsigned int *out_k, unsigned int *out_m, unsigned int *out_c)
 {
         packet_type_t packet_type;
         int nearest = INT_MAX;
         loss_t loss = -1.0;
-        int k, m, c;
+        int k = 0, m = 0, c = 0;
 
         assert(max_expected_loss >= 0.0 && max_expected_loss <= 100.0);
 
@@ -355,7 +448,9 @@ ldgm::ldgm(int packet_size, int frame_size, double max_expected_loss)
                 throw oss.str();
         }
 
-        printf("LDGM: Choosing maximal loss %2.2f percent.\n", loss);
+        if (!quiet) {
+                printf("LDGM: Choosing maximal loss %2.2f percent.\n", loss);
+        }
 
         for(unsigned int i = 0; i < sizeof(suggested_configurations) / sizeof(configuration_t); ++i) {
                 if(suggested_configurations[i].packet_type == packet_type &&
@@ -375,7 +470,7 @@ ldgm::ldgm(int packet_size, int frame_size, double max_expected_loss)
         }
 
         double difference_from_frame_size = abs(nearest - frame_size) / (double) frame_size;
-        if(difference_from_frame_size > 0.2) {
+        if(difference_from_frame_size > 0.2 && !quiet) {
                 LOG(LOG_LEVEL_WARNING) << "LDGM: Chosen LDGM setting for frame size that is " << difference_from_frame_size * 100.0 << "% " << (nearest - frame_size > 0 ? "higher" : "lower") << " than your frame size.\n";
                 LOG(LOG_LEVEL_WARNING) << "You may wish to set the parameters manually.\n";
         }
@@ -384,9 +479,29 @@ ldgm::ldgm(int packet_size, int frame_size, double max_expected_loss)
                 throw string("");
         }
 
+        *out_k = k;
+        *out_m = m;
+        *out_c = c;
+}
+
+ldgm::ldgm(int packet_size, int frame_size, double max_expected_loss)
+{
+        unsigned int k = 0, m = 0, c = 0;
+        select_params(packet_size, frame_size, max_expected_loss, false, &k, &m, &c);
         init(k, m, c);
 }
 
+bool ldgm::prepare(int packet_size, int frame_size, double max_expected_loss)
+{
+        unsigned int k = 0, m = 0, c = 0;
+        try {
+                select_params(packet_size, frame_size, max_expected_loss, true, &k, &m, &c);
+        } catch (...) {
+                return true; // reported by the constructor
+        }
+        return ldgm_matrix_cache::get_instance().prefetch({k, m, c, DEFAULT_LDGM_SEED});
+}
+
 shared_ptr<video_frame> ldgm::encode(shared_ptr<video_frame> tx_frame)
 {
         // We need to have copy of coding session shared pointer in order to exit
@@ -401,8 +516,12 @@ shared_ptr<video_frame> ldgm::encode(shared_ptr<video_frame> tx_frame)
                                 vf_free(frame);
                         });
 
+        if (m_threads > 1) {
+                return encode_parallel(std::move(tx_frame), std::move(out));
+        }
+
         for (unsigned int i = 0; i < tx_frame->tile_count; ++i) {
-                video_payload_hdr_t video_hdr;
+                video_payload_hdr_t video_hdr{};
                 format_video_header(tx_frame.get(), i, 0, video_hdr);
 
                 int out_size;
@@ -423,3 +542,100 @@ shared_ptr<video_frame> ldgm::encode(shared_ptr<video_frame> tx_frame)
         return out;
 }
 
+
+struct ldgm_encode_job {
+        LDGM_session_cpu *session;
+        char *data;        ///< tile block (data symbols followed by parity)
+        int k;
+        int symbol_size;
+        int first, last;   ///< parity symbol range
+        const char *carry; ///< accumulated parity preceding first (carry pass only)
+};
+
+static void *ldgm_encode_range_task(void *arg)
+{
+        auto *job = (struct ldgm_encode_job *) arg;
+        job->session->encode_range(job->data, job->data + job->k * job->symbol_size,
+                        job->symbol_size, job->first, job->last);
+        return NULL;
+}
+
+static void *ldgm_carry_task(void *arg)
+{
+        auto *job = (struct ldgm_encode_job *) arg;
+        char *parity = job->data + job->k * job->symbol_size;
+        for (int m = job->first; m < job->last; ++m) {
+                LDGM_session_cpu::xor_symbol(parity + m * job->symbol_size, job->carry,
+                                job->symbol_size);
+        }
+        return NULL;
+}
+
+/**
+ * Encodes tiles in parallel, each tile additionally split to parity symbol
+ * ranges. Since parity symbols are chained (staircase), every range except
+ * the first one is encoded from zero and subsequently corrected by the last
+ * symbol of the preceding ranges in a second (also parallel) pass.
+ */
+shared_ptr<video_frame> ldgm::encode_parallel(shared_ptr<video_frame> tx_frame,
+                shared_ptr<video_frame> out)
+{
+        const int tile_count = tx_frame->tile_count;
+        const int ranges = max(1, min<int>(m_threads / tile_count, m_m / MIN_PARITY_RANGE));
+        vector<int> symbol_size(tile_count);
+
+        for (int i = 0; i < tile_count; ++i) {
+                video_payload_hdr_t video_hdr{};
+                format_video_header(tx_frame.get(), i, 0, video_hdr);
+
+                int out_size;
+                out->tiles[i].data = m_cpu_session->prepare_hdr_frame((char *) video_hdr,
+                                sizeof(video_hdr), tx_frame->tiles[i].data,
+                                tx_frame->tiles[i].data_len, &out_size, &symbol_size[i]);
+                out->tiles[i].data_len = out_size;
+        }
+
+        vector<ldgm_encode_job> jobs;
+        jobs.reserve(tile_count * ranges);
+        for (int i = 0; i < tile_count; ++i) {
+                for (int r = 0; r < ranges; ++r) {
+                        jobs.push_back({m_cpu_session, out->tiles[i].data, (int) m_k,
+                                        symbol_size[i], (int) (r * m_m / ranges),
+                                        (int) ((r + 1) * m_m / ranges), nullptr});
+                }
+        }
+        task_run_parallel(ldgm_encode_range_task, jobs.size(), jobs.data(), sizeof jobs[0], NULL);
+
+        if (ranges > 1) {
+                // carry for range r is the complete parity symbol preceding it,
+                // ie. XOR of last (partial) symbols of all preceding ranges
+                vector<vector<char>> carries(tile_count);
+                vector<ldgm_encode_job> carry_jobs;
+                carry_jobs.reserve(tile_count * (ranges - 1));
+                for (int i = 0; i < tile_count; ++i) {
+                        const int ss = symbol_size[i];
+                        const char *parity = out->tiles[i].data + m_k * ss;
+                        carries[i].resize((size_t) ranges * ss);
+                        for (int r = 1; r < ranges; ++r) {
+                                char *carry = carries[i].data() + r * ss;
+                                memcpy(carry, carry - ss, ss);
+                                LDGM_session_cpu::xor_symbol(carry,
+                                                parity + (jobs[i * ranges + r].first - 1) * ss, ss);
+                                ldgm_encode_job job = jobs[i * ranges + r];
+                                job.carry = carry;
+                                carry_jobs.push_back(job);
+                        }
+                }
+                task_run_parallel(ldgm_carry_task, carry_jobs.size(), carry_jobs.data(),
+                                sizeof carry_jobs[0], NULL);
+        }
+
+        out->fec_params.type = FEC_LDGM;
+        out->fec_params.k = m_k;
+        out->fec_params.m = m_m;
+        out->fec_params.c = m_c;
+        out->fec_params.seed = m_seed;
+        out->fec_params.symbol_size = symbol_size.back();
+
+        return out;
+}
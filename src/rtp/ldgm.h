@@ -49,23 +49,36 @@
 #define LDGM_GPU_API_VERSION 1
 
 class LDGM_session;
+class LDGM_session_cpu;
 struct video_frame;
 
 struct ldgm : public fec{
         ldgm(unsigned int k, unsigned int m, unsigned int c, unsigned int seed);
         ldgm(int packet_size, int frame_size, double max_expected_loss);
         ldgm(const char *cfg);
+        /**
+         * Starts generation of the parity matrix for ldgm(packet_size, frame_size, max_expected_loss)
+         * in background if it isn't cached.
+         * @returns true if the matrix is ready (the constructor won't block)
+         */
+        static bool prepare(int packet_size, int frame_size, double max_expected_loss);
         void set_params(unsigned int k, unsigned int m, unsigned int c, unsigned int seed);
         std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame>);
+        using fec::decode;
         bool decode(char *in, int in_len, char **out, int *len,
                 const std::map<int, int> &);
+        bool thread_safe_decode() const override;
 
 private:
         void init(unsigned int k, unsigned int m, unsigned int c, unsigned int seed = DEFAULT_LDGM_SEED);
+        std::shared_ptr<video_frame> encode_parallel(std::shared_ptr<video_frame> tx_frame,
+                        std::shared_ptr<video_frame> out);
 
         std::shared_ptr<LDGM_session> m_coding_session;
         unsigned int m_k, m_m, m_c;
         unsigned int m_seed;
+        LDGM_session_cpu *m_cpu_session = nullptr; ///< set if m_coding_session is CPU one (thread-safe)
+        int m_threads = 0; ///< worker count for parallel encode (0 - disabled)
 };
 
 #endif /* __LDGM_H__ */
@@ -0,0 +1,385 @@
+/**
+ * @file   rtp/net_impair.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  packet-level network impairment (loss, delay, jitter, reorder, rate)
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "rtp/net_impair.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+
+#define MOD_NAME "[net impair] "
+#define DEFAULT_RATE_LIMIT_MS 50 ///< max queueing delay of the rate limiter before tail drop
+#define DEFAULT_SEED 1
+#define MAX_QUEUED (1 << 16)
+#define REORDER_MAX_HOLD (10 * NS_IN_MS) ///< release reordered packet if no successor arrives
+
+struct impair_packet {
+        time_ns_t due;
+        uint64_t seq; ///< keeps FIFO order of packets with the same due time
+        void *data;
+        int size;
+        int aux;
+};
+
+struct net_impair {
+        // Gilbert-Elliott model, probabilities in range [0, 1]
+        double p_good_bad;
+        double p_bad_good;
+        double loss_good;
+        double loss_bad;
+        bool bad;
+
+        double dup;
+        double reorder;
+        time_ns_t delay;
+        time_ns_t jitter;
+        long long rate;          ///< bps, 0 - unlimited
+        time_ns_t rate_limit;    ///< max backlog of the rate limiter
+        time_ns_t link_free;     ///< time when the rate-limited link finishes previous packets
+
+        uint64_t rng;
+
+        struct impair_packet *heap; ///< min-heap ordered by (due, seq)
+        int count;
+        uint64_t seq;
+        struct impair_packet held; ///< packet waiting to be swapped with its successor
+        bool have_held;
+
+        struct {
+                unsigned long long received;
+                unsigned long long lost;
+                unsigned long long duplicated;
+                unsigned long long reordered;
+                unsigned long long rate_dropped;
+        } stats;
+};
+
+/// splitmix64
+static uint64_t next_random(struct net_impair *s)
+{
+        uint64_t z = (s->rng += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+}
+
+/// @returns uniformly distributed number in [0, 1)
+static double next_uniform(struct net_impair *s)
+{
+        return (next_random(s) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static bool chance(struct net_impair *s, double p)
+{
+        return p > 0.0 && next_uniform(s) < p;
+}
+
+static void usage(void)
+{
+        color_printf("Network impairment of received RTP packets:\n");
+        color_printf("\t" TBOLD("--param udp-impair=[loss=<%%>[:burst=<n>]|ge=<p>/<r>[/<loss_bad>[/<loss_good>]]]"
+                                "[:delay=<ms>][:jitter=<ms>][:reorder=<%%>][:dup=<%%>][:rate=<bps>[:limit=<ms>]][:seed=<n>]") "\n");
+        color_printf("where\n");
+        color_printf("\t" TBOLD("loss") "    - average packet loss\n");
+        color_printf("\t" TBOLD("burst") "   - average length of a loss burst (Gilbert model), default 1 (independent losses)\n");
+        color_printf("\t" TBOLD("ge") "      - Gilbert-Elliott model - transition probabilities good->bad, bad->good and\n"
+                        "\t          loss probabilities in bad (default 100) and good (default 0) state, all in %%\n");
+        color_printf("\t" TBOLD("delay") "   - constant delay\n");
+        color_printf("\t" TBOLD("jitter") "  - delay variation (uniform +-jitter), may reorder packets\n");
+        color_printf("\t" TBOLD("reorder") " - portion of packets swapped with their successor\n");
+        color_printf("\t" TBOLD("dup") "     - portion of duplicated packets\n");
+        color_printf("\t" TBOLD("rate") "    - link rate (eg. 500M), packets exceeding " TBOLD("limit") " ms of queueing (default "
+                        TOSTRING(DEFAULT_RATE_LIMIT_MS) ") are dropped\n");
+        color_printf("\t" TBOLD("seed") "    - random generator seed (default " TOSTRING(DEFAULT_SEED) ", the same seed gives the same pattern)\n");
+        color_printf("\nApplies to all RTP sockets received in a separate thread.\n");
+}
+
+static double parse_percent(const char *val)
+{
+        return atof(val) / 100.0;
+}
+
+static time_ns_t parse_ms(const char *val)
+{
+        return (time_ns_t) (atof(val) * NS_IN_MS);
+}
+
+static bool parse_ge(struct net_impair *s, char *val)
+{
+        char *save_ptr = NULL;
+        double *dst[] = { &s->p_good_bad, &s->p_bad_good, &s->loss_bad, &s->loss_good };
+        int i = 0;
+        for (char *item = strtok_r(val, "/", &save_ptr); item != NULL && i < (int) (sizeof dst / sizeof dst[0]);
+                        item = strtok_r(NULL, "/", &save_ptr)) {
+                *dst[i++] = parse_percent(item);
+        }
+        return i >= 2;
+}
+
+struct net_impair *net_impair_init(const char *cfg)
+{
+        if (strlen(cfg) == 0 || strcmp(cfg, "help") == 0) {
+                usage();
+                return NULL;
+        }
+        struct net_impair *s = calloc(1, sizeof *s);
+        s->loss_bad = 1.0;
+        s->p_bad_good = 1.0;
+        s->rate_limit = DEFAULT_RATE_LIMIT_MS * NS_IN_MS;
+        s->rng = DEFAULT_SEED;
+        s->heap = malloc(MAX_QUEUED * sizeof s->heap[0]);
+
+        double loss = 0.0;
+        double burst = 1.0;
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        for (char *item = strtok_r(tmp, ":", &save_ptr); item != NULL; item = strtok_r(NULL, ":", &save_ptr)) {
+                char *val = strchr(item, '=');
+                if (val == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Missing value for option: %s\n", item);
+                        goto error;
+                }
+                *val++ = '\0';
+                if (strcmp(item, "loss") == 0) {
+                        loss = parse_percent(val);
+                } else if (strcmp(item, "burst") == 0) {
+                        burst = atof(val);
+                } else if (strcmp(item, "ge") == 0) {
+                        if (!parse_ge(s, val)) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Gilbert-Elliott model needs at least 2 parameters!\n");
+                                goto error;
+                        }
+                } else if (strcmp(item, "delay") == 0) {
+                        s->delay = parse_ms(val);
+                } else if (strcmp(item, "jitter") == 0) {
+                        s->jitter = parse_ms(val);
+                } else if (strcmp(item, "reorder") == 0) {
+                        s->reorder = parse_percent(val);
+                } else if (strcmp(item, "dup") == 0) {
+                        s->dup = parse_percent(val);
+                } else if (strcmp(item, "rate") == 0) {
+                        s->rate = unit_evaluate(val);
+                } else if (strcmp(item, "limit") == 0) {
+                        s->rate_limit = parse_ms(val);
+                } else if (strcmp(item, "seed") == 0) {
+                        s->rng = strtoull(val, NULL, 0);
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        goto error;
+                }
+        }
+        free(tmp);
+
+        if (loss > 0.0) {
+                if (loss >= 1.0 || burst < 1.0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Loss must be lower than 100 %% and burst at least 1!\n");
+                        net_impair_destroy(s, NULL);
+                        return NULL;
+                }
+                if (burst == 1.0) { // independent losses - stay in the good state
+                        s->p_good_bad = 0.0;
+                        s->loss_good = loss;
+                } else { // Gilbert model - all packets in bad state are lost
+                        s->p_bad_good = 1.0 / burst;
+                        s->p_good_bad = loss * s->p_bad_good / (1.0 - loss);
+                        s->loss_bad = 1.0;
+                        s->loss_good = 0.0;
+                }
+        }
+        if (s->jitter > s->delay) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Jitter is higher than delay, delay will be clamped to 0.\n");
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Impairing received packets: %s\n", cfg);
+        return s;
+error:
+        free(tmp);
+        net_impair_destroy(s, NULL);
+        return NULL;
+}
+
+void net_impair_destroy(struct net_impair *s, void (*dispose)(void *data))
+{
+        if (s == NULL) {
+                return;
+        }
+        if (dispose != NULL) {
+                for (int i = 0; i < s->count; ++i) {
+                        dispose(s->heap[i].data);
+                }
+                if (s->have_held) {
+                        dispose(s->held.data);
+                }
+        }
+        if (s->stats.received > 0) {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Received %llu packets, lost %llu (%.2f %%), duplicated %llu, "
+                                "reordered %llu, dropped by rate limit %llu\n",
+                                s->stats.received, s->stats.lost, 100.0 * s->stats.lost / s->stats.received,
+                                s->stats.duplicated, s->stats.reordered, s->stats.rate_dropped);
+        }
+        free(s->heap);
+        free(s);
+}
+
+int net_impair_admit(struct net_impair *s)
+{
+        s->stats.received += 1;
+        if (chance(s, s->bad ? s->p_bad_good : s->p_good_bad)) {
+                s->bad = !s->bad;
+        }
+        if (chance(s, s->bad ? s->loss_bad : s->loss_good)) {
+                s->stats.lost += 1;
+                return 0;
+        }
+        if (chance(s, s->dup)) {
+                s->stats.duplicated += 1;
+                return 2;
+        }
+        return 1;
+}
+
+static bool heap_less(const struct impair_packet *a, const struct impair_packet *b)
+{
+        return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+static void heap_push(struct net_impair *s, struct impair_packet pkt)
+{
+        int i = s->count++;
+        while (i > 0 && heap_less(&pkt, &s->heap[(i - 1) / 2])) {
+                s->heap[i] = s->heap[(i - 1) / 2];
+                i = (i - 1) / 2;
+        }
+        s->heap[i] = pkt;
+}
+
+static struct impair_packet heap_pop(struct net_impair *s)
+{
+        struct impair_packet top = s->heap[0];
+        struct impair_packet last = s->heap[--s->count];
+        int i = 0;
+        while (2 * i + 1 < s->count) {
+                int child = 2 * i + 1;
+                if (child + 1 < s->count && heap_less(&s->heap[child + 1], &s->heap[child])) {
+                        child += 1;
+                }
+                if (!heap_less(&s->heap[child], &last)) {
+                        break;
+                }
+                s->heap[i] = s->heap[child];
+                i = child;
+        }
+        if (s->count > 0) {
+                s->heap[i] = last;
+        }
+        return top;
+}
+
+bool net_impair_enqueue(struct net_impair *s, time_ns_t now, void *data, int size, int aux)
+{
+        if (s->count + 2 > MAX_QUEUED) { // room also for the held packet
+                s->stats.rate_dropped += 1;
+                return false;
+        }
+        time_ns_t departure = now;
+        if (s->rate > 0) {
+                time_ns_t start = MAX(now, s->link_free);
+                if (start - now > s->rate_limit) {
+                        s->stats.rate_dropped += 1;
+                        return false;
+                }
+                s->link_free = start + (time_ns_t) size * 8 * NS_IN_SEC / s->rate;
+                departure = s->link_free;
+        }
+        time_ns_t delay = s->delay;
+        if (s->jitter > 0) {
+                delay += (time_ns_t) ((2.0 * next_uniform(s) - 1.0) * s->jitter);
+        }
+        struct impair_packet pkt = { departure + MAX(delay, 0), s->seq++, data, size, aux };
+
+        if (s->have_held) { // the held packet goes after this one
+                s->have_held = false;
+                heap_push(s, pkt);
+                s->held.due = MAX(s->held.due, pkt.due);
+                s->held.seq = s->seq++;
+                heap_push(s, s->held);
+                return true;
+        }
+        if (chance(s, s->reorder)) {
+                s->stats.reordered += 1;
+                s->held = pkt;
+                s->have_held = true;
+                return true;
+        }
+        heap_push(s, pkt);
+        return true;
+}
+
+void *net_impair_dequeue(struct net_impair *s, time_ns_t now, int *size, int *aux)
+{
+        if (s->have_held && now >= s->held.due + REORDER_MAX_HOLD) {
+                s->have_held = false;
+                heap_push(s, s->held);
+        }
+        if (s->count == 0 || s->heap[0].due > now) {
+                return NULL;
+        }
+        struct impair_packet pkt = heap_pop(s);
+        *size = pkt.size;
+        *aux = pkt.aux;
+        return pkt.data;
+}
+
+time_ns_t net_impair_next_due(const struct net_impair *s)
+{
+        time_ns_t ret = s->count > 0 ? s->heap[0].due : -1;
+        if (s->have_held && (ret == -1 || s->held.due + REORDER_MAX_HOLD < ret)) {
+                ret = s->held.due + REORDER_MAX_HOLD;
+        }
+        return ret;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file   rtp/net_impair.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  packet-level network impairment (loss, delay, jitter, reorder, rate)
+ *
+ * Emulates a lossy network on the receiving side of socket_udp so that FEC
+ * and the playout buffer can be tuned with reproducible conditions (the
+ * random generator is seeded deterministically).
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_NET_IMPAIR_H_
+#define RTP_NET_IMPAIR_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#include "tv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct net_impair;
+
+/**
+ * @param cfg udp-impair parameter value
+ * @returns NULL on error or if help was requested (message is printed)
+ */
+struct net_impair *net_impair_init(const char *cfg);
+/// disposes all held packets with dispose and prints statistics
+void               net_impair_destroy(struct net_impair *s, void (*dispose)(void *data));
+/**
+ * Decides fate of a newly received packet (loss and duplication).
+ * @returns number of copies of the packet to be passed to net_impair_enqueue()
+ *          (0 - the packet is lost)
+ */
+int                net_impair_admit(struct net_impair *s);
+/**
+ * Schedules the packet to be released after the configured delay (+ jitter,
+ * reordering and rate limit).
+ * @retval false if the packet was dropped by the rate limiter (or the queue
+ *         is full) - the caller keeps the ownership
+ */
+bool               net_impair_enqueue(struct net_impair *s, time_ns_t now, void *data, int size, int aux);
+/// @returns next packet that is due at now, NULL if there is none
+void              *net_impair_dequeue(struct net_impair *s, time_ns_t now, int *size, int *aux);
+/// @returns time when the next held packet is due, -1 if there is none
+time_ns_t          net_impair_next_due(const struct net_impair *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_NET_IMPAIR_H_
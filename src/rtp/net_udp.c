@@ -58,18 +58,45 @@
 #include "compat/vsnprintf.h"
 #include "net_udp.h"
 #include "rtp.h"
+#include "rtp/net_impair.h"
+#include "rtp/net_xdp.h"
+#include "rtp/packet_pool.h"
+#include "rtp/rtp_trace.h"
+#include "utils/alloc_stats.h"
+#include "utils/fs.h"
 #include "utils/list.h"
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/net.h"
 #include "utils/thread.h"
+#include "utils/time.h"
 #include "utils/windows.h"
 
 #ifdef NEED_ADDRINFO_H
 #include "addrinfo.h"
 #endif
 
+#ifdef HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+#if defined SO_TXTIME || defined SO_TIMESTAMPING
+#include <linux/net_tstamp.h>
+#endif
+#ifdef HAVE_LINUX_IF_XDP_H
+#include <poll.h>
+#endif
+
 #define DEFAULT_MAX_UDP_READER_QUEUE_LEN (1920/3*8*1080/1152) //< 10-bit FullHD frame divided by 1280 MTU packets (minus headers)
+#define DEFAULT_UDP_RECV_BATCH 32 ///< datagrams per recvmmsg() call if udp-recv-batch is given without value
+#define MAX_UDP_RECV_BATCH 1024
+#define DEFAULT_UDP_SEND_BATCH 64 ///< datagrams per sendmmsg() call if udp-send-batch is given without value
+#define MAX_UDP_SEND_BATCH 1024
+#define UDP_SEND_BATCH_MAX_IOV 3 ///< max iovec count per datagram (RTP hdr, payload hdr, data)
+#define UDP_GSO_MAX_SEGMENTS 64 ///< kernel limit (UDP_MAX_SEGMENTS)
+#define UDP_GSO_MAX_SIZE 65000 ///< max size of GSO super-datagram payload
+#ifdef SO_TIMESTAMPING
+#define UDP_RX_TSTAMP_CMSG_SPACE CMSG_SPACE(3 * sizeof(struct timespec)) ///< struct scm_timestamping
+#endif
 
 static int resolve_address(socket_udp *s, const char *addr, uint16_t tx_port);
 static void *udp_reader(void *arg);
@@ -140,6 +167,12 @@ struct item {
  *
  * Can be shared across multiple RTP sessions.
  */
+enum udp_rx_tstamp {
+        UDP_RX_TSTAMP_NONE = 0,
+        UDP_RX_TSTAMP_USER,     ///< clock read after the datagram is received
+        UDP_RX_TSTAMP_KERNEL,   ///< SO_TIMESTAMPING - software or hardware (NIC) timestamps
+};
+
 struct socket_udp_local {
         int mode;               /* IPv4 or IPv6 */
         fd_t rx_fd;
@@ -152,10 +185,25 @@ struct socket_udp_local {
         // for multithreaded receiving
         pthread_t thread_id;
         struct simple_linked_list *packets;
+        struct rtp_packet_pool *packet_pool;
         unsigned int max_packets;
         pthread_mutex_t lock;
         pthread_cond_t boss_cv;
         pthread_cond_t reader_cv;
+        pthread_mutex_t placement_lock;
+        const struct udp_recv_placement *placement; ///< direct payload placement, guarded by placement_lock
+        unsigned int recv_batch; ///< number of datagrams read by one recvmmsg() call, 0 - disabled
+        unsigned int send_batch; ///< number of datagrams sent by one sendmmsg() call, 0 - disabled
+        bool gso; ///< use UDP GSO (UDP_SEGMENT) for sending batches
+        enum udp_rx_tstamp rx_tstamp; ///< source of rtp_packet::recv_ts (multithreaded only)
+        struct net_impair *impair; ///< emulated network impairment of received packets (reader thread only)
+        struct rtp_trace *record; ///< received datagrams are written here (reader thread only)
+        struct rtp_trace *replay; ///< if not NULL, datagrams are read from this trace instead of the socket
+        bool replay_realtime; ///< replay with the recorded timing (otherwise as fast as possible)
+        bool red_turn; ///< read the redundant path next if both are ready (reader thread only)
+#ifdef HAVE_LINUX_IF_XDP_H
+        struct xdp_socket *xdp; ///< if not NULL, data are sent/received through AF_XDP socket
+#endif
 
         bool should_exit;
         fd_t should_exit_fd[2];
@@ -168,10 +216,18 @@ struct _socket_udp {
         struct sockaddr_storage sock;
         socklen_t sock_len;
         unsigned int ifindex; ///< iface index for multicast
+#ifdef SO_TXTIME
+        bool txtime_enabled;
+        uint64_t next_txtime; ///< CLOCK_MONOTONIC time [ns] for next sent packet, 0 - now
+#endif
 
         struct socket_udp_local *local;
         bool local_is_slave; // whether is the local
 
+        /// redundant path (udp_add_redundant_path()) - sent datagrams are
+        /// duplicated to it, its datagrams are received by our reader thread
+        struct _socket_udp *red;
+
 #ifdef WIN32
         WSAOVERLAPPED *overlapped;
         WSAEVENT *overlapped_events;
@@ -179,6 +235,21 @@ struct _socket_udp {
         bool overlapping_active;
         int overlapped_max;
         int overlapped_count;
+#elif defined HAVE_SENDMMSG
+        // batched sending between udp_async_start() and udp_async_wait()
+        struct mmsghdr *batch_msgs;
+        struct iovec *batch_iovs; ///< UDP_SEND_BATCH_IOV_MAX per message
+        void **batch_udata;
+#ifdef SO_TXTIME
+        char (*batch_control)[CMSG_SPACE(sizeof(uint64_t))];
+#endif
+        int batch_max;
+        int batch_count;
+        bool batch_active;
+        char *gso_buf;
+#endif
+#ifdef HAVE_LINUX_IF_XDP_H
+        bool xdp_async; ///< between udp_async_start() and udp_async_wait() - defer XDP TX wakeup
 #endif
 };
 
@@ -363,6 +434,42 @@ static bool udp_addr_valid4(const char *dst)
         return false;
 }
 
+/**
+ * @returns source address for a source-specific multicast join (udp-mcast-source)
+ * or NULL if not set (any-source multicast)
+ */
+static const char *udp_mcast_source(void)
+{
+        const char *source = get_commandline_param("udp-mcast-source");
+        return source != NULL && strlen(source) > 0 ? source : NULL;
+}
+
+/// joins (join == true) or leaves the source-specific group
+static bool udp_mcast_source_grp4(unsigned long addr, int fd, unsigned int ifindex, const char *source, bool join)
+{
+#ifdef IP_ADD_SOURCE_MEMBERSHIP
+        struct ip_mreq_source imr;
+        memset(&imr, 0, sizeof imr);
+        imr.imr_multiaddr.s_addr = addr;
+        imr.imr_interface.s_addr = ifindex;
+        if (inet_pton(AF_INET, source, &imr.imr_sourceaddr) != 1) {
+                log_msg(LOG_LEVEL_ERROR, "Wrong IPv4 multicast source address: %s\n", source);
+                return false;
+        }
+        if (SETSOCKOPT(fd, IPPROTO_IP, join ? IP_ADD_SOURCE_MEMBERSHIP : IP_DROP_SOURCE_MEMBERSHIP,
+                                (char *) &imr, sizeof imr) != 0) {
+                socket_error(join ? "setsockopt IP_ADD_SOURCE_MEMBERSHIP" : "setsockopt IP_DROP_SOURCE_MEMBERSHIP");
+                return false;
+        }
+        verbose_msg("%s source-specific multicast group (source %s)\n", join ? "Joined" : "Left", source);
+        return true;
+#else
+        UNUSED(addr), UNUSED(fd), UNUSED(ifindex), UNUSED(source), UNUSED(join);
+        log_msg(LOG_LEVEL_ERROR, "Source-specific multicast is not supported on this platform!\n");
+        return false;
+#endif
+}
+
 static bool udp_join_mcast_grp4(unsigned long addr, int rx_fd, int tx_fd, int ttl, unsigned int ifindex)
 {
         if (IN_MULTICAST(ntohl(addr))) {
@@ -374,7 +481,11 @@ static bool udp_join_mcast_grp4(unsigned long addr, int rx_fd, int tx_fd, int tt
                 imr.imr_multiaddr.s_addr = addr;
                 imr.imr_interface.s_addr = ifindex;
 
-                if (SETSOCKOPT
+                if (udp_mcast_source() != NULL) {
+                        if (!udp_mcast_source_grp4(addr, rx_fd, ifindex, udp_mcast_source(), true)) {
+                                return false;
+                        }
+                } else if (SETSOCKOPT
                     (rx_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char *)&imr,
                      sizeof(struct ip_mreq)) != 0) {
                         socket_error("setsockopt IP_ADD_MEMBERSHIP");
@@ -410,7 +521,9 @@ static bool udp_join_mcast_grp4(unsigned long addr, int rx_fd, int tx_fd, int tt
 
 static void udp_leave_mcast_grp4(unsigned long addr, int fd)
 {
-        if (IN_MULTICAST(ntohl(addr))) {
+        if (IN_MULTICAST(ntohl(addr)) && udp_mcast_source() != NULL) {
+                udp_mcast_source_grp4(addr, fd, INADDR_ANY, udp_mcast_source(), false);
+        } else if (IN_MULTICAST(ntohl(addr))) {
                 struct ip_mreq imr;
                 imr.imr_multiaddr.s_addr = addr;
                 imr.imr_interface.s_addr = INADDR_ANY;
@@ -469,6 +582,38 @@ static bool udp_addr_valid6(const char *dst)
         return false;
 }
 
+#ifdef HAVE_IPv6
+/// joins (join == true) or leaves the source-specific group
+static bool udp_mcast_source_grp6(struct in6_addr sin6_addr, int fd, unsigned int ifindex, const char *source, bool join)
+{
+#ifdef MCAST_JOIN_SOURCE_GROUP
+        struct group_source_req gsr;
+        memset(&gsr, 0, sizeof gsr);
+        gsr.gsr_interface = ifindex;
+        struct sockaddr_in6 *group = (struct sockaddr_in6 *) &gsr.gsr_group;
+        group->sin6_family = AF_INET6;
+        group->sin6_addr = sin6_addr;
+        struct sockaddr_in6 *src = (struct sockaddr_in6 *) &gsr.gsr_source;
+        src->sin6_family = AF_INET6;
+        if (inet_pton(AF_INET6, source, &src->sin6_addr) != 1) {
+                log_msg(LOG_LEVEL_ERROR, "Wrong IPv6 multicast source address: %s\n", source);
+                return false;
+        }
+        if (SETSOCKOPT(fd, IPPROTO_IPV6, join ? MCAST_JOIN_SOURCE_GROUP : MCAST_LEAVE_SOURCE_GROUP,
+                                (char *) &gsr, sizeof gsr) != 0) {
+                socket_error(join ? "setsockopt MCAST_JOIN_SOURCE_GROUP" : "setsockopt MCAST_LEAVE_SOURCE_GROUP");
+                return false;
+        }
+        verbose_msg("%s source-specific multicast group (source %s)\n", join ? "Joined" : "Left", source);
+        return true;
+#else
+        UNUSED(sin6_addr), UNUSED(fd), UNUSED(ifindex), UNUSED(source), UNUSED(join);
+        log_msg(LOG_LEVEL_ERROR, "Source-specific multicast is not supported on this platform!\n");
+        return false;
+#endif
+}
+#endif // defined HAVE_IPv6
+
 static bool udp_join_mcast_grp6(struct in6_addr sin6_addr, int rx_fd, int tx_fd, int ttl, unsigned int ifindex)
 {
 #ifdef HAVE_IPv6
@@ -483,7 +628,11 @@ static bool udp_join_mcast_grp6(struct in6_addr sin6_addr, int rx_fd, int tx_fd,
                 imr.ipv6mr_interface = ifindex;
 #endif
 
-                if (SETSOCKOPT
+                if (udp_mcast_source() != NULL) {
+                        if (!udp_mcast_source_grp6(sin6_addr, rx_fd, ifindex, udp_mcast_source(), true)) {
+                                return false;
+                        }
+                } else if (SETSOCKOPT
                     (rx_fd, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, (char *)&imr,
                      sizeof(struct ipv6_mreq)) != 0) {
                         socket_error("setsockopt IPV6_ADD_MEMBERSHIP");
@@ -520,7 +669,9 @@ static bool udp_join_mcast_grp6(struct in6_addr sin6_addr, int rx_fd, int tx_fd,
 static void udp_leave_mcast_grp6(struct in6_addr sin6_addr, int fd, unsigned int ifindex)
 {
 #ifdef HAVE_IPv6
-        if (IN6_IS_ADDR_MULTICAST(&sin6_addr)) {
+        if (IN6_IS_ADDR_MULTICAST(&sin6_addr) && udp_mcast_source() != NULL) {
+                udp_mcast_source_grp6(sin6_addr, fd, ifindex, udp_mcast_source(), false);
+        } else if (IN6_IS_ADDR_MULTICAST(&sin6_addr)) {
                 struct ipv6_mreq imr;
 #ifdef MUSICA_IPV6
                 imr.i6mr_interface = 1;
@@ -760,15 +911,140 @@ static bool set_sock_opts_and_bind(fd_t fd, bool ipv6, uint16_t rx_port, int ttl
         return true;
 }
 
+/**
+ * Enables kernel timestamping of received datagrams if available,
+ * otherwise the reader thread reads the clock itself.
+ */
+static bool udp_enable_rx_timestamping(socket_udp *s, bool hw)
+{
+        s->local->rx_tstamp = UDP_RX_TSTAMP_USER;
+#ifdef SO_TIMESTAMPING
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (hw) {
+                flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        }
+        if (setsockopt(s->local->rx_fd, SOL_SOCKET, SO_TIMESTAMPING, (void *) &flags, sizeof flags) == 0) {
+                s->local->rx_tstamp = UDP_RX_TSTAMP_KERNEL;
+                return true;
+        }
+        socket_error("setsockopt SO_TIMESTAMPING");
+#endif
+        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Kernel RX timestamps not available, using user-space clock.\n");
+        return !hw;
+}
+
 ADD_TO_PARAM("udp-queue-len",
                 "* udp-queue-len=<l>\n"
                 "  Use different queue size than default DEFAULT_MAX_UDP_READER_QUEUE_LEN\n");
+#ifdef HAVE_RECVMMSG
+ADD_TO_PARAM("udp-recv-batch",
+                "* udp-recv-batch[=<n>]\n"
+                "  Receive up to <n> datagrams (default " TOSTRING(DEFAULT_UDP_RECV_BATCH) ") with a single recvmmsg() call in the reader thread\n");
+#endif
+#ifdef HAVE_SENDMMSG
+ADD_TO_PARAM("udp-send-batch",
+                "* udp-send-batch[=<n>]\n"
+                "  Send video and audio packets in batches of up to <n> datagrams (default " TOSTRING(DEFAULT_UDP_SEND_BATCH) ") with sendmmsg(),\n"
+                "  with traffic shaping, the batch is sent as a single burst\n");
+#ifdef UDP_SEGMENT
+ADD_TO_PARAM("udp-gso",
+                "* udp-gso\n"
+                "  Use UDP generic segmentation offload for batched sending (implies udp-send-batch)\n");
+#endif
+ADD_TO_PARAM("udp-rx-timestamp",
+                "* udp-rx-timestamp[=hw]\n"
+                "  Timestamp received datagrams (for latency statistics) with SO_TIMESTAMPING (Linux),\n"
+                "  \"hw\" prefers NIC timestamps - HW timestamping must be enabled on the NIC (eg. hwstamp_ctl)\n"
+                "  and PHC synchronized to the system clock (phc2sys)\n");
+#ifdef HAVE_LINUX_IF_XDP_H
+ADD_TO_PARAM("udp-xdp",
+                "* udp-xdp=<iface>[:queue=<q>][:port=<p>][:dst-mac=<mac>][:copy][:skb]\n"
+                "  Send and receive RTP data through AF_XDP socket bypassing the kernel network stack (IPv4 only, use \"help\" for details)\n");
+#endif
+#endif
+ADD_TO_PARAM("udp-mcast-source",
+                "* udp-mcast-source=<addr>\n"
+                "  Join the multicast group source-specifically (IGMPv3/MLDv2 SSM) - receive only from the sender <addr>\n");
+ADD_TO_PARAM("udp-impair",
+                "* udp-impair=<opts>\n"
+                "  Emulate loss, delay, jitter, reordering, duplication or rate limit of received RTP packets (use \"help\" for details)\n");
+ADD_TO_PARAM("udp-record",
+                "* udp-record=<prefix>\n"
+                "  Record received RTP packets (before udp-impair) to <prefix>_<port>.pcap\n");
+ADD_TO_PARAM("udp-replay",
+                "* udp-replay=<file>[:realtime]\n"
+                "  Receive RTP packets from a pcap trace (eg. recorded with udp-record) instead of the network,\n"
+                "  used for the socket bound to the destination port of the trace, replayed as fast as possible\n");
 #ifdef WIN32
 ADD_TO_PARAM("udp-disable-multi-socket",
                 "* udp-disable-multi-socket\n"
                 "  Disable separate sockets for RX and TX (Win only). Separated RX/TX is a workaround\n"
                 "  to some locking issues (thr. in recv() while no data are received and concurr. send()).\n");
 #endif
+/**
+ * Sets up recording (udp-record) and replay (udp-replay) of the received packets.
+ */
+static bool udp_init_trace(socket_udp *s)
+{
+        const int port = udp_get_udp_rx_port(s);
+        const char *record = get_commandline_param("udp-record");
+        if (record != NULL) {
+                char filename[MAX_PATH_SIZE];
+                snprintf(filename, sizeof filename, "%s_%d.pcap", record, port);
+                if ((s->local->record = rtp_trace_create(filename)) == NULL) {
+                        return false;
+                }
+        }
+        const char *replay = get_commandline_param("udp-replay");
+        if (replay == NULL) {
+                return true;
+        }
+        char *filename = strdup(replay);
+        char *opts = strrchr(filename, ':');
+        if (opts != NULL && strcmp(opts + 1, "realtime") == 0) {
+                *opts = '\0';
+                s->local->replay_realtime = true;
+        }
+        struct rtp_trace *t = rtp_trace_open(filename);
+        free(filename);
+        if (t == NULL) {
+                return false;
+        }
+        // the trace is replayed only to the socket it was captured at
+        char buf[RTP_MAX_PACKET_LEN];
+        time_ns_t ts = 0;
+        uint16_t dst_port = 0;
+        if (rtp_trace_read(t, &ts, NULL, &dst_port, buf, sizeof buf) <= 0 || dst_port != port) {
+                rtp_trace_close(t);
+                return true;
+        }
+        rtp_trace_rewind(t);
+        s->local->replay = t;
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Replaying %s to port %d.\n", replay, port);
+        return true;
+}
+
+static void udp_reader_start(socket_udp *s)
+{
+        s->local->should_exit = false;
+        platform_pipe_init(s->local->should_exit_fd);
+        pthread_create(&s->local->thread_id, NULL, udp_reader, s);
+}
+
+/// stops the reader thread, the received packets are kept in the queue
+static void udp_reader_stop(socket_udp *s)
+{
+        char c = 0;
+        int ret = PLATFORM_PIPE_WRITE(s->local->should_exit_fd[1], &c, 1);
+        assert (ret == 1);
+        pthread_mutex_lock(&s->local->lock);
+        s->local->should_exit = true;
+        pthread_mutex_unlock(&s->local->lock);
+        pthread_cond_signal(&s->local->reader_cv);
+        pthread_join(s->local->thread_id, NULL);
+        platform_pipe_close(s->local->should_exit_fd[1]);
+}
+
 /**
  * udp_init_if:
  * Creates a session for sending and receiving UDP datagrams over IP
@@ -797,6 +1073,7 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
         pthread_mutex_init(&s->local->lock, NULL);
         pthread_cond_init(&s->local->boss_cv, NULL);
         pthread_cond_init(&s->local->reader_cv, NULL);
+        pthread_mutex_init(&s->local->placement_lock, NULL);
 
         assert(force_ip_version == 0 || force_ip_version == 4 || force_ip_version == 6);
         s->local->mode = force_ip_version;
@@ -890,6 +1167,61 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 abort();
         }
 
+#ifdef HAVE_SENDMMSG
+        const char *send_batch = get_commandline_param("udp-send-batch");
+#ifdef UDP_SEGMENT
+        s->local->gso = get_commandline_param("udp-gso") != NULL;
+        if (s->local->gso && send_batch == NULL) {
+                send_batch = "";
+        }
+#endif
+        if (send_batch != NULL) {
+                int val = strlen(send_batch) > 0 ? atoi(send_batch) : DEFAULT_UDP_SEND_BATCH;
+                if (val <= 0 || val > MAX_UDP_SEND_BATCH) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong send batch size %s, allowed range is 1-%d!\n", send_batch, MAX_UDP_SEND_BATCH);
+                        goto error;
+                }
+                s->local->send_batch = val;
+        }
+#endif
+#ifdef HAVE_RECVMMSG
+        const char *batch = get_commandline_param("udp-recv-batch");
+        if (multithreaded && batch != NULL) {
+                int val = strlen(batch) > 0 ? atoi(batch) : DEFAULT_UDP_RECV_BATCH;
+                if (val <= 0 || val > MAX_UDP_RECV_BATCH) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong recv batch size %s, allowed range is 1-%d!\n", batch, MAX_UDP_RECV_BATCH);
+                        goto error;
+                }
+                s->local->recv_batch = val;
+        }
+#endif
+        const char *rx_tstamp = get_commandline_param("udp-rx-timestamp");
+        if (multithreaded && rx_tstamp != NULL && !udp_enable_rx_timestamping(s, strcmp(rx_tstamp, "hw") == 0)) {
+                goto error;
+        }
+#ifdef HAVE_LINUX_IF_XDP_H
+        static bool xdp_claimed; // only one socket per NIC queue may be used
+        const char *xdp_cfg = get_commandline_param("udp-xdp");
+        if (multithreaded && xdp_cfg != NULL && !xdp_claimed) {
+                struct sockaddr_in sin;
+                socklen_t addrlen = sizeof sin;
+                if (s->local->mode != IPv4 || getsockname(s->local->rx_fd, (struct sockaddr *) &sin, &addrlen) != 0 || sin.sin_family != AF_INET) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "AF_XDP is supported only for IPv4, using regular socket.\n");
+                } else if (xdp_socket_port_matches(xdp_cfg, ntohs(sin.sin_port))) {
+                        if ((s->local->xdp = xdp_socket_init(xdp_cfg, ntohs(sin.sin_port))) == NULL) {
+                                goto error;
+                        }
+                        xdp_claimed = true;
+                }
+        }
+#endif
+        const char *impair_cfg = get_commandline_param("udp-impair");
+        if (multithreaded && impair_cfg != NULL && (s->local->impair = net_impair_init(impair_cfg)) == NULL) {
+                goto error;
+        }
+        if (multithreaded && !udp_init_trace(s)) {
+                goto error;
+        }
         s->local->multithreaded = multithreaded;
         if (multithreaded) {
                 if (!get_commandline_param("udp-queue-len")) {
@@ -897,8 +1229,9 @@ socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port,
                 } else {
                         s->local->max_packets = atoi(get_commandline_param("udp-queue-len"));
                 }
-                platform_pipe_init(s->local->should_exit_fd);
-                pthread_create(&s->local->thread_id, NULL, udp_reader, s);
+                // keep enough buffers for the queue and packets held in pbuf
+                s->local->packet_pool = rtp_packet_pool_create(ALIGNED_ITEM_OFF + sizeof(struct item), 4 * s->local->max_packets);
+                udp_reader_start(s);
         }
 
         return s;
@@ -908,6 +1241,42 @@ error:
         return NULL;
 }
 
+/**
+ * Adds a redundant path (SMPTE 2022-7 like) - all datagrams sent with
+ * udp_send() and udp_sendv() are sent also through red (to its destination)
+ * and, if s is multithreaded, datagrams received by red are put to the
+ * queue of s. Duplicates are not removed here.
+ *
+ * @param red  socket created by udp_init_if() as not multithreaded, owned by s
+ *             on success
+ */
+bool udp_add_redundant_path(socket_udp *s, socket_udp *red)
+{
+#ifdef WIN32
+        UNUSED(s), UNUSED(red);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Redundant path is not supported on Windows!\n");
+        return false;
+#else
+        bool unsupported = s->local->replay != NULL || s->local->impair != NULL;
+#ifdef HAVE_LINUX_IF_XDP_H
+        unsupported = unsupported || s->local->xdp != NULL;
+#endif
+        if (s->red != NULL || red->local->multithreaded || unsupported) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot add redundant path%s!\n",
+                                unsupported ? " (not supported with udp-xdp, udp-impair or udp-replay)" : "");
+                return false;
+        }
+        if (s->local->multithreaded) {
+                udp_reader_stop(s);
+        }
+        s->red = red;
+        if (s->local->multithreaded) {
+                udp_reader_start(s);
+        }
+        return true;
+#endif
+}
+
 static const struct in6_addr in6_blackhole = IN6ADDR_BLACKHOLE_INIT;
 
 bool udp_is_blackhole(socket_udp *s) {
@@ -980,18 +1349,19 @@ void udp_exit(socket_udp * s)
 
         if (!s->local_is_slave) {
                 if (s->local->multithreaded) {
-                        char c = 0;
-                        int ret = PLATFORM_PIPE_WRITE(s->local->should_exit_fd[1], &c, 1);
-                        assert (ret == 1);
-                        s->local->should_exit = true;
-                        pthread_cond_signal(&s->local->reader_cv);
-                        pthread_join(s->local->thread_id, NULL);
+                        udp_reader_stop(s);
                         while (simple_linked_list_size(s->local->packets) > 0) {
                                 struct item *item = (struct item *) simple_linked_list_pop(s->local->packets);
-                                free(item->buf);
+                                rtp_packet_free(item->buf);
                         }
-                        platform_pipe_close(s->local->should_exit_fd[1]);
+                        net_impair_destroy(s->local->impair, rtp_packet_free);
+                        rtp_trace_close(s->local->record);
+                        rtp_trace_close(s->local->replay);
+                        rtp_packet_pool_destroy(s->local->packet_pool);
                 }
+#ifdef HAVE_LINUX_IF_XDP_H
+                xdp_socket_destroy(s->local->xdp);
+#endif
                 CLOSESOCKET(s->local->rx_fd);
                 if (s->local->tx_fd != s->local->rx_fd) {
                         CLOSESOCKET(s->local->tx_fd);
@@ -1000,9 +1370,14 @@ void udp_exit(socket_udp * s)
                 pthread_mutex_destroy(&s->local->lock);
                 pthread_cond_destroy(&s->local->boss_cv);
                 pthread_cond_destroy(&s->local->reader_cv);
+                pthread_mutex_destroy(&s->local->placement_lock);
                 free(s->local);
         }
 
+        if (s->red != NULL) {
+                udp_exit(s->red);
+        }
+
         udp_clean_async_state(s);
 
         free(s);
@@ -1024,6 +1399,20 @@ int udp_send(socket_udp * s, char *buffer, int buflen)
         assert(buffer != NULL);
         assert(buflen > 0);
 
+        if (s->red != NULL) {
+                udp_send(s->red, buffer, buflen);
+        }
+
+#ifdef HAVE_LINUX_IF_XDP_H
+        if (s->local->xdp != NULL) {
+                struct iovec iov = { buffer, buflen };
+                int ret = xdp_sendv(s->local->xdp, (struct sockaddr_in *)(void *) &s->sock, &iov, 1);
+                if (!s->xdp_async) {
+                        xdp_flush(s->local->xdp);
+                }
+                return ret;
+        }
+#endif
         return sendto(s->local->tx_fd, buffer, buflen, 0, (struct sockaddr *)&s->sock,
                       s->sock_len);
 }
@@ -1057,12 +1446,180 @@ int udp_sendv(socket_udp * s, LPWSABUF vector, int count, void *d)
         }
 }
 #else
+#ifdef SO_TXTIME
+/// fills SCM_TXTIME control message to msg if requested by udp_set_next_txtime()
+static void udp_add_txtime(socket_udp *s, struct msghdr *msg, char *control, size_t control_len)
+{
+        if (!s->txtime_enabled || s->next_txtime == 0) {
+                return;
+        }
+        memset(control, 0, control_len);
+        msg->msg_control = control;
+        msg->msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+        struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_TXTIME;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        memcpy(CMSG_DATA(cm), &s->next_txtime, sizeof s->next_txtime);
+}
+#endif
+
+#ifdef HAVE_SENDMMSG
+static void udp_batch_dispose(socket_udp *s, int first, int count)
+{
+        for (int i = first; i < first + count; ++i) {
+                free(s->batch_udata[i]);
+        }
+}
+
+static int udp_batch_msg_len(const struct mmsghdr *m)
+{
+        int len = 0;
+        for (unsigned i = 0; i < m->msg_hdr.msg_iovlen; ++i) {
+                len += m->msg_hdr.msg_iov[i].iov_len;
+        }
+        return len;
+}
+
+#ifdef UDP_SEGMENT
+/**
+ * Sends messages starting from first having the same size (except the last
+ * one that may be shorter) as a single GSO super-datagram.
+ *
+ * @returns number of messages consumed, -1 on error
+ */
+static int udp_batch_send_gso(socket_udp *s, int first)
+{
+        const int seg_size = udp_batch_msg_len(&s->batch_msgs[first]);
+        int count = 0;
+        int total = 0;
+        while (first + count < s->batch_count && count < UDP_GSO_MAX_SEGMENTS) {
+                int len = udp_batch_msg_len(&s->batch_msgs[first + count]);
+                if (len > seg_size || total + len > UDP_GSO_MAX_SIZE) {
+                        break;
+                }
+                for (unsigned i = 0; i < s->batch_msgs[first + count].msg_hdr.msg_iovlen; ++i) {
+                        struct iovec *iov = &s->batch_msgs[first + count].msg_hdr.msg_iov[i];
+                        memcpy(s->gso_buf + total, iov->iov_base, iov->iov_len);
+                        total += iov->iov_len;
+                }
+                count += 1;
+                if (len < seg_size) { // shorter segment must be the last one
+                        break;
+                }
+        }
+
+        struct iovec iov = { s->gso_buf, total };
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = { 0 };
+        struct msghdr msg = {
+                .msg_name = &s->sock,
+                .msg_namelen = s->sock_len,
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+        };
+        if (count > 1) {
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof control;
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = seg_size;
+                memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
+        }
+        if (sendmsg(s->local->tx_fd, &msg, 0) == -1) {
+                return -1;
+        }
+        return count;
+}
+#endif // defined UDP_SEGMENT
+
+static void udp_batch_flush(socket_udp *s)
+{
+        int sent = 0;
+        while (sent < s->batch_count) {
+                int ret = 0;
+#ifdef UDP_SEGMENT
+                if (s->local->gso) {
+                        ret = udp_batch_send_gso(s, sent);
+                        if (ret == -1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                                socket_error(MOD_NAME "UDP GSO send failed, disabling GSO");
+                                s->local->gso = false;
+                                continue;
+                        }
+                } else
+#endif
+                {
+                        ret = sendmmsg(s->local->tx_fd, s->batch_msgs + sent, s->batch_count - sent, 0);
+                }
+                if (ret <= 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        socket_error(MOD_NAME "sendmmsg");
+                        break;
+                }
+                sent += ret;
+        }
+        udp_batch_dispose(s, 0, s->batch_count);
+        s->batch_count = 0;
+}
+
+static int udp_batch_enqueue(socket_udp *s, struct iovec *vector, int count, void *d)
+{
+        assert(count <= UDP_SEND_BATCH_MAX_IOV);
+        struct iovec *iov = s->batch_iovs + s->batch_count * UDP_SEND_BATCH_MAX_IOV;
+        int len = 0;
+        for (int i = 0; i < count; ++i) {
+                iov[i] = vector[i];
+                len += vector[i].iov_len;
+        }
+        s->batch_msgs[s->batch_count].msg_hdr = (struct msghdr) {
+                .msg_name = &s->sock,
+                .msg_namelen = s->sock_len,
+                .msg_iov = iov,
+                .msg_iovlen = count,
+        };
+#ifdef SO_TXTIME
+        if (s->batch_control != NULL) {
+                udp_add_txtime(s, &s->batch_msgs[s->batch_count].msg_hdr,
+                                s->batch_control[s->batch_count], sizeof s->batch_control[0]);
+        }
+#endif
+        s->batch_udata[s->batch_count] = d;
+        if (++s->batch_count == s->batch_max) {
+                udp_batch_flush(s);
+        }
+        return len;
+}
+#endif // defined HAVE_SENDMMSG
+
 int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
 {
         struct msghdr msg;
 
         assert(s != NULL);
 
+        if (s->red != NULL) { // sent synchronously, d may be freed after the primary send
+                udp_sendv(s->red, vector, count, NULL);
+        }
+
+#ifdef HAVE_LINUX_IF_XDP_H
+        if (s->local->xdp != NULL) {
+                int ret = xdp_sendv(s->local->xdp, (struct sockaddr_in *)(void *) &s->sock, vector, count);
+                if (!s->xdp_async) {
+                        xdp_flush(s->local->xdp);
+                }
+                free(d);
+                return ret;
+        }
+#endif
+#ifdef HAVE_SENDMMSG
+        if (s->batch_active) {
+                return udp_batch_enqueue(s, vector, count, d);
+        }
+#endif
+
         msg.msg_name = (void *) & s->sock;
         msg.msg_namelen = s->sock_len;
         msg.msg_iov = vector;
@@ -1071,81 +1628,750 @@ int udp_sendv(socket_udp * s, struct iovec *vector, int count, void *d)
         msg.msg_control = 0;
         msg.msg_controllen = 0;
         msg.msg_flags = 0;
+#ifdef SO_TXTIME
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint64_t))];
+        udp_add_txtime(s, &msg, control, sizeof control);
+#endif
 
         int ret = sendmsg(s->local->tx_fd, &msg, 0);
         free(d);
         return ret;
 }
-#endif // WIN32
 
+#ifdef UDP_SEGMENT
 /**
- * When receiving data in separate thread, this function fetches data
- * from socket and puts it in queue.
+ * Sends the datagrams as GSO super-datagrams. Consecutive datagrams of the
+ * same size (the last one may be shorter) are passed as an iovec array so
+ * the data are not copied.
+ *
+ * @returns number of datagrams sent, -1 if nothing was sent
  */
-static void *udp_reader(void *arg)
+static int udp_sendto_gso(socket_udp *s, struct iovec *bufs, int count, struct sockaddr *dst_addr, socklen_t addrlen)
 {
-        set_thread_name(__func__);
-        socket_udp *s = (socket_udp *) arg;
-
-        while (1) {
-                fd_set fds;
-                FD_ZERO(&fds);
-                FD_SET(s->local->rx_fd, &fds);
-                FD_SET(s->local->should_exit_fd[0], &fds);
-                int nfds = MAX(s->local->rx_fd, s->local->should_exit_fd[0]) + 1;
-
-                int rc = select(nfds, &fds, NULL, NULL, NULL);
-                if (rc <= 0) {
-                        socket_error("select");
-                        continue;
+        int sent = 0;
+        while (sent < count) {
+                const size_t seg_size = bufs[sent].iov_len;
+                size_t total = 0;
+                int n = 0;
+                while (sent + n < count && n < UDP_GSO_MAX_SEGMENTS) {
+                        size_t len = bufs[sent + n].iov_len;
+                        if (len > seg_size || total + len > UDP_GSO_MAX_SIZE) {
+                                break;
+                        }
+                        total += len;
+                        n += 1;
+                        if (len < seg_size) { // shorter segment must be the last one
+                                break;
+                        }
                 }
-                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
-                        break;
+                alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = { 0 };
+                struct msghdr msg = {
+                        .msg_name = dst_addr,
+                        .msg_namelen = addrlen,
+                        .msg_iov = bufs + sent,
+                        .msg_iovlen = n,
+                };
+                if (n > 1) {
+                        msg.msg_control = control;
+                        msg.msg_controllen = sizeof control;
+                        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+                        cm->cmsg_level = SOL_UDP;
+                        cm->cmsg_type = UDP_SEGMENT;
+                        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                        uint16_t gso_size = seg_size;
+                        memcpy(CMSG_DATA(cm), &gso_size, sizeof gso_size);
                 }
-                uint8_t *packet = (uint8_t *) malloc(ALIGNED_ITEM_OFF + sizeof(struct item));
-                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
-                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
-                socklen_t addrlen = sizeof(struct sockaddr_storage);
-                int size = recvfrom(s->local->rx_fd, (char *) buffer,
-                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
-                                0, src_addr, &addrlen);
-
-                if (size <= 0) {
-                        /// @todo
-                        /// In MSW, this block is called as often as packet is sent if
-                        /// we got WSAECONNRESET error (noone is listening). This can have
-                        /// negative performance impact.
-                        socket_error("recvfrom");
-                        free(packet);
-                        continue;
+                if (sendmsg(s->local->tx_fd, &msg, 0) == -1) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return sent > 0 ? sent : -1;
                 }
+                sent += n;
+        }
+        return sent;
+}
+#endif // defined UDP_SEGMENT
 
-                pthread_mutex_lock(&s->local->lock);
-                while (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets && !s->local->should_exit) {
-                        pthread_cond_wait(&s->local->reader_cv, &s->local->lock);
+int udp_sendto_multi(socket_udp *s, struct iovec *bufs, int count, struct sockaddr *dst_addr, socklen_t addrlen)
+{
+        int sent = 0;
+#ifdef UDP_SEGMENT
+        if (s->local->gso) {
+                sent = udp_sendto_gso(s, bufs, count, dst_addr, addrlen);
+                if (sent == count) {
+                        return sent;
                 }
-                if (s->local->should_exit) {
-                        free(packet);
-                        pthread_mutex_unlock(&s->local->lock);
-                        break;
+                if (errno != EIO && errno != EINVAL && errno != ENOPROTOOPT) {
+                        return sent;
                 }
-
-                struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
-                *i = (struct item){packet, size, src_addr, addrlen};
-                simple_linked_list_append(s->local->packets, i);
-
-                pthread_mutex_unlock(&s->local->lock);
-                pthread_cond_signal(&s->local->boss_cv);
+                socket_error(MOD_NAME "UDP GSO send failed, disabling GSO");
+                s->local->gso = false;
+                sent = MAX(sent, 0);
         }
+#endif
+#ifdef HAVE_SENDMMSG
+        struct mmsghdr msgs[DEFAULT_UDP_SEND_BATCH];
+        while (sent < count) {
+                int n = MIN(count - sent, DEFAULT_UDP_SEND_BATCH);
+                for (int i = 0; i < n; ++i) {
+                        msgs[i].msg_hdr = (struct msghdr) {
+                                .msg_name = dst_addr,
+                                .msg_namelen = addrlen,
+                                .msg_iov = bufs + sent + i,
+                                .msg_iovlen = 1,
+                        };
+                }
+                int ret = sendmmsg(s->local->tx_fd, msgs, n, 0);
+                if (ret <= 0) {
+                        if (ret == -1 && errno == EINTR) {
+                                continue;
+                        }
+                        return sent > 0 ? sent : -1;
+                }
+                sent += ret;
+        }
+#else
+        for ( ; sent < count; ++sent) {
+                if (sendto(s->local->tx_fd, bufs[sent].iov_base, bufs[sent].iov_len, 0, dst_addr, addrlen) == -1) {
+                        return sent > 0 ? sent : -1;
+                }
+        }
+#endif
+        return sent;
+}
+#endif // WIN32
 
-        platform_pipe_close(s->local->should_exit_fd[0]);
-
-        return NULL;
+static uint8_t *udp_reader_alloc_packet(socket_udp *s)
+{
+        return (uint8_t *) rtp_packet_alloc(s->local->packet_pool);
 }
 
-static int udp_do_recv(socket_udp * s, char *buffer, int buflen, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
+/**
+ * Sets rtp_packet::recv_ts from SCM_TIMESTAMPING control message (raw hardware
+ * timestamp preferred) or from the current time.
+ *
+ * @param msg  received message, may be NULL if there was none (XDP)
+ * @param now  time when the batch containing the packet was received, 0 to read the clock
+ */
+static void udp_reader_set_recv_ts(socket_udp *s, uint8_t *packet, struct msghdr *msg, time_ns_t now)
 {
-        /* Reads data into the buffer, returning the number of bytes read.   */
+        time_ns_t ts = 0;
+        if (s->local->rx_tstamp == UDP_RX_TSTAMP_NONE) {
+                ((rtp_packet *)(void *) packet)->recv_ts = 0;
+                return;
+        }
+#ifdef SO_TIMESTAMPING
+        if (msg != NULL && s->local->rx_tstamp == UDP_RX_TSTAMP_KERNEL) {
+                for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c != NULL; c = CMSG_NXTHDR(msg, c)) {
+                        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPING) {
+                                continue;
+                        }
+                        struct timespec t[3]; // software, deprecated, raw hardware
+                        memcpy(t, CMSG_DATA(c), sizeof t);
+                        const struct timespec *src = t[2].tv_sec != 0 ? &t[2] : &t[0];
+                        ts = src->tv_sec * NS_IN_SEC + src->tv_nsec;
+                }
+        }
+#else
+        UNUSED(msg);
+#endif
+        if (ts == 0) {
+                ts = now != 0 ? now : get_time_in_ns_fast();
+        }
+        ((rtp_packet *)(void *) packet)->recv_ts = ts;
+}
+
+/**
+ * Waits until there is a room in the queue and enqueues packet.
+ *
+ * @note s->local->lock must be held
+ * @retval false if should exit (packet is not enqueued)
+ */
+static bool udp_reader_enqueue_locked(socket_udp *s, uint8_t *packet, int size, socklen_t addrlen)
+{
+        while (simple_linked_list_size(s->local->packets) >= (int) s->local->max_packets && !s->local->should_exit) {
+                pthread_cond_wait(&s->local->reader_cv, &s->local->lock);
+        }
+        if (s->local->should_exit) {
+                return false;
+        }
+
+        struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
+        struct item *i = (struct item *)(void *)(packet + ALIGNED_ITEM_OFF);
+        *i = (struct item){packet, size, src_addr, addrlen};
+        simple_linked_list_append(s->local->packets, i);
+        return true;
+}
+
+static void udp_reader_record(socket_udp *s, uint8_t *packet, int size)
+{
+        const struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
+        uint16_t src_port = 0;
+        if (src_addr->sa_family == AF_INET) {
+                src_port = ntohs(((const struct sockaddr_in *)(const void *) src_addr)->sin_port);
+        } else if (src_addr->sa_family == AF_INET6) {
+                src_port = ntohs(((const struct sockaddr_in6 *)(const void *) src_addr)->sin6_port);
+        }
+        time_ns_t ts = ((rtp_packet *)(void *) packet)->recv_ts;
+        if (!rtp_trace_write(s->local->record, ts != 0 ? ts : get_time_in_ns(), src_port, udp_get_udp_rx_port(s),
+                                (char *) packet + RTP_PACKET_HEADER_SIZE, size)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot write the trace, recording stopped!\n");
+                rtp_trace_close(s->local->record);
+                s->local->record = NULL;
+        }
+}
+
+/**
+ * Passes the received packet through the network impairment (if enabled)
+ * and enqueues the packets that are due.
+ *
+ * @param packet received packet, ownership is always taken; may be NULL to
+ *               only release the impaired packets that are due
+ * @note s->local->lock must be held
+ * @retval false if should exit
+ */
+static bool udp_reader_deliver_locked(socket_udp *s, uint8_t *packet, int size, socklen_t addrlen)
+{
+        if (packet != NULL && s->local->record != NULL) {
+                udp_reader_record(s, packet, size);
+        }
+        struct net_impair *impair = s->local->impair;
+        if (impair == NULL) {
+                if (!udp_reader_enqueue_locked(s, packet, size, addrlen)) {
+                        rtp_packet_free(packet);
+                        return false;
+                }
+                return true;
+        }
+
+        time_ns_t now = get_time_in_ns();
+        if (packet != NULL) {
+                int copies = net_impair_admit(impair);
+                if (copies == 2) {
+                        uint8_t *dup = udp_reader_alloc_packet(s);
+                        memcpy(dup, packet, ALIGNED_ITEM_OFF);
+                        if (!net_impair_enqueue(impair, now, dup, size, addrlen)) {
+                                rtp_packet_free(dup);
+                        }
+                }
+                if (copies == 0 || !net_impair_enqueue(impair, now, packet, size, addrlen)) {
+                        rtp_packet_free(packet);
+                }
+        }
+        uint8_t *due = NULL;
+        int due_size = 0;
+        int due_addrlen = 0;
+        while ((due = net_impair_dequeue(impair, now, &due_size, &due_addrlen)) != NULL) {
+                if (!udp_reader_enqueue_locked(s, due, due_size, due_addrlen)) {
+                        rtp_packet_free(due);
+                        return false;
+                }
+        }
+        return true;
+}
+
+/// @returns false if should exit
+static bool udp_reader_release_impaired(socket_udp *s)
+{
+        pthread_mutex_lock(&s->local->lock);
+        bool ret = udp_reader_deliver_locked(s, NULL, 0, 0);
+        pthread_mutex_unlock(&s->local->lock);
+        pthread_cond_signal(&s->local->boss_cv);
+        return ret;
+}
+
+/// @returns time to wait for incoming data - until the next impaired packet is due, -1 if indefinitely
+static time_ns_t udp_reader_wait_time(socket_udp *s)
+{
+        time_ns_t due = s->local->impair != NULL ? net_impair_next_due(s->local->impair) : -1;
+        return due == -1 ? -1 : MAX(due - get_time_in_ns(), 0);
+}
+
+static struct timeval *udp_reader_select_timeout(socket_udp *s, struct timeval *tv)
+{
+        time_ns_t wait = udp_reader_wait_time(s);
+        if (wait == -1) {
+                return NULL;
+        }
+        tv->tv_sec = wait / NS_IN_SEC;
+        tv->tv_usec = (wait % NS_IN_SEC + 999) / 1000;
+        return tv;
+}
+
+/// @returns nfds for select() waiting for our socket, the redundant path and the exit pipe
+static int udp_reader_fd_set(socket_udp *s, fd_set *fds)
+{
+        FD_ZERO(fds);
+        FD_SET(s->local->rx_fd, fds);
+        FD_SET(s->local->should_exit_fd[0], fds);
+        int nfds = MAX(s->local->rx_fd, s->local->should_exit_fd[0]) + 1;
+        if (s->red != NULL) {
+                FD_SET(s->red->local->rx_fd, fds);
+                nfds = MAX(nfds, (int) s->red->local->rx_fd + 1);
+        }
+        return nfds;
+}
+
+/// @returns socket to read from, alternating if both paths are ready
+static fd_t udp_reader_ready_fd(socket_udp *s, const fd_set *fds)
+{
+        if (s->red == NULL || !FD_ISSET(s->red->local->rx_fd, fds)) {
+                return s->local->rx_fd;
+        }
+        if (!FD_ISSET(s->local->rx_fd, fds)) {
+                return s->red->local->rx_fd;
+        }
+        s->local->red_turn = !s->local->red_turn;
+        return s->local->red_turn ? s->red->local->rx_fd : s->local->rx_fd;
+}
+
+#ifndef WIN32
+enum { UDP_PLACEMENT_MAX_IOV = 3 };
+
+/**
+ * Sets up iovecs for receiving of idx-th datagram of a batch to the packet
+ * buffer or, if the placement predicts the location, header to the packet
+ * buffer, payload to the predicted location and the rest (if the prediction
+ * was too short) to the packet buffer after where the payload would be.
+ *
+ * @returns number of iovecs
+ */
+static int udp_placement_iov(const struct udp_recv_placement *pl, int idx, uint8_t *packet,
+                struct iovec *iov, char **dst, int *dst_len)
+{
+        char *buf = (char *) packet + RTP_PACKET_HEADER_SIZE;
+        const int buf_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+        *dst = pl != NULL ? pl->predict(pl->udata, idx, dst_len) : NULL;
+        if (*dst == NULL || *dst_len <= 0 || *dst_len > buf_len - pl->hdr_len) {
+                *dst = NULL;
+                iov[0] = (struct iovec) { buf, buf_len };
+                return 1;
+        }
+        iov[0] = (struct iovec) { buf, pl->hdr_len };
+        iov[1] = (struct iovec) { *dst, *dst_len };
+        iov[2] = (struct iovec) { buf + pl->hdr_len + *dst_len, buf_len - pl->hdr_len - *dst_len };
+        return 3;
+}
+
+static void udp_placement_commit(const struct udp_recv_placement *pl, uint8_t *packet, int size,
+                char *dst, int dst_len)
+{
+        char *buf = (char *) packet + RTP_PACKET_HEADER_SIZE;
+        int payload_len = size - pl->hdr_len;
+        if (payload_len <= 0) {
+                return;
+        }
+        if (pl->commit(pl->udata, buf, dst != NULL && payload_len <= dst_len ? dst : NULL, payload_len)) {
+                return;
+        }
+        if (dst != NULL) { // move the payload to the packet buffer
+                memcpy(buf + pl->hdr_len, dst, MIN(payload_len, dst_len));
+        }
+}
+
+/**
+ * Sets the placement for the (multithreaded) socket.
+ * @retval false if there is another placement already set
+ */
+bool udp_set_recv_placement(socket_udp *s, const struct udp_recv_placement *p)
+{
+        if (s->local->record != NULL || s->local->replay != NULL) {
+                return false; // placement scatters the payload, the trace needs it contiguous
+        }
+        pthread_mutex_lock(&s->local->placement_lock);
+        bool ret = s->local->placement == NULL;
+        if (ret) {
+                s->local->placement = p;
+        }
+        pthread_mutex_unlock(&s->local->placement_lock);
+        return ret;
+}
+
+/// Removes the placement p if set. After return, no callback is in progress.
+void udp_clear_recv_placement(socket_udp *s, const struct udp_recv_placement *p)
+{
+        pthread_mutex_lock(&s->local->placement_lock);
+        if (s->local->placement == p) {
+                s->local->placement = NULL;
+        }
+        pthread_mutex_unlock(&s->local->placement_lock);
+}
+#endif // ! defined WIN32
+
+#ifdef HAVE_RECVMMSG
+/**
+ * Batched variant of udp_reader() loop body - receives up to recv_batch
+ * datagrams into preallocated slots with a single recvmmsg() and enqueues them
+ * while holding the lock only once per batch. Slots handed to the queue are
+ * replaced from the packet pool (ownership is passed to the consumer that
+ * returns the packet with rtp_packet_free()).
+ */
+static void udp_reader_batched(socket_udp *s)
+{
+        const unsigned int batch = s->local->recv_batch;
+        uint8_t **slots = (uint8_t **) calloc(batch, sizeof slots[0]);
+        struct mmsghdr *msgs = (struct mmsghdr *) calloc(batch, sizeof msgs[0]);
+        struct iovec *iovs = (struct iovec *) calloc(batch * UDP_PLACEMENT_MAX_IOV, sizeof iovs[0]);
+        char **dst = (char **) calloc(batch, sizeof dst[0]);
+        int *dst_len = (int *) calloc(batch, sizeof dst_len[0]);
+#ifdef SO_TIMESTAMPING
+        char *control = (char *) calloc(batch, UDP_RX_TSTAMP_CMSG_SPACE);
+#endif
+
+        for (unsigned int i = 0; i < batch; ++i) {
+                slots[i] = udp_reader_alloc_packet(s);
+        }
+
+        while (1) {
+                fd_set fds;
+                int nfds = udp_reader_fd_set(s, &fds);
+
+                struct timeval tv;
+                int rc = select(nfds, &fds, NULL, NULL, udp_reader_select_timeout(s, &tv));
+                if (rc == 0) {
+                        if (!udp_reader_release_impaired(s)) {
+                                break;
+                        }
+                        continue;
+                }
+                if (rc < 0) {
+                        socket_error("select");
+                        continue;
+                }
+                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                        break;
+                }
+                const fd_t rx_fd = udp_reader_ready_fd(s, &fds);
+
+                pthread_mutex_lock(&s->local->placement_lock);
+                const struct udp_recv_placement *pl = s->local->placement;
+                if (pl != NULL && !pl->begin(pl->udata)) {
+                        pl = NULL;
+                }
+                for (unsigned int i = 0; i < batch; ++i) {
+                        struct iovec *iov = &iovs[i * UDP_PLACEMENT_MAX_IOV];
+                        msgs[i].msg_hdr = (struct msghdr) {
+                                .msg_name = slots[i] + ALIGNED_SOCKADDR_STORAGE_OFF,
+                                .msg_namelen = sizeof(struct sockaddr_storage),
+                                .msg_iov = iov,
+                                .msg_iovlen = udp_placement_iov(pl, i, slots[i], iov, &dst[i], &dst_len[i]),
+                        };
+#ifdef SO_TIMESTAMPING
+                        if (s->local->rx_tstamp == UDP_RX_TSTAMP_KERNEL) {
+                                msgs[i].msg_hdr.msg_control = control + i * UDP_RX_TSTAMP_CMSG_SPACE;
+                                msgs[i].msg_hdr.msg_controllen = UDP_RX_TSTAMP_CMSG_SPACE;
+                        }
+#endif
+                }
+                int count = recvmmsg(rx_fd, msgs, batch, MSG_DONTWAIT, NULL);
+                if (pl != NULL) {
+                        for (int i = 0; i < count; ++i) {
+                                udp_placement_commit(pl, slots[i], msgs[i].msg_len, dst[i], dst_len[i]);
+                        }
+                        pl->end(pl->udata);
+                }
+                pthread_mutex_unlock(&s->local->placement_lock);
+                if (count <= 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                                socket_error("recvmmsg");
+                        }
+                        continue;
+                }
+
+                bool exit_requested = false;
+                const time_ns_t now = s->local->rx_tstamp != UDP_RX_TSTAMP_NONE ? get_time_in_ns_fast() : 0;
+                pthread_mutex_lock(&s->local->lock);
+                for (int i = 0; i < count; ++i) {
+                        if (msgs[i].msg_len == 0) {
+                                continue;
+                        }
+                        udp_reader_set_recv_ts(s, slots[i], &msgs[i].msg_hdr, now);
+                        bool ok = udp_reader_deliver_locked(s, slots[i], msgs[i].msg_len, msgs[i].msg_hdr.msg_namelen);
+                        slots[i] = NULL;
+                        if (!ok) {
+                                exit_requested = true;
+                                break;
+                        }
+                }
+                pthread_mutex_unlock(&s->local->lock);
+                pthread_cond_signal(&s->local->boss_cv);
+
+                for (int i = 0; i < count; ++i) {
+                        if (slots[i] == NULL) {
+                                slots[i] = udp_reader_alloc_packet(s);
+                        }
+                }
+                if (exit_requested) {
+                        break;
+                }
+        }
+
+        for (unsigned int i = 0; i < batch; ++i) {
+                rtp_packet_free(slots[i]);
+        }
+        free(slots);
+        free(msgs);
+        free(iovs);
+        free(dst);
+        free(dst_len);
+#ifdef SO_TIMESTAMPING
+        free(control);
+#endif
+}
+#endif // defined HAVE_RECVMMSG
+
+#ifdef HAVE_LINUX_IF_XDP_H
+/**
+ * Variant of udp_reader_batched() for AF_XDP socket - datagrams are copied
+ * from the UMEM to the packet buffers by xdp_recv().
+ */
+static void udp_reader_xdp(socket_udp *s)
+{
+        enum { BATCH = 64 };
+        uint8_t *slots[BATCH];
+        struct iovec iovs[BATCH];
+        struct sockaddr_in src[BATCH];
+
+        for (unsigned int i = 0; i < BATCH; ++i) {
+                slots[i] = udp_reader_alloc_packet(s);
+        }
+
+        while (1) {
+                struct pollfd fds[] = {
+                        { .fd = xdp_socket_fd(s->local->xdp), .events = POLLIN },
+                        { .fd = s->local->should_exit_fd[0], .events = POLLIN },
+                };
+                time_ns_t wait = udp_reader_wait_time(s);
+                int rc = poll(fds, 2, wait == -1 ? -1 : (int) ((wait + NS_IN_MS - 1) / NS_IN_MS));
+                if (rc == 0) {
+                        if (!udp_reader_release_impaired(s)) {
+                                break;
+                        }
+                        continue;
+                }
+                if (rc < 0) {
+                        socket_error("poll");
+                        continue;
+                }
+                if (fds[1].revents != 0) {
+                        break;
+                }
+
+                for (unsigned int i = 0; i < BATCH; ++i) {
+                        iovs[i].iov_base = slots[i] + RTP_PACKET_HEADER_SIZE;
+                        iovs[i].iov_len = RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE;
+                }
+                int count = xdp_recv(s->local->xdp, iovs, src, BATCH);
+
+                bool exit_requested = false;
+                const time_ns_t now = count > 0 && s->local->rx_tstamp != UDP_RX_TSTAMP_NONE ? get_time_in_ns_fast() : 0;
+                pthread_mutex_lock(&s->local->lock);
+                for (int i = 0; i < count; ++i) {
+                        memcpy(slots[i] + ALIGNED_SOCKADDR_STORAGE_OFF, &src[i], sizeof src[i]);
+                        udp_reader_set_recv_ts(s, slots[i], NULL, now);
+                        bool ok = udp_reader_deliver_locked(s, slots[i], iovs[i].iov_len, sizeof src[i]);
+                        slots[i] = NULL;
+                        if (!ok) {
+                                exit_requested = true;
+                                break;
+                        }
+                }
+                pthread_mutex_unlock(&s->local->lock);
+                pthread_cond_signal(&s->local->boss_cv);
+
+                for (int i = 0; i < count; ++i) {
+                        if (slots[i] == NULL) {
+                                slots[i] = udp_reader_alloc_packet(s);
+                        }
+                }
+                if (exit_requested) {
+                        break;
+                }
+        }
+
+        for (unsigned int i = 0; i < BATCH; ++i) {
+                rtp_packet_free(slots[i]);
+        }
+}
+#endif // defined HAVE_LINUX_IF_XDP_H
+
+/**
+ * Variant of udp_reader() feeding the packets from the trace (udp-replay).
+ * The queue length provides the backpressure, so that no packet is dropped
+ * when replaying as fast as possible.
+ */
+static void udp_reader_replay(socket_udp *s)
+{
+        time_ns_t first_ts = -1;
+        time_ns_t start = get_time_in_ns();
+        while (1) {
+                uint8_t *packet = udp_reader_alloc_packet(s);
+                time_ns_t ts = 0;
+                uint16_t src_port = 0;
+                int size = rtp_trace_read(s->local->replay, &ts, &src_port, NULL,
+                                (char *) packet + RTP_PACKET_HEADER_SIZE, RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE);
+                if (size <= 0) {
+                        rtp_packet_free(packet);
+                        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Replay finished.\n");
+                        break;
+                }
+                if (s->local->replay_realtime) {
+                        first_ts = first_ts == -1 ? ts : first_ts;
+                        time_ns_t wait = (ts - first_ts) - (get_time_in_ns() - start);
+                        if (wait > 0) {
+                                fd_set fds;
+                                FD_ZERO(&fds);
+                                FD_SET(s->local->should_exit_fd[0], &fds);
+                                struct timeval tv = { wait / NS_IN_SEC, wait % NS_IN_SEC / 1000 };
+                                if (select(s->local->should_exit_fd[0] + 1, &fds, NULL, NULL, &tv) > 0) {
+                                        rtp_packet_free(packet);
+                                        return;
+                                }
+                        }
+                }
+                struct sockaddr_in *src_addr = (struct sockaddr_in *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
+                *src_addr = (struct sockaddr_in) { .sin_family = AF_INET, .sin_port = htons(src_port),
+                        .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+                udp_reader_set_recv_ts(s, packet, NULL, 0);
+
+                pthread_mutex_lock(&s->local->lock);
+                if (!udp_reader_deliver_locked(s, packet, size, sizeof *src_addr)) {
+                        pthread_mutex_unlock(&s->local->lock);
+                        return;
+                }
+                pthread_mutex_unlock(&s->local->lock);
+                pthread_cond_signal(&s->local->boss_cv);
+        }
+        // wait for udp_exit() - it writes to the pipe
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(s->local->should_exit_fd[0], &fds);
+        while (select(s->local->should_exit_fd[0] + 1, &fds, NULL, NULL, NULL) < 0 && errno == EINTR) {
+                FD_SET(s->local->should_exit_fd[0], &fds);
+        }
+}
+
+/**
+ * When receiving data in separate thread, this function fetches data
+ * from socket and puts it in queue.
+ */
+static void *udp_reader(void *arg)
+{
+        set_thread_name(__func__);
+        socket_udp *s = (socket_udp *) arg;
+        alloc_stats_push_tag(alloc_stats_tag("udp_reader"));
+
+        if (s->local->replay != NULL) {
+                udp_reader_replay(s);
+                platform_pipe_close(s->local->should_exit_fd[0]);
+                return NULL;
+        }
+
+#ifdef HAVE_LINUX_IF_XDP_H
+        if (s->local->xdp != NULL) {
+                udp_reader_xdp(s);
+                platform_pipe_close(s->local->should_exit_fd[0]);
+                return NULL;
+        }
+#endif
+#ifdef HAVE_RECVMMSG
+        if (s->local->recv_batch > 0) {
+                udp_reader_batched(s);
+                platform_pipe_close(s->local->should_exit_fd[0]);
+                return NULL;
+        }
+#endif
+
+        while (1) {
+                fd_set fds;
+                int nfds = udp_reader_fd_set(s, &fds);
+
+                struct timeval tv;
+                int rc = select(nfds, &fds, NULL, NULL, udp_reader_select_timeout(s, &tv));
+                if (rc == 0) {
+                        if (!udp_reader_release_impaired(s)) {
+                                break;
+                        }
+                        continue;
+                }
+                if (rc < 0) {
+                        socket_error("select");
+                        continue;
+                }
+                if (FD_ISSET(s->local->should_exit_fd[0], &fds)) {
+                        break;
+                }
+                const fd_t rx_fd = udp_reader_ready_fd(s, &fds);
+                uint8_t *packet = udp_reader_alloc_packet(s);
+                struct sockaddr *src_addr = (struct sockaddr *)(void *)(packet + ALIGNED_SOCKADDR_STORAGE_OFF);
+                socklen_t addrlen = sizeof(struct sockaddr_storage);
+#ifdef WIN32
+                uint8_t *buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
+                int size = recvfrom(rx_fd, (char *) buffer,
+                                RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
+                                0, src_addr, &addrlen);
+#else
+                struct iovec iov[UDP_PLACEMENT_MAX_IOV];
+                char *dst = NULL;
+                int dst_len = 0;
+                pthread_mutex_lock(&s->local->placement_lock);
+                const struct udp_recv_placement *pl = s->local->placement;
+                if (pl != NULL && !pl->begin(pl->udata)) {
+                        pl = NULL;
+                }
+                struct msghdr msg = { .msg_name = src_addr, .msg_namelen = addrlen, .msg_iov = iov,
+                        .msg_iovlen = udp_placement_iov(pl, 0, packet, iov, &dst, &dst_len) };
+#ifdef SO_TIMESTAMPING
+                char control[UDP_RX_TSTAMP_CMSG_SPACE];
+                if (s->local->rx_tstamp == UDP_RX_TSTAMP_KERNEL) {
+                        msg.msg_control = control;
+                        msg.msg_controllen = sizeof control;
+                }
+#endif
+                int size = recvmsg(rx_fd, &msg, 0);
+                addrlen = msg.msg_namelen;
+                if (pl != NULL) {
+                        if (size > 0) {
+                                udp_placement_commit(pl, packet, size, dst, dst_len);
+                        }
+                        pl->end(pl->udata);
+                }
+                pthread_mutex_unlock(&s->local->placement_lock);
+#endif
+
+                if (size <= 0) {
+                        /// @todo
+                        /// In MSW, this block is called as often as packet is sent if
+                        /// we got WSAECONNRESET error (noone is listening). This can have
+                        /// negative performance impact.
+                        socket_error("recvfrom");
+                        rtp_packet_free(packet);
+                        continue;
+                }
+#ifdef WIN32
+                udp_reader_set_recv_ts(s, packet, NULL, 0);
+#else
+                udp_reader_set_recv_ts(s, packet, &msg, 0);
+#endif
+
+                pthread_mutex_lock(&s->local->lock);
+                if (!udp_reader_deliver_locked(s, packet, size, addrlen)) {
+                        pthread_mutex_unlock(&s->local->lock);
+                        break;
+                }
+                pthread_mutex_unlock(&s->local->lock);
+                pthread_cond_signal(&s->local->boss_cv);
+        }
+
+        platform_pipe_close(s->local->should_exit_fd[0]);
+
+        return NULL;
+}
+
+static int udp_do_recv(socket_udp * s, char *buffer, int buflen, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
+{
+        /* Reads data into the buffer, returning the number of bytes read.   */
         /* If no data is available, this returns the value zero immediately. */
         /* Note: since we don't care about the source address of the packet  */
         /* we receive, this function becomes protocol independent.           */
@@ -1244,7 +2470,7 @@ int udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_a
  * Receives data from multithreaded socket.
  *
  * @param[in] s       UDP socket state
- * @param[out] buffer data received from socket. Must be freed by caller!
+ * @param[out] buffer data received from socket. Must be freed by caller with rtp_packet_free()!
  * @returns           length of the received datagram
  */
 int udp_recvfrom_data(socket_udp * s, char **buffer,
@@ -1438,6 +2664,9 @@ bool udp_set_recv_buf(socket_udp *s, int size)
 {
         int opt = 0;
         socklen_t opt_size;
+        if (s->red != NULL && !udp_set_recv_buf(s->red, size)) {
+                return false;
+        }
         if (SETSOCKOPT(s->local->rx_fd, SOL_SOCKET, SO_RCVBUF, (sockopt_t) &size,
                         sizeof(size)) != 0) {
                 socket_error("Unable to set socket buffer size");
@@ -1451,7 +2680,18 @@ bool udp_set_recv_buf(socket_udp *s, int size)
                 return false;
         }
 
+#ifdef SO_RCVBUFFORCE
+        // privileged (CAP_NET_ADMIN) processes may exceed net.core.rmem_max
+        if (opt < size && SETSOCKOPT(s->local->rx_fd, SOL_SOCKET, SO_RCVBUFFORCE, (sockopt_t) &size,
+                                sizeof(size)) == 0) {
+                opt_size = sizeof(opt);
+                GETSOCKOPT(s->local->rx_fd, SOL_SOCKET, SO_RCVBUF, (sockopt_t) &opt, &opt_size);
+        }
+#endif
+
         if(opt < size) {
+                log_msg(LOG_LEVEL_WARNING, "Socket recv buffer size capped by the system to %d B (requested %d B).\n",
+                                opt, size);
                 return false;
         }
 
@@ -1486,6 +2726,23 @@ bool udp_set_send_buf(socket_udp *s, int size)
         return true;
 }
 
+/**
+ * Changes the length of the queue between the reader thread and the
+ * consumer (udp-queue-len) of a running multithreaded socket.
+ */
+bool udp_set_queue_len(socket_udp *s, unsigned int len)
+{
+        if (!s->local->multithreaded || len == 0) {
+                return false;
+        }
+        pthread_mutex_lock(&s->local->lock);
+        s->local->max_packets = len;
+        pthread_mutex_unlock(&s->local->lock);
+        pthread_cond_signal(&s->local->reader_cv);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Reader queue length set to %u.\n", len);
+        return true;
+}
+
 /*
  * TODO: This should be definitely removed. We need to solve audio burst avoidance first.
  */
@@ -1518,6 +2775,10 @@ void udp_flush_recv_buf(socket_udp *s)
  * By calling this function under MSW, caller indicates that following packets
  * can be send in asynchronous manner. Caller should then call udp_async_wait()
  * to ensure that all packets were actually sent.
+ *
+ * If udp-send-batch is enabled (Linux), the packets are queued and sent with
+ * sendmmsg() (or as GSO super-datagrams) once the batch is full or in
+ * udp_async_wait(). Data passed to udp_sendv() must remain valid until then.
  */
 void udp_async_start(socket_udp *s, int nr_packets)
 {
@@ -1540,6 +2801,33 @@ void udp_async_start(socket_udp *s, int nr_packets)
 
         s->overlapped_count = 0;
         s->overlapping_active = true;
+#elif defined HAVE_SENDMMSG
+        UNUSED(nr_packets);
+#ifdef HAVE_LINUX_IF_XDP_H
+        if (s->local->xdp != NULL) {
+                s->xdp_async = true;
+                return;
+        }
+#endif
+        if (s->local->send_batch == 0) {
+                return;
+        }
+        if (s->batch_max == 0) {
+                s->batch_max = s->local->send_batch;
+                s->batch_msgs = (struct mmsghdr *) calloc(s->batch_max, sizeof s->batch_msgs[0]);
+                s->batch_iovs = (struct iovec *) calloc(s->batch_max * UDP_SEND_BATCH_MAX_IOV, sizeof s->batch_iovs[0]);
+                s->batch_udata = (void **) calloc(s->batch_max, sizeof s->batch_udata[0]);
+                if (s->local->gso) {
+                        s->gso_buf = (char *) malloc(UDP_GSO_MAX_SIZE);
+                }
+        }
+#ifdef SO_TXTIME
+        if (s->txtime_enabled && s->batch_control == NULL) {
+                s->batch_control = calloc(s->batch_max, sizeof s->batch_control[0]);
+        }
+#endif
+        s->batch_count = 0;
+        s->batch_active = true;
 #else
         UNUSED(nr_packets);
         UNUSED(s);
@@ -1568,6 +2856,19 @@ void udp_async_wait(socket_udp *s)
                 free(s->dispose_udata[i]);
         }
         s->overlapping_active = false;
+#elif defined HAVE_SENDMMSG
+#ifdef HAVE_LINUX_IF_XDP_H
+        if (s->xdp_async) {
+                xdp_flush(s->local->xdp);
+                s->xdp_async = false;
+                return;
+        }
+#endif
+        if (!s->batch_active) {
+                return;
+        }
+        udp_batch_flush(s);
+        s->batch_active = false;
 #else
         UNUSED(s);
 #endif
@@ -1582,11 +2883,96 @@ static void udp_clean_async_state(socket_udp *s)
         free(s->overlapped);
         free(s->overlapped_events);
         free(s->dispose_udata);
+#elif defined HAVE_SENDMMSG
+        udp_batch_dispose(s, 0, s->batch_count); // unsent packets (s->local may be already freed)
+        free(s->batch_msgs);
+        free(s->batch_iovs);
+        free(s->batch_udata);
+        free(s->gso_buf);
+#ifdef SO_TXTIME
+        free(s->batch_control);
+#endif
 #else
         UNUSED(s);
 #endif
 }
 
+/**
+ * Enables kernel-side pacing with SO_TXTIME. Requires fq (or etf for
+ * CLOCK_TAI deadlines) qdisc on outgoing interface to have an effect.
+ *
+ * @sa udp_set_next_txtime
+ */
+bool udp_enable_txtime(socket_udp *s)
+{
+#ifdef SO_TXTIME
+        if (s->txtime_enabled) {
+                return true;
+        }
+        struct sock_txtime cfg = { .clockid = CLOCK_MONOTONIC, .flags = 0 };
+        if (SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_TXTIME, (sockopt_t) &cfg, sizeof cfg) != 0) {
+                socket_error(MOD_NAME "setsockopt SO_TXTIME");
+                return false;
+        }
+        s->txtime_enabled = true;
+        return true;
+#else
+        UNUSED(s);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "SO_TXTIME not supported on this platform!\n");
+        return false;
+#endif
+}
+
+/**
+ * Sets transmit time for subsequently sent packets.
+ *
+ * @param txtime_ns CLOCK_MONOTONIC time in nanoseconds, 0 to send immediately
+ */
+void udp_set_next_txtime(socket_udp *s, uint64_t txtime_ns)
+{
+#ifdef SO_TXTIME
+        s->next_txtime = txtime_ns;
+#else
+        UNUSED(s), UNUSED(txtime_ns);
+#endif
+}
+
+/**
+ * Marks outgoing packets with DiffServ code point and sets local (qdisc)
+ * priority of the socket.
+ *
+ * @param dscp        DSCP (0-63), -1 to keep current
+ * @param so_priority SO_PRIORITY (Linux only, ignored elsewhere), -1 to keep current
+ */
+bool udp_set_priority(socket_udp *s, int dscp, int so_priority)
+{
+        bool ret = true;
+        if (dscp >= 0) {
+                int tos = dscp << 2;
+#ifdef IPV6_TCLASS
+                if (s->local->mode == IPv6 && SETSOCKOPT(s->local->tx_fd, IPPROTO_IPV6, IPV6_TCLASS, (sockopt_t) &tos, sizeof tos) != 0) {
+                        socket_error(MOD_NAME "setsockopt IPV6_TCLASS");
+                        ret = false;
+                }
+#endif
+                // IPv4 or IPv4-mapped destination of a dual-stack socket
+                if (!udp_is_ipv6(s) && SETSOCKOPT(s->local->tx_fd, IPPROTO_IP, IP_TOS, (sockopt_t) &tos, sizeof tos) != 0) {
+                        socket_error(MOD_NAME "setsockopt IP_TOS");
+                        ret = false;
+                }
+        }
+#ifdef SO_PRIORITY
+        // after IP_TOS, which resets the priority on Linux
+        if (so_priority >= 0 && SETSOCKOPT(s->local->tx_fd, SOL_SOCKET, SO_PRIORITY, (sockopt_t) &so_priority, sizeof so_priority) != 0) {
+                socket_error(MOD_NAME "setsockopt SO_PRIORITY");
+                ret = false;
+        }
+#else
+        UNUSED(so_priority);
+#endif
+        return ret;
+}
+
 bool udp_is_ipv6(socket_udp *s)
 {
         return s->local->mode == IPv6 && !IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *) &s->sock)->sin6_addr);
@@ -1718,7 +3104,7 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
                         if (len > 0) {
                                 memcpy(buffer, data, len);
                         }
-                        free(data);
+                        rtp_packet_free(data);
                 }
         } else {
                 udp_fd_zero_r(&fd);
@@ -1735,6 +3121,52 @@ int udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
         return len;
 }
 
+int udp_recvfrom_multi(socket_udp *s, char **bufs, int buflen, int *lens, int count,
+                struct timeval *timeout, struct sockaddr_storage *src_addrs, socklen_t *addrlens)
+{
+        if (s->local->multithreaded) {
+                addrlens[0] = sizeof src_addrs[0];
+                lens[0] = udp_recvfrom_timeout(s, bufs[0], buflen, timeout, (struct sockaddr *) &src_addrs[0], &addrlens[0]);
+                return lens[0] > 0 ? 1 : 0;
+        }
+
+        struct udp_fd_r fd;
+        udp_fd_zero_r(&fd);
+        udp_fd_set_r(s, &fd);
+        if (udp_select_r(timeout, &fd) <= 0 || !udp_fd_isset_r(s, &fd)) {
+                return 0;
+        }
+#ifdef HAVE_RECVMMSG
+        struct mmsghdr msgs[DEFAULT_UDP_RECV_BATCH];
+        struct iovec iov[DEFAULT_UDP_RECV_BATCH];
+        count = MIN(count, DEFAULT_UDP_RECV_BATCH);
+        for (int i = 0; i < count; ++i) {
+                iov[i].iov_base = bufs[i];
+                iov[i].iov_len = buflen;
+                msgs[i].msg_hdr = (struct msghdr) {
+                        .msg_name = &src_addrs[i],
+                        .msg_namelen = sizeof src_addrs[i],
+                        .msg_iov = &iov[i],
+                        .msg_iovlen = 1,
+                };
+        }
+        int ret = recvmmsg(s->local->rx_fd, msgs, count, MSG_DONTWAIT, NULL);
+        if (ret < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        for (int i = 0; i < ret; ++i) {
+                lens[i] = msgs[i].msg_len;
+                addrlens[i] = msgs[i].msg_hdr.msg_namelen;
+        }
+        return ret;
+#else
+        UNUSED(count);
+        addrlens[0] = sizeof src_addrs[0];
+        lens[0] = udp_recvfrom(s, bufs[0], buflen, (struct sockaddr *) &src_addrs[0], &addrlens[0]);
+        return lens[0] < 0 ? -1 : 1;
+#endif
+}
+
 int udp_recv_timeout(socket_udp *s, char *buffer, int buflen, struct timeval *timeout)
 {
         return udp_recvfrom_timeout(s, buffer, buflen, timeout, NULL, NULL);
@@ -64,6 +64,7 @@ bool        udp_addr_valid(const char *addr);
 socket_udp *udp_init(const char *addr, uint16_t rx_port, uint16_t tx_port, int ttl, int force_ip_version, bool multithreaded);
 socket_udp *udp_init_if(const char *addr, const char *iface, uint16_t rx_port, uint16_t tx_port, int ttl, int force_ip_version, bool multithreaded);
 void        udp_exit(socket_udp *s);
+bool        udp_add_redundant_path(socket_udp *s, socket_udp *red);
 
 int         udp_peek(socket_udp *s, char *buffer, int buflen);
 int         udp_recv(socket_udp *s, char *buffer, int buflen);
@@ -72,16 +73,37 @@ int         udp_recvfrom_timeout(socket_udp *s, char *buffer, int buflen,
                 struct timeval *timeout,
                 struct sockaddr *src_addr, socklen_t *addrlen);
 int         udp_recvfrom(socket_udp *s, char *buffer, int buflen, struct sockaddr *src_addr, socklen_t *addrlen);
+/**
+ * Waits up to timeout for incoming data and then receives up to count
+ * datagrams with a single recvmmsg() call (if available, otherwise one).
+ *
+ * @param bufs      count buffers, each of buflen bytes
+ * @param[out] lens lengths of received datagrams
+ * @returns number of datagrams received (0 on timeout), -1 on error
+ */
+int         udp_recvfrom_multi(socket_udp *s, char **bufs, int buflen, int *lens, int count,
+                struct timeval *timeout, struct sockaddr_storage *src_addrs, socklen_t *addrlens);
 int         udp_send(socket_udp *s, char *buffer, int buflen);
 int         udp_sendto(socket_udp *s, char *buffer, int buflen, struct sockaddr *dst_addr, socklen_t addrlen);
 
 int         udp_recvv(socket_udp *s, struct msghdr *m);
 void        udp_async_start(socket_udp *s, int nr_packets);
 void        udp_async_wait(socket_udp *s);
+bool        udp_enable_txtime(socket_udp *s);
+void        udp_set_next_txtime(socket_udp *s, uint64_t txtime_ns);
+bool        udp_set_priority(socket_udp *s, int dscp, int so_priority);
 #ifdef WIN32
 int         udp_sendv(socket_udp *s, LPWSABUF vector, int count, void *d);
 #else
 int         udp_sendv(socket_udp *s, struct iovec *vector, int count, void *d);
+/**
+ * Sends count datagrams (one buffer each) to the given address using as few
+ * syscalls as possible - sendmmsg() or UDP GSO (if udp-gso param is given).
+ * The buffers are not copied.
+ *
+ * @returns number of datagrams sent, -1 if none was sent
+ */
+int         udp_sendto_multi(socket_udp *s, struct iovec *bufs, int count, struct sockaddr *dst_addr, socklen_t addrlen);
 #endif
 
 char       *udp_host_addr(socket_udp *s);
@@ -94,6 +116,7 @@ int         udp_fd_isset(socket_udp *s);
 
 bool        udp_set_recv_buf(socket_udp *s, int size);
 bool        udp_set_send_buf(socket_udp *s, int size);
+bool        udp_set_queue_len(socket_udp *s, unsigned int len);
 void        udp_flush_recv_buf(socket_udp *s);
 
 struct udp_fd_r {
@@ -110,6 +133,31 @@ int         udp_recv_data(socket_udp * s, char **buffer);
 int         udp_recvfrom_data(socket_udp * s, char **buffer,
                 struct sockaddr *src_addr, socklen_t *addrlen);
 bool        udp_not_empty(socket_udp *s, struct timeval *timeout);
+
+/**
+ * Hooks letting the reader thread of a multithreaded socket receive the
+ * payload of datagrams directly to its final location (eg. framebuffer).
+ * The first hdr_len bytes are always received to the packet buffer. All
+ * callbacks are called from the reader thread.
+ */
+struct udp_recv_placement {
+        int hdr_len;
+        /// called before receiving a batch of datagrams, returns false to receive the batch normally
+        bool (*begin)(void *udata);
+        /// returns expected location of payload of idx-th datagram in the batch with capacity *len (or NULL)
+        char *(*predict)(void *udata, int idx, int *len);
+        /**
+         * called for every received datagram, dst is the predicted location if the whole
+         * payload was received there (NULL otherwise)
+         * @retval true    the payload was consumed in dst, packet buffer contains just the header
+         * @retval false   the payload is moved to the packet buffer (if needed)
+         */
+        bool (*commit)(void *udata, const char *hdr, char *dst, int payload_len);
+        void (*end)(void *udata);
+        void *udata;
+};
+bool        udp_set_recv_placement(socket_udp *s, const struct udp_recv_placement *p);
+void        udp_clear_recv_placement(socket_udp *s, const struct udp_recv_placement *p);
 int         udp_port_pair_is_free(int force_ip_version, int even_port);
 bool        udp_is_ipv6(socket_udp *s);
 
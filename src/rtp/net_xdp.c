@@ -0,0 +1,673 @@
+/**
+ * @file   rtp/net_xdp.c
+ * @brief  AF_XDP backend for socket_udp (Linux)
+ *
+ * The socket consists of an UMEM area split into RX and TX frames and the
+ * four rings shared with the kernel. A minimal XDP program (assembled here
+ * to avoid dependency on libbpf/libxdp) redirects IPv4/UDP datagrams for
+ * the bound port into the socket, everything else is passed to the kernel.
+ * Ethernet/IP/UDP headers are parsed and built here, the destination MAC
+ * address is taken from the kernel neighbour table.
+ *
+ * Only a single flow per NIC queue is supported. On multiqueue NICs, the
+ * flow must be steered to the selected queue, eg.:
+ *
+ *     ethtool -N <iface> flow-type udp4 dst-port <port> action <queue>
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#ifdef HAVE_LINUX_IF_XDP_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "rtp/net_xdp.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+
+#define MOD_NAME "[RTP XDP] "
+
+#define XDP_FRAME_SIZE 4096 ///< UMEM chunk size (incl. Ethernet/IP/UDP headers)
+#define XDP_RING_SIZE 2048
+#define XDP_RX_FRAMES XDP_RING_SIZE ///< all RX frames are either in fill or RX ring
+#define XDP_TX_FRAMES XDP_RING_SIZE
+#define XDP_TX_KICK_BATCH 32 ///< wake up the kernel after this number of queued packets
+#define XDP_HDR_LEN (sizeof(struct ethhdr) + sizeof(struct iphdr) + sizeof(struct udphdr))
+
+struct xsk_ring {
+        uint32_t *producer;
+        uint32_t *consumer;
+        uint32_t *flags;
+        void *desc;
+        void *map;
+        size_t map_len;
+};
+
+struct xdp_socket {
+        int fd;
+        int map_fd;
+        int prog_fd;
+        int link_fd;
+        unsigned int ifindex;
+        uint32_t queue;
+
+        unsigned char *umem;
+        size_t umem_len;
+        struct xsk_ring rx;
+        struct xsk_ring tx;
+        struct xsk_ring fill;
+        struct xsk_ring comp;
+
+        uint64_t tx_free[XDP_TX_FRAMES]; ///< stack of free TX frame addresses
+        int tx_free_count;
+        int tx_unkicked;
+
+        unsigned char src_mac[ETH_ALEN];
+        unsigned char dst_mac[ETH_ALEN];
+        bool dst_mac_forced;
+        uint32_t src_ip;         ///< network order
+        uint16_t src_port;       ///< network order
+        uint32_t cached_dst_ip;  ///< destination for which is dst_mac valid, network order
+        bool dst_mac_valid;
+        uint16_t ip_id;
+        uint8_t ttl;
+};
+
+static long sys_bpf(int cmd, union bpf_attr *attr)
+{
+        return syscall(__NR_bpf, cmd, attr, sizeof *attr);
+}
+
+#define INSN(op, d, s, o, i) (struct bpf_insn) { .code = (op), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) }
+#define LDX(size, dst, src, off) INSN(BPF_LDX | BPF_MEM | (size), dst, src, off, 0)
+#define MOV(dst, src) INSN(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0)
+#define MOV_IMM(dst, imm) INSN(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm)
+#define ADD_IMM(dst, imm) INSN(BPF_ALU64 | BPF_ADD | BPF_K, dst, 0, 0, imm)
+#define AND_IMM(dst, imm) INSN(BPF_ALU64 | BPF_AND | BPF_K, dst, 0, 0, imm)
+#define JGT(dst, src, off) INSN(BPF_JMP | BPF_JGT | BPF_X, dst, src, off, 0)
+#define JNE_IMM(dst, imm, off) INSN(BPF_JMP | BPF_JNE | BPF_K, dst, 0, off, imm)
+#define CALL(func) INSN(BPF_JMP | BPF_CALL, 0, 0, 0, func)
+#define EXIT() INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+/**
+ * Loads XDP program equivalent to:
+ *
+ *     if (eth->h_proto == htons(ETH_P_IP) && ip->ihl == 5 && ip->protocol == IPPROTO_UDP
+ *                     && !(ip->frag_off & htons(IP_MF | IP_OFFMASK)) && udp->dest == htons(port)) {
+ *             return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+ *     }
+ *     return XDP_PASS;
+ */
+static int load_xdp_prog(int map_fd, uint16_t port)
+{
+        enum { R0, R1, R2, R3, R4, R5, R6 };
+        const int eth_len = sizeof(struct ethhdr);
+        struct bpf_insn prog[] = {
+                MOV(R6, R1),
+                LDX(BPF_W, R2, R1, offsetof(struct xdp_md, data)),
+                LDX(BPF_W, R3, R1, offsetof(struct xdp_md, data_end)),
+                MOV(R4, R2),
+                ADD_IMM(R4, XDP_HDR_LEN),
+                JGT(R4, R3, 17), // -> pass
+                LDX(BPF_H, R5, R2, offsetof(struct ethhdr, h_proto)),
+                JNE_IMM(R5, htons(ETH_P_IP), 15),
+                LDX(BPF_B, R5, R2, eth_len), // version + IHL
+                JNE_IMM(R5, 0x45, 13),
+                LDX(BPF_B, R5, R2, eth_len + offsetof(struct iphdr, protocol)),
+                JNE_IMM(R5, IPPROTO_UDP, 11),
+                LDX(BPF_H, R5, R2, eth_len + offsetof(struct iphdr, frag_off)),
+                AND_IMM(R5, htons(IP_MF | IP_OFFMASK)),
+                JNE_IMM(R5, 0, 8),
+                LDX(BPF_H, R5, R2, eth_len + sizeof(struct iphdr) + offsetof(struct udphdr, dest)),
+                JNE_IMM(R5, htons(port), 6),
+                LDX(BPF_W, R2, R6, offsetof(struct xdp_md, rx_queue_index)),
+                INSN(BPF_LD | BPF_DW | BPF_IMM, R1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+                INSN(0, 0, 0, 0, 0), // 2nd half of ld_imm64
+                MOV_IMM(R3, XDP_PASS),
+                CALL(BPF_FUNC_redirect_map),
+                EXIT(),
+                MOV_IMM(R0, XDP_PASS), // pass:
+                EXIT(),
+        };
+        char log[4096] = "";
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns = (uintptr_t) prog;
+        attr.insn_cnt = sizeof prog / sizeof prog[0];
+        attr.license = (uintptr_t) "Dual BSD/GPL";
+        attr.log_buf = (uintptr_t) log;
+        attr.log_size = sizeof log;
+        attr.log_level = 1;
+        int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+        if (fd < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot load XDP program: %s\n%s", strerror(errno), log);
+        }
+        return fd;
+}
+
+static bool attach_xdp_prog(struct xdp_socket *s, uint16_t port, bool skb_mode)
+{
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.map_type = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size = sizeof(uint32_t);
+        attr.value_size = sizeof(int);
+        attr.max_entries = s->queue + 1;
+        if ((s->map_fd = sys_bpf(BPF_MAP_CREATE, &attr)) < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create XSK map: %s\n", strerror(errno));
+                return false;
+        }
+        memset(&attr, 0, sizeof attr);
+        attr.map_fd = s->map_fd;
+        attr.key = (uintptr_t) &s->queue;
+        attr.value = (uintptr_t) &s->fd;
+        if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot insert socket to XSK map: %s\n", strerror(errno));
+                return false;
+        }
+        if ((s->prog_fd = load_xdp_prog(s->map_fd, port)) < 0) {
+                return false;
+        }
+        // try native (driver) mode first, the kernel refuses if not supported by the driver
+        for (int i = skb_mode ? 1 : 0; i < 2; ++i) {
+                memset(&attr, 0, sizeof attr);
+                attr.link_create.prog_fd = s->prog_fd;
+                attr.link_create.target_ifindex = s->ifindex;
+                attr.link_create.attach_type = BPF_XDP;
+                attr.link_create.flags = i == 0 ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+                if ((s->link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) >= 0) {
+                        verbose_msg(MOD_NAME "XDP program attached in %s mode\n", i == 0 ? "native" : "generic");
+                        return true;
+                }
+        }
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot attach XDP program: %s\n", strerror(errno));
+        return false;
+}
+
+static bool map_ring(struct xdp_socket *s, struct xsk_ring *r, const struct xdp_ring_offset *off,
+                size_t desc_size, off_t pgoff)
+{
+        r->map_len = off->desc + XDP_RING_SIZE * desc_size;
+        r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s->fd, pgoff);
+        if (r->map == MAP_FAILED) {
+                r->map = NULL;
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot map ring: %s\n", strerror(errno));
+                return false;
+        }
+        r->producer = (uint32_t *)(void *)((char *) r->map + off->producer);
+        r->consumer = (uint32_t *)(void *)((char *) r->map + off->consumer);
+        r->flags = (uint32_t *)(void *)((char *) r->map + off->flags);
+        r->desc = (char *) r->map + off->desc;
+        return true;
+}
+
+static bool setup_umem_and_rings(struct xdp_socket *s)
+{
+        s->umem_len = (size_t) (XDP_RX_FRAMES + XDP_TX_FRAMES) * XDP_FRAME_SIZE;
+        s->umem = mmap(NULL, s->umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (s->umem == MAP_FAILED) {
+                s->umem = NULL;
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate UMEM: %s\n", strerror(errno));
+                return false;
+        }
+        struct xdp_umem_reg reg = { .addr = (uintptr_t) s->umem, .len = s->umem_len,
+                .chunk_size = XDP_FRAME_SIZE, .headroom = 0 };
+        if (setsockopt(s->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof reg) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot register UMEM: %s\n", strerror(errno));
+                return false;
+        }
+        const int ring_size = XDP_RING_SIZE;
+        const int rings[] = { XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING };
+        for (unsigned i = 0; i < sizeof rings / sizeof rings[0]; ++i) {
+                if (setsockopt(s->fd, SOL_XDP, rings[i], &ring_size, sizeof ring_size) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot set ring size: %s\n", strerror(errno));
+                        return false;
+                }
+        }
+        struct xdp_mmap_offsets off;
+        socklen_t optlen = sizeof off;
+        if (getsockopt(s->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot get ring offsets: %s\n", strerror(errno));
+                return false;
+        }
+        return map_ring(s, &s->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) &&
+                map_ring(s, &s->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) &&
+                map_ring(s, &s->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) &&
+                map_ring(s, &s->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+}
+
+static bool bind_socket(struct xdp_socket *s, bool force_copy)
+{
+        struct sockaddr_xdp sxdp = { .sxdp_family = AF_XDP, .sxdp_ifindex = s->ifindex,
+                .sxdp_queue_id = s->queue };
+        for (int i = force_copy ? 1 : 0; i < 2; ++i) {
+                sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | (i == 0 ? XDP_ZEROCOPY : XDP_COPY);
+                if (bind(s->fd, (struct sockaddr *) &sxdp, sizeof sxdp) == 0) {
+                        verbose_msg(MOD_NAME "AF_XDP socket bound in %s mode\n", i == 0 ? "zero-copy" : "copy");
+                        return true;
+                }
+        }
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot bind AF_XDP socket to queue %" PRIu32 ": %s\n", s->queue, strerror(errno));
+        return false;
+}
+
+static bool get_iface_addrs(struct xdp_socket *s, const char *iface)
+{
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof ifr);
+        snprintf(ifr.ifr_name, sizeof ifr.ifr_name, "%s", iface);
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        bool ret = fd >= 0 && ioctl(fd, SIOCGIFHWADDR, &ifr) == 0;
+        if (ret) {
+                memcpy(s->src_mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+                ret = ioctl(fd, SIOCGIFADDR, &ifr) == 0;
+        }
+        if (ret) {
+                s->src_ip = ((struct sockaddr_in *)(void *) &ifr.ifr_addr)->sin_addr.s_addr;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot get %s addresses (is IPv4 address assigned?): %s\n", iface, strerror(errno));
+        }
+        if (fd >= 0) {
+                close(fd);
+        }
+        return ret;
+}
+
+static bool parse_mac(const char *str, unsigned char *mac)
+{
+        unsigned int b[ETH_ALEN];
+        if (sscanf(str, "%x-%x-%x-%x-%x-%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETH_ALEN) {
+                return false;
+        }
+        for (int i = 0; i < ETH_ALEN; ++i) {
+                mac[i] = b[i];
+        }
+        return true;
+}
+
+/// @returns value of option opt in cfg (<iface>[:opt=val]...) or NULL
+static const char *get_opt(const char *cfg, const char *opt, char *buf, size_t buflen)
+{
+        const char *item = strchr(cfg, ':');
+        while (item != NULL) {
+                item += 1;
+                size_t len = strcspn(item, ":");
+                if (strncmp(item, opt, strlen(opt)) == 0 && (item[strlen(opt)] == '=' || item[strlen(opt)] == ':' || item[strlen(opt)] == '\0')) {
+                        const char *val = item + strlen(opt) + (item[strlen(opt)] == '=' ? 1 : 0);
+                        snprintf(buf, buflen, "%.*s", (int) (len - (val - item)), val);
+                        return buf;
+                }
+                item = strchr(item, ':');
+        }
+        return NULL;
+}
+
+bool xdp_socket_port_matches(const char *cfg, uint16_t rx_port)
+{
+        char val[32];
+        return get_opt(cfg, "port", val, sizeof val) == NULL || atoi(val) == rx_port;
+}
+
+struct xdp_socket *xdp_socket_init(const char *cfg, uint16_t rx_port)
+{
+        if (strlen(cfg) == 0 || strcmp(cfg, "help") == 0) {
+                color_printf("AF_XDP socket backend usage:\n");
+                color_printf("\t" TBOLD("--param udp-xdp=<iface>[:queue=<q>][:port=<p>][:dst-mac=<mac>][:copy][:skb]") "\n");
+                color_printf("where\n");
+                color_printf("\t" TBOLD("queue") "   - NIC RX/TX queue to bind to (default 0)\n");
+                color_printf("\t" TBOLD("port") "    - use XDP only for socket bound to this port (default first RTP socket)\n");
+                color_printf("\t" TBOLD("dst-mac") " - destination MAC address (aa-bb-cc-dd-ee-ff), default from neighbour table\n");
+                color_printf("\t" TBOLD("copy") "    - do not try zero-copy mode\n");
+                color_printf("\t" TBOLD("skb") "     - attach the program in generic (SKB) mode\n");
+                color_printf("\nOnly IPv4 is supported. Requires CAP_NET_ADMIN and CAP_BPF (or root).\n");
+                return NULL;
+        }
+        char iface[IF_NAMESIZE];
+        char val[64];
+        snprintf(iface, sizeof iface, "%.*s", (int) strcspn(cfg, ":"), cfg);
+
+        struct xdp_socket *s = calloc(1, sizeof *s);
+        s->fd = s->map_fd = s->prog_fd = s->link_fd = -1;
+        s->ttl = 255;
+        s->src_port = htons(rx_port);
+        if (get_opt(cfg, "queue", val, sizeof val) != NULL) {
+                s->queue = atoi(val);
+        }
+        if (get_opt(cfg, "dst-mac", val, sizeof val) != NULL) {
+                if (!parse_mac(val, s->dst_mac)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong MAC address: %s\n", val);
+                        goto error;
+                }
+                s->dst_mac_forced = true;
+        }
+        if ((s->ifindex = if_nametoindex(iface)) == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown interface %s\n", iface);
+                goto error;
+        }
+        if (!get_iface_addrs(s, iface)) {
+                goto error;
+        }
+        if ((s->fd = socket(AF_XDP, SOCK_RAW, 0)) < 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create AF_XDP socket: %s\n", strerror(errno));
+                goto error;
+        }
+        if (!setup_umem_and_rings(s) ||
+                        !bind_socket(s, get_opt(cfg, "copy", val, sizeof val) != NULL) ||
+                        !attach_xdp_prog(s, rx_port, get_opt(cfg, "skb", val, sizeof val) != NULL)) {
+                goto error;
+        }
+
+        uint64_t *fill = s->fill.desc;
+        for (int i = 0; i < XDP_RX_FRAMES; ++i) {
+                fill[i] = (uint64_t) i * XDP_FRAME_SIZE;
+        }
+        __atomic_store_n(s->fill.producer, XDP_RX_FRAMES, __ATOMIC_RELEASE);
+        for (int i = 0; i < XDP_TX_FRAMES; ++i) {
+                s->tx_free[i] = (uint64_t) (XDP_RX_FRAMES + i) * XDP_FRAME_SIZE;
+        }
+        s->tx_free_count = XDP_TX_FRAMES;
+
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Using AF_XDP socket on %s queue %" PRIu32 " for port %" PRIu16 "\n", iface, s->queue, rx_port);
+        return s;
+error:
+        xdp_socket_destroy(s);
+        return NULL;
+}
+
+void xdp_socket_destroy(struct xdp_socket *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        const int fds[] = { s->link_fd, s->prog_fd, s->map_fd, s->fd };
+        for (unsigned i = 0; i < sizeof fds / sizeof fds[0]; ++i) {
+                if (fds[i] >= 0) {
+                        close(fds[i]);
+                }
+        }
+        struct xsk_ring *rings[] = { &s->rx, &s->tx, &s->fill, &s->comp };
+        for (unsigned i = 0; i < sizeof rings / sizeof rings[0]; ++i) {
+                if (rings[i]->map != NULL) {
+                        munmap(rings[i]->map, rings[i]->map_len);
+                }
+        }
+        if (s->umem != NULL) {
+                munmap(s->umem, s->umem_len);
+        }
+        free(s);
+}
+
+int xdp_socket_fd(struct xdp_socket *s)
+{
+        return s->fd;
+}
+
+int xdp_recv(struct xdp_socket *s, struct iovec *bufs, struct sockaddr_in *src, int count)
+{
+        const uint32_t mask = XDP_RING_SIZE - 1;
+        uint32_t cons = *s->rx.consumer;
+        uint32_t avail = __atomic_load_n(s->rx.producer, __ATOMIC_ACQUIRE) - cons;
+        uint32_t n = MIN(avail, (uint32_t) count);
+        uint32_t fill_prod = *s->fill.producer;
+        const struct xdp_desc *rx = s->rx.desc;
+        uint64_t *fill = s->fill.desc;
+        int received = 0;
+
+        for (uint32_t i = 0; i < n; ++i) {
+                const struct xdp_desc *d = &rx[(cons + i) & mask];
+                const unsigned char *frame = s->umem + d->addr;
+                const struct iphdr *ip = (const void *) (frame + sizeof(struct ethhdr));
+                const struct udphdr *udp = (const void *) ((const char *) ip + ip->ihl * 4);
+                const unsigned char *payload = (const unsigned char *) (udp + 1);
+                int len = (int) ntohs(udp->len) - (int) sizeof(struct udphdr);
+                if (payload + len <= frame + d->len && len > 0 && (size_t) len <= bufs[received].iov_len) {
+                        memcpy(bufs[received].iov_base, payload, len);
+                        bufs[received].iov_len = len;
+                        src[received] = (struct sockaddr_in) { .sin_family = AF_INET,
+                                .sin_port = udp->source, .sin_addr.s_addr = ip->saddr };
+                        received += 1;
+                }
+                fill[(fill_prod + i) & mask] = d->addr & ~(uint64_t) (XDP_FRAME_SIZE - 1);
+        }
+        __atomic_store_n(s->rx.consumer, cons + n, __ATOMIC_RELEASE);
+        __atomic_store_n(s->fill.producer, fill_prod + n, __ATOMIC_RELEASE);
+        if (n > 0 && (__atomic_load_n(s->fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) != 0) {
+                recvfrom(s->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+        }
+        return received;
+}
+
+static void xdp_kick(struct xdp_socket *s)
+{
+        s->tx_unkicked = 0;
+        if ((__atomic_load_n(s->tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) != 0) {
+                sendto(s->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+        }
+}
+
+static void xdp_reclaim_tx(struct xdp_socket *s)
+{
+        uint32_t cons = *s->comp.consumer;
+        uint32_t n = __atomic_load_n(s->comp.producer, __ATOMIC_ACQUIRE) - cons;
+        const uint64_t *comp = s->comp.desc;
+        for (uint32_t i = 0; i < n; ++i) {
+                s->tx_free[s->tx_free_count++] = comp[(cons + i) & (XDP_RING_SIZE - 1)];
+        }
+        __atomic_store_n(s->comp.consumer, cons + n, __ATOMIC_RELEASE);
+}
+
+/**
+ * Finds MAC of the next hop towards dst (network order) in /proc/net/route
+ * and /proc/net/arp. If not found, query is triggered by sending an empty
+ * datagram to the discard port of the next hop.
+ */
+static bool resolve_dst_mac(struct xdp_socket *s, uint32_t dst)
+{
+        if (s->dst_mac_forced) {
+                return true;
+        }
+        if (IN_MULTICAST(ntohl(dst))) {
+                uint32_t h = ntohl(dst);
+                memcpy(s->dst_mac, (unsigned char[]) { 0x01, 0x00, 0x5e, (h >> 16) & 0x7f, (h >> 8) & 0xff, h & 0xff }, ETH_ALEN);
+                return true;
+        }
+        char iface[IF_NAMESIZE];
+        if_indextoname(s->ifindex, iface);
+        uint32_t next_hop = dst;
+        FILE *f = fopen("/proc/net/route", "r");
+        if (f != NULL) {
+                char line[256];
+                char name[IF_NAMESIZE + 1];
+                unsigned int dest, gw, flags, mask;
+                uint32_t best_mask = 0;
+                bool found = false;
+                while (fgets(line, sizeof line, f) != NULL) {
+                        if (sscanf(line, "%16s %x %x %x %*d %*d %*d %x", name, &dest, &gw, &flags, &mask) == 5 &&
+                                        strcmp(name, iface) == 0 && (dst & mask) == dest &&
+                                        (!found || ntohl(mask) >= ntohl(best_mask))) {
+                                found = true;
+                                best_mask = mask;
+                                next_hop = gw != 0 ? gw : dst;
+                        }
+                }
+                fclose(f);
+        }
+        char next_hop_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &next_hop, next_hop_str, sizeof next_hop_str);
+        for (int attempt = 0; attempt < 100; ++attempt) {
+                if ((f = fopen("/proc/net/arp", "r")) == NULL) {
+                        break;
+                }
+                char line[256];
+                char ip[INET_ADDRSTRLEN + 1], dev[IF_NAMESIZE + 1];
+                unsigned int flags, b[ETH_ALEN];
+                bool found = false;
+                while (fgets(line, sizeof line, f) != NULL) {
+                        if (sscanf(line, "%16s %*x %x %x:%x:%x:%x:%x:%x %*s %16s", ip, &flags,
+                                                &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], dev) == 9 &&
+                                        strcmp(ip, next_hop_str) == 0 && strcmp(dev, iface) == 0 && (flags & 0x2) != 0) {
+                                for (int i = 0; i < ETH_ALEN; ++i) {
+                                        s->dst_mac[i] = b[i];
+                                }
+                                found = true;
+                        }
+                }
+                fclose(f);
+                if (found) {
+                        return true;
+                }
+                if (attempt == 0) {
+                        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+                        struct sockaddr_in sin = { .sin_family = AF_INET, .sin_port = htons(9), .sin_addr.s_addr = next_hop };
+                        if (fd >= 0) {
+                                sendto(fd, NULL, 0, 0, (struct sockaddr *) &sin, sizeof sin);
+                                close(fd);
+                        }
+                }
+                usleep(10000);
+        }
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot resolve MAC address of %s, use dst-mac option.\n", next_hop_str);
+        return false;
+}
+
+static uint16_t ip_checksum(const void *hdr, size_t len)
+{
+        const uint16_t *p = hdr;
+        uint32_t sum = 0;
+        for (size_t i = 0; i < len / 2; ++i) {
+                sum += p[i];
+        }
+        while (sum >> 16) {
+                sum = (sum & 0xffff) + (sum >> 16);
+        }
+        return ~sum;
+}
+
+int xdp_sendv(struct xdp_socket *s, const struct sockaddr_in *dst, const struct iovec *vector, int count)
+{
+        size_t len = 0;
+        for (int i = 0; i < count; ++i) {
+                len += vector[i].iov_len;
+        }
+        if (len + XDP_HDR_LEN > XDP_FRAME_SIZE) {
+                errno = EMSGSIZE;
+                return -1;
+        }
+        if (!s->dst_mac_valid || s->cached_dst_ip != dst->sin_addr.s_addr) {
+                s->cached_dst_ip = dst->sin_addr.s_addr;
+                if (!(s->dst_mac_valid = resolve_dst_mac(s, dst->sin_addr.s_addr))) {
+                        errno = EHOSTUNREACH;
+                        return -1;
+                }
+        }
+        if (s->tx_free_count == 0) {
+                xdp_reclaim_tx(s);
+                while (s->tx_free_count == 0) {
+                        xdp_kick(s);
+                        sched_yield();
+                        xdp_reclaim_tx(s);
+                }
+        }
+
+        uint64_t addr = s->tx_free[--s->tx_free_count];
+        unsigned char *frame = s->umem + addr;
+        struct ethhdr *eth = (void *) frame;
+        struct iphdr *ip = (void *) (eth + 1);
+        struct udphdr *udp = (void *) (ip + 1);
+        memcpy(eth->h_dest, s->dst_mac, ETH_ALEN);
+        memcpy(eth->h_source, s->src_mac, ETH_ALEN);
+        eth->h_proto = htons(ETH_P_IP);
+        *ip = (struct iphdr) { .version = 4, .ihl = 5, .tot_len = htons(len + sizeof *ip + sizeof *udp),
+                .id = htons(s->ip_id++), .frag_off = htons(IP_DF), .ttl = s->ttl, .protocol = IPPROTO_UDP,
+                .saddr = s->src_ip, .daddr = dst->sin_addr.s_addr };
+        ip->check = ip_checksum(ip, sizeof *ip);
+        *udp = (struct udphdr) { .source = s->src_port, .dest = dst->sin_port, .len = htons(len + sizeof *udp) };
+        unsigned char *payload = (unsigned char *) (udp + 1);
+        for (int i = 0; i < count; ++i) {
+                memcpy(payload, vector[i].iov_base, vector[i].iov_len);
+                payload += vector[i].iov_len;
+        }
+
+        uint32_t prod = *s->tx.producer;
+        struct xdp_desc *tx = s->tx.desc;
+        tx[prod & (XDP_RING_SIZE - 1)] = (struct xdp_desc) { .addr = addr, .len = len + XDP_HDR_LEN };
+        __atomic_store_n(s->tx.producer, prod + 1, __ATOMIC_RELEASE);
+        if (++s->tx_unkicked >= XDP_TX_KICK_BATCH) {
+                xdp_kick(s);
+        }
+        return len;
+}
+
+void xdp_flush(struct xdp_socket *s)
+{
+        // in copy mode, each wakeup transmits only a limited number of frames
+        for (int i = 0; i < XDP_TX_FRAMES / XDP_TX_KICK_BATCH &&
+                        __atomic_load_n(s->tx.consumer, __ATOMIC_ACQUIRE) != *s->tx.producer; ++i) {
+                xdp_kick(s);
+        }
+        xdp_reclaim_tx(s);
+}
+
+#endif // defined HAVE_LINUX_IF_XDP_H
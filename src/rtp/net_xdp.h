@@ -0,0 +1,89 @@
+/**
+ * @file   rtp/net_xdp.h
+ * @brief  AF_XDP backend for socket_udp (Linux)
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_NET_XDP_H_
+#define RTP_NET_XDP_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct iovec;
+struct sockaddr_in;
+struct xdp_socket;
+
+/**
+ * Creates AF_XDP socket bound to the interface/queue given by cfg
+ * (udp-xdp parameter value) and loads XDP program redirecting IPv4 UDP
+ * datagrams destined to rx_port to the socket. Other traffic is passed to
+ * the kernel network stack.
+ *
+ * @returns NULL on error (message is printed)
+ */
+struct xdp_socket *xdp_socket_init(const char *cfg, uint16_t rx_port);
+void               xdp_socket_destroy(struct xdp_socket *s);
+/// @returns whether cfg requests XDP for (multithreaded) socket bound to rx_port
+bool               xdp_socket_port_matches(const char *cfg, uint16_t rx_port);
+/// @returns file descriptor to wait for for incoming data with poll()/select()
+int                xdp_socket_fd(struct xdp_socket *s);
+/**
+ * Receives up to count datagrams. Payload is copied to bufs[i].iov_base
+ * and bufs[i].iov_len is set to the payload length.
+ *
+ * @returns number of datagrams received (non-blocking)
+ */
+int                xdp_recv(struct xdp_socket *s, struct iovec *bufs, struct sockaddr_in *src, int count);
+/**
+ * Queues datagram to the TX ring. The packet is actually handed to the NIC
+ * (if driver needs a wakeup) after enough packets are queued or in
+ * xdp_flush().
+ *
+ * @returns number of bytes sent, -1 on error (datagram too big, no route)
+ */
+int                xdp_sendv(struct xdp_socket *s, const struct sockaddr_in *dst, const struct iovec *vector, int count);
+void               xdp_flush(struct xdp_socket *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_NET_XDP_H_
@@ -0,0 +1,207 @@
+/**
+ * @file   rtp/packet_pool.c
+ * @brief  lock-free pool of received RTP packet buffers
+ *
+ * Free buffers are kept in a bounded MPMC ring (D. Vyukov) so neither
+ * allocation nor freeing takes a lock.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rtp/packet_pool.h"
+
+#define MAX_CAPACITY (1U<<20U)
+
+/// precedes every buffer handed out by the pool
+struct packet_hdr {
+        struct rtp_packet_pool *pool;
+        alignas(max_align_t) char data[];
+};
+
+struct ring_cell {
+        atomic_size_t seq;
+        struct packet_hdr *pkt;
+};
+
+struct rtp_packet_pool {
+        size_t packet_size;
+        size_t mask;
+        struct ring_cell *cells;
+        alignas(64) atomic_size_t enqueue_pos;
+        alignas(64) atomic_size_t dequeue_pos;
+        alignas(64) atomic_uint refcount; ///< 1 (owner) + packets in flight
+};
+
+static bool ring_push(struct rtp_packet_pool *pool, struct packet_hdr *pkt)
+{
+        size_t pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+        for (;;) {
+                struct ring_cell *cell = &pool->cells[pos & pool->mask];
+                size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+                intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+                if (dif == 0) {
+                        if (atomic_compare_exchange_weak_explicit(&pool->enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+                                cell->pkt = pkt;
+                                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                                return true;
+                        }
+                } else if (dif < 0) {
+                        return false; // full
+                } else {
+                        pos = atomic_load_explicit(&pool->enqueue_pos, memory_order_relaxed);
+                }
+        }
+}
+
+static struct packet_hdr *ring_pop(struct rtp_packet_pool *pool)
+{
+        size_t pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+        for (;;) {
+                struct ring_cell *cell = &pool->cells[pos & pool->mask];
+                size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+                intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+                if (dif == 0) {
+                        if (atomic_compare_exchange_weak_explicit(&pool->dequeue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+                                struct packet_hdr *pkt = cell->pkt;
+                                atomic_store_explicit(&cell->seq, pos + pool->mask + 1, memory_order_release);
+                                return pkt;
+                        }
+                } else if (dif < 0) {
+                        return NULL; // empty
+                } else {
+                        pos = atomic_load_explicit(&pool->dequeue_pos, memory_order_relaxed);
+                }
+        }
+}
+
+/**
+ * @param packet_size size of buffers returned by rtp_packet_alloc()
+ * @param capacity    maximal number of idle buffers kept in pool (rounded up to power of 2)
+ */
+struct rtp_packet_pool *rtp_packet_pool_create(size_t packet_size, unsigned capacity)
+{
+        struct rtp_packet_pool *pool = calloc(1, sizeof *pool);
+        if (pool == NULL) {
+                return NULL;
+        }
+        size_t cap = 2;
+        while (cap < capacity && cap < MAX_CAPACITY) {
+                cap *= 2;
+        }
+        pool->packet_size = packet_size;
+        pool->mask = cap - 1;
+        pool->cells = calloc(cap, sizeof pool->cells[0]);
+        if (pool->cells == NULL) {
+                free(pool);
+                return NULL;
+        }
+        for (size_t i = 0; i < cap; ++i) {
+                atomic_init(&pool->cells[i].seq, i);
+        }
+        atomic_init(&pool->enqueue_pos, 0);
+        atomic_init(&pool->dequeue_pos, 0);
+        atomic_init(&pool->refcount, 1);
+        return pool;
+}
+
+static void pool_drain(struct rtp_packet_pool *pool)
+{
+        struct packet_hdr *pkt = NULL;
+        while ((pkt = ring_pop(pool)) != NULL) {
+                free(pkt);
+        }
+}
+
+static void pool_release(struct rtp_packet_pool *pool)
+{
+        if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1) {
+                pool_drain(pool);
+                free(pool->cells);
+                free(pool);
+        }
+}
+
+/**
+ * Releases the owner reference. Idle buffers are freed immediately, the pool
+ * itself is freed when the last packet in flight is returned.
+ */
+void rtp_packet_pool_destroy(struct rtp_packet_pool *pool)
+{
+        if (pool == NULL) {
+                return;
+        }
+        pool_drain(pool);
+        pool_release(pool);
+}
+
+/**
+ * @returns buffer of pool's packet_size bytes that must be freed with
+ *          rtp_packet_free(), NULL if out of memory
+ */
+void *rtp_packet_alloc(struct rtp_packet_pool *pool)
+{
+        struct packet_hdr *pkt = ring_pop(pool);
+        if (pkt == NULL && (pkt = malloc(sizeof *pkt + pool->packet_size)) == NULL) {
+                return NULL;
+        }
+        atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+        pkt->pool = pool;
+        return pkt->data;
+}
+
+void rtp_packet_free(void *packet)
+{
+        if (packet == NULL) {
+                return;
+        }
+        struct packet_hdr *pkt = (struct packet_hdr *)(void *)((char *) packet - offsetof(struct packet_hdr, data));
+        struct rtp_packet_pool *pool = pkt->pool;
+        if (!ring_push(pool, pkt)) {
+                free(pkt);
+        }
+        pool_release(pool);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file   rtp/packet_pool.h
+ * @brief  lock-free pool of received RTP packet buffers
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_PACKET_POOL_H_
+#define RTP_PACKET_POOL_H_
+
+#ifndef __cplusplus
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pool of fixed-size packet buffers. Buffers are allocated by the receiving
+ * thread with rtp_packet_alloc() and returned by rtp_packet_free() from
+ * (possibly) another thread, typically when pbuf drops the frame.
+ *
+ * The pool is filled lazily - new buffers are allocated only while the
+ * number of packets in flight grows, after that the buffers are recycled.
+ * Pool lifetime is reference-counted so that packets may outlive the
+ * session that created the pool.
+ */
+struct rtp_packet_pool;
+
+struct rtp_packet_pool *rtp_packet_pool_create(size_t packet_size, unsigned capacity);
+void                    rtp_packet_pool_destroy(struct rtp_packet_pool *pool);
+
+void                   *rtp_packet_alloc(struct rtp_packet_pool *pool);
+void                    rtp_packet_free(void *packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_PACKET_POOL_H_
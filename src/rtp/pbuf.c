@@ -58,8 +58,11 @@
 #include "config_win32.h"
 
 #include <inttypes.h>
+#include <math.h>
 
 #include "debug.h"
+#include "host.h"
+#include "rtp/packet_pool.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/ptime.h"
@@ -67,6 +70,8 @@
 #include "tv.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
+#include "utils/time.h"
 
 #define PBUF_MAGIC	0xcafebabe
 
@@ -76,11 +81,24 @@ static_assert(DEFAULT_STATS_INTERVAL % STAT_INT_MIN_DIVISOR == 0,
                 "STATS_INTERVAL must be divisible by (sizeof(ull) * CHAR_BIT)");
 #define MOD_NAME "[Pbuf] "
 
+#define PBUF_TS_HASH_SIZE 64 ///< must be power of 2
+#define CDATA_CHUNK_SIZE 512 ///< number of coded units allocated at once
+
+#define ADAPTIVE_DEFAULT_MAX_MS 100
+#define ADAPTIVE_MARGIN_US 1000   ///< safety margin added to the estimate
+#define ADAPTIVE_WARMUP_FRAMES 16 ///< frames to be seen before adapting
+#define ADAPTIVE_JITTER_MULT 4    ///< multiple of mean deviation to cover
+
+#define NACK_MAX_PENDING 1024 ///< max missing packets waiting for pbuf_get_nack()
+#define NACK_MAX_GAP 512      ///< longer gaps are not requested (stream restart or heavy loss)
+
 struct pbuf_node {
         struct pbuf_node *nxt;
         struct pbuf_node *prv;
+        struct pbuf_node *hnext; ///< next node in the same timestamp hash bucket
         uint32_t rtp_timestamp; /* RTP timestamp for the frame           */
         time_ns_t arrival_time;    /* Arrival time of first packet in frame */
+        time_ns_t last_arrival;    /* Arrival time of last packet (adaptive delay only) */
         time_ns_t playout_time;    /* Playout time for the frame            */
         time_ns_t deletion_time;   /* Deletion time for the frame            */
         struct coded_data *cdata;       /*                                       */
@@ -88,11 +106,30 @@ struct pbuf_node {
         int mbit;               /* determines if mbit of frame had been seen */
         uint32_t magic;         /* For debugging                         */
         bool completed;
+
+        // for eager decoding - frame is known to be complete if it contains all packets
+        // from last packet (M-bit) of previous frame up to its own M-bit packet
+        int pkt_count;          ///< number of stored packets
+        uint16_t first_seq;     ///< valid if first_seq_known
+        uint16_t mbit_seq;      ///< valid if mbit_seq_known
+        bool first_seq_known;
+        bool mbit_seq_known;
+};
+
+struct cdata_chunk {
+        struct cdata_chunk *nxt;
+        struct coded_data units[CDATA_CHUNK_SIZE];
 };
 
 struct pbuf {
         struct pbuf_node *frst;
         struct pbuf_node *last;
+        struct pbuf_node *ts_hash[PBUF_TS_HASH_SIZE]; ///< frames indexed by RTP timestamp
+
+        // recycled nodes and coded units (linked through nxt)
+        struct pbuf_node *free_nodes;
+        struct coded_data *free_cdata;
+        struct cdata_chunk *cdata_chunks; ///< allocated coded units, freed on destroy
         long long int playout_delay_us;
         volatile int *offset_ms;
 
@@ -108,13 +145,147 @@ struct pbuf {
         int out_of_order_pkts;
         int max_out_of_order_dist;
         int dups; // duplicite packets
+        struct metrics_counter *metric_lost;
+        struct metrics_counter *metric_out_of_order;
+        struct metrics_counter *metric_dups;
+
+        /// adaptive playout delay (--param pbuf-adaptive-delay)
+        struct {
+                bool enabled;
+                long long min_us, max_us;
+                int frames;                 ///< number of frames seen
+                time_ns_t last_frame_arrival;
+                double frame_interval_ns;   ///< mean inter-arrival time of frames
+                double jitter_ns;           ///< mean deviation of frame inter-arrival time
+                double span_ns;             ///< decaying peak of first-to-last packet span of a frame
+        } adaptive;
+
+        bool eager; ///< decode frames as soon as all packets are received
+
+        /// missing packets to be reported by pbuf_get_nack() (tracked since its first call)
+        struct {
+                bool enabled;
+                bool highest_seq_valid;
+                uint16_t highest_seq;
+                int count;
+                uint16_t seqs[NACK_MAX_PENDING];
+        } nack;
 };
 
-static void free_cdata(struct coded_data *head);
+static void free_cdata(struct pbuf *playout_buf, struct coded_data *head);
 static int frame_complete(struct pbuf_node *frame);
 
 /*********************************************************************************/
 
+static inline unsigned ts_hash_idx(uint32_t ts)
+{
+        return (ts * 2654435761U) >> 26U; // Knuth multiplicative hash, 6 bits
+}
+static_assert(PBUF_TS_HASH_SIZE == 1 << (32 - 26), "Hash size doesn't match ts_hash_idx()");
+
+static struct pbuf_node *ts_hash_find(struct pbuf *playout_buf, uint32_t ts)
+{
+        struct pbuf_node *node = playout_buf->ts_hash[ts_hash_idx(ts)];
+        while (node != NULL && node->rtp_timestamp != ts) {
+                node = node->hnext;
+        }
+        return node;
+}
+
+static void ts_hash_remove(struct pbuf *playout_buf, struct pbuf_node *node)
+{
+        struct pbuf_node **it = &playout_buf->ts_hash[ts_hash_idx(node->rtp_timestamp)];
+        while (*it != node) {
+                assert(*it != NULL);
+                it = &(*it)->hnext;
+        }
+        *it = node->hnext;
+}
+
+static struct coded_data *get_cdata(struct pbuf *playout_buf)
+{
+        if (playout_buf->free_cdata == NULL) {
+                struct cdata_chunk *chunk = malloc(sizeof *chunk);
+                if (chunk == NULL) {
+                        return NULL;
+                }
+                chunk->nxt = playout_buf->cdata_chunks;
+                playout_buf->cdata_chunks = chunk;
+                for (int i = 0; i < CDATA_CHUNK_SIZE; ++i) {
+                        chunk->units[i].nxt = playout_buf->free_cdata;
+                        playout_buf->free_cdata = &chunk->units[i];
+                }
+        }
+        struct coded_data *ret = playout_buf->free_cdata;
+        playout_buf->free_cdata = ret->nxt;
+        return ret;
+}
+
+/**
+ * Updates the playout delay from the estimated frame completion time
+ * (decaying peak of the first-to-last packet span) and the frame
+ * inter-arrival jitter. Grows immediately, shrinks slowly.
+ */
+static void adaptive_update(struct pbuf *playout_buf, struct pbuf_node *completed)
+{
+        if (completed->last_arrival == 0) {
+                return;
+        }
+        double span = completed->last_arrival - completed->arrival_time;
+        if (span > playout_buf->adaptive.span_ns) {
+                playout_buf->adaptive.span_ns = span;
+        } else {
+                playout_buf->adaptive.span_ns += (span - playout_buf->adaptive.span_ns) / 64;
+        }
+        if (playout_buf->adaptive.frames < ADAPTIVE_WARMUP_FRAMES) {
+                return;
+        }
+        long long target_us = (playout_buf->adaptive.span_ns +
+                        ADAPTIVE_JITTER_MULT * playout_buf->adaptive.jitter_ns) / 1000 + ADAPTIVE_MARGIN_US;
+        playout_buf->playout_delay_us = MIN(MAX(target_us, playout_buf->adaptive.min_us),
+                        playout_buf->adaptive.max_us);
+}
+
+static void adaptive_new_frame(struct pbuf *playout_buf, time_ns_t now)
+{
+        if (playout_buf->adaptive.frames++ > 0) {
+                double interval = now - playout_buf->adaptive.last_frame_arrival;
+                if (playout_buf->adaptive.frames == 2) {
+                        playout_buf->adaptive.frame_interval_ns = interval;
+                }
+                playout_buf->adaptive.frame_interval_ns += (interval - playout_buf->adaptive.frame_interval_ns) / 16;
+                double dev = fabs(interval - playout_buf->adaptive.frame_interval_ns);
+                playout_buf->adaptive.jitter_ns += (dev - playout_buf->adaptive.jitter_ns) / 16;
+        }
+        playout_buf->adaptive.last_frame_arrival = now;
+}
+
+/// unlinks the node from the playout buffer, frees its data and recycles it
+static void free_pnode(struct pbuf *playout_buf, struct pbuf_node *curr)
+{
+        if (playout_buf->adaptive.enabled) {
+                adaptive_update(playout_buf, curr);
+        }
+        if (curr == playout_buf->frst) {
+                playout_buf->frst = curr->nxt;
+        }
+        if (curr == playout_buf->last) {
+                playout_buf->last = curr->prv;
+        }
+        if (curr->nxt != NULL) {
+                curr->nxt->prv = curr->prv;
+        }
+        if (curr->prv != NULL) {
+                curr->prv->nxt = curr->nxt;
+        }
+        ts_hash_remove(playout_buf, curr);
+        free_cdata(playout_buf, curr->cdata);
+        curr->nxt = playout_buf->free_nodes;
+        playout_buf->free_nodes = curr;
+}
+
+/*********************************************************************************/
+
 static void pbuf_validate(struct pbuf *playout_buf)
 {
         /* Run through the entire playout buffer, checking pointers, etc.  */
@@ -168,6 +339,29 @@ static void pbuf_validate(struct pbuf *playout_buf)
 #endif
 }
 
+ADD_TO_PARAM("pbuf-adaptive-delay",
+                "* pbuf-adaptive-delay[=<min_ms>:<max_ms>]\n"
+                "  Adapt playout delay to measured frame completion time and jitter (default range 0:" TOSTRING(ADAPTIVE_DEFAULT_MAX_MS) " ms)\n");
+ADD_TO_PARAM("pbuf-eager-decode",
+                "* pbuf-eager-decode\n"
+                "  Decode frames as soon as all their packets are received, not waiting for the playout delay\n");
+static void adaptive_init(struct pbuf *playout_buf)
+{
+        const char *cfg = get_commandline_param("pbuf-adaptive-delay");
+        if (cfg == NULL) {
+                return;
+        }
+        double min_ms = 0;
+        double max_ms = ADAPTIVE_DEFAULT_MAX_MS;
+        if (strlen(cfg) > 0 && (sscanf(cfg, "%lf:%lf", &min_ms, &max_ms) != 2 || min_ms < 0 || max_ms < min_ms)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong adaptive delay range \"%s\", using fixed delay!\n", cfg);
+                return;
+        }
+        playout_buf->adaptive.enabled = true;
+        playout_buf->adaptive.min_us = min_ms * 1000;
+        playout_buf->adaptive.max_us = max_ms * 1000;
+}
+
 struct pbuf *pbuf_init(volatile int *delay_ms)
 {
         struct pbuf *playout_buf = NULL;
@@ -183,6 +377,11 @@ struct pbuf *pbuf_init(volatile int *delay_ms)
                 playout_buf->playout_delay_us = 0.032 * 1000 * 1000;
                 playout_buf->last_report_seq = -1;
                 playout_buf->stats_interval = DEFAULT_STATS_INTERVAL;
+                adaptive_init(playout_buf);
+                playout_buf->eager = get_commandline_param("pbuf-eager-decode") != NULL;
+                playout_buf->metric_lost = metrics_counter_register("pbuf_lost_packets", "Packets not received by the playout buffer", NULL);
+                playout_buf->metric_out_of_order = metrics_counter_register("pbuf_out_of_order_packets", "Packets received out of order", NULL);
+                playout_buf->metric_dups = metrics_counter_register("pbuf_duplicate_packets", "Duplicate packets", NULL);
         } else {
                 debug_msg("Failed to allocate memory for playout buffer\n");
         }
@@ -202,24 +401,18 @@ void pbuf_destroy(struct pbuf *playout_buf) {
                                         playout_buf->expected_pkts_cum * 100.0);
                 }
 
-                struct pbuf_node *curr = playout_buf->frst;
-                while (curr != NULL) {
-                        struct pbuf_node *temp = curr->nxt;
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        free(curr);
-                        curr = temp;
+                while (playout_buf->frst != NULL) {
+                        free_pnode(playout_buf, playout_buf->frst);
+                }
+                while (playout_buf->free_nodes != NULL) {
+                        struct pbuf_node *tmp = playout_buf->free_nodes;
+                        playout_buf->free_nodes = tmp->nxt;
+                        free(tmp);
+                }
+                while (playout_buf->cdata_chunks != NULL) {
+                        struct cdata_chunk *tmp = playout_buf->cdata_chunks;
+                        playout_buf->cdata_chunks = tmp->nxt;
+                        free(tmp);
                 }
                 free(playout_buf);
         }
@@ -230,21 +423,34 @@ void pbuf_destroy(struct pbuf *playout_buf) {
  *
  * New arrivals are filed to the list in descending sequence number order
  */
-static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
+static void set_mbit_seq(struct pbuf_node *node, uint16_t seq)
+{
+        node->mbit_seq = seq;
+        node->mbit_seq_known = true;
+        if (node->nxt != NULL) {
+                node->nxt->first_seq = seq + 1;
+                node->nxt->first_seq_known = true;
+        }
+}
+
+static void add_coded_unit(struct pbuf *playout_buf, struct pbuf_node *node, rtp_packet * pkt)
 {
         assert(node->rtp_timestamp == pkt->ts);
         assert(node->cdata != NULL);
 
-        struct coded_data *tmp = (struct coded_data *) malloc(sizeof(struct coded_data));
+        struct coded_data *tmp = get_cdata(playout_buf);
         if (tmp == NULL) {
                 /* this is bad, out of memory, drop the packet... */
-                free(pkt);
+                rtp_packet_free(pkt);
                 return;
         }
 
         tmp->seqno = pkt->seq;
         tmp->data = pkt;
         node->mbit |= pkt->m;
+        if (playout_buf->adaptive.enabled) {
+                node->last_arrival = get_time_in_ns_fast();
+        }
         if((int16_t)(tmp->seqno - node->cdata->seqno) > 0){
                 tmp->prv = NULL;
                 tmp->nxt = node->cdata;
@@ -268,37 +474,61 @@ static void add_coded_unit(struct pbuf_node *node, rtp_packet * pkt)
                         curr->prv = tmp;
                 } else {
                         /* this is bad, something went terribly wrong... */
-                        free(pkt);
-                        free(tmp);
+                        rtp_packet_free(pkt);
+                        tmp->nxt = playout_buf->free_cdata;
+                        playout_buf->free_cdata = tmp;
+                        return;
                 }
         }
+        node->pkt_count += 1;
+        if (pkt->m) {
+                set_mbit_seq(node, pkt->seq);
+        }
 }
 
-static struct pbuf_node *create_new_pnode(rtp_packet * pkt, long long playout_delay_us)
+static struct pbuf_node *create_new_pnode(struct pbuf *playout_buf, rtp_packet * pkt, long long playout_delay_us)
 {
-        struct pbuf_node *tmp = calloc(1, sizeof(struct pbuf_node));
+        struct pbuf_node *tmp = playout_buf->free_nodes;
+        if (tmp != NULL) {
+                playout_buf->free_nodes = tmp->nxt;
+                memset(tmp, 0, sizeof *tmp);
+        } else {
+                tmp = calloc(1, sizeof(struct pbuf_node));
+        }
         if (tmp != NULL) {
                 tmp->magic = PBUF_MAGIC;
                 tmp->rtp_timestamp = pkt->ts;
                 tmp->mbit = pkt->m;
+                tmp->pkt_count = 1;
+                if (pkt->m) {
+                        set_mbit_seq(tmp, pkt->seq);
+                }
                 tmp->playout_time =
                         tmp->arrival_time = get_time_in_ns();
+                if (playout_buf->adaptive.enabled) {
+                        tmp->last_arrival = tmp->arrival_time;
+                        adaptive_new_frame(playout_buf, tmp->arrival_time);
+                }
                 tmp->playout_time += playout_delay_us * 1000;
                 tmp->deletion_time = tmp->playout_time + playout_delay_us * 1000;
 
-                tmp->cdata = (struct coded_data *) malloc(sizeof(struct coded_data));
+                tmp->cdata = get_cdata(playout_buf);
                 if (tmp->cdata != NULL) {
                         tmp->cdata->nxt = NULL;
                         tmp->cdata->prv = NULL;
                         tmp->cdata->seqno = pkt->seq;
                         tmp->cdata->data = pkt;
                 } else {
-                        free(pkt);
-                        free(tmp);
+                        rtp_packet_free(pkt);
+                        tmp->nxt = playout_buf->free_nodes;
+                        playout_buf->free_nodes = tmp;
                         return NULL;
                 }
+                unsigned idx = ts_hash_idx(tmp->rtp_timestamp);
+                tmp->hnext = playout_buf->ts_hash[idx];
+                playout_buf->ts_hash[idx] = tmp;
         } else {
-                free(pkt);
+                rtp_packet_free(pkt);
         }
         return tmp;
 }
@@ -339,6 +569,27 @@ static void compute_longest_gap(int *longest_gap, int *accumulated_loss, unsigne
         }
 }
 
+/// records packets between the highest received one and seq as missing
+static void pbuf_detect_gap(struct pbuf *playout_buf, uint16_t seq)
+{
+        if (!playout_buf->nack.highest_seq_valid) {
+                playout_buf->nack.highest_seq_valid = true;
+                playout_buf->nack.highest_seq = seq;
+                return;
+        }
+        uint16_t dist = seq - playout_buf->nack.highest_seq;
+        if (dist == 0 || dist >= 1U<<15U) { // duplicate or reordered/retransmitted packet
+                return;
+        }
+        if (dist - 1 <= NACK_MAX_GAP) {
+                for (uint16_t i = playout_buf->nack.highest_seq + 1; i != seq &&
+                                playout_buf->nack.count < NACK_MAX_PENDING; ++i) {
+                        playout_buf->nack.seqs[playout_buf->nack.count++] = i;
+                }
+        }
+        playout_buf->nack.highest_seq = seq;
+}
+
 static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt)
 {
         // collect statistics
@@ -353,6 +604,7 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         unsigned long long current_bit = 1ull << (pkt->seq % NUMBER_WORD_BITS);
         if ((playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] & ~current_bit) > current_bit) {
                 playout_buf->out_of_order_pkts += 1;
+                metrics_counter_add(playout_buf->metric_out_of_order, 1);
                 int dist = ((pkt->seq + (1<<16U)) - playout_buf->last_seq) % (1<<16U);
                 dist = dist < 1<<15U ? dist : abs(dist - (1<<16U));
                 playout_buf->max_out_of_order_dist = MAX(playout_buf->max_out_of_order_dist, dist);
@@ -360,16 +612,22 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
         playout_buf->last_seq = pkt->seq;
         if (playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] & current_bit) {
                 playout_buf->dups += 1;
+                metrics_counter_add(playout_buf->metric_dups, 1);
         }
         playout_buf->packets[pkt->seq / NUMBER_WORD_BITS] |= current_bit;
+        if (playout_buf->nack.enabled) {
+                pbuf_detect_gap(playout_buf, pkt->seq);
+        }
         uint16_t dist = (uint16_t) (pkt->seq - playout_buf->last_report_seq);
         if (dist >= playout_buf->stats_interval * 2 && dist < 1U<<15U) {
                 uint16_t report_seq_until = (uint16_t) ((pkt->seq / playout_buf->stats_interval * playout_buf->stats_interval) - playout_buf->stats_interval); // sum up only up to current-playout_buf->stats_interval to be able to catch out-of-order packets
                 int accumulated_loss = 0;
                 for (uint16_t i = playout_buf->last_report_seq;
                                 i != report_seq_until; i += NUMBER_WORD_BITS) {
+                        const int received = __builtin_popcountll(playout_buf->packets[i / NUMBER_WORD_BITS]);
                         playout_buf->expected_pkts += NUMBER_WORD_BITS;
-                        playout_buf->received_pkts += __builtin_popcountll(playout_buf->packets[i / NUMBER_WORD_BITS]);
+                        playout_buf->received_pkts += received;
+                        metrics_counter_add(playout_buf->metric_lost, NUMBER_WORD_BITS - received);
                         compute_longest_gap(&playout_buf->longest_gap, &accumulated_loss,  playout_buf->packets[i / NUMBER_WORD_BITS]);
                         playout_buf->packets[i / NUMBER_WORD_BITS] = 0;
                 }
@@ -397,6 +655,11 @@ static inline void pbuf_process_stats(struct pbuf *playout_buf, rtp_packet * pkt
                 log_msg(LOG_LEVEL_INFO, "SSRC 0x%08" PRIx32 ": %d/%d packets received (%s%.4f%%" TERM_FG_RESET "), %d lost, max loss %d%s\n",
                                 pkt->ssrc, playout_buf->received_pkts, playout_buf->expected_pkts, (loss_pct < 100.0 ? TERM_FG_RED : ""), loss_pct,
                                 playout_buf->expected_pkts - playout_buf->received_pkts, playout_buf->longest_gap, oo_dups_str);
+                if (playout_buf->adaptive.enabled) {
+                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Adaptive playout delay %.2f ms (frame span %.2f ms, jitter %.2f ms)\n",
+                                        playout_buf->playout_delay_us / 1000.0, playout_buf->adaptive.span_ns / NS_IN_MS_DBL,
+                                        playout_buf->adaptive.jitter_ns / NS_IN_MS_DBL);
+                }
 
                 if (playout_buf->max_out_of_order_dist >= playout_buf->stats_interval) {
                         size_t new_val = (playout_buf->max_out_of_order_dist + STAT_INT_MIN_DIVISOR - 1) / STAT_INT_MIN_DIVISOR * STAT_INT_MIN_DIVISOR;
@@ -423,7 +686,7 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
 
         if (playout_buf->frst == NULL && playout_buf->last == NULL) {
                 /* playout buffer is empty - add new frame */
-                playout_buf->frst = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                playout_buf->frst = create_new_pnode(playout_buf, pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
                 playout_buf->last = playout_buf->frst;
                 return;
         }
@@ -434,14 +697,21 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                 }
                 /* Packet belongs to last frame in playout_buf this is the */
                 /* most likely scenario - although...                      */
-                add_coded_unit(playout_buf->last, pkt);
+                add_coded_unit(playout_buf, playout_buf->last, pkt);
         } else {
                 if (playout_buf->last->rtp_timestamp < pkt->ts) {
                         /* Packet belongs to a new frame... */
-                        tmp = create_new_pnode(pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        tmp = create_new_pnode(playout_buf, pkt, playout_buf->playout_delay_us + 1000 * (playout_buf->offset_ms ? *playout_buf->offset_ms : 0));
+                        if (tmp == NULL) {
+                                return;
+                        }
                         playout_buf->last->nxt = tmp;
                         playout_buf->last->completed = true;
                         tmp->prv = playout_buf->last;
+                        if (tmp->prv->mbit_seq_known) {
+                                tmp->first_seq = tmp->prv->mbit_seq + 1;
+                                tmp->first_seq_known = true;
+                        }
                         playout_buf->last = tmp;
                 } else {
                         bool discard_pkt = false;
@@ -452,13 +722,10 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                         } else {
                                 debug_msg
                                     ("A packet for a previous frame, but might still be useful\n");
-                                struct pbuf_node *curr = playout_buf->last;
-                                while(curr != playout_buf->frst && curr->rtp_timestamp > pkt->ts){
-                                        curr = curr->prv;
-                                }
-                                if (curr->rtp_timestamp == pkt->ts) {
+                                struct pbuf_node *curr = ts_hash_find(playout_buf, pkt->ts);
+                                if (curr != NULL) {
                                         /* Packet belongs to a previous existing frame... */
-                                        add_coded_unit(curr, pkt);
+                                        add_coded_unit(playout_buf, curr, pkt);
                                 } else {
                                         /* Packet belongs to a frame that is not present */
                                         discard_pkt = true;
@@ -469,22 +736,23 @@ void pbuf_insert(struct pbuf *playout_buf, rtp_packet * pkt)
                                         debug_msg
                                                 ("Oops... dropped packet with M bit set\n");
                                 }
-                                free(pkt);
+                                rtp_packet_free(pkt);
                         }
                 }
         }
         pbuf_validate(playout_buf);
 }
 
-static void free_cdata(struct coded_data *head)
+static void free_cdata(struct pbuf *playout_buf, struct coded_data *head)
 {
         struct coded_data *tmp;
 
         while (head != NULL) {
-                free(head->data);
+                rtp_packet_free(head->data);
                 tmp = head;
                 head = head->nxt;
-                free(tmp);
+                tmp->nxt = playout_buf->free_cdata;
+                playout_buf->free_cdata = tmp;
         }
 }
 
@@ -502,20 +770,7 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
         while (curr != NULL) {
                 temp = curr->nxt;
                 if (curr_time > curr->deletion_time && frame_complete(curr)) {
-                        if (curr == playout_buf->frst) {
-                                playout_buf->frst = curr->nxt;
-                        }
-                        if (curr == playout_buf->last) {
-                                playout_buf->last = curr->prv;
-                        }
-                        if (curr->nxt != NULL) {
-                                curr->nxt->prv = curr->prv;
-                        }
-                        if (curr->prv != NULL) {
-                                curr->prv->nxt = curr->nxt;
-                        }
-                        free_cdata(curr->cdata);
-                        free(curr);
+                        free_pnode(playout_buf, curr);
                 } else {
                         /* The playout buffer is stored in order, so once  */
                         /* we see one packet that has not yet reached it's */
@@ -530,6 +785,13 @@ void pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time)
         return;
 }
 
+/// @returns true if frame is known to have all its packets
+static bool frame_fully_received(struct pbuf_node *frame)
+{
+        return frame->first_seq_known && frame->mbit_seq_known &&
+                frame->pkt_count >= (uint16_t) (frame->mbit_seq - frame->first_seq + 1);
+}
+
 static int frame_complete(struct pbuf_node *frame)
 {
         /* Return non-zero if the list of coded_data represents a    */
@@ -564,6 +826,16 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
 
         curr = playout_buf->frst;
         while (curr != NULL) {
+                if (!curr->decoded && playout_buf->eager && curr_time <= curr->playout_time) {
+                        if (!frame_fully_received(curr)) {
+                                break; // do not pass over not yet due frame
+                        }
+                        struct pbuf_stats stats = { playout_buf->received_pkts_cum,
+                                playout_buf->expected_pkts_cum };
+                        int ret = decode_func(curr->cdata, data, &stats);
+                        curr->decoded = 1;
+                        return ret;
+                }
                 if (!curr->decoded 
                                 && curr_time > curr->playout_time
                    ) {
@@ -587,8 +859,37 @@ pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
         return 0;
 }
 
+/**
+ * @note
+ * If adaptive delay is enabled, the value is used only until the estimate
+ * is available.
+ */
+/**
+ * Returns sequence numbers of packets detected missing since the last call
+ * (and not received meanwhile) in ascending order. Gap detection starts with
+ * the first call.
+ *
+ * @returns number of sequence numbers stored to seqs
+ */
+int pbuf_get_nack(struct pbuf *playout_buf, uint16_t *seqs, int max_count)
+{
+        playout_buf->nack.enabled = true;
+        int count = 0;
+        for (int i = 0; i < playout_buf->nack.count && count < max_count; ++i) {
+                uint16_t seq = playout_buf->nack.seqs[i];
+                if ((playout_buf->packets[seq / NUMBER_WORD_BITS] & (1ULL << (seq % NUMBER_WORD_BITS))) == 0) {
+                        seqs[count++] = seq;
+                }
+        }
+        playout_buf->nack.count = 0;
+        return count;
+}
+
 void pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay)
 {
+        if (playout_buf->adaptive.enabled && playout_buf->adaptive.frames >= ADAPTIVE_WARMUP_FRAMES) {
+                return;
+        }
         playout_buf->playout_delay_us = playout_delay * 1000 * 1000;
 }
 
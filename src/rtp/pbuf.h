@@ -93,6 +93,12 @@ struct vcodec_state {
         unsigned int max_frame_size; // maximal frame size
                                      // to be returned to caller by a decoder to allow him adjust buffers accordingly
         unsigned int decoded;
+        struct {                 // RTP/NTP timestamp mapping from the last sender report
+                bool     valid;  // (set by the caller if packets carry receive timestamps or A/V sync is enabled)
+                uint32_t ntp_sec;
+                uint32_t ntp_frac;
+                uint32_t rtp_ts;
+        } sr;
 };
 
 struct pbuf_audio_data {
@@ -102,6 +108,7 @@ struct pbuf_audio_data {
 
         bool reconfigured;
         size_t frame_size; ///< currently decoded audio frame size (used similarly as vcodec_state::max_frame_size to allow caller adjust buffers if needed)
+        uint32_t rtp_ts;   ///< RTP timestamp of the first decoded frame in buffer
 };
 
 /**
@@ -121,6 +128,7 @@ int 	 	 pbuf_decode(struct pbuf *playout_buf, time_ns_t curr_time,
                              //struct video_frame *framebuffer, int i, struct state_decoder *decoder);
 void		 pbuf_remove(struct pbuf *playout_buf, time_ns_t curr_time);
 void		 pbuf_set_playout_delay(struct pbuf *playout_buf, double playout_delay);
+int		 pbuf_get_nack(struct pbuf *playout_buf, uint16_t *seqs, int max_count);
 
 #ifdef __cplusplus
 }
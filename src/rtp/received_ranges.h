@@ -0,0 +1,149 @@
+/**
+ * @file   rtp/received_ranges.h
+ * @brief  compact bookkeeping of received byte ranges of a frame buffer
+ *
+ * Replaces std::map<offset, length> for per-packet bookkeeping. Packets
+ * usually arrive in order so adding a packet adjoining the last range just
+ * extends it (O(1), no allocation). Ranges are kept sorted and merged, so
+ * a frame received without loss is represented by a single range.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RECEIVED_RANGES_H_
+#define RTP_RECEIVED_RANGES_H_
+
+#ifdef __cplusplus
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <utility>
+#include <vector>
+
+class received_ranges {
+public:
+        using range = std::pair<int, int>; ///< <offset, length>
+        using const_iterator = std::vector<range>::const_iterator;
+
+        /// records received data <offset, offset + len)
+        void add(int offset, int len) {
+                if (len <= 0) {
+                        return;
+                }
+                if (!m_ranges.empty()) {
+                        range &last = m_ranges.back();
+                        if (offset == last.first + last.second) { // fast path - in-order packet
+                                last.second += len;
+                                m_total += len;
+                                return;
+                        }
+                        if (offset > last.first + last.second) {
+                                m_ranges.emplace_back(offset, len);
+                                m_total += len;
+                                return;
+                        }
+                }
+                if (m_ranges.empty()) {
+                        m_ranges.reserve(INITIAL_CAPACITY);
+                        m_ranges.emplace_back(offset, len);
+                        m_total = len;
+                        return;
+                }
+                insert_slow(offset, len);
+        }
+        /// @returns number of distinct received bytes
+        int total() const { return m_total; }
+        bool empty() const { return m_ranges.empty(); }
+        size_t size() const { return m_ranges.size(); }
+        const_iterator begin() const { return m_ranges.cbegin(); }
+        const_iterator end() const { return m_ranges.cend(); }
+        /// @returns length of range starting at offset, 0 if there is none
+        int length_at(int offset) const {
+                auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), range{offset, 0});
+                return it != m_ranges.end() && it->first == offset ? it->second : 0;
+        }
+        /// @returns whether <offset, offset + len) was fully received
+        bool contains(int offset, int len) const {
+                auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), range{offset, INT_MAX});
+                if (it == m_ranges.begin()) {
+                        return false;
+                }
+                --it;
+                return offset + len <= it->first + it->second;
+        }
+        void clear() {
+                m_ranges.clear();
+                m_total = 0;
+        }
+        /// conversion for interfaces taking the map
+        std::map<int, int> to_map() const {
+                return std::map<int, int>(m_ranges.begin(), m_ranges.end());
+        }
+        static received_ranges from_map(std::map<int, int> const &m) {
+                received_ranges ret;
+                for (auto const &it : m) {
+                        ret.add(it.first, it.second);
+                }
+                return ret;
+        }
+
+private:
+        static constexpr int INITIAL_CAPACITY = 8;
+
+        /// out-of-order or duplicate packet - insert and merge with overlapping neighbours
+        void insert_slow(int offset, int len) {
+                int end = offset + len;
+                auto first = std::lower_bound(m_ranges.begin(), m_ranges.end(), offset,
+                                [](range const &r, int off) { return r.first + r.second < off; });
+                auto last = first;
+                while (last != m_ranges.end() && last->first <= end) {
+                        offset = std::min(offset, last->first);
+                        end = std::max(end, last->first + last->second);
+                        m_total -= last->second;
+                        ++last;
+                }
+                m_total += end - offset;
+                if (first == last) {
+                        m_ranges.insert(first, range{offset, end - offset});
+                } else {
+                        *first = range{offset, end - offset};
+                        m_ranges.erase(first + 1, last);
+                }
+        }
+
+        std::vector<range> m_ranges;
+        int m_total = 0;
+};
+#endif // defined __cplusplus
+
+#endif // RTP_RECEIVED_RANGES_H_
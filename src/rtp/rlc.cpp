@@ -0,0 +1,410 @@
+/**
+ * @file   rtp/rlc.cpp
+ * @brief  Sliding-window Random Linear Code FEC
+ *
+ * Layout of the encoded buffer (S - source symbol, R - repair symbol),
+ * eg. for step 4 and 1 repair per burst:
+ *
+ *     S0 S1 S2 S3 R0 S4 S5 S6 S7 R1 S8 S9 R2
+ *
+ * Every repair is a GF(2^8) linear combination of the preceding <window>
+ * source symbols with pseudo-random coefficients derived from the repair
+ * and source indices, so no coefficients need to be transmitted. The last
+ * group is shortened and followed by its repair burst as well, therefore
+ * the source symbol count can be inferred from the buffer length.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "debug.h"
+#include "rtp/rlc.h"
+#include "rtp/rtp_callback.h"
+#include "transmit.h"
+#include "ug_runtime_error.hpp"
+#include "utils/gf256.h"
+#include "utils/misc.h" // get_cpu_core_count
+#include "utils/worker.h"
+#include "video.h"
+
+#define MOD_NAME "[RLC] "
+
+#define DEFAULT_WINDOW 32
+#define DEFAULT_STEP 16
+#define DEFAULT_REPAIRS 2
+
+#define MAX_WINDOW 1024
+#define MAX_STEP MAX_WINDOW
+#define MAX_REPAIRS 63 ///< 6 bits in FEC header
+#define MIN_GROUPS_PER_JOB 4
+
+using namespace std;
+
+static void usage();
+
+namespace {
+struct rlc_layout {
+        unsigned int window, step, repairs;
+        unsigned int k; ///< source symbol count
+
+        unsigned int group_count() const { return (k + step - 1) / step; }
+        unsigned int symbol_count() const { return k + group_count() * repairs; }
+        unsigned int source_pos(unsigned int idx) const { return idx + idx / step * repairs; }
+        /// group g protects source symbols [group_first(g), group_end(g))
+        unsigned int group_end(unsigned int g) const { return min((g + 1) * step, k); }
+        unsigned int group_first(unsigned int g) const { return group_end(g) > window ? group_end(g) - window : 0; }
+        unsigned int repair_pos(unsigned int g, unsigned int j) const { return group_end(g) + g * repairs + j; }
+};
+
+struct rlc_encode_job {
+        const struct gf256_impl *gf;
+        struct rlc_layout layout;
+        unsigned char *data;
+        size_t ss;
+        unsigned int first_group, last_group;
+};
+
+/// equation of a received repair symbol reduced to the missing source symbols
+struct rlc_equation {
+        vector<unsigned char> coeffs; ///< indexed by missing symbol index
+        vector<unsigned char> data;
+};
+} // end of anonymous namespace
+
+/// @returns nonzero pseudo-random coefficient of source symbol src in repair symbol repair
+static inline unsigned char rlc_coef(unsigned int repair, unsigned int src)
+{
+        uint32_t x = repair * 0x9E3779B1U ^ (src + 1) * 0x85EBCA77U;
+        x ^= x >> 16;
+        x *= 0x7FEB352DU;
+        x ^= x >> 15;
+        x *= 0x846CA68BU;
+        x ^= x >> 16;
+        return x % 255 + 1;
+}
+
+static unsigned char gf256_inv(unsigned char a)
+{
+        for (int x = 1; x < 256; ++x) {
+                if (gf256_mul(a, x) == 1) {
+                        return x;
+                }
+        }
+        abort(); // a == 0
+}
+
+static void *rlc_encode_task(void *arg)
+{
+        auto *job = (struct rlc_encode_job *) arg;
+        const struct rlc_layout &l = job->layout;
+        vector<const unsigned char *> src(l.window);
+        vector<unsigned char> coeffs(l.window);
+        for (unsigned int g = job->first_group; g < job->last_group; ++g) {
+                unsigned int first = l.group_first(g);
+                unsigned int end = l.group_end(g);
+                for (unsigned int i = first; i < end; ++i) {
+                        src[i - first] = job->data + l.source_pos(i) * job->ss;
+                }
+                for (unsigned int j = 0; j < l.repairs; ++j) {
+                        for (unsigned int i = first; i < end; ++i) {
+                                coeffs[i - first] = rlc_coef(g * l.repairs + j, i);
+                        }
+                        job->gf->dot(job->data + l.repair_pos(g, j) * job->ss, src.data(),
+                                        coeffs.data(), end - first, job->ss);
+                }
+        }
+        return NULL;
+}
+
+static bool check_params(unsigned int window, unsigned int step, unsigned int repairs, unsigned int ss)
+{
+        return step >= 1 && step <= MAX_STEP && window >= step && window <= MAX_WINDOW &&
+                repairs >= 1 && repairs <= MAX_REPAIRS && ss > 0;
+}
+
+rlc::rlc(unsigned int window, unsigned int step, unsigned int repairs, unsigned int symbol_size)
+        : m_window(window), m_step(step), m_repairs(repairs), m_ss(symbol_size)
+{
+        if (!check_params(window, step, repairs, symbol_size)) {
+                throw ug_runtime_error(MOD_NAME "Invalid parameters received!");
+        }
+        m_gf = gf256_get_impl(nullptr);
+}
+
+rlc::rlc(const char *c_cfg)
+        : m_window(DEFAULT_WINDOW), m_step(DEFAULT_STEP), m_repairs(DEFAULT_REPAIRS)
+{
+        char *cfg = strdup(c_cfg);
+        char *save_ptr = nullptr;
+        char *item = strtok_r(cfg, ":", &save_ptr);
+        if (item != nullptr) {
+                m_ss = atoi(item);
+                item = strtok_r(nullptr, ":", &save_ptr);
+        }
+        if (item != nullptr && strcmp(item, "help") == 0) {
+                free(cfg);
+                usage();
+                throw 0;
+        }
+        if (item != nullptr) {
+                m_window = atoi(item);
+                if ((item = strtok_r(nullptr, ":", &save_ptr)) != nullptr) {
+                        m_step = atoi(item);
+                }
+                if ((item = strtok_r(nullptr, ":", &save_ptr)) != nullptr) {
+                        m_repairs = atoi(item);
+                }
+        }
+        free(cfg);
+        if (!check_params(m_window, m_step, m_repairs, m_ss)) {
+                usage();
+                throw 1;
+        }
+        m_gf = gf256_get_impl(nullptr);
+        m_threads = get_cpu_core_count();
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Window " << m_window << ", " << m_repairs << " repair(s) every "
+                << m_step << " symbols, symbol size " << m_ss << " B, using " << m_gf->name << " implementation.\n";
+}
+
+shared_ptr<video_frame> rlc::encode(shared_ptr<video_frame> in)
+{
+        video_payload_hdr_t hdr;
+        format_video_header(in.get(), 0, 0, hdr);
+        const size_t hdr_len = sizeof(hdr);
+
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(in.get()));
+        vector<rlc_encode_job> jobs;
+
+        for (unsigned int i = 0; i < in->tile_count; ++i) {
+                size_t len = in->tiles[i].data_len;
+                size_t src_len = sizeof(uint32_t) + hdr_len + len;
+                struct rlc_layout l{m_window, m_step, m_repairs, (unsigned int) ((src_len + m_ss - 1) / m_ss)};
+                size_t buffer_len = (size_t) l.symbol_count() * m_ss;
+                char *out_data = out->tiles[i].data = (char *) malloc(buffer_len);
+                uint32_t len32 = len + hdr_len;
+                memcpy(out_data, &len32, sizeof(len32));
+                memcpy(out_data + sizeof(len32), hdr, hdr_len);
+                memcpy(out_data + sizeof(len32) + hdr_len, in->tiles[i].data, len);
+                memset(out_data + src_len, 0, (size_t) l.k * m_ss - src_len);
+                // spread the source symbols to make room for the repair bursts
+                for (unsigned int s = l.k; s-- > m_step; ) {
+                        memcpy(out_data + l.source_pos(s) * m_ss, out_data + s * m_ss, m_ss);
+                }
+                out->tiles[i].data_len = buffer_len;
+
+                unsigned int group_count = l.group_count();
+                unsigned int per_job = max<unsigned int>(MIN_GROUPS_PER_JOB,
+                                (group_count * in->tile_count + m_threads - 1) / m_threads);
+                for (unsigned int g = 0; g < group_count; g += per_job) {
+                        jobs.push_back({m_gf, l, (unsigned char *) out_data, m_ss, g, min(g + per_job, group_count)});
+                }
+        }
+        out->fec_params = fec_desc(FEC_RLC, m_window, m_step, m_repairs, m_ss, m_ss);
+
+        if (jobs.size() == 1) {
+                rlc_encode_task(jobs.data());
+        } else {
+                task_run_parallel(rlc_encode_task, jobs.size(), jobs.data(), sizeof jobs[0], NULL);
+        }
+
+        static auto deleter = [](video_frame *frame) {
+                for (unsigned i = 0; i < frame->tile_count; ++i) {
+                        free(frame->tiles[i].data);
+                }
+                vf_free(frame);
+        };
+        return {out, deleter};
+}
+
+bool rlc::decode(char *in, int in_len, char **out, int *len,
+                std::map<int, int> const & c_m)
+{
+        return decode(in, in_len, out, len, received_ranges::from_map(c_m));
+}
+
+bool rlc::decode(char *in, int in_len, char **out, int *len,
+                received_ranges const & r)
+{
+        *len = 0;
+        if (in_len <= 0 || in_len % m_ss != 0) {
+                return false;
+        }
+        unsigned int n = in_len / m_ss;
+        unsigned int group_count = (n + m_step + m_repairs - 1) / (m_step + m_repairs);
+        if (n <= group_count * m_repairs) {
+                return false;
+        }
+        const struct rlc_layout l{m_window, m_step, m_repairs, n - group_count * m_repairs};
+        if (l.group_count() != group_count) {
+                return false;
+        }
+        auto *data = (unsigned char *) in;
+        auto received = [&](unsigned int pos) { return r.contains(pos * m_ss, m_ss); };
+
+        vector<unsigned int> missing;
+        vector<int> col(l.k, -1); ///< index to missing for lost source symbols
+        for (unsigned int i = 0; i < l.k; ++i) {
+                if (!received(l.source_pos(i))) {
+                        col[i] = missing.size();
+                        missing.push_back(i);
+                }
+        }
+        const unsigned int u = missing.size();
+        vector<bool> recovered(u);
+
+        if (u > 0) {
+                // gather repairs covering the lost symbols, reduced by the received ones
+                vector<rlc_equation> eqs;
+                vector<const unsigned char *> src(l.window + 1);
+                vector<unsigned char> coeffs(l.window + 1);
+                for (unsigned int g = 0; g < group_count; ++g) {
+                        unsigned int first = l.group_first(g);
+                        unsigned int end = l.group_end(g);
+                        auto it = lower_bound(missing.begin(), missing.end(), first);
+                        if (it == missing.end() || *it >= end) {
+                                continue;
+                        }
+                        for (unsigned int j = 0; j < l.repairs; ++j) {
+                                unsigned int pos = l.repair_pos(g, j);
+                                if (!received(pos)) {
+                                        continue;
+                                }
+                                eqs.push_back({vector<unsigned char>(u), vector<unsigned char>(m_ss)});
+                                rlc_equation &eq = eqs.back();
+                                src[0] = data + pos * m_ss;
+                                coeffs[0] = 1;
+                                int count = 1;
+                                for (unsigned int i = first; i < end; ++i) {
+                                        unsigned char c = rlc_coef(g * l.repairs + j, i);
+                                        if (col[i] >= 0) {
+                                                eq.coeffs[col[i]] = c;
+                                        } else {
+                                                src[count] = data + l.source_pos(i) * m_ss;
+                                                coeffs[count++] = c;
+                                        }
+                                }
+                                m_gf->dot(eq.data.data(), src.data(), coeffs.data(), count, m_ss);
+                        }
+                }
+
+                // Gauss-Jordan elimination, equations are banded so that the fill-in is low
+                vector<int> pivot(u, -1);
+                vector<bool> used(eqs.size());
+                vector<unsigned char> tmp(m_ss);
+                for (unsigned int c = 0; c < u; ++c) {
+                        unsigned int p = 0;
+                        while (p < eqs.size() && (used[p] || eqs[p].coeffs[c] == 0)) {
+                                ++p;
+                        }
+                        if (p == eqs.size()) {
+                                continue;
+                        }
+                        used[p] = true;
+                        pivot[c] = p;
+                        rlc_equation &pe = eqs[p];
+                        unsigned char inv = gf256_inv(pe.coeffs[c]);
+                        for (auto &x : pe.coeffs) {
+                                x = gf256_mul(x, inv);
+                        }
+                        const unsigned char *s = pe.data.data();
+                        m_gf->dot(tmp.data(), &s, &inv, 1, m_ss);
+                        swap(tmp, pe.data);
+                        for (unsigned int e = 0; e < eqs.size(); ++e) {
+                                unsigned char x = eqs[e].coeffs[c];
+                                if (e == p || x == 0) {
+                                        continue;
+                                }
+                                for (unsigned int i = 0; i < u; ++i) {
+                                        eqs[e].coeffs[i] ^= gf256_mul(x, pe.coeffs[i]);
+                                }
+                                const unsigned char *srcs[] = { eqs[e].data.data(), pe.data.data() };
+                                const unsigned char cfs[] = { 1, x };
+                                m_gf->dot(tmp.data(), srcs, cfs, 2, m_ss);
+                                swap(tmp, eqs[e].data);
+                        }
+                }
+                for (unsigned int c = 0; c < u; ++c) {
+                        if (pivot[c] < 0) {
+                                continue;
+                        }
+                        const rlc_equation &eq = eqs[pivot[c]];
+                        unsigned int nonzero = count_if(eq.coeffs.begin(), eq.coeffs.end(),
+                                        [](unsigned char x) { return x != 0; });
+                        if (nonzero == 1) { // otherwise depends on unresolved symbols
+                                memcpy(data + l.source_pos(missing[c]) * m_ss, eq.data.data(), m_ss);
+                                recovered[c] = true;
+                        }
+                }
+        }
+
+        // compact the source symbols
+        for (unsigned int i = m_step; i < l.k; ++i) {
+                memmove(data + i * m_ss, data + l.source_pos(i) * m_ss, m_ss);
+        }
+
+        if (u > 0 && missing[0] == 0 && !recovered[0]) {
+                return false;
+        }
+        uint32_t len32;
+        memcpy(&len32, data, sizeof len32);
+        if (len32 > l.k * m_ss - sizeof len32) {
+                return false;
+        }
+        *len = len32;
+        *out = in + sizeof(uint32_t);
+        return all_of(recovered.begin(), recovered.end(), [](bool b) { return b; });
+}
+
+static void usage() {
+        printf("RLC (sliding window FEC) usage:\n"
+                        "\t-f rlc[:<window>:<step>:<repairs>]\n"
+                        "\n"
+                        "\t\t<window> - count of source symbols protected by a repair symbol (default %d, max %d)\n"
+                        "\t\t<step> - count of source symbols between repair bursts (default %d), must be <= <window>\n"
+                        "\t\t<repairs> - count of repair symbols in a burst (default %d, max %d)\n"
+                        "\n"
+                        "\tSymbol size is derived from MTU, one symbol is sent per packet. Overhead is <repairs>/<step>.\n"
+                        "\n",
+                        DEFAULT_WINDOW, MAX_WINDOW, DEFAULT_STEP, DEFAULT_REPAIRS, MAX_REPAIRS);
+}
+
@@ -0,0 +1,75 @@
+/**
+ * @file   rtp/rlc.h
+ * @brief  Sliding-window Random Linear Code FEC (inspired by RFC 8681)
+ *
+ * Repair symbols are interleaved with source symbols - after every <step>
+ * source symbols, <repairs> repair symbols protecting the last <window>
+ * sources are inserted. A loss thus needs only repairs following it
+ * within the window to be recovered instead of the whole block.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RLC_H_
+#define RTP_RLC_H_
+
+#include <map>
+#include <memory>
+
+#include "fec.h"
+
+struct gf256_impl;
+struct video_frame;
+
+struct rlc : public fec {
+        rlc(unsigned int window, unsigned int step, unsigned int repairs, unsigned int symbol_size);
+        /// @param cfg "<symbol_size>[:<window>:<step>:<repairs>]"
+        rlc(const char *cfg);
+        std::shared_ptr<video_frame> encode(std::shared_ptr<video_frame> frame) override;
+        bool decode(char *in, int in_len, char **out, int *len,
+                const std::map<int, int> &) override;
+        bool decode(char *in, int in_len, char **out, int *len,
+                const received_ranges &) override;
+        bool thread_safe_decode() const override {
+                return true;
+        }
+
+private:
+        unsigned int m_window = 0, m_step = 0, m_repairs = 0;
+        unsigned int m_ss = 0;
+        const struct gf256_impl *m_gf = nullptr;
+        int m_threads = 1;
+};
+
+#endif // defined RTP_RLC_H_
+
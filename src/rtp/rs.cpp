@@ -41,14 +41,19 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
 #include <bitset>
 #include <stdlib.h>
+#include <vector>
 
 #include "debug.h"
 #include "rtp/rs.h"
 #include "rtp/rtp_callback.h"
 #include "transmit.h"
 #include "ug_runtime_error.hpp"
+#include "utils/gf256.h"
+#include "utils/misc.h" // get_cpu_core_count
+#include "utils/worker.h"
 #include "video.h"
 
 #define DEFAULT_K 200
@@ -56,6 +61,9 @@
 
 #define MAX_K 255
 #define MAX_N 255
+#define MIN_STRIPE 1024 ///< minimal symbol stripe encoded by one worker
+#define STRIPE_ALIGN 64
+#define CACHE_BLOCK 2048 ///< k * CACHE_BLOCK source bytes should fit L2 cache
 
 #ifdef HAVE_ZFEC
 extern "C" {
@@ -70,6 +78,37 @@ static void usage();
 
 using namespace std;
 
+#ifdef HAVE_ZFEC
+/// encodes all parity symbols of a block over the byte range [offset, offset + len) of the symbols
+struct rs_encode_job {
+        const struct gf256_impl *impl;
+        const unsigned char *enc_matrix; ///< n x k, rows k..n-1 are used
+        unsigned char *data;             ///< block - k data symbols followed by n-k parity symbols
+        int k, n;
+        size_t ss;
+        size_t offset, len;
+};
+
+static void *rs_encode_stripe_task(void *arg)
+{
+        auto *job = (struct rs_encode_job *) arg;
+        const unsigned char *src[MAX_K];
+        // process the stripe in cache-sized blocks so that the source data
+        // are reused from the cache by all parity symbols
+        for (size_t off = job->offset; off < job->offset + job->len; off += CACHE_BLOCK) {
+                size_t len = min<size_t>(CACHE_BLOCK, job->offset + job->len - off);
+                for (int j = 0; j < job->k; ++j) {
+                        src[j] = job->data + j * job->ss + off;
+                }
+                for (int m = job->k; m < job->n; ++m) {
+                        job->impl->dot(job->data + m * job->ss + off, src,
+                                        job->enc_matrix + m * job->k, job->k, len);
+                }
+        }
+        return NULL;
+}
+#endif // defined HAVE_ZFEC
+
 /**
  * Constructs RS state. Since this constructor is currently used only for the decoder,
  * it allows creation of dummy state even if zfec was not compiled in.
@@ -97,20 +136,34 @@ rs::rs(const char *c_cfg)
         char *cfg = strdup(c_cfg);
         char *item, *save_ptr;
         item = strtok_r(cfg, ":", &save_ptr);
+        const char *impl = nullptr;
         if (item != NULL) {
                 m_k = atoi(item);
                 item = strtok_r(NULL, ":", &save_ptr);
                 assert(item != NULL);
                 m_n = atoi(item);
+                impl = strtok_r(NULL, ":", &save_ptr);
         } else {
                 m_k = DEFAULT_K;
                 m_n = DEFAULT_N;
         }
-        free(cfg);
+        if (impl == nullptr || strcmp(impl, "zfec") != 0) {
+                m_gf = gf256_get_impl(impl);
+                if (m_gf == nullptr) {
+                        LOG(LOG_LEVEL_ERROR) << "[RS] Implementation " << impl << " not available!\n";
+                        free(cfg);
+                        usage();
+                        throw 1;
+                }
+                m_threads = get_cpu_core_count();
+        }
         if (m_k > MAX_K || m_n > MAX_N || m_k >= m_n) {
+                free(cfg);
                 usage();
                 throw 1;
         }
+        LOG(LOG_LEVEL_VERBOSE) << "[RS] Using " << (m_gf ? m_gf->name : "zfec") << " encoder implementation.\n";
+        free(cfg);
 
 #ifdef HAVE_ZFEC
         state = fec_new(m_k, m_n);
@@ -154,33 +207,30 @@ shared_ptr<video_frame> rs::encode(shared_ptr<video_frame> in)
                 memcpy(out_data + sizeof(len32) + hdr_len, data, len);
                 memset(out_data + sizeof(len32) + hdr_len + len, 0, ss * m_k - (sizeof(len32) + hdr_len + len));
 
-#if 0
-                void *src[m_k];
-                for (int k = 0; k < m_k; ++k) {
-                        src[k] = *out + ss * k;
+                if (m_gf == nullptr) {
+                        encode_zfec(out_data, ss);
                 }
+                out->tiles[i].data_len = buffer_len;
+                out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
+        }
 
-                for (int m = 0; m < m_n - m_k; ++m) {
-                        fec_encode(state, src, *out + ss * (m_k + m), m, ss);
-                }
-#else
-                void *src[m_k];
-                for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out_data + ss * k;
+        if (m_gf != nullptr) {
+                vector<rs_encode_job> jobs;
+                const int tile_count = in->tile_count;
+                for (int i = 0; i < tile_count; ++i) {
+                        size_t ss = out->tiles[i].data_len / m_n;
+                        int stripe_count = max<int>(1, min<size_t>(m_threads / tile_count, ss / MIN_STRIPE));
+                        size_t stripe = (ss / stripe_count + STRIPE_ALIGN - 1) / STRIPE_ALIGN * STRIPE_ALIGN;
+                        for (size_t offset = 0; offset < ss; offset += stripe) {
+                                jobs.push_back(get_encode_job((unsigned char *) out->tiles[i].data, ss,
+                                                        offset, min(stripe, ss - offset)));
+                        }
                 }
-                void *dst[m_n-m_k];
-                unsigned int dst_idx[m_n-m_k];
-                for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out_data + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
+                if (jobs.size() == 1) {
+                        rs_encode_stripe_task(jobs.data());
+                } else {
+                        task_run_parallel(rs_encode_stripe_task, jobs.size(), jobs.data(), sizeof jobs[0], NULL);
                 }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
-#endif
-
-                out->tiles[i].data_len = buffer_len;
-                out->fec_params = fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss);
         }
 
         static auto deleter = [](video_frame *frame) {
@@ -221,20 +271,12 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 
                 out.set_fec_params(i, fec_desc(FEC_RS, m_k, m_n - m_k, 0, 0, ss));
 
-                void *src[m_k];
-                for (unsigned int k = 0; k < m_k; ++k) {
-                        src[k] = out.get_data(i) + ss * k;
-                }
-
-                void *dst[m_n-m_k];
-                unsigned int dst_idx[m_n-m_k];
-                for (unsigned int m = 0; m < m_n-m_k; ++m) {
-                        dst[m] = out.get_data(i) + ss * (m_k + m);
-                        dst_idx[m] = m_k + m;
+                if (m_gf == nullptr) {
+                        encode_zfec(out.get_data(i), ss);
+                } else {
+                        struct rs_encode_job job = get_encode_job((unsigned char *) out.get_data(i), ss, 0, ss);
+                        rs_encode_stripe_task(&job);
                 }
-
-                fec_encode((const fec_t *)state, (gf **) src,
-                                (gf **) dst, dst_idx, m_n-m_k, ss);
         }
 
         return out;
@@ -244,6 +286,34 @@ audio_frame2 rs::encode(const audio_frame2 &in)
 #endif // defined HAVE_ZFEC
 }
 
+#ifdef HAVE_ZFEC
+/**
+ * Computes parity of the (already filled) block with zfec scalar implementation
+ */
+void rs::encode_zfec(char *data, int ss)
+{
+        void *src[m_k];
+        for (unsigned int k = 0; k < m_k; ++k) {
+                src[k] = data + ss * k;
+        }
+        void *dst[m_n-m_k];
+        unsigned int dst_idx[m_n-m_k];
+        for (unsigned int m = 0; m < m_n-m_k; ++m) {
+                dst[m] = data + ss * (m_k + m);
+                dst_idx[m] = m_k + m;
+        }
+
+        fec_encode((const fec_t *)state, (gf **) src,
+                        (gf **) dst, dst_idx, m_n-m_k, ss);
+}
+
+struct rs_encode_job rs::get_encode_job(unsigned char *data, size_t ss, size_t offset, size_t len)
+{
+        return { m_gf, ((const fec_t *) state)->enc_matrix, data, (int) m_k, (int) m_n,
+                ss, offset, len };
+}
+#endif // defined HAVE_ZFEC
+
 /**
  * Returns symbol size (?) for given headers len and with configured m_k
  */
@@ -254,9 +324,9 @@ int rs::get_ss(int hdr_len, int len) {
 /**
  * @returns stored buffer data length or 0 if first packet (header) is missing
  */
-uint32_t rs::get_buf_len(const char *buf, std::map<int, int> const & c_m)
+uint32_t rs::get_buf_len(const char *buf, received_ranges const & r)
 {
-        if (auto it = c_m.find(0); it != c_m.end() && it->second >= 4) {
+        if (r.length_at(0) >= 4) {
                 uint32_t out_sz;
                 memcpy(&out_sz, buf, sizeof(out_sz));
                 return out_sz;
@@ -267,27 +337,18 @@ uint32_t rs::get_buf_len(const char *buf, std::map<int, int> const & c_m)
 bool rs::decode(char *in, int in_len, char **out, int *len,
                 std::map<int, int> const & c_m)
 {
-        std::map<int, int> m = c_m; // make private copy
-        unsigned int ss = in_len / m_n;
-
-        // compact neighbouring segments
-        for (auto it = m.begin(); it != m.end(); ++it) {
-                int start = it->first;
-                int size = it->second;
+        return decode(in, in_len, out, len, received_ranges::from_map(c_m));
+}
 
-                auto neighbour = m.end();
-                while ((neighbour = m.find(start + size)) != m.end()) {
-                        it->second += neighbour->second;
-                        size = it->second;
-                        m.erase(neighbour);
-                }
-        }
+bool rs::decode(char *in, int in_len, char **out, int *len,
+                received_ranges const & m)
+{
+        unsigned int ss = in_len / m_n;
 
         if (state == nullptr) { // zfec was not compiled in - dummy mode
-                *len = get_buf_len(in, c_m);
+                *len = get_buf_len(in, m);
                 *out = (char *) in + sizeof(uint32_t);
-                auto fst_sgmt = m.find(0);
-                return fst_sgmt != m.end() && (unsigned) fst_sgmt->second >= ss * m_k;
+                return (unsigned) m.length_at(0) >= ss * m_k;
         }
 
 #ifdef HAVE_ZFEC
@@ -374,7 +435,7 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
         //fprintf(stderr, "       %d\n", i);
 
         if (i != m_k) {
-                *len = get_buf_len(in, c_m);
+                *len = get_buf_len(in, m);
                 *out = (char *) in + sizeof(uint32_t);
                 return false;
         }
@@ -413,11 +474,16 @@ bool rs::decode(char *in, int in_len, char **out, int *len,
 
 static void usage() {
         printf("RS usage:\n"
-                        "\t-f rs[:<k>:<n>]\n"
+                        "\t-f rs[:<k>:<n>[:<impl>]]\n"
                         "\n"
                         "\t\t<k> - block length (default %d, max %d)\n"
                         "\t\t<n> - length of block + parity (default %d, max %d)\n\t\t\tmust be > <k>\n"
-                        "\n",
+                        "\t\t<impl> - encoder implementation (default: fastest available):\n"
+                        "\t\t\tzfec (scalar, single-threaded)",
                         DEFAULT_K, MAX_K, DEFAULT_N, MAX_N);
+        for (const struct gf256_impl *it = gf256_get_impls(); it->name != NULL; ++it) {
+                printf(", %s%s", it->name, it->available() ? "" : " (unsupported)");
+        }
+        printf("\n\n");
 }
 
@@ -44,6 +44,8 @@
 
 #include "fec.h"
 
+struct gf256_impl;
+struct rs_encode_job;
 struct video_frame;
 
 struct rs : public fec {
@@ -54,12 +56,21 @@ struct rs : public fec {
         virtual audio_frame2 encode(audio_frame2 const &) override;
         bool decode(char *in, int in_len, char **out, int *len,
                 const std::map<int, int> &) override;
+        bool decode(char *in, int in_len, char **out, int *len,
+                const received_ranges &) override;
+        bool thread_safe_decode() const override {
+                return true;
+        }
 
 private:
+        void encode_zfec(char *data, int ss);
+        struct rs_encode_job get_encode_job(unsigned char *data, size_t ss, size_t offset, size_t len);
         int get_ss(int hdr_len, int len);
-        uint32_t get_buf_len(const char *buf, std::map<int, int> const & c_m);
+        uint32_t get_buf_len(const char *buf, received_ranges const & r);
         void *state = nullptr;
         unsigned int m_k, m_n;
+        const struct gf256_impl *m_gf = nullptr; ///< nullptr - use zfec fec_encode()
+        int m_threads = 1;
 };
 
 #endif /* __RS_H__ */
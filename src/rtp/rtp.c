@@ -91,8 +91,12 @@
 #include "crypto/md5.h"
 #include "ntp.h"
 #include "rtp.h"
+#include "rtp/packet_pool.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
 #include "utils/net.h"
+#include "utils/thread.h"
+#include "utils/time.h"
 
 #undef max
 #undef min
@@ -107,6 +111,7 @@
  * Encryption stuff.
  */
 #define MAX_ENCRYPTION_PAD 16
+#define RTP_PACKET_POOL_CAPACITY 16384 ///< max idle packets kept in session packet pool
 
 static bool rijndael_initialize(struct rtp *session, u_char * hash,
                                int hash_len);
@@ -122,6 +127,9 @@ static int des_encrypt(struct rtp *session, unsigned char *data,
                        unsigned int size, unsigned char *initVec);
 static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                uint8_t *buffer, rtp_packet *packet, int buflen);
+static void rtp_init_metrics(struct rtp *session);
+static void rtcp_rx_start(struct rtp *session);
+static void rtcp_rx_stop(struct rtp *session);
 
 #define MAX_DROPOUT    3000
 #define MAX_MISORDER   100
@@ -142,6 +150,13 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
 #define RTCP_BYE  203
 #define RTCP_APP  204
 #define RTCP_RX   205
+#define RTCP_RTPFB RTCP_RX /* RFC 4585 transport layer feedback, shares PT with the (TFRC) RX report */
+#define RTCP_RTPFB_FMT_NACK 1
+#define RTCP_PSFB 206 /* RFC 4585 payload-specific feedback */
+#define RTCP_PSFB_FMT_PLI 1
+#define RTCP_PSFB_FMT_AFB 15 /* application layer feedback */
+#define RTCP_AFB_VIEWPORT_ID 0x55475650 /* "UGVP" - first FCI word of UltraGrid viewport feedback */
+#define RTCP_AFB_VIEWPORT_LEN 5 /* FCI length in 32-bit words - ID and 4 angles */
 
 typedef struct {
 #ifdef WORDS_BIGENDIAN
@@ -233,6 +248,8 @@ typedef struct _source {
         int probation;
         uint32_t jitter;
         uint32_t transit;
+        uint64_t *red_seen;     /* received sequence numbers (bitmap) if redundant path is used */
+        uint16_t red_highest;
         uint32_t magic;         /* For debugging... */
 } source;
 
@@ -301,6 +318,7 @@ struct rtp {
         time_ns_t last_rtcp_send_time;
         time_ns_t next_rtcp_send_time;
         double rtcp_interval;
+        double rtcp_min_time;   /* minimal RTCP interval in seconds, 0 - default (RTCP_MIN_TIME) */
         int sdes_count_pri;
         int sdes_count_sec;
         int sdes_count_ter;
@@ -308,6 +326,12 @@ struct rtp {
         uint32_t rtp_pcount;
         uint32_t rtp_bcount;
         uint64_t rtp_bytes_sent;
+        struct metrics_counter *metric_tx_packets;
+        struct metrics_counter *metric_tx_bytes;
+        struct metrics_counter *metric_rx_packets;
+        struct metrics_counter *metric_rx_bytes;
+        struct metrics_counter *metric_rx_duplicates;
+        bool redundant;         /* packets are received through 2 paths - duplicates are removed */
         int tfrc_on;            /* indicates TFRC congestion control */
         /* tfrc sender variables */
         uint32_t cmp_rtt;       /* rtt as computed by the sender */
@@ -331,8 +355,16 @@ struct rtp {
                 } des;
         } crypto_state;
         rtp_callback callback;
-        struct msghdr *mhdr;
         bool mt_recv; /* whether the receiver uses separate thread for receiving */
+        struct rtcp_rx_thread *rtcp_rx; /* RTCP receiving thread (mt_recv only), NULL if not running */
+        struct rtp_packet_pool *packet_pool; /* received packets if !mt_recv (mt uses socket's pool) */
+        struct rtp_nack_cache *nack_cache; /* sent packets for retransmission, NULL if disabled */
+        atomic_uint rr_fb_count;        /* report blocks about our stream since rtp_get_rr_feedback() */
+        atomic_uint rr_fb_fract_lost;   /* worst fraction lost (1/256) in these blocks */
+        atomic_uint rr_fb_rtt_us;       /* worst RTT computed from these blocks */
+        atomic_bool pli_received;       /* PLI for our stream since rtp_pli_received() */
+        atomic_int viewport[4];         /* last viewport feedback (yaw, pitch, fov_h, fov_v) in millidegrees */
+        atomic_bool viewport_received;  /* viewport feedback since rtp_viewport_received() */
         uint32_t magic;         /* For debugging...  */
 };
 
@@ -671,7 +703,7 @@ static inline source *create_source(struct rtp *session, uint32_t ssrc,
         }
         /* Source is already in the database... Mark it as */
         /* active and exit (this is the common case...)    */
-        s->last_active = get_time_in_ns();
+        s->last_active = get_time_in_ns_fast();
         return s;
 }
 
@@ -719,6 +751,7 @@ static void delete_source(struct rtp *session, uint32_t ssrc)
                 free(s->sdes_priv);
         if (s->sr != NULL)
                 free(s->sr);
+        free(s->red_seen);
 
         remove_rr(session, ssrc);
 
@@ -856,7 +889,7 @@ static double rtcp_interval(struct rtp *session)
         double const COMPENSATION = 2.71828 - 1.5;
 
         double t;               /* interval */
-        double rtcp_min_time = RTCP_MIN_TIME;
+        double rtcp_min_time = session->rtcp_min_time > 0 ? session->rtcp_min_time : RTCP_MIN_TIME;
         int n;                  /* no. of members for computation */
         double rtcp_bw = session->rtcp_bw;
 
@@ -1104,6 +1137,7 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         memset(session, 0, sizeof(struct rtp));
 
         session->magic = 0xfeedface;
+        rtp_init_metrics(session);
         session->opt = (options *) malloc(sizeof(options));
         session->userdata = userdata;
         session->mt_recv = multithreaded;
@@ -1166,7 +1200,6 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
         session->sdes_count_ter = 0;
         session->rtp_seq = (uint16_t) lrand48();
         session->rtp_pcount = 0;
-        session->mhdr = NULL;
         session->tfrc_on = tfrc_on;
         session->rtp_bcount = 0;
         session->rtp_bytes_sent = 0;
@@ -1200,6 +1233,10 @@ struct rtp *rtp_init_if(const char *addr, const char *iface,
                      strlen(cname));
         free(cname);            /* cname is copied by rtp_set_sdes()... */
 
+        if (session->mt_recv) {
+                rtcp_rx_start(session);
+        }
+
         log_msg(LOG_LEVEL_DEBUG, "Created new RTP session with SSRC 0x%08x.\n",
                   session->my_ssrc);
 
@@ -1219,6 +1256,7 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         memset(session, 0, sizeof(struct rtp));
 
         session->magic = 0xfeedface;
+        rtp_init_metrics(session);
         session->opt = (options *) malloc(sizeof(options));
         // socket is not designated to receiving
         session->userdata = 0;
@@ -1259,7 +1297,6 @@ rtp_t rtp_init_with_udp_socket(struct socket_udp_local *l, struct sockaddr *sa,
         session->sdes_count_ter = 0;
         session->rtp_seq = (uint16_t) lrand48();
         session->rtp_pcount = 0;
-        session->mhdr = NULL;
         session->tfrc_on = tfrc_on;
         session->rtp_bcount = 0;
         session->rtp_bytes_sent = 0;
@@ -1540,14 +1577,27 @@ process_rtp(struct rtp *session, uint32_t curr_rtp_ts, rtp_packet * packet,
                 event.type = RX_RTP;
 
                 //              printf("This packet is going to have size %d\n",sizeof(packet));
-                event.data = (void *)packet;    /* The callback function MUST free this! */
+                event.data = (void *)packet;    /* The callback function MUST free this (rtp_packet_free())! */
                 session->callback(session, &event);
         }
 }
 
-void rtp_set_recv_iov(struct rtp *session, struct msghdr *m)
+/**
+ * Lets payload of received RTP packets be placed directly to its final
+ * location by the reader thread (only for multithreaded receive).
+ *
+ * @retval false if not possible (single-threaded receive, other placement set)
+ */
+bool rtp_set_recv_placement(struct rtp *session, const struct udp_recv_placement *p)
 {
-        session->mhdr = m;
+        return session->mt_recv && udp_set_recv_placement(session->rtp_socket, p);
+}
+
+void rtp_clear_recv_placement(struct rtp *session, const struct udp_recv_placement *p)
+{
+        if (session->mt_recv) {
+                udp_clear_recv_placement(session->rtp_socket, p);
+        }
 }
 
 int rtp_send_raw_rtp_data(struct rtp *session, char *data, int buflen)
@@ -1568,7 +1618,10 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                 buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
         } else {
                 if (!session->opt->reuse_bufs || (packet == NULL)) {
-                        packet = (rtp_packet *) malloc(RTP_MAX_PACKET_LEN + (session->opt->record_source ? sizeof(struct sockaddr_storage) : 0));
+                        if (session->packet_pool == NULL) {
+                                session->packet_pool = rtp_packet_pool_create(RTP_MAX_PACKET_LEN + sizeof(struct sockaddr_storage), RTP_PACKET_POOL_CAPACITY);
+                        }
+                        packet = (rtp_packet *) rtp_packet_alloc(session->packet_pool);
                         buffer = ((uint8_t *) packet) + RTP_PACKET_HEADER_SIZE;
                 }
                 struct sockaddr_storage *sin = NULL;
@@ -1582,7 +1635,9 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
                                         RTP_MAX_PACKET_LEN - RTP_PACKET_HEADER_SIZE,
                                         (struct sockaddr *) sin, sin ? &addrlen : 0);
                 if (buflen <= 0) {
-                        free(packet);
+                        rtp_packet_free(packet);
+                } else {
+                        packet->recv_ts = 0;
                 }
         }
 
@@ -1593,6 +1648,43 @@ static int rtp_recv_data(struct rtp *session, uint32_t curr_rtp_ts)
         return buflen;
 }
 
+static void rtp_init_metrics(struct rtp *session)
+{
+        session->metric_tx_packets = metrics_counter_register("rtp_tx_packets", "Sent RTP packets", NULL);
+        session->metric_tx_bytes = metrics_counter_register("rtp_tx_bytes", "Sent RTP bytes (including headers)", NULL);
+        session->metric_rx_packets = metrics_counter_register("rtp_rx_packets", "Received RTP packets", NULL);
+        session->metric_rx_bytes = metrics_counter_register("rtp_rx_bytes", "Received RTP bytes (including headers)", NULL);
+        session->metric_rx_duplicates = metrics_counter_register("rtp_rx_duplicate_packets",
+                        "Received RTP packets discarded as duplicates from the redundant path", NULL);
+}
+
+#define RTP_SEQ_BITMAP_WORDS (65536 / 64)
+
+/**
+ * Checks if the packet was already received over the other path. Every
+ * sequence number has a bit, the bits are cleared as the highest sequence
+ * number advances, so that each of them is cleared once per a sequence
+ * number cycle (O(1) amortized).
+ */
+static bool rtp_redundant_duplicate(source *s, uint16_t seq)
+{
+        if (s->red_seen == NULL) {
+                s->red_seen = (uint64_t *) calloc(RTP_SEQ_BITMAP_WORDS, sizeof s->red_seen[0]);
+                s->red_highest = seq - 1;
+        }
+        int16_t delta = (int16_t) (seq - s->red_highest);
+        if (delta > 0) {
+                for (uint16_t i = s->red_highest + 1; i != seq; ++i) {
+                        s->red_seen[i / 64] &= ~(1ULL << (i % 64));
+                }
+                s->red_highest = seq;
+        } else if (s->red_seen[seq / 64] & (1ULL << (seq % 64))) {
+                return true;
+        }
+        s->red_seen[seq / 64] |= 1ULL << (seq % 64);
+        return false;
+}
+
 static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                uint8_t *buffer, rtp_packet *packet, int buflen)
 {
@@ -1602,6 +1694,8 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
         source *s;
 
         if (buflen > 0) {
+                metrics_counter_add(session->metric_rx_packets, 1);
+                metrics_counter_add(session->metric_rx_bytes, buflen);
                 if (session->encryption_enabled) {
                         uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
                         (session->decrypt_func) (session, buffer, buflen,
@@ -1674,11 +1768,20 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                                                       FALSE);
                                         s = get_source(session, packet->ssrc);
                                 }
+                                if (session->redundant && rtp_redundant_duplicate(s, packet->seq)) {
+                                        metrics_counter_add(session->metric_rx_duplicates, 1);
+                                        if (!session->opt->reuse_bufs) {
+                                                rtp_packet_free(packet);
+                                        }
+                                        return;
+                                }
                                 update_seq(s, packet->seq);
                                 process_rtp(session, curr_rtp_ts, packet, s);
                                 return; /* We don't free "packet", that's done by the callback function... */
                         }
-                        if (s != NULL) {
+                        if (s != NULL && session->redundant && rtp_redundant_duplicate(s, packet->seq)) {
+                                metrics_counter_add(session->metric_rx_duplicates, 1);
+                        } else if (s != NULL) {
                                 if (s->probation == -1) {
                                         s->probation = MIN_SEQUENTIAL;
                                         s->max_seq = packet->seq - 1;
@@ -1701,7 +1804,7 @@ static void rtp_process_data(struct rtp *session, uint32_t curr_rtp_ts,
                 }
 
                 if (!session->opt->reuse_bufs) {
-                        free(packet);
+                        rtp_packet_free(packet);
                 }
         }
 }
@@ -1882,6 +1985,49 @@ static int validate_rtcp(uint8_t * packet, int len)
         return is_okay;
 }
 
+static void atomic_store_max(atomic_uint *var, unsigned val)
+{
+        unsigned old = atomic_load(var);
+        while (val > old && !atomic_compare_exchange_weak(var, &old, val)) {
+        }
+}
+
+/*
+ * Accumulates the worst reception quality reported for our own stream
+ * until it is picked up by rtp_get_rr_feedback().
+ */
+static void store_rr_feedback(struct rtp *session, const rtcp_rr *rr)
+{
+        if (rr->lsr != 0) {
+                uint32_t ntp_sec, ntp_frac;
+                ntp64_time(&ntp_sec, &ntp_frac);
+                uint32_t now = ntp64_to_ntp32(ntp_sec, ntp_frac);
+                if (now - rr->lsr >= rr->dlsr) { /* otherwise bogus */
+                        uint32_t rtt = now - rr->lsr - rr->dlsr; /* in 1/65536 s */
+                        atomic_store_max(&session->rr_fb_rtt_us, (uint64_t) rtt * 1000000 / 65536);
+                }
+        }
+        atomic_store_max(&session->rr_fb_fract_lost, rr->fract_lost);
+        atomic_fetch_add(&session->rr_fb_count, 1);
+}
+
+void rtp_set_rtcp_min_interval(struct rtp *session, double seconds)
+{
+        session->rtcp_min_time = seconds;
+}
+
+bool rtp_get_rr_feedback(struct rtp *session, struct rtp_rr_feedback *fb)
+{
+        unsigned count = atomic_exchange(&session->rr_fb_count, 0);
+        if (count == 0) {
+                return false;
+        }
+        fb->fract_lost = atomic_exchange(&session->rr_fb_fract_lost, 0) / 256.0;
+        fb->rtt_us = atomic_exchange(&session->rr_fb_rtt_us, 0);
+        fb->reports = count;
+        return true;
+}
+
 static void process_report_blocks(struct rtp *session, rtcp_t * packet,
                                   uint32_t ssrc, rtcp_rr * rrp, rtcp_rx * rrx)
 {
@@ -1920,6 +2066,10 @@ static void process_report_blocks(struct rtp *session, rtcp_t * packet,
                         /* Create a database entry for this SSRC, if one doesn't already exist... */
                         create_source(session, rr->ssrc, FALSE);
 
+                        if (rr->ssrc == session->my_ssrc && ssrc != session->my_ssrc) {
+                                store_rr_feedback(session, rr);
+                        }
+
                         /* Call the event handler... */
                         if (!filter_event(session, ssrc)) {
                                 event.ssrc = ssrc;
@@ -2003,6 +2153,191 @@ static void process_rtcp_rr(struct rtp *session, rtcp_t * packet)
         }
 }
 
+#define RTP_NACK_MAX_PENDING 1024 ///< max requested packets waiting for retransmission
+#define RTP_NACK_MAX_FCI 128      ///< max FCI entries (PID + BLP) in one NACK packet
+#define RTP_NACK_SLOT_LEN RTP_MAX_MTU
+
+/// recently sent RTP packets kept for retransmission on generic NACK (RFC 4585)
+struct rtp_nack_cache {
+        pthread_mutex_t lock;
+        int size;             ///< number of slots, packet seq is stored in slot seq % size
+        uint8_t *mem;         ///< size * RTP_NACK_SLOT_LEN bytes
+        int *len;             ///< length of the packet in slot, 0 if empty
+        uint16_t *seq;
+        uint16_t pending[RTP_NACK_MAX_PENDING];
+        atomic_int pending_count; ///< modified under lock, may be checked without
+        unsigned long long requested;
+        unsigned long long retransmitted;
+};
+
+/**
+ * Enables the cache of sent packets that are retransmitted when the receiver
+ * requests them with a NACK.
+ *
+ * @param packets number of packets to be kept
+ */
+bool rtp_enable_nack(struct rtp *session, int packets)
+{
+        if (session->nack_cache != NULL || packets <= 0) {
+                return false;
+        }
+        struct rtp_nack_cache *c = calloc(1, sizeof *c);
+        c->size = packets;
+        c->mem = malloc((size_t) packets * RTP_NACK_SLOT_LEN);
+        c->len = calloc(packets, sizeof c->len[0]);
+        c->seq = calloc(packets, sizeof c->seq[0]);
+        if (c->mem == NULL || c->len == NULL || c->seq == NULL) {
+                log_msg(LOG_LEVEL_ERROR, "RTP: cannot allocate retransmission cache of %d packets\n", packets);
+                free(c->mem);
+                free(c->len);
+                free(c->seq);
+                free(c);
+                return false;
+        }
+        pthread_mutex_init(&c->lock, NULL);
+        session->nack_cache = c;
+        return true;
+}
+
+static void rtp_nack_cache_destroy(struct rtp_nack_cache *c)
+{
+        if (c == NULL) {
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, "RTP: %llu packets requested by NACK, %llu retransmitted\n",
+                        c->requested, c->retransmitted);
+        pthread_mutex_destroy(&c->lock);
+        free(c->mem);
+        free(c->len);
+        free(c->seq);
+        free(c);
+}
+
+static void rtp_nack_cache_store(struct rtp_nack_cache *c, uint16_t seq, const char *hdr, int hdr_len,
+                const char *phdr, int phdr_len, const char *data, int data_len)
+{
+        if (hdr_len + phdr_len + data_len > RTP_NACK_SLOT_LEN) {
+                return;
+        }
+        int slot = seq % c->size;
+        uint8_t *dst = c->mem + (size_t) slot * RTP_NACK_SLOT_LEN;
+        pthread_mutex_lock(&c->lock);
+        memcpy(dst, hdr, hdr_len);
+        if (phdr_len > 0) {
+                memcpy(dst + hdr_len, phdr, phdr_len);
+        }
+        if (data_len > 0) {
+                memcpy(dst + hdr_len + phdr_len, data, data_len);
+        }
+        c->len[slot] = hdr_len + phdr_len + data_len;
+        c->seq[slot] = seq;
+        pthread_mutex_unlock(&c->lock);
+}
+
+static void rtp_nack_add_pending(struct rtp_nack_cache *c, uint16_t seq)
+{
+        c->requested += 1;
+        if (c->pending_count < RTP_NACK_MAX_PENDING) {
+                c->pending[c->pending_count++] = seq;
+        }
+}
+
+static void process_rtcp_nack(struct rtp *session, rtcp_t * packet)
+{
+        struct rtp_nack_cache *c = session->nack_cache;
+        const uint32_t *words = (const uint32_t *)(const void *) packet;
+        const int len = ntohs(packet->common.length); // words following the common header
+        if (c == NULL || len < 2 || ntohl(words[2]) != session->my_ssrc) {
+                return;
+        }
+        pthread_mutex_lock(&c->lock);
+        for (int i = 3; i <= len; ++i) {
+                uint32_t fci = ntohl(words[i]);
+                uint16_t pid = fci >> 16;
+                uint16_t blp = fci & 0xFFFF;
+                rtp_nack_add_pending(c, pid);
+                for (int b = 0; b < 16; ++b) {
+                        if (blp & (1U << b)) {
+                                rtp_nack_add_pending(c, pid + b + 1);
+                        }
+                }
+        }
+        pthread_mutex_unlock(&c->lock);
+}
+
+static void process_rtcp_pli(struct rtp *session, rtcp_t * packet)
+{
+        const uint32_t *words = (const uint32_t *)(const void *) packet;
+        if (ntohs(packet->common.length) < 2 || ntohl(words[2]) != session->my_ssrc) {
+                return;
+        }
+        atomic_store(&session->pli_received, true);
+}
+
+static void process_rtcp_afb(struct rtp *session, rtcp_t * packet)
+{
+        const uint32_t *words = (const uint32_t *)(const void *) packet;
+        if (ntohs(packet->common.length) < 2 + RTCP_AFB_VIEWPORT_LEN || ntohl(words[2]) != session->my_ssrc
+                        || ntohl(words[3]) != RTCP_AFB_VIEWPORT_ID) {
+                return;
+        }
+        for (int i = 0; i < 4; ++i) {
+                atomic_store(&session->viewport[i], (int32_t) ntohl(words[4 + i]));
+        }
+        atomic_store(&session->viewport_received, true);
+}
+
+/**
+ * @retval true if a Picture Loss Indication (RFC 4585) for our stream has
+ * arrived since the previous call, ie. a receiver asks for a keyframe
+ */
+bool rtp_pli_received(struct rtp *session)
+{
+        return atomic_exchange(&session->pli_received, false);
+}
+
+/**
+ * @retval true if a receiver reported its viewport since the previous call,
+ *              viewport then contains the most recent one
+ */
+bool rtp_viewport_received(struct rtp *session, struct video_viewport *viewport)
+{
+        if (!atomic_exchange(&session->viewport_received, false)) {
+                return false;
+        }
+        viewport->yaw = atomic_load(&session->viewport[0]) / 1000.0F;
+        viewport->pitch = atomic_load(&session->viewport[1]) / 1000.0F;
+        viewport->fov_h = atomic_load(&session->viewport[2]) / 1000.0F;
+        viewport->fov_v = atomic_load(&session->viewport[3]) / 1000.0F;
+        return true;
+}
+
+/**
+ * Retransmits the packets requested by NACKs received so far. It is called
+ * before sending every RTP data packet and it should be called also after
+ * processing incoming RTCP by the sending thread.
+ */
+void rtp_retransmit_nacked(struct rtp *session)
+{
+        struct rtp_nack_cache *c = session->nack_cache;
+        if (c == NULL) {
+                return;
+        }
+        pthread_mutex_lock(&c->lock);
+        for (int i = 0; i < c->pending_count; ++i) {
+                int slot = c->pending[i] % c->size;
+                if (c->len[slot] == 0 || c->seq[slot] != c->pending[i]) {
+                        continue; // already overwritten
+                }
+                if (udp_send(session->rtp_socket, (char *) c->mem + (size_t) slot * RTP_NACK_SLOT_LEN,
+                                        c->len[slot]) > 0) {
+                        c->retransmitted += 1;
+                }
+        }
+        c->pending_count = 0;
+        pthread_mutex_unlock(&c->lock);
+}
+
 static void process_rtcp_rx(struct rtp *session, rtcp_t * packet)
 {
         uint32_t ssrc;
@@ -2216,6 +2551,10 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         process_rtcp_rr(session, packet);
                                         break;
                                 case RTCP_RX:
+                                        if (!session->tfrc_on && packet->common.count == RTCP_RTPFB_FMT_NACK) {
+                                                process_rtcp_nack(session, packet);
+                                                break;
+                                        }
                                         /* am not sending up a RX_RTCP_START... */
                                         process_rtcp_rx(session, packet);
                                         if (session->tfrc_on) {
@@ -2281,6 +2620,13 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
                                         }
                                         process_rtcp_app(session, packet);
                                         break;
+                                case RTCP_PSFB:
+                                        if (packet->common.count == RTCP_PSFB_FMT_PLI) {
+                                                process_rtcp_pli(session, packet);
+                                        } else if (packet->common.count == RTCP_PSFB_FMT_AFB) {
+                                                process_rtcp_afb(session, packet);
+                                        }
+                                        break;
                                 default:
                                         debug_msg
                                             ("RTCP packet with unknown type (%d) ignored.\n",
@@ -2321,6 +2667,127 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
         }
 }
 
+/**
+ * Receives and processes a RTCP packet. The source address is recorded as
+ * the RTCP destination (see rtcp_udp_send()) only if a packet was actually
+ * received, a pending error (eg. ECONNREFUSED) doesn't clear it.
+ */
+static void rtcp_recv_process(struct rtp *session)
+{
+        uint8_t buffer[RTP_MAX_PACKET_LEN];
+        struct sockaddr_storage src;
+        socklen_t src_len = sizeof src;
+        int buflen = udp_recvfrom(session->rtcp_socket, (char *)buffer,
+                        RTP_MAX_PACKET_LEN, (struct sockaddr *) &src, &src_len);
+        if (buflen > 0 && src_len > 0) {
+                memcpy(&session->rtcp_dest, &src, src_len);
+                session->rtcp_dest_len = src_len;
+        }
+        rtp_process_ctrl(session, buffer, buflen);
+}
+
+#define RTCP_RX_RING_SIZE 16 ///< power of two
+#define RTCP_RX_TIMEOUT_US 100000 ///< exit check interval of the RTCP thread
+
+struct rtcp_rx_slot {
+        int len;
+        socklen_t src_len;
+        struct sockaddr_storage src;
+        uint8_t buf[RTP_MAX_PACKET_LEN];
+};
+
+/**
+ * RTCP socket is read by a dedicated thread so that the data thread doesn't
+ * need an extra select() per receive call. Received packets are passed in a
+ * single-producer/single-consumer ring and are processed by the data thread
+ * in a batch (rtcp_rx_drain()) - the source database is thus still modified
+ * by one thread only.
+ */
+struct rtcp_rx_thread {
+        pthread_t thread;
+        socket_udp *socket;
+        atomic_bool should_exit;
+        atomic_uint head; ///< written by the RTCP thread
+        atomic_uint tail; ///< written by the data thread
+        unsigned dropped; ///< RTCP thread only
+        struct rtcp_rx_slot slots[RTCP_RX_RING_SIZE];
+};
+
+static void *rtcp_rx_thread_run(void *arg)
+{
+        set_thread_name("rtcp_rx");
+        struct rtcp_rx_thread *r = arg;
+        struct rtcp_rx_slot scratch;
+        while (!atomic_load_explicit(&r->should_exit, memory_order_relaxed)) {
+                unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+                bool full = head - atomic_load_explicit(&r->tail, memory_order_acquire) == RTCP_RX_RING_SIZE;
+                struct rtcp_rx_slot *slot = full ? &scratch : &r->slots[head % RTCP_RX_RING_SIZE];
+                struct timeval timeout = { 0, RTCP_RX_TIMEOUT_US };
+                slot->src_len = sizeof slot->src;
+                slot->len = udp_recvfrom_timeout(r->socket, (char *) slot->buf, sizeof slot->buf,
+                                &timeout, (struct sockaddr *) &slot->src, &slot->src_len);
+                if (slot->len <= 0) {
+                        continue;
+                }
+                if (full) {
+                        if (r->dropped++ == 0) {
+                                log_msg(LOG_LEVEL_WARNING, "RTCP packets not processed fast enough, dropping.\n");
+                        }
+                        continue;
+                }
+                atomic_store_explicit(&r->head, head + 1, memory_order_release);
+        }
+        return NULL;
+}
+
+static void rtcp_rx_start(struct rtp *session)
+{
+        struct rtcp_rx_thread *r = calloc(1, sizeof *r);
+        r->socket = session->rtcp_socket;
+        atomic_init(&r->should_exit, false);
+        atomic_init(&r->head, 0);
+        atomic_init(&r->tail, 0);
+        if (pthread_create(&r->thread, NULL, rtcp_rx_thread_run, r) != 0) {
+                log_msg(LOG_LEVEL_WARNING, "Unable to start RTCP thread, RTCP will be received inline.\n");
+                free(r);
+                return;
+        }
+        session->rtcp_rx = r;
+}
+
+static void rtcp_rx_stop(struct rtp *session)
+{
+        if (session->rtcp_rx == NULL) {
+                return;
+        }
+        atomic_store_explicit(&session->rtcp_rx->should_exit, true, memory_order_relaxed);
+        pthread_join(session->rtcp_rx->thread, NULL);
+        free(session->rtcp_rx);
+        session->rtcp_rx = NULL;
+}
+
+/**
+ * Processes all RTCP packets received by the RTCP thread.
+ * @returns number of processed packets
+ */
+static int rtcp_rx_drain(struct rtp *session)
+{
+        struct rtcp_rx_thread *r = session->rtcp_rx;
+        unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+        int count = 0;
+        for ( ; tail != head; ++tail, ++count) {
+                struct rtcp_rx_slot *slot = &r->slots[tail % RTCP_RX_RING_SIZE];
+                if (slot->src_len > 0) {
+                        memcpy(&session->rtcp_dest, &slot->src, slot->src_len);
+                        session->rtcp_dest_len = slot->src_len;
+                }
+                rtp_process_ctrl(session, slot->buf, slot->len);
+        }
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+        return count;
+}
+
 /**
  * rtp_recv:
  * @session: the session pointer (returned by rtp_init())
@@ -2335,6 +2802,7 @@ static void rtp_process_ctrl(struct rtp *session, uint8_t * buffer, int buflen)
  */
 bool rtp_recv(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_ts)
 {
+        assert(session->rtcp_rx == NULL);
         check_database(session);
         udp_fd_zero();
         udp_fd_set(session->rtp_socket);
@@ -2385,19 +2853,18 @@ bool rtp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_
                         rtp_recv_data(session, curr_rtp_ts);
                         ret = true;
                 }
+                if (session->rtcp_rx != NULL) {
+                        if (rtcp_rx_drain(session) > 0) {
+                                ret = true;
+                        }
+                        return ret;
+                }
                 udp_fd_zero_r(&fd);
                 udp_fd_set_r(session->rtcp_socket, &fd);
                 struct timeval no_wait_tv = { .tv_sec = 0, .tv_usec = 0 };
 
                 if (udp_select_r(&no_wait_tv, &fd) > 0) {
-                        uint8_t buffer[RTP_MAX_PACKET_LEN];
-                        int buflen;
-                        session->rtcp_dest_len = sizeof(session->rtcp_dest);
-                        buflen =
-                                udp_recvfrom(session->rtcp_socket, (char *)buffer,
-                                                RTP_MAX_PACKET_LEN,
-                                                (struct sockaddr *) &session->rtcp_dest, &session->rtcp_dest_len);
-                        rtp_process_ctrl(session, buffer, buflen);
+                        rtcp_recv_process(session);
                         ret = true;
                 }
                 return ret;
@@ -2410,14 +2877,7 @@ bool rtp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp_
                                 rtp_recv_data(session, curr_rtp_ts);
                         }
                         if (udp_fd_isset_r(session->rtcp_socket, &fd)) {
-                                uint8_t buffer[RTP_MAX_PACKET_LEN];
-                                int buflen;
-                                session->rtcp_dest_len = sizeof(session->rtcp_dest);
-                                buflen =
-                                        udp_recvfrom(session->rtcp_socket, (char *)buffer,
-                                                        RTP_MAX_PACKET_LEN,
-                                                        (struct sockaddr *) &session->rtcp_dest, &session->rtcp_dest_len);
-                                rtp_process_ctrl(session, buffer, buflen);
+                                rtcp_recv_process(session);
                         }
                         check_database(session);
                         return true;
@@ -2440,18 +2900,17 @@ bool rtcp_recv_r(struct rtp *session, struct timeval *timeout, uint32_t curr_rtp
         struct udp_fd_r fd;
 
         check_database(session);
+        if (session->rtcp_rx != NULL) {
+                UNUSED(timeout); // all callers poll
+                bool ret = rtcp_rx_drain(session) > 0;
+                check_database(session);
+                return ret;
+        }
         udp_fd_zero_r(&fd);
         udp_fd_set_r(session->rtcp_socket, &fd);
         if (udp_select_r(timeout, &fd) > 0) {
                 if (udp_fd_isset_r(session->rtcp_socket, &fd)) {
-                        uint8_t buffer[RTP_MAX_PACKET_LEN];
-                        int buflen;
-                        session->rtcp_dest_len = sizeof(session->rtcp_dest);
-                        buflen =
-                                udp_recvfrom(session->rtcp_socket, (char *)buffer,
-                                                RTP_MAX_PACKET_LEN,
-                                                (struct sockaddr *) &session->rtcp_dest, &session->rtcp_dest_len);
-                        rtp_process_ctrl(session, buffer, buflen);
+                        rtcp_recv_process(session);
                 }
                 check_database(session);
                 return true;
@@ -2478,6 +2937,7 @@ int rtp_recv_poll_r(struct rtp **sessions, struct timeval *timeout, uint32_t cur
         udp_fd_zero_r(&fd);
 
         for(current = sessions; *current != NULL; ++current) {
+                assert((*current)->rtcp_rx == NULL);
                 check_database(*current);
                 udp_fd_set_r((*current)->rtp_socket, &fd);
                 udp_fd_set_r((*current)->rtcp_socket, &fd);
@@ -2761,8 +3221,8 @@ const rtcp_rr *rtp_get_rr(struct rtp *session, uint32_t reporter,
  * @data: The RTP data to be sent.
  * @data_len: The size @data in bytes.
  * @extn: Extension data (if present).
- * @extn_len: size of @extn in bytes.
- * @extn_type: extension type indicator.
+ * @extn_len: size of @extn in 32-bit words.
+ * @extn_type: extension type indicator (eg. 0xBEDE for RFC 8285 one-byte headers).
  * 
  * Send an RTP packet.  Most media applications will only set the
  * @session, @rtp_ts, @pt, @m, @data, @data_len arguments.
@@ -2813,6 +3273,10 @@ rtp_send_data_hdr(struct rtp *session,
         assert((data == NULL && data_len == 0)
                || (data != NULL && data_len > 0));
 
+        if (session->nack_cache != NULL && session->nack_cache->pending_count > 0) {
+                rtp_retransmit_nacked(session);
+        }
+
         vlen = 12;
         if (session->tfrc_on) {
                 vlen += 4;
@@ -2852,11 +3316,11 @@ rtp_send_data_hdr(struct rtp *session,
         assert(buffer_len < RTP_MAX_PACKET_LEN);
         /* we dont always need 20 (12|16) but this seems to work. LG */
 #ifdef WIN32
-        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + 20 + RTP_PACKET_HEADER_SIZE);
+        d = (uint8_t *) malloc(3 * sizeof(WSABUF) + buffer_len + RTP_PACKET_HEADER_SIZE);
         send_vector = d;
         buffer = (uint8_t *) d + 3 * sizeof(WSABUF);
 #else
-        d = buffer = (uint8_t *) malloc(20 + RTP_PACKET_HEADER_SIZE);
+        d = buffer = (uint8_t *) malloc(buffer_len + RTP_PACKET_HEADER_SIZE);
 #endif
         packet = (rtp_packet *)(void *) buffer;
 
@@ -2909,10 +3373,11 @@ rtp_send_data_hdr(struct rtp *session,
         /* ...a header extension? */
         if (extn != NULL) {
                 /* We don't use the packet->extn_type field here, that's for receive only... */
-                uint16_t *base = (uint16_t *)(void *) packet->extn;
+                uint8_t *extn_hdr = buffer + RTP_PACKET_HEADER_SIZE + vlen + (4 * cc);
+                uint16_t *base = (uint16_t *)(void *) extn_hdr;
                 base[0] = htons(extn_type);
                 base[1] = htons(extn_len);
-                memcpy(packet->extn + 4, extn, extn_len * 4);
+                memcpy(extn_hdr + 4, extn, extn_len * 4);
         }
         /* ...the payload header... */
         if (phdr != NULL) {
@@ -2955,6 +3420,12 @@ rtp_send_data_hdr(struct rtp *session,
                                          buffer_len, initVec);
         }
 
+        if (session->nack_cache != NULL) {
+                rtp_nack_cache_store(session->nack_cache, ntohs(packet->seq),
+                                (char *) buffer + RTP_PACKET_HEADER_SIZE, buffer_len,
+                                phdr, phdr != NULL ? phdr_len : 0, data, data_len);
+        }
+
         rc = udp_sendv(session->rtp_socket, send_vector, send_vector_len, d);
         if (rc == -1) {
                 log_msg(LOG_LEVEL_WARNING, "sending RTP packet: %s", ug_strerror(errno));
@@ -2966,6 +3437,8 @@ rtp_send_data_hdr(struct rtp *session,
         session->rtp_bcount += buffer_len;
         session->rtp_bytes_sent += buffer_len + data_len;
         session->last_rtp_send_time = get_time_in_ns();
+        metrics_counter_add(session->metric_tx_packets, 1);
+        metrics_counter_add(session->metric_tx_bytes, buffer_len + data_len);
 
         check_database(session);
         return rc;
@@ -3620,6 +4093,180 @@ static void rtp_send_bye_now(struct rtp *session)
         check_database(session);
 }
 
+/**
+ * Sends payload-specific feedback (RFC 4585) to source ssrc immediately (early
+ * feedback), not in the regular RTCP interval.
+ *
+ * @param fci       feedback control information (in network byte order)
+ * @param fci_words length of fci in 32-bit words
+ */
+static void send_psfb(struct rtp *session, uint32_t ssrc, int fmt, const uint32_t *fci, int fci_words)
+{
+        uint8_t buffer[RTP_MAX_PACKET_LEN + MAX_ENCRYPTION_PAD];
+        uint8_t *ptr = buffer;
+        uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+        if (session->encryption_enabled) {
+                *((uint32_t *)(void *) ptr) = lbl_random();
+                ptr += 4;
+        }
+
+        /* Compound RTCP packet must start with SR or RR, use an empty one */
+        rtcp_common *common = (rtcp_common *)(void *) ptr;
+        common->version = 2;
+        common->p = 0;
+        common->count = 0;
+        common->pt = RTCP_RR;
+        common->length = htons(1);
+        ptr += sizeof(rtcp_common);
+        *((uint32_t *)(void *) ptr) = htonl(session->my_ssrc);
+        ptr += 4;
+
+        common = (rtcp_common *)(void *) ptr;
+        common->version = 2;
+        common->p = 0;
+        common->count = fmt;
+        common->pt = RTCP_PSFB;
+        common->length = htons(2 + fci_words);
+        ptr += sizeof(rtcp_common);
+        *((uint32_t *)(void *) ptr) = htonl(session->my_ssrc);
+        ptr += 4;
+        *((uint32_t *)(void *) ptr) = htonl(ssrc);
+        ptr += 4;
+        if (fci_words > 0) {
+                memcpy(ptr, fci, fci_words * 4);
+                ptr += fci_words * 4;
+        }
+
+        if (session->encryption_enabled) {
+                if (((ptr - buffer) % session->encryption_pad_length) != 0) {
+                        /* Add padding to the last packet in the compound, if necessary. */
+                        int padlen =
+                            session->encryption_pad_length -
+                            ((ptr - buffer) % session->encryption_pad_length);
+                        int i;
+
+                        for (i = 0; i < padlen - 1; i++) {
+                                *(ptr++) = '\0';
+                        }
+                        *(ptr++) = (uint8_t) padlen;
+
+                        common->p = TRUE;
+                        common->length =
+                            htons((int16_t)
+                                  (((ptr - (uint8_t *) common) / 4) - 1));
+                }
+                assert(((ptr - buffer) % session->encryption_pad_length) == 0);
+                (session->encrypt_func) (session, buffer, ptr - buffer,
+                                         initVec);
+        }
+        rtcp_udp_send(session, ptr - buffer, (char *)buffer);
+}
+
+/**
+ * Sends Picture Loss Indication (RFC 4585) to source ssrc, which requests
+ * a keyframe.
+ */
+void rtp_send_pli(struct rtp *session, uint32_t ssrc)
+{
+        send_psfb(session, ssrc, RTCP_PSFB_FMT_PLI, NULL, 0);
+}
+
+/**
+ * Reports the viewport of a 360° display to source ssrc (application layer
+ * feedback), so that the sender can prioritize the visible part of the frame.
+ */
+void rtp_send_viewport(struct rtp *session, uint32_t ssrc, const struct video_viewport *viewport)
+{
+        const float angles[] = { viewport->yaw, viewport->pitch, viewport->fov_h, viewport->fov_v };
+        uint32_t fci[RTCP_AFB_VIEWPORT_LEN] = { htonl(RTCP_AFB_VIEWPORT_ID) };
+        for (int i = 0; i < 4; ++i) {
+                fci[1 + i] = htonl((uint32_t) (int32_t) lrintf(angles[i] * 1000.0F));
+        }
+        send_psfb(session, ssrc, RTCP_PSFB_FMT_AFB, fci, RTCP_AFB_VIEWPORT_LEN);
+}
+
+/**
+ * Sends generic NACK (RFC 4585) requesting retransmission of packets with
+ * sequence numbers seqs from source ssrc. Consecutive sequence numbers in
+ * seqs (in ascending order) are packed to the FCI bitmasks.
+ */
+void rtp_send_nack(struct rtp *session, uint32_t ssrc, const uint16_t *seqs, int count)
+{
+        while (count > 0) {
+                uint8_t buffer[RTP_MAX_PACKET_LEN + MAX_ENCRYPTION_PAD];
+                uint8_t *ptr = buffer;
+                uint8_t initVec[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+                if (session->encryption_enabled) {
+                        *((uint32_t *)(void *) ptr) = lbl_random();
+                        ptr += 4;
+                }
+
+                /* Compound RTCP packet must start with SR or RR, use an empty one */
+                rtcp_common *common = (rtcp_common *)(void *) ptr;
+                common->version = 2;
+                common->p = 0;
+                common->count = 0;
+                common->pt = RTCP_RR;
+                common->length = htons(1);
+                ptr += sizeof(rtcp_common);
+                *((uint32_t *)(void *) ptr) = htonl(session->my_ssrc);
+                ptr += 4;
+
+                common = (rtcp_common *)(void *) ptr;
+                common->version = 2;
+                common->p = 0;
+                common->count = RTCP_RTPFB_FMT_NACK;
+                common->pt = RTCP_RTPFB;
+                ptr += sizeof(rtcp_common);
+                *((uint32_t *)(void *) ptr) = htonl(session->my_ssrc);
+                ptr += 4;
+                *((uint32_t *)(void *) ptr) = htonl(ssrc);
+                ptr += 4;
+
+                int fci_count = 0;
+                while (count > 0 && fci_count < RTP_NACK_MAX_FCI) {
+                        uint16_t pid = *seqs++;
+                        uint16_t blp = 0;
+                        count -= 1;
+                        while (count > 0 && (uint16_t) (*seqs - pid) >= 1 && (uint16_t) (*seqs - pid) <= 16) {
+                                blp |= 1U << ((uint16_t) (*seqs - pid) - 1);
+                                seqs++;
+                                count -= 1;
+                        }
+                        *((uint32_t *)(void *) ptr) = htonl((uint32_t) pid << 16 | blp);
+                        ptr += 4;
+                        fci_count += 1;
+                }
+                common->length = htons(2 + fci_count);
+
+                if (session->encryption_enabled) {
+                        if (((ptr - buffer) % session->encryption_pad_length) != 0) {
+                                /* Add padding to the last packet in the compound, if necessary. */
+                                int padlen =
+                                    session->encryption_pad_length -
+                                    ((ptr - buffer) % session->encryption_pad_length);
+                                int i;
+
+                                for (i = 0; i < padlen - 1; i++) {
+                                        *(ptr++) = '\0';
+                                }
+                                *(ptr++) = (uint8_t) padlen;
+
+                                common->p = TRUE;
+                                common->length =
+                                    htons((int16_t)
+                                          (((ptr - (uint8_t *) common) / 4) - 1));
+                        }
+                        assert(((ptr - buffer) % session->encryption_pad_length) == 0);
+                        (session->encrypt_func) (session, buffer, ptr - buffer,
+                                                 initVec);
+                }
+                rtcp_udp_send(session, ptr - buffer, (char *)buffer);
+        }
+}
+
 /**
  * rtp_send_bye:
  * @session: The RTP session
@@ -3663,6 +4310,7 @@ void rtp_send_bye(struct rtp *session)
                 session->next_rtcp_send_time += (rtcp_interval(session) / (session->csrc_count + 1)) * NS_IN_SEC;
 
                 debug_msg("Preparing to send BYE...\n");
+                rtcp_rx_stop(session); // RTCP is received below
                 while (1) {
                         /* Schedule us to block in udp_select() until the time we are due to send our */
                         /* BYE packet. If we receive an RTCP packet from another participant before   */
@@ -3714,6 +4362,7 @@ void rtp_done(struct rtp *session)
         int i;
         source *s, *n;
 
+        rtcp_rx_stop(session);
         check_database(session);
         /* In delete_source, check database gets called and this assumes */
         /* first added and last removed is us.                           */
@@ -3740,6 +4389,8 @@ void rtp_done(struct rtp *session)
 
         udp_exit(session->rtp_socket);
         udp_exit(session->rtcp_socket);
+        rtp_packet_pool_destroy(session->packet_pool);
+        rtp_nack_cache_destroy(session->nack_cache);
         free(session->opt);
         free(session);
 }
@@ -3971,6 +4622,31 @@ static bool rijndael_decrypt(struct rtp *session, unsigned char *data,
         return rc;
 }
 
+/**
+ * Adds a redundant network path (seamless protection like SMPTE 2022-7) -
+ * every RTP packet is sent also to addr and the packets received through
+ * either path are merged (duplicates removed by the sequence number) before
+ * being passed further. Should be called before any packet is sent or
+ * received. Only the multithreaded receiving merges the paths.
+ *
+ * @param addr  address of the second path (destination or multicast group)
+ * @param iface interface of the second path (may be NULL)
+ */
+bool rtp_add_redundant_path(struct rtp *session, const char *addr, const char *iface,
+                uint16_t rx_port, uint16_t tx_port, int ttl, int force_ip_version)
+{
+        socket_udp *red = udp_init_if(addr, iface, rx_port, tx_port, ttl, force_ip_version, false);
+        if (red == NULL) {
+                return false;
+        }
+        if (!udp_add_redundant_path(session->rtp_socket, red)) {
+                udp_exit(red);
+                return false;
+        }
+        session->redundant = true;
+        return true;
+}
+
 /**
  * Sets receiver buffer size
  * @param session the RTP Session
@@ -3991,6 +4667,16 @@ bool rtp_set_send_buf(struct rtp *session, int bufsize)
         return udp_set_send_buf(session->rtp_socket, bufsize);
 }
 
+/**
+ * Sets the length of the received packet queue (multithreaded session only)
+ * @param session the RTP Session
+ * @param len     new queue length in packets
+ */
+bool rtp_set_recv_queue_len(struct rtp *session, unsigned int len)
+{
+        return udp_set_queue_len(session->rtp_socket, len);
+}
+
 /**
  * rtp_flush_recv_buf:
  * Flushes receiver buffer contents.
@@ -4068,6 +4754,21 @@ void rtp_async_wait(struct rtp *session)
        udp_async_wait(session->rtp_socket);
 }
 
+bool rtp_enable_txtime(struct rtp *session)
+{
+        return udp_enable_txtime(session->rtp_socket);
+}
+
+void rtp_set_next_txtime(struct rtp *session, uint64_t txtime_ns)
+{
+        udp_set_next_txtime(session->rtp_socket, txtime_ns);
+}
+
+bool rtp_set_priority(struct rtp *session, bool rtcp, int dscp, int so_priority)
+{
+        return udp_set_priority(rtcp ? session->rtcp_socket : session->rtp_socket, dscp, so_priority);
+}
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session)
 {
         return udp_get_local(session->rtp_socket);
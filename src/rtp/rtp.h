@@ -88,6 +88,7 @@ typedef struct __attribute__((packed)) {
 	uint32_t	*csrc;
 	char		*data;
 	int		 data_len;
+	time_ns_t	 recv_ts;	/* receive time (ns, wall clock), 0 if not measured */
 	unsigned char	*extn;
 	uint16_t	 extn_len;	/* Size of the extension in 32 bit words minus one */
 	uint16_t	 extn_type;	/* Extension type field in the RTP packet header   */
@@ -229,6 +230,7 @@ typedef enum {
 } rtp_option;
 
 struct socket_udp_local;
+struct udp_recv_placement;
 
 /* API */
 rtp_t		rtp_init(const char *addr, 
@@ -293,11 +295,43 @@ const rtcp_rr	*rtp_get_rr(struct rtp *session, uint32_t reporter, uint32_t repor
 bool             rtp_set_encryption_key(struct rtp *session, const char *passphrase);
 bool             rtp_set_my_ssrc(struct rtp *session, uint32_t ssrc);
 
+/**
+ * Reception quality of our stream as reported by its receivers (RR/SR report blocks)
+ */
+struct rtp_rr_feedback {
+        double   fract_lost; ///< worst fraction of packets lost [0..1]
+        uint32_t rtt_us;     ///< worst round-trip time in microseconds, 0 if not known
+        int      reports;    ///< number of report blocks aggregated
+};
+/// overrides the minimal RTCP report interval (5 s)
+void             rtp_set_rtcp_min_interval(struct rtp *session, double seconds);
+/// @retval true if a report has arrived since the previous call, fb is then filled
+bool             rtp_get_rr_feedback(struct rtp *session, struct rtp_rr_feedback *fb);
+
 uint8_t		*rtp_get_userdata(struct rtp *session);
-void 		 rtp_set_recv_iov(struct rtp *session, struct msghdr *m);
+bool             rtp_set_recv_placement(struct rtp *session, const struct udp_recv_placement *p);
+void             rtp_clear_recv_placement(struct rtp *session, const struct udp_recv_placement *p);
+
+/* generic NACK (RFC 4585) based retransmissions */
+bool             rtp_enable_nack(struct rtp *session, int packets);
+void             rtp_send_nack(struct rtp *session, uint32_t ssrc, const uint16_t *seqs, int count);
+void             rtp_retransmit_nacked(struct rtp *session);
+
+/* keyframe requests - Picture Loss Indication (RFC 4585) */
+void             rtp_send_pli(struct rtp *session, uint32_t ssrc);
+bool             rtp_pli_received(struct rtp *session);
+
+/* viewport of a 360° receiver (RFC 4585 application layer feedback) */
+void             rtp_send_viewport(struct rtp *session, uint32_t ssrc, const struct video_viewport *viewport);
+bool             rtp_viewport_received(struct rtp *session, struct video_viewport *viewport);
+
+/* redundant path - packets duplicated to both, merged on reception */
+bool             rtp_add_redundant_path(struct rtp *session, const char *addr, const char *iface,
+                                        uint16_t rx_port, uint16_t tx_port, int ttl, int force_ip_version);
 
 bool             rtp_set_recv_buf(struct rtp *session, int bufsize);
 bool             rtp_set_send_buf(struct rtp *session, int bufsize);
+bool             rtp_set_recv_queue_len(struct rtp *session, unsigned int len);
 
 void             rtp_flush_recv_buf(struct rtp *session);
 int              rtp_get_udp_rx_port(struct rtp *session);
@@ -307,7 +341,7 @@ bool             rtp_is_ipv6(struct rtp *session);
 bool             rtp_has_receiver(struct rtp *session);
 
 /*
- * Async API - MSW specific
+ * Async API - MSW specific (on Linux used for sendmmsg() batching)
  *
  * Using async API hugely improves performance.
  * Usage is simple - prior to sending a bulk of packets (eg. video frame), rtp_async_start()
@@ -319,6 +353,19 @@ bool             rtp_has_receiver(struct rtp *session);
 void             rtp_async_start(struct rtp *session, int nr_packets);
 void             rtp_async_wait(struct rtp *session);
 
+/*
+ * Kernel pacing (SO_TXTIME, Linux only) - subsequent packets are sent at
+ * given CLOCK_MONOTONIC time (in ns, std::chrono::steady_clock in C++).
+ */
+bool             rtp_enable_txtime(struct rtp *session);
+void             rtp_set_next_txtime(struct rtp *session, uint64_t txtime_ns);
+
+/*
+ * DSCP marking and SO_PRIORITY (Linux) of the RTP or RTCP socket, -1 keeps
+ * the current value.
+ */
+bool             rtp_set_priority(struct rtp *session, bool rtcp, int dscp, int so_priority);
+
 struct socket_udp_local *rtp_get_udp_local_socket(struct rtp *session);
 
 #ifdef __cplusplus
@@ -69,6 +69,7 @@
 #include "video_codec.h"
 #include "ntp.h"
 #include "tv.h"
+#include "rtp/packet_pool.h"
 #include "rtp/rtp.h"
 #include "rtp/pbuf.h"
 #include "rtp/rtp_callback.h"
@@ -221,6 +222,8 @@ void rtp_recv_callback(struct rtp *session, rtp_event * e)
                                pckt_rtp->data_len + 40);
                 if (pckt_rtp->data_len > 0) {   /* Only process packets that contain data... */
                         pbuf_insert(state->playout_buffer, pckt_rtp);
+                } else {
+                        rtp_packet_free(pckt_rtp);
                 }
                 break;
         case RX_TFRC_RX:
@@ -0,0 +1,118 @@
+/**
+ * @file   rtp/rtp_hdrext.h
+ * @brief  RFC 8285 RTP header extensions
+ *
+ * Only the one-byte header form is used. There is no SDP negotiation for the
+ * UltraGrid payload types, so the extension IDs are fixed. The capture time
+ * is carried in the abs-capture-time element (64-bit NTP timestamp of the
+ * capture on the sender wall clock, the optional clock offset is omitted).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RTP_HDREXT_H_2B7E5C19_84D3_4A6F_9E21_C0F3A8D6B574
+#define RTP_RTP_HDREXT_H_2B7E5C19_84D3_4A6F_9E21_C0F3A8D6B574
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#else
+#include <cstdint>
+#include <cstring>
+#endif
+
+#include "ntp.h"
+#include "rtp/rtp.h"
+#include "tv.h"
+
+#define RTP_HDREXT_ONE_BYTE             0xBEDE
+#define RTP_HDREXT_ID_ABS_CAPTURE_TIME  1
+#define RTP_HDREXT_ABS_CAPTURE_TIME_WORDS 3 ///< element header (1 B) + timestamp (8 B), padded
+/// bytes added to each packet (incl. the extension header)
+#define RTP_HDREXT_ABS_CAPTURE_TIME_LEN (4 * (1 + RTP_HDREXT_ABS_CAPTURE_TIME_WORDS))
+
+/**
+ * @param[out] buf  extension data to be passed to rtp_send_data_hdr() with
+ *                  RTP_HDREXT_ABS_CAPTURE_TIME_WORDS and RTP_HDREXT_ONE_BYTE
+ */
+static inline void rtp_hdrext_write_abs_capture_time(uint32_t buf[RTP_HDREXT_ABS_CAPTURE_TIME_WORDS],
+                time_ns_t capture_time)
+{
+        uint32_t ntp_sec = 0;
+        uint32_t ntp_frac = 0;
+        unix_ns_to_ntp64(capture_time, &ntp_sec, &ntp_frac);
+
+        unsigned char *p = (unsigned char *) buf;
+        memset(buf, 0, RTP_HDREXT_ABS_CAPTURE_TIME_WORDS * sizeof buf[0]); // trailing padding
+        *p++ = RTP_HDREXT_ID_ABS_CAPTURE_TIME << 4U | (8 - 1);
+        for (int i = 24; i >= 0; i -= 8) {
+                *p++ = ntp_sec >> i;
+        }
+        for (int i = 24; i >= 0; i -= 8) {
+                *p++ = ntp_frac >> i;
+        }
+}
+
+/**
+ * @retval true  packet carries the capture time
+ */
+static inline bool rtp_hdrext_parse_abs_capture_time(const rtp_packet *pckt, time_ns_t *capture_time)
+{
+        if (pckt->extn == NULL || pckt->extn_type != RTP_HDREXT_ONE_BYTE) {
+                return false;
+        }
+        const unsigned char *p = pckt->extn + 4;
+        const unsigned char *end = p + 4 * pckt->extn_len;
+        while (p < end) {
+                if (*p == 0) { // padding
+                        p++;
+                        continue;
+                }
+                unsigned id = *p >> 4U;
+                unsigned len = (*p & 0xFU) + 1;
+                if (id == 15 || p + 1 + len > end) { // reserved ID - stop parsing (RFC 8285 4.2)
+                        return false;
+                }
+                if (id == RTP_HDREXT_ID_ABS_CAPTURE_TIME && len >= 8) {
+                        uint32_t ntp_sec = (uint32_t) p[1] << 24U | p[2] << 16U | p[3] << 8U | p[4];
+                        uint32_t ntp_frac = (uint32_t) p[5] << 24U | p[6] << 16U | p[7] << 8U | p[8];
+                        *capture_time = ntp64_to_unix_ns(ntp_sec, ntp_frac);
+                        return true;
+                }
+                p += 1 + len;
+        }
+        return false;
+}
+
+#endif // defined RTP_RTP_HDREXT_H_2B7E5C19_84D3_4A6F_9E21_C0F3A8D6B574
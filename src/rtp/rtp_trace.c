@@ -0,0 +1,249 @@
+/**
+ * @file   rtp/rtp_trace.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "rtp/rtp_trace.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+
+#define MOD_NAME "[rtp trace] "
+
+#define PCAP_MAGIC_US 0xa1b2c3d4U
+#define PCAP_MAGIC_NS 0xa1b23c4dU
+#define PCAP_SNAPLEN 65535
+#define PCAP_HDR_LEN 24
+#define PCAP_REC_HDR_LEN 16
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define IPV4_HDR_LEN 20
+#define IPV6_HDR_LEN 40
+#define UDP_HDR_LEN 8
+#define IPPROTO_UDP_NUM 17
+
+struct rtp_trace {
+        FILE *f;
+        bool swapped;      ///< file written with other endianness (read only)
+        bool ns;           ///< nanosecond timestamps (read only)
+        uint32_t linktype; ///< (read only)
+        unsigned char rec[PCAP_SNAPLEN + 64];
+};
+
+static uint32_t get32(const struct rtp_trace *t, const unsigned char *p)
+{
+        uint32_t val;
+        memcpy(&val, p, sizeof val);
+        return t->swapped ? __builtin_bswap32(val) : val;
+}
+
+static uint16_t get_be16(const unsigned char *p)
+{
+        return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+static void put_be16(unsigned char *p, uint16_t val)
+{
+        p[0] = val >> 8;
+        p[1] = val & 0xFF;
+}
+
+struct rtp_trace *rtp_trace_create(const char *filename)
+{
+        struct rtp_trace *t = calloc(1, sizeof *t);
+        if ((t->f = fopen(filename, "wb")) == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create %s: %s\n", filename, ug_strerror(errno));
+                free(t);
+                return NULL;
+        }
+        uint32_t hdr[] = { PCAP_MAGIC_US, 0, 0, 0, PCAP_SNAPLEN, LINKTYPE_RAW };
+        _Static_assert(sizeof hdr == PCAP_HDR_LEN, "pcap header size");
+        const uint16_t version[2] = { 2, 4 }; // major and minor are 16-bit fields in host order
+        memcpy(&hdr[1], version, sizeof version);
+        if (fwrite(hdr, sizeof hdr, 1, t->f) != 1) {
+                rtp_trace_close(t);
+                return NULL;
+        }
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Recording received packets to %s\n", filename);
+        return t;
+}
+
+bool rtp_trace_write(struct rtp_trace *t, time_ns_t ts, uint16_t src_port, uint16_t dst_port,
+                const char *data, int len)
+{
+        len = MIN(len, PCAP_SNAPLEN - IPV4_HDR_LEN - UDP_HDR_LEN);
+        const uint32_t total = IPV4_HDR_LEN + UDP_HDR_LEN + len;
+        const uint32_t rec_hdr[] = { (uint32_t) (ts / NS_IN_SEC), (uint32_t) (ts % NS_IN_SEC / 1000), total, total };
+
+        unsigned char hdr[IPV4_HDR_LEN + UDP_HDR_LEN] = {
+                0x45, 0, 0, 0, // version + IHL, DSCP, total length
+                0, 0, 0x40, 0, // id, flags (DF)
+                64, IPPROTO_UDP_NUM, 0, 0, // TTL, protocol, checksum
+                127, 0, 0, 1,
+                127, 0, 0, 1,
+        };
+        put_be16(hdr + 2, total);
+        uint32_t sum = 0;
+        for (int i = 0; i < IPV4_HDR_LEN; i += 2) {
+                sum += get_be16(hdr + i);
+        }
+        sum = (sum & 0xFFFF) + (sum >> 16);
+        put_be16(hdr + 10, ~(sum + (sum >> 16)));
+        put_be16(hdr + IPV4_HDR_LEN, src_port);
+        put_be16(hdr + IPV4_HDR_LEN + 2, dst_port);
+        put_be16(hdr + IPV4_HDR_LEN + 4, UDP_HDR_LEN + len); // checksum 0 - not computed
+        return fwrite(rec_hdr, sizeof rec_hdr, 1, t->f) == 1 && fwrite(hdr, sizeof hdr, 1, t->f) == 1
+                && fwrite(data, len, 1, t->f) == 1;
+}
+
+struct rtp_trace *rtp_trace_open(const char *filename)
+{
+        struct rtp_trace *t = calloc(1, sizeof *t);
+        unsigned char hdr[PCAP_HDR_LEN];
+        if ((t->f = fopen(filename, "rb")) == NULL) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s: %s\n", filename, ug_strerror(errno));
+                free(t);
+                return NULL;
+        }
+        if (fread(hdr, sizeof hdr, 1, t->f) != 1) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s: cannot read pcap header\n", filename);
+                rtp_trace_close(t);
+                return NULL;
+        }
+        uint32_t magic = get32(t, hdr);
+        t->swapped = magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+        magic = get32(t, hdr);
+        t->ns = magic == PCAP_MAGIC_NS;
+        t->linktype = get32(t, hdr + 20) & 0xFFFF;
+        if ((magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS)
+                        || (t->linktype != LINKTYPE_ETHERNET && t->linktype != LINKTYPE_RAW && t->linktype != LINKTYPE_LINUX_SLL)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "%s: not a pcap file or unsupported link type\n", filename);
+                rtp_trace_close(t);
+                return NULL;
+        }
+        return t;
+}
+
+/**
+ * @returns offset of the IP header in the record, -1 if not IP
+ */
+static int ip_offset(const struct rtp_trace *t, const unsigned char *rec, uint32_t len)
+{
+        switch (t->linktype) {
+        case LINKTYPE_RAW:
+                return 0;
+        case LINKTYPE_ETHERNET:
+                return len >= 14 && (get_be16(rec + 12) == 0x0800 || get_be16(rec + 12) == 0x86DD) ? 14 : -1;
+        case LINKTYPE_LINUX_SLL:
+                return len >= 16 && (get_be16(rec + 14) == 0x0800 || get_be16(rec + 14) == 0x86DD) ? 16 : -1;
+        }
+        return -1;
+}
+
+int rtp_trace_read(struct rtp_trace *t, time_ns_t *ts, uint16_t *src_port, uint16_t *dst_port,
+                char *buf, int buflen)
+{
+        while (true) {
+                unsigned char rec_hdr[PCAP_REC_HDR_LEN];
+                if (fread(rec_hdr, sizeof rec_hdr, 1, t->f) != 1) {
+                        return feof(t->f) ? 0 : -1;
+                }
+                const uint32_t incl_len = get32(t, rec_hdr + 8);
+                if (incl_len > sizeof t->rec || fread(t->rec, incl_len, 1, t->f) != 1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Truncated or corrupted record!\n");
+                        return -1;
+                }
+                int off = ip_offset(t, t->rec, incl_len);
+                if (off < 0 || incl_len < (uint32_t) off + 1) {
+                        continue;
+                }
+                const unsigned char *ip = t->rec + off;
+                int udp_off = 0;
+                if (ip[0] >> 4 == 4 && incl_len >= (uint32_t) off + IPV4_HDR_LEN && ip[9] == IPPROTO_UDP_NUM) {
+                        udp_off = off + (ip[0] & 0xF) * 4;
+                } else if (ip[0] >> 4 == 6 && incl_len >= (uint32_t) off + IPV6_HDR_LEN && ip[6] == IPPROTO_UDP_NUM) {
+                        udp_off = off + IPV6_HDR_LEN;
+                } else {
+                        continue;
+                }
+                if (incl_len < (uint32_t) udp_off + UDP_HDR_LEN) {
+                        continue;
+                }
+                const unsigned char *udp = t->rec + udp_off;
+                int len = MIN((int) get_be16(udp + 4) - UDP_HDR_LEN, (int) incl_len - udp_off - UDP_HDR_LEN);
+                if (len <= 0) {
+                        continue; // 0 is reserved for EOF
+                }
+                len = MIN(len, buflen);
+                memcpy(buf, udp + UDP_HDR_LEN, len);
+                *ts = (time_ns_t) get32(t, rec_hdr) * NS_IN_SEC + get32(t, rec_hdr + 4) * (t->ns ? 1 : 1000);
+                if (src_port != NULL) {
+                        *src_port = get_be16(udp);
+                }
+                if (dst_port != NULL) {
+                        *dst_port = get_be16(udp + 2);
+                }
+                return len;
+        }
+}
+
+void rtp_trace_rewind(struct rtp_trace *t)
+{
+        fseek(t->f, PCAP_HDR_LEN, SEEK_SET);
+}
+
+void rtp_trace_close(struct rtp_trace *t)
+{
+        if (t == NULL) {
+                return;
+        }
+        if (t->f != NULL) {
+                fclose(t->f);
+        }
+        free(t);
+}
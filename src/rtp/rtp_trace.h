@@ -0,0 +1,86 @@
+/**
+ * @file   rtp/rtp_trace.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  pcap files with received UDP datagrams (recording and replay)
+ *
+ * Traces are written as pcap with raw IPv4 packets (LINKTYPE_RAW) with the
+ * UDP payload prefixed by synthetic loopback IPv4/UDP headers so that they
+ * can be inspected with Wireshark (Decode As RTP). Besides the own traces,
+ * captures made by tcpdump (Ethernet, Linux cooked or raw IPv4/IPv6 link
+ * types) can be read.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RTP_RTP_TRACE_H_
+#define RTP_RTP_TRACE_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#include "tv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rtp_trace;
+
+/// @returns trace to be written, NULL on error (message is printed)
+struct rtp_trace *rtp_trace_create(const char *filename);
+/// @param ts receive time (any clock, only the differences are significant)
+bool              rtp_trace_write(struct rtp_trace *t, time_ns_t ts, uint16_t src_port, uint16_t dst_port,
+                                  const char *data, int len);
+/// @returns trace to be read, NULL on error (message is printed)
+struct rtp_trace *rtp_trace_open(const char *filename);
+/**
+ * Reads next UDP datagram, records that are not UDP over IPv4/IPv6 are skipped.
+ * @param ts       receive time of the datagram
+ * @param src_port, dst_port may be NULL
+ * @returns payload length (truncated to buflen), 0 at the end of the trace, -1 on error
+ */
+int               rtp_trace_read(struct rtp_trace *t, time_ns_t *ts, uint16_t *src_port, uint16_t *dst_port,
+                                 char *buf, int buflen);
+/// restarts reading from the first record
+void              rtp_trace_rewind(struct rtp_trace *t);
+void              rtp_trace_close(struct rtp_trace *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RTP_RTP_TRACE_H_
@@ -70,6 +70,8 @@
 #define PT_ENCRYPT_VIDEO_RS   30
 #define PT_AUDIO_RS           35
 #define PT_ENCRYPT_AUDIO_RS   36
+#define PT_VIDEO_RLC          37
+#define PT_ENCRYPT_VIDEO_RLC  38
 #define PT_Unassign_Type95  95 /* reserved for future, backward compatible use with UG (metadata etc.) */
 #define PT_DynRTP_Type96    96 /* usually H.264 */
 #define PT_DynRTP_Type97    97 /* mU-law stereo amongst others */
@@ -144,6 +146,10 @@ typedef uint32_t audio_payload_hdr_t[5];
  *
  * 5th word
  * bits 0 - 31 LDGM random generator seed
+ *
+ * For RLC, K is the window length, M the count of source symbols between
+ * repair bursts, C the count of repair symbols per burst and the
+ * 5th word carries the symbol size.
  */
 typedef uint32_t fec_payload_hdr_t[5];
 
@@ -159,7 +165,7 @@ typedef uint32_t crypto_payload_hdr_t[1];
 #define PT_AUDIO_HAS_FEC(pt) ((pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO_RS)
 #define PT_AUDIO_IS_ENCRYPTED(pt) ((pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS)
 #define PT_IS_AUDIO(pt) ((pt) == PT_AUDIO || (pt) == PT_AUDIO_RS || (pt) == PT_ENCRYPT_AUDIO || (pt) == PT_ENCRYPT_AUDIO_RS)
-#define PT_VIDEO_HAS_FEC(pt) (pt == PT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_VIDEO_RS || pt == PT_ENCRYPT_VIDEO_RS)
-#define PT_VIDEO_IS_ENCRYPTED(pt) (pt == PT_ENCRYPT_VIDEO || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_RS)
+#define PT_VIDEO_HAS_FEC(pt) (pt == PT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_VIDEO_RS || pt == PT_ENCRYPT_VIDEO_RS || pt == PT_VIDEO_RLC || pt == PT_ENCRYPT_VIDEO_RLC)
+#define PT_VIDEO_IS_ENCRYPTED(pt) (pt == PT_ENCRYPT_VIDEO || pt == PT_ENCRYPT_VIDEO_LDGM || pt == PT_ENCRYPT_VIDEO_RS || pt == PT_ENCRYPT_VIDEO_RLC)
 
 #define BUFNUM_BITS 22U
@@ -46,13 +46,17 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <string.h>
+
 #include "debug.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
 #include "rtp/pbuf.h"
 #include "rtp/rtpdec_h264.h"
-#include "utils/h264_stream.h"
 #include "utils/bs.h"
+#include "utils/frame_alloc.h"
+#include "utils/h264_stream.h"
+#include "video_codec.h"
 #include "video_frame.h"
 
 // NAL values >23 are invalid in H.264 codestream but used by RTP
@@ -62,204 +66,285 @@
 #define RTP_MTAP24 27
 #define RTP_FU_A   28
 #define RTP_FU_B   29
-/// type was 1-23 representing H.264 NAL type
-#define H264_NAL   32
+// HEVC (RFC 7798) payload types
+#define RTP_HEVC_AP   48
+#define RTP_HEVC_FU   49
+#define RTP_HEVC_PACI 50
+
+#define NAL_HEVC_BLA_W_LP 16
+#define NAL_HEVC_CRA      21
+
+#define HEVC_NALU_HDR_GET_TYPE(nal) (((nal) >> 1U) & 0x3FU)
 
 static const uint8_t start_sequence[] = { 0, 0, 0, 1 };
 
 int fill_coded_frame_from_sps(struct video_frame *rx_data, unsigned char *data, int data_len);
 
+/**
+ * Depacketizer state - the bitstream is appended to the frame tile data,
+ * which grows if needed and is always followed by MAX_PADDING zeroed bytes
+ * (at least AV_INPUT_BUFFER_PADDING_SIZE) so that it can be passed to
+ * libavcodec without a copy.
+ */
+struct h264_depack {
+    struct decode_data_h264 *d;
+    struct video_frame *frame;
+    unsigned char *buf;
+    size_t len;
+    size_t fu_start; ///< start code of the NAL unit being reassembled from FUs
+    _Bool fu_active;
+};
+
+static _Bool reserve(struct h264_depack *s, size_t len) {
+    if (s->len + len <= s->d->buf_size) {
+        return TRUE;
+    }
+    size_t new_size = s->d->buf_size * 2;
+    if (new_size < s->len + len) {
+        new_size = s->len + len;
+    }
+    unsigned char *new_buf = frame_data_alloc(new_size + MAX_PADDING, NULL);
+    if (new_buf == NULL) {
+        error_msg("Cannot allocate %zu B for the H.264 bitstream!\n", new_size);
+        return FALSE;
+    }
+    memcpy(new_buf, s->buf, s->len);
+    frame_data_free(s->buf);
+    s->buf = new_buf;
+    s->frame->tiles[0].data = (char *) new_buf;
+    s->d->buf_size = new_size;
+    return TRUE;
+}
+
+static _Bool append(struct h264_depack *s, const uint8_t *hdr, int hdr_len, const uint8_t *data, int data_len) {
+    if (!reserve(s, hdr_len + data_len)) {
+        return FALSE;
+    }
+    if (hdr_len > 0) {
+        memcpy(s->buf + s->len, hdr, hdr_len);
+    }
+    memcpy(s->buf + s->len + hdr_len, data, data_len);
+    s->len += hdr_len + data_len;
+    return TRUE;
+}
+
+/**
+ * Sets the frame as INTRA - the RTSP/SDP sprop-parameter-sets are prepended
+ * to the bitstream then. The NAL units already written precede the first
+ * IDR/SEI (usually just the parameter sets) so moving them is cheap.
+ */
+static _Bool set_intra(struct h264_depack *s) {
+    if (s->frame->frame_type == INTRA) {
+        return TRUE;
+    }
+    s->frame->frame_type = INTRA;
+    int offset_len = s->d->offset_len;
+    if (offset_len == 0 || s->d->offset_buf == NULL) {
+        return TRUE;
+    }
+    if (!reserve(s, offset_len)) {
+        return FALSE;
+    }
+    memmove(s->buf + offset_len, s->buf, s->len);
+    memcpy(s->buf, s->d->offset_buf, offset_len);
+    s->len += offset_len;
+    s->fu_start += offset_len;
+    return TRUE;
+}
+
 /**
  * This function extracts important data for futher processing of the stream,
  * eg. frame type - for prepending RTSP/SDP sprop-parameter-sets to I-frame and
  * parsing dimensions from SPS NAL.
  *
- * Should be run in 1st pass - it sets frame_type according to which does the
- * decoder deduce offset in 2nd pass.
- *
- * @retval H.264 or RTP NAL type
+ * @param data  whole NAL unit (including header) or NULL if not yet available
+ *              (FU start), SPS is not parsed then
  */
-static uint8_t process_nal(uint8_t nal, struct video_frame *frame, uint8_t *data, int data_len) {
-    uint8_t type = NALU_HDR_GET_TYPE(nal);
-    uint8_t nri = NALU_HDR_GET_NRI(nal);
+static _Bool process_nal(struct h264_depack *s, const uint8_t *hdr, uint8_t *data, int data_len) {
+    if (s->d->hevc) {
+        uint8_t type = HEVC_NALU_HDR_GET_TYPE(hdr[0]);
+        log_msg(LOG_LEVEL_DEBUG2, "HEVC NAL type %d\n", (int) type);
+        if (type >= NAL_HEVC_BLA_W_LP && type <= NAL_HEVC_CRA) {
+            return set_intra(s);
+        }
+        if (type < NAL_HEVC_VPS && s->frame->frame_type == BFRAME) {
+            s->frame->frame_type = OTHER;
+        }
+        return TRUE;
+    }
+
+    uint8_t type = NALU_HDR_GET_TYPE(hdr[0]);
+    uint8_t nri = NALU_HDR_GET_NRI(hdr[0]);
     log_msg(LOG_LEVEL_DEBUG2, "NAL type %d (nri: %d)\n", (int) type, (int) nri);
 
-    if (type == NAL_SPS) {
-        fill_coded_frame_from_sps(frame, data, data_len);
+    if (type == NAL_SPS && data != NULL) {
+        fill_coded_frame_from_sps(s->frame, data, data_len);
     }
 
     if (type >= NAL_MIN && type <= NAL_MAX) {
         if (type == NAL_IDR || type == NAL_SEI) {
-            frame->frame_type = INTRA;
-        } else if (frame->frame_type == BFRAME && nri != 0){
-            frame->frame_type = OTHER;
+            return set_intra(s);
+        }
+        if (s->frame->frame_type == BFRAME && nri != 0){
+            s->frame->frame_type = OTHER;
         }
     }
-    return type;
+    return TRUE;
 }
 
-static _Bool decode_nal_unit(struct video_frame *frame, int *total_length, int pass, unsigned char **dst, uint8_t *data, int data_len) {
-    int fu_length = 0;
-    uint8_t nal = data[0];
-    uint8_t type = pass == 0 ? process_nal(nal, frame, data, data_len) : NALU_HDR_GET_TYPE(nal);
-    if (type >= NAL_MIN && type <= NAL_MAX) {
-        type = H264_NAL;
+static _Bool single_nal(struct h264_depack *s, uint8_t *data, int data_len) {
+    return process_nal(s, data, data, data_len) &&
+            append(s, start_sequence, sizeof start_sequence, data, data_len);
+}
+
+/// STAP-A (H.264) or AP (HEVC) without DONL
+static _Bool aggregation_packet(struct h264_depack *s, uint8_t *data, int data_len) {
+    const int nal_hdr_len = s->d->hevc ? 2 : 1;
+    data += nal_hdr_len;
+    data_len -= nal_hdr_len;
+
+    while (data_len > 2) {
+        uint16_t nal_size;
+        memcpy(&nal_size, data, sizeof(uint16_t));
+        nal_size = ntohs(nal_size);
+
+        data += 2;
+        data_len -= 2;
+
+        if (nal_size > data_len || nal_size < nal_hdr_len) {
+            error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
+            return FALSE;
+        }
+        if (!single_nal(s, data, nal_size)) {
+            return FALSE;
+        }
+        data += nal_size;
+        data_len -= nal_size;
+    }
+    return TRUE;
+}
+
+/// FU-A (H.264) or FU (HEVC)
+static _Bool fragmentation_unit(struct h264_depack *s, uint8_t *data, int data_len) {
+    const int nal_hdr_len = s->d->hevc ? 2 : 1;
+    if (data_len <= nal_hdr_len + 1) {
+        error_msg("Too short data for FU %s RTP packet\n", s->d->hevc ? "HEVC" : "H.264");
+        return FALSE;
+    }
+    uint8_t fu_header = data[nal_hdr_len];
+    _Bool start_bit = fu_header >> 7;
+    _Bool end_bit = (fu_header & 0x40) >> 6;
+
+    // Reconstruct this packet's true nal; only the data follows.
+    uint8_t nal_hdr[2];
+    if (s->d->hevc) {
+        nal_hdr[0] = (data[0] & 0x81) | (fu_header & 0x3F) << 1;
+        nal_hdr[1] = data[1];
+    } else {
+        /* The original nal forbidden bit and NRI are stored in this
+         * packet's nal. */
+        nal_hdr[0] = (data[0] & 0xe0) | NALU_HDR_GET_TYPE(fu_header);
+    }
+    data += nal_hdr_len + 1;
+    data_len -= nal_hdr_len + 1;
+
+    if (!start_bit && !s->fu_active) {
+        log_msg(LOG_LEVEL_DEBUG, "FU without a start fragment - dropping\n");
+        return TRUE;
+    }
+    if (start_bit) {
+        if (!process_nal(s, nal_hdr, NULL, 0)) {
+            return FALSE;
+        }
+        s->fu_start = s->len;
+        s->fu_active = TRUE;
+        if (!append(s, start_sequence, sizeof start_sequence, nal_hdr, nal_hdr_len)) {
+            return FALSE;
+        }
+    }
+    if (!append(s, NULL, 0, data, data_len)) {
+        return FALSE;
+    }
+    if (end_bit) {
+        s->fu_active = FALSE;
+        if (!s->d->hevc && NALU_HDR_GET_TYPE(nal_hdr[0]) == NAL_SPS) {
+            uint8_t *nal = s->buf + s->fu_start + sizeof start_sequence;
+            fill_coded_frame_from_sps(s->frame, nal, s->buf + s->len - nal);
+        }
+    }
+    return TRUE;
+}
+
+static _Bool decode_nal_unit(struct h264_depack *s, uint8_t *data, int data_len) {
+    if (data_len < (s->d->hevc ? 2 : 1)) {
+        error_msg("Empty H.264/HEVC RTP packet\n");
+        return FALSE;
+    }
+    if (s->d->hevc) {
+        uint8_t type = HEVC_NALU_HDR_GET_TYPE(data[0]);
+        switch (type) {
+            case RTP_HEVC_AP:
+                return aggregation_packet(s, data, data_len);
+            case RTP_HEVC_FU:
+                return fragmentation_unit(s, data, data_len);
+            case RTP_HEVC_PACI:
+                error_msg("Unhandled HEVC NAL type %d\n", type);
+                return FALSE;
+            default:
+                return single_nal(s, data, data_len);
+        }
     }
 
+    uint8_t type = NALU_HDR_GET_TYPE(data[0]);
+    if (type >= NAL_MIN && type <= NAL_MAX) {
+        return single_nal(s, data, data_len);
+    }
     switch (type) {
-        case H264_NAL:
-            if (pass == 0) {
-                *total_length += sizeof(start_sequence) + data_len;
-            } else {
-                *dst -= data_len + sizeof(start_sequence);
-                memcpy(*dst, start_sequence, sizeof(start_sequence));
-                memcpy(*dst + sizeof(start_sequence), data, data_len);
-            }
-            break;
         case RTP_STAP_A:
-        {
-            int nal_sizes[100];
-            unsigned nal_count = 0;
-            data++;
-            data_len--;
-
-            while (data_len > 2) {
-                uint16_t nal_size;
-                memcpy(&nal_size, data, sizeof(uint16_t));
-                nal_size = ntohs(nal_size);
-
-                data += 2;
-                data_len -= 2;
-
-                log_msg(LOG_LEVEL_DEBUG2, "STAP-A subpacket NAL type %d (nri: %d)\n", (int) NALU_HDR_GET_TYPE(data[0]), (int) NALU_HDR_GET_NRI(nal));
-
-                if (nal_size <= data_len) {
-                    if (pass == 0) {
-                        *total_length += sizeof(start_sequence) + nal_size;
-                        process_nal(data[0], frame, data, data_len);
-                    } else {
-                        assert(nal_count < sizeof nal_sizes / sizeof nal_sizes[0] - 1);
-                        nal_sizes[nal_count++] = nal_size;
-                    }
-                } else {
-                    error_msg("NAL size exceeds length: %u %d\n", nal_size, data_len);
-                    return FALSE;
-                }
-                data += nal_size;
-                data_len -= nal_size;
-
-                if (data_len < 0) {
-                    error_msg("Consumed more bytes than we got! (%d)\n", data_len);
-                    return FALSE;
-                }
-
-            }
-            if (pass > 0) {
-                for (int i = nal_count - 1; i >= 0; i--) {
-                    int nal_size = nal_sizes[i];
-                    data -= nal_size;
-                    *dst -= nal_size + sizeof(start_sequence);
-                    memcpy(*dst, start_sequence, sizeof(start_sequence));
-                    memcpy(*dst + sizeof(start_sequence), data, nal_size);
-                    data -= 2;
-                }
-            }
-            break;
-        }
+            return aggregation_packet(s, data, data_len);
+        case RTP_FU_A:
+            return fragmentation_unit(s, data, data_len);
         case RTP_STAP_B:
         case RTP_MTAP16:
         case RTP_MTAP24:
         case RTP_FU_B:
             error_msg("Unhandled NAL type %d\n", type);
             return FALSE;
-        case RTP_FU_A:
-            data++;
-            data_len--;
-
-            if (data_len > 1) {
-                uint8_t fu_header = *data;
-                uint8_t start_bit = fu_header >> 7;
-                uint8_t end_bit       = (fu_header & 0x40) >> 6;
-                uint8_t nal_type = NALU_HDR_GET_TYPE(fu_header);
-                uint8_t reconstructed_nal;
-
-                // Reconstruct this packet's true nal; only the data follows.
-                /* The original nal forbidden bit and NRI are stored in this
-                 * packet's nal. */
-                reconstructed_nal = nal & 0xe0;
-                reconstructed_nal |= nal_type;
-
-                // skip the fu_header
-                data++;
-                data_len--;
-
-                if (pass == 0) {
-                    if (end_bit) {
-                        fu_length = data_len;
-                    } else {
-                        fu_length += data_len;
-                    }
-                    if (start_bit) {
-                        *total_length += sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        process_nal(reconstructed_nal, frame, data, fu_length);
-                    } else {
-                        *total_length += data_len;
-                    }
-                } else {
-                    if (start_bit) {
-                        *dst -= sizeof(start_sequence) + sizeof(reconstructed_nal) + data_len;
-                        memcpy(*dst, start_sequence, sizeof(start_sequence));
-                        memcpy(*dst + sizeof(start_sequence), &reconstructed_nal, sizeof(reconstructed_nal));
-                        memcpy(*dst + sizeof(start_sequence) + sizeof(reconstructed_nal), data, data_len);
-                    } else {
-                        *dst -= data_len;
-                        memcpy(*dst, data, data_len);
-                    }
-                }
-            } else {
-                error_msg("Too short data for FU-A H264 RTP packet\n");
-                return FALSE;
-            }
-            break;
         default:
             error_msg("Unknown NAL type %d\n", type);
             return FALSE;
     }
-    return TRUE;
 }
 
+/**
+ * Depacketizes H.264 (RFC 6184) or HEVC (RFC 7798) frame in a single pass
+ * directly to data->frame tile (Annex B).
+ *
+ * Frame tile data must be allocated with frame_data_alloc() with
+ * data->buf_size (+ MAX_PADDING) bytes. If the bitstream doesn't fit, it is
+ * reallocated and buf_size updated, so the caller should keep the value
+ * together with the frame.
+ */
 int decode_frame_h264(struct coded_data *cdata, void *decode_data) {
-    struct coded_data *orig = cdata;
-
-    int total_length = 0;
-
     struct decode_data_h264 *data = (struct decode_data_h264 *) decode_data;
-    struct video_frame *frame = data->frame;
-    frame->frame_type = BFRAME;
-
-    for (int pass = 0; pass < 2; pass++) {
-        unsigned char *dst = NULL;
-
-        if (pass > 0) {
-            cdata = orig;
-            if(frame->frame_type == INTRA){
-                total_length+=data->offset_len;
-            }
-            frame->tiles[0].data_len = total_length;
-            dst = (unsigned char *) frame->tiles[0].data + total_length;
-        }
-
-        while (cdata != NULL) {
-            rtp_packet *pckt = cdata->data;
+    struct h264_depack s = { .d = data, .frame = data->frame,
+        .buf = (unsigned char *) data->frame->tiles[0].data };
+    s.frame->frame_type = BFRAME;
 
-            if (!decode_nal_unit(frame, &total_length, pass, &dst, (uint8_t *) pckt->data, pckt->data_len)) {
-                return FALSE;
-            }
-
-            cdata = cdata->nxt;
+    // coded_data are ordered from the newest packet
+    while (cdata != NULL && cdata->nxt != NULL) {
+        cdata = cdata->nxt;
+    }
+    for ( ; cdata != NULL; cdata = cdata->prv) {
+        rtp_packet *pckt = cdata->data;
+        if (!decode_nal_unit(&s, (uint8_t *) pckt->data, pckt->data_len)) {
+            return FALSE;
         }
     }
 
+    s.frame->tiles[0].data_len = s.len;
+    memset(s.buf + s.len, 0, MAX_PADDING);
+
     return TRUE;
 }
 
@@ -44,6 +44,13 @@
 #ifndef _RTP_DEC_H264_H
 #define _RTP_DEC_H264_H
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -52,16 +59,21 @@ extern "C" {
 #define NAL_IDR     5
 #define NAL_SEI     6
 #define NAL_SPS     7
+#define NAL_PPS     8
 #define NAL_MAX    23
 
 #define NAL_HEVC_VPS 32
+#define NAL_HEVC_PPS 34
 
 struct video_frame;
 
 struct decode_data_h264 {
         struct video_frame *frame;
+        size_t buf_size;                  ///< [in,out] allocated size of frame data (without padding)
+        const unsigned char *offset_buf;  ///< parameter sets prepended to INTRA frames (may be NULL)
         int offset_len;
         int video_pt;
+        bool hevc;
 };
 
 struct coded_data;
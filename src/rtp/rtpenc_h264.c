@@ -52,11 +52,95 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "rtp/rtpenc_h264.h"
+#include "utils/simd_lanes.h"
 
-static uint32_t get4Bytes(const unsigned char *ptr) {
-        return (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3];
+static const unsigned char *find_zero_pair_scalar(const unsigned char *p, const unsigned char *end)
+{
+        for (; end - p >= 2; ++p) {
+                if (p[0] == 0 && p[1] == 0) {
+                        return p;
+                }
+        }
+        return NULL;
+}
+
+#ifdef PIXFMT_SIMD_X86
+__attribute__((target("avx2")))
+static const unsigned char *find_zero_pair_avx2(const unsigned char *p, const unsigned char *end)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        for (; end - p >= 33; p += 32) {
+                __m256i a = _mm256_loadu_si256((const __m256i *)(const void *) p);
+                __m256i b = _mm256_loadu_si256((const __m256i *)(const void *) (p + 1));
+                unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, zero),
+                                        _mm256_cmpeq_epi8(b, zero)));
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_zero_pair_scalar(p, end);
+}
+#endif
+
+#ifdef __SSE2__
+static const unsigned char *find_zero_pair_sse2(const unsigned char *p, const unsigned char *end)
+{
+        const __m128i zero = _mm_setzero_si128();
+        for (; end - p >= 17; p += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i *)(const void *) p);
+                __m128i b = _mm_loadu_si128((const __m128i *)(const void *) (p + 1));
+                unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)));
+                if (mask != 0) {
+                        return p + __builtin_ctz(mask);
+                }
+        }
+        return find_zero_pair_scalar(p, end);
+}
+#endif
+
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+static const unsigned char *find_zero_pair_neon(const unsigned char *p, const unsigned char *end)
+{
+        for (; end - p >= 17; p += 16) {
+                uint8x16_t pair = vandq_u8(vceqzq_u8(vld1q_u8(p)), vceqzq_u8(vld1q_u8(p + 1)));
+                if (vmaxvq_u8(pair) != 0) {
+                        return find_zero_pair_scalar(p, p + 17);
+                }
+        }
+        return find_zero_pair_scalar(p, end);
+}
+#endif
+
+/**
+ * Finds two consecutive zero bytes - the only place where a start code
+ * (00 00 01) or an emulation prevention (00 00 03) may begin. In a slice
+ * they are rare, so the search runs at memchr() speed.
+ *
+ * @returns pointer to the first byte of the first 00 00 in [start, end) or NULL
+ */
+const unsigned char *rtpenc_h264_find_zero_pair(const unsigned char *start, const unsigned char *end)
+{
+#ifdef PIXFMT_SIMD_X86
+        static int use_avx2 = -1; // benign race - all threads resolve the same value
+        if (use_avx2 == -1) {
+                use_avx2 = avx2_available();
+        }
+        if (use_avx2) {
+                return find_zero_pair_avx2(start, end);
+        }
+#endif
+#if defined __SSE2__
+        return find_zero_pair_sse2(start, end);
+#elif defined PIXFMT_SIMD_NEON_ENABLED
+        return find_zero_pair_neon(start, end);
+#else
+        return find_zero_pair_scalar(start, end);
+#endif
 }
 
 /**
@@ -67,22 +151,20 @@ static uint32_t get4Bytes(const unsigned char *ptr) {
  */
 static const unsigned char *get_next_nal(const unsigned char *start, long len, _Bool with_start_code) {
         const unsigned char * const stop = start + len;
-        while (stop - start >= 4) {
-                uint32_t next4Bytes = get4Bytes(start);
-                if (next4Bytes == 0x00000001) {
-                        return start + (with_start_code ? 0 : 4);
-                }
-                if ((next4Bytes & 0xFFFFFF00) == 0x00000100) {
-                        return start + (with_start_code ? 0 : 3);
-                }
-                // We save at least some of "next4Bytes".
-                if ((unsigned) (next4Bytes & 0xFF) > 1) {
-                        // Common case: 0x00000001 or 0x000001 definitely doesn't begin anywhere in "next4Bytes", so we save all of it:
-                        start += 4;
-                } else {
-                        // Save the first byte, and continue testing the rest:
-                        start += 1;
+        const unsigned char *p = start;
+        while ((p = rtpenc_h264_find_zero_pair(p, stop)) != NULL && stop - p >= 3) {
+                if (p[2] == 1) {
+                        // 4-byte start code 00 00 00 01 if preceded by zero
+                        _Bool long_code = p > start && p[-1] == 0;
+                        if (!long_code && stop - p == 3) {
+                                return NULL; // 3-byte code must be followed by NAL unit data
+                        }
+                        if (with_start_code) {
+                                return long_code ? p - 1 : p;
+                        }
+                        return p + 3;
                 }
+                p += p[2] == 0 ? 1 : 3;
         }
         return NULL;
 }
@@ -57,8 +57,9 @@
 extern "C" {
 #endif
 
-// function documented at definition
+// functions documented at definition
 const unsigned char *rtpenc_h264_get_next_nal(const unsigned char *start, long len, const unsigned char **endptr);
+const unsigned char *rtpenc_h264_find_zero_pair(const unsigned char *start, const unsigned char *end);
 
 #ifdef __cplusplus
 }
@@ -56,6 +56,8 @@
  *
  * ### Compressed video ###
  * Data is saved to decompress buffer. The decompression itself is done by decompress_thread().
+ * With decoder-pipeline-depth > 1, decompress_thread() decompresses to own frames that
+ * are passed in order to a display thread, see @ref decompress_pipeline.
  *
  * ### video with FEC ###
  * Data is saved to FEC buffer. Decoded with fec_thread().
@@ -107,14 +109,26 @@
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
+#include "ntp.h"
 #include "rtp/fec.h"
+#include "rtp/net_udp.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtp_hdrext.h"
 #include "rtp/pbuf.h"
+#include "rtp/received_ranges.h"
+#include "rtp/rtpdec_h264.h"
+#include "rtp/rtpenc_h264.h"
 #include "rtp/video_decoders.h"
+#include "utils/av_sync.h"
 #include "utils/color_out.h"
+#include "utils/latency_histogram.hpp"
+#include "utils/latency_probe.h"
 #include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h"
+#include "utils/pipeline_stats.h"
+#include "utils/spsc_queue.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/timed_message.h"
@@ -126,6 +140,7 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <climits>
 #include <condition_variable>
 #ifdef RECONFIGURE_IN_FUTURE_THREAD
 #include <future>
@@ -134,9 +149,11 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <thread>
+#include <tuple>
 
 #ifdef HAVE_LIBAVCODEC_AVCODEC_H
 #include <libavcodec/avcodec.h> // AV_INPUT_BUFFER_PADDING_SIZE
@@ -170,15 +187,6 @@ static void *decompress_thread(void *args);
 static void cleanup(struct state_video_decoder *decoder);
 static void decoder_process_message(struct module *);
 
-static int sum_map(map<int, int> const & m) {
-        int ret = 0;
-        for (map<int, int>::const_iterator it = m.begin();
-                        it != m.end(); ++it) {
-                ret += it->second;
-        }
-        return ret;
-}
-
 namespace {
 
 #ifdef HAVE_LIBAVCODEC_AVCODEC_H
@@ -196,6 +204,16 @@ enum decoder_type_t {
                           * a whole. */
 };
 
+/**
+ * Interlacing change done by a line decoder while writing lines (instead of
+ * a separate change_il pass over the whole frame).
+ */
+enum il_remap_t {
+        IL_REMAP_NONE,            ///< source line N is written to destination line N
+        IL_REMAP_UPPER_TO_MERGED, ///< @sa il_upper_to_merged
+        IL_REMAP_MERGED_TO_UPPER, ///< @sa il_merged_to_upper
+};
+
 /**
  * This structure holds data needed to use a linedecoder.
  */
@@ -208,6 +226,8 @@ struct line_decoder {
         unsigned int         dst_linesize; ///< destination linesize
         unsigned int         dst_pitch;    ///< framebuffer pitch - it can be larger if SDL resolution is larger than data
         unsigned int         src_linesize; ///< source linesize
+        enum il_remap_t      il_remap;     ///< interlacing change fused to the decoding
+        int                  height;       ///< tile height (used only if il_remap is set)
 };
 
 struct reported_statistics_cumul {
@@ -218,6 +238,13 @@ struct reported_statistics_cumul {
         chrono::steady_clock::time_point t_last = chrono::steady_clock::now();
         unsigned long int displayed = 0, dropped = 0, corrupted = 0, missing = 0;
         atomic_ulong fec_ok = 0, fec_corrected = 0, fec_nok = 0;
+        struct metrics_counter *m_displayed = metrics_counter_register("video_decoder_frames", "Received video frames", "result=\"displayed\"");
+        struct metrics_counter *m_dropped = metrics_counter_register("video_decoder_frames", "Received video frames", "result=\"dropped\"");
+        struct metrics_counter *m_corrupted = metrics_counter_register("video_decoder_frames", "Received video frames", "result=\"corrupted\"");
+        struct metrics_counter *m_missing = metrics_counter_register("video_decoder_frames", "Received video frames", "result=\"missing\"");
+        struct metrics_counter *m_fec_ok = metrics_counter_register("fec_frames", "Frames protected by FEC", "result=\"ok\"");
+        struct metrics_counter *m_fec_corrected = metrics_counter_register("fec_frames", "Frames protected by FEC", "result=\"corrected\"");
+        struct metrics_counter *m_fec_nok = metrics_counter_register("fec_frames", "Frames protected by FEC", "result=\"failed\"");
         void print() {
                 ostringstream fec;
                 if (fec_ok + fec_nok + fec_corrected > 0) {
@@ -243,8 +270,10 @@ struct reported_statistics_cumul {
                         diff = (diff + (1U<<BUFNUM_BITS)) % (1U<<BUFNUM_BITS);
                         if (diff < (1U<<BUFNUM_BITS) / 2) {
                                 missing += diff;
+                                metrics_counter_add(m_missing, diff);
                         } else { // frames may have been reordered, add arbitrary 1
                                 missing += 1;
+                                metrics_counter_add(m_missing, 1);
                         }
                 }
                 last_buffer_number = buffer_number;
@@ -267,23 +296,28 @@ struct frame_msg {
                 if (recv_frame) {
                         int received_bytes = 0;
                         for (unsigned int i = 0; i < recv_frame->tile_count; ++i) {
-                                received_bytes += sum_map(pckt_list[i]);
+                                received_bytes += pckt_list[i].total();
                         }
                         int expected_bytes = vf_get_data_len(recv_frame);
                         if (recv_frame->fec_params.type != FEC_NONE) {
                                 if (is_corrupted) {
                                         stats.fec_nok += 1;
+                                        metrics_counter_add(stats.m_fec_nok, 1);
                                 } else {
                                         if (received_bytes == expected_bytes) {
                                                 stats.fec_ok += 1;
+                                                metrics_counter_add(stats.m_fec_ok, 1);
                                         } else {
                                                 stats.fec_corrected += 1;
+                                                metrics_counter_add(stats.m_fec_corrected, 1);
                                         }
                                 }
                         }
                         stats.corrupted += is_corrupted;
                         stats.displayed += is_displayed;
                         stats.dropped += !is_displayed;
+                        metrics_counter_add(stats.m_corrupted, is_corrupted);
+                        metrics_counter_add(is_displayed ? stats.m_displayed : stats.m_dropped, 1);
                 }
                 vf_free(recv_frame);
                 vf_free(nofec_frame);
@@ -292,11 +326,15 @@ struct frame_msg {
         vector <uint32_t> buffer_num;
         struct video_frame *recv_frame; ///< received frame with FEC and/or compression
         struct video_frame *nofec_frame; ///< frame without FEC
-        unique_ptr<map<int, int>[]> pckt_list;
+        unique_ptr<received_ranges[]> pckt_list;
         unsigned long long int received_pkts_cum, expected_pkts_cum;
         struct reported_statistics_cumul &stats;
         bool is_corrupted = false;
         bool is_displayed = false;
+        bool reconf_barrier = false; ///< with recv_frame == nullptr - pipeline drain marker (otherwise poison)
+        time_ns_t recv_ts = 0; ///< receive time of the last packet of the frame (0 if not available)
+        time_ns_t capture_ts = 0; ///< sender time of the frame capture (0 if no sender report)
+        time_ns_t decode_ts = 0; ///< time when the frame was passed from the playout buffer to decoding
 };
 
 struct main_msg_reconfigure {
@@ -316,6 +354,110 @@ struct main_msg_reconfigure {
 };
 }
 
+/// packet payload whose copy/line-decode is deferred to a per-substream worker
+struct deferred_packet {
+        uint32_t    data_pos;
+        const char *data;
+        int         len;
+};
+
+/// per-substream work collected by decode_video_frame() if decoder-shard-substreams is set
+struct substream_shard {
+        struct tile *tile = nullptr;                  ///< destination tile
+        struct line_decoder *line_decoder = nullptr;  ///< NULL - plain memcpy to tile
+        vector<deferred_packet> packets;
+};
+
+/**
+ * Framebuffer to which the UDP reader thread receives payload of the frame
+ * following the last decoded one (decoder-direct-recv). The buffer is
+ * supplied by decompress_thread() after it gets a new frame from the display
+ * and it is detached by decode_video_frame() when it starts writing to it.
+ */
+struct direct_recv {
+        mutex lock;
+        struct rtp *session = nullptr;  ///< session with the placement set, accessed only from the receiver thread
+        uint32_t ssrc = 0;
+        struct udp_recv_placement hooks{};
+
+        char *buf = nullptr;            ///< landing buffer (tile data), NULL if none
+        unsigned int buf_len = 0;
+        struct video_frame *frame = nullptr; ///< frame owning buf (stripe completion reported to it)
+        int linesize = 0;
+        bool assigned = false;          ///< buffer is being filled with the frame with timestamp ts
+        uint32_t ts = 0;
+        bool last_ts_valid = false;
+        uint32_t last_ts = 0;           ///< last decoded frame, older frames are not assigned
+        unsigned int max_end = 0;       ///< end of the highest placed packet
+        int stride = 0;                 ///< payload length of a full packet (prediction step)
+        received_ranges placed;         ///< data received to buf for frame ts
+
+        static constexpr size_t MAX_LOST = 4;
+        vector<pair<uint32_t, received_ranges>> lost; ///< <ts, ranges> of placed data overwritten before decoding
+
+        unsigned long long placed_packets = 0;
+        unsigned long long total_packets = 0;
+};
+
+/**
+ * Last H.264/HEVC parameter sets (VPS, SPS, PPS) received in the stream.
+ * After the decompressor is (re)configured, they are prepended to the first
+ * frame that doesn't carry its own, so that decoding can start without
+ * waiting for the next in-band parameter sets (once per GOP or intra-refresh
+ * period). Accessed only from the decompress thread (and from reconfiguration
+ * while it is drained).
+ */
+struct param_set_cache {
+        vector<char> nals;   ///< Annex B parameter set NAL units
+        bool inject = false; ///< prepend nals to the next frame
+
+        static bool is_param_set(codec_t codec, unsigned char hdr) {
+                if (codec == H264) {
+                        return NALU_HDR_GET_TYPE(hdr) == NAL_SPS || NALU_HDR_GET_TYPE(hdr) == NAL_PPS;
+                }
+                return (hdr >> 1U) >= NAL_HEVC_VPS && (hdr >> 1U) <= NAL_HEVC_PPS;
+        }
+        static bool is_vcl(codec_t codec, unsigned char hdr) {
+                if (codec == H264) {
+                        return NALU_HDR_GET_TYPE(hdr) >= NAL_MIN && NALU_HDR_GET_TYPE(hdr) <= NAL_IDR;
+                }
+                return (hdr >> 1U) < NAL_HEVC_VPS;
+        }
+        /**
+         * Caches parameter sets preceding the first slice of the frame and
+         * returns the frame to be decompressed - either the original one or
+         * a copy in buf prefixed with the cached parameter sets.
+         */
+        pair<char *, unsigned> process(codec_t codec, char *data, unsigned len, vector<char> &buf) {
+                vector<char> found;
+                const auto *const start = (const unsigned char *) data;
+                const unsigned char *end = start;
+                const unsigned char *nal = nullptr;
+                while ((nal = rtpenc_h264_get_next_nal(end, start + len - end, &end)) != nullptr
+                                && !is_vcl(codec, nal[0])) {
+                        if (is_param_set(codec, nal[0])) {
+                                found.insert(found.end(), { 0, 0, 0, 1 });
+                                found.insert(found.end(), (const char *) nal, (const char *) end);
+                        }
+                }
+                if (!found.empty()) {
+                        nals = std::move(found);
+                        inject = false;
+                        return { data, len };
+                }
+                if (!inject || nals.empty()) {
+                        return { data, len };
+                }
+                inject = false;
+                buf.resize(nals.size() + len + PADDING);
+                memcpy(buf.data(), nals.data(), nals.size());
+                memcpy(buf.data() + nals.size(), data, len);
+                memset(buf.data() + nals.size() + len, 0, PADDING);
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Prepending cached parameter sets to the stream.\n";
+                return { buf.data(), (unsigned) (nals.size() + len) };
+        }
+};
+
 /**
  * @brief Decoder state
  */
@@ -328,6 +470,9 @@ struct state_video_decoder
                 mod.new_message = decoder_process_message;
                 module_register(&mod, parent);
                 control = (struct control_state *) get_module(get_root_module(parent), "control");
+                fec_stage = pipeline_stage_get(parent, "fec_decode");
+                decompress_stage = pipeline_stage_get(parent, "decompress");
+                display_stage = pipeline_stage_get(parent, "display");
         }
         ~state_video_decoder() {
                 module_done(&mod);
@@ -363,13 +508,15 @@ struct state_video_decoder
         bool buffer_swapped = true; /**< variable indicating that display buffer
                               * has been processed and we can write to a new one */
         condition_variable buffer_swapped_cv; ///< condition variable associated with @ref buffer_swapped
+        bool reconf_barrier_passed = true; ///< decompress thread has processed all frames preceding the barrier
+        condition_variable reconf_barrier_cv; ///< condition variable associated with @ref reconf_barrier_passed
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> decompress_queue;
+        spsc_queue<unique_ptr<frame_msg>, 1> decompress_queue; ///< fec_thread -> decompress_thread
 
         codec_t           out_codec = VIDEO_CODEC_NONE;
         int               pitch = 0;
 
-        synchronized_queue<unique_ptr<frame_msg>, 1> fec_queue;
+        spsc_queue<unique_ptr<frame_msg>, 1> fec_queue; ///< receiver -> fec_thread
 
         enum video_mode   video_mode = {} ;  ///< video mode set for this decoder
         bool          merged_fb = false; ///< flag if the display device driver requires tiled video or not
@@ -377,6 +524,7 @@ struct state_video_decoder
         timed_message<LOG_LEVEL_WARNING> slow_msg; ///< shows warning ony in certain interval
 
         synchronized_queue<main_msg_reconfigure *, -1> msg_queue;
+        map<string, string> pending_params; ///< set-param values to be applied on next reconf (guarded by lock)
 
         const struct openssl_decrypt_info *dec_funcs = NULL; ///< decrypt state
         struct openssl_decrypt      *decrypt = NULL; ///< decrypt state
@@ -386,6 +534,41 @@ struct state_video_decoder
         bool             reconfiguration_in_progress = false;
 #endif
         struct reported_statistics_cumul stats = {}; ///< stats to be reported through control socket
+
+        bool shard_substreams = false; ///< decode substreams in parallel workers
+        bool fuse_il = false; ///< change interlacing in line decoder if possible
+        vector<substream_shard> shards; ///< used only from decode_video_frame() (receiver thread)
+
+        /// @name per-stage latencies
+        /// net_latency and pbuf_latency are used from receiver thread only, the rest from the thread calling display_put_frame()
+        /// @{
+        latency_histogram net_latency{"RECV_LATENCY", "network"};   ///< sender (capture) to receiver
+        latency_histogram pbuf_latency{"RECV_LATENCY", "pbuf"};     ///< last packet received to frame leaving playout buffer
+        latency_histogram decode_latency{"RECV_LATENCY", "decode"}; ///< frame leaving playout buffer to display_put_frame()
+        latency_histogram display_latency{"RECV_LATENCY", "display"}; ///< display_put_frame() duration
+        latency_histogram glass_latency{"RECV_LATENCY", "glass"};   ///< capture time embedded in picture to frame displayed
+        bool latency_probe = false; ///< extract capture time embedded by the sender (eg. testcard:probe)
+        /// @}
+        struct metrics_histogram *decompress_duration = metrics_histogram_register("decompress_duration", "Video decompression duration", nullptr);
+        struct metrics_histogram *display_put_duration = metrics_histogram_register("display_put_duration", "display_put_frame() duration", nullptr);
+        /// @name pipeline stages for bottleneck detection (see utils/pipeline_stats.h)
+        /// @{
+        struct pipeline_stage *fec_stage = nullptr;
+        struct pipeline_stage *decompress_stage = nullptr;
+        struct pipeline_stage *display_stage = nullptr; ///< display_put_frame()
+        /// @}
+
+        bool direct_recv_requested = false;
+        struct direct_recv direct; ///< direct reception to framebuffer (if direct_recv_requested)
+
+        param_set_cache param_sets; ///< used only for single-tile H.264/HEVC
+        /// @name keyframe requests, see update_keyframe_request()
+        /// @{
+        atomic<bool> keyframe_requested{false}; ///< picked up by video_decoder_keyframe_requested()
+        time_ns_t last_keyframe_request = 0;
+        int no_frame_count = 0;                 ///< consecutive compressed frames that didn't produce output
+        bool decompressed_since_reconf = false;
+        /// @}
 };
 
 /**
@@ -398,11 +581,213 @@ static void wait_for_framebuffer_swap(struct state_video_decoder *decoder) {
         decoder->buffer_swapped_cv.wait(lk, [decoder]{return decoder->buffer_swapped;});
 }
 
+/// @name direct reception to framebuffer
+/// @{
+static bool direct_recv_begin(void *udata)
+{
+        auto *d = (struct direct_recv *) udata;
+        d->lock.lock();
+        if (d->buf == nullptr) {
+                d->lock.unlock();
+                return false;
+        }
+        return true;
+}
+
+/**
+ * Packets of a frame are expected to arrive in sequence with equal payload
+ * length (except the last one) so the idx-th datagram of the batch is
+ * predicted to follow the highest packet received so far.
+ */
+static char *direct_recv_predict(void *udata, int idx, int *len)
+{
+        auto *d = (struct direct_recv *) udata;
+        if (d->stride == 0) {
+                return nullptr;
+        }
+        unsigned long long off = d->max_end + (unsigned long long) idx * d->stride;
+        if (off >= d->buf_len) {
+                return nullptr;
+        }
+        *len = min<unsigned long long>(d->stride, d->buf_len - off);
+        return d->buf + off;
+}
+
+static bool direct_recv_commit(void *udata, const char *hdr, char *dst, int payload_len)
+{
+        auto *d = (struct direct_recv *) udata;
+        uint32_t rtp_hdr[3];
+        video_payload_hdr_t video_hdr;
+        memcpy(rtp_hdr, hdr, sizeof rtp_hdr);
+        memcpy(video_hdr, hdr + sizeof rtp_hdr, sizeof video_hdr);
+        // RTPv2 without padding, extension and CSRCs
+        if ((ntohl(rtp_hdr[0]) >> 24) != 0x80 || ((ntohl(rtp_hdr[0]) >> 16) & 0x7f) != PT_VIDEO ||
+                        ntohl(rtp_hdr[2]) != d->ssrc) {
+                return false;
+        }
+        uint32_t ts = ntohl(rtp_hdr[1]);
+        uint32_t substream = ntohl(video_hdr[0]) >> 22;
+        uint32_t data_pos = ntohl(video_hdr[1]);
+        uint32_t buffer_length = ntohl(video_hdr[2]);
+        if (substream != 0 || buffer_length != d->buf_len || data_pos > buffer_length ||
+                        (uint32_t) payload_len > buffer_length - data_pos) {
+                return false;
+        }
+        d->total_packets += 1;
+        if (data_pos + payload_len < buffer_length) {
+                d->stride = payload_len;
+        }
+        if (!d->assigned) {
+                if (d->last_ts_valid && (int32_t) (ts - d->last_ts) <= 0) {
+                        return false;
+                }
+                d->assigned = true;
+                d->ts = ts;
+                d->placed.clear();
+        }
+        if (ts != d->ts) {
+                return false;
+        }
+        // predictions never overlap already placed data
+        d->max_end = max(d->max_end, data_pos + payload_len);
+        if (dst != d->buf + data_pos) {
+                return false;
+        }
+        d->placed.add(data_pos, payload_len);
+        d->placed_packets += 1;
+        vf_stripes_add(d->frame, d->linesize, data_pos, payload_len);
+        return true;
+}
+
+static void direct_recv_end(void *udata)
+{
+        ((struct direct_recv *) udata)->lock.unlock();
+}
+
+/// removes landing buffer, placed data of the assigned frame are recorded as lost
+static void direct_recv_drop_locked(struct direct_recv *d)
+{
+        if (d->assigned && !d->placed.empty()) {
+                if (d->lost.size() == d->MAX_LOST) {
+                        d->lost.erase(d->lost.begin());
+                }
+                d->lost.emplace_back(d->ts, std::move(d->placed));
+        }
+        d->buf = nullptr;
+        d->assigned = false;
+        d->placed.clear();
+}
+
+static void direct_recv_drop(struct state_video_decoder *decoder)
+{
+        if (!decoder->direct_recv_requested) {
+                return;
+        }
+        lock_guard<mutex> lk(decoder->direct.lock);
+        direct_recv_drop_locked(&decoder->direct);
+}
+
+/**
+ * Offers decoder->frame as a landing buffer. Called by decompress_thread()
+ * after getting a new frame from display.
+ */
+static void direct_recv_supply(struct state_video_decoder *decoder)
+{
+        struct direct_recv *d = &decoder->direct;
+        if (!decoder->direct_recv_requested) {
+                return;
+        }
+        lock_guard<mutex> lk(d->lock);
+        direct_recv_drop_locked(d);
+        if (decoder->frame == nullptr || decoder->frame->tile_count != 1 ||
+                        decoder->decoder_type != LINE_DECODER || decoder->max_substreams != 1 ||
+                        decoder->decrypt != nullptr) {
+                return;
+        }
+        const struct line_decoder *ld = &decoder->line_decoder[0];
+        // payload must map 1:1 to the framebuffer
+        if (ld->decode_line != vc_memcpy || ld->base_offset != 0 || ld->src_linesize != ld->dst_linesize ||
+                        ld->dst_pitch != ld->dst_linesize || ld->il_remap != IL_REMAP_NONE) {
+                return;
+        }
+        d->buf = decoder->frame->tiles[0].data;
+        d->buf_len = decoder->frame->tiles[0].data_len;
+        d->frame = decoder->frame;
+        d->linesize = ld->dst_linesize;
+        d->max_end = 0;
+}
+
+/**
+ * Detaches the landing buffer before decode_video_frame() starts writing to
+ * decoder->frame.
+ *
+ * @returns ranges of frame ts that were already received to the framebuffer
+ */
+static received_ranges direct_recv_detach(struct state_video_decoder *decoder, uint32_t ts)
+{
+        struct direct_recv *d = &decoder->direct;
+        received_ranges ret;
+        if (!decoder->direct_recv_requested) {
+                return ret;
+        }
+        lock_guard<mutex> lk(d->lock);
+        if (d->assigned && d->ts == ts && decoder->frame != nullptr && d->buf == decoder->frame->tiles[0].data) {
+                swap(ret, d->placed);
+                d->assigned = false;
+        } else if (d->assigned && !d->placed.empty() && d->frame == decoder->frame) {
+                vf_stripes_reset(d->frame); // placed data of another frame are going to be overwritten
+        }
+        direct_recv_drop_locked(d);
+        d->last_ts_valid = true;
+        d->last_ts = ts;
+        return ret;
+}
+
+/// @returns ranges of frame ts that were received to an already reused framebuffer
+static received_ranges direct_recv_get_lost(struct state_video_decoder *decoder, uint32_t ts)
+{
+        struct direct_recv *d = &decoder->direct;
+        received_ranges ret;
+        if (!decoder->direct_recv_requested) {
+                return ret;
+        }
+        lock_guard<mutex> lk(d->lock);
+        for (auto it = d->lost.begin(); it != d->lost.end(); ++it) {
+                if (it->first == ts) {
+                        swap(ret, it->second);
+                        d->lost.erase(it);
+                        break;
+                }
+        }
+        return ret;
+}
+/// @}
+
 #define ENCRYPTED_ERR "Receiving encrypted video data but " \
         "no decryption key entered!\n"
 #define NOT_ENCRYPTED_ERR "Receiving unencrypted video data " \
         "while expecting encrypted.\n"
 
+/// FEC decoding of one substream, run in parallel if the FEC allows it
+struct fec_substream_job {
+        fec *state;
+        frame_msg *msg;
+        int pos;
+        char *out;
+        int out_len;
+        bool ret;
+};
+
+static void *fec_decode_substream_task(void *arg)
+{
+        auto *job = (struct fec_substream_job *) arg;
+        struct video_frame *recv_frame = job->msg->recv_frame;
+        job->ret = job->state->decode(recv_frame->tiles[job->pos].data,
+                        recv_frame->tiles[job->pos].data_len,
+                        &job->out, &job->out_len, job->msg->pckt_list[job->pos]);
+        return NULL;
+}
+
 static void *fec_thread(void *args) {
         set_thread_name(__func__);
         struct state_video_decoder *decoder =
@@ -410,20 +795,28 @@ static void *fec_thread(void *args) {
 
         fec *fec_state = NULL;
         struct fec_desc desc(FEC_NONE);
+        vector<fec_substream_job> fec_jobs;
 
         while(1) {
+                pipeline_stage_queue(decoder->fec_stage, decoder->fec_queue.size(), 1);
                 unique_ptr<frame_msg> data = decoder->fec_queue.pop();
 
-                if (!data->recv_frame) { // poisoned
+                if (!data->recv_frame) { // poisoned or reconfiguration barrier
+                        const bool poisoned = !data->reconf_barrier;
                         decoder->decompress_queue.push(std::move(data));
-                        break; // exit from loop
+                        if (poisoned) {
+                                break; // exit from loop
+                        }
+                        continue;
                 }
 
+                pipeline_stage_timer busy(decoder->fec_stage);
                 struct video_frame *frame = decoder->frame;
                 struct tile *tile = NULL;
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
-                        if(!fec_state || desc.k != data->recv_frame->fec_params.k ||
+                        if(!fec_state || desc.type != data->recv_frame->fec_params.type ||
+                                        desc.k != data->recv_frame->fec_params.k ||
                                         desc.m != data->recv_frame->fec_params.m ||
                                         desc.c != data->recv_frame->fec_params.c ||
                                         desc.seed != data->recv_frame->fec_params.seed
@@ -444,23 +837,32 @@ static void *fec_thread(void *args) {
 
                 if (data->recv_frame->fec_params.type != FEC_NONE) {
                         bool buffer_swapped = false;
-                        for (int pos = 0; pos < get_video_mode_tiles_x(decoder->video_mode)
-                                        * get_video_mode_tiles_y(decoder->video_mode); ++pos) {
-                                char *fec_out_buffer = NULL;
-                                int fec_out_len = 0;
+                        const int substreams = get_video_mode_tiles_x(decoder->video_mode)
+                                        * get_video_mode_tiles_y(decoder->video_mode);
+                        fec_jobs.resize(substreams);
+                        for (int pos = 0; pos < substreams; ++pos) {
+                                fec_jobs[pos] = { fec_state, data.get(), pos, nullptr, 0, false };
+                        }
+                        if (substreams > 1 && fec_state->thread_safe_decode()) {
+                                task_run_parallel(fec_decode_substream_task, substreams, fec_jobs.data(),
+                                                sizeof fec_jobs[0], NULL);
+                        } else {
+                                for (auto &job : fec_jobs) {
+                                        fec_decode_substream_task(&job);
+                                }
+                        }
+                        for (int pos = 0; pos < substreams; ++pos) {
+                                char *fec_out_buffer = fec_jobs[pos].out;
+                                int fec_out_len = fec_jobs[pos].out_len;
 
-                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) sum_map(data->pckt_list[pos])) {
+                                if (data->recv_frame->tiles[pos].data_len != (unsigned int) data->pckt_list[pos].total()) {
                                         debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.\n", pos,
                                                         (unsigned int) data->buffer_num[pos],
                                                         data->recv_frame->tiles[pos].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[pos]));
+                                                        (unsigned int) data->pckt_list[pos].total());
                                 }
 
-                                bool ret = fec_state->decode(data->recv_frame->tiles[pos].data,
-                                                data->recv_frame->tiles[pos].data_len,
-                                                &fec_out_buffer, &fec_out_len, data->pckt_list[pos]);
-
-                                if (ret == false) {
+                                if (!fec_jobs[pos].ret) {
                                         data->is_corrupted = true;
                                         verbose_msg("[decoder] FEC: unable to reconstruct data.\n");
                                         if (fec_out_len < (int) sizeof(video_payload_hdr_t)) {
@@ -496,6 +898,7 @@ static void *fec_thread(void *args) {
                                         if (!buffer_swapped) {
                                                 buffer_swapped = true;
                                                 wait_for_framebuffer_swap(decoder);
+                                                direct_recv_drop(decoder);
                                                 unique_lock<mutex> lk(decoder->lock);
                                                 decoder->buffer_swapped = false;
                                         }
@@ -532,11 +935,11 @@ static void *fec_thread(void *args) {
                                 data->nofec_frame->tiles[i].data_len = data->recv_frame->tiles[i].data_len;
                                 data->nofec_frame->tiles[i].data = data->recv_frame->tiles[i].data;
 
-                                if (data->recv_frame->tiles[i].data_len != (unsigned int) sum_map(data->pckt_list[i])) {
+                                if (data->recv_frame->tiles[i].data_len != (unsigned int) data->pckt_list[i].total()) {
                                         debug_msg("Frame incomplete - substream %d, buffer %d: expected %u bytes, got %u.%s\n", i,
                                                         (unsigned int) data->buffer_num[i],
                                                         data->recv_frame->tiles[i].data_len,
-                                                        (unsigned int) sum_map(data->pckt_list[i]),
+                                                        (unsigned int) data->pckt_list[i].total(),
                                                         decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame ? " dropped.\n" : "");
                                         data->is_corrupted = true;
                                         if(decoder->decoder_type == EXTERNAL_DECODER && !decoder->accepts_corrupted_frame) {
@@ -546,6 +949,7 @@ static void *fec_thread(void *args) {
                         }
                 }
 
+                busy.done();
                 decoder->decompress_queue.push(std::move(data));
 cleanup:
                 ;
@@ -573,10 +977,12 @@ static bool blacklist_current_out_codec(struct state_video_decoder *decoder){
 struct decompress_data {
         struct state_video_decoder *decoder;
         int pos;
-        struct video_frame *compressed;
+        char *src;
+        unsigned int src_len;
         int buffer_num;
         decompress_status ret = DECODER_NO_FRAME;
         unsigned char *out;
+        struct video_frame_callbacks *callbacks;
         struct pixfmt_desc internal_prop; // set only if probing (ret == DECODER_GOT_CODEC)
 };
 static void *decompress_worker(void *data)
@@ -584,28 +990,235 @@ static void *decompress_worker(void *data)
         auto d = (struct decompress_data *) data;
         struct state_video_decoder *decoder = d->decoder;
 
-        if (!d->compressed->tiles[d->pos].data)
+        if (!d->src)
                 return NULL;
+        const time_ns_t t0 = get_time_in_ns();
         d->ret = decompress_frame(decoder->decompress_state.at(d->pos),
                         (unsigned char *) d->out,
-                        (unsigned char *) d->compressed->tiles[d->pos].data,
-                        d->compressed->tiles[d->pos].data_len,
+                        (unsigned char *) d->src,
+                        d->src_len,
                         d->buffer_num,
-                        &decoder->frame->callbacks,
+                        d->callbacks,
                         &d->internal_prop);
+        metrics_histogram_record(decoder->decompress_duration, get_time_in_ns() - t0);
         return d;
 }
 
+/**
+ * Requests a keyframe from the sender (RTCP PLI sent by the receiver loop) if
+ * an interframe stream doesn't produce any output - either after the decoder
+ * has been (re)configured, eg. on stream start or switch, or if it got out of
+ * sync. This reduces the wait to about one RTT instead of up to one GOP.
+ */
+static void update_keyframe_request(struct state_video_decoder *decoder, decompress_status ret)
+{
+        constexpr int KEYFRAME_REQ_NO_FRAMES = 5; ///< once decoding started
+        constexpr time_ns_t KEYFRAME_REQ_MIN_INTERVAL = 250 * NS_IN_MS;
+        if (ret != DECODER_NO_FRAME) {
+                if (ret == DECODER_GOT_FRAME) {
+                        decoder->decompressed_since_reconf = true;
+                        decoder->no_frame_count = 0;
+                }
+                return;
+        }
+        if (!is_codec_interframe(decoder->received_vid_desc.color_spec)) {
+                return;
+        }
+        decoder->no_frame_count += 1;
+        if (decoder->decompressed_since_reconf && decoder->no_frame_count < KEYFRAME_REQ_NO_FRAMES) {
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        if (now - decoder->last_keyframe_request < KEYFRAME_REQ_MIN_INTERVAL) {
+                return;
+        }
+        decoder->last_keyframe_request = now;
+        decoder->keyframe_requested = true;
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Requesting keyframe from the sender.\n";
+}
+
+/**
+ * Overload detection for interframe codecs - if the next frame is already
+ * waiting when the decompression of the current one starts or the display
+ * drops the frames, the decompressor is asked to skip non-reference frames
+ * (only libavcodec supports that) until there is no sign of the overload for
+ * a while. The displayed frame rate then degrades instead of the latency
+ * building up.
+ */
+struct decode_overload {
+        static constexpr int ENTER_FRAMES = 3;  ///< consecutive overloaded frames to start skipping
+        static constexpr int LEAVE_FRAMES = 60; ///< consecutive frames without overload to stop skipping
+        int overloaded = 0;
+        int ok = 0;
+        bool skipping = false;
+};
+
+static void update_decode_overload(struct state_video_decoder *decoder, struct decode_overload *o, bool overloaded)
+{
+        if (decoder->decoder_type != EXTERNAL_DECODER || !is_codec_interframe(decoder->received_vid_desc.color_spec)) {
+                return;
+        }
+        if (overloaded) {
+                o->overloaded += 1;
+                o->ok = 0;
+        } else {
+                o->ok += 1;
+                o->overloaded = 0;
+        }
+        const bool skip = o->skipping ? o->ok < decode_overload::LEAVE_FRAMES
+                : o->overloaded >= decode_overload::ENTER_FRAMES;
+        if (skip == o->skipping) {
+                return;
+        }
+        o->skipping = skip;
+        bool supported = false;
+        for (auto *d : decoder->decompress_state) {
+                supported = decompress_set_property(d, DECOMPRESS_PROPERTY_SKIP_NONREF, &skip, sizeof skip) || supported;
+        }
+        if (supported) {
+                LOG(LOG_LEVEL_NOTICE) << MOD_NAME << (skip ? "Receiver overloaded, skipping non-reference frames.\n"
+                                : "Decoding all frames again.\n");
+        }
+}
+
+/**
+ * @returns true if the display signals that a frame put now (nonblocking)
+ * would be dropped, so decoding it can be skipped - only for intra-only
+ * codecs decoded by an external decoder (skipped inter frames would break
+ * decoding of the following ones)
+ */
+static bool display_backpressure(struct state_video_decoder *decoder, long long putf_timeout)
+{
+        if (putf_timeout != PUTF_NONBLOCK || decoder->decoder_type != EXTERNAL_DECODER
+                        || is_codec_interframe(decoder->received_vid_desc.color_spec)) {
+                return false;
+        }
+        bool behind = false;
+        size_t len = sizeof behind;
+        return display_ctl_property(decoder->display, DISPLAY_PROPERTY_BACKPRESSURE, &behind, &len) && behind;
+}
+
+/// passes decoder->frame to the display and gets a new one
+static void put_decoded_frame(struct state_video_decoder *decoder, frame_msg *msg, long long putf_timeout)
+{
+        decoder->frame->ssrc = msg->nofec_frame->ssrc;
+        time_ns_t probe_capture_ts = 0;
+        if (decoder->latency_probe
+                        && !latency_probe_extract(decoder->frame->color_spec, decoder->frame->tiles[0].width,
+                                decoder->frame->tiles[0].height, decoder->frame->tiles[0].data, &probe_capture_ts)) {
+                probe_capture_ts = 0;
+        }
+        pipeline_stage_timer busy(decoder->display_stage);
+        const time_ns_t put_start = get_time_in_ns();
+        int ret = display_put_frame(decoder->display,
+                        decoder->frame, putf_timeout);
+        busy.done();
+        msg->is_displayed = ret == 0;
+        if (msg->is_displayed) {
+                const time_ns_t put_end = get_time_in_ns();
+                if (msg->decode_ts != 0) {
+                        decoder->decode_latency.add(put_start - msg->decode_ts);
+                        decoder->decode_latency.report(decoder->control);
+                }
+                decoder->display_latency.add(put_end - put_start);
+                metrics_histogram_record(decoder->display_put_duration, put_end - put_start);
+                decoder->display_latency.report(decoder->control);
+                if (probe_capture_ts != 0) {
+                        decoder->glass_latency.add(put_end - probe_capture_ts);
+                        decoder->glass_latency.report(decoder->control);
+                }
+        }
+        if (msg->capture_ts != 0 && msg->is_displayed) {
+                av_sync_report(AV_SYNC_VIDEO, msg->capture_ts, get_time_in_ns());
+        }
+        decoder->frame = display_get_frame(decoder->display);
+        direct_recv_supply(decoder);
+}
+
+/**
+ * Frames decompressed ahead of the display (decoder-pipeline-depth > 1).
+ *
+ * External decoders decompress to one of the pipeline frames, which are then
+ * handed in order to the display thread. This thread copies the frame to the
+ * display buffer and calls display_put_frame()/display_get_frame(), so that
+ * decompression of following frames is not blocked by the display.
+ */
+struct decompress_pipeline {
+        struct item {
+                unique_ptr<frame_msg> msg; ///< nullptr - poison
+                struct video_frame *frame;
+        };
+        vector<struct video_frame *> frames;
+        synchronized_queue<struct video_frame *, -1> free_frames;
+        synchronized_queue<item, -1> display_queue;
+        thread display_thread;
+};
+
+static void decompress_pipeline_display(struct state_video_decoder *decoder,
+                struct decompress_pipeline *p, long long putf_timeout)
+{
+        set_thread_name(__func__);
+        while (true) {
+                pipeline_stage_queue(decoder->display_stage, p->display_queue.size(), p->frames.size());
+                decompress_pipeline::item item = p->display_queue.pop();
+                if (!item.msg) {
+                        break;
+                }
+                for (unsigned int i = 0; i < item.frame->tile_count; ++i) {
+                        decoder->frame->tiles[i].data_len = item.frame->tiles[i].data_len;
+                        memcpy(decoder->frame->tiles[i].data, item.frame->tiles[i].data,
+                                        item.frame->tiles[i].data_len);
+                }
+                p->free_frames.push(item.frame);
+                put_decoded_frame(decoder, item.msg.get(), putf_timeout);
+        }
+}
+
+/// allocates pipeline frames with layout of decoder->frame and starts the display thread
+static void decompress_pipeline_start(struct state_video_decoder *decoder,
+                struct decompress_pipeline *p, int depth, long long putf_timeout)
+{
+        for (int i = 0; i < depth; ++i) {
+                struct video_frame *f = vf_alloc_desc(video_desc_from_frame(decoder->frame));
+                f->decoder_overrides_data_len = decoder->frame->decoder_overrides_data_len;
+                for (unsigned int j = 0; j < f->tile_count; ++j) {
+                        f->tiles[j].data_len = decoder->frame->tiles[j].data_len;
+                        f->tiles[j].data = (char *) malloc(f->tiles[j].data_len);
+                }
+                f->callbacks.data_deleter = vf_data_deleter;
+                p->frames.push_back(f);
+                p->free_frames.push(f);
+        }
+        p->display_thread = thread(decompress_pipeline_display, decoder, p, putf_timeout);
+}
+
+/// displays the pending frames and frees the pipeline
+static void decompress_pipeline_stop(struct decompress_pipeline *p)
+{
+        if (p->frames.empty()) {
+                return;
+        }
+        p->display_queue.push({});
+        p->display_thread.join();
+        for (auto *f : p->frames) {
+                vf_free(f);
+        }
+        p->frames.clear();
+}
+
 ADD_TO_PARAM("decoder-drop-policy",
                 "* decoder-drop-policy=blocking|nonblock|<sec>\n"
                 "  Force specified blocking policy (default nonblock).\n"
                 "  <sec> - specifies frame timeout in seconds (can have suffixes, eg. \"20ms\")\n");
+ADD_TO_PARAM("decoder-pipeline-depth",
+                "* decoder-pipeline-depth=<n>\n"
+                "  Decompress up to <n> frames ahead of the display (compressed video only).\n"
+                "  Default 1 decompresses directly to the display buffer, higher values\n"
+                "  need an additional copy but decompression doesn't wait for the display.\n");
 static void *decompress_thread(void *args) {
         set_thread_name(__func__);
         struct state_video_decoder *decoder =
                 (struct state_video_decoder *) args;
-        int tile_width = decoder->received_vid_desc.width; // get_video_mode_tiles_x(decoder->video_mode);
-        int tile_height = decoder->received_vid_desc.height; // get_video_mode_tiles_y(decoder->video_mode);
 
         long long force_putf_timeout = []() {
                 auto drop_policy = commandline_params.find("decoder-drop-policy"s);
@@ -620,14 +1233,35 @@ static void *decompress_thread(void *args) {
                 }
                 return static_cast<long long>(unit_evaluate_dbl(drop_policy->second.c_str(), true) * NS_IN_SEC);
         }();
+        long long putf_timeout = force_putf_timeout != -1 ? force_putf_timeout : PUTF_NONBLOCK; // originally was BLOCKING when !is_codec_interframe(decoder->received_vid_desc.color_spec)
+        const int pipeline_depth = max(1, get_commandline_param("decoder-pipeline-depth") != nullptr ?
+                        atoi(get_commandline_param("decoder-pipeline-depth")) : 1);
+        struct decompress_pipeline pipeline;
+        struct decode_overload overload;
 
         while(1) {
+                pipeline_stage_queue(decoder->decompress_stage, decoder->decompress_queue.size(), 1);
                 unique_ptr<frame_msg> msg = decoder->decompress_queue.pop();
+                const bool backlog = decoder->decompress_queue.size() > 0; // next frame already waiting
+                bool display_dropped = false;
 
                 if(!msg->recv_frame) { // poisoned
-                        break;
+                        if (!msg->reconf_barrier) {
+                                break;
+                        }
+                        // pending frames belong to the old configuration
+                        decompress_pipeline_stop(&pipeline);
+                        overload = {}; // decompress states are recreated
+                        unique_lock<mutex> lk(decoder->lock);
+                        decoder->reconf_barrier_passed = true;
+                        lk.unlock();
+                        decoder->reconf_barrier_cv.notify_one();
+                        continue;
                 }
 
+                // may change only in reconfiguration while the pipeline is drained
+                const int tile_width = decoder->received_vid_desc.width;
+                const int tile_height = decoder->received_vid_desc.height;
                 auto t0 = std::chrono::high_resolution_clock::now();
                 unique_ptr<char[]> tmp;
 
@@ -635,30 +1269,61 @@ static void *decompress_thread(void *args) {
                         tmp = unique_ptr<char[]>(new char[tile_height * (tile_width * MAX_BPS + MAX_PADDING)]);
                 }
 
+                // frame to decompress to - either the display buffer or a pipeline frame
+                // (decoder->frame is owned by the pipeline display thread once started)
+                struct video_frame *out_frame = nullptr;
+                bool pipelined = false;
+                if (pipeline_depth > 1 && decoder->decoder_type == EXTERNAL_DECODER && !tmp) {
+                        if (pipeline.frames.empty() && decoder->frame != nullptr) {
+                                decompress_pipeline_start(decoder, &pipeline, pipeline_depth, putf_timeout);
+                        }
+                        if (!pipeline.frames.empty()) {
+                                out_frame = pipeline.free_frames.pop();
+                                pipelined = true;
+                        }
+                }
+                if (!pipelined) {
+                        out_frame = decoder->frame;
+                }
+                pipeline_stage_timer busy(decoder->decompress_stage);
+
+                if (!pipelined && display_backpressure(decoder, putf_timeout)) {
+                        LOG(LOG_LEVEL_DEBUG) << MOD_NAME << "Display is behind, frame not decoded.\n";
+                        goto skip_frame;
+                }
+
                 if(decoder->decoder_type == EXTERNAL_DECODER) {
                         int tile_count = get_video_mode_tiles_x(decoder->video_mode) *
                                         get_video_mode_tiles_y(decoder->video_mode);
                         vector<task_result_handle_t> handle(tile_count);
                         vector<decompress_data> data(tile_count);
+                        vector<char> warm_start; // frame prefixed with cached parameter sets
                         for (int pos = 0; pos < tile_count; ++pos) {
                                 data[pos].decoder = decoder;
                                 data[pos].pos = pos;
-                                data[pos].compressed = msg->nofec_frame;
+                                data[pos].src = msg->nofec_frame->tiles[pos].data;
+                                data[pos].src_len = msg->nofec_frame->tiles[pos].data_len;
                                 data[pos].buffer_num = msg->buffer_num[pos];
+                                data[pos].callbacks = out_frame != nullptr ? &out_frame->callbacks : nullptr;
                                 if (tmp.get()) {
                                         data[pos].out = (unsigned char *) tmp.get();
                                 } else if (decoder->merged_fb) {
                                         // TODO: OK when rendering directly to display FB, otherwise, do not reflect pitch (we use PP)
                                         int x = pos % get_video_mode_tiles_x(decoder->video_mode),
                                             y = pos / get_video_mode_tiles_x(decoder->video_mode);
-                                        data[pos].out = (unsigned char *) vf_get_tile(decoder->frame, 0)->data + y * decoder->pitch * tile_height +
+                                        data[pos].out = (unsigned char *) vf_get_tile(out_frame, 0)->data + y * decoder->pitch * tile_height +
                                                 vc_get_linesize(tile_width, decoder->out_codec) * x;
                                 } else {
-                                        data[pos].out = (unsigned char *) vf_get_tile(decoder->frame, pos)->data;
+                                        data[pos].out = (unsigned char *) vf_get_tile(out_frame, pos)->data;
                                 }
                                 if (tile_count > 1) {
                                         handle[pos] = task_run_async(decompress_worker, &data[pos]);
                                 } else {
+                                        const codec_t codec = decoder->received_vid_desc.color_spec;
+                                        if (data[pos].src != nullptr && (codec == H264 || codec == H265)) {
+                                                tie(data[pos].src, data[pos].src_len) = decoder->param_sets.process(codec,
+                                                                data[pos].src, data[pos].src_len, warm_start);
+                                        }
                                         decompress_worker(&data[pos]);
                                 }
                         }
@@ -667,6 +1332,7 @@ static void *decompress_thread(void *args) {
                                         wait_task(handle[pos]);
                                 }
                         }
+                        update_keyframe_request(decoder, data[0].ret);
                         for (int pos = 0; pos < tile_count; ++pos) {
                                 if (data[pos].ret == DECODER_GOT_CODEC) {
                                         LOG(LOG_LEVEL_NOTICE) << MOD_NAME << "Detected compression properties: " << get_pixdesc_desc(data[pos].internal_prop) << "\n";
@@ -693,24 +1359,27 @@ static void *decompress_thread(void *args) {
                         duration_cast<nanoseconds>(high_resolution_clock::now() - t0).count() / 1000000.0 << " ms\n";
 
                 if(decoder->change_il) {
-                        for(unsigned int i = 0; i < decoder->frame->tile_count; ++i) {
-                                struct tile *tile = vf_get_tile(decoder->frame, i);
+                        for(unsigned int i = 0; i < out_frame->tile_count; ++i) {
+                                struct tile *tile = vf_get_tile(out_frame, i);
                                 decoder->change_il(tile->data, tile->data, vc_get_linesize(tile->width,
                                                         decoder->out_codec), tile->height, &decoder->change_il_state[i]);
                         }
                 }
 
-                {
-                        long long putf_timeout = force_putf_timeout != -1 ? force_putf_timeout : PUTF_NONBLOCK; // originally was BLOCKING when !is_codec_interframe(decoder->received_vid_desc.color_spec)
-
-                        decoder->frame->ssrc = msg->nofec_frame->ssrc;
-                        int ret = display_put_frame(decoder->display,
-                                        decoder->frame, putf_timeout);
-                        msg->is_displayed = ret == 0;
-                        decoder->frame = display_get_frame(decoder->display);
+                busy.done();
+                if (pipelined) {
+                        pipeline.display_queue.push({std::move(msg), out_frame});
+                        pipelined = false;
+                } else {
+                        put_decoded_frame(decoder, msg.get(), putf_timeout);
+                        display_dropped = !msg->is_displayed;
                 }
 
 skip_frame:
+                update_decode_overload(decoder, &overload, backlog || display_dropped);
+                if (pipelined) { // frame was not decompressed
+                        pipeline.free_frames.push(out_frame);
+                }
                 {
                         unique_lock<mutex> lk(decoder->lock);
                         // we have put the video frame and requested another one which is
@@ -721,6 +1390,8 @@ skip_frame:
                 }
         }
 
+        decompress_pipeline_stop(&pipeline);
+
         return NULL;
 }
 
@@ -742,6 +1413,26 @@ static void decoder_set_video_mode(struct state_video_decoder *decoder, enum vid
  *                    used. This may change eventually.
  * @return Newly created decoder state. If an error occured, returns NULL.
  */
+ADD_TO_PARAM("decoder-shard-substreams",
+                "* decoder-shard-substreams\n"
+                "  Copy/line-decode received substreams (tiles) in parallel worker threads\n"
+                "  (useful for tiled streams, eg. -M tiled-4K).\n");
+ADD_TO_PARAM("decoder-direct-recv",
+                "* decoder-direct-recv\n"
+                "  Receive uncompressed video payload directly to the display framebuffer if possible\n"
+                "  (most effective with pbuf-eager-decode or a low playout delay).\n");
+ADD_TO_PARAM("decoder-fuse-interlacing",
+                "* decoder-fuse-interlacing\n"
+                "  Change interlacing of uncompressed video while line-decoding packets to the\n"
+                "  framebuffer instead of an extra pass over the decoded frame.\n");
+ADD_TO_PARAM("decoder-queue-spin",
+                "* decoder-queue-spin=<n>\n"
+                "  Spin <n> iterations before sleeping when waiting on the receiver->FEC->decompress\n"
+                "  frame hand-off (default 0 - sleep immediately; trades CPU time for wake-up latency).\n");
+ADD_TO_PARAM("decoder-latency-probe",
+                "* decoder-latency-probe\n"
+                "  Extract capture time embedded in the picture by the sender (testcard:probe) and report\n"
+                "  capture-to-display latency (RECV_LATENCY glass) to the control socket.\n");
 struct state_video_decoder *video_decoder_init(struct module *parent,
                 enum video_mode video_mode,
                 struct display *display, const char *encryption)
@@ -766,6 +1457,14 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
         }
 
         decoder_set_video_mode(s, video_mode);
+        s->shard_substreams = get_commandline_param("decoder-shard-substreams") != nullptr;
+        s->direct_recv_requested = get_commandline_param("decoder-direct-recv") != nullptr;
+        s->fuse_il = get_commandline_param("decoder-fuse-interlacing") != nullptr;
+        s->latency_probe = get_commandline_param("decoder-latency-probe") != nullptr;
+        if (const char *spin = get_commandline_param("decoder-queue-spin")) {
+                s->fec_queue.set_spin_count(atoi(spin));
+                s->decompress_queue.set_spin_count(atoi(spin));
+        }
 
         if(!video_decoder_register_display(s, display)) {
                 delete s;
@@ -775,11 +1474,74 @@ struct state_video_decoder *video_decoder_init(struct module *parent,
         return s;
 }
 
+/**
+ * Enables receiving of the payload of the stream ssrc directly to the
+ * framebuffer by the reader thread of session (if requested by
+ * decoder-direct-recv). Used only when the received video maps 1:1 to the
+ * framebuffer, otherwise the data are decoded as usually.
+ *
+ * Must be called from the receiver thread.
+ *
+ * @param session  RTP session to receive from, NULL to disable the direct
+ *                 reception (must be done before the session is destroyed)
+ */
+/**
+ * @retval true if the decoder asked for a keyframe since the previous call,
+ *              the caller should then send a PLI to the sender
+ */
+bool video_decoder_keyframe_requested(struct state_video_decoder *decoder)
+{
+        return decoder != nullptr && decoder->keyframe_requested.exchange(false);
+}
+
+/**
+ * @retval true if the display renders only a part of a 360° frame (and
+ *              reports it), the receiver then forwards it to the sender
+ */
+bool video_decoder_get_viewport(struct state_video_decoder *decoder, struct video_viewport *viewport)
+{
+        if (decoder == nullptr || decoder->display == nullptr) {
+                return false;
+        }
+        size_t len = sizeof *viewport;
+        return display_ctl_property(decoder->display, DISPLAY_PROPERTY_VIEWPORT, viewport, &len) && len == sizeof *viewport;
+}
+
+void video_decoder_set_direct_recv(struct state_video_decoder *decoder, struct rtp *session, uint32_t ssrc)
+{
+        if (decoder == nullptr || !decoder->direct_recv_requested) {
+                return;
+        }
+        struct direct_recv *d = &decoder->direct;
+        if (d->session != nullptr) {
+                rtp_clear_recv_placement(d->session, &d->hooks);
+                d->session = nullptr;
+                direct_recv_drop(decoder);
+        }
+        if (session == nullptr) {
+                return;
+        }
+        d->ssrc = ssrc;
+        d->hooks.hdr_len = 12 /* RTP header */ + sizeof(video_payload_hdr_t);
+        d->hooks.begin = direct_recv_begin;
+        d->hooks.predict = direct_recv_predict;
+        d->hooks.commit = direct_recv_commit;
+        d->hooks.end = direct_recv_end;
+        d->hooks.udata = d;
+        if (!rtp_set_recv_placement(session, &d->hooks)) {
+                log_msg(LOG_LEVEL_WARNING, "[video dec.] Direct reception to framebuffer not available "
+                                "(requires multithreaded receiving, single stream).\n");
+                return;
+        }
+        d->session = session;
+        verbose_msg("[video dec.] Direct reception to framebuffer enabled.\n");
+}
+
 /**
  * @brief starts decompress and ldmg threads
  *
- * Called from video_decoder_register_display(). It is also called after
- * video_decoder_stop_threads() in reconfiguration.
+ * Called from video_decoder_register_display(). Reconfiguration doesn't
+ * restart the threads, see video_decoder_drain_threads().
  *
  * @invariant
  * decoder->display != NULL
@@ -792,6 +1554,34 @@ static void video_decoder_start_threads(struct state_video_decoder *decoder)
         decoder->fec_thread_id = thread(fec_thread, decoder);
 }
 
+/**
+ * @brief Waits until all frames already passed to the decoding threads are processed.
+ *
+ * A barrier message is passed through the FEC and decompress queues, the
+ * threads keep running and are idle when this function returns (until a next
+ * frame is pushed), so that the decoder may be safely reconfigured.
+ *
+ * Must be called from the receiver thread (the fec_queue producer).
+ *
+ * @invariant
+ * decoder->display != NULL
+ */
+static void video_decoder_drain_threads(struct state_video_decoder *decoder)
+{
+        assert(decoder->display);
+
+        unique_ptr<frame_msg> msg(new frame_msg(decoder->control, decoder->stats));
+        msg->reconf_barrier = true;
+        {
+                unique_lock<mutex> lk(decoder->lock);
+                decoder->reconf_barrier_passed = false;
+        }
+        decoder->fec_queue.push(std::move(msg));
+
+        unique_lock<mutex> lk(decoder->lock);
+        decoder->reconf_barrier_cv.wait(lk, [decoder]{return decoder->reconf_barrier_passed;});
+}
+
 /**
  * @brief This function stops running threads.
  *
@@ -910,6 +1700,7 @@ void video_decoder_remove_display(struct state_video_decoder *decoder)
 {
         if (decoder->display) {
                 video_decoder_stop_threads(decoder);
+                direct_recv_drop(decoder);
                 if (decoder->frame) {
                         display_put_frame(decoder->display, decoder->frame, PUTF_DISCARD);
                         decoder->frame = NULL;
@@ -950,6 +1741,12 @@ void video_decoder_destroy(struct state_video_decoder *decoder)
                 decoder->dec_funcs->destroy(decoder->decrypt);
         }
 
+        if (decoder->direct_recv_requested) {
+                video_decoder_set_direct_recv(decoder, nullptr, 0);
+                verbose_msg("[video dec.] Received %llu of %llu packets directly to framebuffer.\n",
+                                decoder->direct.placed_packets, decoder->direct.total_packets);
+        }
+
         video_decoder_remove_display(decoder);
 
         cleanup(decoder);
@@ -1029,6 +1826,55 @@ static vector<pair<struct pixfmt_desc, codec_t>> video_decoder_order_output_code
         return ret;
 }
 
+/**
+ * Process-wide cache of the decompressor choices. Key is the compression,
+ * its internal pixel format (as reported by the decompressor), whether the
+ * format autodetection may be probed and the display codecs. Value is the
+ * (internal format, output codec) pair that succeeded - out_codec is
+ * VIDEO_CODEC_END if the decompressor supports the autodetection.
+ *
+ * Probing the candidates means initializing (and destroying) each preceding
+ * decompressor that fails, which is expensive for the GPU or lavc ones, so a
+ * reconfiguration to an already seen stream initializes only the cached one.
+ * Only successful choices are cached - if the cached decompressor fails to
+ * initialize, the entry is dropped and all the candidates are probed again.
+ */
+using decompress_cache_key = tuple<codec_t, int, int, bool, bool, vector<codec_t>>;
+static mutex decompress_cache_lock;
+static map<decompress_cache_key, pair<struct pixfmt_desc, codec_t>> decompress_cache;
+
+static bool init_cached_decompress(struct state_video_decoder *decoder, const decompress_cache_key &key,
+                codec_t *out_codec)
+{
+        pair<struct pixfmt_desc, codec_t> choice;
+        {
+                lock_guard<mutex> lk(decompress_cache_lock);
+                auto it = decompress_cache.find(key);
+                if (it == decompress_cache.end()) {
+                        return false;
+                }
+                choice = it->second;
+        }
+        codec_t init_codec = choice.second == VIDEO_CODEC_END ? VIDEO_CODEC_NONE : choice.second;
+        if (decompress_init_multi(get<0>(key), choice.first, init_codec,
+                                decoder->decompress_state.data(),
+                                decoder->decompress_state.size())) {
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Using cached decompressor choice for " << get_codec_name(get<0>(key)) << ".\n";
+                *out_codec = choice.second;
+                return true;
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Cached decompressor for " << get_codec_name(get<0>(key)) << " failed to initialize, probing all.\n";
+        lock_guard<mutex> lk(decompress_cache_lock);
+        decompress_cache.erase(key);
+        return false;
+}
+
+static void cache_decompress(const decompress_cache_key &key, struct pixfmt_desc internal, codec_t out_codec)
+{
+        lock_guard<mutex> lk(decompress_cache_lock);
+        decompress_cache[key] = { internal, out_codec };
+}
+
 /**
  * This function selects, according to given video description, appropriate
  *
@@ -1080,12 +1926,21 @@ after_linedecoder_lookup:
         if(*decode_line == NULL) {
                 decoder->decompress_state.resize(decoder->max_substreams);
 
+                bool try_autodetection = comp_int_prop.depth == 0 && decoder->out_codec != VIDEO_CODEC_END;
+                decompress_cache_key key{desc.color_spec, comp_int_prop.depth, comp_int_prop.subsampling,
+                        comp_int_prop.rgb, try_autodetection, decoder->native_codecs};
+                if (init_cached_decompress(decoder, key, &out_codec)) {
+                        decoder->decoder_type = EXTERNAL_DECODER;
+                        return out_codec;
+                }
+
                 // try to probe video format
-                if (comp_int_prop.depth == 0 && decoder->out_codec != VIDEO_CODEC_END) {
+                if (try_autodetection) {
                         bool supports_autodetection = decompress_init_multi(desc.color_spec,
                                         pixfmt_desc{}, VIDEO_CODEC_NONE, decoder->decompress_state.data(),
                                         decoder->decompress_state.size());
                         if (supports_autodetection) {
+                                cache_decompress(key, pixfmt_desc{}, VIDEO_CODEC_END);
                                 decoder->decoder_type = EXTERNAL_DECODER;
                                 return VIDEO_CODEC_END;
                         }
@@ -1100,6 +1955,7 @@ after_linedecoder_lookup:
                                                 (*it).second,
                                                 decoder->decompress_state.data(),
                                                 decoder->decompress_state.size())) {
+                                cache_decompress(key, (*it).first, (*it).second);
                                 decoder->decoder_type = EXTERNAL_DECODER;
                                 goto after_decoder_lookup;
                         }
@@ -1181,12 +2037,11 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
         int display_requested_pitch = PITCH_DEFAULT;
         int display_requested_rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
 
-        // this code forces flushing the pipelined data
-        video_decoder_stop_threads(decoder);
+        // the decoding threads are drained by reconfigure_if_needed()
+        direct_recv_drop(decoder);
         if (decoder->frame)
                 display_put_frame(decoder->display, decoder->frame, PUTF_DISCARD);
         decoder->frame = NULL;
-        video_decoder_start_threads(decoder);
 
         cleanup(decoder);
 
@@ -1331,6 +2186,23 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                         }
                         decoder->merged_fb = false;
                 }
+                enum il_remap_t il_remap = IL_REMAP_NONE;
+                // change_il of merged tiles works over the whole frame, not per tile
+                if (decoder->fuse_il && !(decoder->merged_fb && decoder->video_mode != VIDEO_NORMAL)) {
+                        if (decoder->change_il == il_upper_to_merged) {
+                                il_remap = IL_REMAP_UPPER_TO_MERGED;
+                        } else if (decoder->change_il == il_merged_to_upper) {
+                                il_remap = IL_REMAP_MERGED_TO_UPPER;
+                        }
+                }
+                if (il_remap != IL_REMAP_NONE) {
+                        decoder->change_il = NULL;
+                        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Changing interlacing in line decoder.\n";
+                }
+                for (int i = 0; i < src_x_tiles * src_y_tiles; ++i) {
+                        decoder->line_decoder[i].il_remap = il_remap;
+                        decoder->line_decoder[i].height = desc.height;
+                }
         } else if (decoder->decoder_type == EXTERNAL_DECODER) {
                 int buf_size;
 
@@ -1346,6 +2218,9 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
                         }
                 }
                 decoder->merged_fb = display_mode != DISPLAY_PROPERTY_VIDEO_SEPARATE_TILES;
+                decoder->param_sets.inject = true;
+                decoder->decompressed_since_reconf = false;
+                decoder->no_frame_count = 0;
                 int res = 0, ret;
                 size_t size = sizeof(res);
                 ret = decompress_get_property(decoder->decompress_state.at(0),
@@ -1365,6 +2240,7 @@ static bool reconfigure_decoder(struct state_video_decoder *decoder,
 
         if (out_codec != VIDEO_CODEC_END) {
                 decoder->frame = display_get_frame(decoder->display);
+                direct_recv_supply(decoder);
         }
 
         return true;
@@ -1415,6 +2291,17 @@ static int reconfigure_if_needed(struct state_video_decoder *decoder,
         if(!desc_changed && !force)
                 return FALSE;
 
+        // frames of the old format that are already in the pipeline are
+        // decoded with the old configuration to the old framebuffer
+        video_decoder_drain_threads(decoder);
+
+        decoder->lock.lock();
+        for (auto const &p : decoder->pending_params) {
+                set_commandline_param(p.first.c_str(), p.second.c_str());
+        }
+        decoder->pending_params.clear();
+        decoder->lock.unlock();
+
         if (desc_changed) {
                 LOG(LOG_LEVEL_NOTICE) << "[video dec.] New incoming video format detected: " << network_desc << endl;
                 decoder->received_vid_desc = network_desc;
@@ -1458,6 +2345,132 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
 #define ERROR_GOTO_CLEANUP ret = FALSE; goto cleanup;
 #define max(a, b)       (((a) > (b))? (a): (b))
 
+/**
+ * @returns destination line of source line row with regard to the interlacing
+ * change (see il_upper_to_merged() and il_merged_to_upper())
+ */
+static inline int line_decoder_dst_row(const struct line_decoder *ld, int row)
+{
+        const int upper_field_lines = (ld->height + 1) / 2;
+        switch (ld->il_remap) {
+        case IL_REMAP_NONE:
+                return row;
+        case IL_REMAP_UPPER_TO_MERGED:
+                return row < upper_field_lines ? 2 * row : 2 * (row - upper_field_lines) + 1;
+        case IL_REMAP_MERGED_TO_UPPER:
+                return row % 2 == 0 ? row / 2 : upper_field_lines + row / 2;
+        }
+        abort();
+}
+
+/**
+ * Decodes (line by line) one packet payload into the framebuffer tile.
+ *
+ * @param prints number of already printed warnings (to throttle the output)
+ * @returns number of warnings issued
+ */
+static int line_decode_packet(struct line_decoder *line_decoder, struct tile *tile,
+                uint32_t data_pos, const unsigned char *source, int len, int prints)
+{
+        int prints_orig = prints;
+        uint32_t offset;
+
+        /* MAGIC, don't touch it, you definitely break it
+         *  *source* is data from network, *destination* is frame buffer
+         */
+
+        /* compute Y pos in source frame and convert it to
+         * byte offset in the destination frame
+         */
+        int row = data_pos / line_decoder->src_linesize;
+        int y = line_decoder_dst_row(line_decoder, row) * line_decoder->dst_pitch;
+
+        /* compute X pos in source frame */
+        int s_x = data_pos % line_decoder->src_linesize;
+
+        /* convert X pos from source frame into the destination frame.
+         * it is byte offset from the beginning of a line.
+         */
+        int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
+
+        /* copy whole packet that can span several lines.
+         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
+         */
+        while (len > 0) {
+                /* len id payload length in source BPP
+                 * decoder needs len in destination BPP, so convert it
+                 */
+                int l = len * line_decoder->conv_num / line_decoder->conv_den;
+
+                /* do not copy multiple lines, we need to
+                 * copy (& clip, center) line by line
+                 */
+                if (l + d_x > (int) line_decoder->dst_linesize) {
+                        l = line_decoder->dst_linesize - d_x;
+                }
+
+                /* compute byte offset in destination frame */
+                offset = y + d_x;
+
+                /* watch the SEGV */
+                if (l + line_decoder->base_offset + offset <= tile->data_len) {
+                        /*decode frame:
+                         * we have offset for destination
+                         * we update source contiguously
+                         * we pass {r,g,b}shifts */
+                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
+                                        line_decoder->shifts[0], line_decoder->shifts[1],
+                                        line_decoder->shifts[2]);
+                        /* we decoded one line (or a part of one line) to the end of the line
+                         * so decrease *source* len by 1 line (or that part of the line */
+                        len -= line_decoder->src_linesize - s_x;
+                        /* jump in source by the same amount */
+                        source += line_decoder->src_linesize - s_x;
+                } else {
+                        /* this should not ever happen as we call reconfigure before each packet
+                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
+                         * say it loudly
+                         */
+                        if((prints % 100) == 0) {
+                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
+                                                "Well this should not happened. Expect troubles pretty soon.\n");
+                        }
+                        prints++;
+                        len = 0;
+                }
+                /* each new line continues from the beginning */
+                d_x = 0;        /* next line from beginning */
+                s_x = 0;
+                /* next line */
+                if (line_decoder->il_remap == IL_REMAP_NONE) {
+                        y += line_decoder->dst_pitch;
+                } else {
+                        y = line_decoder_dst_row(line_decoder, ++row) * line_decoder->dst_pitch;
+                }
+        }
+        return prints - prints_orig;
+}
+
+/**
+ * Worker copying or line-decoding packets of one substream deferred by
+ * decode_video_frame() if decoder-shard-substreams is set.
+ */
+static void *substream_shard_task(void *arg)
+{
+        auto *shard = (struct substream_shard *) arg;
+        int prints = 0;
+        for (auto const &p : shard->packets) {
+                if (shard->line_decoder) {
+                        prints += line_decode_packet(shard->line_decoder, shard->tile, p.data_pos,
+                                        (const unsigned char *) p.data, p.len, prints);
+                } else {
+                        memcpy(shard->tile->data + p.data_pos, p.data, p.len);
+                }
+        }
+        shard->packets.clear();
+        return NULL;
+}
+
 /**
  * @brief Decodes a participant buffer representing one video frame.
  * @param cdata        PBUF buffer
@@ -1467,6 +2480,36 @@ static int check_for_mode_change(struct state_video_decoder *decoder,
  *                     decoding may fail in some subsequent (asynchronous) steps.
  * @retval FALSE       if decoding failed
  */
+/**
+ * Converts RTP timestamp (90 kHz) to sender's wall clock with the RTP/NTP
+ * mapping from its last sender report.
+ */
+static time_ns_t sender_clock_ns(const decltype(vcodec_state::sr) *sr, uint32_t rtp_ts)
+{
+        return av_sync_sender_time(sr->ntp_sec, sr->ntp_frac, sr->rtp_ts, rtp_ts);
+}
+
+/**
+ * Processes reconfiguration requests from the FEC thread.
+ * @retval false the frame should be skipped (reconfiguration in progress)
+ */
+static bool process_reconfigure_messages(struct state_video_decoder *decoder)
+{
+        main_msg_reconfigure *msg_reconf;
+        while ((msg_reconf = decoder->msg_queue.pop(true /* nonblock */))) {
+                if (reconfigure_if_needed(decoder, msg_reconf->desc, msg_reconf->force, msg_reconf->compress_internal_prop)) {
+#ifdef RECONFIGURE_IN_FUTURE_THREAD
+                        return false;
+#endif
+                }
+                if (msg_reconf->last_frame) {
+                        decoder->fec_queue.push(std::move(msg_reconf->last_frame));
+                }
+                delete msg_reconf;
+        }
+        return true;
+}
+
 int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf_stats *stats)
 {
         struct vcodec_state *pbuf_data = (struct vcodec_state *) decoder_data;
@@ -1485,13 +2528,16 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         // is just the FEC buffer present, so we point to it instead to copying
         struct video_frame *frame = vf_alloc(max_substreams);
         frame->callbacks.data_deleter = vf_data_deleter;
-        unique_ptr<map<int, int>[]> pckt_list(new map<int, int>[max_substreams]);
+        unique_ptr<received_ranges[]> pckt_list(new received_ranges[max_substreams]);
 
         int k = 0, m = 0, c = 0, seed = 0; // LDGM
         int buffer_number = 0;
         int buffer_length = 0;
         int pt = 0;
         bool buffer_swapped = false;
+        time_ns_t frame_recv_ts = 0;
+        time_ns_t frame_capture_ts = 0;
+        bool capture_ts_from_ext = false;
 
         // We have no framebuffer assigned, exitting
         if(!decoder->display) {
@@ -1521,31 +2567,46 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
         }
 #endif
 
-        main_msg_reconfigure *msg_reconf;
-        while ((msg_reconf = decoder->msg_queue.pop(true /* nonblock */))) {
-                if (reconfigure_if_needed(decoder, msg_reconf->desc, msg_reconf->force, msg_reconf->compress_internal_prop)) {
-#ifdef RECONFIGURE_IN_FUTURE_THREAD
-                        vf_free(frame);
-                        return FALSE;
-#endif
-                }
-                if (msg_reconf->last_frame) {
-                        decoder->fec_queue.push(std::move(msg_reconf->last_frame));
+        if (!process_reconfigure_messages(decoder)) {
+                vf_free(frame);
+                return FALSE;
+        }
+
+        // payload of some packets may be already in the framebuffer
+        received_ranges direct_placed;
+        const received_ranges direct_lost = cdata != NULL ? direct_recv_get_lost(decoder, cdata->data->ts)
+                : received_ranges();
+
+        if (decoder->shard_substreams) {
+                decoder->shards.resize(max_substreams);
+                for (auto &shard : decoder->shards) {
+                        shard.packets.clear();
                 }
-                delete msg_reconf;
         }
 
         while (cdata != NULL) {
                 uint32_t tmp;
                 uint32_t *hdr;
                 int len;
-                uint32_t offset;
-                unsigned char *source;
                 char *data;
                 uint32_t data_pos;
                 uint32_t substream;
+                bool defer;
                 pckt = cdata->data;
                 enum openssl_mode crypto_mode = MODE_AES128_NONE;
+                // capture time sent with the packets is exact, the SR mapping only approximates it
+                if (!capture_ts_from_ext) {
+                        capture_ts_from_ext = rtp_hdrext_parse_abs_capture_time(pckt, &frame_capture_ts);
+                        if (!capture_ts_from_ext && pbuf_data->sr.valid) {
+                                frame_capture_ts = sender_clock_ns(&pbuf_data->sr, pckt->ts);
+                        }
+                }
+                if (pckt->recv_ts != 0) {
+                        frame_recv_ts = max(frame_recv_ts, pckt->recv_ts);
+                        if (frame_capture_ts != 0) {
+                                decoder->net_latency.add(pckt->recv_ts - frame_capture_ts);
+                        }
+                }
 
                 pt = pckt->pt;
                 hdr = (uint32_t *)(void *) pckt->data;
@@ -1583,12 +2644,14 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         break;
                 case PT_VIDEO_RS:
                 case PT_VIDEO_LDGM:
+                case PT_VIDEO_RLC:
                         len = pckt->data_len - sizeof(fec_payload_hdr_t);
                         data = (char *) hdr + sizeof(fec_payload_hdr_t);
                         break;
                 case PT_ENCRYPT_VIDEO:
                 case PT_ENCRYPT_VIDEO_LDGM:
                 case PT_ENCRYPT_VIDEO_RS:
+                case PT_ENCRYPT_VIDEO_RLC:
                         {
 				size_t media_hdr_len = pt == PT_ENCRYPT_VIDEO ? sizeof(video_payload_hdr_t) : sizeof(fec_payload_hdr_t);
                                 len = pckt->data_len - sizeof(crypto_payload_hdr_t) - media_hdr_len;
@@ -1634,9 +2697,10 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                         goto cleanup;
                 }
 
-                char plaintext[len]; // will be actually shorter
                 if (PT_VIDEO_IS_ENCRYPTED(pt)) {
                         int data_len;
+                        // decrypted in place - the packet is decoded only once
+                        char *plaintext = data + CRYPTO_PREFIX_LEN;
 
                         if((data_len = decoder->dec_funcs->decrypt(decoder->decrypt,
                                         data, len,
@@ -1645,10 +2709,14 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                         plaintext, crypto_mode)) == 0) {
                                 goto next_packet;
                         }
-                        data = (char *) plaintext;
+                        data = plaintext;
                         len = data_len;
                 }
 
+                if (!direct_lost.empty() && direct_lost.contains(data_pos, len)) {
+                        goto next_packet; // payload was overwritten, treat as missing
+                }
+
                 if (!PT_VIDEO_HAS_FEC(pt))
                 {
                         /* Critical section
@@ -1671,12 +2739,15 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
                 buffer_num[substream] = buffer_number;
                 frame->tiles[substream].data_len = buffer_length;
-                pckt_list[substream][data_pos] = len;
+                pckt_list[substream].add(data_pos, len);
+
+                defer = decoder->shard_substreams && max_substreams > 1;
 
                 if ((pt == PT_VIDEO || pt == PT_ENCRYPT_VIDEO) && decoder->decoder_type == LINE_DECODER) {
                         struct tile *tile = NULL;
                         if(!buffer_swapped) {
                                 wait_for_framebuffer_swap(decoder);
+                                direct_placed = direct_recv_detach(decoder, pckt->ts);
                                 buffer_swapped = true;
                                 unique_lock<mutex> lk(decoder->lock);
                                 decoder->buffer_swapped = false;
@@ -1693,75 +2764,18 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
 
                         /* End of critical section */
 
-                        /* MAGIC, don't touch it, you definitely break it
-                         *  *source* is data from network, *destination* is frame buffer
-                         */
-
-                        /* compute Y pos in source frame and convert it to
-                         * byte offset in the destination frame
-                         */
-                        int y = (data_pos / line_decoder->src_linesize) * line_decoder->dst_pitch;
-
-                        /* compute X pos in source frame */
-                        int s_x = data_pos % line_decoder->src_linesize;
-
-                        /* convert X pos from source frame into the destination frame.
-                         * it is byte offset from the beginning of a line.
-                         */
-                        int d_x = s_x * line_decoder->conv_num / line_decoder->conv_den;
-
-                        /* pointer to data payload in packet */
-                        source = (unsigned char*)(data);
-
-                        /* copy whole packet that can span several lines.
-                         * we need to clip data (v210 case) or center data (RGBA, R10k cases)
-                         */
-                        while (len > 0) {
-                                /* len id payload length in source BPP
-                                 * decoder needs len in destination BPP, so convert it
-                                 */
-                                int l = len * line_decoder->conv_num / line_decoder->conv_den;
-
-                                /* do not copy multiple lines, we need to
-                                 * copy (& clip, center) line by line
-                                 */
-                                if (l + d_x > (int) line_decoder->dst_linesize) {
-                                        l = line_decoder->dst_linesize - d_x;
-                                }
-
-                                /* compute byte offset in destination frame */
-                                offset = y + d_x;
-
-                                /* watch the SEGV */
-                                if (l + line_decoder->base_offset + offset <= tile->data_len) {
-                                        /*decode frame:
-                                         * we have offset for destination
-                                         * we update source contiguously
-                                         * we pass {r,g,b}shifts */
-                                        line_decoder->decode_line((unsigned char*)tile->data + line_decoder->base_offset + offset, source, l,
-                                                        line_decoder->shifts[0], line_decoder->shifts[1],
-                                                        line_decoder->shifts[2]);
-                                        /* we decoded one line (or a part of one line) to the end of the line
-                                         * so decrease *source* len by 1 line (or that part of the line */
-                                        len -= line_decoder->src_linesize - s_x;
-                                        /* jump in source by the same amount */
-                                        source += line_decoder->src_linesize - s_x;
-                                } else {
-                                        /* this should not ever happen as we call reconfigure before each packet
-                                         * iff reconfigure is needed. But if it still happens, something is terribly wrong
-                                         * say it loudly
-                                         */
-                                        if((prints % 100) == 0) {
-                                                log_msg(LOG_LEVEL_ERROR, "WARNING!! Discarding input data as frame buffer is too small.\n"
-                                                                "Well this should not happened. Expect troubles pretty soon.\n");
-                                        }
-                                        prints++;
-                                        len = 0;
+                        if (!direct_placed.empty() && direct_placed.contains(data_pos, len)) {
+                                // already received to the framebuffer
+                        } else if (defer) {
+                                decoder->shards[substream].tile = tile;
+                                decoder->shards[substream].line_decoder = line_decoder;
+                                decoder->shards[substream].packets.push_back({data_pos, data, len});
+                        } else {
+                                prints += line_decode_packet(line_decoder, tile, data_pos,
+                                                (const unsigned char *) data, len, prints);
+                                if (max_substreams == 1 && line_decoder->il_remap == IL_REMAP_NONE) {
+                                        vf_stripes_add(decoder->frame, line_decoder->src_linesize, data_pos, len);
                                 }
-                                /* each new line continues from the beginning */
-                                d_x = 0;        /* next line from beginning */
-                                s_x = 0;
-                                y += line_decoder->dst_pitch;  /* next line */
                         }
                 } else { /* PT_VIDEO_LDGM or external decoder */
                         if(!frame->tiles[substream].data) {
@@ -1776,14 +2790,25 @@ int decode_video_frame(struct coded_data *cdata, void *decoder_data, struct pbuf
                                 prints++;
                                 len = max<int>(0, buffer_length - data_pos);
                         }
-                        memcpy(frame->tiles[substream].data + data_pos, (unsigned char*) data,
-                                len);
+                        if (defer) {
+                                decoder->shards[substream].tile = &frame->tiles[substream];
+                                decoder->shards[substream].line_decoder = nullptr;
+                                decoder->shards[substream].packets.push_back({data_pos, data, len});
+                        } else {
+                                memcpy(frame->tiles[substream].data + data_pos, (unsigned char*) data,
+                                                len);
+                        }
                 }
 
 next_packet:
                 cdata = cdata->nxt;
         }
 
+        if (decoder->shard_substreams && max_substreams > 1) {
+                task_run_parallel(substream_shard_task, max_substreams, decoder->shards.data(),
+                                sizeof decoder->shards[0], NULL);
+        }
+
         if(!pckt) {
                 vf_free(frame);
                 return FALSE;
@@ -1831,6 +2856,12 @@ next_packet:
                 fec_msg->pckt_list = std::move(pckt_list);
                 fec_msg->received_pkts_cum = stats->received_pkts_cum;
                 fec_msg->expected_pkts_cum = stats->expected_pkts_cum;
+                fec_msg->recv_ts = frame_recv_ts;
+                fec_msg->capture_ts = frame_capture_ts;
+                fec_msg->decode_ts = get_time_in_ns();
+                if (frame_recv_ts != 0) {
+                        decoder->pbuf_latency.add(fec_msg->decode_ts - frame_recv_ts);
+                }
 
                 auto t0 = std::chrono::high_resolution_clock::now();
                 decoder->fec_queue.push(std::move(fec_msg));
@@ -1851,10 +2882,86 @@ cleanup:
         pbuf_data->decoded++;
 
         decoder->stats.update(buffer_number);
+        decoder->net_latency.report(decoder->control);
+        decoder->pbuf_latency.report(decoder->control);
 
         return ret;
 }
 
+/**
+ * Decodes a complete compressed frame passed in-process (loopback), ie.
+ * without RTP, FEC and packet reassembly. The frame enters the pipeline in
+ * place of an unprotected received frame, so it is decompressed and displayed
+ * exactly as a received one.
+ *
+ * The compressed data are copied (as when assembled from packets) because the
+ * decompressors need zeroed padding past the end of the buffer.
+ *
+ * @retval FALSE the frame was dropped (no display, reconfiguration failed or
+ *               the codec is not compressed)
+ */
+int video_decoder_put_frame(struct state_video_decoder *decoder, const struct video_frame *frame)
+{
+        if (decoder->display == nullptr || !process_reconfigure_messages(decoder)) {
+                return FALSE;
+        }
+        reconfigure_if_needed(decoder, video_desc_from_frame(const_cast<struct video_frame *>(frame)));
+        const int max_substreams = decoder->max_substreams;
+        if (FRAMEBUFFER_NOT_READY(decoder) || decoder->decoder_type != EXTERNAL_DECODER
+                        || (int) frame->tile_count != max_substreams) {
+                return FALSE;
+        }
+
+        struct video_frame *recv_frame = vf_alloc(max_substreams);
+        recv_frame->callbacks.data_deleter = vf_data_deleter;
+        for (int i = 0; i < max_substreams; ++i) {
+                const unsigned int len = frame->tiles[i].data_len;
+                recv_frame->tiles[i].data = (char *) malloc(len + PADDING);
+                memcpy(recv_frame->tiles[i].data, frame->tiles[i].data, len);
+                memset(recv_frame->tiles[i].data + len, 0, PADDING);
+                recv_frame->tiles[i].data_len = len;
+        }
+
+        unique_ptr<frame_msg> msg(new frame_msg(decoder->control, decoder->stats));
+        msg->buffer_num.resize(max_substreams);
+        msg->pckt_list.reset(new received_ranges[max_substreams]);
+        for (int i = 0; i < max_substreams; ++i) {
+                msg->pckt_list[i].add(0, frame->tiles[i].data_len);
+        }
+        recv_frame->fec_params = fec_desc(FEC_NONE);
+        recv_frame->ssrc = frame->ssrc;
+        msg->recv_frame = recv_frame;
+        msg->decode_ts = get_time_in_ns();
+        decoder->fec_queue.push(std::move(msg));
+        return TRUE;
+}
+
+/**
+ * Decompressor parameters are read at its initialization so the new value is
+ * stored and a reconfiguration is forced - the receiver thread then applies
+ * it and reinitializes the decompressor with the already received format.
+ */
+static struct response *decoder_set_param(struct state_video_decoder *s, const char *param)
+{
+        char key[64];
+        char val[1024];
+        if (sscanf(param, "%63s %1023[^\n]", key, val) != 2) {
+                return new_response(RESPONSE_BAD_REQUEST, "usage: <key> <value>");
+        }
+        if (strcmp(key, "lavd-thread-count") != 0) {
+                return new_response(RESPONSE_NOT_FOUND, "unknown decoder parameter");
+        }
+        s->lock.lock();
+        s->pending_params[key] = val;
+        struct video_desc desc = s->received_vid_desc;
+        s->lock.unlock();
+        if (desc.width != 0) { // otherwise applied on the first reconfiguration
+                s->msg_queue.push(new main_msg_reconfigure(desc, nullptr, true));
+        }
+        log_msg(LOG_LEVEL_NOTICE, "[video dec.] %s set to %s\n", key, val);
+        return new_response(RESPONSE_ACCEPTED, NULL);
+}
+
 static void decoder_process_message(struct module *m)
 {
         struct state_video_decoder *s = (struct state_video_decoder *) m->priv_data;
@@ -1868,6 +2975,8 @@ static void decoder_process_message(struct module *m)
                         string video_desc = s->received_vid_desc;
                         s->lock.unlock();
                         r = new_response(RESPONSE_OK, video_desc.c_str());
+                } else if (strncmp(m_univ->text, MSG_UNIVERSAL_TAG_SET_PARAM, strlen(MSG_UNIVERSAL_TAG_SET_PARAM)) == 0) {
+                        r = decoder_set_param(s, m_univ->text + strlen(MSG_UNIVERSAL_TAG_SET_PARAM));
                 } else {
                         r = new_response(RESPONSE_NOT_FOUND, NULL);
                 }
@@ -56,23 +56,29 @@
 struct coded_data;
 struct display;
 struct module;
+struct rtp;
 struct state_video_decoder;
 struct video_desc;
 struct video_frame;
 struct state_decompress;
 struct tile;
+struct video_viewport;
 
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
 
 int decode_video_frame(struct coded_data *received_data, void *decoder_data, struct pbuf_stats *stats);
+int video_decoder_put_frame(struct state_video_decoder *decoder, const struct video_frame *frame);
 
 struct state_video_decoder *video_decoder_init(struct module *parent, enum video_mode,
                 struct display *display, const char *encryption);
 void video_decoder_destroy(struct state_video_decoder *decoder);
 bool video_decoder_register_display(struct state_video_decoder *decoder, struct display *display);
 void video_decoder_remove_display(struct state_video_decoder *decoder);
+void video_decoder_set_direct_recv(struct state_video_decoder *decoder, struct rtp *session, uint32_t ssrc);
+bool video_decoder_keyframe_requested(struct state_video_decoder *decoder);
+bool video_decoder_get_viewport(struct state_video_decoder *decoder, struct video_viewport *viewport);
 bool parse_video_hdr(uint32_t *hdr, struct video_desc *desc);
 
 /** @} */ // end of video_rtp_decoder
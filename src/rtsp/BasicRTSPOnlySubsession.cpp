@@ -65,7 +65,6 @@ BasicRTSPOnlySubsession::BasicRTSPOnlySubsession(UsageEnvironment& env,
 		int audio_bps, int rtp_port, int rtp_port_audio) :
 		ServerMediaSubsession(env), fSDPLines(NULL), fReuseFirstSource(
 				reuseFirstSource), fLastStreamToken(NULL) {
-	Vdestination = NULL;
 	Adestination = NULL;
 	gethostname(fCNAME, sizeof fCNAME);
 	this->fmod = mod;
@@ -82,14 +81,13 @@ BasicRTSPOnlySubsession::BasicRTSPOnlySubsession(UsageEnvironment& env,
 BasicRTSPOnlySubsession::~BasicRTSPOnlySubsession() {
 	delete[] fSDPLines;
 	delete Adestination;
-	delete Vdestination;
 }
 
 char const* BasicRTSPOnlySubsession::sdpLines() {
 	if (fSDPLines == NULL) {
 		setSDPLines();
 	}
-	if (Adestination != NULL || Vdestination != NULL)
+	if (Adestination != NULL) // audio is sent to one client only
 		return NULL;
 	return fSDPLines;
 }
@@ -180,19 +178,42 @@ void BasicRTSPOnlySubsession::setSDPLines() {
 	}
 }
 
-void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */,
+#define ADD_CLIENT_TIMEOUT_MS 1000
+
+/**
+ * Sends a message about the RTSP client to the video sender, waits for
+ * the response only when adding the client (the server port is needed).
+ */
+static struct response *send_client_message(struct module *mod,
+		enum msg_sender_type type, unsigned clientSessionId,
+		const char *addr = "", int port = 0) {
+	char path[1024];
+	memset(path, 0, sizeof(path));
+	enum module_class path_sender[] = { MODULE_CLASS_SENDER,
+			MODULE_CLASS_NONE };
+	append_message_path(path, sizeof(path), path_sender);
+
+	struct msg_sender *msg = (struct msg_sender *) new_message(
+			sizeof(struct msg_sender));
+	msg->type = type;
+	msg->client_id = clientSessionId;
+	msg->client_port = port;
+	strncpy(msg->client_addr, addr, sizeof(msg->client_addr) - 1);
+	if (type == SENDER_MSG_ADD_CLIENT) {
+		return send_message_sync(mod, path, (struct message *) msg,
+				ADD_CLIENT_TIMEOUT_MS, 0);
+	}
+	return send_message(mod, path, (struct message *) msg);
+}
+
+void BasicRTSPOnlySubsession::getStreamParameters(unsigned clientSessionId,
 		netAddressBits clientAddress, Port const& clientRTPPort,
 		Port const& clientRTCPPort, int /* tcpSocketNum */,
 		unsigned char /* rtpChannelId */, unsigned char /* rtcpChannelId */,
 		netAddressBits& destinationAddress, uint8_t& /*destinationTTL*/,
 		Boolean& /* isMulticast */, Port& serverRTPPort, Port& serverRTCPPort,
 		void*& /* streamToken */) {
-	if (Vdestination == NULL && (avType == video || avType == av)) {
-		Port rtp(rtp_port);
-		serverRTPPort = rtp;
-		Port rtcp(rtp_port + 1);
-		serverRTCPPort = rtcp;
-
+	if (avType == video || avType == av) {
 		if (fSDPLines == NULL) {
 			setSDPLines();
 		}
@@ -201,8 +222,22 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 		}
 		struct in_addr destinationAddr;
 		destinationAddr.s_addr = destinationAddress;
-		Vdestination = new Destinations(destinationAddr, clientRTPPort,
-				clientRTCPPort);
+
+		// every client has its own RTP session in the sender, the server
+		// port is the one of the session (RTCP is per client)
+		int port = rtp_port;
+		struct response *resp = send_client_message(fmod,
+				SENDER_MSG_ADD_CLIENT, clientSessionId,
+				inet_ntoa(destinationAddr), ntohs(clientRTPPort.num()));
+		if (response_get_status(resp) == RESPONSE_OK
+				&& response_get_text(resp) != NULL) {
+			port = atoi(response_get_text(resp));
+		}
+		free_response(resp);
+		Port rtp(port);
+		serverRTPPort = rtp;
+		Port rtcp(port + 1);
+		serverRTCPPort = rtcp;
 	}
 	if (Adestination == NULL && (avType == audio || avType == av)) {
 		Port rtp(rtp_port_audio);
@@ -223,7 +258,7 @@ void BasicRTSPOnlySubsession::getStreamParameters(unsigned /* clientSessionId */
 	}
 }
 
-void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::startStream(unsigned clientSessionId,
 		void* /* streamToken */, TaskFunc* /* rtcpRRHandler */,
 		void* /* rtcpRRHandlerClientData */, unsigned short& /* rtpSeqNum */,
 		unsigned& /* rtpTimestamp */,
@@ -231,33 +266,11 @@ void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
 		void* /* serverRequestAlternativeByteHandlerClientData */) {
 	struct response *resp = NULL;
 
-	if (Vdestination != NULL) {
-		if (avType == video || avType == av) {
-			char pathV[1024];
-
-			memset(pathV, 0, sizeof(pathV));
-			enum module_class path_sender[] = { MODULE_CLASS_SENDER,
-					MODULE_CLASS_NONE };
-			append_message_path(pathV, sizeof(pathV), path_sender);
-
-			//CHANGE DST PORT
-			struct msg_sender *msgV1 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			msgV1->tx_port = ntohs(Vdestination->rtpPort.num());
-			msgV1->type = SENDER_MSG_CHANGE_PORT;
-			resp = send_message(fmod, pathV, (struct message *) msgV1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgV2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgV2->receiver, inet_ntoa(Vdestination->addr),
-					sizeof(msgV2->receiver) - 1);
-			msgV2->type = SENDER_MSG_CHANGE_RECEIVER;
-
-			resp = send_message(fmod, pathV, (struct message *) msgV2);
-			free_response(resp);
-		}
+	if (avType == video || avType == av) {
+		resp = send_client_message(fmod, SENDER_MSG_PLAY_CLIENT,
+				clientSessionId);
+		free_response(resp);
+		resp = NULL;
 	}
 
 	if (Adestination != NULL) {
@@ -292,34 +305,12 @@ void BasicRTSPOnlySubsession::startStream(unsigned /* clientSessionId */,
 	}
 }
 
-void BasicRTSPOnlySubsession::deleteStream(unsigned /* clientSessionId */,
+void BasicRTSPOnlySubsession::deleteStream(unsigned clientSessionId,
 		void*& /* streamToken */) {
-	if (Vdestination != NULL) {
-		if (avType == video || avType == av) {
-			char pathV[1024];
-			Vdestination = NULL;
-			memset(pathV, 0, sizeof(pathV));
-			enum module_class path_sender[] = { MODULE_CLASS_SENDER,
-					MODULE_CLASS_NONE };
-			append_message_path(pathV, sizeof(pathV), path_sender);
-
-			//CHANGE DST PORT
-			struct msg_sender *msgV1 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			msgV1->tx_port = rtp_port;
-			msgV1->type = SENDER_MSG_CHANGE_PORT;
-			struct response *resp;
-			resp = send_message(fmod, pathV, (struct message *) msgV1);
-			free_response(resp);
-
-			//CHANGE DST ADDRESS
-			struct msg_sender *msgV2 = (struct msg_sender *) new_message(
-					sizeof(struct msg_sender));
-			strncpy(msgV2->receiver, "127.0.0.1", sizeof(msgV2->receiver) - 1);
-			msgV2->type = SENDER_MSG_CHANGE_RECEIVER;
-			resp = send_message(fmod, pathV, (struct message *) msgV2);
-			free_response(resp);
-		}
+	if (avType == video || avType == av) {
+		struct response *resp = send_client_message(fmod,
+				SENDER_MSG_REMOVE_CLIENT, clientSessionId);
+		free_response(resp);
 	}
 
 	if (Adestination != NULL) {
@@ -130,7 +130,6 @@ protected:
 protected:
 
     char* fSDPLines;
-    Destinations* Vdestination;
     Destinations* Adestination;
 
 private:
@@ -71,10 +71,12 @@
 #include "host.h"
 #include "lib_common.h"
 #include "crypto/openssl_encrypt.h"
+#include "messaging.h"
 #include "module.h"
 #include "rtp/fec.h"
 #include "rtp/rtp.h"
 #include "rtp/rtp_callback.h"
+#include "rtp/rtp_hdrext.h"
 #include "rtp/rtpenc_h264.h"
 #include "tv.h"
 #include "transmit.h"
@@ -86,7 +88,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #define MOD_NAME "[transmit] "
@@ -96,21 +104,23 @@
 
 #define CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS 1000
 
-#ifdef HAVE_MACOSX
-#define GET_STARTTIME gettimeofday(&start, NULL)
-#define GET_STOPTIME gettimeofday(&stop, NULL)
-#define GET_DELTA delta = (stop.tv_sec - start.tv_sec) * 1000000000l + (stop.tv_usec - start.tv_usec) * 1000L
-#elif defined HAVE_LINUX
-#define GET_STARTTIME clock_gettime(CLOCK_REALTIME, &start)
-#define GET_STOPTIME clock_gettime(CLOCK_REALTIME, &stop)
-#define GET_DELTA delta = (stop.tv_sec - start.tv_sec) * 1000000000l + stop.tv_nsec - start.tv_nsec
-#else // Windows
-#define GET_STARTTIME {QueryPerformanceFrequency(&freq); QueryPerformanceCounter(&start); }
-#define GET_STOPTIME { QueryPerformanceCounter(&stop); }
-#define GET_DELTA delta = (long)((double)(stop.QuadPart - start.QuadPart) * 1000 * 1000 * 1000 / freq.QuadPart);
-#endif
-
 #define DEFAULT_CIPHER_MODE MODE_AES128_GCM
+#define DEFAULT_PACING_BURST_US 100 ///< minimal length of a burst for TX_PACING_SLEEP
+#define TX_PRIO_DSCP_AUDIO 46        ///< EF (RFC 8837 - interactive audio)
+#define TX_PRIO_DSCP_VIDEO 34        ///< AF41 (RFC 8837 - interactive video)
+#define TX_PRIO_SO_AUDIO 6           ///< TC_PRIO_INTERACTIVE - highest pfifo_fast band (also RTCP)
+#define TX_PRIO_SO_VIDEO 2           ///< TC_PRIO_BULK - lowest pfifo_fast band
+#define TX_PRIO_MAX_YIELD_NS (2 * NS_IN_MS) ///< max time video waits for an audio frame to be sent
+
+#define RATE_CTL_MIN_BPS (1000 * 1000)          ///< do not go below 1 Mbps
+#define RATE_CTL_LOSS_LOW 0.005                 ///< increase rate below this loss
+#define RATE_CTL_LOSS_HIGH 0.02                 ///< decrease rate above this loss
+#define RATE_CTL_QUEUING_US 10000               ///< RTT increase over minimum considered as queuing
+#define RATE_CTL_INCREASE 1.08                  ///< multiplicative increase per report
+#define RATE_CTL_HEADROOM 1.5                   ///< max rate relative to the actual sending rate
+#define RATE_CTL_COMPRESS_SHARE 0.85            ///< part of the rate given to the compressor
+#define RATE_CTL_COMPRESS_MIN_CHANGE 0.1        ///< relative change that triggers compressor reconfiguration
+#define RATE_CTL_COMPRESS_INTERVAL_NS (2 * NS_IN_SEC) ///< minimal interval between compressor changes
 
 using std::array;
 using std::vector;
@@ -122,8 +132,15 @@ static uint32_t format_interl_fps_hdr_row(enum interlacing_t interlacing, double
 static void
 tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                 uint32_t ts, int send_m,
-                unsigned int substream,
-                int fragment_offset);
+                unsigned int first_tile, unsigned int tile_count);
+
+struct tx_packet {
+        char *data;
+        int data_len;
+        uint32_t *rtp_hdr;
+        int m;
+        unsigned int tile;
+};
 
 
 static bool set_fec(struct tx *tx, const char *fec);
@@ -135,6 +152,50 @@ struct rate_limit_dyn {
         static constexpr int EXCESS_GAP = 4; ///< minimal gap between excessive frames
 };
 
+enum tx_pacing_mode {
+        TX_PACING_SLEEP = 0, ///< bursts of packets followed by sleep (default)
+        TX_PACING_SPIN,      ///< busy-wait between each packet
+        TX_PACING_TXTIME,    ///< kernel pacing with SO_TXTIME (Linux, needs fq qdisc)
+};
+
+/**
+ * Traffic shaper - schedules packets of a frame (all its tiles) to be sent in regular
+ * intervals given by get_packet_rate().
+ */
+struct tx_pacer {
+        enum tx_pacing_mode mode;
+        long long min_burst_ns;
+        struct rtp *txtime_session; ///< session with SO_TXTIME enabled
+        long long start_ns;         ///< steady clock time of first packet
+        long long sched_end_ns;     ///< end of last schedule (TX_PACING_TXTIME)
+        long interval_ns;
+        long burst;                 ///< packets sent at once (TX_PACING_SLEEP)
+        bool yield_to_audio;        ///< wait between packets while audio is being sent
+};
+
+/// audio (and RTCP) priority over video, see "--param tx-priority"
+struct tx_priority {
+        bool enabled;
+        int audio_dscp;
+        int video_dscp;
+        struct rtp *session;        ///< session the marking was applied to
+};
+
+/**
+ * Loss-based sender rate control driven by RTCP reception reports,
+ * similar to the loss-based controller of Google Congestion Control.
+ */
+struct tx_rate_ctl {
+        bool enabled;
+        bool drive_compress;            ///< propagate the rate to the compressor
+        double rate;                    ///< target rate in bps, 0 until known
+        uint32_t min_rtt_us;
+        uint64_t last_bytes_sent;
+        long long last_report_ns;
+        double compress_rate;           ///< last bitrate requested from the compressor
+        long long compress_change_ns;
+};
+
 struct tx {
         struct module mod;
 
@@ -162,12 +223,339 @@ struct tx {
 
         const struct openssl_encrypt_info *enc_funcs;
         struct openssl_encrypt *encryption;
+        char *enc_buf;      ///< encrypted packets of a video or an audio frame
+        size_t enc_buf_len;
+        char *agg_buf;      ///< H.264/HEVC aggregation packets of a tile
+        size_t agg_buf_len;
         long long int bitrate;
         struct rate_limit_dyn dyn_rate_limit_state;
-		
+        int spread_max;             ///< max frame intervals an oversized frame may span (0, 1 - no spreading)
+        double spread_avg_len;      ///< moving average of the frame length for the spreading
+        struct tx_pacer pacer;
+        struct tx_rate_ctl rate_ctl;
+        struct tx_priority prio;
+        bool capture_time_ext;      ///< add abs-capture-time header extension to video packets
+
         char tmp_packet[RTP_MAX_MTU];
 };
 
+ADD_TO_PARAM("rtp-capture-time", "* rtp-capture-time\n"
+                "  Add frame capture time to video RTP packets (RFC 8285 abs-capture-time\n"
+                "  header extension, 16 B per packet) for per-frame latency and A/V sync\n"
+                "  at the receiver without the need of RTCP sender reports.\n");
+
+/// @returns bytes to be reserved in each video packet for the header extension
+static int tx_hdrext_len(const struct tx *tx)
+{
+        return tx->capture_time_ext ? RTP_HDREXT_ABS_CAPTURE_TIME_LEN : 0;
+}
+
+/**
+ * @param[out] buf extension data if the capture time is sent with the frame
+ * @returns        buf or nullptr
+ */
+static char *tx_get_capture_time_ext(const struct tx *tx, const struct video_frame *frame,
+                uint32_t buf[RTP_HDREXT_ABS_CAPTURE_TIME_WORDS])
+{
+        if (!tx->capture_time_ext || frame->compress_start == 0) {
+                return nullptr;
+        }
+        rtp_hdrext_write_abs_capture_time(buf, (time_ns_t) frame->compress_start * NS_IN_MS);
+        return (char *) buf;
+}
+
+static long long steady_time_ns()
+{
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Accounts bytes sent for the control port bandwidth report. Called once per
+ * packet batch (not per packet) to read the clock only once.
+ */
+static void tx_update_sent_stats(struct tx *tx, struct rtp *rtp_session, const char *media, size_t bytes)
+{
+        if (!control_stats_enabled(tx->control)) {
+                return;
+        }
+        auto current_time_ms = time_since_epoch_in_ms();
+        if(current_time_ms - tx->last_stat_report >= CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS){
+                std::ostringstream oss;
+                oss << "tx_send " << std::hex << rtp_my_ssrc(rtp_session) << std::dec << " " << media << " " << tx->sent_since_report;
+                control_report_stats(tx->control, oss.str());
+                tx->last_stat_report = current_time_ms;
+                tx->sent_since_report = 0;
+        }
+        tx->sent_since_report += bytes;
+}
+
+/**
+ * Transmit scheduling shared by all tx instances (audio and video) of the
+ * process if tx-priority is enabled - audio is sent with strict priority, the
+ * video pacer doesn't put further packets to the socket while an audio frame
+ * is being sent.
+ */
+static struct {
+        std::atomic<int> urgent_senders{0};
+        std::mutex lock;
+        std::condition_variable cv;
+} tx_sched;
+
+static void tx_sched_urgent_begin()
+{
+        tx_sched.urgent_senders.fetch_add(1, std::memory_order_acq_rel);
+}
+
+static void tx_sched_urgent_end()
+{
+        if (tx_sched.urgent_senders.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lk(tx_sched.lock);
+                tx_sched.cv.notify_all();
+        }
+}
+
+/// waits (at most TX_PRIO_MAX_YIELD_NS) until no audio frame is being sent
+static void tx_sched_yield()
+{
+        if (tx_sched.urgent_senders.load(std::memory_order_acquire) == 0) {
+                return;
+        }
+        std::unique_lock<std::mutex> lk(tx_sched.lock);
+        tx_sched.cv.wait_for(lk, std::chrono::nanoseconds(TX_PRIO_MAX_YIELD_NS),
+                        [] { return tx_sched.urgent_senders.load(std::memory_order_acquire) == 0; });
+}
+
+ADD_TO_PARAM("tx-priority", "* tx-priority[=<audio_dscp>:<video_dscp>]\n"
+                "  Send audio and RTCP with strict priority over video - video packets are held back\n"
+                "  while an audio frame is being sent and sockets are marked with DSCP (default\n"
+                "  " TOSTRING(TX_PRIO_DSCP_AUDIO) ":" TOSTRING(TX_PRIO_DSCP_VIDEO) " - EF/AF41) and SO_PRIORITY (Linux)\n");
+static bool tx_prio_init(struct tx_priority *p)
+{
+        const char *cfg = get_commandline_param("tx-priority");
+        if (cfg == nullptr) {
+                return true;
+        }
+        p->enabled = true;
+        p->audio_dscp = TX_PRIO_DSCP_AUDIO;
+        p->video_dscp = TX_PRIO_DSCP_VIDEO;
+        if (strlen(cfg) > 0) {
+                if (sscanf(cfg, "%d:%d", &p->audio_dscp, &p->video_dscp) != 2 ||
+                                p->audio_dscp < 0 || p->audio_dscp > 63 || p->video_dscp < 0 || p->video_dscp > 63) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong tx-priority DSCP values: %s\n", cfg);
+                        return false;
+                }
+        }
+        return true;
+}
+
+/// marks the RTP (and RTCP) socket of the session according to the media type
+static void tx_prio_apply(struct tx *tx, struct rtp *rtp_session)
+{
+        if (!tx->prio.enabled || tx->prio.session == rtp_session) {
+                return;
+        }
+        bool audio = tx->media_type == TX_MEDIA_AUDIO;
+        if (!rtp_set_priority(rtp_session, false, audio ? tx->prio.audio_dscp : tx->prio.video_dscp,
+                                audio ? TX_PRIO_SO_AUDIO : TX_PRIO_SO_VIDEO) ||
+                        !rtp_set_priority(rtp_session, true, tx->prio.audio_dscp, TX_PRIO_SO_AUDIO)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set packet priority!\n");
+        }
+        tx->prio.session = rtp_session;
+}
+
+ADD_TO_PARAM("tx-pacing", "* tx-pacing=sleep[:<burst_us>]|spin|txtime\n"
+                "  Traffic shaper pacing - bursts lasting at least <burst_us> (default " TOSTRING(DEFAULT_PACING_BURST_US) ") followed by sleep,\n"
+                "  busy-waiting between packets or kernel pacing with SO_TXTIME (Linux, requires fq qdisc)\n");
+/// @param cfg tx-pacing value, NULL for default
+static bool pacer_configure(struct tx_pacer *p, const char *cfg)
+{
+        enum tx_pacing_mode mode = TX_PACING_SLEEP;
+        long long min_burst_ns = DEFAULT_PACING_BURST_US * NS_IN_US;
+        if (cfg == nullptr) {
+                // default
+        } else if (strstr(cfg, "sleep") == cfg) {
+                if (cfg[strlen("sleep")] == ':') {
+                        min_burst_ns = atoll(cfg + strlen("sleep:")) * NS_IN_US;
+                }
+        } else if (strcmp(cfg, "spin") == 0) {
+                mode = TX_PACING_SPIN;
+        } else if (strcmp(cfg, "txtime") == 0) {
+                mode = TX_PACING_TXTIME;
+        } else {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown pacing mode: %s\n", cfg);
+                return false;
+        }
+        p->mode = mode;
+        p->min_burst_ns = min_burst_ns;
+        return true;
+}
+
+static bool pacer_init(struct tx_pacer *p)
+{
+        return pacer_configure(p, get_commandline_param("tx-pacing"));
+}
+
+static void pacer_start(struct tx_pacer *p, struct rtp *rtp_session, long interval_ns)
+{
+        if (p->mode != TX_PACING_TXTIME && p->txtime_session == rtp_session) {
+                // switched from txtime at runtime - do not keep the last schedule
+                rtp_set_next_txtime(rtp_session, 0);
+                p->txtime_session = nullptr;
+        }
+        if (p->mode == TX_PACING_TXTIME && p->txtime_session != rtp_session) {
+                if (rtp_enable_txtime(rtp_session)) {
+                        p->txtime_session = rtp_session;
+                } else {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot use SO_TXTIME pacing, falling back to sleep.\n");
+                        p->mode = TX_PACING_SLEEP;
+                }
+        }
+        p->interval_ns = interval_ns;
+        p->start_ns = steady_time_ns();
+        if (p->mode == TX_PACING_TXTIME) {
+                // keep schedule monotonic - previous tile may be still queued
+                p->start_ns = std::max(p->start_ns, p->sched_end_ns);
+        }
+        p->burst = interval_ns > 0 ? std::max<long>(1, ceil((double) p->min_burst_ns / interval_ns)) : 1;
+}
+
+/// called prior to sending packet number idx
+static inline void pacer_before_send(struct tx_pacer *p, struct rtp *rtp_session, long idx)
+{
+        if (p->mode != TX_PACING_TXTIME || p->interval_ns <= 0) {
+                return;
+        }
+        p->sched_end_ns = p->start_ns + idx * p->interval_ns;
+        rtp_set_next_txtime(rtp_session, p->sched_end_ns);
+}
+
+/// called after sending packet number idx if more packets follow
+static inline void pacer_wait(struct tx_pacer *p, long idx)
+{
+        if (p->yield_to_audio) {
+                tx_sched_yield();
+        }
+        if (p->interval_ns <= 0) {
+                return;
+        }
+        long long next_ns = p->start_ns + (idx + 1) * p->interval_ns;
+        switch (p->mode) {
+        case TX_PACING_SPIN:
+                while (steady_time_ns() < next_ns) {
+                }
+                break;
+        case TX_PACING_SLEEP:
+                if ((idx + 1) % p->burst == 0) {
+                        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+                                                std::chrono::nanoseconds(next_ns)));
+                }
+                break;
+        case TX_PACING_TXTIME:
+                break;
+        }
+}
+
+static void pacer_done(struct tx_pacer *p, struct rtp *rtp_session)
+{
+        if (p->mode == TX_PACING_TXTIME && p->txtime_session == rtp_session) {
+                rtp_set_next_txtime(rtp_session, 0);
+        }
+}
+
+ADD_TO_PARAM("tx-rate-control", "* tx-rate-control[=compress]\n"
+                "  Adapt video sending rate to the loss reported by receivers in RTCP, with \"compress\"\n"
+                "  also reconfigure the compression bitrate (libavcodec)\n");
+static bool rate_ctl_init(struct tx_rate_ctl *rc)
+{
+        const char *cfg = get_commandline_param("tx-rate-control");
+        if (cfg == nullptr) {
+                return true;
+        }
+        rc->enabled = true;
+        if (strcmp(cfg, "compress") == 0) {
+                rc->drive_compress = true;
+        } else if (strlen(cfg) > 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown rate control option: %s\n", cfg);
+                return false;
+        }
+        return true;
+}
+
+static void rate_ctl_set_compress(struct tx *tx, long long now)
+{
+        struct tx_rate_ctl *rc = &tx->rate_ctl;
+        double target = rc->rate * RATE_CTL_COMPRESS_SHARE;
+        if (now - rc->compress_change_ns < RATE_CTL_COMPRESS_INTERVAL_NS ||
+                        fabs(target - rc->compress_rate) < rc->compress_rate * RATE_CTL_COMPRESS_MIN_CHANGE) {
+                return;
+        }
+        auto *msg = (struct msg_change_compress_data *)
+                new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "bitrate=%lld", (long long) target);
+        struct response *resp = send_message(get_root_module(&tx->mod), "sender.compress", (struct message *) msg);
+        free_response(resp);
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Setting compression bitrate to %sbps\n", format_in_si_units(target));
+        rc->compress_rate = target;
+        rc->compress_change_ns = now;
+}
+
+/**
+ * Updates the target rate if a new reception report is available. The rate
+ * is decreased proportionally to loss above RATE_CTL_LOSS_HIGH and increased
+ * multiplicatively below RATE_CTL_LOSS_LOW unless RTT grows (queues are being
+ * filled) - but only up to RATE_CTL_HEADROOM times the actually sent rate so
+ * that it doesn't grow unbounded when the source doesn't fill the link.
+ */
+static void rate_ctl_update(struct tx *tx, struct rtp *rtp_session)
+{
+        struct tx_rate_ctl *rc = &tx->rate_ctl;
+        struct rtp_rr_feedback fb;
+        if (!rc->enabled || !rtp_get_rr_feedback(rtp_session, &fb)) {
+                return;
+        }
+        long long now = steady_time_ns();
+        uint64_t bytes_sent = rtp_get_bytes_sent(rtp_session);
+        double sent_rate = 0;
+        if (rc->last_report_ns != 0 && now > rc->last_report_ns) {
+                sent_rate = (double) (bytes_sent - rc->last_bytes_sent) * 8 * NS_IN_SEC / (now - rc->last_report_ns);
+        }
+        rc->last_bytes_sent = bytes_sent;
+        rc->last_report_ns = now;
+        if (sent_rate == 0) {
+                return;
+        }
+
+        bool queuing = false;
+        if (fb.rtt_us > 0) {
+                if (rc->min_rtt_us == 0 || fb.rtt_us < rc->min_rtt_us) {
+                        rc->min_rtt_us = fb.rtt_us;
+                }
+                queuing = fb.rtt_us > rc->min_rtt_us + RATE_CTL_QUEUING_US;
+        }
+
+        double rate = rc->rate == 0 ? sent_rate : rc->rate;
+        if (fb.fract_lost > RATE_CTL_LOSS_HIGH) {
+                rate *= 1 - 0.5 * fb.fract_lost;
+        } else if (fb.fract_lost < RATE_CTL_LOSS_LOW && !queuing && rate < RATE_CTL_HEADROOM * sent_rate) {
+                rate = std::min(rate * RATE_CTL_INCREASE, RATE_CTL_HEADROOM * sent_rate);
+        }
+        if (tx->bitrate > 0) {
+                rate = std::min<double>(rate, tx->bitrate & ~RATE_FLAG_FIXED_RATE);
+        }
+        rate = std::max<double>(rate, RATE_CTL_MIN_BPS);
+        if (fabs(rate - rc->rate) > rc->rate / 100) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Reported loss %.2f%%, RTT %" PRIu32 " us, sent %.2f Mbps - rate %.2f Mbps\n",
+                                fb.fract_lost * 100, fb.rtt_us, sent_rate / 1e6, rate / 1e6);
+        }
+        rc->rate = rate;
+
+        if (rc->drive_compress) {
+                rate_ctl_set_compress(tx, now);
+        }
+}
+
 static void tx_update(struct tx *tx, struct video_frame *frame, int substream)
 {
         if(!frame) {
@@ -231,15 +619,19 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
         tx->mult_count = 1;
         tx->max_loss = 0.0;
         tx->mtu = mtu;
+        tx->capture_time_ext = media_type == TX_MEDIA_VIDEO && get_commandline_param("rtp-capture-time") != nullptr;
         tx->buffer = lrand48() & 0x3fffff;
         tx->avg_len = tx->avg_len_last = tx->sent_frames = 0u;
         tx->fec_scheme = FEC_NONE;
         tx->last_frame_fragment_id = -1;
-        if (fec) {
-                if(!set_fec(tx, fec)) {
-                        module_done(&tx->mod);
-                        return NULL;
-                }
+        if (!pacer_init(&tx->pacer) || !tx_prio_init(&tx->prio)) {
+                module_done(&tx->mod);
+                return NULL;
+        }
+        tx->pacer.yield_to_audio = tx->prio.enabled && media_type == TX_MEDIA_VIDEO;
+        if (media_type == TX_MEDIA_VIDEO && !rate_ctl_init(&tx->rate_ctl)) {
+                module_done(&tx->mod);
+                return NULL;
         }
         if (encryption) {
                 tx->enc_funcs = static_cast<const struct openssl_encrypt_info *>(load_library("openssl_encrypt",
@@ -257,6 +649,14 @@ struct tx *tx_init(struct module *parent, unsigned mtu, enum tx_media_type media
                 }
         }
 
+        // after encryption initialization - RLC symbol size depends on its overhead
+        if (fec) {
+                if(!set_fec(tx, fec)) {
+                        module_done(&tx->mod);
+                        return NULL;
+                }
+        }
+
         tx->bitrate = bitrate;
 
         tx->control = (struct control_state *) get_module(get_root_module(parent), "control");
@@ -306,9 +706,23 @@ static bool set_fec(struct tx *tx, const char *fec_const)
                 snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RS cfg %s",
                                 fec_cfg ? fec_cfg : "");
                 tx->fec_scheme = FEC_RS;
+        } else if(strcasecmp(fec, "RLC") == 0) {
+                if(tx->media_type == TX_MEDIA_AUDIO) {
+                        fprintf(stderr, "RLC is not currently supported for audio!\n");
+                        ret = false;
+                } else {
+                        // one symbol per packet
+                        int symbol_size = tx->mtu - (40 + 8 + 12 + sizeof(fec_payload_hdr_t)) - tx_hdrext_len(tx);
+                        if (tx->encryption) {
+                                symbol_size -= sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
+                        }
+                        snprintf(msg->fec_cfg, sizeof(msg->fec_cfg), "RLC cfg %d%s%s", symbol_size,
+                                        fec_cfg ? ":" : "", fec_cfg ? fec_cfg : "");
+                        tx->fec_scheme = FEC_RLC;
+                }
         } else if(strcasecmp(fec, "help") == 0) {
                 std::cout << "Usage:\n"
-                        "\t-f [A:|V:]{ mult:count | ldgm[:params] | rs[:params] }\n";
+                        "\t-f [A:|V:]{ mult:count | ldgm[:params] | rs[:params] | rlc[:params] }\n";
                 ret = false;
         } else {
                 fprintf(stderr, "Unknown FEC: %s\n", fec);
@@ -360,6 +774,14 @@ static void fec_check_messages(struct tx *tx)
                                 r = new_response(RESPONSE_BAD_REQUEST, "Wrong value for bitrate");
                                 LOG(LOG_LEVEL_ERROR) << "[Transmit] Wrong bitrate: " << text << "\n";
                         }
+                } else if (strstr(text, MSG_UNIVERSAL_TAG_SET_PARAM "tx-pacing ") == text) {
+                        text += strlen(MSG_UNIVERSAL_TAG_SET_PARAM "tx-pacing ");
+                        if (pacer_configure(&tx->pacer, text)) {
+                                r = new_response(RESPONSE_OK, nullptr);
+                                LOG(LOG_LEVEL_NOTICE) << "[Transmit] Pacing set to: " << text << "\n";
+                        } else {
+                                r = new_response(RESPONSE_BAD_REQUEST, "Wrong pacing mode");
+                        }
                 } else {
                         r = new_response(RESPONSE_BAD_REQUEST, "Unknown TX message");
                         LOG(LOG_LEVEL_ERROR) << "[Transmit] Unknown TX message: " << text << "\n";
@@ -373,46 +795,63 @@ static void tx_done(struct module *mod)
 {
         struct tx *tx = (struct tx *) mod->priv_data;
         assert(tx->magic == TRANSMIT_MAGIC);
+        free(tx->enc_buf);
+        free(tx->agg_buf);
         free(tx);
 }
 
+/**
+ * @returns ts for the frame - fragments of one frame (same frame_fragment_id)
+ * share the timestamp of the first one
+ */
+/**
+ * @returns RTP timestamp of the frame capture - the receiver relates it to
+ * audio via RTCP SR (both use get_local_mediatime() clock), so the encoding
+ * time must not be included. Capture time is approximated with compression
+ * start.
+ */
+static uint32_t get_frame_mediatime(const struct video_frame *frame)
+{
+        uint32_t now = get_local_mediatime();
+        if (frame->compress_start == 0) {
+                return now;
+        }
+        uint64_t age_ms = time_since_epoch_in_ms() - frame->compress_start;
+        if (age_ms > MS_IN_SEC) { // unlikely, clock has stepped
+                return now;
+        }
+        return now - age_ms * 90;
+}
+
+static uint32_t get_fragment_ts(struct tx *tx, struct video_frame *frame, uint32_t ts)
+{
+        if(frame->fragment &&
+                        tx->last_frame_fragment_id == frame->frame_fragment_id) {
+                return tx->last_ts;
+        }
+        tx->last_frame_fragment_id = frame->frame_fragment_id;
+        tx->last_ts = ts;
+        return ts;
+}
+
 /*
  * sends one or more frames (tiles) with same TS in one RTP stream. Only one m-bit is set.
  */
 void
 tx_send(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session)
 {
-        unsigned int i;
         uint32_t ts = 0;
 
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
+        rate_ctl_update(tx, rtp_session);
 
-        ts = get_local_mediatime();
-        if(frame->fragment &&
-                        tx->last_frame_fragment_id == frame->frame_fragment_id) {
-                ts = tx->last_ts;
-        } else {
-                tx->last_frame_fragment_id = frame->frame_fragment_id;
-                tx->last_ts = ts;
-        }
-
-        for(i = 0; i < frame->tile_count; ++i)
-        {
-                int last = FALSE;
-                int fragment_offset = 0;
-                
-                if (i == frame->tile_count - 1) {
-                        if(!frame->fragment || frame->last_fragment)
-                                last = TRUE;
-                }
-                if(frame->fragment)
-                        fragment_offset = vf_get_tile(frame, i)->offset;
+        ts = get_fragment_ts(tx, frame, get_frame_mediatime(frame));
 
-                tx_send_base(tx, frame, rtp_session, ts, last,
-                                i, fragment_offset);
-        }
+        // all tiles are sent at once, interleaved (see tx_send_base())
+        tx_send_base(tx, frame, rtp_session, ts, !frame->fragment || frame->last_fragment,
+                        0, frame->tile_count);
         tx->buffer++;
 }
 
@@ -454,26 +893,15 @@ tx_send_tile(struct tx *tx, struct video_frame *frame, int pos, struct rtp *rtp_
 {
         int last = FALSE;
         uint32_t ts = 0;
-        int fragment_offset = 0;
 
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tile are not currently supported for fragmented send
         fec_check_messages(tx);
 
-        ts = get_local_mediatime();
-        if(frame->fragment &&
-                        tx->last_frame_fragment_id == frame->frame_fragment_id) {
-                ts = tx->last_ts;
-        } else {
-                tx->last_frame_fragment_id = frame->frame_fragment_id;
-                tx->last_ts = ts;
-        }
+        ts = get_fragment_ts(tx, frame, get_frame_mediatime(frame));
         if(!frame->fragment || frame->last_fragment)
                 last = TRUE;
-        if(frame->fragment)
-                fragment_offset = vf_get_tile(frame, pos)->offset;
-        tx_send_base(tx, frame, rtp_session, ts, last, pos,
-                        fragment_offset);
+        tx_send_base(tx, frame, rtp_session, ts, last, pos, 1);
         tx->buffer ++;
 }
 
@@ -573,15 +1001,42 @@ static vector<int> get_packet_sizes(struct video_frame *frame, int substream, in
 }
 
 /**
- * Returns inter-packet interval in nanoseconds.
+ * Returns number of frame intervals the frame may be spread over - frames
+ * larger than the average (eg. keyframes) span proportionally more intervals,
+ * up to tx->spread_max. The sender is expected to queue the following frames
+ * meanwhile (see tx_set_max_frame_spread()).
+ */
+static double
+get_frame_spread(struct tx *tx, long data_len)
+{
+        if (tx->spread_max <= 1) {
+                return 1.0;
+        }
+        double spread = 1.0;
+        if (tx->spread_avg_len > 0) {
+                spread = std::clamp(data_len / tx->spread_avg_len, 1.0, (double) tx->spread_max);
+        }
+        tx->spread_avg_len = tx->spread_avg_len == 0 ? data_len : (15 * tx->spread_avg_len + data_len) / 16;
+        return spread;
+}
+
+/**
+ * Returns inter-packet interval in nanoseconds for the rate given by the -l option.
+ *
+ * @param tile_count  number of tiles sent in one schedule - the schedule gets
+ *                    corresponding share of the frame interval
+ * @param data_len    length of the tiles
  */
 static long
-get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long packet_count)
+get_packet_rate_nominal(struct tx *tx, struct video_frame *frame, int tile_count, long data_len, long packet_count)
 {
         if (tx->bitrate == RATE_UNLIMITED) {
                 return 0;
         }
-        double time_for_frame = 1.0 / frame->fps / frame->tile_count;
+        double time_for_frame = 1.0 / frame->fps * tile_count / frame->tile_count;
+        if (tx->bitrate != RATE_DYNAMIC) { // dynamic rate sends oversized frames faster instead
+                time_for_frame *= get_frame_spread(tx, data_len);
+        }
         double interval_between_pkts = time_for_frame / tx->mult_count / packet_count;
         // use only 75% of the time - we less likely overshot the frame time and
         // can minimize risk of swapping packets between 2 frames (out-of-order ones)
@@ -594,18 +1049,18 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
                return packet_rate_auto;
         }
         if (tx->bitrate == RATE_DYNAMIC) {
-                if (frame->tiles[substream].data_len > 2 * tx->dyn_rate_limit_state.avg_frame_size
+                if ((size_t) data_len > 2 * tx->dyn_rate_limit_state.avg_frame_size
                                 && tx->dyn_rate_limit_state.last_excess > rate_limit_dyn::EXCESS_GAP) {
                         packet_rate_auto /= 2; // double packet rate for this frame
                         tx->dyn_rate_limit_state.last_excess = 0;
                 } else {
                         tx->dyn_rate_limit_state.last_excess += 1;
                 }
-                tx->dyn_rate_limit_state.avg_frame_size = (9 * tx->dyn_rate_limit_state.avg_frame_size + frame->tiles[substream].data_len) / 10;
+                tx->dyn_rate_limit_state.avg_frame_size = (9 * tx->dyn_rate_limit_state.avg_frame_size + data_len) / 10;
                 return packet_rate_auto;
         }
         long long int bitrate = tx->bitrate & ~RATE_FLAG_FIXED_RATE;
-        int avg_packet_size = frame->tiles[substream].data_len / packet_count;
+        int avg_packet_size = data_len / packet_count;
         long packet_rate = 1000'000'000L * avg_packet_size * 8 / bitrate; // fixed rate
         if ((tx->bitrate & RATE_FLAG_FIXED_RATE) == 0) { // adaptive capped rate
                 packet_rate = std::max(packet_rate, packet_rate_auto);
@@ -613,47 +1068,35 @@ get_packet_rate(struct tx *tx, struct video_frame *frame, int substream, long pa
         return packet_rate;
 }
 
-static void
-tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
-                uint32_t ts, int send_m,
-                unsigned int substream,
-                int fragment_offset)
+/**
+ * Returns inter-packet interval in nanoseconds, further limited by the rate control.
+ */
+static long
+get_packet_rate(struct tx *tx, struct video_frame *frame, int tile_count, long data_len, long packet_count)
 {
-        if (!rtp_has_receiver(rtp_session)) {
-                return;
+        long packet_rate = get_packet_rate_nominal(tx, frame, tile_count, data_len, packet_count);
+        if (frame->frame_capped && tx->bitrate != RATE_UNLIMITED) {
+                // frames of a constant-latency encoder must not be spread over more than the frame interval (75 %)
+                double time_for_frame = 1.0 / frame->fps * tile_count / frame->tile_count;
+                packet_rate = std::min<long>(packet_rate, time_for_frame / tx->mult_count / packet_count * 0.75 * NS_IN_SEC);
+        }
+        if (tx->rate_ctl.rate > 0 && (tx->bitrate <= 0 || (tx->bitrate & RATE_FLAG_FIXED_RATE) == 0)) {
+                int avg_packet_size = data_len / packet_count;
+                packet_rate = std::max<long>(packet_rate, NS_IN_SEC * avg_packet_size * 8 / tx->rate_ctl.rate);
         }
+        return packet_rate;
+}
 
+/// fills RTP payload header template of the tile (offset word excluded)
+static void
+format_tile_header(struct tx *tx, struct video_frame *frame, unsigned int substream, uint32_t *rtp_hdr)
+{
         struct tile *tile = &frame->tiles[substream];
-
-        int data_len;
-        // see definition in rtp_callback.h
-
-        uint32_t rtp_hdr[100];
-        int rtp_hdr_len;
-        int pt = fec_pt_from_fec_type(TX_MEDIA_VIDEO, frame->fec_params.type, tx->encryption);            /* A value specified in our packet format */
-#ifdef HAVE_LINUX
-        struct timespec start, stop;
-#elif defined HAVE_MACOSX
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta, overslept = 0;
-        array <int, FEC_MAX_MULT> mult_pos{};
-        int mult_index = 0;
-
-        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // IP hdr size + UDP hdr size + RTP hdr size
-
-        assert(tx->magic == TRANSMIT_MAGIC);
-
-        tx_update(tx, frame, substream);
-
+        int rtp_hdr_len = 0;
         if (frame->fec_params.type == FEC_NONE) {
-                hdrs_len += (sizeof(video_payload_hdr_t));
                 rtp_hdr_len = sizeof(video_payload_hdr_t);
                 format_video_header(frame, substream, tx->buffer, rtp_hdr);
         } else {
-                hdrs_len += (sizeof(fec_payload_hdr_t));
                 rtp_hdr_len = sizeof(fec_payload_hdr_t);
                 uint32_t tmp = substream << 22;
                 tmp |= 0x3fffff & tx->buffer;
@@ -668,34 +1111,34 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
         }
 
         if (tx->encryption) {
-                hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
                 rtp_hdr[rtp_hdr_len / sizeof(uint32_t)] = htonl(DEFAULT_CIPHER_MODE << 24);
-                rtp_hdr_len += sizeof(crypto_payload_hdr_t);
         }
+}
 
-        vector<int> packet_sizes = get_packet_sizes(frame, substream, tx->mtu - hdrs_len);
-        long packet_count = packet_sizes.size() * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
-
-        long packet_rate = get_packet_rate(tx, frame, substream, packet_count);
-
-        // initialize header array with values (except offset which is different among
-        // different packts)
-        void *rtp_headers = malloc(packet_count * rtp_hdr_len);
-        uint32_t *rtp_hdr_packet = (uint32_t *) rtp_headers;
-        for (int i = 0; i < packet_count; ++i) {
-                memcpy(rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
-                rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
-        }
-        rtp_hdr_packet = (uint32_t *) rtp_headers;
+/**
+ * Lays out packets of one tile. M-bit of the packets is set at the end of
+ * the tile data (of each copy with FEC mult), tx_interleave_tiles() then
+ * decides which of them keep it.
+ *
+ * @param[in,out] rtp_hdr_packet  next free header in the header array
+ */
+static void
+tx_layout_tile(struct tx *tx, struct video_frame *frame, unsigned int substream,
+                vector<int> const &packet_sizes, int rtp_hdr_len,
+                uint32_t **rtp_hdr_packet, vector<tx_packet> *packets)
+{
+        struct tile *tile = &frame->tiles[substream];
+        const int fragment_offset = frame->fragment ? tile->offset : 0;
+        array <int, FEC_MAX_MULT> mult_pos{};
+        int mult_index = 0;
+        uint32_t rtp_hdr[100];
 
-        if (!tx->encryption) {
-                rtp_async_start(rtp_session, packet_count);
-        }
+        tx_update(tx, frame, substream);
+        format_tile_header(tx, frame, substream, rtp_hdr);
 
         int packet_idx = 0;
         unsigned pos = 0;
         do {
-                GET_STARTTIME;
                 int m = 0;
                 if(tx->fec_scheme == FEC_MULT) {
                         pos = mult_pos[mult_index];
@@ -703,45 +1146,18 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
 
                 int offset = pos + fragment_offset;
 
-                rtp_hdr_packet[1] = htonl(offset);
+                memcpy(*rtp_hdr_packet, rtp_hdr, rtp_hdr_len);
+                (*rtp_hdr_packet)[1] = htonl(offset);
 
                 char *data = tile->data + pos;
-                data_len = packet_sizes.at(packet_idx);
+                int data_len = packet_sizes.at(packet_idx);
                 if (pos + data_len >= (unsigned int) tile->data_len) {
-                        if (send_m) {
-                                m = 1;
-                        }
+                        m = 1;
                         data_len = tile->data_len - pos;
                 }
                 pos += data_len;
                 if(data_len) { /* check needed for FEC_MULT */
-                        char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
-
-                        if (tx->encryption) {
-                                data_len = tx->enc_funcs->encrypt(tx->encryption,
-                                                data, data_len,
-                                                (char *) rtp_hdr_packet,
-                                                frame->fec_params.type != FEC_NONE ? sizeof(fec_payload_hdr_t) :
-                                                sizeof(video_payload_hdr_t),
-                                                encrypted_data);
-                                data = encrypted_data;
-                        }
-
-                        if (control_stats_enabled(tx->control)) {
-                                auto current_time_ms = time_since_epoch_in_ms();
-                                if(current_time_ms - tx->last_stat_report >= CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS){
-                                        std::ostringstream oss;
-                                        oss << "tx_send " << std::hex << rtp_my_ssrc(rtp_session) << std::dec << " video " << tx->sent_since_report;
-                                        control_report_stats(tx->control, oss.str());
-                                        tx->last_stat_report = current_time_ms;
-                                        tx->sent_since_report = 0;
-                                }
-                                tx->sent_since_report += data_len + rtp_hdr_len;
-                        }
-
-                        rtp_send_data_hdr(rtp_session, ts, pt, m, 0, 0,
-                                  (char *) rtp_hdr_packet, rtp_hdr_len,
-                                  data, data_len, 0, 0, 0);
+                        packets->push_back({data, data_len, *rtp_hdr_packet, m, substream});
                 }
 
                 if (mult_index + 1 == tx->mult_count) {
@@ -753,22 +1169,170 @@ tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
                         mult_index = (mult_index + 1) % tx->mult_count;
                 }
 
-                rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
+                *rtp_hdr_packet += rtp_hdr_len / sizeof(uint32_t);
+        } while (pos < tile->data_len || mult_index != 0); // when multiplying, we need all streams go to the end
+}
 
-                // TRAFFIC SHAPER
-                if (pos < (unsigned int) tile->data_len) { // wait for all but last packet
-                        do {
-                                GET_STOPTIME;
-                                GET_DELTA;
-                        } while (packet_rate - delta - overslept > 0);
-                        overslept = -(packet_rate - delta - overslept);
-                        //fprintf(stdout, "%ld ", overslept);
+/**
+ * Merges packets of the tiles so that every tile is spread evenly over the
+ * whole schedule (packet of the tile with the lowest relative position goes
+ * first) - all tiles thus finish at the same time instead of one after
+ * another. M-bit is kept only for the tile ending the frame.
+ */
+static vector<tx_packet>
+tx_interleave_tiles(vector<vector<tx_packet>> &tiles, bool send_m)
+{
+        vector<tx_packet> merged;
+        if (tiles.size() == 1) {
+                merged = std::move(tiles[0]);
+        } else {
+                size_t total = 0;
+                for (auto const &t : tiles) {
+                        total += t.size();
                 }
-        } while (pos < tile->data_len || mult_index != 0); // when multiplying, we need all streams go to the end
+                merged.reserve(total);
+                vector<size_t> next(tiles.size());
+                while (merged.size() < total) {
+                        size_t best = SIZE_MAX;
+                        for (size_t i = 0; i < tiles.size(); ++i) {
+                                if (next[i] == tiles[i].size()) {
+                                        continue;
+                                }
+                                if (best == SIZE_MAX || (next[i] + 1) * tiles[best].size() <
+                                                (next[best] + 1) * tiles[i].size()) {
+                                        best = i;
+                                }
+                        }
+                        merged.push_back(tiles[best][next[best]++]);
+                }
+        }
+        if (merged.empty()) {
+                return merged;
+        }
+        const unsigned last_tile = merged.back().tile;
+        for (auto &p : merged) {
+                p.m = send_m && p.m && p.tile == last_tile;
+        }
+        return merged;
+}
+
+/**
+ * Sends tiles [first_tile, first_tile + tile_count) of the frame. Packets of
+ * the tiles are interleaved and paced as a single schedule spanning the
+ * time share of the tiles in the frame interval.
+ */
+static void
+tx_send_base(struct tx *tx, struct video_frame *frame, struct rtp *rtp_session,
+                uint32_t ts, int send_m,
+                unsigned int first_tile, unsigned int tile_count)
+{
+        if (!rtp_has_receiver(rtp_session)) {
+                return;
+        }
+
+        int rtp_hdr_len;
+        int pt = fec_pt_from_fec_type(TX_MEDIA_VIDEO, frame->fec_params.type, tx->encryption);            /* A value specified in our packet format */
+
+        int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12 + tx_hdrext_len(tx); // IP hdr size + UDP hdr size + RTP hdr size (+ ext)
+
+        assert(tx->magic == TRANSMIT_MAGIC);
+
+        if (frame->fec_params.type == FEC_NONE) {
+                rtp_hdr_len = sizeof(video_payload_hdr_t);
+        } else {
+                rtp_hdr_len = sizeof(fec_payload_hdr_t);
+        }
+        hdrs_len += rtp_hdr_len;
+
+        if (tx->encryption) {
+                hdrs_len += sizeof(crypto_payload_hdr_t) + tx->enc_funcs->get_overhead(tx->encryption);
+                rtp_hdr_len += sizeof(crypto_payload_hdr_t);
+        }
+
+        vector<vector<int>> packet_sizes(tile_count);
+        long packet_count = 0;
+        long data_len = 0;
+        for (unsigned int i = 0; i < tile_count; ++i) {
+                packet_sizes[i] = get_packet_sizes(frame, first_tile + i, tx->mtu - hdrs_len);
+                packet_count += packet_sizes[i].size() * (tx->fec_scheme == FEC_MULT ? tx->mult_count : 1);
+                data_len += frame->tiles[first_tile + i].data_len;
+        }
+
+        long packet_rate = get_packet_rate(tx, frame, tile_count, data_len, packet_count);
+
+        // lay out the packets first so that they can be encrypted in one batch
+        void *rtp_headers = malloc(packet_count * rtp_hdr_len);
+        uint32_t *rtp_hdr_packet = (uint32_t *) rtp_headers;
+        vector<vector<tx_packet>> tile_packets(tile_count);
+        for (unsigned int i = 0; i < tile_count; ++i) {
+                tile_packets[i].reserve(packet_sizes[i].size() * tx->mult_count);
+                tx_layout_tile(tx, frame, first_tile + i, packet_sizes[i], rtp_hdr_len,
+                                &rtp_hdr_packet, &tile_packets[i]);
+        }
+        vector<tx_packet> packets = tx_interleave_tiles(tile_packets, send_m);
+
+        if (tx->encryption) {
+                // tile data may be shared (or sent multiple times), so encrypt
+                // to a persistent buffer instead of in place
+                size_t enc_len = 0;
+                for (auto const &p : packets) {
+                        enc_len += p.data_len + MAX_CRYPTO_EXCEED;
+                }
+                if (tx->enc_buf_len < enc_len) {
+                        free(tx->enc_buf);
+                        tx->enc_buf = (char *) malloc(enc_len);
+                        tx->enc_buf_len = enc_len;
+                }
+                vector<openssl_encrypt_block> blocks(packets.size());
+                char *enc_data = tx->enc_buf;
+                const int aad_len = frame->fec_params.type != FEC_NONE ? sizeof(fec_payload_hdr_t) :
+                        sizeof(video_payload_hdr_t);
+                for (size_t i = 0; i < packets.size(); ++i) {
+                        blocks[i] = { packets[i].data, packets[i].data_len, (char *) packets[i].rtp_hdr,
+                                aad_len, enc_data, 0 };
+                        enc_data += packets[i].data_len + MAX_CRYPTO_EXCEED;
+                }
+                int encrypted = tx->enc_funcs->encrypt_batch(tx->encryption, blocks.data(), blocks.size());
+                if (encrypted != (int) blocks.size()) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Encryption failed, dropping frame!\n";
+                        free(rtp_headers);
+                        return;
+                }
+                for (size_t i = 0; i < packets.size(); ++i) {
+                        packets[i].data = blocks[i].ciphertext;
+                        packets[i].data_len = blocks[i].ciphertext_len;
+                }
+        }
 
-        if (!tx->encryption) {
-                rtp_async_wait(rtp_session);
+        size_t batch_bytes = 0;
+        for (auto const &p : packets) {
+                batch_bytes += p.data_len + rtp_hdr_len;
         }
+        tx_update_sent_stats(tx, rtp_session, "video", batch_bytes);
+
+        uint32_t ext_buf[RTP_HDREXT_ABS_CAPTURE_TIME_WORDS];
+        char *ext = tx_get_capture_time_ext(tx, frame, ext_buf);
+
+        tx_prio_apply(tx, rtp_session);
+        rtp_async_start(rtp_session, packets.size());
+        pacer_start(&tx->pacer, rtp_session, packet_rate);
+
+        for (size_t sent_idx = 0; sent_idx < packets.size(); ++sent_idx) {
+                tx_packet const &p = packets[sent_idx];
+                pacer_before_send(&tx->pacer, rtp_session, sent_idx);
+                rtp_send_data_hdr(rtp_session, ts, pt, p.m, 0, 0,
+                                (char *) p.rtp_hdr, rtp_hdr_len,
+                                p.data, p.data_len, ext, ext ? RTP_HDREXT_ABS_CAPTURE_TIME_WORDS : 0,
+                                RTP_HDREXT_ONE_BYTE);
+
+                // TRAFFIC SHAPER
+                if (sent_idx + 1 < packets.size()) { // wait for all but last packet
+                        pacer_wait(&tx->pacer, sent_idx);
+                }
+        }
+
+        rtp_async_wait(rtp_session);
+        pacer_done(&tx->pacer, rtp_session);
         free(rtp_headers);
 }
 
@@ -784,31 +1348,34 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
 
         int pt = fec_pt_from_fec_type(TX_MEDIA_AUDIO, buffer->get_fec_params(0).type, tx->encryption); /* PT set for audio in our packet format */
         unsigned m = 0u;
-        const char *chan_data;
         // see definition in rtp_callback.h
         uint32_t rtp_hdr[100];
-        uint32_t timestamp;
-#ifdef HAVE_LINUX
-        struct timespec start, stop;
-#elif defined HAVE_MACOSX
-        struct timeval start, stop;
-#else // Windows
-	LARGE_INTEGER start, stop, freq;
-#endif
-        long delta;
+        int rtp_hdr_len = 0;
         int mult_first_sent = 0;
 
         fec_check_messages(tx);
 
-        timestamp = get_local_mediatime();
+        uint32_t timestamp = get_local_mediatime();
+
+        // packets of all channels are laid out first so that they can be
+        // encrypted and sent in one batch (sendmmsg() if udp-send-batch)
+        struct tx_packet {
+                const char *data;
+                int data_len;
+                size_t hdr_idx; ///< index to hdrs
+                unsigned m;
+        };
+        thread_local vector<tx_packet> packets;
+        thread_local vector<uint32_t> hdrs;
+        packets.clear();
+        hdrs.clear();
 
         for (int channel = 0; channel < buffer->get_channel_count(); ++channel)
         {
-                int rtp_hdr_len = 0;
                 int hdrs_len = (rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12; // MTU - IP hdr - UDP hdr - RTP hdr - payload_hdr
                 unsigned int fec_symbol_size = buffer->get_fec_params(channel).symbol_size;
 
-                chan_data = buffer->get_data(channel);
+                const char *chan_data = buffer->get_data(channel);
                 unsigned pos = 0u;
 
                 array <int, FEC_MAX_MULT> mult_pos{};
@@ -843,36 +1410,6 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                         check_symbol_size(fec_symbol_size, tx->mtu - hdrs_len);
                 }
 
-                int packet_rate = 0;
-#if 0
-                if (tx->bitrate > 0) {
-                        //packet_rate = 1000ll * 1000 * 1000 * tx->mtu * 8 / tx->bitrate;
-			packet_rate = 0;
-                } else if (tx->bitrate == RATE_UNLIMITED) {
-                        packet_rate = 0;
-                } else if (tx->bitrate == RATE_AUTO || tx->bitrate == RATE_DYNAMIC) {
-                        /**
-                         * @todo
-                         * Following code would actually work but seems to be useless in most of cases (eg.
-                         * PCM 2 channels 2 Bps takes 5 std. Eth frames). On the other hand it could cause
-                         * unexpectable problems (I'd write them here but if I'd expect them they wouldn't
-                         * be unexpectable.)
-                         */
-                        double time_for_frame = buffer->get_duration() / buffer->get_channel_count();
-                        if (time_for_frame > 0.0) {
-                                long long req_bitrate = buffer->get_data_len(channel) * 8 / time_for_frame * tx->mult_count;
-                                // adjust computed value to 3
-                                req_bitrate = req_bitrate * 3;
-                                packet_rate = compute_packet_rate(req_bitrate, tx->mtu);
-                        } else {
-                                packet_rate = 0;
-                        }
-                        packet_rate = 0;
-                } else {
-                        abort();
-                }
-#endif
-
                 do {
                         if(tx->fec_scheme == FEC_MULT) {
                                 pos = mult_pos[mult_index];
@@ -887,37 +1424,10 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                         }
                         rtp_hdr[1] = htonl(pos);
                         pos += data_len;
-                        
-                        GET_STARTTIME;
-                        
-                        if(data_len) { /* check needed for FEC_MULT */
-                                char encrypted_data[data_len + MAX_CRYPTO_EXCEED];
-                                if(tx->encryption) {
-                                        data_len = tx->enc_funcs->encrypt(tx->encryption,
-                                                        const_cast<char *>(data), data_len,
-                                                        (char *) rtp_hdr, rtp_hdr_len - sizeof(crypto_payload_hdr_t),
-                                                        encrypted_data);
-                                        data = encrypted_data;
-                                }
-
-                                if (control_stats_enabled(tx->control)) {
-                                        auto current_time_ms = time_since_epoch_in_ms();
-                                        if(current_time_ms - tx->last_stat_report >= CONTROL_PORT_BANDWIDTH_REPORT_INTERVAL_MS){
-                                                std::ostringstream oss;
-                                                oss << "tx_send " << std::hex << rtp_my_ssrc(rtp_session) << std::dec << " audio " << tx->sent_since_report;
-                                                control_report_stats(tx->control, oss.str());
-                                                tx->last_stat_report = current_time_ms;
-                                                tx->sent_since_report = 0;
-                                        }
-                                        tx->sent_since_report += data_len + rtp_hdr_len;
-                                }
 
-
-                                rtp_send_data_hdr(rtp_session, timestamp, pt, m, 0,        /* contributing sources */
-                                      0,        /* contributing sources length */
-                                      (char *) rtp_hdr, rtp_hdr_len,
-                                      const_cast<char *>(data), data_len,
-                                      0, 0, 0);
+                        if(data_len) { /* check needed for FEC_MULT */
+                                packets.push_back({data, data_len, hdrs.size(), m});
+                                hdrs.insert(hdrs.end(), rtp_hdr, rtp_hdr + rtp_hdr_len / sizeof(uint32_t));
                         }
 
                         if(tx->fec_scheme == FEC_MULT) {
@@ -927,24 +1437,66 @@ void audio_tx_send(struct tx* tx, struct rtp *rtp_session, const audio_frame2 *
                                                 mult_index = (mult_index + 1) % tx->mult_count;
                         }
 
-                        if (pos < buffer->get_data_len(channel)) {
-                                do {
-                                        GET_STOPTIME;
-                                        GET_DELTA;
-                                        if (delta < 0)
-                                                delta += 1000000000L;
-                                } while (packet_rate - delta > 0);
-                        }
-
                         /* when trippling, we need all streams goes to end */
                         if(tx->fec_scheme == FEC_MULT) {
                                 pos = mult_pos[tx->mult_count - 1];
                         }
-
-                      
                 } while (pos < buffer->get_data_len(channel));
         }
 
+        if (tx->encryption) {
+                size_t enc_len = 0;
+                for (auto const &p : packets) {
+                        enc_len += p.data_len + MAX_CRYPTO_EXCEED;
+                }
+                if (tx->enc_buf_len < enc_len) {
+                        free(tx->enc_buf);
+                        tx->enc_buf = (char *) malloc(enc_len);
+                        tx->enc_buf_len = enc_len;
+                }
+                vector<openssl_encrypt_block> blocks(packets.size());
+                char *enc_data = tx->enc_buf;
+                for (size_t i = 0; i < packets.size(); ++i) {
+                        blocks[i] = { const_cast<char *>(packets[i].data), packets[i].data_len,
+                                (char *) &hdrs[packets[i].hdr_idx], (int) (rtp_hdr_len - sizeof(crypto_payload_hdr_t)),
+                                enc_data, 0 };
+                        enc_data += packets[i].data_len + MAX_CRYPTO_EXCEED;
+                }
+                int encrypted = tx->enc_funcs->encrypt_batch(tx->encryption, blocks.data(), blocks.size());
+                if (encrypted != (int) blocks.size()) {
+                        LOG(LOG_LEVEL_ERROR) << MOD_NAME "Audio encryption failed, dropping frame!\n";
+                        tx->buffer ++;
+                        return;
+                }
+                for (size_t i = 0; i < packets.size(); ++i) {
+                        packets[i].data = blocks[i].ciphertext;
+                        packets[i].data_len = blocks[i].ciphertext_len;
+                }
+        }
+
+        size_t batch_bytes = 0;
+        for (auto const &p : packets) {
+                batch_bytes += p.data_len + rtp_hdr_len;
+        }
+        tx_update_sent_stats(tx, rtp_session, "audio", batch_bytes);
+
+        tx_prio_apply(tx, rtp_session);
+        if (tx->prio.enabled) {
+                tx_sched_urgent_begin();
+        }
+        rtp_async_start(rtp_session, packets.size());
+        for (auto const &p : packets) {
+                rtp_send_data_hdr(rtp_session, timestamp, pt, p.m, 0,        /* contributing sources */
+                                0,        /* contributing sources length */
+                                (char *) &hdrs[p.hdr_idx], rtp_hdr_len,
+                                const_cast<char *>(p.data), p.data_len,
+                                0, 0, 0);
+        }
+        rtp_async_wait(rtp_session);
+        if (tx->prio.enabled) {
+                tx_sched_urgent_end();
+        }
+
         tx->buffer ++;
 }
 
@@ -1020,125 +1572,215 @@ void audio_tx_send_standard(struct tx* tx, struct rtp *rtp_session,
                 rtp_send_ctrl(rtp_session, ts_prev, 0, get_time_in_ns()); //send RTCP SR
                 ts_prev = ts;
                 // Send the packet
+                tx_prio_apply(tx, rtp_session);
+                if (tx->prio.enabled) {
+                        tx_sched_urgent_begin();
+                }
                 rtp_send_data(rtp_session, ts, pt, 0, 0, /* contributing sources 		*/
                                 0, 												/* contributing sources length 	*/
                                 tx->tmp_packet, pkt_len, 0, 0, 0);
+                if (tx->prio.enabled) {
+                        tx_sched_urgent_end();
+                }
                 pos += pkt_len;
 	} while (pos < data_len);
 }
 
 /**
- *  H.264 standard transmission
+ * One packet of the H.264 (RFC 6184) or HEVC (RFC 7798) standard
+ * transmission - payload header of an aggregation or fragmentation unit
+ * (if any) followed by the data.
+ */
+struct h26x_packet {
+        unsigned char hdr[3];
+        int hdr_len;
+        const char *data;
+        int data_len;
+        int m;
+};
+
+/**
+ * Lays out the NAL units of the tile to RTP packets - NAL units not fitting
+ * to max_payload are fragmented (FU-A/FU), consecutive small ones are
+ * aggregated (STAP-A/AP) to agg_buf, which must be at least tile->data_len
+ * long (an aggregated NAL unit is not longer than with its start code).
+ */
+static vector<h26x_packet> h26x_packetize(const struct tile *tile, bool hevc, int max_payload,
+                bool set_m, char *agg_buf)
+{
+        const int nal_hdr_len = hevc ? 2 : 1;
+        const int fu_hdr_len = nal_hdr_len + 1;
+        const auto *start = (const unsigned char *) tile->data;
+        vector<std::pair<const unsigned char *, int>> nals;
+        const unsigned char *endptr = nullptr;
+        const unsigned char *nal = start;
+        while ((nal = rtpenc_h264_get_next_nal(nal, tile->data_len - (nal - start), &endptr))) {
+                if (endptr - nal > nal_hdr_len) {
+                        nals.emplace_back(nal, endptr - nal);
+                }
+        }
+        if (endptr != start + tile->data_len) {
+                error_msg("No NAL found!\n");
+        }
+
+        vector<h26x_packet> packets;
+        for (size_t i = 0; i < nals.size(); ) {
+                const unsigned char *nal = nals[i].first;
+                int nal_len = nals[i].second;
+                if (nal_len > max_payload) { // fragmentation unit
+                        unsigned char fu_hdr[3];
+                        if (hevc) {
+                                fu_hdr[0] = (nal[0] & 0x81) | 49 << 1; // PayloadHdr - F, type FU, LayerId
+                                fu_hdr[1] = nal[1]; // LayerId, TID
+                                fu_hdr[2] = (nal[0] >> 1) & 0x3F; // FU header - type
+                        } else {
+                                fu_hdr[0] = (nal[0] & 0xE0) | 28; // FU indicator - F, NRI, type FU-A
+                                fu_hdr[1] = nal[0] & 0x1F; // FU header - type
+                        }
+                        for (int pos = nal_hdr_len; pos < nal_len; ) {
+                                h26x_packet p{};
+                                memcpy(p.hdr, fu_hdr, fu_hdr_len);
+                                p.hdr_len = fu_hdr_len;
+                                p.data = (const char *) nal + pos;
+                                p.data_len = std::min(max_payload - fu_hdr_len, nal_len - pos);
+                                if (pos == nal_hdr_len) {
+                                        p.hdr[fu_hdr_len - 1] |= 0x80; // S
+                                }
+                                pos += p.data_len;
+                                if (pos == nal_len) {
+                                        p.hdr[fu_hdr_len - 1] |= 0x40; // E
+                                }
+                                packets.push_back(p);
+                        }
+                        i += 1;
+                        continue;
+                }
+                size_t j = i;
+                int agg_len = nal_hdr_len;
+                while (j < nals.size() && agg_len + 2 + nals[j].second <= max_payload) {
+                        agg_len += 2 + nals[j].second;
+                        j += 1;
+                }
+                if (j - i < 2) { // single NAL unit packet
+                        packets.push_back({{}, 0, (const char *) nal, nal_len, 0});
+                        i += 1;
+                        continue;
+                }
+                // aggregation packet - payload header has the highest NRI (H.264) or
+                // the lowest LayerId and TID (HEVC) of the aggregated units
+                unsigned char *out = (unsigned char *) agg_buf;
+                unsigned char *wr = out + nal_hdr_len;
+                int f = 0;
+                int nri = 0;
+                int layer_id = 63;
+                int tid = 7;
+                for (; i < j; ++i) {
+                        const unsigned char *n = nals[i].first;
+                        const int len = nals[i].second;
+                        f |= n[0] & 0x80;
+                        nri = std::max(nri, n[0] & 0x60);
+                        if (hevc) {
+                                layer_id = std::min(layer_id, (n[0] & 0x01) << 5 | n[1] >> 3);
+                                tid = std::min(tid, n[1] & 0x07);
+                        }
+                        *wr++ = len >> 8;
+                        *wr++ = len & 0xFF;
+                        memcpy(wr, n, len);
+                        wr += len;
+                }
+                if (hevc) {
+                        out[0] = f | 48 << 1 | layer_id >> 5; // PayloadHdr - type AP
+                        out[1] = (layer_id & 0x1F) << 3 | tid;
+                } else {
+                        out[0] = f | nri | 24; // STAP-A
+                }
+                packets.push_back({{}, 0, agg_buf, agg_len, 0});
+                agg_buf += agg_len;
+        }
+        if (set_m && !packets.empty()) {
+                packets.back().m = 1;
+        }
+        return packets;
+}
+
+/**
+ * H.264 (RFC 6184) and HEVC (RFC 7798) standard transmission
+ *
+ * Packets are paced the same way as with tx_send_base().
  */
 void tx_send_h264(struct tx *tx, struct video_frame *frame,
 		struct rtp *rtp_session) {
+        tx_send_h264_multi(tx, frame, &rtp_session, 1);
+}
+
+/**
+ * Sends the frame to all sessions (eg. RTSP clients) - the frame is
+ * packetized only once and each packet is sent to all sessions within the
+ * same pacing slot, so that every session receives identically paced
+ * stream. Each session has its own RTP sequence numbers, SSRC and RTCP.
+ */
+void tx_send_h264_multi(struct tx *tx, struct video_frame *frame,
+		struct rtp **sessions, int session_count) {
+        if (session_count == 0) {
+                return;
+        }
+        struct rtp *rtp_session = sessions[0];
         assert(frame->tile_count == 1); // std transmit doesn't handle more than one tile
         assert(!frame->fragment || tx->fec_scheme == FEC_NONE); // currently no support for FEC with fragments
         assert(!frame->fragment || frame->tile_count); // multiple tiles are not currently supported for fragmented send
-        uint32_t ts = get_std_video_local_mediatime();
+        // a fragment carries whole NAL units (eg. slices sent as soon as
+        // encoded) - keep the TS of the frame and set M-bit only in the last one
+        uint32_t ts = get_fragment_ts(tx, frame, get_std_video_local_mediatime());
+        const bool last_fragment = !frame->fragment || frame->last_fragment;
         struct tile *tile = &frame->tiles[0];
+        const char pt = PT_DynRTP_Type96;
+        const int max_payload = tx->mtu - ((rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12) - tx_hdrext_len(tx); // IP hdr size + UDP hdr size + RTP hdr size (+ ext)
 
-	char pt =  PT_DynRTP_Type96;
-	unsigned char hdr[2];
-	int cc = 0;
-	uint32_t csrc = 0;
-	int m = 0;
-	char *extn = 0;
-	uint16_t extn_len = 0;
-	uint16_t extn_type = 0;
-	const uint8_t *start = (uint8_t *) tile->data;
-	int data_len = tile->data_len;
-	unsigned maxPacketSize = tx->mtu - 40;
-
-        const unsigned char *endptr = 0;
-        const unsigned char *nal = start;
+        if (tx->agg_buf_len < tile->data_len) {
+                free(tx->agg_buf);
+                tx->agg_buf = (char *) malloc(tile->data_len);
+                tx->agg_buf_len = tile->data_len;
+        }
+        vector<h26x_packet> packets = h26x_packetize(tile, frame->color_spec == H265, max_payload,
+                        last_fragment, tx->agg_buf);
+        if (packets.empty()) {
+                return;
+        }
 
-        while ((nal = rtpenc_h264_get_next_nal(nal, data_len - (nal - start), &endptr))) {
-                unsigned int nalsize = endptr - nal;
-                bool eof = endptr == start + data_len;
-                bool lastNALUnitFragment = false; // by default
-                unsigned curNALOffset = 0;
-                char *nalc = const_cast<char *>(reinterpret_cast<const char *>(nal));
-
-		while(!lastNALUnitFragment){
-			// We have NAL unit data in the buffer.  There are three cases to consider:
-			// 1. There is a new NAL unit in the buffer, and it's small enough to deliver
-			//    to the RTP sink (as is).
-			// 2. There is a new NAL unit in the buffer, but it's too large to deliver to
-			//    the RTP sink in its entirety.  Deliver the first fragment of this data,
-			//    as a FU packet, with one extra preceding header byte (for the "FU header").
-			// 3. There is a NAL unit in the buffer, and we've already delivered some
-			//    fragment(s) of this.  Deliver the next fragment of this data,
-			//    as a FU packet, with two (H.264) extra preceding header bytes
-			//    (for the "NAL header" and the "FU header").
-			if (curNALOffset == 0) { // case 1 or 2
-				if (nalsize	<= maxPacketSize) { // case 1
-
-					if (eof) m = 1;
-					if (rtp_send_data(rtp_session, ts, pt, m, cc, &csrc,
-							nalc, nalsize,
-							extn, extn_len, extn_type) < 0) {
-						error_msg("There was a problem sending the RTP packet\n");
-					}
-					lastNALUnitFragment = true;
-				} else { // case 2
-					// We need to send the NAL unit data as FU packets.  Deliver the first
-					// packet now.  Note that we add "NAL header" and "FU header" bytes to the front
-					// of the packet (overwriting the existing "NAL header").
-					hdr[0] = (nal[0] & 0xE0) | 28; //FU indicator
-					hdr[1] = 0x80 | (nal[0] & 0x1F); // FU header (with S bit)
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + 1, maxPacketSize - 2,
-									extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					curNALOffset += maxPacketSize - 1;
-					lastNALUnitFragment = false;
-					nalsize -= maxPacketSize - 1;
-				}
-			} else { // case 3
-				// We are sending this NAL unit data as FU packets.  We've already sent the
-				// first packet (fragment).  Now, send the next fragment.  Note that we add
-				// "NAL header" and "FU header" bytes to the front.  (We reuse these bytes that
-				// we already sent for the first fragment, but clear the S bit, and add the E
-				// bit if this is the last fragment.)
-				hdr[1] = hdr[1] & ~0x80;// FU header (no S bit)
-
-				if (nalsize + 1 > maxPacketSize) {
-					// We can't send all of the remaining data this time:
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-							(char *) hdr, 2,
-							nalc + curNALOffset,
-							maxPacketSize - 2, extn, extn_len,
-							extn_type) < 0) {
-								error_msg("There was a problem sending the RTP packet\n");
-					}
-					curNALOffset += maxPacketSize - 2;
-					lastNALUnitFragment = false;
-					nalsize -= maxPacketSize - 2;
-
-				} else {
-					// This is the last fragment:
-					if (eof) m = 1;
-
-					hdr[1] |= 0x40;// set the E bit in the FU header
-
-					if (rtp_send_data_hdr(rtp_session, ts, pt, m, cc, &csrc,
-									(char *) hdr, 2,
-									nalc + curNALOffset,
-									nalsize, extn, extn_len, extn_type) < 0) {
-										error_msg("There was a problem sending the RTP packet\n");
-					}
-					lastNALUnitFragment = true;
-				}
-			}
-		}
-	}
-        if (endptr != start + data_len) {
-                error_msg("No NAL found!\n");
+        if (session_count > 1 && tx->pacer.mode == TX_PACING_TXTIME) {
+                // the schedule is kept for one socket only
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "SO_TXTIME pacing not supported with multiple receivers, "
+                                "falling back to sleep.\n");
+                tx->pacer.mode = TX_PACING_SLEEP;
+        }
+
+        uint32_t ext_buf[RTP_HDREXT_ABS_CAPTURE_TIME_WORDS];
+        char *ext = tx_get_capture_time_ext(tx, frame, ext_buf);
+
+        for (int s = 0; s < session_count; ++s) {
+                tx_prio_apply(tx, sessions[s]);
+                rtp_async_start(sessions[s], packets.size());
+        }
+        pacer_start(&tx->pacer, rtp_session, get_packet_rate(tx, frame, 1, tile->data_len, packets.size()));
+        for (size_t i = 0; i < packets.size(); ++i) {
+                h26x_packet const &p = packets[i];
+                pacer_before_send(&tx->pacer, rtp_session, i);
+                for (int s = 0; s < session_count; ++s) {
+                        if (rtp_send_data_hdr(sessions[s], ts, pt, p.m, 0, nullptr,
+                                                p.hdr_len > 0 ? (char *) p.hdr : nullptr, p.hdr_len,
+                                                (char *) p.data, p.data_len,
+                                                ext, ext ? RTP_HDREXT_ABS_CAPTURE_TIME_WORDS : 0, RTP_HDREXT_ONE_BYTE) < 0) {
+                                error_msg("There was a problem sending the RTP packet\n");
+                        }
+                }
+                if (i + 1 < packets.size()) {
+                        pacer_wait(&tx->pacer, i);
+                }
+        }
+        for (int s = 0; s < session_count; ++s) {
+                rtp_async_wait(sessions[s]);
         }
+        pacer_done(&tx->pacer, rtp_session);
 }
 
 void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
@@ -1185,6 +1827,7 @@ void tx_send_jpeg(struct tx *tx, struct video_frame *frame,
         int bytes_left = tile->data_len - ((char *) d.data - tile->data);
         int max_mtu = tx->mtu - ((rtp_is_ipv6(rtp_session) ? 40 : 20) + 8 + 12); // IP hdr size + UDP hdr size + RTP hdr size
 
+        tx_prio_apply(tx, rtp_session);
         int fragment_offset = 0;
         do {
                 int hdr_len;
@@ -1219,3 +1862,9 @@ int tx_get_buffer_id(struct tx *tx)
 
 }
 
+void tx_set_max_frame_spread(struct tx *tx, int intervals)
+{
+        tx->spread_max = intervals;
+        tx->spread_avg_len = 0;
+}
+
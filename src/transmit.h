@@ -78,6 +78,7 @@ void             format_video_header(struct video_frame *frame, int tile_idx, in
                 uint32_t *hdr);
 
 void tx_send_h264(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
+void tx_send_h264_multi(struct tx *tx_session, struct video_frame *frame, struct rtp **sessions, int session_count);
 void tx_send_jpeg(struct tx *tx_session, struct video_frame *frame, struct rtp *rtp_session);
 
 /**
@@ -85,6 +86,13 @@ void tx_send_jpeg(struct tx *tx_session, struct video_frame *frame, struct rtp *
  */
 int tx_get_buffer_id(struct tx *tx_session);
 
+/**
+ * Allows oversized frames (eg. keyframes) to be paced over up to intervals
+ * frame intervals instead of one. Useful only if the caller doesn't block
+ * the following frames meanwhile (queues them).
+ */
+void tx_set_max_frame_spread(struct tx *tx_session, int intervals);
+
 #ifdef __cplusplus
 }
 #endif
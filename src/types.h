@@ -104,6 +104,8 @@ typedef enum {
         PRORES_422,       ///< Apple ProRes 422
         PRORES_422_PROXY, ///< Apple ProRes 422 (Proxy)
         PRORES_422_LT,    ///< Apple ProRes 422 (LT)
+        HW_VAAPI, ///< VA-API hardware surface (av_frame_wrapper)
+        ULW,      ///< UltraGrid lite wavelet - intra-only slice-based 4:2:2 codec
         VIDEO_CODEC_COUNT, ///< count of known video codecs (including VIDEO_CODEC_NONE)
         VIDEO_CODEC_END = VIDEO_CODEC_COUNT
 } codec_t;
@@ -157,6 +159,18 @@ struct video_desc {
 #endif
 };
 
+/**
+ * Part of an equirectangular (360°) frame rendered by a display, angles in
+ * degrees. Yaw 0 and pitch 0 is the frame center, positive yaw is to the
+ * right, positive pitch up.
+ */
+struct video_viewport {
+        float yaw;
+        float pitch;
+        float fov_h; ///< horizontal field of view
+        float fov_v; ///< vertical field of view
+};
+
 typedef enum frame_type {
     INTRA = 0,
     BFRAME,
@@ -168,6 +182,7 @@ enum fec_type {
         FEC_MULT = 1,
         FEC_LDGM = 2,
         FEC_RS   = 3,
+        FEC_RLC  = 4,
 };
 
 struct fec_desc {
@@ -185,6 +200,7 @@ struct fec_desc {
 };
 
 struct video_frame;
+struct vf_stripes;
 /**
  * @brief Struct containing callbacks of a @ref video_frame
  */
@@ -200,7 +216,8 @@ struct video_frame_callbacks {
          * This function (if defined) is called when frame is no longer needed
          * by processing queue.
          * @note
-         * Currently, this is only used in sending workflow, not the receiving one!
+         * Currently, this is only used in sending workflow, in the receiving
+         * one only for frames passed to displays with DISPLAY_PROPERTY_EXTERNAL_FRAMES.
          * Can be called from arbitrary thread.
          */
         void               (*dispose)(struct video_frame *);
@@ -251,13 +268,22 @@ struct tile {
         /// @brief Fragment offset from tile beginning (in bytes). Used only if frame is fragmented.
         /// @see video_frame::fragment
         unsigned int         offset;
+
+        /// @brief Distance of the lines in bytes if the tile is a view into a larger
+        /// buffer (see vf_split_view()), 0 if the lines are contiguous.
+        /// Only tiles passed to consumers handling it may have it set.
+        /// @see tile_get_linesize()
+        unsigned int         linesize;
 };
 
 #define FLEXIBLE_ARRAY_MEMBER 0
 
 enum mem_location_t {
         CPU_MEM = 0,
-        CUDA_MEM
+        CUDA_MEM,
+        /// tile data is AVFrame * of a hw. surface (with hw_frames_ctx set),
+        /// color_spec is its CPU-memory equivalent, see vf_alloc_lavc_hw_frame()
+        LAVC_HW_MEM,
 };
 
 /**
@@ -284,6 +310,10 @@ struct video_frame {
 
         struct video_frame_callbacks callbacks;
 
+        /// completion of horizontal stripes if the frame is consumed while
+        /// being written (NULL otherwise), see vf_stripes_enable()
+        struct vf_stripes   *stripes;
+
         // metadata follow
 #define VF_METADATA_START fec_params
         struct fec_desc fec_params;
@@ -294,6 +324,7 @@ struct video_frame {
         uint64_t compress_start; ///< in ms from epoch
         uint64_t compress_end; ///< in ms from epoch
         unsigned int paused_play:1;
+        unsigned int frame_capped:1; ///< encoder RC keeps the size within frame interval at nominal bitrate, send it within the interval
 #define VF_METADATA_END tile_count
 
         /// tiles contain actual video frame data. A frame usually contains exactly one
@@ -0,0 +1,178 @@
+/**
+ * @file   utils/alloc_stats.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "host.h"
+#include "utils/alloc_stats.h"
+#include "utils/macros.h"
+
+#define MOD_NAME "[alloc stats] "
+#define MAX_TAGS 32
+#define MAX_TAG_DEPTH 8
+
+struct alloc_tag {
+        char name[32];
+        _Atomic uint64_t count;
+        _Atomic uint64_t bytes;
+};
+
+static struct alloc_tag tags[MAX_TAGS] = { { .name = "other" } };
+static _Atomic int tag_count = 1;
+static pthread_mutex_t tag_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool enabled;
+
+static _Thread_local int tag_stack[MAX_TAG_DEPTH];
+static _Thread_local int tag_depth;
+
+ADD_TO_PARAM("alloc-stats", "* alloc-stats\n"
+                "  Count heap allocations per pipeline stage and report them (per frame) with the pipeline statistics\n");
+
+static inline void account(size_t size)
+{
+        if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+                return;
+        }
+        const int depth = tag_depth;
+        struct alloc_tag *t = &tags[depth > 0 ? tag_stack[MIN(depth, MAX_TAG_DEPTH) - 1] : ALLOC_STATS_OTHER];
+        atomic_fetch_add_explicit(&t->count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&t->bytes, size, memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+        account(size);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+        account(nmemb * size);
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+        account(size);
+        return __libc_realloc(ptr, size);
+}
+#define ALLOC_STATS_SUPPORTED 1
+#else
+#define ALLOC_STATS_SUPPORTED 0
+#endif
+
+bool alloc_stats_enable(bool enable)
+{
+        if (!ALLOC_STATS_SUPPORTED) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Allocation accounting is not supported on this platform.\n");
+                return false;
+        }
+        atomic_store(&enabled, enable);
+        return true;
+}
+
+bool alloc_stats_enabled(void)
+{
+        return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+int alloc_stats_tag(const char *name)
+{
+        pthread_mutex_lock(&tag_lock);
+        const int count = atomic_load(&tag_count);
+        int ret = ALLOC_STATS_OTHER;
+        for (int i = 0; i < count; ++i) {
+                if (strcmp(tags[i].name, name) == 0) {
+                        pthread_mutex_unlock(&tag_lock);
+                        return i;
+                }
+        }
+        if (count < MAX_TAGS) {
+                strncpy(tags[count].name, name, sizeof tags[count].name - 1);
+                atomic_store(&tag_count, count + 1);
+                ret = count;
+        }
+        pthread_mutex_unlock(&tag_lock);
+        return ret;
+}
+
+void alloc_stats_push_tag(int tag)
+{
+        if (tag_depth < MAX_TAG_DEPTH) {
+                tag_stack[tag_depth] = tag;
+        }
+        tag_depth += 1;
+}
+
+void alloc_stats_pop_tag(void)
+{
+        if (tag_depth > 0) {
+                tag_depth -= 1;
+        }
+}
+
+int alloc_stats_tag_count(void)
+{
+        return atomic_load(&tag_count);
+}
+
+const char *alloc_stats_tag_name(int tag)
+{
+        return tags[tag].name;
+}
+
+void alloc_stats_get(int tag, uint64_t *count, uint64_t *bytes)
+{
+        *count = atomic_load_explicit(&tags[tag].count, memory_order_relaxed);
+        *bytes = atomic_load_explicit(&tags[tag].bytes, memory_order_relaxed);
+}
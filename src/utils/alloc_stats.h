@@ -0,0 +1,83 @@
+/**
+ * @file   utils/alloc_stats.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  opt-in accounting of heap allocations per pipeline stage
+ *
+ * When enabled (--param alloc-stats), malloc(), calloc() and realloc() are
+ * counted (number and bytes) to the tag of the calling thread. Tags form a
+ * per-thread stack pushed and popped together with the profiler scopes of
+ * the pipeline stages (see utils/pipeline_stats.h), allocations outside any
+ * tag are accounted as "other". The pipeline statistics then report
+ * allocations per frame of each stage.
+ *
+ * Implemented by interposing the glibc allocator, on other platforms the
+ * counters stay zero.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_ALLOC_STATS_H_8E2D4B71_0C3A_4F5E_A6B9_1D7E3C5A9F02
+#define UTILS_ALLOC_STATS_H_8E2D4B71_0C3A_4F5E_A6B9_1D7E3C5A9F02
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#define ALLOC_STATS_OTHER 0 ///< tag of allocations outside any tagged scope
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// enables or disables the accounting, @retval false if not supported by the platform
+bool        alloc_stats_enable(bool enable);
+bool        alloc_stats_enabled(void);
+/// @returns tag for name (the same name returns the same tag), ALLOC_STATS_OTHER if there are too many tags
+int         alloc_stats_tag(const char *name);
+/// tags allocations of the calling thread until the matching pop
+void        alloc_stats_push_tag(int tag);
+void        alloc_stats_pop_tag(void);
+/// @returns number of registered tags, valid tags are 0..count-1
+int         alloc_stats_tag_count(void);
+const char *alloc_stats_tag_name(int tag);
+/// @param count, bytes totals since the start of the program
+void        alloc_stats_get(int tag, uint64_t *count, uint64_t *bytes);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // defined UTILS_ALLOC_STATS_H_8E2D4B71_0C3A_4F5E_A6B9_1D7E3C5A9F02
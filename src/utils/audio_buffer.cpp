@@ -0,0 +1,347 @@
+/**
+ * @file   utils/audio_buffer.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ *
+ * Single-producer/single-consumer audio buffer. The reader keeps the buffer
+ * occupancy around the requested latency by a PI controller that adjusts the
+ * ratio of the resampler applied to the written data (sender/receiver clock
+ * drift is thus compensated without audible drops). If no resampler is
+ * available (or the sample format isn't supported by it), excessive data are
+ * dropped instead.
+ */
+/*
+ * Copyright (c) 2016-2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "audio/resampler.hpp"
+#include "audio/types.h"
+#include "audio/utils.h"
+#include "debug.h"
+#include "host.h"
+#include "utils/audio_buffer.h"
+#include "utils/ring_buffer.h"
+
+#define MOD_NAME "[audio_buffer] "
+#define WINDOW 50
+
+#define BUF_LAST_UNDERRUN_MAX 1000000000
+#define BUF_LAST_UNDERRUN_THRESHOLD 10000
+#define BUF_LAST_OVERRUN_THRESHOLD 10000
+#define AGGRESSIVITY_MAX 4
+#define AGGRESSIVITY_STEP 100
+
+#define RATE_DEN 1000           ///< denominator of the resampled rate (fits INT_MAX up to 2 MHz)
+#define MAX_CORRECTION 0.002    ///< max relative rate adjustment (~3.5 cents, inaudible)
+#define CORRECTION_STEP 0.000001 ///< quantize the correction to 1 ppm not to reconfigure resampler too often
+#define DRIFT_KP 0.28           ///< [1/s] of the occupancy error (in seconds)
+#define DRIFT_KI 0.04           ///< [1/s^2] - with KP gives ~0.7 damping, 30 s settling
+#define HARD_DROP_FACTOR 2      ///< with resampling, drop data only if exceeding requested latency this many times
+
+using std::atomic;
+using std::clamp;
+using std::max;
+using std::memory_order_relaxed;
+using std::min;
+using std::unique_ptr;
+using std::vector;
+
+static const int occupacy_windows[] = { 50, 200 };
+
+/**
+ * Fields are owned by either the writer or the reader thread, the only shared
+ * ones are atomic (ring buffer is SPSC), so no locking is needed.
+ */
+struct audio_buffer {
+        struct audio_desc desc;
+        ring_buffer_t *ring;
+        int suggested_latency_ms;
+
+        // writer
+        atomic<int> in_pkt_size{0}; ///< moving average (read also by reader)
+        unique_ptr<audio_frame2_resampler> resampler;
+        audio_frame2 remainder; ///< input not consumed by the resampler in previous write
+        vector<char> interleaved;
+
+        // reader
+        int out_pkt_size = 0; ///< moving average
+        int avg_occupancy[2]{}; // at read time
+        int last_underrun = BUF_LAST_UNDERRUN_MAX; // last underrun n output frames ago
+        int last_overrun = 0; // last overrun n output frames ago
+        int aggressivity = 1;
+        int last_aggressivity_change = AGGRESSIVITY_STEP;
+        double drift_integral = 0.0;
+        bool prefilling = true; ///< buffer is being filled to requested latency (after start or underrun)
+
+        atomic<bool> resampling{false}; ///< false if drift is handled by dropping, cleared by writer on error
+        atomic<int> resample_num; ///< output sample rate * RATE_DEN, set by reader, used by writer
+};
+
+static unique_ptr<audio_frame2_resampler> create_resampler(int bps)
+{
+        try {
+                auto resampler = std::make_unique<audio_frame2_resampler>();
+                if (resampler->align_bps(bps) == bps) {
+                        return resampler;
+                }
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Resampler doesn't support %d B samples, dropping excess data to fix drift.\n", bps);
+        } catch (std::exception &e) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot create resampler: %s\n", e.what());
+        }
+        return {};
+}
+
+struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, int suggested_latency_ms)
+{
+        auto *buf = new audio_buffer();
+        buf->desc.sample_rate = sample_rate;
+        buf->desc.bps = bps;
+        buf->desc.ch_count = ch_count;
+        buf->desc.codec = AC_PCM;
+
+        buf->ring = ring_buffer_init(sample_rate * bps * ch_count);
+
+        buf->suggested_latency_ms = suggested_latency_ms;
+
+        buf->resampler = create_resampler(bps);
+        buf->resampling = (bool) buf->resampler;
+        buf->resample_num = sample_rate * RATE_DEN;
+
+        return buf;
+}
+
+void audio_buffer_destroy(struct audio_buffer *buf)
+{
+        if (!buf) {
+                return;
+        }
+        ring_buffer_destroy(buf->ring);
+        delete buf;
+}
+
+/**
+ * PI controller - keeps the occupancy at read time around the requested
+ * latency by setting the rate the written data are resampled to.
+ */
+static void adjust_resample_rate(struct audio_buffer *buf, int read_len, int requested_latency_bytes)
+{
+        const double bytes_per_sec = (double) buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate;
+        double err = (buf->avg_occupancy[0] - requested_latency_bytes) / bytes_per_sec;
+        double dt = read_len / bytes_per_sec;
+        buf->drift_integral = clamp(buf->drift_integral + DRIFT_KI * err * dt, -MAX_CORRECTION, MAX_CORRECTION);
+        double correction = clamp(DRIFT_KP * err + buf->drift_integral, -MAX_CORRECTION, MAX_CORRECTION);
+        correction = round(correction / CORRECTION_STEP) * CORRECTION_STEP;
+        // fuller buffer than requested -> produce less samples
+        int num = (int) llround((double) buf->desc.sample_rate * RATE_DEN * (1.0 - correction));
+        if (num != buf->resample_num.load(memory_order_relaxed)) {
+                buf->resample_num.store(num, memory_order_relaxed);
+                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "drift correction %+.0f ppm (occupancy %d, requested %d)\n",
+                                correction * 1000000, buf->avg_occupancy[0], requested_latency_bytes);
+        }
+}
+
+static void drop(struct audio_buffer *buf, int len_drop, int remaining_bytes, int requested_latency_bytes)
+{
+        len_drop -= len_drop % (buf->desc.bps * buf->desc.ch_count);
+        ring_advance_read_idx(buf->ring, len_drop);
+        buf->last_overrun = 0;
+        log_msg(LOG_LEVEL_VERBOSE, "Dropped audio samples: req latency %d remaining %d dropped %d!\n", requested_latency_bytes, remaining_bytes, len_drop);
+}
+
+/**
+ * The buffer is filled to the requested latency first (and after each
+ * underrun), the drift is then corrected by the resampler. Data are dropped
+ * only on a large excess (eg. burst after network outage).
+ */
+static int read_resampled(struct audio_buffer *buf, char *out, int max_len, int ring_size, int requested_latency_bytes)
+{
+        if (buf->prefilling) {
+                if (ring_size < requested_latency_bytes) {
+                        return 0;
+                }
+                buf->prefilling = false;
+                buf->avg_occupancy[0] = ring_size; // do not let the fill-up wind up the controller
+        }
+        int ret = ring_buffer_read(buf->ring, out, max_len);
+        if (ret < max_len) {
+                buf->prefilling = true;
+                return ret;
+        }
+        adjust_resample_rate(buf, ret, requested_latency_bytes);
+
+        int remaining_bytes = ring_size - ret;
+        if (remaining_bytes > HARD_DROP_FACTOR * requested_latency_bytes) {
+                drop(buf, remaining_bytes - requested_latency_bytes, remaining_bytes, requested_latency_bytes);
+        } else {
+                buf->last_overrun += 1;
+        }
+        return ret;
+}
+
+int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len)
+{
+        if (buf->out_pkt_size > 0) {
+                buf->out_pkt_size = (max_len + (buf->out_pkt_size * (WINDOW-1))) / WINDOW;
+        } else {
+                buf->out_pkt_size = max_len;
+        }
+
+        int ring_size = ring_get_current_size(buf->ring);
+
+        for (unsigned int i = 0; i < sizeof buf->avg_occupancy / sizeof buf->avg_occupancy[0]; ++i) {
+                if (buf->avg_occupancy[i] > 0) {
+                        buf->avg_occupancy[i] = (ring_size + (buf->avg_occupancy[i] * (occupacy_windows[i] -1))) / occupacy_windows[i];
+                } else {
+                        buf->avg_occupancy[i] = ring_size;
+                }
+        }
+
+        // handle underruns
+        if (ring_size < max_len) {
+                buf->last_underrun = 0;
+        } else {
+                if (buf->last_underrun < BUF_LAST_UNDERRUN_MAX) {
+                        buf->last_underrun += 1;
+                }
+        }
+
+        int suggested_latency_bytes = buf->suggested_latency_ms * buf->desc.bps * buf->desc.ch_count * buf->desc.sample_rate / 1000;
+        int in_pkt_size = buf->in_pkt_size.load(memory_order_relaxed);
+        int requested_latency_bytes = max(suggested_latency_bytes, 2*max(in_pkt_size, buf->out_pkt_size));
+
+        if (buf->resampling.load(memory_order_relaxed)) {
+                return read_resampled(buf, out, max_len, ring_size, requested_latency_bytes);
+        }
+
+        int ret = ring_buffer_read(buf->ring, out, max_len);
+        int remaining_bytes = ring_size - ret;
+
+        // fiddle aggressivity
+        if (buf->last_aggressivity_change >= AGGRESSIVITY_STEP) {
+                buf->last_aggressivity_change = 0;
+                if ((buf->avg_occupancy[0] > buf->avg_occupancy[1] && buf->last_underrun > BUF_LAST_UNDERRUN_THRESHOLD / 10) && buf->last_overrun <= BUF_LAST_OVERRUN_THRESHOLD) {
+                        buf->aggressivity = min(buf->aggressivity + 1, AGGRESSIVITY_MAX);
+                } else if (buf->avg_occupancy[0] < buf->avg_occupancy[1] || buf->last_underrun < BUF_LAST_UNDERRUN_THRESHOLD / 100 || buf->last_overrun > BUF_LAST_OVERRUN_THRESHOLD) {
+                        buf->aggressivity = max(buf->aggressivity - 1, 1);
+                }
+        } else {
+                buf->last_aggressivity_change += 1;
+        }
+
+        // handle overruns
+        if (requested_latency_bytes < remaining_bytes) {
+                int len_drop = (1<<buf->aggressivity) * buf->desc.bps * buf->desc.ch_count * 128;
+                drop(buf, min(len_drop, remaining_bytes / 2), remaining_bytes, requested_latency_bytes);
+        } else {
+                buf->last_overrun += 1;
+        }
+
+        log_msg(LOG_LEVEL_DEBUG, "buf - in a. %d, out a. %d, occ. a. [%d,%d] last under/overrun %d, %d aggressivity %d\n", in_pkt_size, buf->out_pkt_size, buf->avg_occupancy[0],buf->avg_occupancy[1], buf->last_underrun, buf->last_overrun, buf->aggressivity);
+
+        return ret;
+}
+
+/// @returns false if resampling failed (data should be written unmodified)
+static bool write_resampled(struct audio_buffer *buf, const char *in, int len)
+{
+        struct audio_frame in_frame{};
+        in_frame.bps = buf->desc.bps;
+        in_frame.sample_rate = buf->desc.sample_rate;
+        in_frame.ch_count = buf->desc.ch_count;
+        in_frame.data = const_cast<char *>(in);
+        in_frame.data_len = len;
+        audio_frame2 frame(&in_frame);
+        if (buf->remainder) {
+                buf->remainder.append(frame);
+                frame = std::move(buf->remainder);
+        }
+
+        int num = buf->resample_num.load(memory_order_relaxed);
+        auto [ret, remainder] = frame.resample_fake(*buf->resampler, num, RATE_DEN);
+        if (!ret) {
+                return false;
+        }
+        buf->remainder = std::move(remainder);
+
+        const int ch_count = buf->desc.ch_count;
+        size_t out_len = frame.get_data_len(0) * ch_count;
+        buf->interleaved.resize(out_len);
+        for (int i = 0; i < ch_count; ++i) {
+                mux_channel(buf->interleaved.data(), frame.get_data(i), buf->desc.bps, frame.get_data_len(0), ch_count, i, 1.0);
+        }
+        ring_buffer_write(buf->ring, buf->interleaved.data(), out_len);
+        return true;
+}
+
+void audio_buffer_write(struct audio_buffer *buf, const char *in, int len)
+{
+        int in_pkt_size = buf->in_pkt_size.load(memory_order_relaxed);
+        if (in_pkt_size > 0) {
+                in_pkt_size = (len + (in_pkt_size * (WINDOW-1))) / WINDOW;
+        } else {
+                in_pkt_size = len;
+        }
+        buf->in_pkt_size.store(in_pkt_size, memory_order_relaxed);
+
+        if (buf->resampling.load(memory_order_relaxed)) {
+                if (write_resampled(buf, in, len)) {
+                        return;
+                }
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Resampling failed, dropping excess data to fix drift.\n");
+                buf->resampling.store(false, memory_order_relaxed);
+        }
+        ring_buffer_write(buf->ring, in, len);
+}
+
+int audio_buffer_get_occupancy(struct audio_buffer *buf)
+{
+        return ring_get_current_size(buf->ring);
+}
+
+struct audio_buffer_api audio_buffer_fns = {
+        (void (*)(void *)) audio_buffer_destroy,
+        (int (*)(void *, char *, int)) audio_buffer_read,
+        (void (*)(void *, const char *, int)) audio_buffer_write,
+};
@@ -49,6 +49,8 @@ struct audio_buffer *audio_buffer_init(int sample_rate, int bps, int ch_count, i
 void audio_buffer_destroy(struct audio_buffer *buf);
 int audio_buffer_read(struct audio_buffer *buf, char *out, int max_len);
 void audio_buffer_write(struct audio_buffer *buf, const char *in, int len);
+/// @returns number of bytes currently buffered, may be called from any thread
+int audio_buffer_get_occupancy(struct audio_buffer *buf);
 
 // used also for ring buffer;
 struct audio_buffer_api {
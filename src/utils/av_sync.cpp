@@ -0,0 +1,147 @@
+/**
+ * @file   utils/av_sync.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <mutex>
+
+#include "debug.h"
+#include "host.h"
+#include "ntp.h"
+#include "utils/av_sync.h"
+
+#define MOD_NAME "[A/V sync] "
+
+using std::lock_guard;
+using std::mutex;
+
+constexpr time_ns_t MEASURE_INTERVAL = NS_IN_SEC; ///< latencies are averaged over this interval
+constexpr time_ns_t SETTLE_TIME = 2 * NS_IN_SEC; ///< time for the buffers to apply the new delay
+constexpr int MIN_SAMPLES = 10; ///< per stream in the measurement interval
+constexpr int THRESHOLD_MS = 10; ///< smaller changes are not applied (the change causes a glitch)
+constexpr int MAX_DELAY_MS = 2000;
+
+ADD_TO_PARAM("av-sync", "* av-sync[=<ms>]\n"
+                "  Synchronize audio with video according to sender capture timestamps (RTCP SR) by delaying\n"
+                "  the stream with lower latency. Overrides the manually set audio delay, optional <ms> is\n"
+                "  added to the computed audio delay (eg. to compensate display latency).\n");
+
+static struct {
+        mutex lock;
+        struct {
+                double latency_sum = 0; ///< present - capture [ns]
+                int count = 0;
+        } media[2];
+        time_ns_t interval_start = 0; ///< may be in the future (settling)
+        bool out_of_range_reported = false;
+} state;
+
+bool av_sync_enabled(void)
+{
+        static const bool enabled = get_commandline_param("av-sync") != nullptr;
+        return enabled;
+}
+
+time_ns_t av_sync_sender_time(uint32_t sr_ntp_sec, uint32_t sr_ntp_frac, uint32_t sr_rtp_ts, uint32_t rtp_ts)
+{
+        return ntp64_to_unix_ns(sr_ntp_sec, sr_ntp_frac) +
+                (int32_t) (rtp_ts - sr_rtp_ts) * NS_IN_SEC / 90000;
+}
+
+/// @returns new audio delay or INT_MIN if it should not be changed
+static int evaluate(int current_delay_ms)
+{
+        auto &audio = state.media[AV_SYNC_AUDIO];
+        auto &video = state.media[AV_SYNC_VIDEO];
+        if (audio.count < MIN_SAMPLES || video.count < MIN_SAMPLES) {
+                return INT_MIN;
+        }
+        double audio_latency_ms = audio.latency_sum / audio.count / NS_IN_MS_DBL;
+        double video_latency_ms = video.latency_sum / video.count / NS_IN_MS_DBL;
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "capture to presentation - audio: %.2f ms, video: %.2f ms\n",
+                        audio_latency_ms, video_latency_ms);
+
+        // measured latencies include the current delay (one of the streams is delayed)
+        int extra_ms = atoi(get_commandline_param("av-sync"));
+        int target = (int) std::lround(video_latency_ms - audio_latency_ms) + current_delay_ms + extra_ms;
+        if (std::abs(target) > MAX_DELAY_MS) {
+                if (!state.out_of_range_reported) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Computed audio delay %d ms is out of range, "
+                                        "are audio and video from the same sender?\n", target);
+                        state.out_of_range_reported = true;
+                }
+                return INT_MIN;
+        }
+        if (std::abs(target - current_delay_ms) < THRESHOLD_MS) {
+                return INT_MIN;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Setting audio delay to %d ms (capture to presentation - "
+                        "audio: %.2f ms, video: %.2f ms).\n", target, audio_latency_ms, video_latency_ms);
+        return target;
+}
+
+void av_sync_report(enum av_sync_media media, time_ns_t capture_time, time_ns_t present_time)
+{
+        if (!av_sync_enabled()) {
+                return;
+        }
+
+        lock_guard<mutex> lk(state.lock);
+        time_ns_t now = get_time_in_ns();
+        if (state.interval_start == 0) {
+                state.interval_start = now;
+        }
+        if (now < state.interval_start) { // waiting for the last change to apply
+                return;
+        }
+        state.media[media].latency_sum += present_time - capture_time;
+        state.media[media].count += 1;
+        if (now - state.interval_start < MEASURE_INTERVAL) {
+                return;
+        }
+
+        int delay = evaluate(get_audio_delay());
+        state.interval_start = now;
+        if (delay != INT_MIN) {
+                set_audio_delay(delay);
+                state.interval_start += SETTLE_TIME;
+        }
+        for (auto &m : state.media) {
+                m = {};
+        }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file   utils/av_sync.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  audio/video synchronization from sender capture timestamps
+ *
+ * Both receivers report, for each presented frame, the sender wall-clock
+ * time of its capture (RTP timestamp mapped with RTCP SR) and the local time
+ * of its presentation. The difference of the two end-to-end latencies is the
+ * A/V skew, which is compensated by delaying (via the playout buffer) only the
+ * stream that arrives earlier, so that the total delay is minimal.
+ *
+ * Sender clock offset cancels out so the clocks need not be synchronized,
+ * but both streams must originate from the same sender.
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_AV_SYNC_H_
+#define UTILS_AV_SYNC_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdint>
+#endif
+
+#include "tv.h" // time_ns_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum av_sync_media {
+        AV_SYNC_AUDIO,
+        AV_SYNC_VIDEO,
+};
+
+/// @returns true if A/V sync is enabled by the user ("--param av-sync")
+bool av_sync_enabled(void);
+
+/**
+ * Converts RTP timestamp (90 kHz) to sender's wall clock with the RTP/NTP
+ * mapping from its last sender report.
+ */
+time_ns_t av_sync_sender_time(uint32_t sr_ntp_sec, uint32_t sr_ntp_frac, uint32_t sr_rtp_ts, uint32_t rtp_ts);
+
+/**
+ * @param capture_time  sender time of the capture, see av_sync_sender_time()
+ * @param present_time  local time when the media is presented (played out)
+ *
+ * Thread-safe, no-op if A/V sync is disabled.
+ */
+void av_sync_report(enum av_sync_media media, time_ns_t capture_time, time_ns_t present_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UTILS_AV_SYNC_H_
@@ -4,6 +4,8 @@
 #include <cuda_runtime.h>
 #include <time.h>
 
+#include "cuda_pix_conv.h"
+
         __global__
 void kern_RGBtoRGBA(unsigned char *dst,
                 size_t dstPitch,
@@ -193,3 +195,385 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
 
         kern_UYVYtoRGBA<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
 }
+
+/*
+ * 10-bit and 12-bit formats and the conversions listed in get_cuda_pix_conv().
+ *
+ * The kernels mirror the line decoders from pixfmt_conv.c so that the result
+ * is the same as if the frame was converted by the CPU. v210 and R12L are
+ * processed per pixel group (6 and 8 pixels respectively), the rest per pixel
+ * or per UYVY pixel pair.
+ */
+
+/// returns i-th 10-bit sample of a v210 pixel group (samples are in UYVY order)
+__device__ static inline unsigned int v210_sample(const uint32_t *group, int i)
+{
+        return (group[i / 3] >> (10 * (i % 3))) & 0x3FFU;
+}
+
+/// returns i-th 12-bit sample of a R12L pixel group (8 pixels in 36 bytes)
+__device__ static inline unsigned int r12l_sample(const unsigned char *group, int i)
+{
+        const int bit_off = 12 * i;
+        const unsigned int val = group[bit_off / 8] | group[bit_off / 8 + 1] << 8;
+        return (val >> (bit_off % 8)) & 0xFFFU;
+}
+
+__global__
+void kern_v210toUYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x; // 6-pixel group
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x * 6 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uint32_t *s = (const uint32_t *) (src + y * srcPitch) + x * 4;
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x * 3;
+
+        for (int i = 0; i < 3 && x * 6 + i * 2 < width; ++i) {
+                dst_px[i] = make_uchar4(v210_sample(s, i * 4) >> 2,
+                                v210_sample(s, i * 4 + 1) >> 2,
+                                v210_sample(s, i * 4 + 2) >> 2,
+                                v210_sample(s, i * 4 + 3) >> 2);
+        }
+}
+
+__global__
+void kern_UYVYtov210(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x; // 6-pixel group
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x * 6 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const unsigned char *s = src + y * srcPitch + x * 12;
+        uint32_t *d = (uint32_t *) (dst + y * dstPitch) + x * 4;
+        const int samples = min(12, (int) (width - x * 6) * 2);
+
+        for (int w = 0; w < 4; ++w) {
+                uint32_t word = 0;
+                for (int i = 0; i < 3; ++i) {
+                        const int idx = w * 3 + i;
+                        if (idx < samples) {
+                                word |= (uint32_t) s[idx] << (10 * i + 2);
+                        }
+                }
+                d[w] = word;
+        }
+}
+
+__global__
+void kern_v210toY416(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x; // 6-pixel group
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x * 6 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uint32_t *s = (const uint32_t *) (src + y * srcPitch) + x * 4;
+        ushort4 *dst_px = (ushort4 *) (dst + y * dstPitch) + x * 6;
+
+        for (int i = 0; i < 6 && x * 6 + i < width; ++i) {
+                const int pair = (i / 2) * 4;
+                dst_px[i] = make_ushort4(v210_sample(s, pair) << 6,
+                                v210_sample(s, pair + 1 + (i % 2) * 2) << 6,
+                                v210_sample(s, pair + 2) << 6,
+                                0xFFFFU);
+        }
+}
+
+__global__
+void kern_Y416toUYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x; // pixel pair
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x * 2 + 1 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const ushort4 *src_px = (const ushort4 *) (src + y * srcPitch) + x * 2;
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x;
+
+        const ushort4 px1 = src_px[0];
+        const ushort4 px2 = src_px[1];
+
+        *dst_px = make_uchar4(((px1.x >> 8) + (px2.x >> 8)) / 2,
+                        px1.y >> 8,
+                        ((px1.z >> 8) + (px2.z >> 8)) / 2,
+                        px2.y >> 8);
+}
+
+__global__
+void kern_R10ktoRGBA(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uchar4 px = *((const uchar4 *) (src + y * srcPitch) + x);
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar4(px.x,
+                        px.y << 2 | px.z >> 6,
+                        px.z << 4 | px.w >> 4,
+                        0xFF);
+}
+
+__global__
+void kern_R10ktoRGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uchar4 px = *((const uchar4 *) (src + y * srcPitch) + x);
+        uchar3 *dst_px = (uchar3 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar3(px.x,
+                        px.y << 2 | px.z >> 6,
+                        px.z << 4 | px.w >> 4);
+}
+
+__global__
+void kern_R10ktoRG48(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const uchar4 px = *((const uchar4 *) (src + y * srcPitch) + x);
+        uint16_t *dst_px = (uint16_t *) (dst + y * dstPitch) + x * 3;
+
+        // R10k is big-endian RRRRRRRR RRGGGGGG GGGGBBBB BBBBBB--
+        const uint32_t val = (uint32_t) px.x << 24 | px.y << 16 | px.z << 8 | px.w;
+        dst_px[0] = ((val >> 22) & 0x3FFU) << 6;
+        dst_px[1] = ((val >> 12) & 0x3FFU) << 6;
+        dst_px[2] = ((val >> 2) & 0x3FFU) << 6;
+}
+
+__global__
+void kern_R12LtoRG48(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const unsigned char *group = src + y * srcPitch + (x / 8) * 36;
+        uint16_t *dst_px = (uint16_t *) (dst + y * dstPitch) + x * 3;
+
+        for (int i = 0; i < 3; ++i) {
+                dst_px[i] = r12l_sample(group, (x % 8) * 3 + i) << 4;
+        }
+}
+
+__global__
+void kern_R12LtoRGB(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x;
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const unsigned char *group = src + y * srcPitch + (x / 8) * 36;
+        uchar3 *dst_px = (uchar3 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar3(r12l_sample(group, (x % 8) * 3) >> 4,
+                        r12l_sample(group, (x % 8) * 3 + 1) >> 4,
+                        r12l_sample(group, (x % 8) * 3 + 2) >> 4);
+}
+
+/**
+ * I420 is expected to be stored contiguously as UG does - Y plane with
+ * srcPitch followed by U and V planes with (srcPitch + 1) / 2 pitch.
+ */
+__global__
+void kern_I420toUYVY(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height)
+{
+        const int x = (blockIdx.x * blockDim.x) + threadIdx.x; // pixel pair
+        const int y = (blockIdx.y * blockDim.y) + threadIdx.y;
+
+        if(x * 2 >= width)
+                return;
+
+        if(y >= height)
+                return;
+
+        const size_t chroma_pitch = (srcPitch + 1) / 2;
+        const unsigned char *src_y = src + y * srcPitch + x * 2;
+        const unsigned char *src_u = src + height * srcPitch + (y / 2) * chroma_pitch + x;
+        const unsigned char *src_v = src_u + ((height + 1) / 2) * chroma_pitch;
+        uchar4 *dst_px = (uchar4 *) (dst + y * dstPitch) + x;
+
+        *dst_px = make_uchar4(*src_u, src_y[0], *src_v, x * 2 + 1 < width ? src_y[1] : src_y[0]);
+}
+
+template<typename kernel_t>
+static void launch_conv(kernel_t kern, size_t threads_per_line,
+                unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                CUstream_st *stream)
+{
+        dim3 blockSize(32,32);
+        dim3 numBlocks((threads_per_line + blockSize.x - 1) / blockSize.x,
+                        (height + blockSize.y - 1) / blockSize.y);
+
+        kern<<<numBlocks, blockSize, 0, stream>>>(dst, dstPitch, src, srcPitch, width, height);
+}
+
+#define DEFINE_CUDA_CONV(in_c, out_c, threads_per_line) \
+void cuda_ ## in_c ## _to_ ## out_c(unsigned char *dst, \
+                size_t dstPitch, \
+                unsigned char *src, \
+                size_t srcPitch, \
+                size_t width, \
+                size_t height, \
+                CUstream_st *stream){ \
+        launch_conv(kern_ ## in_c ## to ## out_c, threads_per_line, dst, dstPitch, src, srcPitch, width, height, stream); \
+}
+
+DEFINE_CUDA_CONV(v210, UYVY, (width + 5) / 6)
+DEFINE_CUDA_CONV(UYVY, v210, (width + 5) / 6)
+DEFINE_CUDA_CONV(v210, Y416, (width + 5) / 6)
+DEFINE_CUDA_CONV(Y416, UYVY, width / 2)
+DEFINE_CUDA_CONV(R10k, RGBA, width)
+DEFINE_CUDA_CONV(R10k, RGB, width)
+DEFINE_CUDA_CONV(R10k, RG48, width)
+DEFINE_CUDA_CONV(R12L, RG48, width)
+DEFINE_CUDA_CONV(R12L, RGB, width)
+DEFINE_CUDA_CONV(I420, UYVY, (width + 1) / 2)
+
+static const struct {
+        codec_t in;
+        codec_t out;
+        cuda_pix_conv_t *conv;
+} cuda_pix_convs[] = {
+        { RGB,  RGBA, cuda_RGB_to_RGBA },
+        { RGBA, RGB,  cuda_RGBA_to_RGB },
+        { RGBA, UYVY, cuda_RGBA_to_UYVY },
+        { UYVY, RGBA, cuda_UYVY_to_RGBA },
+        { v210, UYVY, cuda_v210_to_UYVY },
+        { UYVY, v210, cuda_UYVY_to_v210 },
+        { v210, Y416, cuda_v210_to_Y416 },
+        { Y416, UYVY, cuda_Y416_to_UYVY },
+        { R10k, RGBA, cuda_R10k_to_RGBA },
+        { R10k, RGB,  cuda_R10k_to_RGB },
+        { R10k, RG48, cuda_R10k_to_RG48 },
+        { R12L, RG48, cuda_R12L_to_RG48 },
+        { R12L, RGB,  cuda_R12L_to_RGB },
+        { I420, UYVY, cuda_I420_to_UYVY },
+};
+
+cuda_pix_conv_t *get_cuda_pix_conv(codec_t in, codec_t out)
+{
+        for (unsigned i = 0; i < sizeof cuda_pix_convs / sizeof cuda_pix_convs[0]; ++i) {
+                if (cuda_pix_convs[i].in == in && cuda_pix_convs[i].out == out) {
+                        return cuda_pix_convs[i].conv;
+                }
+        }
+        return NULL;
+}
+
+cuda_pix_conv_t *get_best_cuda_pix_conv(codec_t in, const codec_t *out_candidates, codec_t *out)
+{
+        for (const codec_t *it = out_candidates; *it != VIDEO_CODEC_NONE; ++it) {
+                cuda_pix_conv_t *conv = get_cuda_pix_conv(in, *it);
+                if (conv != NULL) {
+                        *out = *it;
+                        return conv;
+                }
+        }
+        return NULL;
+}
@@ -3,6 +3,23 @@
 #ifndef CUDA_RGB_RGBA_H
 #define CUDA_RGB_RGBA_H
 
+#include "../types.h"
+
+/**
+ * Converts pixel format of a frame residing in CUDA device memory.
+ *
+ * @param width  width of the frame in pixels
+ * @param height height of the frame in lines
+ * The conversion is only enqueued to the stream.
+ */
+typedef void cuda_pix_conv_t(unsigned char *dst,
+                size_t dstPitch,
+                unsigned char *src,
+                size_t srcPitch,
+                size_t width,
+                size_t height,
+                struct CUstream_st *stream);
+
 void cuda_RGB_to_RGBA(unsigned char *dst,
                 size_t dstPitch,
                 unsigned char *src,
@@ -35,4 +52,28 @@ void cuda_UYVY_to_RGBA(unsigned char *dst,
                 size_t height,
                 struct CUstream_st *stream);
 
+cuda_pix_conv_t cuda_v210_to_UYVY;
+cuda_pix_conv_t cuda_UYVY_to_v210;
+cuda_pix_conv_t cuda_v210_to_Y416;
+cuda_pix_conv_t cuda_Y416_to_UYVY;
+cuda_pix_conv_t cuda_R10k_to_RGBA;
+cuda_pix_conv_t cuda_R10k_to_RGB;
+cuda_pix_conv_t cuda_R10k_to_RG48;
+cuda_pix_conv_t cuda_R12L_to_RG48;
+cuda_pix_conv_t cuda_R12L_to_RGB;
+cuda_pix_conv_t cuda_I420_to_UYVY;
+
+/**
+ * Device-side counterpart of get_decoder_from_to().
+ * @returns conversion from in to out or NULL if there is none
+ */
+cuda_pix_conv_t *get_cuda_pix_conv(codec_t in, codec_t out);
+/**
+ * Device-side counterpart of get_best_decoder_from() - returns the first
+ * conversion to one of out_candidates (in the order of preference).
+ * @param out_candidates list terminated by VIDEO_CODEC_NONE
+ * @param[out] out selected output codec
+ */
+cuda_pix_conv_t *get_best_cuda_pix_conv(codec_t in, const codec_t *out_candidates, codec_t *out);
+
 #endif
@@ -0,0 +1,251 @@
+/**
+ * @file   utils/deinterlace_adaptive.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+#include "utils/deinterlace_adaptive.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "utils/simd_lanes.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+/*
+ * The kernel uses GCC generic vectors (32 bytes) - compiled to AVX2 for
+ * the target("avx2") variant, 2x SSE2 or NEON otherwise. The scalar tail
+ * uses the same code with int, so the results are identical.
+ */
+typedef int16_t v16hi __attribute__((vector_size(32)));
+typedef int32_t v8si __attribute__((vector_size(32)));
+typedef uint8_t v16qu __attribute__((vector_size(16)));
+typedef uint16_t v8hu __attribute__((vector_size(16)));
+typedef uint32_t v8su __attribute__((vector_size(32)));
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// the vector helpers are always inlined so the vector ABI isn't relevant
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace {
+
+/// input lines used to interpolate a missing line
+enum { C, E, P0, N0, PC, PE, NC, NE, PB, PF, NB, NF, ROW_COUNT };
+
+template<typename V> ALWAYS_INLINE V vmin(const V &a, const V &b) { return a < b ? a : b; }
+template<typename V> ALWAYS_INLINE V vmax(const V &a, const V &b) { return a > b ? a : b; }
+template<typename V> ALWAYS_INLINE V vabs(const V &a) { return a < V{} ? -a : a; }
+
+/**
+ * Interpolates a missing pixel (component) - C and E are the lines above and
+ * below in the current field, P* lines of previous frame, N* of the next one.
+ * The spatial prediction is clamped to the temporal one with the amount of
+ * detected motion (the same as yadif mode 0 without the edge-directed part).
+ */
+template<typename V> ALWAYS_INLINE V ma_pixel(const V *r)
+{
+        V tp = (r[P0] + r[N0]) >> 1;
+        V diff = vmax(vmax(vabs(r[P0] - r[N0]) >> 1,
+                                (vabs(r[PC] - r[C]) + vabs(r[PE] - r[E])) >> 1),
+                        (vabs(r[NC] - r[C]) + vabs(r[NE] - r[E])) >> 1);
+        V b = (r[PB] + r[NB]) >> 1;
+        V f = (r[PF] + r[NF]) >> 1;
+        V mx = vmax(vmax(tp - r[E], tp - r[C]), vmin(b - r[C], f - r[E]));
+        V mn = vmin(vmin(tp - r[E], tp - r[C]), vmax(b - r[C], f - r[E]));
+        diff = vmax(vmax(diff, mn), -mx);
+        V sp = (r[C] + r[E]) >> 1;
+        return vmin(vmax(sp, tp - diff), tp + diff);
+}
+
+/// one component per element (8- or 16-bit), V holds the loaded elements widened
+template<typename T, typename in_vec, typename V>
+ALWAYS_INLINE void ma_row_packed(const void *const *rows_v, void *dst_v, int count)
+{
+        const T *const *rows = (const T *const *) rows_v;
+        T *dst = (T *) dst_v;
+        constexpr int lanes = sizeof(in_vec) / sizeof(T);
+        int x = 0;
+        for ( ; x + lanes <= count; x += lanes) {
+                V in[ROW_COUNT];
+                for (int i = 0; i < ROW_COUNT; ++i) {
+                        in_vec t;
+                        memcpy(&t, rows[i] + x, sizeof t);
+                        in[i] = __builtin_convertvector(t, V);
+                }
+                in_vec out = __builtin_convertvector(ma_pixel(in), in_vec);
+                memcpy(dst + x, &out, sizeof out);
+        }
+        for ( ; x < count; ++x) {
+                int in[ROW_COUNT];
+                for (int i = 0; i < ROW_COUNT; ++i) {
+                        in[i] = rows[i][x];
+                }
+                dst[x] = ma_pixel(in);
+        }
+}
+
+/// v210 - 3 10-bit components in a 32-bit word, processed one position at a time
+ALWAYS_INLINE void ma_row_v210(const void *const *rows_v, void *dst_v, int count)
+{
+        const uint32_t *const *rows = (const uint32_t *const *) rows_v;
+        uint32_t *dst = (uint32_t *) dst_v;
+        int x = 0;
+        for ( ; x + 8 <= count; x += 8) {
+                v8su w[ROW_COUNT];
+                for (int i = 0; i < ROW_COUNT; ++i) {
+                        memcpy(&w[i], rows[i] + x, sizeof w[i]);
+                }
+                v8su out{};
+                for (int shift = 0; shift < 30; shift += 10) {
+                        v8si in[ROW_COUNT];
+                        for (int i = 0; i < ROW_COUNT; ++i) {
+                                in[i] = (v8si) ((w[i] >> shift) & 0x3FFU);
+                        }
+                        out |= (v8su) ma_pixel(in) << shift;
+                }
+                memcpy(dst + x, &out, sizeof out);
+        }
+        for ( ; x < count; ++x) {
+                uint32_t out = 0;
+                for (int shift = 0; shift < 30; shift += 10) {
+                        int in[ROW_COUNT];
+                        for (int i = 0; i < ROW_COUNT; ++i) {
+                                in[i] = (rows[i][x] >> shift) & 0x3FFU;
+                        }
+                        out |= (uint32_t) ma_pixel(in) << shift;
+                }
+                dst[x] = out;
+        }
+}
+
+typedef void (*ma_row_t)(const void *const *rows, void *dst, int count);
+
+void ma_row_8(const void *const *rows, void *dst, int count) { ma_row_packed<uint8_t, v16qu, v16hi>(rows, dst, count); }
+void ma_row_16(const void *const *rows, void *dst, int count) { ma_row_packed<uint16_t, v8hu, v8si>(rows, dst, count); }
+void ma_row_10(const void *const *rows, void *dst, int count) { ma_row_v210(rows, dst, count); }
+#ifdef PIXFMT_SIMD_X86
+__attribute__((target("avx2"))) void ma_row_8_avx2(const void *const *rows, void *dst, int count) { ma_row_packed<uint8_t, v16qu, v16hi>(rows, dst, count); }
+__attribute__((target("avx2"))) void ma_row_16_avx2(const void *const *rows, void *dst, int count) { ma_row_packed<uint16_t, v8hu, v8si>(rows, dst, count); }
+__attribute__((target("avx2"))) void ma_row_10_avx2(const void *const *rows, void *dst, int count) { ma_row_v210(rows, dst, count); }
+#endif
+
+struct ma_data {
+        ma_row_t row;
+        int elem_size; ///< bytes per element passed to row
+        const char *prev;
+        const char *cur;
+        const char *next;
+        int linesize;
+        int height;
+        int parity;
+        char *dst;
+        int dst_pitch;
+};
+
+void ma_rows(void *arg, int begin, int end)
+{
+        auto *d = (const struct ma_data *) arg;
+        for (int y = begin; y < end; ++y) {
+                char *dst = d->dst + (size_t) y * d->dst_pitch;
+                if ((y & 1) == d->parity) {
+                        memcpy(dst, d->cur + (size_t) y * d->linesize, d->linesize);
+                        continue;
+                }
+                int yc = y > 0 ? y - 1 : y + 1;
+                int ye = y + 1 < d->height ? y + 1 : y - 1;
+                int yb = y >= 2 ? y - 2 : y;
+                int yf = y + 2 < d->height ? y + 2 : y;
+                const int idx[ROW_COUNT] = { yc, ye, y, y, yc, ye, yc, ye, yb, yf, yb, yf };
+                const char *const src[ROW_COUNT] = { d->cur, d->cur, d->prev, d->next, d->prev, d->prev,
+                        d->next, d->next, d->prev, d->prev, d->next, d->next };
+                const void *rows[ROW_COUNT];
+                for (int i = 0; i < ROW_COUNT; ++i) {
+                        rows[i] = src[i] + (size_t) idx[i] * d->linesize;
+                }
+                d->row(rows, dst, d->linesize / d->elem_size);
+        }
+}
+
+} // end anonymous namespace
+
+bool deinterlace_adaptive_supports(codec_t codec)
+{
+        if (codec == v210) {
+                return true;
+        }
+        int bpp = get_bits_per_component(codec);
+        return !is_codec_opaque(codec) && !codec_is_planar(codec) && (bpp == 8 || bpp == 16);
+}
+
+bool deinterlace_adaptive(codec_t codec, int width, int height, const char *prev,
+                const char *cur, const char *next, int parity, char *dst, int dst_pitch)
+{
+        if (!deinterlace_adaptive_supports(codec)) {
+                return false;
+        }
+        int linesize = vc_get_linesize(width, codec);
+        if (height < 2) {
+                for (int y = 0; y < height; ++y) {
+                        memcpy(dst + (size_t) y * dst_pitch, cur + (size_t) y * linesize, linesize);
+                }
+                return true;
+        }
+
+        struct ma_data d = { ma_row_8, 1, prev, cur, next, linesize, height, parity, dst, dst_pitch };
+        if (codec == v210) {
+                d.row = ma_row_10;
+                d.elem_size = 4;
+        } else if (get_bits_per_component(codec) == 16) {
+                d.row = ma_row_16;
+                d.elem_size = 2;
+        }
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                d.row = d.row == ma_row_10 ? ma_row_10_avx2 : d.row == ma_row_16 ? ma_row_16_avx2 : ma_row_8_avx2;
+        }
+#endif
+        task_run_parallel_range(ma_rows, &d, height, parallel_conv_chunk_rows(3 * linesize, 2),
+                        get_cpu_core_count());
+        return true;
+}
+
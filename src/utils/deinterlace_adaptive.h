@@ -0,0 +1,77 @@
+/**
+ * @file   utils/deinterlace_adaptive.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  motion-adaptive deinterlacing (yadif-like)
+ *
+ * Missing lines of a field are interpolated spatially where the picture
+ * moves and taken from the temporally neighbouring fields where it is
+ * static. The check is done per component, so it works on packed formats
+ * directly without conversion.
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_DEINTERLACE_ADAPTIVE_H_3A9E5D27_61C4_4B8F_9F02_C7E4D1B86A30
+#define UTILS_DEINTERLACE_ADAPTIVE_H_3A9E5D27_61C4_4B8F_9F02_C7E4D1B86A30
+
+#include "types.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 8- and 16-bit packed formats and v210
+bool deinterlace_adaptive_supports(codec_t codec);
+/**
+ * Reconstructs a progressive frame from the field of @p cur. Lines of the
+ * other field are interpolated using @p prev and @p next - frames with
+ * the opposite field preceding and following the kept field (one of them
+ * may be the same as @p cur).
+ *
+ * Frames have vc_get_linesize() line length.
+ *
+ * @param parity  0 - keep the top (even) lines, 1 - keep the bottom ones
+ * @retval false  unsupported codec
+ */
+bool deinterlace_adaptive(codec_t codec, int width, int height, const char *prev,
+                const char *cur, const char *next, int parity, char *dst, int dst_pitch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_DEINTERLACE_ADAPTIVE_H_3A9E5D27_61C4_4B8F_9F02_C7E4D1B86A30
@@ -0,0 +1,349 @@
+/**
+ * @file   utils/frame_alloc.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ *
+ * Large frames (eg. 8K RGBA is ~130 MB) span tens of thousands of 4 KiB pages
+ * and conversions iterating over them suffer from TLB misses, huge pages
+ * reduce that by 2-3 orders of magnitude. See also:
+ * - https://kernel.org/doc/html//v5.15/admin-guide/mm/transhuge.html
+ * - https://www.kernel.org/doc/html/latest/admin-guide/mm/hugetlbpage.html
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/frame_alloc.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+
+#define MOD_NAME "[frame_alloc] "
+#define PARAM_NAME "frame-alloc"
+#define THP_SIZE (1U<<21U) /* 2 MiB */
+#define DEFAULT_ALIGN 64
+#define PAGE_ALIGN 4096
+
+ADD_TO_PARAM(PARAM_NAME, "* " PARAM_NAME "=<mode>[:numa[=<node>]]\n"
+                "  Allocation of video frame data - malloc, thp (transparent huge pages,\n"
+                "  default), 2M or 1G (reserved huge pages, see /proc/sys/vm/nr_hugepages,\n"
+                "  1G pages are used for every frame). numa places the frames to the node\n"
+                "  of the allocating thread (or to <node>).\n");
+
+static struct frame_alloc_policy default_policy = { FRAME_ALLOC_THP, FRAME_ALLOC_NUMA_NONE };
+static pthread_once_t default_policy_once = PTHREAD_ONCE_INIT;
+
+bool frame_alloc_parse_policy(const char *cfg, struct frame_alloc_policy *policy)
+{
+        struct frame_alloc_policy p = { FRAME_ALLOC_THP, FRAME_ALLOC_NUMA_NONE };
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        char *item = strtok_r(tmp, ":", &save_ptr);
+        bool ret = true;
+        if (item != NULL) {
+                if (strcmp(item, "malloc") == 0) {
+                        p.mode = FRAME_ALLOC_MALLOC;
+                } else if (strcmp(item, "thp") == 0) {
+                        p.mode = FRAME_ALLOC_THP;
+                } else if (strcasecmp(item, "2M") == 0) {
+                        p.mode = FRAME_ALLOC_HUGETLB_2M;
+                } else if (strcasecmp(item, "1G") == 0) {
+                        p.mode = FRAME_ALLOC_HUGETLB_1G;
+                } else {
+                        ret = false;
+                }
+        }
+        while (ret && (item = strtok_r(NULL, ":", &save_ptr)) != NULL) {
+                if (strcmp(item, "numa") == 0) {
+                        p.numa_node = FRAME_ALLOC_NUMA_LOCAL;
+                } else if (strncmp(item, "numa=", strlen("numa=")) == 0) {
+                        p.numa_node = atoi(item + strlen("numa="));
+                        ret = p.numa_node >= 0;
+                } else {
+                        ret = false;
+                }
+        }
+        free(tmp);
+        if (ret) {
+                *policy = p;
+        }
+        return ret;
+}
+
+static void init_default_policy(void)
+{
+        const char *cfg = get_commandline_param(PARAM_NAME);
+        if (cfg != NULL && !frame_alloc_parse_policy(cfg, &default_policy)) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong allocation policy: %s, using default.\n", cfg);
+        }
+}
+
+const struct frame_alloc_policy *frame_alloc_get_default_policy(void)
+{
+        pthread_once(&default_policy_once, init_default_policy);
+        return &default_policy;
+}
+
+void frame_alloc_set_default_numa_node(int node)
+{
+        pthread_once(&default_policy_once, init_default_policy);
+        if (default_policy.numa_node == FRAME_ALLOC_NUMA_NONE) {
+                default_policy.numa_node = node;
+        }
+}
+
+#ifdef __linux__
+/// mappings created with MAP_HUGETLB (other memory is freed with free())
+struct hugetlb_mapping {
+        void *ptr;
+        size_t len;
+        struct hugetlb_mapping *next;
+};
+static struct hugetlb_mapping *mappings;
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *alloc_hugetlb(size_t size, bool gigantic)
+{
+#ifdef MAP_HUGETLB
+        const size_t page = gigantic ? 1UL<<30U : 1UL<<21U;
+        const size_t len = (size + page - 1) / page * page;
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | ((gigantic ? 30 : 21) << MAP_HUGE_SHIFT);
+        void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ptr == MAP_FAILED) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('f', 'a', 'h', 'p'), MOD_NAME "Cannot allocate %s huge pages "
+                                "(%s), using transparent huge pages.\n", gigantic ? "1 GiB" : "2 MiB", ug_strerror(errno));
+                return NULL;
+        }
+        struct hugetlb_mapping *m = malloc(sizeof *m);
+        m->ptr = ptr;
+        m->len = len;
+        pthread_mutex_lock(&mappings_lock);
+        m->next = mappings;
+        mappings = m;
+        pthread_mutex_unlock(&mappings_lock);
+        return ptr;
+#else
+        UNUSED(size), UNUSED(gigantic);
+        return NULL;
+#endif
+}
+
+/// sets preferred node for the pages not yet faulted in
+static void bind_to_node(void *ptr, size_t size, int node)
+{
+        if (node == FRAME_ALLOC_NUMA_LOCAL) {
+                unsigned cpu = 0;
+                unsigned local_node = 0;
+                if (syscall(SYS_getcpu, &cpu, &local_node, NULL) != 0) {
+                        return;
+                }
+                node = local_node;
+        }
+        unsigned long nodemask = 0;
+        if (node >= (int) (8 * sizeof nodemask)) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('f', 'a', 'n', 'n'), MOD_NAME "NUMA node %d out of range.\n", node);
+                return;
+        }
+        nodemask = 1UL << node;
+        const uintptr_t page_mask = (uintptr_t) sysconf(_SC_PAGESIZE) - 1;
+        uintptr_t start = (uintptr_t) ptr & ~page_mask;
+        size_t len = ((uintptr_t) ptr + size - start + page_mask) & ~page_mask;
+        if (syscall(SYS_mbind, start, len, MPOL_PREFERRED, &nodemask, 8 * sizeof nodemask + 1, 0) != 0) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('f', 'a', 'm', 'b'), MOD_NAME "mbind: %s\n", ug_strerror(errno));
+        }
+}
+#endif // defined __linux__
+
+void *frame_data_alloc(size_t size, const struct frame_alloc_policy *policy)
+{
+        if (policy == NULL) {
+                policy = frame_alloc_get_default_policy();
+        }
+        void *ptr = NULL;
+#ifdef __linux__
+        if (policy->mode == FRAME_ALLOC_HUGETLB_2M || policy->mode == FRAME_ALLOC_HUGETLB_1G) {
+                ptr = alloc_hugetlb(size, policy->mode == FRAME_ALLOC_HUGETLB_1G);
+        }
+        if (ptr == NULL && policy->mode != FRAME_ALLOC_MALLOC && size >= THP_SIZE) {
+                ptr = aligned_malloc(size, THP_SIZE);
+                if (ptr != NULL) {
+                        madvise(ptr, size, MADV_HUGEPAGE);
+                }
+        }
+#endif
+        if (ptr == NULL) {
+                ptr = aligned_malloc(size, DEFAULT_ALIGN);
+        }
+#ifdef __linux__
+        if (ptr != NULL && policy->numa_node != FRAME_ALLOC_NUMA_NONE) {
+                bind_to_node(ptr, size, policy->numa_node);
+        }
+#endif
+        return ptr;
+}
+
+void frame_data_free(void *ptr)
+{
+        if (ptr == NULL) {
+                return;
+        }
+#ifdef __linux__
+        pthread_mutex_lock(&mappings_lock);
+        for (struct hugetlb_mapping **m = &mappings; *m != NULL; m = &(*m)->next) {
+                if ((*m)->ptr == ptr) {
+                        struct hugetlb_mapping *found = *m;
+                        *m = found->next;
+                        pthread_mutex_unlock(&mappings_lock);
+                        munmap(found->ptr, found->len);
+                        free(found);
+                        return;
+                }
+        }
+        pthread_mutex_unlock(&mappings_lock);
+#endif
+        aligned_free(ptr);
+}
+
+/// buffers allocated with frame_data_alloc_pinnable()
+struct pinnable_buffer {
+        void *ptr;
+        size_t size;
+        bool pinned;
+        struct pinnable_buffer *next;
+};
+static struct pinnable_buffer *pinnable;
+static const struct frame_pin_ops *pin_ops;
+static pthread_mutex_t pinnable_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void pin_buffer(struct pinnable_buffer *b)
+{
+        b->pinned = pin_ops->pin(b->ptr, b->size);
+        if (!b->pinned) {
+                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('f', 'a', 'p', 'n'), MOD_NAME "Cannot pin frame buffer, "
+                                "GPU transfers will be staged.\n");
+        }
+}
+
+bool frame_alloc_set_pin_ops(const struct frame_pin_ops *ops)
+{
+        pthread_mutex_lock(&pinnable_lock);
+        if (pin_ops != NULL) {
+                pthread_mutex_unlock(&pinnable_lock);
+                return pin_ops == ops;
+        }
+        pin_ops = ops;
+        for (struct pinnable_buffer *b = pinnable; b != NULL; b = b->next) {
+                pin_buffer(b);
+        }
+        pthread_mutex_unlock(&pinnable_lock);
+        return true;
+}
+
+void frame_alloc_unset_pin_ops(const struct frame_pin_ops *ops)
+{
+        pthread_mutex_lock(&pinnable_lock);
+        if (pin_ops == ops) {
+                for (struct pinnable_buffer *b = pinnable; b != NULL; b = b->next) {
+                        if (b->pinned) {
+                                pin_ops->unpin(b->ptr);
+                                b->pinned = false;
+                        }
+                }
+                pin_ops = NULL;
+        }
+        pthread_mutex_unlock(&pinnable_lock);
+}
+
+void *frame_data_alloc_pinnable(size_t size)
+{
+        void *ptr = aligned_malloc(size, size >= THP_SIZE ? THP_SIZE : PAGE_ALIGN);
+        if (ptr == NULL) {
+                return NULL;
+        }
+#ifdef __linux__
+        if (size >= THP_SIZE && frame_alloc_get_default_policy()->mode != FRAME_ALLOC_MALLOC) {
+                madvise(ptr, size, MADV_HUGEPAGE);
+        }
+#endif
+        struct pinnable_buffer *b = malloc(sizeof *b);
+        b->ptr = ptr;
+        b->size = size;
+        b->pinned = false;
+        pthread_mutex_lock(&pinnable_lock);
+        if (pin_ops != NULL) {
+                pin_buffer(b);
+        }
+        b->next = pinnable;
+        pinnable = b;
+        pthread_mutex_unlock(&pinnable_lock);
+        return ptr;
+}
+
+void frame_data_free_pinnable(void *ptr)
+{
+        if (ptr == NULL) {
+                return;
+        }
+        pthread_mutex_lock(&pinnable_lock);
+        for (struct pinnable_buffer **b = &pinnable; *b != NULL; b = &(*b)->next) {
+                if ((*b)->ptr == ptr) {
+                        struct pinnable_buffer *found = *b;
+                        *b = found->next;
+                        if (found->pinned) {
+                                pin_ops->unpin(found->ptr);
+                        }
+                        free(found);
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&pinnable_lock);
+        aligned_free(ptr);
+}
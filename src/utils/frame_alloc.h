@@ -0,0 +1,113 @@
+/**
+ * @file   utils/frame_alloc.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  video frame data allocation backed by huge pages
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_FRAME_ALLOC_H_8C2D4E6A_1B3F_4A57_9E0D_6F1A2B3C4D5E
+#define UTILS_FRAME_ALLOC_H_8C2D4E6A_1B3F_4A57_9E0D_6F1A2B3C4D5E
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum frame_alloc_mode {
+        FRAME_ALLOC_MALLOC,      ///< regular heap allocation
+        FRAME_ALLOC_THP,         ///< transparent huge pages (madvise), default
+        FRAME_ALLOC_HUGETLB_2M,  ///< MAP_HUGETLB with 2 MiB pages (falls back to THP)
+        FRAME_ALLOC_HUGETLB_1G,  ///< MAP_HUGETLB with 1 GiB pages (falls back to THP)
+};
+
+#define FRAME_ALLOC_NUMA_NONE  (-1) ///< leave placement to the kernel (first touch)
+#define FRAME_ALLOC_NUMA_LOCAL (-2) ///< node of the allocating thread
+
+struct frame_alloc_policy {
+        enum frame_alloc_mode mode;
+        int numa_node; ///< node number or FRAME_ALLOC_NUMA_NONE/LOCAL
+};
+
+/**
+ * @param cfg  <mode>[:numa[=<node>]], mode is one of malloc, thp, 2M, 1G
+ */
+bool frame_alloc_parse_policy(const char *cfg, struct frame_alloc_policy *policy);
+/// @returns policy set by "--param frame-alloc" (or the default one)
+const struct frame_alloc_policy *frame_alloc_get_default_policy(void);
+/// sets NUMA node of the default policy unless set by "--param frame-alloc"
+void frame_alloc_set_default_numa_node(int node);
+
+/**
+ * @param policy  NULL for the default policy
+ * @returns 64B aligned memory that must be freed with frame_data_free()
+ */
+void *frame_data_alloc(size_t size, const struct frame_alloc_policy *policy);
+void frame_data_free(void *ptr);
+
+/**
+ * Page-locking (pinning) of the frames allocated by frame_data_alloc_pinnable()
+ * so that a GPU can DMA them directly (eg. cudaHostRegister).
+ */
+struct frame_pin_ops {
+        bool (*pin)(void *ptr, size_t size);
+        void (*unpin)(void *ptr);
+};
+
+/**
+ * Installs the pinning functions (usually done by a GPU module), the pinnable
+ * frames already allocated are pinned immediately.
+ * @returns false if other pinning functions are already installed
+ */
+bool frame_alloc_set_pin_ops(const struct frame_pin_ops *ops);
+/// unpins all pinnable frames and uninstalls ops (if installed)
+void frame_alloc_unset_pin_ops(const struct frame_pin_ops *ops);
+/**
+ * Allocates page-aligned frame data that is pinned while the pinning functions
+ * are installed. Intended for long-lived (pooled) buffers.
+ * @returns memory that must be freed with frame_data_free_pinnable()
+ */
+void *frame_data_alloc_pinnable(size_t size);
+void frame_data_free_pinnable(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_FRAME_ALLOC_H_8C2D4E6A_1B3F_4A57_9E0D_6F1A2B3C4D5E
@@ -0,0 +1,444 @@
+/**
+ * @file   utils/gf256.c
+ * @brief  GF(2^8) multiply-accumulate kernels (used by Reed-Solomon FEC)
+ *
+ * Besides the scalar table implementation, there are split-nibble table
+ * lookup kernels (PSHUFB on x86, TBL on AArch64) and GFNI kernels using
+ * the affine transformation (GF2P8MULB itself cannot be used because it
+ * is bound to the AES polynomial). x86 kernels are compiled with function
+ * target attributes and picked at runtime.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if (defined __x86_64__ || defined __i386__) && (defined __clang__ || __GNUC__ >= 9)
+#define GF256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#if defined __aarch64__ && defined __ARM_NEON
+#define GF256_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "utils/gf256.h"
+
+#define GF256_POLY 0x11D
+
+static unsigned char mul_table[256][256];
+static unsigned char nibble_table[256][2][16]; ///< c * i and c * (i << 4) for split-nibble lookup
+static uint64_t affine_table[256]; ///< 8x8 bit matrices for GF2P8AFFINEQB multiplying by c
+static pthread_once_t tables_initialized = PTHREAD_ONCE_INIT;
+
+static void init_tables(void)
+{
+        unsigned char exp_table[512];
+        unsigned char log_table[256] = { 0 };
+        unsigned x = 1;
+        for (int i = 0; i < 255; ++i) {
+                exp_table[i] = exp_table[i + 255] = x;
+                log_table[x] = i;
+                x <<= 1;
+                if (x & 0x100) {
+                        x ^= GF256_POLY;
+                }
+        }
+        for (int a = 1; a < 256; ++a) {
+                for (int b = 1; b < 256; ++b) {
+                        mul_table[a][b] = exp_table[log_table[a] + log_table[b]];
+                }
+        }
+        for (int c = 0; c < 256; ++c) {
+                for (int i = 0; i < 16; ++i) {
+                        nibble_table[c][0][i] = mul_table[c][i];
+                        nibble_table[c][1][i] = mul_table[c][i << 4];
+                }
+                uint64_t matrix = 0;
+                for (int j = 0; j < 8; ++j) {
+                        unsigned char v = mul_table[c][1 << j];
+                        for (int i = 0; i < 8; ++i) {
+                                if (v & (1 << i)) {
+                                        matrix |= 1ULL << (8 * (7 - i) + j);
+                                }
+                        }
+                }
+                affine_table[c] = matrix;
+        }
+}
+
+unsigned char gf256_mul(unsigned char a, unsigned char b)
+{
+        pthread_once(&tables_initialized, init_tables);
+        return mul_table[a][b];
+}
+
+static bool always_available(void)
+{
+        return true;
+}
+
+static void gf256_dot_generic(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        memset(dst, 0, len);
+        for (int j = 0; j < count; ++j) {
+                if (coeffs[j] == 0) {
+                        continue;
+                }
+                const unsigned char *row = mul_table[coeffs[j]];
+                const unsigned char *s = src[j];
+                for (size_t i = 0; i < len; ++i) {
+                        dst[i] ^= row[s[i]];
+                }
+        }
+}
+
+/// does the scalar part of the dot product for bytes [offset, len)
+static void gf256_dot_tail(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t offset, size_t len)
+{
+        for (size_t i = offset; i < len; ++i) {
+                unsigned char acc = 0;
+                for (int j = 0; j < count; ++j) {
+                        acc ^= mul_table[coeffs[j]][src[j][i]];
+                }
+                dst[i] = acc;
+        }
+}
+
+#ifdef GF256_X86
+__attribute__((target("ssse3")))
+static void gf256_dot_ssse3(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        __m128i tbl[2 * count];
+        for (int j = 0; j < count; ++j) {
+                const unsigned char *lo = nibble_table[coeffs[j]][0];
+                const unsigned char *hi = nibble_table[coeffs[j]][1];
+                tbl[2 * j] = _mm_loadu_si128((const __m128i *)(const void *) lo);
+                tbl[2 * j + 1] = _mm_loadu_si128((const __m128i *)(const void *) hi);
+        }
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        size_t i = 0;
+        for ( ; i + 2 * sizeof(__m128i) <= len; i += 2 * sizeof(__m128i)) {
+                __m128i acc0 = _mm_setzero_si128();
+                __m128i acc1 = _mm_setzero_si128();
+                for (int j = 0; j < count; ++j) {
+                        __m128i x0 = _mm_loadu_si128((const __m128i *)(const void *) (src[j] + i));
+                        __m128i x1 = _mm_loadu_si128((const __m128i *)(const void *) (src[j] + i + sizeof(__m128i)));
+                        acc0 = _mm_xor_si128(acc0, _mm_xor_si128(_mm_shuffle_epi8(tbl[2 * j], _mm_and_si128(x0, mask)),
+                                                _mm_shuffle_epi8(tbl[2 * j + 1], _mm_and_si128(_mm_srli_epi64(x0, 4), mask))));
+                        acc1 = _mm_xor_si128(acc1, _mm_xor_si128(_mm_shuffle_epi8(tbl[2 * j], _mm_and_si128(x1, mask)),
+                                                _mm_shuffle_epi8(tbl[2 * j + 1], _mm_and_si128(_mm_srli_epi64(x1, 4), mask))));
+                }
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), acc0);
+                _mm_storeu_si128((__m128i *)(void *) (dst + i + sizeof(__m128i)), acc1);
+        }
+        for ( ; i + sizeof(__m128i) <= len; i += sizeof(__m128i)) {
+                __m128i acc = _mm_setzero_si128();
+                for (int j = 0; j < count; ++j) {
+                        __m128i x = _mm_loadu_si128((const __m128i *)(const void *) (src[j] + i));
+                        __m128i lo = _mm_shuffle_epi8(tbl[2 * j], _mm_and_si128(x, mask));
+                        __m128i hi = _mm_shuffle_epi8(tbl[2 * j + 1], _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+                        acc = _mm_xor_si128(acc, _mm_xor_si128(lo, hi));
+                }
+                _mm_storeu_si128((__m128i *)(void *) (dst + i), acc);
+        }
+        gf256_dot_tail(dst, src, coeffs, count, i, len);
+}
+
+__attribute__((target("avx2")))
+static void gf256_dot_avx2(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        __m256i tbl[2 * count];
+        for (int j = 0; j < count; ++j) {
+                const unsigned char *lo = nibble_table[coeffs[j]][0];
+                const unsigned char *hi = nibble_table[coeffs[j]][1];
+                tbl[2 * j] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) lo));
+                tbl[2 * j + 1] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) hi));
+        }
+        const __m256i mask = _mm256_set1_epi8(0x0f);
+        size_t i = 0;
+        for ( ; i + 2 * sizeof(__m256i) <= len; i += 2 * sizeof(__m256i)) {
+                __m256i acc0 = _mm256_setzero_si256();
+                __m256i acc1 = _mm256_setzero_si256();
+                for (int j = 0; j < count; ++j) {
+                        __m256i x0 = _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i));
+                        __m256i x1 = _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i + sizeof(__m256i)));
+                        acc0 = _mm256_xor_si256(acc0, _mm256_xor_si256(_mm256_shuffle_epi8(tbl[2 * j], _mm256_and_si256(x0, mask)),
+                                                _mm256_shuffle_epi8(tbl[2 * j + 1], _mm256_and_si256(_mm256_srli_epi64(x0, 4), mask))));
+                        acc1 = _mm256_xor_si256(acc1, _mm256_xor_si256(_mm256_shuffle_epi8(tbl[2 * j], _mm256_and_si256(x1, mask)),
+                                                _mm256_shuffle_epi8(tbl[2 * j + 1], _mm256_and_si256(_mm256_srli_epi64(x1, 4), mask))));
+                }
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc0);
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i + sizeof(__m256i)), acc1);
+        }
+        for ( ; i + sizeof(__m256i) <= len; i += sizeof(__m256i)) {
+                __m256i acc = _mm256_setzero_si256();
+                for (int j = 0; j < count; ++j) {
+                        __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i));
+                        __m256i lo = _mm256_shuffle_epi8(tbl[2 * j], _mm256_and_si256(x, mask));
+                        __m256i hi = _mm256_shuffle_epi8(tbl[2 * j + 1], _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+                        acc = _mm256_xor_si256(acc, _mm256_xor_si256(lo, hi));
+                }
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc);
+        }
+        gf256_dot_tail(dst, src, coeffs, count, i, len);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gf256_dot_avx512(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        __m512i tbl[2 * count];
+        for (int j = 0; j < count; ++j) {
+                const unsigned char *lo = nibble_table[coeffs[j]][0];
+                const unsigned char *hi = nibble_table[coeffs[j]][1];
+                tbl[2 * j] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(const void *) lo));
+                tbl[2 * j + 1] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(const void *) hi));
+        }
+        const __m512i mask = _mm512_set1_epi8(0x0f);
+        size_t i = 0;
+        for ( ; i + 2 * sizeof(__m512i) <= len; i += 2 * sizeof(__m512i)) {
+                __m512i acc0 = _mm512_setzero_si512();
+                __m512i acc1 = _mm512_setzero_si512();
+                for (int j = 0; j < count; ++j) {
+                        __m512i x0 = _mm512_loadu_si512((const void *) (src[j] + i));
+                        __m512i x1 = _mm512_loadu_si512((const void *) (src[j] + i + sizeof(__m512i)));
+                        acc0 = _mm512_xor_si512(acc0, _mm512_xor_si512(_mm512_shuffle_epi8(tbl[2 * j], _mm512_and_si512(x0, mask)),
+                                                _mm512_shuffle_epi8(tbl[2 * j + 1], _mm512_and_si512(_mm512_srli_epi64(x0, 4), mask))));
+                        acc1 = _mm512_xor_si512(acc1, _mm512_xor_si512(_mm512_shuffle_epi8(tbl[2 * j], _mm512_and_si512(x1, mask)),
+                                                _mm512_shuffle_epi8(tbl[2 * j + 1], _mm512_and_si512(_mm512_srli_epi64(x1, 4), mask))));
+                }
+                _mm512_storeu_si512((void *) (dst + i), acc0);
+                _mm512_storeu_si512((void *) (dst + i + sizeof(__m512i)), acc1);
+        }
+        for ( ; i + sizeof(__m512i) <= len; i += sizeof(__m512i)) {
+                __m512i acc = _mm512_setzero_si512();
+                for (int j = 0; j < count; ++j) {
+                        __m512i x = _mm512_loadu_si512((const void *) (src[j] + i));
+                        __m512i lo = _mm512_shuffle_epi8(tbl[2 * j], _mm512_and_si512(x, mask));
+                        __m512i hi = _mm512_shuffle_epi8(tbl[2 * j + 1], _mm512_and_si512(_mm512_srli_epi64(x, 4), mask));
+                        acc = _mm512_xor_si512(acc, _mm512_xor_si512(lo, hi));
+                }
+                _mm512_storeu_si512((void *) (dst + i), acc);
+        }
+        gf256_dot_tail(dst, src, coeffs, count, i, len);
+}
+
+__attribute__((target("gfni,avx2")))
+static void gf256_dot_avx2_gfni(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        __m256i matrix[count];
+        for (int j = 0; j < count; ++j) {
+                matrix[j] = _mm256_set1_epi64x((long long) affine_table[coeffs[j]]);
+        }
+        size_t i = 0;
+        for ( ; i + 2 * sizeof(__m256i) <= len; i += 2 * sizeof(__m256i)) {
+                __m256i acc0 = _mm256_setzero_si256();
+                __m256i acc1 = _mm256_setzero_si256();
+                for (int j = 0; j < count; ++j) {
+                        __m256i x0 = _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i));
+                        __m256i x1 = _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i + sizeof(__m256i)));
+                        acc0 = _mm256_xor_si256(acc0, _mm256_gf2p8affine_epi64_epi8(x0, matrix[j], 0));
+                        acc1 = _mm256_xor_si256(acc1, _mm256_gf2p8affine_epi64_epi8(x1, matrix[j], 0));
+                }
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc0);
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i + sizeof(__m256i)), acc1);
+        }
+        for ( ; i + sizeof(__m256i) <= len; i += sizeof(__m256i)) {
+                __m256i acc = _mm256_setzero_si256();
+                for (int j = 0; j < count; ++j) {
+                        __m256i x = _mm256_loadu_si256((const __m256i *)(const void *) (src[j] + i));
+                        acc = _mm256_xor_si256(acc, _mm256_gf2p8affine_epi64_epi8(x, matrix[j], 0));
+                }
+                _mm256_storeu_si256((__m256i *)(void *) (dst + i), acc);
+        }
+        gf256_dot_tail(dst, src, coeffs, count, i, len);
+}
+
+__attribute__((target("gfni,avx512f,avx512bw")))
+static void gf256_dot_avx512_gfni(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        __m512i matrix[count];
+        for (int j = 0; j < count; ++j) {
+                matrix[j] = _mm512_set1_epi64((long long) affine_table[coeffs[j]]);
+        }
+        size_t i = 0;
+        for ( ; i + 2 * sizeof(__m512i) <= len; i += 2 * sizeof(__m512i)) {
+                __m512i acc0 = _mm512_setzero_si512();
+                __m512i acc1 = _mm512_setzero_si512();
+                for (int j = 0; j < count; ++j) {
+                        __m512i x0 = _mm512_loadu_si512((const void *) (src[j] + i));
+                        __m512i x1 = _mm512_loadu_si512((const void *) (src[j] + i + sizeof(__m512i)));
+                        acc0 = _mm512_xor_si512(acc0, _mm512_gf2p8affine_epi64_epi8(x0, matrix[j], 0));
+                        acc1 = _mm512_xor_si512(acc1, _mm512_gf2p8affine_epi64_epi8(x1, matrix[j], 0));
+                }
+                _mm512_storeu_si512((void *) (dst + i), acc0);
+                _mm512_storeu_si512((void *) (dst + i + sizeof(__m512i)), acc1);
+        }
+        for ( ; i + sizeof(__m512i) <= len; i += sizeof(__m512i)) {
+                __m512i acc = _mm512_setzero_si512();
+                for (int j = 0; j < count; ++j) {
+                        __m512i x = _mm512_loadu_si512((const void *) (src[j] + i));
+                        acc = _mm512_xor_si512(acc, _mm512_gf2p8affine_epi64_epi8(x, matrix[j], 0));
+                }
+                _mm512_storeu_si512((void *) (dst + i), acc);
+        }
+        gf256_dot_tail(dst, src, coeffs, count, i, len);
+}
+
+static bool cpu_has_gfni(void)
+{
+        unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+                return false;
+        }
+        return (ecx & bit_GFNI) != 0;
+}
+
+static bool ssse3_available(void)
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3");
+}
+
+static bool avx2_available(void)
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+}
+
+static bool avx512_available(void)
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+
+static bool avx2_gfni_available(void)
+{
+        return avx2_available() && cpu_has_gfni();
+}
+
+static bool avx512_gfni_available(void)
+{
+        return avx512_available() && cpu_has_gfni();
+}
+#endif // defined GF256_X86
+
+#ifdef GF256_NEON
+static void gf256_dot_neon(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len)
+{
+        uint8x16_t tbl[2 * count];
+        for (int j = 0; j < count; ++j) {
+                const unsigned char *lo = nibble_table[coeffs[j]][0];
+                const unsigned char *hi = nibble_table[coeffs[j]][1];
+                tbl[2 * j] = vld1q_u8(lo);
+                tbl[2 * j + 1] = vld1q_u8(hi);
+        }
+        const uint8x16_t mask = vdupq_n_u8(0x0f);
+        size_t i = 0;
+        for ( ; i + 2 * sizeof(uint8x16_t) <= len; i += 2 * sizeof(uint8x16_t)) {
+                uint8x16_t acc0 = vdupq_n_u8(0);
+                uint8x16_t acc1 = vdupq_n_u8(0);
+                for (int j = 0; j < count; ++j) {
+                        uint8x16_t x0 = vld1q_u8(src[j] + i);
+                        uint8x16_t x1 = vld1q_u8(src[j] + i + sizeof(uint8x16_t));
+                        acc0 = veorq_u8(acc0, veorq_u8(vqtbl1q_u8(tbl[2 * j], vandq_u8(x0, mask)),
+                                                vqtbl1q_u8(tbl[2 * j + 1], vshrq_n_u8(x0, 4))));
+                        acc1 = veorq_u8(acc1, veorq_u8(vqtbl1q_u8(tbl[2 * j], vandq_u8(x1, mask)),
+                                                vqtbl1q_u8(tbl[2 * j + 1], vshrq_n_u8(x1, 4))));
+                }
+                vst1q_u8(dst + i, acc0);
+                vst1q_u8(dst + i + sizeof(uint8x16_t), acc1);
+        }
+        for ( ; i + sizeof(uint8x16_t) <= len; i += sizeof(uint8x16_t)) {
+                uint8x16_t acc = vdupq_n_u8(0);
+                for (int j = 0; j < count; ++j) {
+                        uint8x16_t x = vld1q_u8(src[j] + i);
+                        uint8x16_t lo = vqtbl1q_u8(tbl[2 * j], vandq_u8(x, mask));
+                        uint8x16_t hi = vqtbl1q_u8(tbl[2 * j + 1], vshrq_n_u8(x, 4));
+                        acc = veorq_u8(acc, veorq_u8(lo, hi));
+                }
+                vst1q_u8(dst + i, acc);
+        }
+        gf256_dot_tail(dst, src, coeffs, count, i, len);
+}
+#endif // defined GF256_NEON
+
+static const struct gf256_impl impls[] = {
+#ifdef GF256_X86
+        { "avx512_gfni", gf256_dot_avx512_gfni, avx512_gfni_available },
+        { "avx2_gfni", gf256_dot_avx2_gfni, avx2_gfni_available },
+        { "avx512", gf256_dot_avx512, avx512_available },
+        { "avx2", gf256_dot_avx2, avx2_available },
+        { "ssse3", gf256_dot_ssse3, ssse3_available },
+#endif
+#ifdef GF256_NEON
+        { "neon", gf256_dot_neon, always_available },
+#endif
+        { "generic", gf256_dot_generic, always_available },
+        { NULL, NULL, NULL },
+};
+
+const struct gf256_impl *gf256_get_impls(void)
+{
+        pthread_once(&tables_initialized, init_tables);
+        return impls;
+}
+
+const struct gf256_impl *gf256_get_impl(const char *name)
+{
+        pthread_once(&tables_initialized, init_tables);
+        bool any = name == NULL || strcmp(name, "auto") == 0;
+        for (const struct gf256_impl *it = impls; it->name != NULL; ++it) {
+                if ((any || strcmp(it->name, name) == 0) && it->available()) {
+                        return it;
+                }
+        }
+        return NULL;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file   utils/gf256.h
+ * @brief  GF(2^8) multiply-accumulate kernels (used by Reed-Solomon FEC)
+ *
+ * The field uses the polynomial x^8+x^4+x^3+x^2+1 (0x11D), compatible
+ * with zfec.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_GF256_H_
+#define UTILS_GF256_H_
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#else
+#include <cstddef>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Computes dst = coeffs[0] * src[0] + ... + coeffs[count - 1] * src[count - 1]
+ * over len bytes. Buffers do not need to be aligned, dst must not alias src.
+ */
+typedef void (*gf256_dot_func_t)(unsigned char *dst, const unsigned char *const *src,
+                const unsigned char *coeffs, int count, size_t len);
+
+struct gf256_impl {
+        const char *name;
+        gf256_dot_func_t dot;
+        bool (*available)(void);
+};
+
+/// @returns all compiled-in implementations ordered by preference, terminated by {}
+const struct gf256_impl *gf256_get_impls(void);
+/**
+ * @param name implementation name, NULL or "auto" selects the fastest one
+ * @returns    selected implementation or NULL if not compiled in/not supported by CPU
+ */
+const struct gf256_impl *gf256_get_impl(const char *name);
+unsigned char gf256_mul(unsigned char a, unsigned char b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_GF256_H_
@@ -29,9 +29,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "h264_stream.h"
+#include "rtp/rtpenc_h264.h"
 
 /***************************** reading ******************************/
 
@@ -56,6 +58,24 @@ int nal_to_rbsp(const uint8_t* nal_buf, int* nal_size, uint8_t* rbsp_buf, int* r
 
     for( i = 1; i < *nal_size; i++ )
     {
+        if( count == 0 )
+        {
+            // emulation prevention may only follow 00 00, copy the data up to it at once
+            const uint8_t* pair = rtpenc_h264_find_zero_pair(nal_buf + i, nal_buf + *nal_size);
+            int span = (pair != NULL ? (int) (pair - nal_buf) : *nal_size) - i;
+            if ( j + span > *rbsp_size )
+            {
+                return -1;
+            }
+            memcpy(rbsp_buf + j, nal_buf + i, span);
+            i += span;
+            j += span;
+            if( i == *nal_size )
+            {
+                break;
+            }
+        }
+
         // in NAL unit, 0x000000, 0x000001 or 0x000002 shall not occur at any byte-aligned position
         if( ( count == 2 ) && ( nal_buf[i] < 0x03) )
         {
@@ -0,0 +1,112 @@
+/**
+ * @file   utils/latency_histogram.hpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  latency histogram periodically reported to the control socket
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LATENCY_HISTOGRAM_HPP_3A9D6E21_7B4C_4F05_8E1A_C2D5F6B70934
+#define UTILS_LATENCY_HISTOGRAM_HPP_3A9D6E21_7B4C_4F05_8E1A_C2D5F6B70934
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <sstream>
+
+#include "control_socket.h"
+#include "debug.h"
+#include "tv.h"
+
+/**
+ * Log2 histogram of latencies - bucket i counts values in [2^i, 2^(i+1)) us,
+ * negative values (unsynchronized clocks) are counted in bucket 0. Not
+ * thread-safe, add() and report() must be called from the same thread.
+ *
+ * Reported as "<tag> <name> count <n> min_us ... hist_log2_us <b0>,<b1>,...".
+ */
+struct latency_histogram {
+        static constexpr int BUCKETS = 24; // last one is >= 8 s
+        static constexpr int REPORT_INTERVAL_SEC = 5;
+
+        latency_histogram(const char *t, const char *n) : tag(t), name(n) {}
+        const char *tag;
+        const char *name;
+        unsigned long buckets[BUCKETS] = {};
+        unsigned long count = 0;
+        long long sum_us = 0;
+        long long min_us = LLONG_MAX;
+        long long max_us = LLONG_MIN;
+        std::chrono::steady_clock::time_point t_last = std::chrono::steady_clock::now();
+
+        void add(time_ns_t latency_ns) {
+                long long us = latency_ns / 1000;
+                int idx = us <= 0 ? 0 : std::min(BUCKETS - 1, 63 - __builtin_clzll(us));
+                buckets[idx] += 1;
+                count += 1;
+                sum_us += us;
+                min_us = std::min(min_us, us);
+                max_us = std::max(max_us, us);
+        }
+        /// @returns upper bound of bucket containing the percentile
+        long long percentile_us(double p) const {
+                unsigned long cum = 0;
+                for (int i = 0; i < BUCKETS; ++i) {
+                        cum += buckets[i];
+                        if (cum >= p * count) {
+                                return 1LL << (i + 1);
+                        }
+                }
+                return max_us;
+        }
+        /// reports (and resets) the histogram if REPORT_INTERVAL_SEC has elapsed
+        void report(struct control_state *control) {
+                auto now = std::chrono::steady_clock::now();
+                if (count == 0 || std::chrono::duration_cast<std::chrono::seconds>(now - t_last).count() < REPORT_INTERVAL_SEC) {
+                        return;
+                }
+                std::ostringstream oss;
+                oss << tag << " " << name << " count " << count << " min_us " << min_us
+                        << " avg_us " << sum_us / (long long) count << " p50_us " << percentile_us(0.5)
+                        << " p99_us " << percentile_us(0.99) << " max_us " << max_us << " hist_log2_us ";
+                for (int i = 0; i < BUCKETS; ++i) {
+                        oss << (i > 0 ? "," : "") << buckets[i];
+                }
+                control_report_stats(control, oss.str());
+                LOG(LOG_LEVEL_VERBOSE) << "Latency (" << tag << " " << name << "): avg " << sum_us / (long long) count / 1000.0
+                        << " ms, p99 < " << percentile_us(0.99) / 1000.0 << " ms, max " << max_us / 1000.0 << " ms\n";
+                *this = latency_histogram(tag, name);
+        }
+};
+
+#endif // defined UTILS_LATENCY_HISTOGRAM_HPP_3A9D6E21_7B4C_4F05_8E1A_C2D5F6B70934
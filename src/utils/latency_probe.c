@@ -0,0 +1,137 @@
+/**
+ * @file   utils/latency_probe.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pixfmt_conv.h"
+#include "utils/latency_probe.h"
+#include "video_codec.h"
+
+enum {
+        MAGIC = 0x4C50, ///< "LP"
+        MAGIC_BITS = 16,
+        TS_BITS = LATENCY_PROBE_BITS - MAGIC_BITS,
+        MAX_BLOCK_PIXELS = 2 * LATENCY_PROBE_BLOCK,
+};
+#define TS_MASK ((UINT64_C(1) << TS_BITS) - 1)
+
+/// one bit block width aligned to the pixel format block size
+static int get_block_pixels(codec_t c)
+{
+        const int pf_block = get_pf_block_pixels(c);
+        return (LATENCY_PROBE_BLOCK + pf_block - 1) / pf_block * pf_block;
+}
+
+static decoder_t get_conversion(codec_t in, codec_t out)
+{
+        return in == out ? vc_memcpy : get_decoder_from_to(in, out);
+}
+
+bool latency_probe_supported(codec_t c, int width, int height)
+{
+        if (codec_is_planar(c) || is_codec_opaque(c) || get_pf_block_pixels(c) == 0
+                        || get_block_pixels(c) > MAX_BLOCK_PIXELS) {
+                return false;
+        }
+        return get_conversion(RGBA, c) != NULL && get_conversion(c, RGBA) != NULL
+                && width >= LATENCY_PROBE_BITS * get_block_pixels(c) && height >= LATENCY_PROBE_BLOCK;
+}
+
+bool latency_probe_embed(codec_t c, int width, int height, char *data, time_ns_t capture_time)
+{
+        if (!latency_probe_supported(c, width, height)) {
+                return false;
+        }
+        const int block_pixels = get_block_pixels(c);
+        const size_t block_len = vc_get_size(block_pixels, c); // excluding line padding (R10k)
+        const size_t linesize = vc_get_linesize(width, c);
+        unsigned char rgba[4 * MAX_BLOCK_PIXELS + MAX_PADDING];
+        unsigned char block[2][4 * MAX_BLOCK_PIXELS * 2 + MAX_PADDING];
+        for (int val = 0; val < 2; ++val) {
+                memset(rgba, val ? 0xFF : 0, sizeof rgba);
+                for (int i = 3; i < 4 * block_pixels; i += 4) {
+                        rgba[i] = 0xFF; // alpha
+                }
+                get_conversion(RGBA, c)(block[val], rgba, (int) block_len, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+        }
+
+        const uint64_t stamp = (uint64_t) MAGIC << TS_BITS | ((uint64_t) (capture_time / NS_IN_US) & TS_MASK);
+        for (int y = 0; y < LATENCY_PROBE_BLOCK; ++y) {
+                for (int bit = 0; bit < LATENCY_PROBE_BITS; ++bit) {
+                        int val = (stamp >> (LATENCY_PROBE_BITS - 1 - bit)) & 1U;
+                        memcpy(data + y * linesize + bit * block_len, block[val], block_len);
+                }
+        }
+        return true;
+}
+
+bool latency_probe_extract(codec_t c, int width, int height, const char *data, time_ns_t *capture_time)
+{
+        if (!latency_probe_supported(c, width, height)) {
+                return false;
+        }
+        const int block_pixels = get_block_pixels(c);
+        const size_t linesize = vc_get_linesize(width, c);
+        unsigned char rgba[4 * LATENCY_PROBE_BITS * MAX_BLOCK_PIXELS + MAX_PADDING];
+        // the middle line of the probe is least affected by compression artifacts at block edges
+        get_conversion(c, RGBA)(rgba, (const unsigned char *) data + LATENCY_PROBE_BLOCK / 2 * linesize,
+                        4 * LATENCY_PROBE_BITS * block_pixels, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+
+        uint64_t stamp = 0;
+        for (int bit = 0; bit < LATENCY_PROBE_BITS; ++bit) {
+                // average luma (green) of the central half of the block
+                unsigned sum = 0;
+                for (int x = block_pixels / 4; x < 3 * block_pixels / 4; ++x) {
+                        sum += rgba[4 * (bit * block_pixels + x) + 1];
+                }
+                stamp = stamp << 1U | (sum > 128U * (block_pixels / 2) ? 1U : 0U);
+        }
+        if (stamp >> TS_BITS != MAGIC) {
+                return false;
+        }
+        const uint64_t now_us = get_time_in_ns() / NS_IN_US;
+        const uint64_t age_us = (now_us - stamp) & TS_MASK;
+        *capture_time = (time_ns_t) (now_us - age_us) * NS_IN_US;
+        return true;
+}
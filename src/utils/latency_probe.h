@@ -0,0 +1,80 @@
+/**
+ * @file   utils/latency_probe.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  capture timestamp embedded to the picture for latency measurement
+ *
+ * The timestamp is written as LATENCY_PROBE_BITS white(1)/black(0) blocks of
+ * LATENCY_PROBE_BLOCK pixels to the top-left corner of the picture (16-bit
+ * magic followed by 48 bits of the capture time in microseconds, MSB first)
+ * so that it passes through the compression and also through an external
+ * video loop (display output captured by a capture card). The sender and
+ * receiver clocks need to be synchronized (eg. NTP/PTP) unless measuring on a
+ * single host.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_LATENCY_PROBE_H_5C0E2A7B_9F41_4D8B_A3E6_1B7D4C2F8E90
+#define UTILS_LATENCY_PROBE_H_5C0E2A7B_9F41_4D8B_A3E6_1B7D4C2F8E90
+
+#include "tv.h"
+#include "types.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LATENCY_PROBE_BITS 64
+#define LATENCY_PROBE_BLOCK 16 ///< size (in pixels) of one bit of the probe
+
+bool latency_probe_supported(codec_t c, int width, int height);
+/**
+ * writes capture_time to the top-left corner of the picture
+ * @retval false the picture doesn't have suitable pixel format or is too small
+ */
+bool latency_probe_embed(codec_t c, int width, int height, char *data, time_ns_t capture_time);
+/**
+ * reads the capture time written by latency_probe_embed()
+ * @retval false the picture doesn't contain the probe
+ */
+bool latency_probe_extract(codec_t c, int width, int height, const char *data, time_ns_t *capture_time);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // defined UTILS_LATENCY_PROBE_H_5C0E2A7B_9F41_4D8B_A3E6_1B7D4C2F8E90
@@ -0,0 +1,303 @@
+/**
+ * @file   utils/metrics.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utils/metrics.h"
+#include "utils/spsc_queue.h" // SPSC_CACHE_LINE
+
+using std::atomic;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::vector;
+
+namespace {
+constexpr int MAX_COUNTERS = 256;
+constexpr int MAX_HISTOGRAMS = 64;
+constexpr int SUB_BITS = 3; ///< sub-buckets per power of two (2^SUB_BITS)
+constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+constexpr int HIST_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+/// exposition bucket bounds are powers of two, 2^10 ns (~1 us) to 2^34 ns (~17 s)
+constexpr int EXPO_MIN_LOG2 = 10;
+constexpr int EXPO_MAX_LOG2 = 34;
+
+int bucket_idx(uint64_t val) {
+        if (val < SUB_BUCKETS) {
+                return (int) val;
+        }
+        int exp = 63 - __builtin_clzll(val);
+        int mant = (int) (val >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return (exp - SUB_BITS + 1) * SUB_BUCKETS + mant;
+}
+
+/// @returns exclusive upper bound of the bucket
+double bucket_upper(int idx) {
+        if (idx < SUB_BUCKETS) {
+                return idx + 1;
+        }
+        int exp = idx / SUB_BUCKETS + SUB_BITS - 1;
+        int mant = idx % SUB_BUCKETS;
+        return (double) (SUB_BUCKETS + mant + 1) * (double) (1ULL << (exp - SUB_BITS));
+}
+
+struct hist_data {
+        atomic<uint64_t> buckets[HIST_BUCKETS];
+        atomic<uint64_t> sum;
+};
+
+/// metrics of one thread, written only by the owning thread
+struct alignas(SPSC_CACHE_LINE) thread_metrics {
+        atomic<uint64_t> counters[MAX_COUNTERS];
+        atomic<hist_data *> histograms[MAX_HISTOGRAMS]; ///< allocated on first record
+};
+
+struct metric_desc {
+        string name;
+        string help;
+        string labels;
+};
+
+struct registry {
+        mutex lock;
+        vector<metric_desc> counters;
+        vector<metric_desc> histograms;
+        std::list<thread_metrics *> threads;
+        thread_metrics retired{}; ///< values of exited threads
+        hist_data retired_hist[MAX_HISTOGRAMS]{};
+};
+
+registry &get_registry() {
+        static auto *r = new registry; // never destroyed - threads may exit after static destructors
+        return *r;
+}
+
+/// owning thread increments are plain load+store (no RMW) since it is the only writer
+inline void add_relaxed(atomic<uint64_t> &a, uint64_t val) {
+        a.store(a.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+}
+
+struct thread_metrics_holder {
+        thread_metrics *m = nullptr;
+        thread_metrics *get() {
+                if (m != nullptr) {
+                        return m;
+                }
+                m = new thread_metrics{};
+                auto &r = get_registry();
+                lock_guard<mutex> lk(r.lock);
+                r.threads.push_back(m);
+                return m;
+        }
+        ~thread_metrics_holder() {
+                if (m == nullptr) {
+                        return;
+                }
+                auto &r = get_registry();
+                lock_guard<mutex> lk(r.lock);
+                for (int i = 0; i < MAX_COUNTERS; ++i) {
+                        add_relaxed(r.retired.counters[i], m->counters[i].load(std::memory_order_relaxed));
+                }
+                for (int i = 0; i < MAX_HISTOGRAMS; ++i) {
+                        hist_data *h = m->histograms[i].load(std::memory_order_relaxed);
+                        if (h == nullptr) {
+                                continue;
+                        }
+                        for (int b = 0; b < HIST_BUCKETS; ++b) {
+                                add_relaxed(r.retired_hist[i].buckets[b], h->buckets[b].load(std::memory_order_relaxed));
+                        }
+                        add_relaxed(r.retired_hist[i].sum, h->sum.load(std::memory_order_relaxed));
+                        delete h;
+                }
+                r.threads.remove(m);
+                delete m;
+        }
+};
+
+thread_local thread_metrics_holder tls_metrics;
+
+int register_metric(vector<metric_desc> &list, size_t max, const char *name, const char *help, const char *labels) {
+        auto &r = get_registry();
+        lock_guard<mutex> lk(r.lock);
+        string l = labels != nullptr ? labels : "";
+        for (size_t i = 0; i < list.size(); ++i) {
+                if (list[i].name == name && list[i].labels == l) {
+                        return (int) i;
+                }
+        }
+        if (list.size() == max) {
+                return -1;
+        }
+        list.push_back({name, help, l});
+        return (int) list.size() - 1;
+}
+
+string format_labels(const string &labels, const string &extra = {}) {
+        if (labels.empty() && extra.empty()) {
+                return {};
+        }
+        return "{" + labels + (!labels.empty() && !extra.empty() ? "," : "") + extra + "}";
+}
+
+/// calls fn(idx) for all metrics of list grouped by name (OpenMetrics requires a family to be contiguous)
+template<typename F>
+void for_each_family(const vector<metric_desc> &list, F fn) {
+        vector<bool> done(list.size());
+        for (size_t i = 0; i < list.size(); ++i) {
+                if (done[i]) {
+                        continue;
+                }
+                for (size_t j = i; j < list.size(); ++j) {
+                        if (list[j].name == list[i].name) {
+                                fn(j, j == i);
+                                done[j] = true;
+                        }
+                }
+        }
+}
+} // end of anonymous namespace
+
+/// handles are index + 1 so that NULL means invalid
+struct metrics_counter *metrics_counter_register(const char *name, const char *help, const char *labels)
+{
+        int idx = register_metric(get_registry().counters, MAX_COUNTERS, name, help, labels);
+        return (struct metrics_counter *) (intptr_t) (idx + 1);
+}
+
+void metrics_counter_add(struct metrics_counter *counter, uint64_t val)
+{
+        if (counter == nullptr) {
+                return;
+        }
+        add_relaxed(tls_metrics.get()->counters[(intptr_t) counter - 1], val);
+}
+
+struct metrics_histogram *metrics_histogram_register(const char *name, const char *help, const char *labels)
+{
+        int idx = register_metric(get_registry().histograms, MAX_HISTOGRAMS, name, help, labels);
+        return (struct metrics_histogram *) (intptr_t) (idx + 1);
+}
+
+void metrics_histogram_record(struct metrics_histogram *histogram, uint64_t duration_ns)
+{
+        if (histogram == nullptr) {
+                return;
+        }
+        auto &slot = tls_metrics.get()->histograms[(intptr_t) histogram - 1];
+        hist_data *h = slot.load(std::memory_order_relaxed);
+        if (h == nullptr) {
+                h = new hist_data{};
+                slot.store(h, std::memory_order_release);
+        }
+        add_relaxed(h->buckets[bucket_idx(duration_ns)], 1);
+        add_relaxed(h->sum, duration_ns);
+}
+
+char *metrics_scrape(void)
+{
+        auto &r = get_registry();
+        std::ostringstream oss;
+        oss << std::setprecision(12);
+        lock_guard<mutex> lk(r.lock);
+
+        for_each_family(r.counters, [&](size_t i, bool first) {
+                const auto &d = r.counters[i];
+                if (first) {
+                        oss << "# TYPE ug_" << d.name << " counter\n# HELP ug_" << d.name << " " << d.help << "\n";
+                }
+                uint64_t val = r.retired.counters[i].load(std::memory_order_relaxed);
+                for (auto *t : r.threads) {
+                        val += t->counters[i].load(std::memory_order_relaxed);
+                }
+                oss << "ug_" << d.name << "_total" << format_labels(d.labels) << " " << val << "\n";
+        });
+
+        for_each_family(r.histograms, [&](size_t i, bool first) {
+                const auto &d = r.histograms[i];
+                if (first) {
+                        oss << "# TYPE ug_" << d.name << "_seconds histogram\n# HELP ug_" << d.name << "_seconds " << d.help << "\n";
+                }
+                vector<uint64_t> buckets(HIST_BUCKETS);
+                uint64_t sum = r.retired_hist[i].sum.load(std::memory_order_relaxed);
+                for (int b = 0; b < HIST_BUCKETS; ++b) {
+                        buckets[b] = r.retired_hist[i].buckets[b].load(std::memory_order_relaxed);
+                }
+                for (auto *t : r.threads) {
+                        hist_data *h = t->histograms[i].load(std::memory_order_acquire);
+                        if (h == nullptr) {
+                                continue;
+                        }
+                        for (int b = 0; b < HIST_BUCKETS; ++b) {
+                                buckets[b] += h->buckets[b].load(std::memory_order_relaxed);
+                        }
+                        sum += h->sum.load(std::memory_order_relaxed);
+                }
+                uint64_t cumulative = 0;
+                int b = 0;
+                for (int exp = EXPO_MIN_LOG2; exp <= EXPO_MAX_LOG2; ++exp) {
+                        const double bound = (double) (1ULL << exp);
+                        for ( ; b < HIST_BUCKETS && bucket_upper(b) <= bound; ++b) {
+                                cumulative += buckets[b];
+                        }
+                        std::ostringstream le;
+                        le << std::setprecision(12) << "le=\"" << bound / 1E9 << "\"";
+                        oss << "ug_" << d.name << "_seconds_bucket" << format_labels(d.labels, le.str()) << " " << cumulative << "\n";
+                }
+                for ( ; b < HIST_BUCKETS; ++b) {
+                        cumulative += buckets[b];
+                }
+                oss << "ug_" << d.name << "_seconds_bucket" << format_labels(d.labels, "le=\"+Inf\"") << " " << cumulative << "\n";
+                oss << "ug_" << d.name << "_seconds_count" << format_labels(d.labels) << " " << cumulative << "\n";
+                oss << "ug_" << d.name << "_seconds_sum" << format_labels(d.labels) << " " << sum / 1E9 << "\n";
+        });
+        oss << "# EOF\n";
+        return strdup(oss.str().c_str());
+}
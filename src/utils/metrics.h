@@ -0,0 +1,88 @@
+/**
+ * @file   utils/metrics.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  always-on pipeline counters and histograms
+ *
+ * Counters and histograms are kept per thread (in a cache-line aligned
+ * block owned by the thread, so the hot path is an uncontended store) and
+ * are aggregated only when scraped - with the control socket command
+ * "metrics" or by HTTP GET /metrics on the control port, both in the
+ * OpenMetrics (Prometheus) text format.
+ *
+ * Metrics are registered once (eg. on module init) and the returned handle
+ * is then used from any thread. Registering the same name and labels again
+ * returns the same handle. NULL handle (registry full) is accepted and ignored
+ * by the update functions.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_METRICS_H_8D2F4A61_0C7E_4B93_A5D1_6E3B9F2C7A48
+#define UTILS_METRICS_H_8D2F4A61_0C7E_4B93_A5D1_6E3B9F2C7A48
+
+#ifdef __cplusplus
+#include <cstdint>
+#else
+#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct metrics_counter;
+struct metrics_histogram;
+
+/**
+ * @param name   metric name without the "ug_" prefix and "_total" suffix, eg. "tx_packets"
+ * @param help   description
+ * @param labels OpenMetrics labels (eg. "stage=\"capture\""), may be NULL
+ */
+struct metrics_counter *metrics_counter_register(const char *name, const char *help, const char *labels);
+void metrics_counter_add(struct metrics_counter *counter, uint64_t val);
+/**
+ * Histogram of durations in nanoseconds (log-linear buckets with 12.5 %
+ * precision), exposed in seconds.
+ * @param name   metric name without the "ug_" prefix and "_seconds" suffix, eg. "compress_duration"
+ */
+struct metrics_histogram *metrics_histogram_register(const char *name, const char *help, const char *labels);
+void metrics_histogram_record(struct metrics_histogram *histogram, uint64_t duration_ns);
+
+/// @returns all metrics in OpenMetrics text format (terminated by "# EOF"), caller frees
+char *metrics_scrape(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // defined UTILS_METRICS_H_8D2F4A61_0C7E_4B93_A5D1_6E3B9F2C7A48
@@ -324,6 +324,60 @@ bool get_local_addresses(struct sockaddr_storage *addrs, size_t *len, int ip_ver
 #endif
 }
 
+/**
+ * Finds the local interface that the traffic to host is routed through.
+ *
+ * @param[out] iface  interface name
+ */
+bool get_iface_for_host(const char *host, char *iface, size_t len)
+{
+#ifdef WIN32
+        UNUSED(host), UNUSED(iface), UNUSED(len);
+        return false;
+#else
+        struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM };
+        struct addrinfo *res = NULL;
+        if (getaddrinfo(host, "9", &hints, &res) != 0) {
+                return false;
+        }
+        struct sockaddr_storage local;
+        socklen_t local_len = sizeof local;
+        int fd = socket(res->ai_family, SOCK_DGRAM, 0);
+        bool found = fd != -1 && connect(fd, res->ai_addr, res->ai_addrlen) == 0
+                && getsockname(fd, (struct sockaddr *) &local, &local_len) == 0;
+        if (fd != -1) {
+                CLOSESOCKET(fd);
+        }
+        freeaddrinfo(res);
+        if (!found) {
+                return false;
+        }
+
+        found = false;
+        struct ifaddrs *a = NULL;
+        if (getifaddrs(&a) != 0) {
+                return false;
+        }
+        for (struct ifaddrs *p = a; p != NULL && !found; p = p->ifa_next) {
+                if (p->ifa_addr == NULL || p->ifa_addr->sa_family != local.ss_family) {
+                        continue;
+                }
+                if (local.ss_family == AF_INET) {
+                        found = ((struct sockaddr_in *) (void *) p->ifa_addr)->sin_addr.s_addr
+                                == ((struct sockaddr_in *) (void *) &local)->sin_addr.s_addr;
+                } else {
+                        found = memcmp(&((struct sockaddr_in6 *) (void *) p->ifa_addr)->sin6_addr,
+                                        &((struct sockaddr_in6 *) (void *) &local)->sin6_addr, sizeof(struct in6_addr)) == 0;
+                }
+                if (found) {
+                        snprintf(iface, len, "%s", p->ifa_name);
+                }
+        }
+        freeifaddrs(a);
+        return found;
+#endif
+}
+
 /**
  * Checks if the address is a dot-separated numeric IPv4 address.
  */
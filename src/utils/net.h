@@ -67,6 +67,7 @@ bool is_host_loopback(const char *hostname);
 bool is_host_private(const char *hostname);
 uint16_t socket_get_recv_port(int fd);
 bool get_local_addresses(struct sockaddr_storage *addrs, size_t *len, int ip_version);
+bool get_iface_for_host(const char *host, char *iface, size_t len);
 bool is_ipv6_supported(void);
 void get_sockaddr_addr_str(struct sockaddr *sa, char *buf, size_t n);
 unsigned get_sockaddr_addr_port(struct sockaddr *sa);
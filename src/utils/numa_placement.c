@@ -0,0 +1,186 @@
+/**
+ * @file   utils/numa_placement.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ *
+ * The topology is read from sysfs - the node of a NIC from
+ * /sys/class/net/<iface>/device/numa_node, CPUs of the node from
+ * /sys/devices/system/node/node<n>/cpulist.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "host.h"
+#include "utils/frame_alloc.h"
+#include "utils/net.h"
+#include "utils/numa_placement.h"
+#include "utils/thread.h"
+
+#define MOD_NAME "[numa] "
+#define PARAM_NAME "numa-placement"
+#define PCI_VENDOR_NVIDIA "0x10de"
+
+ADD_TO_PARAM(PARAM_NAME, "* " PARAM_NAME "=no|<iface>\n"
+                "  Disables placing the receiver threads and frame memory to the NUMA node\n"
+                "  of the NIC (default on multi-node systems) or sets the NIC explicitly.\n");
+
+static const char *const placed_roles[] = { "udp_reader", "receiver_loop", "fec", "decompress" };
+
+#ifdef __linux__
+/// @returns first line of the file (without the newline) or NULL
+static char *read_line(const char *path, char *buf, size_t len)
+{
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+                return NULL;
+        }
+        char *ret = fgets(buf, (int) len, f);
+        fclose(f);
+        if (ret != NULL) {
+                buf[strcspn(buf, "\n")] = '\0';
+        }
+        return ret;
+}
+
+static int get_iface_numa_node(const char *iface)
+{
+        char path[1024];
+        char buf[32];
+        snprintf(path, sizeof path, "/sys/class/net/%s/device/numa_node", iface);
+        return read_line(path, buf, sizeof buf) != NULL ? atoi(buf) : -1;
+}
+
+static bool is_numa_system(void)
+{
+        return access("/sys/devices/system/node/node1", F_OK) == 0;
+}
+
+/// appends nodes of NVIDIA GPUs to buf (the order doesn't need to match CUDA device indices)
+static void get_gpu_nodes(int nic_node, char *buf, size_t len, bool *nic_node_gpu)
+{
+        buf[0] = '\0';
+        *nic_node_gpu = false;
+        DIR *dir = opendir("/sys/bus/pci/devices");
+        if (dir == NULL) {
+                return;
+        }
+        struct dirent *ent = NULL;
+        while ((ent = readdir(dir)) != NULL) {
+                char path[1024];
+                char val[32];
+                snprintf(path, sizeof path, "/sys/bus/pci/devices/%s/vendor", ent->d_name);
+                if (read_line(path, val, sizeof val) == NULL || strcmp(val, PCI_VENDOR_NVIDIA) != 0) {
+                        continue;
+                }
+                snprintf(path, sizeof path, "/sys/bus/pci/devices/%s/class", ent->d_name);
+                if (read_line(path, val, sizeof val) == NULL || strncmp(val, "0x03", 4) != 0) { // display controller
+                        continue;
+                }
+                snprintf(path, sizeof path, "/sys/bus/pci/devices/%s/numa_node", ent->d_name);
+                int node = read_line(path, val, sizeof val) != NULL ? atoi(val) : -1;
+                *nic_node_gpu = *nic_node_gpu || node == nic_node;
+                snprintf(buf + strlen(buf), len - strlen(buf), "%s%s@%d", buf[0] == '\0' ? "" : ", ", ent->d_name, node);
+        }
+        closedir(dir);
+}
+
+bool numa_placement_init(const char *host, char *summary, size_t summary_len)
+{
+        const char *cfg = get_commandline_param(PARAM_NAME);
+        if ((cfg != NULL && strcmp(cfg, "no") == 0) || (cfg == NULL && !is_numa_system())) {
+                return false;
+        }
+        char iface[256] = "";
+        if (cfg != NULL) {
+                snprintf(iface, sizeof iface, "%s", cfg);
+        } else if (host == NULL || !get_iface_for_host(host, iface, sizeof iface)) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cannot determine interface used for %s.\n", host ? host : "(none)");
+                return false;
+        }
+        int node = get_iface_numa_node(iface);
+        if (node < 0) { // virtual interface (loopback, bridge...) or single-node system
+                log_msg(cfg != NULL ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE, MOD_NAME "Unknown NUMA node of %s.\n", iface);
+                return false;
+        }
+        char path[1024];
+        char cpus[1024];
+        snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_line(path, cpus, sizeof cpus) == NULL) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot get CPUs of node %d.\n", node);
+                return false;
+        }
+
+        char roles[256] = "";
+        for (unsigned i = 0; i < sizeof placed_roles / sizeof placed_roles[0]; ++i) {
+                if (set_thread_role_default_cpus(placed_roles[i], cpus)) {
+                        snprintf(roles + strlen(roles), sizeof roles - strlen(roles), "%s%s",
+                                        roles[0] == '\0' ? "" : ", ", placed_roles[i]);
+                }
+        }
+        frame_alloc_set_default_numa_node(node);
+
+        char gpus[256];
+        bool nic_node_gpu = false;
+        get_gpu_nodes(node, gpus, sizeof gpus, &nic_node_gpu);
+        if (gpus[0] != '\0' && !nic_node_gpu) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "No GPU on node %d of %s, consider selecting "
+                                "a GPU from that node for GPU compression (GPUs: %s).\n", node, iface, gpus);
+        }
+        snprintf(summary, summary_len, "%s on node %d (CPUs %s) - threads: %s, frames: %s%s%s", iface, node, cpus,
+                        roles[0] != '\0' ? roles : "(set explicitly)",
+                        frame_alloc_get_default_policy()->numa_node == node ? "same node" : "(set explicitly)",
+                        gpus[0] != '\0' ? ", GPUs: " : "", gpus);
+        return true;
+}
+#else
+bool numa_placement_init(const char *host, char *summary, size_t summary_len)
+{
+        UNUSED(host), UNUSED(summary), UNUSED(summary_len);
+        return false;
+}
+#endif
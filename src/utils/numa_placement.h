@@ -0,0 +1,68 @@
+/**
+ * @file   utils/numa_placement.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  placement of the receiver to the NUMA node of the NIC
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_NUMA_PLACEMENT_H_5B0E7D2C_9A41_4C6F_8E13_2D7F6A9B0C35
+#define UTILS_NUMA_PLACEMENT_H_5B0E7D2C_9A41_4C6F_8E13_2D7F6A9B0C35
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Places the receiving threads (UDP reader, receiver loop, FEC and
+ * decompress) and video frame memory to the NUMA node of the NIC facing
+ * host. Active by default on multi-node systems, controlled with
+ * "--param numa-placement". Must be called before the threads are started.
+ *
+ * @param[out] summary  placement description for the startup summary
+ * @returns true if the placement was applied
+ */
+bool numa_placement_init(const char *host, char *summary, size_t summary_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_NUMA_PLACEMENT_H_5B0E7D2C_9A41_4C6F_8E13_2D7F6A9B0C35
@@ -44,42 +44,45 @@
 #include "utils/parallel_conv.h"
 #include "utils/worker.h"
 
+#define PARALLEL_CONV_CHUNK_BYTES (128 * 1024) ///< input + output bytes per chunk (to stay in L2)
+
+/**
+ * Returns number of rows of a work chunk that keeps both input and output of
+ * the chunk in cache.
+ *
+ * @param row_bytes  sum of input and output bytes per row (of all planes)
+ * @param align      chunk row count alignment (eg. 2 for vertically subsampled chroma)
+ */
+int parallel_conv_chunk_rows(size_t row_bytes, int align)
+{
+        int rows = row_bytes == 0 ? 1 : (int) (PARALLEL_CONV_CHUNK_BYTES / row_bytes);
+        rows = rows / align * align;
+        return rows > 0 ? rows : align;
+}
+
 struct parallel_pix_conv_data {
         decoder_t decode;
-        int height;
         unsigned char *out_data;
         int out_linesize;
         const unsigned char *in_data;
         int in_linesize;
 };
 
-static void *parallel_pix_conv_task(void *arg) {
+static void parallel_pix_conv_rows(void *arg, int begin, int end) {
         struct parallel_pix_conv_data *data = arg;
-        for (int y = 0; y < data->height; ++y) {
-                data->decode(data->out_data, data->in_data, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
-                data->out_data += data->out_linesize;
-                data->in_data += data->in_linesize;
+        unsigned char *out = data->out_data + (size_t) begin * data->out_linesize;
+        const unsigned char *in = data->in_data + (size_t) begin * data->in_linesize;
+        for (int y = begin; y < end; ++y) {
+                data->decode(out, in, data->out_linesize, DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                out += data->out_linesize;
+                in += data->in_linesize;
         }
-        return NULL;
 }
 
-/// @todo utilize respawn_parallel
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads)
 {
-        struct parallel_pix_conv_data data[threads];
-
-        for (int i = 0; i < threads; ++i) {
-                data[i].decode = decode;
-                data[i].height = height / threads;
-                data[i].out_data = (unsigned char *) out + i * data[i].height * out_linesize;
-                data[i].out_linesize = out_linesize;
-                data[i].in_data = (const unsigned char *) in + i * data[i].height * in_linesize;
-                data[i].in_linesize = in_linesize;
-                if (i == threads - 1) {
-                        data[i].height = height - (threads - 1) * (height / threads);
-                }
-        }
-
-        task_run_parallel(parallel_pix_conv_task, threads, data, sizeof data[0], NULL);
+        struct parallel_pix_conv_data data = { decode, (unsigned char *) out, out_linesize,
+                (const unsigned char *) in, in_linesize };
+        task_run_parallel_range(parallel_pix_conv_rows, &data, height,
+                        parallel_conv_chunk_rows(in_linesize + out_linesize, 1), threads);
 }
-
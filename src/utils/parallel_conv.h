@@ -40,10 +40,13 @@
 
 #include "video_codec.h"
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+int parallel_conv_chunk_rows(size_t row_bytes, int align);
 void parallel_pix_conv(int height, char *out, int out_linesize, const char *in, int in_linesize, decoder_t decode, int threads);
 
 #ifdef __cplusplus
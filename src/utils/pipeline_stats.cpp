@@ -0,0 +1,305 @@
+/**
+ * @file   utils/pipeline_stats.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "control_socket.h"
+#include "debug.h"
+#include "host.h"
+#include "module.h"
+#include "utils/alloc_stats.h"
+#include "utils/metrics.h"
+#include "utils/pipeline_stats.h"
+#include "utils/profile_timer.hpp"
+
+#define MOD_NAME "[pipeline] "
+
+using std::atomic;
+using std::lock_guard;
+using std::max;
+using std::mutex;
+using std::ostringstream;
+using std::string;
+
+struct pipeline_stage {
+        char name[32];
+        struct metrics_counter *busy_total;
+        atomic<long long> busy_ns{0};
+        atomic<int> frames{0};
+        atomic<int> active{0};      ///< currently running instances of the stage
+        atomic<int> max_active{0};  ///< in the current interval
+        atomic<long long> queue_fill{0}; ///< sum of queue fill samples in permille
+        atomic<int> queue_samples{0};
+        int alloc_tag;
+};
+
+namespace {
+constexpr int MAX_STAGES = 16;
+constexpr time_ns_t REPORT_INTERVAL = 5 * NS_IN_SEC;
+constexpr int BACKLOG_MIN_FILL = 500; ///< permille
+constexpr int MAX_ALLOC_TAGS = 32;
+
+struct pipeline_registry {
+        mutex lock; ///< guards registration only
+        struct pipeline_stage stages[MAX_STAGES];
+        atomic<int> count{0};
+        atomic<struct control_state *> control{nullptr};
+        atomic<time_ns_t> last_report{0};
+        uint64_t alloc_count_last[MAX_ALLOC_TAGS]; ///< alloc stats at the last report (reporting thread only)
+        uint64_t alloc_bytes_last[MAX_ALLOC_TAGS];
+};
+
+/// @returns allocations and allocated bytes of tag since the last call
+void alloc_delta(pipeline_registry &r, int tag, uint64_t *count, uint64_t *bytes)
+{
+        uint64_t total_count = 0;
+        uint64_t total_bytes = 0;
+        alloc_stats_get(tag, &total_count, &total_bytes);
+        *count = total_count - r.alloc_count_last[tag];
+        *bytes = total_bytes - r.alloc_bytes_last[tag];
+        r.alloc_count_last[tag] = total_count;
+        r.alloc_bytes_last[tag] = total_bytes;
+}
+
+/// reports allocations of the tags that are not stages (eg. the UDP reader) per pipeline frame
+void report_other_allocs(pipeline_registry &r, const bool *stage_tag, int frames)
+{
+        ostringstream log;
+        ostringstream stat;
+        log << std::fixed << std::setprecision(1);
+        stat << "ALLOCS";
+        const int tag_count = std::min(alloc_stats_tag_count(), MAX_ALLOC_TAGS);
+        for (int tag = 0; tag < tag_count; ++tag) {
+                if (stage_tag[tag]) {
+                        continue;
+                }
+                uint64_t count = 0;
+                uint64_t bytes = 0;
+                alloc_delta(r, tag, &count, &bytes);
+                if (frames == 0) {
+                        continue;
+                }
+                log << (tag > 0 ? ", " : "") << alloc_stats_tag_name(tag) << " " << (double) count / frames
+                        << " (" << bytes / frames / 1024.0 << " KiB)";
+                stat << " " << alloc_stats_tag_name(tag) << " " << count / frames << " " << bytes / frames;
+        }
+        if (frames == 0) {
+                return;
+        }
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME "Allocations per frame outside stages: " << log.str() << "\n";
+        control_report_stats(r.control.load(), stat.str());
+}
+
+pipeline_registry &get_registry() {
+        static pipeline_registry registry;
+        return registry;
+}
+
+void report(pipeline_registry &r, time_ns_t elapsed)
+{
+        ostringstream log;
+        ostringstream stat;
+        log << std::fixed << std::setprecision(2);
+        stat << "PIPELINE";
+        const char *bottleneck = nullptr;
+        double bottleneck_util = -1.0;
+        const char *backlog = nullptr;
+        long long backlog_fill = BACKLOG_MIN_FILL - 1;
+
+        const bool allocs = alloc_stats_enabled();
+        bool stage_tag[MAX_ALLOC_TAGS] = {};
+        int max_frames = 0;
+
+        const int count = r.count.load(std::memory_order_acquire);
+        for (int i = 0; i < count; ++i) {
+                struct pipeline_stage &s = r.stages[i];
+                const long long busy = s.busy_ns.exchange(0);
+                const int frames = s.frames.exchange(0);
+                const int concurrency = max(1, s.max_active.exchange(s.active.load()));
+                const int queue_samples = s.queue_samples.exchange(0);
+                const long long queue_fill = s.queue_fill.exchange(0);
+                uint64_t alloc_count = 0;
+                uint64_t alloc_bytes = 0;
+                if (allocs && s.alloc_tag != ALLOC_STATS_OTHER && s.alloc_tag < MAX_ALLOC_TAGS) {
+                        stage_tag[s.alloc_tag] = true;
+                        alloc_delta(r, s.alloc_tag, &alloc_count, &alloc_bytes);
+                }
+                if (frames == 0) {
+                        continue;
+                }
+                max_frames = max(max_frames, frames);
+                const double util = (double) busy / ((double) elapsed * concurrency);
+                const long long idle = max(0LL, elapsed * concurrency - busy);
+                const long long fill = queue_samples > 0 ? queue_fill / queue_samples : -1;
+
+                log << (bottleneck != nullptr ? ", " : "") << s.name << " " << std::setprecision(0) << util * 100.0
+                        << "% (" << std::setprecision(2) << busy / frames / 1E6 << "/" << idle / frames / 1E6
+                        << " ms busy/idle per frame";
+                if (concurrency > 1) {
+                        log << ", " << concurrency << " concurrent";
+                }
+                if (fill >= 0) {
+                        log << ", input queue " << fill / 10 << "% full";
+                }
+                if (allocs) {
+                        log << ", " << alloc_count / frames << " allocs (" << alloc_bytes / frames / 1024.0 << " KiB) per frame";
+                }
+                log << ")";
+                stat << " " << s.name << " util " << (int) (util * 100.0) << " busy_us " << busy / frames / 1000
+                        << " idle_us " << idle / frames / 1000 << " frames " << frames;
+                if (fill >= 0) {
+                        stat << " queue " << fill / 10;
+                }
+                if (allocs) {
+                        stat << " allocs " << alloc_count / frames << " alloc_bytes " << alloc_bytes / frames;
+                }
+
+                if (util > bottleneck_util) {
+                        bottleneck_util = util;
+                        bottleneck = s.name;
+                }
+                if (fill > backlog_fill) {
+                        backlog_fill = fill;
+                        backlog = s.name;
+                }
+        }
+        if (allocs) {
+                report_other_allocs(r, stage_tag, max_frames);
+        }
+        if (bottleneck == nullptr) {
+                return;
+        }
+        stat << " bottleneck " << bottleneck << " backlog " << (backlog != nullptr ? backlog : "none");
+        LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << log.str() << " - busiest: " << bottleneck
+                << ", backing up: " << (backlog != nullptr ? string("queue to ") + backlog : string("none")) << "\n";
+        control_report_stats(r.control.load(), stat.str());
+}
+
+void check_report(time_ns_t now)
+{
+        pipeline_registry &r = get_registry();
+        time_ns_t last = r.last_report.load(std::memory_order_relaxed);
+        if (now - last < REPORT_INTERVAL
+                        || !r.last_report.compare_exchange_strong(last, now)) {
+                return;
+        }
+        report(r, now - last);
+}
+} // end of anonymous namespace
+
+struct pipeline_stage *pipeline_stage_get(struct module *mod, const char *name)
+{
+        pipeline_registry &r = get_registry();
+        if (mod != nullptr && r.control.load() == nullptr) {
+                r.control = (struct control_state *) get_module(get_root_module(mod), "control");
+        }
+
+        lock_guard<mutex> lk(r.lock);
+        const int count = r.count.load(std::memory_order_relaxed);
+        for (int i = 0; i < count; ++i) {
+                if (strcmp(r.stages[i].name, name) == 0) {
+                        return &r.stages[i];
+                }
+        }
+        if (count == MAX_STAGES) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Too many stages, %s not accounted!\n", name);
+                return nullptr;
+        }
+        struct pipeline_stage *s = &r.stages[count];
+        snprintf(s->name, sizeof s->name, "%s", name);
+        s->busy_total = metrics_counter_register("pipeline_busy_ns", "Time spent processing frames by the pipeline stage",
+                        (string("stage=\"") + s->name + "\"").c_str());
+        s->alloc_tag = alloc_stats_tag(s->name);
+        if (count == 0) {
+                r.last_report = get_time_in_ns();
+                if (get_commandline_param("alloc-stats") != nullptr) {
+                        alloc_stats_enable(true);
+                }
+        }
+        r.count.store(count + 1, std::memory_order_release);
+        return s;
+}
+
+time_ns_t pipeline_stage_begin(struct pipeline_stage *stage)
+{
+        if (stage == nullptr) {
+                return 0;
+        }
+        const int active = stage->active.fetch_add(1) + 1;
+        int max_active = stage->max_active.load(std::memory_order_relaxed);
+        while (active > max_active && !stage->max_active.compare_exchange_weak(max_active, active)) {
+        }
+        push_prof_timer(stage->name);
+        alloc_stats_push_tag(stage->alloc_tag);
+        return get_time_in_ns();
+}
+
+void pipeline_stage_end(struct pipeline_stage *stage, time_ns_t start)
+{
+        if (stage == nullptr) {
+                return;
+        }
+        const time_ns_t now = get_time_in_ns();
+        alloc_stats_pop_tag();
+        pop_prof_timer();
+        stage->busy_ns.fetch_add(now - start, std::memory_order_relaxed);
+        stage->frames.fetch_add(1, std::memory_order_relaxed);
+        stage->active.fetch_sub(1, std::memory_order_relaxed);
+        metrics_counter_add(stage->busy_total, now - start);
+        check_report(now);
+}
+
+void pipeline_stage_queue(struct pipeline_stage *stage, int depth, int capacity)
+{
+        if (stage == nullptr || capacity <= 0) {
+                return;
+        }
+        stage->queue_fill.fetch_add(std::min(depth, capacity) * 1000LL / capacity, std::memory_order_relaxed);
+        stage->queue_samples.fetch_add(1, std::memory_order_relaxed);
+}
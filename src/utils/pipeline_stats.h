@@ -0,0 +1,104 @@
+/**
+ * @file   utils/pipeline_stats.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  per-stage busy time accounting and bottleneck detection
+ *
+ * Each stage of the frame pipeline (compress, fec_encode, tx on the sender;
+ * fec_decode, decompress, display on the receiver) marks the time it works
+ * on a frame with pipeline_stage_begin()/pipeline_stage_end(), the time in
+ * between is waiting (for the input or for the output queue). The consumer
+ * of a queue samples its fill with pipeline_stage_queue() before it pops.
+ *
+ * Every 5 seconds, utilization (busy time relative to the wall time and the
+ * concurrency of the stage) and busy/idle time per frame of all active
+ * stages are logged (verbose) and reported to the control socket as
+ * "PIPELINE <stage> util <%> busy_us <n> idle_us <n> frames <n> queue <%> ...
+ * bottleneck <stage> backlog <stage>|none". The bottleneck is the stage with
+ * the highest utilization, the backlog is the stage whose input queue is
+ * full most of the time (at least half full on average).
+ *
+ * The stage spans are also recorded by the profiler (see utils/profile_timer.hpp).
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_PIPELINE_STATS_H_5C1E9A37_2B6D_4E80_9F4A_7D3C0B1E6A25
+#define UTILS_PIPELINE_STATS_H_5C1E9A37_2B6D_4E80_9F4A_7D3C0B1E6A25
+
+#include "tv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct module;
+struct pipeline_stage;
+
+/**
+ * @param mod  any module of the pipeline (used to find the control socket), may be NULL
+ * @param name stage name, the same name returns the same stage
+ * @returns stage handle valid until the program exits, NULL if there is too many stages
+ *          (all functions below accept NULL and do nothing)
+ */
+struct pipeline_stage *pipeline_stage_get(struct module *mod, const char *name);
+/// @returns start time to be passed to pipeline_stage_end()
+time_ns_t pipeline_stage_begin(struct pipeline_stage *stage);
+void pipeline_stage_end(struct pipeline_stage *stage, time_ns_t start);
+/// @param depth    number of items waiting in the input queue of the stage
+/// @param capacity capacity of the queue
+void pipeline_stage_queue(struct pipeline_stage *stage, int depth, int capacity);
+
+#ifdef __cplusplus
+} // extern "C"
+
+/// busy scope of a stage, ended by the destructor or by done()
+class pipeline_stage_timer {
+public:
+        explicit pipeline_stage_timer(struct pipeline_stage *stage)
+                : stage(stage), start(pipeline_stage_begin(stage)) {}
+        ~pipeline_stage_timer() { done(); }
+        pipeline_stage_timer(const pipeline_stage_timer &) = delete;
+        pipeline_stage_timer &operator=(const pipeline_stage_timer &) = delete;
+        void done() {
+                if (stage != nullptr) {
+                        pipeline_stage_end(stage, start);
+                        stage = nullptr;
+                }
+        }
+private:
+        struct pipeline_stage *stage;
+        time_ns_t start;
+};
+#endif
+
+#endif // defined UTILS_PIPELINE_STATS_H_5C1E9A37_2B6D_4E80_9F4A_7D3C0B1E6A25
@@ -1,61 +1,178 @@
-#ifdef BUILD_PROFILED
-
+#include <algorithm>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <sstream>
 #include "profile_timer.hpp"
 
+#define MAX_EXITED_RINGS 64
+#define STREAM_FLUSH_INTERVAL std::chrono::seconds(1)
+
+std::atomic<bool> Profiler::enabled{false};
+std::atomic<unsigned> Profiler::sampling{1};
 std::chrono::steady_clock::time_point Profiler::start_point;
 
-Profiler& Profiler::get_instance(){
-        static Profiler inst;
-        static std::mutex mut;
-        std::lock_guard<std::mutex> lock(mut);
-        if(inst.start_point.time_since_epoch() == std::chrono::steady_clock::duration::zero()){
-                inst.start_point = std::chrono::steady_clock::now();
+static std::condition_variable flusher_cv;
+
+std::vector<Profile_event> Profile_ring::read(uint64_t from, uint64_t *to) const {
+        uint64_t h = head.load(std::memory_order_acquire);
+        uint64_t first = std::max<uint64_t>(from, h > PROFILE_RING_SIZE ? h - PROFILE_RING_SIZE : 0);
+        std::vector<Profile_event> events;
+        events.reserve(h - first);
+        for (uint64_t i = first; i < h; ++i) {
+                const slot &s = slots[i % PROFILE_RING_SIZE];
+                events.push_back({s.name.load(std::memory_order_relaxed),
+                                s.start.load(std::memory_order_relaxed),
+                                s.end.load(std::memory_order_relaxed)});
         }
-        return inst;
+        // drop the slots the producer may have overwritten while copying
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t h2 = head.load(std::memory_order_relaxed);
+        if (h2 > PROFILE_RING_SIZE && h2 - PROFILE_RING_SIZE > first) {
+                size_t overwritten = std::min<uint64_t>(h2 - PROFILE_RING_SIZE - first, events.size());
+                events.erase(events.begin(), events.begin() + overwritten);
+        }
+        *to = h;
+        return events;
 }
 
-void Profiler::write_events(const std::vector<Profile_event>& events){
-        if(!active)
-                return;
-
-        std::lock_guard<std::mutex> lock(io_mut);
-        for(const auto& event : events){
-
-                auto ts = event.start;
-                auto end = event.end;
-                out_file << "{ \"name\": \"" << event.name << "\""
-                        << ", \"cat\": \"function\""
-                        << ", \"ph\": \"X\""
-                        << ", \"pid\": \"" << pid << "\""
-                        << ", \"tid\": \"" << event.thread_id << "\""
-                        << ", \"ts\": \"" << ts << "\""
-                        << ", \"dur\": \"" << end - ts << "\""
-                        << ", \"dbg_end\": \"" << end << "\""
-                        << "},\n ";
-        }
+Profiler& Profiler::get_instance(){
+        static Profiler inst;
+        return inst;
 }
 
 Profiler::Profiler(){
+        start_point = std::chrono::steady_clock::now();
+        std::ostringstream oss;
+        oss << std::this_thread::get_id();
+        pid = oss.str();
+
         const char *env_p = std::getenv("UG_PROFILE");
-        active = env_p && env_p[0] != '\0';
-        if(!active){
+        if(!env_p || env_p[0] == '\0'){
                 return;
         }
 
         std::string filename = "ug_";
         filename += env_p;
         filename += ".json";
-
-        pid = std::this_thread::get_id();
         out_file.open(filename);
-
         out_file << "[ ";
+
+        enabled.store(true, std::memory_order_relaxed);
+        flusher_thread = std::thread(&Profiler::flusher, this);
+}
+
+Profiler::~Profiler(){
+        if(!flusher_thread.joinable()){
+                return;
+        }
+        {
+                std::lock_guard<std::mutex> lock(flusher_mut);
+                should_exit = true;
+        }
+        flusher_cv.notify_one();
+        flusher_thread.join();
+        flush_stream();
+        out_file << "{} ]\n";
+}
+
+void Profiler::set_enabled(bool enable, unsigned sampling){
+        Profiler::sampling.store(std::max(sampling, 1U), std::memory_order_relaxed);
+        enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Profiler::write_event(std::ostream &out, const Profile_ring &ring, const Profile_event &event){
+        out << "{ \"name\": \"" << event.name << "\""
+                << ", \"cat\": \"function\""
+                << ", \"ph\": \"X\""
+                << ", \"pid\": \"" << pid << "\""
+                << ", \"tid\": \"" << ring.thread_id << "\""
+                << ", \"ts\": \"" << event.start << "\""
+                << ", \"dur\": \"" << event.end - event.start << "\""
+                << "},\n ";
+}
+
+Profile_ring *Profiler::register_thread(){
+        auto ring = std::make_unique<Profile_ring>();
+        std::ostringstream oss;
+        oss << std::this_thread::get_id();
+        ring->thread_id = oss.str();
+
+        std::lock_guard<std::mutex> lock(rings_mut);
+        // without the stream, exited rings are kept only for dumps - drop the oldest
+        if(!flusher_thread.joinable()){
+                auto exited = std::count_if(rings.begin(), rings.end(),
+                                [](const auto &r) { return r->exited.load(); });
+                for(auto it = rings.begin(); it != rings.end() && exited > MAX_EXITED_RINGS; ){
+                        if((*it)->exited){
+                                it = rings.erase(it);
+                                exited -= 1;
+                        } else {
+                                ++it;
+                        }
+                }
+        }
+        rings.push_back(std::move(ring));
+        return rings.back().get();
+}
+
+void Profiler::flush_stream(){
+        std::lock_guard<std::mutex> lock(rings_mut);
+        for(auto it = rings.begin(); it != rings.end(); ){
+                Profile_ring &ring = **it;
+                bool exited = ring.exited.load(std::memory_order_acquire);
+                uint64_t to = 0;
+                for(const auto &event : ring.read(ring.flushed, &to)){
+                        write_event(out_file, ring, event);
+                }
+                ring.flushed = to;
+                if(exited){
+                        it = rings.erase(it);
+                } else {
+                        ++it;
+                }
+        }
+        out_file.flush();
+}
+
+void Profiler::flusher(){
+        std::unique_lock<std::mutex> lock(flusher_mut);
+        while(!should_exit){
+                flusher_cv.wait_for(lock, STREAM_FLUSH_INTERVAL);
+                lock.unlock();
+                flush_stream();
+                lock.lock();
+        }
+}
+
+bool Profiler::dump(const std::string &filename, double last_sec){
+        std::ofstream out(filename);
+        if(!out){
+                return false;
+        }
+        int64_t since = 0;
+        if(last_sec > 0){
+                since = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_point).count()
+                        - static_cast<int64_t>(last_sec * 1000000);
+        }
+
+        out << "[ ";
+        {
+                std::lock_guard<std::mutex> lock(rings_mut);
+                for(const auto &ring : rings){
+                        uint64_t to = 0;
+                        for(const auto &event : ring->read(0, &to)){
+                                if(event.end >= since){
+                                        write_event(out, *ring, event);
+                                }
+                        }
+                }
+        }
+        out << "{} ]\n";
+        return static_cast<bool>(out);
 }
 
 Profiler_thread_inst::Profiler_thread_inst(Profiler& profiler) : profiler(profiler) {
-        thread_events.reserve(THREAD_EVENT_BUF_SIZE);
         c_timers.reserve(20);
 }
 
@@ -65,66 +182,110 @@ Profiler_thread_inst& Profiler_thread_inst::get_instance(){
 }
 
 Profiler_thread_inst::~Profiler_thread_inst(){
-        profiler.write_events(thread_events);
+        c_timers.clear();
+        if(ring){
+                ring->exited.store(true, std::memory_order_release);
+        }
 }
 
-void Profiler_thread_inst::add_event(Profile_event&& event){
-        if(thread_events.size() == THREAD_EVENT_BUF_SIZE){
-                profiler.write_events(thread_events);
-                thread_events.clear();
+void Profiler_thread_inst::add_event(const Profile_event& event){
+        if(!ring){
+                ring = profiler.register_thread();
         }
+        ring->push(event);
+        // let the stream flusher catch up before the ring wraps
+        if(ring->head.load(std::memory_order_relaxed) % (PROFILE_RING_SIZE / 2) == 0){
+                flusher_cv.notify_one();
+        }
+}
 
-        thread_events.emplace_back(std::move(event));
+bool Profiler_thread_inst::sample(){
+        if(!Profiler::is_enabled()){
+                return false;
+        }
+        return ++scope_count % Profiler::get_sampling() == 0;
+}
+
+int64_t Profiler_thread_inst::timestamp(){
+        auto ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Profiler::get_start_point()).count();
+
+        /* Chromium has problems if two events within the same thread have
+         * the same start time. To work around this we just add a microsecond
+         * if the start time would be the same as the previous one
+         */
+        if(ts <= last_ts){
+                ts = last_ts + 1;
+        }
+        last_ts = ts;
+        return ts;
 }
 
 void Profiler_thread_inst::push_timer(const char *name){
-        c_timers.emplace_back(std::ref(*this), std::string(name));
+        if(c_timers.empty()){
+                c_timers.emplace_back(*this, name);
+        } else {
+                c_timers.emplace_back(c_timers.back(), name);
+        }
 }
 
 void Profiler_thread_inst::pop_timer(){
-        c_timers.pop_back();
+        if(!c_timers.empty()){
+                c_timers.pop_back();
+        }
 }
 
-Profile_timer::Profile_timer(Profiler_thread_inst& profiler, std::string name) :
-        profiler(profiler),
-        event(name, std::this_thread::get_id())
+Profile_timer::Profile_timer(Profiler_thread_inst& profiler, const char *name) :
+        profiler(&profiler)
 {
-        auto ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - profiler.profiler.get_start_point()).count();
+        if(profiler.sample()){
+                start(name);
+        }
+}
 
-        /* Chromium has problems if two events within the same thread have
-         * the same start time. To work around this we just add a microsecond
-         * if the start time would be the same as the previous one
-         */
-        if(ts <= profiler.last_ts){
-                ts = profiler.last_ts + 1;
+Profile_timer::Profile_timer(const Profile_timer &parent, const char *name) :
+        profiler(parent.profiler)
+{
+        if(parent.active && name[0] != '\0' && Profiler::is_enabled()){
+                start(name);
         }
+}
 
-        event.start = ts;
-        profiler.last_ts = ts;
+void Profile_timer::start(const char *name){
+        active = true;
+        event.name = name;
+        event.start = profiler->timestamp();
 }
 
-Profile_timer::Profile_timer(Profile_timer&& o) :
-        profiler(o.profiler)
+Profile_timer::Profile_timer(Profile_timer&& o) noexcept :
+        profiler(o.profiler),
+        active(o.active),
+        event(o.event)
 {
-        std::swap(event, o.event);
+        o.active = false;
 }
 
 Profile_timer::~Profile_timer(){
         commit();
 }
 
-Profile_timer& Profile_timer::operator=(Profile_timer&& rhs) {
-        std::swap(event, rhs.event);
-        std::swap(profiler, rhs.profiler);
+Profile_timer& Profile_timer::operator=(Profile_timer&& rhs) noexcept {
+        if(this != &rhs){
+                commit();
+                profiler = rhs.profiler;
+                active = rhs.active;
+                event = rhs.event;
+                rhs.active = false;
+        }
         return *this;
 }
 
 void Profile_timer::commit(){
-        if(event.name.empty())
+        if(!active)
                 return;
 
-        event.end = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - profiler.get().profiler.get_start_point()).count();
-        profiler.get().add_event(std::move(event));
+        active = false;
+        event.end = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Profiler::get_start_point()).count();
+        profiler->add_event(event);
 }
 
 void push_prof_timer(const char *name){
@@ -135,4 +296,10 @@ void pop_prof_timer(){
         Profiler_thread_inst::get_instance().pop_timer();
 }
 
-#endif //BUILD_PROFILED
+void profiler_set_enabled(bool enabled, unsigned sampling){
+        Profiler::get_instance().set_enabled(enabled, sampling);
+}
+
+bool profiler_dump(const char *filename, double last_sec){
+        return Profiler::get_instance().dump(filename, last_sec);
+}
@@ -1,7 +1,28 @@
 #ifndef PROFILE_TIMER_HPP
 #define PROFILE_TIMER_HPP
 
-#ifdef BUILD_PROFILED
+/*
+ * Scope profiler producing Chrome trace (chrome://tracing, Perfetto) JSON.
+ *
+ * Always compiled in, disabled by default - a disabled timer costs one relaxed
+ * atomic load. It is enabled either by the UG_PROFILE=<name> environment
+ * variable (events are continuously written to ug_<name>.json by a background
+ * thread) or at runtime with the control socket command "profile on [<n>]"
+ * (every n-th top-level scope of a thread is recorded). Events are kept in
+ * per-thread lock-free rings holding the most recent PROFILE_RING_SIZE
+ * events, so "profile dump [<sec>]" can write the last seconds (flight
+ * recorder) without stopping the program.
+ *
+ * Names passed to the timers must be string literals (or otherwise outlive
+ * the program) - only the pointer is stored.
+ */
+
+#ifdef __cplusplus
+#include <cstddef>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#endif
 
 #define C_PROFILER_PUSH(name) \
         push_prof_timer((name))
@@ -11,38 +32,59 @@
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <chrono>
-#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
-#include <fstream>
-#include <functional>
+#include <vector>
 
-#define THREAD_EVENT_BUF_SIZE 256
+#define PROFILE_RING_SIZE 8192 ///< events kept per thread, power of two
 
 #define PROFILE_FUNC \
         Profile_timer PROFILER_PROFILE_TIMER_FUNC(Profiler_thread_inst::get_instance(), __PRETTY_FUNCTION__); \
-        Profile_timer PROFILER_PROFILE_TIMER_DETAIL(Profiler_thread_inst::get_instance(), "");
+        Profile_timer PROFILER_PROFILE_TIMER_DETAIL(PROFILER_PROFILE_TIMER_FUNC, "");
 
 #define PROFILE_DETAIL(name) \
-        PROFILER_PROFILE_TIMER_DETAIL = Profile_timer(Profiler_thread_inst::get_instance(), (name));
-
+        PROFILER_PROFILE_TIMER_DETAIL = Profile_timer(PROFILER_PROFILE_TIMER_FUNC, (name));
 
 struct Profile_event {
-        Profile_event(std::string name,
-                        std::thread::id thread_id) :
-                name(name),
-                start(),
-                end(),
-                thread_id(thread_id) {  }
-
-        Profile_event() = default;
-
-        std::string name;
-        std::chrono::steady_clock::time_point::rep start;
-        std::chrono::steady_clock::time_point::rep end;
+        const char *name;
+        int64_t start; ///< us since Profiler start point
+        int64_t end;
+};
 
-        std::thread::id thread_id;
+/**
+ * Single-producer ring of the most recent events of one thread. The reader
+ * (flusher or dump) copies the slots and discards those the producer may have
+ * overwritten meanwhile.
+ */
+struct Profile_ring {
+        struct slot {
+                std::atomic<const char *> name;
+                std::atomic<int64_t> start;
+                std::atomic<int64_t> end;
+        };
+        std::unique_ptr<slot[]> slots{new slot[PROFILE_RING_SIZE]};
+        std::atomic<uint64_t> head{0};     ///< total events written
+        uint64_t flushed = 0;              ///< events written to the stream file (flusher only)
+        std::string thread_id;
+        std::atomic<bool> exited{false};   ///< the ring is then owned by the Profiler
+
+        void push(const Profile_event &e) {
+                uint64_t h = head.load(std::memory_order_relaxed);
+                slot &s = slots[h % PROFILE_RING_SIZE];
+                s.name.store(e.name, std::memory_order_relaxed);
+                s.start.store(e.start, std::memory_order_relaxed);
+                s.end.store(e.end, std::memory_order_relaxed);
+                head.store(h + 1, std::memory_order_release);
+        }
+        /// @returns events [from, head) still present in the ring
+        std::vector<Profile_event> read(uint64_t from, uint64_t *to) const;
 };
 
 class Profiler_thread_inst;
@@ -56,8 +98,17 @@ class Profiler {
         Profiler(Profiler&&) = delete;
         Profiler& operator=(Profiler&&) = delete;
         Profiler& operator=(const Profiler&) = delete;
+        ~Profiler();
 
-        void write_events(const std::vector<Profile_event>& events);
+        static bool is_enabled() {
+                return enabled.load(std::memory_order_relaxed);
+        }
+        static unsigned get_sampling() {
+                return sampling.load(std::memory_order_relaxed);
+        }
+        void set_enabled(bool enable, unsigned sampling);
+        /// writes events of all threads younger than last_sec seconds to filename
+        bool dump(const std::string &filename, double last_sec);
 
         static std::chrono::steady_clock::time_point get_start_point(){
                 return start_point;
@@ -65,13 +116,22 @@ class Profiler {
 
         private:
         Profiler();
-
-        std::mutex io_mut;
-        std::ofstream out_file;
-        std::thread::id pid;
-
-        bool active = false;
-
+        Profile_ring *register_thread();
+        void flusher();
+        void flush_stream();
+        void write_event(std::ostream &out, const Profile_ring &ring, const Profile_event &event);
+
+        std::mutex rings_mut;
+        std::list<std::unique_ptr<Profile_ring>> rings;
+
+        std::ofstream out_file;            ///< UG_PROFILE stream
+        std::thread flusher_thread;
+        std::mutex flusher_mut;
+        bool should_exit = false;
+        std::string pid;
+
+        static std::atomic<bool> enabled;
+        static std::atomic<unsigned> sampling; ///< record every n-th top-level scope
         static std::chrono::steady_clock::time_point start_point;
 };
 
@@ -91,34 +151,43 @@ class Profiler_thread_inst {
 
         static Profiler_thread_inst& get_instance();
 
-        void add_event(Profile_event&& event);
+        void add_event(const Profile_event& event);
 
         void push_timer(const char *name);
         void pop_timer();
 
         private:
+        bool sample(); ///< decides if a new top-level scope is recorded
+        int64_t timestamp();
+
         Profiler& profiler;
-        std::vector<Profile_event> thread_events;
-        std::chrono::steady_clock::time_point::rep last_ts;
+        Profile_ring *ring = nullptr;      ///< registered on first event
+        int64_t last_ts = -1;
+        unsigned scope_count = 0;
         std::vector<Profile_timer> c_timers;
 };
 
 class Profile_timer {
         friend Profiler;
         public:
-        Profile_timer(Profiler_thread_inst& profiler, std::string name);
-        Profile_timer(Profile_timer&&);
+        /// top-level timer - recorded if the profiler is enabled and sampled
+        Profile_timer(Profiler_thread_inst& profiler, const char *name);
+        /// nested timer - recorded if parent is recorded
+        Profile_timer(const Profile_timer &parent, const char *name);
+        Profile_timer(Profile_timer&&) noexcept;
         Profile_timer(const Profile_timer&) = delete;
         ~Profile_timer();
 
-        Profile_timer& operator=(Profile_timer&& rhs);
+        Profile_timer& operator=(Profile_timer&& rhs) noexcept;
         Profile_timer& operator=(const Profile_timer&) = delete;
 
         private:
+        void start(const char *name);
         void commit();
 
-        std::reference_wrapper<Profiler_thread_inst> profiler;
-        Profile_event event;
+        Profiler_thread_inst *profiler;
+        bool active = false;
+        Profile_event event{};
 };
 
 #endif //__cplusplus
@@ -128,19 +197,14 @@ extern "C" {
 #endif //__cplusplus
 
         void push_prof_timer(const char *name);
-        void pop_prof_timer();
+        void pop_prof_timer(void);
+        /// @param sampling record every n-th top-level scope (1 - all)
+        void profiler_set_enabled(bool enabled, unsigned sampling);
+        /// @param last_sec dump only the events from the last last_sec seconds (<= 0 - all)
+        bool profiler_dump(const char *filename, double last_sec);
 
 #ifdef __cplusplus
 }
 #endif //__cplusplus
 
-#else //BUILD_PROFILED
-
-#define PROFILE_FUNC
-#define PROFILE_DETAIL(name)
-#define C_PROFILER_PUSH(name)
-#define C_PROFILER_POP
-
-#endif //BUILD_PROFILED
-
 #endif
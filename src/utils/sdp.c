@@ -266,7 +266,7 @@ int sdp_add_audio(bool ipv6, int port, int sample_rate, int channels, audio_code
  */
 int sdp_add_video(bool ipv6, int port, codec_t codec, address_callback_t addr_callback, void *addr_callback_udata)
 {
-    if (codec != H264 && codec != JPEG && codec != MJPG) {
+    if (codec != H264 && codec != H265 && codec != JPEG && codec != MJPG) {
         return -2;
     }
     if (!sdp_state) {
@@ -282,9 +282,10 @@ int sdp_add_video(bool ipv6, int port, codec_t codec, address_callback_t addr_ca
     if (index < 0) {
         return -1;
     }
-    snprintf(sdp_state->stream[index].media_info, STR_LENGTH, "m=video %d RTP/AVP %d\n", port, codec == H264 ? PT_DynRTP_Type96 : PT_JPEG);
-    if (codec == H264) {
-        snprintf(sdp_state->stream[index].rtpmap, STR_LENGTH, "a=rtpmap:%d H264/90000\n", PT_DynRTP_Type96);
+    const bool dynamic_pt = codec == H264 || codec == H265;
+    snprintf(sdp_state->stream[index].media_info, STR_LENGTH, "m=video %d RTP/AVP %d\n", port, dynamic_pt ? PT_DynRTP_Type96 : PT_JPEG);
+    if (dynamic_pt) {
+        snprintf(sdp_state->stream[index].rtpmap, STR_LENGTH, "a=rtpmap:%d %s/90000\n", PT_DynRTP_Type96, codec == H264 ? "H264" : "H265");
     }
 
     sdp_state->video_set = true;
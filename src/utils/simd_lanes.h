@@ -0,0 +1,306 @@
+/**
+ * @file   utils/simd_lanes.h
+ * @brief  lane-local SIMD abstraction shared by the SIMD converter templates
+ *
+ * The first inclusion detects the available instruction sets and defines
+ * PIXFMT_SIMD_{SSE4,AVX2,AVX512,NEON} IDs and <isa>_available() checks.
+ *
+ * Every inclusion with PIXFMT_SIMD_ISA set defines SIMD_FUNC, SIMD_FN(),
+ * VEC and V_* operations over 1, 2 or 4 128-bit lanes of that instruction
+ * set. Include the file with SIMD_LANES_UNDEF defined to undefine the
+ * ISA-specific macros again before switching to another instruction set.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_SIMD_LANES_H_COMMON
+#define UTILS_SIMD_LANES_H_COMMON
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#define PIXFMT_SIMD_SSE4   1
+#define PIXFMT_SIMD_AVX2   2
+#define PIXFMT_SIMD_AVX512 3
+#define PIXFMT_SIMD_NEON   4
+
+#if (defined __x86_64__ || defined __i386__) && (defined __clang__ || __GNUC__ >= 9) && !defined WORDS_BIGENDIAN
+#define PIXFMT_SIMD_X86 1
+#include <immintrin.h>
+
+static inline bool sse4_available(void)
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1");
+}
+
+static inline bool avx2_available(void)
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+}
+
+static inline bool avx512_available(void)
+{
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+}
+#endif
+#if defined __aarch64__ && defined __ARM_NEON && !defined WORDS_BIGENDIAN
+#define PIXFMT_SIMD_NEON_ENABLED 1
+#include <arm_neon.h>
+
+static inline bool neon_available(void)
+{
+        return true;
+}
+#endif
+#endif // !defined UTILS_SIMD_LANES_H_COMMON
+
+#if defined SIMD_LANES_UNDEF
+#undef SIMD_FUNC
+#undef PIXFMT_SIMD_SUFFIX
+#undef VEC
+#undef V_LANES
+#undef V_CONST
+#undef V_SET1_32
+#undef V_SHUF
+#undef V_AND
+#undef V_OR
+#undef V_ADD16
+#undef V_ADD32
+#undef V_SRLI16
+#undef V_SLLI16
+#undef V_SRLI32
+#undef V_SLLI32
+#undef V_SRAI32
+#undef V_MULLO32
+#undef V_MAX32
+#undef V_MIN32
+#undef V_SWAP32
+#undef V_BSRLI8
+#undef V_XOR
+#undef V_HADDU8
+#undef V_U32
+#undef V_S32
+#undef V_U16
+
+#elif defined PIXFMT_SIMD_ISA
+#define SIMD_FN_(name, suffix) name ## _ ## suffix
+#define SIMD_FN_EXP(name, suffix) SIMD_FN_(name, suffix)
+#define SIMD_FN(name) SIMD_FN_EXP(name, PIXFMT_SIMD_SUFFIX)
+
+#if PIXFMT_SIMD_ISA == PIXFMT_SIMD_AVX512
+#define PIXFMT_SIMD_SUFFIX avx512
+#define SIMD_FUNC static __attribute__((target("avx512f,avx512bw")))
+#define VEC __m512i
+#define V_LANES 4
+SIMD_FUNC inline __m512i SIMD_FN(load_lanes)(const unsigned char *p, int stride)
+{
+        if (stride == 16) {
+                return _mm512_loadu_si512((const void *) p);
+        }
+        __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)(const void *) p));
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)(const void *) (p + stride)), 1);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)(const void *) (p + 2 * stride)), 2);
+        return _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)(const void *) (p + 3 * stride)), 3);
+}
+SIMD_FUNC inline void SIMD_FN(store)(unsigned char *p, __m512i v)
+{
+        _mm512_storeu_si512((void *) p, v);
+}
+SIMD_FUNC inline void SIMD_FN(store_lane)(unsigned char *p, __m512i v, int k)
+{
+        __m128i l = k == 0 ? _mm512_castsi512_si128(v) : k == 1 ? _mm512_extracti32x4_epi32(v, 1)
+                : k == 2 ? _mm512_extracti32x4_epi32(v, 2) : _mm512_extracti32x4_epi32(v, 3);
+        _mm_storeu_si128((__m128i *)(void *) p, l);
+}
+#define V_CONST(tbl)    _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(const void *) (tbl)))
+#define V_SET1_32(x)    _mm512_set1_epi32(x)
+#define V_SHUF(a, t)    _mm512_shuffle_epi8(a, t)
+#define V_AND(a, b)     _mm512_and_si512(a, b)
+#define V_OR(a, b)      _mm512_or_si512(a, b)
+#define V_ADD16(a, b)   _mm512_add_epi16(a, b)
+#define V_ADD32(a, b)   _mm512_add_epi32(a, b)
+#define V_SRLI16(a, n)  _mm512_srli_epi16(a, n)
+#define V_SLLI16(a, n)  _mm512_slli_epi16(a, n)
+#define V_SRLI32(a, n)  _mm512_srli_epi32(a, n)
+#define V_SLLI32(a, n)  _mm512_slli_epi32(a, n)
+#define V_SRAI32(a, n)  _mm512_srai_epi32(a, n)
+#define V_MULLO32(a, b) _mm512_mullo_epi32(a, b)
+#define V_MAX32(a, b)   _mm512_max_epi32(a, b)
+#define V_MIN32(a, b)   _mm512_min_epi32(a, b)
+#define V_SWAP32(a)     _mm512_shuffle_epi32(a, (_MM_PERM_ENUM) 0xB1)
+#define V_BSRLI8(a)     _mm512_bsrli_epi128(a, 8)
+#define V_XOR(a, b)     _mm512_xor_si512(a, b)
+/// (a + b) / 2 for unsigned bytes (truncating)
+#define V_HADDU8(a, b)  _mm512_sub_epi8(_mm512_avg_epu8(a, b), _mm512_and_si512(_mm512_xor_si512(a, b), _mm512_set1_epi8(1)))
+
+#elif PIXFMT_SIMD_ISA == PIXFMT_SIMD_AVX2
+#define PIXFMT_SIMD_SUFFIX avx2
+#define SIMD_FUNC static __attribute__((target("avx2")))
+#define VEC __m256i
+#define V_LANES 2
+SIMD_FUNC inline __m256i SIMD_FN(load_lanes)(const unsigned char *p, int stride)
+{
+        if (stride == 16) {
+                return _mm256_loadu_si256((const __m256i *)(const void *) p);
+        }
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) p)),
+                        _mm_loadu_si128((const __m128i *)(const void *) (p + stride)), 1);
+}
+SIMD_FUNC inline void SIMD_FN(store)(unsigned char *p, __m256i v)
+{
+        _mm256_storeu_si256((__m256i *)(void *) p, v);
+}
+SIMD_FUNC inline void SIMD_FN(store_lane)(unsigned char *p, __m256i v, int k)
+{
+        _mm_storeu_si128((__m128i *)(void *) p, k == 0 ? _mm256_castsi256_si128(v) : _mm256_extracti128_si256(v, 1));
+}
+#define V_CONST(tbl)    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(const void *) (tbl)))
+#define V_SET1_32(x)    _mm256_set1_epi32(x)
+#define V_SHUF(a, t)    _mm256_shuffle_epi8(a, t)
+#define V_AND(a, b)     _mm256_and_si256(a, b)
+#define V_OR(a, b)      _mm256_or_si256(a, b)
+#define V_ADD16(a, b)   _mm256_add_epi16(a, b)
+#define V_ADD32(a, b)   _mm256_add_epi32(a, b)
+#define V_SRLI16(a, n)  _mm256_srli_epi16(a, n)
+#define V_SLLI16(a, n)  _mm256_slli_epi16(a, n)
+#define V_SRLI32(a, n)  _mm256_srli_epi32(a, n)
+#define V_SLLI32(a, n)  _mm256_slli_epi32(a, n)
+#define V_SRAI32(a, n)  _mm256_srai_epi32(a, n)
+#define V_MULLO32(a, b) _mm256_mullo_epi32(a, b)
+#define V_MAX32(a, b)   _mm256_max_epi32(a, b)
+#define V_MIN32(a, b)   _mm256_min_epi32(a, b)
+#define V_SWAP32(a)     _mm256_shuffle_epi32(a, 0xB1)
+#define V_BSRLI8(a)     _mm256_bsrli_epi128(a, 8)
+#define V_XOR(a, b)     _mm256_xor_si256(a, b)
+#define V_HADDU8(a, b)  _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)))
+
+#elif PIXFMT_SIMD_ISA == PIXFMT_SIMD_SSE4
+#define PIXFMT_SIMD_SUFFIX sse4
+#define SIMD_FUNC static __attribute__((target("sse4.1")))
+#define VEC __m128i
+#define V_LANES 1
+SIMD_FUNC inline __m128i SIMD_FN(load_lanes)(const unsigned char *p, int stride)
+{
+        (void) stride;
+        return _mm_loadu_si128((const __m128i *)(const void *) p);
+}
+SIMD_FUNC inline void SIMD_FN(store)(unsigned char *p, __m128i v)
+{
+        _mm_storeu_si128((__m128i *)(void *) p, v);
+}
+SIMD_FUNC inline void SIMD_FN(store_lane)(unsigned char *p, __m128i v, int k)
+{
+        (void) k;
+        _mm_storeu_si128((__m128i *)(void *) p, v);
+}
+#define V_CONST(tbl)    _mm_loadu_si128((const __m128i *)(const void *) (tbl))
+#define V_SET1_32(x)    _mm_set1_epi32(x)
+#define V_SHUF(a, t)    _mm_shuffle_epi8(a, t)
+#define V_AND(a, b)     _mm_and_si128(a, b)
+#define V_OR(a, b)      _mm_or_si128(a, b)
+#define V_ADD16(a, b)   _mm_add_epi16(a, b)
+#define V_ADD32(a, b)   _mm_add_epi32(a, b)
+#define V_SRLI16(a, n)  _mm_srli_epi16(a, n)
+#define V_SLLI16(a, n)  _mm_slli_epi16(a, n)
+#define V_SRLI32(a, n)  _mm_srli_epi32(a, n)
+#define V_SLLI32(a, n)  _mm_slli_epi32(a, n)
+#define V_SRAI32(a, n)  _mm_srai_epi32(a, n)
+#define V_MULLO32(a, b) _mm_mullo_epi32(a, b)
+#define V_MAX32(a, b)   _mm_max_epi32(a, b)
+#define V_MIN32(a, b)   _mm_min_epi32(a, b)
+#define V_SWAP32(a)     _mm_shuffle_epi32(a, 0xB1)
+#define V_BSRLI8(a)     _mm_srli_si128(a, 8)
+#define V_XOR(a, b)     _mm_xor_si128(a, b)
+#define V_HADDU8(a, b)  _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)))
+
+#elif PIXFMT_SIMD_ISA == PIXFMT_SIMD_NEON
+#define PIXFMT_SIMD_SUFFIX neon
+#define SIMD_FUNC static
+#define VEC uint8x16_t
+#define V_LANES 1
+static inline uint8x16_t SIMD_FN(load_lanes)(const unsigned char *p, int stride)
+{
+        (void) stride;
+        return vld1q_u8(p);
+}
+static inline void SIMD_FN(store)(unsigned char *p, uint8x16_t v)
+{
+        vst1q_u8(p, v);
+}
+static inline void SIMD_FN(store_lane)(unsigned char *p, uint8x16_t v, int k)
+{
+        (void) k;
+        vst1q_u8(p, v);
+}
+#define V_U32(a)        vreinterpretq_u32_u8(a)
+#define V_S32(a)        vreinterpretq_s32_u8(a)
+#define V_U16(a)        vreinterpretq_u16_u8(a)
+#define V_CONST(tbl)    vld1q_u8((const uint8_t *) (const void *) (tbl))
+#define V_SET1_32(x)    vreinterpretq_u8_s32(vdupq_n_s32(x))
+#define V_SHUF(a, t)    vqtbl1q_u8(a, t)
+#define V_AND(a, b)     vandq_u8(a, b)
+#define V_OR(a, b)      vorrq_u8(a, b)
+#define V_ADD16(a, b)   vreinterpretq_u8_u16(vaddq_u16(V_U16(a), V_U16(b)))
+#define V_ADD32(a, b)   vreinterpretq_u8_u32(vaddq_u32(V_U32(a), V_U32(b)))
+#define V_SRLI16(a, n)  vreinterpretq_u8_u16(vshrq_n_u16(V_U16(a), n))
+#define V_SLLI16(a, n)  vreinterpretq_u8_u16(vshlq_n_u16(V_U16(a), n))
+#define V_SRLI32(a, n)  vreinterpretq_u8_u32(vshrq_n_u32(V_U32(a), n))
+#define V_SLLI32(a, n)  vreinterpretq_u8_u32(vshlq_n_u32(V_U32(a), n))
+#define V_SRAI32(a, n)  vreinterpretq_u8_s32(vshrq_n_s32(V_S32(a), n))
+#define V_MULLO32(a, b) vreinterpretq_u8_s32(vmulq_s32(V_S32(a), V_S32(b)))
+#define V_MAX32(a, b)   vreinterpretq_u8_s32(vmaxq_s32(V_S32(a), V_S32(b)))
+#define V_MIN32(a, b)   vreinterpretq_u8_s32(vminq_s32(V_S32(a), V_S32(b)))
+#define V_SWAP32(a)     vreinterpretq_u8_u32(vrev64q_u32(V_U32(a)))
+#define V_BSRLI8(a)     vextq_u8(a, vdupq_n_u8(0), 8)
+#define V_XOR(a, b)     veorq_u8(a, b)
+#define V_HADDU8(a, b)  vhaddq_u8(a, b)
+#else
+#error PIXFMT_SIMD_ISA not set
+#endif
+
+#define V_LOAD(p, stride) SIMD_FN(load_lanes)(p, stride)
+/// stores all lanes of v, lane k at p + k * stride
+#define V_STORE_LANES(p, stride, v) do { \
+        if ((stride) == 16) { \
+                SIMD_FN(store)(p, v); \
+                break; \
+        } \
+        for (int k_ = 0; k_ < V_LANES; ++k_) { \
+                SIMD_FN(store_lane)((p) + k_ * (stride), v, k_); \
+        } \
+} while (0)
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file   utils/spsc_queue.h
+ * @brief  bounded lock-free single-producer single-consumer queue
+ *
+ * Drop-in replacement of @ref synchronized_queue for hand-offs between
+ * exactly two threads. Elements are passed through a ring without locking,
+ * a waiting side optionally spins first and then sleeps on a futex (Linux)
+ * or a condition variable. The other side issues a wake-up only if there
+ * is someone sleeping.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_SPSC_QUEUE_H_
+#define UTILS_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif
+
+#define SPSC_CACHE_LINE 64
+
+/// waiting for a condition changed by one other thread (at most one waiter)
+class spsc_waiter {
+public:
+        /**
+         * @param ready      predicate to be waited for
+         * @param spin_count number of checks before going to sleep
+         */
+        template<typename Pred>
+        void wait(Pred ready, int spin_count) {
+                for (int i = 0; i < spin_count; ++i) {
+                        if (ready()) {
+                                return;
+                        }
+                        cpu_relax();
+                }
+#ifdef __linux__
+                while (!ready()) {
+                        uint32_t seq = m_seq.load(std::memory_order_acquire);
+                        m_waiting.store(true, std::memory_order_relaxed);
+                        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with notify()
+                        if (ready()) {
+                                break;
+                        }
+                        syscall(SYS_futex, &m_seq, FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+                }
+                m_waiting.store(false, std::memory_order_relaxed);
+#else
+                std::unique_lock<std::mutex> l(m_lock);
+                m_waiting.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                m_cv.wait(l, ready);
+                m_waiting.store(false, std::memory_order_relaxed);
+#endif
+        }
+        /// to be called after the state checked by the waiter was changed
+        void notify() {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!m_waiting.load(std::memory_order_relaxed)) {
+                        return;
+                }
+#ifdef __linux__
+                m_seq.fetch_add(1, std::memory_order_release);
+                syscall(SYS_futex, &m_seq, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+                { std::lock_guard<std::mutex> l(m_lock); }
+                m_cv.notify_one();
+#endif
+        }
+
+private:
+        static void cpu_relax() {
+#if defined __x86_64__ || defined __i386__
+                _mm_pause();
+#elif defined __aarch64__
+                __asm__ volatile("yield");
+#endif
+        }
+        std::atomic<bool> m_waiting{false};
+#ifdef __linux__
+        std::atomic<uint32_t> m_seq{0};
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32-bit");
+#else
+        std::mutex m_lock;
+        std::condition_variable m_cv;
+#endif
+};
+
+/**
+ * @tparam T        type to be stored (default-constructed value is returned by nonblocking pop())
+ * @tparam capacity maximal number of elements until push() blocks, must be a power of 2
+ */
+template<typename T, unsigned int capacity = 1>
+class spsc_queue {
+        static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+public:
+        /// sets number of spins before a blocking push()/pop() goes to sleep (0 - sleep immediately)
+        void set_spin_count(int count) {
+                m_spin_count = count;
+        }
+
+        int size() const {
+                return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+        }
+
+        void push(T const & item) {
+                T copy = item;
+                push(std::move(copy));
+        }
+
+        /// may be called only from the producer thread
+        void push(T && item) {
+                const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+                m_not_full.wait([this, tail] {
+                                return tail - m_head.load(std::memory_order_acquire) < capacity; },
+                                m_spin_count);
+                m_items[tail % capacity] = std::move(item);
+                m_tail.store(tail + 1, std::memory_order_release);
+                m_not_empty.notify();
+        }
+
+        /// may be called only from the consumer thread
+        T pop(bool nonblocking = false) {
+                const uint32_t head = m_head.load(std::memory_order_relaxed);
+                auto ready = [this, head] { return m_tail.load(std::memory_order_acquire) != head; };
+                if (nonblocking && !ready()) {
+                        return T();
+                }
+                m_not_empty.wait(ready, m_spin_count);
+                T ret = std::move(m_items[head % capacity]);
+                m_head.store(head + 1, std::memory_order_release);
+                m_not_full.notify();
+                return ret;
+        }
+
+private:
+        alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> m_head{0}; ///< written by consumer
+        alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> m_tail{0}; ///< written by producer
+        alignas(SPSC_CACHE_LINE) T m_items[capacity];
+        spsc_waiter m_not_empty; ///< consumer waits here
+        spsc_waiter m_not_full;  ///< producer waits here
+        int m_spin_count = 0;
+};
+
+#endif // defined UTILS_SPSC_QUEUE_H_
+
@@ -42,6 +42,9 @@
 #endif
 
 #include <libgen.h>
+#ifdef HAVE_LINUX
+#include <sched.h>
+#endif
 #ifdef HAVE_SETTHREADDESCRIPTION
 #include <processthreadsapi.h>
 // TODO: not yet present in MinGW headers - remove when available
@@ -52,6 +55,171 @@ HRESULT SetThreadDescription( HANDLE hThread, PCWSTR lpThreadDescription);
 #include "host.h"
 #include "utils/thread.h"
 
+#define MOD_NAME "[thread] "
+#define PARAM_NAME "thread-affinity"
+#define MAX_THREAD_ROLES 32
+#define MAX_CPUS 1024
+#define DEFAULT_RT_PRIORITY 50
+
+ADD_TO_PARAM(PARAM_NAME, "* " PARAM_NAME "=<role>:[<cpus>][:fifo[=<prio>]][,<role>...]\n"
+                "  Pins threads of given role to <cpus> (eg. 2 or 4-7+12, '+' separated)\n"
+                "  and optionally runs them with SCHED_FIFO (priority default 50, needs\n"
+                "  CAP_SYS_NICE). Role is the thread name without the program prefix\n"
+                "  and \"_thread\" suffix, eg. capture, udp_reader, fec, decompress,\n"
+                "  display, audio_sender, audio_receiver, worker (Linux only).\n");
+
+struct thread_role {
+        char name[32];
+        unsigned long long cpus[MAX_CPUS / 64];
+        bool has_cpus;
+        int rt_priority; ///< SCHED_FIFO priority, 0 - keep default policy
+};
+
+static struct thread_role thread_roles[MAX_THREAD_ROLES];
+static int thread_role_count;
+static pthread_once_t thread_roles_once = PTHREAD_ONCE_INIT;
+
+static bool parse_cpus(char *cpus, struct thread_role *role)
+{
+        char *save_ptr = NULL;
+        char *item = NULL;
+        while ((item = strtok_r(cpus, "+,", &save_ptr)) != NULL) {
+                cpus = NULL;
+                char *endptr = NULL;
+                long first = strtol(item, &endptr, 10);
+                long last = first;
+                if (*endptr == '-') {
+                        last = strtol(endptr + 1, &endptr, 10);
+                }
+                if (endptr == item || *endptr != '\0' || first < 0 || last < first || last >= MAX_CPUS) {
+                        return false;
+                }
+                for (long i = first; i <= last; ++i) {
+                        role->cpus[i / 64] |= 1ULL << (i % 64);
+                }
+                role->has_cpus = true;
+        }
+        return true;
+}
+
+static bool parse_role(char *cfg, struct thread_role *role)
+{
+        char *cpus = strchr(cfg, ':');
+        if (cpus == NULL || cpus == cfg || (size_t) (cpus - cfg) >= sizeof role->name) {
+                return false;
+        }
+        *cpus++ = '\0';
+        strncpy(role->name, cfg, sizeof role->name - 1);
+        char *sched = strchr(cpus, ':');
+        if (sched != NULL) {
+                *sched++ = '\0';
+                if (strcmp(sched, "fifo") == 0) {
+                        role->rt_priority = DEFAULT_RT_PRIORITY;
+                } else if (strncmp(sched, "fifo=", strlen("fifo=")) == 0) {
+                        role->rt_priority = atoi(sched + strlen("fifo="));
+                        if (role->rt_priority <= 0) {
+                                return false;
+                        }
+                } else {
+                        return false;
+                }
+        }
+        return parse_cpus(cpus, role);
+}
+
+static void init_thread_roles(void)
+{
+        const char *cfg = get_commandline_param(PARAM_NAME);
+        if (cfg == NULL) {
+                return;
+        }
+        char *tmp = strdup(cfg);
+        char *save_ptr = NULL;
+        char *item = NULL;
+        char *it = tmp;
+        while ((item = strtok_r(it, ",", &save_ptr)) != NULL) {
+                it = NULL;
+                if (thread_role_count == MAX_THREAD_ROLES) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Too many thread roles, ignoring %s.\n", item);
+                        break;
+                }
+                struct thread_role role = { 0 };
+                if (!parse_role(item, &role)) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong " PARAM_NAME " item: %s\n", item);
+                        continue;
+                }
+                thread_roles[thread_role_count++] = role;
+        }
+        free(tmp);
+}
+
+/// @returns role matching the thread name either exactly or with "_thread" suffix
+static const struct thread_role *get_thread_role(const char *name)
+{
+        pthread_once(&thread_roles_once, init_thread_roles);
+        for (int i = 0; i < thread_role_count; ++i) {
+                size_t len = strlen(thread_roles[i].name);
+                if (strncmp(name, thread_roles[i].name, len) == 0
+                                && (name[len] == '\0' || strcmp(name + len, "_thread") == 0)) {
+                        return &thread_roles[i];
+                }
+        }
+        return NULL;
+}
+
+bool set_thread_role_default_cpus(const char *role, const char *cpus)
+{
+        pthread_once(&thread_roles_once, init_thread_roles);
+        for (int i = 0; i < thread_role_count; ++i) {
+                if (strcmp(thread_roles[i].name, role) == 0) {
+                        return false;
+                }
+        }
+        struct thread_role new_role = { 0 };
+        char *tmp = strdup(cpus);
+        bool ret = thread_role_count < MAX_THREAD_ROLES && strlen(role) < sizeof new_role.name
+                && parse_cpus(tmp, &new_role);
+        free(tmp);
+        if (ret) {
+                strncpy(new_role.name, role, sizeof new_role.name - 1);
+                thread_roles[thread_role_count++] = new_role;
+        }
+        return ret;
+}
+
+static void apply_thread_role(const char *name)
+{
+        const struct thread_role *role = get_thread_role(name);
+        if (role == NULL) {
+                return;
+        }
+#ifdef HAVE_LINUX
+        if (role->has_cpus) {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                for (int i = 0; i < MAX_CPUS && i < CPU_SETSIZE; ++i) {
+                        if ((role->cpus[i / 64] & (1ULL << (i % 64))) != 0) {
+                                CPU_SET(i, &cpus);
+                        }
+                }
+                int rc = pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus);
+                if (rc != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set affinity of %s: %s\n", name, strerror(rc));
+                }
+        }
+        if (role->rt_priority > 0) {
+                struct sched_param param = { .sched_priority = role->rt_priority };
+                int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+                if (rc != 0) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot set SCHED_FIFO for %s: %s\n", name, strerror(rc));
+                }
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Thread %s placement applied.\n", name);
+#else
+        log_msg(LOG_LEVEL_WARNING, MOD_NAME PARAM_NAME " not supported on this platform, ignoring for %s.\n", name);
+#endif
+}
+
 #if ! defined  WIN32 || defined HAVE_SETTHREADDESCRIPTION
 static inline char *get_argv_program_name(void) {
         if (uv_argv != NULL && uv_argv[0] != NULL) {
@@ -67,6 +235,7 @@ static inline char *get_argv_program_name(void) {
 #endif
 
 void set_thread_name(const char *name) {
+        apply_thread_role(name);
 #ifdef HAVE_LINUX
 // thread name can have at most 16 chars (including terminating null char)
         char *prog_name = get_argv_program_name();
@@ -38,11 +38,26 @@
 #ifndef UTILS_THREAD_H_
 #define UTILS_THREAD_H_
 
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Sets the name of the calling thread and applies CPU affinity and
+ * scheduling policy configured for the name (role) with
+ * "--param thread-affinity".
+ */
 void set_thread_name(const char *name);
+/**
+ * Places threads of the role to cpus (Linux cpulist format, eg. "0-7,16")
+ * unless the role is configured explicitly. Must be called before the
+ * threads of the role are started.
+ */
+bool set_thread_role_default_cpus(const char *role, const char *cpus);
 
 #ifdef __cplusplus
 }
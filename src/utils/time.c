@@ -41,8 +41,27 @@
 #include "config_win32.h"
 #endif
 
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined __x86_64__ && defined __linux__ && (defined __GNUC__ || defined __clang__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC_CLOCK 1
+#endif
+
+#include "debug.h"
+#include "host.h"
 #include "utils/time.h"
 
+#define MOD_NAME "[clock] "
+#define TSC_REANCHOR_NS (250 * NS_IN_MS)
+#define TSC_MAX_RATE_DEVIATION 0.001 ///< larger change of the measured rate is considered a clock step
+#define TSC_MAX_REJECTED 4           ///< accept the measured rate after that many rejections (the previous was wrong)
+
 void format_time_ms(uint64_t ts, char buf[static FORMAT_TIME_MS_BUF_LEN]) {
         int ms = ts % 1000;
         ts /= 1000;
@@ -54,3 +73,145 @@ void format_time_ms(uint64_t ts, char buf[static FORMAT_TIME_MS_BUF_LEN]) {
 
         snprintf(buf, FORMAT_TIME_MS_BUF_LEN, "%02d:%02d:%02d.%03d", h, m, s, ms);
 }
+
+ADD_TO_PARAM("clock",
+                "* clock=system|tsc\n"
+                "  Clock used for per-packet timestamps, \"tsc\" (default if supported) is TSC re-anchored to the system clock\n");
+
+enum fast_clock_source {
+        FAST_CLOCK_UNKNOWN = 0,
+        FAST_CLOCK_SYSTEM,
+        FAST_CLOCK_TSC,
+};
+
+static _Atomic int fast_clock_source;
+
+#ifdef HAVE_TSC_CLOCK
+/**
+ * Anchor (TSC value and corresponding system time) and TSC rate, guarded by a
+ * sequence lock (odd seq - update in progress). Only one thread updates at a
+ * time (updating flag), others meanwhile fall back to the system clock.
+ */
+static struct {
+        _Atomic unsigned seq;
+        _Atomic uint64_t tsc0;
+        _Atomic time_ns_t ns0;
+        _Atomic uint64_t mult;             ///< ns per tick, 32.32 fixed point, 0 until calibrated
+        _Atomic uint64_t reanchor_ticks;   ///< ticks after anchor when it is refreshed
+        atomic_flag updating;
+        int rejected;                      ///< consecutive rejected rate measurements (updater only)
+} tsc_clock = { .updating = ATOMIC_FLAG_INIT };
+
+static bool tsc_usable(void)
+{
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) {
+                return false;
+        }
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        if ((edx & (1U << 8U)) == 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "TSC is not invariant\n");
+                return false;
+        }
+        // the kernel rejects TSC if it is not synchronized among CPUs (or unstable in a VM)
+        FILE *f = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+        if (f == NULL) {
+                return false;
+        }
+        char buf[32] = "";
+        bool ret = fgets(buf, sizeof buf, f) != NULL && strncmp(buf, "tsc", 3) == 0;
+        fclose(f);
+        if (!ret) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "TSC is not the kernel clocksource\n");
+        }
+        return ret;
+}
+
+/// refreshes the anchor and measures the rate since the previous anchor
+static void tsc_reanchor(uint64_t tsc, time_ns_t now)
+{
+        if (atomic_flag_test_and_set_explicit(&tsc_clock.updating, memory_order_acquire)) {
+                return;
+        }
+        uint64_t tsc0 = atomic_load_explicit(&tsc_clock.tsc0, memory_order_relaxed);
+        time_ns_t ns0 = atomic_load_explicit(&tsc_clock.ns0, memory_order_relaxed);
+        uint64_t mult = atomic_load_explicit(&tsc_clock.mult, memory_order_relaxed);
+        if (tsc0 != 0 && (tsc <= tsc0 || now - ns0 < TSC_REANCHOR_NS)) { // not yet (or raced)
+                atomic_flag_clear_explicit(&tsc_clock.updating, memory_order_release);
+                return;
+        }
+        if (tsc0 != 0 && now > ns0) {
+                double measured = (double) (now - ns0) / (double) (tsc - tsc0) * (double) (1ULL << 32U);
+                if (mult == 0 || fabs(measured - (double) mult) < TSC_MAX_RATE_DEVIATION * (double) mult
+                                || ++tsc_clock.rejected > TSC_MAX_REJECTED) {
+                        mult = (uint64_t) measured;
+                        tsc_clock.rejected = 0;
+                } else {
+                        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "System clock step detected, keeping TSC rate.\n");
+                }
+        }
+
+        unsigned seq = atomic_load_explicit(&tsc_clock.seq, memory_order_relaxed);
+        atomic_store_explicit(&tsc_clock.seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        atomic_store_explicit(&tsc_clock.tsc0, tsc, memory_order_relaxed);
+        atomic_store_explicit(&tsc_clock.ns0, now, memory_order_relaxed);
+        atomic_store_explicit(&tsc_clock.mult, mult, memory_order_relaxed);
+        atomic_store_explicit(&tsc_clock.reanchor_ticks,
+                        mult == 0 ? 0 : ((uint64_t) TSC_REANCHOR_NS << 32U) / mult, memory_order_relaxed);
+        atomic_store_explicit(&tsc_clock.seq, seq + 2, memory_order_release);
+
+        atomic_flag_clear_explicit(&tsc_clock.updating, memory_order_release);
+}
+
+static time_ns_t tsc_get_time_in_ns(void)
+{
+        unsigned seq = atomic_load_explicit(&tsc_clock.seq, memory_order_acquire);
+        uint64_t tsc0 = atomic_load_explicit(&tsc_clock.tsc0, memory_order_relaxed);
+        time_ns_t ns0 = atomic_load_explicit(&tsc_clock.ns0, memory_order_relaxed);
+        uint64_t mult = atomic_load_explicit(&tsc_clock.mult, memory_order_relaxed);
+        uint64_t reanchor_ticks = atomic_load_explicit(&tsc_clock.reanchor_ticks, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t tsc = __rdtsc();
+        if ((seq & 1U) == 0 && atomic_load_explicit(&tsc_clock.seq, memory_order_relaxed) == seq
+                        && mult != 0 && tsc >= tsc0 && tsc - tsc0 < reanchor_ticks) {
+                // (tsc - tsc0) * mult cannot overflow - the product is below TSC_REANCHOR_NS << 32
+                return ns0 + (time_ns_t) (((tsc - tsc0) * mult) >> 32U);
+        }
+        time_ns_t now = get_time_in_ns();
+        tsc_reanchor(tsc, now);
+        return now;
+}
+#endif // defined HAVE_TSC_CLOCK
+
+static enum fast_clock_source fast_clock_init(void)
+{
+        enum fast_clock_source source = FAST_CLOCK_SYSTEM;
+        const char *req = get_commandline_param("clock");
+#ifdef HAVE_TSC_CLOCK
+        if ((req == NULL || strcmp(req, "tsc") == 0) && tsc_usable()) {
+                source = FAST_CLOCK_TSC;
+        }
+#endif
+        if (req != NULL && strcmp(req, "system") != 0 && source != FAST_CLOCK_TSC) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Clock \"%s\" not available, using system clock.\n", req);
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s clock for packet timestamps.\n",
+                        source == FAST_CLOCK_TSC ? "TSC" : "system");
+        atomic_store_explicit(&fast_clock_source, source, memory_order_relaxed);
+        return source;
+}
+
+time_ns_t get_time_in_ns_fast(void)
+{
+        enum fast_clock_source source = atomic_load_explicit(&fast_clock_source, memory_order_relaxed);
+        if (source == FAST_CLOCK_UNKNOWN) { // racing initializations reach the same result
+                source = fast_clock_init();
+        }
+#ifdef HAVE_TSC_CLOCK
+        if (source == FAST_CLOCK_TSC) {
+                return tsc_get_time_in_ns();
+        }
+#endif
+        return get_time_in_ns();
+}
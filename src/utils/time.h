@@ -42,6 +42,8 @@
 
 #include <stdint.h>
 
+#include "tv.h"
+
 enum {
         FORMAT_TIME_MS_BUF_LEN = 13
 };
@@ -55,5 +57,22 @@ enum {
  */
 void format_time_ms(uint64_t ts, char buf[static FORMAT_TIME_MS_BUF_LEN]);
 
+/**
+ * Cheap variant of get_time_in_ns() intended for per-packet timestamps.
+ *
+ * Returns the same (wall-clock) time base as get_time_in_ns(). If the CPU has
+ * an invariant TSC that is also used by the kernel as a clocksource (x86-64
+ * Linux), the time is computed from the TSC, which is periodically
+ * re-anchored to get_time_in_ns(). The re-anchoring may step the returned
+ * time by a few microseconds (also backwards), so it should not be used for
+ * intervals shorter than that. Otherwise (or with "--param clock=system")
+ * get_time_in_ns() is used directly.
+ *
+ * @note
+ * Even cheaper is to read the time once per batch of packets and pass it
+ * along, which callers processing packets in batches should prefer.
+ */
+time_ns_t get_time_in_ns_fast(void);
+
 #endif// UTILS_TIME_H_
 
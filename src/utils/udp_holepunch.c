@@ -42,6 +42,7 @@
 #endif
 
 #include <juice/juice.h>
+#include <pthread.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
@@ -49,7 +50,9 @@
 #include "utils/udp_holepunch.h"
 
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
+#include "utils/macros.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -64,8 +67,16 @@
 
 #define MAX_MSG_LEN 2048
 #define MSG_HEADER_LEN 5
+#define MAX_PENDING_CANDIDATES 32
+#define END_OF_CANDIDATES "a=end-of-candidates"
+#define STATE_POLL_INTERVAL_US 10000
+#define SEQUENTIAL_PARAM "holepunch-sequential"
 #define MOD_NAME "[HOLEPUNCH] "
 
+ADD_TO_PARAM(SEQUENTIAL_PARAM, "* " SEQUENTIAL_PARAM "\n"
+                "  Punch the audio session after the video one (bound to the same local\n"
+                "  address) instead of both at once, eg. if the host has multiple interfaces.\n");
+
 /* Coordination protocol description
  *
  * The hole punching library requires that clients exchange candidate ip:port
@@ -92,7 +103,8 @@
  * 5. Client receives the sdp description of the other client
  *
  * After that the client sends and receives sdp candidate pairs as they are
- * discovered.
+ * discovered (those gathered before 5. are sent right after it), followed by
+ * "a=end-of-candidates" once the gathering is done.
  *
  */
 
@@ -100,7 +112,13 @@ struct Punch_ctx {
         juice_agent_t *juice_agent;
 
         fd_t coord_sock;
+        bool coord_closed;
+
+        pthread_mutex_t lock; ///< guards the members below (libjuice calls back from its thread)
         fd_t local_candidate_port;
+        bool remote_desc_received; ///< local candidates may be sent to the peer
+        char *pending[MAX_PENDING_CANDIDATES]; ///< candidates gathered before that
+        int pending_count;
 };
 
 static void send_msg(int sock, const char *msg){
@@ -119,11 +137,26 @@ static void send_msg(int sock, const char *msg){
         ret = send(sock, msg, msg_size, 0);
 }
 
+/**
+ * Candidates are gathered already while waiting for the peer, those found
+ * before the remote description is received are queued and sent afterwards.
+ */
+static void send_candidate(struct Punch_ctx *ctx, const char *sdp){
+        pthread_mutex_lock(&ctx->lock);
+        if(ctx->remote_desc_received){
+                send_msg(ctx->coord_sock, sdp);
+        } else if(ctx->pending_count < MAX_PENDING_CANDIDATES){
+                ctx->pending[ctx->pending_count++] = strdup(sdp);
+        } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Too many candidates, dropping: %s\n", sdp);
+        }
+        pthread_mutex_unlock(&ctx->lock);
+}
+
 static void on_candidate(juice_agent_t *agent, const char *sdp, void *user_ptr) {
         UNUSED(agent);
         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Received candidate: %s\n", sdp);
         struct Punch_ctx *ctx = (struct Punch_ctx *) user_ptr;
-        send_msg(ctx->coord_sock, sdp);
 
         /* sdp is a RFC5245 string which should look like this:
          * "a=candidate:2 1 UDP <prio> <ip> <port> typ <type> ..."
@@ -147,8 +180,19 @@ static void on_candidate(juice_agent_t *agent, const char *sdp, void *user_ptr)
         const char *host_type_str = "typ host";
         if(strncmp(c, host_type_str, strlen(host_type_str)) == 0){
                 log_msg(LOG_LEVEL_INFO, MOD_NAME "Local candidate port: %d\n", port);
+                pthread_mutex_lock(&ctx->lock);
                 ctx->local_candidate_port = port;
+                pthread_mutex_unlock(&ctx->lock);
         }
+
+        send_candidate(ctx, sdp);
+}
+
+/// lets the peer finish the checks without waiting for more candidates
+static void on_gathering_done(juice_agent_t *agent, void *user_ptr) {
+        UNUSED(agent);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Candidate gathering done\n");
+        send_candidate((struct Punch_ctx *) user_ptr, END_OF_CANDIDATES);
 }
 
 static juice_agent_t *create_agent(const struct Holepunch_config *c, void *usr_ptr){
@@ -158,12 +202,24 @@ static juice_agent_t *create_agent(const struct Holepunch_config *c, void *usr_p
         conf.stun_server_host = c->stun_srv_addr;
         conf.stun_server_port = c->stun_srv_port;
 
-        conf.turn_servers = NULL;
-        conf.turn_servers_count = 0;
+        juice_turn_server_t turn_server;
+        memset(&turn_server, 0, sizeof(turn_server));
+        if(strlen(c->turn_srv_addr) > 0){
+                turn_server.host = c->turn_srv_addr;
+                turn_server.port = c->turn_srv_port;
+                turn_server.username = c->turn_user;
+                turn_server.password = c->turn_pass;
+                conf.turn_servers = &turn_server;
+                conf.turn_servers_count = 1;
+        } else {
+                conf.turn_servers = NULL;
+                conf.turn_servers_count = 0;
+        }
 
         conf.bind_address = c->bind_addr;
 
         conf.cb_candidate = on_candidate;
+        conf.cb_gathering_done = on_gathering_done;
         conf.user_ptr = usr_ptr;
 
         return juice_create(&conf);
@@ -191,7 +247,7 @@ static void recv_msg(int sock, char *buf, size_t buf_len){
                 expected_len = buf_len - 1;
 
         bytes = recv(sock, buf, expected_len, MSG_WAITALL);
-        buf[bytes] = '\0';
+        buf[bytes < 0 ? 0 : bytes] = '\0';
 }
 
 static bool connect_to_coordinator(const char *coord_srv_addr,
@@ -224,49 +280,109 @@ static bool connect_to_coordinator(const char *coord_srv_addr,
         return true;
 }
 
-static void exchange_coord_desc(juice_agent_t *agent, fd_t coord_sock){
+static void send_local_desc(juice_agent_t *agent, fd_t coord_sock){
         char sdp[JUICE_MAX_SDP_STRING_LEN];
         juice_get_local_description(agent, sdp, JUICE_MAX_SDP_STRING_LEN);
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Local description:\n%s\n", sdp);
 
         send_msg(coord_sock, sdp);
+}
 
+static void recv_remote_desc(struct Punch_ctx *ctx){
         log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Connection: Waiting for remote client...\n");
         char msg_buf[MAX_MSG_LEN];
-        recv_msg(coord_sock, msg_buf, sizeof(msg_buf));
+        recv_msg(ctx->coord_sock, msg_buf, sizeof(msg_buf));
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Remote client name: %s\n", msg_buf);
-        recv_msg(coord_sock, msg_buf, sizeof(msg_buf));
+        recv_msg(ctx->coord_sock, msg_buf, sizeof(msg_buf));
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Remote desc: %s\n", msg_buf);
 
-        juice_set_remote_description(agent, msg_buf);
+        juice_set_remote_description(ctx->juice_agent, msg_buf);
+
+        pthread_mutex_lock(&ctx->lock);
+        ctx->remote_desc_received = true;
+        for(int i = 0; i < ctx->pending_count; ++i){
+                send_msg(ctx->coord_sock, ctx->pending[i]);
+                free(ctx->pending[i]);
+        }
+        ctx->pending_count = 0;
+        pthread_mutex_unlock(&ctx->lock);
 }
 
-static void discover_and_xchg_candidates(juice_agent_t *agent, fd_t coord_sock) {
-        juice_gather_candidates(agent);
+static bool punch_finished(struct Punch_ctx *ctx){
+        juice_state_t state = juice_get_state(ctx->juice_agent);
+        return state == JUICE_STATE_COMPLETED || state == JUICE_STATE_FAILED;
+}
 
-        fd_set rfds;
-        FD_ZERO(&rfds);
+/**
+ * Runs the connectivity checks of all sessions at once, remote candidates are
+ * passed to the agents as soon as they arrive. Returns when every agent has
+ * either completed (libjuice nominates the first succeeded pair of the highest
+ * priority) or failed.
+ */
+static void xchg_candidates(struct Punch_ctx **ctxs, int count) {
+        while(1){
+                fd_set rfds;
+                FD_ZERO(&rfds);
+                fd_t max_fd = 0;
+                bool all_finished = true;
+                for(int i = 0; i < count; ++i){
+                        if(punch_finished(ctxs[i])){
+                                continue;
+                        }
+                        all_finished = false;
+                        if(!ctxs[i]->coord_closed){
+                                FD_SET(ctxs[i]->coord_sock, &rfds);
+                                max_fd = MAX(max_fd, ctxs[i]->coord_sock);
+                        }
+                }
+                if(all_finished){
+                        break;
+                }
 
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 300000;
+                // state is polled, so the wait is short to react quickly once completed
+                struct timeval tv;
+                tv.tv_sec = 0;
+                tv.tv_usec = STATE_POLL_INTERVAL_US;
+                if(select(max_fd + 1, &rfds, NULL, NULL, &tv) <= 0){
+                        continue;
+                }
 
-        while(1){
-                FD_SET(coord_sock, &rfds);
-                select(coord_sock + 1, &rfds, NULL, NULL, &tv);
-                if(FD_ISSET(coord_sock, &rfds)){
+                for(int i = 0; i < count; ++i){
+                        if(ctxs[i]->coord_closed || !FD_ISSET(ctxs[i]->coord_sock, &rfds)){
+                                continue;
+                        }
                         char msg_buf[MAX_MSG_LEN];
-                        recv_msg(coord_sock, msg_buf, sizeof(msg_buf));
-                        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Received remote candidate\n");
-                        juice_add_remote_candidate(agent, msg_buf);
+                        recv_msg(ctxs[i]->coord_sock, msg_buf, sizeof(msg_buf));
+                        if(strlen(msg_buf) == 0){
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Coordination server closed the connection\n");
+                                ctxs[i]->coord_closed = true;
+                        } else if(strcmp(msg_buf, END_OF_CANDIDATES) == 0){
+                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Remote candidate gathering done\n");
+                                juice_set_remote_gathering_done(ctxs[i]->juice_agent);
+                        } else {
+                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Received remote candidate\n");
+                                juice_add_remote_candidate(ctxs[i]->juice_agent, msg_buf);
+                        }
                 }
-                juice_state_t state = juice_get_state(agent);
-                if(state == JUICE_STATE_COMPLETED)
-                        break;
         }
 }
 
-static bool initialize_punch(struct Punch_ctx *ctx,
+static void cleanup_punch(struct Punch_ctx *ctx){
+        if(ctx->juice_agent){
+                juice_destroy(ctx->juice_agent);
+        }
+        for(int i = 0; i < ctx->pending_count; ++i){
+                free(ctx->pending[i]);
+        }
+        pthread_mutex_destroy(&ctx->lock);
+        CLOSESOCKET(ctx->coord_sock);
+}
+
+/**
+ * Joins the room and starts gathering the candidates, which then runs while
+ * waiting for the peer (recv_remote_desc()).
+ */
+static bool start_punch(struct Punch_ctx *ctx,
                 const struct Holepunch_config *c,
                 const char *room_suffix)
 {
@@ -282,17 +398,35 @@ static bool initialize_punch(struct Punch_ctx *ctx,
         if(!connect_to_coordinator(c->coord_srv_addr, c->coord_srv_port, &ctx->coord_sock)){
                 return false;
         }
+        pthread_mutex_init(&ctx->lock, NULL);
 
         send_msg(ctx->coord_sock, c->client_name);
         send_msg(ctx->coord_sock, room_name);
 
         ctx->juice_agent = create_agent(c, ctx);
+        if(!ctx->juice_agent){
+                error_msg(MOD_NAME "Failed to create ICE agent\n");
+                cleanup_punch(ctx);
+                return false;
+        }
 
-        exchange_coord_desc(ctx->juice_agent, ctx->coord_sock);
+        send_local_desc(ctx->juice_agent, ctx->coord_sock);
+        juice_gather_candidates(ctx->juice_agent);
 
         return true;
 }
 
+static bool initialize_punch(struct Punch_ctx *ctx,
+                const struct Holepunch_config *c,
+                const char *room_suffix)
+{
+        if(!start_punch(ctx, c, room_suffix)){
+                return false;
+        }
+        recv_remote_desc(ctx);
+        return true;
+}
+
 static bool split_host_port(char *pair, int *port){
         char *colon = strrchr(pair, ':');
         if(!colon)
@@ -315,9 +449,8 @@ static void juice_log_handler(juice_log_level_t level, const char *message){
         log_msg(LOG_LEVEL_DEBUG, MOD_NAME "libjuice: %s\n", message);
 }
 
-static bool run_punch(struct Punch_ctx *ctx, char *local, char *remote){
-        discover_and_xchg_candidates(ctx->juice_agent, ctx->coord_sock);
-
+/// @param local, remote  selected addresses (<ip>:<port>)
+static bool get_punch_result(struct Punch_ctx *ctx, char *local, char *remote){
         enum juice_state state = juice_get_state(ctx->juice_agent);
         if(state != JUICE_STATE_COMPLETED){
                 error_msg(MOD_NAME "Punching finished unsuccessfuly (state %d)\n", state);
@@ -340,34 +473,39 @@ static bool run_punch(struct Punch_ctx *ctx, char *local, char *remote){
         return true;
 }
 
-static void cleanup_punch(struct Punch_ctx *ctx){
-        juice_destroy(ctx->juice_agent);
-        CLOSESOCKET(ctx->coord_sock);
+static bool run_punch(struct Punch_ctx *ctx, char *local, char *remote){
+        xchg_candidates(&ctx, 1);
+        return get_punch_result(ctx, local, remote);
+}
 
+static int get_local_candidate_port(struct Punch_ctx *ctx){
+        pthread_mutex_lock(&ctx->lock);
+        int port = ctx->local_candidate_port;
+        pthread_mutex_unlock(&ctx->lock);
+        return port;
 }
 
-bool punch_udp(struct Holepunch_config *c){
+/**
+ * Audio session is bound to the local address selected for video, so it is
+ * punched only after the video one.
+ */
+static bool punch_udp_sequential(struct Holepunch_config *c){
         struct Punch_ctx video_ctx = {0};
         struct Punch_ctx audio_ctx = {0};
 
-        juice_set_log_level(JUICE_LOG_LEVEL_DEBUG);
-        juice_set_log_handler(juice_log_handler);
-
         char local[JUICE_MAX_CANDIDATE_SDP_STRING_LEN];
         char remote[JUICE_MAX_CANDIDATE_SDP_STRING_LEN];
 
-        if(!strlen(c->client_name)){
-                gethostname(c->client_name, sizeof(c->client_name) - 1);
-        }
-
         if(!initialize_punch(&video_ctx, c, "_video")){
                 return false;
         }
 
-        if(!run_punch(&video_ctx, local, remote))
+        if(!run_punch(&video_ctx, local, remote)){
+                cleanup_punch(&video_ctx);
                 return false;
+        }
 
-        *c->video_rx_port = video_ctx.local_candidate_port;
+        *c->video_rx_port = get_local_candidate_port(&video_ctx);
         assert(split_host_port(remote, c->video_tx_port));
         assert(split_host_port(local, NULL));
 
@@ -381,16 +519,86 @@ bool punch_udp(struct Holepunch_config *c){
 
         cleanup_punch(&video_ctx);
 
-        if(!run_punch(&audio_ctx, local, remote))
+        if(!run_punch(&audio_ctx, local, remote)){
+                cleanup_punch(&audio_ctx);
                 return false;
+        }
 
-        *c->audio_rx_port = audio_ctx.local_candidate_port;
+        *c->audio_rx_port = get_local_candidate_port(&audio_ctx);
         assert(split_host_port(remote, c->audio_tx_port));
 
         assert(strcmp(c->host_addr, remote) == 0);
 
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cleaning up\n");
         cleanup_punch(&audio_ctx);
+        return true;
+}
+
+/**
+ * Both sessions gather the candidates and run the checks at once. The peer
+ * needs to be reached on the same address by both of them, which is normally
+ * the case because both agents see the same candidates.
+ */
+static bool punch_udp_parallel(struct Holepunch_config *c){
+        struct Punch_ctx video_ctx = {0};
+        struct Punch_ctx audio_ctx = {0};
+        struct Punch_ctx *ctxs[] = { &video_ctx, &audio_ctx };
+
+        char video_local[JUICE_MAX_CANDIDATE_SDP_STRING_LEN];
+        char video_remote[JUICE_MAX_CANDIDATE_SDP_STRING_LEN];
+        char audio_local[JUICE_MAX_CANDIDATE_SDP_STRING_LEN];
+        char audio_remote[JUICE_MAX_CANDIDATE_SDP_STRING_LEN];
+
+        if(!start_punch(&video_ctx, c, "_video")){
+                return false;
+        }
+        if(!start_punch(&audio_ctx, c, "_audio")){
+                cleanup_punch(&video_ctx);
+                return false;
+        }
+        recv_remote_desc(&video_ctx);
+        recv_remote_desc(&audio_ctx);
+
+        xchg_candidates(ctxs, 2);
+
+        bool ret = get_punch_result(&video_ctx, video_local, video_remote)
+                && get_punch_result(&audio_ctx, audio_local, audio_remote);
+        if(ret){
+                *c->video_rx_port = get_local_candidate_port(&video_ctx);
+                *c->audio_rx_port = get_local_candidate_port(&audio_ctx);
+                if(!split_host_port(video_remote, c->video_tx_port)
+                                || !split_host_port(audio_remote, c->audio_tx_port)){
+                        error_msg(MOD_NAME "Cannot parse selected remote address\n");
+                        ret = false;
+                } else if(strcmp(video_remote, audio_remote) != 0){
+                        error_msg(MOD_NAME "Video and audio were punched to different hosts (%s, %s), "
+                                        "try \"--param " SEQUENTIAL_PARAM "\".\n", video_remote, audio_remote);
+                        ret = false;
+                } else {
+                        strncpy(c->host_addr, video_remote, c->host_addr_len);
+                }
+        }
+
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cleaning up\n");
+        cleanup_punch(&video_ctx);
+        cleanup_punch(&audio_ctx);
+        return ret;
+}
+
+bool punch_udp(struct Holepunch_config *c){
+        juice_set_log_level(JUICE_LOG_LEVEL_DEBUG);
+        juice_set_log_handler(juice_log_handler);
+
+        if(!strlen(c->client_name)){
+                gethostname(c->client_name, sizeof(c->client_name) - 1);
+        }
+
+        bool ret = get_commandline_param(SEQUENTIAL_PARAM) != NULL
+                ? punch_udp_sequential(c)
+                : punch_udp_parallel(c);
+        if(!ret){
+                return false;
+        }
 
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cleanup done\n");
 
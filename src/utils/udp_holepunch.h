@@ -46,7 +46,7 @@
 extern "C" {
 #endif
 
-#define HOLEPUNCH_ABI_VERSION 1
+#define HOLEPUNCH_ABI_VERSION 2
 
 struct Holepunch_config{
         char client_name[512];
@@ -66,6 +66,10 @@ struct Holepunch_config{
         int coord_srv_port;
         char stun_srv_addr[512];
         int stun_srv_port;
+        char turn_srv_addr[512];   ///< relay, optional (empty if not used)
+        int turn_srv_port;
+        char turn_user[128];
+        char turn_pass[128];
 };
 
 #ifdef HAVE_LIBJUICE
@@ -0,0 +1,819 @@
+/**
+ * @file   utils/ulw.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  UltraGrid lite wavelet (ULW) encoder and decoder
+ *
+ * @sa utils/ulw.h for the bitstream description
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/misc.h"
+#include "utils/simd_lanes.h"
+#include "utils/ulw.h"
+#include "utils/worker.h"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define GROUP 4          ///< coefficients sharing one GCLI (bit-plane count)
+#define H_LEVELS 3       ///< horizontal decomposition levels of vertically low-pass rows
+#define MAX_GCLI 24
+#define MAX_SHIFT 24
+#define MAX_COEF (1 << 24)
+#define COMPONENTS 3
+
+/// group attributes stored for the rate control
+#define GRP_BAND_START 0x80
+#define GRP_CNT_SHIFT 3
+#define GRP_WEIGHT_MASK 0x7
+
+struct bit_writer {
+        unsigned char *out;
+        uint64_t acc;
+        int bits;
+};
+
+static ALWAYS_INLINE void put_bits(struct bit_writer *w, uint32_t val, int n) // n <= 32
+{
+        w->acc = (w->acc << n) | val;
+        w->bits += n;
+        while (w->bits >= 8) {
+                w->bits -= 8;
+                *w->out++ = (unsigned char) (w->acc >> w->bits);
+        }
+}
+
+static ALWAYS_INLINE void put_unary(struct bit_writer *w, int z)
+{
+        while (z >= 32) {
+                put_bits(w, 0, 32);
+                z -= 32;
+        }
+        put_bits(w, 1, z + 1);
+}
+
+static ALWAYS_INLINE void flush_bits(struct bit_writer *w)
+{
+        if (w->bits > 0) {
+                put_bits(w, 0, 8 - w->bits);
+        }
+}
+
+/// MSB-aligned reader, reads zeros past the end
+struct bit_reader {
+        const unsigned char *in;
+        const unsigned char *end;
+        uint64_t acc;
+        int bits;
+        int padding;   ///< zero bytes appended past the end
+};
+
+static ALWAYS_INLINE void refill(struct bit_reader *r)
+{
+        while (r->bits <= 56) {
+                uint64_t byte = 0;
+                if (r->in < r->end) {
+                        byte = *r->in++;
+                } else {
+                        r->padding += 1;
+                }
+                r->acc |= byte << (56 - r->bits);
+                r->bits += 8;
+        }
+}
+
+static ALWAYS_INLINE uint32_t get_bits(struct bit_reader *r, int n) // n <= MAX_GCLI
+{
+        if (n == 0) {
+                return 0;
+        }
+        refill(r);
+        uint32_t ret = r->acc >> (64 - n);
+        r->acc <<= n;
+        r->bits -= n;
+        return ret;
+}
+
+static ALWAYS_INLINE bool overrun(const struct bit_reader *r)
+{
+        return r->padding * 8 > r->bits;
+}
+
+/// @returns -1 if there is no terminating one bit in the 56 following bits
+static ALWAYS_INLINE int get_unary(struct bit_reader *r)
+{
+        refill(r);
+        if (r->acc == 0) {
+                return -1;
+        }
+        int z = __builtin_clzll(r->acc);
+        r->acc <<= z + 1;
+        r->bits -= z + 1;
+        return z;
+}
+
+static ALWAYS_INLINE int bit_length(uint32_t x)
+{
+        return x == 0 ? 0 : 32 - __builtin_clz(x);
+}
+
+/**
+ * Band boundaries of a row with n coefficients decomposed to levels levels
+ * (Mallat layout) - LL, H_levels ... H_1.
+ * @param start  levels + 2 items
+ * @returns      band count
+ */
+static ALWAYS_INLINE int band_bounds(int n, int levels, int *start)
+{
+        start[levels + 1] = n;
+        for (int b = levels; b > 0; --b) {
+                start[b] = (start[b + 1] + 1) / 2;
+        }
+        start[0] = 0;
+        return levels + 1;
+}
+
+/**
+ * Quantizer shift of a band. LL and higher levels get finer quantization,
+ * vertically high-pass rows coarser. q 0 is lossless.
+ */
+static ALWAYS_INLINE int band_weight(int band, int levels, bool low_row)
+{
+        return (band == 0 ? levels : levels - band) - (low_row ? 0 : 1);
+}
+
+static ALWAYS_INLINE int band_shift(int q, int weight)
+{
+        if (q == 0) {
+                return 0;
+        }
+        int s = q - weight;
+        return s < 0 ? 0 : s > MAX_SHIFT ? MAX_SHIFT : s;
+}
+
+/// @param tmp  n items
+static ALWAYS_INLINE void fwd_53(int32_t *x, int n, int32_t *tmp)
+{
+        if (n < 2) {
+                return;
+        }
+        const int nh = n / 2;
+        const int nl = n - nh;
+        int32_t *d = tmp + nl;
+        for (int i = 0; i < nh; ++i) {
+                int32_t right = 2 * i + 2 < n ? x[2 * i + 2] : x[2 * i];
+                d[i] = x[2 * i + 1] - ((x[2 * i] + right) >> 1);
+        }
+        for (int i = 0; i < nl; ++i) {
+                int32_t dl = d[i > 0 ? i - 1 : 0];
+                int32_t dr = d[i < nh ? i : nh - 1];
+                tmp[i] = x[2 * i] + ((dl + dr + 2) >> 2);
+        }
+        memcpy(x, tmp, n * sizeof *x);
+}
+
+static ALWAYS_INLINE void inv_53(int32_t *x, int n, int32_t *tmp)
+{
+        if (n < 2) {
+                return;
+        }
+        const int nh = n / 2;
+        const int nl = n - nh;
+        const int32_t *d = x + nl;
+        for (int i = 0; i < nl; ++i) {
+                int32_t dl = d[i > 0 ? i - 1 : 0];
+                int32_t dr = d[i < nh ? i : nh - 1];
+                tmp[2 * i] = x[i] - ((dl + dr + 2) >> 2);
+        }
+        for (int i = 0; i < nh; ++i) {
+                int32_t right = 2 * i + 2 < n ? tmp[2 * i + 2] : tmp[2 * i];
+                tmp[2 * i + 1] = d[i] + ((tmp[2 * i] + right) >> 1);
+        }
+        memcpy(x, tmp, n * sizeof *x);
+}
+
+/**
+ * Vertical 5/3 over whole rows (vectorizable), low-pass rows are stored
+ * first, high-pass after.
+ * @param tmp  lines * width items
+ */
+static ALWAYS_INLINE void fwd_53_vert(int32_t *c, int width, int lines, int32_t *tmp)
+{
+        const int nh = lines / 2;
+        const int nl = lines - nh;
+        for (int i = 0; i < nh; ++i) {
+                const int32_t *a = c + (2 * i) * width;
+                const int32_t *b = c + (2 * i + 1) * width;
+                const int32_t *r = 2 * i + 2 < lines ? c + (2 * i + 2) * width : a;
+                int32_t *d = tmp + (nl + i) * width;
+                for (int x = 0; x < width; ++x) {
+                        d[x] = b[x] - ((a[x] + r[x]) >> 1);
+                }
+        }
+        for (int i = 0; i < nl; ++i) {
+                const int32_t *a = c + (2 * i) * width;
+                const int32_t *dl = tmp + (nl + (i > 0 ? i - 1 : 0)) * width;
+                const int32_t *dr = tmp + (nl + (i < nh ? i : nh - 1)) * width;
+                int32_t *s = tmp + i * width;
+                for (int x = 0; x < width; ++x) {
+                        s[x] = a[x] + ((dl[x] + dr[x] + 2) >> 2);
+                }
+        }
+        memcpy(c, tmp, (size_t) lines * width * sizeof *c);
+}
+
+static ALWAYS_INLINE void inv_53_vert(int32_t *c, int width, int lines, int32_t *tmp)
+{
+        const int nh = lines / 2;
+        const int nl = lines - nh;
+        for (int i = 0; i < nl; ++i) {
+                const int32_t *s = c + i * width;
+                const int32_t *dl = c + (nl + (i > 0 ? i - 1 : 0)) * width;
+                const int32_t *dr = c + (nl + (i < nh ? i : nh - 1)) * width;
+                int32_t *a = tmp + (2 * i) * width;
+                for (int x = 0; x < width; ++x) {
+                        a[x] = s[x] - ((dl[x] + dr[x] + 2) >> 2);
+                }
+        }
+        for (int i = 0; i < nh; ++i) {
+                const int32_t *a = tmp + (2 * i) * width;
+                const int32_t *r = 2 * i + 2 < lines ? tmp + (2 * i + 2) * width : a;
+                const int32_t *d = c + (nl + i) * width;
+                int32_t *b = tmp + (2 * i + 1) * width;
+                for (int x = 0; x < width; ++x) {
+                        b[x] = d[x] + ((a[x] + r[x]) >> 1);
+                }
+        }
+        memcpy(c, tmp, (size_t) lines * width * sizeof *c);
+}
+
+static ALWAYS_INLINE bool is_low_row(int row, int lines)
+{
+        return lines == 1 || row < lines - lines / 2;
+}
+
+static ALWAYS_INLINE void fwd_2d(int32_t *c, int width, int lines, int32_t *tmp)
+{
+        if (lines > 1) {
+                fwd_53_vert(c, width, lines, tmp);
+        }
+        for (int r = 0; r < lines; ++r) {
+                int levels = is_low_row(r, lines) ? H_LEVELS : 1;
+                for (int l = 0, n = width; l < levels; ++l, n = (n + 1) / 2) {
+                        fwd_53(c + r * width, n, tmp);
+                }
+        }
+}
+
+static ALWAYS_INLINE void inv_2d(int32_t *c, int width, int lines, int32_t *tmp)
+{
+        for (int r = 0; r < lines; ++r) {
+                int levels = is_low_row(r, lines) ? H_LEVELS : 1;
+                int n[H_LEVELS];
+                n[0] = width;
+                for (int l = 1; l < levels; ++l) {
+                        n[l] = (n[l - 1] + 1) / 2;
+                }
+                for (int l = levels - 1; l >= 0; --l) {
+                        inv_53(c + r * width, n[l], tmp);
+                }
+        }
+        if (lines > 1) {
+                inv_53_vert(c, width, lines, tmp);
+        }
+}
+
+struct slice_layout {
+        int width;
+        int height;
+        int depth;
+        int slice_height;
+        int slice_count;
+        size_t slot_len;  ///< encoder only
+        double bpp;
+        int q;
+        enum ulw_packing packing;
+        int linesize;
+};
+
+static int comp_width(int width, int comp) {
+        return comp == 0 ? width : width / 2;
+}
+
+static size_t scratch_items(int width, int slice_height) {
+        // 3 components (2 * width items per line) + the same for transform temp
+        return (size_t) 4 * width * slice_height + width;
+}
+
+/// lower bound of the slice length (all coefficients zero - 1 bit per group)
+static size_t min_slice_bits(int width, int lines) {
+        return (size_t) lines * (width / 2 + 16);
+}
+
+static size_t slot_len(int width, int lines, double bpp) {
+        if (bpp > 0) {
+                size_t budget = bpp * width * lines / 8;
+                size_t min_len = (min_slice_bits(width, lines) + 7) / 8;
+                return (budget > min_len ? budget : min_len) + 2; // q + padding
+        }
+        // unary GCLI up to 2*MAX_GCLI+1 bits, magnitudes and signs
+        size_t group_bits = 2 * MAX_GCLI + 1 + GROUP * (MAX_GCLI + 1);
+        return ((size_t) lines * (width / GROUP * 2 + 16) * group_bits + 7) / 8 + 2;
+}
+
+size_t ulw_max_size(int width, int height, int slice_height, double bpp)
+{
+        int slice_count = (height + slice_height - 1) / slice_height;
+        return ULW_HEADER_LEN + 4 * slice_count
+                + slice_count * slot_len(width, slice_height, bpp);
+}
+
+static ALWAYS_INLINE void load_slice(const struct slice_layout *l, const unsigned char *src,
+                int lines, int32_t *comp[COMPONENTS])
+{
+        const int half = 1 << (l->depth - 1);
+        const int w2 = l->width / 2;
+        for (int r = 0; r < lines; ++r) {
+                int32_t *y = comp[0] + r * l->width;
+                int32_t *cb = comp[1] + r * w2;
+                int32_t *cr = comp[2] + r * w2;
+                const unsigned char *in = src + (size_t) r * l->linesize;
+                if (l->packing == ULW_UYVY) {
+                        for (int x = 0; x < w2; ++x) {
+                                cb[x] = in[4 * x] - half;
+                                y[2 * x] = in[4 * x + 1] - half;
+                                cr[x] = in[4 * x + 2] - half;
+                                y[2 * x + 1] = in[4 * x + 3] - half;
+                        }
+                } else {
+                        const uint16_t *in16 = (const uint16_t *)(const void *) in;
+                        const int shift = 16 - l->depth;
+                        for (int x = 0; x < w2; ++x) {
+                                y[2 * x] = (in16[4 * x] >> shift) - half;
+                                cb[x] = (in16[4 * x + 1] >> shift) - half;
+                                y[2 * x + 1] = (in16[4 * x + 2] >> shift) - half;
+                                cr[x] = (in16[4 * x + 3] >> shift) - half;
+                        }
+                }
+        }
+}
+
+static ALWAYS_INLINE int32_t clamp_sample(int32_t x, int32_t max) {
+        return x < 0 ? 0 : x > max ? max : x;
+}
+
+static ALWAYS_INLINE void store_slice(const struct slice_layout *l, unsigned char *dst, int linesize,
+                int lines, int32_t *comp[COMPONENTS])
+{
+        const int half = 1 << (l->depth - 1);
+        const int32_t max = (1 << l->depth) - 1;
+        const int w2 = l->width / 2;
+        for (int r = 0; r < lines; ++r) {
+                const int32_t *y = comp[0] + r * l->width;
+                const int32_t *cb = comp[1] + r * w2;
+                const int32_t *cr = comp[2] + r * w2;
+                unsigned char *out = dst + (size_t) r * linesize;
+                if (l->packing == ULW_UYVY) {
+                        const int down = l->depth - 8;
+                        for (int x = 0; x < w2; ++x) {
+                                out[4 * x] = clamp_sample(cb[x] + half, max) >> down;
+                                out[4 * x + 1] = clamp_sample(y[2 * x] + half, max) >> down;
+                                out[4 * x + 2] = clamp_sample(cr[x] + half, max) >> down;
+                                out[4 * x + 3] = clamp_sample(y[2 * x + 1] + half, max) >> down;
+                        }
+                } else {
+                        uint16_t *out16 = (uint16_t *)(void *) out;
+                        const int shift = 16 - l->depth;
+                        for (int x = 0; x < w2; ++x) {
+                                out16[4 * x] = clamp_sample(y[2 * x] + half, max) << shift;
+                                out16[4 * x + 1] = clamp_sample(cb[x] + half, max) << shift;
+                                out16[4 * x + 2] = clamp_sample(y[2 * x + 1] + half, max) << shift;
+                                out16[4 * x + 3] = clamp_sample(cr[x] + half, max) << shift;
+                        }
+                }
+        }
+}
+
+/**
+ * Computes GCLIs of unquantized groups, from which the exact GCLI for any
+ * quantizer is derived (bit_length(m >> s) == max(bit_length(m) - s, 0)).
+ * @returns group count
+ */
+static ALWAYS_INLINE int slice_gclis(int32_t *comp[COMPONENTS], int width, int lines,
+                uint8_t *gcli, uint8_t *attr)
+{
+        int k = 0;
+        for (int c = 0; c < COMPONENTS; ++c) {
+                const int cw = comp_width(width, c);
+                for (int r = 0; r < lines; ++r) {
+                        const int32_t *row = comp[c] + r * cw;
+                        const bool low = is_low_row(r, lines);
+                        const int levels = low ? H_LEVELS : 1;
+                        int start[H_LEVELS + 2];
+                        int bands = band_bounds(cw, levels, start);
+                        for (int b = 0; b < bands; ++b) {
+                                int weight = band_weight(b, levels, low);
+                                for (int x = start[b]; x < start[b + 1]; x += GROUP) {
+                                        int cnt = start[b + 1] - x < GROUP ? start[b + 1] - x : GROUP;
+                                        uint32_t m = 0;
+                                        for (int i = 0; i < cnt; ++i) {
+                                                m |= (uint32_t) abs(row[x + i]);
+                                        }
+                                        gcli[k] = bit_length(m);
+                                        attr[k] = (x == start[b] ? GRP_BAND_START : 0)
+                                                | cnt << GRP_CNT_SHIFT | (weight + 1);
+                                        k += 1;
+                                }
+                        }
+                }
+        }
+        return k;
+}
+
+/// @returns upper bound of the coded slice size (exact except for the sign bits)
+static size_t slice_bits(const uint8_t *gcli, const uint8_t *attr, int groups, int q)
+{
+        size_t bits = 0;
+        int pred = 0;
+        for (int k = 0; k < groups; ++k) {
+                if (attr[k] & GRP_BAND_START) {
+                        pred = 0;
+                }
+                int s = band_shift(q, (attr[k] & GRP_WEIGHT_MASK) - 1);
+                int g = gcli[k] > s ? gcli[k] - s : 0;
+                int d = g - pred;
+                bits += (d >= 0 ? 2 * d : -2 * d - 1) + 1;
+                if (g > 0) {
+                        bits += (size_t) ((attr[k] >> GRP_CNT_SHIFT) & 0x7) * (g + 1);
+                }
+                pred = g;
+        }
+        return bits;
+}
+
+static int select_q(const uint8_t *gcli, const uint8_t *attr, int groups, size_t budget_bits)
+{
+        int lo = 0;
+        int hi = ULW_MAX_Q;
+        while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (slice_bits(gcli, attr, groups, mid) <= budget_bits) {
+                        hi = mid;
+                } else {
+                        lo = mid + 1;
+                }
+        }
+        // the size isn't strictly monotonic in q
+        while (lo < ULW_MAX_Q && slice_bits(gcli, attr, groups, lo) > budget_bits) {
+                lo += 1;
+        }
+        return lo;
+}
+
+static ALWAYS_INLINE size_t encode_slice(const struct slice_layout *l, const unsigned char *src,
+                int lines, int32_t *scratch, uint8_t *gcli, uint8_t *attr, unsigned char *out)
+{
+        int32_t *comp[COMPONENTS] = { scratch, scratch + l->width * lines,
+                scratch + l->width * lines + l->width / 2 * lines };
+        int32_t *tmp = scratch + 2 * l->width * lines;
+
+        load_slice(l, src, lines, comp);
+        for (int c = 0; c < COMPONENTS; ++c) {
+                fwd_2d(comp[c], comp_width(l->width, c), lines, tmp);
+        }
+
+        int q = l->q;
+        if (l->bpp > 0) {
+                int groups = slice_gclis(comp, l->width, lines, gcli, attr);
+                size_t budget = (slot_len(l->width, lines, l->bpp) - 2) * 8;
+                q = select_q(gcli, attr, groups, budget);
+        }
+
+        out[0] = q;
+        struct bit_writer w = { out + 1, 0, 0 };
+        for (int c = 0; c < COMPONENTS; ++c) {
+                const int cw = comp_width(l->width, c);
+                for (int r = 0; r < lines; ++r) {
+                        const int32_t *row = comp[c] + r * cw;
+                        const bool low = is_low_row(r, lines);
+                        const int levels = low ? H_LEVELS : 1;
+                        int start[H_LEVELS + 2];
+                        int bands = band_bounds(cw, levels, start);
+                        for (int b = 0; b < bands; ++b) {
+                                const int s = band_shift(q, band_weight(b, levels, low));
+                                int pred = 0;
+                                for (int x = start[b]; x < start[b + 1]; x += GROUP) {
+                                        int cnt = start[b + 1] - x < GROUP ? start[b + 1] - x : GROUP;
+                                        uint32_t mag[GROUP];
+                                        uint32_t m = 0;
+                                        for (int i = 0; i < cnt; ++i) {
+                                                mag[i] = (uint32_t) abs(row[x + i]) >> s;
+                                                m |= mag[i];
+                                        }
+                                        int g = bit_length(m);
+                                        int d = g - pred;
+                                        put_unary(&w, d >= 0 ? 2 * d : -2 * d - 1);
+                                        pred = g;
+                                        if (g == 0) {
+                                                continue;
+                                        }
+                                        for (int i = 0; i < cnt; ++i) {
+                                                put_bits(&w, mag[i], g);
+                                        }
+                                        for (int i = 0; i < cnt; ++i) {
+                                                if (mag[i] != 0) {
+                                                        put_bits(&w, row[x + i] < 0, 1);
+                                                }
+                                        }
+                                }
+                        }
+                }
+        }
+        flush_bits(&w);
+        return w.out - out;
+}
+
+/// @returns false if the slice data is damaged
+static ALWAYS_INLINE bool decode_slice(const struct slice_layout *l, const unsigned char *in, size_t len,
+                int lines, int32_t *scratch, unsigned char *dst, int dst_linesize)
+{
+        int32_t *comp[COMPONENTS] = { scratch, scratch + l->width * lines,
+                scratch + l->width * lines + l->width / 2 * lines };
+        int32_t *tmp = scratch + 2 * l->width * lines;
+        bool ok = len > 0 && in[0] <= ULW_MAX_Q;
+        const int q = len > 0 ? in[0] : 0;
+        struct bit_reader rd = { in + (len > 0 ? 1 : 0), in + len, 0, 0, 0 };
+
+        for (int c = 0; c < COMPONENTS; ++c) {
+                const int cw = comp_width(l->width, c);
+                for (int r = 0; r < lines; ++r) {
+                        int32_t *row = comp[c] + r * cw;
+                        if (!ok) {
+                                memset(row, 0, cw * sizeof *row);
+                                continue;
+                        }
+                        const bool low = is_low_row(r, lines);
+                        const int levels = low ? H_LEVELS : 1;
+                        int start[H_LEVELS + 2];
+                        int bands = band_bounds(cw, levels, start);
+                        for (int b = 0; b < bands; ++b) {
+                                const int s = band_shift(q, band_weight(b, levels, low));
+                                const int64_t rounding = s > 0 ? 1 << (s - 1) : 0;
+                                int pred = 0;
+                                for (int x = start[b]; x < start[b + 1]; x += GROUP) {
+                                        int cnt = start[b + 1] - x < GROUP ? start[b + 1] - x : GROUP;
+                                        int z = ok ? get_unary(&rd) : 0;
+                                        int g = pred + (z & 1 ? -(z + 1) / 2 : z / 2);
+                                        if (z < 0 || g < 0 || g > MAX_GCLI) {
+                                                ok = false;
+                                                g = 0;
+                                        }
+                                        pred = g;
+                                        uint32_t mag[GROUP];
+                                        for (int i = 0; i < cnt; ++i) {
+                                                mag[i] = get_bits(&rd, g);
+                                        }
+                                        for (int i = 0; i < cnt; ++i) {
+                                                if (mag[i] == 0) {
+                                                        row[x + i] = 0;
+                                                        continue;
+                                                }
+                                                int64_t val = ((int64_t) mag[i] << s) + rounding;
+                                                val = val > MAX_COEF ? MAX_COEF : val;
+                                                row[x + i] = get_bits(&rd, 1) ? -val : val;
+                                        }
+                                }
+                        }
+                }
+        }
+        ok = ok && !overrun(&rd);
+
+        for (int c = 0; c < COMPONENTS; ++c) {
+                inv_2d(comp[c], comp_width(l->width, c), lines, tmp);
+        }
+        store_slice(l, dst, dst_linesize, lines, comp);
+        return ok;
+}
+
+struct encode_job {
+        struct slice_layout l;
+        const unsigned char *src;
+        unsigned char *slots;
+        uint32_t *lens;
+};
+
+static ALWAYS_INLINE void encode_range(void *arg, int begin, int end)
+{
+        struct encode_job *j = arg;
+        const struct slice_layout *l = &j->l;
+        int32_t *scratch = malloc(scratch_items(l->width, l->slice_height) * sizeof *scratch);
+        // groups per line - (width + 2 * width / 2) / GROUP + partial groups of 3 * (H_LEVELS + 1) bands
+        size_t max_groups = (size_t) l->slice_height * (2 * l->width / GROUP + COMPONENTS * (H_LEVELS + 1));
+        uint8_t *gcli = malloc(2 * max_groups);
+        uint8_t *attr = gcli + max_groups;
+        for (int s = begin; s < end; ++s) {
+                int y = s * l->slice_height;
+                int lines = l->height - y < l->slice_height ? l->height - y : l->slice_height;
+                j->lens[s] = encode_slice(l, j->src + (size_t) y * l->linesize, lines, scratch,
+                                gcli, attr, j->slots + s * l->slot_len);
+        }
+        free(scratch);
+        free(gcli);
+}
+
+static void encode_range_generic(void *arg, int begin, int end) {
+        encode_range(arg, begin, end);
+}
+
+struct decode_job {
+        struct slice_layout l;
+        const unsigned char *in;
+        const size_t *offsets;     ///< slice_count + 1 items
+        unsigned char *dst;
+        bool *slice_ok;
+};
+
+static ALWAYS_INLINE void decode_range(void *arg, int begin, int end)
+{
+        struct decode_job *j = arg;
+        const struct slice_layout *l = &j->l;
+        int32_t *scratch = malloc(scratch_items(l->width, l->slice_height) * sizeof *scratch);
+        for (int s = begin; s < end; ++s) {
+                int y = s * l->slice_height;
+                int lines = l->height - y < l->slice_height ? l->height - y : l->slice_height;
+                j->slice_ok[s] = decode_slice(l, j->in + j->offsets[s], j->offsets[s + 1] - j->offsets[s],
+                                lines, scratch, j->dst + (size_t) y * l->linesize, l->linesize);
+        }
+        free(scratch);
+}
+
+static void decode_range_generic(void *arg, int begin, int end) {
+        decode_range(arg, begin, end);
+}
+
+#ifdef PIXFMT_SIMD_X86
+__attribute__((target("avx2"))) static void encode_range_avx2(void *arg, int begin, int end) {
+        encode_range(arg, begin, end);
+}
+
+__attribute__((target("avx2"))) static void decode_range_avx2(void *arg, int begin, int end) {
+        decode_range(arg, begin, end);
+}
+#endif
+
+static range_task_t encode_task(void) {
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                return encode_range_avx2;
+        }
+#endif
+        return encode_range_generic;
+}
+
+static range_task_t decode_task(void) {
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                return decode_range_avx2;
+        }
+#endif
+        return decode_range_generic;
+}
+
+static void put_be(unsigned char *out, uint32_t val, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+                out[i] = val >> (8 * (bytes - 1 - i));
+        }
+}
+
+static uint32_t get_be(const unsigned char *in, int bytes) {
+        uint32_t ret = 0;
+        for (int i = 0; i < bytes; ++i) {
+                ret = ret << 8 | in[i];
+        }
+        return ret;
+}
+
+size_t ulw_encode(const unsigned char *src, int linesize, enum ulw_packing packing,
+                int width, int height, int depth, int slice_height, double bpp, int q,
+                unsigned char *out)
+{
+        struct encode_job j = { .l = { .width = width, .height = height, .depth = depth,
+                .slice_height = slice_height, .slice_count = (height + slice_height - 1) / slice_height,
+                .slot_len = slot_len(width, slice_height, bpp), .bpp = bpp, .q = q,
+                .packing = packing, .linesize = linesize }, .src = src };
+        const int slices = j.l.slice_count;
+
+        memcpy(out, "ULW1", 4);
+        put_be(out + 4, width, 2);
+        put_be(out + 6, height, 2);
+        out[8] = depth;
+        out[9] = slice_height;
+        put_be(out + 10, slices, 2);
+        memset(out + 12, 0, 4);
+
+        unsigned char *index = out + ULW_HEADER_LEN;
+        j.slots = index + 4 * slices;
+        j.lens = malloc(slices * sizeof *j.lens);
+        task_run_parallel_range(encode_task(), &j, slices, 1, get_cpu_core_count());
+
+        // compact the slots
+        unsigned char *pos = j.slots;
+        for (int s = 0; s < slices; ++s) {
+                put_be(index + 4 * s, j.lens[s], 4);
+                memmove(pos, j.slots + s * j.l.slot_len, j.lens[s]);
+                pos += j.lens[s];
+        }
+        free(j.lens);
+        return pos - out;
+}
+
+bool ulw_read_header(const unsigned char *in, size_t len, struct ulw_info *info)
+{
+        if (len < ULW_HEADER_LEN || memcmp(in, "ULW1", 4) != 0) {
+                return false;
+        }
+        info->width = get_be(in + 4, 2);
+        info->height = get_be(in + 6, 2);
+        info->depth = in[8];
+        info->slice_height = in[9];
+        info->slice_count = get_be(in + 10, 2);
+        return info->width > 0 && info->width % 2 == 0 && info->height > 0
+                && info->depth >= 8 && info->depth <= 16 && info->slice_height > 0
+                && info->slice_count == (info->height + info->slice_height - 1) / info->slice_height
+                && len >= ULW_HEADER_LEN + 4 * (size_t) info->slice_count;
+}
+
+bool ulw_decode(const unsigned char *in, size_t len, unsigned char *dst, int dst_linesize,
+                enum ulw_packing packing)
+{
+        struct ulw_info info;
+        if (!ulw_read_header(in, len, &info)) {
+                return false;
+        }
+        const int slices = info.slice_count;
+        size_t *offsets = malloc((slices + 1) * sizeof *offsets);
+        bool *slice_ok = malloc(slices * sizeof *slice_ok);
+        bool ok = true;
+        offsets[0] = ULW_HEADER_LEN + 4 * slices;
+        for (int s = 0; s < slices; ++s) {
+                size_t slice_len = get_be(in + ULW_HEADER_LEN + 4 * s, 4);
+                if (slice_len > len - offsets[s]) { // truncated - decode what is present
+                        slice_len = len - offsets[s];
+                        ok = false;
+                }
+                offsets[s + 1] = offsets[s] + slice_len;
+        }
+
+        struct decode_job j = { .l = { .width = info.width, .height = info.height, .depth = info.depth,
+                .slice_height = info.slice_height, .slice_count = slices, .packing = packing,
+                .linesize = dst_linesize }, .in = in, .offsets = offsets, .dst = dst, .slice_ok = slice_ok };
+        task_run_parallel_range(decode_task(), &j, slices, 1, get_cpu_core_count());
+
+        for (int s = 0; s < slices; ++s) {
+                ok = ok && slice_ok[s];
+        }
+        free(offsets);
+        free(slice_ok);
+        return ok;
+}
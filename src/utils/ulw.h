@@ -0,0 +1,117 @@
+/**
+ * @file   utils/ulw.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  UltraGrid lite wavelet (ULW) - lightweight intra-only codec
+ *
+ * Line-based codec in the spirit of JPEG XS/VC-2 LD intended for
+ * visually-lossless transmission of 4:2:2 video over 10G links. The frame is
+ * split to horizontal slices of few lines coded independently (and in
+ * parallel) - LeGall 5/3 wavelet (1 vertical level within the slice, 3
+ * horizontal levels), per-band dead-zone quantization and a simple
+ * bit-plane count (GCLI) entropy coder over groups of 4 coefficients. Each
+ * slice gets the same bit budget, so the compressed frame size is
+ * constant for given bpp.
+ *
+ * Bitstream layout (all numbers big-endian):
+ * - header (ULW_HEADER_LEN bytes): "ULW1", width (16b), height (16b),
+ *   depth (8b), slice height (8b), slice count (16b), 4 reserved bytes
+ * - slice index - 32-bit length of each slice
+ * - slices, each starting with a quantizer byte
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_ULW_H_6A0F3E21_9C4B_4D7E_B2A5_1F8C3D9E7B60
+#define UTILS_ULW_H_6A0F3E21_9C4B_4D7E_B2A5_1F8C3D9E7B60
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#define ULW_HEADER_LEN 16
+#define ULW_DEFAULT_SLICE_HEIGHT 16
+#define ULW_MAX_Q 15
+
+#ifdef __cplusplus
+extern "C" {
+#endif // defined __cplusplus
+
+/// packing of the uncompressed frame
+enum ulw_packing {
+        ULW_UYVY, ///< 8-bit, Cb Y0 Cr Y1
+        ULW_Y216, ///< 16-bit little-endian, Y0 Cb Y1 Cr, used for 10-bit depth (MSB-aligned)
+};
+
+struct ulw_info {
+        int width;
+        int height;
+        int depth;        ///< 8 or 10
+        int slice_height;
+        int slice_count;
+};
+
+/**
+ * @param bpp  target bits per pixel, 0 for constant quantizer
+ * @returns    maximal length of the encoded frame
+ */
+size_t ulw_max_size(int width, int height, int slice_height, double bpp);
+/**
+ * Encodes 4:2:2 frame of even width.
+ *
+ * @param bpp  target bits per pixel (>= 1), each slice gets bpp * slice_pixels / 8
+ *             bytes at most; if 0, q is used for all slices
+ * @param q    quantizer (0 - ULW_MAX_Q) for the constant quantizer mode
+ * @param out  buffer of ulw_max_size() bytes
+ * @returns    length of the encoded frame
+ */
+size_t ulw_encode(const unsigned char *src, int linesize, enum ulw_packing packing,
+                int width, int height, int depth, int slice_height, double bpp, int q,
+                unsigned char *out);
+bool ulw_read_header(const unsigned char *in, size_t len, struct ulw_info *info);
+/**
+ * @returns false if the stream is invalid, damaged slices are still decoded
+ *          (as far as possible) so that the output is fully written
+ */
+bool ulw_decode(const unsigned char *in, size_t len, unsigned char *dst, int dst_linesize,
+                enum ulw_packing packing);
+
+#ifdef __cplusplus
+}
+#endif // defined __cplusplus
+
+#endif // defined UTILS_ULW_H_6A0F3E21_9C4B_4D7E_B2A5_1F8C3D9E7B60
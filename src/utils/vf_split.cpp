@@ -63,8 +63,7 @@ void vf_split(struct video_frame *out, struct video_frame *src,
 
         assert(vf_get_tile(src, 0)->width % x_count == 0u && vf_get_tile(src, 0)->height % y_count == 0u);
 
-        src_linesize = vc_get_linesize(src->tiles[0].width,
-                        src->color_spec);
+        src_linesize = tile_get_linesize(&src->tiles[0], src->color_spec);
 
         assert(x_count * y_count > 0);
         for(tile_idx = 0u; tile_idx < x_count * y_count; ++tile_idx) {
@@ -130,6 +129,48 @@ void vf_split_horizontal(struct video_frame *out, struct video_frame *src,
         }
 }
 
+static void vf_split_view_dispose(struct video_frame *frame)
+{
+        struct video_frame *src = (struct video_frame *) frame->callbacks.dispose_udata;
+        VIDEO_FRAME_DISPOSE(src);
+        vf_free(frame);
+}
+
+struct video_frame *vf_split_view(struct video_frame *src, unsigned int x_count, unsigned int y_count)
+{
+        assert(x_count * y_count > 0);
+        assert(src->tiles[0].width % x_count == 0u && src->tiles[0].height % y_count == 0u);
+        assert(!codec_is_planar(src->color_spec) && !is_codec_opaque(src->color_spec));
+
+        struct video_desc desc = video_desc_from_frame(src);
+        desc.tile_count = x_count * y_count;
+        desc.width /= x_count;
+        desc.height /= y_count;
+        struct video_frame *out = vf_alloc_desc(desc);
+        if (out == NULL) {
+                return NULL;
+        }
+        vf_copy_metadata(out, src);
+
+        const int src_linesize = tile_get_linesize(&src->tiles[0], src->color_spec);
+        const int tile_linesize = vc_get_linesize(desc.width, desc.color_spec);
+        // horizontal stripes of a contiguous frame are contiguous as well
+        const bool contiguous = x_count == 1 && src_linesize == tile_linesize;
+        for (unsigned int y = 0; y < y_count; ++y) {
+                for (unsigned int x = 0; x < x_count; ++x) {
+                        struct tile *tile = &out->tiles[y * x_count + x];
+                        tile->data = src->tiles[0].data + (size_t) y * desc.height * src_linesize +
+                                (size_t) x * tile_linesize;
+                        tile->linesize = contiguous ? 0 : src_linesize;
+                        tile->data_len = (desc.height - 1) * src_linesize + tile_linesize;
+                }
+        }
+
+        out->callbacks.dispose_udata = src;
+        out->callbacks.dispose = vf_split_view_dispose;
+        return out;
+}
+
 using namespace std;
 
 vector<shared_ptr<video_frame>> vf_separate_tiles(shared_ptr<video_frame> frame)
@@ -147,6 +188,7 @@ vector<shared_ptr<video_frame>> vf_separate_tiles(shared_ptr<video_frame> frame)
 
                 ret[i]->tiles[0].data_len = frame->tiles[i].data_len;
                 ret[i]->tiles[0].data = frame->tiles[i].data;
+                ret[i]->tiles[0].linesize = frame->tiles[i].linesize;
                 vf_copy_metadata(ret[i].get(), frame.get());
         }
 
@@ -169,6 +211,7 @@ shared_ptr<video_frame> vf_merge_tiles(std::vector<shared_ptr<video_frame>> cons
         for (unsigned int i = 0; i < tiles.size(); ++i) {
                 ret->tiles[i].data = tiles[i]->tiles[0].data;
                 ret->tiles[i].data_len = tiles[i]->tiles[0].data_len;
+                ret->tiles[i].linesize = tiles[i]->tiles[0].linesize;
                 t0 = tiles[i]->compress_start < t0 ? tiles[i]->compress_start : t0;
                 t1 = tiles[i]->compress_end > t1 ? tiles[i]->compress_end : t1;
         }
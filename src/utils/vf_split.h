@@ -64,6 +64,16 @@ extern "C" {
 void vf_split(struct video_frame *out, struct video_frame *src,
               unsigned int x_count, unsigned int y_count, int preallocate);
 
+/**
+ * Zero-copy variant of vf_split() - the tiles of the returned frame point to
+ * the src data (tile::linesize is set to the src line size unless the tiles
+ * are contiguous, ie. x_count is 1). src is disposed with the returned frame
+ * (by its callbacks::dispose).
+ *
+ * @returns frame that needs to be disposed with VIDEO_FRAME_DISPOSE
+ */
+struct video_frame *vf_split_view(struct video_frame *src, unsigned int x_count, unsigned int y_count);
+
 /**
  * @deprecated this function should not be used
  */
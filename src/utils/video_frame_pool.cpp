@@ -42,83 +42,218 @@
 #include "config_unix.h"
 #include "config_win32.h"
 
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 #include "video_frame_pool.h"
 
 void *default_data_allocator::allocate(size_t size) {
-        return malloc(size);
+        return frame_data_alloc(size, nullptr);
 }
 void default_data_allocator::deallocate(void *ptr) {
-        free(ptr);
+        frame_data_free(ptr);
 }
 struct video_frame_pool_allocator *default_data_allocator::clone() const {
         return new default_data_allocator(*this);
 }
 
-video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_max_used_frames(max_used_frames) {
+hugepage_data_allocator::hugepage_data_allocator(struct frame_alloc_policy policy) : m_policy(policy) {
+}
+void *hugepage_data_allocator::allocate(size_t size) {
+        return frame_data_alloc(size, &m_policy);
+}
+void hugepage_data_allocator::deallocate(void *ptr) {
+        frame_data_free(ptr);
+}
+struct video_frame_pool_allocator *hugepage_data_allocator::clone() const {
+        return new hugepage_data_allocator(*this);
+}
+
+#define FREELIST_MIN_SIZE 64
+#define DEPOT_MAX_WASTE 4 ///< depot buffers larger than this multiple of the frame size are freed on reconfigure
+
+video_frame_freelist::video_frame_freelist(size_t capacity) {
+        size_t size = FREELIST_MIN_SIZE;
+        while (size < capacity) {
+                size *= 2;
+        }
+        m_slots = std::unique_ptr<slot[]>(new slot[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+                m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+}
+
+bool video_frame_freelist::push(struct video_frame *frame, int generation) {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+                slot &s = m_slots[pos & m_mask];
+                intptr_t diff = (intptr_t) s.seq.load(std::memory_order_acquire) - (intptr_t) pos;
+                if (diff == 0) {
+                        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                s.frame = frame;
+                                s.generation = generation;
+                                s.seq.store(pos + 1, std::memory_order_release);
+                                return true;
+                        }
+                } else if (diff < 0) {
+                        return false; // full
+                } else {
+                        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                }
+        }
+}
+
+bool video_frame_freelist::pop(struct video_frame **frame, int *generation) {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+                slot &s = m_slots[pos & m_mask];
+                intptr_t diff = (intptr_t) s.seq.load(std::memory_order_acquire) - (intptr_t) (pos + 1);
+                if (diff == 0) {
+                        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                                *frame = s.frame;
+                                *generation = s.generation;
+                                s.seq.store(pos + m_mask + 1, std::memory_order_release);
+                                return true;
+                        }
+                } else if (diff < 0) {
+                        return false; // empty
+                } else {
+                        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                }
+        }
+}
+
+/// rounds up to a multiple of quarter of the highest power of two not greater than size
+static size_t size_class(size_t size) {
+        size_t step = 1;
+        while (step * 2 <= size) {
+                step *= 2;
+        }
+        step = std::max<size_t>(step / 4, 1);
+        return (size + step - 1) / step * step;
+}
+
+video_frame_pool::video_frame_pool(unsigned int max_used_frames, video_frame_pool_allocator const &alloc) : m_allocator(alloc.clone()), m_free_frames(max_used_frames), m_generation(0), m_desc(), m_max_data_len(0), m_unreturned_frames(0), m_waiters(0), m_returning(0), m_max_used_frames(max_used_frames) {
 }
 
 video_frame_pool::~video_frame_pool() {
         std::unique_lock<std::mutex> lk(m_lock);
-        remove_free_frames();
         // wait also for all frames we gave out to return us
+        m_waiters += 1;
         m_frame_returned.wait(lk, [this] {return m_unreturned_frames == 0;});
+        m_waiters -= 1;
+        lk.unlock();
+        while (m_returning > 0) { // deleter may be still notifying
+                std::this_thread::yield();
+        }
+        lk.lock();
+        remove_free_frames();
+        for (auto &buf : m_depot) {
+                m_allocator->deallocate(buf.second);
+        }
 }
 
 void video_frame_pool::reconfigure(struct video_desc new_desc, size_t new_size) {
         std::unique_lock<std::mutex> lk(m_lock);
         m_desc = new_desc;
         m_max_data_len = new_size != SIZE_MAX ? new_size : new_desc.height * vc_get_linesize(new_desc.width, new_desc.color_spec);
-        remove_free_frames();
         m_generation++;
+        remove_free_frames();
+        // keep only the buffers usable for the new format
+        for (auto it = m_depot.begin(); it != m_depot.end(); ) {
+                if (it->first < m_max_data_len || it->first > DEPOT_MAX_WASTE * size_class(m_max_data_len)) {
+                        m_capacity.erase(it->second);
+                        m_allocator->deallocate(it->second);
+                        it = m_depot.erase(it);
+                } else {
+                        ++it;
+                }
+        }
 }
 
 std::shared_ptr<video_frame> video_frame_pool::get_frame() {
-        assert(m_generation != 0);
+        int generation = m_generation.load(std::memory_order_acquire);
+        assert(generation != 0);
+        if (m_unreturned_frames.fetch_add(1) >= m_max_used_frames && m_max_used_frames > 0) {
+                std::unique_lock<std::mutex> lk(m_lock);
+                m_waiters += 1;
+                m_frame_returned.wait(lk, [this] {return m_unreturned_frames <= m_max_used_frames;});
+                m_waiters -= 1;
+        }
+
         struct video_frame *ret = NULL;
-        std::unique_lock<std::mutex> lk(m_lock);
-        if (!m_free_frames.empty()) {
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else if (m_max_used_frames > 0 && m_max_used_frames == m_unreturned_frames) {
-                m_frame_returned.wait(lk, [this] {return m_unreturned_frames < m_max_used_frames;});
-                assert(!m_free_frames.empty());
-                ret = m_free_frames.front();
-                m_free_frames.pop();
-        } else {
+        struct video_frame *frame = NULL;
+        int frame_generation = 0;
+        while (ret == NULL && m_free_frames.pop(&frame, &frame_generation)) {
+                if (frame_generation == generation) {
+                        ret = frame;
+                } else {
+                        std::unique_lock<std::mutex> lk(m_lock);
+                        recycle_frame(frame);
+                }
+        }
+        if (ret == NULL) {
+                std::unique_lock<std::mutex> lk(m_lock);
                 try {
-                        ret = vf_alloc_desc(m_desc);
-                        for (unsigned int i = 0; i < m_desc.tile_count; ++i) {
+                        ret = allocate_frame();
+                } catch (...) {
+                        lk.unlock();
+                        m_unreturned_frames -= 1;
+                        throw;
+                }
+                generation = m_generation;
+        }
+        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
+                                return_frame(frame, generation);
+                                }, std::placeholders::_1, generation));
+}
+
+/// m_lock must be held
+struct video_frame *video_frame_pool::allocate_frame() {
+        struct video_frame *ret = vf_alloc_desc(m_desc);
+        try {
+                for (unsigned int i = 0; i < m_desc.tile_count; ++i) {
+                        auto it = m_depot.lower_bound(m_max_data_len);
+                        if (it != m_depot.end()) {
+                                ret->tiles[i].data = (char *) it->second;
+                                m_depot.erase(it);
+                        } else {
+                                size_t capacity = size_class(m_max_data_len);
                                 ret->tiles[i].data = (char *)
-                                        m_allocator->allocate(m_max_data_len);
+                                        m_allocator->allocate(capacity);
                                 if (ret->tiles[i].data == NULL) {
                                         throw std::runtime_error("Cannot allocate data");
                                 }
-                                ret->tiles[i].data_len = m_max_data_len;
+                                m_capacity[ret->tiles[i].data] = capacity;
                         }
-                } catch (std::exception &e) {
-                        std::cerr << e.what() << std::endl;
-                        deallocate_frame(ret);
-                        throw e;
+                        ret->tiles[i].data_len = m_max_data_len;
                 }
+        } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                recycle_frame(ret);
+                throw;
         }
-        m_unreturned_frames += 1;
-        return std::shared_ptr<video_frame>(ret, std::bind([this](struct video_frame *frame, int generation) {
-                                std::unique_lock<std::mutex> lk(m_lock);
-
-                                assert(m_unreturned_frames > 0);
-                                m_unreturned_frames -= 1;
-                                m_frame_returned.notify_one();
+        return ret;
+}
 
-                                if (this->m_generation != generation) {
-                                this->deallocate_frame(frame);
-                                } else {
-                                m_free_frames.push(frame);
-                                }
-                                }, std::placeholders::_1, m_generation));
+void video_frame_pool::return_frame(struct video_frame *frame, int generation) {
+        m_returning += 1;
+        if (generation != m_generation.load(std::memory_order_acquire) ||
+                        !m_free_frames.push(frame, generation)) {
+                std::unique_lock<std::mutex> lk(m_lock);
+                recycle_frame(frame);
+        }
+        assert(m_unreturned_frames > 0);
+        m_unreturned_frames -= 1;
+        if (m_waiters > 0) {
+                std::unique_lock<std::mutex> lk(m_lock);
+                m_frame_returned.notify_all();
+        }
+        m_returning -= 1;
 }
 
 struct video_frame *video_frame_pool::get_disposable_frame() {
@@ -130,6 +265,16 @@ struct video_frame *video_frame_pool::get_disposable_frame() {
         return out;
 }
 
+struct video_frame *video_frame_pool::get_disposable_frame(struct video_desc desc) {
+        std::unique_lock<std::mutex> lk(m_lock);
+        bool changed = m_generation == 0 || !video_desc_eq(desc, m_desc);
+        lk.unlock();
+        if (changed) {
+                reconfigure(desc);
+        }
+        return get_disposable_frame();
+}
+
 struct video_frame *video_frame_pool::get_pod_frame() {
         auto && frame = get_frame();
         struct video_frame *out = vf_alloc_desc(video_desc_from_frame(frame.get()));
@@ -146,26 +291,32 @@ video_frame_pool_allocator const & video_frame_pool::get_allocator() {
         return *m_allocator;
 }
 
+/// m_lock must be held
 void video_frame_pool::remove_free_frames() {
-        while (!m_free_frames.empty()) {
-                struct video_frame *frame = m_free_frames.front();
-                m_free_frames.pop();
-                deallocate_frame(frame);
+        struct video_frame *frame = NULL;
+        int generation = 0;
+        while (m_free_frames.pop(&frame, &generation)) {
+                recycle_frame(frame);
         }
 }
 
-void video_frame_pool::deallocate_frame(struct video_frame *frame) {
+/// moves the frame data to the depot, m_lock must be held
+void video_frame_pool::recycle_frame(struct video_frame *frame) {
         if (frame == NULL)
                 return;
         for (unsigned int i = 0; i < frame->tile_count; ++i) {
-                m_allocator->deallocate(frame->tiles[i].data);
+                if (frame->tiles[i].data != NULL) {
+                        m_depot.emplace(m_capacity.at(frame->tiles[i].data), frame->tiles[i].data);
+                }
         }
         vf_free(frame);
 }
 
 void *video_frame_pool_init(struct video_desc desc, int len) {
         auto *out = new video_frame_pool(len, default_data_allocator());
-        out->reconfigure(desc);
+        if (desc.color_spec != VIDEO_CODEC_NONE) {
+                out->reconfigure(desc);
+        }
         return (void *) out;
 }
 
@@ -174,6 +325,11 @@ struct video_frame *video_frame_pool_get_disposable_frame(void *state) {
         return s->get_disposable_frame();
 }
 
+struct video_frame *video_frame_pool_get_disposable_frame_desc(void *state, struct video_desc desc) {
+        auto *s = static_cast<video_frame_pool* >(state);
+        return s->get_disposable_frame(desc);
+}
+
 void video_frame_pool_destroy(void *state) {
         auto *s = static_cast<video_frame_pool* >(state);
         delete s;
@@ -40,16 +40,18 @@
 
 #include "debug.h"
 #include "host.h"
+#include "utils/frame_alloc.h"
 #include "utils/macros.h"
 #include "video.h"
 
 #ifdef __cplusplus
 
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
+#include <map>
 #include <mutex>
 #include <memory>
-#include <queue>
 
 struct video_frame_pool_allocator {
         virtual void *allocate(size_t size) = 0;
@@ -58,12 +60,50 @@ struct video_frame_pool_allocator {
         virtual ~video_frame_pool_allocator() {}
 };
 
+/// uses the allocation policy set by "--param frame-alloc", see utils/frame_alloc.h
 struct default_data_allocator : public video_frame_pool_allocator {
         void *allocate(size_t size) override;
         void deallocate(void *ptr) override;
         struct video_frame_pool_allocator *clone() const override;
 };
 
+/// allocator with an explicit policy, eg. huge pages local to the allocating thread
+struct hugepage_data_allocator : public video_frame_pool_allocator {
+        explicit hugepage_data_allocator(struct frame_alloc_policy policy = { FRAME_ALLOC_HUGETLB_2M, FRAME_ALLOC_NUMA_LOCAL });
+        void *allocate(size_t size) override;
+        void deallocate(void *ptr) override;
+        struct video_frame_pool_allocator *clone() const override;
+private:
+        struct frame_alloc_policy m_policy;
+};
+
+/**
+ * Bounded lock-free MPMC queue (D. Vyukov) of the frames returned to the pool
+ * so that getting and returning a frame in a steady state doesn't lock.
+ */
+class video_frame_freelist {
+        public:
+                explicit video_frame_freelist(size_t capacity);
+                bool push(struct video_frame *frame, int generation);
+                bool pop(struct video_frame **frame, int *generation);
+
+        private:
+                struct slot {
+                        std::atomic<size_t> seq;
+                        struct video_frame *frame;
+                        int generation;
+                };
+                std::unique_ptr<slot[]> m_slots;
+                size_t m_mask;
+                alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+                alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+};
+
+/**
+ * Data buffers are allocated in size classes and kept in a depot when the
+ * pool is reconfigured, so that a change to a smaller (or slightly larger)
+ * format reuses them instead of reallocating.
+ */
 struct video_frame_pool {
         public:
                 /**
@@ -94,26 +134,43 @@ struct video_frame_pool {
                 /** @returns frame eligible to be freed by vf_free() */
                 struct video_frame *get_pod_frame();
 
+                /**
+                 * Same as get_disposable_frame() but reconfigures the pool
+                 * first if desc differs from the current one
+                 */
+                struct video_frame *get_disposable_frame(struct video_desc desc);
+
                 video_frame_pool_allocator const & get_allocator();
 
         private:
+                struct video_frame *allocate_frame();
+                void return_frame(struct video_frame *frame, int generation);
                 void remove_free_frames();
-                void deallocate_frame(struct video_frame *frame);
+                void recycle_frame(struct video_frame *frame);
 
                 std::unique_ptr<video_frame_pool_allocator> m_allocator;
-                std::queue<struct video_frame *> m_free_frames;
-                std::mutex        m_lock;
+                video_frame_freelist m_free_frames;
+                std::mutex        m_lock; ///< protects all but the atomics and m_free_frames
                 std::condition_variable m_frame_returned;
-                int               m_generation;
+                std::atomic<int>  m_generation;
                 struct video_desc m_desc;
                 size_t            m_max_data_len;
-                unsigned int      m_unreturned_frames;
+                std::atomic<unsigned int> m_unreturned_frames; ///< including those being waited for
+                std::atomic<unsigned int> m_waiters;
+                std::atomic<unsigned int> m_returning; ///< deleters in progress
                 unsigned int      m_max_used_frames;
+                std::map<void *, size_t> m_capacity; ///< allocated buffers and their size
+                std::multimap<size_t, void *> m_depot; ///< unused buffers by size
 };
 #endif //  __cplusplus
 
+/**
+ * @param desc  may be empty (color_spec VIDEO_CODEC_NONE) if not yet known,
+ *              frames are then obtained with video_frame_pool_get_disposable_frame_desc()
+ */
 EXTERN_C void *video_frame_pool_init(struct video_desc desc, int len);
 EXTERN_C struct video_frame *video_frame_pool_get_disposable_frame(void *);
+EXTERN_C struct video_frame *video_frame_pool_get_disposable_frame_desc(void *, struct video_desc desc);
 EXTERN_C void video_frame_pool_destroy(void *);
 
 #endif // VIDEO_FRAME_POOL_H_
@@ -0,0 +1,255 @@
+/**
+ * @file   utils/video_overlay.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "color.h"
+#include "utils/macros.h"
+#include "utils/simd_lanes.h"
+#include "utils/video_overlay.h"
+#include "video_codec.h"
+
+/**
+ * Both buffers have the layout of the target codec so that the blend is
+ * format-agnostic: dst = color + dst * inv_alpha / 255 for every byte. For
+ * UYVY the chroma alpha is the mean of the pixel pair alpha.
+ */
+struct video_overlay {
+        codec_t codec;
+        int width;           ///< in pixels, multiple of the pixel block
+        int height;
+        int linesize;        ///< bytes per overlay line
+        unsigned char *color;     ///< premultiplied overlay in codec layout
+        unsigned char *inv_alpha; ///< 255 - alpha per byte
+};
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+typedef uint8_t v16qu __attribute__((vector_size(16)));
+typedef uint16_t v16hu __attribute__((vector_size(32)));
+
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+static ALWAYS_INLINE unsigned blend_px(unsigned dst, unsigned color, unsigned inv_alpha)
+{
+        unsigned x = dst * inv_alpha + 128;
+        x = color + ((x + (x >> 8)) >> 8);
+        return x > 255 ? 255 : x;
+}
+
+static ALWAYS_INLINE void blend_row(unsigned char *dst, const unsigned char *color,
+                const unsigned char *inv_alpha, int len)
+{
+        int i = 0;
+        for ( ; i + 16 <= len; i += 16) {
+                v16qu d, c, a;
+                memcpy(&d, dst + i, sizeof d);
+                memcpy(&c, color + i, sizeof c);
+                memcpy(&a, inv_alpha + i, sizeof a);
+                v16hu x = __builtin_convertvector(d, v16hu) * __builtin_convertvector(a, v16hu) + 128;
+                x = __builtin_convertvector(c, v16hu) + ((x + (x >> 8)) >> 8);
+                x |= (v16hu) { 0 } - (x >> 8); // saturate (rounding may overflow by 1)
+                d = __builtin_convertvector(x, v16qu);
+                memcpy(dst + i, &d, sizeof d);
+        }
+        for ( ; i < len; ++i) {
+                dst[i] = blend_px(dst[i], color[i], inv_alpha[i]);
+        }
+}
+
+typedef void blend_rows_t(const struct video_overlay *o, unsigned char *dst, int pitch,
+                int row_off, int rows, int len);
+
+static ALWAYS_INLINE void blend_rows_impl(const struct video_overlay *o, unsigned char *dst, int pitch,
+                int row_off, int rows, int len)
+{
+        for (int y = 0; y < rows; ++y) {
+                blend_row(dst + (size_t) y * pitch, o->color + (size_t) y * o->linesize + row_off,
+                                o->inv_alpha + (size_t) y * o->linesize + row_off, len);
+        }
+}
+
+static void blend_rows(const struct video_overlay *o, unsigned char *dst, int pitch,
+                int row_off, int rows, int len)
+{
+        blend_rows_impl(o, dst, pitch, row_off, rows, len);
+}
+
+#ifdef PIXFMT_SIMD_X86
+__attribute__((target("avx2"))) static void blend_rows_avx2(const struct video_overlay *o,
+                unsigned char *dst, int pitch, int row_off, int rows, int len)
+{
+        blend_rows_impl(o, dst, pitch, row_off, rows, len);
+}
+#endif
+
+bool video_overlay_supports(codec_t codec)
+{
+        return codec == UYVY || codec == RGB || codec == RGBA;
+}
+
+static inline unsigned premul(unsigned val, unsigned alpha)
+{
+        return (val * alpha + 127) / 255;
+}
+
+static void convert_uyvy(struct video_overlay *o, const unsigned char *rgba, int width)
+{
+        const int depth = 8;
+        for (int y = 0; y < o->height; ++y) {
+                const unsigned char *in = rgba + (size_t) y * width * 4;
+                unsigned char *color = o->color + (size_t) y * o->linesize;
+                unsigned char *ia = o->inv_alpha + (size_t) y * o->linesize;
+                for (int x = 0; x < o->width; x += 2) {
+                        unsigned char px[2][4] = { { 0 } };
+                        memcpy(px[0], in + 4 * x, 4);
+                        if (x + 1 < width) {
+                                memcpy(px[1], in + 4 * (x + 1), 4);
+                        }
+                        comp_type_t yy[2];
+                        comp_type_t cb = 0;
+                        comp_type_t cr = 0;
+                        for (int i = 0; i < 2; ++i) {
+                                comp_type_t r = px[i][0];
+                                comp_type_t g = px[i][1];
+                                comp_type_t b = px[i][2];
+                                yy[i] = (RGB_TO_Y_709_SCALED(r, g, b) >> COMP_BASE) + (1 << (depth - 4));
+                                yy[i] = CLAMP_LIMITED_Y(yy[i], depth);
+                                cb += CLAMP_LIMITED_CBCR((RGB_TO_CB_709_SCALED(r, g, b) >> COMP_BASE) + (1 << (depth - 1)), depth) * px[i][3];
+                                cr += CLAMP_LIMITED_CBCR((RGB_TO_CR_709_SCALED(r, g, b) >> COMP_BASE) + (1 << (depth - 1)), depth) * px[i][3];
+                        }
+                        unsigned a_c = (px[0][3] + px[1][3] + 1) / 2;
+                        color[0] = (cb + 255) / 510;
+                        color[1] = premul(yy[0], px[0][3]);
+                        color[2] = (cr + 255) / 510;
+                        color[3] = premul(yy[1], px[1][3]);
+                        ia[0] = ia[2] = 255 - a_c;
+                        ia[1] = 255 - px[0][3];
+                        ia[3] = 255 - px[1][3];
+                        color += 4;
+                        ia += 4;
+                }
+        }
+}
+
+static void convert_rgb(struct video_overlay *o, const unsigned char *rgba, int bpp)
+{
+        for (int y = 0; y < o->height; ++y) {
+                const unsigned char *in = rgba + (size_t) y * o->width * 4;
+                unsigned char *color = o->color + (size_t) y * o->linesize;
+                unsigned char *ia = o->inv_alpha + (size_t) y * o->linesize;
+                for (int x = 0; x < o->width; ++x) {
+                        unsigned alpha = in[3];
+                        for (int i = 0; i < 3; ++i) {
+                                color[i] = premul(in[i], alpha);
+                                ia[i] = 255 - alpha;
+                        }
+                        if (bpp == 4) {
+                                color[3] = alpha;
+                                ia[3] = 255 - alpha;
+                        }
+                        in += 4;
+                        color += bpp;
+                        ia += bpp;
+                }
+        }
+}
+
+struct video_overlay *video_overlay_create(const unsigned char *rgba, int width, int height, codec_t codec)
+{
+        if (!video_overlay_supports(codec) || width <= 0 || height <= 0) {
+                return NULL;
+        }
+        struct video_overlay *o = calloc(1, sizeof *o);
+        o->codec = codec;
+        o->width = codec == UYVY ? (width + 1) / 2 * 2 : width;
+        o->height = height;
+        o->linesize = vc_get_linesize(o->width, codec);
+        o->color = malloc((size_t) o->linesize * height);
+        o->inv_alpha = malloc((size_t) o->linesize * height);
+        if (codec == UYVY) {
+                convert_uyvy(o, rgba, width);
+        } else {
+                convert_rgb(o, rgba, (int) get_bpp(codec));
+        }
+        return o;
+}
+
+void video_overlay_destroy(struct video_overlay *o)
+{
+        if (!o) {
+                return;
+        }
+        free(o->color);
+        free(o->inv_alpha);
+        free(o);
+}
+
+void video_overlay_blend(const struct video_overlay *o, char *frame, int pitch, int frame_width,
+                int frame_height, int x, int y)
+{
+        const int block = o->codec == UYVY ? 2 : 1;
+        x = x / block * block;
+        int src_x = 0;
+        int src_y = 0;
+        if (x < 0) {
+                src_x = (-x + block - 1) / block * block;
+                x += src_x;
+        }
+        if (y < 0) {
+                src_y = -y;
+                y = 0;
+        }
+        int width = MIN(o->width - src_x, frame_width / block * block - x);
+        int height = MIN(o->height - src_y, frame_height - y);
+        if (width <= 0 || height <= 0) {
+                return;
+        }
+
+        blend_rows_t *blend = blend_rows;
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                blend = blend_rows_avx2;
+        }
+#endif
+        const int row_off = vc_get_linesize(src_x, o->codec);
+        blend(o, (unsigned char *) frame + (size_t) y * pitch + vc_get_linesize(x, o->codec), pitch,
+                        row_off + src_y * o->linesize, height, vc_get_linesize(width, o->codec));
+}
@@ -0,0 +1,79 @@
+/**
+ * @file   utils/video_overlay.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  prerendered overlay (logo, text) blended over video frames
+ *
+ * The overlay is converted once to the pixel format of the video with
+ * premultiplied alpha, so blending a frame is a single multiply-add per
+ * byte touching only the overlay rectangle.
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_VIDEO_OVERLAY_H_5F1C7A94_2E3B_4D6A_8B10_9A4E2C7D3F65
+#define UTILS_VIDEO_OVERLAY_H_5F1C7A94_2E3B_4D6A_8B10_9A4E2C7D3F65
+
+#include "types.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct video_overlay;
+
+/// UYVY, RGB and RGBA
+bool video_overlay_supports(codec_t codec);
+/**
+ * @param rgba  overlay image, RGBA with straight (not premultiplied) alpha
+ * @returns     overlay converted to @p codec, NULL if unsupported
+ */
+struct video_overlay *video_overlay_create(const unsigned char *rgba, int width, int height, codec_t codec);
+void video_overlay_destroy(struct video_overlay *o);
+/**
+ * Blends the overlay over the frame (in place), the part exceeding the
+ * frame is clipped.
+ *
+ * @param x  left edge, rounded down to pixel block boundary (even for UYVY)
+ */
+void video_overlay_blend(const struct video_overlay *o, char *frame, int pitch, int frame_width,
+                int frame_height, int x, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_VIDEO_OVERLAY_H_5F1C7A94_2E3B_4D6A_8B10_9A4E2C7D3F65
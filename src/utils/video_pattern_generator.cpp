@@ -60,7 +60,6 @@
 #include <array>
 #include <iostream>
 #include <memory>
-#include <random>
 #include <utility>
 #include <vector>
 
@@ -69,7 +68,9 @@
 #include "ug_runtime_error.hpp"
 #include "utils/color_out.h"
 #include "utils/string_view_utils.hpp"
+#include "utils/misc.h"
 #include "utils/text.h"
+#include "utils/worker.h"
 #include "video.h"
 #include "video_capture/testcard_common.h"
 #include "video_pattern_generator.h"
@@ -82,9 +83,7 @@ using namespace std::string_literals;
 using std::array;
 using std::copy;
 using std::cout;
-using std::default_random_engine;
 using std::exception;
-using std::for_each;
 using std::make_unique;
 using std::min;
 using std::stoi;
@@ -92,7 +91,6 @@ using std::stoll;
 using std::string;
 using std::string_view;
 using std::unique_ptr;
-using std::uniform_int_distribution;
 using std::vector;
 
 enum class generator_depth {
@@ -400,11 +398,28 @@ class image_pattern_uv_plane : public image_pattern {
                 }
 };
 
+/**
+ * Rows are generated in parallel, each with a xorshift generator seeded by the
+ * row index (4 samples per draw) so that the output doesn't depend on the
+ * thread count.
+ */
 class image_pattern_noise : public image_pattern {
-        default_random_engine rand_gen;
         enum generator_depth fill(int width, int height, unsigned char *data) override {
-                uniform_int_distribution<> dist(0, 0xFFFF);
-                for_each(reinterpret_cast<uint16_t *>(data), reinterpret_cast<uint16_t *>(data) + 3 * width * height, [&](uint16_t & c) { c = dist(rand_gen); });
+                int cpus = get_cpu_core_count();
+                parallel_for(height, std::max(1, height / (4 * cpus)), cpus, [&](int begin, int end) {
+                        for (int y = begin; y < end; ++y) {
+                                uint64_t state = (y + 1ULL) * 0x9E3779B97F4A7C15ULL;
+                                auto *row = reinterpret_cast<uint16_t *>(data + (size_t) y * width * rg48_bpp);
+                                for (int i = 0; i < 3 * width; i += 4) {
+                                        state ^= state << 13U;
+                                        state ^= state >> 7U;
+                                        state ^= state << 17U;
+                                        for (int j = 0; j < min(4, 3 * width - i); ++j) {
+                                                row[i + j] = state >> (16U * j);
+                                        }
+                                }
+                        }
+                });
                 return generator_depth::bits16;
         }
 };
@@ -524,6 +539,21 @@ struct video_pattern_generator {
         virtual ~video_pattern_generator() {}
 };
 
+/// testcard_convert_buffer() split to row ranges converted in parallel
+static void convert_buffer_parallel(codec_t in_c, codec_t out_c, unsigned char *out, const unsigned char *in, int width, int height)
+{
+        if (out_c == I420) { // planar
+                testcard_convert_buffer(in_c, out_c, out, in, width, height);
+                return;
+        }
+        long in_linesize = vc_get_linesize(width, in_c);
+        long out_linesize = vc_get_linesize(width, out_c);
+        int cpus = get_cpu_core_count();
+        parallel_for(height, std::max(1, height / (4 * cpus)), cpus, [&](int begin, int end) {
+                testcard_convert_buffer(in_c, out_c, out + begin * out_linesize, in + begin * in_linesize, width, end - begin);
+        });
+}
+
 struct still_image_video_pattern_generator : public video_pattern_generator {
         still_image_video_pattern_generator(string const &pattern, string const &params, int w, int h, codec_t c, int o)
                 : width(w), height(h), color_spec(c), offset(o)
@@ -539,18 +569,19 @@ struct still_image_video_pattern_generator : public video_pattern_generator {
                         throw 2;
                 }
 
-                data = generator->init(width, height, generator_depth::bits8);
                 codec_t codec_src = RGBA;
+                enum generator_depth depth = generator_depth::bits8;
                 if (get_decoder_from_to(RG48, color_spec) != NULL) {
-                        data = generator->init(width, height, generator_depth::bits16);
                         codec_src = RG48;
+                        depth = generator_depth::bits16;
                 }
+                data = generator->init(width, height, depth);
 
                 vector<unsigned char> src;
                 data.swap(src);
                 long data_len = vc_get_datalen(width, height, color_spec);
                 data.resize(data_len * 2);
-                testcard_convert_buffer(codec_src, color_spec, data.data(), src.data(), width, height);
+                convert_buffer_parallel(codec_src, color_spec, data.data(), src.data(), width, height);
 
                 if (auto *raw_generator = dynamic_cast<image_pattern_raw *>(generator.get())) {
                         raw_generator->raw_fill(data.data(), data_len);
@@ -577,6 +608,11 @@ struct still_image_video_pattern_generator : public video_pattern_generator {
         }
 };
 
+/**
+ * Frames are rendered when requested to a small ring of buffers (instead of
+ * keeping all 255/step levels) - one row is built from the converted pixel
+ * block and copied to the others in parallel.
+ */
 struct gray_video_pattern_generator : public video_pattern_generator {
         gray_video_pattern_generator(int w, int h, codec_t c, string const& opts)
                 : width(w), height(h), color_spec(c)
@@ -588,34 +624,38 @@ struct gray_video_pattern_generator : public video_pattern_generator {
                         }
                         step = stoi(opts);
                 }
-                int col = 0;
-                while (col < 0xFF) {
-                        int pixels = get_pf_block_pixels(color_spec);
-                        unsigned char rgba[pixels * 4];
-                        for (int i = 0; i < pixels * 4; ++i) {
-                                rgba[i] = (i + 1) % 4 != 0 ? col : 0xFFU; // handle alpha
-                        }
-                        int dst_bs = get_pf_block_bytes(color_spec);
-                        unsigned char dst[dst_bs];
-                        testcard_convert_buffer(RGBA, color_spec, dst, rgba, pixels, 1);
-
-                        auto next_frame = vector<unsigned char>(data_len);
-                        for (int y = 0; y < height; ++y) {
-                                for (int x = 0; x < width / pixels; x += 1) {
-                                        memcpy(next_frame.data() + y * vc_get_linesize(width, color_spec) + x * dst_bs, dst, dst_bs);
-                                }
-                        }
-                        data.push_back(std::move(next_frame));
-                        col += step;
+                for (auto &buf : data) {
+                        buf.resize(data_len);
                 }
+                row.resize(linesize);
         }
         char *get_next() override {
-                auto *out = (char *) data[cur_idx++].data();
+                int col = cur_idx++ * step;
                 if (cur_idx * step >= 0xFF) {
                         cur_idx = 0;
                 }
 
-                return out;
+                int pixels = get_pf_block_pixels(color_spec);
+                unsigned char rgba[pixels * 4];
+                for (int i = 0; i < pixels * 4; ++i) {
+                        rgba[i] = (i + 1) % 4 != 0 ? col : 0xFFU; // handle alpha
+                }
+                int dst_bs = get_pf_block_bytes(color_spec);
+                unsigned char dst[dst_bs];
+                testcard_convert_buffer(RGBA, color_spec, dst, rgba, pixels, 1);
+                for (int x = 0; x < width / pixels; x += 1) {
+                        memcpy(row.data() + x * dst_bs, dst, dst_bs);
+                }
+
+                auto &out = data[cur_buf];
+                cur_buf = (cur_buf + 1) % data.size();
+                int cpus = get_cpu_core_count();
+                parallel_for(height, std::max(1, height / (4 * cpus)), cpus, [&](int begin, int end) {
+                        for (int y = begin; y < end; ++y) {
+                                memcpy(out.data() + y * linesize, row.data(), linesize);
+                        }
+                });
+                return (char *) out.data();
         }
 private:
         constexpr static int DEFAULT_STEP = 1;
@@ -625,7 +665,10 @@ private:
         codec_t color_spec;
         int cur_idx = 0;
         long data_len = vc_get_datalen(width, height, color_spec);
-        vector<vector<unsigned char>> data;
+        long linesize = vc_get_linesize(width, color_spec);
+        array<vector<unsigned char>, 3> data; ///< the returned frame may still be in use by the caller
+        size_t cur_buf = 0;
+        vector<unsigned char> row;
 };
 
 struct interlaced_video_pattern_generator : public video_pattern_generator {
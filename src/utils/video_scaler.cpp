@@ -0,0 +1,484 @@
+/**
+ * @file   utils/video_scaler.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+#include <vector>
+
+#include "utils/misc.h"
+#include "utils/simd_lanes.h"
+#include "utils/video_scaler.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+constexpr int COEF_BITS = 14; ///< fixed-point precision of filter coefficients
+constexpr int MAX_PLANES = 4;
+
+namespace {
+
+/// filter coefficients for one dimension, taps per output sample
+struct scaler_coefs {
+        int taps = 0;
+        vector<int> start;     ///< first input sample for each output sample
+        vector<int16_t> coef;  ///< taps coefficients for each output sample
+};
+
+/// component interleaved in a row - sample x is at offset + x * step
+struct plane_layout {
+        int offset;
+        int step;
+        bool chroma; ///< subsampled horizontally
+};
+
+struct scaler_geometry {
+        codec_t codec;
+        int width, height, dst_width, dst_height;
+        bool operator==(const scaler_geometry &o) const {
+                return codec == o.codec && width == o.width && height == o.height
+                        && dst_width == o.dst_width && dst_height == o.dst_height;
+        }
+};
+
+double filter_support(enum video_scaler_filter f) {
+        switch (f) {
+        case VIDEO_SCALER_BILINEAR: return 1.0;
+        case VIDEO_SCALER_BICUBIC: return 2.0;
+        case VIDEO_SCALER_LANCZOS: return 3.0;
+        }
+        return 1.0;
+}
+
+double sinc(double x) {
+        if (x == 0.0) {
+                return 1.0;
+        }
+        x *= M_PI;
+        return sin(x) / x;
+}
+
+double filter_weight(enum video_scaler_filter f, double x) {
+        x = fabs(x);
+        switch (f) {
+        case VIDEO_SCALER_BILINEAR:
+                return max(0.0, 1.0 - x);
+        case VIDEO_SCALER_BICUBIC: {
+                const double a = -0.5;
+                if (x < 1.0) {
+                        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+                }
+                if (x < 2.0) {
+                        return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+                }
+                return 0.0;
+        }
+        case VIDEO_SCALER_LANCZOS:
+                return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+        }
+        return 0.0;
+}
+
+/**
+ * Computes polyphase coefficients mapping in_size samples to out_size.
+ * When downscaling, the filter is stretched to avoid aliasing. Taps falling
+ * outside the picture are folded to the edge samples.
+ */
+void compute_coefs(enum video_scaler_filter f, int in_size, int out_size, scaler_coefs *c) {
+        double scale = (double) out_size / in_size;
+        double stretch = max(1.0, 1.0 / scale);
+        double support = filter_support(f) * stretch;
+        c->taps = min<int>(ceil(support) * 2, in_size);
+        c->start.resize(out_size);
+        c->coef.resize((size_t) out_size * c->taps);
+        vector<double> w(c->taps);
+        for (int x = 0; x < out_size; ++x) {
+                double center = (x + 0.5) / scale - 0.5;
+                int first = floor(center - support) + 1;
+                int start = max(0, min(first, in_size - c->taps));
+                std::fill(w.begin(), w.end(), 0.0);
+                double sum = 0.0;
+                for (int pos = first; pos < first + (int) ceil(support) * 2; ++pos) {
+                        double weight = filter_weight(f, (pos - center) / stretch);
+                        int idx = max(0, min(pos, in_size - 1)) - start;
+                        idx = max(0, min(idx, c->taps - 1));
+                        w[idx] += weight;
+                        sum += weight;
+                }
+                int16_t *coef = &c->coef[(size_t) x * c->taps];
+                int isum = 0;
+                int largest = 0;
+                for (int k = 0; k < c->taps; ++k) {
+                        coef[k] = lround(w[k] / sum * (1 << COEF_BITS));
+                        isum += coef[k];
+                        if (abs(coef[k]) > abs(coef[largest])) {
+                                largest = k;
+                        }
+                }
+                coef[largest] += (1 << COEF_BITS) - isum; // keep DC gain exactly 1
+                c->start[x] = start;
+        }
+}
+
+/// v210 component order is the same as UYVY - 3 components per 32-bit word
+void unpack_v210(const unsigned char *src, uint16_t *dst, int width) {
+        int words = (width + 5) / 6 * 4;
+        for (int i = 0; i < words; ++i) {
+                uint32_t w;
+                memcpy(&w, src + 4 * i, sizeof w);
+                *dst++ = w & 0x3FF;
+                *dst++ = (w >> 10) & 0x3FF;
+                *dst++ = (w >> 20) & 0x3FF;
+        }
+}
+
+void pack_v210(const uint16_t *src, unsigned char *dst, int width) {
+        int words = (width + 5) / 6 * 4;
+        for (int i = 0; i < words; ++i) {
+                uint32_t w = src[0] | src[1] << 10 | src[2] << 20;
+                memcpy(dst + 4 * i, &w, sizeof w);
+                src += 3;
+        }
+}
+
+template<typename out_t>
+void vertical_c(const int16_t *const *rows, const int16_t *coef, int taps, int shift, int maxval,
+                out_t *out, int begin, int count) {
+        for (int i = begin; i < count; ++i) {
+                int32_t acc = 1 << (shift - 1);
+                for (int k = 0; k < taps; ++k) {
+                        acc += coef[k] * rows[k][i];
+                }
+                out[i] = max(0, min(acc >> shift, maxval));
+        }
+}
+
+#ifdef PIXFMT_SIMD_X86
+/// @returns 16 output samples as int16 (in order)
+__attribute__((target("avx2"))) inline __m256i vertical_avx2_16(const int16_t *const *rows, const int16_t *coef,
+                int taps, int shift, int i) {
+        __m256i lo = _mm256_set1_epi32(1 << (shift - 1));
+        __m256i hi = lo;
+        int k = 0;
+        for (; k + 1 < taps; k += 2) {
+                __m256i a = _mm256_loadu_si256((const __m256i *)(const void *) (rows[k] + i));
+                __m256i b = _mm256_loadu_si256((const __m256i *)(const void *) (rows[k + 1] + i));
+                __m256i c = _mm256_set1_epi32((uint16_t) coef[k] | (uint32_t) (uint16_t) coef[k + 1] << 16);
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c));
+        }
+        if (k < taps) {
+                __m256i a = _mm256_loadu_si256((const __m256i *)(const void *) (rows[k] + i));
+                __m256i c = _mm256_set1_epi32((uint16_t) coef[k]);
+                __m256i zero = _mm256_setzero_si256();
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, zero), c));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, zero), c));
+        }
+        lo = _mm256_sra_epi32(lo, _mm_cvtsi32_si128(shift));
+        hi = _mm256_sra_epi32(hi, _mm_cvtsi32_si128(shift));
+        // unpack{lo,hi} and packs work within 128-bit lanes so the order is restored
+        return _mm256_packs_epi32(lo, hi);
+}
+
+__attribute__((target("avx2"))) void vertical_avx2_u8(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint8_t *out, int count) {
+        int i = 0;
+        for (; i + 16 <= count; i += 16) {
+                __m256i v = vertical_avx2_16(rows, coef, taps, shift, i);
+                v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+                _mm_storeu_si128((__m128i *)(void *) (out + i), _mm256_castsi256_si128(v));
+        }
+        vertical_c(rows, coef, taps, shift, maxval, out, i, count);
+}
+
+__attribute__((target("avx2"))) void vertical_avx2_u16(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint16_t *out, int count) {
+        int i = 0;
+        const __m256i vmax = _mm256_set1_epi16(maxval);
+        for (; i + 16 <= count; i += 16) {
+                __m256i v = vertical_avx2_16(rows, coef, taps, shift, i);
+                v = _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()), vmax);
+                _mm256_storeu_si256((__m256i *)(void *) (out + i), v);
+        }
+        vertical_c(rows, coef, taps, shift, maxval, out, i, count);
+}
+#endif // defined PIXFMT_SIMD_X86
+
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+/// @returns 8 output samples as int16
+inline int16x8_t vertical_neon_8(const int16_t *const *rows, const int16_t *coef, int taps, int shift, int i) {
+        int32x4_t lo = vdupq_n_s32(1 << (shift - 1));
+        int32x4_t hi = lo;
+        for (int k = 0; k < taps; ++k) {
+                int16x8_t a = vld1q_s16(rows[k] + i);
+                lo = vmlal_n_s16(lo, vget_low_s16(a), coef[k]);
+                hi = vmlal_n_s16(hi, vget_high_s16(a), coef[k]);
+        }
+        int32x4_t sh = vdupq_n_s32(-shift);
+        return vcombine_s16(vqmovn_s32(vshlq_s32(lo, sh)), vqmovn_s32(vshlq_s32(hi, sh)));
+}
+
+void vertical_neon_u8(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint8_t *out, int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+                vst1_u8(out + i, vqmovun_s16(vertical_neon_8(rows, coef, taps, shift, i)));
+        }
+        vertical_c(rows, coef, taps, shift, maxval, out, i, count);
+}
+
+void vertical_neon_u16(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint16_t *out, int count) {
+        int i = 0;
+        const int16x8_t vmax = vdupq_n_s16(maxval);
+        for (; i + 8 <= count; i += 8) {
+                int16x8_t v = vminq_s16(vmaxq_s16(vertical_neon_8(rows, coef, taps, shift, i), vdupq_n_s16(0)), vmax);
+                vst1q_u16(out + i, vreinterpretq_u16_s16(v));
+        }
+        vertical_c(rows, coef, taps, shift, maxval, out, i, count);
+}
+#endif // defined PIXFMT_SIMD_NEON_ENABLED
+
+typedef void (*vertical_u8_t)(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint8_t *out, int count);
+typedef void (*vertical_u16_t)(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint16_t *out, int count);
+
+void vertical_c_u8(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint8_t *out, int count) {
+        vertical_c(rows, coef, taps, shift, maxval, out, 0, count);
+}
+
+void vertical_c_u16(const int16_t *const *rows, const int16_t *coef, int taps,
+                int shift, int maxval, uint16_t *out, int count) {
+        vertical_c(rows, coef, taps, shift, maxval, out, 0, count);
+}
+
+template<typename in_t>
+void horizontal(const in_t *in, int16_t *out, const plane_layout *planes, int plane_count,
+                const scaler_coefs *luma, const scaler_coefs *chroma, int dst_width, int inter_shift) {
+        const int shift = COEF_BITS - inter_shift;
+        for (int p = 0; p < plane_count; ++p) {
+                const plane_layout &pl = planes[p];
+                const scaler_coefs *c = pl.chroma ? chroma : luma;
+                int count = pl.chroma ? (dst_width + 1) / 2 : dst_width;
+                const in_t *src = in + pl.offset;
+                int16_t *dst = out + pl.offset;
+                for (int x = 0; x < count; ++x) {
+                        const int16_t *coef = &c->coef[(size_t) x * c->taps];
+                        const in_t *s = src + (ptrdiff_t) c->start[x] * pl.step;
+                        int32_t acc = 1 << (shift - 1);
+                        for (int k = 0; k < c->taps; ++k) {
+                                acc += coef[k] * s[k * pl.step];
+                        }
+                        dst[x * pl.step] = max<int32_t>(INT16_MIN, min<int32_t>(acc >> shift, INT16_MAX));
+                }
+        }
+}
+
+} // end anonymous namespace
+
+struct video_scaler {
+        enum video_scaler_filter filter;
+        scaler_geometry geometry{};
+        scaler_coefs h_luma, h_chroma, vert;
+        vector<int16_t> intermediate; ///< horizontally scaled source rows
+        int row_samples = 0;           ///< samples in intermediate (and output) row
+
+        vertical_u8_t vertical_u8 = vertical_c_u8;
+        vertical_u16_t vertical_u16 = vertical_c_u16;
+};
+
+struct video_scaler *video_scaler_create(enum video_scaler_filter filter)
+{
+        auto *s = new video_scaler();
+        s->filter = filter;
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                s->vertical_u8 = vertical_avx2_u8;
+                s->vertical_u16 = vertical_avx2_u16;
+        }
+#endif
+#ifdef PIXFMT_SIMD_NEON_ENABLED
+        s->vertical_u8 = vertical_neon_u8;
+        s->vertical_u16 = vertical_neon_u16;
+#endif
+        return s;
+}
+
+void video_scaler_destroy(struct video_scaler *s)
+{
+        delete s;
+}
+
+bool video_scaler_supports(codec_t codec)
+{
+        return codec == UYVY || codec == v210 || codec == RGB || codec == RGBA;
+}
+
+bool video_scaler_parse_filter(const char *filter_name, enum video_scaler_filter *filter)
+{
+        if (strcasecmp(filter_name, "bilinear") == 0) {
+                *filter = VIDEO_SCALER_BILINEAR;
+        } else if (strcasecmp(filter_name, "bicubic") == 0) {
+                *filter = VIDEO_SCALER_BICUBIC;
+        } else if (strcasecmp(filter_name, "lanczos") == 0) {
+                *filter = VIDEO_SCALER_LANCZOS;
+        } else {
+                return false;
+        }
+        return true;
+}
+
+static int get_planes(codec_t codec, plane_layout *planes)
+{
+        switch (codec) {
+        case RGB:
+        case RGBA: {
+                int comps = codec == RGB ? 3 : 4;
+                for (int i = 0; i < comps; ++i) {
+                        planes[i] = { i, comps, false };
+                }
+                return comps;
+        }
+        case UYVY:
+        case v210: // unpacked to UYVY order
+                planes[0] = { 1, 2, false };
+                planes[1] = { 0, 4, true };
+                planes[2] = { 2, 4, true };
+                return 3;
+        default:
+                return 0;
+        }
+}
+
+static int get_row_samples(codec_t codec, int width)
+{
+        switch (codec) {
+        case RGB: return 3 * width;
+        case RGBA: return 4 * width;
+        case UYVY: return 4 * ((width + 1) / 2);
+        case v210: return (width + 5) / 6 * 12; // whole v210 blocks
+        default: return 0;
+        }
+}
+
+static void reconfigure(struct video_scaler *s, const scaler_geometry &g)
+{
+        s->geometry = g;
+        compute_coefs(s->filter, g.width, g.dst_width, &s->h_luma);
+        if (g.codec == UYVY || g.codec == v210) {
+                compute_coefs(s->filter, (g.width + 1) / 2, (g.dst_width + 1) / 2, &s->h_chroma);
+        }
+        compute_coefs(s->filter, g.height, g.dst_height, &s->vert);
+        s->row_samples = get_row_samples(g.codec, g.dst_width);
+        s->intermediate.assign((size_t) s->row_samples * g.height, 0);
+}
+
+bool video_scaler_scale(struct video_scaler *s, codec_t codec,
+                const char *src, int src_pitch, int width, int height,
+                char *dst, int dst_pitch, int dst_width, int dst_height)
+{
+        plane_layout planes[MAX_PLANES];
+        int plane_count = get_planes(codec, planes);
+        if (plane_count == 0 || width <= 0 || height <= 0 || dst_width <= 0 || dst_height <= 0) {
+                return false;
+        }
+        scaler_geometry g{ codec, width, height, dst_width, dst_height };
+        if (!(g == s->geometry)) {
+                reconfigure(s, g);
+        }
+
+        const int depth = codec == v210 ? 10 : 8;
+        const int inter_shift = 12 - depth; // headroom for filter overshoot in int16
+        const int cpus = get_cpu_core_count();
+
+        parallel_for(height, max(1, height / (4 * cpus)), cpus, [&](int begin, int end) {
+                thread_local vector<uint16_t> unpacked;
+                for (int y = begin; y < end; ++y) {
+                        const unsigned char *in = (const unsigned char *) src + (size_t) y * src_pitch;
+                        int16_t *out = &s->intermediate[(size_t) y * s->row_samples];
+                        if (codec == v210) {
+                                unpacked.resize((width + 5) / 6 * 12);
+                                unpack_v210(in, unpacked.data(), width);
+                                horizontal(unpacked.data(), out, planes, plane_count, &s->h_luma, &s->h_chroma,
+                                                dst_width, inter_shift);
+                        } else {
+                                horizontal(in, out, planes, plane_count, &s->h_luma, &s->h_chroma,
+                                                dst_width, inter_shift);
+                        }
+                }
+        });
+
+        const int shift = COEF_BITS + inter_shift;
+        const int maxval = (1 << depth) - 1;
+        const scaler_coefs &v = s->vert;
+        parallel_for(dst_height, max(1, dst_height / (4 * cpus)), cpus, [&](int begin, int end) {
+                thread_local vector<uint16_t> packed;
+                thread_local vector<const int16_t *> rows;
+                rows.resize(v.taps);
+                for (int y = begin; y < end; ++y) {
+                        for (int k = 0; k < v.taps; ++k) {
+                                rows[k] = &s->intermediate[(size_t) (v.start[y] + k) * s->row_samples];
+                        }
+                        const int16_t *coef = &v.coef[(size_t) y * v.taps];
+                        unsigned char *out = (unsigned char *) dst + (size_t) y * dst_pitch;
+                        if (codec == v210) {
+                                packed.resize(s->row_samples);
+                                s->vertical_u16(rows.data(), coef, v.taps, shift, maxval, packed.data(), s->row_samples);
+                                pack_v210(packed.data(), out, dst_width);
+                        } else {
+                                s->vertical_u8(rows.data(), coef, v.taps, shift, maxval, out,
+                                                vc_get_linesize(dst_width, codec));
+                        }
+                }
+        });
+
+        return true;
+}
+
@@ -0,0 +1,90 @@
+/**
+ * @file   utils/video_scaler.h
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  native polyphase scaler working directly on packed pixel formats
+ *
+ * Supports UYVY, v210, RGB and RGBA without converting the picture to
+ * another color space. Filtering is separable - a horizontal pass to
+ * an intermediate buffer is followed by a vertical one, both split among
+ * worker threads by rows. Filter coefficients are computed once for
+ * a geometry and cached in the scaler state.
+ */
+/*
+ * Copyright (c) 2024 CESNET z.s.p.o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UTILS_VIDEO_SCALER_H_7C3E1A52_9D4B_4F86_A2E1_5B0C8D6F3A91
+#define UTILS_VIDEO_SCALER_H_7C3E1A52_9D4B_4F86_A2E1_5B0C8D6F3A91
+
+#include "types.h"
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum video_scaler_filter {
+        VIDEO_SCALER_BILINEAR,
+        VIDEO_SCALER_BICUBIC,  ///< Catmull-Rom
+        VIDEO_SCALER_LANCZOS,  ///< Lanczos3
+};
+
+struct video_scaler;
+
+struct video_scaler *video_scaler_create(enum video_scaler_filter filter);
+void video_scaler_destroy(struct video_scaler *s);
+bool video_scaler_supports(codec_t codec);
+/**
+ * @param filter_name bilinear, bicubic or lanczos
+ * @retval false      unknown name
+ */
+bool video_scaler_parse_filter(const char *filter_name, enum video_scaler_filter *filter);
+/**
+ * Scales picture, the pixel format is kept.
+ *
+ * @param src_pitch, dst_pitch  line lengths in bytes (may be larger than
+ *                              vc_get_linesize(), eg. to process a field
+ *                              of an interlaced frame)
+ * @retval false  unsupported codec
+ */
+bool video_scaler_scale(struct video_scaler *s, codec_t codec,
+                const char *src, int src_pitch, int width, int height,
+                char *dst, int dst_pitch, int dst_width, int dst_height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // defined UTILS_VIDEO_SCALER_H_7C3E1A52_9D4B_4F86_A2E1_5B0C8D6F3A91
@@ -41,213 +41,493 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include "debug.h"
+#include "host.h"
 #include "utils/misc.h" // get_cpu_core_count
 #include "utils/thread.h"
 #include "utils/worker.h"
 
 #include <algorithm>
-#include <queue>
-#include <set>
+#include <atomic>
+#include <climits>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
+#ifdef HAVE_LINUX
+#include <sched.h>
+#endif
 
 using namespace std;
 
-struct wp_worker;
+#define MOD_NAME "[worker] "
+#define RESPAWN_PARALLEL_CHUNK_BYTES (128 * 1024)
 
-struct worker_state_observer {
-        virtual ~worker_state_observer() {}
-        virtual void notify(wp_worker *) = 0;
-};
+ADD_TO_PARAM("worker-numa-pin",
+                "* worker-numa-pin=no\n"
+                "  Do not restrict the worker pool threads to CPUs of the NUMA node of the\n"
+                "  thread that first used them (Linux, multi-node machines only).\n");
 
 /**
- * @brief Holds data to be passed to worker.
+ * @brief Single unit of work of the pool
+ *
+ * Tasks belonging to a task_group are (possibly nested) compute tasks, that
+ * may be executed also by a thread waiting for any group. Async tasks may
+ * block arbitrarily long so they are run by the pool workers only.
  */
-struct wp_task_data {
-        wp_task_data(runnable_t task, void *data, wp_worker *w, bool detached) : m_task(task), m_data(data),
-                m_result(0), m_returned(false), m_w(w), m_detached(detached) {}
+struct ws_task {
         runnable_t m_task;
         void *m_data;
-        void *m_result;
+        struct task_group *m_group; ///< NULL for async tasks
+        void **m_result_ptr;        ///< group tasks - where to store the result (may be NULL)
+        void *m_result;             ///< async tasks
         bool m_returned;
-        struct wp_worker *m_w;
         bool m_detached;
 };
 
-/**
- * @brief This class represents a worker that is called from within the pool
- */
-struct wp_worker {
-        wp_worker(worker_state_observer &observer) :
-                m_state_observer(observer)
-        {
-                int ret;
-                ret = pthread_mutex_init(&m_lock, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_ready_cv, NULL);
-                assert(ret == 0);
-                ret = pthread_cond_init(&m_task_completed_cv, NULL);
-                assert(ret == 0);
-
-                ret = pthread_create(&m_thread_id, NULL, wp_worker::enter_loop, this);
-                assert(ret == 0);
-        }
-        ~wp_worker() {
-                wp_task_data *poisoned = new wp_task_data(NULL, NULL, this, false);
-                this->push(poisoned);
-
-                pthread_join(m_thread_id, NULL);
+struct task_group {
+        task_group() {
+                pthread_mutex_init(&m_lock, NULL);
+                pthread_cond_init(&m_done_cv, NULL);
+        }
+        ~task_group() {
+                pthread_cond_destroy(&m_done_cv);
                 pthread_mutex_destroy(&m_lock);
-                pthread_cond_destroy(&m_task_ready_cv);
-                pthread_cond_destroy(&m_task_completed_cv);
         }
-        static void      *enter_loop(void *args);
-        void              run();
+        void run(runnable_t task, void *data, void **result_ptr = nullptr);
+        void wait();
+        void finished();
+
+        atomic<int>     m_pending{0};
+        pthread_mutex_t m_lock;
+        pthread_cond_t  m_done_cv;
+};
+
+/**
+ * @brief Work-stealing thread pool
+ *
+ * Each of the core (get_cpu_core_count()) workers has its own deque of group
+ * tasks - it pushes to and pops from its back while the other threads steal
+ * from the front. Threads outside of the pool push to the shared injection
+ * queue. Async tasks (task_run_async()) are queued separately and if there is
+ * not enough idle workers for them, an additional worker is spawned (which
+ * is kept for later use), so that a blocking async task never starves the
+ * others.
+ */
+class ws_pool {
+        public:
+                ws_pool() {
+                        pthread_mutex_init(&m_lock, NULL);
+                        pthread_cond_init(&m_work_cv, NULL);
+                        pthread_cond_init(&m_async_done_cv, NULL);
+                }
+                ~ws_pool() {
+                        pthread_mutex_lock(&m_lock);
+                        m_should_exit = true;
+                        pthread_cond_broadcast(&m_work_cv);
+                        pthread_mutex_unlock(&m_lock);
+                        for (auto &t : m_threads) {
+                                pthread_join(t, NULL);
+                        }
+                        pthread_cond_destroy(&m_async_done_cv);
+                        pthread_cond_destroy(&m_work_cv);
+                        pthread_mutex_destroy(&m_lock);
+                }
 
-        void              push(wp_task_data *);
-        void             *pop(wp_task_data *);
+                void push(ws_task *t);
+                ws_task *run_async(runnable_t task, void *data, bool detached);
+                void *wait_async(ws_task *t);
+                ws_task *find_group_task();
+                int size();
 
-        queue<wp_task_data*> m_data;
-        pthread_mutex_t   m_lock;
-        pthread_cond_t    m_task_ready_cv;
-        pthread_cond_t    m_task_completed_cv;
-        pthread_t         m_thread_id;
+        private:
+                struct alignas(64) ws_queue {
+                        ws_queue() { pthread_mutex_init(&m_lock, NULL); }
+                        ~ws_queue() { pthread_mutex_destroy(&m_lock); }
+                        pthread_mutex_t m_lock;
+                        deque<ws_task *> m_tasks;
+                };
+                struct worker_arg {
+                        ws_pool *pool;
+                        int queue_idx;
+                };
+
+                static void *enter_loop(void *arg);
+                void worker_loop(int queue_idx);
+                ws_task *find_task(int queue_idx);
+                ws_task *pop_front(int queue_idx);
+                void execute(ws_task *t);
+                void start();
+                void spawn_worker(int queue_idx);
 
-        worker_state_observer &m_state_observer;
+                pthread_mutex_t m_lock;
+                pthread_cond_t  m_work_cv;
+                pthread_cond_t  m_async_done_cv;
+                bool            m_started = false;
+                bool            m_should_exit = false;
+                int             m_idle = 0;         ///< workers waiting for work
+                atomic<int>     m_queued{0};        ///< queued tasks (group and async), incremented with m_lock held
+                int             m_async_queued = 0;
+                deque<ws_task *> m_async_tasks;     ///< protected by m_lock
+                unique_ptr<ws_queue[]> m_queues;    ///< [0] injection queue, [1..m_core_workers] worker deques
+                int             m_core_workers = 0;
+                vector<pthread_t> m_threads;
+#ifdef HAVE_LINUX
+                bool            m_use_affinity = false;
+                cpu_set_t       m_node_cpus;
+                void init_affinity();
+#endif
 };
 
-void *wp_worker::enter_loop(void *args) {
-        set_thread_name("worker");
-        wp_worker *instance = (wp_worker *) args;
-        instance->run();
+static thread_local int tl_queue_idx = 0; ///< own deque of a core worker, 0 (injection queue) otherwise
 
-        return NULL;
+#ifdef HAVE_LINUX
+static bool parse_cpulist(const string &list, cpu_set_t *set)
+{
+        CPU_ZERO(set);
+        istringstream iss(list);
+        string range;
+        while (getline(iss, range, ',')) {
+                int first = 0;
+                int last = 0;
+                int ret = sscanf(range.c_str(), "%d-%d", &first, &last);
+                if (ret < 1) {
+                        continue;
+                }
+                if (ret == 1) {
+                        last = first;
+                }
+                for (int i = first; i <= last && i < CPU_SETSIZE; ++i) {
+                        CPU_SET(i, set);
+                }
+        }
+        return CPU_COUNT(set) > 0;
 }
 
-void wp_worker::run() {
-        while(1) {
-                struct wp_task_data *data;
-                pthread_mutex_lock(&m_lock);
-                while(m_data.empty()) {
-                        pthread_cond_wait(&m_task_ready_cv, &m_lock);
+/**
+ * Looks up CPUs of the NUMA node the calling thread is currently running on.
+ * Affinity is used only if the machine has more than one node.
+ */
+void ws_pool::init_affinity()
+{
+        const char *pin = get_commandline_param("worker-numa-pin");
+        if (pin != nullptr && strcmp(pin, "no") == 0) {
+                return;
+        }
+        if (!ifstream("/sys/devices/system/node/node1/cpulist").is_open()) {
+                return;
+        }
+        int cpu = sched_getcpu();
+        if (cpu < 0) {
+                return;
+        }
+        for (int node = 0; ; ++node) {
+                ifstream f("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+                if (!f.is_open()) {
+                        break;
                 }
-                data = m_data.front();
-                m_data.pop();
-                pthread_mutex_unlock(&m_lock);
-
-                // poisoned pill
-                if(data->m_task == NULL) {
-                        delete data;
+                string list;
+                getline(f, list);
+                cpu_set_t node_cpus;
+                if (!parse_cpulist(list, &node_cpus) || !CPU_ISSET(cpu, &node_cpus)) {
+                        continue;
+                }
+                cpu_set_t allowed;
+                if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
                         return;
                 }
+                CPU_AND(&m_node_cpus, &node_cpus, &allowed);
+                m_use_affinity = CPU_COUNT(&m_node_cpus) > 0;
+                verbose_msg(MOD_NAME "Pinning workers to NUMA node %d (%d CPUs).\n",
+                                node, CPU_COUNT(&m_node_cpus));
+                return;
+        }
+}
+#endif
 
-                void *res = data->m_task(data->m_data);
+void *ws_pool::enter_loop(void *arg)
+{
+        set_thread_name("worker");
+        auto *warg = (worker_arg *) arg;
+        ws_pool *pool = warg->pool;
+        int queue_idx = warg->queue_idx;
+        delete warg;
+        tl_queue_idx = queue_idx;
+        pool->worker_loop(queue_idx);
+        return NULL;
+}
 
-                pthread_mutex_lock(&m_lock);
-                data->m_result = res;
-                data->m_returned = true;
-                pthread_cond_signal(&m_task_completed_cv);
-                m_state_observer.notify(this);
-                if (data->m_detached) {
-                        delete data;
-                }
-                pthread_mutex_unlock(&m_lock);
+/// @note called with m_lock held
+void ws_pool::spawn_worker(int queue_idx)
+{
+        pthread_t thread_id;
+        int ret = pthread_create(&thread_id, NULL, enter_loop, new worker_arg{this, queue_idx});
+        assert(ret == 0);
+#ifdef HAVE_LINUX
+        if (m_use_affinity) {
+                pthread_setaffinity_np(thread_id, sizeof m_node_cpus, &m_node_cpus);
+        }
+#endif
+        m_threads.push_back(thread_id);
+}
+
+/// @note called with m_lock held
+void ws_pool::start()
+{
+        m_started = true;
+#ifdef HAVE_LINUX
+        init_affinity();
+#endif
+        m_core_workers = get_cpu_core_count();
+        m_queues.reset(new ws_queue[m_core_workers + 1]);
+        for (int i = 1; i <= m_core_workers; ++i) {
+                spawn_worker(i);
         }
 }
 
-void wp_worker::push(wp_task_data *data) {
+/// @returns number of threads that may process group tasks (including the caller)
+int ws_pool::size()
+{
         pthread_mutex_lock(&m_lock);
-        assert(m_data.size() == 0);
-        m_data.push(data);
+        if (!m_started) {
+                start();
+        }
         pthread_mutex_unlock(&m_lock);
-        pthread_cond_signal(&m_task_ready_cv);
+        return m_core_workers + (tl_queue_idx == 0 ? 1 : 0);
 }
 
-void *wp_worker::pop(wp_task_data *d) {
-        void *res = NULL;
+void ws_pool::push(ws_task *t)
+{
+        pthread_mutex_lock(&m_lock);
+        if (!m_started) {
+                start();
+        }
+        pthread_mutex_unlock(&m_lock);
+
+        ws_queue &q = m_queues[tl_queue_idx];
+        pthread_mutex_lock(&q.m_lock);
+        q.m_tasks.push_back(t);
+        pthread_mutex_unlock(&q.m_lock);
+
+        pthread_mutex_lock(&m_lock);
+        m_queued += 1;
+        if (m_idle > 0) {
+                pthread_cond_signal(&m_work_cv);
+        }
+        pthread_mutex_unlock(&m_lock);
+}
 
+ws_task *ws_pool::run_async(runnable_t task, void *data, bool detached)
+{
+        auto *t = new ws_task{task, data, nullptr, nullptr, nullptr, false, detached};
         pthread_mutex_lock(&m_lock);
-        while(!d->m_returned) {
-                pthread_cond_wait(&m_task_completed_cv, &m_lock);
+        if (!m_started) {
+                start();
+        }
+        m_async_tasks.push_back(t);
+        m_async_queued += 1;
+        m_queued += 1;
+        if (m_async_queued > m_idle) {
+                spawn_worker(0);
+        } else {
+                pthread_cond_signal(&m_work_cv);
         }
-        res = d->m_result;
-        delete d;
         pthread_mutex_unlock(&m_lock);
+        return t;
+}
 
+void *ws_pool::wait_async(ws_task *t)
+{
+        pthread_mutex_lock(&m_lock);
+        while (!t->m_returned) {
+                pthread_cond_wait(&m_async_done_cv, &m_lock);
+        }
+        void *res = t->m_result;
+        pthread_mutex_unlock(&m_lock);
+        delete t;
         return res;
 }
 
-static void func_delete(wp_worker *arg) {
-        delete arg;
+ws_task *ws_pool::pop_front(int queue_idx)
+{
+        ws_queue &q = m_queues[queue_idx];
+        ws_task *t = nullptr;
+        pthread_mutex_lock(&q.m_lock);
+        if (!q.m_tasks.empty()) {
+                t = q.m_tasks.front();
+                q.m_tasks.pop_front();
+        }
+        pthread_mutex_unlock(&q.m_lock);
+        return t;
 }
 
-class worker_pool : public worker_state_observer
+/**
+ * Finds a group task - from the back of own deque first, then from the
+ * injection queue, then steals from the other workers.
+ */
+ws_task *ws_pool::find_group_task()
 {
-        public:
-                worker_pool() {
-                        pthread_mutex_init(&m_lock, NULL);
-                        pthread_cond_init(&m_worker_finished, NULL);
+        ws_task *t = nullptr;
+        if (tl_queue_idx != 0) {
+                ws_queue &q = m_queues[tl_queue_idx];
+                pthread_mutex_lock(&q.m_lock);
+                if (!q.m_tasks.empty()) {
+                        t = q.m_tasks.back();
+                        q.m_tasks.pop_back();
+                }
+                pthread_mutex_unlock(&q.m_lock);
+        }
+        for (int i = 0; t == nullptr && i <= m_core_workers; ++i) {
+                int victim = (tl_queue_idx + i) % (m_core_workers + 1);
+                if (i > 0 || tl_queue_idx == 0) {
+                        t = pop_front(victim);
                 }
+        }
+        if (t != nullptr) {
+                m_queued -= 1;
+        }
+        return t;
+}
 
-                ~worker_pool() {
-                        pthread_mutex_lock(&m_lock);
-                        while (m_occupied_workers.size() > 0) {
-                                pthread_cond_wait(&m_worker_finished, &m_lock);
-                        }
-                        pthread_mutex_unlock(&m_lock);
+ws_task *ws_pool::find_task(int queue_idx)
+{
+        if (queue_idx != 0) {
+                ws_task *t = find_group_task();
+                if (t != nullptr) {
+                        return t;
+                }
+        }
+        pthread_mutex_lock(&m_lock);
+        ws_task *t = nullptr;
+        if (!m_async_tasks.empty()) {
+                t = m_async_tasks.front();
+                m_async_tasks.pop_front();
+                m_async_queued -= 1;
+                m_queued -= 1;
+        }
+        pthread_mutex_unlock(&m_lock);
+        if (t == nullptr && queue_idx == 0) {
+                t = find_group_task();
+        }
+        return t;
+}
 
-                        for_each(m_empty_workers.begin(),
-                                        m_empty_workers.end(), func_delete);
-                        pthread_cond_destroy(&m_worker_finished);
-                        pthread_mutex_destroy(&m_lock);
+void ws_pool::execute(ws_task *t)
+{
+        void *res = t->m_task(t->m_data);
+        if (t->m_group != nullptr) {
+                if (t->m_result_ptr != nullptr) {
+                        *t->m_result_ptr = res;
                 }
+                task_group *g = t->m_group;
+                delete t;
+                g->finished();
+                return;
+        }
+        pthread_mutex_lock(&m_lock);
+        if (t->m_detached) {
+                delete t;
+        } else {
+                t->m_result = res;
+                t->m_returned = true;
+                pthread_cond_broadcast(&m_async_done_cv);
+        }
+        pthread_mutex_unlock(&m_lock);
+}
 
-                void notify(wp_worker *w) {
-                        pthread_mutex_lock(&m_lock);
-                        m_occupied_workers.erase(w);
-                        m_empty_workers.insert(w);
-                        pthread_mutex_unlock(&m_lock);
-                        pthread_cond_signal(&m_worker_finished);
+void ws_pool::worker_loop(int queue_idx)
+{
+        while (true) {
+                ws_task *t = find_task(queue_idx);
+                if (t != nullptr) {
+                        execute(t);
+                        continue;
+                }
+                pthread_mutex_lock(&m_lock);
+                if (m_queued == 0) {
+                        if (m_should_exit) {
+                                pthread_mutex_unlock(&m_lock);
+                                return;
+                        }
+                        m_idle += 1;
+                        pthread_cond_wait(&m_work_cv, &m_lock);
+                        m_idle -= 1;
                 }
+                pthread_mutex_unlock(&m_lock);
+        }
+}
 
-                task_result_handle_t run_async(runnable_t task, void *data, bool detached);
-                void *wait_task(task_result_handle_t handle);
+static class ws_pool instance;
 
-        private:
-                set<wp_worker*>    m_empty_workers;
-                set<wp_worker*>    m_occupied_workers;
-                pthread_mutex_t m_lock;
-                pthread_cond_t     m_worker_finished;
-};
+void task_group::run(runnable_t task, void *data, void **result_ptr)
+{
+        m_pending += 1;
+        instance.push(new ws_task{task, data, this, result_ptr, nullptr, false, false});
+}
 
-task_result_handle_t worker_pool::run_async(runnable_t task, void *data, bool detached)
+/// @note the lock is held while decrementing so that the group can be destroyed once wait() returns
+void task_group::finished()
 {
-        wp_worker *w;
         pthread_mutex_lock(&m_lock);
-        if(m_empty_workers.empty()) {
-                m_empty_workers.insert(new wp_worker(*this));
-        }
-        set<wp_worker*>::iterator it = m_empty_workers.begin();
-        assert(it != m_empty_workers.end());
-        w = *it;
-        /// @todo: really weird - it seems like that 'it' instead of 'w' caused some problems
-        m_empty_workers.erase(w);
-        m_occupied_workers.insert(w);
-
-        wp_task_data *d = new wp_task_data(task, data, w, detached);
-        w->push(d);
+        if (--m_pending == 0) {
+                pthread_cond_broadcast(&m_done_cv);
+        }
         pthread_mutex_unlock(&m_lock);
+}
 
-        return d;
+/**
+ * Waits until all tasks of the group finish, executing queued group tasks
+ * (of any group) in the meanwhile. Once there is nothing left to help with,
+ * the remaining tasks of the group are already running so just sleep.
+ */
+void task_group::wait()
+{
+        while (m_pending > 0) {
+                ws_task *t = instance.find_group_task();
+                if (t == nullptr) {
+                        break;
+                }
+                void *res = t->m_task(t->m_data);
+                if (t->m_result_ptr != nullptr) {
+                        *t->m_result_ptr = res;
+                }
+                task_group *g = t->m_group;
+                delete t;
+                g->finished();
+        }
+        pthread_mutex_lock(&m_lock);
+        while (m_pending > 0) {
+                pthread_cond_wait(&m_done_cv, &m_lock);
+        }
+        pthread_mutex_unlock(&m_lock);
 }
 
-void *worker_pool::wait_task(task_result_handle_t handle)
+struct task_group *task_group_create(void)
 {
-        wp_task_data *d = (wp_task_data *) handle;
-        wp_worker *w = d->m_w;
-        return w->pop(d);
+        return new task_group();
 }
 
-static class worker_pool instance;
+/**
+ * Adds compute task to the group. The task may be run by the pool workers
+ * or by any thread waiting for a task group so it must not block on anything
+ * else than other group tasks.
+ */
+void task_group_run(struct task_group *g, runnable_t task, void *data)
+{
+        g->run(task, data);
+}
+
+void task_group_wait(struct task_group *g)
+{
+        g->wait();
+}
+
+void task_group_destroy(struct task_group *g)
+{
+        delete g;
+}
 
 /**
  * @brief Runs task asynchronously.
@@ -279,49 +559,132 @@ void task_run_async_detached(runnable_t task, void *data)
 
 void *wait_task(task_result_handle_t handle)
 {
-        return instance.wait_task(handle);
+        return instance.wait_async((ws_task *) handle);
 }
 
 /**
- * This combines task_run_async() + wait_task()
+ * This runs task for every element of data in the pool and waits for the
+ * completion. The caller takes part in the processing.
  *
  * @param task         task to be run
- * @param worker_count number of workers to be run
+ * @param worker_count number of data elements
  * @param data         pointer to data array to be passed to task
  * @param data_size    size of element of data
  * @param res          (optional) pointer to result array, may be NULL
  */
 void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res)
 {
+        if (worker_count <= 0) {
+                return;
+        }
         if (worker_count == 1) {
-                task(data);
+                void *ret = task(data);
+                if (res != nullptr) {
+                        res[0] = ret;
+                }
                 return;
         }
 
-        vector<task_result_handle_t> tasks(worker_count);
-        for (int i = 0; i < worker_count; ++i) {
-                tasks[i] = task_run_async(task, (void *)((char *) data + i * data_size));
+        task_group g;
+        for (int i = 1; i < worker_count; ++i) {
+                g.run(task, (char *) data + i * data_size, res != nullptr ? &res[i] : nullptr);
         }
-        for (int i = 0; i < worker_count; ++i) {
-                if (res != nullptr) {
-                        res[i] = wait_task(tasks[i]);
-                } else {
-                        wait_task(tasks[i]);
+        void *ret = task(data);
+        if (res != nullptr) {
+                res[0] = ret;
+        }
+        g.wait();
+}
+
+namespace {
+struct alignas(64) range_slot { ///< participant's share of chunks, cache-line aligned
+        atomic<int> next;
+        int end;
+};
+struct range_job {
+        range_task_t task;
+        void *udata;
+        int count;
+        int chunk;
+        int participants;
+        range_slot *slots;
+};
+struct range_participant {
+        range_job *job;
+        int idx;
+};
+} // end anonymous namespace
+
+/**
+ * Processes own chunks first, then steals from the others' shares.
+ */
+static void *range_participant_task(void *arg)
+{
+        auto *p = (range_participant *) arg;
+        range_job *job = p->job;
+        for (int i = 0; i < job->participants; ++i) {
+                range_slot &s = job->slots[(p->idx + i) % job->participants];
+                int c = 0;
+                while ((c = s.next.fetch_add(1, memory_order_relaxed)) < s.end) {
+                        int begin = c * job->chunk;
+                        job->task(job->udata, begin, min(begin + job->chunk, job->count));
                 }
         }
+        return NULL;
+}
+
+/**
+ * Parallel for - runs task over range [0, count) split to chunks of (at most)
+ * chunk items by at most worker_count threads (including the caller).
+ *
+ * Each chunk begin is a multiple of chunk, so alignment requirements (eg. even
+ * lines for 4:2:0) can be expressed by the chunk size. The chunks are
+ * initially dealt contiguously to the participants; a participant that
+ * finished its share steals the remaining chunks of the others.
+ *
+ * @param task         callback processing items [begin, end)
+ * @param udata        user data passed to the callback
+ * @param count        number of items to be processed
+ * @param chunk        granularity of the split (items)
+ * @param worker_count maximal number of threads processing the range
+ */
+void task_run_parallel_range(range_task_t task, void *udata, int count, int chunk, int worker_count)
+{
+        chunk = max(chunk, 1);
+        int chunk_count = (count + chunk - 1) / chunk;
+        int participants = min({worker_count, chunk_count, instance.size()});
+        if (participants <= 1) {
+                task(udata, 0, count);
+                return;
+        }
+
+        unique_ptr<range_slot[]> slots(new range_slot[participants]);
+        vector<range_participant> args(participants);
+        range_job job{task, udata, count, chunk, participants, slots.get()};
+        for (int i = 0; i < participants; ++i) {
+                slots[i].next.store(i * chunk_count / participants, memory_order_relaxed);
+                slots[i].end = (i + 1) * chunk_count / participants;
+                args[i] = { &job, i };
+        }
+
+        task_group g;
+        for (int i = 1; i < participants; ++i) {
+                g.run(range_participant_task, &args[i]);
+        }
+        range_participant_task(&args[0]);
+        g.wait();
 }
 
 struct respawn_parallel_data {
         respawn_parallel_callback_t c;
-        void *in;
-        void *out;
-        size_t data_len;
+        char *in;
+        char *out;
+        size_t size;
         void *udata;
 };
-static void *respawn_parallel_task(void *arg) {
+static void respawn_parallel_range(void *arg, int begin, int end) {
         auto data = (struct respawn_parallel_data *) arg;
-        data->c(data->in, data->out, data->data_len, data->udata);
-        return NULL;
+        data->c(data->in + begin * data->size, data->out + begin * data->size, (end - begin) * data->size, data->udata);
 }
 /**
  * Automatically respawns threads to convert in to out
@@ -331,20 +694,8 @@ static void *respawn_parallel_task(void *arg) {
  */
 void respawn_parallel(void *in, void *out, size_t nmemb, size_t size, respawn_parallel_callback_t c, void *udata)
 {
-        int threads = get_cpu_core_count();
-        struct respawn_parallel_data data[threads];
-
-        for (int i = 0; i < threads; ++i) {
-                data[i].c = c;
-                data[i].in = (char *) in + i * (nmemb / threads) * size;
-                data[i].out = (char *) out + i * (nmemb / threads) * size;
-                data[i].data_len = (nmemb / threads) * size;
-                data[i].udata = udata;
-                if (i == threads - 1) {
-                        data[i].data_len = size * (nmemb - (threads - 1) * (nmemb / threads));
-                }
-        }
-
-        task_run_parallel(respawn_parallel_task, threads, data, sizeof data[0], NULL);
+        struct respawn_parallel_data data = { c, (char *) in, (char *) out, size, udata };
+        size_t chunk = max<size_t>(RESPAWN_PARALLEL_CHUNK_BYTES / size, 1);
+        assert(nmemb <= INT_MAX);
+        task_run_parallel_range(respawn_parallel_range, &data, nmemb, min<size_t>(chunk, INT_MAX), get_cpu_core_count());
 }
-
@@ -55,6 +55,13 @@ typedef void *(*runnable_t)(void *);
 task_result_handle_t task_run_async(runnable_t task, void *data);
 void task_run_async_detached(runnable_t task, void *data);
 void *wait_task(task_result_handle_t handle);
+
+struct task_group;
+struct task_group *task_group_create(void);
+void task_group_run(struct task_group *g, runnable_t task, void *data);
+void task_group_wait(struct task_group *g);
+void task_group_destroy(struct task_group *g);
+
 void task_run_parallel(runnable_t task, int worker_count, void *data, size_t data_size, void **res);
 
 /**
@@ -63,8 +70,28 @@ void task_run_parallel(runnable_t task, int worker_count, void *data, size_t dat
 typedef void (*respawn_parallel_callback_t)(void *in, void *out, size_t data_len, void *udata);
 void respawn_parallel(void *in, void *out, size_t nmemb, size_t size, respawn_parallel_callback_t c, void *udata);
 
+/**
+ * @param begin   first item of the chunk to be processed
+ * @param end     one past the last item of the chunk
+ */
+typedef void (*range_task_t)(void *udata, int begin, int end);
+void task_run_parallel_range(range_task_t task, void *udata, int count, int chunk, int worker_count);
+
 #ifdef __cplusplus
 }
+
+#include <type_traits>
+
+/**
+ * C++ wrapper over task_run_parallel_range()
+ * @param f callable with signature void(int begin, int end)
+ */
+template<typename F>
+inline void parallel_for(int count, int chunk, int worker_count, F &&f) {
+        using func_t = typename std::remove_reference<F>::type;
+        task_run_parallel_range([](void *udata, int begin, int end) { (*static_cast<func_t *>(udata))(begin, end); },
+                        &f, count, chunk, worker_count);
+}
 #endif
 
 #endif /* WORKER_H_ */
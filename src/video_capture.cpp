@@ -61,6 +61,8 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "module.h"
+#include "utils/metrics.h"
+#include "utils/pipeline_stats.h"
 #include "video_capture.h"
 
 #include <string>
@@ -78,6 +80,9 @@ struct vidcap {
         uint32_t magic; ///< For debugging. Conatins @ref VIDCAP_MAGIC
 
         struct capture_filter *capture_filter; ///< capture_filter_state
+        struct metrics_counter *captured_frames;
+        struct metrics_counter *filter_dropped_frames;
+        struct pipeline_stage *filter_stage; ///< NULL if there are no capture filters
 };
 
 /* API for probing capture devices ****************************************************************/
@@ -134,6 +139,8 @@ int initialize_video_capture(struct module *parent,
                 (struct vidcap *)malloc(sizeof(struct vidcap));
         d->magic = VIDCAP_MAGIC;
         d->funcs = vci;
+        d->captured_frames = metrics_counter_register("capture_frames", "Frames grabbed from the capture device", NULL);
+        d->filter_dropped_frames = metrics_counter_register("capture_filter_dropped_frames", "Captured frames dropped by capture filters", NULL);
 
         module_init_default(&d->mod);
         d->mod.cls = MODULE_CLASS_CAPTURE;
@@ -176,6 +183,9 @@ int initialize_video_capture(struct module *parent,
                 return ret;
         }
 
+        d->filter_stage = vidcap_params_get_capture_filter(param) != nullptr
+                ? pipeline_stage_get(&d->mod, "capture_filter") : nullptr;
+
         *state = d;
         return 0;
 }
@@ -207,9 +217,19 @@ struct video_frame *vidcap_grab(struct vidcap *state, struct audio_frame **audio
 {
         assert(state->magic == VIDCAP_MAGIC);
         struct video_frame *frame;
+        if ((frame = capture_filter_get_pending(state->capture_filter)) != NULL) {
+                *audio = NULL;
+                return frame;
+        }
         frame = state->funcs->grab(state->state, audio);
-        if (frame != NULL)
+        if (frame != NULL) {
+                metrics_counter_add(state->captured_frames, 1);
+                pipeline_stage_timer busy(state->filter_stage);
                 frame = capture_filter(state->capture_filter, frame);
+                if (frame == NULL) {
+                        metrics_counter_add(state->filter_dropped_frames, 1);
+                }
+        }
         return frame;
 }
 
@@ -47,11 +47,22 @@
 #include "video_capture.h"
 
 #include "tv.h"
+#include "utils/macros.h"
+#include "utils/thread.h"
 
 #include "audio/types.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define MOD_NAME "[aggregate cap.] "
+#define MAX_QUEUED 3 ///< frames kept per device for the time alignment
+#define GRAB_TIMEOUT_MS 100
+#define REPORT_INTERVAL_S 5
 
 /* prototypes of functions defined in this module */
 static void show_help(void);
@@ -60,23 +71,141 @@ static void show_help()
 {
         printf("Aggregate capture\n");
         printf("Usage\n");
-        printf("\t-t aggregate -t <dev1_config> -t <dev2_config> ....]\n");
+        printf("\t-t aggregate[:tolerance=<ms>] -t <dev1_config> -t <dev2_config> ....]\n");
         printf("\t\twhere devn_config is a complete configuration string of device involved in an aggregate device\n");
-
+        printf("\t\ttolerance - maximal time difference of capture of the tiles (default half of the frame time)\n");
+        printf("\n\tEach device is grabbed in a separate thread, tiles are assembled from the frames\n"
+               "\twith the nearest capture time.\n");
 }
 
+struct captured_frame {
+        struct video_frame *frame;
+        time_ns_t           ts; ///< time when the frame was grabbed
+};
+
+struct aggregate_input {
+        struct vidcap_aggregate_state *parent;
+        int                 index;
+        struct vidcap      *device;
+        pthread_t           thread_id;
+
+        struct captured_frame queue[MAX_QUEUED]; ///< ordered by the capture time, oldest dropped if full
+        int                 queued;
+        /// a frame without dispose callback was passed downstream - the
+        /// device must not be grabbed until it is returned (next grab
+        /// invalidates it)
+        bool                waiting_release;
+        struct captured_frame out; ///< frame used in the currently returned aggregate frame
+};
+
 struct vidcap_aggregate_state {
-        struct vidcap     **devices;
+        struct aggregate_input *inputs;
         int                 devices_cnt;
+        bool                threads_started;
+
+        pthread_mutex_t     lock;
+        pthread_cond_t      frame_ready_cv; ///< an input queued a frame
+        pthread_cond_t      input_cv; ///< an input may grab again
+        bool                should_exit;
 
-        struct video_frame      **captured_frames;
         struct video_frame       *frame; 
         int frames;
         struct       timeval t, t0;
+        long long           tolerance_ns; ///< 0 - derive from FPS
+
+        time_ns_t           skew_sum;
+        time_ns_t           skew_max;
+        int                 skew_exceeded;
 
         int          audio_source_index;
+        struct audio_frame  audio_acc; ///< audio accumulated by the workers
+        struct audio_frame  audio_out; ///< audio returned by the last grab
 };
 
+static void
+dispose_captured(struct aggregate_input *in, struct video_frame *frame)
+{
+        if (frame->callbacks.dispose) {
+                frame->callbacks.dispose(frame);
+        } else {
+                in->waiting_release = false;
+                pthread_cond_broadcast(&in->parent->input_cv);
+        }
+}
+
+/// appends audio to the accumulator, must be called with the lock held
+static void
+accumulate_audio(struct vidcap_aggregate_state *s, const struct audio_frame *audio)
+{
+        struct audio_frame *acc = &s->audio_acc;
+        if (acc->bps != audio->bps || acc->ch_count != audio->ch_count ||
+                        acc->sample_rate != audio->sample_rate) {
+                acc->bps = audio->bps;
+                acc->ch_count = audio->ch_count;
+                acc->sample_rate = audio->sample_rate;
+                acc->data_len = 0;
+        }
+        if (acc->data_len + audio->data_len > acc->max_size) {
+                acc->max_size = acc->data_len + audio->data_len;
+                acc->data = realloc(acc->data, acc->max_size);
+        }
+        memcpy(acc->data + acc->data_len, audio->data, audio->data_len);
+        acc->data_len += audio->data_len;
+}
+
+static void *
+aggregate_worker(void *arg)
+{
+        struct aggregate_input *in = arg;
+        struct vidcap_aggregate_state *s = in->parent;
+        char name[16];
+        snprintf(name, sizeof name, "aggregate_%d", in->index);
+        set_thread_name(name);
+
+        pthread_mutex_lock(&s->lock);
+        while (!s->should_exit) {
+                while (!s->should_exit && in->waiting_release) {
+                        pthread_cond_wait(&s->input_cv, &s->lock);
+                }
+                if (s->should_exit) {
+                        break;
+                }
+                pthread_mutex_unlock(&s->lock);
+
+                struct audio_frame *audio = NULL;
+                struct video_frame *frame = vidcap_grab(in->device, &audio);
+                time_ns_t ts = get_time_in_ns();
+
+                pthread_mutex_lock(&s->lock);
+                if (audio != NULL) {
+                        if (s->audio_source_index == -1) {
+                                log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Locking device #%d as an audio source.\n",
+                                                in->index);
+                                s->audio_source_index = in->index;
+                        }
+                        if (s->audio_source_index == in->index) {
+                                accumulate_audio(s, audio);
+                        }
+                        AUDIO_FRAME_DISPOSE(audio);
+                }
+                if (frame == NULL) {
+                        continue;
+                }
+                in->waiting_release = frame->callbacks.dispose == NULL;
+                if (in->queued == MAX_QUEUED) {
+                        dispose_captured(in, in->queue[0].frame);
+                        memmove(in->queue, in->queue + 1, (MAX_QUEUED - 1) * sizeof in->queue[0]);
+                        in->queued -= 1;
+                }
+                in->queue[in->queued].frame = frame;
+                in->queue[in->queued].ts = ts;
+                in->queued += 1;
+                pthread_cond_signal(&s->frame_ready_cv);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        return NULL;
+}
 
 static void vidcap_aggregate_probe(struct device_info **cards, int *count, void (**deleter)(void *))
 {
@@ -85,6 +214,9 @@ static void vidcap_aggregate_probe(struct device_info **cards, int *count, void
         *deleter = free;
 }
 
+static void
+vidcap_aggregate_done(void *state);
+
 static int
 vidcap_aggregate_init(struct vidcap_params *params, void **state)
 {
@@ -102,11 +234,17 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
         s->audio_source_index = -1;
         s->frames = 0;
         gettimeofday(&s->t0, NULL);
-
-        if(vidcap_params_get_fmt(params) && strcmp(vidcap_params_get_fmt(params), "") != 0) {
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->frame_ready_cv, NULL);
+        pthread_cond_init(&s->input_cv, NULL);
+
+        const char *fmt = vidcap_params_get_fmt(params);
+        if (fmt && strncmp(fmt, "tolerance=", strlen("tolerance=")) == 0) {
+                s->tolerance_ns = atof(fmt + strlen("tolerance=")) * NS_IN_MS;
+        } else if(fmt && strcmp(fmt, "") != 0) {
                 show_help();
-                free(s);
-                return VIDCAP_INIT_NOERR;
+                vidcap_aggregate_done(s);
+                return strcmp(fmt, "help") == 0 ? VIDCAP_INIT_NOERR : VIDCAP_INIT_FAIL;
         }
 
 
@@ -119,38 +257,32 @@ vidcap_aggregate_init(struct vidcap_params *params, void **state)
                         break;
         }
 
-        s->devices = calloc(s->devices_cnt, sizeof(struct vidcap *));
+        s->inputs = calloc(s->devices_cnt, sizeof(struct aggregate_input));
         tmp = params;
         for (int i = 0; i < s->devices_cnt; ++i) {
                 tmp = vidcap_params_get_next(tmp);
+                s->inputs[i].parent = s;
+                s->inputs[i].index = i;
 
-                int ret = initialize_video_capture(NULL, (struct vidcap_params *) tmp, &s->devices[i]);
+                int ret = initialize_video_capture(NULL, (struct vidcap_params *) tmp, &s->inputs[i].device);
                 if(ret != 0) {
                         fprintf(stderr, "[aggregate] Unable to initialize device %d (%s:%s).\n",
                                         i, vidcap_params_get_driver(tmp),
                                         vidcap_params_get_fmt(tmp));
-                        goto error;
+                        vidcap_aggregate_done(s);
+                        return VIDCAP_INIT_FAIL;
                 }
         }
 
-        s->captured_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
-
         s->frame = vf_alloc(s->devices_cnt);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                pthread_create(&s->inputs[i].thread_id, NULL, aggregate_worker, &s->inputs[i]);
+        }
+        s->threads_started = true;
         
         *state = s;
 	return VIDCAP_INIT_OK;
-
-error:
-        if(s->devices) {
-                int i;
-                for (i = 0u; i < s->devices_cnt; ++i) {
-                        if(s->devices[i]) {
-                                 vidcap_done(s->devices[i]);
-                        }
-                }
-        }
-        free(s);
-        return VIDCAP_INIT_FAIL;
 }
 
 static void
@@ -160,48 +292,211 @@ vidcap_aggregate_done(void *state)
 
 	assert(s != NULL);
 
-	if (s != NULL) {
-                int i;
-		for (i = 0; i < s->devices_cnt; ++i) {
-                         vidcap_done(s->devices[i]);
-		}
-	}
+        if (s->threads_started) {
+                pthread_mutex_lock(&s->lock);
+                s->should_exit = true;
+                pthread_cond_broadcast(&s->input_cv);
+                pthread_mutex_unlock(&s->lock);
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        pthread_join(s->inputs[i].thread_id, NULL);
+                }
+        }
+
+        for (int i = 0; s->inputs != NULL && i < s->devices_cnt; ++i) {
+                struct aggregate_input *in = &s->inputs[i];
+                if (in->out.frame) {
+                        VIDEO_FRAME_DISPOSE(in->out.frame);
+                }
+                for (int j = 0; j < in->queued; ++j) {
+                        VIDEO_FRAME_DISPOSE(in->queue[j].frame);
+                }
+                if (in->device) {
+                        vidcap_done(in->device);
+                }
+        }
         
         vf_free(s->frame);
+        free(s->inputs);
+        free(s->audio_acc.data);
+        free(s->audio_out.data);
+        pthread_cond_destroy(&s->frame_ready_cv);
+        pthread_cond_destroy(&s->input_cv);
+        pthread_mutex_destroy(&s->lock);
         free(s);
 }
 
+/**
+ * Picks for each input the queued frame nearest to the time that all
+ * inputs have reached (the oldest of the newest frames), older frames are
+ * dropped. Must be called with the lock held and all inputs having a frame.
+ *
+ * @returns skew (difference between the earliest and the latest selected frame)
+ */
+static time_ns_t
+select_aligned_frames(struct vidcap_aggregate_state *s)
+{
+        time_ns_t target = INT64_MAX;
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_input *in = &s->inputs[i];
+                target = MIN(target, in->queue[in->queued - 1].ts);
+        }
+
+        time_ns_t min_ts = INT64_MAX;
+        time_ns_t max_ts = INT64_MIN;
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_input *in = &s->inputs[i];
+                int best = 0;
+                for (int j = 1; j < in->queued; ++j) {
+                        if (llabs(in->queue[j].ts - target) < llabs(in->queue[best].ts - target)) {
+                                best = j;
+                        }
+                }
+                min_ts = MIN(min_ts, in->queue[best].ts);
+                max_ts = MAX(max_ts, in->queue[best].ts);
+                for (int j = 0; j < best; ++j) { // drop older
+                        dispose_captured(in, in->queue[j].frame);
+                }
+                memmove(in->queue, in->queue + best, (in->queued - best) * sizeof in->queue[0]);
+                in->queued -= best;
+        }
+        return max_ts - min_ts;
+}
+
+/// @param[out] deadline  absolute time for pthread_cond_timedwait (realtime clock)
+static void
+deadline_after(struct timespec *deadline, time_ns_t timeout)
+{
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        time_ns_t abs_ns = (time_ns_t) now.tv_sec * NS_IN_SEC + now.tv_usec * 1000 + timeout;
+        deadline->tv_sec = abs_ns / NS_IN_SEC;
+        deadline->tv_nsec = abs_ns % NS_IN_SEC;
+}
+
+/// @returns true if all inputs have at least one frame queued (waits at most timeout)
+static bool
+wait_all_queued(struct vidcap_aggregate_state *s, time_ns_t timeout)
+{
+        struct timespec deadline;
+        deadline_after(&deadline, timeout);
+
+        while (true) {
+                bool all = true;
+                for (int i = 0; i < s->devices_cnt; ++i) {
+                        all = all && s->inputs[i].queued > 0;
+                }
+                if (all) {
+                        return true;
+                }
+                if (pthread_cond_timedwait(&s->frame_ready_cv, &s->lock, &deadline) == ETIMEDOUT) {
+                        return false;
+                }
+        }
+}
+
+/// @returns true if the newest frame of any input is too far from the others
+static bool
+newer_frame_may_help(struct vidcap_aggregate_state *s, time_ns_t tolerance)
+{
+        time_ns_t max_ts = INT64_MIN;
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                max_ts = MAX(max_ts, s->inputs[i].queue[0].ts);
+        }
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct aggregate_input *in = &s->inputs[i];
+                if (in->queued == 1 && max_ts - in->queue[0].ts > tolerance) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static void
+report_stats(struct vidcap_aggregate_state *s, time_ns_t skew, time_ns_t tolerance)
+{
+        s->skew_sum += skew;
+        s->skew_max = MAX(s->skew_max, skew);
+        if (skew > tolerance) {
+                s->skew_exceeded += 1;
+        }
+        s->frames++;
+        gettimeofday(&s->t, NULL);
+        double seconds = tv_diff(s->t, s->t0);    
+        if (seconds >= REPORT_INTERVAL_S) {
+            float fps  = s->frames / seconds;
+            log_msg(LOG_LEVEL_INFO, MOD_NAME "%d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
+            log_msg(s->skew_exceeded > 0 ? LOG_LEVEL_WARNING : LOG_LEVEL_VERBOSE,
+                            MOD_NAME "Tile skew avg %.2f ms, max %.2f ms, %d frames over tolerance %.2f ms\n",
+                            (double) s->skew_sum / s->frames / NS_IN_MS, (double) s->skew_max / NS_IN_MS,
+                            s->skew_exceeded, (double) tolerance / NS_IN_MS);
+            s->t0 = s->t;
+            s->frames = 0;
+            s->skew_sum = s->skew_max = 0;
+            s->skew_exceeded = 0;
+        }  
+}
+
 static struct video_frame *
 vidcap_aggregate_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_aggregate_state *s = (struct vidcap_aggregate_state *) state;
-        struct audio_frame *audio_frame = NULL;
-        struct video_frame *frame = NULL;
 
+        *audio = NULL;
+
+        pthread_mutex_lock(&s->lock);
         for (int i = 0; i < s->devices_cnt; ++i) {
-                VIDEO_FRAME_DISPOSE(s->captured_frames[i]);
+                if (s->inputs[i].out.frame) {
+                        dispose_captured(&s->inputs[i], s->inputs[i].out.frame);
+                        s->inputs[i].out.frame = NULL;
+                }
         }
 
-        *audio = NULL;
+        if (s->audio_acc.data_len > 0) {
+                struct audio_frame *acc = &s->audio_acc;
+                struct audio_frame *out = &s->audio_out;
+                // swap the buffers, the accumulator continues with the previous output buffer
+                char *data = out->data;
+                int max_size = out->max_size;
+                *out = *acc;
+                acc->data = data;
+                acc->max_size = max_size;
+                acc->data_len = 0;
+                *audio = out;
+        }
+
+        if (!wait_all_queued(s, GRAB_TIMEOUT_MS * NS_IN_MS)) {
+                pthread_mutex_unlock(&s->lock);
+                return NULL;
+        }
+
+        double fps = s->inputs[0].queue[0].frame->fps;
+        time_ns_t tolerance = s->tolerance_ns > 0 ? s->tolerance_ns
+                : fps > 0 ? (time_ns_t) (NS_IN_SEC_DBL / fps / 2) : NS_IN_SEC / 60;
+        time_ns_t skew = select_aligned_frames(s);
+        // a lagging input will likely deliver the matching frame soon
+        if (skew > tolerance && newer_frame_may_help(s, tolerance)) {
+                struct timespec deadline;
+                deadline_after(&deadline, tolerance);
+                pthread_cond_timedwait(&s->frame_ready_cv, &s->lock, &deadline);
+                skew = select_aligned_frames(s);
+        }
 
         for (int i = 0; i < s->devices_cnt; ++i) {
-                frame = NULL;
-                while(!frame) {
-                        frame = vidcap_grab(s->devices[i], &audio_frame);
-                }
+                struct aggregate_input *in = &s->inputs[i];
+                in->out = in->queue[0];
+                memmove(in->queue, in->queue + 1, (in->queued - 1) * sizeof in->queue[0]);
+                in->queued -= 1;
+        }
+        pthread_cond_broadcast(&s->input_cv);
+        pthread_mutex_unlock(&s->lock);
+
+        for (int i = 0; i < s->devices_cnt; ++i) {
+                struct video_frame *frame = s->inputs[i].out.frame;
                 if (i == 0) {
                         s->frame->color_spec = frame->color_spec;
                         s->frame->interlacing = frame->interlacing;
                         s->frame->fps = frame->fps;
                 }
-                if (s->audio_source_index == -1 && audio_frame != NULL) {
-                        fprintf(stderr, "[aggregate] Locking device #%d as an audio source.\n",
-                                        i);
-                        s->audio_source_index = i;
-                }
-                if (s->audio_source_index == i) {
-                        *audio = audio_frame;
-                }
                 if (frame->color_spec != s->frame->color_spec ||
                                 frame->fps != s->frame->fps ||
                                 frame->interlacing != s->frame->interlacing) {
@@ -220,17 +515,8 @@ vidcap_aggregate_grab(void *state, struct audio_frame **audio)
                 vf_get_tile(s->frame, i)->height = vf_get_tile(frame, 0)->height;
                 vf_get_tile(s->frame, i)->data_len = vf_get_tile(frame, 0)->data_len;
                 vf_get_tile(s->frame, i)->data = vf_get_tile(frame, 0)->data;
-                s->captured_frames[i] = frame;
         }
-        s->frames++;
-        gettimeofday(&s->t, NULL);
-        double seconds = tv_diff(s->t, s->t0);    
-        if (seconds >= 5) {
-            float fps  = s->frames / seconds;
-            log_msg(LOG_LEVEL_INFO, "[aggregate cap.] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
-            s->t0 = s->t;
-            s->frames = 0;
-        }  
+        report_stats(s, skew, tolerance);
 
 	return s->frame;
 }
@@ -244,4 +530,3 @@ static const struct video_capture_info vidcap_aggregate_info = {
 };
 
 REGISTER_MODULE(aggregate, &vidcap_aggregate_info, LIBRARY_CLASS_VIDEO_CAPTURE, VIDEO_CAPTURE_ABI_VERSION);
-
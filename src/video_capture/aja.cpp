@@ -58,9 +58,9 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
-#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_capture.h"
+#include "video_capture/dma_capture.hpp"
 
 #include "ajatypes.h"
 #ifdef __GNUC__
@@ -96,9 +96,8 @@
 #define NTV2_AUDIOSIZE_MAX      (401 * 1024)
 
 #include <algorithm>
-#include <condition_variable>
 #include <chrono>
-#include <mutex>
+#include <memory>
 #include <string>
 #include <thread>
 
@@ -133,16 +132,10 @@ unsigned int *aja_audio_capture_channels = &audio_capture_channels;
 
 using namespace std;
 
-struct aligned_data_allocator : public video_frame_pool_allocator {
-        void *allocate(size_t size) override {
-                return aligned_malloc(size, AJA_PAGE_SIZE);
-        }
-        void deallocate(void *ptr) override {
-                aligned_free(ptr);
-        }
-        video_frame_pool_allocator *clone() const override {
-                return new aligned_data_allocator(*this);
-        }
+/// audio captured along with the frame
+struct aja_audio {
+        shared_ptr<uint32_t> data;
+        size_t size;
 };
 
 static const ULWord app = AJA_FOURCC ('U','L','G','R');
@@ -170,12 +163,8 @@ class vidcap_state_aja {
                 uint32_t               mVideoBufferSize{};            ///     My video buffer size, in bytes
                 uint32_t               mAudioBufferSize{};            ///     My audio buffer size, in bytes
                 thread                 mProducerThread;               ///     My producer thread object -- does the frame capturing
-                video_frame_pool       mPool{0, aligned_data_allocator()};
-                shared_ptr<video_frame> mOutputFrame;
-                shared_ptr<uint32_t>   mOutputAudioFrame;
-                size_t                 mOutputAudioFrameSize{};
-                mutex                  mOutputFrameLock;
-                condition_variable     mOutputFrameReady;
+                unsigned int           mBuffers{DMA_CAPTURE_DEFAULT_BUFFERS};
+                unique_ptr<dma_capture<aja_audio>> mCapture;  ///< frames are DMAed directly to its buffers
                 bool                   mProgressive{false};
                 chrono::system_clock::time_point mT0{chrono::system_clock::now()};
                 int                    mFrames{0};
@@ -217,6 +206,11 @@ vidcap_state_aja::vidcap_state_aja(unordered_map<string, string> const & paramet
                         mCheckFor4K = true;
                 } else if (it.first == "clear-routing") {
                         mClearRouting = true;
+                } else if (it.first == "buffers") {
+                        mBuffers = stoi(it.second);
+                        if (mBuffers < 2) {
+                                throw string("At least 2 buffers needed!");
+                        }
                 } else if (it.first == "device") {
                         mDeviceIndex = stol(it.second, nullptr, 10);
                 } else if (it.first == "channel") {
@@ -306,6 +300,19 @@ vidcap_state_aja::vidcap_state_aja(unordered_map<string, string> const & paramet
                 mAudioSource = NTV2_AUDIO_SOURCE_INVALID;
         }
 
+        dma_data_allocator::lock_fn dma_lock;
+#if !AJA_NTV2_SDK_VERSION_BEFORE(15,5)
+        // lock the buffers once instead of for every DMA transfer
+        dma_lock = [this](void *ptr, size_t size, bool lock) {
+                if (lock) {
+                        CHECK(mDevice.DMABufferLock(static_cast<ULWord *>(ptr), size, true));
+                } else {
+                        CHECK(mDevice.DMABufferUnlock(static_cast<ULWord *>(ptr), size));
+                }
+        };
+#endif
+        mCapture = make_unique<dma_capture<aja_audio>>("aja", MOD_NAME, mBuffers, dma_data_allocator(dma_lock));
+
         Init();
 }
 
@@ -384,7 +391,7 @@ vidcap_state_aja::~vidcap_state_aja() {
         CHECK(mDevice.ReleaseStreamForApplication (app, static_cast <uint32_t> (getpid()))); //      Release the device
 #endif
 
-        mOutputFrame = NULL;
+        mCapture = nullptr;
         free(mAudio.data);
 }
 
@@ -764,7 +771,7 @@ void vidcap_state_aja::SetupHostBuffers (void)
                 GetFramesPerSecond(GetNTV2FrameRateFromVideoFormat(mVideoFormat)),
                 interlacing,
                 1};
-        mPool.reconfigure(desc, mVideoBufferSize);
+        mCapture->reconfigure(desc, mVideoBufferSize);
 
 #ifndef _MSC_VER
         cout << MOD_NAME "Detected input video mode: " << desc << endl;
@@ -885,11 +892,11 @@ void vidcap_state_aja::CaptureFrames (void)
                 //      Flip sense of the buffers again to refer to the buffers that the hardware isn't using (i.e. the off-screen buffers)...
                 currentInFrame  ^= 1;
 
-                shared_ptr<video_frame> out = mPool.get_frame();
+                shared_ptr<video_frame> out = mCapture->get_buffer();
                 //      DMA the new frame to system memory...
                 CHECK(mDevice.DMAReadFrame (currentInFrame, reinterpret_cast<uint32_t *>(out->tiles[0].data), mVideoBufferSize));
                 if (out->color_spec == R12L) {
-                        shared_ptr<video_frame> converted = mPool.get_frame();
+                        shared_ptr<video_frame> converted = mCapture->get_buffer();
                         vc_copylineR12AtoR12L((unsigned char *) converted->tiles[0].data, (unsigned char *) out->tiles[0].data, out->tiles[0].data_len, 0, 0, 0);
                         out = converted;
                 }
@@ -916,12 +923,7 @@ void vidcap_state_aja::CaptureFrames (void)
                 //      Tell the hardware which buffers to start using at the beginning of the next frame...
                 CHECK(mDevice.SetInputFrame   (mInputChannel,  currentInFrame));
 
-                unique_lock<mutex> lk(mOutputFrameLock);
-                mOutputFrame = out;
-		mOutputAudioFrame = shared_ptr<uint32_t>(pHostAudioBuffer, aligned_free);
-		mOutputAudioFrameSize = audioBytesCaptured;
-                lk.unlock();
-                mOutputFrameReady.notify_one();
+                mCapture->submit(move(out), { shared_ptr<uint32_t>(pHostAudioBuffer, aligned_free), audioBytesCaptured });
 	}       //      loop til quit signaled
 }       //      CaptureFrames
 
@@ -931,33 +933,22 @@ struct video_frame *vidcap_state_aja::grab(struct audio_frame **audio)
                 return NULL;
         }
 
-        struct video_frame *ret;
-
-        unique_lock<mutex> lk(mOutputFrameLock);
-        if (mOutputFrameReady.wait_for(lk, chrono::milliseconds(100), [this]{return mOutputFrame != NULL;}) == false) {
+        aja_audio captured_audio{};
+        struct video_frame *ret = mCapture->grab(chrono::milliseconds(100), &captured_audio);
+        if (ret == NULL) {
                 return NULL;
         }
 
-        ret = mOutputFrame.get();
-        ret->callbacks.dispose_udata = new shared_ptr<video_frame>(mOutputFrame);
-        static auto dispose = [](video_frame *f) { delete static_cast<shared_ptr<video_frame> *>(f->callbacks.dispose_udata); };
-        ret->callbacks.dispose = dispose;
-
-        mOutputFrame = NULL;
-
-        if (mOutputAudioFrame) {
+        if (captured_audio.data) {
                 for (int i = 0; i < mAudio.ch_count; ++i) {
-                        remux_channel(mAudio.data, (char *) mOutputAudioFrame.get(), mAudio.bps, mOutputAudioFrameSize, mMaxAudioChannels, mAudio.ch_count, i, i);
+                        remux_channel(mAudio.data, (char *) captured_audio.data.get(), mAudio.bps, captured_audio.size, mMaxAudioChannels, mAudio.ch_count, i, i);
                 }
-                mAudio.data_len = mOutputAudioFrameSize / mMaxAudioChannels * mAudio.ch_count;
-                mOutputAudioFrame = NULL;
+                mAudio.data_len = captured_audio.size / mMaxAudioChannels * mAudio.ch_count;
                 *audio = &mAudio;
         } else {
                 *audio = NULL;
         }
 
-        lk.unlock();
-
         mFrames += 1;
 
         chrono::system_clock::time_point now = chrono::system_clock::now();
@@ -984,12 +975,15 @@ bool vidcap_state_aja::IsInput3Gb(const NTV2InputSource inputSource)
 
 static void show_help() {
         cout << "Usage:\n";
-        col() << SBOLD(SRED("\t-t aja") << "[[:4K][:clear-routing][:channel=<ch>][:codec=<pixfmt>][:connection=<c>][:device=<idx>][:format=<fmt>][:progressive][:RGB|:YUV]|:help] -r [embedded|AESEBU|analog]")"\n";
+        col() << SBOLD(SRED("\t-t aja") << "[[:4K][:buffers=<n>][:clear-routing][:channel=<ch>][:codec=<pixfmt>][:connection=<c>][:device=<idx>][:format=<fmt>][:progressive][:RGB|:YUV]|:help] -r [embedded|AESEBU|analog]")"\n";
         cout << "where\n";
 
         col() << SBOLD("\t4K") << "\n";
         cout << "\t\tVideo input is 4K.\n";
 
+        col() << SBOLD("\tbuffers") "\n";
+        cout << "\t\tNumber of frame buffers (being transferred, waiting and being processed), default " << DMA_CAPTURE_DEFAULT_BUFFERS << ".\n";
+
         col() << SBOLD("\tclear-routing") "\n" <<
                 "\t\tremove all existing signal paths for device\n";
 
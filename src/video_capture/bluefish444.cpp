@@ -41,9 +41,12 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <atomic>
+#include <chrono>
 #include <iomanip>
 #include <iostream>
-#include <queue>
+#include <memory>
+#include <vector>
 
 #include "bluefish444_common.h"
 
@@ -55,6 +58,7 @@
 #include "tv.h"
 #include "video.h"
 #include "video_capture.h"
+#include "video_capture/dma_capture.hpp"
 
 #ifndef UINT
 #define UINT uint32_t
@@ -63,6 +67,7 @@
 #define BUFFERS 4
 
 #define MAX_BLUE_IN_CHANNELS 4
+#define MAX_SUBFIELD_CHUNKS 4
 
 using namespace std;
 
@@ -76,7 +81,7 @@ static void SyncForSignal(struct vidcap_bluefish444_state *s);
 #ifdef WIN32
 static int CompleteBlueAsyncReq(HANDLE hDevice, LPOVERLAPPED pOverlap);
 #endif
-static bool should_exit_worker = false;
+static atomic<bool> should_exit_worker{false};
 
 static void show_help()
 {
@@ -88,9 +93,11 @@ static void show_help()
         printf("Bluefish444 capture\n");
         printf("Usage\n");
         printf("\t-t bluefish444[:framestore|:duplex][:depth={10|8}]"
-                        "[:subfield][:4K][:device=<device_id>]\n");
+                        "[:subfield][:4K][:device=<device_id>][:buffers=<n>]\n");
 
         printf("\t\t4K - use 4 inputs of a SuperNova card\n");
+        printf("\t\tbuffers - number of frame buffers (being transferred, waiting and being processed), default %d\n",
+                        DMA_CAPTURE_DEFAULT_BUFFERS);
 
         printf("\t\t<device_id> - ID of the Bluefish device (if more present)\n");
         cout << "\t\t" << iDevices << " Bluefish devices found in this system" << endl;
@@ -102,47 +109,6 @@ static void show_help()
         }
 }
 
-struct av_frame_base {
-        virtual ~av_frame_base() {}
-};
-
-struct av_frame_nosignal : public av_frame_base {
-};
-
-struct av_frame : public av_frame_base {
-        av_frame(struct video_desc desc, int GoldenSize, int BytesPerFrame, int AudioLen) :
-                valid(true),
-                audio_len(0),
-                mGoldenSize(GoldenSize)
-        {
-                video = vf_alloc_desc(desc);
-                for(unsigned int i = 0; i < desc.tile_count; ++i) {
-                        video->tiles[i].data_len = BytesPerFrame;
-                        video->tiles[i].data = (char*)
-                                bfAlloc(GoldenSize);
-                }
-                if(AudioLen) {
-                        audio_data = (char *) bfAlloc(AudioLen);
-                } else {
-                        audio_data = NULL;
-                }
-        }
-
-        ~av_frame() {
-                bfFree(audio_len, audio_data);
-                for(unsigned int i = 0; i < video->tile_count; ++i) {
-                        bfFree(mGoldenSize, video->tiles[i].data);
-                }
-                vf_free(video);
-        }
-
-        char               *audio_data;
-        struct video_frame *video;
-        bool                valid;
-        int                 audio_len;
-        int                 mGoldenSize;
-};
-
 struct vidcap_bluefish444_state {
         BLUEVELVETC_HANDLE        pSDK[MAX_BLUE_IN_CHANNELS];
         struct video_desc         video_desc;
@@ -180,14 +146,9 @@ struct vidcap_bluefish444_state {
         ULONG                     ScheduleID, CapturingID, DoneID;
         bool                      interlaced;
 
-        struct av_frame_base     *CapturedFrame; // ready to send
-        struct av_frame          *NetworkFrame; // frame that is being sent
-        queue<struct av_frame*>   FreeFrameQueue;
-
-        pthread_mutex_t           lock;
-        pthread_cond_t            CapturedFrameReadyCV;
-        pthread_cond_t            CapturedFrameDoneCV;
-        pthread_cond_t            FreeFrameQueueNotEmptyCV;
+        unsigned int              buffers;
+        unique_ptr<dma_capture<vector<char>>> capture; ///< frames (with audio) are DMAed to its buffers
+        vector<char>              grabbed_audio;       ///< audio of the last grabbed frame
 
         pthread_t                 worker_id;
 };
@@ -446,20 +407,12 @@ static bool setup_audio(struct vidcap_bluefish444_state *s, unsigned int flags)
 }
 #endif
 
-static void signal_error(struct vidcap_bluefish444_state *s) {
-        pthread_mutex_lock(&s->lock);
-        if(!s->CapturedFrame) {
-                s->CapturedFrame = new av_frame_nosignal;
-                pthread_cond_signal(&s->CapturedFrameReadyCV);
-        }
-        pthread_mutex_unlock(&s->lock);
-}
-
 static void *worker(void *arg)
 {
         struct vidcap_bluefish444_state *s =
                 (struct vidcap_bluefish444_state *) arg;
         uint32_t GoldenSize = 0;
+        uint32_t FrameSize = 0;
         uint32_t ChunkSize = 0;
         uint32_t nChunks = 1;
         unsigned long int FieldCount = 0;
@@ -474,7 +427,8 @@ static void *worker(void *arg)
                 blue_videoframe_info_ex FrameInfo;
 
                 unsigned long int CurrentFieldCount = FieldCount;
-                struct av_frame *current_frame = NULL;
+                shared_ptr<video_frame> current_frame;
+                vector<char> current_audio;
                 int nOffset = 0;
 
                 // Synchronize
@@ -488,7 +442,6 @@ static void *worker(void *arg)
                                 {
                                         cerr << "No valid input signal on channel " <<
                                                (char)('A' + i) << endl;
-                                        signal_error(s);
                                         goto next_iteration;
                                 }
                                 if(i == 0) {
@@ -498,7 +451,6 @@ static void *worker(void *arg)
                                                 cerr << "Different signal detected on channel " <<
                                                         (char)('A' + i) << " than on " <<
                                                        "channel A" << endl;
-                                                signal_error(s);
                                                 goto next_iteration;
                                         }
                                 }
@@ -535,19 +487,6 @@ static void *worker(void *arg)
                 if(s->SavedVideoMode != VideoMode) {
                         if(UpdateVideoMode(s, VideoMode)) {
                                 // mode changed
-                                pthread_mutex_lock(&s->lock);
-                                if(s->NetworkFrame) {
-                                        s->NetworkFrame->valid = false;
-                                }
-                                while(s->CapturedFrame) {
-                                        pthread_cond_wait(&s->CapturedFrameDoneCV, &s->lock);
-                                }
-                                while(!s->FreeFrameQueue.empty()) {
-                                        struct av_frame *frame = s->FreeFrameQueue.front();
-                                        s->FreeFrameQueue.pop();
-                                        delete frame;
-                                }
-
                                 s->SavedVideoMode = VideoMode;
 
                                 uint32_t val32 = 0; // no subfield interrupts
@@ -566,14 +505,10 @@ static void *worker(void *arg)
 
                                 BLUE_U32 Width, Height, BytesPerLine, BytesPerFrame;
                                 bfcGetVideoInfo(VideoMode, s->UpdateFormat, s->MemoryFormat, &Width, &Height, &BytesPerLine, &BytesPerFrame, &GoldenSize);
-                                ChunkSize = BytesPerFrame;
+                                ChunkSize = FrameSize = BytesPerFrame;
                                 nChunks = 1;
-
-                                for(int i = 0; i < 2; ++i) {
-                                        s->FreeFrameQueue.push(new av_frame(s->video_desc, GoldenSize, BytesPerFrame,
-                                                                s->audio.max_size));
-                                }
-                                pthread_mutex_unlock(&s->lock);
+                                // frames with the old format already grabbed keep their buffers
+                                s->capture->reconfigure(s->video_desc, GoldenSize);
 
                                 for(int i = 0; i < s->attachedDevices; ++i) {
                                         bfcSetCardProperty32(s->pSDK[i], VIDEO_INPUT_UPDATE_TYPE,
@@ -593,19 +528,15 @@ static void *worker(void *arg)
 
                         } else {
                                 cerr << "[Blue422 cap] Fatal: unknown video mode: " << VideoMode << endl;
-                                signal_error(s);
                                 goto next_iteration;
                         }
                         SyncForSignal(s);
                 }
 
-                pthread_mutex_lock(&s->lock);
-                while(s->FreeFrameQueue.empty()) {
-                        pthread_cond_wait(&s->FreeFrameQueueNotEmptyCV, &s->lock);
+                current_frame = s->capture->get_buffer();
+                for(unsigned int i = 0; i < current_frame->tile_count; ++i) {
+                        current_frame->tiles[i].data_len = s->SubField ? ChunkSize : FrameSize;
                 }
-                current_frame = s->FreeFrameQueue.front();
-                s->FreeFrameQueue.pop();
-                pthread_mutex_unlock(&s->lock);
 
                 if(s->VideoEngine == VIDEO_ENGINE_DUPLEX) {
 #ifdef WIN32
@@ -613,26 +544,22 @@ static void *worker(void *arg)
                         if(BLUE_FAIL(bfcGetCaptureVideoFrameInfoEx(s->pSDK[0], &s->OverlapChA, FrameInfo,
                                                         0, &FifoSize))) {
                                 cerr << "Capture frame failed!" << endl;
-                                signal_error(s);
                                 goto next_iteration;
                         }
 #else
                         if(BLUE_FAIL(bfcGetCaptureVideoFrameInfoEx(s->pSDK[0], &FrameInfo))) {
                                 cerr << "Capture frame failed!" << endl;
-                                signal_error(s);
                                 goto next_iteration;
                         }
 #endif
 
                         if(FrameInfo.nVideoSignalType >= s->InvalidVideoModeFlag) {
                                 cerr << "Invalid video mode!" << endl;
-                                signal_error(s);
                                 goto next_iteration;
                         }
 
                         if(FrameInfo.BufferId == -1) {
                                 cerr << "No buffer!" << endl;
-                                signal_error(s);
                                 goto next_iteration;
                         }
                         BufferId = FrameInfo.BufferId;
@@ -643,27 +570,26 @@ static void *worker(void *arg)
                 if(s->SubField) {
                         if(SubFieldIrqs == 0) {
                                 nOffset = (nChunks - 1) * ChunkSize;
-                                current_frame->video->last_fragment = TRUE;
+                                current_frame->last_fragment = TRUE;
                         } else {
                                 nOffset = (SubFieldIrqs - 1) * ChunkSize;
-                                current_frame->video->last_fragment = FALSE;
+                                current_frame->last_fragment = FALSE;
                         }
-                        current_frame->video->tiles[0].data_len = ChunkSize;
-                        current_frame->video->fragment = TRUE;
-                        current_frame->video->tiles[0].offset = nOffset;
-                        current_frame->video->frame_fragment_id = CurrentFieldCount & 0x3fff;
+                        current_frame->fragment = TRUE;
+                        current_frame->tiles[0].offset = nOffset;
+                        current_frame->frame_fragment_id = CurrentFieldCount & 0x3fff;
                 }
 
-                //DMA the frame from the card to our buffer
+                //DMA the frame from the card directly to the buffer passed to grab
                 for(int i = 0; i < s->attachedDevices; ++i) {
 #ifdef WIN32
                         bfcSystemBufferReadAsync(s->pSDK[i], (unsigned char *)
-                                        current_frame->video->tiles[i].data,
+                                        current_frame->tiles[i].data,
                                         ChunkSize, NULL,
                                         BlueImage_HANC_DMABuffer(BufferId, BLUE_DATA_IMAGE), nOffset);
 #else
                         bfcSystemBufferRead(s->pSDK[i], (unsigned char *)
-                                        current_frame->video->tiles[i].data,
+                                        current_frame->tiles[i].data,
                                         ChunkSize,
                                         BlueImage_HANC_DMABuffer(BufferId, BLUE_DATA_IMAGE), nOffset);
 #endif
@@ -680,13 +606,13 @@ static void *worker(void *arg)
 #else
                         bfcSystemBufferRead(s->pSDK[0], (unsigned char *) s->hanc_buffer, MAX_HANC_SIZE, BlueImage_HANC_DMABuffer(BufferId, BLUE_DATA_HANC), 0);
 #endif
-                        s->objHancDecode.audio_pcm_data_ptr = current_frame->audio_data;
+                        current_audio.resize(s->audio.max_size);
+                        s->objHancDecode.audio_pcm_data_ptr = current_audio.data();
                         int iCardType = CRD_INVALID;
                         bfcQueryCardType(s->pSDK[0], &iCardType, s->iDeviceId);
                         bfcDecodeHancFrameEx(s->pSDK[0], iCardType, (unsigned int *) s->hanc_buffer,
                                         &s->objHancDecode);
-                        current_frame->audio_len = s->objHancDecode.no_audio_samples *
-                                s->audio.bps;
+                        current_audio.resize(s->objHancDecode.no_audio_samples * s->audio.bps);
                 }
 #endif
 
@@ -720,13 +646,7 @@ static void *worker(void *arg)
                         }
                 }
 
-                pthread_mutex_lock(&s->lock);
-                while(s->CapturedFrame) {
-                        pthread_cond_wait(&s->CapturedFrameDoneCV, &s->lock);
-                }
-                s->CapturedFrame = current_frame;
-                pthread_cond_signal(&s->CapturedFrameReadyCV);
-                pthread_mutex_unlock(&s->lock);
+                s->capture->submit(move(current_frame), move(current_audio));
 
 next_iteration:
 		;
@@ -761,6 +681,8 @@ static void parse_fmt(struct vidcap_bluefish444_state *s, char *fmt) {
                         s->iDeviceId = atoi(item + strlen("device="));
                 } else if(strcasecmp(item, "4K") == 0) {
                         s->is4K = true;
+                } else if(strncasecmp(item, "buffers=", strlen("buffers=")) == 0) {
+                        s->buffers = max(atoi(item + strlen("buffers=")), 2);
                 } else {
                         cerr << "[Blue cap] Unrecognized option: " << item << endl;
                 }
@@ -810,11 +732,17 @@ vidcap_bluefish444_init(struct vidcap_params *params, void **state)
         s->SubField = false;
         s->iDeviceId = 1;
         s->is4K = false;
+        s->buffers = DMA_CAPTURE_DEFAULT_BUFFERS;
 
         char *tmp_fmt = strdup(vidcap_params_get_fmt(params));
         parse_fmt(s, tmp_fmt);
         free(tmp_fmt);
 
+        // fragments of a subfield frame must not be dropped
+        s->capture = make_unique<dma_capture<vector<char>>>("bluefish444", "[Blue cap] ",
+                        s->buffers + (s->SubField ? MAX_SUBFIELD_CHUNKS - 1 : 0), dma_data_allocator(),
+                        s->SubField ? MAX_SUBFIELD_CHUNKS : 1);
+
 #ifdef WIN32
         memset(&s->OverlapChA, 0, sizeof(s->OverlapChA));
         s->OverlapChA.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -943,13 +871,6 @@ vidcap_bluefish444_init(struct vidcap_params *params, void **state)
         }
 #endif
 
-        pthread_mutex_init(&s->lock, NULL);
-        pthread_cond_init(&s->CapturedFrameReadyCV, NULL);
-        pthread_cond_init(&s->CapturedFrameDoneCV, NULL);
-        pthread_cond_init(&s->FreeFrameQueueNotEmptyCV, NULL);
-        s->NetworkFrame = NULL;
-        s->CapturedFrame = NULL;
-
         if(pthread_create(&s->worker_id, NULL, worker, (void *) s) != 0) {
                 cerr << "[Blue cap] Error initializing thread." << endl;
                 goto error;
@@ -972,36 +893,14 @@ static void vidcap_bluefish444_done(void *state)
 
 	assert(s != NULL);
 
-        pthread_mutex_lock(&s->lock);
-        if(s->NetworkFrame) {
-                if(s->NetworkFrame->valid) {
-                        s->FreeFrameQueue.push(s->NetworkFrame);
-                        pthread_cond_signal(&s->FreeFrameQueueNotEmptyCV);
-                } else {
-                        delete s->NetworkFrame;
-                }
-                s->NetworkFrame = NULL;
-        }
-        if(s->CapturedFrame) {
-                delete s->CapturedFrame;
-                s->CapturedFrame = NULL;
-                pthread_cond_signal(&s->CapturedFrameDoneCV);
-        }
         should_exit_worker = true;
-        pthread_mutex_unlock(&s->lock);
+        s->capture->flush();
         pthread_join(s->worker_id, NULL);
 
 #ifdef WIN32
         CloseHandle(s->OverlapChA.hEvent);
 #endif
 
-        delete s->CapturedFrame;
-        delete s->NetworkFrame;
-        while(!s->FreeFrameQueue.empty()) {
-                delete s->FreeFrameQueue.front();
-                s->FreeFrameQueue.pop();
-        }
-
         bfFree(MAX_HANC_SIZE, s->hanc_buffer);
 
         for(int i = 0; i < s->attachedDevices; ++i) {
@@ -1009,10 +908,6 @@ static void vidcap_bluefish444_done(void *state)
                 BailOut(s->pSDK[i]);
         }
 
-        pthread_cond_destroy(&s->CapturedFrameReadyCV);
-        pthread_cond_destroy(&s->CapturedFrameDoneCV);
-        pthread_cond_destroy(&s->FreeFrameQueueNotEmptyCV);
-
         delete s;
 }
 
@@ -1021,48 +916,19 @@ vidcap_bluefish444_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_bluefish444_state *s = (struct vidcap_bluefish444_state *) state;
 
-        struct av_frame *frame;
-        struct video_frame *res = NULL;
-
         *audio = NULL;
 
-        pthread_mutex_lock(&s->lock);
-        if(s->NetworkFrame) {
-                if(s->NetworkFrame->valid) {
-                        s->FreeFrameQueue.push(s->NetworkFrame);
-                        pthread_cond_signal(&s->FreeFrameQueueNotEmptyCV);
-                } else {
-                        delete s->NetworkFrame;
-                }
-                s->NetworkFrame = NULL;
-        }
-
-        while(!s->CapturedFrame) {
-                pthread_cond_wait(&s->CapturedFrameReadyCV, &s->lock);
-        }
-
-        if(dynamic_cast<av_frame_nosignal *>(s->CapturedFrame)) {
-		delete s->CapturedFrame;
-                s->CapturedFrame = NULL;
-                pthread_cond_signal(&s->CapturedFrameDoneCV);
-                pthread_mutex_unlock(&s->lock);
+        struct video_frame *res = s->capture->grab(chrono::milliseconds(100), &s->grabbed_audio);
+        if(!res) { // no signal
                 return NULL;
-        } else {
-                frame = dynamic_cast<av_frame *>(s->CapturedFrame);
         }
 
-        if(frame->audio_len) {
-                s->audio.data = frame->audio_data;
-                s->audio.data_len = frame->audio_len;
+        if(!s->grabbed_audio.empty()) {
+                s->audio.data = s->grabbed_audio.data();
+                s->audio.data_len = s->grabbed_audio.size();
                 *audio = &s->audio;
         }
 
-        res = frame->video;
-
-        s->NetworkFrame = frame;
-        s->CapturedFrame = NULL;
-        pthread_cond_signal(&s->CapturedFrameDoneCV);
-
         // Merge two fields together if needed (subfield, interlaced)
         if(res->fragment) {
                 if(res->frame_fragment_id % 2 == 0) {
@@ -1078,8 +944,6 @@ vidcap_bluefish444_grab(void *state, struct audio_frame **audio)
                 }
         }
 
-        pthread_mutex_unlock(&s->lock);
-
         return res;
 }
 
@@ -56,6 +56,7 @@
 #include <cassert>
 #include <condition_variable>
 #include <chrono>
+#include <deque>
 #include <iostream>
 #include <iomanip>
 #include <list>
@@ -73,6 +74,7 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/metrics.h"
 #include "utils/windows.h"
 #include "video.h"
 #include "video_capture.h"
@@ -80,6 +82,8 @@
 constexpr const int DEFAULT_AUDIO_BPS = 4;
 constexpr const size_t MAX_AUDIO_PACKETS = 10;
 #define MOD_NAME "[DeckLink capture] "
+#define DEFAULT_QUEUE_LEN 2
+#define DROP_REPORT_INTERVAL_SEC 5
 
 #ifndef WIN32
 #define STDMETHODCALLTYPE
@@ -177,6 +181,13 @@ struct vidcap_decklink_state {
         bmd_option              profile;
         bool                    nosig_send = false; ///< send video even when no signal detected
         bool                    keep_device_defaults = false;
+        bool                    sdk_alloc = false; ///< use SDK-allocated frame buffers (not pinnable)
+
+        size_t                  queue_len = DEFAULT_QUEUE_LEN; ///< max retained frames per device not yet grabbed
+        int                     dropped_frames = 0; ///< frames superseded before grabbed (since last report)
+        steady_clock::time_point last_drop_report = steady_clock::now();
+        struct metrics_counter *metric_dropped = metrics_counter_register("decklink_capture_dropped_frames",
+                        "DeckLink captured frames superseded before grabbed", nullptr);
 
         void set_codec(codec_t c);
 
@@ -195,6 +206,29 @@ static void cleanup_common(struct vidcap_decklink_state *s);
 static list<tuple<int, string, string, string>> get_input_modes (IDeckLink* deckLink);
 static void print_input_modes (IDeckLink* deckLink);
 
+/**
+ * Retained captured frame - the SDK buffers are held until the frame passed
+ * downstream is disposed (or until superseded in the queue).
+ */
+struct captured_frame {
+        IDeckLinkVideoInputFrame *frame;
+        IDeckLinkVideoFrame      *right; ///< right eye (3D) or nullptr
+        uint32_t                  timecode;
+
+        void retain() {
+                frame->AddRef();
+                if (right != nullptr) {
+                        right->AddRef();
+                }
+        }
+        void release() {
+                frame->Release();
+                if (right != nullptr) {
+                        right->Release();
+                }
+        }
+};
+
 class VideoDelegate : public IDeckLinkInputCallback {
 private:
 	int32_t                       mRefCount{};
@@ -203,12 +237,8 @@ private:
         BMDDetectedVideoInputFormatFlags configuredCsBitDepth{};
 
 public:
-        int	                      newFrameReady{};
-        IDeckLinkVideoFrame          *rightEyeFrame{};
-        void                         *pixelFrame{};
-        void                         *pixelFrameRight{};
-        IDeckLinkVideoInputFrame     *lastFrame{nullptr};
-        uint32_t                      timecode{};
+        deque<captured_frame>         frames;      ///< frames not yet grabbed, oldest first
+        captured_frame                lastFrame{}; ///< last valid frame (resent with nosig-send)
         struct vidcap_decklink_state *s;
         struct device_state          &device;
 	
@@ -216,10 +246,30 @@ public:
         }
 	
         virtual ~VideoDelegate () {
-                RELEASE_IF_NOT_NULL(rightEyeFrame);
-                RELEASE_IF_NOT_NULL(lastFrame);
+                flush();
+                if (lastFrame.frame != nullptr) {
+                        lastFrame.release();
+                }
 	}
 
+        bool frameReady() const {
+                return !frames.empty();
+        }
+        /// drops the oldest queued frame, it is accounted as dropped (lock must be held)
+        void dropFront() {
+                frames.front().release();
+                frames.pop_front();
+                s->dropped_frames += 1;
+                metrics_counter_add(s->metric_dropped, 1);
+        }
+        /// releases all queued frames (lock must be held)
+        void flush() {
+                for (auto &f : frames) {
+                        f.release();
+                }
+                frames.clear();
+        }
+
 	virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID *) override { return E_NOINTERFACE; }
 	virtual ULONG STDMETHODCALLTYPE  AddRef(void) override {
 		return mRefCount++;
@@ -334,12 +384,52 @@ public:
                         deckLinkInput->FlushStreams();
                         deckLinkInput->StartStreams();
                 }
+                flush(); // queued frames have the old format
 
                 return S_OK;
 	}
 	virtual HRESULT STDMETHODCALLTYPE VideoInputFrameArrived(IDeckLinkVideoInputFrame*, IDeckLinkAudioInputPacket*) override;
+private:
+        captured_frame captureFrame(IDeckLinkVideoInputFrame *videoFrame);
 };
 
+/**
+ * Retains the frame (and the right eye for 3D), lock must be held.
+ */
+captured_frame
+VideoDelegate::captureFrame(IDeckLinkVideoInputFrame *videoFrame)
+{
+        captured_frame ret{videoFrame, nullptr, 0};
+        videoFrame->AddRef();
+
+        IDeckLinkTimecode *tc = NULL;
+        if (videoFrame->GetTimecode(bmdTimecodeRP188Any, &tc) == S_OK) {
+                ret.timecode = tc->GetBCD();
+                tc->Release();
+        } else if (s->sync_timecode) {
+                log_msg(LOG_LEVEL_ERROR, "Failed to acquire timecode from stream. Disabling sync.\n");
+                s->sync_timecode = FALSE;
+        }
+
+        if (s->stereo) {
+                IDeckLinkVideoFrame3DExtensions *rightEye = nullptr;
+                if (videoFrame->QueryInterface(IID_IDeckLinkVideoFrame3DExtensions, (void **)&rightEye) == S_OK) {
+                        if (rightEye->GetFrameForRightEye(&ret.right) == S_OK) {
+                                if (ret.right->GetFlags() & bmdFrameHasNoInputSource) {
+                                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Right Eye Frame received (#%d) - No input signal detected\n", s->frames);
+                                }
+                        } else {
+                                ret.right = nullptr;
+                        }
+                        rightEye->Release();
+                }
+                if (ret.right == nullptr) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Sending right eye error.\n");
+                }
+        }
+        return ret;
+}
+
 HRESULT	
 VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDeckLinkAudioInputPacket *audioPacket)
 {
@@ -349,18 +439,9 @@ VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDe
 // LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK - LOCK //
 
 	// Video
-	if (videoFrame)
-	{
-                if (videoFrame->GetFlags() & bmdFrameHasNoInputSource) {
-                        nosig = true;
-			log_msg(LOG_LEVEL_INFO, "Frame received (#%d) - No input signal detected\n", s->frames);
-                        if (s->nosig_send) {
-                                newFrameReady = 1;
-                        }
-		} else {
-                        newFrameReady = 1; // The new frame is ready to grab
-			// printf("Frame received (#%lu) - Valid Frame (Size: %li bytes)\n", framecount, videoFrame->GetRowBytes() * videoFrame->GetHeight());
-		}
+        if (videoFrame && (videoFrame->GetFlags() & bmdFrameHasNoInputSource)) {
+                nosig = true;
+                log_msg(LOG_LEVEL_INFO, "Frame received (#%d) - No input signal detected\n", s->frames);
 	}
 
         if (audioPacket) {
@@ -372,50 +453,26 @@ VideoDelegate::VideoInputFrameArrived (IDeckLinkVideoInputFrame *videoFrame, IDe
                 }
         }
 
-        if (videoFrame && newFrameReady && (!nosig || !lastFrame)) {
-                /// @todo videoFrame should be actually retained until the data are processed
-                videoFrame->GetBytes(&pixelFrame);
-
-                RELEASE_IF_NOT_NULL(lastFrame);
-                lastFrame = videoFrame;
-                lastFrame->AddRef();
-
-                IDeckLinkTimecode *tc = NULL;
-                if (videoFrame->GetTimecode(bmdTimecodeRP188Any, &tc) == S_OK) {
-                        timecode = tc->GetBCD();
-                        tc->Release();
+        if (videoFrame && (!nosig || s->nosig_send)) {
+                captured_frame f{};
+                if (nosig && lastFrame.frame != nullptr) { // repeat the last valid frame
+                        f = lastFrame;
+                        f.retain();
                 } else {
-                        timecode = 0;
-                        if (s->sync_timecode) {
-                                log_msg(LOG_LEVEL_ERROR, "Failed to acquire timecode from stream. Disabling sync.\n");
-                                s->sync_timecode = FALSE;
-                        }
-                }
-
-                RELEASE_IF_NOT_NULL(rightEyeFrame);
-                pixelFrameRight = NULL;
-
-                if(s->stereo) {
-                        IDeckLinkVideoFrame3DExtensions *rightEye;
-                        HRESULT result;
-                        result = videoFrame->QueryInterface(IID_IDeckLinkVideoFrame3DExtensions, (void **)&rightEye);
-
-                        if (result == S_OK) {
-                                result = rightEye->GetFrameForRightEye(&rightEyeFrame);
-
-                                if(result == S_OK) {
-                                        if (rightEyeFrame->GetFlags() & bmdFrameHasNoInputSource)
-                                        {
-                                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Right Eye Frame received (#%d) - No input signal detected\n", s->frames);
-                                        }
-                                        rightEyeFrame->GetBytes(&pixelFrameRight);
+                        f = captureFrame(videoFrame);
+                        if (s->nosig_send) {
+                                if (lastFrame.frame != nullptr) {
+                                        lastFrame.release();
                                 }
-                        }
-                        rightEye->Release();
-                        if(!pixelFrameRight) {
-                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Sending right eye error.\n");
+                                lastFrame = f;
+                                lastFrame.retain();
                         }
                 }
+                frames.push_back(f);
+                // grabbing thread is late - the oldest frames are superseded
+                while (frames.size() > s->queue_len) {
+                        dropFront();
+                }
         }
 
         lk.unlock();
@@ -516,6 +573,17 @@ decklink_help(bool full)
                         "\tbut the video stream needs to be preserved, eg. to keep sync with audio).\n";
                 col() << "\n";
 
+                col() << SBOLD("queue=<n>") << "\n";
+                col() << "\tNumber of captured frames per device waiting to be grabbed (default " << DEFAULT_QUEUE_LEN << "), older\n"
+                        "\tframes are dropped. Frames are passed without a copy, so the frames being processed\n"
+                        "\tare held in addition (the number of card buffers is limited).\n";
+                col() << "\n";
+
+                col() << SBOLD("sdk-alloc") << "\n";
+                col() << "\tUse frame buffers allocated by the DeckLink SDK instead of the ones that are\n"
+                        "\tpage-locked for GPU compressions (eg. GPUJPEG) to avoid staging copies.\n";
+                col() << "\n";
+
                 col() << SBOLD("[no]passthrough[=keep]") << "\n";
                 col() << "\tDisables/enables/keeps capture passthrough (default is disable).\n";
                 col() << "\n";
@@ -689,6 +757,15 @@ static bool parse_option(struct vidcap_decklink_state *s, const char *opt)
                 s->profile.set_int(bmdDuplexHalf);
         } else if (strcasecmp(opt, "nosig-send") == 0) {
                 s->nosig_send = true;
+        } else if (strcasecmp(opt, "sdk-alloc") == 0) {
+                s->sdk_alloc = true;
+        } else if (strstr(opt, "queue=") == opt) {
+                int len = atoi(strchr(opt, '=') + 1);
+                if (len <= 0) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong queue length: %s\n", strchr(opt, '=') + 1);
+                        return false;
+                }
+                s->queue_len = len;
         } else if (strstr(opt, "keep-settings") == opt) {
                 s->keep_device_defaults = true;
         } else if ((strchr(opt, '=') != nullptr && strchr(opt, '=') - opt == 4) || strlen(opt) == 4) {
@@ -974,12 +1051,16 @@ static bool detect_format(struct vidcap_decklink_state *s, BMDDisplayMode *outDi
                         if (result == S_OK) {
                                 device->deckLinkInput->StartStreams();
                                 unique_lock<mutex> lk(s->lock);
-                                s->boss_cv.wait_for(lk, chrono::milliseconds(1200), [device]{return device->delegate->newFrameReady;});
+                                s->boss_cv.wait_for(lk, chrono::milliseconds(1200), [device]{return device->delegate->frameReady();});
                                 lk.unlock();
                                 device->deckLinkInput->StopStreams();
                                 device->deckLinkInput->DisableVideoInput();
 
-                                if (device->delegate->newFrameReady) {
+                                lk.lock();
+                                bool detected = device->delegate->frameReady();
+                                device->delegate->flush();
+                                lk.unlock();
+                                if (detected) {
                                         *outDisplayMode = displayMode->GetDisplayMode();
                                         // set also detected codec (!)
                                         s->set_codec(pf == bmdFormat8BitYUV ? UYVY : RGBA);
@@ -1242,6 +1323,13 @@ bool device_state::init(struct vidcap_decklink_state *s, struct tile *t, BMDAudi
                 INIT_ERR();
         }
 
+        if (!s->sdk_alloc) {
+                // buffers that can be pinned for GPU compressors, passed downstream without a copy
+                IDeckLinkMemoryAllocator *allocator = bmd_create_pinnable_allocator();
+                BMD_CHECK(deckLinkInput->SetVideoInputFrameMemoryAllocator(allocator), "SetVideoInputFrameMemoryAllocator", );
+                allocator->Release();
+        }
+
         if (HRESULT result = deckLinkInput->EnableVideoInput(displayMode->GetDisplayMode(), pf, s->enable_flags); result != S_OK) {
                 switch (result) {
                         case E_INVALIDARG:
@@ -1451,12 +1539,12 @@ static int nr_frames(struct vidcap_decklink_state *s) {
         int tiles_total = 0;
         int i;
 
-        /* If we use timecode, take maximal timecode value... */
+        /* If we use timecode, take maximal timecode value of the oldest frames... */
         if (s->sync_timecode) {
                 for (i = 0; i < s->devices_cnt; ++i) {
-                        if(s->state[i].delegate->newFrameReady) {
-                                if (s->state[i].delegate->timecode > max_timecode) {
-                                        max_timecode = s->state[i].delegate->timecode;
+                        if(s->state[i].delegate->frameReady()) {
+                                if (s->state[i].delegate->frames.front().timecode > max_timecode) {
+                                        max_timecode = s->state[i].delegate->frames.front().timecode;
                                 }
                         }
                 }
@@ -1464,13 +1552,17 @@ static int nr_frames(struct vidcap_decklink_state *s) {
 
         /* count all tiles */
         for (i = 0; i < s->devices_cnt; ++i) {
-                if(s->state[i].delegate->newFrameReady) {
-                        /* if inputs are synchronized, use only up-to-date frames (with same TC)
-                         * as the most recent */
+                VideoDelegate *delegate = s->state[i].delegate.get();
+                /* if inputs are synchronized, drop frames older than the
+                 * newest one from other inputs */
+                while (s->sync_timecode && delegate->frameReady() && delegate->frames.front().timecode != 0
+                                && delegate->frames.front().timecode < max_timecode) {
+                        delegate->dropFront();
+                }
+                if(delegate->frameReady()) {
+                        /* use only up-to-date frames (with same TC) */
                         if(s->sync_timecode) {
-                                if(s->state[i].delegate->timecode && s->state[i].delegate->timecode != max_timecode) {
-                                        s->state[i].delegate->newFrameReady = FALSE;
-                                } else {
+                                if (delegate->frames.front().timecode == 0 || delegate->frames.front().timecode == max_timecode) {
                                         tiles_total++;
                                 }
                         }
@@ -1515,22 +1607,46 @@ static audio_frame *process_new_audio_packets(struct vidcap_decklink_state *s) {
         return &s->audio;
 }
 
-static void postprocess_frame(struct vidcap_decklink_state *s) {
+static void postprocess_frame(struct vidcap_decklink_state *s, struct video_frame *frame) {
         if (s->codec == RGBA) {
-                for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        vc_copylineToRGBA_inplace((unsigned char*) s->frame->tiles[i].data,
-                                        (unsigned char*)s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len, 16, 8, 0);
+                for (unsigned i = 0; i < frame->tile_count; ++i) {
+                        vc_copylineToRGBA_inplace((unsigned char*) frame->tiles[i].data,
+                                        (unsigned char*)frame->tiles[i].data,
+                                        frame->tiles[i].data_len, 16, 8, 0);
                 }
         }
         if (s->codec == R10k && get_commandline_param(R10K_FULL_OPT) == nullptr) {
-                for (unsigned i = 0; i < s->frame->tile_count; ++i) {
-                        r10k_limited_to_full(s->frame->tiles[i].data, s->frame->tiles[i].data,
-                                        s->frame->tiles[i].data_len);
+                for (unsigned i = 0; i < frame->tile_count; ++i) {
+                        r10k_limited_to_full(frame->tiles[i].data, frame->tiles[i].data,
+                                        frame->tiles[i].data_len);
                 }
         }
 }
 
+/// releases the DeckLink frames retained by the grabbed frame
+static void dispose_frame(struct video_frame *frame) {
+        auto *retained = static_cast<vector<captured_frame> *>(frame->callbacks.dispose_udata);
+        for (auto &f : *retained) {
+                f.release();
+        }
+        delete retained;
+        vf_free(frame);
+}
+
+/// reports the frames dropped since last report (lock must be held)
+static void report_dropped(struct vidcap_decklink_state *s) {
+        steady_clock::time_point now = steady_clock::now();
+        if (now - s->last_drop_report < seconds(DROP_REPORT_INTERVAL_SEC)) {
+                return;
+        }
+        if (s->dropped_frames > 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "%d frames dropped in last %d seconds (not grabbed in time, "
+                                "queue length %zu).\n", s->dropped_frames, DROP_REPORT_INTERVAL_SEC, s->queue_len);
+        }
+        s->dropped_frames = 0;
+        s->last_drop_report = now;
+}
+
 static struct video_frame *
 vidcap_decklink_grab(void *state, struct audio_frame **audio)
 {
@@ -1598,48 +1714,66 @@ vidcap_decklink_grab(void *state, struct audio_frame **audio)
                 }
 	}
 
-        /* cleanup newframe flag */
+        /* take the oldest frame from each device */
         for (i = 0; i < s->devices_cnt; ++i) {
-                if(s->state[i].delegate->newFrameReady == 0) {
+                if (!s->state[i].delegate->frameReady()) {
                         frame_ready = false;
                 }
-                s->state[i].delegate->newFrameReady = 0;
 	}
+        auto *grabbed = new vector<captured_frame>();
+        struct video_frame *out = nullptr;
+        if (frame_ready) {
+                for (i = 0; i < s->devices_cnt; ++i) {
+                        grabbed->push_back(s->state[i].delegate->frames.front());
+                        s->state[i].delegate->frames.pop_front();
+                }
+                out = vf_alloc_desc(video_desc_from_frame(s->frame));
+        }
+        report_dropped(s);
 
         *audio = process_new_audio_packets(s); // return audio even if there is no video to avoid
                                                //  hoarding and then dropping of audio packets
 // UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UNLOCK - UN //
 	lk.unlock();
 
-	if(!frame_ready)
-		return NULL;
+        if (!frame_ready) {
+                delete grabbed;
+                return NULL;
+        }
 
+        out->callbacks.dispose_udata = grabbed;
+        out->callbacks.dispose = dispose_frame;
         /* count returned tiles */
         int count = 0;
         if(s->stereo) {
-                if (s->state[0].delegate->pixelFrame != NULL &&
-                                s->state[0].delegate->pixelFrameRight != NULL) {
-                        s->frame->tiles[0].data = (char*)s->state[0].delegate->pixelFrame;
-                        s->frame->tiles[1].data = (char*)s->state[0].delegate->pixelFrameRight;
+                if ((*grabbed)[0].right != nullptr) {
+                        void *left = nullptr;
+                        void *right = nullptr;
+                        (*grabbed)[0].frame->GetBytes(&left);
+                        (*grabbed)[0].right->GetBytes(&right);
+                        out->tiles[0].data = (char *) left;
+                        out->tiles[1].data = (char *) right;
                         ++count;
                 } // else count == 0 -> return NULL
         } else {
                 for (i = 0; i < s->devices_cnt; ++i) {
-                        if (s->state[i].delegate->pixelFrame == NULL) {
+                        void *data = nullptr;
+                        if ((*grabbed)[i].frame->GetBytes(&data) != S_OK || data == nullptr) {
                                 break;
                         }
-                        s->frame->tiles[i].data = (char*)s->state[i].delegate->pixelFrame;
+                        out->tiles[i].data = (char *) data;
                         ++count;
                 }
         }
         if (count < s->devices_cnt) {
+                dispose_frame(out);
                 return NULL;
         }
-        postprocess_frame(s);
+        postprocess_frame(s, out);
 
         s->frames++;
-        s->frame->timecode = s->state[0].delegate->timecode;
-        return s->frame;
+        out->timecode = (*grabbed)[0].timecode;
+        return out;
 }
 
 /* function from DeckLink SDK sample DeviceList */
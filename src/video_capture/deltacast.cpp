@@ -64,13 +64,16 @@
 #include "video_capture.h"
 #include "video_capture_params.h"
 
+#define DEFAULT_BUFFERS 4
+
 using namespace std;
 
 struct vidcap_deltacast_state {
-        struct video_frame *frame;
+        struct video_frame *frame; ///< current format
         struct tile        *tile;
         HANDLE            BoardHandle, StreamHandle;
-        HANDLE            SlotHandle;
+        unsigned int      buffers;    ///< driver slots (being filled, waiting and locked by grabbed frames)
+        ULONG             SlotsDropped;
 
         struct audio_frame audio_frame;
         
@@ -92,7 +95,7 @@ static void usage(void);
 
 static void usage(void)
 {
-        printf("\t-t deltacast[:device=<index>][:mode=<mode>][:codec=<codec>]\n");
+        printf("\t-t deltacast[:device=<index>][:mode=<mode>][:codec=<codec>][:buffers=<n>]\n");
 
         print_available_delta_boards();
 
@@ -113,6 +116,8 @@ static void usage(void)
 
         printf("\nDefault board is 0. If mode is omitted, it will be autodetected "
                         "(except of UHD modes). Default codec is UYVY.\n");
+        printf("Buffers is the number of the driver frame slots, the grabbed frames hold their slots "
+                        "until disposed (default %d).\n", DEFAULT_BUFFERS);
 }
 
 static void vidcap_deltacast_probe(device_info **available_cards, int *count, void (**deleter)(void *))
@@ -295,6 +300,13 @@ static bool wait_for_channel(struct vidcap_deltacast_state *s)
                 s->grab_audio = TRUE;
         }
 
+        // slots are passed without a copy and kept locked until the grabbed frame is disposed
+        Result = VHD_SetStreamProperty(s->StreamHandle, VHD_CORE_SP_BUFFERQUEUE_DEPTH, s->buffers);
+        if (Result != VHDERR_NOERROR) {
+                log_msg(LOG_LEVEL_WARNING, "[DELTACAST] Unable to set buffer queue depth to %u. Result = 0x%08" PRIX_ULONG "\n",
+                                s->buffers, Result);
+        }
+
         /* Start stream */
         Result = VHD_StartStream(s->StreamHandle);
         if (Result == VHDERR_NOERROR){
@@ -341,8 +353,9 @@ vidcap_deltacast_init(struct vidcap_params *params, void **state)
         s->autodetect_format = TRUE;
         s->frame->color_spec = UYVY;
         s->audio_frame.data = NULL;
+        s->buffers = DEFAULT_BUFFERS;
 
-        s->BoardHandle = s->StreamHandle = s->SlotHandle = NULL;
+        s->BoardHandle = s->StreamHandle = NULL;
 
         if (init_fmt) {
                 char *save_ptr = NULL;
@@ -355,6 +368,8 @@ vidcap_deltacast_init(struct vidcap_params *params, void **state)
                         } else if (strncasecmp(tok, "board=", strlen("board=")) == 0) {
                                 // compat, should be device= instead
                                 BrdId = atoi(tok + strlen("board="));
+                        } else if (strncasecmp(tok, "buffers=", strlen("buffers=")) == 0) {
+                                s->buffers = max(atoi(tok + strlen("buffers=")), 2);
                         } else if (strncasecmp(tok, "mode=", strlen("mode=")) == 0) {
                                 s->VideoStandard = atoi(tok + strlen("mode="));
                                 s->autodetect_format = FALSE;
@@ -469,9 +484,7 @@ vidcap_deltacast_done(void *state)
 	struct vidcap_deltacast_state *s = (struct vidcap_deltacast_state *) state;
 
 	assert(s != NULL);
-        
-        if(s->SlotHandle)
-                VHD_UnlockSlotHandle(s->SlotHandle);
+
         VHD_StopStream(s->StreamHandle);
         VHD_CloseStreamHandle(s->StreamHandle);
         /* Re-establish RX0-TX0 by-pass relay loopthrough */
@@ -483,14 +496,34 @@ vidcap_deltacast_done(void *state)
         free(s);
 }
 
+static void dispose_slot(struct video_frame *frame)
+{
+        VHD_UnlockSlotHandle(frame->callbacks.dispose_udata);
+        vf_free(frame);
+}
+
+static void report_dropped(struct vidcap_deltacast_state *s)
+{
+        ULONG SlotsDropped = 0;
+        if (VHD_GetStreamProperty(s->StreamHandle, VHD_CORE_SP_SLOTS_DROPPED, &SlotsDropped) != VHDERR_NOERROR) {
+                return;
+        }
+        if (SlotsDropped > s->SlotsDropped) {
+                log_msg(LOG_LEVEL_WARNING, "[DELTACAST cap.] %" PRIu_ULONG " frames dropped by the driver (all %u slots in use).\n",
+                                SlotsDropped - s->SlotsDropped, s->buffers);
+        }
+        s->SlotsDropped = SlotsDropped;
+}
+
 static struct video_frame *
 vidcap_deltacast_grab(void *state, struct audio_frame **audio)
 {
 	struct vidcap_deltacast_state   *s = (struct vidcap_deltacast_state *) state;
-        
-        ULONG             /*SlotsCount, SlotsDropped,*/BufferSize;
+
+        ULONG             BufferSize;
         ULONG             Result;
         BYTE             *pBuffer=NULL;
+        HANDLE            SlotHandle = NULL;
 
         if (!s->initialized) {
                 try {
@@ -504,10 +537,7 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
         }
 
         *audio = NULL;
-        /* Unlock slot */
-        if(s->SlotHandle)
-                VHD_UnlockSlotHandle(s->SlotHandle);
-        Result = VHD_LockSlotHandle(s->StreamHandle,&s->SlotHandle);
+        Result = VHD_LockSlotHandle(s->StreamHandle,&SlotHandle);
         if (Result != VHDERR_NOERROR) {
                 if (Result != VHDERR_TIMEOUT) {
                         log_msg(LOG_LEVEL_ERROR, "ERROR : Cannot lock slot on RX0 stream. Result = 0x%08" PRIX_ULONG "\n", Result);
@@ -525,7 +555,7 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
                 s->pAudioChn->DataSize = s->AudioBufferSize;
 
                 /* Extract audio */
-                Result = VHD_SlotExtractAudio(s->SlotHandle, &s->AudioInfo);
+                Result = VHD_SlotExtractAudio(SlotHandle, &s->AudioInfo);
                 if(Result==VHDERR_NOERROR) {
                         s->audio_frame.data_len = s->pAudioChn->DataSize;
                         /* Do audio processing here */
@@ -536,31 +566,33 @@ vidcap_deltacast_grab(void *state, struct audio_frame **audio)
         }
 
         
-         Result = VHD_GetSlotBuffer(s->SlotHandle, VHD_SDI_BT_VIDEO, &pBuffer, &BufferSize);
+         Result = VHD_GetSlotBuffer(SlotHandle, VHD_SDI_BT_VIDEO, &pBuffer, &BufferSize);
          
          if (Result != VHDERR_NOERROR) {
                 log_msg(LOG_LEVEL_ERROR, "\nERROR : Cannot get slot buffer. Result = 0x%08" PRIX_ULONG "\n",Result);
+                VHD_UnlockSlotHandle(SlotHandle);
                 return NULL;
          }
-         
-         s->tile->data = (char*) pBuffer;
-         s->tile->data_len = BufferSize;
 
-         /* Print some statistics */
-         /*VHD_GetStreamProperty(s->StreamHandle,VHD_CORE_SP_SLOTS_COUNT,&SlotsCount);
-         VHD_GetStreamProperty(s->StreamHandle,VHD_CORE_SP_SLOTS_DROPPED,&SlotsDropped);
-         printf("%u frames received (%u dropped)            \r",SlotsCount,SlotsDropped);*/
+        // the slot buffer is passed without a copy, it is unlocked when the frame is disposed
+        struct video_frame *out = vf_alloc_desc(video_desc_from_frame(s->frame));
+        out->tiles[0].data = (char*) pBuffer;
+        out->tiles[0].data_len = BufferSize;
+        out->callbacks.dispose = dispose_slot;
+        out->callbacks.dispose_udata = SlotHandle;
+
         gettimeofday(&s->t, NULL);
         double seconds = tv_diff(s->t, s->t0);    
         if (seconds >= 5) {
             float fps  = s->frames / seconds;
             log_msg(LOG_LEVEL_INFO, "[DELTACAST cap.] %d frames in %g seconds = %g FPS\n", s->frames, seconds, fps);
+            report_dropped(s);
             s->t0 = s->t;
             s->frames = 0;
         }
         s->frames++;
         
-	return s->frame;
+	return out;
 }
 
 static const struct video_capture_info vidcap_deltacast_info = {
@@ -0,0 +1,224 @@
+/**
+ * @file   video_capture/dma_capture.hpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  host buffers for capture cards transferring frames by DMA
+ *
+ * Frames are transferred directly to the buffers of a frame pool (pinnable,
+ * see utils/frame_alloc.h, and optionally locked for DMA by the card SDK so
+ * that the pages aren't locked for every transfer). The captured frame is
+ * then passed from grab() without a copy and its buffer returns to the pool
+ * when the frame is disposed. The number of buffers bounds the frames being
+ * transferred, waiting for grab and being processed by the rest of the
+ * pipeline together.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_CAPTURE_DMA_CAPTURE_HPP_5B2E8D14_7A3C_4F61_9E0B_2C4D6F8A1B37
+#define VIDEO_CAPTURE_DMA_CAPTURE_HPP_5B2E8D14_7A3C_4F61_9E0B_2C4D6F8A1B37
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "debug.h"
+#include "utils/frame_alloc.h"
+#include "utils/metrics.h"
+#include "utils/video_frame_pool.h"
+#include "video_frame.h"
+
+#define DMA_CAPTURE_DEFAULT_BUFFERS 4
+
+/**
+ * Pinnable buffers, lock_fn (if given) is called to lock the buffer for DMA
+ * after allocation and to unlock it before it is freed.
+ */
+struct dma_data_allocator : public video_frame_pool_allocator {
+        using lock_fn = std::function<void(void *ptr, size_t size, bool lock)>;
+
+        explicit dma_data_allocator(lock_fn lock = {}) : m_lock(std::move(lock)) {}
+        void *allocate(size_t size) override {
+                void *ptr = frame_data_alloc_pinnable(size);
+                if (ptr != nullptr && m_lock) {
+                        m_lock(ptr, size, true);
+                        std::lock_guard<std::mutex> lk(m_sizes_lock);
+                        m_sizes[ptr] = size;
+                }
+                return ptr;
+        }
+        void deallocate(void *ptr) override {
+                if (ptr != nullptr && m_lock) {
+                        size_t size = 0;
+                        {
+                                std::lock_guard<std::mutex> lk(m_sizes_lock);
+                                auto it = m_sizes.find(ptr);
+                                size = it->second;
+                                m_sizes.erase(it);
+                        }
+                        m_lock(ptr, size, false);
+                }
+                frame_data_free_pinnable(ptr);
+        }
+        struct video_frame_pool_allocator *clone() const override {
+                return new dma_data_allocator(m_lock);
+        }
+
+private:
+        lock_fn m_lock;
+        std::mutex m_sizes_lock;
+        std::map<void *, size_t> m_sizes;
+};
+
+struct dma_no_aux {};
+
+/**
+ * Hand-off of the frames transferred by a capture thread to grab().
+ *
+ * The capture thread obtains a buffer with get_buffer(), transfers the frame
+ * to it and passes it with submit(). If the frame isn't grabbed before
+ * queue_len newer frames are submitted, it is dropped (and counted).
+ *
+ * @tparam Aux  per-frame data passed along with the frame (eg. audio)
+ */
+template<typename Aux = dma_no_aux>
+class dma_capture {
+public:
+        /**
+         * @param name       module name (metric label)
+         * @param mod_name   log message prefix
+         * @param buffers    total number of buffers (transferred, queued and
+         *                   used downstream), get_buffer() blocks if all are used
+         * @param queue_len  maximal number of the frames waiting for grab
+         */
+        dma_capture(const char *name, const char *mod_name, unsigned buffers, dma_data_allocator const &alloc = dma_data_allocator(),
+                        size_t queue_len = 1)
+                : m_mod_name(mod_name), m_pool(buffers, alloc), m_queue_len(queue_len),
+                m_metric_dropped(metrics_counter_register("capture_dropped_frames",
+                                        "captured frames superseded before grabbed",
+                                        (std::string("module=\"") + name + "\"").c_str()))
+        {
+                if (m_queue_len + 1 >= buffers) {
+                        log_msg(LOG_LEVEL_WARNING, "%s%u buffers leave none to the frames being processed, "
+                                        "the capture will stall on slow consumers.\n", mod_name, buffers);
+                }
+        }
+
+        /// drops the queued frames, frames already grabbed keep their buffers
+        void reconfigure(struct video_desc desc, size_t buffer_size = SIZE_MAX) {
+                flush();
+                m_pool.reconfigure(desc, buffer_size);
+        }
+
+        /// @returns buffer to transfer the next frame to
+        std::shared_ptr<video_frame> get_buffer() {
+                return m_pool.get_frame();
+        }
+
+        void submit(std::shared_ptr<video_frame> frame, Aux aux = {}) {
+                std::unique_lock<std::mutex> lk(m_lock);
+                m_queue.emplace_back(std::move(frame), std::move(aux));
+                while (m_queue.size() > m_queue_len) {
+                        m_queue.pop_front();
+                        m_dropped += 1;
+                        metrics_counter_add(m_metric_dropped, 1);
+                }
+                lk.unlock();
+                m_frame_ready.notify_one();
+        }
+
+        /**
+         * @param aux  if not NULL, per-frame data are moved there
+         * @returns    frame to be disposed by the caller, NULL on timeout
+         */
+        struct video_frame *grab(std::chrono::milliseconds timeout, Aux *aux = nullptr) {
+                std::unique_lock<std::mutex> lk(m_lock);
+                report_dropped();
+                if (!m_frame_ready.wait_for(lk, timeout, [this] { return !m_queue.empty(); })) {
+                        return nullptr;
+                }
+                auto *holder = new std::shared_ptr<video_frame>(std::move(m_queue.front().first));
+                if (aux != nullptr) {
+                        *aux = std::move(m_queue.front().second);
+                }
+                m_queue.pop_front();
+                lk.unlock();
+
+                struct video_frame *ret = holder->get();
+                ret->callbacks.dispose_udata = holder;
+                ret->callbacks.dispose = [](struct video_frame *f) {
+                        delete static_cast<std::shared_ptr<video_frame> *>(f->callbacks.dispose_udata);
+                };
+                return ret;
+        }
+
+        void flush() {
+                std::lock_guard<std::mutex> lk(m_lock);
+                m_queue.clear();
+        }
+
+private:
+        static constexpr std::chrono::seconds DROP_REPORT_INTERVAL{5};
+
+        /// (lock must be held)
+        void report_dropped() {
+                auto now = std::chrono::steady_clock::now();
+                if (now - m_last_drop_report < DROP_REPORT_INTERVAL) {
+                        return;
+                }
+                if (m_dropped > 0) {
+                        log_msg(LOG_LEVEL_WARNING, "%s%d frames dropped in last %lld seconds (not grabbed in time).\n",
+                                        m_mod_name.c_str(), m_dropped, (long long) DROP_REPORT_INTERVAL.count());
+                }
+                m_dropped = 0;
+                m_last_drop_report = now;
+        }
+
+        std::string m_mod_name;
+        video_frame_pool m_pool;
+        size_t m_queue_len;
+        std::mutex m_lock;
+        std::condition_variable m_frame_ready;
+        std::deque<std::pair<std::shared_ptr<video_frame>, Aux>> m_queue;
+        int m_dropped = 0;
+        std::chrono::steady_clock::time_point m_last_drop_report = std::chrono::steady_clock::now();
+        struct metrics_counter *m_metric_dropped;
+};
+
+#endif // defined VIDEO_CAPTURE_DMA_CAPTURE_HPP_5B2E8D14_7A3C_4F61_9E0B_2C4D6F8A1B37
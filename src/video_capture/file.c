@@ -85,6 +85,7 @@
 
 static const double AUDIO_RATIO = 1.05; ///< at this ratio the audio frame can be longer than the video frame
 #define FILE_DEFAULT_QUEUE_LEN 1
+#define FILE_DEFAULT_READAHEAD_SEC 0.5
 #define MAGIC to_fourcc('u', 'g', 'l', 'f')
 #define MOD_NAME "[File cap.] "
 
@@ -114,13 +115,21 @@ struct vidcap_state_lavf_decoder {
 
         struct simple_linked_list *video_frame_queue;
         int max_queue_len;
+        struct simple_linked_list *video_pkt_queue; ///< demuxed packets waiting for vidcap_file_video_worker
+        double readahead_sec;
+        int max_queued_pkts;
+        int seek_gen; ///< incremented on seek, packets and frames from older generation are dropped
+        int64_t seek_target; ///< video PTS that the last seek was requested to
         struct audio_frame audio_frame;
         pthread_mutex_t audio_frame_lock;
 
         pthread_t thread_id;
+        pthread_t video_thread_id;
         pthread_mutex_t lock;
         pthread_cond_t new_frame_ready;
         pthread_cond_t frame_consumed;
+        pthread_cond_t pkt_queued;
+        pthread_cond_t pkt_consumed;
         pthread_cond_t paused_cv;
         struct timeval last_frame;
 
@@ -130,7 +139,7 @@ struct vidcap_state_lavf_decoder {
 static void vidcap_file_show_help(bool full) {
         color_printf("Usage:\n");
         color_printf(TERM_BOLD TERM_FG_RED "\t-t file:<name>" TERM_FG_RESET "[:loop][:nodecode][:codec=<c>]%s\n" TERM_RESET,
-                        full ? "[:opportunistic_audio][:queue=<len>][:threads=<n>[FS]]" : "");
+                        full ? "[:opportunistic_audio][:queue=<len>][:readahead=<sec>][:threads=<n>[FS]]" : "");
         color_printf("where\n");
         color_printf(TERM_BOLD "\tloop\n" TERM_RESET);
         color_printf("\t\tloop the playback\n");
@@ -143,6 +152,8 @@ static void vidcap_file_show_help(bool full) {
                 color_printf("\t\tgrab audio if not present but do not fail if not\n");
                 color_printf(TERM_BOLD "\tqueue\n" TERM_RESET);
                 color_printf("\t\tmax queue len (default: %d), increasing may help if video stutters\n", FILE_DEFAULT_QUEUE_LEN);
+                color_printf(TERM_BOLD "\treadahead\n" TERM_RESET);
+                color_printf("\t\tseconds of video read ahead of the decoder (default: %g), increase if disk latency causes stutter\n", FILE_DEFAULT_READAHEAD_SEC);
                 color_printf(TERM_BOLD "\tthreads\n" TERM_RESET);
                 color_printf("\t\tnumber of threads (0 is default), 'S' and/or 'F' to use slice/frame threads, use at least one flag\n");
         } else {
@@ -169,15 +180,22 @@ static void vidcap_file_common_cleanup(struct vidcap_state_lavf_decoder *s) {
         while ((f = simple_linked_list_pop(s->video_frame_queue)) != NULL) {
                 VIDEO_FRAME_DISPOSE(f);
         }
+        AVPacket *pkt = NULL;
+        while ((pkt = simple_linked_list_pop(s->video_pkt_queue)) != NULL) {
+                av_packet_free(&pkt);
+        }
 
         pthread_mutex_destroy(&s->audio_frame_lock);
         pthread_mutex_destroy(&s->lock);
         pthread_cond_destroy(&s->frame_consumed);
         pthread_cond_destroy(&s->new_frame_ready);
         pthread_cond_destroy(&s->paused_cv);
+        pthread_cond_destroy(&s->pkt_queued);
+        pthread_cond_destroy(&s->pkt_consumed);
         free(s->src_filename);
         module_done(&s->mod);
         simple_linked_list_destroy(s->video_frame_queue);
+        simple_linked_list_destroy(s->video_pkt_queue);
         free(s);
 }
 
@@ -219,6 +237,8 @@ static void vidcap_file_write_audio(struct vidcap_state_lavf_decoder *s, AVFrame
         pthread_mutex_unlock(&s->audio_frame_lock);
 }
 
+static void vidcap_file_drop_queued(struct vidcap_state_lavf_decoder *s);
+
 #define CHECK_FF(cmd, action_failed) do { int rc = cmd; if (rc < 0) { char buf[1024]; av_strerror(rc, buf, 1024); log_msg(LOG_LEVEL_ERROR, MOD_NAME #cmd ": %s\n", buf); action_failed} } while(0)
 static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
         struct msg_universal *msg;
@@ -233,7 +253,23 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
                         }
                         AVStream *st = s->fmt_ctx->streams[s->video_stream_idx];
                         AVRational tb = st->time_base;
-                        CHECK_FF(avformat_seek_file(s->fmt_ctx, s->video_stream_idx, INT64_MIN, st->start_time + s->last_vid_pts + sec * tb.den / tb.num, INT64_MAX, AVSEEK_FLAG_FRAME), {});
+                        // seek to the preceding keyframe, frames before target are decoded and discarded
+                        int64_t target = s->last_vid_pts + sec * tb.den / tb.num;
+                        int rc = avformat_seek_file(s->fmt_ctx, s->video_stream_idx, INT64_MIN, target, target, 0);
+                        if (rc < 0) {
+                                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Seek failed", rc);
+                                free_message((struct message *) msg, new_response(RESPONSE_INT_SERV_ERR, "seek failed"));
+                                continue;
+                        }
+                        s->seek_target = target;
+                        s->seek_gen += 1;
+                        vidcap_file_drop_queued(s);
+                        if (s->aud_ctx) {
+                                avcodec_flush_buffers(s->aud_ctx);
+                        }
+                        pthread_mutex_lock(&s->audio_frame_lock);
+                        s->audio_frame.data_len = 0;
+                        pthread_mutex_unlock(&s->audio_frame_lock);
                         char position[13], duration[13];
                         format_time_ms(s->last_vid_pts * tb.num * 1000 / tb.den  + sec * 1000, position);
                         format_time_ms(st->duration * tb.num * 1000 / tb.den, duration);
@@ -253,7 +289,192 @@ static void vidcap_file_process_messages(struct vidcap_state_lavf_decoder *s) {
         }
 }
 
-#define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); pthread_cond_signal(&s->new_frame_ready); return NULL; }
+#define FAIL_WORKER { pthread_mutex_lock(&s->lock); s->failed = true; pthread_mutex_unlock(&s->lock); pthread_cond_signal(&s->new_frame_ready); pthread_cond_signal(&s->pkt_queued); return NULL; }
+
+/// must be called with s->lock held
+static void vidcap_file_drop_queued(struct vidcap_state_lavf_decoder *s) {
+        AVPacket *pkt = NULL;
+        while ((pkt = simple_linked_list_pop(s->video_pkt_queue)) != NULL) {
+                av_packet_free(&pkt);
+        }
+        struct video_frame *f = NULL;
+        while ((f = simple_linked_list_pop(s->video_frame_queue)) != NULL) {
+                VIDEO_FRAME_DISPOSE(f);
+        }
+        pthread_cond_signal(&s->pkt_consumed);
+        pthread_cond_signal(&s->frame_consumed);
+}
+
+/**
+ * Passes the video packet to the decoding thread. The queue is bounded to
+ * the read-ahead time. Messages are processed while waiting so that the seek
+ * is not delayed by a full queue.
+ */
+static void vidcap_file_queue_video_packet(struct vidcap_state_lavf_decoder *s, AVPacket *pkt) {
+        AVPacket *queued = av_packet_alloc();
+        av_packet_move_ref(queued, pkt);
+
+        pthread_mutex_lock(&s->lock);
+        int seek_gen = s->seek_gen;
+        while (!s->should_exit && seek_gen == s->seek_gen
+                        && simple_linked_list_size(s->video_pkt_queue) >= s->max_queued_pkts) {
+                if (s->new_msg) {
+                        vidcap_file_process_messages(s);
+                        s->new_msg = false;
+                        continue;
+                }
+                pthread_cond_wait(&s->pkt_consumed, &s->lock);
+        }
+        if (s->should_exit || seek_gen != s->seek_gen) {
+                pthread_mutex_unlock(&s->lock);
+                av_packet_free(&queued);
+                return;
+        }
+        simple_linked_list_append(s->video_pkt_queue, queued);
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->pkt_queued);
+}
+
+static void vidcap_file_decode_audio(struct vidcap_state_lavf_decoder *s, AVPacket *pkt) {
+        int ret = avcodec_send_packet(s->aud_ctx, pkt);
+        if (ret < 0) {
+                print_decoder_error(MOD_NAME, ret);
+        }
+        AVFrame * frame = av_frame_alloc();
+        while (ret >= 0) {
+                ret = avcodec_receive_frame(s->aud_ctx, frame);
+                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                        break;
+                } else if (ret < 0) {
+                        print_decoder_error(MOD_NAME, ret);
+                        break;
+                }
+                /* if a frame has been decoded, output it */
+                vidcap_file_write_audio(s, frame);
+        }
+        av_frame_free(&frame);
+}
+
+/**
+ * @param seek_target frames with lower PTS are decoded but discarded (the
+ *                    seek lands on a preceding keyframe)
+ * @returns decoded frame or NULL if there is nothing to output
+ */
+static struct video_frame *vidcap_file_decode_video(struct vidcap_state_lavf_decoder *s, AVPacket *pkt, int64_t seek_target) {
+        struct video_frame *out;
+        if (s->no_decode) {
+                out = vf_alloc_desc(s->video_desc);
+                out->callbacks.data_deleter = vf_data_deleter;
+                out->callbacks.dispose = vf_free;
+                out->tiles[0].data_len = pkt->size;
+                out->tiles[0].data = malloc(pkt->size);
+                memcpy(out->tiles[0].data, pkt->data, pkt->size);
+                return out;
+        }
+
+        AVFrame * frame = av_frame_alloc();
+        int got_frame = 0;
+
+        time_ns_t t0 = get_time_in_ns();
+        int ret = avcodec_send_packet(s->vid_ctx, pkt);
+        if (ret == 0 || ret == AVERROR(EAGAIN)) {
+                ret = avcodec_receive_frame(s->vid_ctx, frame);
+                if (ret == 0) {
+                        got_frame = 1;
+                }
+        }
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Video decompress duration: %f\n", (get_time_in_ns() - t0) / NS_IN_SEC_DBL);
+        if (ret != 0) {
+                print_decoder_error(MOD_NAME, ret);
+        }
+
+        if (ret < 0 || !got_frame) {
+                if (ret < 0) {
+                        fprintf(stderr, "Error decoding video frame (%s)\n", av_err2str(ret));
+                }
+                av_frame_free(&frame);
+                return NULL;
+        }
+        if (frame->best_effort_timestamp != AV_NOPTS_VALUE && frame->best_effort_timestamp < seek_target) {
+                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Skipping frame %" PRId64 " preceding seek target\n", frame->best_effort_timestamp);
+                av_frame_free(&frame);
+                return NULL;
+        }
+        out = vf_alloc_desc_data(s->video_desc);
+
+        /* copy decoded frame to destination buffer:
+         * this is required since rawvideo expects non aligned data */
+        int video_dst_linesize[4] = { vc_get_linesize(out->tiles[0].width, out->color_spec) };
+        uint8_t *dst[4] = { (uint8_t *) out->tiles[0].data };
+        if (s->conv_uv.valid) {
+                int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
+                av_to_uv_convert(&s->conv_uv, out->tiles[0].data, frame, out->tiles[0].width, out->tiles[0].height, video_dst_linesize[0], rgb_shift);
+        } else {
+                sws_scale(s->sws_ctx, (const uint8_t * const *) frame->data, frame->linesize, 0,
+                                frame->height, dst, video_dst_linesize);
+        }
+        av_frame_free(&frame);
+        out->callbacks.dispose = vf_free;
+        return out;
+}
+
+/**
+ * Decodes video packets queued by vidcap_file_worker. The decoder is
+ * flushed when the demuxer has seeked in the meanwhile (seek_gen changed).
+ */
+static void *vidcap_file_video_worker(void *state) {
+        set_thread_name(__func__);
+        struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
+        int seek_gen = 0;
+
+        while (true) {
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && !s->failed && simple_linked_list_size(s->video_pkt_queue) == 0) {
+                        pthread_cond_wait(&s->pkt_queued, &s->lock);
+                }
+                if (s->should_exit || s->failed) {
+                        pthread_mutex_unlock(&s->lock);
+                        break;
+                }
+                AVPacket *pkt = simple_linked_list_pop(s->video_pkt_queue);
+                bool flush = seek_gen != s->seek_gen;
+                seek_gen = s->seek_gen;
+                int64_t seek_target = s->seek_target;
+                s->last_vid_pts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_signal(&s->pkt_consumed);
+
+                if (flush && s->vid_ctx) {
+                        avcodec_flush_buffers(s->vid_ctx);
+                }
+                struct video_frame *out = vidcap_file_decode_video(s, pkt, seek_target);
+                av_packet_free(&pkt);
+                if (out == NULL) {
+                        continue;
+                }
+
+                pthread_mutex_lock(&s->lock);
+                while (!s->should_exit && seek_gen == s->seek_gen
+                                && simple_linked_list_size(s->video_frame_queue) > s->max_queue_len) {
+                        pthread_cond_wait(&s->frame_consumed, &s->lock);
+                }
+                if (s->should_exit || seek_gen != s->seek_gen) { // exit or frame obsoleted by seek
+                        VIDEO_FRAME_DISPOSE(out);
+                        pthread_mutex_unlock(&s->lock);
+                        continue;
+                }
+                simple_linked_list_append(s->video_frame_queue, out);
+                pthread_mutex_unlock(&s->lock);
+                pthread_cond_signal(&s->new_frame_ready);
+        }
+
+        return NULL;
+}
+
+/**
+ * Demuxer thread - reads packets ahead, decodes audio and passes video
+ * packets to vidcap_file_video_worker.
+ */
 static void *vidcap_file_worker(void *state) {
         set_thread_name(__func__);
         struct vidcap_state_lavf_decoder *s = (struct vidcap_state_lavf_decoder *) state;
@@ -285,6 +506,9 @@ static void *vidcap_file_worker(void *state) {
                         if (s->loop) {
                                 CHECK_FF(avio_seek(s->fmt_ctx->pb, s->video_stream_idx, SEEK_SET), {}); // handle single JPEG loop, inspired by libavformat's seek_frame_generic because img_read_seek (AVInputFormat::read_seek) doesn't do the job - seeking is inmplemeted just in img2dec if VideoDemuxData::loop == 1
                                 CHECK_FF(avformat_seek_file(s->fmt_ctx, -1, INT64_MIN, s->fmt_ctx->start_time, INT64_MAX, 0), FAIL_WORKER);
+                                pthread_mutex_lock(&s->lock);
+                                s->seek_target = INT64_MIN;
+                                pthread_mutex_unlock(&s->lock);
                                 log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Rewinding the file.\n");
                                 continue;
                         } else {
@@ -312,89 +536,9 @@ static void *vidcap_file_worker(void *state) {
                                 * tb.num / tb.den, pts_val, dts_val, pkt->size);
 
                 if (pkt->stream_index == s->audio_stream_idx) {
-                        ret = avcodec_send_packet(s->aud_ctx, pkt);
-                        if (ret < 0) {
-                                print_decoder_error(MOD_NAME, ret);
-                        }
-                        AVFrame * frame = av_frame_alloc();
-                        while (ret >= 0) {
-                                ret = avcodec_receive_frame(s->aud_ctx, frame);
-				if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-					av_frame_free(&frame);
-					break; // inner loop
-                                } else if (ret < 0) {
-					print_decoder_error(MOD_NAME, ret);
-					av_frame_free(&frame);
-					break; // inner loop
-				}
-				/* if a frame has been decoded, output it */
-                                vidcap_file_write_audio(s, frame);
-                        }
-                        av_frame_free(&frame);
+                        vidcap_file_decode_audio(s, pkt);
                 } else if (pkt->stream_index == s->video_stream_idx) {
-                        s->last_vid_pts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
-                        struct video_frame *out;
-                        if (s->no_decode) {
-                                out = vf_alloc_desc(s->video_desc);
-                                out->callbacks.data_deleter = vf_data_deleter;
-                                out->callbacks.dispose = vf_free;
-                                out->tiles[0].data_len = pkt->size;
-                                out->tiles[0].data = malloc(pkt->size);
-                                memcpy(out->tiles[0].data, pkt->data, pkt->size);
-                        } else {
-                                AVFrame * frame = av_frame_alloc();
-                                int got_frame = 0;
-
-                                time_ns_t t0 = get_time_in_ns();
-                                ret = avcodec_send_packet(s->vid_ctx, pkt);
-                                if (ret == 0 || ret == AVERROR(EAGAIN)) {
-                                        ret = avcodec_receive_frame(s->vid_ctx, frame);
-                                        if (ret == 0) {
-                                                got_frame = 1;
-                                        }
-                                }
-                                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Video decompress duration: %f\n", (get_time_in_ns() - t0) / NS_IN_SEC_DBL);
-                                if (ret != 0) {
-                                        print_decoder_error(MOD_NAME, ret);
-                                }
-
-                                if (ret < 0 || !got_frame) {
-                                        if (ret < 0) {
-                                                fprintf(stderr, "Error decoding video frame (%s)\n", av_err2str(ret));
-                                        }
-                                        av_frame_free(&frame);
-                                        continue;
-                                }
-                                out = vf_alloc_desc_data(s->video_desc);
-
-                                /* copy decoded frame to destination buffer:
-                                 * this is required since rawvideo expects non aligned data */
-                                int video_dst_linesize[4] = { vc_get_linesize(out->tiles[0].width, out->color_spec) };
-                                uint8_t *dst[4] = { (uint8_t *) out->tiles[0].data };
-                                if (s->conv_uv.valid) {
-                                        int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
-                                        av_to_uv_convert(&s->conv_uv, out->tiles[0].data, frame, out->tiles[0].width, out->tiles[0].height, video_dst_linesize[0], rgb_shift);
-                                } else {
-                                        sws_scale(s->sws_ctx, (const uint8_t * const *) frame->data, frame->linesize, 0,
-                                                        frame->height, dst, video_dst_linesize);
-                                }
-                                av_frame_free(&frame);
-                                out->callbacks.dispose = vf_free;
-                        }
-                        pthread_mutex_lock(&s->lock);
-                        while (!s->should_exit && simple_linked_list_size(s->video_frame_queue) > s->max_queue_len) {
-                                pthread_cond_wait(&s->frame_consumed, &s->lock);
-                        }
-                        if (s->should_exit) {
-                                VIDEO_FRAME_DISPOSE(out);
-                                pthread_mutex_unlock(&s->lock);
-                                av_packet_unref(pkt);
-                                av_packet_free(&pkt);
-                                return NULL;
-                        }
-                        simple_linked_list_append(s->video_frame_queue, out);
-                        pthread_mutex_unlock(&s->lock);
-                        pthread_cond_signal(&s->new_frame_ready);
+                        vidcap_file_queue_video_packet(s, pkt);
                 }
                 av_packet_unref(pkt);
         }
@@ -428,6 +572,12 @@ static bool vidcap_file_parse_fmt(struct vidcap_state_lavf_decoder *s, const cha
                         }
                 } else if (strncmp(item, "queue=", strlen("queue=")) == 0) {
                         s->max_queue_len = atoi(item + strlen("queue="));
+                } else if (strncmp(item, "readahead=", strlen("readahead=")) == 0) {
+                        s->readahead_sec = atof(item + strlen("readahead="));
+                        if (s->readahead_sec < 0.0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Read-ahead must not be negative!\n");
+                                return false;
+                        }
                 } else if (strncmp(item, "threads=", strlen("threads=")) == 0) {
                         char *endptr = NULL;
                         long count = strtol(item + strlen("threads="), &endptr, 0);
@@ -473,6 +623,7 @@ static void vidcap_file_new_message(struct module *mod) {
         s->new_msg = true;
         pthread_mutex_unlock(&s->lock);
         pthread_cond_signal(&s->paused_cv);
+        pthread_cond_signal(&s->pkt_consumed);
 }
 
 static void vidcap_file_should_exit(void *state) {
@@ -483,6 +634,8 @@ static void vidcap_file_should_exit(void *state) {
         pthread_cond_signal(&s->new_frame_ready);
         pthread_cond_signal(&s->frame_consumed);
         pthread_cond_signal(&s->paused_cv);
+        pthread_cond_signal(&s->pkt_queued);
+        pthread_cond_signal(&s->pkt_consumed);
 }
 
 #define CHECK(call) { int ret = call; if (ret != 0) abort(); }
@@ -506,6 +659,9 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
 
         struct vidcap_state_lavf_decoder *s = calloc(1, sizeof (struct vidcap_state_lavf_decoder));
         s->video_frame_queue = simple_linked_list_init();
+        s->video_pkt_queue = simple_linked_list_init();
+        s->readahead_sec = FILE_DEFAULT_READAHEAD_SEC;
+        s->seek_target = INT64_MIN;
         s->audio_stream_idx = -1;
         s->video_stream_idx = -1;
         s->max_queue_len = FILE_DEFAULT_QUEUE_LEN;
@@ -516,6 +672,8 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         CHECK(pthread_cond_init(&s->frame_consumed, NULL));
         CHECK(pthread_cond_init(&s->new_frame_ready, NULL));
         CHECK(pthread_cond_init(&s->paused_cv, NULL));
+        CHECK(pthread_cond_init(&s->pkt_queued, NULL));
+        CHECK(pthread_cond_init(&s->pkt_consumed, NULL));
         module_init_default(&s->mod);
         s->mod.priv_magic = MAGIC;
         s->mod.cls = MODULE_CLASS_DATA;
@@ -565,7 +723,8 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
                         s->audio_frame.bps = av_get_bytes_per_sample(s->aud_ctx->sample_fmt);
                         s->audio_frame.sample_rate = s->aud_ctx->sample_rate;
                         s->audio_frame.ch_count = AVCODECCTX_CHANNELS(s->aud_ctx);
-                        s->audio_frame.max_size = s->audio_frame.bps * s->audio_frame.ch_count * s->audio_frame.sample_rate;
+                        // audio is decoded when demuxed so it must hold also the read-ahead
+                        s->audio_frame.max_size = s->audio_frame.bps * s->audio_frame.ch_count * s->audio_frame.sample_rate * (1 + s->readahead_sec);
                         s->audio_frame.data = malloc(s->audio_frame.max_size);
                         s->use_audio = true;
                 }
@@ -630,11 +789,13 @@ static int vidcap_file_init(struct vidcap_params *params, void **state) {
         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Capturing audio idx %d, video idx %d\n", s->audio_stream_idx, s->video_stream_idx);
 
         s->last_vid_pts = s->fmt_ctx->streams[s->video_stream_idx]->start_time;
+        s->max_queued_pkts = MAX(1, (int) (s->readahead_sec * s->video_desc.fps));
 
         playback_register_keyboard_ctl(&s->mod);
         register_should_exit_callback(&s->mod, vidcap_file_should_exit, s);
 
         pthread_create(&s->thread_id, NULL, vidcap_file_worker, s);
+        pthread_create(&s->video_thread_id, NULL, vidcap_file_video_worker, s);
 
         *state = s;
         return VIDCAP_INIT_OK;
@@ -647,6 +808,7 @@ static void vidcap_file_done(void *state) {
         vidcap_file_should_exit(s);
 
         pthread_join(s->thread_id, NULL);
+        pthread_join(s->video_thread_id, NULL);
 
         vidcap_file_common_cleanup(s);
 }
@@ -65,8 +65,19 @@
 
 #include "utils/cuda_pix_conv.h"
 #include "utils/profile_timer.hpp"
+#include "utils/video_frame_pool.h"
+
+#if defined HAVE_LAVC && defined HWACC_COMMON_IMPL
+#define GPUSTITCH_LAVC_OUTPUT 1
+extern "C" {
+#include <libavutil/hwcontext_cuda.h>
+}
+#include "hwaccel_libav_common.h"
+#include "libavcodec/utils.h"
+#endif
 
 #define PI 3.14159265
+#define MAX_DEVICE_FRAMES 3 ///< output frames in GPU memory held by the pipeline
 
 const static char *log_str = "[gpustitch] ";
 
@@ -83,11 +94,38 @@ static void show_help()
         printf("Usage\n");
         printf("\t-t gpustitch -t <dev1_config> -t <dev2_config> ....]\n");
         printf("\t\twhere devn_config is a complete configuration string of device involved in stitching\n");
+        printf("\toptions (separated by ':' before the device configs):\n");
+        printf("\t\tcudabuf - output frames stay in the GPU memory (for GPUJPEG)\n");
+#ifdef GPUSTITCH_LAVC_OUTPUT
+        printf("\t\tcudabuf=lavc - output FFmpeg CUDA frames (for libavcodec NVENC, RGBA only)\n");
+#endif
 
 }
 
 struct grab_worker_state;
 
+enum gpustitch_output {
+        OUTPUT_HOST,      ///< downloaded to pinned host memory
+        OUTPUT_CUDA,      ///< CUDA_MEM frame
+        OUTPUT_LAVC,      ///< LAVC_HW_MEM frame (AV_PIX_FMT_CUDA surface)
+};
+
+struct cuda_device_allocator : public video_frame_pool_allocator {
+        void *allocate(size_t size) override {
+                void *ptr = nullptr;
+                if (cudaMalloc(&ptr, size) != cudaSuccess) {
+                        return nullptr;
+                }
+                return ptr;
+        }
+        void deallocate(void *ptr) override {
+                cudaFree(ptr);
+        }
+        video_frame_pool_allocator *clone() const override {
+                return new cuda_device_allocator(*this);
+        }
+};
+
 struct vidcap_gpustitch_state {
         unsigned            devices_cnt;
 
@@ -107,7 +145,11 @@ struct vidcap_gpustitch_state {
         double fps;
         codec_t out_fmt;
         bool tiled_capture = false;
-        bool output_cuda_buf = false;
+        enum gpustitch_output output = OUTPUT_HOST;
+        video_frame_pool device_pool{MAX_DEVICE_FRAMES, cuda_device_allocator()};
+#ifdef GPUSTITCH_LAVC_OUTPUT
+        AVBufferRef *hw_frames_ctx = nullptr;
+#endif
 
         unsigned char *conv_tmp_frame = nullptr;
         void (*conv_func)(unsigned char *dst,
@@ -497,8 +539,15 @@ static void parse_fmt(vidcap_gpustitch_state *s, const char * const fmt){
                         s->out_fmt = get_codec_from_name(strchr(item, '=') + 1);
                 } else if(FMT_CMP("tiled")){
                         s->tiled_capture = true;
+                } else if(FMT_CMP("cudabuf=lavc")){
+#ifdef GPUSTITCH_LAVC_OUTPUT
+                        s->output = OUTPUT_LAVC;
+#else
+                        log_msg(LOG_LEVEL_WARNING, "%sCompiled without libavcodec hw. acceleration, using cudabuf\n", log_str);
+                        s->output = OUTPUT_CUDA;
+#endif
                 } else if(FMT_CMP("cudabuf")){
-                        s->output_cuda_buf = true;
+                        s->output = OUTPUT_CUDA;
                 }
                 init_fmt = NULL;
         }
@@ -600,6 +649,9 @@ vidcap_gpustitch_done(void *state)
         free(s->captured_frames);
         vf_free(s->frame);
         cudaFree(s->conv_tmp_frame);
+#ifdef GPUSTITCH_LAVC_OUTPUT
+        av_buffer_unref(&s->hw_frames_ctx);
+#endif
 
         delete s;
 }
@@ -626,13 +678,11 @@ static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, uns
         s->frame->callbacks.data_deleter = NULL;
         s->frame->callbacks.recycle = NULL;
 
-        if(!s->output_cuda_buf){
-                if(cudaMallocHost(&s->frame->tiles[0].data, s->frame->tiles[0].data_len) != cudaSuccess){
-                        std::cerr << log_str << "Failed to allocate result frame" << std::endl;
-                        return false;
-                }
-                s->frame->callbacks.data_deleter = result_data_delete;
+        if(cudaMallocHost(&s->frame->tiles[0].data, s->frame->tiles[0].data_len) != cudaSuccess){
+                std::cerr << log_str << "Failed to allocate result frame" << std::endl;
+                return false;
         }
+        s->frame->callbacks.data_deleter = result_data_delete;
 
         if(s->conv_func){
                 size_t size = vc_get_linesize(desc.width, s->out_fmt) * desc.height;
@@ -646,7 +696,64 @@ static bool allocate_result_frame(vidcap_gpustitch_state *s, unsigned width, uns
         return true;
 }
 
-static bool download_stitched(vidcap_gpustitch_state *s, cudaStream_t out_stream){
+#ifdef GPUSTITCH_LAVC_OUTPUT
+/**
+ * Allocates a surface from a CUDA hw frames context so that the frame can be
+ * passed to the libavcodec encoder (NVENC) without a download.
+ */
+static struct video_frame *alloc_lavc_frame(vidcap_gpustitch_state *s, struct video_desc desc,
+                unsigned char **dst, size_t *dst_pitch){
+        if(!s->hw_frames_ctx){
+                enum AVPixelFormat sw_format = get_ug_to_av_pixfmt(desc.color_spec);
+                if(desc.color_spec != RGBA || sw_format == AV_PIX_FMT_NONE){
+                        log_msg(LOG_LEVEL_ERROR, "%sOnly RGBA output is supported with cudabuf=lavc\n", log_str);
+                        return nullptr;
+                }
+                int flags = 0;
+#ifdef AV_CUDA_USE_PRIMARY_CONTEXT
+                // the stitcher uses the runtime API (primary context) - share it
+                flags = AV_CUDA_USE_PRIMARY_CONTEXT;
+#endif
+                int dev = 0;
+                cudaGetDevice(&dev);
+                char dev_name[16];
+                snprintf(dev_name, sizeof dev_name, "%d", dev);
+                AVBufferRef *device_ref = nullptr;
+                if(av_hwdevice_ctx_create(&device_ref, AV_HWDEVICE_TYPE_CUDA, dev_name, nullptr, flags) < 0){
+                        log_msg(LOG_LEVEL_ERROR, "%sUnable to create CUDA hw. device context\n", log_str);
+                        return nullptr;
+                }
+                int ret = create_hw_frame_ctx(device_ref, desc.width, desc.height,
+                                AV_PIX_FMT_CUDA, sw_format, MAX_DEVICE_FRAMES, &s->hw_frames_ctx);
+                av_buffer_unref(&device_ref);
+                if(ret < 0){
+                        return nullptr;
+                }
+        }
+
+        AVFrame *hw_frame = av_frame_alloc();
+        if(!hw_frame || av_hwframe_get_buffer(s->hw_frames_ctx, hw_frame, 0) < 0){
+                log_msg(LOG_LEVEL_ERROR, "%sUnable to get CUDA hw. frame\n", log_str);
+                av_frame_free(&hw_frame);
+                return nullptr;
+        }
+        struct video_frame *out = vf_alloc_lavc_hw_frame(desc, hw_frame);
+        *dst = hw_frame->data[0];
+        *dst_pitch = hw_frame->linesize[0];
+        av_frame_free(&hw_frame); // out holds its own reference
+        if(out){
+                out->callbacks.dispose = vf_free;
+        }
+        return out;
+}
+#endif
+
+/**
+ * Downloads the panorama to s->frame or, if the output stays in the GPU
+ * memory, copies it to a newly obtained disposable frame. The copy is needed
+ * because the stitcher reuses its output image for the next frame.
+ */
+static bool download_stitched(vidcap_gpustitch_state *s, cudaStream_t out_stream, struct video_frame **out){
         PROFILE_FUNC;
         gpustitch::Image_cuda *output_image;
 
@@ -659,36 +766,67 @@ static bool download_stitched(vidcap_gpustitch_state *s, cudaStream_t out_stream
         size_t w = output_image->get_width();
         size_t h = output_image->get_height();
 
-        if(!s->frame){
-                if(!allocate_result_frame(s, w, h)){
-                        return false;
-                }
+        // fps is set by the grab, keep it out of the pool description
+        video_desc desc{(unsigned) w, (unsigned) h, s->out_fmt, 0, PROGRESSIVE, 1};
+        unsigned char *dst = nullptr;
+        size_t dst_pitch = vc_get_linesize(w, s->out_fmt);
+        switch(s->output){
+                case OUTPUT_HOST:
+                        if(!s->frame){
+                                if(!allocate_result_frame(s, w, h)){
+                                        return false;
+                                }
+                        }
+                        *out = s->frame;
+                        break;
+                case OUTPUT_CUDA:
+                        *out = s->device_pool.get_disposable_frame(desc);
+                        (*out)->mem_location = CUDA_MEM;
+                        break;
+                case OUTPUT_LAVC:
+#ifdef GPUSTITCH_LAVC_OUTPUT
+                        *out = alloc_lavc_frame(s, desc, &dst, &dst_pitch);
+                        if(!*out){
+                                return false;
+                        }
+#endif
+                        break;
+        }
+        if(!dst){
+                dst = (unsigned char *) (*out)->tiles[0].data;
         }
+        const bool on_device = s->output != OUTPUT_HOST;
 
         void *src = output_image->data();
         size_t src_pitch = output_image->get_pitch();
         size_t row_bytes = output_image->get_row_bytes();
         if(s->conv_func){
-                s->conv_func(s->conv_tmp_frame, vc_get_linesize(w, s->out_fmt),
+                // device outputs are converted directly to the output frame
+                unsigned char *conv_dst = on_device ? dst : s->conv_tmp_frame;
+                size_t conv_pitch = on_device ? dst_pitch : vc_get_linesize(w, s->out_fmt);
+                s->conv_func(conv_dst, conv_pitch,
                                 (unsigned char *) src, src_pitch,
                                 w, h,
                                 out_stream);
+                if(on_device){
+                        return true;
+                }
                 src = s->conv_tmp_frame;
-                src_pitch = vc_get_linesize(w, s->out_fmt);
+                src_pitch = conv_pitch;
                 row_bytes = src_pitch;
         }
 
-        if(s->output_cuda_buf){
-                s->frame->tiles[0].data = (char *) src;
-        } else {
-                if (cudaMemcpy2DAsync(s->frame->tiles[0].data, row_bytes,
-                                        src, src_pitch,
-                                        row_bytes, h,
-                                        cudaMemcpyDeviceToHost, out_stream) != cudaSuccess)
-                {
-                        std::cerr << log_str << "Error copying output panorama from CUDA buffer" << std::endl;
-                        return false;
+        if (cudaMemcpy2DAsync(dst, on_device ? dst_pitch : row_bytes,
+                                src, src_pitch,
+                                row_bytes, h,
+                                on_device ? cudaMemcpyDeviceToDevice : cudaMemcpyDeviceToHost,
+                                out_stream) != cudaSuccess)
+        {
+                std::cerr << log_str << "Error copying output panorama from CUDA buffer" << std::endl;
+                if(on_device){
+                        VIDEO_FRAME_DISPOSE(*out);
                 }
+                return false;
         }
 
         return true;
@@ -739,7 +877,8 @@ static struct video_frame *stitch(struct vidcap_gpustitch_state *s){
         stitch_lk.unlock();
         s->stitched_cv.notify_all();
 
-        if(!download_stitched(s, out_stream)){
+        struct video_frame *out = nullptr;
+        if(!download_stitched(s, out_stream, &out)){
                 return NULL;
         }
 
@@ -747,10 +886,13 @@ static struct video_frame *stitch(struct vidcap_gpustitch_state *s){
         if (cudaStreamSynchronize(out_stream) != cudaSuccess)
         {
                 std::cerr << "Error synchronizing with the output CUDA stream" << std::endl;
+                if(out != s->frame){
+                        VIDEO_FRAME_DISPOSE(out);
+                }
                 return NULL;
         }
 
-        return s->frame;
+        return out;
 }
 
 static struct video_frame *
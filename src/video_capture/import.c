@@ -69,6 +69,7 @@
 #include "video_capture.h"
 #include "video_export.h"
 
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -77,6 +78,9 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -88,12 +92,14 @@
 #define PIPE "/tmp/ultragrid_import.fifo"
 
 #define MAX_NUMBER_WORKERS 100
+#define PREFETCH_FRAMES 8 ///< how many frames ahead of the read one are hinted to the kernel for read-ahead
 #define MOD_NAME "[import] "
 
 struct processed_entry;
 struct tile_data {
         char *data;
         int data_len;
+        bool mapped; ///< data is mmap-ed file (otherwise aligned_malloc-ed)
 };
 
 struct processed_entry {
@@ -152,6 +158,17 @@ struct audio_state {
         struct message_queue message_queue;
 }; 
 
+/// recording in the container layout (see video_export.h)
+struct import_container {
+        struct container_tile {
+                unsigned segment; ///< 1-based, 0 if the tile was not recorded
+                uint64_t offset;
+                int len;
+        } *index; ///< video_frame_count * tile_count entries
+        int *segment_fds; ///< indexed by segment number, NULL if not container
+        unsigned segment_count;
+};
+
 struct vidcap_import_state {
         struct module mod;
         struct module *parent;
@@ -160,6 +177,7 @@ struct vidcap_import_state {
         struct video_desc video_desc;
         char *directory;
         char tile_delim; // eg. '_' for format "00000001_0.yuv"
+        struct import_container container;
 
         struct message_queue message_queue;
 
@@ -178,6 +196,7 @@ struct vidcap_import_state {
         bool finished;
         bool loop;
         bool o_direct;
+        bool use_mmap;
         int video_reading_threads_count;
         bool should_exit_at_end;
         double force_fps;
@@ -263,7 +282,8 @@ static long strtol_checked(const char *line, const char *prefix, long min_val, l
         return val;
 }
 
-static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_count) {
+/// @param[out] container set to true if the recording uses container layout
+static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_count, bool *container) {
         struct video_desc desc = { 0 };
 
         char line[512];
@@ -321,6 +341,13 @@ static struct video_desc parse_video_desc_info(FILE *info, long *video_frame_cou
                         };
                         *video_frame_count = val;
                         items_found |= 1U<<6U;
+                } else if (strcmp(line, "layout container\n") == 0) {
+                        *container = true;
+                } else if(strncmp(line, "tiles ", strlen("tiles ")) == 0) {
+                        if ((val = strtol_checked(line, "tiles ", 1, INT_MAX)) == LONG_MIN) {
+                                return (struct video_desc) { 0 };
+                        }
+                        desc.tile_count = val;
                 }
         }
 
@@ -370,6 +397,54 @@ static int get_tile_count(const char *directory, codec_t color_spec, char *tile_
         return tile_count;
 }
 
+static bool load_container_index(struct vidcap_import_state *s) {
+#ifdef WIN32
+        UNUSED(s);
+        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Container layout not supported on this platform!\n");
+        return false;
+#else
+        char name[MAX_PATH_SIZE];
+        snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_NAME, s->directory);
+        FILE *f = fopen(name, "r");
+        if (f == NULL) {
+                perror(MOD_NAME "Cannot open container index");
+                return false;
+        }
+        const size_t count = (size_t) s->video_frame_count * s->video_desc.tile_count;
+        s->container.index = calloc(count, sizeof s->container.index[0]);
+        for (size_t i = 0; i < count; ++i) {
+                struct container_tile *t = &s->container.index[i];
+                if (fscanf(f, "%u %" SCNu64 " %d", &t->segment, &t->offset, &t->len) != 3) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Container index truncated at entry %zu!\n", i);
+                        fclose(f);
+                        return false;
+                }
+                s->container.segment_count = MAX(s->container.segment_count, t->segment);
+        }
+        fclose(f);
+
+        s->container.segment_fds = malloc((s->container.segment_count + 1) * sizeof(int));
+        for (unsigned i = 0; i <= s->container.segment_count; ++i) {
+                s->container.segment_fds[i] = -1;
+        }
+        int flags = O_RDONLY;
+#ifdef HAVE_LINUX
+        if (s->o_direct) {
+                flags |= O_DIRECT; // offsets and lengths in container are aligned
+        }
+#endif
+        for (unsigned i = 1; i <= s->container.segment_count; ++i) {
+                int len = snprintf(name, sizeof name, "%s/", s->directory);
+                snprintf(name + len, sizeof name - len, VIDEO_EXPORT_SEGMENT_NAME, i);
+                if ((s->container.segment_fds[i] = open(name, flags)) == -1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open segment %s: %s\n", name, strerror(errno));
+                        return false;
+                }
+        }
+        return true;
+#endif
+}
+
 static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **info, unsigned int flags) {
         bool disable_audio = false;
 
@@ -408,6 +483,12 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
                                         MAX_NUMBER_WORKERS);
                 } else if (strcmp(suffix, "o_direct") == 0) {
                         s->o_direct = true;
+                } else if (strcmp(suffix, "mmap") == 0) {
+#ifdef WIN32
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "mmap not supported on this platform!\n");
+#else
+                        s->use_mmap = true;
+#endif
                 } else if (strcmp(suffix, "noaudio") == 0) {
                         disable_audio = true;
                 } else if (strcmp(suffix, "opportunistic_audio") == 0) { // skip
@@ -459,15 +540,26 @@ static bool initialize_import(struct vidcap_import_state *s, char *tmp, FILE **i
 
         if (s->has_video) {
                 long frame_count = 0;
-                s->video_desc = parse_video_desc_info(*info, &frame_count);
+                bool container = false;
+                s->video_desc = parse_video_desc_info(*info, &frame_count, &container);
                 if (s->video_desc.width == 0) {
                         return false;
                 }
                 s->video_frame_count = s->video_frame_count == 0 ? frame_count : MIN(s->video_frame_count, frame_count);
 
-                s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
-                if (s->video_desc.tile_count == 0) {
-                        return false;
+                if (container) {
+                        if (s->video_desc.tile_count == 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Tile count missing in container metadata!\n");
+                                return false;
+                        }
+                        if (!load_container_index(s)) {
+                                return false;
+                        }
+                } else {
+                        s->video_desc.tile_count = get_tile_count(s->directory, s->video_desc.color_spec, &s->tile_delim);
+                        if (s->video_desc.tile_count == 0) {
+                                return false;
+                        }
                 }
         }
 
@@ -502,9 +594,10 @@ vidcap_import_init(struct vidcap_params *params, void **state)
         char *tmp = strdup(vidcap_params_get_fmt(params));
         if (strlen(tmp) == 0 || strcmp(tmp, "help") == 0) {
                 color_printf("Import usage:\n"
-                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:o_direct|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
+                                TERM_BOLD TERM_FG_RED "\t<directory>" TERM_FG_RESET "{:loop|:mt_reading=<nr_threads>|:o_direct|:mmap|:exit_at_end|:fps=<fps>|frames=<n>|:disable_audio}\n" TERM_RESET
                                 "where\n"
                                 TERM_BOLD "\t<fps>" TERM_RESET " - overrides FPS from sequence metadata\n"
+                                TERM_BOLD "\tmmap " TERM_RESET " - map the frame files to memory instead of reading them (frames are passed without copy)\n"
                                 TERM_BOLD "\t<n>  " TERM_RESET " - use only N first frames fron sequence (if less than available frames)\n");
                 free(tmp);
                 return VIDCAP_INIT_NOERR;
@@ -576,6 +669,12 @@ static void free_entry(struct processed_entry *entry)
                 return;
         }
         for (int i = 0; i < entry->count; ++i) {
+#ifndef WIN32
+                if (entry->tiles[i].mapped) {
+                        munmap(entry->tiles[i].data, entry->tiles[i].data_len);
+                        continue;
+                }
+#endif
                 aligned_free(entry->tiles[i].data);
         }
 
@@ -609,6 +708,16 @@ static void cleanup_common(struct vidcap_import_state *s) {
 
         free(s->directory);
 
+        if (s->container.segment_fds != NULL) {
+                for (unsigned i = 1; i <= s->container.segment_count; ++i) {
+                        if (s->container.segment_fds[i] != -1) {
+                                close(s->container.segment_fds[i]);
+                        }
+                }
+        }
+        free(s->container.segment_fds);
+        free(s->container.index);
+
         // audio
         if(s->audio_state.has_audio) {
                 ring_buffer_destroy(s->audio_state.data);
@@ -832,10 +941,115 @@ struct video_reader_data {
         unsigned int tile_count;
         struct processed_entry *entry;
         bool o_direct;
+        bool use_mmap;
+        char prefetch_prefix[512]; ///< file name prefix of a frame to be prefetched, empty if none
+        const struct import_container *container; ///< NULL if not container layout
+        long frame_idx; ///< index of the read frame (container only)
+        long prefetch_frame_idx; ///< index of the frame to be prefetched, -1 if none (container only)
 };
 
 #define ALLOC_ALIGN 512
 
+static void get_tile_file_name(char *name, size_t name_len, const struct video_reader_data *data,
+                const char *prefix, unsigned int tile_idx)
+{
+        char tile_idx_str[3] = "";
+        if (data->tile_count > 1) {
+                snprintf(tile_idx_str, sizeof tile_idx_str, "%c%u", data->tile_delim, tile_idx);
+        }
+        snprintf(name, name_len, "%s%s.%s", prefix, tile_idx_str, data->file_name_suffix);
+}
+
+/// hints the kernel to start reading the files of a frame that will be needed soon
+static void prefetch_frame(const struct video_reader_data *data)
+{
+#ifdef HAVE_LINUX
+        if (data->o_direct) {
+                return;
+        }
+        if (data->container != NULL) {
+                if (data->prefetch_frame_idx < 0) {
+                        return;
+                }
+                for (unsigned int i = 0; i < data->tile_count; i++) {
+                        const struct container_tile *t = &data->container->index[data->prefetch_frame_idx * data->tile_count + i];
+                        if (t->segment != 0) {
+                                posix_fadvise(data->container->segment_fds[t->segment], t->offset, t->len, POSIX_FADV_WILLNEED);
+                        }
+                }
+                return;
+        }
+        if (data->prefetch_prefix[0] == '\0') {
+                return;
+        }
+        for (unsigned int i = 0; i < data->tile_count; i++) {
+                char name[1048];
+                get_tile_file_name(name, sizeof name, data, data->prefetch_prefix, i);
+                int fd = open(name, O_RDONLY);
+                if (fd == -1) {
+                        continue;
+                }
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                close(fd);
+        }
+#else
+        UNUSED(data);
+#endif
+}
+
+#ifndef WIN32
+/// @retval true  tile was mapped
+/// @retval false mapping failed, regular read should be used
+static bool map_tile(int fd, off_t offset, size_t len, struct tile_data *tile)
+{
+        if (len == 0 || offset % sysconf(_SC_PAGESIZE) != 0) {
+                return false;
+        }
+        int flags = MAP_PRIVATE; // private - writes by consumers do not propagate to the file
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE; // fault the pages in by the reading thread, not by the consumer
+#endif
+        void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, fd, offset);
+        if (ptr == MAP_FAILED) {
+                perror("mmap");
+                return false;
+        }
+        madvise(ptr, len, MADV_SEQUENTIAL);
+        tile->data = (char *) ptr;
+        tile->mapped = true;
+        return true;
+}
+
+static bool read_container_tile(struct video_reader_data *data, unsigned int tile_idx)
+{
+        const struct container_tile *t = &data->container->index[data->frame_idx * data->tile_count + tile_idx];
+        if (t->segment == 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame %ld was not recorded.\n", data->frame_idx + 1);
+                return false;
+        }
+        int fd = data->container->segment_fds[t->segment];
+        struct tile_data *tile = &data->entry->tiles[tile_idx];
+        tile->data_len = t->len;
+        if (data->use_mmap && !data->o_direct && map_tile(fd, t->offset, t->len, tile)) {
+                return true;
+        }
+        const size_t padded_len = (t->len + VIDEO_EXPORT_CONTAINER_ALIGN - 1)
+                / VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN;
+        tile->data = (char *) aligned_malloc(padded_len, VIDEO_EXPORT_CONTAINER_ALIGN);
+        assert(tile->data != NULL);
+        ssize_t bytes = 0;
+        while (bytes < t->len) {
+                ssize_t res = pread(fd, tile->data + bytes, padded_len - bytes, t->offset + bytes);
+                if (res <= 0) {
+                        perror("pread");
+                        return false;
+                }
+                bytes += res;
+        }
+        return true;
+}
+#endif
+
 static void *video_reader_callback(void *arg)
 {
         struct video_reader_data *data =
@@ -847,14 +1061,17 @@ static void *video_reader_callback(void *arg)
         data->entry->count = data->tile_count;
 
         for (unsigned int i = 0; i < data->tile_count; i++) {
+#ifndef WIN32
+                if (data->container != NULL) {
+                        if (!read_container_tile(data, i)) {
+                                free_entry(data->entry);
+                                return NULL;
+                        }
+                        continue;
+                }
+#endif
                 char name[1048];
-                char tile_idx[3] = "";
-                if (data->tile_count > 1) {
-                        snprintf(tile_idx, sizeof tile_idx, "%c%d", data->tile_delim, i);
-	        }
-                snprintf(name, sizeof(name), "%s%s.%s",
-                                data->file_name_prefix, tile_idx,
-                                data->file_name_suffix);
+                get_tile_file_name(name, sizeof name, data, data->file_name_prefix, i);
 
                 struct stat sb;
 
@@ -870,6 +1087,7 @@ static void *video_reader_callback(void *arg)
                 int fd = open(name, flags);
                 if(fd == -1) {
                         perror("open");
+                        free_entry(data->entry);
                         return NULL;
                 }
                 if (fstat(fd, &sb)) {
@@ -880,6 +1098,12 @@ static void *video_reader_callback(void *arg)
                 }
 
                 data->entry->tiles[i].data_len = sb.st_size;
+#ifndef WIN32
+                if (data->use_mmap && !data->o_direct && map_tile(fd, 0, sb.st_size, &data->entry->tiles[i])) {
+                        close(fd);
+                        continue;
+                }
+#endif
                 const int aligned_data_len = (data->entry->tiles[i].data_len + ALLOC_ALIGN - 1)
                         / ALLOC_ALIGN * ALLOC_ALIGN;
                 // alignment needed when using O_DIRECT flag
@@ -894,10 +1118,7 @@ static void *video_reader_callback(void *arg)
                                         / ALLOC_ALIGN * ALLOC_ALIGN);
                         if (res <= 0) {
                                 perror("read");
-                                for (unsigned int i = 0; i < data->tile_count; i++) {
-                                        aligned_free(data->entry->tiles[i].data);
-                                }
-                                free(data->entry);
+                                free_entry(data->entry);
                                 close(fd);
                                 return NULL;
                         }
@@ -907,6 +1128,8 @@ static void *video_reader_callback(void *arg)
                 close(fd);
         }
 
+        prefetch_frame(data);
+
         return data;
 }
 
@@ -982,10 +1205,20 @@ static void * video_reading_thread(void *args)
                         struct video_reader_data *data =
                                 &data_reader[i];
                         data->o_direct = s->o_direct;
+                        data->use_mmap = s->use_mmap;
+                        data->container = s->container.segment_fds != NULL ? &s->container : NULL;
+                        data->frame_idx = index + i;
+                        data->prefetch_frame_idx = index + i + PREFETCH_FRAMES < s->video_frame_count
+                                ? index + i + PREFETCH_FRAMES : -1;
                         data->tile_count = s->video_desc.tile_count;
                         data->tile_delim = s->tile_delim;
                         snprintf(data->file_name_prefix, sizeof(data->file_name_prefix),
                                         "%s/%08ld", s->directory, index + i + 1);
+                        data->prefetch_prefix[0] = '\0';
+                        if (index + i + PREFETCH_FRAMES < s->video_frame_count) {
+                                snprintf(data->prefetch_prefix, sizeof(data->prefetch_prefix),
+                                                "%s/%08ld", s->directory, index + i + PREFETCH_FRAMES + 1);
+                        }
                         strncpy(data->file_name_suffix,
                                         get_codec_file_extension(s->video_desc.color_spec),
                                         sizeof(data->file_name_suffix));
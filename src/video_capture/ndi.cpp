@@ -544,10 +544,15 @@ static struct video_frame *vidcap_ndi_grab(void *state, struct audio_frame **aud
                         s->NDIlib->recv_free_video_v2(s->pNDI_recv, &video_frame);
                         out->callbacks.dispose = vf_free;
                 } else {
+                        // NDI frame wrapped without a copy, padded lines are passed as a strided tile
                         out = vf_alloc_desc(out_desc);
                         out->tiles[0].data = reinterpret_cast<char*>(video_frame.p_data);
                         if (is_codec_opaque(out_desc.color_spec)) {
                                 out->tiles[0].data_len = video_frame.data_size_in_bytes;
+                        } else if (const int linesize = vc_get_linesize(out_desc.width, out_desc.color_spec);
+                                        video_frame.line_stride_in_bytes > linesize) {
+                                out->tiles[0].linesize = video_frame.line_stride_in_bytes;
+                                out->tiles[0].data_len = (out_desc.height - 1) * video_frame.line_stride_in_bytes + linesize;
                         }
                         struct dispose_udata_t {
                                 NDIlib_video_frame_v2_t video_frame;
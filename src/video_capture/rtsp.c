@@ -310,6 +310,8 @@ vidcap_rtsp_thread(void *arg) {
     time_ns_t start_time = get_time_in_ns();
 
     struct video_frame *frame = vf_alloc_desc_data(s->vrtsp_state.desc);
+    // size of the frame data, the depacketizer reallocates it if needed
+    size_t frame_buf_size = frame->tiles[0].data_len;
 
     while (!s->should_exit) {
         time_ns_t curr_time = get_time_in_ns();
@@ -328,10 +330,15 @@ vidcap_rtsp_thread(void *arg) {
             while (cp != NULL) {
                 struct decode_data_h264 d;
                 d.frame = frame;
+                d.buf_size = frame_buf_size;
+                d.offset_buf = s->vrtsp_state.h264_offset_buffer;
                 d.offset_len = s->vrtsp_state.h264_offset_len;
                 d.video_pt = s->vrtsp_state.pt;
-                if (pbuf_decode(cp->playout_buffer, curr_time,
-                            decode_frame_by_pt, &d))
+                d.hevc = s->vrtsp_state.desc.color_spec == H265;
+                int ret = pbuf_decode(cp->playout_buffer, curr_time,
+                            decode_frame_by_pt, &d);
+                frame_buf_size = d.buf_size;
+                if (ret)
                 {
                     pthread_mutex_lock(&s->vrtsp_state.lock);
                     while (s->vrtsp_state.out_frame != NULL && !s->should_exit) {
@@ -342,6 +349,7 @@ vidcap_rtsp_thread(void *arg) {
                     if (s->vrtsp_state.out_frame == NULL) {
                         s->vrtsp_state.out_frame = frame;
                         frame = vf_alloc_desc_data(s->vrtsp_state.desc); // alloc new
+                        frame_buf_size = frame->tiles[0].data_len;
                         if (s->vrtsp_state.boss_waiting)
                             pthread_cond_signal(&s->vrtsp_state.boss_cv);
                         pthread_mutex_unlock(&s->vrtsp_state.lock);
@@ -418,10 +426,6 @@ vidcap_rtsp_grab(void *state, struct audio_frame **audio) {
             pthread_mutex_unlock(&s->vrtsp_state.lock);
             pthread_cond_signal(&s->vrtsp_state.worker_cv);
 
-            if(s->vrtsp_state.h264_offset_len>0 && frame->frame_type == INTRA){
-                    memcpy(frame->tiles[0].data, s->vrtsp_state.h264_offset_buffer, s->vrtsp_state.h264_offset_len);
-            }
-
             if (s->vrtsp_state.decompress) {
                 struct video_desc curr_desc = video_desc_from_frame(frame);
                 curr_desc.color_spec = H264;
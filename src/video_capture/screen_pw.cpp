@@ -58,6 +58,9 @@ static constexpr int MIN_BUFFERS_PW = 2;
 static constexpr int MAX_BUFFERS_PW = 10;
 static constexpr int QUEUE_SIZE = 3;
 static constexpr int DEFAULT_EXPECTING_FPS = 30;
+static constexpr int MAX_DAMAGE_REGIONS = 16;
+/// unchanged frame is passed anyway if no frame was passed for this interval
+static constexpr uint64_t DAMAGE_KEEPALIVE_MS = 1000;
 
 struct request_path_t {
         std::string token;
@@ -308,6 +311,7 @@ struct screen_cast_session {
                 std::string restore_file = "";
                 uint32_t fps = 0;
                 bool crop = true;
+                bool damage = true; ///< skip frames that PipeWire marks as unchanged
         } user_options;
 
         std::unique_ptr<ScreenCastPortal> portal;
@@ -363,6 +367,8 @@ struct screen_cast_session {
                 }
 
                 int frame_count = 0;
+                int skipped_count = 0; ///< unchanged frames not passed
+                uint64_t last_passed_time = 0;
                 uint64_t frame_counter_begin_time = time_since_epoch_in_ms();
                 int expecting_fps = DEFAULT_EXPECTING_FPS;
 
@@ -434,7 +440,7 @@ static void on_stream_param_changed(void *session_ptr, uint32_t id, const struct
                 SPA_PARAM_BUFFERS_size, SPA_POD_Int(size),
                 SPA_PARAM_BUFFERS_stride, SPA_POD_Int(linesize),
                 SPA_PARAM_BUFFERS_dataType,
-                SPA_POD_CHOICE_FLAGS_Int((1 << SPA_DATA_MemPtr)))
+                SPA_POD_CHOICE_FLAGS_Int((1 << SPA_DATA_MemPtr) | (1 << SPA_DATA_MemFd)))
         );
         
         if(session.user_options.crop) {
@@ -445,6 +451,17 @@ static void on_stream_param_changed(void *session_ptr, uint32_t id, const struct
                         SPA_POD_Int(sizeof(struct spa_meta_region)))
                 );
         }
+
+        if(session.user_options.damage) {
+                params[n_params++] = static_cast<spa_pod *>(spa_pod_builder_add_object(&builder,
+                        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+                        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+                        SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+                                sizeof(struct spa_meta_region) * MAX_DAMAGE_REGIONS,
+                                sizeof(struct spa_meta_region),
+                                sizeof(struct spa_meta_region) * MAX_DAMAGE_REGIONS))
+                );
+        }
         
         pw_stream_update_params(session.pw.stream, params, n_params);
 
@@ -523,6 +540,25 @@ static void copy_frame(spa_video_format video_format, spa_buffer *buffer, video_
         tile->data_len = vc_get_linesize(tile->width, RGBA) * tile->height;
 }
 
+/**
+ * @returns false if the producer marked the buffer as unchanged (video
+ * damage metadata present but without any valid region), true otherwise
+ */
+static bool buffer_damaged(spa_buffer *buffer) {
+        auto *damage = static_cast<spa_meta *>(spa_buffer_find_meta(buffer, SPA_META_VideoDamage));
+        if (damage == nullptr) {
+                return true;
+        }
+        spa_meta_region *region = nullptr;
+        spa_meta_for_each(region, damage) {
+                if (!spa_meta_region_is_valid(region)) {
+                        break;
+                }
+                return true;
+        }
+        return false;
+}
+
 static void on_process(void *session_ptr) {
         using namespace std::chrono_literals;
         SCOPE_STOPWATCH(on_process);
@@ -546,6 +582,14 @@ static void on_process(void *session_ptr) {
                         continue;
                 }
 
+                if (session.user_options.damage && !buffer_damaged(buffer->buffer) &&
+                                time_since_epoch_in_ms() - session.pw.last_passed_time < DAMAGE_KEEPALIVE_MS) {
+                        LOG(LOG_LEVEL_DEBUG2) << "[screen_pw]: skipping unchanged frame\n";
+                        session.pw.skipped_count += 1;
+                        pw_stream_queue_buffer(session.pw.stream, buffer);
+                        continue;
+                }
+
                 if(!session.blank_frames.timed_pop(next_frame, 1000ms / session.pw.expecting_fps)) {
                         LOG(LOG_LEVEL_DEBUG) << "[screen_pw]: dropping frame (blank frame dequeue timed out)\n";
                         pw_stream_queue_buffer(session.pw.stream, buffer);
@@ -565,11 +609,14 @@ static void on_process(void *session_ptr) {
                 
                 ++session.pw.frame_count;
                 uint64_t time_now = time_since_epoch_in_ms();
+                session.pw.last_passed_time = time_now;
 
                 uint64_t delta = time_now - session.pw.frame_counter_begin_time;
                 if(delta >= 5000) {
                         double average_fps = session.pw.frame_count / (static_cast<int>(delta) / 1000.0);
-                        LOG(LOG_LEVEL_VERBOSE) << "[screen_pw]: on process: average fps in last 5 seconds: " << average_fps << "\n";
+                        LOG(LOG_LEVEL_VERBOSE) << "[screen_pw]: on process: average fps in last 5 seconds: " << average_fps
+                                << " (" << session.pw.skipped_count << " unchanged frames skipped)\n";
+                        session.pw.skipped_count = 0;
                         session.pw.expecting_fps = static_cast<int>(average_fps);
                         if(session.pw.expecting_fps == 0)
                                 session.pw.expecting_fps = 1;
@@ -875,9 +922,10 @@ static void show_help() {
         };
 
         std::cout << "Screen capture using PipeWire and ScreenCast freedesktop portal API\n";
-        std::cout << "Usage: -t screen_pw[:cursor|:nocrop|:fps=<fps>|:restore=<token_file>]]\n";
+        std::cout << "Usage: -t screen_pw[:cursor|:nocrop|:nodamage|:fps=<fps>|:restore=<token_file>]]\n";
         param("cursor") << "make the cursor visible (default hidden)\n";
         param("nocrop") << "when capturing a window do not crop out the empty background\n";
+        param("nodamage") << "pass also frames that PipeWire reports as unchanged (by default these are skipped, except one per second)\n";
         param("<fps>") << "prefered FPS passed to PipeWire (PipeWire may ignore it)\n";
         param("<token_file>") << "restore the selected window/display from a file.\n\t\tIf not possible, display the selection dialog and save the token to the file specified.\n";
 }
@@ -896,6 +944,8 @@ static int parse_params(struct vidcap_params *params, screen_cast_session &sessi
                                 session.user_options.show_cursor = true;
                         } else if (param == "nocrop") {
                                 session.user_options.crop = false;
+                        } else if (param == "nodamage") {
+                                session.user_options.damage = false;
                         } else {
                                 auto split_index = param.find('=');
                                 if(split_index != std::string::npos && split_index != 0){
@@ -35,8 +35,10 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /**
- * @todo
- * The XGetImage() is a bit slow, consider using XShm as OBS does.
+ * If available (local display), the screen is grabbed with XShmGetImage()
+ * to a set of shared memory images reused across frames, otherwise with
+ * XGetImage(). Optionally, XDamage is used to avoid grabbing the screen if
+ * nothing has changed.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -61,11 +63,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include <X11/Xlib.h>
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif // HAVE_XDAMAGE
 #ifdef HAVE_XFIXES
 #include <X11/extensions/Xfixes.h>
 #endif // HAVE_XFIXES
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif // HAVE_XSHM
 #include <X11/Xutil.h>
 
 #define MOD_NAME "[screen capture] "
@@ -79,16 +90,23 @@ static void show_help()
 {
         printf("Screen capture\n");
         printf("Usage\n");
-        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH]\n");
+        printf("\t-t screen[:fps=<fps>][:display=<d>][:geometry=WxH[+x[+y]]|:size=WxH][:noshm][:damage]\n");
         printf("\t\t<fps> - preferred grabbing fps (otherwise unlimited)\n");
         printf("\t\tdisplay - display to capture (including the colon!)\n");
         printf("\t\tgeomoetry | size - viewport to use (both option mean the same - size is just a convenient name)\n");
+        printf("\t\tnoshm - do not use XShm extension (XShm is used if the display is local)\n");
+        printf("\t\tdamage - grab the screen only if changed (XDamage)\n");
 }
 
 struct grabbed_data;
 
 struct grabbed_data {
         XImage *data;
+        bool unchanged; ///< screen not changed since last item, data is not valid
+#ifdef HAVE_XSHM
+        bool shm;
+        XShmSegmentInfo shminfo;
+#endif // HAVE_XSHM
         struct grabbed_data *next;
 };
 
@@ -121,8 +139,125 @@ struct vidcap_screen_x11_state {
         bool initialized;
         int cpu_count;
         char *req_display;
+
+        bool use_shm;
+        struct grabbed_data *free_items; ///< XShm images for reuse
+        bool use_damage;
+#ifdef HAVE_XDAMAGE
+        Damage damage;
+        int damage_event_base;
+#endif // HAVE_XDAMAGE
+        bool have_frame; ///< at least one frame was grabbed
+        int cursor_x, cursor_y;
+        unsigned long cursor_serial;
 };
 
+#ifdef HAVE_XSHM
+static bool create_shm_image(struct vidcap_screen_x11_state *s, struct grabbed_data *item) {
+        int screen = DefaultScreen(s->dpy);
+        item->data = XShmCreateImage(s->dpy, DefaultVisual(s->dpy, screen), DefaultDepth(s->dpy, screen),
+                        ZPixmap, NULL, &item->shminfo, s->tile->width, s->tile->height);
+        if (item->data == NULL) {
+                return false;
+        }
+        item->shminfo.shmid = shmget(IPC_PRIVATE, item->data->bytes_per_line * item->data->height, IPC_CREAT | 0600);
+        if (item->shminfo.shmid == -1) {
+                XDestroyImage(item->data);
+                item->data = NULL;
+                return false;
+        }
+        item->shminfo.shmaddr = item->data->data = shmat(item->shminfo.shmid, NULL, 0);
+        item->shminfo.readOnly = False;
+        bool ret = item->shminfo.shmaddr != (void *) -1 && XShmAttach(s->dpy, &item->shminfo);
+        XSync(s->dpy, False);
+        shmctl(item->shminfo.shmid, IPC_RMID, NULL); // destroyed after detach
+        if (!ret) {
+                if (item->shminfo.shmaddr != (void *) -1) {
+                        shmdt(item->shminfo.shmaddr);
+                }
+                item->data->data = NULL;
+                XDestroyImage(item->data);
+                item->data = NULL;
+                return false;
+        }
+        item->shm = true;
+        return true;
+}
+#endif // HAVE_XSHM
+
+static void destroy_item(struct vidcap_screen_x11_state *s, struct grabbed_data *item) {
+#ifndef HAVE_XSHM
+        UNUSED(s);
+#endif // ! HAVE_XSHM
+        if (item->data) {
+#ifdef HAVE_XSHM
+                if (item->shm) {
+                        XShmDetach(s->dpy, &item->shminfo);
+                        shmdt(item->shminfo.shmaddr);
+                        item->data->data = NULL;
+                }
+#endif // HAVE_XSHM
+                XDestroyImage(item->data);
+        }
+        free(item);
+}
+
+/// returns grabbed item to the pool (XShm) or destroys it
+static void release_item(struct vidcap_screen_x11_state *s, struct grabbed_data *item) {
+#ifdef HAVE_XSHM
+        if (!item->shm) {
+#endif // HAVE_XSHM
+                destroy_item(s, item);
+                return;
+#ifdef HAVE_XSHM
+        }
+#endif // HAVE_XSHM
+        pthread_mutex_lock(&s->lock);
+        item->next = s->free_items;
+        s->free_items = item;
+        pthread_mutex_unlock(&s->lock);
+}
+
+static struct grabbed_data *get_item(struct vidcap_screen_x11_state *s) {
+        struct grabbed_data *item = NULL;
+        pthread_mutex_lock(&s->lock);
+        if (s->free_items) {
+                item = s->free_items;
+                s->free_items = item->next;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (item == NULL) {
+                item = calloc(1, sizeof(struct grabbed_data));
+        }
+        item->unchanged = false;
+        item->next = NULL;
+        return item;
+}
+
+/// @returns true if the screen may have changed since last call
+static bool screen_changed(struct vidcap_screen_x11_state *s) {
+#ifdef HAVE_XDAMAGE
+        if (!s->use_damage) {
+                return true;
+        }
+        bool damaged = !s->have_frame;
+        while (XPending(s->dpy)) {
+                XEvent ev;
+                XNextEvent(s->dpy, &ev);
+                if (ev.type == s->damage_event_base + XDamageNotify) {
+                        damaged = true;
+                }
+        }
+        if (damaged) {
+                XDamageSubtract(s->dpy, s->damage, None, None);
+        }
+        return damaged;
+#else
+        UNUSED(s);
+        return true;
+#endif // HAVE_XDAMAGE
+}
+
 static bool initialize(struct vidcap_screen_x11_state *s) {
         s->frame = vf_alloc(1);
         s->tile = vf_get_tile(s->frame, 0);
@@ -141,6 +276,27 @@ static bool initialize(struct vidcap_screen_x11_state *s) {
                 return false;
         }
 
+#ifdef HAVE_XSHM
+        if (s->use_shm && !XShmQueryExtension(s->dpy)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "XShm not available (remote display?), using XGetImage\n");
+                s->use_shm = false;
+        }
+#else
+        s->use_shm = false;
+#endif // HAVE_XSHM
+#ifdef HAVE_XDAMAGE
+        int damage_error_base = 0;
+        if (s->use_damage && XDamageQueryExtension(s->dpy, &s->damage_event_base, &damage_error_base)) {
+                s->damage = XDamageCreate(s->dpy, s->root, XDamageReportNonEmpty);
+        } else
+#endif // HAVE_XDAMAGE
+        if (s->use_damage) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "XDamage not available, grabbing every frame\n");
+                s->use_damage = false;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s%s\n", s->use_shm ? "XShm" : "XGetImage",
+                        s->use_damage ? " with XDamage" : "");
+
         XGetWindowAttributes(s->dpy, DefaultRootWindow(s->dpy), &wa);
         s->tile->width = IF_NOT_NULL_ELSE(MIN(s->width, wa.width), wa.width);
         s->tile->height = IF_NOT_NULL_ELSE(MIN(s->height, wa.height), wa.height);
@@ -181,17 +337,43 @@ static void *grab_thread(void *args)
         struct vidcap_screen_x11_state *s = args;
 
         while(!s->should_exit_worker) {
-                struct grabbed_data *new_item = malloc(sizeof(struct grabbed_data));
+                struct grabbed_data *new_item = get_item(s);
 
+                bool changed = screen_changed(s);
 #ifdef HAVE_XFIXES
                 XFixesCursorImage *cursor =
                         XFixesGetCursorImage (s->dpy);
+                if (cursor && (cursor->x != s->cursor_x || cursor->y != s->cursor_y ||
+                                        cursor->cursor_serial != s->cursor_serial)) {
+                        s->cursor_x = cursor->x;
+                        s->cursor_y = cursor->y;
+                        s->cursor_serial = cursor->cursor_serial;
+                        changed = true;
+                }
 #endif // HAVE_XFIXES
-                new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
-                assert(new_item->data != NULL);
+                if (!changed) {
+                        // wait a while not to busy-loop, the previous frame will be repeated
+                        new_item->unchanged = true;
+                        usleep(1000000 / s->frame->fps);
+                } else {
+#ifdef HAVE_XSHM
+                        if (s->use_shm && new_item->data == NULL && !create_shm_image(s, new_item)) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create XShm image, using XGetImage!\n");
+                                s->use_shm = false;
+                        }
+                        if (new_item->shm) {
+                                if (!XShmGetImage(s->dpy, s->root, new_item->data, s->x, s->y, AllPlanes)) {
+                                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "XShmGetImage failed!\n");
+                                }
+                        } else
+#endif // HAVE_XSHM
+                        new_item->data = XGetImage(s->dpy,s->root, s->x, s->y, s->tile->width, s->tile->height, AllPlanes, ZPixmap);
+                        assert(new_item->data != NULL);
+                        s->have_frame = true;
+                }
 
 #ifdef HAVE_XFIXES
-                if (cursor) {
+                if (cursor && !new_item->unchanged) {
                         uint32_t *image_data = (uint32_t *)(void *) new_item->data->data;
                         for(int x = 0; x < cursor->width; ++x) {
                                 for(int y = 0; y < cursor->height; ++y) {
@@ -219,6 +401,8 @@ static void *grab_thread(void *args)
                                 }
                         }
 
+                }
+                if (cursor) {
                         XFree(cursor);
                 }
 #endif // HAVE_XFIXES
@@ -297,6 +481,10 @@ static _Bool parse_fmt(struct vidcap_screen_x11_state *s, char *fmt) {
                         s->req_display = realloc(s->req_display, strlen(s->req_display) + 1 + strlen(tok) + 1);
                         strcat(s->req_display, ":");
                         strcat(s->req_display, tok);
+                } else if (strcmp(tok, "noshm") == 0) {
+                        s->use_shm = false;
+                } else if (strcmp(tok, "damage") == 0) {
+                        s->use_damage = true;
                 } else if (strstr(tok, "geometry=") == tok || strstr(tok, "size=") == tok) {
                         char *val = strchr(tok, '=') + 1;
                         s->width = atoi(val);
@@ -342,6 +530,7 @@ static int vidcap_screen_x11_init(struct vidcap_params *params, void **state)
                 return VIDCAP_INIT_FAIL;
         }
         s->cpu_count = get_cpu_core_count();
+        s->use_shm = true;
         gettimeofday(&s->t0, NULL);
 
 #ifndef HAVE_XFIXES
@@ -395,13 +584,23 @@ static void vidcap_screen_x11_done(void *state)
                 while(s->queue_len > 0) {
                         struct grabbed_data *item = s->head;
                         s->head = s->head->next;
-                        XDestroyImage(item->data);
-                        free(item);
+                        destroy_item(s, item);
                         s->queue_len -= 1;
                 }
+                while (s->free_items) {
+                        struct grabbed_data *item = s->free_items;
+                        s->free_items = item->next;
+                        destroy_item(s, item);
+                }
         }
         pthread_mutex_unlock(&s->lock);
 
+#ifdef HAVE_XDAMAGE
+        if (s->damage) {
+                XDamageDestroy(s->dpy, s->damage);
+        }
+#endif // HAVE_XDAMAGE
+
         if(s->tile)
                 free(s->tile->data);
 
@@ -451,10 +650,11 @@ static struct video_frame * vidcap_screen_x11_grab(void *state, struct audio_fra
          * some configurations, but seems to work currently. To be corrected if there is an
          * opposite case.
          */
-        parallel_pix_conv(s->tile->height, s->tile->data, vc_get_linesize(s->tile->width, RGB), &item->data->data[0], vc_get_linesize(s->tile->width, RGBA), vc_copylineABGRtoRGB, s->cpu_count);
+        if (!item->unchanged) { // otherwise keep previous content
+                parallel_pix_conv(s->tile->height, s->tile->data, vc_get_linesize(s->tile->width, RGB), &item->data->data[0], item->data->bytes_per_line, vc_copylineABGRtoRGB, s->cpu_count);
+        }
 
-        XDestroyImage(item->data);
-        free(item);
+        release_item(s, item);
 
         if(s->fps > 0.0) {
                 struct timeval cur_time;
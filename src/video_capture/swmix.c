@@ -67,6 +67,9 @@
 #include <stdlib.h>
 
 #define MAX_AUDIO_LEN (1024*1024)
+/// number of pixel pack buffers used for asynchronous read-back (progressive
+/// output only) - the frame is downloaded while the next one is rendered
+#define READBACK_PBO_COUNT 2
 
 typedef enum {
         BICUBIC,
@@ -601,6 +604,52 @@ static void render_slave(struct slave_data *s, interpolation_t interpolation, GL
         glEnd();
 }
 
+/**
+ * Pending asynchronous read-back of the mixed frame. The frame stays in the
+ * PBO until the fence is signalled so that glReadPixels doesn't stall the
+ * pipeline; audio captured with the frame is held back with it.
+ */
+struct readback_slot {
+        GLuint  pbo;
+        GLsync  fence;
+        char   *audio_data;
+        int     audio_len;
+};
+
+static void readback_start(struct readback_slot *slot, int width, int height, GLenum format)
+{
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * Copies the frame read back to slot PBO to buf
+ * @retval false no read-back pending in slot
+ */
+static bool readback_finish(struct readback_slot *slot, char *buf, size_t len)
+{
+        if (slot->fence == NULL) {
+                return false;
+        }
+        while (glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 * 1000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(slot->fence);
+        slot->fence = NULL;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        void *ptr = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (ptr) {
+                memcpy(buf, ptr, len);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+                fprintf(stderr, "[swmix] Unable to map read-back buffer!\n");
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return true;
+}
+
 static void *master_worker(void *arg)
 {
         struct vidcap_swmix_state *s = (struct vidcap_swmix_state *) arg;
@@ -627,6 +676,20 @@ static void *master_worker(void *arg)
 
         char *current_buffer = NULL;
 
+        // interlaced modes compose the frame from 2 fields in system memory
+        // so they keep the synchronous read-back
+        const bool async_readback = s->frame->interlacing == PROGRESSIVE;
+        struct readback_slot readback[READBACK_PBO_COUNT] = { { 0 } };
+        int readback_idx = 0;
+        if (async_readback) {
+                for (int i = 0; i < READBACK_PBO_COUNT; ++i) {
+                        glGenBuffers(1, &readback[i].pbo);
+                        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback[i].pbo);
+                        glBufferData(GL_PIXEL_PACK_BUFFER, s->frame->tiles[0].data_len, NULL, GL_STREAM_READ);
+                }
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
         while(1) {
                 pthread_mutex_lock(&s->lock);
                 if(s->should_exit) {
@@ -635,7 +698,7 @@ static void *master_worker(void *arg)
                 }
                 pthread_mutex_unlock(&s->lock);
 
-                if(field == 0) {
+                if(field == 0 && current_buffer == NULL) {
                         pthread_mutex_lock(&s->lock);
                         while(simple_linked_list_size(s->free_buffer_queue) == 0) {
                                 pthread_cond_wait(&s->free_buffer_queue_not_empty_cv,
@@ -745,18 +808,39 @@ static void *master_worker(void *arg)
                         format = GL_RGB;
                 }
 
-                char *read_buf;
-                if(s->frame->interlacing == PROGRESSIVE) {
-                        read_buf = current_buffer;
+                if (async_readback) {
+                        struct readback_slot *slot = &readback[readback_idx];
+                        readback_start(slot, width, s->frame->tiles[0].height, format);
+                        slot->audio_data = audio_data;
+                        slot->audio_len = audio_len;
+                        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                        glBindTexture(GL_TEXTURE_2D, 0);
+
+                        // deliver the previous frame, its read-back should
+                        // have been completed while rendering this one
+                        readback_idx = (readback_idx + 1) % READBACK_PBO_COUNT;
+                        slot = &readback[readback_idx];
+                        audio_data = slot->audio_data;
+                        audio_len = slot->audio_len;
+                        slot->audio_data = NULL;
+                        slot->audio_len = 0;
+                        if (!readback_finish(slot, current_buffer, s->frame->tiles[0].data_len)) {
+                                continue; // pipeline not yet filled
+                        }
                 } else {
-                        read_buf = tmp_buffer;
+                        char *read_buf;
+                        if(s->frame->interlacing == PROGRESSIVE) {
+                                read_buf = current_buffer;
+                        } else {
+                                read_buf = tmp_buffer;
+                        }
+                        glReadPixels(0, 0, width,
+                                        s->frame->tiles[0].height,
+                                        format, GL_UNSIGNED_BYTE,
+                                        read_buf);
+                        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                        glBindTexture(GL_TEXTURE_2D, 0);
                 }
-                glReadPixels(0, 0, width,
-                                s->frame->tiles[0].height,
-                                format, GL_UNSIGNED_BYTE,
-                                read_buf);
-                glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                glBindTexture(GL_TEXTURE_2D, 0);
 
                 if(s->frame->interlacing == INTERLACED_MERGED) {
                         int linesize =
@@ -794,6 +878,17 @@ static void *master_worker(void *arg)
         }
 
         free(tmp_buffer);
+        free(current_buffer);
+
+        for (int i = 0; i < READBACK_PBO_COUNT; ++i) {
+                if (readback[i].fence) {
+                        glDeleteSync(readback[i].fence);
+                }
+                free(readback[i].audio_data);
+                if (readback[i].pbo) {
+                        glDeleteBuffers(1, &readback[i].pbo);
+                }
+        }
 
         glDeleteProgram(from_uyvy);
         glDeleteProgram(to_uyvy);
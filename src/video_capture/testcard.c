@@ -66,6 +66,7 @@
 #include "video.h"
 #include "video_capture.h"
 #include "utils/color_out.h"
+#include "utils/latency_probe.h"
 #include "utils/misc.h"
 #include "utils/string.h"
 #include "utils/vf_split.h"
@@ -73,6 +74,9 @@
 #include "utils/y4m.h"
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef HAVE_LINUX
+#include <sys/mman.h>
+#endif
 #include "audio/types.h"
 #include "utils/video_pattern_generator.h"
 #include "video_capture/testcard_common.h"
@@ -82,6 +86,10 @@ enum {
         AUDIO_BPS = 2,
         BUFFER_SEC = 1,
         DEFAULT_AUIDIO_FREQUENCY = 1000,
+        DEFAULT_STAMP_CYCLE = 8,
+        CYCLE_ALIGN = 2 * 1024 * 1024, ///< hugepage size (x86_64) to allow THP backing of the cycle
+        STAMP_BITS = 32,
+        STAMP_BLOCK = 16, ///< size (in pixels) of one bit of the stamp
 };
 #define MOD_NAME "[testcard] "
 #define AUDIO_BUFFER_SIZE(ch_count) ( AUDIO_SAMPLE_RATE * AUDIO_BPS * (ch_count) * BUFFER_SEC )
@@ -117,6 +125,14 @@ struct testcard_state {
         bool grab_audio;
         bool still_image;
         char pattern[128];
+
+        char **cycle; ///< prerendered frames served in a loop (if cycle_len > 0)
+        int cycle_len;
+        uint32_t frame_num;
+        bool stamp; ///< stamp frame number to the top-left corner
+        bool probe; ///< embed capture time to the top-left corner (see utils/latency_probe.h)
+        unsigned char *stamp_block[2]; ///< one line of black and white stamp bit in target codec
+        int stamp_block_pixels;
 };
 
 static void configure_fallback_audio(struct testcard_state *s) {
@@ -414,9 +430,75 @@ static size_t testcard_load_from_file(const char *filename, struct video_desc *d
         return data_len;
 }
 
+static bool testcard_init_stamp(struct testcard_state *s)
+{
+        const codec_t c = s->frame->color_spec;
+        const int block_pixels = get_pf_block_pixels(c);
+        s->stamp_block_pixels = (STAMP_BLOCK + block_pixels - 1) / block_pixels * block_pixels;
+        if (codec_is_planar(c) || (int) s->frame->tiles[0].width < STAMP_BITS * s->stamp_block_pixels
+                        || (int) s->frame->tiles[0].height < STAMP_BLOCK) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot stamp frame number to %s %ux%u!\n", get_codec_name(c),
+                                s->frame->tiles[0].width, s->frame->tiles[0].height);
+                return false;
+        }
+        unsigned char *rgba = malloc(4 * s->stamp_block_pixels);
+        for (int val = 0; val < 2; ++val) {
+                memset(rgba, val ? 0xFF : 0, 4 * s->stamp_block_pixels);
+                for (int i = 3; i < 4 * s->stamp_block_pixels; i += 4) {
+                        rgba[i] = 0xFF; // alpha
+                }
+                s->stamp_block[val] = malloc(vc_get_linesize(s->stamp_block_pixels, c));
+                testcard_convert_buffer(RGBA, c, s->stamp_block[val], rgba, s->stamp_block_pixels, 1);
+        }
+        free(rgba);
+        return true;
+}
+
+/// writes current frame number to data as STAMP_BITS blocks
+static void testcard_stamp(struct testcard_state *s, char *data)
+{
+        const size_t linesize = vc_get_linesize(s->frame->tiles[0].width, s->frame->color_spec);
+        const size_t block_len = vc_get_linesize(s->stamp_block_pixels, s->frame->color_spec);
+        for (int y = 0; y < STAMP_BLOCK; ++y) {
+                for (int bit = 0; bit < STAMP_BITS; ++bit) {
+                        int val = (s->frame_num >> (STAMP_BITS - 1 - bit)) & 1U;
+                        memcpy(data + y * linesize + bit * block_len, s->stamp_block[val], block_len);
+                }
+        }
+}
+
+/**
+ * Prerenders cycle_len consecutive frames from the generator (including
+ * pan or other animation) so that the grab only passes a pointer.
+ */
+static void testcard_prerender_cycle(struct testcard_state *s)
+{
+        const size_t data_len = s->frame->tiles[0].data_len;
+        s->cycle = calloc(s->cycle_len, sizeof s->cycle[0]);
+        for (int i = 0; i < s->cycle_len; ++i) {
+                s->cycle[i] = aligned_malloc(data_len, CYCLE_ALIGN);
+#ifdef MADV_HUGEPAGE
+                madvise(s->cycle[i], data_len, MADV_HUGEPAGE);
+#endif
+                memcpy(s->cycle[i], video_pattern_generator_next_frame(s->generator), data_len);
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Prerendered %d frames (%.1f MiB)%s.\n", s->cycle_len,
+                        (double) data_len * s->cycle_len / (1024 * 1024), s->stamp ? ", frame numbers stamped" : s->probe ? ", capture time embedded" : "");
+}
+
+static void testcard_free_cycle(struct testcard_state *s)
+{
+        for (int i = 0; s->cycle != NULL && i < s->cycle_len; ++i) {
+                aligned_free(s->cycle[i]);
+        }
+        free(s->cycle);
+        free(s->stamp_block[0]);
+        free(s->stamp_block[1]);
+}
+
 static void show_help(bool full) {
         printf("testcard options:\n");
-        color_printf(TBOLD(TRED("\t-t testcard") "[:size=<width>x<height>][:fps=<fps>][:codec=<codec>]") "[:file=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=<pattern>] " TBOLD("| -t testcard:[full]help\n"));
+        color_printf(TBOLD(TRED("\t-t testcard") "[:size=<width>x<height>][:fps=<fps>][:codec=<codec>]") "[:file=<filename>][:p][:s=<X>x<Y>][:i|:sf][:still][:pattern=<pattern>][:cycle=<n>][:stamp|:probe] " TBOLD("| -t testcard:[full]help\n"));
         color_printf("or\n");
         color_printf(TBOLD(TRED("\t-t testcard") ":<width>:<height>:<fps>:<codec>") "[:other_opts]\n");
         color_printf("where\n");
@@ -428,6 +510,12 @@ static void show_help(bool full) {
         color_printf(TBOLD("\tpattern") "      - pattern to use, use \"" TBOLD("pattern=help") "\" for options\n");
         color_printf(TBOLD("\t   s   ") "      - split the frames into XxY separate tiles (currently defunct)\n");
         color_printf(TBOLD("\t still ") "      - send still image\n");
+        color_printf(TBOLD("\t cycle ") "      - prerender <n> frames and send them in a loop without any further processing (load generator)\n");
+        color_printf(TBOLD("\t stamp ") "      - stamp frame number to the top-left corner (implies cycle=%d if not set) as %d %dx%d white(1)/black(0) blocks, MSB first\n",
+                        DEFAULT_STAMP_CYCLE, STAMP_BITS, STAMP_BLOCK, STAMP_BLOCK);
+        color_printf(TBOLD("\t probe ") "      - embed capture time to the top-left corner (implies cycle=%d if not set) for end-to-end\n"
+                        "\t               latency measurement, see " TBOLD("--param decoder-latency-probe") " and capture filter " TBOLD("latency_probe") "\n",
+                        DEFAULT_STAMP_CYCLE);
         if (full) {
                 color_printf(TBOLD("       afrequency") "    - embedded audio frequency\n");
         }
@@ -494,6 +582,16 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                         log_msg(LOG_LEVEL_WARNING, "[testcard] Deprecated 'sf' option. Use format testcard:1920:1080:25sf:UYVY instead!\n");
                 } else if (strcmp(tmp, "still") == 0) {
                         s->still_image = true;
+                } else if (strstr(tmp, "cycle=") == tmp) {
+                        s->cycle_len = atoi(strchr(tmp, '=') + 1);
+                        if (s->cycle_len <= 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cycle length must be positive!\n");
+                                goto error;
+                        }
+                } else if (strcmp(tmp, "stamp") == 0) {
+                        s->stamp = true;
+                } else if (strcmp(tmp, "probe") == 0) {
+                        s->probe = true;
                 } else if (strncmp(tmp, "pattern=", strlen("pattern=")) == 0) {
                         const char *pattern = tmp + strlen("pattern=");
                         strncpy(s->pattern, pattern, sizeof s->pattern - 1);
@@ -548,6 +646,25 @@ static int vidcap_testcard_init(struct vidcap_params *params, void **state)
                 video_pattern_generator_fill_data(s->generator, in_file_contents);
         }
 
+        if (s->stamp && s->probe) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Options stamp and probe are mutually exclusive!\n");
+                goto error;
+        }
+        if (s->stamp && !testcard_init_stamp(s)) {
+                s->stamp = false;
+        }
+        if (s->probe && !latency_probe_supported(s->frame->color_spec, s->frame->tiles[0].width, s->frame->tiles[0].height)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot embed latency probe to %s %ux%u!\n", get_codec_name(s->frame->color_spec),
+                                s->frame->tiles[0].width, s->frame->tiles[0].height);
+                s->probe = false;
+        }
+        if ((s->stamp || s->probe) && s->cycle_len == 0) {
+                s->cycle_len = DEFAULT_STAMP_CYCLE;
+        }
+        if (s->cycle_len > 0) {
+                testcard_prerender_cycle(s);
+        }
+
         s->last_frame_time = get_time_in_ns();
 
         log_msg(LOG_LEVEL_INFO, MOD_NAME "capture set to %s, bpc %d, pattern: %s, audio %s\n", video_desc_to_string(desc),
@@ -580,6 +697,7 @@ error:
         free(fmt);
         vf_free(s->frame);
         free(in_file_contents);
+        testcard_free_cycle(s);
         free(s);
         return ret;
 }
@@ -596,6 +714,7 @@ static void vidcap_testcard_done(void *state)
         }
         vf_free(s->frame);
         video_pattern_generator_destroy(s->generator);
+        testcard_free_cycle(s);
         free(s->audio_data);
         free(s);
 }
@@ -623,7 +742,20 @@ static struct video_frame *vidcap_testcard_grab(void *arg, struct audio_frame **
                 *audio = NULL;
         }
 
-        vf_get_tile(state->frame, 0)->data = video_pattern_generator_next_frame(state->generator);
+        if (state->cycle_len > 0) {
+                char *data = state->cycle[state->frame_num % state->cycle_len];
+                if (state->stamp) {
+                        testcard_stamp(state, data);
+                }
+                if (state->probe) {
+                        latency_probe_embed(state->frame->color_spec, state->frame->tiles[0].width,
+                                        state->frame->tiles[0].height, data, curr_time);
+                }
+                vf_get_tile(state->frame, 0)->data = data;
+                state->frame_num += 1;
+        } else {
+                vf_get_tile(state->frame, 0)->data = video_pattern_generator_next_frame(state->generator);
+        }
 
         if (state->tiled) {
                 /* update tile data instead */
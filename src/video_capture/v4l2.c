@@ -78,6 +78,8 @@
 
 /* prototypes of functions defined in this module */
 static void print_fps(int fd, struct v4l2_frmivalenum *param);
+struct vidcap_v4l2_state;
+static _Bool set_v4l2_userptr_buffers(struct vidcap_v4l2_state *s, struct v4l2_requestbuffers *reqbuf);
 
 struct vidcap_v4l2_state {
         struct video_desc desc;
@@ -91,6 +93,7 @@ struct vidcap_v4l2_state {
 #endif
         struct v4l2_format src_fmt; ///< captured format
         struct v4l2_format dst_fmt; ///< converted format if v4lconvert is used
+        unsigned int linesize; ///< bytesperline of captured (unconverted) frames, 0 if contiguous
 
         struct timeval t0;
         int frames;
@@ -99,6 +102,12 @@ struct vidcap_v4l2_state {
 
         struct simple_linked_list *buffers_to_enqueue;
         int dequeued_buffers;
+
+        _Bool userptr; ///< capture to our buffers (V4L2_MEMORY_USERPTR), driver buffer is replaced on dequeue
+        size_t userptr_len;
+        struct simple_linked_list *free_userptr_bufs;
+        int userptr_allocated; ///< buffers allocated in addition to the ones given to driver
+        int userptr_held; ///< buffers passed out in frames
         pthread_mutex_t lock;
         pthread_cond_t cv;
 };
@@ -131,14 +140,24 @@ static void vidcap_v4l2_common_cleanup(struct vidcap_v4l2_state *s) {
 
         pthread_mutex_lock(&s->lock);
         enqueue_all_finished_frames(s);
-        while (s->dequeued_buffers != 0) {
+        while (s->dequeued_buffers != 0 || s->userptr_held != 0) {
                 pthread_cond_wait(&s->cv, &s->lock);
                 enqueue_all_finished_frames(s);
         }
         pthread_mutex_unlock(&s->lock);
 
+        if (s->userptr) {
+                void *buf = NULL;
+                while ((buf = simple_linked_list_pop(s->free_userptr_bufs)) != NULL) {
+                        aligned_free(buf);
+                }
+        }
+        simple_linked_list_destroy(s->free_userptr_bufs);
+
         for (int i = 0; i < s->buffer_count; ++i) {
-                if (s->buffers[i].start) {
+                if (s->userptr) {
+                        aligned_free(s->buffers[i].start);
+                } else if (s->buffers[i].start) {
                         if (-1 == munmap(s->buffers[i].start, s->buffers[i].length)) {
                                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "munmap");
                         }
@@ -206,7 +225,7 @@ static void show_help(_Bool full)
         printf("V4L2 capture\n");
         printf("Usage\n");
         color_printf(TERM_BOLD TERM_FG_RED "\t-t v4l2[:device=<dev>]" TERM_FG_RESET
-                        "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:convert=<conv>][:permissive] | -t v4l2:[short]help\n" TERM_RESET);
+                        "[:codec=<pixel_fmt>][:size=<width>x<height>][:tpf=<tpf>|:fps=<fps>][:buffers=<bufcnt>][:convert=<conv>][:userptr][:permissive] | -t v4l2:[short]help\n" TERM_RESET);
         printf("where\n");
         color_printf(TERM_BOLD "<dev> -" TERM_RESET "\tuse device to grab from (default: first usable)\n");
         color_printf(TERM_BOLD "\t<tpf>" TERM_RESET " - time per frame in format <numerator>/<denominator>\n");
@@ -224,6 +243,7 @@ static void show_help(_Bool full)
         color_printf(TERM_FG_RED " v4lconvert support not compiled in!" TERM_RESET);
 #endif
         printf("\n");
+        printf("\t\tuserptr - capture to buffers allocated by UltraGrid (V4L2_MEMORY_USERPTR) - the driver is not starved if frames are held downstream\n");
         printf("\t\tpermissive - do not fail if configuration values (size, FPS) are adjusted by driver and not set exactly\n");
         printf("\n");
 
@@ -521,6 +541,7 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         s->buffer_count = DEFAULT_BUF_COUNT;
         s->fd = -1;
         s->buffers_to_enqueue = simple_linked_list_init();
+        s->free_userptr_bufs = simple_linked_list_init();
         pthread_mutex_init(&s->lock, NULL);
         pthread_cond_init(&s->cv, NULL);
 
@@ -584,6 +605,8 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "v4lconvert support not compiled in!");
                                 goto error;
 #endif
+                        } else if (strcmp(item, "userptr") == 0) {
+                                s->userptr = 1;
                         } else if (strstr(item, "permissive") == item) {
                                 s->permissive = 1;
                         } else {
@@ -712,6 +735,14 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
                 stream_params.parm.capture.timeperframe.numerator;
         s->desc.width = fmt.fmt.pix.width;
         s->desc.height = fmt.fmt.pix.height;
+        // pass padded driver lines as they are (tile::linesize)
+        s->linesize = 0;
+        if (v4l2_convert_to == VIDEO_CODEC_NONE && !codec_is_planar(s->desc.color_spec)
+                        && !is_codec_opaque(s->desc.color_spec)
+                        && (int) fmt.fmt.pix.bytesperline > vc_get_linesize(s->desc.width, s->desc.color_spec)) {
+                s->linesize = fmt.fmt.pix.bytesperline;
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Driver line padding - %u bytes per line.\n", s->linesize);
+        }
 
 #ifdef HAVE_LIBV4LCONVERT
         s->convert = NULL;
@@ -727,7 +758,17 @@ static int vidcap_v4l2_init(struct vidcap_params *params, void **state)
         reqbuf.memory = V4L2_MEMORY_MMAP;
         reqbuf.count = s->buffer_count;
 
-        if (!set_v4l2_buffers(s->fd, &reqbuf, s->buffers)) {
+        if (s->userptr && v4l2_convert_to != VIDEO_CODEC_NONE) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "User pointer capture is not used with conversion, using mmap.\n");
+                s->userptr = 0;
+        }
+        if (s->userptr && !set_v4l2_userptr_buffers(s, &reqbuf)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "User pointer capture not available, using mmap.\n");
+                s->userptr = 0;
+                reqbuf.memory = V4L2_MEMORY_MMAP;
+                reqbuf.count = s->buffer_count;
+        }
+        if (!s->userptr && !set_v4l2_buffers(s->fd, &reqbuf, s->buffers)) {
                 goto error;
         }
         s->buffer_count = reqbuf.count;
@@ -755,6 +796,47 @@ error:
         return VIDCAP_INIT_FAIL;
 }
 
+/**
+ * Requests V4L2_MEMORY_USERPTR buffers and enqueues page-aligned buffers
+ * allocated by us. On failure, the state is left as if it was not called.
+ */
+static _Bool set_v4l2_userptr_buffers(struct vidcap_v4l2_state *s, struct v4l2_requestbuffers *reqbuf)
+{
+        reqbuf->memory = V4L2_MEMORY_USERPTR;
+        if (ioctl(s->fd, VIDIOC_REQBUFS, reqbuf) != 0) {
+                log_perror(LOG_LEVEL_VERBOSE, MOD_NAME "VIDIOC_REQBUFS (USERPTR)");
+                return 0;
+        }
+        if (reqbuf->count < 2 || reqbuf->count > MAX_BUF_COUNT) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Driver adjusted buffer count to %u!\n", reqbuf->count);
+                goto error;
+        }
+
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        s->userptr_len = (s->src_fmt.fmt.pix.sizeimage + page_size - 1) / page_size * page_size;
+        for (unsigned int i = 0; i < reqbuf->count; i++) {
+                s->buffers[i].start = aligned_malloc(s->userptr_len, page_size);
+                s->buffers[i].length = s->userptr_len;
+                struct v4l2_buffer buf = { .type = reqbuf->type, .memory = V4L2_MEMORY_USERPTR, .index = i };
+                buf.m.userptr = (unsigned long) s->buffers[i].start;
+                buf.length = s->userptr_len;
+                if (s->buffers[i].start == NULL || ioctl(s->fd, VIDIOC_QBUF, &buf) != 0) {
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue user pointer buffer");
+                        goto error;
+                }
+        }
+        return 1;
+
+error:
+        for (unsigned int i = 0; i < MAX_BUF_COUNT; i++) {
+                aligned_free(s->buffers[i].start);
+                s->buffers[i].start = NULL;
+        }
+        reqbuf->count = 0;
+        ioctl(s->fd, VIDIOC_REQBUFS, reqbuf);
+        return 0;
+}
+
 static void vidcap_v4l2_done(void *state)
 {
         struct vidcap_v4l2_state *s = (struct vidcap_v4l2_state *) state;
@@ -778,6 +860,61 @@ static void vidcap_v4l2_dispose_video_frame(struct video_frame *frame) {
         vf_free(frame);
 }
 
+static void vidcap_v4l2_dispose_userptr_frame(struct video_frame *frame) {
+        struct vidcap_v4l2_state *s = frame->callbacks.dispose_udata;
+
+        pthread_mutex_lock(&s->lock);
+        simple_linked_list_append(s->free_userptr_bufs, frame->tiles[0].data);
+        s->userptr_held -= 1;
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->cv);
+
+        vf_free(frame);
+}
+
+/**
+ * Passes the dequeued buffer to the frame and gives the driver a spare one
+ * in its place so that captured frames held downstream do not block capture.
+ */
+static _Bool userptr_pass_buffer(struct vidcap_v4l2_state *s, struct v4l2_buffer *buf, struct video_frame *out)
+{
+        void *spare = NULL;
+        pthread_mutex_lock(&s->lock);
+        while ((spare = simple_linked_list_pop(s->free_userptr_bufs)) == NULL
+                        && s->userptr_allocated >= s->buffer_count) {
+                pthread_cond_wait(&s->cv, &s->lock);
+        }
+        if (spare == NULL) {
+                spare = aligned_malloc(s->userptr_len, sysconf(_SC_PAGESIZE));
+                s->userptr_allocated += spare != NULL;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (spare == NULL) { // keep the captured data, return the buffer to the driver
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to allocate capture buffer!\n");
+                if (ioctl(s->fd, VIDIOC_QBUF, buf) != 0) {
+                        log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue buffer");
+                }
+                return 0;
+        }
+
+        out->tiles[0].data = (char *) buf->m.userptr;
+        out->tiles[0].data_len = buf->bytesused;
+        out->callbacks.dispose = vidcap_v4l2_dispose_userptr_frame;
+        out->callbacks.dispose_udata = s;
+        pthread_mutex_lock(&s->lock);
+        s->userptr_held += 1;
+        pthread_mutex_unlock(&s->lock);
+
+        s->buffers[buf->index].start = spare;
+        buf->m.userptr = (unsigned long) spare;
+        buf->length = s->userptr_len;
+        if (ioctl(s->fd, VIDIOC_QBUF, buf) != 0) {
+                log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to enqueue buffer");
+        }
+        return 1;
+}
+
 static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **audio)
 {
         struct vidcap_v4l2_state *s = (struct vidcap_v4l2_state *) state;
@@ -796,17 +933,25 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
         struct v4l2_buffer buf;
         memset(&buf, 0, sizeof(buf));
         buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
+        buf.memory = s->userptr ? V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
 
         if(ioctl(s->fd, VIDIOC_DQBUF, &buf) != 0) {
                 log_perror(LOG_LEVEL_ERROR, MOD_NAME "Unable to dequeue buffer");
                 return NULL;
         };
 
-        s->dequeued_buffers += 1;
-
         out = vf_alloc_desc(s->desc);
-        out->callbacks.dispose = vidcap_v4l2_dispose_video_frame;
+        out->tiles[0].linesize = s->linesize;
+
+        if (s->userptr) {
+                if (!userptr_pass_buffer(s, &buf, out)) {
+                        vf_free(out);
+                        return NULL;
+                }
+        } else {
+                s->dequeued_buffers += 1;
+                out->callbacks.dispose = vidcap_v4l2_dispose_video_frame;
+        }
 
 #ifdef HAVE_LIBV4LCONVERT
         if (s->convert) {
@@ -837,7 +982,7 @@ static struct video_frame * vidcap_v4l2_grab(void *state, struct audio_frame **a
 #else
         if (0) {
 #endif // HAVE_LIBV4LCONVERT
-        } else {
+        } else if (!s->userptr) {
                 struct v4l2_dispose_deq_buffer_data *frame_data =
                         malloc(sizeof(struct v4l2_dispose_deq_buffer_data));
                 frame_data->s = s;
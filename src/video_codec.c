@@ -195,6 +195,10 @@ static const struct codec_info_t codec_info[] = {
                 to_fourcc('a','p','c','o'), 1, 1, 0, 8, FALSE, TRUE, FALSE, FALSE, 0, "apco"},
         [PRORES_422_LT] =  {"PRORES_422_LT", "Apple ProRes 422 (LT)",
                 to_fourcc('a','p','c','s'), 1, 1, 0, 8, FALSE, TRUE, FALSE, FALSE, 0, "apcs"},
+        [HW_VAAPI] = {"HW_VAAPI", "VA-API hardware surface",
+                to_fourcc('V', 'A', 'S', 'F'), sizeof(av_frame_wrapper), 1, 0, 8, FALSE, TRUE, FALSE, TRUE, 4200, "vaapi"},
+        [ULW] = {"ULW", "UltraGrid lite wavelet",
+                to_fourcc('U','L','W','1'), 1, 1, 0, 10, FALSE, TRUE, FALSE, FALSE, 0, "ulw"},
 };
 
 /// for planar pixel formats
@@ -478,7 +482,7 @@ bool codec_is_const_size(codec_t codec)
 }
 
 bool codec_is_hw_accelerated(codec_t codec) {
-        return codec == HW_VDPAU;
+        return codec == HW_VDPAU || codec == HW_VAAPI;
 }
 
 /**
@@ -876,6 +880,9 @@ bool clear_video_buffer(unsigned char *data, size_t linesize, size_t pitch, size
                         memset(data, 0,sizeof(hw_vdpau_frame));
                         return true;
 #endif
+                case HW_VAAPI:
+                        memset(data, 0, sizeof(av_frame_wrapper));
+                        return true;
                 default:
                         return false;
         }
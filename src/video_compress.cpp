@@ -43,6 +43,7 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <algorithm>
 #include <cinttypes>
 #include <memory>
 #include <stdio.h>
@@ -52,8 +53,12 @@
 #include <vector>
 
 #include "compat/platform_time.h"
+#include "host.h"
 #include "messaging.h"
 #include "module.h"
+#include "tv.h"
+#include "utils/metrics.h"
+#include "utils/pipeline_stats.h"
 #include "utils/synchronized_queue.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
@@ -64,12 +69,29 @@
 #include "debug.h"
 
 static constexpr const char *MOD_NAME = "[vcompress] ";
+#define FRAMES_IN_FLIGHT_PARAM "compress-frames-in-flight"
+
+ADD_TO_PARAM(FRAMES_IN_FLIGHT_PARAM, "* " FRAMES_IN_FLIGHT_PARAM "=<n>\n"
+                "  Run a compression with synchronous API (eg. uyvy, dxt_glsl) as <n>\n"
+                "  independent instances with up to <n> frames compressed concurrently.\n"
+                "  Output order is kept, adds up to <n>-1 frames of latency.\n");
 
 using namespace std;
 
 struct compress_state;
 
 namespace {
+/// frame being compressed by the frames-in-flight adapter
+struct adapter_job {
+        unsigned slot;
+        uint64_t compress_start;
+        struct compress_state *proxy;
+        vector<struct module *> *states; ///< driver states of the slot
+        shared_ptr<video_frame> frame;   ///< uncompressed frame
+        shared_ptr<video_frame> ret;     ///< OUT - compressed frame, NULL if failed
+        task_result_handle_t handle;
+};
+
 /**
  * @brief This structure represents real internal compress state
  */
@@ -79,6 +101,7 @@ private:
         void          start(struct compress_state *proxy);
         void          async_consumer(struct compress_state *s);
         void          async_tile_consumer(struct compress_state *s);
+        void          adapter_consumer(struct compress_state *s);
         thread        asynch_consumer_thread;
 public:
         static compress_state_real *create(struct module *parent, const char *config_string,
@@ -92,6 +115,17 @@ public:
         vector<struct module *> state;                  ///< driver internal states
         string              compress_options; ///< compress options (for reconfiguration)
         volatile bool       discard_frames;   ///< this class is no longer active
+
+        /// @name frames-in-flight adapter for sync API (active if frames_in_flight > 1)
+        /// @{
+        unsigned            frames_in_flight = 1;
+        vector<vector<struct module *>> adapter_state; ///< states of slots 1..n-1, slot 0 uses state
+        synchronized_queue<unsigned, -1> adapter_free_slots;
+        synchronized_queue<struct adapter_job *, -1> adapter_jobs; ///< jobs in submission order, NULL is poison
+        vector<struct module *> &slot_states(unsigned slot) {
+                return slot == 0 ? state : adapter_state[slot - 1];
+        }
+        /// @}
 };
 }
 
@@ -106,10 +140,16 @@ struct compress_state {
         struct compress_state_real *ptr; ///< pointer to real compress state
         synchronized_queue<shared_ptr<video_frame>, 1> queue;
         bool poisoned = false;
+        struct metrics_counter *frames = metrics_counter_register("compress_frames", "Compressed frames", nullptr);
+        struct metrics_counter *bytes = metrics_counter_register("compress_bytes", "Compressed data size", nullptr);
+        struct metrics_histogram *duration = metrics_histogram_register("compress_duration", "Frame compression duration (ms resolution)", nullptr);
+        struct pipeline_stage *stage = nullptr;    ///< compression with sync API
+        struct pipeline_stage *tx_stage = nullptr; ///< consumer of the queue
 };
 
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy,
-                shared_ptr<video_frame> frame);
+                vector<struct module *> &states, shared_ptr<video_frame> frame);
+static void *adapter_compress_callback(void *arg);
 static void compress_done(struct module *mod);
 
 /// @brief Displays list of available compressions.
@@ -126,6 +166,8 @@ static void async_poison(struct compress_state_real *s){
                 for(size_t i = 0; i < s->state.size(); i++){
                         s->funcs->compress_tile_async_push_func(s->state[i], {}); // poison
                 }
+        } else if (s->frames_in_flight > 1) {
+                s->adapter_jobs.push(nullptr);
         }
 }
 
@@ -144,14 +186,18 @@ static void compress_process_message(struct compress_state *proxy, struct msg_ch
         /* In this case we are only changing some parameter of compression.
          * This means that we pass the parameter to compress driver. */
         if(data->what == CHANGE_PARAMS) {
-                for(unsigned int i = 0; i < proxy->ptr->state.size(); ++i) {
+                vector<struct module *> states = proxy->ptr->state;
+                for (auto &slot : proxy->ptr->adapter_state) {
+                        states.insert(states.end(), slot.begin(), slot.end());
+                }
+                for(unsigned int i = 0; i < states.size(); ++i) {
                         struct msg_change_compress_data *tmp_data =
                                 (struct msg_change_compress_data *)
                                 new_message(sizeof(struct msg_change_compress_data));
                         tmp_data->what = data->what;
                         strncpy(tmp_data->config_string, data->config_string,
                                         sizeof(tmp_data->config_string));
-                        struct response *resp = send_message_to_receiver(proxy->ptr->state[i],
+                        struct response *resp = send_message_to_receiver(states[i],
                                         (struct message *) tmp_data);
                         /// @todo
                         /// Handle responses more inteligently (eg. aggregate).
@@ -203,6 +249,8 @@ int compress_init(struct module *parent, const char *config_string, struct compr
         proxy->mod.cls = MODULE_CLASS_COMPRESS;
         proxy->mod.priv_data = proxy;
         proxy->mod.deleter = compress_done;
+        proxy->stage = pipeline_stage_get(parent, "compress");
+        proxy->tx_stage = pipeline_stage_get(parent, "tx");
 
         try {
                 proxy->ptr = compress_state_real::create(&proxy->mod, config_string, proxy);
@@ -267,6 +315,23 @@ compress_state_real::compress_state_real(struct module *parent, const char *conf
         } else {
                 throw -1;
         }
+
+        const char *in_flight = get_commandline_param(FRAMES_IN_FLIGHT_PARAM);
+        if (in_flight && (funcs->compress_frame_func || funcs->compress_tile_func)) {
+                frames_in_flight = max(atoi(in_flight), 1);
+                LOG(LOG_LEVEL_INFO) << MOD_NAME << "Running " << frames_in_flight << " instances of " << compress_name << " concurrently.\n";
+                for (unsigned i = 1; i < frames_in_flight; ++i) {
+                        struct module *slot_state = funcs->init_func(parent, compress_options.c_str());
+                        if (!slot_state) {
+                                LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Compression initialization failed: " << config_string << "\n";
+                                throw -1;
+                        }
+                        adapter_state.push_back({slot_state});
+                }
+                for (unsigned i = 0; i < frames_in_flight; ++i) {
+                        adapter_free_slots.push(i);
+                }
+        }
 }
 
 void compress_state_real::start(struct compress_state *proxy)
@@ -275,6 +340,8 @@ void compress_state_real::start(struct compress_state *proxy)
                 asynch_consumer_thread = thread(&compress_state_real::async_consumer, this, proxy);
         } else if (funcs->compress_tile_async_push_func){
                 asynch_consumer_thread = thread(&compress_state_real::async_tile_consumer, this, proxy);
+        } else if (frames_in_flight > 1) {
+                asynch_consumer_thread = thread(&compress_state_real::adapter_consumer, this, proxy);
         }
 }
 
@@ -297,19 +364,21 @@ const char *get_compress_name(struct compress_state *proxy)
  * If there are not enough states it initializes new ones. 
  *
  * @param         proxy         compress state
+ * @param[in,out] states        driver states to be checked (proxy->ptr->state or adapter slot states)
  * @param[in]     frame         uncompressed frame
  * @return                      false in case of failure
  */
-static bool check_state_count(unsigned tile_count, struct compress_state *proxy)
+static bool check_state_count(unsigned tile_count, struct compress_state *proxy,
+                vector<struct module *> &states)
 {
         struct compress_state_real *s = proxy->ptr;
 
-        if(tile_count != s->state.size()) {
-                size_t old_size = s->state.size();
-                s->state.resize(tile_count);
-                for (unsigned int i = old_size; i < s->state.size(); ++i) {
-                        s->state[i] = s->funcs->init_func(&proxy->mod, s->compress_options.c_str());
-                        if(!s->state[i]) {
+        if(tile_count != states.size()) {
+                size_t old_size = states.size();
+                states.resize(tile_count);
+                for (unsigned int i = old_size; i < states.size(); ++i) {
+                        states[i] = s->funcs->init_func(&proxy->mod, s->compress_options.c_str());
+                        if(!states[i]) {
                                 LOG(LOG_LEVEL_ERROR) << MOD_NAME << "Compression initialization failed\n";
                                 return false;
                         }
@@ -346,6 +415,10 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 
         if (!frame) {
                 proxy->poisoned = true;
+        } else if (!s->funcs->accepts_linesize && vf_is_strided(frame.get())) {
+                struct video_frame *packed = vf_get_copy(frame.get());
+                vf_copy_metadata(packed, frame.get());
+                frame = shared_ptr<video_frame>(packed, vf_free);
         }
 
         if (s->funcs->compress_frame_async_push_func) {
@@ -363,7 +436,7 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
 
                 frame->compress_start = t0;
 
-                if(!check_state_count(frame->tile_count, proxy)){
+                if(!check_state_count(frame->tile_count, proxy, s->state)){
                         return;
                 }
 
@@ -375,6 +448,21 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                         s->funcs->compress_tile_async_push_func(s->state[i], separate_tiles[i]);
                 }
 
+        } else if (s->frames_in_flight > 1) {
+                if (!frame) {
+                        async_poison(s);
+                        return;
+                }
+
+                unsigned slot = s->adapter_free_slots.pop(); // blocks if all slots are busy
+                auto &states = s->slot_states(slot);
+                if (!s->funcs->compress_frame_func && !check_state_count(frame->tile_count, proxy, states)) {
+                        s->adapter_free_slots.push(slot);
+                        return;
+                }
+                auto *job = new adapter_job{slot, t0, proxy, &states, std::move(frame), {}, {}};
+                job->handle = task_run_async(adapter_compress_callback, job);
+                s->adapter_jobs.push(job);
         } else {
                 if (!frame) { // pass poisoned pill
                         proxy->queue.push(shared_ptr<video_frame>());
@@ -382,13 +470,15 @@ void compress_frame(struct compress_state *proxy, shared_ptr<video_frame> frame)
                 }
 
                 shared_ptr<video_frame> sync_api_frame;
+                pipeline_stage_timer busy(proxy->stage);
                 if (s->funcs->compress_frame_func) {
                         sync_api_frame = s->funcs->compress_frame_func(s->state[0], frame);
                 } else if(s->funcs->compress_tile_func) {
-                        sync_api_frame = compress_frame_tiles(proxy, frame);
+                        sync_api_frame = compress_frame_tiles(proxy, s->state, frame);
                 } else {
                         assert(!"No egliable compress API found");
                 }
+                busy.done();
 
                 // empty return value here represents error, but we don't want to pass it to queue, since it would
                 // be interpreted as poisoned pill
@@ -436,15 +526,16 @@ static void *compress_tile_callback(void *arg) {
  * Compresses video frame with tiles API
  *
  * @param         proxy         compress state
+ * @param         states        driver states to be used (one per tile)
  * @param[in]     frame         uncompressed frame
  * @return                      compressed video frame, may be NULL if compression failed
  */
 static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy,
-                shared_ptr<video_frame> frame)
+                vector<struct module *> &states, shared_ptr<video_frame> frame)
 {
         struct compress_state_real *s = proxy->ptr;
 
-        if(!check_state_count(frame->tile_count, proxy)){
+        if(!check_state_count(frame->tile_count, proxy, states)){
                 return NULL;
         }
 
@@ -457,7 +548,7 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
         vector <compress_worker_data> data_tile(separate_tiles.size());
         for(unsigned int i = 0; i < separate_tiles.size(); ++i) {
                 struct compress_worker_data *data = &data_tile[i];
-                data->state = s->state[i];
+                data->state = states[i];
                 data->frame = separate_tiles[i];
                 data->callback = s->funcs->compress_tile_func;
 
@@ -488,6 +579,25 @@ static shared_ptr<video_frame> compress_frame_tiles(struct compress_state *proxy
  * @}
  */
 
+/**
+ * Compresses frame with sync API in a worker thread (frames-in-flight adapter).
+ * @param arg @ref adapter_job
+ */
+static void *adapter_compress_callback(void *arg) {
+        auto *job = (struct adapter_job *) arg;
+        struct compress_state_real *s = job->proxy->ptr;
+        pipeline_stage_timer busy(job->proxy->stage);
+
+        if (s->funcs->compress_frame_func) {
+                job->ret = s->funcs->compress_frame_func((*job->states)[0], job->frame);
+        } else {
+                job->ret = compress_frame_tiles(job->proxy, *job->states, job->frame);
+        }
+        job->frame = nullptr;
+
+        return job;
+}
+
 /**
  * @brief Video compression cleanup function.
  * @param mod video compress module
@@ -516,6 +626,11 @@ compress_state_real::~compress_state_real()
         for(unsigned int i = 0; i < state.size(); ++i) {
                 module_done(state[i]);
         }
+        for (auto &slot : adapter_state) {
+                for (auto *slot_state : slot) {
+                        module_done(slot_state);
+                }
+        }
 }
 
 namespace {
@@ -587,6 +702,33 @@ void compress_state_real::async_consumer(struct compress_state *s)
         }
 
 }
+
+/**
+ * Passes frames compressed by the frames-in-flight adapter to the output
+ * queue in the order they were submitted.
+ */
+void compress_state_real::adapter_consumer(struct compress_state *s)
+{
+        set_thread_name(__func__);
+        while (true) {
+                struct adapter_job *job = adapter_jobs.pop();
+                if (!job) {
+                        if (!discard_frames) {
+                                s->queue.push(nullptr); // poison
+                        }
+                        return;
+                }
+                wait_task(job->handle);
+                adapter_free_slots.push(job->slot);
+                // empty result represents error, not poisoned pill - do not pass it
+                if (job->ret && !discard_frames) {
+                        job->ret->compress_start = job->compress_start;
+                        job->ret->compress_end = time_since_epoch_in_ms();
+                        s->queue.push(job->ret);
+                }
+                delete job;
+        }
+}
 } // end of anonymous namespace
 
 /**
@@ -599,9 +741,15 @@ shared_ptr<video_frame> compress_pop(struct compress_state *proxy)
         if(!proxy)
                 return NULL;
 
+        pipeline_stage_queue(proxy->tx_stage, proxy->queue.size(), 1);
         auto f = proxy->queue.pop();
         if (f) {
                 log_msg(LOG_LEVEL_DEBUG, "Compressed frame size: %8u; duration: %3" PRIu64 " ms\n", vf_get_data_len(f.get()), f->compress_end - f->compress_start);
+                metrics_counter_add(proxy->frames, 1);
+                metrics_counter_add(proxy->bytes, vf_get_data_len(f.get()));
+                if (f->compress_start != 0 && f->compress_end >= f->compress_start) {
+                        metrics_histogram_record(proxy->duration, (f->compress_end - f->compress_start) * NS_IN_MS);
+                }
         }
         return f;
 }
@@ -68,7 +68,7 @@
 
 #include "types.h"
 
-#define VIDEO_COMPRESS_ABI_VERSION 9
+#define VIDEO_COMPRESS_ABI_VERSION 10
 
 #ifdef __cplusplus
 extern "C" {
@@ -224,6 +224,10 @@ struct video_compress_info {
         compress_tile_async_pop_t compress_tile_async_pop_func; ///< Async tile API
 
         compress_module_info (*get_module_info)();
+
+        /// module honors tile::linesize of the input, otherwise strided frames
+        /// are packed by compress_frame()
+        bool accepts_linesize;
 };
 
 #endif // __cplusplus
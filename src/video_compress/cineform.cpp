@@ -58,18 +58,19 @@
 
 #include "video.h"
 #include "video_codec.h"
+#include <algorithm>
 #include <memory>
 #include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
-#include <queue>
 #include <condition_variable>
 
 #ifdef MEASUREMENT
 #include <time.h>
 #endif
-#include "utils/misc.h" // to_fourcc
+#include "utils/misc.h" // to_fourcc, get_cpu_core_count
+#include "utils/worker.h"
 
 #define DEFAULT_POOL_SIZE 16
 #define DEFAULT_THREAD_COUNT 8
@@ -96,7 +97,10 @@ struct state_video_compress_cineform{
         uint32_t frame_seq_in;
         uint32_t frame_seq_out;
 
-        std::queue<std::unique_ptr<video_frame, decltype(&vf_free)>> frame_queue;
+        /// source frames (metadata) of the samples being encoded indexed by sequence number
+        std::map<uint32_t, std::unique_ptr<video_frame, decltype(&vf_free)>> frame_queue;
+        /// samples returned by the pool ahead of frame_seq_out
+        std::map<uint32_t, CFHD_SampleBufferRef> reorder_buf;
 
         bool started;
         bool stop;
@@ -113,6 +117,9 @@ static void cineform_compress_done(struct module *mod){
         s->mutex.lock();
 
         CFHD_StopEncoderPool(s->encoderPoolRef);
+        for (auto &sample : s->reorder_buf) {
+                CFHD_ReleaseSampleBuffer(s->encoderPoolRef, sample.second);
+        }
         CFHD_ReleaseEncoderPool(s->encoderPoolRef);
         CFHD_MetadataClose(s->metadataRef);
 
@@ -193,7 +200,7 @@ static struct module * cineform_compress_init(struct module *parent, const char
                 return ret > 0 ? static_cast<module*>(INIT_NOERR) : nullptr;
         }
 
-        log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d.\n", s->requested_threads);
+        log_msg(LOG_LEVEL_NOTICE, "[cineform] : Threads: %d, pool size: %d.\n", s->requested_threads, s->requested_pool_size);
         CFHD_Error status = CFHD_ERROR_OKAY;
         status = CFHD_CreateEncoderPool(&s->encoderPoolRef,
                         s->requested_threads,
@@ -334,17 +341,21 @@ static bool configure_with(struct state_video_compress_cineform *s, struct video
 static video_frame *get_copy(struct state_video_compress_cineform *s, video_frame *frame){
         video_frame *ret = vf_alloc_desc_data(s->precompress_desc);
         vf_copy_metadata(ret, frame); // seq and compress_start
-        int src_linesize = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
-        int dst_linesize = vc_get_linesize(frame->tiles[0].width, ret->color_spec);
+        const size_t src_linesize = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
+        const int dst_linesize = vc_get_linesize(frame->tiles[0].width, ret->color_spec);
+        const int height = frame->tiles[0].height;
+        const bool upside_down = s->precompress_desc.color_spec == RGB;
+        const auto *src = (unsigned char *) frame->tiles[0].data;
         auto *dst = (unsigned char *) ret->tiles[0].data;
-        int dst_sign = 1;
-        if (s->precompress_desc.color_spec == RGB) { // upside down
-                dst += static_cast<size_t>(dst_linesize) * frame->tiles[0].height - 1;
-                dst_sign = -1;
-        }
-        for (unsigned i = 0; i < frame->tiles[0].height; ++i) {
-                s->dec(dst + dst_sign * i * dst_linesize, (unsigned char *) frame->tiles[0].data + i * src_linesize, dst_linesize, 16, 8, 0);
-        }
+        const decoder_t dec = s->dec;
+        // the conversion of 4K 4:4:4 doesn't fit into the frame time on a single core
+        const int cpus = get_cpu_core_count();
+        parallel_for(height, std::max(1, height / (4 * cpus)), cpus, [&](int begin, int end) {
+                for (int i = begin; i < end; ++i) {
+                        size_t dst_row = upside_down ? height - 1 - i : i;
+                        dec(dst + dst_row * dst_linesize, src + i * src_linesize, dst_linesize, 16, 8, 0);
+                }
+        });
 
         return ret;
 }
@@ -369,7 +380,7 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
 
                 lock.lock();
                 s->stop = true;
-                s->frame_queue.push(std::move(dummy));
+                s->frame_queue.emplace(s->frame_seq_in, std::move(dummy));
                 lock.unlock();
 
                 status = CFHD_EncodeAsyncSample(s->encoderPoolRef,
@@ -399,7 +410,7 @@ static void cineform_compress_push(struct module *state, std::shared_ptr<video_f
         video_frame *frame_ptr = frame_copy.get();
 
         lock.lock();
-        s->frame_queue.push(std::move(frame_copy));
+        s->frame_queue.emplace(s->frame_seq_in, std::move(frame_copy));
 
 #ifdef MEASUREMENT
         struct timespec t_0;
@@ -457,12 +468,29 @@ static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
 
         lock.unlock();
 
+        /* Frames are encoded concurrently by the pool encoders, so the samples
+         * may be completed out of order - keep the early ones until the
+         * expected one arrives. Only this thread touches reorder_buf. */
         CFHD_Error status = CFHD_ERROR_OKAY;
-        uint32_t frame_num;
+        uint32_t frame_num = s->frame_seq_out;
         CFHD_SampleBufferRef buf;
-        status = CFHD_WaitForSample(s->encoderPoolRef,
-                        &frame_num,
-                        &buf);
+        auto ready = s->reorder_buf.find(s->frame_seq_out);
+        while (ready == s->reorder_buf.end()) {
+                status = CFHD_WaitForSample(s->encoderPoolRef,
+                                &frame_num,
+                                &buf);
+                if (status != CFHD_ERROR_OKAY || frame_num == s->frame_seq_out) {
+                        break;
+                }
+                log_msg(LOG_LEVEL_DEBUG, "[cineform] Sample %u completed before %u.\n", frame_num, s->frame_seq_out);
+                s->reorder_buf.emplace(frame_num, buf);
+                ready = s->reorder_buf.find(s->frame_seq_out);
+        }
+        if (ready != s->reorder_buf.end()) {
+                frame_num = ready->first;
+                buf = ready->second;
+                s->reorder_buf.erase(ready);
+        }
 #if MEASUREMENT
         struct timespec t_0, t_1, t_res;
         clock_gettime(CLOCK_MONOTONIC_RAW, &t_1);
@@ -476,6 +504,7 @@ static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to wait for sample %d\n", status);
                 return {};
         }
+        s->frame_seq_out = frame_num + 1;
 
         static auto dispose = [](struct video_frame *frame) {
                 std::tuple<CFHD_EncoderPoolRef, CFHD_SampleBufferRef> *t = 
@@ -499,13 +528,13 @@ static std::shared_ptr<video_frame> cineform_compress_pop(struct module *state)
         out->seq = frame_num;
 
         lock.lock();
-        if(s->frame_queue.empty()){
+        auto src = s->frame_queue.find(frame_num);
+        if(src == s->frame_queue.end()){
                 log_msg(LOG_LEVEL_ERROR, "[cineform] Failed to pop\n");
         } else {
-                auto &src = s->frame_queue.front();
-                vf_copy_metadata(out.get(), src.get());
+                vf_copy_metadata(out.get(), src->second.get());
+                s->frame_queue.erase(src);
         }
-        s->frame_queue.pop();
 
         out->compress_end = time_since_epoch_in_ms();
 
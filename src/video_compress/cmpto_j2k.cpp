@@ -56,13 +56,16 @@
 #include "module.h"
 #include "utils/color_out.h"
 #include "utils/misc.h"
+#include "utils/parallel_conv.h"
 #include "utils/video_frame_pool.h"
 #include "video_compress.h"
 #include "video.h"
 
 #include <cmpto_j2k_enc.h>
 
+#include <algorithm>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <queue>
 #include <utility>
@@ -86,6 +89,8 @@ constexpr const char *MOD_NAME = "[Cmpto J2K enc.] ";
 /// number of frames that encoder encodes at moment
 #define DEFAULT_TILE_LIMIT 1
 #define DEFAULT_MEM_LIMIT 1000000000LLU
+/// number of recently passed input buffers remembered (see use_directly())
+#define MAX_SEEN_BUFFERS 32
 
 using namespace std;
 
@@ -107,6 +112,8 @@ struct state_video_compress_j2k {
         video_desc precompress_desc{};
         video_desc compressed_desc{};
         void (*convertFunc)(video_frame *dst, video_frame *src){nullptr};
+        deque<const void *> seen_buffers; ///< recently passed input buffers (already registered by CUDA)
+        unsigned long long zero_copy_frames{};
 };
 
 static void j2k_compressed_frame_dispose(struct video_frame *frame);
@@ -116,15 +123,9 @@ static void R12L_to_RG48(video_frame *dst, video_frame *src){
         int src_pitch = vc_get_linesize(src->tiles[0].width, src->color_spec);
         int dst_pitch = vc_get_linesize(dst->tiles[0].width, dst->color_spec);
 
-        unsigned char *s = (unsigned char *) src->tiles[0].data;
-        unsigned char *d = (unsigned char *) dst->tiles[0].data;
-        decoder_t vc_copylineR12LtoRG48 = get_decoder_from_to(R12L, RG48);
-
-        for(unsigned i = 0; i < src->tiles[0].height; i++){
-                vc_copylineR12LtoRG48(d, s, dst_pitch, 0, 0, 0);
-                s += src_pitch;
-                d += dst_pitch;
-        }
+        parallel_pix_conv(src->tiles[0].height, dst->tiles[0].data, dst_pitch,
+                        src->tiles[0].data, src_pitch, get_decoder_from_to(R12L, RG48),
+                        get_cpu_core_count());
 }
 
 static struct {
@@ -192,6 +193,34 @@ static bool configure_with(struct state_video_compress_j2k *s, struct video_desc
         return true;
 }
 
+/**
+ * Decides whether the captured frame can be passed to the encoder directly
+ * (it is then held until the encoder releases it):
+ * - no conversion is needed
+ * - capture has own frame pool (dispose callback) so that holding the frame
+ *   doesn't block it - a single buffer captures are decoupled by the copy
+ * - the buffer was already seen - CUDA registers each new buffer, which is
+ *   slow, so zero-copy pays off only for captures recycling their buffers
+ *   (the first use of each buffer is copied)
+ */
+static bool use_directly(struct state_video_compress_j2k *s, video_frame *frame){
+        if (s->convertFunc != nullptr || frame->callbacks.dispose == nullptr
+                        || frame->tiles[0].data_len != vc_get_datalen(s->precompress_desc.width,
+                                s->precompress_desc.height, s->precompress_desc.color_spec)) {
+                return false;
+        }
+        const void *buf = frame->tiles[0].data;
+        auto it = find(s->seen_buffers.begin(), s->seen_buffers.end(), buf);
+        if (it != s->seen_buffers.end()) {
+                return true;
+        }
+        s->seen_buffers.push_back(buf);
+        if (s->seen_buffers.size() > MAX_SEEN_BUFFERS) {
+                s->seen_buffers.pop_front();
+        }
+        return false;
+}
+
 static shared_ptr<video_frame> get_copy(struct state_video_compress_j2k *s, video_frame *frame){
         std::shared_ptr<video_frame> ret = s->pool.get_frame();
 
@@ -430,6 +459,7 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
                 }
                 s->pool.reconfigure(s->precompress_desc, vc_get_linesize(s->precompress_desc.width, s->precompress_desc.color_spec)
                                 * s->precompress_desc.height);
+                s->seen_buffers.clear();
         }
 
         assert(tx->tile_count == 1); // TODO
@@ -452,7 +482,14 @@ static void j2k_compress_push(struct module *state, std::shared_ptr<video_frame>
         memcpy(udata, &s->compressed_desc, sizeof(s->compressed_desc));
 
         ref = (shared_ptr<video_frame> *)(void *)((char *) udata + sizeof(struct video_desc));
-        new (ref) shared_ptr<video_frame>(get_copy(s, tx.get()));
+        if (use_directly(s, tx.get())) {
+                if (s->zero_copy_frames++ == 0) {
+                        log_msg(LOG_LEVEL_VERBOSE, "%sPassing captured frames to the encoder without a copy.\n", MOD_NAME);
+                }
+                new (ref) shared_ptr<video_frame>(tx);
+        } else {
+                new (ref) shared_ptr<video_frame>(get_copy(s, tx.get()));
+        }
 
         CHECK_OK(cmpto_j2k_enc_img_set_samples(img, ref->get()->tiles[0].data, ref->get()->tiles[0].data_len, release_cstream),
                         "Setting image samples", HANDLE_ERROR_COMPRESS_PUSH);
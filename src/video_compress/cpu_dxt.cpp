@@ -0,0 +1,602 @@
+/**
+ * @file   video_compress/cpu_dxt.cpp
+ * @brief  DXT1, DXT1_YUV and DXT5 YCoCg compression running on the CPU
+ *
+ * Implements the same algorithm as the RTDXT GLSL shaders (van Waveren's
+ * real-time DXT/YCoCg-DXT compression), so the output is decodable by all
+ * DXT consumers (GL display, RTDXT and GPUJPEG-to-DXT decompressors).
+ *
+ * Blocks are encoded in batches of BATCH blocks stored as structure of
+ * arrays, so that the per-block arithmetic is vectorized by the compiler
+ * across the blocks of the batch. The encoder is compiled for the baseline
+ * target (SSE4.1 or NEON) and additionally for AVX2, selected in runtime.
+ * Rows of blocks are distributed among the worker pool.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "module.h"
+#include "utils/misc.h"
+#include "utils/simd_lanes.h"
+#include "utils/video_frame_pool.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_compress.h"
+
+#define MOD_NAME "[CPU DXT] "
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+using namespace std;
+
+namespace {
+
+constexpr int BATCH = 16; ///< number of blocks encoded together
+
+/// 4x4 pixel blocks, px[channel][pixel][block]
+struct block_batch {
+        uint8_t px[3][16][BATCH];
+};
+
+enum dxt_in_conv {
+        IN_RGB,       ///< RGB input encoded as RGB
+        IN_YUV,       ///< UYVY input encoded as YCbCr (DXT1_YUV)
+        IN_YUV_TO_RGB ///< UYVY input converted to RGB
+};
+
+static ALWAYS_INLINE int clamp255(int x) {
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+/**
+ * Converts a line to planar 8-bit 4:4:4 (RGB or YCbCr), pixels past width
+ * (up to padded_width) replicate the last one.
+ */
+static ALWAYS_INLINE void line_to_planar(const uint8_t *src, int width, int padded_width,
+                enum dxt_in_conv conv, bool ycocg, uint8_t *planes[3])
+{
+        uint8_t *p0 = planes[0];
+        uint8_t *p1 = planes[1];
+        uint8_t *p2 = planes[2];
+        if (conv == IN_RGB) {
+                for (int x = 0; x < width; ++x) {
+                        p0[x] = src[3 * x];
+                        p1[x] = src[3 * x + 1];
+                        p2[x] = src[3 * x + 2];
+                }
+        } else {
+                for (int x = 0; x < width; ++x) {
+                        int u = src[(x / 2) * 4];
+                        int y = src[(x / 2) * 4 + 1 + 2 * (x % 2)];
+                        int v = src[(x / 2) * 4 + 2];
+                        if (conv == IN_YUV) {
+                                p0[x] = y;
+                                p1[x] = u;
+                                p2[x] = v;
+                                continue;
+                        }
+                        // BT.709 limited range, same coefficients as the RTDXT shaders
+                        int yy = 1192 * (y - 16);
+                        u -= 128;
+                        v -= 128;
+                        p0[x] = clamp255((yy + 1836 * v + 512) >> 10);
+                        p1[x] = clamp255((yy - 218 * u - 546 * v + 512) >> 10);
+                        p2[x] = clamp255((yy + 2163 * u + 512) >> 10);
+                }
+        }
+        if (ycocg) {
+                for (int x = 0; x < width; ++x) {
+                        int r = p0[x];
+                        int g = p1[x];
+                        int b = p2[x];
+                        p0[x] = (r + 2 * g + b + 2) >> 2;
+                        p1[x] = (r - b + 256) >> 1;
+                        p2[x] = (2 * g - r - b + 512) >> 2;
+                }
+        }
+        for (int x = width; x < padded_width; ++x) {
+                p0[x] = p0[width - 1];
+                p1[x] = p1[width - 1];
+                p2[x] = p2[width - 1];
+        }
+}
+
+/// gathers BATCH blocks starting at block column bx from 4 planar lines
+static ALWAYS_INLINE void gather_batch(uint8_t *const planes[4][3], int bx, struct block_batch *b)
+{
+        for (int c = 0; c < 3; ++c) {
+                for (int y = 0; y < 4; ++y) {
+                        const uint8_t *line = planes[y][c] + bx * 4;
+                        for (int x = 0; x < 4; ++x) {
+                                for (int j = 0; j < BATCH; ++j) {
+                                        b->px[c][y * 4 + x][j] = line[j * 4 + x];
+                                }
+                        }
+                }
+        }
+}
+
+/**
+ * Computes 2-bit indices to a 4-entry palette, pal[entry][channel][block].
+ * Uses the branchless selection from the RTDXT shaders.
+ */
+template<int CHANNELS>
+static ALWAYS_INLINE void emit_color_indices(const struct block_batch *b, int first_channel,
+                const int pal[4][CHANNELS][BATCH], uint32_t *indices)
+{
+        for (int j = 0; j < BATCH; ++j) {
+                indices[j] = 0;
+        }
+        for (int i = 0; i < 16; ++i) {
+                for (int j = 0; j < BATCH; ++j) {
+                        int dist[4];
+                        for (int k = 0; k < 4; ++k) {
+                                dist[k] = 0;
+                                for (int c = 0; c < CHANNELS; ++c) {
+                                        int d = b->px[first_channel + c][i][j] - pal[k][c][j];
+                                        dist[k] += d * d;
+                                }
+                        }
+                        uint32_t b0 = dist[0] > dist[3];
+                        uint32_t b1 = dist[1] > dist[2];
+                        uint32_t b2 = dist[0] > dist[2];
+                        uint32_t b3 = dist[1] > dist[3];
+                        uint32_t b4 = dist[2] > dist[3];
+                        uint32_t index = (b0 & b4) | (((b1 & b2) | (b0 & b3)) << 1U);
+                        indices[j] |= index << (2U * i);
+                }
+        }
+}
+
+static ALWAYS_INLINE void store_u16(uint8_t *out, uint32_t val) {
+        out[0] = val & 0xFFU;
+        out[1] = (val >> 8U) & 0xFFU;
+}
+
+static ALWAYS_INLINE void store_u32(uint8_t *out, uint32_t val) {
+        store_u16(out, val);
+        store_u16(out + 2, val >> 16U);
+}
+
+/// encodes BATCH blocks to DXT1 (8 B per block), first n blocks are stored
+static ALWAYS_INLINE void encode_dxt1_batch(const struct block_batch *b, int n, uint8_t *out)
+{
+        int mn[3][BATCH];
+        int mx[3][BATCH];
+        for (int c = 0; c < 3; ++c) {
+                for (int j = 0; j < BATCH; ++j) {
+                        mn[c][j] = mx[c][j] = b->px[c][0][j];
+                }
+                for (int i = 1; i < 16; ++i) {
+                        for (int j = 0; j < BATCH; ++j) {
+                                mn[c][j] = min<int>(mn[c][j], b->px[c][i][j]);
+                                mx[c][j] = max<int>(mx[c][j], b->px[c][i][j]);
+                        }
+                }
+        }
+
+        // select diagonal of the bounding box according to covariance with the 3rd channel
+        int cov0[BATCH] = {};
+        int cov1[BATCH] = {};
+        for (int i = 0; i < 16; ++i) {
+                for (int j = 0; j < BATCH; ++j) {
+                        int t0 = 2 * b->px[0][i][j] - mn[0][j] - mx[0][j];
+                        int t1 = 2 * b->px[1][i][j] - mn[1][j] - mx[1][j];
+                        int t2 = 2 * b->px[2][i][j] - mn[2][j] - mx[2][j];
+                        cov0[j] += t0 * t2;
+                        cov1[j] += t1 * t2;
+                }
+        }
+        for (int j = 0; j < BATCH; ++j) {
+                int lo0 = cov0[j] < 0 ? mx[0][j] : mn[0][j];
+                int hi0 = cov0[j] < 0 ? mn[0][j] : mx[0][j];
+                int lo1 = cov1[j] < 0 ? mx[1][j] : mn[1][j];
+                int hi1 = cov1[j] < 0 ? mn[1][j] : mx[1][j];
+                mn[0][j] = lo0;
+                mx[0][j] = hi0;
+                mn[1][j] = lo1;
+                mx[1][j] = hi1;
+        }
+
+        // inset the bounding box and quantize to RGB565
+        int pal[4][3][BATCH];
+        uint32_t endpoints[BATCH];
+        for (int j = 0; j < BATCH; ++j) {
+                int e[2][3];
+                uint32_t c565[2];
+                for (int c = 0; c < 3; ++c) {
+                        int inset = (mx[c][j] - mn[c][j]) / 16;
+                        e[0][c] = clamp255(mx[c][j] - inset);
+                        e[1][c] = clamp255(mn[c][j] + inset);
+                }
+                for (int k = 0; k < 2; ++k) {
+                        int r = e[k][0] >> 3;
+                        int g = e[k][1] >> 2;
+                        int bb = e[k][2] >> 3;
+                        c565[k] = (r << 11U) | (g << 5U) | bb;
+                        e[k][0] = (r << 3U) | (r >> 2U);
+                        e[k][1] = (g << 2U) | (g >> 4U);
+                        e[k][2] = (bb << 3U) | (bb >> 2U);
+                }
+                // color0 > color1 selects the 4-color mode
+                bool swap = c565[0] < c565[1];
+                endpoints[j] = swap ? c565[1] | c565[0] << 16U : c565[0] | c565[1] << 16U;
+                for (int c = 0; c < 3; ++c) {
+                        int c0 = swap ? e[1][c] : e[0][c];
+                        int c1 = swap ? e[0][c] : e[1][c];
+                        pal[0][c][j] = c0;
+                        pal[1][c][j] = c1;
+                        pal[2][c][j] = (2 * c0 + c1) / 3;
+                        pal[3][c][j] = (c0 + 2 * c1) / 3;
+                }
+        }
+
+        uint32_t indices[BATCH];
+        emit_color_indices<3>(b, 0, pal, indices);
+
+        for (int j = 0; j < n; ++j) {
+                store_u32(out + 8 * j, endpoints[j]);
+                store_u32(out + 8 * j + 4, indices[j]);
+        }
+}
+
+/// encodes BATCH blocks of YCoCg pixels to DXT5 YCoCg (16 B per block), first n blocks are stored
+static ALWAYS_INLINE void encode_dxt5ycocg_batch(const struct block_batch *b, int n, uint8_t *out)
+{
+        int mn[3][BATCH];
+        int mx[3][BATCH];
+        for (int c = 0; c < 3; ++c) {
+                for (int j = 0; j < BATCH; ++j) {
+                        mn[c][j] = mx[c][j] = b->px[c][0][j];
+                }
+                for (int i = 1; i < 16; ++i) {
+                        for (int j = 0; j < BATCH; ++j) {
+                                mn[c][j] = min<int>(mn[c][j], b->px[c][i][j]);
+                                mx[c][j] = max<int>(mx[c][j], b->px[c][i][j]);
+                        }
+                }
+        }
+
+        // CoCg diagonal
+        int cov[BATCH] = {};
+        for (int i = 0; i < 16; ++i) {
+                for (int j = 0; j < BATCH; ++j) {
+                        int t1 = 2 * b->px[1][i][j] - mn[1][j] - mx[1][j];
+                        int t2 = 2 * b->px[2][i][j] - mn[2][j] - mx[2][j];
+                        cov[j] += t1 * t2;
+                }
+        }
+
+        int pal[4][2][BATCH];
+        uint32_t endpoints[BATCH];
+        for (int j = 0; j < BATCH; ++j) {
+                int lo2 = cov[j] < 0 ? mx[2][j] : mn[2][j];
+                int hi2 = cov[j] < 0 ? mn[2][j] : mx[2][j];
+                mn[2][j] = lo2;
+                mx[2][j] = hi2;
+
+                int m = max(max(abs(mn[1][j] - 128), abs(mn[2][j] - 128)),
+                                max(abs(mx[1][j] - 128), abs(mx[2][j] - 128)));
+                int shift = m < 32 ? 2 : m < 64 ? 1 : 0;
+                int scale = 1 << shift;
+
+                int e[2][2];
+                uint32_t c565[2];
+                for (int c = 0; c < 2; ++c) {
+                        int hi = (mx[c + 1][j] - 128) * scale + 128;
+                        int lo = (mn[c + 1][j] - 128) * scale + 128;
+                        int inset = (hi - lo) / 16;
+                        e[0][c] = clamp255(hi - inset);
+                        e[1][c] = clamp255(lo + inset);
+                }
+                for (int k = 0; k < 2; ++k) {
+                        int co = e[k][0] >> 3;
+                        int cg = e[k][1] >> 2;
+                        c565[k] = (co << 11U) | (cg << 5U) | (scale - 1);
+                        // expand and undo the scale
+                        e[k][0] = ((((co << 3U) | (co >> 2U)) - 128) >> shift) + 128;
+                        e[k][1] = ((((cg << 2U) | (cg >> 4U)) - 128) >> shift) + 128;
+                }
+                endpoints[j] = c565[0] | c565[1] << 16U;
+                for (int c = 0; c < 2; ++c) {
+                        pal[0][c][j] = e[0][c];
+                        pal[1][c][j] = e[1][c];
+                        pal[2][c][j] = (2 * e[0][c] + e[1][c]) / 3;
+                        pal[3][c][j] = (e[0][c] + 2 * e[1][c]) / 3;
+                }
+        }
+
+        uint32_t indices[BATCH];
+        emit_color_indices<2>(b, 1, pal, indices);
+
+        // Y in the alpha block
+        int ab[7][BATCH];
+        for (int j = 0; j < BATCH; ++j) {
+                int inset = (mx[0][j] - mn[0][j]) / 32;
+                int hi = mx[0][j] - inset;
+                int lo = mn[0][j] + inset;
+                mx[0][j] = hi;
+                mn[0][j] = lo;
+                int mid = (hi - lo) / 14;
+                ab[0][j] = lo + mid;
+                for (int k = 1; k < 7; ++k) {
+                        ab[k][j] = ((7 - k) * hi + k * lo) / 7 + mid;
+                }
+        }
+        uint64_t alpha_indices[BATCH] = {};
+        for (int i = 0; i < 16; ++i) {
+                for (int j = 0; j < BATCH; ++j) {
+                        int a = b->px[0][i][j];
+                        uint32_t index = 1;
+                        for (int k = 0; k < 7; ++k) {
+                                index += a <= ab[k][j];
+                        }
+                        index &= 7U;
+                        index ^= 2U > index;
+                        alpha_indices[j] |= (uint64_t) index << (3U * i);
+                }
+        }
+
+        for (int j = 0; j < n; ++j) {
+                uint8_t *o = out + 16 * j;
+                o[0] = mx[0][j];
+                o[1] = mn[0][j];
+                for (int k = 0; k < 6; ++k) {
+                        o[2 + k] = (alpha_indices[j] >> (8U * k)) & 0xFFU;
+                }
+                store_u32(o + 8, endpoints[j]);
+                store_u32(o + 12, indices[j]);
+        }
+}
+
+struct encode_rows_data {
+        const uint8_t *src;
+        int src_linesize;
+        int width;
+        int height;
+        enum dxt_in_conv conv;
+        bool dxt5;
+        uint8_t *out;
+};
+
+/// encodes rows of blocks [begin, end)
+static ALWAYS_INLINE void encode_rows(const struct encode_rows_data *d, int begin, int end)
+{
+        const int blocks_x = (d->width + 3) / 4;
+        const int padded_width = (blocks_x + BATCH - 1) / BATCH * BATCH * 4;
+        const int block_size = d->dxt5 ? 16 : 8;
+        vector<uint8_t> buf(4 * 3 * padded_width);
+        uint8_t *planes[4][3];
+        for (int y = 0; y < 4; ++y) {
+                for (int c = 0; c < 3; ++c) {
+                        planes[y][c] = buf.data() + (y * 3 + c) * padded_width;
+                }
+        }
+        struct block_batch batch;
+
+        for (int by = begin; by < end; ++by) {
+                for (int y = 0; y < 4; ++y) {
+                        int sy = min(by * 4 + y, d->height - 1);
+                        line_to_planar(d->src + (size_t) sy * d->src_linesize, d->width, padded_width,
+                                        d->conv, d->dxt5, planes[y]);
+                }
+                uint8_t *out = d->out + (size_t) by * blocks_x * block_size;
+                for (int bx = 0; bx < blocks_x; bx += BATCH) {
+                        gather_batch(planes, bx, &batch);
+                        int n = min(BATCH, blocks_x - bx);
+                        if (d->dxt5) {
+                                encode_dxt5ycocg_batch(&batch, n, out + bx * block_size);
+                        } else {
+                                encode_dxt1_batch(&batch, n, out + bx * block_size);
+                        }
+                }
+        }
+}
+
+static void encode_rows_generic(void *arg, int begin, int end)
+{
+        encode_rows((const struct encode_rows_data *) arg, begin, end);
+}
+
+#ifdef PIXFMT_SIMD_X86
+__attribute__((target("avx2")))
+static void encode_rows_avx2(void *arg, int begin, int end)
+{
+        encode_rows((const struct encode_rows_data *) arg, begin, end);
+}
+#endif
+
+struct state_video_compress_cpu_dxt {
+        struct module       module_data;
+        struct video_desc   saved_desc;
+        codec_t             out_codec;
+        codec_t             in_codec;
+        decoder_t           decoder;
+        unique_ptr<uint8_t []> decoded;
+        range_task_t        encode_rows_func;
+
+        video_frame_pool pool;
+};
+
+static void cpu_dxt_compress_done(struct module *mod);
+
+struct module *cpu_dxt_compress_init(struct module *parent, const char *fmt)
+{
+        if (strcmp(fmt, "help") == 0) {
+                printf("CPU DXT compression usage:\n");
+                printf("\t-c cpu_dxt[:DXT1|:DXT1_YUV|:DXT5]\n");
+                printf("\t\tcompress with DXT1 (default), DXT1_YUV or DXT5 YCoCg\n");
+                return static_cast<module*>(INIT_NOERR);
+        }
+
+        auto *s = new state_video_compress_cpu_dxt();
+        s->out_codec = DXT1;
+        if (strcasecmp(fmt, "DXT5") == 0) {
+                s->out_codec = DXT5;
+        } else if (strcasecmp(fmt, "DXT1_YUV") == 0) {
+                s->out_codec = DXT1_YUV;
+        } else if (fmt[0] != '\0' && strcasecmp(fmt, "DXT1") != 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown compression: %s\n", fmt);
+                delete s;
+                return NULL;
+        }
+
+        s->encode_rows_func = encode_rows_generic;
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                s->encode_rows_func = encode_rows_avx2;
+        }
+#endif
+
+        module_init_default(&s->module_data);
+        s->module_data.cls = MODULE_CLASS_DATA;
+        s->module_data.priv_data = s;
+        s->module_data.deleter = cpu_dxt_compress_done;
+        module_register(&s->module_data, parent);
+
+        return &s->module_data;
+}
+
+static bool configure_with(struct state_video_compress_cpu_dxt *s, struct video_desc desc)
+{
+        if (get_bits_per_component(desc.color_spec) > 8) {
+                LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Converting from " << get_bits_per_component(desc.color_spec) <<
+                        " to 8 bits. You may directly capture 8-bit signal to improve performance.\n";
+        }
+
+        codec_t yuv_codecs[] = { UYVY, VIDEO_CODEC_NONE };
+        codec_t rgb_first[] = { RGB, UYVY, VIDEO_CODEC_NONE };
+        codec_t yuv_first[] = { UYVY, RGB, VIDEO_CODEC_NONE };
+        const codec_t *supported_codecs = s->out_codec == DXT1_YUV ? yuv_codecs
+                : codec_is_a_rgb(desc.color_spec) ? rgb_first : yuv_first;
+        s->decoder = get_best_decoder_from(desc.color_spec, supported_codecs, &s->in_codec);
+        if (!s->decoder) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n", get_codec_name(desc.color_spec));
+                return false;
+        }
+        if (s->decoder != vc_memcpy) {
+                s->decoded = unique_ptr<uint8_t []>(new uint8_t[vc_get_linesize(desc.width, s->in_codec) * desc.height]);
+        }
+
+        struct video_desc compressed_desc = desc;
+        compressed_desc.color_spec = s->out_codec;
+        compressed_desc.tile_count = 1;
+        size_t data_len = (size_t) (desc.width + 3) / 4 * 4 * ((desc.height + 3) / 4 * 4) / (s->out_codec == DXT5 ? 1 : 2);
+        s->pool.reconfigure(compressed_desc, data_len);
+
+        return true;
+}
+
+shared_ptr<video_frame> cpu_dxt_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto *s = (struct state_video_compress_cpu_dxt *) mod->priv_data;
+
+        if (!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
+                                s->saved_desc, PARAM_TILE_COUNT)) {
+                if (configure_with(s, video_desc_from_frame(tx.get()))) {
+                        s->saved_desc = video_desc_from_frame(tx.get());
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Reconfiguration failed!\n");
+                        return NULL;
+                }
+        }
+
+        struct tile *in_tile = &tx->tiles[0];
+        const uint8_t *in_buffer = (uint8_t *) in_tile->data;
+        const int in_linesize = vc_get_linesize(in_tile->width, s->in_codec);
+        if (s->decoder != vc_memcpy) {
+                unsigned char *line1 = (unsigned char *) in_tile->data;
+                unsigned char *line2 = s->decoded.get();
+
+                for (int i = 0; i < (int) in_tile->height; ++i) {
+                        s->decoder(line2, line1, in_linesize, 0, 8, 16);
+                        line1 += vc_get_linesize(in_tile->width, tx->color_spec);
+                        line2 += in_linesize;
+                }
+                in_buffer = s->decoded.get();
+        }
+
+        shared_ptr<video_frame> out = s->pool.get_frame();
+
+        struct encode_rows_data d{};
+        d.src = in_buffer;
+        d.src_linesize = in_linesize;
+        d.width = in_tile->width;
+        d.height = in_tile->height;
+        d.conv = s->in_codec == RGB ? IN_RGB : s->out_codec == DXT1_YUV ? IN_YUV : IN_YUV_TO_RGB;
+        d.dxt5 = s->out_codec == DXT5;
+        d.out = (uint8_t *) out->tiles[0].data;
+        const int block_rows = (d.height + 3) / 4;
+        task_run_parallel_range(s->encode_rows_func, &d, block_rows, max(1, block_rows / (4 * get_cpu_core_count())),
+                        get_cpu_core_count());
+
+        return out;
+}
+
+static void cpu_dxt_compress_done(struct module *mod)
+{
+        auto *s = (struct state_video_compress_cpu_dxt *) mod->priv_data;
+
+        delete s;
+}
+
+const struct video_compress_info cpu_dxt_info = {
+        "cpu_dxt",
+        cpu_dxt_compress_init,
+        NULL,
+        cpu_dxt_compress_tile,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL
+};
+
+REGISTER_MODULE(cpu_dxt, &cpu_dxt_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
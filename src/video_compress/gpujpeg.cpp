@@ -48,10 +48,18 @@
 #include "module.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/frame_alloc.h"
 #include "utils/synchronized_queue.h"
 #include "utils/video_frame_pool.h"
 #include "video.h"
 
+#ifdef HAVE_CUDA
+#include <cuda_runtime.h>
+#include "utils/cuda_pix_conv.h"
+#else
+typedef void cuda_pix_conv_t;
+#endif
+
 #include <algorithm>
 #include <initializer_list>
 #include <libgpujpeg/gpujpeg_encoder.h>
@@ -82,6 +90,10 @@ private:
         void cleanup_state();
         shared_ptr<video_frame> compress_step(shared_ptr<video_frame> frame);
         bool configure_with(struct video_desc desc);
+        uint8_t *convert_on_device(unsigned char *src, struct tile *in_tile);
+        unsigned char *decode_tile(struct tile *in_tile, unsigned int slot);
+        bool start_upload(struct video_frame *tx, unsigned int tile_idx);
+        uint8_t *finish_upload(unsigned int tile_idx);
 
         struct state_video_compress_gpujpeg        *m_parent_state;
         int                                      m_device_id;
@@ -90,7 +102,15 @@ private:
         video_frame_pool                         m_pool;
         decoder_t                                m_decoder;
         codec_t                                  m_enc_input_codec{};
-        unique_ptr<char []>                      m_decoded;
+        unsigned char                           *m_decoded[2]{}; ///< m_decoder output (pinned if HAVE_CUDA)
+        cuda_pix_conv_t                         *m_cuda_conv{}; ///< used instead of m_decoder if set
+        unsigned char                           *m_cuda_in[2]{}; ///< device copies of CPU_MEM input tiles
+        unsigned char                           *m_cuda_out{}; ///< m_cuda_conv output
+#ifdef HAVE_CUDA
+        cudaStream_t                             m_stream{}; ///< conversion+encode, shared with multi-input (otherwise default)
+        cudaStream_t                             m_upload_stream{}; ///< H2D copies, overlaps with encoding
+        cudaEvent_t                              m_uploaded[2]{};
+#endif
 
         struct gpujpeg_parameters                m_encoder_param{};
         struct gpujpeg_image_parameters          m_param_image{};
@@ -102,6 +122,11 @@ public:
         }
         ~encoder_state() {
                 cleanup_state();
+#ifdef HAVE_CUDA
+                if (m_upload_stream != nullptr) {
+                        cudaStreamDestroy(m_upload_stream);
+                }
+#endif
         }
         void worker();
         void compress(shared_ptr<video_frame> frame);
@@ -111,6 +136,20 @@ public:
         bool                                     m_occupied; ///< protected by state_video_compress_gpujpeg::m_occupancy_lock
 };
 
+#ifdef HAVE_CUDA
+/// pinned capture frames (eg. DeckLink) are then uploaded by DMA without a staging copy
+static const struct frame_pin_ops cuda_pin_ops = {
+        [](void *ptr, size_t size) {
+                if (cudaHostRegister(ptr, size, cudaHostRegisterPortable) != cudaSuccess) {
+                        cudaGetLastError(); // reset the error
+                        return false;
+                }
+                return true;
+        },
+        [](void *ptr) { cudaHostUnregister(ptr); },
+};
+#endif
+
 struct state_video_compress_gpujpeg {
 private:
         state_video_compress_gpujpeg(struct module *parent, const char *opts);
@@ -135,6 +174,9 @@ public:
                 for (auto worker : m_workers) {
                         delete worker;
                 }
+#ifdef HAVE_CUDA
+                frame_alloc_unset_pin_ops(&cuda_pin_ops);
+#endif
         }
         static state_video_compress_gpujpeg *create(struct module *parent, const char *opts);
         bool parse_fmt(char *fmt);
@@ -205,16 +247,55 @@ void encoder_state::worker() {
         }
 }
 
+static const codec_t gpujpeg_input_codecs[] = { UYVY, RGB,
+#if GJ_RGBA_SUPP == 1
+        RGBA,
+#endif
+        VIDEO_CODEC_NONE
+};
+
 static decoder_t get_decoder(codec_t in_codec, codec_t *out_codec)
 {
-        codec_t candidate_codecs[] = { UYVY, RGB,
-#if GJ_RGBA_SUPP == 1
-                RGBA,
+        return get_best_decoder_from(in_codec, gpujpeg_input_codecs, out_codec);
+}
+
+#ifdef HAVE_CUDA
+/**
+ * With --param multi-input, the conversion and encode kernels of all inputs
+ * encoded on the device are issued to a single stream of the (shared)
+ * primary context, so that the GPU processes them back-to-back instead of
+ * time-slicing per-process contexts. The streams live for the whole process.
+ *
+ * @returns shared stream for device_id or nullptr (default stream) if not in
+ *          multi-input mode
+ */
+static cudaStream_t get_shared_stream(int device_id)
+{
+        if (get_commandline_param("multi-input") == nullptr) {
+                return nullptr;
+        }
+        static mutex lock;
+        static map<int, cudaStream_t> streams;
+        lock_guard<mutex> lk(lock);
+        auto it = streams.find(device_id);
+        if (it != streams.end()) {
+                return it->second;
+        }
+        cudaStream_t stream = nullptr;
+        if (cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking) != cudaSuccess) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot create shared stream, using default.\n");
+                stream = nullptr;
+        }
+        streams[device_id] = stream;
+        return stream;
+}
 #endif
-        };
 
-        return get_best_decoder_from(in_codec, candidate_codecs, out_codec);
+#ifndef HAVE_CUDA
+static cuda_pix_conv_t *get_best_cuda_pix_conv(codec_t, const codec_t *, codec_t *) {
+        return nullptr;
 }
+#endif
 
 /**
  * Configures GPUJPEG encoder with provided parameters.
@@ -238,7 +319,17 @@ bool encoder_state::configure_with(struct video_desc desc)
                 m_enc_input_codec = desc.color_spec;
         } else {
                 m_decoder = get_decoder(desc.color_spec, &m_enc_input_codec);
-                if (!m_decoder) {
+                // convert on the GPU if possible - saves the CPU conversion and
+                // allows CUDA_MEM frames that are not directly supported
+                if (m_decoder != vc_memcpy) {
+                        m_cuda_conv = get_best_cuda_pix_conv(desc.color_spec, gpujpeg_input_codecs, &m_enc_input_codec);
+                        if (m_cuda_conv) {
+                                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Converting %s to %s on the GPU.\n",
+                                                get_codec_name(desc.color_spec), get_codec_name(m_enc_input_codec));
+                                m_decoder = nullptr;
+                        }
+                }
+                if (!m_decoder && !m_cuda_conv) {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n",
                                         get_codec_name(desc.color_spec));
                         return false;
@@ -298,7 +389,12 @@ bool encoder_state::configure_with(struct video_desc desc)
 #else
                 codec_is_a_rgb(m_enc_input_codec) ? 8 : 4);
 #endif
+#ifdef HAVE_CUDA
+        m_stream = get_shared_stream(m_device_id);
+        m_encoder = gpujpeg_encoder_create(m_stream);
+#else
         m_encoder = gpujpeg_encoder_create(NULL);
+#endif
 
         int data_len = desc.width * desc.height * 3;
         m_pool.reconfigure(compressed_desc, data_len);
@@ -309,7 +405,34 @@ bool encoder_state::configure_with(struct video_desc desc)
                 return false;
         }
 
-        m_decoded = unique_ptr<char []>(new char[4 * desc.width * desc.height]);
+        const size_t decoded_len = vc_get_datalen(desc.width, desc.height, m_enc_input_codec);
+#ifdef HAVE_CUDA
+        // Host input is staged in a 2-slot ring: pinned host buffers (for
+        // m_decoder output) and device buffers filled asynchronously on
+        // m_upload_stream, so that the upload of tile n+1 runs during the
+        // encode of tile n and the copy is a DMA rather than a staged one.
+        const size_t upload_len = max(vc_get_datalen(desc.width, desc.height, desc.color_spec), decoded_len);
+        if (m_upload_stream == nullptr && cudaStreamCreateWithFlags(&m_upload_stream, cudaStreamNonBlocking) != cudaSuccess) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create upload stream.\n");
+                return false;
+        }
+        for (int i = 0; i < 2; ++i) {
+                if ((m_decoder && m_decoder != vc_memcpy && cudaHostAlloc((void **) &m_decoded[i], decoded_len, cudaHostAllocDefault) != cudaSuccess) ||
+                                cudaMalloc((void **) &m_cuda_in[i], upload_len) != cudaSuccess ||
+                                cudaEventCreateWithFlags(&m_uploaded[i], cudaEventDisableTiming) != cudaSuccess) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate upload buffers.\n");
+                        return false;
+                }
+        }
+        if (m_cuda_conv && cudaMalloc((void **) &m_cuda_out, vc_get_linesize(desc.width, m_enc_input_codec) * desc.height) != cudaSuccess) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate conversion buffer.\n");
+                return false;
+        }
+#else
+        if (m_decoder && m_decoder != vc_memcpy) {
+                m_decoded[0] = new unsigned char[decoded_len];
+        }
+#endif
 
         m_saved_desc = desc;
 
@@ -413,6 +536,9 @@ state_video_compress_gpujpeg *state_video_compress_gpujpeg::create(struct module
         if (cuda_devices_count > 1) {
                 ret->m_uses_worker_threads = true;
         }
+#ifdef HAVE_CUDA
+        frame_alloc_set_pin_ops(&cuda_pin_ops);
+#endif
 
         if (ret->m_uses_worker_threads) {
                 for (auto worker : ret->m_workers) {
@@ -538,29 +664,47 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
 
         shared_ptr<video_frame> out = m_pool.get_frame();
 
+#ifdef HAVE_CUDA
+        const bool upload = tx->mem_location != CUDA_MEM;
+        cudaStreamSynchronize(m_upload_stream); // no-op unless previous frame failed mid-way
+#else
+        const bool upload = false;
+#endif
+        if (upload && !start_upload(tx.get(), 0)) {
+                return {};
+        }
+
         for (unsigned int x = 0; x < out->tile_count;  ++x) {
                 struct tile *in_tile = vf_get_tile(tx.get(), x);
                 struct tile *out_tile = vf_get_tile(out.get(), x);
                 uint8_t *jpeg_enc_input_data;
+                bool on_device = tx->mem_location == CUDA_MEM;
 
-                if (m_decoder && m_decoder != vc_memcpy) {
-                        assert(tx.get()->mem_location == CPU_MEM);
-                        unsigned char *line1 = (unsigned char *) in_tile->data;
-                        unsigned char *line2 = (unsigned char *) m_decoded.get();
-
-                        for (int i = 0; i < (int) in_tile->height; ++i) {
-                                m_decoder(line2, line1,
-                                                vc_get_linesize(desc.width,
-                                                        m_enc_input_codec),
-                                                0, 8, 16);
-                                line1 += vc_get_linesize(in_tile->width, tx->color_spec);
-                                line2 += vc_get_linesize(desc.width, m_enc_input_codec);
+                if (upload) {
+                        // upload of the next tile overlaps with encoding of this one
+                        if (x + 1 < out->tile_count && !start_upload(tx.get(), x + 1)) {
+                                return {};
                         }
-                        jpeg_enc_input_data = (uint8_t *) m_decoded.get();
+                        jpeg_enc_input_data = finish_upload(x);
+                        if (!jpeg_enc_input_data) {
+                                return {};
+                        }
+                        on_device = true;
+                } else if (m_decoder && m_decoder != vc_memcpy) {
+                        assert(tx.get()->mem_location == CPU_MEM);
+                        jpeg_enc_input_data = decode_tile(in_tile, 0);
                 } else {
                         jpeg_enc_input_data = (uint8_t *) in_tile->data;
                 }
 
+                if (m_cuda_conv) {
+                        jpeg_enc_input_data = convert_on_device(jpeg_enc_input_data, in_tile);
+                        if (!jpeg_enc_input_data) {
+                                return {};
+                        }
+                        on_device = true;
+                }
+
                 uint8_t *compressed;
 #if GPUJPEG_VERSION_INT < GPUJPEG_MK_VERSION_INT(0, 21, 0)
                 int size;
@@ -569,7 +713,7 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
 #endif
 
                 struct gpujpeg_encoder_input encoder_input;
-                if(tx.get()->mem_location == CUDA_MEM){
+                if (on_device) {
                         gpujpeg_encoder_input_set_gpu_image(&encoder_input, jpeg_enc_input_data);
                 } else {
                         gpujpeg_encoder_input_set_image(&encoder_input, jpeg_enc_input_data);
@@ -587,11 +731,117 @@ shared_ptr<video_frame> encoder_state::compress_step(shared_ptr<video_frame> tx)
         return out;
 }
 
+/**
+ * Converts CPU_MEM tile with m_decoder to m_decoded[slot].
+ */
+unsigned char *encoder_state::decode_tile(struct tile *in_tile, unsigned int slot)
+{
+        unsigned char *line1 = (unsigned char *) in_tile->data;
+        unsigned char *line2 = m_decoded[slot];
+
+        for (int i = 0; i < (int) in_tile->height; ++i) {
+                m_decoder(line2, line1, vc_get_linesize(in_tile->width, m_enc_input_codec),
+                                0, 8, 16);
+                line1 += vc_get_linesize(in_tile->width, m_saved_desc.color_spec);
+                line2 += vc_get_linesize(in_tile->width, m_enc_input_codec);
+        }
+        return m_decoded[slot];
+}
+
+/**
+ * Enqueues asynchronous upload of CPU_MEM tile tile_idx (converted with
+ * m_decoder if set) to m_cuda_in[tile_idx % 2]. The slot must not be in use,
+ * which holds because tile_idx - 2 has already been encoded synchronously.
+ */
+bool encoder_state::start_upload(struct video_frame *tx, unsigned int tile_idx)
+{
+#ifdef HAVE_CUDA
+        const unsigned int slot = tile_idx % 2;
+        struct tile *in_tile = vf_get_tile(tx, tile_idx);
+        unsigned char *src = (unsigned char *) in_tile->data;
+        size_t len = in_tile->data_len;
+        if (m_decoder && m_decoder != vc_memcpy) {
+                src = decode_tile(in_tile, slot);
+                len = vc_get_datalen(in_tile->width, in_tile->height, m_enc_input_codec);
+        }
+        if (cudaMemcpyAsync(m_cuda_in[slot], src, len, cudaMemcpyHostToDevice, m_upload_stream) != cudaSuccess ||
+                        cudaEventRecord(m_uploaded[slot], m_upload_stream) != cudaSuccess) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Upload failed: %s\n", cudaGetErrorString(cudaGetLastError()));
+                return false;
+        }
+        return true;
+#else
+        UNUSED(tx), UNUSED(tile_idx);
+        return false;
+#endif
+}
+
+/**
+ * Waits for upload started by start_upload().
+ * @returns device pointer to the tile, nullptr on error
+ */
+uint8_t *encoder_state::finish_upload(unsigned int tile_idx)
+{
+#ifdef HAVE_CUDA
+        const unsigned int slot = tile_idx % 2;
+        if (cudaEventSynchronize(m_uploaded[slot]) != cudaSuccess) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Upload failed: %s\n", cudaGetErrorString(cudaGetLastError()));
+                return nullptr;
+        }
+        return m_cuda_in[slot];
+#else
+        UNUSED(tile_idx);
+        return nullptr;
+#endif
+}
+
+/**
+ * Converts device-resident tile src (with dimensions of in_tile) to
+ * m_enc_input_codec with m_cuda_conv.
+ * @returns device pointer to the converted tile, nullptr on error
+ */
+uint8_t *encoder_state::convert_on_device(unsigned char *src, struct tile *in_tile)
+{
+#ifdef HAVE_CUDA
+        const size_t src_pitch = vc_get_linesize(in_tile->width, m_saved_desc.color_spec);
+        m_cuda_conv(m_cuda_out, vc_get_linesize(in_tile->width, m_enc_input_codec), src, src_pitch,
+                        in_tile->width, in_tile->height, m_stream);
+        if (cudaStreamSynchronize(m_stream) != cudaSuccess) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Conversion failed: %s\n", cudaGetErrorString(cudaGetLastError()));
+                return nullptr;
+        }
+        return m_cuda_out;
+#else
+        UNUSED(src), UNUSED(in_tile);
+        return nullptr;
+#endif
+}
+
 void encoder_state::cleanup_state()
 {
         if (m_encoder)
                 gpujpeg_encoder_destroy(m_encoder);
         m_encoder = NULL;
+#ifdef HAVE_CUDA
+        if (m_upload_stream != nullptr) {
+                cudaStreamSynchronize(m_upload_stream);
+        }
+        for (int i = 0; i < 2; ++i) {
+                cudaFreeHost(m_decoded[i]);
+                cudaFree(m_cuda_in[i]);
+                if (m_uploaded[i] != nullptr) {
+                        cudaEventDestroy(m_uploaded[i]);
+                }
+                m_decoded[i] = m_cuda_in[i] = nullptr;
+                m_uploaded[i] = nullptr;
+        }
+        cudaFree(m_cuda_out);
+#else
+        delete [] m_decoded[0];
+        m_decoded[0] = nullptr;
+#endif
+        m_cuda_out = nullptr;
+        m_cuda_conv = nullptr;
 }
 
 void state_video_compress_gpujpeg::push(std::shared_ptr<video_frame> in_frame)
@@ -71,16 +71,20 @@
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/string.h" // replace_all
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_compress.h"
 
-#ifdef HWACC_VAAPI
+#ifdef HWACC_COMMON_IMPL
 extern "C"
 {
 #include <libavutil/hwcontext.h>
+#ifdef HWACC_VAAPI
 #include <libavutil/hwcontext_vaapi.h>
+#endif
 }
 #include "hwaccel_libav_common.h"
+#include "libavcodec/from_lavc_vid_conv.h"
 #endif
 
 #ifdef HAVE_SWSCALE
@@ -237,6 +241,8 @@ struct state_video_compress_libav {
         }
         ~state_video_compress_libav() {
                 av_packet_free(&pkt);
+                av_frame_free(&hw_in_ref);
+                av_buffer_unref(&in_hw_frames_ctx);
                 to_lavc_vid_conv_destroy(&pixfmt_conversion);
         }
 
@@ -253,9 +259,15 @@ struct state_video_compress_libav {
         double              requested_bpp = 0;
         double              requested_crf = -1;
         int                 requested_cqp = -1;
+        double              frame_cap = 0; ///< if >0, max frame size relative to bitrate/fps (constant-latency RC)
+        double              vbv_fullness = 0; ///< bytes over the per-frame budget carried to next frames
+        long long int       rc_base_bitrate = 0; ///< bitrate the constant-latency RC modulates
+        bool                keyframe_requested = false; ///< force next frame to be a keyframe (receiver PLI)
         struct to_lavc_req_prop req_conv_prop{ 0, 0, -1, VIDEO_CODEC_NONE };
 
         struct video_desc compressed_desc{};
+        video_frame_pool    out_pool;         ///< pool of compressed output frames
+        size_t              out_buf_len = 0;  ///< size of out_pool buffers, grows with observed frame sizes
 
         struct setparam_param params{lavc_opts, blacklist_opts};
         string              backend;
@@ -268,6 +280,12 @@ struct state_video_compress_libav {
         bool store_orig_format = false;
         AVFrame *hwframe = nullptr;
 
+        AVBufferRef *in_hw_frames_ctx = nullptr; ///< frames ctx of LAVC_HW_MEM input, NULL for CPU input
+        bool hw_passthrough = false; ///< LAVC_HW_MEM input is passed to the encoder as-is
+        video_frame_pool hw_download_pool; ///< LAVC_HW_MEM input downloaded and converted to UG pixfmt
+        AVFrame *hw_in_ref = av_frame_alloc(); ///< reference to the passed-through surface
+        int64_t hw_pts = 0;
+
 #ifdef HAVE_SWSCALE
         struct SwsContext *sws_ctx = nullptr;
         AVFrame *sws_frame = nullptr;
@@ -350,7 +368,7 @@ static void get_codec_details(AVCodecID id, char *buf, size_t buflen)
 
 static void usage() {
         printf("Libavcodec encoder usage:\n");
-        col() << "\t" SBOLD(SRED("-c libavcodec") << "[:codec=<codec_name>|:encoder=<encoder>][:bitrate=<bits_per_sec>|:bpp=<bits_per_pixel>|:crf=<crf>|:cqp=<cqp>]\n"
+        col() << "\t" SBOLD(SRED("-c libavcodec") << "[:codec=<codec_name>|:encoder=<encoder>][:bitrate=<bits_per_sec>|:bpp=<bits_per_pixel>|:crf=<crf>|:cqp=<cqp>][:frame_cap[=<r>]]\n"
                         "\t\t[:subsampling=<subsampling>][:depth=<depth>][:rgb|:yuv][:gop=<gop>]"
                         "[:[disable_]intra_refresh][:threads=<threads>][:slices=<slices>][:<lavc_opt>=<val>]*") << "\n";
         col() << "\nwhere\n";
@@ -363,6 +381,8 @@ static void usage() {
                 << "\t\t\tbitrate = frame width * frame height * bits_per_pixel * fps\n";
         col() << "\t" << SBOLD("<cqp>") << " use codec-specific constant QP value, for some codecs like MJPEG this is the only quality setting option\n";
         col() << "\t" << SBOLD("<crf>") << " specifies CRF factor (only for libx264/libx265)\n";
+        col() << "\t" << SBOLD("frame_cap[=<r>]") << " constant-latency rate control - keep every frame below <r> (default 1.0) times\n"
+                << "\t\t\tbitrate/fps, so that it can be sent within a frame interval (not with cqp/crf)\n";
         col() << "\t" << SBOLD("<subsampling>") << " may be one of 444, 422, or 420, default 420 for progresive, 422 for interlaced\n";
         col() << "\t" << SBOLD("<depth>") << " enforce specified compression bit depth\n";
         col() << "\t" << SBOLD("rgb|yuv") << " enforce specified color space compreesion\n";
@@ -438,6 +458,12 @@ static int parse_fmt(struct state_video_compress_libav *s, char *fmt) {
                                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Option \"q=\" is deprecated, use \"cqp=\" instead.\n");
                         }
                         s->requested_cqp = atoi(strchr(item, '=') + 1);
+                } else if (strcasecmp(item, "frame_cap") == 0 || strstr(item, "frame_cap=") == item) {
+                        s->frame_cap = strchr(item, '=') != nullptr ? atof(strchr(item, '=') + 1) : 1.0;
+                        if (s->frame_cap <= 0.0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Frame cap must be positive!\n");
+                                return -1;
+                        }
                 } else if(strncasecmp("subsampling=", item, strlen("subsampling=")) == 0) {
                         char *subsample_str = item + strlen("subsampling=");
                         s->req_conv_prop.subsampling = atoi(subsample_str);
@@ -745,10 +771,11 @@ bool set_codec_ctx_params(struct state_video_compress_libav *s, AVPixelFormat pi
 
         s->codec_ctx->strict_std_compliance = -2;
 
-        // set quality
-        if (s->requested_cqp >= 0 || ((is_vaapi || is_mjpeg) && s->requested_crf == -1.0 && s->requested_bitrate == 0 && s->requested_bpp == 0.0)) {
+        // set quality (frame cap implies bitrate-based RC unless CQP/CRF is given explicitly)
+        const bool default_quality = s->requested_bitrate == 0 && s->requested_bpp == 0.0 && s->frame_cap == 0.0;
+        if (s->requested_cqp >= 0 || ((is_vaapi || is_mjpeg) && s->requested_crf == -1.0 && default_quality)) {
                 set_cqp(s->codec_ctx, s->requested_cqp);
-        } else if (s->requested_crf >= 0.0 || (is_x264_x265 && s->requested_bitrate == 0 && s->requested_bpp == 0.0)) {
+        } else if (s->requested_crf >= 0.0 || (is_x264_x265 && default_quality)) {
                 double crf = s->requested_crf >= 0.0 ? s->requested_crf : DEFAULT_X264_X265_CRF;
                 if (check_av_opt_set<double>(s->codec_ctx->priv_data, "crf", crf)) {
                         log_msg(LOG_LEVEL_INFO, "[lavc] Setting CRF to %.2f.\n", crf);
@@ -761,6 +788,11 @@ bool set_codec_ctx_params(struct state_video_compress_libav *s, AVPixelFormat pi
                 s->codec_ctx->bit_rate_tolerance = bitrate / desc.fps * 6;
                 LOG(LOG_LEVEL_INFO) << MOD_NAME << "Setting bitrate to " << format_in_si_units(bitrate) << "bps.\n";
         }
+        s->rc_base_bitrate = s->codec_ctx->bit_rate;
+        s->vbv_fullness = 0;
+        if (s->frame_cap > 0.0 && s->codec_ctx->bit_rate == 0) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame cap requires bitrate-based rate control, ignoring.\n");
+        }
 
         /* resolution must be a multiple of two */
         s->codec_ctx->width = desc.width;
@@ -803,6 +835,17 @@ bool set_codec_ctx_params(struct state_video_compress_libav *s, AVPixelFormat pi
                 }
         }
 
+        if (s->frame_cap > 0.0 && s->codec_ctx->bit_rate > 0) {
+                // the encoder VBV holds at most one capped frame, no look-ahead
+                s->codec_ctx->rc_max_rate = s->codec_ctx->bit_rate;
+                s->codec_ctx->rc_buffer_size = s->codec_ctx->bit_rate / desc.fps * s->frame_cap;
+                if (av_opt_find(s->codec_ctx->priv_data, "rc-lookahead", nullptr, 0, 0) != nullptr) {
+                        check_av_opt_set<int>(s->codec_ctx->priv_data, "rc-lookahead", 0);
+                }
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Constant-latency RC: frame cap %sB.\n",
+                                format_in_si_units(s->codec_ctx->rc_buffer_size / 8));
+        }
+
         return true;
 }
 
@@ -908,6 +951,83 @@ static bool try_open_codec(struct state_video_compress_libav *s,
         return true;
 }
 
+#ifdef HWACC_COMMON_IMPL
+/**
+ * Opens the encoder with hw_frames_ctx of the LAVC_HW_MEM input if the
+ * encoder accepts its surfaces so that the frames do not need to be
+ * downloaded and uploaded again.
+ */
+static bool try_open_codec_hw_input(struct state_video_compress_libav *s,
+                                    struct video_desc desc,
+                                    codec_t ug_codec,
+                                    const AVCodec *codec)
+{
+        auto *frames_ctx = (AVHWFramesContext *)(void *) s->in_hw_frames_ctx->data;
+        bool supported = false;
+        for (const auto *it = codec->pix_fmts; it != nullptr && *it != AV_PIX_FMT_NONE; ++it) {
+                supported = supported || *it == frames_ctx->format;
+        }
+        if (!supported) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Encoder %s doesn't accept %s surfaces.\n", codec->name,
+                                av_get_pix_fmt_name(frames_ctx->format));
+                return false;
+        }
+
+        s->codec_ctx = avcodec_alloc_context3(codec);
+        if (!s->codec_ctx) {
+                log_msg(LOG_LEVEL_ERROR, "Could not allocate video codec context\n");
+                return false;
+        }
+        if (!set_codec_ctx_params(s, frames_ctx->sw_format, desc, ug_codec)) {
+                avcodec_free_context(&s->codec_ctx);
+                return false;
+        }
+        s->codec_ctx->pix_fmt = frames_ctx->format;
+        s->codec_ctx->sw_pix_fmt = frames_ctx->sw_format;
+        s->codec_ctx->hw_frames_ctx = av_buffer_ref(s->in_hw_frames_ctx);
+        get_av_pixfmt_details(frames_ctx->sw_format, &s->codec_ctx->colorspace, &s->codec_ctx->color_range);
+
+        if (avcodec_open2(s->codec_ctx, codec, NULL) < 0) {
+                avcodec_free_context(&s->codec_ctx);
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Could not open codec for %s surfaces\n", av_get_pix_fmt_name(frames_ctx->format));
+                return false;
+        }
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Encoding %s surfaces (%s) without download\n",
+                        av_get_pix_fmt_name(frames_ctx->format), av_get_pix_fmt_name(frames_ctx->sw_format));
+        return true;
+}
+
+/**
+ * Downloads LAVC_HW_MEM frame tx and converts it to tx->color_spec, used if
+ * the encoder doesn't accept the surfaces directly.
+ */
+static shared_ptr<video_frame> download_hw_frame(struct state_video_compress_libav *s, struct video_frame *tx)
+{
+        AVFrame *hw_in = (AVFrame *)(void *) tx->tiles[0].data;
+        AVFrame *sw_frame = av_frame_alloc();
+        int ret = av_hwframe_transfer_data(sw_frame, hw_in, 0);
+        if (ret < 0) {
+                print_libav_error(LOG_LEVEL_ERROR, MOD_NAME "Cannot download hw frame", ret);
+                av_frame_free(&sw_frame);
+                return {};
+        }
+        av_to_uv_convert_t conv = get_av_to_uv_conversion(sw_frame->format, tx->color_spec);
+        if (!conv.valid) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot convert downloaded %s to %s!\n",
+                                av_get_pix_fmt_name((enum AVPixelFormat) sw_frame->format), get_codec_name(tx->color_spec));
+                av_frame_free(&sw_frame);
+                return {};
+        }
+        shared_ptr<video_frame> out = s->hw_download_pool.get_frame();
+        vf_copy_metadata(out.get(), tx);
+        const int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
+        av_to_uv_convert(&conv, out->tiles[0].data, sw_frame, tx->tiles[0].width, tx->tiles[0].height,
+                        vc_get_linesize(tx->tiles[0].width, tx->color_spec), rgb_shift);
+        av_frame_free(&sw_frame);
+        return out;
+}
+#endif // defined HWACC_COMMON_IMPL
+
 const AVCodec *get_av_codec(struct state_video_compress_libav *s, codec_t *ug_codec, bool src_rgb) {
         // Open encoder specified by user if given
         if (!s->backend.empty()) {
@@ -1013,6 +1133,18 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         log_msg(LOG_LEVEL_NOTICE, "[lavc] Using codec: %s, encoder: %s\n",
                         get_codec_name(ug_codec), codec->name);
 
+        s->hw_passthrough = false;
+#ifdef HWACC_COMMON_IMPL
+        if (s->in_hw_frames_ctx != nullptr) {
+                if (try_open_codec_hw_input(s, desc, ug_codec, codec)) {
+                        s->hw_passthrough = true;
+                        pix_fmt = ((AVHWFramesContext *)(void *) s->in_hw_frames_ctx->data)->sw_format;
+                } else { // encode downloaded frames converted to desc.color_spec
+                        s->hw_download_pool.reconfigure(desc);
+                }
+        }
+#endif
+
         // Try to open the codec context
         // It is done in a loop because some pixel formats that are reported
         // by codec can actually fail (typically YUV444 in hevc_nvenc for Maxwell
@@ -1020,7 +1152,7 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         list<enum AVPixelFormat> requested_pix_fmt = get_requested_pix_fmts(desc.color_spec, s->req_conv_prop);
         apply_blacklist(requested_pix_fmt, codec->name);
         auto requested_pix_fmt_it = requested_pix_fmt.cbegin();
-        while ((pix_fmt = get_first_matching_pix_fmt(requested_pix_fmt_it, requested_pix_fmt.cend(), codec->pix_fmts)) != AV_PIX_FMT_NONE) {
+        while (!s->hw_passthrough && (pix_fmt = get_first_matching_pix_fmt(requested_pix_fmt_it, requested_pix_fmt.cend(), codec->pix_fmts)) != AV_PIX_FMT_NONE) {
                 if(try_open_codec(s, pix_fmt, desc, ug_codec, codec)){
                         break;
                 }
@@ -1069,9 +1201,12 @@ static bool configure_with(struct state_video_compress_libav *s, struct video_de
         s->compressed_desc.color_spec = ug_codec;
         s->compressed_desc.tile_count = 1;
         s->mov_avg_frames = s->mov_avg_comp_duration = 0;
+        // initial estimate only, enlarged by ensure_out_capacity() if a frame doesn't fit
+        s->out_buf_len = MAX((size_t) desc.width * desc.height / 2, 4096);
+        s->out_pool.reconfigure(s->compressed_desc, s->out_buf_len);
 
         to_lavc_vid_conv_destroy(&s->pixfmt_conversion);
-        if ((s->pixfmt_conversion = to_lavc_vid_conv_init(desc.color_spec, desc.width, desc.height, pix_fmt, s->conv_thread_count)) == nullptr) {
+        if (!s->hw_passthrough && (s->pixfmt_conversion = to_lavc_vid_conv_init(desc.color_spec, desc.width, desc.height, pix_fmt, s->conv_thread_count)) == nullptr) {
                 if (!configure_swscale(s, desc, pix_fmt)) {
                         return false;
                 }
@@ -1159,6 +1294,31 @@ static void write_orig_format(struct video_frame *compressed_frame, codec_t orig
         *data_len += sizeof eob;
 }
 
+/// headroom for write_orig_format() (SEI NAL prefix + GUID + format + EOB)
+enum { ORIG_FORMAT_MAX_LEN = 64 };
+
+/**
+ * Ensures that out can hold at least needed bytes. If not, the pool is
+ * reconfigured with larger buffers (with some headroom so that the growth
+ * settles after a few frames) and out is replaced with a new frame holding
+ * copy of already written data.
+ */
+static void ensure_out_capacity(struct state_video_compress_libav *s, shared_ptr<video_frame> &out, size_t needed)
+{
+        if (needed <= s->out_buf_len) {
+                return;
+        }
+        s->out_buf_len = needed + needed / 2;
+        verbose_msg(MOD_NAME "Enlarging output buffers to %zu B.\n", s->out_buf_len);
+        s->out_pool.reconfigure(s->compressed_desc, s->out_buf_len);
+        shared_ptr<video_frame> new_out = s->out_pool.get_frame();
+        new_out->color_spec = out->color_spec;
+        vf_copy_metadata(new_out.get(), out.get());
+        memcpy(new_out->tiles[0].data, out->tiles[0].data, out->tiles[0].data_len);
+        new_out->tiles[0].data_len = out->tiles[0].data_len;
+        out = std::move(new_out);
+}
+
 static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
 {
         struct state_video_compress_libav *s = (struct state_video_compress_libav *) mod->priv_data;
@@ -1167,38 +1327,66 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
 
         libavcodec_check_messages(s);
 
+        AVBufferRef *in_hw_frames_ctx = nullptr;
+#ifdef HWACC_COMMON_IMPL
+        if (tx->mem_location == LAVC_HW_MEM) {
+                in_hw_frames_ctx = ((AVFrame *)(void *) tx->tiles[0].data)->hw_frames_ctx;
+                assert(in_hw_frames_ctx != nullptr);
+        }
+#else
+        if (tx->mem_location == LAVC_HW_MEM) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Compiled without hw. acceleration support, cannot encode hw. surfaces!\n");
+                return {};
+        }
+#endif
+        const bool hw_ctx_changed = (in_hw_frames_ctx == nullptr) != (s->in_hw_frames_ctx == nullptr)
+                || (in_hw_frames_ctx != nullptr && in_hw_frames_ctx->data != s->in_hw_frames_ctx->data);
+
         if(!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
-                                s->saved_desc, PARAM_TILE_COUNT)) {
+                                s->saved_desc, PARAM_TILE_COUNT) || hw_ctx_changed) {
                 cleanup(s);
+                av_buffer_unref(&s->in_hw_frames_ctx);
+                s->in_hw_frames_ctx = in_hw_frames_ctx != nullptr ? av_buffer_ref(in_hw_frames_ctx) : nullptr;
                 int ret = configure_with(s, video_desc_from_frame(tx.get()));
                 if(!ret) {
                         return {};
                 }
         }
 
-        static auto dispose = [](struct video_frame *frame) {
-                free(frame->tiles[0].data);
-                vf_free(frame);
-        };
-        out = shared_ptr<video_frame>(vf_alloc_desc(s->compressed_desc), dispose);
+        out = s->out_pool.get_frame();
+        out->color_spec = s->compressed_desc.color_spec;
         if (s->compressed_desc.color_spec == PRORES) {
                 assert(s->codec_ctx->codec_tag != 0);
                 out->color_spec = get_codec_from_fcc(s->codec_ctx->codec_tag);
         }
         vf_copy_metadata(out.get(), tx.get());
-        const size_t max_len = MAX((size_t) s->compressed_desc.width * s->compressed_desc.height * 4, 4096);
-        out->tiles[0].data = (char *) malloc(max_len);
 
         time_ns_t t0 = get_time_in_ns();
-        struct AVFrame *frame = to_lavc_vid_conv(s->pixfmt_conversion, tx->tiles[0].data);
-        if (!frame) {
-                return {};
+        struct AVFrame *frame = nullptr;
+        if (s->hw_passthrough) {
+                // the encoder takes its own reference of the surface
+                av_frame_ref(s->hw_in_ref, (AVFrame *)(void *) tx->tiles[0].data);
+                s->hw_in_ref->pts = s->hw_pts++;
+                frame = s->hw_in_ref;
+        } else {
+#ifdef HWACC_COMMON_IMPL
+                if (tx->mem_location == LAVC_HW_MEM && !(tx = download_hw_frame(s, tx.get()))) {
+                        return {};
+                }
+#endif
+                // the encoder may reference the input frame if passed without conversion
+                frame = to_lavc_vid_conv_zero_copy(s->pixfmt_conversion, tx->tiles[0].data, (int) tx->tiles[0].linesize,
+                                [](void *tx_ref) { delete static_cast<shared_ptr<video_frame> *>(tx_ref); },
+                                new shared_ptr<video_frame>(tx));
+                if (!frame) {
+                        return {};
+                }
         }
         time_ns_t t1 = get_time_in_ns();
 
         debug_file_dump("lavc-avframe", serialize_video_avframe, frame);
 #ifdef HWACC_VAAPI
-        if(s->hwenc){
+        if(s->hwenc && !s->hw_passthrough){
                 av_hwframe_transfer_data(s->hwframe, frame, 0);
                 frame = s->hwframe;
         }
@@ -1219,21 +1407,32 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
         time_ns_t t2 = get_time_in_ns();
 
         /* encode the image */
-        frame->pts += 1;
+        if (!s->hw_passthrough) {
+                frame->pts += 1;
+        }
         out->tiles[0].data_len = 0;
         if (libav_codec_has_extradata(s->compressed_desc.color_spec)) { // we need to store extradata for HuffYUV/FFV1 in the beginning
+                ensure_out_capacity(s, out, sizeof(uint32_t) + s->codec_ctx->extradata_size);
                 out->tiles[0].data_len += sizeof(uint32_t) + s->codec_ctx->extradata_size;
                 *(uint32_t *)(void *) out->tiles[0].data = s->codec_ctx->extradata_size;
                 memcpy(out->tiles[0].data + sizeof(uint32_t), s->codec_ctx->extradata, s->codec_ctx->extradata_size);
         }
 
-        if (int ret = avcodec_send_frame(s->codec_ctx, frame)) {
-                print_libav_error(LOG_LEVEL_WARNING, "[lavc] Error encoding frame", ret);
+        frame->pict_type = s->keyframe_requested ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        s->keyframe_requested = false;
+        int send_ret = avcodec_send_frame(s->codec_ctx, frame);
+        if (s->hw_passthrough) {
+                av_frame_unref(s->hw_in_ref);
+        } else {
+                to_lavc_vid_conv_release_input(s->pixfmt_conversion);
+        }
+        if (send_ret != 0) {
+                print_libav_error(LOG_LEVEL_WARNING, "[lavc] Error encoding frame", send_ret);
                 return {};
         }
         int ret = avcodec_receive_packet(s->codec_ctx, s->pkt);
         while (ret == 0) {
-                assert(s->pkt->size + out->tiles[0].data_len <= max_len - out->tiles[0].data_len);
+                ensure_out_capacity(s, out, out->tiles[0].data_len + s->pkt->size + ORIG_FORMAT_MAX_LEN);
                 memcpy((uint8_t *) out->tiles[0].data + out->tiles[0].data_len,
                                 s->pkt->data, s->pkt->size);
                 out->tiles[0].data_len += s->pkt->size;
@@ -1258,6 +1457,9 @@ static shared_ptr<video_frame> libavcodec_compress_tile(struct module *mod, shar
                 write_orig_format(out.get(), tx->color_spec);
         }
 
+        constant_latency_rc_update(s, out->tiles[0].data_len);
+        out->frame_capped = s->frame_cap > 0.0 && s->rc_base_bitrate > 0;
+
         return out;
 }
 
@@ -1446,6 +1648,7 @@ static void configure_x264_x265(AVCodecContext *codec_ctx, struct setparam_param
         if ("libx265"s == codec_ctx->codec->name) {
                 check_av_opt_set<const char *>(codec_ctx->priv_data, "x265-params", x265_params.c_str());
         }
+        check_av_opt_set<const char *>(codec_ctx->priv_data, "forced-idr", "1"); // keyframes forced on receiver request (PLI) must be IDR
 }
 
 static void configure_qsv_h264_hevc(AVCodecContext *codec_ctx, struct setparam_param *param)
@@ -1720,6 +1923,77 @@ static void setparam_vp8_vp9(AVCodecContext *codec_ctx, struct setparam_param *p
         check_av_opt_set<int>(codec_ctx->priv_data, "rc_lookahead", 0);
 }
 
+/**
+ * Changes bitrate of the running encoder without reinitialization (and thus
+ * without forcing a new key frame). Encoders supporting that check the
+ * changed AVCodecContext::bit_rate on every frame.
+ *
+ * @retval false if not applicable, full reconfiguration needed
+ */
+static bool can_change_bitrate_on_the_fly(struct state_video_compress_libav *s)
+{
+        if (s->codec_ctx == nullptr || s->codec_ctx->bit_rate == 0) {
+                return false;
+        }
+        const char *name = s->codec_ctx->codec->name;
+        return strcmp(name, "libx264") == 0 || ends_with(name, "_nvenc");
+}
+
+static void set_bitrate_on_the_fly(struct state_video_compress_libav *s, long long bitrate)
+{
+        const double ratio = (double) bitrate / s->codec_ctx->bit_rate;
+        s->codec_ctx->bit_rate = bitrate;
+        s->codec_ctx->bit_rate_tolerance *= ratio;
+        s->codec_ctx->rc_max_rate *= ratio;
+        s->codec_ctx->rc_buffer_size *= ratio;
+}
+
+static bool change_bitrate_on_the_fly(struct state_video_compress_libav *s, const char *cfg)
+{
+        if (!can_change_bitrate_on_the_fly(s) ||
+                        strncasecmp(cfg, "bitrate=", strlen("bitrate=")) != 0 || strchr(cfg, ':') != nullptr) {
+                return false;
+        }
+        long long bitrate = unit_evaluate(cfg + strlen("bitrate="));
+        if (bitrate <= 0) {
+                return false;
+        }
+        set_bitrate_on_the_fly(s, bitrate);
+        s->requested_bitrate = bitrate;
+        s->rc_base_bitrate = bitrate;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Bitrate changed to %sbps.\n", format_in_si_units(bitrate));
+        return true;
+}
+
+/**
+ * Constant-latency rate control (frame_cap option) - VBV-style accounting
+ * of the frame sizes against the per-frame budget (bitrate/fps). Bytes
+ * exceeding the budget are paid back by lowering the encoder bitrate for
+ * the following frames (for encoders accepting bitrate changes per frame),
+ * so that the sender never falls behind by more than the frame cap.
+ */
+static void constant_latency_rc_update(struct state_video_compress_libav *s, size_t frame_size)
+{
+        if (s->frame_cap <= 0.0 || s->rc_base_bitrate == 0) {
+                return;
+        }
+        const double budget = s->rc_base_bitrate / 8.0 / s->saved_desc.fps;
+        s->vbv_fullness = max(0.0, s->vbv_fullness + frame_size - budget);
+        if (frame_size > budget * s->frame_cap) {
+                log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Frame size %zu B exceeds cap %.0f B.\n", frame_size, budget * s->frame_cap);
+        }
+        if (!can_change_bitrate_on_the_fly(s)) {
+                return;
+        }
+        // pay the excess back within the next frame, but keep at least 1/4 of the budget
+        const double target = max(budget / 4, budget - s->vbv_fullness);
+        const long long bitrate = target * 8 * s->saved_desc.fps;
+        if (llabs(bitrate - s->codec_ctx->bit_rate) > s->codec_ctx->bit_rate / 50) { // ignore changes < 2 %
+                set_bitrate_on_the_fly(s, bitrate);
+                log_msg(LOG_LEVEL_DEBUG2, MOD_NAME "Constant-latency RC bitrate %sbps.\n", format_in_si_units(bitrate));
+        }
+}
+
 static void libavcodec_check_messages(struct state_video_compress_libav *s)
 {
         struct message *msg;
@@ -1727,6 +2001,15 @@ static void libavcodec_check_messages(struct state_video_compress_libav *s)
                 struct msg_change_compress_data *data =
                         (struct msg_change_compress_data *) msg;
                 struct response *r;
+                if (strcmp(data->config_string, "keyframe") == 0) {
+                        s->keyframe_requested = true;
+                        free_message(msg, new_response(RESPONSE_OK, NULL));
+                        continue;
+                }
+                if (change_bitrate_on_the_fly(s, data->config_string)) {
+                        free_message(msg, new_response(RESPONSE_OK, NULL));
+                        continue;
+                }
                 if (parse_fmt(s, data->config_string) == 0) {
                         log_msg(LOG_LEVEL_NOTICE, "[Libavcodec] Compression successfully changed.\n");
                         r = new_response(RESPONSE_OK, NULL);
@@ -1750,6 +2033,7 @@ const struct video_compress_info libavcodec_info = {
         NULL,
         NULL,
         get_libavcodec_module_info,
+        true,
 };
 
 REGISTER_MODULE(libavcodec, &libavcodec_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
@@ -0,0 +1,223 @@
+/**
+ * @file   video_compress/ulw.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  UltraGrid lite wavelet (ULW) compression
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "module.h"
+#include "pixfmt_conv.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "utils/ulw.h"
+#include "utils/video_frame_pool.h"
+#include "video.h"
+#include "video_compress.h"
+
+#define MOD_NAME "[ULW] "
+#define DEFAULT_BPP 6.0
+
+using namespace std;
+
+namespace {
+
+struct state_video_compress_ulw {
+        struct module       module_data;
+        struct video_desc   saved_desc;
+        codec_t             in_codec;
+        decoder_t           decoder;
+        unique_ptr<unsigned char []> decoded;
+        double              bpp = DEFAULT_BPP;
+        int                 q = 0;
+        int                 slice_height = ULW_DEFAULT_SLICE_HEIGHT;
+
+        video_frame_pool pool;
+};
+
+static void ulw_compress_done(struct module *mod);
+
+static void usage()
+{
+        printf("UltraGrid lite wavelet (ULW) - intra-only codec for visually-lossless transmission usage:\n");
+        printf("\t-c ulw[:bpp=<bpp>|:q=<q>][:slice=<lines>]\n");
+        printf("\t\t<bpp>   - target bits per pixel (constant frame size, default %.0f)\n", DEFAULT_BPP);
+        printf("\t\t<q>     - constant quantizer 0-%d (0 is lossless), disables rate control\n", ULW_MAX_Q);
+        printf("\t\t<lines> - slice height (default %d)\n", ULW_DEFAULT_SLICE_HEIGHT);
+        printf("\n\tThe bitrate is bpp * width * height * fps, eg. 4K60 at 6 bpp is ~3 Gbps.\n");
+}
+
+struct module *ulw_compress_init(struct module *parent, const char *fmt)
+{
+        auto *s = new state_video_compress_ulw();
+        char *tmp = strdup(fmt);
+        char *save_ptr = nullptr;
+        char *item = nullptr;
+        char *cfg = tmp;
+        bool ok = true;
+        while ((item = strtok_r(cfg, ":", &save_ptr)) != nullptr) {
+                cfg = nullptr;
+                if (strcmp(item, "help") == 0) {
+                        usage();
+                        free(tmp);
+                        delete s;
+                        return static_cast<module*>(INIT_NOERR);
+                }
+                if (strncasecmp(item, "bpp=", strlen("bpp=")) == 0) {
+                        s->bpp = atof(item + strlen("bpp="));
+                        ok = ok && s->bpp >= 1.0;
+                } else if (strncasecmp(item, "q=", strlen("q=")) == 0) {
+                        s->q = atoi(item + strlen("q="));
+                        s->bpp = 0.0;
+                        ok = ok && s->q >= 0 && s->q <= ULW_MAX_Q;
+                } else if (strncasecmp(item, "slice=", strlen("slice=")) == 0) {
+                        s->slice_height = atoi(item + strlen("slice="));
+                        ok = ok && s->slice_height >= 2 && s->slice_height <= 255;
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unknown option: %s\n", item);
+                        ok = false;
+                }
+        }
+        free(tmp);
+        if (!ok) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong configuration (bpp >= 1, q 0-%d, slice 2-255)!\n", ULW_MAX_Q);
+                delete s;
+                return NULL;
+        }
+
+        module_init_default(&s->module_data);
+        s->module_data.cls = MODULE_CLASS_DATA;
+        s->module_data.priv_data = s;
+        s->module_data.deleter = ulw_compress_done;
+        module_register(&s->module_data, parent);
+
+        return &s->module_data;
+}
+
+static bool configure_with(struct state_video_compress_ulw *s, struct video_desc desc)
+{
+        if (desc.width % 2 != 0 || desc.width > UINT16_MAX || desc.height > UINT16_MAX) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported resolution %ux%u (width must be even)!\n",
+                                desc.width, desc.height);
+                return false;
+        }
+        codec_t codecs_8b[] = { UYVY, Y216, VIDEO_CODEC_NONE };
+        codec_t codecs_10b[] = { Y216, UYVY, VIDEO_CODEC_NONE };
+        s->decoder = get_best_decoder_from(desc.color_spec,
+                        get_bits_per_component(desc.color_spec) > 8 ? codecs_10b : codecs_8b, &s->in_codec);
+        if (!s->decoder) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported codec: %s\n", get_codec_name(desc.color_spec));
+                return false;
+        }
+        s->decoded = nullptr;
+        if (s->decoder != vc_memcpy) {
+                s->decoded = unique_ptr<unsigned char []>(new unsigned char[vc_get_linesize(desc.width, s->in_codec) * desc.height]);
+        }
+
+        struct video_desc compressed_desc = desc;
+        compressed_desc.color_spec = ULW;
+        compressed_desc.tile_count = 1;
+        s->pool.reconfigure(compressed_desc, ulw_max_size(desc.width, desc.height, s->slice_height, s->bpp));
+
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "Compressing %s as %d-bit 4:2:2, %s %g\n", get_codec_name(desc.color_spec),
+                        s->in_codec == Y216 ? 10 : 8, s->bpp > 0 ? "bpp" : "q", s->bpp > 0 ? s->bpp : s->q);
+        return true;
+}
+
+shared_ptr<video_frame> ulw_compress_tile(struct module *mod, shared_ptr<video_frame> tx)
+{
+        auto *s = (struct state_video_compress_ulw *) mod->priv_data;
+
+        if (!video_desc_eq_excl_param(video_desc_from_frame(tx.get()),
+                                s->saved_desc, PARAM_TILE_COUNT)) {
+                if (configure_with(s, video_desc_from_frame(tx.get()))) {
+                        s->saved_desc = video_desc_from_frame(tx.get());
+                } else {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Reconfiguration failed!\n");
+                        return NULL;
+                }
+        }
+
+        struct tile *in_tile = &tx->tiles[0];
+        const unsigned char *in_buffer = (unsigned char *) in_tile->data;
+        const int in_linesize = vc_get_linesize(in_tile->width, s->in_codec);
+        if (s->decoder != vc_memcpy) {
+                parallel_pix_conv((int) in_tile->height, (char *) s->decoded.get(), in_linesize, in_tile->data,
+                                vc_get_linesize(in_tile->width, tx->color_spec), s->decoder, get_cpu_core_count());
+                in_buffer = s->decoded.get();
+        }
+
+        shared_ptr<video_frame> out = s->pool.get_frame();
+        out->tiles[0].data_len = ulw_encode(in_buffer, in_linesize, s->in_codec == Y216 ? ULW_Y216 : ULW_UYVY,
+                        (int) in_tile->width, (int) in_tile->height, s->in_codec == Y216 ? 10 : 8,
+                        s->slice_height, s->bpp, s->q, (unsigned char *) out->tiles[0].data);
+
+        return out;
+}
+
+static void ulw_compress_done(struct module *mod)
+{
+        auto *s = (struct state_video_compress_ulw *) mod->priv_data;
+
+        delete s;
+}
+
+const struct video_compress_info ulw_info = {
+        "ulw",
+        ulw_compress_init,
+        NULL,
+        ulw_compress_tile,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL
+};
+
+REGISTER_MODULE(ulw, &ulw_info, LIBRARY_CLASS_VIDEO_COMPRESS, VIDEO_COMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
@@ -245,6 +245,15 @@ int decompress_get_property(struct state_decompress *s, int property, void *val,
         return s->functions->get_property(s->state, property, val, len);
 }
 
+/** @copydoc decompress_set_property_t */
+int decompress_set_property(struct state_decompress *s, int property, const void *val, size_t len)
+{
+        if (s->functions->set_property == nullptr) {
+                return FALSE;
+        }
+        return s->functions->set_property(s->state, property, val, len);
+}
+
 /** @copydoc decompress_done_t */
 void decompress_done(struct state_decompress *s)
 {
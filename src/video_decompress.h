@@ -39,7 +39,7 @@
  *
  */
 
-#define VIDEO_DECOMPRESS_ABI_VERSION 6
+#define VIDEO_DECOMPRESS_ABI_VERSION 7
 
 /**
  * @defgroup video_decompress Video Decompress
@@ -62,6 +62,13 @@ struct state_decompress;
  */
 #define DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME  1          /* int */
 
+/**
+ * Settable property - decoder should skip frames that are not used as a
+ * reference (returning DECODER_SKIPPED) to catch up if the receiver is
+ * overloaded.
+ */
+#define DECOMPRESS_PROPERTY_SKIP_NONREF  2                      /* bool */
+
 /**
  * initializes decompression and returns internal state
  */
@@ -86,6 +93,7 @@ typedef enum {
         DECODER_GOT_FRAME,    //Frame decoded and written to destination
         DECODER_GOT_CODEC,    ///< Internal pixel format was determined
         DECODER_UNSUPP_PIXFMT, ///< Decoder can't decode to selected out_codec
+        DECODER_SKIPPED,      ///< Frame intentionally not decoded (@ref DECOMPRESS_PROPERTY_SKIP_NONREF)
 } decompress_status;
 
 /**
@@ -125,6 +133,15 @@ typedef decompress_status (*decompress_decompress_t)(
  */
 typedef  int (*decompress_get_property_t)(void *state, int property, void *val, size_t *len);
 
+/**
+ * @param state decoder state
+ * @param property  ID of the property
+ * @param val value to be set
+ * @param len size of val
+ * @retval FALSE if property is not supported
+ */
+typedef  int (*decompress_set_property_t)(void *state, int property, const void *val, size_t len);
+
 /**
  * Cleanup function
  */
@@ -144,6 +161,7 @@ struct video_decompress_info {
         decompress_get_property_t get_property;
         decompress_done_t done;
         decompress_get_priority_t get_decompress_priority;
+        decompress_set_property_t set_property; ///< optional, may be NULL
 };
 
 bool decompress_init_multi(codec_t compression,
@@ -179,6 +197,11 @@ int decompress_get_property(struct state_decompress *state,
                 void *val,
                 size_t *len);
 
+int decompress_set_property(struct state_decompress *state,
+                int property,
+                const void *val,
+                size_t len);
+
 void decompress_done(struct state_decompress *);
 
 #ifdef __cplusplus
@@ -535,6 +535,7 @@ static const struct video_decompress_info j2k_decompress_info = {
         j2k_decompress_get_property,
         j2k_decompress_done,
         j2k_decompress_get_priority,
+        nullptr,
 };
 
 REGISTER_MODULE(j2k, &j2k_decompress_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
@@ -0,0 +1,413 @@
+/**
+ * @file   video_decompress/cpu_dxt.cpp
+ * @brief  DXT1, DXT1_YUV and DXT5 YCoCg decompression running on the CPU
+ *
+ * Fallback for receivers without a GPU (the RTDXT decompressor needs
+ * OpenGL). Produces the same output as the RTDXT display shaders. A row of
+ * blocks is expanded to 4 planar 8-bit lines, which are then converted to
+ * RGBA or UYVY, so that the loops are vectorized by the compiler. The
+ * decoder is compiled for the baseline target and additionally for AVX2,
+ * selected in runtime. Rows of blocks are distributed among the worker
+ * pool, tiles are decoded concurrently by the video decoder.
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/misc.h"
+#include "utils/simd_lanes.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[CPU DXT dec.] "
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+using namespace std;
+
+namespace {
+
+static ALWAYS_INLINE int clamp255(int x) {
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static ALWAYS_INLINE uint32_t load_u16(const uint8_t *in) {
+        return in[0] | in[1] << 8U;
+}
+
+static ALWAYS_INLINE uint32_t load_u32(const uint8_t *in) {
+        return load_u16(in) | load_u16(in + 2) << 16U;
+}
+
+/// expands RGB565 to 8-bit channels
+static ALWAYS_INLINE void expand_565(uint32_t c, int out[3]) {
+        int r = (c >> 11U) & 0x1FU;
+        int g = (c >> 5U) & 0x3FU;
+        int b = c & 0x1FU;
+        out[0] = (r << 3U) | (r >> 2U);
+        out[1] = (g << 2U) | (g >> 4U);
+        out[2] = (b << 3U) | (b >> 2U);
+}
+
+/**
+ * Computes the 4-entry color palette of a block.
+ * @param dxt1  DXT1 (color0 <= color1 selects the 3-color mode), otherwise
+ *              the color block of DXT5 (always 4 colors)
+ */
+static ALWAYS_INLINE void color_palette(uint32_t endpoints, bool dxt1, int pal[4][3])
+{
+        uint32_t c0 = endpoints & 0xFFFFU;
+        uint32_t c1 = endpoints >> 16U;
+        expand_565(c0, pal[0]);
+        expand_565(c1, pal[1]);
+        for (int c = 0; c < 3; ++c) {
+                if (!dxt1 || c0 > c1) {
+                        pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+                        pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+                } else {
+                        pal[2][c] = (pal[0][c] + pal[1][c]) / 2;
+                        pal[3][c] = 0;
+                }
+        }
+}
+
+/// decodes a DXT1 block to planes[y][channel][x]
+static ALWAYS_INLINE void decode_dxt1_block(const uint8_t *in, uint8_t *const planes[4][3], int x0)
+{
+        int pal[4][3];
+        color_palette(load_u32(in), true, pal);
+        uint32_t indices = load_u32(in + 4);
+        for (int i = 0; i < 16; ++i) {
+                const int *col = pal[(indices >> (2U * i)) & 3U];
+                for (int c = 0; c < 3; ++c) {
+                        planes[i / 4][c][x0 + i % 4] = col[c];
+                }
+        }
+}
+
+/// decodes a DXT5 YCoCg block (Y in alpha, CoCg and scale in color) to RGB planes[y][channel][x]
+static ALWAYS_INLINE void decode_dxt5ycocg_block(const uint8_t *in, uint8_t *const planes[4][3], int x0)
+{
+        int a[8];
+        a[0] = in[0];
+        a[1] = in[1];
+        if (a[0] > a[1]) {
+                for (int k = 1; k < 7; ++k) {
+                        a[k + 1] = ((7 - k) * a[0] + k * a[1]) / 7;
+                }
+        } else {
+                for (int k = 1; k < 5; ++k) {
+                        a[k + 1] = ((5 - k) * a[0] + k * a[1]) / 5;
+                }
+                a[6] = 0;
+                a[7] = 255;
+        }
+        uint64_t alpha_indices = 0;
+        for (int k = 0; k < 6; ++k) {
+                alpha_indices |= (uint64_t) in[2 + k] << (8U * k);
+        }
+
+        int pal[4][3];
+        uint32_t endpoints = load_u32(in + 8);
+        color_palette(endpoints, false, pal);
+        // blue of color0 holds the CoCg scale - 1
+        const int shift = (endpoints & 0x1FU) == 3 ? 2 : (endpoints & 0x1FU) == 1 ? 1 : 0;
+        uint32_t indices = load_u32(in + 12);
+        for (int i = 0; i < 16; ++i) {
+                const int *col = pal[(indices >> (2U * i)) & 3U];
+                int y = a[(alpha_indices >> (3U * i)) & 7U];
+                int co = (col[0] - 128) >> shift;
+                int cg = (col[1] - 128) >> shift;
+                uint8_t *const *line = planes[i / 4];
+                line[0][x0 + i % 4] = clamp255(y + co - cg);
+                line[1][x0 + i % 4] = clamp255(y + cg);
+                line[2][x0 + i % 4] = clamp255(y - co - cg);
+        }
+}
+
+/// planar line (R, G, B) to RGBA
+static ALWAYS_INLINE void rgb_to_rgba(uint8_t *const planes[3], int width, int rshift, int gshift, int bshift, uint8_t *out)
+{
+        const uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift | 0xFFU << gshift | 0xFFU << bshift);
+        for (int x = 0; x < width; ++x) {
+                uint32_t px = (uint32_t) planes[0][x] << rshift | (uint32_t) planes[1][x] << gshift |
+                        (uint32_t) planes[2][x] << bshift | alpha_mask;
+                memcpy(out + 4 * x, &px, sizeof px);
+        }
+}
+
+/// planar line (R, G, B) to UYVY - BT.709 limited range, same as the RTDXT shader
+static ALWAYS_INLINE void rgb_to_uyvy(uint8_t *const planes[3], int width, uint8_t *out)
+{
+        for (int x = 0; x < (width + 1) / 2; ++x) {
+                int r0 = planes[0][2 * x];
+                int g0 = planes[1][2 * x];
+                int b0 = planes[2][2 * x];
+                int r1 = planes[0][2 * x + 1];
+                int g1 = planes[1][2 * x + 1];
+                int b1 = planes[2][2 * x + 1];
+                int r = r0 + r1;
+                int g = g0 + g1;
+                int b = b0 + b1;
+                out[4 * x] = (-103 * r - 347 * g + 450 * b + (128 << 11) + 1024) >> 11;
+                out[4 * x + 1] = (187 * r0 + 629 * g0 + 63 * b0 + (16 << 10) + 512) >> 10;
+                out[4 * x + 2] = (450 * r - 408 * g - 42 * b + (128 << 11) + 1024) >> 11;
+                out[4 * x + 3] = (187 * r1 + 629 * g1 + 63 * b1 + (16 << 10) + 512) >> 10;
+        }
+}
+
+/// planar line (Y, Cb, Cr) to RGBA - coefficients of the RTDXT DXT1_YUV shader
+static ALWAYS_INLINE void yuv_to_rgba(uint8_t *const planes[3], int width, int rshift, int gshift, int bshift, uint8_t *out)
+{
+        const uint32_t alpha_mask = 0xFFFFFFFFU ^ (0xFFU << rshift | 0xFFU << gshift | 0xFFU << bshift);
+        for (int x = 0; x < width; ++x) {
+                int y = 1192 * (planes[0][x] - 16);
+                int u = planes[1][x] - 128;
+                int v = planes[2][x] - 128;
+                uint32_t r = clamp255((y + 1860 * v + 512) >> 10);
+                uint32_t g = clamp255((y - 457 * u - 948 * v + 512) >> 10);
+                uint32_t b = clamp255((y + 2351 * u + 512) >> 10);
+                uint32_t px = r << rshift | g << gshift | b << bshift | alpha_mask;
+                memcpy(out + 4 * x, &px, sizeof px);
+        }
+}
+
+/// planar line (Y, Cb, Cr) to UYVY
+static ALWAYS_INLINE void yuv_to_uyvy(uint8_t *const planes[3], int width, uint8_t *out)
+{
+        for (int x = 0; x < (width + 1) / 2; ++x) {
+                out[4 * x] = (planes[1][2 * x] + planes[1][2 * x + 1] + 1) >> 1;
+                out[4 * x + 1] = planes[0][2 * x];
+                out[4 * x + 2] = (planes[2][2 * x] + planes[2][2 * x + 1] + 1) >> 1;
+                out[4 * x + 3] = planes[0][2 * x + 1];
+        }
+}
+
+struct decode_rows_data {
+        const uint8_t *src;
+        int width;
+        int height;
+        codec_t in_codec;
+        codec_t out_codec;
+        int rshift, gshift, bshift;
+        uint8_t *out;
+        int pitch;
+};
+
+/// decodes rows of blocks [begin, end)
+static ALWAYS_INLINE void decode_rows(const struct decode_rows_data *d, int begin, int end)
+{
+        const int blocks_x = (d->width + 3) / 4;
+        const int padded_width = blocks_x * 4;
+        const int block_size = d->in_codec == DXT5 ? 16 : 8;
+        vector<uint8_t> buf(4 * 3 * padded_width);
+        uint8_t *planes[4][3];
+        for (int y = 0; y < 4; ++y) {
+                for (int c = 0; c < 3; ++c) {
+                        planes[y][c] = buf.data() + (y * 3 + c) * padded_width;
+                }
+        }
+
+        for (int by = begin; by < end; ++by) {
+                const uint8_t *in = d->src + (size_t) by * blocks_x * block_size;
+                for (int bx = 0; bx < blocks_x; ++bx) {
+                        if (d->in_codec == DXT5) {
+                                decode_dxt5ycocg_block(in + bx * block_size, planes, bx * 4);
+                        } else {
+                                decode_dxt1_block(in + bx * block_size, planes, bx * 4);
+                        }
+                }
+                for (int y = 0; y < 4 && by * 4 + y < d->height; ++y) {
+                        uint8_t *out = d->out + (size_t) (by * 4 + y) * d->pitch;
+                        if (d->in_codec == DXT1_YUV) {
+                                if (d->out_codec == RGBA) {
+                                        yuv_to_rgba(planes[y], d->width, d->rshift, d->gshift, d->bshift, out);
+                                } else {
+                                        yuv_to_uyvy(planes[y], d->width, out);
+                                }
+                        } else {
+                                if (d->out_codec == RGBA) {
+                                        rgb_to_rgba(planes[y], d->width, d->rshift, d->gshift, d->bshift, out);
+                                } else {
+                                        rgb_to_uyvy(planes[y], d->width, out);
+                                }
+                        }
+                }
+        }
+}
+
+static void decode_rows_generic(void *arg, int begin, int end)
+{
+        decode_rows((const struct decode_rows_data *) arg, begin, end);
+}
+
+#ifdef PIXFMT_SIMD_X86
+__attribute__((target("avx2")))
+static void decode_rows_avx2(void *arg, int begin, int end)
+{
+        decode_rows((const struct decode_rows_data *) arg, begin, end);
+}
+#endif
+
+struct state_cpu_dxt_decompress {
+        struct video_desc desc;
+        int rshift, gshift, bshift;
+        int pitch;
+        codec_t out_codec;
+        size_t compressed_len;
+        range_task_t decode_rows_func;
+};
+
+static void *cpu_dxt_decompress_init(void)
+{
+        auto *s = new state_cpu_dxt_decompress();
+        s->decode_rows_func = decode_rows_generic;
+#ifdef PIXFMT_SIMD_X86
+        if (avx2_available()) {
+                s->decode_rows_func = decode_rows_avx2;
+        }
+#endif
+        return s;
+}
+
+static int cpu_dxt_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        auto *s = (struct state_cpu_dxt_decompress *) state;
+
+        s->desc = desc;
+        s->rshift = rshift;
+        s->gshift = gshift;
+        s->bshift = bshift;
+        s->pitch = pitch;
+        s->out_codec = out_codec;
+        s->compressed_len = (size_t) (desc.width + 3) / 4 * ((desc.height + 3) / 4) * (desc.color_spec == DXT5 ? 16 : 8);
+
+        return TRUE;
+}
+
+static decompress_status cpu_dxt_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, struct pixfmt_desc *internal_prop)
+{
+        auto *s = (struct state_cpu_dxt_decompress *) state;
+        UNUSED(frame_seq);
+        UNUSED(callbacks);
+        UNUSED(internal_prop);
+
+        if (src_len < s->compressed_len) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame too short (%u B, expected %zu B)!\n", src_len, s->compressed_len);
+                return DECODER_NO_FRAME;
+        }
+
+        struct decode_rows_data d{};
+        d.src = buffer;
+        d.width = s->desc.width;
+        d.height = s->desc.height;
+        d.in_codec = s->desc.color_spec;
+        d.out_codec = s->out_codec;
+        d.rshift = s->rshift;
+        d.gshift = s->gshift;
+        d.bshift = s->bshift;
+        d.out = dst;
+        d.pitch = s->pitch;
+        const int block_rows = (d.height + 3) / 4;
+        task_run_parallel_range(s->decode_rows_func, &d, block_rows, max(1, block_rows / (4 * get_cpu_core_count())),
+                        get_cpu_core_count());
+
+        return DECODER_GOT_FRAME;
+}
+
+static int cpu_dxt_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        int ret = FALSE;
+
+        switch(property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = TRUE;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
+                default:
+                        ret = FALSE;
+        }
+
+        return ret;
+}
+
+static void cpu_dxt_decompress_done(void *state)
+{
+        delete (struct state_cpu_dxt_decompress *) state;
+}
+
+/// lower priority than RTDXT (500), which is preferred if GPU is present
+static int cpu_dxt_decompress_get_priority(codec_t compression, struct pixfmt_desc internal, codec_t ugc) {
+        UNUSED(internal);
+        if (compression != DXT1 && compression != DXT1_YUV && compression != DXT5) {
+                return -1;
+        }
+        if (ugc != RGBA && ugc != UYVY) {
+                return -1;
+        }
+        return 700;
+}
+
+static const struct video_decompress_info cpu_dxt_info = {
+        cpu_dxt_decompress_init,
+        cpu_dxt_decompress_reconfigure,
+        cpu_dxt_decompress,
+        cpu_dxt_decompress_get_property,
+        cpu_dxt_decompress_done,
+        cpu_dxt_decompress_get_priority,
+        nullptr,
+};
+
+REGISTER_MODULE(cpu_dxt, &cpu_dxt_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
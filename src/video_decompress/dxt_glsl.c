@@ -71,12 +71,7 @@ static int configure_with(struct state_decompress_rtdxt *decompressor, struct vi
 {
         enum dxt_type type;
 
-        if(!init_gl_context(&decompressor->context, GL_CONTEXT_ANY)) {
-                fprintf(stderr, "[RTDXT decompress] Failed to create GL context.\n");
-                exit_uv(EXIT_FAILURE);
-                decompressor->compressed_len = 0;
-                return FALSE;
-        }
+        gl_context_make_current(&decompressor->context);
 
         if(desc.color_spec == DXT5) {
                 type = DXT_TYPE_DXT5_YCOCG;
@@ -114,6 +109,14 @@ static void * dxt_glsl_decompress_init(void)
         s = (struct state_decompress_rtdxt *) malloc(sizeof(struct state_decompress_rtdxt));
         s->configured = FALSE;
 
+        // fail early without a GPU so that a CPU decompressor is selected
+        if(!init_gl_context(&s->context, GL_CONTEXT_ANY)) {
+                log_msg(LOG_LEVEL_VERBOSE, "[RTDXT decompress] Failed to create GL context.\n");
+                free(s);
+                return NULL;
+        }
+        gl_context_make_current(NULL);
+
         return s;
 }
 
@@ -133,7 +136,7 @@ static int dxt_glsl_decompress_reconfigure(void *state, struct video_desc desc,
         } else {
                 gl_context_make_current(&s->context);
                 dxt_decoder_destroy(s->decoder);
-                destroy_gl_context(&s->context);
+                s->configured = FALSE;
                 ret = configure_with(s, desc);
         }
 
@@ -225,8 +228,8 @@ static void dxt_glsl_decompress_done(void *state)
                 gl_context_make_current(&s->context);
                 dxt_decoder_destroy(s->decoder);
                 gl_context_make_current(NULL);
-                destroy_gl_context(&s->context);
         }
+        destroy_gl_context(&s->context);
         free(s);
 }
 
@@ -248,6 +251,7 @@ static const struct video_decompress_info dxt_glsl_info = {
         dxt_glsl_decompress_get_property,
         dxt_glsl_decompress_done,
         dxt_glsl_decompress_get_priority,
+        NULL,
 };
 
 REGISTER_MODULE(dxt_glsl, &dxt_glsl_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
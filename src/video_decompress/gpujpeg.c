@@ -52,8 +52,30 @@
 #include <stdlib.h>
 
 #include "lib_common.h"
+#include "utils/frame_alloc.h"
 #include "utils/macros.h"
 
+#ifdef HAVE_CUDA
+#include <cuda_runtime.h>
+
+static bool pin_host(void *ptr, size_t size)
+{
+        if (cudaHostRegister(ptr, size, cudaHostRegisterPortable) != cudaSuccess) {
+                cudaGetLastError(); // reset the error
+                return false;
+        }
+        return true;
+}
+
+static void unpin_host(void *ptr)
+{
+        cudaHostUnregister(ptr);
+}
+
+/// display frames allocated as pinnable (eg. DeckLink) are then downloaded by DMA
+static const struct frame_pin_ops cuda_pin_ops = { pin_host, unpin_host };
+#endif
+
 #define MOD_NAME "[GPUJPEG dec.] "
 
 struct state_decompress_gpujpeg {
@@ -140,7 +162,9 @@ static void * gpujpeg_decompress_init(void)
                 free(s);
                 return NULL;
         }
-
+#ifdef HAVE_CUDA
+        frame_alloc_set_pin_ops(&cuda_pin_ops);
+#endif
 
         return s;
 }
@@ -313,6 +337,9 @@ static void gpujpeg_decompress_done(void *state)
         if(s->decoder) {
                 gpujpeg_decoder_destroy(s->decoder);
         }
+#ifdef HAVE_CUDA
+        frame_alloc_unset_pin_ops(&cuda_pin_ops);
+#endif
         free(s);
 }
 
@@ -354,6 +381,7 @@ static const struct video_decompress_info gpujpeg_info = {
         gpujpeg_decompress_get_property,
         gpujpeg_decompress_done,
         gpujpeg_decompress_get_priority,
+        NULL,
 };
 
 REGISTER_MODULE(gpujpeg, &gpujpeg_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
@@ -50,7 +50,10 @@
 #include "tv.h"
 #include "rtp/rtpdec_h264.h"
 #include "rtp/rtpenc_h264.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
 #include "utils/misc.h" // get_cpu_core_count()
+#include "utils/parallel_conv.h"
 #include "utils/worker.h"
 #include "video.h"
 #include "video_decompress.h"
@@ -59,6 +62,7 @@
 #include <libswscale/swscale.h>
 #endif // defined HAVE_SWSCALE
 #include <limits.h>
+#include <math.h>
 
 #include "hwaccel_libav_common.h"
 #include "hwaccel_vaapi.h"
@@ -66,6 +70,16 @@
 #include "hwaccel_videotoolbox.h"
 
 #define MOD_NAME "[lavd] "
+#define DELAY_RING 64        ///< submission times of the packets being decoded (must be > frame threads)
+#define MAX_FRAME_THREADS 16
+#define AUTO_WINDOW 30       ///< frames measured before the auto mode decides
+
+enum lavd_threading {
+        LAVD_THREADING_UNSET,      ///< lavd-thread-count semantics
+        LAVD_THREADING_LOW_DELAY,  ///< slice threads only, no decode delay
+        LAVD_THREADING_THROUGHPUT, ///< frame threads, output delayed by at most max_delay frames
+        LAVD_THREADING_AUTO,       ///< low delay until the decoding keeps up with the frame rate
+};
 
 struct state_libavcodec_decompress {
         AVCodecContext  *codec_ctx;
@@ -99,9 +113,24 @@ struct state_libavcodec_decompress {
         _Bool sps_vps_found; ///< to avoid initial error flood, start decoding after SPS (H.264) or VPS (HEVC) was received
         double mov_avg_comp_duration;
         long mov_avg_frames;
+
+        unsigned char   *direct_dst; ///< output buffer of the current decompress call for get_buffer_callback(), NULL outside it
+        bool             direct_decode_logged;
+
+        enum lavd_threading threading;
+        int              max_delay;     ///< max frame threads - 1
+        int              frame_threads; ///< frame threads in use (0 - low-delay), auto mode may switch
+        double           auto_avg_decode_ns;
+        int              auto_frames;
+        int64_t          pkt_count;
+        bool             skip_nonref;   ///< DECOMPRESS_PROPERTY_SKIP_NONREF
+        time_ns_t        submit_time[DELAY_RING];
+        struct metrics_histogram *metric_decode_time;
+        struct metrics_histogram *metric_decode_delay;
 };
 
 static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const enum AVPixelFormat *fmt);
+static int get_buffer_callback(struct AVCodecContext *s, AVFrame *frame, int flags);
 
 static void deconfigure(struct state_libavcodec_decompress *s)
 {
@@ -184,6 +213,21 @@ static void set_codec_context_params(struct state_libavcodec_decompress *s)
                         log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Warning: Codec doesn't support slice-based multithreading.\n");
                 }
         }
+        if (s->threading != LAVD_THREADING_UNSET) { // overrides lavd-thread-count
+                s->codec_ctx->thread_count = 0;
+                s->codec_ctx->thread_type = s->codec_ctx->codec->capabilities & AV_CODEC_CAP_SLICE_THREADS ? FF_THREAD_SLICE : 0;
+                req_low_delay = true;
+                if (s->frame_threads > 0) {
+                        if (s->codec_ctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) {
+                                s->codec_ctx->thread_count = s->frame_threads;
+                                s->codec_ctx->thread_type = FF_THREAD_FRAME;
+                                req_low_delay = false; // libavcodec disables frame threads with low delay
+                        } else {
+                                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Codec doesn't support frame-based multithreading, using low-delay mode.\n");
+                                s->frame_threads = 0;
+                        }
+                }
+        }
         log_msg(LOG_LEVEL_INFO, MOD_NAME "Setting thread count to %d, type: %s\n", s->codec_ctx->thread_count, lavc_thread_type_to_str(s->codec_ctx->thread_type));
 
         s->codec_ctx->flags |= req_low_delay ? AV_CODEC_FLAG_LOW_DELAY : 0;
@@ -192,6 +236,8 @@ static void set_codec_context_params(struct state_libavcodec_decompress *s)
         s->codec_ctx->pix_fmt = AV_PIX_FMT_NONE;
         // callback to negotiate pixel format that is supported by UG
         s->codec_ctx->get_format = get_format_callback;
+        // decode directly to the output buffer if the layouts match
+        s->codec_ctx->get_buffer2 = get_buffer_callback;
         s->codec_ctx->opaque = s;
 
         if (strstr(s->codec_ctx->codec->name, "cuvid") != NULL) {
@@ -378,10 +424,44 @@ static bool configure_with(struct state_libavcodec_decompress *s,
         return true;
 }
 
+ADD_TO_PARAM("lavd-threading", "* lavd-threading=low-delay|throughput[:<max_delay>]|auto[:<max_delay>]\n"
+                "  low-delay - slice threads only; throughput - frame threads, frames are output\n"
+                "  delayed by at most <max_delay> frames (default nr of cores - 1, max 15);\n"
+                "  auto - low-delay until the decoding doesn't keep up with the frame rate,\n"
+                "  then the smallest sufficient number of frame threads. Overrides lavd-thread-count.\n");
+static void parse_threading(struct state_libavcodec_decompress *s)
+{
+        s->max_delay = MAX(MIN(get_cpu_core_count(), MAX_FRAME_THREADS) - 1, 1);
+        const char *opt = get_commandline_param("lavd-threading");
+        if (opt == NULL) {
+                return;
+        }
+        const char *delay = strchr(opt, ':');
+        size_t mode_len = delay != NULL ? (size_t) (delay - opt) : strlen(opt);
+        if (strncmp(opt, "low-delay", mode_len) == 0 && mode_len > 0) {
+                s->threading = LAVD_THREADING_LOW_DELAY;
+        } else if (strncmp(opt, "throughput", mode_len) == 0 && mode_len > 0) {
+                s->threading = LAVD_THREADING_THROUGHPUT;
+        } else if (strncmp(opt, "auto", mode_len) == 0 && mode_len > 0) {
+                s->threading = LAVD_THREADING_AUTO;
+        } else {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Unknown threading mode: %s\n", opt);
+                return;
+        }
+        if (delay != NULL) {
+                s->max_delay = MAX(MIN(atoi(delay + 1), MAX_FRAME_THREADS - 1), 1);
+        }
+        s->frame_threads = s->threading == LAVD_THREADING_THROUGHPUT ? s->max_delay + 1 : 0;
+}
+
 static void * libavcodec_decompress_init(void)
 {
         struct state_libavcodec_decompress *s =
                 calloc(1, sizeof(struct state_libavcodec_decompress));
+        parse_threading(s);
+        s->metric_decode_time = metrics_histogram_register("lavd_decode_duration", "Libavcodec decode call duration", NULL);
+        s->metric_decode_delay = metrics_histogram_register("lavd_decode_delay",
+                        "Time from passing a packet to libavcodec until its frame is decoded", NULL);
 
         ug_set_av_logging();
 
@@ -411,6 +491,10 @@ static int libavcodec_decompress_reconfigure(void *state, struct video_desc desc
         }
         s->out_codec = out_codec;
         s->desc = desc;
+        // new stream - auto mode starts again with low delay
+        s->frame_threads = s->threading == LAVD_THREADING_THROUGHPUT ? s->max_delay + 1 : 0;
+        s->auto_frames = 0;
+        s->auto_avg_decode_ns = 0;
 
         deconfigure(s);
         if (libav_codec_has_extradata(desc.color_spec)) {
@@ -511,7 +595,8 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
                 }
                 for(const enum AVPixelFormat *it = fmt; *it != AV_PIX_FMT_NONE; it++){
                         for(unsigned i = 0; i < sizeof(accels) / sizeof(accels[0]); i++){
-                                if(*it == accels[i].pix_fmt && !state->block_accel[accels[i].accel_type])
+                                if(*it == accels[i].pix_fmt && !state->block_accel[accels[i].accel_type]
+                                                && (state->out_codec != HW_VAAPI || accels[i].accel_type == HWACCEL_VAAPI))
                                 {
                                         int ret = accels[i].init_func(s, &state->hwaccel, state->out_codec);
                                         if(ret < 0){
@@ -523,7 +608,7 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
                         }
                 }
                 log_msg(LOG_LEVEL_WARNING, "[lavd] Falling back to software decoding!\n");
-                if (state->out_codec == HW_VDPAU) {
+                if (codec_is_hw_accelerated(state->out_codec)) {
                         return AV_PIX_FMT_NONE;
                 }
         }
@@ -554,6 +639,56 @@ static enum AVPixelFormat get_format_callback(struct AVCodecContext *s, const en
         return AV_PIX_FMT_NONE;
 }
 
+static void direct_buffer_free(void *opaque, uint8_t *data)
+{
+        UNUSED(opaque), UNUSED(data); // owned by the caller of libavcodec_decompress()
+}
+
+/**
+ * Lets the decoder write the picture directly to the output buffer (usually
+ * the display framebuffer) if its layout is exactly the requested UG pixel
+ * format so that the conversion (memcpy) is not needed.
+ *
+ * This is possible only if the decoder doesn't keep the picture as a
+ * reference and no frame threading is used, because the output buffer is
+ * valid only during the particular libavcodec_decompress() call. Otherwise
+ * the default libavcodec allocator, which uses a buffer pool, is used.
+ */
+static int get_buffer_callback(struct AVCodecContext *s, AVFrame *frame, int flags)
+{
+        struct state_libavcodec_decompress *state = (struct state_libavcodec_decompress *) s->opaque;
+        if (state->direct_dst == NULL || (flags & AV_GET_BUFFER_FLAG_REF) != 0 || frame->hw_frames_ctx != NULL
+                        || (s->codec->capabilities & AV_CODEC_CAP_DR1) == 0 || (s->active_thread_type & FF_THREAD_FRAME) != 0
+                        || frame->width != (int) state->desc.width || frame->height != (int) state->desc.height
+                        || state->out_codec == VIDEO_CODEC_NONE || codec_is_planar(state->out_codec)
+                        || get_av_to_ug_pixfmt(frame->format) != state->out_codec) {
+                return avcodec_default_get_buffer2(s, frame, flags);
+        }
+
+        int width = frame->width;
+        int height = frame->height;
+        int linesize_align[AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2(s, &width, &height, linesize_align);
+        const size_t buf_len = (size_t) state->pitch * frame->height;
+        if (height > frame->height || vc_get_linesize(width, state->out_codec) > state->pitch
+                        || state->pitch % linesize_align[0] != 0 || (uintptr_t) state->direct_dst % linesize_align[0] != 0) {
+                return avcodec_default_get_buffer2(s, frame, flags);
+        }
+
+        frame->buf[0] = av_buffer_create(state->direct_dst, buf_len, direct_buffer_free, NULL, 0);
+        if (frame->buf[0] == NULL) {
+                return AVERROR(ENOMEM);
+        }
+        frame->data[0] = state->direct_dst;
+        frame->linesize[0] = state->pitch;
+        frame->extended_data = frame->data;
+        if (!state->direct_decode_logged) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Decoding directly to the output buffer.\n");
+                state->direct_decode_logged = true;
+        }
+        return 0;
+}
+
 #ifdef HAVE_SWSCALE
 static bool lavd_sws_convert_reconfigure(struct state_libavcodec_decompress_sws *sws, enum AVPixelFormat sws_in_codec,
                 enum AVPixelFormat sws_out_codec, int width, int height)
@@ -639,16 +774,26 @@ struct convert_task_data {
         const av_to_uv_convert_t *convert;
         unsigned char *out_data;
         AVFrame *in_frame;
+        int log2_chroma_h;
         int width;
-        int height;
         int pitch;
         const int *rgb_shift;
 };
 
-static void *convert_task(void *arg) {
+/// converts rows [begin, end) from a view of in_frame starting at row begin
+static void convert_rows(void *arg, int begin, int end) {
         struct convert_task_data *d = arg;
-        av_to_uv_convert(d->convert, (char *) d->out_data, d->in_frame, d->width, d->height, d->pitch, d->rgb_shift);
-        return NULL;
+        AVFrame part;
+        memcpy(part.linesize, d->in_frame->linesize, sizeof d->in_frame->linesize);
+        part.format = d->in_frame->format;
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS; ++plane) {
+                if (d->in_frame->data[plane] == NULL) {
+                        part.data[plane] = NULL;
+                        break;
+                }
+                part.data[plane] = d->in_frame->data[plane] + (((ptrdiff_t) begin * d->in_frame->linesize[plane]) >> (plane == 0 ? 0 : d->log2_chroma_h));
+        }
+        av_to_uv_convert(d->convert, (char *) d->out_data + (size_t) begin * d->pitch, &part, d->width, end - begin, d->pitch, d->rgb_shift);
 }
 
 static void parallel_convert(codec_t out_codec, const av_to_uv_convert_t *convert, char *dst, AVFrame *in, int width, int height, int pitch, int rgb_shift[static restrict 3]) {
@@ -657,27 +802,14 @@ static void parallel_convert(codec_t out_codec, const av_to_uv_convert_t *conver
                 return;
         }
 
-        int cpu_count = get_cpu_core_count();
-
-        struct convert_task_data d[cpu_count];
-        AVFrame parts[cpu_count];
-        for (int i = 0; i < cpu_count; ++i) {
-                int row_height = (height / cpu_count) & ~1; // needs to be even
-                unsigned char *part_dst = (unsigned char *) dst + i * row_height * pitch;
-                memcpy(parts[i].linesize, in->linesize, sizeof in->linesize);
-                const AVPixFmtDescriptor *fmt_desc = av_pix_fmt_desc_get(in->format);
-                for (int plane = 0; plane < AV_NUM_DATA_POINTERS; ++plane) {
-                        if (in->data[plane] == NULL) {
-                                break;
-                        }
-                        parts[i].data[plane] = in->data[plane] + ((i * row_height * in->linesize[plane]) >> (plane == 0 ? 0 : fmt_desc->log2_chroma_h));
-                }
-                if (i == cpu_count - 1) {
-                        row_height = height - row_height * (cpu_count - 1);
-                }
-                d[i] = (struct convert_task_data){convert, part_dst, &parts[i], width, row_height, pitch, rgb_shift};
+        struct convert_task_data d = { convert, (unsigned char *) dst, in,
+                av_pix_fmt_desc_get(in->format)->log2_chroma_h, width, pitch, rgb_shift };
+        size_t row_bytes = pitch;
+        for (int plane = 0; plane < AV_NUM_DATA_POINTERS && in->data[plane] != NULL; ++plane) {
+                row_bytes += in->linesize[plane];
         }
-        task_run_parallel(convert_task, cpu_count, d, sizeof d[0], NULL);
+        // chunk height needs to be even
+        task_run_parallel_range(convert_rows, &d, height, parallel_conv_chunk_rows(row_bytes, 2), get_cpu_core_count());
 }
 
 static _Bool reconfigure_convert_if_needed(struct state_libavcodec_decompress *s, enum AVPixelFormat av_codec, codec_t out_codec, int width, int height) {
@@ -816,9 +948,11 @@ static void check_duration(struct state_libavcodec_decompress *s, double duratio
         } else if (s->codec_ctx->thread_count == 1 && (s->codec_ctx->codec->capabilities & AV_CODEC_CAP_OTHER_THREADS) != 0) {
                 hint = "\"--param lavd-thread-count=<n>\" option with small <n> or 0 (nr of logical cores)";
         }
+        if (s->frame_threads == 0 && (s->codec_ctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0) {
+                hint = "\"--param lavd-threading=auto\" (or throughput)";
+        }
         if (hint) {
-                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Consider adding %s to increase throughput at the expense of latency.\n"
-                                "You may also try to disable low delay decode using 'd' flag.\n",
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Consider adding %s to increase throughput at the expense of latency.\n",
                                 hint);
         }
         s->mov_avg_frames = LONG_MAX;
@@ -850,6 +984,39 @@ static void handle_lavd_error(struct state_libavcodec_decompress *s, int ret)
         }
 }
 
+/**
+ * Auto threading - switches to frame threads if the (low-delay) decoding
+ * doesn't keep up with the frame rate. The decoder is reopened, so the
+ * decoding continues from the next SPS/VPS.
+ */
+static void auto_threading_update(struct state_libavcodec_decompress *s, time_ns_t decode_ns)
+{
+        if (s->threading != LAVD_THREADING_AUTO || s->frame_threads > 0 || s->desc.fps <= 0.0
+                        || (s->codec_ctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) == 0) {
+                return;
+        }
+        s->auto_avg_decode_ns = (s->auto_avg_decode_ns * s->auto_frames + decode_ns) / (s->auto_frames + 1);
+        if (++s->auto_frames < AUTO_WINDOW) {
+                return;
+        }
+        s->auto_frames = AUTO_WINDOW - 1; // keep moving average
+        const double interval_ns = NS_IN_SEC_DBL / s->desc.fps;
+        if (s->auto_avg_decode_ns < 0.9 * interval_ns) {
+                return;
+        }
+        // 25 % headroom + the frame being received
+        int threads = (int) ceil(1.25 * s->auto_avg_decode_ns / interval_ns) + 1;
+        s->frame_threads = MAX(MIN(threads, s->max_delay + 1), 2);
+        log_msg(LOG_LEVEL_NOTICE, MOD_NAME "Decoding takes %.2f ms per frame (frame interval %.2f ms), "
+                        "switching to %d frame threads (delay up to %d frames).\n", s->auto_avg_decode_ns / NS_IN_MS_DBL,
+                        interval_ns / NS_IN_MS_DBL, s->frame_threads, s->frame_threads - 1);
+        deconfigure(s);
+        s->sps_vps_found = 0;
+        if (!libav_codec_has_extradata(s->desc.color_spec)) { // otherwise configured with next frame
+                configure_with(s, s->desc, NULL, 0);
+        }
+}
+
 static bool read_forced_pixfmt(codec_t compress, unsigned char *src, unsigned int src_len, struct pixfmt_desc *internal_props) {
         if (compress == H264) {
                 char expected_prefix[] = { START_CODE_3B, H264_NAL_SEI_PREFIX, sizeof (unsigned char[]) { UG_ORIG_FORMAT_ISO_IEC_11578_GUID } + 1, UG_ORIG_FORMAT_ISO_IEC_11578_GUID };
@@ -894,9 +1061,13 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
 
         s->pkt->size = src_len;
         s->pkt->data = src;
+        s->pkt->pts = s->pkt_count;
 
         time_ns_t t0 = get_time_in_ns();
+        s->submit_time[s->pkt_count++ % DELAY_RING] = t0;
 
+        s->direct_dst = dst;
+        s->codec_ctx->skip_frame = s->skip_nonref ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
         int ret = avcodec_send_packet(s->codec_ctx, s->pkt);
         if (ret == 0 || ret == AVERROR(EAGAIN)) {
                 ret = avcodec_receive_frame(s->codec_ctx, s->frame);
@@ -904,11 +1075,24 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                         s->consecutive_failed_decodes = 0;
                 }
         }
+        s->direct_dst = NULL;
+        time_ns_t t1 = get_time_in_ns();
+        metrics_histogram_record(s->metric_decode_time, t1 - t0);
+        if (ret == AVERROR(EAGAIN) && s->codec_ctx->active_thread_type == FF_THREAD_FRAME) {
+                return DECODER_NO_FRAME; // frame threads being filled
+        }
+        if (ret == AVERROR(EAGAIN) && s->skip_nonref) {
+                return DECODER_SKIPPED;
+        }
         if (ret != 0) {
                 handle_lavd_error(s, ret);
                 return DECODER_NO_FRAME;
         }
-        time_ns_t t1 = get_time_in_ns();
+        int delay_frames = 0;
+        if (s->frame->pts != AV_NOPTS_VALUE && s->frame->pts >= s->pkt_count - DELAY_RING && s->frame->pts < s->pkt_count) {
+                delay_frames = (int) (s->pkt_count - 1 - s->frame->pts);
+                metrics_histogram_record(s->metric_decode_delay, t1 - s->submit_time[s->frame->pts % DELAY_RING]);
+        }
 
         s->frame->opaque = callbacks;
         /* Skip the frame if this is not an I-frame
@@ -932,14 +1116,16 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 if (!reconfigure_convert_if_needed(s, s->frame->format, s->out_codec, s->desc.width, s->desc.height)) {
                         return DECODER_UNSUPP_PIXFMT;
                 }
-                change_pixfmt(s->frame, dst, &s->convert, s->out_codec, s->desc.width,
-                              s->desc.height, s->pitch, s->rgb_shift, &s->sws);
+                if (s->frame->data[0] != dst) { // not decoded directly by get_buffer_callback()
+                        change_pixfmt(s->frame, dst, &s->convert, s->out_codec, s->desc.width,
+                                      s->desc.height, s->pitch, s->rgb_shift, &s->sws);
+                }
                 s->last_frame_seq_initialized = true;
                 s->last_frame_seq = frame_seq;
         }
         time_ns_t t2 = get_time_in_ns();
-        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Decompressing %c frame took %f ms, pixfmt change %f ms.\n", av_get_picture_type_char(s->frame->pict_type),
-                (t1 - t0) / NS_IN_MS_DBL, (t2 - t1) / NS_IN_MS_DBL);
+        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "Decompressing %c frame took %f ms, pixfmt change %f ms, delay %d frames.\n", av_get_picture_type_char(s->frame->pict_type),
+                (t1 - t0) / NS_IN_MS_DBL, (t2 - t1) / NS_IN_MS_DBL, delay_frames);
         check_duration(s, (t2 - t0) / NS_IN_SEC_DBL, (t2 - t1) / NS_IN_MS_DBL);
 
         if (s->out_codec == VIDEO_CODEC_NONE) {
@@ -950,9 +1136,12 @@ static decompress_status libavcodec_decompress(void *state, unsigned char *dst,
                 return DECODER_GOT_CODEC;
         }
 
-        if (avcodec_receive_frame(s->codec_ctx, s->frame) != AVERROR(EAGAIN)) {
+        // with frame threads, further frame would be lost
+        if (s->codec_ctx->active_thread_type != FF_THREAD_FRAME
+                        && avcodec_receive_frame(s->codec_ctx, s->frame) != AVERROR(EAGAIN)) {
                 log_msg(LOG_LEVEL_WARNING, MOD_NAME "Multiple frames decoded at once!\n");
         }
+        auto_threading_update(s, t1 - t0);
 
         return DECODER_GOT_FRAME;
 }
@@ -992,6 +1181,25 @@ static int libavcodec_decompress_get_property(void *state, int property, void *v
         return ret;
 }
 
+static int libavcodec_decompress_set_property(void *state, int property, const void *val, size_t len)
+{
+        struct state_libavcodec_decompress *s =
+                (struct state_libavcodec_decompress *) state;
+
+        switch (property) {
+        case DECOMPRESS_PROPERTY_SKIP_NONREF:
+                if (len < sizeof(bool)) {
+                        return FALSE;
+                }
+                s->skip_nonref = *(const bool *) val;
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%s non-reference frames.\n",
+                                s->skip_nonref ? "Skipping" : "Decoding");
+                return TRUE;
+        default:
+                return FALSE;
+        }
+}
+
 static void libavcodec_decompress_done(void *state)
 {
         struct state_libavcodec_decompress *s =
@@ -1008,7 +1216,7 @@ static void libavcodec_decompress_done(void *state)
  */
 static int libavcodec_decompress_get_priority(codec_t compression, struct pixfmt_desc internal, codec_t ugc) {
         if (get_commandline_param("use-hw-accel") &&
-                        (((compression == H264 || compression == H265) && ugc == HW_VDPAU) ||
+                        (((compression == H264 || compression == H265) && (ugc == HW_VDPAU || ugc == HW_VAAPI)) ||
                          (compression == H265 && ugc == RPI4_8))) {
                 return 200;
         }
@@ -1051,6 +1259,7 @@ static const struct video_decompress_info libavcodec_info = {
         libavcodec_decompress_get_property,
         libavcodec_decompress_done,
         libavcodec_decompress_get_priority,
+        libavcodec_decompress_set_property,
 };
 
 REGISTER_MODULE(libavcodec, &libavcodec_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
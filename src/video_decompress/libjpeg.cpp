@@ -0,0 +1,468 @@
+/**
+ * @file   video_decompress/libjpeg.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  CPU JPEG/MJPEG decompression with libjpeg(-turbo)
+ *
+ * Intended for MJPEG from IP cameras on receivers without a GPU. The
+ * headers (tables) are parsed only when they differ from the previous
+ * frame. If the restart interval is aligned to MCU rows, the image is split
+ * at the restart markers to horizontal stripes which are decoded
+ * concurrently - each stripe is turned into a standalone JPEG (the headers
+ * with adjusted height and the entropy-coded segments with renumbered RST
+ * markers).
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio> // jpeglib.h needs FILE
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "utils/jpeg_reader.h"
+#include "utils/misc.h"
+#include "utils/worker.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[libjpeg dec.] "
+
+using namespace std;
+
+namespace {
+
+struct jpeg_worker {
+        struct jpeg_decompress_struct cinfo;
+        struct {
+                struct jpeg_error_mgr pub;
+                jmp_buf setjmp_buffer;
+        } err;
+        vector<unsigned char> stream; ///< standalone JPEG of the stripe
+        vector<unsigned char> line;   ///< conversion buffer
+
+        jpeg_worker() {
+                cinfo.err = jpeg_std_error(&err.pub);
+                err.pub.error_exit = [](j_common_ptr cinfo) {
+                        char msg[JMSG_LENGTH_MAX];
+                        (*cinfo->err->format_message)(cinfo, msg);
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "%s\n", msg);
+                        longjmp(reinterpret_cast<jpeg_worker *>(cinfo->client_data)->err.setjmp_buffer, 1);
+                };
+                err.pub.output_message = [](j_common_ptr cinfo) {
+                        char msg[JMSG_LENGTH_MAX];
+                        (*cinfo->err->format_message)(cinfo, msg);
+                        log_msg(LOG_LEVEL_DEBUG, MOD_NAME "%s\n", msg);
+                };
+                jpeg_create_decompress(&cinfo);
+                cinfo.client_data = this;
+        }
+        ~jpeg_worker() {
+                jpeg_destroy_decompress(&cinfo);
+        }
+        jpeg_worker(const jpeg_worker &) = delete;
+        jpeg_worker &operator=(const jpeg_worker &) = delete;
+};
+
+struct state_libjpeg_decompress {
+        struct video_desc desc;
+        int rshift, gshift, bshift;
+        int pitch;
+        codec_t out_codec;
+        vector<unique_ptr<jpeg_worker>> workers;
+        uint8_t y_lut[256]; ///< full to limited range
+        uint8_t c_lut[256];
+
+        // cached headers of the last frame
+        vector<unsigned char> header; ///< everything up to the entropy-coded data
+        struct jpeg_info info;
+        int sof_height_off;   ///< offset of the image height in SOF0 within the header
+        bool can_split;
+        int split_rows;       ///< MCU lines in a split unit
+        int split_intervals;  ///< restart intervals in a split unit
+        int total_intervals;
+        int mcu_h;
+        bool fancy_upsampling;
+
+        vector<const unsigned char *> segments; ///< entropy-coded segment starts
+};
+
+/**
+ * Parses the headers unless they are the same as in the previous frame.
+ * @returns pointer to the entropy-coded data or NULL on error
+ */
+static const unsigned char *parse_header(struct state_libjpeg_decompress *s, unsigned char *buffer, unsigned int len)
+{
+        if (!s->header.empty() && len > s->header.size() &&
+                        memcmp(buffer, s->header.data(), s->header.size()) == 0) {
+                return buffer + s->header.size();
+        }
+        s->header.clear();
+        if (jpeg_read_info(buffer, len, &s->info) != 0) {
+                return nullptr;
+        }
+        const size_t hdr_len = s->info.data - buffer;
+        s->header.assign(buffer, buffer + hdr_len);
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "New JPEG headers (%zu B), restart interval %d.\n", hdr_len, s->info.restart_interval);
+
+        s->sof_height_off = -1;
+        for (size_t pos = 2; pos + 4 <= hdr_len && buffer[pos] == 0xFF; ) {
+                if (buffer[pos + 1] == 0xC0 || buffer[pos + 1] == 0xC1) {
+                        s->sof_height_off = pos + 5;
+                        break;
+                }
+                pos += 2 + (buffer[pos + 2] << 8 | buffer[pos + 3]);
+        }
+
+        int max_h = 1;
+        int max_v = 1;
+        if (s->info.comp_count > 1) {
+                for (int i = 0; i < s->info.comp_count; ++i) {
+                        max_h = max(max_h, s->info.sampling_factor_h[i]);
+                        max_v = max(max_v, s->info.sampling_factor_v[i]);
+                }
+        }
+        const int mcus_per_row = (s->info.width + 8 * max_h - 1) / (8 * max_h);
+        const int mcu_rows = (s->info.height + 8 * max_v - 1) / (8 * max_v);
+        const int ri = s->info.restart_interval;
+        s->mcu_h = 8 * max_v;
+        // vertical triangle filter would need chroma of the neighbouring
+        // stripe, disable it to get the same result regardless of splitting
+        s->fancy_upsampling = max_v == 1;
+        s->can_split = false;
+        if (ri > 0 && s->info.interleaved && s->sof_height_off > 0) {
+                if (mcus_per_row % ri == 0) {
+                        s->split_rows = 1;
+                        s->split_intervals = mcus_per_row / ri;
+                        s->can_split = true;
+                } else if (ri % mcus_per_row == 0) {
+                        s->split_rows = ri / mcus_per_row;
+                        s->split_intervals = 1;
+                        s->can_split = true;
+                }
+        }
+        s->total_intervals = ri > 0 ? (mcus_per_row * mcu_rows + ri - 1) / ri : 1;
+        if (!s->can_split) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Restart interval not aligned to MCU rows, "
+                                "the frames will be decoded by a single thread.\n");
+        }
+        return s->info.data;
+}
+
+static bool decode_stream(struct state_libjpeg_decompress *s, struct jpeg_worker *w,
+                const unsigned char *src, size_t len, unsigned char *dst, int height)
+{
+        struct jpeg_decompress_struct *cinfo = &w->cinfo;
+        if (setjmp(w->err.setjmp_buffer)) {
+                jpeg_abort_decompress(cinfo);
+                return false;
+        }
+        jpeg_mem_src(cinfo, src, len);
+        jpeg_read_header(cinfo, TRUE);
+        cinfo->do_fancy_upsampling = s->fancy_upsampling;
+        const bool direct = s->out_codec == RGB ||
+                (s->out_codec == RGBA && s->rshift == 0 && s->gshift == 8 && s->bshift == 16);
+        int line_bytes = 3 * s->desc.width;
+        switch (s->out_codec) {
+        case RGB:
+                cinfo->out_color_space = JCS_RGB;
+                break;
+        case RGBA:
+                cinfo->out_color_space = JCS_EXT_RGBA;
+                line_bytes = 4 * s->desc.width;
+                break;
+        default: // UYVY
+                cinfo->out_color_space = JCS_YCbCr;
+                break;
+        }
+        jpeg_start_decompress(cinfo);
+        w->line.resize(line_bytes);
+        height = min<int>(height, cinfo->output_height);
+        while ((int) cinfo->output_scanline < height) {
+                unsigned char *out = dst + (size_t) cinfo->output_scanline * s->pitch;
+                JSAMPROW row = direct ? out : w->line.data();
+                jpeg_read_scanlines(cinfo, &row, 1);
+                if (direct) {
+                        continue;
+                }
+                if (s->out_codec == RGBA) {
+                        vc_copylineRGBA(out, w->line.data(), line_bytes, s->rshift, s->gshift, s->bshift);
+                        continue;
+                }
+                const unsigned char *in = w->line.data();
+                for (int x = 0; x < (int) s->desc.width / 2; ++x) {
+                        out[4 * x] = s->c_lut[(in[6 * x + 1] + in[6 * x + 4] + 1) >> 1];
+                        out[4 * x + 1] = s->y_lut[in[6 * x]];
+                        out[4 * x + 2] = s->c_lut[(in[6 * x + 2] + in[6 * x + 5] + 1) >> 1];
+                        out[4 * x + 3] = s->y_lut[in[6 * x + 3]];
+                }
+        }
+        jpeg_abort_decompress(cinfo); // the stripe may end before the image end
+        return true;
+}
+
+struct stripe {
+        struct state_libjpeg_decompress *s;
+        unsigned char *buffer;
+        unsigned int len;
+        const unsigned char *data;
+        unsigned char *dst;
+        int stripes;
+        int units;
+        bool ok;
+};
+
+/// assembles and decodes a standalone JPEG from split units of the stripe
+static void decode_stripe(void *arg, int begin, int end)
+{
+        auto *d = static_cast<struct stripe *>(arg);
+        struct state_libjpeg_decompress *s = d->s;
+        for (int i = begin; i < end; ++i) {
+                struct jpeg_worker *w = s->workers[i].get();
+                const int unit0 = i * d->units / d->stripes;
+                const int unit1 = (i + 1) * d->units / d->stripes;
+                const int int0 = unit0 * s->split_intervals;
+                const int int1 = min(unit1 * s->split_intervals, s->total_intervals);
+                const int row0 = unit0 * s->split_rows * s->mcu_h;
+                const int rows = min<int>(unit1 * s->split_rows * s->mcu_h, s->desc.height) - row0;
+                const bool last = int1 == s->total_intervals;
+
+                const unsigned char *start = s->segments[int0];
+                const unsigned char *stop = last ? d->buffer + d->len : s->segments[int1] - 2;
+                w->stream.resize(s->header.size() + (stop - start) + 2);
+                memcpy(w->stream.data(), s->header.data(), s->header.size());
+                w->stream[s->sof_height_off] = rows >> 8;
+                w->stream[s->sof_height_off + 1] = rows & 0xFF;
+                unsigned char *data = w->stream.data() + s->header.size();
+                memcpy(data, start, stop - start);
+                for (int k = int0 + 1; k < int1; ++k) {
+                        data[s->segments[k] - 1 - start] = 0xD0 + ((k - int0 - 1) & 7);
+                }
+                size_t len = s->header.size() + (stop - start);
+                if (!last) {
+                        w->stream[len++] = 0xFF;
+                        w->stream[len++] = 0xD9; // EOI
+                }
+                if (!decode_stream(s, w, w->stream.data(), len, d->dst + (size_t) row0 * s->pitch, rows)) {
+                        d->ok = false;
+                }
+        }
+}
+
+/// @returns number of restart intervals found
+static int find_segments(struct state_libjpeg_decompress *s, const unsigned char *data, const unsigned char *end)
+{
+        s->segments.clear();
+        s->segments.push_back(data);
+        for (const unsigned char *p = data; p + 1 < end; ) {
+                p = static_cast<const unsigned char *>(memchr(p, 0xFF, end - 1 - p));
+                if (p == nullptr) {
+                        break;
+                }
+                if ((p[1] & 0xF8) == 0xD0) { // RSTn
+                        s->segments.push_back(p + 2);
+                }
+                p += 2;
+        }
+        return s->segments.size();
+}
+
+static void *libjpeg_decompress_init(void)
+{
+        auto *s = new state_libjpeg_decompress();
+        int thread_count = get_cpu_core_count();
+        if (const char *threads = get_commandline_param("libjpeg-threads")) {
+                thread_count = max(1, atoi(threads));
+        }
+        for (int i = 0; i < thread_count; ++i) {
+                s->workers.emplace_back(new jpeg_worker());
+        }
+        for (int i = 0; i < 256; ++i) {
+                s->y_lut[i] = 16 + (i * 219 + 127) / 255;
+                s->c_lut[i] = 128 + ((i - 128) * 224 + (i < 128 ? -127 : 127)) / 255;
+        }
+        return s;
+}
+
+static int libjpeg_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        auto *s = (struct state_libjpeg_decompress *) state;
+
+        s->desc = desc;
+        s->rshift = rshift;
+        s->gshift = gshift;
+        s->bshift = bshift;
+        s->pitch = pitch;
+        s->out_codec = out_codec;
+        s->header.clear();
+
+        return TRUE;
+}
+
+static decompress_status libjpeg_probe_internal_codec(struct jpeg_info *info, struct pixfmt_desc *internal_prop)
+{
+        internal_prop->depth = 8;
+        internal_prop->rgb = info->color_spec == JPEG_COLOR_SPEC_RGB;
+        if (info->comp_count == 1) {
+                internal_prop->subsampling = 4000;
+        } else if (info->sampling_factor_h[0] == 2 && info->sampling_factor_v[0] == 2) {
+                internal_prop->subsampling = 4200;
+        } else if (info->sampling_factor_h[0] == 2) {
+                internal_prop->subsampling = 4220;
+        } else {
+                internal_prop->subsampling = 4440;
+        }
+        return DECODER_GOT_CODEC;
+}
+
+static decompress_status libjpeg_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, struct pixfmt_desc *internal_prop)
+{
+        auto *s = (struct state_libjpeg_decompress *) state;
+        UNUSED(frame_seq);
+        UNUSED(callbacks);
+
+        const unsigned char *data = parse_header(s, buffer, src_len);
+        if (data == nullptr) {
+                return DECODER_NO_FRAME;
+        }
+        if (s->out_codec == VIDEO_CODEC_NONE) {
+                return libjpeg_probe_internal_codec(&s->info, internal_prop);
+        }
+        if (s->out_codec == UYVY && s->info.color_spec != JPEG_COLOR_SPEC_YCBCR) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Only YCbCr JPEG can be decoded to UYVY!\n");
+                return DECODER_NO_FRAME;
+        }
+
+        if (!s->can_split || s->workers.size() == 1 ||
+                        find_segments(s, data, buffer + src_len) != s->total_intervals) {
+                return decode_stream(s, s->workers[0].get(), buffer, src_len, dst, s->desc.height)
+                        ? DECODER_GOT_FRAME : DECODER_NO_FRAME;
+        }
+
+        struct stripe d{};
+        d.s = s;
+        d.buffer = buffer;
+        d.len = src_len;
+        d.data = data;
+        d.dst = dst;
+        d.units = (s->total_intervals + s->split_intervals - 1) / s->split_intervals;
+        d.stripes = min<int>(s->workers.size(), d.units);
+        d.ok = true;
+        task_run_parallel_range(decode_stripe, &d, d.stripes, 1, d.stripes);
+
+        return d.ok ? DECODER_GOT_FRAME : DECODER_NO_FRAME;
+}
+
+static int libjpeg_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        int ret = FALSE;
+
+        switch(property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = FALSE;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
+                default:
+                        ret = FALSE;
+        }
+
+        return ret;
+}
+
+static void libjpeg_decompress_done(void *state)
+{
+        delete (struct state_libjpeg_decompress *) state;
+}
+
+/**
+ * Preferred over libavcodec for MJPEG, GPUJPEG keeps precedence for JPEG
+ * (its priority is 200 there).
+ */
+static int libjpeg_decompress_get_priority(codec_t compression, struct pixfmt_desc internal, codec_t ugc) {
+        if (compression != JPEG && compression != MJPG) {
+                return -1;
+        }
+        switch (ugc) {
+                case VIDEO_CODEC_NONE:
+                        return 85; // for probe
+                case RGB:
+                case RGBA:
+                        break;
+                case UYVY:
+                        if (internal.depth != 0 && internal.rgb) {
+                                return -1;
+                        }
+                        break;
+                default:
+                        return -1;
+        }
+        if (internal.depth == 0) { // unspecified
+                return 910;
+        }
+        return internal.rgb == codec_is_a_rgb(ugc) ? 450 : 700;
+}
+
+ADD_TO_PARAM("libjpeg-threads", "* libjpeg-threads=<n>\n"
+                "  Number of threads decoding a JPEG frame with restart markers in libjpeg decompress (default number of cores).\n");
+
+static const struct video_decompress_info libjpeg_info = {
+        libjpeg_decompress_init,
+        libjpeg_decompress_reconfigure,
+        libjpeg_decompress,
+        libjpeg_decompress_get_property,
+        libjpeg_decompress_done,
+        libjpeg_decompress_get_priority,
+        nullptr,
+};
+
+REGISTER_MODULE(libjpeg, &libjpeg_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
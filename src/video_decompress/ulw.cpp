@@ -0,0 +1,188 @@
+/**
+ * @file   video_decompress/ulw.cpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  UltraGrid lite wavelet (ULW) decompression
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include <memory>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "pixfmt_conv.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "utils/ulw.h"
+#include "video.h"
+#include "video_decompress.h"
+
+#define MOD_NAME "[ULW dec.] "
+
+using namespace std;
+
+namespace {
+
+struct state_ulw_decompress {
+        struct video_desc desc;
+        int pitch;
+        codec_t out_codec;
+        unique_ptr<unsigned char []> tmp; ///< Y216 frame for v210 output
+};
+
+static void *ulw_decompress_init(void)
+{
+        return new state_ulw_decompress();
+}
+
+static int ulw_decompress_reconfigure(void *state, struct video_desc desc,
+                int rshift, int gshift, int bshift, int pitch, codec_t out_codec)
+{
+        auto *s = (struct state_ulw_decompress *) state;
+        UNUSED(rshift);
+        UNUSED(gshift);
+        UNUSED(bshift);
+
+        s->desc = desc;
+        s->pitch = pitch;
+        s->out_codec = out_codec;
+        s->tmp = nullptr;
+        if (out_codec == v210) {
+                s->tmp = unique_ptr<unsigned char []>(new unsigned char[vc_get_linesize(desc.width, Y216) * desc.height]);
+        }
+
+        return TRUE;
+}
+
+static decompress_status ulw_decompress(void *state, unsigned char *dst, unsigned char *buffer,
+                unsigned int src_len, int frame_seq, struct video_frame_callbacks *callbacks, struct pixfmt_desc *internal_prop)
+{
+        auto *s = (struct state_ulw_decompress *) state;
+        UNUSED(frame_seq);
+        UNUSED(callbacks);
+
+        struct ulw_info info;
+        if (!ulw_read_header(buffer, src_len, &info)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Invalid frame header!\n");
+                return DECODER_NO_FRAME;
+        }
+        if (s->out_codec == VIDEO_CODEC_NONE) {
+                internal_prop->depth = info.depth;
+                internal_prop->subsampling = 4220;
+                internal_prop->rgb = false;
+                return DECODER_GOT_CODEC;
+        }
+        if (info.width != (int) s->desc.width || info.height != (int) s->desc.height) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Frame size %dx%d doesn't match the stream %ux%u!\n",
+                                info.width, info.height, s->desc.width, s->desc.height);
+                return DECODER_NO_FRAME;
+        }
+
+        bool ok = true;
+        if (s->out_codec == v210) {
+                const int tmp_linesize = vc_get_linesize(info.width, Y216);
+                ok = ulw_decode(buffer, src_len, s->tmp.get(), tmp_linesize, ULW_Y216);
+                parallel_pix_conv(info.height, (char *) dst, s->pitch, (char *) s->tmp.get(), tmp_linesize,
+                                get_decoder_from_to(Y216, v210), get_cpu_core_count());
+        } else {
+                ok = ulw_decode(buffer, src_len, dst, s->pitch, s->out_codec == Y216 ? ULW_Y216 : ULW_UYVY);
+        }
+        if (!ok) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Damaged slices in the frame.\n");
+        }
+
+        return DECODER_GOT_FRAME;
+}
+
+static int ulw_decompress_get_property(void *state, int property, void *val, size_t *len)
+{
+        UNUSED(state);
+        int ret = FALSE;
+
+        switch(property) {
+                case DECOMPRESS_PROPERTY_ACCEPTS_CORRUPTED_FRAME:
+                        if(*len >= sizeof(int)) {
+                                *(int *) val = TRUE;
+                                *len = sizeof(int);
+                                ret = TRUE;
+                        }
+                        break;
+                default:
+                        ret = FALSE;
+        }
+
+        return ret;
+}
+
+static void ulw_decompress_done(void *state)
+{
+        delete (struct state_ulw_decompress *) state;
+}
+
+static int ulw_decompress_get_priority(codec_t compression, struct pixfmt_desc internal, codec_t ugc) {
+        if (compression != ULW) {
+                return -1;
+        }
+        switch (ugc) {
+                case VIDEO_CODEC_NONE:
+                        return 50; // for probe
+                case UYVY:
+                        return internal.depth > 8 ? 600 : 500;
+                case Y216:
+                case v210:
+                        return 500;
+                default:
+                        return -1;
+        }
+}
+
+static const struct video_decompress_info ulw_info = {
+        ulw_decompress_init,
+        ulw_decompress_reconfigure,
+        ulw_decompress,
+        ulw_decompress_get_property,
+        ulw_decompress_done,
+        ulw_decompress_get_priority,
+        nullptr,
+};
+
+REGISTER_MODULE(ulw, &ulw_info, LIBRARY_CLASS_VIDEO_DECOMPRESS, VIDEO_DECOMPRESS_ABI_VERSION);
+
+} // end of anonymous namespace
@@ -63,6 +63,7 @@
 #include "config_unix.h"
 #include "config_win32.h"
 #include "debug.h"
+#include "host.h"
 #include "lib_common.h"
 #include "module.h"
 #include "tv.h"
@@ -108,6 +109,10 @@ void list_video_display_devices(bool full)
  * Display initialisation and playout routines...
  */
 
+ADD_TO_PARAM("display-queue-policy", "* display-queue-policy=drop-oldest|drop-newest|block\n"
+                "  Policy for a full queue of frames waiting for presentation (GL, Vulkan) - replace the oldest frame,\n"
+                "  drop the new one or block the decoder (default depends on the display)\n");
+
 /**
  * @brief Initializes video display.
  * @param[in] requested_display  video display module name, not NULL
@@ -129,6 +134,13 @@ int initialize_video_display(struct module *parent, const char *requested_displa
                 return 1;
         }
 
+        const char *queue_policy = get_commandline_param("display-queue-policy");
+        if (queue_policy != NULL && strcmp(queue_policy, "drop-oldest") != 0
+                        && strcmp(queue_policy, "drop-newest") != 0 && strcmp(queue_policy, "block") != 0) {
+                log_msg(LOG_LEVEL_ERROR, "[Display] Unknown queue policy: %s\n", queue_policy);
+                return -1;
+        }
+
         const struct video_display_info *vdi = (const struct video_display_info *)
                         load_library(requested_display, LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
 
@@ -334,6 +346,7 @@ struct video_frame *display_get_frame(struct display *d)
 
 static int display_frame_helper(struct display *d, struct video_frame *frame, long long timeout_ns)
 {
+        vf_stripes_complete(frame); // the frame is final now, consumer shouldn't wait for missing data
         int ret = d->funcs->putf(d->state, frame, timeout_ns);
         if (ret != 0 || !d->funcs->generic_fps_indicator_prefix) {
                 return ret;
@@ -372,6 +385,9 @@ int display_put_frame(struct display *d, struct video_frame *frame, long long ti
         if (!frame) {
                 return d->funcs->putf(d->state, frame, timeout_ns);
         }
+        if (timeout_ns != PUTF_DISCARD) {
+                startup_report_event(STARTUP_FIRST_DISPLAYED);
+        }
 
         if (d->postprocess) {
                 int display_ret = 0;
@@ -506,6 +522,8 @@ int display_ctl_property(struct display *d, int property, void *val, size_t *len
                         *(int *) val = PITCH_DEFAULT;
                         *len = sizeof(int);
                         return TRUE;
+                case DISPLAY_PROPERTY_EXTERNAL_FRAMES: // frames are postprocessed to display's own buffers
+                        return FALSE;
 		case DISPLAY_PROPERTY_CODECS:
 			{
                                 codec_t display_codecs[VIDEO_CODEC_COUNT];
@@ -132,6 +132,10 @@ enum display_property {
         DISPLAY_PROPERTY_SUPPORTS_MULTI_SOURCES = 5, ///< whether display supports receiving data from - returns (struct multi_sources_supp_info *)
                                                      ///< multiple network sources concurrently
         DISPLAY_PROPERTY_AUDIO_FORMAT = 6, ///< @see audio_display_info::query_format - in/out parameter is struct audio_desc
+        DISPLAY_PROPERTY_EXTERNAL_FRAMES = 7, ///< display accepts frames not obtained from getf() (bool) - they have a default pitch,
+                                              ///< must be treated as read-only and are released with VIDEO_FRAME_DISPOSE()
+        DISPLAY_PROPERTY_VIEWPORT = 8, ///< currently rendered part of a 360° frame - struct video_viewport
+        DISPLAY_PROPERTY_BACKPRESSURE = 9, ///< display is behind - a frame put now with PUTF_NONBLOCK would be dropped (bool), optional
 };
 
 #define PITCH_DEFAULT -1 ///< default pitch, i. e. respective linesize
@@ -143,7 +147,7 @@ enum display_prop_vid_mode {
 };
 /// @}
 
-#define VIDEO_DISPLAY_ABI_VERSION 18
+#define VIDEO_DISPLAY_ABI_VERSION 19
 
 #define DISPLAY_NO_GENERIC_FPS_INDICATOR ((const char *) 0x00)
 
@@ -51,9 +51,22 @@
 
 #include <assert.h>
 #include <host.h>
+#include <pthread.h>
+#include <stdbool.h>
 
 #define MAGIC_AGGREGATE 0xbbcaa321
 
+struct display_aggregate_state;
+
+/// putf of one sub-display, run in its own thread
+struct aggregate_worker {
+        pthread_t               thread_id;
+        struct display_aggregate_state *parent;
+        unsigned int            idx;
+        struct video_frame     *frame;
+        int                     ret;
+};
+
 struct display_aggregate_state {
         pthread_t               thread_id;
         struct display        **devices;
@@ -62,6 +75,18 @@ struct display_aggregate_state {
         struct video_frame     **dev_frames;
         struct tile            *tile;
 
+        /* parallel putf - all sub-displays get the frame at once and putf
+         * returns when the last one has taken it (frame barrier) */
+        struct aggregate_worker *workers;
+        unsigned int            workers_cnt; ///< workers started
+        pthread_mutex_t         lock;
+        pthread_cond_t          work_cv;
+        pthread_cond_t          done_cv;
+        unsigned int            generation;  ///< incremented for every frame
+        unsigned int            remaining;   ///< workers not yet finished the frame
+        long long               nonblock;
+        bool                    should_exit;
+
         /* For debugging... */
         uint32_t magic;
 
@@ -91,6 +116,52 @@ static void *display_aggregate_run(void *state)
         return NULL;
 }
 
+static void *display_aggregate_worker(void *arg)
+{
+        struct aggregate_worker *w = arg;
+        struct display_aggregate_state *s = w->parent;
+        unsigned int generation = 0;
+
+        pthread_mutex_lock(&s->lock);
+        while (true) {
+                while (s->generation == generation && !s->should_exit) {
+                        pthread_cond_wait(&s->work_cv, &s->lock);
+                }
+                if (s->should_exit) {
+                        break;
+                }
+                generation = s->generation;
+                struct video_frame *frame = w->frame;
+                long long nonblock = s->nonblock;
+                pthread_mutex_unlock(&s->lock);
+
+                int ret = display_put_frame(s->devices[w->idx], frame, nonblock);
+
+                pthread_mutex_lock(&s->lock);
+                w->ret = ret;
+                if (--s->remaining == 0) {
+                        pthread_cond_signal(&s->done_cv);
+                }
+        }
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+}
+
+static void stop_workers(struct display_aggregate_state *s)
+{
+        pthread_mutex_lock(&s->lock);
+        s->should_exit = true;
+        pthread_cond_broadcast(&s->work_cv);
+        pthread_mutex_unlock(&s->lock);
+        for (unsigned int i = 0; i < s->workers_cnt; ++i) {
+                pthread_join(s->workers[i].thread_id, NULL);
+        }
+        free(s->workers);
+        pthread_cond_destroy(&s->done_cv);
+        pthread_cond_destroy(&s->work_cv);
+        pthread_mutex_destroy(&s->lock);
+}
+
 static void display_aggregate_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
 {
         UNUSED(deleter);
@@ -157,10 +228,28 @@ static void *display_aggregate_init(struct module *parent, const char *fmt, unsi
                 tmp = NULL;
         }
         free(parse_string);
+        parse_string = NULL;
 
         s->frame = vf_alloc(s->devices_cnt);
         s->dev_frames = calloc(s->devices_cnt, sizeof(struct video_frame *));
 
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->work_cv, NULL);
+        pthread_cond_init(&s->done_cv, NULL);
+        s->workers = calloc(s->devices_cnt, sizeof s->workers[0]);
+        for (unsigned int i = 0; i < s->devices_cnt; ++i) {
+                s->workers[i].parent = s;
+                s->workers[i].idx = i;
+                if (pthread_create(&s->workers[i].thread_id, NULL, display_aggregate_worker, &s->workers[i]) != 0) {
+                        log_msg(LOG_LEVEL_ERROR, "[aggregate] Unable to create putf thread!\n");
+                        stop_workers(s);
+                        vf_free(s->frame);
+                        free(s->dev_frames);
+                        goto error;
+                }
+                s->workers_cnt += 1;
+        }
+
         pthread_create(&s->thread_id, NULL, display_aggregate_run, s);
         return (void *)s;
 
@@ -186,6 +275,7 @@ static void display_aggregate_done(void *state)
         assert(s->magic == MAGIC_AGGREGATE);
 
         pthread_join(s->thread_id, NULL);
+        stop_workers(s);
 
         for (unsigned int i = 0; i < s->devices_cnt; ++i) {
                 display_done(s->devices[i]);
@@ -216,22 +306,36 @@ static struct video_frame *display_aggregate_getf(void *state)
         return s->frame;
 }
 
+/**
+ * Puts the frame to all sub-displays in parallel and waits until all of them
+ * finish, so the total time is the one of the slowest display and a tile of
+ * the next frame never overtakes the current frame on another display.
+ *
+ * @returns first nonzero return value of the sub-displays' putf
+ */
 static int display_aggregate_putf(void *state, struct video_frame *frame, long long nonblock)
 {
-        unsigned int i;
         struct display_aggregate_state *s = (struct display_aggregate_state *)state;
 
         assert(s->magic == MAGIC_AGGREGATE);
-        for(i = 0; i < s->devices_cnt; ++i) {
-                struct video_frame *dev_frame = NULL;
-                if(frame)
-                        dev_frame = s->dev_frames[i];
-                int ret = display_put_frame(s->devices[i], dev_frame, nonblock);
-                if(ret != 0)
-                        return ret;
+        pthread_mutex_lock(&s->lock);
+        for (unsigned int i = 0; i < s->devices_cnt; ++i) {
+                s->workers[i].frame = frame ? s->dev_frames[i] : NULL;
+        }
+        s->nonblock = nonblock;
+        s->remaining = s->devices_cnt;
+        s->generation += 1;
+        pthread_cond_broadcast(&s->work_cv);
+        while (s->remaining > 0) {
+                pthread_cond_wait(&s->done_cv, &s->lock);
         }
+        int ret = 0;
+        for (unsigned int i = 0; i < s->devices_cnt && ret == 0; ++i) {
+                ret = s->workers[i].ret;
+        }
+        pthread_mutex_unlock(&s->lock);
 
-        return 0;
+        return ret;
 }
 
 static int display_aggregate_reconfigure(void *state, struct video_desc desc)
@@ -46,6 +46,7 @@
 #include "video_display.h"
 #include "video_codec.h"
 #include "module.h"
+#include "pixfmt_conv.h"
 #include "utils/misc.h"
 #include "utils/string_view_utils.hpp"
 
@@ -78,6 +79,10 @@
 
 #include "utils/profile_timer.hpp"
 
+#ifdef HAVE_VIDEO_MIX_GL
+#include "gl_context.h"
+#endif
+
 #define MOD_NAME "[conference] "
 
 namespace{
@@ -92,6 +97,7 @@ struct Participant{
         void set_pos_keep_aspect(int x, int y, int w, int h);
 
         unique_frame frame;
+        bool dirty = true; ///< new frame or position since last composition
         clock::time_point last_time_recieved;
         unsigned src_w = 0;
         unsigned src_h = 0;
@@ -107,6 +113,7 @@ struct Participant{
 
 void Participant::frame_recieved(unique_frame &&f){
         frame = std::move(f);
+        dirty = true;
         last_time_recieved = clock::now();
 
         src_w = frame->tiles[0].width;
@@ -129,6 +136,7 @@ void Participant::set_pos_keep_aspect(int x, int y, int w, int h){
 
         this->x = x;
         this->y = y;
+        dirty = true;
 }
 
 void Participant::to_cv_frame(){
@@ -186,11 +194,323 @@ void Participant::to_cv_frame(){
         }
 }
 
+#ifdef HAVE_VIDEO_MIX_GL
+#define STRINGIFY(A) #A
+static const char *vprogram = STRINGIFY(
+void main() {
+        gl_TexCoord[0] = gl_MultiTexCoord0;
+        gl_Position = ftransform();
+});
+
+static const char *fprogram_from_uyvy = STRINGIFY(
+uniform sampler2D image;
+uniform float imageWidth;
+void main()
+{
+        vec4 yuv;
+        yuv.rgba  = texture2D(image, gl_TexCoord[0].xy).grba;
+        if(gl_TexCoord[0].x * imageWidth / 2.0 - floor(gl_TexCoord[0].x * imageWidth / 2.0) > 0.5)
+                yuv.r = yuv.a;
+        yuv.r = 1.1643 * (yuv.r - 0.0625);
+        yuv.g = yuv.g - 0.5;
+        yuv.b = yuv.b - 0.5;
+        gl_FragColor.r = yuv.r + 1.7926 * yuv.b;
+        gl_FragColor.g = yuv.r - 0.2132 * yuv.g - 0.5328 * yuv.b;
+        gl_FragColor.b = yuv.r + 2.1124 * yuv.g;
+        gl_FragColor.a = 1.0;
+});
+
+static const char *fprogram_to_uyvy = STRINGIFY(
+uniform sampler2D image;
+uniform float imageWidth;
+void main()
+{
+        vec2 coor1 = gl_TexCoord[0].xy - vec2(1.0 / (imageWidth * 2.0), 0.0);
+        vec2 coor2 = gl_TexCoord[0].xy + vec2(1.0 / (imageWidth * 2.0), 0.0);
+        vec4 rgba1 = texture2D(image, coor1);
+        vec4 rgba2 = texture2D(image, coor2);
+        float y1 = 1.0/16.0 + (rgba1.r * 0.2126 + rgba1.g * 0.7152 + rgba1.b * 0.0722) * 0.8588;
+        float y2 = 1.0/16.0 + (rgba2.r * 0.2126 + rgba2.g * 0.7152 + rgba2.b * 0.0722) * 0.8588;
+        vec4 rgba = mix(rgba1, rgba2, 0.5);
+        float u = 0.5 + (-rgba.r * 0.1145 - rgba.g * 0.3854 + rgba.b * 0.5) * 0.8784;
+        float v = 0.5 + (rgba.r * 0.5 - rgba.g * 0.4541 - rgba.b * 0.0458) * 0.8784;
+        gl_FragColor = vec4(u, y1, v, y2);
+});
+
+/**
+ * Scales and composes participant frames with OpenGL (in a headless context)
+ * instead of OpenCV on the CPU.
+ *
+ * Frames in RGB, BGR, RGBA and UYVY are uploaded as they are (UYVY is
+ * converted by a shader), other codecs are line-decoded to one of those
+ * first. The result is converted to UYVY by a shader and read back.
+ */
+class Gl_compositor{
+public:
+        Gl_compositor(unsigned width, unsigned height);
+        ~Gl_compositor();
+        Gl_compositor(const Gl_compositor&) = delete;
+        Gl_compositor& operator=(const Gl_compositor&) = delete;
+
+        bool is_initialized() const { return initialized; }
+        /// must be called in the thread doing the composition before first use
+        void make_current() { gl_context_make_current(&context); }
+        void release() { gl_context_make_current(NULL); }
+
+        void upload(uint32_t ssrc, const video_frame *frame);
+        void remove(uint32_t ssrc);
+        /// @param redraw  if false, participants are unchanged and only the previous result is read back
+        void compose(const std::map<uint32_t, Participant>& participants, video_frame *result, bool redraw);
+
+        static bool is_codec_supported(codec_t codec);
+
+private:
+        struct Texture{
+                GLuint rgba = 0;
+                GLuint uyvy = 0;
+                GLuint fbo = 0;
+                unsigned width = 0;
+                unsigned height = 0;
+                codec_t codec = VIDEO_CODEC_NONE;
+                codec_t upload_codec = VIDEO_CODEC_NONE;
+                decoder_t decoder = nullptr;
+                std::vector<unsigned char> tmp;
+        };
+        static constexpr codec_t natively_supported[] = { UYVY, RGBA, RGB, BGR, VIDEO_CODEC_NONE };
+
+        void configure_texture(Texture& t, const video_frame *frame);
+        void delete_texture(Texture& t);
+        static GLuint create_texture(GLint internal_format, unsigned width, unsigned height, GLenum format);
+        static void draw_quad(float x, float y, float w, float h);
+
+        struct gl_context context{};
+        bool initialized = false;
+        unsigned width;
+        unsigned height;
+
+        GLuint from_uyvy = 0;
+        GLuint to_uyvy = 0;
+        GLuint tex_output = 0;
+        GLuint tex_output_uyvy = 0;
+        GLuint fbo = 0;
+        GLuint fbo_uyvy = 0;
+
+        std::map<uint32_t, Texture> textures;
+};
+
+Gl_compositor::Gl_compositor(unsigned width, unsigned height) :
+        width(width),
+        height(height)
+{
+        if(!init_gl_context(&context, GL_CONTEXT_LEGACY)){
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to initialize OpenGL context.\n");
+                return;
+        }
+        if(context.gl_major < 2){
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Insufficient OpenGL version for GPU compositing.\n");
+                destroy_gl_context(&context);
+                context.context = nullptr;
+                return;
+        }
+
+        gl_context_make_current(&context);
+        glEnable(GL_TEXTURE_2D);
+        from_uyvy = glsl_compile_link(vprogram, fprogram_from_uyvy);
+        to_uyvy = glsl_compile_link(vprogram, fprogram_to_uyvy);
+        tex_output = create_texture(GL_RGBA, width, height, GL_RGBA);
+        tex_output_uyvy = create_texture(GL_RGBA, width / 2, height, GL_RGBA);
+        glGenFramebuffers(1, &fbo);
+        glGenFramebuffers(1, &fbo_uyvy);
+        gl_context_make_current(NULL);
+
+        initialized = from_uyvy != 0 && to_uyvy != 0;
+        if(!initialized){
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to compile compositing shaders.\n");
+        }
+}
+
+Gl_compositor::~Gl_compositor(){
+        if(context.context == nullptr){
+                return;
+        }
+        gl_context_make_current(&context);
+        for(auto& [ssrc, t] : textures){
+                (void) ssrc;
+                delete_texture(t);
+        }
+        glDeleteTextures(1, &tex_output);
+        glDeleteTextures(1, &tex_output_uyvy);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteFramebuffers(1, &fbo_uyvy);
+        glDeleteProgram(from_uyvy);
+        glDeleteProgram(to_uyvy);
+        gl_context_make_current(NULL);
+        destroy_gl_context(&context);
+}
+
+bool Gl_compositor::is_codec_supported(codec_t codec){
+        if(is_codec_opaque(codec)){
+                return false;
+        }
+        codec_t out = VIDEO_CODEC_NONE;
+        return codec_is_in_set(codec, natively_supported)
+                || get_best_decoder_from(codec, natively_supported, &out) != nullptr;
+}
+
+GLuint Gl_compositor::create_texture(GLint internal_format, unsigned width, unsigned height, GLenum format){
+        GLuint tex = 0;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        return tex;
+}
+
+void Gl_compositor::delete_texture(Texture& t){
+        glDeleteTextures(1, &t.rgba);
+        if(t.uyvy){
+                glDeleteTextures(1, &t.uyvy);
+        }
+        if(t.fbo){
+                glDeleteFramebuffers(1, &t.fbo);
+        }
+        t = Texture();
+}
+
+void Gl_compositor::configure_texture(Texture& t, const video_frame *frame){
+        delete_texture(t);
+        t.width = frame->tiles[0].width;
+        t.height = frame->tiles[0].height;
+        t.codec = t.upload_codec = frame->color_spec;
+        if(!codec_is_in_set(t.codec, natively_supported)){
+                t.decoder = get_best_decoder_from(t.codec, natively_supported, &t.upload_codec);
+                assert(t.decoder != nullptr);
+                t.tmp.resize(vc_get_datalen(t.width, t.height, t.upload_codec));
+        }
+
+        t.rgba = create_texture(GL_RGBA, t.width, t.height, GL_RGBA);
+        if(t.upload_codec == UYVY){
+                t.uyvy = create_texture(GL_RGBA, (t.width + 1) / 2, t.height, GL_RGBA);
+                glGenFramebuffers(1, &t.fbo);
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Participant texture %ux%u %s (uploaded as %s)\n",
+                        t.width, t.height, get_codec_name(t.codec), get_codec_name(t.upload_codec));
+}
+
+void Gl_compositor::upload(uint32_t ssrc, const video_frame *frame){
+        PROFILE_FUNC;
+        auto& t = textures[ssrc];
+        const auto& tile = frame->tiles[0];
+        if(t.width != tile.width || t.height != tile.height || t.codec != frame->color_spec){
+                configure_texture(t, frame);
+        }
+
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(tile.data);
+        if(t.decoder){
+                int src_linesize = vc_get_linesize(t.width, t.codec);
+                int dst_linesize = vc_get_linesize(t.width, t.upload_codec);
+                for(unsigned i = 0; i < t.height; i++){
+                        t.decoder(t.tmp.data() + i * dst_linesize, data + i * src_linesize, dst_linesize, 0, 8, 16);
+                }
+                data = t.tmp.data();
+        }
+
+        GLenum format = t.upload_codec == RGB ? GL_RGB : t.upload_codec == BGR ? GL_BGR : GL_RGBA;
+        unsigned upload_width = t.upload_codec == UYVY ? (t.width + 1) / 2 : t.width;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, t.upload_codec == UYVY ? t.uyvy : t.rgba);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, upload_width, t.height, format, GL_UNSIGNED_BYTE, data);
+
+        if(t.upload_codec == UYVY){
+                glUseProgram(from_uyvy);
+                glUniform1i(glGetUniformLocation(from_uyvy, "image"), 0);
+                glUniform1f(glGetUniformLocation(from_uyvy, "imageWidth"), (GLfloat) t.width);
+                glBindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, t.rgba, 0);
+                glViewport(0, 0, t.width, t.height);
+                draw_quad(-1.0, -1.0, 2.0, 2.0);
+                glUseProgram(0);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+}
+
+void Gl_compositor::remove(uint32_t ssrc){
+        auto it = textures.find(ssrc);
+        if(it == textures.end()){
+                return;
+        }
+        delete_texture(it->second);
+        textures.erase(it);
+}
+
+/// draws textured quad, coordinates are in NDC, texture row 0 is at y
+void Gl_compositor::draw_quad(float x, float y, float w, float h){
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0, 0.0); glVertex2f(x, y);
+        glTexCoord2f(1.0, 0.0); glVertex2f(x + w, y);
+        glTexCoord2f(1.0, 1.0); glVertex2f(x + w, y + h);
+        glTexCoord2f(0.0, 1.0); glVertex2f(x, y + h);
+        glEnd();
+}
+
+void Gl_compositor::compose(const std::map<uint32_t, Participant>& participants, video_frame *result, bool redraw){
+        PROFILE_FUNC;
+        if(!redraw){
+                glBindFramebuffer(GL_FRAMEBUFFER, fbo_uyvy);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glReadPixels(0, 0, width / 2, height, GL_RGBA, GL_UNSIGNED_BYTE, result->tiles[0].data);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                return;
+        }
+        // rows are kept in memory order (row 0 at the bottom of the FB), so no flip is needed for readback
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_output, 0);
+        glViewport(0, 0, width, height);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        for(const auto& [ssrc, p] : participants){
+                auto it = textures.find(ssrc);
+                if(it == textures.end()){
+                        continue;
+                }
+                glBindTexture(GL_TEXTURE_2D, it->second.rgba);
+                draw_quad(-1.0 + 2.0 * p.x / width, -1.0 + 2.0 * p.y / height,
+                                2.0 * p.width / width, 2.0 * p.height / height);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_uyvy);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_output_uyvy, 0);
+        glViewport(0, 0, width / 2, height);
+        glBindTexture(GL_TEXTURE_2D, tex_output);
+        glUseProgram(to_uyvy);
+        glUniform1i(glGetUniformLocation(to_uyvy, "image"), 0);
+        glUniform1f(glGetUniformLocation(to_uyvy, "imageWidth"), (GLfloat) width);
+        draw_quad(-1.0, -1.0, 2.0, 2.0);
+        glUseProgram(0);
+
+        PROFILE_DETAIL("read back");
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width / 2, height, GL_RGBA, GL_UNSIGNED_BYTE, result->tiles[0].data);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        gl_check_error();
+}
+#else
+class Gl_compositor;
+#endif // defined HAVE_VIDEO_MIX_GL
+
 class Video_mixer{
 public:
         enum class Layout{ Invalid, Tiled, One_big };
 
-        Video_mixer(int width, int height, Layout l = Layout::Tiled);
+        /// @param gl  GPU compositor to be used instead of OpenCV (optional)
+        Video_mixer(int width, int height, Layout l = Layout::Tiled, Gl_compositor *gl = nullptr);
+        ~Video_mixer();
+        Video_mixer(const Video_mixer&) = delete;
+        Video_mixer& operator=(const Video_mixer&) = delete;
 
         void process_frame(unique_frame&& f);
         void get_mixed(video_frame *result);
@@ -214,21 +534,38 @@ private:
 
         uint32_t primary_ssrc = 0;
 
+        Gl_compositor *gl;
+
         cv::Mat mixed_luma;
         cv::Mat mixed_chroma;
 
         std::map<uint32_t, Participant> participants;
 };
 
-Video_mixer::Video_mixer(int width, int height, Layout layout):
+Video_mixer::Video_mixer(int width, int height, Layout layout, Gl_compositor *gl):
         width(width),
         height(height),
-        layout(layout)
+        layout(layout),
+        gl(gl)
 {
+#ifdef HAVE_VIDEO_MIX_GL
+        if(gl){
+                gl->make_current();
+                return;
+        }
+#endif
         mixed_luma.create(cv::Size(width, height), CV_8UC1);
         mixed_chroma.create(cv::Size(width / 2, height), CV_8UC2);
 }
 
+Video_mixer::~Video_mixer(){
+#ifdef HAVE_VIDEO_MIX_GL
+        if(gl){
+                gl->release();
+        }
+#endif
+}
+
 void Video_mixer::tiled_layout(){
         const unsigned rows = (unsigned) ceil(sqrt(participants.size()));
         const unsigned tile_width = width / rows;
@@ -268,6 +605,10 @@ void Video_mixer::one_big_layout(){
 void Video_mixer::recompute_layout(){
         mixed_luma.setTo(16);
         mixed_chroma.setTo(128);
+        for(auto& [ssrc, p] : participants){
+                (void) ssrc;
+                p.dirty = true; // the canvas was cleared
+        }
 
         if(!primary_ssrc && !participants.empty()){
                 primary_ssrc = participants.begin()->first;
@@ -313,6 +654,10 @@ void Video_mixer::get_mixed(video_frame *result){
                         if(it->first == primary_ssrc)
                                 primary_ssrc = 0;
 
+#ifdef HAVE_VIDEO_MIX_GL
+                        if(gl)
+                                gl->remove(it->first);
+#endif
                         it = participants.erase(it);
                         recompute = true;
                         continue;
@@ -322,8 +667,31 @@ void Video_mixer::get_mixed(video_frame *result){
         if(recompute)
                 recompute_layout();
 
+#ifdef HAVE_VIDEO_MIX_GL
+        if(gl){
+                bool redraw = recompute;
+                for(auto&& [ssrc, p] : participants){
+                        if(p.dirty){
+                                gl->upload(ssrc, p.frame.get());
+                                redraw = true;
+                        }
+                }
+                gl->compose(participants, result, redraw);
+                for(auto& [ssrc, p] : participants){
+                        (void) ssrc;
+                        p.dirty = false;
+                }
+                return;
+        }
+#endif
+
+        // mixed_luma/mixed_chroma keep the scaled images, only the changed participants are redrawn
         for(auto&& [ssrc, p] : participants){
                 (void) ssrc;
+                if(!p.dirty){
+                        continue;
+                }
+                p.dirty = false;
                 p.to_cv_frame();
 
                 PROFILE_DETAIL("resize participant");
@@ -426,6 +794,9 @@ struct state_conference_common{
 
         unique_disp real_display;
         struct video_desc display_desc = {};
+#ifdef HAVE_VIDEO_MIX_GL
+        std::unique_ptr<Gl_compositor> gl; ///< set if compositing on GPU
+#endif
 
         std::mutex incoming_frames_lock;
         std::condition_variable incoming_frame_consumed;
@@ -455,7 +826,8 @@ static struct display *display_conference_fork(void *state)
 static void show_help(){
         printf("Conference display\n");
         printf("Usage:\n");
-        printf("\t-d conference:<display_config>#<width>:<height>:[fps]:[layout]\n");
+        printf("\t-d conference:<display_config>#<width>:<height>:[fps]:[layout]:[gpu]\n");
+        printf("\t\tgpu - scale and compose participants with OpenGL (accepts any uncompressed codec)\n");
 }
 
 static void *display_conference_init(struct module *parent, const char *fmt, unsigned int flags)
@@ -511,6 +883,15 @@ static void *display_conference_init(struct module *parent, const char *fmt, uns
                 s->common->layout = Video_mixer::Layout::One_big;
         }
 
+        if(tokenize(conf_cfg, ':') == "gpu"){
+#ifdef HAVE_VIDEO_MIX_GL
+                s->common->gl = std::make_unique<Gl_compositor>(desc.width, desc.height);
+                FAIL_IF(!s->common->gl->is_initialized(), MOD_NAME "Unable to initialize GPU compositing\n");
+#else
+                FAIL_IF(true, MOD_NAME "GPU compositing not compiled in\n");
+#endif
+        }
+
         struct display *d_ptr;
         int ret = initialize_video_display(parent, requested_display.c_str(), disp_conf.c_str(),
                         flags, nullptr, &d_ptr);
@@ -536,7 +917,11 @@ static void check_reconf(struct state_conference_common *s, struct video_desc de
 
 static void display_conference_worker(std::shared_ptr<state_conference_common> s){
         PROFILE_FUNC;
+#ifdef HAVE_VIDEO_MIX_GL
+        Video_mixer mixer(s->desc.width, s->desc.height, s->layout, s->gl.get());
+#else
         Video_mixer mixer(s->desc.width, s->desc.height, s->layout);
+#endif
 
         auto next_frame_time = clock::now() + std::chrono::hours(1); //workaround for gcc bug 58931
         auto last_frame_time = clock::time_point::min();
@@ -655,6 +1040,22 @@ static int display_conference_get_property(void *state, int property, void *val,
                 return TRUE;
 
         } else if(property == DISPLAY_PROPERTY_CODECS) {
+#ifdef HAVE_VIDEO_MIX_GL
+                if(s->gl){
+                        std::vector<codec_t> codecs{UYVY};
+                        for(int c = VIDEO_CODEC_FIRST; c != VIDEO_CODEC_END; ++c){
+                                if(c != UYVY && Gl_compositor::is_codec_supported(static_cast<codec_t>(c))){
+                                        codecs.push_back(static_cast<codec_t>(c));
+                                }
+                        }
+                        if(codecs.size() * sizeof(codec_t) > *len){
+                                return FALSE;
+                        }
+                        memcpy(val, codecs.data(), codecs.size() * sizeof(codec_t));
+                        *len = codecs.size() * sizeof(codec_t);
+                        return TRUE;
+                }
+#endif
                 codec_t codecs[] = {UYVY};
 
                 memcpy(val, codecs, sizeof(codecs));
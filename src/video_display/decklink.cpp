@@ -60,6 +60,7 @@
 #include "rtp/audio_decoders.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/frame_alloc.h"
 #include "utils/misc.h"
 #include "utils/string.h" // is_prefix_of
 #include "video.h"
@@ -70,6 +71,7 @@
 #include <array>
 #include <chrono>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstdint>
 #include <iomanip>
 #include <mutex>
@@ -167,6 +169,9 @@ class DeckLinkFrame;
 struct buffer_pool_t {
         queue<DeckLinkFrame *> frame_queue;
         mutex lock;
+        condition_variable frame_returned;
+        size_t allocated = 0; ///< frames owned by the pool (both free and in use)
+        size_t max_size = 0; ///< pool depth (getf waits for a free frame if reached)
 };
 
 class DeckLinkTimecode : public IDeckLinkTimecode{
@@ -240,7 +245,7 @@ class DeckLinkFrame : public IDeckLinkMutableVideoFrame, public IDeckLinkVideoFr
                 long height;
                 long rawBytes;
                 BMDPixelFormat pixelFormat;
-                unique_ptr<char []> data;
+                unique_ptr<char, void (*)(void *)> data;
 
                 IDeckLinkTimecode *timecode;
 
@@ -309,6 +314,11 @@ class DeckLink3DFrame : public DeckLinkFrame, public IDeckLinkVideoFrame3DExtens
 } // end of unnamed namespace
 
 #define DECKLINK_MAGIC 0x12de326b
+enum {
+        DEFAULT_BUFFERS_LOW_LATENCY = 3, ///< frame being decoded, frame being displayed + 1 spare
+        DEFAULT_BUFFERS_SCHEDULED = 8,
+        POOL_WAIT_FRAMES = 2, ///< how long (in frame times) getf waits for a free frame
+};
 
 struct device_state {
         PlaybackDelegate           *delegate;
@@ -355,6 +365,7 @@ struct state_decklink {
         HDRMetadata         requested_hdr_mode{};
 
         buffer_pool_t       buffer_pool;
+        unsigned            buffers           = 0; ///< requested pool depth per output, 0 - default
 
         bool                low_latency       = true;
 
@@ -395,6 +406,8 @@ static void show_help(bool full)
                 col() << SBOLD("\ttimecode") << "\temit timecode\n";
                 col() << SBOLD("\t[no-]quad-square") << " set Quad-link SDI is output in Square Division Quad Split mode\n";
                 col() << SBOLD("\t[no-]low-latency") << " do not use low-latency mode (use regular scheduled mode; low-latency is default)\n";
+                col() << SBOLD("\tbuffers=<n>") << "\tnumber of preallocated output frames per device, also limits number of frames scheduled in advance (default "
+                        << DEFAULT_BUFFERS_LOW_LATENCY << " in low-latency mode, " << DEFAULT_BUFFERS_SCHEDULED << " otherwise)\n";
                 col() << SBOLD("\tconversion") << "\toutput size conversion, can be:\n" <<
                                 SBOLD("\t\tnone") << " - no conversion\n" <<
                                 SBOLD("\t\tltbx") << " - down-converted letterbox SD\n" <<
@@ -500,7 +513,17 @@ display_decklink_getf(void *state)
         for (unsigned int i = 0; i < s->vid_desc.tile_count; ++i) {
                 const int linesize = vc_get_linesize(s->vid_desc.width, s->vid_desc.color_spec);
                 IDeckLinkMutableVideoFrame *deckLinkFrame = nullptr;
-                lock_guard<mutex> lg(s->buffer_pool.lock);
+                unique_lock<mutex> lk(s->buffer_pool.lock);
+
+                if (s->buffer_pool.frame_queue.empty() && s->buffer_pool.allocated >= s->buffer_pool.max_size) {
+                        // all frames are scheduled or being displayed - wait for the card to return one
+                        auto timeout = chrono::nanoseconds((long long) (POOL_WAIT_FRAMES * NS_IN_SEC_DBL / s->vid_desc.fps));
+                        if (!s->buffer_pool.frame_returned.wait_for(lk, timeout,
+                                                [s]{ return !s->buffer_pool.frame_queue.empty(); })) {
+                                log_msg_once(LOG_LEVEL_WARNING, to_fourcc('D', 'L', 'P', 'E'), MOD_NAME "Frame pool exhausted, "
+                                                "allocating additional frames (consider increasing \"buffers\")\n");
+                        }
+                }
 
                 while (!s->buffer_pool.frame_queue.empty()) {
                         auto tmp = s->buffer_pool.frame_queue.front();
@@ -516,6 +539,7 @@ display_decklink_getf(void *state)
                                         frame->GetRowBytes() != linesize ||
                                         frame->GetPixelFormat() != s->pixelFormat) {
                                 delete tmp;
+                                s->buffer_pool.allocated -= 1;
                         } else {
                                 deckLinkFrame = frame;
                                 deckLinkFrame->AddRef();
@@ -531,6 +555,7 @@ display_decklink_getf(void *state)
                                 deckLinkFrame = DeckLinkFrame::Create(s->vid_desc.width,
                                                 s->vid_desc.height, linesize,
                                                 s->pixelFormat, s->buffer_pool, s->requested_hdr_mode);
+                        s->buffer_pool.allocated += 1;
                 }
                 (*deckLinkFrames)[i] = deckLinkFrame;
 
@@ -717,6 +742,46 @@ static BMDDisplayMode get_mode(IDeckLinkOutput *deckLinkOutput, struct video_des
         return displayMode;
 }
 
+/**
+ * Fills the frame pool with frames matching the current video format so
+ * that getf() doesn't need to allocate (and clear) them during playback.
+ * Stale frames are removed from the pool, frames currently in use are
+ * deleted by getf() when returned.
+ */
+static void preallocate_frames(struct state_decklink *s)
+{
+        unsigned buffers = s->buffers > 0 ? s->buffers
+                : s->low_latency ? DEFAULT_BUFFERS_LOW_LATENCY : DEFAULT_BUFFERS_SCHEDULED;
+        const int linesize = vc_get_linesize(s->vid_desc.width, s->vid_desc.color_spec);
+        size_t to_allocate = 0;
+        {
+                lock_guard<mutex> lg(s->buffer_pool.lock);
+                while (!s->buffer_pool.frame_queue.empty()) {
+                        delete s->buffer_pool.frame_queue.front();
+                        s->buffer_pool.frame_queue.pop();
+                        s->buffer_pool.allocated -= 1;
+                }
+                s->buffer_pool.max_size = (size_t) buffers * s->devices_cnt;
+                if (s->buffer_pool.allocated < s->buffer_pool.max_size) {
+                        to_allocate = s->buffer_pool.max_size - s->buffer_pool.allocated;
+                        s->buffer_pool.allocated = s->buffer_pool.max_size;
+                }
+        }
+        for (size_t i = 0; i < to_allocate; ++i) {
+                DeckLinkFrame *frame = nullptr;
+                if (s->stereo) {
+                        frame = DeckLink3DFrame::Create(s->vid_desc.width, s->vid_desc.height, linesize,
+                                        s->pixelFormat, s->buffer_pool, s->requested_hdr_mode);
+                } else {
+                        frame = DeckLinkFrame::Create(s->vid_desc.width, s->vid_desc.height, linesize,
+                                        s->pixelFormat, s->buffer_pool, s->requested_hdr_mode);
+                }
+                frame->Release(); // puts the frame to the pool
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Preallocated %zu output frames (pool depth %zu).\n",
+                        to_allocate, (size_t) buffers * s->devices_cnt);
+}
+
 /**
  * @todo
  * In non-low-latency mode, StopScheduledPlayback should be called. However, since this
@@ -869,6 +934,8 @@ display_decklink_reconfigure_video(void *state, struct video_desc desc)
                                 "EnableAudioOutput");
         }
 
+        preallocate_frames(s);
+
         if (!s->low_latency) {
                 for(int i = 0; i < s->devices_cnt; ++i) {
                         EXIT_IF_FAILED(s->state.at(i).deckLinkOutput->StartScheduledPlayback(0, s->frameRateScale, (double) s->frameRateDuration), "StartScheduledPlayback (video)");
@@ -1045,6 +1112,12 @@ static bool settings_init(struct state_decklink *s, const char *fmt,
                         }
                 } else if (strcasecmp(ptr, "low-latency") == 0 || strcasecmp(ptr, "no-low-latency") == 0) {
                         s->low_latency = strcasecmp(ptr, "low-latency") == 0;
+                } else if (strncasecmp(ptr, "buffers=", strlen("buffers=")) == 0) {
+                        s->buffers = parse_uint32(strchr(ptr, '=') + 1);
+                        if (s->buffers == 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Number of buffers must be positive!\n");
+                                return false;
+                        }
                 } else if (strcasecmp(ptr, "quad-square") == 0 || strcasecmp(ptr, "no-quad-square") == 0) {
                         s->quad_square_division_split.set_flag(strcasecmp(ptr, "quad-square") == 0);
                 } else if (strncasecmp(ptr, "hdr", strlen("hdr")) == 0) {
@@ -1613,12 +1686,16 @@ ULONG DeckLinkFrame::Release()
         if (--ref == 0) {
                 lock_guard<mutex> lg(buffer_pool.lock);
                 buffer_pool.frame_queue.push(this);
+                buffer_pool.frame_returned.notify_one();
         }
 	return ref;
 }
 
 DeckLinkFrame::DeckLinkFrame(long w, long h, long rb, BMDPixelFormat pf, buffer_pool_t & bp, HDRMetadata const & hdr_metadata)
-	: width(w), height(h), rawBytes(rb), pixelFormat(pf), data(new char[rb * h]), timecode(NULL), ref(1l),
+	: width(w), height(h), rawBytes(rb), pixelFormat(pf),
+        // page aligned (no bounce buffers in driver DMA), pinned for GPU decoders (see frame_alloc_set_pin_ops)
+        data((char *) frame_data_alloc_pinnable(rb * h), frame_data_free_pinnable),
+        timecode(NULL), ref(1l),
         buffer_pool(bp)
 {
         clear_video_buffer(reinterpret_cast<unsigned char *>(data.get()), rawBytes, rawBytes, height,
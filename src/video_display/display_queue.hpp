@@ -0,0 +1,189 @@
+/**
+ * @file   video_display/display_queue.hpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  Bounded queue of frames waiting for presentation with drop policy
+ *
+ * Shared by the displays presenting frames from their own render loop (GL,
+ * Vulkan). The policy decides what happens when the decoder puts a frame to
+ * a full queue - the oldest queued frame is replaced, the new one is dropped
+ * or the put blocks until the render loop consumes a frame. The display can
+ * signal the back-pressure to the decoder (DISPLAY_PROPERTY_BACKPRESSURE) so
+ * that it doesn't need to decode frames that would be dropped anyway.
+ */
+/*
+ * Copyright (c) 2025 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_VIDEO_DISPLAY_DISPLAY_QUEUE_HPP_7C2E9A41_5B3D_4E8F_A1C6_3D9F0B2E6C17
+#define SRC_VIDEO_DISPLAY_DISPLAY_QUEUE_HPP_7C2E9A41_5B3D_4E8F_A1C6_3D9F0B2E6C17
+
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <utility>
+
+enum class display_queue_policy {
+        drop_oldest, ///< the oldest queued frame is replaced by the new one
+        drop_newest, ///< the new frame is dropped
+        block,       ///< put waits until there is a room (even if nonblocking)
+};
+
+/**
+ * @param cfg  "drop-oldest", "drop-newest" or "block" (may be nullptr)
+ * @returns    parsed policy or dflt if cfg is nullptr or not recognized
+ */
+static inline display_queue_policy display_queue_policy_from_string(const char *cfg, display_queue_policy dflt)
+{
+        if (cfg == nullptr) {
+                return dflt;
+        }
+        if (strcmp(cfg, "drop-oldest") == 0) {
+                return display_queue_policy::drop_oldest;
+        }
+        if (strcmp(cfg, "drop-newest") == 0) {
+                return display_queue_policy::drop_newest;
+        }
+        if (strcmp(cfg, "block") == 0) {
+                return display_queue_policy::block;
+        }
+        return dflt;
+}
+
+/**
+ * The queue is not synchronized itself - it is guarded by the lock of the
+ * display (passed to wait_for_room()).
+ *
+ * If the render loop keeps the head in the queue until it is presented, it
+ * marks it with set_front_busy() so that it is not replaced by drop_oldest
+ * (the new frame is then dropped instead if there is no other queued frame).
+ */
+template<typename T>
+class display_queue {
+public:
+        static constexpr long long WAIT_FOREVER = LLONG_MAX; ///< same value as PUTF_BLOCKING
+
+        display_queue(size_t capacity, display_queue_policy policy) : capacity(capacity), policy(policy) {}
+
+        void set_policy(display_queue_policy p) { policy = p; }
+        display_queue_policy get_policy() const { return policy; }
+
+        size_t size() const { return items.size(); }
+        bool empty() const { return items.empty(); }
+        bool full() const { return items.size() >= capacity; }
+        T &front() { return items.front(); }
+
+        /// removes the head (also clears its busy mark)
+        T pop() {
+                T item = std::move(items.front());
+                items.pop_front();
+                front_busy = false;
+                return item;
+        }
+
+        void set_front_busy() { front_busy = !items.empty(); }
+
+        /// back-pressure - a frame put now without waiting would be dropped
+        bool would_drop() const {
+                if (!full() || policy == display_queue_policy::block) {
+                        return false;
+                }
+                return policy == display_queue_policy::drop_newest || !can_replace();
+        }
+
+        /**
+         * Waits until there is a room in the queue. Nonblocking (timeout 0)
+         * and timed waits are turned to blocking by the block policy.
+         *
+         * @param room_cv    notified by the render loop when a frame is popped
+         * @param timeout_ns 0 - don't wait, WAIT_FOREVER or number of nanoseconds
+         * @returns          true if there is a room
+         */
+        template<typename Lock>
+        bool wait_for_room(std::condition_variable &room_cv, Lock &lk, long long timeout_ns) const {
+                auto has_room = [this] { return !full(); };
+                if (policy == display_queue_policy::block || timeout_ns == WAIT_FOREVER) {
+                        room_cv.wait(lk, has_room);
+                        return true;
+                }
+                if (timeout_ns > 0) {
+                        return room_cv.wait_for(lk, std::chrono::nanoseconds(timeout_ns), has_room);
+                }
+                return has_room();
+        }
+
+        /**
+         * Queues the item, if the queue is full, the policy is applied (block
+         * behaves as drop_newest here - the caller should wait_for_room() first).
+         *
+         * @param[out] dropped     set to the dropped item (the replaced one or item itself)
+         * @param[out] dropped_idx index of the replaced item in the queue (if item was queued)
+         * @returns                true if item was queued
+         */
+        bool push(T item, T *dropped, size_t *dropped_idx = nullptr) {
+                if (!full()) {
+                        items.push_back(std::move(item));
+                        return true;
+                }
+                if (policy != display_queue_policy::drop_oldest || !can_replace()) {
+                        *dropped = std::move(item);
+                        return false;
+                }
+                auto victim = items.begin() + (front_busy ? 1 : 0);
+                if (dropped_idx != nullptr) {
+                        *dropped_idx = victim - items.begin();
+                }
+                *dropped = std::move(*victim);
+                items.erase(victim);
+                items.push_back(std::move(item));
+                return true;
+        }
+
+        /// queues the item regardless of the capacity (eg. poison pill)
+        void force_push(T item) {
+                items.push_back(std::move(item));
+        }
+
+private:
+        bool can_replace() const {
+                return items.size() > (front_busy ? 1U : 0U);
+        }
+
+        std::deque<T> items;
+        size_t capacity;
+        display_queue_policy policy;
+        bool front_busy = false;
+};
+
+#endif // defined SRC_VIDEO_DISPLAY_DISPLAY_QUEUE_HPP_7C2E9A41_5B3D_4E8F_A1C6_3D9F0B2E6C17
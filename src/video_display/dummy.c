@@ -40,6 +40,10 @@
 #include "config_win32.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -50,11 +54,13 @@
 #include "utils/macros.h"
 #include "utils/misc.h"
 #include "utils/text.h"
+#include "utils/thread.h"
 #include "video.h"
 #include "video_codec.h"
 #include "video_display.h"
 
 #define DEFAULT_DUMP_LEN 32
+#define DEFAULT_STRIPE_HEIGHT 64
 #define MOD_NAME "[dummy] "
 
 static const codec_t default_codecs[] = {I420, UYVY, YUYV, v210, R10k, R12L, RGBA, RGB, BGR, RG48};
@@ -81,6 +87,21 @@ struct dummy_display_state {
         _Bool oneshot;
         _Bool raw;
         int dump_to_file_skip_frames;
+
+        /// @name stripe consumer
+        /// reads stripes of the frame returned by getf() as they are being written
+        /// @{
+        unsigned int stripe_height; ///< 0 - disabled
+        pthread_t stripe_thread;
+        pthread_mutex_t stripe_lock;
+        pthread_cond_t stripe_cv;
+        struct video_frame *stripe_frame; ///< frame being consumed, NULL if idle
+        _Bool stripe_exit;
+        atomic_int stripes_consumed; ///< of stripe_frame
+        long long stripes_total;
+        long long stripes_early; ///< stripes consumed before putf()
+        uint64_t checksum;
+        /// @}
 };
 
 static _Bool parse_codecs(char *str, codec_t *codecs, size_t *codec_count) {
@@ -136,6 +157,12 @@ static _Bool dummy_parse_opts(struct dummy_display_state *s, char *fmt) {
                         s->oneshot = 1;
                 } else if (strcmp(item, "raw") == 0) {
                         s->raw = 1;
+                } else if (strstr(item, "stripes") == item) {
+                        s->stripe_height = strchr(item, '=') != NULL ? atoi(strchr(item, '=') + 1) : DEFAULT_STRIPE_HEIGHT;
+                        if (s->stripe_height == 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong stripe height: %s\n", item);
+                                return 0;
+                        }
                 } else {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unrecognized option: %s\n", item);
                         return 0;
@@ -147,6 +174,46 @@ static _Bool dummy_parse_opts(struct dummy_display_state *s, char *fmt) {
         return 1;
 }
 
+/**
+ * Reads the stripes of the frame handed out by getf() in order as soon as
+ * they are complete (a stand-in for eg. an upload to GPU).
+ */
+static void *stripe_consumer(void *arg)
+{
+        struct dummy_display_state *s = arg;
+        set_thread_name("dummy_stripes");
+        pthread_mutex_lock(&s->stripe_lock);
+        while (!s->stripe_exit) {
+                if (s->stripe_frame == NULL) {
+                        pthread_cond_wait(&s->stripe_cv, &s->stripe_lock);
+                        continue;
+                }
+                struct video_frame *f = s->stripe_frame;
+                pthread_mutex_unlock(&s->stripe_lock);
+
+                const size_t linesize = vc_get_linesize(f->tiles[0].width, f->color_spec);
+                uint64_t sum = 0;
+                for (int i = 0; i < vf_stripes_count(f); ++i) {
+                        vf_stripe_wait(f, i);
+                        const size_t begin = vf_stripe_first_row(f, i) * linesize;
+                        const size_t end = MIN(vf_stripe_first_row(f, i + 1) * linesize, f->tiles[0].data_len);
+                        for (size_t off = begin; off + sizeof sum <= end; off += sizeof sum) {
+                                uint64_t val = 0;
+                                memcpy(&val, f->tiles[0].data + off, sizeof val);
+                                sum += val;
+                        }
+                        atomic_fetch_add(&s->stripes_consumed, 1);
+                }
+
+                pthread_mutex_lock(&s->stripe_lock);
+                s->checksum ^= sum;
+                s->stripe_frame = NULL;
+                pthread_cond_broadcast(&s->stripe_cv);
+        }
+        pthread_mutex_unlock(&s->stripe_lock);
+        return NULL;
+}
+
 static void *display_dummy_init(struct module *parent, const char *cfg, unsigned int flags)
 {
         UNUSED(parent), UNUSED(flags);
@@ -160,6 +227,7 @@ static void *display_dummy_init(struct module *parent, const char *cfg, unsigned
                         { "rgb_shift=<r>,<g>,<b>", "if using output codec RGBA, use specified shifts instead of default (" TOSTRING(DEFAULT_R_SHIFT) ", " TOSTRING(DEFAULT_G_SHIFT) ", " TOSTRING(DEFAULT_B_SHIFT) ")" },
                         { "dump[:skip=<n>][:oneshot][:raw]", "dump first frame to file dummy.<ext> (optionally skip <n> first frames); 'oneshot' - exit after dumping the picture; 'raw' - dump raw data" },
                         { "hexdump[=<n>]", "dump first n (default " TOSTRING(DEFAULT_DUMP_LEN) ") bytes of every frame in hexadecimal format" },
+                        { "stripes[=<rows>]", "read the frame in stripes of <rows> (default " TOSTRING(DEFAULT_STRIPE_HEIGHT) ") lines already while it is being received (to evaluate the stripe pipeline)" },
                         { NULL, NULL }
                 };
                 print_module_usage("-d dummy", options, NULL, 0);
@@ -182,21 +250,64 @@ static void *display_dummy_init(struct module *parent, const char *cfg, unsigned
 
         struct dummy_display_state *ret = malloc(sizeof s);
         memcpy(ret, &s, sizeof s);
+        if (ret->stripe_height > 0) {
+                pthread_mutex_init(&ret->stripe_lock, NULL);
+                pthread_cond_init(&ret->stripe_cv, NULL);
+                pthread_create(&ret->stripe_thread, NULL, stripe_consumer, ret);
+        }
 
         return ret;
 }
 
+/// waits until the stripe consumer finishes the current frame, all stripes are completed first if abort is set
+static void stripe_consumer_wait(struct dummy_display_state *s, _Bool abort)
+{
+        if (s->stripe_height == 0) {
+                return;
+        }
+        pthread_mutex_lock(&s->stripe_lock);
+        if (abort && s->stripe_frame != NULL) {
+                vf_stripes_complete(s->stripe_frame);
+        }
+        while (s->stripe_frame != NULL) {
+                pthread_cond_wait(&s->stripe_cv, &s->stripe_lock);
+        }
+        pthread_mutex_unlock(&s->stripe_lock);
+}
+
 static void display_dummy_done(void *state)
 {
         struct dummy_display_state *s = state;
 
+        if (s->stripe_height > 0) {
+                stripe_consumer_wait(s, 1);
+                pthread_mutex_lock(&s->stripe_lock);
+                s->stripe_exit = 1;
+                pthread_cond_broadcast(&s->stripe_cv);
+                pthread_mutex_unlock(&s->stripe_lock);
+                pthread_join(s->stripe_thread, NULL);
+                pthread_cond_destroy(&s->stripe_cv);
+                pthread_mutex_destroy(&s->stripe_lock);
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "%lld of %lld stripes read before the frame was complete (checksum %" PRIx64 ").\n",
+                                s->stripes_early, s->stripes_total, s->checksum);
+        }
         vf_free(s->f);
         free(s);
 }
 
 static struct video_frame *display_dummy_getf(void *state)
 {
-        return ((struct dummy_display_state *) state)->f;
+        struct dummy_display_state *s = state;
+        if (s->stripe_height > 0 && s->f != NULL) {
+                stripe_consumer_wait(s, 1);
+                vf_stripes_reset(s->f);
+                pthread_mutex_lock(&s->stripe_lock);
+                atomic_store(&s->stripes_consumed, 0);
+                s->stripe_frame = s->f;
+                pthread_cond_broadcast(&s->stripe_cv);
+                pthread_mutex_unlock(&s->stripe_lock);
+        }
+        return s->f;
 }
 
 static void dump_buf(unsigned char *buf, size_t len, int block_size) {
@@ -216,6 +327,12 @@ static int display_dummy_putf(void *state, struct video_frame *frame, long long
                 return 0;
         }
         struct dummy_display_state *s = state;
+        if (s->stripe_height > 0 && frame == s->f) {
+                // stripes are already completed by display_put_frame()
+                s->stripes_early += atomic_load(&s->stripes_consumed);
+                stripe_consumer_wait(s, 0);
+                s->stripes_total += vf_stripes_count(frame);
+        }
         if (s->dump_bytes > 0) {
                 dump_buf((unsigned char *)(frame->tiles[0].data), MIN(frame->tiles[0].data_len, s->dump_bytes), get_pf_block_bytes(frame->color_spec));
         }
@@ -268,8 +385,12 @@ static int display_dummy_get_property(void *state, int property, void *val, size
 static int display_dummy_reconfigure(void *state, struct video_desc desc)
 {
         struct dummy_display_state *s = state;
+        stripe_consumer_wait(s, 1);
         vf_free(s->f);
         s->f = vf_alloc_desc_data(desc);
+        if (s->stripe_height > 0) {
+                vf_stripes_enable(s->f, s->stripe_height);
+        }
 
         return TRUE;
 }
@@ -0,0 +1,358 @@
+/**
+ * @file   video_display/fifo.c
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  Streams the frames as Y4M or raw data to stdout or a FIFO
+ *
+ * Intended for piping the decoded video to an external tool (ffmpeg, an
+ * analyzer). If the output is a pipe on Linux, the frame data are passed
+ * with vmsplice(), which maps the page-aligned frame buffer to the pipe
+ * instead of copying it. The buffer must then not be touched until the
+ * consumer reads it, so the frames are taken from a small ring and a buffer
+ * is returned by getf() only after the pipe has drained past its end.
+ * Otherwise writev() is used.
+ */
+/*
+ * Copyright (c) 2025 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#endif
+#include <unistd.h>
+
+#include "debug.h"
+#include "lib_common.h"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
+#include "video.h"
+#include "video_display.h"
+
+#define MOD_NAME "[fifo] "
+#define FIFO_RING_LEN 3
+#define FIFO_BUF_ALIGN 4096 ///< page size - vmsplice() maps whole pages
+
+#ifdef _WIN32
+struct iovec {
+        void *iov_base;
+        size_t iov_len;
+};
+#endif
+
+struct fifo_display_state {
+        int fd;
+        bool close_fd;
+        bool raw;
+        bool splice; ///< output is a pipe and vmsplice() is used
+
+        struct video_desc desc;
+        struct video_frame *ring[FIFO_RING_LEN];
+        unsigned long long ring_end[FIFO_RING_LEN]; ///< stream position of the end of the buffer data
+        unsigned int next;
+        unsigned long long written; ///< bytes written to the output so far
+        bool stream_header_written;
+};
+
+static void usage()
+{
+        color_printf("Usage:\n");
+        color_printf(TERM_BOLD TERM_FG_RED "\t-d fifo" TERM_FG_RESET "[:<path>][:raw]\n" TERM_RESET);
+        color_printf("where\n");
+        color_printf(TERM_BOLD "\t<path>" TERM_RESET " - FIFO or file to write to, stdout if not given or '-'\n");
+        color_printf(TERM_BOLD "\traw" TERM_RESET "    - write raw frames in the received pixel format instead of Y4M\n");
+        color_printf("\nY4M output requires I420 (eg. --param decoder-use-codec=I420).\n");
+        color_printf("When writing to stdout, UltraGrid messages are redirected to stderr.\n");
+}
+
+static bool fifo_open(struct fifo_display_state *s, const char *path)
+{
+        if (path == NULL || strcmp(path, "-") == 0) {
+                // keep our output clean - log messages are printed to stdout
+                s->fd = dup(STDOUT_FILENO);
+                if (s->fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot redirect stdout: %s\n", ug_strerror(errno));
+                        return false;
+                }
+        } else {
+                log_msg(LOG_LEVEL_INFO, MOD_NAME "Opening %s (waits for a reader if it is a FIFO).\n", path);
+                s->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (s->fd == -1) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot open %s: %s\n", path, ug_strerror(errno));
+                        return false;
+                }
+        }
+        s->close_fd = true;
+#ifdef __linux__
+        struct stat st;
+        s->splice = fstat(s->fd, &st) == 0 && S_ISFIFO(st.st_mode);
+#endif
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %s.\n", s->splice ? "vmsplice" : "writev");
+        return true;
+}
+
+static void *display_fifo_init(struct module *parent, const char *cfg, unsigned int flags)
+{
+        (void) parent, (void) flags;
+        if (strcmp(cfg, "help") == 0) {
+                usage();
+                return INIT_NOERR;
+        }
+        struct fifo_display_state *s = calloc(1, sizeof *s);
+        s->fd = -1;
+        char *cfg_copy = strdupa(cfg);
+        char *path = NULL;
+        char *save_ptr = NULL;
+        char *item = NULL;
+        while ((item = strtok_r(cfg_copy, ":", &save_ptr)) != NULL) {
+                cfg_copy = NULL;
+                if (strcmp(item, "raw") == 0) {
+                        s->raw = true;
+                } else {
+                        path = item;
+                }
+        }
+        if (!fifo_open(s, path)) {
+                free(s);
+                return NULL;
+        }
+        return s;
+}
+
+static void display_fifo_done(void *state)
+{
+        struct fifo_display_state *s = state;
+
+        for (int i = 0; i < FIFO_RING_LEN; ++i) {
+                vf_free(s->ring[i]);
+        }
+        if (s->close_fd) {
+                close(s->fd);
+        }
+        free(s);
+}
+
+static void fifo_data_deleter(struct video_frame *f)
+{
+        for (unsigned int i = 0; i < f->tile_count; ++i) {
+                aligned_free(f->tiles[i].data);
+        }
+}
+
+/**
+ * Waits until the consumer has read the stream up to the position end, so
+ * that the pages passed with vmsplice() may be overwritten.
+ */
+static void fifo_wait_consumed(struct fifo_display_state *s, unsigned long long end)
+{
+#ifdef __linux__
+        while (s->splice) {
+                int queued = 0;
+                if (ioctl(s->fd, FIONREAD, &queued) != 0 || s->written - queued >= end) {
+                        return;
+                }
+                usleep(1000);
+        }
+#else
+        (void) s, (void) end;
+#endif
+}
+
+static struct video_frame *display_fifo_getf(void *state)
+{
+        struct fifo_display_state *s = state;
+        fifo_wait_consumed(s, s->ring_end[s->next]);
+        return s->ring[s->next];
+}
+
+/// writes all iovecs, vmsplice() is used instead of writev() if splice is set
+static bool fifo_write_iov(int fd, struct iovec *iov, int count, bool splice)
+{
+        while (count > 0) {
+#ifdef __linux__
+                ssize_t ret = splice ? vmsplice(fd, iov, count, 0) : writev(fd, iov, count);
+#elif !defined _WIN32
+                assert(!splice);
+                ssize_t ret = writev(fd, iov, count);
+#else
+                assert(!splice);
+                ssize_t ret = write(fd, iov->iov_base, iov->iov_len);
+#endif
+                if (ret < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Write failed: %s\n", ug_strerror(errno));
+                        return false;
+                }
+                while (count > 0 && (size_t) ret >= iov->iov_len) {
+                        ret -= (ssize_t) iov->iov_len;
+                        iov++;
+                        count--;
+                }
+                if (count > 0) {
+                        iov->iov_base = (char *) iov->iov_base + ret;
+                        iov->iov_len -= ret;
+                }
+        }
+        return true;
+}
+
+static int display_fifo_putf(void *state, struct video_frame *frame, long long flags)
+{
+        struct fifo_display_state *s = state;
+        if (frame == NULL || flags == PUTF_DISCARD) {
+                return 0;
+        }
+        assert(frame == s->ring[s->next]);
+
+        char header[256] = "";
+        if (!s->raw) {
+                if (!s->stream_header_written) {
+                        snprintf(header, sizeof header, "YUV4MPEG2 W%u H%u F%d:%d I%c A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                                        s->desc.width, s->desc.height,
+                                        get_framerate_n(s->desc.fps), get_framerate_d(s->desc.fps),
+                                        s->desc.interlacing == INTERLACED_MERGED ? 't' : 'p');
+                        s->stream_header_written = true;
+                }
+                strncat(header, "FRAME\n", sizeof header - strlen(header) - 1);
+        }
+        struct iovec iov[2] = {
+                { header, strlen(header) },
+                { frame->tiles[0].data, frame->tiles[0].data_len },
+        };
+        bool ret = true;
+        if (s->splice) {
+                // header is a stack buffer - copy it, only the frame data are mapped
+                ret = fifo_write_iov(s->fd, iov, 1, false) && fifo_write_iov(s->fd, iov + 1, 1, true);
+        } else {
+                ret = fifo_write_iov(s->fd, iov, 2, false);
+        }
+        s->written += iov[0].iov_len + frame->tiles[0].data_len;
+        s->ring_end[s->next] = s->written;
+        s->next = (s->next + 1) % FIFO_RING_LEN;
+
+        return ret ? 0 : 1;
+}
+
+static int display_fifo_get_property(void *state, int property, void *val, size_t *len)
+{
+        struct fifo_display_state *s = state;
+        codec_t codecs[VIDEO_CODEC_COUNT - 1];
+        size_t codecs_len = 0;
+
+        if (s->raw) {
+                for (int i = 1; i < VIDEO_CODEC_COUNT; ++i) {
+                        if (!is_codec_opaque((codec_t) i) && !is_codec_interframe((codec_t) i)) {
+                                codecs[codecs_len++] = (codec_t) i;
+                        }
+                }
+        } else {
+                codecs[codecs_len++] = I420;
+        }
+
+        switch (property) {
+                case DISPLAY_PROPERTY_CODECS:
+                        if (codecs_len * sizeof codecs[0] <= *len) {
+                                memcpy(val, codecs, codecs_len * sizeof codecs[0]);
+                                *len = codecs_len * sizeof codecs[0];
+                        } else {
+                                return FALSE;
+                        }
+                        break;
+                case DISPLAY_PROPERTY_VIDEO_MODE:
+                        *(int *) val = DISPLAY_PROPERTY_VIDEO_MERGED;
+                        *len = sizeof(int);
+                        break;
+                default:
+                        return FALSE;
+        }
+        return TRUE;
+}
+
+static int display_fifo_reconfigure(void *state, struct video_desc desc)
+{
+        struct fifo_display_state *s = state;
+        if (!s->raw && s->stream_header_written && !video_desc_eq(s->desc, desc)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Y4M stream format changed, the consumer may not handle that!\n");
+        }
+        s->stream_header_written = false;
+        s->desc = desc;
+
+        for (int i = 0; i < FIFO_RING_LEN; ++i) {
+                fifo_wait_consumed(s, s->ring_end[i]);
+                vf_free(s->ring[i]);
+                s->ring[i] = vf_alloc_desc(desc);
+                struct tile *t = &s->ring[i]->tiles[0];
+                size_t alloc_len = (t->data_len + FIFO_BUF_ALIGN - 1) / FIFO_BUF_ALIGN * FIFO_BUF_ALIGN;
+                t->data = aligned_malloc(alloc_len, FIFO_BUF_ALIGN);
+                if (t->data == NULL) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot allocate frame buffer!\n");
+                        return FALSE;
+                }
+                s->ring[i]->callbacks.data_deleter = fifo_data_deleter;
+        }
+
+        return TRUE;
+}
+
+static void display_fifo_probe(struct device_info **available_cards, int *count, void (**deleter)(void *)) {
+        UNUSED(deleter);
+        *available_cards = NULL;
+        *count = 0;
+}
+
+static const struct video_display_info display_fifo_info = {
+        display_fifo_probe,
+        display_fifo_init,
+        NULL, // _run
+        display_fifo_done,
+        display_fifo_getf,
+        display_fifo_putf,
+        display_fifo_reconfigure,
+        display_fifo_get_property,
+        NULL, // _put_audio_frame
+        NULL, // _reconfigure_audio,
+        MOD_NAME,
+};
+
+REGISTER_MODULE(fifo, &display_fifo_info, LIBRARY_CLASS_VIDEO_DISPLAY, VIDEO_DISPLAY_ABI_VERSION);
@@ -82,6 +82,8 @@
 #include "utils/ref_count.hpp"
 #include "video.h"
 #include "video_display.h"
+#include "video_display/display_queue.hpp"
+#include "video_display/present_scheduler.hpp"
 #include "tv.h"
 
 #define MAGIC_GL         0x1331018e
@@ -96,6 +98,7 @@
 #define SINGLE_BUF 0xFF // use single buffering instead of double
 
 #include "gl_vdpau.hpp"
+#include "gl_vaapi.hpp"
 
 using namespace std;
 using namespace std::chrono_literals;
@@ -114,6 +117,24 @@ void main()
 }
 )raw";
 
+/// keeps the top field and interpolates the lines of the bottom one
+static const char * deinterlace_bob_fp = R"raw(
+#version 110
+uniform sampler2D image;
+uniform float lines;
+void main()
+{
+        float line = floor(gl_TexCoord[0].y * lines);
+        if (mod(line, 2.0) < 0.5) {
+                gl_FragColor = texture2D(image, vec2(gl_TexCoord[0].x, (line + 0.5) / lines));
+        } else {
+                vec4 pix_up = texture2D(image, vec2(gl_TexCoord[0].x, (line - 0.5) / lines));
+                vec4 pix_down = texture2D(image, vec2(gl_TexCoord[0].x, min(line + 1.5, lines - 1.5) / lines));
+                gl_FragColor = (pix_up + pix_down) / 2.0;
+        }
+}
+)raw";
+
 static const char * uyvy_to_rgb_fp = R"raw(
 #version 110
 uniform sampler2D image;
@@ -255,6 +276,26 @@ void main(void) {
 }
 )raw";
 
+/// 2-plane 4:2:0 (NV12, P010) - luma in image, interleaved chroma in imageUV
+static const char * yuv420_biplanar_to_rgb_fp = R"raw(
+#version 110
+uniform sampler2D image;
+uniform sampler2D imageUV;
+void main()
+{
+        vec4 yuv;
+        yuv.r = texture2D(image, gl_TexCoord[0].xy).r;
+        yuv.gb = texture2D(imageUV, gl_TexCoord[0].xy).rg;
+        yuv.r = Y_SCALED_PLACEHOLDER * (yuv.r - 0.0625);
+        yuv.g = yuv.g - 0.5;
+        yuv.b = yuv.b - 0.5;
+        gl_FragColor.r = yuv.r + R_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.g = yuv.r + G_CB_PLACEHOLDER * yuv.g + G_CR_PLACEHOLDER * yuv.b;
+        gl_FragColor.b = yuv.r + B_CB_PLACEHOLDER * yuv.g;
+        gl_FragColor.a = 1.0;
+}
+)raw";
+
 /* DXT YUV (FastDXT) related */
 static const char *fp_display_dxt1_yuv = R"raw(
 #version 110
@@ -308,6 +349,9 @@ unordered_map<codec_t, const char *> glsl_programs = {
         { v210, v210_to_rgb_fp },
         { DXT1_YUV, fp_display_dxt1_yuv },
         { DXT5, fp_display_dxt5ycocg },
+#ifdef HWACC_VAAPI_EGL
+        { HW_VAAPI, yuv420_biplanar_to_rgb_fp },
+#endif
 };
 
 static constexpr array keybindings{
@@ -326,7 +370,7 @@ static bool display_gl_init_opengl(struct state_gl *s);
 static int display_gl_putf(void *state, struct video_frame *frame, long long timeout);
 static bool display_gl_process_key(struct state_gl *s, long long int key);
 static int display_gl_reconfigure(void *state, struct video_desc desc);
-static void gl_draw(double ratio, double bottom_offset, bool double_buf);
+static void gl_draw(double ratio, const float *tex_rect, bool double_buf);
 static void gl_change_aspect(struct state_gl *s, int width, int height);
 static void gl_resize(GLFWwindow *win, int width, int height);
 static void gl_render_glsl(struct state_gl *s, char *data);
@@ -343,10 +387,23 @@ static void upload_compressed_texture(struct state_gl *s, char *data);
 static void upload_texture(struct state_gl *s, char *data);
 static bool check_rpi_pbo_quirks();
 static void set_gamma(struct state_gl *s);
+static void gl_alloc_pbo_frames(struct state_gl *s, struct video_desc desc);
+static void gl_free_retired_pbo_frames(struct state_gl *s);
+static void gl_pbo_frame_wait(struct state_gl *s, struct video_frame *frame);
+
+/// number of frames decoded directly to persistently mapped PBOs
+constexpr int PBO_RING_SIZE = 3;
+
+/// data_deleter of frames from gl_alloc_pbo_frames(), also used to identify them
+static void pbo_frame_data_deleter(struct video_frame * /* frame */)
+{
+        // the PBO is deleted by the GL thread
+}
 
 struct state_gl {
         unordered_map<codec_t, GLuint> PHandles;
         GLuint          PHandle_deint = 0;
+        GLuint          PHandle_deint_bob = 0;
         GLuint          current_program = 0;
 
         // Framebuffer
@@ -355,6 +412,15 @@ struct state_gl {
         GLuint texture_raw = 0;
         GLuint pbo_id = 0;
 
+        /// frame data in a persistently mapped PBO (GL_ARB_buffer_storage)
+        struct pbo_frame {
+                GLuint pbo;
+                GLsync fence; ///< upload from the PBO issued, 0 if none pending
+        };
+        unordered_map<struct video_frame *, pbo_frame> pbo_frames; ///< accessed only from the GL thread
+        pbo_frame      *current_pbo = nullptr; ///< PBO of the frame being rendered if it has one
+        vector<struct video_frame *> pbo_frames_retired; ///< PBO frames with obsolete desc (guarded by lock)
+
         /* For debugging... */
         uint32_t        magic = MAGIC_GL;
 
@@ -363,10 +429,14 @@ struct state_gl {
 
         bool            fs = false;
         enum class deint { off, on, force } deinterlace = deint::off;
+        bool            deint_bob = false; ///< interpolate the top field instead of blending the fields
+        struct display_region { int width, height, x, y; };
+        display_region  crop{};   ///< requested region to be displayed (width 0 - whole frame)
+        display_region  region{}; ///< displayed region of the current frame (crop clamped to the frame)
 
         struct video_frame *current_frame = nullptr;
 
-        queue<struct video_frame *> frame_queue;
+        display_queue<struct video_frame *> frame_queue{MAX_BUFFER_SIZE, display_queue_policy::drop_newest}; ///< head is being presented
         queue<struct video_frame *> free_frame_queue;
         struct video_desc current_desc = {};
         struct video_desc current_display_desc {};
@@ -381,6 +451,8 @@ struct state_gl {
         int             dxt_height = 0;
 
         int             vsync = 1;
+        bool            sched = false; ///< align presentation of frames to VBlank with present_scheduler
+        present_scheduler scheduler{MOD_NAME}; ///< guarded by lock
         bool            paused = false;
         enum show_cursor_t { SC_TRUE, SC_FALSE, SC_AUTOHIDE } show_cursor = SC_AUTOHIDE;
         chrono::steady_clock::time_point                      cursor_shown_from{}; ///< indicates time point from which is cursor show if show_cursor == SC_AUTOHIDE, timepoint() means cursor is not currently shown
@@ -402,6 +474,9 @@ struct state_gl {
         int use_pbo = -1;
 #ifdef HWACC_VDPAU
         struct state_vdpau vdp;
+#endif
+#ifdef HWACC_VAAPI_EGL
+        struct state_vaapi_egl vaapi;
 #endif
         vector<char> scratchpad; ///< scratchpad sized WxHx8
 
@@ -436,6 +511,9 @@ struct state_gl {
 static constexpr array gl_supp_codecs = {
 #ifdef HWACC_VDPAU
         HW_VDPAU,
+#endif
+#ifdef HWACC_VAAPI_EGL
+        HW_VAAPI,
 #endif
         UYVY,
         v210,
@@ -494,18 +572,21 @@ static void gl_print_monitors(bool fullhelp) {
  */
 static void gl_show_help(bool full) {
         col() << "usage:\n";
-        col() << SBOLD(SRED("\t-d gl") << "[:d|:fs[=<monitor>]|:aspect=<v>/<h>|:cursor|:size=X%%|:syphon[=<name>]|:spout[=<name>]|:modeset[=<fps>]|:nodecorate|:fixed_size[=WxH]|:vsync[=<x>|single]]* | gl:[full]help"
+        col() << SBOLD(SRED("\t-d gl") << "[:d[force][=bob]|:crop=<w>x<h>[+<x>+<y>]|:fs[=<monitor>]|:aspect=<v>/<h>|:cursor|:size=X%%|:syphon[=<name>]|:spout[=<name>]|:modeset[=<fps>]|:nodecorate|:fixed_size[=WxH]|:vsync[=<x>|single]|:sched]* | gl:[full]help"
                 << (full ? " [--param " GL_DISABLE_10B_OPT_PARAM_NAME "|" GL_WINDOW_HINT_OPT_PARAM_NAME "=<k>=<v>]" : "")) << "\n\n";
         col() << "options:\n";
         col() << TBOLD("\taspect=<w>/<h>") << "\trequested video aspect (eg. 16/9). Leave unset if PAR = 1.\n";
         col() << TBOLD("\tcursor")      << "\t\tshow visible cursor\n";
-        col() << TBOLD("\td[force]")    << "\tdeinterlace (optionally forcing deinterlace of progressive video)\n";
+        col() << TBOLD("\tcrop=<w>x<h>[+<x>+<y>]") << " display only the region of the frame (cropped when rendering)\n";
+        col() << TBOLD("\td[force][=bob]") << "\tdeinterlace (optionally forcing deinterlace of progressive video), fields are blended\n"
+                "\t\t\tor with \"bob\" the lines of the top field are interpolated\n";
         col() << TBOLD("\tfs[=<monitor>]") << "\tfullscreen with optional display specification\n";
         col() << TBOLD("\tgamma[=<val>]") << "\tgamma value to be added _in addition_ to the hardware gamma correction\n";
         col() << TBOLD("\thide-window") << "\tdo not show OpenGL window (useful with Syphon/SPOUT)\n";
         col() << TBOLD("\tmodeset[=<fps>]")<< "\tset received video mode as display mode (in fullscreen); modeset=<fps>|size - set specified FPS or only size\n";
         col() << TBOLD("\tnodecorate")  << "\tdisable window decorations\n";
         col() << TBOLD("\tnovsync")     << "\t\tdo not turn sync on VBlank\n";
+        col() << TBOLD("\tsched")       << "\t\tschedule frames to VBlank according to their arrival (frame pacing, requires vsync)\n";
         col() << TBOLD("\t[no]pbo")     << "\t\tWhether or not use PBO (ignore if not sure)\n";
         col() << TBOLD("\tsingle")      << "\t\tuse single buffer (instead of double-buffering)\n";
         col() << TBOLD("\tsize")        << "\t\tspecifies desired size of window compared "
@@ -532,7 +613,8 @@ static void gl_load_splashscreen(struct state_gl *s)
 {
         struct video_frame *frame = get_splashscreen();
         display_gl_reconfigure(s, video_desc_from_frame(frame));
-        s->frame_queue.push(frame);
+        s->frame_queue.force_push(frame);
+        s->scheduler.frame_queued(get_time_in_ns(), frame->fps);
 }
 
 static void *display_gl_parse_fmt(struct state_gl *s, char *ptr) {
@@ -544,8 +626,15 @@ static void *display_gl_parse_fmt(struct state_gl *s, char *ptr) {
         char *tok, *save_ptr = NULL;
 
         while((tok = strtok_r(ptr, ":", &save_ptr)) != NULL) {
-                if (!strcmp(tok, "d") || !strcmp(tok, "dforce")) {
-                        s->deinterlace = !strcmp(tok, "d") ? state_gl::deint::on : state_gl::deint::force;
+                if (!strcmp(tok, "d") || !strcmp(tok, "dforce") || !strcmp(tok, "d=bob") || !strcmp(tok, "dforce=bob")) {
+                        s->deinterlace = strncmp(tok, "dforce", strlen("dforce")) != 0 ? state_gl::deint::on : state_gl::deint::force;
+                        s->deint_bob = strchr(tok, '=') != nullptr;
+                } else if (strstr(tok, "crop=") == tok) {
+                        if (sscanf(tok, "crop=%dx%d+%d+%d", &s->crop.width, &s->crop.height, &s->crop.x, &s->crop.y) < 2
+                                        || s->crop.width <= 0 || s->crop.height <= 0 || s->crop.x < 0 || s->crop.y < 0) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Wrong crop specification: %s\n", tok + strlen("crop="));
+                                return nullptr;
+                        }
                 } else if(!strncmp(tok, "fs", 2)) {
                         s->fs = true;
                         if (char *val = strchr(tok, '=')) {
@@ -574,6 +663,8 @@ static void *display_gl_parse_fmt(struct state_gl *s, char *ptr) {
                         if(pos) s->video_aspect /= atof(pos + 1);
                 } else if(!strcasecmp(tok, "nodecorate")) {
                         s->nodecorate = true;
+                } else if (!strcasecmp(tok, "sched")) {
+                        s->sched = true;
                 } else if(!strcasecmp(tok, "novsync")) {
                         s->vsync = 0;
                 } else if(!strcasecmp(tok, "single")) {
@@ -640,6 +731,9 @@ static void * display_gl_init(struct module *parent, const char *fmt, unsigned i
                 return nullptr;
         }
 
+        s->frame_queue.set_policy(display_queue_policy_from_string(
+                                get_commandline_param("display-queue-policy"), display_queue_policy::drop_newest));
+
         if (fmt != NULL) {
                 char *tmp = strdup(fmt);
                 void *ret = nullptr;
@@ -819,7 +913,15 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         s->dxt_height = desc.color_spec == DXT1 || desc.color_spec == DXT1_YUV || desc.color_spec == DXT5 ?
                 (desc.height + 3) / 4 * 4 : desc.height;
 
-        s->aspect = s->video_aspect ? s->video_aspect : (double) desc.width / desc.height;
+        s->region = { (int) desc.width, (int) desc.height, 0, 0 };
+        if (s->crop.width > 0) {
+                s->region.x = min<int>(s->crop.x, desc.width - 1);
+                s->region.y = min<int>(s->crop.y, desc.height - 1);
+                s->region.width = min<int>(s->crop.width, desc.width - s->region.x);
+                s->region.height = min<int>(s->crop.height, desc.height - s->region.y);
+        }
+
+        s->aspect = s->video_aspect ? s->video_aspect : (double) s->region.width / s->region.height;
 
         log_msg(LOG_LEVEL_INFO, "Setting GL size %dx%d (%dx%d).\n", (int) round(s->aspect * desc.height),
                         desc.height, desc.width, desc.height);
@@ -942,12 +1044,25 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         else if (desc.color_spec == HW_VDPAU) {
                 s->vdp.init();
         }
+#endif
+#ifdef HWACC_VAAPI_EGL
+        else if (desc.color_spec == HW_VAAPI) {
+                glBindTexture(GL_TEXTURE_2D,s->texture_display);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                                desc.width, desc.height, 0,
+                                GL_RGBA, GL_UNSIGNED_BYTE,
+                                nullptr);
+                s->current_program = s->PHandles.at(HW_VAAPI);
+        }
 #endif
         if (s->current_program) {
                 glUseProgram(s->current_program);
                 if (GLint l = glGetUniformLocation(s->current_program, "image"); l != -1) {
                         glUniform1i(l, 2);
                 }
+                if (GLint l = glGetUniformLocation(s->current_program, "imageUV"); l != -1) {
+                        glUniform1i(l, 3);
+                }
                 if (GLint l = glGetUniformLocation(s->current_program, "imageWidth"); l != -1) {
                         glUniform1f(l, (GLfloat) desc.width);
                 }
@@ -959,6 +1074,12 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
                 glUniform1f(glGetUniformLocation(s->PHandle_deint, "lineOff"), 1.0f / desc.height);
                 glUseProgram(0);
         }
+        if (s->PHandle_deint_bob) {
+                glUseProgram(s->PHandle_deint_bob);
+                glUniform1i(glGetUniformLocation(s->PHandle_deint_bob, "image"), 0);
+                glUniform1f(glGetUniformLocation(s->PHandle_deint_bob, "lines"), (GLfloat) s->dxt_height);
+                glUseProgram(0);
+        }
         gl_check_error();
 
         glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, s->pbo_id);
@@ -968,7 +1089,7 @@ static void gl_reconfigure_screen(struct state_gl *s, struct video_desc desc)
         gl_check_error();
 
         if (!s->fixed_size) {
-                glfw_resize_window(s->window, s->fs, desc.height, s->aspect, desc.fps, s->window_size_factor);
+                glfw_resize_window(s->window, s->fs, s->region.height, s->aspect, desc.fps, s->window_size_factor);
                 //gl_resize(s->window, desc.width, desc.height);
         }
         int width, height;
@@ -1010,14 +1131,100 @@ static void gl_render(struct state_gl *s, char *data)
         gl_check_error();
 }
 
+/**
+ * Returns the frame to the pool of frames for getf(). Frames not obtained
+ * from getf() (DISPLAY_PROPERTY_EXTERNAL_FRAMES) are disposed instead.
+ */
+static void gl_release_frame(struct state_gl *s, struct video_frame *frame)
+{
+        if (frame->callbacks.dispose) {
+                frame->callbacks.dispose(frame);
+                return;
+        }
+        vf_recycle(frame);
+        s->free_frame_queue.push(frame);
+}
+
+static void gl_free_frame(struct video_frame *frame)
+{
+        if (frame != nullptr && frame->callbacks.dispose) {
+                frame->callbacks.dispose(frame);
+        } else {
+                vf_free(frame);
+        }
+}
+
 /// @note lk will be unlocked!
 static void pop_frame(struct state_gl *s, unique_lock<mutex> &lk)
 {
+        if (s->frame_queue.front() != nullptr) {
+                s->scheduler.frame_dequeued();
+        }
         s->frame_queue.pop();
         lk.unlock();
         s->frame_consumed_cv.notify_one();
 }
 
+static bool gl_scheduling_enabled(struct state_gl *s)
+{
+        return s->sched && s->vsync != 0 && s->vsync != SINGLE_BUF;
+}
+
+/**
+ * Drops the queued frames that would be superseded at the next VBlank.
+ * @returns the frame to be presented or nullptr if the current frame
+ *          should be repeated (lk is unlocked in that case)
+ */
+static struct video_frame *gl_schedule_frame(struct state_gl *s, unique_lock<mutex> &lk)
+{
+        size_t drop = s->scheduler.frames_to_drop();
+        s->scheduler.frames_dropped(drop);
+        for (size_t i = 0; i < drop; ++i) {
+                gl_release_frame(s, s->frame_queue.front());
+                s->scheduler.frame_dequeued();
+                s->frame_queue.pop();
+        }
+        if (drop > 0) {
+                s->frame_consumed_cv.notify_one();
+        }
+        if (s->current_frame == nullptr || s->scheduler.head_due()) {
+                return s->frame_queue.front();
+        }
+        lk.unlock();
+        return nullptr;
+}
+
+/**
+ * Draws texture_display to the window - the (optional) deinterlacing and
+ * cropping is done here so that the frame doesn't need to leave the GPU.
+ */
+static void gl_draw_frame(struct state_gl *s, bool double_buf)
+{
+        if (s->deinterlace == state_gl::deint::force || (s->deinterlace == state_gl::deint::on && s->current_display_desc.interlacing == INTERLACED_MERGED)) {
+                glUseProgram(s->deint_bob ? s->PHandle_deint_bob : s->PHandle_deint);
+        }
+        float tex_rect[4] = { 0.0F, 0.0F, 1.0F, 1.0F - (s->dxt_height - s->current_display_desc.height) / (float) s->dxt_height * 2 };
+        if (s->crop.width > 0) {
+                tex_rect[0] = (float) s->region.x / s->current_display_desc.width;
+                tex_rect[1] = (float) s->region.y / s->dxt_height;
+                tex_rect[2] = (float) (s->region.x + s->region.width) / s->current_display_desc.width;
+                tex_rect[3] = (float) (s->region.y + s->region.height) / s->dxt_height;
+        }
+        gl_draw(s->aspect, tex_rect, double_buf);
+        glUseProgram(0);
+}
+
+/// presents the current frame again and waits for VBlank
+static void gl_repeat_frame(struct state_gl *s)
+{
+        glBindTexture(GL_TEXTURE_2D, s->texture_display);
+        gl_draw_frame(s, true);
+        glfwSwapBuffers(s->window);
+
+        unique_lock<mutex> lk(s->lock);
+        s->scheduler.presented(get_time_in_ns(), false);
+}
+
 static void gl_process_frames(struct state_gl *s)
 {
         struct video_frame *frame;
@@ -1073,31 +1280,39 @@ static void gl_process_frames(struct state_gl *s)
                 }
 
                 glfwMakeContextCurrent(s->window);
+                gl_free_retired_pbo_frames(s);
 
                 if (s->paused) {
-                        vf_recycle(frame);
-                        s->free_frame_queue.push(frame);
+                        gl_release_frame(s, frame);
                         pop_frame(s, lk);
                         return;
                 }
+                if (gl_scheduling_enabled(s)) {
+                        frame = gl_schedule_frame(s, lk);
+                        if (!frame) {
+                                gl_repeat_frame(s);
+                                return;
+                        }
+                }
                 if (s->current_frame) {
-                        vf_recycle(s->current_frame);
-                        s->free_frame_queue.push(s->current_frame);
+                        gl_pbo_frame_wait(s, s->current_frame);
+                        gl_release_frame(s, s->current_frame);
                 }
                 s->current_frame = frame;
+                s->frame_queue.set_front_busy();
         }
 
         if (!video_desc_eq(video_desc_from_frame(frame), s->current_display_desc)) {
                 gl_reconfigure_screen(s, video_desc_from_frame(frame));
+                gl_alloc_pbo_frames(s, video_desc_from_frame(frame));
         }
         glBindTexture(GL_TEXTURE_2D, s->texture_display);
 
+        auto pbo_it = s->pbo_frames.find(frame);
+        s->current_pbo = pbo_it != s->pbo_frames.end() ? &pbo_it->second : nullptr;
         gl_render(s, frame->tiles[0].data);
-        if (s->deinterlace == state_gl::deint::force || (s->deinterlace == state_gl::deint::on && s->current_display_desc.interlacing == INTERLACED_MERGED)) {
-                glUseProgram(s->PHandle_deint);
-        }
-        gl_draw(s->aspect, (s->dxt_height - s->current_display_desc.height) / (float) s->dxt_height * 2, s->vsync != SINGLE_BUF);
-        glUseProgram(0);
+        s->current_pbo = nullptr;
+        gl_draw_frame(s, s->vsync != SINGLE_BUF);
 
         // publish to Syphon/Spout
         if (s->syphon_spout) {
@@ -1117,6 +1332,9 @@ static void gl_process_frames(struct state_gl *s)
         log_msg(LOG_LEVEL_DEBUG, "Render buffer %dx%d\n", frame->tiles[0].width, frame->tiles[0].height);
         {
                 unique_lock<mutex> lk(s->lock);
+                if (gl_scheduling_enabled(s)) {
+                        s->scheduler.presented(get_time_in_ns(), true);
+                }
                 pop_frame(s, lk);
         }
 }
@@ -1192,11 +1410,11 @@ static bool display_gl_process_key(struct state_gl *s, long long int key)
                         break;
                 case K_CTRL_UP:
                         s->window_size_factor *= 1.1;
-                        glfw_resize_window(s->window, s->fs, s->current_display_desc.height, s->aspect, s->current_display_desc.fps, s->window_size_factor);
+                        glfw_resize_window(s->window, s->fs, s->region.height, s->aspect, s->current_display_desc.fps, s->window_size_factor);
                         break;
                 case K_CTRL_DOWN:
                         s->window_size_factor /= 1.1;
-                        glfw_resize_window(s->window, s->fs, s->current_display_desc.height, s->aspect, s->current_display_desc.fps, s->window_size_factor);
+                        glfw_resize_window(s->window, s->fs, s->region.height, s->aspect, s->current_display_desc.fps, s->window_size_factor);
                         break;
                 default:
                         return false;
@@ -1499,6 +1717,10 @@ static bool display_gl_init_opengl(struct state_gl *s)
                 log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to compile deinterlace program!\n");
                 handle_error(1);
         }
+        if ((s->PHandle_deint_bob = gl_substitute_compile_link(vert, deinterlace_bob_fp)) == 0) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to compile bob deinterlace program!\n");
+                handle_error(1);
+        }
 
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // set row alignment to 1 byte instead of default
                                                // 4 bytes which won't work on row-unaligned RGB
@@ -1507,6 +1729,9 @@ static bool display_gl_init_opengl(struct state_gl *s)
         glGenFramebuffersEXT(1, &s->fbo_id);
 
         glGenBuffersARB(1, &s->pbo_id);
+#ifdef HWACC_VAAPI_EGL
+        s->vaapi.init();
+#endif
         glfwMakeContextCurrent(nullptr);
 
         return true;
@@ -1520,10 +1745,19 @@ static void display_gl_cleanup_opengl(struct state_gl *s){
         for (auto &it : s->PHandles) {
                 glDeleteProgram(it.second);
         }
+        glDeleteProgram(s->PHandle_deint);
+        glDeleteProgram(s->PHandle_deint_bob);
         glDeleteTextures(1, &s->texture_display);
         glDeleteTextures(1, &s->texture_raw);
         glDeleteFramebuffersEXT(1, &s->fbo_id);
         glDeleteBuffersARB(1, &s->pbo_id);
+        gl_free_retired_pbo_frames(s);
+        while (!s->pbo_frames.empty()) { // frames themselves are freed by display_gl_done()
+                gl_delete_pbo_frame(s, s->pbo_frames.begin()->first);
+        }
+#ifdef HWACC_VAAPI_EGL
+        s->vaapi.uninit();
+#endif
         glfwDestroyWindow(s->window);
 
         if (s->syphon_spout) {
@@ -1618,6 +1852,12 @@ static void upload_texture(struct state_gl *s, char *data)
                 s->vdp.loadFrame(reinterpret_cast<hw_vdpau_frame *>(data));
                 return;
         }
+#endif
+#ifdef HWACC_VAAPI_EGL
+        if (s->current_display_desc.color_spec == HW_VAAPI) {
+                s->vaapi.loadFrame(reinterpret_cast<av_frame_wrapper *>(data));
+                return;
+        }
 #endif
         if (s->current_display_desc.color_spec == DXT1 || s->current_display_desc.color_spec == DXT1_YUV || s->current_display_desc.color_spec == DXT5) {
                 upload_compressed_texture(s, data);
@@ -1651,7 +1891,15 @@ static void upload_texture(struct state_gl *s, char *data)
                 DEBUG_TIMER_STOP(process_r10k);
         };
         int data_size = vc_get_linesize(s->current_display_desc.width, s->current_display_desc.color_spec) * s->current_display_desc.height;
-        if (s->use_pbo) {
+        if (s->current_pbo != nullptr) { // decoded directly to the mapped PBO, no copy needed
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, s->current_pbo->pbo);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, s->current_display_desc.height, format, type, nullptr);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                if (s->current_pbo->fence != nullptr) {
+                        glDeleteSync(s->current_pbo->fence);
+                }
+                s->current_pbo->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        } else if (s->use_pbo) {
                 glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, s->pbo_id); // current pbo
                 glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, data_size, 0, GL_STREAM_DRAW_ARB);
                 if (void *ptr = glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB)) {
@@ -1675,6 +1923,90 @@ static void upload_texture(struct state_gl *s, char *data)
         }
 }
 
+/**
+ * Creates a ring of frames with data in persistently mapped PBOs and passes
+ * them to display_gl_getf() so that the decoder writes directly to memory
+ * from which the texture is uploaded. Frames not fitting this (R10k needs
+ * a byte swap, compressed and HW formats are uploaded differently) or
+ * without GL_ARB_buffer_storage keep using the regular PBO upload.
+ */
+static void gl_alloc_pbo_frames(struct state_gl *s, struct video_desc desc)
+{
+        if (!s->use_pbo || !GLEW_ARB_buffer_storage || !GLEW_ARB_sync || desc.tile_count != 1
+                        || desc.color_spec == R10k || desc.color_spec == DXT1 || desc.color_spec == DXT1_YUV
+                        || desc.color_spec == DXT5 || codec_is_hw_accelerated(desc.color_spec)) {
+                return;
+        }
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        vector<struct video_frame *> frames;
+        for (int i = 0; i < PBO_RING_SIZE; ++i) {
+                struct video_frame *frame = vf_alloc_desc(desc);
+                const GLsizeiptr size = max<GLsizeiptr>(frame->tiles[0].data_len,
+                                (GLsizeiptr) vc_get_linesize(desc.width, desc.color_spec) * desc.height);
+                state_gl::pbo_frame pbo{};
+                glGenBuffersARB(1, &pbo.pbo);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo.pbo);
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, size, nullptr, flags);
+                frame->tiles[0].data = (char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, size, flags);
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                if (frame->tiles[0].data == nullptr) {
+                        log_msg(LOG_LEVEL_WARNING, MOD_NAME "Cannot map persistent PBO, using regular upload.\n");
+                        glDeleteBuffersARB(1, &pbo.pbo);
+                        vf_free(frame);
+                        break;
+                }
+                frame->callbacks.data_deleter = pbo_frame_data_deleter;
+                s->pbo_frames[frame] = pbo;
+                frames.push_back(frame);
+        }
+        gl_check_error();
+        if (frames.empty()) {
+                return;
+        }
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Using %zu persistently mapped PBO frames.\n", frames.size());
+        lock_guard<mutex> lk(s->lock);
+        for (auto *f : frames) {
+                s->free_frame_queue.push(f);
+        }
+}
+
+/// waits until the texture upload from frame's PBO (if any) has finished so that it can be rewritten
+static void gl_pbo_frame_wait(struct state_gl *s, struct video_frame *frame)
+{
+        auto it = s->pbo_frames.find(frame);
+        if (it == s->pbo_frames.end() || it->second.fence == nullptr) {
+                return;
+        }
+        glClientWaitSync(it->second.fence, GL_SYNC_FLUSH_COMMANDS_BIT, NS_IN_SEC);
+        glDeleteSync(it->second.fence);
+        it->second.fence = nullptr;
+}
+
+static void gl_delete_pbo_frame(struct state_gl *s, struct video_frame *frame)
+{
+        auto it = s->pbo_frames.find(frame);
+        assert(it != s->pbo_frames.end());
+        if (it->second.fence != nullptr) {
+                glClientWaitSync(it->second.fence, GL_SYNC_FLUSH_COMMANDS_BIT, NS_IN_SEC);
+                glDeleteSync(it->second.fence);
+        }
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, it->second.pbo);
+        glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+        glDeleteBuffersARB(1, &it->second.pbo);
+        s->pbo_frames.erase(it);
+}
+
+/// deletes PBO frames discarded by display_gl_getf(), must be called with s->lock held
+static void gl_free_retired_pbo_frames(struct state_gl *s)
+{
+        for (auto *frame : s->pbo_frames_retired) {
+                gl_delete_pbo_frame(s, frame);
+                vf_free(frame);
+        }
+        s->pbo_frames_retired.clear();
+}
+
 static bool check_rpi_pbo_quirks()
 {
 #if ! defined __linux__
@@ -1748,9 +2080,11 @@ static void gl_render_glsl(struct state_gl *s, char *data)
         glBindTexture(GL_TEXTURE_2D, s->texture_display);
 }    
 
-static void gl_draw(double ratio, double bottom_offset, bool double_buf)
+/**
+ * @param tex_rect  left, top, right and bottom texture coordinate of the displayed area
+ */
+static void gl_draw(double ratio, const float *tex_rect, bool double_buf)
 {
-        float bottom;
         gl_check_error();
 
         glDrawBuffer(double_buf ? GL_BACK : GL_FRONT);
@@ -1762,22 +2096,17 @@ static void gl_draw(double ratio, double bottom_offset, bool double_buf)
         glLoadIdentity( );
         glTranslatef( 0.0f, 0.0f, -1.35f );
 
-        /* Reflect that we may have higher texture than actual data
-         * if we use DXT and source height was not divisible by 4 
-         * In normal case, there would be 1.0 */
-        bottom = 1.0f - bottom_offset;
-
         gl_check_error();
         glBegin(GL_QUADS);
         /* Front Face */
         /* Bottom Left Of The Texture and Quad */
-        glTexCoord2f( 0.0f, bottom ); glVertex2f( -1.0f, -1/ratio);
+        glTexCoord2f( tex_rect[0], tex_rect[3] ); glVertex2f( -1.0f, -1/ratio);
         /* Bottom Right Of The Texture and Quad */
-        glTexCoord2f( 1.0f, bottom ); glVertex2f(  1.0f, -1/ratio);
+        glTexCoord2f( tex_rect[2], tex_rect[3] ); glVertex2f(  1.0f, -1/ratio);
         /* Top Right Of The Texture and Quad */
-        glTexCoord2f( 1.0f, 0.0f ); glVertex2f(  1.0f,  1/ratio);
+        glTexCoord2f( tex_rect[2], tex_rect[1] ); glVertex2f(  1.0f,  1/ratio);
         /* Top Left Of The Texture and Quad */
-        glTexCoord2f( 0.0f, 0.0f ); glVertex2f( -1.0f,  1/ratio);
+        glTexCoord2f( tex_rect[0], tex_rect[1] ); glVertex2f( -1.0f,  1/ratio);
         glEnd( );
 
         gl_check_error();
@@ -1805,6 +2134,11 @@ static int display_gl_get_property(void *state, int property, void *val, size_t
                                         if (glsl_programs.find(c) != glsl_programs.end() && s->PHandles.find(c) == s->PHandles.end()) { // GLSL shader needed but compilation failed
                                                 return false;
                                         }
+#ifdef HWACC_VAAPI_EGL
+                                        if (c == HW_VAAPI && !s->vaapi.initialized) { // context cannot import DMA-BUFs
+                                                return false;
+                                        }
+#endif
                                         return true;
                                 };
                                 copy_if(gl_supp_codecs.begin(), gl_supp_codecs.end(), (codec_t *) val, filter_codecs);
@@ -1833,6 +2167,23 @@ static int display_gl_get_property(void *state, int property, void *val, size_t
                         }
                         *len = sizeof(supported_il_modes);
                         break;
+                case DISPLAY_PROPERTY_EXTERNAL_FRAMES:
+                        if (*len < sizeof(bool)) {
+                                return FALSE;
+                        }
+                        *(bool *) val = true;
+                        *len = sizeof(bool);
+                        break;
+                case DISPLAY_PROPERTY_BACKPRESSURE:
+                        if (*len < sizeof(bool)) {
+                                return FALSE;
+                        }
+                        {
+                                lock_guard<mutex> lk(s->lock);
+                                *(bool *) val = s->frame_queue.would_drop();
+                        }
+                        *len = sizeof(bool);
+                        break;
                 default:
                         return FALSE;
         }
@@ -1856,10 +2207,10 @@ static void display_gl_done(void *state)
         while (s->frame_queue.size() > 0) {
                 struct video_frame *buffer = s->frame_queue.front();
                 s->frame_queue.pop();
-                vf_free(buffer);
+                gl_free_frame(buffer);
         }
 
-        vf_free(s->current_frame);
+        gl_free_frame(s->current_frame);
 
         delete s;
 }
@@ -1877,6 +2228,10 @@ static struct video_frame * display_gl_getf(void *state)
                 if (video_desc_eq(video_desc_from_frame(buffer), s->current_desc)) {
                         return buffer;
                 }
+                if (buffer->callbacks.data_deleter == pbo_frame_data_deleter) {
+                        s->pbo_frames_retired.push_back(buffer); // PBO must be deleted by the GL thread
+                        continue;
+                }
                 vf_free(buffer);
         }
 
@@ -1895,33 +2250,31 @@ static int display_gl_putf(void *state, struct video_frame *frame, long long tim
 
         if(!frame) {
                 glfwSetWindowShouldClose(s->window, GLFW_TRUE);
-                s->frame_queue.push(frame);
+                s->frame_queue.force_push(frame);
                 lk.unlock();
                 s->new_frame_ready_cv.notify_one();
                 return 0;
         }
 
-        switch (timeout_ns) {
-                case PUTF_DISCARD:
-                        vf_recycle(frame);
-                        s->free_frame_queue.push(frame);
-                        return 0;
-                case PUTF_BLOCKING:
-                        s->frame_consumed_cv.wait(lk, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
-                        break;
-                case PUTF_NONBLOCK:
-                        break;
-                default:
-                        s->frame_consumed_cv.wait_for(lk, timeout_ns * 1ns, [s]{return s->frame_queue.size() < MAX_BUFFER_SIZE;});
-                        break;
+        if (timeout_ns == PUTF_DISCARD) {
+                gl_release_frame(s, frame);
+                return 0;
         }
-        if (s->frame_queue.size() >= MAX_BUFFER_SIZE) {
+        s->frame_queue.wait_for_room(s->frame_consumed_cv, lk, timeout_ns);
+        struct video_frame *dropped = nullptr;
+        size_t dropped_idx = 0;
+        const bool queued = s->frame_queue.push(frame, &dropped, &dropped_idx);
+        if (dropped != nullptr) {
                 LOG(LOG_LEVEL_INFO) << MOD_NAME << "1 frame(s) dropped!\n";
-                vf_recycle(frame);
-                s->free_frame_queue.push(frame);
+                gl_release_frame(s, dropped);
+        }
+        if (!queued) {
                 return 1;
         }
-        s->frame_queue.push(frame);
+        if (dropped != nullptr) {
+                s->scheduler.frame_removed(dropped_idx);
+        }
+        s->scheduler.frame_queued(get_time_in_ns(), frame->fps);
 
         lk.unlock();
         s->new_frame_ready_cv.notify_one();
@@ -0,0 +1,227 @@
+/**
+ * @file   video_display/gl_vaapi.cpp
+ *
+ * @brief VA-API surface import to OpenGL textures via DMA-BUF/EGLImage
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // defined HAVE_CONFIG_H
+#include "config_unix.h"
+#include "config_win32.h"
+
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+
+#include "debug.h"
+#include "hwaccel_vaapi.h"
+
+#include "gl_vaapi.hpp"
+
+#if VA_CHECK_VERSION(1, 1, 0)
+#include <va/va_drmcommon.h>
+#endif
+
+#define MOD_NAME "[GL VA-API] "
+
+static bool egl_has_extension(EGLDisplay dpy, const char *ext) {
+        const char *exts = eglQueryString(dpy, EGL_EXTENSIONS);
+        if (exts == nullptr) {
+                return false;
+        }
+        size_t len = strlen(ext);
+        for (const char *it = strstr(exts, ext); it != nullptr; it = strstr(it + len, ext)) {
+                if ((it == exts || it[-1] == ' ') && (it[len] == ' ' || it[len] == '\0')) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * @brief Initializes state_vaapi_egl, GL context must be current
+ *
+ * @retval false if the context cannot import DMA-BUFs (eg. it is GLX-based)
+ */
+bool state_vaapi_egl::init(){
+#if VA_CHECK_VERSION(1, 1, 0)
+        egl_display = eglGetCurrentDisplay();
+        if (egl_display == EGL_NO_DISPLAY) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "GL context is not EGL-based, VA-API interop disabled "
+                                "(use \"--param glfw-window-hint=0x2200B=0x36002\" to request EGL context)\n");
+                return false;
+        }
+        if (!egl_has_extension(egl_display, "EGL_EXT_image_dma_buf_import")) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "EGL_EXT_image_dma_buf_import not supported, VA-API interop disabled\n");
+                return false;
+        }
+        has_modifiers = egl_has_extension(egl_display, "EGL_EXT_image_dma_buf_import_modifiers");
+
+        createImage = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+        destroyImage = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+        imageTargetTexture2D = (egl_image_target_texture_2d_t) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+        if (createImage == nullptr || destroyImage == nullptr || imageTargetTexture2D == nullptr) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "EGLImage functions not available, VA-API interop disabled\n");
+                return false;
+        }
+
+        glGenTextures(2, textures);
+        for (GLuint tex : textures) {
+                glBindTexture(GL_TEXTURE_2D, tex);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        initialized = true;
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "VA-API interop available (modifiers %ssupported)\n", has_modifiers ? "" : "not ");
+
+        return true;
+#else
+        log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "libva too old for surface export, VA-API interop disabled\n");
+        return false;
+#endif
+}
+
+void state_vaapi_egl::destroyImages(){
+        for (auto &img : images) {
+                if (img != EGL_NO_IMAGE_KHR) {
+                        destroyImage(egl_display, img);
+                        img = EGL_NO_IMAGE_KHR;
+                }
+        }
+}
+
+/**
+ * @brief Exports the frame surface as DMA-BUF and binds its planes to textures
+ *
+ * Only 2-plane (NV12/P010-like) 4:2:0 surfaces are supported, which is what
+ * VA-API decoders produce.
+ */
+bool state_vaapi_egl::loadFrame(av_frame_wrapper *wrapper){
+        assert(initialized);
+#if VA_CHECK_VERSION(1, 1, 0)
+        AVFrame *frame = wrapper->av_frame;
+        if (frame == nullptr || frame->hw_frames_ctx == nullptr) {
+                return false;
+        }
+        auto *frames_ctx = (AVHWFramesContext *)(void *) frame->hw_frames_ctx->data;
+        auto *va_dev = (AVVAAPIDeviceContext *) frames_ctx->device_ctx->hwctx;
+        auto surface = (VASurfaceID)(uintptr_t) frame->data[3];
+
+        VADRMPRIMESurfaceDescriptor desc{};
+        VAStatus st = vaExportSurfaceHandle(va_dev->display, surface,
+                        VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                        VA_EXPORT_SURFACE_READ_ONLY | VA_EXPORT_SURFACE_SEPARATE_LAYERS,
+                        &desc);
+        if (st != VA_STATUS_SUCCESS) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot export surface: %s\n", vaErrorStr(st));
+                return false;
+        }
+        vaSyncSurface(va_dev->display, surface);
+
+        destroyImages();
+        bool ret = desc.num_layers == 2;
+        if (!ret) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unsupported surface layout (%u layers)!\n", desc.num_layers);
+        }
+        for (unsigned i = 0; ret && i < 2; ++i) {
+                const auto &layer = desc.layers[i];
+                const auto &obj = desc.objects[layer.object_index[0]];
+                EGLint attribs[32] = {
+                        EGL_WIDTH, i == 0 ? frame->width : (frame->width + 1) / 2,
+                        EGL_HEIGHT, i == 0 ? frame->height : (frame->height + 1) / 2,
+                        EGL_LINUX_DRM_FOURCC_EXT, (EGLint) layer.drm_format,
+                        EGL_DMA_BUF_PLANE0_FD_EXT, obj.fd,
+                        EGL_DMA_BUF_PLANE0_OFFSET_EXT, (EGLint) layer.offset[0],
+                        EGL_DMA_BUF_PLANE0_PITCH_EXT, (EGLint) layer.pitch[0],
+                };
+                int idx = 12;
+                if (has_modifiers) {
+                        attribs[idx++] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+                        attribs[idx++] = (EGLint) (obj.drm_format_modifier & 0xFFFFFFFFU);
+                        attribs[idx++] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+                        attribs[idx++] = (EGLint) (obj.drm_format_modifier >> 32U);
+                }
+                attribs[idx] = EGL_NONE;
+
+                images[i] = createImage(egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attribs);
+                if (images[i] == EGL_NO_IMAGE_KHR) {
+                        log_msg(LOG_LEVEL_ERROR, MOD_NAME "Cannot create EGLImage for plane %u: 0x%x\n", i, eglGetError());
+                        ret = false;
+                        break;
+                }
+                glActiveTexture(GL_TEXTURE0 + 2 + i);
+                glBindTexture(GL_TEXTURE_2D, textures[i]);
+                imageTargetTexture2D(GL_TEXTURE_2D, images[i]);
+        }
+        glActiveTexture(GL_TEXTURE0 + 2);
+
+        // EGLImages hold own references to the DMA-BUFs
+        for (unsigned i = 0; i < desc.num_objects; ++i) {
+                close(desc.objects[i].fd);
+        }
+
+        av_frame_free(&lastFrame);
+        if (ret) {
+                lastFrame = av_frame_clone(frame);
+        }
+        return ret;
+#else
+        UNUSED(wrapper);
+        return false;
+#endif
+}
+
+/**
+ * @brief Uninitializes state_vaapi_egl, GL context must be current
+ */
+void state_vaapi_egl::uninit(){
+        if (!initialized) {
+                return;
+        }
+        destroyImages();
+        av_frame_free(&lastFrame);
+        glDeleteTextures(2, textures);
+        textures[0] = textures[1] = 0;
+        initialized = false;
+}
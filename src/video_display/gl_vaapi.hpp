@@ -0,0 +1,84 @@
+/**
+ * @file   video_display/gl_vaapi.hpp
+ *
+ * @brief VA-API surface import to OpenGL textures via DMA-BUF/EGLImage
+ */
+/*
+ * Copyright (c) 2026 CESNET z.s.p.o.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * 3. All advertising materials mentioning features or use of this software
+ *    must display the following acknowledgement:
+ * 
+ *      This product includes software developed by CESNET z.s.p.o.
+ * 
+ * 4. Neither the name of the CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef GL_VAAPI_HPP_3c1a8f6e2d47
+#define GL_VAAPI_HPP_3c1a8f6e2d47
+
+#ifdef HWACC_VAAPI_EGL
+
+#include <GL/glew.h>
+
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "hwaccel_rpi4.h" // av_frame_wrapper
+
+/**
+ * Imports decoded VA-API surfaces (HW_VAAPI frames) as GL textures without
+ * a round-trip through system memory. Luma plane is bound to texture unit 2,
+ * chroma plane to unit 3. Requires the GL context to be created with EGL.
+ */
+struct state_vaapi_egl {
+        typedef void (*egl_image_target_texture_2d_t)(GLenum target, void *image); // glEGLImageTargetTexture2DOES
+
+        bool initialized = false;
+        GLuint textures[2] = {0, 0};
+        EGLDisplay egl_display = EGL_NO_DISPLAY;
+        EGLImageKHR images[2] = {EGL_NO_IMAGE_KHR, EGL_NO_IMAGE_KHR};
+        bool has_modifiers = false;
+        struct AVFrame *lastFrame = nullptr; ///< kept referenced while its surface is displayed
+
+        PFNEGLCREATEIMAGEKHRPROC createImage = nullptr;
+        PFNEGLDESTROYIMAGEKHRPROC destroyImage = nullptr;
+        egl_image_target_texture_2d_t imageTargetTexture2D = nullptr;
+
+        bool init();
+        bool loadFrame(av_frame_wrapper *frame);
+        void destroyImages();
+        void uninit();
+};
+
+#endif //HWACC_VAAPI_EGL
+#endif //GL_VAAPI_HPP_3c1a8f6e2d47
@@ -66,6 +66,7 @@ using unique_disp = std::unique_ptr<struct display, disp_deleter>;
 
 struct state_multiplier_common {
         std::vector<unique_disp> displays;
+        std::vector<bool> external_frames; ///< display accepts shared frames (DISPLAY_PROPERTY_EXTERNAL_FRAMES)
 
         struct video_desc display_desc;
 
@@ -131,7 +132,15 @@ static void *display_multiplier_init(struct module *parent, const char *fmt, uns
                         LOG(LOG_LEVEL_ERROR) << "[multiplier] Display " << display << " needs mainloop and should be given first!\n";
                 }
 
+                bool external_frames = false;
+                size_t len = sizeof external_frames;
+                if (!display_ctl_property(disp.get(), DISPLAY_PROPERTY_EXTERNAL_FRAMES, &external_frames, &len)) {
+                        external_frames = false;
+                }
+                LOG(LOG_LEVEL_VERBOSE) << MOD_NAME << "Display " << display << (external_frames ? " shares" : " copies") << " the frames\n";
+
                 s->common->displays.push_back(std::move(disp));
+                s->common->external_frames.push_back(external_frames);
         }
 
         return s.release();
@@ -148,6 +157,26 @@ static void check_reconf(struct state_multiplier_common *s, struct video_desc de
         }
 }
 
+static void shared_frame_dispose(struct video_frame *frame)
+{
+        delete static_cast<shared_ptr<video_frame> *>(frame->callbacks.dispose_udata);
+        vf_free(frame);
+}
+
+/// @returns read-only reference to the frame data for a display supporting DISPLAY_PROPERTY_EXTERNAL_FRAMES
+static struct video_frame *get_shared_frame(const shared_ptr<video_frame> &frame)
+{
+        struct video_frame *ref = vf_alloc_desc(video_desc_from_frame(frame.get()));
+        vf_copy_metadata(ref, frame.get());
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                ref->tiles[i].data = frame->tiles[i].data;
+                ref->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        ref->callbacks.dispose = shared_frame_dispose;
+        ref->callbacks.dispose_udata = new shared_ptr<video_frame>(frame);
+        return ref;
+}
+
 static void display_multiplier_worker(void *state)
 {
         shared_ptr<struct state_multiplier_common> s = ((struct state_multiplier *)state)->common;
@@ -178,13 +207,17 @@ static void display_multiplier_worker(void *state)
 
                 check_reconf(s.get(), video_desc_from_frame(frame));
 
-                for (auto& disp : s->displays) {
-                        struct video_frame *real_display_frame = display_get_frame(disp.get());
+                shared_ptr<video_frame> shared_frame(frame, vf_free); // freed when the last display disposes it
+                for (size_t i = 0; i < s->displays.size(); ++i) {
+                        struct display *disp = s->displays[i].get();
+                        if (s->external_frames[i]) {
+                                display_put_frame(disp, get_shared_frame(shared_frame), PUTF_BLOCKING);
+                                continue;
+                        }
+                        struct video_frame *real_display_frame = display_get_frame(disp);
                         memcpy(real_display_frame->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                        display_put_frame(disp.get(), real_display_frame, PUTF_BLOCKING);
+                        display_put_frame(disp, real_display_frame, PUTF_BLOCKING);
                 }
-
-                vf_free(frame);
         }
 }
 
@@ -268,6 +301,9 @@ static int display_multiplier_get_property(void *state, int property, void *val,
                 return FALSE;
 
         }
+        if (property == DISPLAY_PROPERTY_EXTERNAL_FRAMES) {
+                return FALSE;
+        }
         //TODO Find common properties, for now just return properties of the first display
         return display_ctl_property(s->displays[0].get(), property, val, len);
 }
@@ -81,7 +81,10 @@ struct display_ndi {
         struct video_frame *send_frame; ///< frame that is just being asynchronously sent
 
         ndi_disp_convert_t *convert;
-        char *convert_buffer; ///< for codecs that need conversion (eg. Y216->P216)
+        /// for codecs that need conversion (eg. Y216->P216) - one is being
+        /// sent asynchronously while the next frame is converted to the other
+        char *convert_buffer[2];
+        int convert_idx; ///< index of the buffer to be converted to
 };
 
 static void display_ndi_probe(struct device_info **available_cards, int *count, void (**deleter)(void *))
@@ -111,9 +114,15 @@ static int display_ndi_reconfigure(void *state, struct video_desc desc)
 {
         struct display_ndi *s = (struct display_ndi *) state;
 
+        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL); // the buffers of the async frame are going to be freed
+        vf_free(s->send_frame);
+        s->send_frame = NULL;
+
         s->desc = desc;
-        free(s->convert_buffer);
-        s->convert_buffer = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        for (int i = 0; i < 2; ++i) {
+                free(s->convert_buffer[i]);
+                s->convert_buffer[i] = malloc(MAX_BPS * desc.width * desc.height + MAX_PADDING);
+        }
 
         s->NDI_video_frame.xres = s->desc.width;
         s->NDI_video_frame.yres = s->desc.height;
@@ -259,7 +268,8 @@ static void display_ndi_done(void *state)
         struct display_ndi *s = (struct display_ndi *) state;
 
         s->NDIlib->send_destroy(s->pNDI_send);
-        free(s->convert_buffer);
+        free(s->convert_buffer[0]);
+        free(s->convert_buffer[1]);
         s->NDIlib->destroy();
         close_ndi_library(s->lib);
         vf_free(s->send_frame);
@@ -317,6 +327,10 @@ static void ndi_disp_convert_Y416_to_PA16(const struct video_frame *f, char *out
 }
 
 /**
+ * The frame is sent asynchronously, the send call then waits for the
+ * previous frame being sent so that conversion of a frame overlaps with
+ * sending the previous one.
+ *
  * flag = PUTF_NONBLOCK is not implemented
  */
 static int display_ndi_putf(void *state, struct video_frame *frame, long long flag)
@@ -332,20 +346,22 @@ static int display_ndi_putf(void *state, struct video_frame *frame, long long fl
                 return 0;
         }
 
-        s->NDIlib->send_send_video_v2(s->pNDI_send, NULL); // wait for the async frame to be processed
-        vf_free(s->send_frame);
-        s->send_frame = NULL;
-
+        struct video_frame *sent_frame = s->send_frame;
         if (s->convert != NULL) {
-                s->convert(frame, s->convert_buffer);
-                s->NDI_video_frame.p_data = (uint8_t *) s->convert_buffer;
+                // the other buffer may be still being sent
+                s->convert(frame, s->convert_buffer[s->convert_idx]);
+                s->NDI_video_frame.p_data = (uint8_t *) s->convert_buffer[s->convert_idx];
+                s->convert_idx = 1 - s->convert_idx;
                 vf_free(frame);
+                s->send_frame = NULL;
         } else {
                 s->NDI_video_frame.p_data = (uint8_t *) frame->tiles[0].data;
                 s->send_frame = frame;
         }
 
+        // returns when the previous async frame is no longer used
         s->NDIlib->send_send_video_async_v2(s->pNDI_send, &s->NDI_video_frame);
+        vf_free(sent_frame);
 
         return 0;
 }
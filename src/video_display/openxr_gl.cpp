@@ -40,7 +40,9 @@
 #       include "config_win32.h"
 #endif //HAVE_CONFIG_H
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <thread>
 #include <vector>
 #include <condition_variable>
@@ -407,6 +409,8 @@ struct state_xrgl{
         std::condition_variable free_frame_ready_cv;
 
         std::vector<video_frame *> dispose_frame_pool;
+
+        video_viewport viewport{}; ///< rendered part of the panorama, reported to the sender
 };
 
 static std::vector<XrViewConfigurationView> get_views(Openxr_state& xr_state){
@@ -497,6 +501,32 @@ static int64_t select_swapchain_fmt(const std::vector<int64_t>& swapchain_format
         return 0;
 }
 
+/**
+ * Updates the part of the panorama reported to the sender. The field of view
+ * is the union of the fields of view of all the views (eyes).
+ *
+ * @param cam_rot rotation of the camera in the scene
+ */
+static void update_viewport(state_xrgl *s, const glm::mat4& cam_rot, const std::vector<XrView>& views){
+        glm::vec4 dir = cam_rot * glm::vec4(0.f, 0.f, -1.f, 0.f);
+        video_viewport viewport{};
+        // the sphere texture has u = 1 - lon / 360 with lon = atan2(x, z)
+        viewport.yaw = 180.f - glm::degrees(std::atan2(dir.x, dir.z));
+        viewport.pitch = glm::degrees(std::asin(glm::clamp(dir.y, -1.f, 1.f)));
+        float left = 0, right = 0, up = 0, down = 0;
+        for(const auto& view : views){
+                left = std::min(left, view.fov.angleLeft);
+                right = std::max(right, view.fov.angleRight);
+                up = std::max(up, view.fov.angleUp);
+                down = std::min(down, view.fov.angleDown);
+        }
+        viewport.fov_h = glm::degrees(right - left);
+        viewport.fov_v = glm::degrees(up - down);
+
+        std::lock_guard<std::mutex> lock(s->lock);
+        s->viewport = viewport;
+}
+
 static void map_new_buffer(struct video_frame *f){
         glBufferData(GL_PIXEL_UNPACK_BUFFER, f->tiles[0].data_len, 0, GL_STREAM_DRAW);
         f->tiles[0].data = (char *) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
@@ -887,6 +917,9 @@ static void display_xrgl_run(void *state){
                                 view_reset_rot = viewMat;
                         }
                         glm::mat4 pvMat = projMat * glm::inverse(viewMat) * view_reset_rot;
+                        if(i == 0){
+                                update_viewport(s, glm::inverse(view_reset_rot) * viewMat, views);
+                        }
 
                         auto framebuffer = swapchains[i].get_framebuffer(buf_idx).get();
                         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
@@ -1062,7 +1095,7 @@ static int display_xrgl_reconfigure(void *state, struct video_desc desc) {
 }
 
 static int display_xrgl_get_property(void *state, int property, void *val, size_t *len) {
-        UNUSED(state);
+        auto *s = static_cast<state_xrgl *>(state);
         codec_t codecs[] = {
                 RGBA,
                 RGB,
@@ -1100,6 +1133,16 @@ static int display_xrgl_get_property(void *state, int property, void *val, size_
                         }
                         *len = sizeof(supported_il_modes);
                         break;
+                case DISPLAY_PROPERTY_VIEWPORT:
+                        {
+                                std::lock_guard<std::mutex> lock(s->lock);
+                                if(sizeof(video_viewport) > *len || s->viewport.fov_v <= 0) { // not rendered yet
+                                        return FALSE;
+                                }
+                                memcpy(val, &s->viewport, sizeof(video_viewport));
+                                *len = sizeof(video_viewport);
+                        }
+                        break;
                 default:
                         return FALSE;
         }
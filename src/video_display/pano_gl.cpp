@@ -42,6 +42,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
@@ -87,6 +88,8 @@ struct state_vr{
         std::mutex lock;
         std::condition_variable frame_consumed_cv;
         std::queue<video_frame *> free_frame_queue;
+
+        video_viewport viewport{}; ///< rendered part of the panorama, reported to the sender
 };
 
 static void * display_panogl_init(struct module *parent, const char *fmt, unsigned int flags) {
@@ -109,6 +112,13 @@ static void draw(state_vr *s){
         s->scene.render(s->window.width, s->window.height);
 
         SDL_GL_SwapWindow(s->window.sdl_window);
+
+        const float aspect_ratio = static_cast<float>(s->window.width) / s->window.height;
+        std::lock_guard<std::mutex> lock(s->lock);
+        s->viewport.yaw = s->scene.rot_x;
+        s->viewport.pitch = -s->scene.rot_y;
+        s->viewport.fov_v = s->scene.fov;
+        s->viewport.fov_h = 2 * std::atan(std::tan(s->scene.fov / 2 * M_PI / 180) * aspect_ratio) * 180 / M_PI;
 }
 
 static Uint32 redraw_callback(Uint32 interval, void *param){
@@ -313,7 +323,7 @@ static int display_panogl_reconfigure(void *state, struct video_desc desc) {
 }
 
 static int display_panogl_get_property(void *state, int property, void *val, size_t *len) {
-        UNUSED(state);
+        auto *s = static_cast<state_vr *>(state);
         codec_t codecs[] = {
                 RGBA,
                 RGB,
@@ -351,6 +361,16 @@ static int display_panogl_get_property(void *state, int property, void *val, siz
                         }
                         *len = sizeof(supported_il_modes);
                         break;
+                case DISPLAY_PROPERTY_VIEWPORT:
+                        {
+                                std::lock_guard<std::mutex> lock(s->lock);
+                                if(sizeof(video_viewport) > *len || s->viewport.fov_v <= 0) { // not rendered yet
+                                        return FALSE;
+                                }
+                                memcpy(val, &s->viewport, sizeof(video_viewport));
+                                *len = sizeof(video_viewport);
+                        }
+                        break;
                 default:
                         return FALSE;
         }
@@ -0,0 +1,214 @@
+/**
+ * @file   video_display/present_scheduler.hpp
+ * @author Martin Pulec     <pulec@cesnet.cz>
+ * @brief  VBlank-aligned selection of the frame to be presented
+ *
+ * Displays that present frames from their own render loop (GL, SDL2,
+ * Vulkan) can use this to decide, before each VBlank, which of the queued
+ * frames should be shown. Arrival times are smoothed to a media clock
+ * running at the nominal stream frame rate so that a network jitter doesn't
+ * result in one frame being skipped and the next one shown twice (eg.
+ * 59.94 content on a 60 Hz panel). The refresh period is estimated from
+ * the times when the presentation (buffer swap) completed.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SRC_VIDEO_DISPLAY_PRESENT_SCHEDULER_HPP_4E1B7C0A_2D5F_4F0E_9C3A_8B6D2E1F7A54
+#define SRC_VIDEO_DISPLAY_PRESENT_SCHEDULER_HPP_4E1B7C0A_2D5F_4F0E_9C3A_8B6D2E1F7A54
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <string>
+
+#include "debug.h"
+#include "tv.h"
+
+/**
+ * Usage - the display calls (all under the lock guarding its frame queue):
+ * - frame_queued() for every frame put to its queue (in queue order)
+ * - frames_to_drop() before presenting to learn how many of the queued
+ *   frames are obsolete (the frames are removed with frame_dequeued())
+ * - head_due() to decide whether to present the queue head or to repeat
+ *   the current frame
+ * - presented() after each completed presentation and frame_dequeued()
+ *   for every frame removed from the queue.
+ *
+ * Until the refresh period is known, every frame is due (unscheduled behavior).
+ */
+class present_scheduler {
+public:
+        explicit present_scheduler(const char *mod_name) : mod_name(mod_name) {}
+
+        void frame_queued(time_ns_t arrival, double fps) {
+                if (fps != this->fps) {
+                        this->fps = fps;
+                        frame_period = fps > 0.0 ? (time_ns_t) (NS_IN_SEC_DBL / fps) : 0;
+                        expected = 0;
+                }
+                if (expected == 0 || llabs(arrival - expected) > 2 * frame_period) {
+                        expected = arrival;
+                } else {
+                        expected += (arrival - expected) / CLOCK_SLEW;
+                }
+                due.push_back(expected);
+                expected += frame_period;
+        }
+
+        void frame_dequeued() {
+                if (!due.empty()) {
+                        due.pop_front();
+                }
+        }
+
+        /// frame at queue index idx was removed (replaced by a new one)
+        void frame_removed(size_t idx) {
+                if (idx < due.size()) {
+                        due.erase(due.begin() + idx);
+                }
+        }
+
+        /// @returns number of frames at the queue head that would be
+        /// superseded by a later frame at the next VBlank
+        size_t frames_to_drop() const {
+                if (refresh_period == 0) {
+                        return 0;
+                }
+                time_ns_t deadline = next_vblank() + refresh_period / 2;
+                size_t due_count = std::count_if(due.begin(), due.end(),
+                                [deadline](time_ns_t t) { return t <= deadline; });
+                return due_count > 1 ? due_count - 1 : 0;
+        }
+
+        /// @returns true if queue head should be presented at the next
+        /// VBlank, false if the current frame should be repeated
+        bool head_due() const {
+                if (refresh_period == 0 || due.empty()) {
+                        return true;
+                }
+                return due.front() <= next_vblank() + refresh_period / 2;
+        }
+
+        /**
+         * @param t          time when the presentation completed (approximates VBlank)
+         * @param new_frame  queue head was presented (otherwise the previous frame was repeated)
+         */
+        void presented(time_ns_t t, bool new_frame) {
+                update_refresh_period(t);
+                if (new_frame && !due.empty()) {
+                        time_ns_t lateness = t - due.front();
+                        log_msg(LOG_LEVEL_DEBUG2, "%sframe presented %.2f ms %s\n", mod_name.c_str(),
+                                        std::abs(lateness) / 1000000.0, lateness > 0 ? "late" : "early");
+                        stats.lateness_sum += lateness;
+                        stats.lateness_min = std::min(stats.lateness_min, lateness);
+                        stats.lateness_max = std::max(stats.lateness_max, lateness);
+                        stats.presented += 1;
+                } else if (!new_frame) {
+                        stats.repeated += 1;
+                }
+                report(t);
+        }
+
+        void frames_dropped(int count) {
+                stats.dropped += count;
+        }
+
+private:
+        static constexpr int CLOCK_SLEW = 16; ///< reciprocal of the media clock correction per frame
+        static constexpr int PERIOD_SLEW = 32;
+        static constexpr time_ns_t MAX_REFRESH_PERIOD = NS_IN_SEC / 20;
+        static constexpr time_ns_t REPORT_INTERVAL = 5 * NS_IN_SEC;
+
+        time_ns_t next_vblank() const {
+                time_ns_t now = get_time_in_ns();
+                time_ns_t periods = std::max<time_ns_t>((now - last_vblank) / refresh_period + 1, 1);
+                return last_vblank + periods * refresh_period;
+        }
+
+        void update_refresh_period(time_ns_t t) {
+                time_ns_t delta = t - last_vblank;
+                last_vblank = t;
+                if (delta <= 0 || delta > MAX_REFRESH_PERIOD) {
+                        return;
+                }
+                if (refresh_period == 0) {
+                        refresh_period = delta;
+                        return;
+                }
+                // ignore missed VBlanks and swaps not throttled by the display
+                if (delta > refresh_period * 3 / 2 || delta < refresh_period / 2) {
+                        return;
+                }
+                refresh_period += (delta - refresh_period) / PERIOD_SLEW;
+        }
+
+        void report(time_ns_t t) {
+                if (stats.since == 0) {
+                        stats.since = t;
+                        return;
+                }
+                if (t - stats.since < REPORT_INTERVAL) {
+                        return;
+                }
+                if (stats.presented > 0) {
+                        log_msg(LOG_LEVEL_VERBOSE, "%sPresented %d frames (repeated %d, dropped %d), "
+                                        "refresh %.3f Hz, lateness avg %.2f ms, min %.2f ms, max %.2f ms\n",
+                                        mod_name.c_str(), stats.presented, stats.repeated, stats.dropped,
+                                        refresh_period > 0 ? NS_IN_SEC_DBL / refresh_period : 0.0,
+                                        stats.lateness_sum / stats.presented / 1000000.0,
+                                        stats.lateness_min / 1000000.0, stats.lateness_max / 1000000.0);
+                }
+                stats = {};
+                stats.since = t;
+        }
+
+        std::string mod_name;
+        std::deque<time_ns_t> due; ///< due times of the queued frames
+        double fps = 0.0;
+        time_ns_t frame_period = 0;
+        time_ns_t expected = 0; ///< media clock - due time of the next frame
+        time_ns_t refresh_period = 0;
+        time_ns_t last_vblank = 0;
+        struct {
+                time_ns_t since = 0;
+                int presented = 0;
+                int repeated = 0;
+                int dropped = 0;
+                time_ns_t lateness_sum = 0;
+                time_ns_t lateness_min = NS_IN_SEC;
+                time_ns_t lateness_max = -NS_IN_SEC;
+        } stats;
+};
+
+#endif // defined SRC_VIDEO_DISPLAY_PRESENT_SCHEDULER_HPP_4E1B7C0A_2D5F_4F0E_9C3A_8B6D2E1F7A54
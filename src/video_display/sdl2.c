@@ -56,8 +56,11 @@
 #include "lib_common.h"
 #include "messaging.h"
 #include "module.h"
+#include "tv.h"
 #include "utils/color_out.h"
 #include "utils/list.h"
+#include "utils/macros.h"
+#include "utils/metrics.h"
 #include "video_display.h"
 #include "video.h"
 
@@ -74,7 +77,9 @@
 
 #define SDL2_DEINTERLACE_IMPOSSIBLE_MSG_ID 0x327058e5
 #define MAGIC_SDL2   0x3cc234a1
-#define BUFFER_COUNT   2
+#define DEFAULT_BUFFER_COUNT 3
+#define MIN_BUFFER_COUNT     2
+#define STATS_INTERVAL_NS    (5 * NS_IN_SEC)
 #define MOD_NAME "[SDL] "
 
 struct state_sdl2;
@@ -93,6 +98,7 @@ struct state_sdl2 {
         struct module           mod;
 
         int                     texture_pitch;
+        int                     buffer_count; ///< streaming textures in the ring
 
         Uint32                  sdl_user_new_frame_event;
         Uint32                  sdl_user_new_message_event;
@@ -120,10 +126,25 @@ struct state_sdl2 {
         int                     reconfiguration_status;
 
         struct video_desc       current_display_desc;
-        struct video_frame     *last_frame;
+        struct video_frame     *last_frame; ///< presented, its texture is kept unlocked for redraws
 
         struct simple_linked_list *free_frame_queue;
+        int                     queued; ///< frames passed to the render thread but not yet processed
+
+        struct metrics_counter *metric_dropped;
+        struct metrics_counter *metric_late;
+        struct {
+                time_ns_t since;
+                int presented;
+                int dropped;
+                int late;
+        } stats; ///< protected by lock
+};
 
+/// dispose_udata of the ring frames
+struct sdl2_buffer {
+        SDL_Texture *texture;
+        time_ns_t    put_time; ///< when the frame was passed to putf
 };
 
 static const char *deint_to_string(enum deint val) {
@@ -146,38 +167,116 @@ static const struct {
 
 #define SDL_CHECK(cmd) do { int ret = cmd; if (ret < 0) { log_msg(LOG_LEVEL_ERROR, MOD_NAME "Error (%s): %s\n", #cmd, SDL_GetError());} } while(0)
 
+static void frames_dropped(struct state_sdl2 *s, int count) {
+        s->stats.dropped += count;
+        metrics_counter_add(s->metric_dropped, count);
+}
+
+/// called with lock held
+static void report_stats(struct state_sdl2 *s, time_ns_t now) {
+        if (s->stats.since == 0) {
+                s->stats.since = now;
+                return;
+        }
+        if (now - s->stats.since < STATS_INTERVAL_NS) {
+                return;
+        }
+        if (s->stats.dropped > 0 || s->stats.late > 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Presented %d frames (dropped %d, late %d) in last %.1f seconds.\n",
+                                s->stats.presented, s->stats.dropped, s->stats.late,
+                                (now - s->stats.since) / NS_IN_SEC_DBL);
+        }
+        memset(&s->stats, 0, sizeof s->stats);
+        s->stats.since = now;
+}
+
+/**
+ * Returns the frame to the ring - the texture is locked again and the frame
+ * becomes available to getf.
+ */
+static void release_frame(struct state_sdl2 *s, struct video_frame *frame)
+{
+        struct sdl2_buffer *buf = frame->callbacks.dispose_udata;
+        int pitch = 0;
+        SDL_CHECK(SDL_LockTexture(buf->texture, NULL, (void **) &frame->tiles[0].data, &pitch));
+        assert(pitch == s->texture_pitch);
+
+        pthread_mutex_lock(&s->lock);
+        simple_linked_list_append(s->free_frame_queue, frame);
+        pthread_mutex_unlock(&s->lock);
+        pthread_cond_signal(&s->frame_consumed_cv);
+}
+
+/**
+ * Presents the frame. The texture is not locked again until the next frame is
+ * presented, so that the decoder fills the other textures of the ring
+ * meanwhile and the presented one can be redrawn (frame == s->last_frame).
+ */
 static void display_frame(struct state_sdl2 *s, struct video_frame *frame)
 {
         if (!frame) {
                 return;
         }
 
-        SDL_Texture *texture = (SDL_Texture *) frame->callbacks.dispose_udata;
+        struct sdl2_buffer *buf = frame->callbacks.dispose_udata;
+        if (frame == s->last_frame) { // only redrawing on window resize/expose
+                SDL_RenderClear(s->renderer);
+                SDL_CHECK(SDL_RenderCopy(s->renderer, buf->texture, NULL, NULL));
+                SDL_RenderPresent(s->renderer);
+                return;
+        }
+
         if (s->deinterlace == DEINT_FORCE || (s->deinterlace == DEINT_ON && frame->interlacing == INTERLACED_MERGED)) {
-                size_t pitch = vc_get_linesize(frame->tiles[0].width, frame->color_spec);
+                size_t pitch = tile_get_linesize(&frame->tiles[0], frame->color_spec);
                 if (!vc_deinterlace_ex(frame->color_spec, (unsigned char *) frame->tiles[0].data, pitch, (unsigned char *) frame->tiles[0].data, pitch, frame->tiles[0].height)) {
                          log_msg_once(LOG_LEVEL_ERROR, SDL2_DEINTERLACE_IMPOSSIBLE_MSG_ID, MOD_NAME "Cannot deinterlace, unsupported pixel format '%s'!\n", get_codec_name(frame->color_spec));
                 }
         }
 
         SDL_RenderClear(s->renderer);
-        SDL_UnlockTexture(texture);
-        SDL_CHECK(SDL_RenderCopy(s->renderer, texture, NULL, NULL));
+        SDL_UnlockTexture(buf->texture);
+        SDL_CHECK(SDL_RenderCopy(s->renderer, buf->texture, NULL, NULL));
         SDL_RenderPresent(s->renderer);
 
-        int pitch = 0;
-        SDL_CHECK(SDL_LockTexture(texture, NULL, (void **) &frame->tiles[0].data, &pitch));
-        assert(pitch == s->texture_pitch);
+        if (s->last_frame != NULL) {
+                release_frame(s, s->last_frame);
+        }
+        s->last_frame = frame;
 
-        if (frame == s->last_frame) {
-                return; // we are only redrawing on window resize
+        if (buf->put_time == 0) { // splashscreen
+                return;
+        }
+        time_ns_t now = get_time_in_ns();
+        double fps = s->current_display_desc.fps;
+        bool late = fps > 0.0 && now - buf->put_time > NS_IN_SEC_DBL / fps;
+        if (late) {
+                metrics_counter_add(s->metric_late, 1);
         }
+        pthread_mutex_lock(&s->lock);
+        s->stats.presented += 1;
+        s->stats.late += late ? 1 : 0;
+        report_stats(s, now);
+        pthread_mutex_unlock(&s->lock);
+}
 
+/**
+ * Processes the frame received from putf - if a newer frame is already
+ * waiting, this one is dropped without being presented.
+ */
+static void display_new_frame(struct state_sdl2 *s, struct video_frame *frame)
+{
         pthread_mutex_lock(&s->lock);
-        simple_linked_list_append(s->free_frame_queue, frame);
+        bool superseded = s->queued > 1;
+        s->queued -= 1;
+        if (superseded) {
+                frames_dropped(s, 1);
+                simple_linked_list_append(s->free_frame_queue, frame); // texture still locked
+        }
         pthread_mutex_unlock(&s->lock);
-        pthread_cond_signal(&s->frame_consumed_cv);
-        s->last_frame = frame;
+        pthread_cond_signal(&s->frame_consumed_cv); // putf waits for queued to decrease
+        if (!superseded) {
+                display_frame(s, frame);
+        }
 }
 
 static int64_t translate_sdl_key_to_ug(SDL_Keysym sym) {
@@ -263,7 +362,7 @@ static void display_sdl2_run(void *arg)
                         if (sdl_event.user.data1 == NULL) { // poison pill received
                                 break;
                         }
-                        display_frame(s, (struct video_frame *) sdl_event.user.data1);
+                        display_new_frame(s, (struct video_frame *) sdl_event.user.data1);
                 } else if (sdl_event.type == s->sdl_user_new_message_event) {
                         struct msg_universal *msg;
                         while ((msg = (struct msg_universal *) check_message(&s->mod))) {
@@ -307,9 +406,7 @@ static void display_sdl2_run(void *arg)
                         if (sdl_event.window.event == SDL_WINDOWEVENT_EXPOSED
                                         || sdl_event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
                                 // clear both buffers
-                                SDL_RenderClear(s->renderer);
                                 display_frame(s, s->last_frame);
-                                SDL_RenderClear(s->renderer);
                                 display_frame(s, s->last_frame);
                         }
                 } else if (sdl_event.type == SDL_QUIT) {
@@ -336,7 +433,7 @@ static void show_help(void)
 {
         SDL_CHECK(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS));
         printf("SDL options:\n");
-        color_printf(TBOLD(TRED("\t-d sdl") "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:renderer=<ridx>|:nodecorate|:fixed_size[=WxH]|:window_flags=<f>|:pos=<x>,<y>|:keep-aspect]*|:help]") "\n");
+        color_printf(TBOLD(TRED("\t-d sdl") "[[:fs|:d|:display=<didx>|:driver=<drv>|:novsync|:renderer=<ridx>|:nodecorate|:fixed_size[=WxH]|:window_flags=<f>|:pos=<x>,<y>|:keep-aspect|:buffers=<n>]*|:help]") "\n");
         printf("\twhere:\n");
         color_printf(TBOLD("\t\td[force]") " - deinterlace (force even for progresive video)\n");
         color_printf(TBOLD("\t\t      fs") " - fullscreen\n");
@@ -349,6 +446,7 @@ static void show_help(void)
         color_printf("\n");
         color_printf(TBOLD("\t     keep-aspect") " - keep window aspect ratio respecive to the video\n");
         color_printf(TBOLD("\t         novsync") " - disable sync on VBlank\n");
+        color_printf(TBOLD("\t     buffers=<n>") " - number of streaming textures the decoder writes to while another one is presented (default %d)\n", DEFAULT_BUFFER_COUNT);
         color_printf(TBOLD("\t      nodecorate") " - disable window border\n");
         color_printf(TBOLD("\tfixed_size[=WxH]") " - use fixed sized window\n");
         color_printf(TBOLD("\t    window_flags") " - flags to be passed to SDL_CreateWindow (use prefix 0x for hex)\n");
@@ -438,6 +536,7 @@ static int get_supported_pfs(codec_t *codecs) {
 }
 
 static void cleanup_frames(struct state_sdl2 *s) {
+        vf_free(s->last_frame);
         s->last_frame = NULL;
         struct video_frame *buffer = NULL;
         while ((buffer = simple_linked_list_pop(s->free_frame_queue)) != NULL) {
@@ -445,23 +544,29 @@ static void cleanup_frames(struct state_sdl2 *s) {
         }
 }
 
-static void vf_sdl_texture_data_deleter(struct video_frame *buf) {
-        SDL_Texture *texture = (SDL_Texture *) buf->callbacks.dispose_udata;
-        SDL_DestroyTexture(texture);
+static void vf_sdl_texture_data_deleter(struct video_frame *f) {
+        struct sdl2_buffer *buf = f->callbacks.dispose_udata;
+        SDL_DestroyTexture(buf->texture);
+        free(buf);
 }
 
 static bool recreate_textures(struct state_sdl2 *s, struct video_desc desc) {
         cleanup_frames(s);
 
-        for (int i = 0; i < BUFFER_COUNT; ++i) {
+        for (int i = 0; i < s->buffer_count; ++i) {
                 SDL_Texture *texture = SDL_CreateTexture(s->renderer, get_ug_to_sdl_format(desc.color_spec), SDL_TEXTUREACCESS_STREAMING, desc.width, desc.height);
                 if (!texture) {
                         log_msg(LOG_LEVEL_ERROR, MOD_NAME "Unable to create texture: %s\n", SDL_GetError());
                         return false;
                 }
+                struct sdl2_buffer *buf = calloc(1, sizeof *buf);
+                buf->texture = texture;
                 struct video_frame *f = vf_alloc_desc(desc);
-                f->callbacks.dispose_udata = (void *) texture;
+                f->callbacks.dispose_udata = buf;
                 SDL_CHECK(SDL_LockTexture(texture, NULL, (void **) &f->tiles[0].data, &s->texture_pitch));
+                if (!codec_is_planar(desc.color_spec)) {
+                        f->tiles[0].linesize = s->texture_pitch;
+                }
                 f->callbacks.data_deleter = vf_sdl_texture_data_deleter;
                 simple_linked_list_append(s->free_frame_queue, f);
         }
@@ -548,6 +653,7 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
         s->x = s->y = SDL_WINDOWPOS_UNDEFINED;
         s->renderer_idx = -1;
         s->vsync = true;
+        s->buffer_count = DEFAULT_BUFFER_COUNT;
 
         if (fmt == NULL) {
                 fmt = "";
@@ -603,6 +709,13 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
                         s->y = atoi(strchr(tok, ',') + 1);
                 } else if (strncmp(tok, "renderer=", strlen("renderer=")) == 0) {
                         s->renderer_idx = atoi(tok + strlen("renderer="));
+                } else if (strncmp(tok, "buffers=", strlen("buffers=")) == 0) {
+                        s->buffer_count = atoi(tok + strlen("buffers="));
+                        if (s->buffer_count < MIN_BUFFER_COUNT) {
+                                log_msg(LOG_LEVEL_ERROR, MOD_NAME "At least %d buffers needed!\n", MIN_BUFFER_COUNT);
+                                free(s);
+                                return NULL;
+                        }
                 } else {
                         log_msg(LOG_LEVEL_ERROR, "[SDL] Wrong option: %s\n", tok);
                         free(s);
@@ -644,6 +757,11 @@ static void *display_sdl2_init(struct module *parent, const char *fmt, unsigned
         s->sdl_user_reconfigure_event = s->sdl_user_new_frame_event + 2;
 
         s->free_frame_queue = simple_linked_list_init();
+        s->metric_dropped = metrics_counter_register("display_dropped_frames",
+                        "Frames dropped by the display", "module=\"sdl\"");
+        s->metric_late = metrics_counter_register("display_late_frames",
+                        "Frames presented later than one frame period after being passed to the display",
+                        "module=\"sdl\"");
 
         for (unsigned int i = 0; i < sizeof keybindings / sizeof keybindings[0]; ++i) {
                 if (keybindings[i].key == 'q') { // don't report 'q' to avoid accidental close - user can use Ctrl-c there
@@ -721,9 +839,11 @@ static int display_sdl2_putf(void *state, struct video_frame *frame, long long t
                 return 0;
         }
 
+        // keep at least one texture for the decoder while the render thread catches up
+        const int max_queued = MAX(s->buffer_count - 2, 1);
         if (frame != NULL && timeout_ns > 0) {
                 int rc = 0;
-                while (rc == 0 && simple_linked_list_size(s->free_frame_queue) == 0) {
+                while (rc == 0 && s->queued >= max_queued) {
                         if (timeout_ns == PUTF_BLOCKING) {
                                 rc = pthread_cond_wait(&s->frame_consumed_cv, &s->lock);
                         } else {
@@ -734,12 +854,17 @@ static int display_sdl2_putf(void *state, struct video_frame *frame, long long t
                         }
                 }
         }
-        if (frame != NULL && simple_linked_list_size(s->free_frame_queue) == 0) {
+        if (frame != NULL && s->queued >= max_queued) {
                 simple_linked_list_append(s->free_frame_queue, frame);
+                frames_dropped(s, 1);
                 log_msg(LOG_LEVEL_INFO, MOD_NAME "1 frame(s) dropped!\n");
                 pthread_mutex_unlock(&s->lock);
                 return 1;
         }
+        if (frame != NULL) {
+                ((struct sdl2_buffer *) frame->callbacks.dispose_udata)->put_time = get_time_in_ns();
+                s->queued += 1;
+        }
         pthread_mutex_unlock(&s->lock);
         SDL_Event event;
         event.type = s->sdl_user_new_frame_event;
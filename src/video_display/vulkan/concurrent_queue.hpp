@@ -40,22 +40,24 @@
 #include <cstdint>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
+
+#include "video_display/display_queue.hpp"
 
 
 namespace vulkan_display_detail{
 
 constexpr size_t unlimited_size = SIZE_MAX;
 
+/// synchronized wrapper of display_queue, the policy applies to policy_push() only
 template<typename T, size_t max_size = unlimited_size>
 class ConcurrentQueue{
-        std::queue<T> queue;
+        display_queue<T> queue{max_size, display_queue_policy::drop_oldest};
         mutable std::mutex mutex{};
         std::condition_variable queue_decremented_cv{};
         std::condition_variable queue_incremented_cv{};
 
         void push_and_unlock(std::unique_lock<std::mutex>& lock, T&& item){
-                queue.push(std::move(item));
+                queue.force_push(std::move(item));
                 lock.unlock();
                 queue_incremented_cv.notify_one();
         }
@@ -68,8 +70,7 @@ class ConcurrentQueue{
                 }
 
                 queue_incremented_cv.wait(lock, [this]{return queue.size() > 0;});
-                T result = std::move(queue.front());
-                queue.pop();
+                T result = queue.pop();
 
                 lock.unlock();
                 queue_decremented_cv.notify_one();
@@ -92,8 +93,7 @@ public:
                 if (queue.empty()){
                         return T{};
                 }
-                T result = std::move(queue.front());
-                queue.pop();
+                T result = queue.pop();
 
                 lock.unlock();
                 queue_decremented_cv.notify_one();
@@ -103,17 +103,45 @@ public:
         T force_push(T item){
                 std::unique_lock lock{mutex};
                 T result = {};
-                if (queue.size() >= max_size) {
-                        result = std::move(queue.front());
-                        queue.pop();
+                if (queue.full()) {
+                        result = queue.pop();
                 }
                 push_and_unlock(lock, std::move(item));
                 return result;
         }
 
+        void set_policy(display_queue_policy policy){
+                std::unique_lock lock{mutex};
+                queue.set_policy(policy);
+        }
+
+        /// @returns true if policy_push() without waiting would drop the item
+        bool would_drop() const {
+                std::unique_lock lock{mutex};
+                return queue.would_drop();
+        }
+
+        /**
+         * Pushes the item according to the policy.
+         *
+         * @param timeout_ns see display_queue::wait_for_room()
+         * @returns          dropped item (the replaced one or item itself), T{} if none
+         */
+        T policy_push(T item, long long timeout_ns){
+                std::unique_lock lock{mutex};
+                queue.wait_for_room(queue_decremented_cv, lock, timeout_ns);
+                T dropped = {};
+                if (!queue.push(std::move(item), &dropped)) {
+                        return dropped;
+                }
+                lock.unlock();
+                queue_incremented_cv.notify_one();
+                return dropped;
+        }
+
         bool try_push(T item){
                 std::unique_lock lock{mutex};
-                if (queue.size() >= max_size) {
+                if (queue.full()) {
                         return false;
                 }
                 push_and_unlock(lock, std::move(item));
@@ -5,7 +5,7 @@ GLSLC=glslc
 
 DEST_PATH=../../../../share/ultragrid/vulkan_shaders
 
-declare -a SHADERS=("render.vert" "render.frag" "RGB10A2_conv.comp" "UYVA16_conv.comp" "UYVY8_conv.comp")
+declare -a SHADERS=("render.vert" "render.frag" "RGB10A2_conv.comp" "UYVA16_conv.comp" "UYVY8_conv.comp" "v210_conv.comp")
 
 for shader in ${SHADERS[@]}; do
 	echo "$GLSLC $SOURCE_PATH/$shader -o $DEST_PATH/$shader.spv"
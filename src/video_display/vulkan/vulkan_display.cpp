@@ -441,7 +441,7 @@ bool VulkanDisplay::queue_image(TransferImage image, bool discardable) {
                 return false;
         }
         
-        auto removed = filled_img_queue.force_push(image.get_transfer_image());
+        auto removed = filled_img_queue.policy_push(image.get_transfer_image(), 0);
         if (removed != nullptr){
                 available_images.push_back(removed);
                 return true;
@@ -170,6 +170,15 @@ public:
          */
         bool queue_image(TransferImage img, bool discardable);
 
+        /** Thread-safe*/
+        void set_queue_policy(display_queue_policy policy) { filled_img_queue.set_policy(policy); }
+
+        /** Thread-safe
+         **
+         ** @return true if an image queued now as discardable would be discarded
+         */
+        bool would_discard() const { return filled_img_queue.would_drop(); }
+
         /** Thread-safe to call from provider thread.*/
         void copy_and_queue_image(unsigned char* frame, ImageDescription description);
 
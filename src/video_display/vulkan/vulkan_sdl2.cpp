@@ -515,6 +515,7 @@ const std::vector<CodecToVulkanFormat>& get_ug_to_vkd_format_mapping(state_vulka
                 {Y216, vkd::Format::YUYV16_422},
                 {Y416, vkd::Format::UYVA16_422_conv},
                 {R10k, vkd::Format::RGB10A2_conv},
+                {v210, vkd::Format::v210_conv},
                 {RG48, vkd::Format::RGB16},
         }};
 
@@ -829,6 +830,8 @@ void* display_vulkan_init(module* parent, const char* fmt, unsigned int flags) {
 #endif
                 s->vulkan = new vkd::VulkanDisplay{};
                 s->vulkan->init(std::move(instance), surface, initial_frame_count, *s->window_callback, args.gpu_idx, path_to_shaders, args.vsync, args.tearing_permitted);
+                s->vulkan->set_queue_policy(display_queue_policy_from_string(
+                                        get_commandline_param("display-queue-policy"), display_queue_policy::drop_oldest));
                 LOG(LOG_LEVEL_NOTICE) << MOD_NAME "Vulkan display initialised." << std::endl;
         }
         catch (std::exception& e) { log_and_exit_uv(e); return nullptr; }
@@ -956,6 +959,13 @@ int display_vulkan_get_property(void* state, int property, void* val, size_t* le
                         catch (std::exception& e) { log_and_exit_uv(e); return FALSE; }
                         break;
                 }
+                case DISPLAY_PROPERTY_BACKPRESSURE:
+                        if (sizeof(bool) > *len) {
+                                return FALSE;
+                        }
+                        *len = sizeof(bool);
+                        *static_cast<bool*>(val) = s->vulkan->would_discard();
+                        break;
                 default:
                         return FALSE;
         }
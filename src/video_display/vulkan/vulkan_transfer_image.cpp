@@ -91,6 +91,10 @@ vk::Extent2D get_buffer_size(const vulkan_display::ImageDescription& description
         if (description.format == vulkan_display::Format::UYVY8_422_conv){
                 return { description.size.width / 2, description.size.height };
         }
+        if (description.format == vulkan_display::Format::v210_conv){
+                // 6 pixels per 128-bit block, lines are padded to 48 pixels
+                return { (description.size.width + 47) / 48 * 8, description.size.height };
+        }
         return description.size;
 }
 
@@ -43,9 +43,14 @@
 
 #include <compat/platform_semaphore.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include "debug.h"
 #include "video.h"
@@ -53,6 +58,8 @@
 #include "video_export.h"
 
 #define MAX_QUEUE_SIZE 300
+#define SEGMENT_SIZE (4ULL * 1024 * 1024 * 1024) ///< container segment size (a bigger tile gets its own segment)
+#define MOD_NAME "[Video export] "
 
 /*
  * we do not need to have possible stalls, so IO is performend in a separate thread
@@ -63,9 +70,10 @@ void output_summary(struct video_export *s);
 struct output_entry;
 
 struct output_entry {
-        char *filename;
-        char *data;
+        char *filename; ///< NULL for container layout
+        char *data; ///< aligned to VIDEO_EXPORT_CONTAINER_ALIGN, padded with zeros to the alignment
         int data_len;
+        bool skipped; ///< placeholder for a tile not saved due to full queue (container layout)
 
         struct output_entry *next;
 };
@@ -84,8 +92,104 @@ struct video_export {
         struct video_desc saved_desc;
 
         pthread_t thread_id;
+
+        bool container;
+        struct {
+                int fd;
+                bool direct; ///< fd opened with O_DIRECT
+                unsigned idx;
+                uint64_t offset;
+                FILE *index;
+        } segment; ///< used by the container layout
 };
 
+#ifdef WIN32
+static bool container_write(struct video_export *s, struct output_entry *entry) {
+        UNUSED(s), UNUSED(entry);
+        return false;
+}
+static void container_close_segment(struct video_export *s) {
+        UNUSED(s);
+}
+#else
+static void container_close_segment(struct video_export *s)
+{
+        if (s->segment.fd == -1) {
+                return;
+        }
+        // drop the unused preallocated space
+        if (ftruncate(s->segment.fd, s->segment.offset) != 0) {
+                perror(MOD_NAME "ftruncate");
+        }
+        close(s->segment.fd);
+        s->segment.fd = -1;
+}
+
+static bool container_open_segment(struct video_export *s)
+{
+        container_close_segment(s);
+        s->segment.idx += 1;
+        s->segment.offset = 0;
+
+        char name[512];
+        int len = snprintf(name, sizeof name, "%s/", s->path);
+        snprintf(name + len, sizeof name - len, VIDEO_EXPORT_SEGMENT_NAME, s->segment.idx);
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        s->segment.direct = true;
+        s->segment.fd = open(name, flags | O_DIRECT, 0666);
+        if (s->segment.fd == -1 && errno == EINVAL) { // not supported by the FS (eg. tmpfs)
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "O_DIRECT not supported for %s, using buffered writes.\n", name);
+                s->segment.direct = false;
+                s->segment.fd = open(name, flags, 0666);
+        }
+#else
+        s->segment.direct = false;
+        s->segment.fd = open(name, flags, 0666);
+#endif
+        if (s->segment.fd == -1) {
+                perror(MOD_NAME "Cannot create segment file");
+                return false;
+        }
+#ifdef HAVE_LINUX
+        // not posix_fallocate - it would write zeros where the FS doesn't support preallocation
+        if (fallocate(s->segment.fd, 0, 0, SEGMENT_SIZE) != 0) {
+                log_msg(LOG_LEVEL_VERBOSE, MOD_NAME "Cannot preallocate segment: %s\n", strerror(errno));
+        }
+#endif
+        return true;
+}
+
+static bool container_write(struct video_export *s, struct output_entry *entry)
+{
+        if (entry->skipped) { // keep the index aligned with frame numbers
+                fprintf(s->segment.index, "0 0 0\n");
+                return true;
+        }
+        size_t padded_len = (entry->data_len + VIDEO_EXPORT_CONTAINER_ALIGN - 1)
+                / VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN;
+        if (s->segment.fd == -1 ||
+                        (s->segment.offset > 0 && s->segment.offset + padded_len > SEGMENT_SIZE)) {
+                if (!container_open_segment(s)) {
+                        return false;
+                }
+        }
+        size_t written = 0;
+        while (written < padded_len) {
+                ssize_t ret = pwrite(s->segment.fd, entry->data + written, padded_len - written,
+                                s->segment.offset + written);
+                if (ret <= 0) {
+                        perror(MOD_NAME "pwrite");
+                        return false;
+                }
+                written += ret;
+        }
+        fprintf(s->segment.index, "%u %" PRIu64 " %d\n", s->segment.idx, s->segment.offset, entry->data_len);
+        s->segment.offset += padded_len;
+        return true;
+}
+#endif // defined WIN32
+
 static void *video_export_thread(void *arg)
 {
         struct video_export *s = (struct video_export *) arg;
@@ -106,20 +210,24 @@ static void *video_export_thread(void *arg)
                                 (current->data != NULL && current->data_len != 0));
 
                 // poison
-                if(current->data == NULL) {
+                if(current->data == NULL && !current->skipped) {
                         return NULL;
                 }
 
-                FILE *out = fopen(current->filename, "wb");
-                if (out == NULL) {
-                        perror("fopen");
+                if (current->filename == NULL) {
+                        container_write(s, current);
                 } else {
-                        if (fwrite(current->data, current->data_len, 1, out) != 1) {
-                                perror("fwrite");
+                        FILE *out = fopen(current->filename, "wb");
+                        if (out == NULL) {
+                                perror("fopen");
+                        } else {
+                                if (fwrite(current->data, current->data_len, 1, out) != 1) {
+                                        perror("fwrite");
+                                }
+                                fclose(out);
                         }
-                        fclose(out);
                 }
-                free(current->data);
+                aligned_free(current->data);
                 free(current->filename);
                 free(current);
         }
@@ -127,12 +235,31 @@ static void *video_export_thread(void *arg)
         // never get here
 }
 
-struct video_export * video_export_init(const char *path)
+struct video_export * video_export_init(const char *path, bool container)
 {
         struct video_export *s;
 
+#ifdef WIN32
+        if (container) {
+                log_msg(LOG_LEVEL_ERROR, MOD_NAME "Container layout not supported on this platform!\n");
+                return NULL;
+        }
+#endif
+
         s = (struct video_export *) calloc(1, sizeof(struct video_export));
         assert(s != NULL);
+        s->container = container;
+        s->segment.fd = -1;
+        if (container) {
+                char name[512];
+                snprintf(name, sizeof name, "%s/" VIDEO_EXPORT_INDEX_NAME, path);
+                s->segment.index = fopen(name, "w");
+                if (s->segment.index == NULL) {
+                        perror(MOD_NAME "Cannot create index file");
+                        free(s);
+                        return NULL;
+                }
+        }
 
         platform_sem_init(&s->semaphore, 0, 0);
         pthread_mutex_init(&s->lock, NULL);
@@ -172,6 +299,10 @@ void output_summary(struct video_export *s)
         fprintf(summary, "fps %.2f\n", s->saved_desc.fps);
         fprintf(summary, "interlacing %d\n", (int) s->saved_desc.interlacing);
         fprintf(summary, "count %d\n", s->total);
+        if (s->container) {
+                fprintf(summary, "layout container\n");
+                fprintf(summary, "tiles %d\n", s->saved_desc.tile_count);
+        }
 
         fclose(summary);
 }
@@ -197,6 +328,11 @@ void video_export_destroy(struct video_export *s)
                 pthread_join(s->thread_id, NULL);
                 pthread_mutex_destroy(&s->lock);
 
+                if (s->container) {
+                        container_close_segment(s);
+                        fclose(s->segment.index);
+                }
+
                 // write summary
                 if(s->total > 0) {
                         output_summary(s);
@@ -230,11 +366,17 @@ void video_export(struct video_export *s, struct video_frame *frame)
                 struct output_entry *entry = malloc(sizeof(struct output_entry));
 
                 entry->data_len = frame->tiles[i].data_len;
-                entry->data = (char *) malloc(entry->data_len);
-                entry->filename = malloc(512);
+                entry->skipped = false;
+                const size_t padded_len = (entry->data_len + VIDEO_EXPORT_CONTAINER_ALIGN - 1)
+                        / VIDEO_EXPORT_CONTAINER_ALIGN * VIDEO_EXPORT_CONTAINER_ALIGN;
+                entry->data = (char *) aligned_malloc(padded_len, VIDEO_EXPORT_CONTAINER_ALIGN);
+                memset(entry->data + entry->data_len, 0, padded_len - entry->data_len);
+                entry->filename = s->container ? NULL : malloc(512);
                 entry->next = NULL;
 
-                if(frame->tile_count == 1) {
+                if (s->container) {
+                        // index is written by the export thread
+                } else if(frame->tile_count == 1) {
                         snprintf(entry->filename, 512, "%s/%08d.%s", s->path, s->total + 1, get_codec_file_extension(frame->color_spec));
                 } else {
                         // add also tile index
@@ -248,11 +390,18 @@ void video_export(struct video_export *s, struct video_frame *frame)
                         if(s->queue_len >= MAX_QUEUE_SIZE) {
                                 fprintf(stderr, "[Video export] Maximal queue size (%d) exceeded, not saving frame %d.\n",
                                                 MAX_QUEUE_SIZE,
-                                                s->total++); // we increment total size to keep the index
-                                pthread_mutex_unlock(&s->lock);
-                                free(entry->data);
-                                free(entry);
-                                return;
+                                                s->total + 1);
+                                aligned_free(entry->data);
+                                free(entry->filename);
+                                if (!s->container) {
+                                        pthread_mutex_unlock(&s->lock);
+                                        free(entry);
+                                        s->total++; // we increment total size to keep the index
+                                        return;
+                                }
+                                entry->data = NULL;
+                                entry->data_len = 0;
+                                entry->skipped = true;
                         }
 
                         if(s->head) {
@@ -40,6 +40,24 @@
 
 #define VIDEO_EXPORT_SUMMARY_VERSION 1
 
+/**
+ * @name Container layout
+ * Instead of a file per frame, tiles are appended to large preallocated
+ * segment files (VIDEO_EXPORT_SEGMENT_NAME) at offsets aligned to
+ * VIDEO_EXPORT_CONTAINER_ALIGN. Each tile has a line "<segment> <offset>
+ * <length>" in VIDEO_EXPORT_INDEX_NAME, tiles of a frame are on consecutive
+ * lines. video.info then contains "layout container" and "tiles <n>".
+ * @{
+ */
+#define VIDEO_EXPORT_INDEX_NAME "video.idx"
+#define VIDEO_EXPORT_SEGMENT_NAME "video_%04u.ugv"
+#define VIDEO_EXPORT_CONTAINER_ALIGN 4096
+/// @}
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -47,7 +65,10 @@ extern "C" {
 struct video_export;
 struct video_frame;
 
-struct video_export * video_export_init(const char *path);
+/**
+ * @param container use the container layout instead of a file per frame
+ */
+struct video_export * video_export_init(const char *path, bool container);
 void video_export_destroy(struct video_export *state);
 void video_export(struct video_export *state, struct video_frame *frame);
 
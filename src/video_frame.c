@@ -56,14 +56,24 @@
 #endif // HAVE_CONFIG_H
 #include "debug.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "utils/frame_alloc.h"
+#include "utils/macros.h"
+#include "utils/misc.h"
 #include "utils/pam.h"
+#include "utils/parallel_conv.h"
+#include "utils/worker.h"
 #include "utils/y4m.h"
 #include "video_codec.h"
 #include "video_frame.h"
 
+static void vf_stripes_free(struct vf_stripes *s);
+
 struct video_frame * vf_alloc(int count)
 {
         struct video_frame *buf;
@@ -102,19 +112,18 @@ struct video_frame * vf_alloc_desc(struct video_desc desc)
         return buf;
 }
 
-static void vf_aligned_data_deleter(struct video_frame *buf)
+static void vf_frame_data_deleter(struct video_frame *buf)
 {
         for (unsigned int i = 0u; i < buf->tile_count; ++i) {
-                aligned_free(buf->tiles[i].data);
+                frame_data_free(buf->tiles[i].data);
         }
 }
 
 /**
  * @brief allocates struct video_frame including data pointers in RAM
  * @note
- * Try to use hugepages in Linux, which may improve performance. See:
- * - https://kernel.org/doc/html//v5.15/admin-guide/mm/transhuge.html
- * - https://rigtorp.se/hugepages/
+ * Uses hugepages in Linux (according to "--param frame-alloc"), which may
+ * improve performance, see utils/frame_alloc.c.
  */
 struct video_frame * vf_alloc_desc_data(struct video_desc desc)
 {
@@ -133,14 +142,11 @@ struct video_frame * vf_alloc_desc_data(struct video_desc desc)
                                         desc.color_spec) *
                                 desc.height;
                 }
-                buf->tiles[i].data = (char *) aligned_malloc(buf->tiles[i].data_len + MAX_PADDING, 1U<<21U /* 2 MiB */);
+                buf->tiles[i].data = (char *) frame_data_alloc(buf->tiles[i].data_len + MAX_PADDING, NULL);
                 assert(buf->tiles[i].data != NULL);
-#ifdef __linux__
-                madvise(buf->tiles[0].data, buf->tiles[0].data_len, MADV_HUGEPAGE);
-#endif
         }
 
-        buf->callbacks.data_deleter = vf_aligned_data_deleter;
+        buf->callbacks.data_deleter = vf_frame_data_deleter;
         buf->callbacks.recycle = NULL;
 
         return buf;
@@ -156,6 +162,7 @@ void vf_free(struct video_frame *buf)
         if (buf->callbacks.data_deleter) {
                 buf->callbacks.data_deleter(buf);
         }
+        vf_stripes_free(buf->stripes);
         free(buf);
 }
 
@@ -185,6 +192,22 @@ struct tile * vf_get_tile(struct video_frame *buf, int pos)
         return &buf->tiles[pos];
 }
 
+int tile_get_linesize(const struct tile *tile, codec_t codec)
+{
+        return tile->linesize != 0 ? (int) tile->linesize : vc_get_linesize(tile->width, codec);
+}
+
+bool vf_is_strided(const struct video_frame *frame)
+{
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                if (frame->tiles[i].linesize != 0 && (int) frame->tiles[i].linesize
+                                != vc_get_linesize(frame->tiles[i].width, frame->color_spec)) {
+                        return true;
+                }
+        }
+        return false;
+}
+
 bool video_desc_eq(struct video_desc a, struct video_desc b)
 {
         return video_desc_eq_excl_param(a, b, 0);
@@ -266,107 +289,143 @@ enum interlacing_t get_interlacing_from_suffix(const char *suffix)
 }
 
 /**
- * @todo
- * Needs to be more efficient
+ * Scratch fields kept between calls of the il_* functions (stored_state), so
+ * that no frame-sized buffer is allocated per frame.
  */
-void il_lower_to_merged(char *dst, char *src, int linesize, int height, void **stored_state)
+struct il_state {
+        size_t field_len;  ///< length of one scratch field
+        bool has_prev;     ///< il_lower_to_merged() - lower field of previous frame stored
+        int prev;          ///< index of the field holding the previous lower field
+        char fields[];     ///< 2 * field_len
+};
+
+static struct il_state *il_get_state(void **stored_state, size_t field_len)
 {
-        struct il_lower_to_merged_state {
-                size_t field_len;
-                char field[];
-        };
-        struct il_lower_to_merged_state *last_field = (struct il_lower_to_merged_state *) *stored_state;
-
-        char *tmp = malloc(linesize * height);
-        char *line1, *line2;
-
-        // upper field
-        line1 = tmp;
-        int upper_field_len = linesize * ((height + 1) / 2);
-        // first check if we have field from last frame
-        if (last_field == NULL) {
-                last_field = (struct il_lower_to_merged_state *)
-                        malloc(sizeof(struct il_lower_to_merged_state) + upper_field_len);
-                last_field->field_len = upper_field_len;
-                *stored_state = last_field;
-                // if no, use current one
-                line2 = src + linesize * (height / 2);
-        } else {
-                // otherwise use field from last "frame"
-                line2 = last_field->field;
-        }
-        for (int y = 0; y < (height + 1) / 2; y++) {
-                memcpy(line1, line2, linesize);
-                line1 += linesize * 2;
-                line2 += linesize;
+        struct il_state *s = *stored_state;
+        if (s == NULL || s->field_len != field_len) {
+                free(s);
+                s = calloc(1, sizeof *s + 2 * field_len);
+                s->field_len = field_len;
+                *stored_state = s;
         }
-        // store
-        assert ((int) last_field->field_len == upper_field_len);
-        memcpy(last_field->field, src + linesize * (height / 2), upper_field_len);
+        return s;
+}
 
-        // lower field
-        line1 = tmp + linesize;
-        line2 = src;
-        for (int y = 0; y < height / 2; y++) {
-                memcpy(line1, line2, linesize);
-                line1 += linesize * 2;
-                line2 += linesize;
+struct il_copy_rows_data {
+        char *dst;
+        int dst_first;
+        int dst_step;
+        const char *src;
+        int src_first;
+        int src_step;
+        int lo;
+        int linesize;
+};
+
+static void il_copy_rows_task(void *arg, int begin, int end)
+{
+        const struct il_copy_rows_data *d = arg;
+        for (int i = d->lo + begin; i < d->lo + end; ++i) {
+                memcpy(d->dst + (size_t) (d->dst_first + i * d->dst_step) * d->linesize,
+                                d->src + (size_t) (d->src_first + i * d->src_step) * d->linesize, d->linesize);
         }
-        memcpy(dst, tmp, linesize * height);
-        free(tmp);
 }
 
-/* TODO: rewrite following 2 functions in more efficient way */
-void il_upper_to_merged(char *dst, char *src, int linesize, int height, void **state)
+/**
+ * Copies rows i from [lo, hi) - dst row dst_first + i * dst_step from src row
+ * src_first + i * src_step, in parallel by the worker pool. Rows of one call
+ * must not overlap.
+ */
+static void il_copy_rows(char *dst, int dst_first, int dst_step, const char *src, int src_first, int src_step,
+                int lo, int hi, int linesize)
 {
-        UNUSED(state);
-        int y;
-        char *tmp = malloc(linesize * height);
-        char *line1, *line2;
+        if (hi <= lo) {
+                return;
+        }
+        struct il_copy_rows_data d = { dst, dst_first, dst_step, src, src_first, src_step, lo, linesize };
+        task_run_parallel_range(il_copy_rows_task, &d, hi - lo, parallel_conv_chunk_rows(linesize, 1),
+                        get_cpu_core_count());
+}
 
-        line1 = tmp;
-        line2 = src;
-        for(y = 0; y < (height + 1) / 2; y ++) {
-                memcpy(line1, line2, linesize);
-                line1 += linesize * 2;
-                line2 += linesize;
+/**
+ * Moves rows y of [0, count) in place to row first + 2 * y (first is 0 or 1).
+ * Done in rounds from the bottom, each round moves rows whose destinations
+ * don't overlap their sources nor sources of the following rounds, so the
+ * rows of a round can be copied in parallel.
+ */
+static void il_spread_rows(char *buf, int first, int count, int linesize)
+{
+        int hi = count;
+        while (hi > 0) {
+                int lo = (hi - first + 1) / 2;
+                if (lo == hi) { // row 0 with first == 0 stays
+                        break;
+                }
+                il_copy_rows(buf, first, 2, buf, 0, 1, lo, hi, linesize);
+                hi = lo;
         }
+}
 
-        line1 = tmp + linesize;
-        line2 = src + linesize * ((height + 1) / 2);
-        for(y = 0; y < height / 2; y ++) {
-                memcpy(line1, line2, linesize);
-                line1 += linesize * 2;
-                line2 += linesize;
+/**
+ * Moves even rows 2 * y in place to row y for y of [0, count), inverse of
+ * il_spread_rows(buf, 0, count, linesize), rounds go from the top.
+ */
+static void il_compact_rows(char *buf, int count, int linesize)
+{
+        for (int lo = 1; lo < count; lo *= 2) {
+                il_copy_rows(buf, 0, 1, buf, 0, 2, lo, MIN(2 * lo, count), linesize);
         }
-        memcpy(dst, tmp, linesize * height);
-        free(tmp);
 }
 
-void il_merged_to_upper(char *dst, char *src, int linesize, int height, void **state)
+/**
+ * Upper field is taken from the previous frame (its lower field is stored in
+ * stored_state), so the field order is shifted by one field.
+ */
+void il_lower_to_merged(char *dst, char *src, int linesize, int height, void **stored_state)
 {
-        UNUSED(state);
-        int y;
-        char *tmp = malloc(linesize * height);
-        char *line1, *line2;
+        const int upper_field_lines = (height + 1) / 2;
+        struct il_state *s = il_get_state(stored_state, (size_t) linesize * upper_field_lines);
+        const int cur = s->has_prev ? !s->prev : 0;
+        char *cur_field = s->fields + cur * s->field_len;
+        char *prev_field = s->has_prev ? s->fields + s->prev * s->field_len : cur_field;
+
+        il_copy_rows(cur_field, 0, 1, src, height / 2, 1, 0, upper_field_lines, linesize);
+        if (dst == src) {
+                il_spread_rows(dst, 1, height / 2, linesize);
+        } else {
+                il_copy_rows(dst, 1, 2, src, 0, 1, 0, height / 2, linesize);
+        }
+        il_copy_rows(dst, 0, 2, prev_field, 0, 1, 0, upper_field_lines, linesize);
+        s->prev = cur;
+        s->has_prev = true;
+}
 
-        line1 = tmp;
-        line2 = src;
-        for(y = 0; y < (height + 1) / 2; y ++) {
-                memcpy(line1, line2, linesize);
-                line1 += linesize;
-                line2 += linesize * 2;
+void il_upper_to_merged(char *dst, char *src, int linesize, int height, void **stored_state)
+{
+        const int upper_field_lines = (height + 1) / 2;
+        if (dst != src) {
+                il_copy_rows(dst, 0, 2, src, 0, 1, 0, upper_field_lines, linesize);
+                il_copy_rows(dst, 1, 2, src, upper_field_lines, 1, 0, height / 2, linesize);
+                return;
         }
+        struct il_state *s = il_get_state(stored_state, (size_t) linesize * (height / 2));
+        il_copy_rows(s->fields, 0, 1, src, upper_field_lines, 1, 0, height / 2, linesize);
+        il_spread_rows(dst, 0, upper_field_lines, linesize);
+        il_copy_rows(dst, 1, 2, s->fields, 0, 1, 0, height / 2, linesize);
+}
 
-        line1 = tmp + linesize * ((height + 1) / 2);
-        line2 = src + linesize;
-        for(y = 0; y < height / 2; y ++) {
-                memcpy(line1, line2, linesize);
-                line1 += linesize;
-                line2 += linesize * 2;
+void il_merged_to_upper(char *dst, char *src, int linesize, int height, void **stored_state)
+{
+        const int upper_field_lines = (height + 1) / 2;
+        if (dst != src) {
+                il_copy_rows(dst, 0, 1, src, 0, 2, 0, upper_field_lines, linesize);
+                il_copy_rows(dst, upper_field_lines, 1, src, 1, 2, 0, height / 2, linesize);
+                return;
         }
-        memcpy(dst, tmp, linesize * height);
-        free(tmp);
+        struct il_state *s = il_get_state(stored_state, (size_t) linesize * (height / 2));
+        il_copy_rows(s->fields, 0, 1, src, 1, 2, 0, height / 2, linesize);
+        il_compact_rows(dst, upper_field_lines, linesize);
+        il_copy_rows(dst, upper_field_lines, 1, s->fields, 0, 1, 0, height / 2, linesize);
 }
 
 /**
@@ -405,8 +464,17 @@ struct video_frame *vf_get_copy(struct video_frame *original) {
 
         for(int i = 0; i < (int) frame_copy->tile_count; ++i) {
                 frame_copy->tiles[i].data = (char *) malloc(frame_copy->tiles[i].data_len);
-                memcpy(frame_copy->tiles[i].data, original->tiles[i].data,
-                                frame_copy->tiles[i].data_len);
+                int src_linesize = tile_get_linesize(&original->tiles[i], original->color_spec);
+                int dst_linesize = vc_get_linesize(original->tiles[i].width, original->color_spec);
+                if (original->tiles[i].linesize == 0 || src_linesize == dst_linesize) {
+                        memcpy(frame_copy->tiles[i].data, original->tiles[i].data,
+                                        frame_copy->tiles[i].data_len);
+                        continue;
+                }
+                for (unsigned int y = 0; y < original->tiles[i].height; ++y) {
+                        memcpy(frame_copy->tiles[i].data + (size_t) y * dst_linesize,
+                                        original->tiles[i].data + (size_t) y * src_linesize, dst_linesize);
+                }
         }
 
         if(frame_copy->callbacks.copy){
@@ -622,3 +690,133 @@ void vf_clear(struct video_frame *f)
                         f->tiles[0].height,
                         f->color_spec);
 }
+
+struct vf_stripes {
+        pthread_mutex_t lock;
+        pthread_cond_t cv;
+        unsigned int height;
+        unsigned int stripe_height;
+        int count;
+        atomic_size_t *bytes;           ///< written bytes per stripe
+        _Atomic uint64_t done[];        ///< completion bitmap
+};
+
+static void vf_stripes_free(struct vf_stripes *s)
+{
+        if (s == NULL) {
+                return;
+        }
+        pthread_cond_destroy(&s->cv);
+        pthread_mutex_destroy(&s->lock);
+        free(s->bytes);
+        free(s);
+}
+
+bool vf_stripes_enable(struct video_frame *f, unsigned int stripe_height)
+{
+        unsigned int height = f->tiles[0].height;
+        if (stripe_height == 0 || height == 0) {
+                return false;
+        }
+        if (f->stripes != NULL && f->stripes->height == height && f->stripes->stripe_height == stripe_height) {
+                return true;
+        }
+        vf_stripes_free(f->stripes);
+        int count = (height + stripe_height - 1) / stripe_height;
+        struct vf_stripes *s = calloc(1, sizeof *s + (count + 63) / 64 * sizeof s->done[0]);
+        s->bytes = calloc(count, sizeof s->bytes[0]);
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->cv, NULL);
+        s->height = height;
+        s->stripe_height = stripe_height;
+        s->count = count;
+        f->stripes = s;
+        return true;
+}
+
+void vf_stripes_reset(struct video_frame *f)
+{
+        struct vf_stripes *s = f->stripes;
+        if (s == NULL) {
+                return;
+        }
+        for (int i = 0; i < s->count; ++i) {
+                atomic_store_explicit(&s->bytes[i], 0, memory_order_relaxed);
+        }
+        for (int i = 0; i < (s->count + 63) / 64; ++i) {
+                atomic_store_explicit(&s->done[i], 0, memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_release);
+}
+
+static void vf_stripe_set_complete(struct vf_stripes *s, int idx)
+{
+        atomic_fetch_or_explicit(&s->done[idx / 64], UINT64_C(1) << (idx % 64), memory_order_release);
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_broadcast(&s->cv);
+        pthread_mutex_unlock(&s->lock);
+}
+
+void vf_stripes_add(struct video_frame *f, int linesize, size_t offset, size_t len)
+{
+        struct vf_stripes *s = f->stripes;
+        if (s == NULL || linesize <= 0) {
+                return;
+        }
+        const size_t stripe_len = (size_t) s->stripe_height * linesize;
+        const size_t total_len = (size_t) s->height * linesize;
+        size_t end = MIN(offset + len, total_len);
+        while (offset < end) {
+                int idx = offset / stripe_len;
+                size_t stripe_end = MIN((idx + 1) * stripe_len, total_len);
+                size_t n = MIN(end, stripe_end) - offset;
+                size_t written = atomic_fetch_add_explicit(&s->bytes[idx], n, memory_order_acq_rel) + n;
+                if (written >= stripe_end - idx * stripe_len && written - n < stripe_end - idx * stripe_len) {
+                        vf_stripe_set_complete(s, idx);
+                }
+                offset += n;
+        }
+}
+
+void vf_stripes_complete(struct video_frame *f)
+{
+        struct vf_stripes *s = f->stripes;
+        if (s == NULL) {
+                return;
+        }
+        for (int i = 0; i < (s->count + 63) / 64; ++i) {
+                uint64_t mask = i < s->count / 64 ? UINT64_MAX : (UINT64_C(1) << (s->count % 64)) - 1;
+                atomic_store_explicit(&s->done[i], mask, memory_order_release);
+        }
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_broadcast(&s->cv);
+        pthread_mutex_unlock(&s->lock);
+}
+
+int vf_stripes_count(const struct video_frame *f)
+{
+        return f->stripes != NULL ? f->stripes->count : 0;
+}
+
+unsigned int vf_stripe_first_row(const struct video_frame *f, int idx)
+{
+        return MIN((unsigned int) idx * f->stripes->stripe_height, f->stripes->height);
+}
+
+bool vf_stripe_is_complete(struct video_frame *f, int idx)
+{
+        return atomic_load_explicit(&f->stripes->done[idx / 64], memory_order_acquire) & UINT64_C(1) << (idx % 64);
+}
+
+void vf_stripe_wait(struct video_frame *f, int idx)
+{
+        struct vf_stripes *s = f->stripes;
+        if (vf_stripe_is_complete(f, idx)) {
+                return;
+        }
+        pthread_mutex_lock(&s->lock);
+        while (!vf_stripe_is_complete(f, idx)) {
+                pthread_cond_wait(&s->cv, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+}
@@ -132,10 +132,20 @@ void vf_data_deleter(struct video_frame *buf);
  * Equivalent to &video_frame::tiles[pos]
  */
 struct tile * vf_get_tile(struct video_frame *buf, int pos);
+/**
+ * @returns distance of the tile lines in bytes, honoring tile::linesize
+ */
+int tile_get_linesize(const struct tile *tile, codec_t codec);
+/**
+ * @returns true if lines of some tile are not contiguous (tile::linesize
+ * differs from vc_get_linesize())
+ */
+bool vf_is_strided(const struct video_frame *frame);
 /**
  * @brief Makes deep copy of the video frame
  *
- * Copied data are automatically freeed by vf_free()
+ * Copied data are automatically freeed by vf_free(). Lines of strided tiles
+ * are packed in the copy.
  */
 struct video_frame * vf_get_copy(struct video_frame *frame);
 /**
@@ -169,8 +179,16 @@ const char *get_interlacing_description(enum interlacing_t interlacing);
 const char *get_interlacing_suffix(enum interlacing_t interlacing);
 enum interlacing_t get_interlacing_from_suffix(const char *suffix);
 
-void il_lower_to_merged(char *dst, char *src, int linesize, int height, void **stored_state);
 /* these functions transcode one interlacing format to another */
+/*
+ * dst may be equal to src. Scratch data are kept in *stored_state (initially
+ * NULL, to be freed with free()), rows are copied in parallel by the worker
+ * pool.
+ */
+/**
+ * @brief Converts lower-field-first to interlaced merged.
+ */
+void il_lower_to_merged(char *dst, char *src, int linesize, int height, void **stored_state);
 /**
  * @brief Converts upper-field-first to interlaced merged.
  */
@@ -211,6 +229,38 @@ void buf_get_linesizes(int width, codec_t color_spec, int *linesize);
 
 void vf_clear(struct video_frame *f);
 
+/**
+ * @name Stripes
+ * Completion of horizontal stripes of a frame (tile 0) that is consumed
+ * while it is still being written - eg. a display uploading stripes of
+ * a 16K frame while the rest is being received. The owner of the frame (the
+ * display) enables it and resets it every time the frame is handed out from
+ * getf(), producers report the written bytes with vf_stripes_add() and
+ * display_put_frame() marks all stripes complete (so that the consumer
+ * doesn't wait for lost data). Writers unaware of the stripes are thus
+ * still correct, just without the overlap.
+ * @{ */
+/**
+ * @param stripe_height rows per stripe (the last one may be shorter)
+ */
+bool vf_stripes_enable(struct video_frame *f, unsigned int stripe_height);
+void vf_stripes_reset(struct video_frame *f);
+/**
+ * Reports written bytes, ranges must not be reported twice for one frame.
+ *
+ * @param linesize  bytes per row in the layout of offset and len (producer
+ *                  source, eg. received payload), rows match rows of tile 0
+ */
+void vf_stripes_add(struct video_frame *f, int linesize, size_t offset, size_t len);
+void vf_stripes_complete(struct video_frame *f);
+int vf_stripes_count(const struct video_frame *f);
+/// @returns first row of stripe idx (tile height for idx equal to the stripe count)
+unsigned int vf_stripe_first_row(const struct video_frame *f, int idx);
+bool vf_stripe_is_complete(struct video_frame *f, int idx);
+/// blocks until stripe idx is complete
+void vf_stripe_wait(struct video_frame *f, int idx);
+/// @}
+
 /** @name Video Flags
  * @deprecated use rather video_frame or video_desc members
  * @{ */
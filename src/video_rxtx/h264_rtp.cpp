@@ -52,9 +52,12 @@
 #include "config_win32.h"
 #endif // HAVE_CONFIG_H
 
+#include <vector>
+
 #include "compat/misc.h"
 #include "host.h"
 #include "lib_common.h"
+#include "messaging.h"
 #include "transmit.h"
 #include "tv.h"
 #include "rtp/rtp.h"
@@ -81,28 +84,97 @@ h264_rtp_video_rxtx::h264_rtp_video_rxtx(std::map<std::string, param_u> const &p
 #endif
 }
 
+/**
+ * With RTSP clients connected, the frame is sent to all playing clients
+ * (packetized once), otherwise to the configured receiver(s).
+ */
 void h264_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 {
-        if (m_connections_count == 1) { /* normal/default case - only one connection */
-            tx_send_h264(m_tx, tx_frame.get(), m_network_devices[0]);
-        } else {
-            //TODO to be tested, the idea is to reply per destiny
-                for (int i = 0; i < m_connections_count; ++i) {
-                    tx_send_h264(m_tx, tx_frame.get(),
-                                        m_network_devices[i]);
+        vector<struct rtp *> sessions;
+        for (auto const &c : m_clients) {
+                if (c.second.playing) {
+                        sessions.push_back(c.second.session);
                 }
         }
+        if (!sessions.empty()) {
+                tx_send_h264_multi(m_tx, tx_frame.get(), sessions.data(), sessions.size());
+        } else if (m_clients.empty()) {
+                tx_send_h264_multi(m_tx, tx_frame.get(), m_network_devices, m_connections_count);
+        }
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // send RTCP (receiver thread would otherwise do this
-                time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
-                rtp_update(m_network_devices[0], curr_time);
-                rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
-
-                // receive RTCP
-                struct timeval timeout;
-                timeout.tv_sec = 0;
-                timeout.tv_usec = 0;
-                rtp_recv_r(m_network_devices[0], &timeout, ts);
+                if (m_clients.empty()) {
+                        send_rtcp(m_network_devices[0]);
+                }
+                for (auto const &c : m_clients) {
+                        send_rtcp(c.second.session);
+                }
+        }
+}
+
+void h264_rtp_video_rxtx::send_rtcp(struct rtp *session)
+{
+        time_ns_t curr_time = get_time_in_ns();
+        uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+        rtp_update(session, curr_time);
+        rtp_send_ctrl(session, ts, 0, curr_time);
+
+        // receive RTCP
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+        rtp_recv_r(session, &timeout, ts);
+}
+
+struct response *h264_rtp_video_rxtx::process_sender_message(struct msg_sender *msg, int *status)
+{
+        switch (msg->type) {
+        case SENDER_MSG_ADD_CLIENT:
+                {
+                        *status = 0;
+                        lock_guard<mutex> lock(m_network_devices_lock);
+                        auto it = m_clients.find(msg->client_id);
+                        if (it != m_clients.end()) {
+                                rtp_done(it->second.session);
+                                m_clients.erase(it);
+                        }
+                        // local port pair is chosen by rtp_init_if (RTCP from the
+                        // client must be received by its session)
+                        struct rtp **devices = initialize_network(msg->client_addr, 0, msg->client_port,
+                                        m_participants, m_force_ip_version, m_requested_mcast_if,
+                                        m_requested_ttl);
+                        if (devices == nullptr) {
+                                log_msg(LOG_LEVEL_ERROR, "[RTSP SERVER] Unable to add client %s:%d.\n",
+                                                msg->client_addr, msg->client_port);
+                                return new_response(RESPONSE_INT_SERV_ERR, nullptr);
+                        }
+                        struct rtp *session = devices[0];
+                        free(devices);
+                        m_clients[msg->client_id] = { session, false };
+                        log_msg(LOG_LEVEL_NOTICE, "[RTSP SERVER] Added client %s:%d (%zu clients).\n",
+                                        msg->client_addr, msg->client_port, m_clients.size());
+                        return new_response(RESPONSE_OK, to_string(rtp_get_udp_rx_port(session)).c_str());
+                }
+        case SENDER_MSG_PLAY_CLIENT:
+        case SENDER_MSG_REMOVE_CLIENT:
+                {
+                        *status = 0;
+                        lock_guard<mutex> lock(m_network_devices_lock);
+                        auto it = m_clients.find(msg->client_id);
+                        if (it == m_clients.end()) {
+                                return new_response(RESPONSE_NOT_FOUND, nullptr);
+                        }
+                        if (msg->type == SENDER_MSG_PLAY_CLIENT) {
+                                it->second.playing = true;
+                        } else {
+                                rtp_done(it->second.session);
+                                m_clients.erase(it);
+                                log_msg(LOG_LEVEL_NOTICE, "[RTSP SERVER] Removed client (%zu clients).\n",
+                                                m_clients.size());
+                        }
+                        return new_response(RESPONSE_OK, nullptr);
+                }
+        default:
+                return rtp_video_rxtx::process_sender_message(msg, status);
         }
 }
 
@@ -112,6 +184,9 @@ h264_rtp_video_rxtx::~h264_rtp_video_rxtx()
         c_stop_server(m_rtsp_server);
         free(m_rtsp_server);
 #endif
+        for (auto const &c : m_clients) {
+                rtp_done(c.second.session);
+        }
 }
 
 static void rtps_server_usage(){
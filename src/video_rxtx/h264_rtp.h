@@ -42,6 +42,8 @@
 #ifndef VIDEO_RXTX_H264_RTP_H_
 #define VIDEO_RXTX_H264_RTP_H_
 
+#include <map>
+
 #include "rtsp/c_basicRTSPOnlyServer.h"
 #include "video_rxtx.h"
 #include "video_rxtx/rtp.h"
@@ -55,6 +57,16 @@ private:
         virtual void *(*get_receiver_thread())(void *arg) {
                 return NULL;
         }
+        struct response *process_sender_message(struct msg_sender *msg, int *status) override;
+        void send_rtcp(struct rtp *session);
+
+        /// RTSP clients (by RTSP session ID), each has own RTP session
+        /// (sequence numbers, SSRC and RTCP)
+        struct rtsp_client {
+                struct rtp *session;
+                bool playing;
+        };
+        std::map<unsigned, rtsp_client> m_clients;
         rtsp_serv_t *m_rtsp_server;
 };
 
@@ -35,8 +35,12 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /**
+ * Compressed frames are passed to the regular video decoder (without RTP),
+ * uncompressed ones are handed over to the display without a copy if it
+ * accepts external frames.
+ *
  * @todo
- * * works only when device can directly display the codec natively
+ * * uncompressed video works only when device can directly display the codec natively
  * * add also audio
  */
 
@@ -53,7 +57,9 @@
 #include "debug.h"
 #include "host.h"
 #include "lib_common.h"
+#include "rtp/video_decoders.h"
 #include "utils/thread.h"
+#include "video_codec.h"
 #include "video_display.h"
 #include "video_frame.h"
 
@@ -69,10 +75,19 @@ loopback_video_rxtx::loopback_video_rxtx(std::map<std::string, param_u> const &p
         : video_rxtx(params)
 {
         m_display_device = static_cast<struct display *>(params.at("display_device").ptr);
+        m_decoder_mode = (enum video_mode) params.at("decoder_mode").l;
+        size_t len = sizeof m_external_frames;
+        if (m_display_device == nullptr ||
+                        !display_ctl_property(m_display_device, DISPLAY_PROPERTY_EXTERNAL_FRAMES, &m_external_frames, &len)) {
+                m_external_frames = false;
+        }
+        const char *drop_policy = get_commandline_param("decoder-drop-policy");
+        m_putf_timeout = drop_policy != nullptr && strcmp(drop_policy, "blocking") == 0 ? PUTF_BLOCKING : PUTF_NONBLOCK;
 }
 
 loopback_video_rxtx::~loopback_video_rxtx()
 {
+        video_decoder_destroy(m_decoder);
 }
 
 void *loopback_video_rxtx::receiver_thread(void *arg)
@@ -94,6 +109,64 @@ void loopback_video_rxtx::send_frame(std::shared_ptr<video_frame> f)
 
 }
 
+static void shared_frame_dispose(struct video_frame *frame)
+{
+        delete static_cast<std::shared_ptr<video_frame> *>(frame->callbacks.dispose_udata);
+        vf_free(frame);
+}
+
+/// @returns read-only reference to the frame data for a display supporting DISPLAY_PROPERTY_EXTERNAL_FRAMES
+static struct video_frame *get_shared_frame(std::shared_ptr<video_frame> const &frame)
+{
+        struct video_frame *ref = vf_alloc_desc(video_desc_from_frame(frame.get()));
+        vf_copy_metadata(ref, frame.get());
+        for (unsigned int i = 0; i < frame->tile_count; ++i) {
+                ref->tiles[i].data = frame->tiles[i].data;
+                ref->tiles[i].data_len = frame->tiles[i].data_len;
+        }
+        ref->callbacks.dispose = shared_frame_dispose;
+        ref->callbacks.dispose_udata = new std::shared_ptr<video_frame>(frame);
+        return ref;
+}
+
+void loopback_video_rxtx::display_uncompressed(std::shared_ptr<video_frame> const &frame)
+{
+        if (m_decoder != nullptr) { // switched from compressed video
+                video_decoder_destroy(m_decoder);
+                m_decoder = nullptr;
+                m_configure_desc = {};
+        }
+        auto new_desc = video_desc_from_frame(frame.get());
+        if (m_configure_desc != new_desc) {
+                if (display_reconfigure(m_display_device, new_desc, VIDEO_NORMAL) == FALSE) {
+                        LOG(LOG_LEVEL_ERROR) << "Unable to reconfigure display!\n";
+                        return;
+                }
+                m_configure_desc = new_desc;
+        }
+        if (m_external_frames) {
+                display_put_frame(m_display_device, get_shared_frame(frame), m_putf_timeout);
+                return;
+        }
+        auto display_f = display_get_frame(m_display_device);
+        memcpy(display_f->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
+        display_put_frame(m_display_device, display_f, m_putf_timeout);
+}
+
+void loopback_video_rxtx::decode_compressed(std::shared_ptr<video_frame> const &frame)
+{
+        if (m_decoder == nullptr) {
+                m_configure_desc = {};
+                m_decoder = video_decoder_init(&m_receiver_mod, m_decoder_mode, m_display_device, nullptr);
+                if (m_decoder == nullptr) {
+                        LOG(LOG_LEVEL_ERROR) << MODULE_NAME << "Unable to create decoder!\n";
+                        exit_uv(EXIT_FAILURE);
+                        return;
+                }
+        }
+        video_decoder_put_frame(m_decoder, frame.get());
+}
+
 void *loopback_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
@@ -107,18 +180,14 @@ void *loopback_video_rxtx::receiver_loop()
                 auto frame = m_frames.front();
                 m_frames.pop();
                 lk.unlock();
-                auto new_desc = video_desc_from_frame(frame.get());
-                if (m_configure_desc != new_desc) {
-                        if (display_reconfigure(m_display_device, new_desc, VIDEO_NORMAL) == FALSE) {
-                                LOG(LOG_LEVEL_ERROR) << "Unable to reconfigure display!\n";
-                                continue;
-                        }
-                        m_configure_desc = new_desc;
+                if (is_codec_opaque(frame->color_spec)) {
+                        decode_compressed(frame);
+                } else {
+                        display_uncompressed(frame);
                 }
-                auto display_f = display_get_frame(m_display_device);
-                memcpy(display_f->tiles[0].data, frame->tiles[0].data, frame->tiles[0].data_len);
-                display_put_frame(m_display_device, display_f, PUTF_BLOCKING);
         }
+        video_decoder_destroy(m_decoder);
+        m_decoder = nullptr;
         display_put_frame(m_display_device, nullptr, PUTF_BLOCKING);
         return nullptr;
 }
@@ -47,6 +47,7 @@
 #include "video_rxtx.h"
 
 struct display;
+struct state_video_decoder;
 
 class loopback_video_rxtx : public video_rxtx {
 public:
@@ -57,9 +58,15 @@ private:
         static void *receiver_thread(void *arg);
         virtual void send_frame(std::shared_ptr<video_frame>) override;
         void *receiver_loop();
+        void display_uncompressed(std::shared_ptr<video_frame> const &frame);
+        void decode_compressed(std::shared_ptr<video_frame> const &frame);
         virtual void *(*get_receiver_thread())(void *arg) override;
 
         struct display *m_display_device;
+        enum video_mode m_decoder_mode;
+        bool m_external_frames = false; ///< display accepts frames not from getf() (DISPLAY_PROPERTY_EXTERNAL_FRAMES)
+        long long m_putf_timeout;
+        struct state_video_decoder *m_decoder = nullptr; ///< created for compressed frames
         struct video_desc m_configure_desc{};
         std::queue<std::shared_ptr<video_frame>> m_frames;
         std::condition_variable m_frame_ready;
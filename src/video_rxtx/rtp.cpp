@@ -66,6 +66,7 @@
 #include "transmit.h"
 #include "tv.h"
 #include "ug_runtime_error.hpp"
+#include "utils/macros.h"
 #include "utils/net.h" // IN6_BLACKHOLE_STR
 #include "utils/vf_split.h"
 #include "video.h"
@@ -76,6 +77,19 @@
 
 using namespace std;
 
+/// applies the FEC configuration deferred by process_sender_message() once it is prepared
+void rtp_video_rxtx::apply_pending_fec()
+{
+        if (m_pending_fec_cfg.empty() || !fec::prepare_config(m_pending_fec_cfg.c_str())) {
+                return;
+        }
+        auto *msg = (struct msg_sender *) new_message(sizeof(struct msg_sender));
+        msg->type = SENDER_MSG_CHANGE_FEC;
+        snprintf(msg->fec_cfg, sizeof msg->fec_cfg, "%s", m_pending_fec_cfg.c_str());
+        int status = 0;
+        free_message((struct message *) msg, process_sender_message(msg, &status));
+}
+
 struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg, int *status)
 {
         *status = 0;
@@ -149,6 +163,13 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
                         }
                 case SENDER_MSG_CHANGE_FEC:
                         {
+                                if (m_frames_sent > 0 && strcmp(msg->fec_cfg, "flush") != 0
+                                                && !fec::prepare_config(msg->fec_cfg)) {
+                                        // keep the current FEC until the new state is prepared in background
+                                        m_pending_fec_cfg = msg->fec_cfg;
+                                        return new_response(RESPONSE_ACCEPTED, NULL);
+                                }
+                                m_pending_fec_cfg.clear();
                                 lock_guard<mutex> lock(m_network_devices_lock);
                                 auto old_fec_state = m_fec_state;
                                 m_fec_state = NULL;
@@ -200,8 +221,22 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
                                 }
                         }
                         break;
+                case SENDER_MSG_SET_PARAM:
+                        {
+                                char key[64];
+                                char val[1024];
+                                if (sscanf(msg->param, "%63s %1023[^\n]", key, val) != 2) {
+                                        return new_response(RESPONSE_BAD_REQUEST, "expected <key> <value>");
+                                }
+                                lock_guard<mutex> lock(m_network_devices_lock);
+                                struct response *r = set_network_param(key, val);
+                                return r != nullptr ? r : new_response(RESPONSE_NOT_FOUND, "unknown sender parameter");
+                        }
                 case SENDER_MSG_GET_STATUS:
                 case SENDER_MSG_MUTE:
+                case SENDER_MSG_ADD_CLIENT:
+                case SENDER_MSG_PLAY_CLIENT:
+                case SENDER_MSG_REMOVE_CLIENT:
                         log_msg(LOG_LEVEL_ERROR, "Unexpected message!\n");
                         break;
         }
@@ -209,6 +244,41 @@ struct response *rtp_video_rxtx::process_sender_message(struct msg_sender *msg,
         return new_response(RESPONSE_OK, NULL);
 }
 
+/**
+ * Applies a network parameter to the running sessions (control socket
+ * "set-param" command). The values are lost when the network is
+ * reinitialized (eg. port change).
+ *
+ * @note m_network_devices_lock must be held
+ * @returns response, nullptr if key is not a network parameter
+ */
+struct response *rtp_video_rxtx::set_network_param(const char *key, const char *val)
+{
+        bool ok = true;
+        const long long num = strtoll(val, nullptr, 0);
+        if (strcmp(key, "recv-buf") == 0) {
+                for (int i = 0; m_network_devices[i] != nullptr; ++i) {
+                        ok = rtp_set_recv_buf(m_network_devices[i], num) && ok;
+                }
+        } else if (strcmp(key, "send-buf") == 0) {
+                for (int i = 0; m_network_devices[i] != nullptr; ++i) {
+                        ok = rtp_set_send_buf(m_network_devices[i], num) && ok;
+                }
+        } else if (strcmp(key, "udp-queue-len") == 0) {
+                for (int i = 0; m_network_devices[i] != nullptr; ++i) {
+                        ok = num > 0 && rtp_set_recv_queue_len(m_network_devices[i], num) && ok;
+                }
+        } else {
+                return nullptr;
+        }
+        if (!ok) {
+                log_msg(LOG_LEVEL_ERROR, "[control] Unable to set %s to %s.\n", key, val);
+                return new_response(RESPONSE_INT_SERV_ERR, nullptr);
+        }
+        log_msg(LOG_LEVEL_NOTICE, "[control] %s set to %s.\n", key, val);
+        return new_response(RESPONSE_OK, nullptr);
+}
+
 rtp_video_rxtx::rtp_video_rxtx(map<string, param_u> const &params) :
         video_rxtx(params), m_fec_state(NULL), m_start_time(params.at("start_time").ll), m_video_desc{}
 {
@@ -288,6 +358,55 @@ void rtp_video_rxtx::display_buf_increase_warning(int size)
 
 }
 
+#define DEFAULT_NACK_CACHE_PACKETS 4096
+ADD_TO_PARAM("rtp-nack",
+                "* rtp-nack[=<packets>]\n"
+                "  Request retransmission of lost video packets with RTCP NACK (receiver), keep last <packets>\n"
+                "  sent packets for retransmission (sender, default " TOSTRING(DEFAULT_NACK_CACHE_PACKETS) ").\n"
+                "  Should be set on both sides, playout delay should be longer than RTT.\n");
+ADD_TO_PARAM("rtcp-interval",
+                "* rtcp-interval=<ms>\n"
+                "  Minimal interval between RTCP reports (default 5000 ms), shorter interval gives\n"
+                "  faster feedback to the sender rate control (tx-rate-control).\n");
+ADD_TO_PARAM("rtp-redundant",
+                "* rtp-redundant=<addr>[@<iface>][,<addr2>[@<iface2>]...]\n"
+                "  Send video also over a second network path to <addr> and merge the streams received\n"
+                "  over both paths (hitless protection like SMPTE 2022-7), one item per video connection.\n"
+                "  Should be set on both sides, <addr> is the peer address on the second network\n"
+                "  (or the multicast group of the second path).\n");
+/**
+ * Adds the redundant path of the index-th connection given by the
+ * rtp-redundant parameter (if any).
+ */
+static bool add_redundant_path(struct rtp *device, int index, int recv_port, int send_port,
+                int ttl, int force_ip_version)
+{
+        const char *cfg = get_commandline_param("rtp-redundant");
+        if (cfg == nullptr) {
+                return true;
+        }
+        string item;
+        istringstream iss(cfg);
+        for (int i = 0; i <= index; ++i) {
+                if (!getline(iss, item, ',')) {
+                        return true;
+                }
+        }
+        string iface;
+        if (size_t pos = item.find('@'); pos != string::npos) {
+                iface = item.substr(pos + 1);
+                item.resize(pos);
+        }
+        if (!rtp_add_redundant_path(device, item.c_str(), iface.empty() ? nullptr : iface.c_str(),
+                                recv_port, send_port, ttl, force_ip_version)) {
+                log_msg(LOG_LEVEL_ERROR, "Cannot add redundant path %s!\n", item.c_str());
+                return false;
+        }
+        log_msg(LOG_LEVEL_NOTICE, "Using redundant path %s%s%s.\n", item.c_str(),
+                        iface.empty() ? "" : " over ", iface.c_str());
+        return true;
+}
+
 struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port_base,
                 int send_port_base, struct pdb *participants, int force_ip_version,
                 const char *mcast_if, int ttl)
@@ -337,6 +456,11 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
                                 send_port, ttl, rtcp_bw, FALSE,
                                 rtp_recv_callback, (uint8_t *)participants,
                                 force_ip_version, multithreaded);
+                if (devices[index] != nullptr && !add_redundant_path(devices[index], index,
+                                        recv_port, send_port, ttl, force_ip_version)) {
+                        rtp_done(devices[index]);
+                        devices[index] = nullptr;
+                }
                 if (devices[index] == nullptr) {
                         int index_nest;
                         for(index_nest = 0; index_nest < index; ++index_nest) {
@@ -366,6 +490,18 @@ struct rtp **rtp_video_rxtx::initialize_network(const char *addrs, int recv_port
 
                 rtp_set_send_buf(devices[index], INITIAL_VIDEO_SEND_BUFFER_SIZE);
 
+                if (const char *nack = get_commandline_param("rtp-nack")) {
+                        int packets = strlen(nack) > 0 ? atoi(nack) : DEFAULT_NACK_CACHE_PACKETS;
+                        if (packets <= 0 || !rtp_enable_nack(devices[index], packets)) {
+                                log_msg(LOG_LEVEL_WARNING, "Cannot enable retransmissions for %s (cache: %s)\n",
+                                                addr, nack);
+                        }
+                }
+
+                if (const char *interval = get_commandline_param("rtcp-interval")) {
+                        rtp_set_rtcp_min_interval(devices[index], atof(interval) / MS_IN_SEC_DBL);
+                }
+
                 pdb_add(participants, rtp_my_ssrc(devices[index]));
         }
         if(devices != NULL) devices[index] = NULL;
@@ -68,6 +68,10 @@ public:
         static void display_buf_increase_warning(int size);
 
 protected:
+        struct response *process_sender_message(struct msg_sender *i, int *status) override;
+        struct response *set_network_param(const char *key, const char *val);
+        void apply_pending_fec();
+
         int m_connections_count;
         struct rtp **m_network_devices; // ULTRAGRID_RTP
         std::mutex m_network_devices_lock;
@@ -80,10 +84,9 @@ protected:
         const char      *m_requested_mcast_if;
         int              m_requested_ttl;
         fec             *m_fec_state;
+        std::string      m_pending_fec_cfg; ///< FEC config waiting for fec::prepare_config() (sender thread)
         time_ns_t        m_start_time;
         video_desc       m_video_desc;
-private:
-        struct response *process_sender_message(struct msg_sender *i, int *status);
 };
 
 #endif // VIDEO_RXTX_RTP_H_
@@ -0,0 +1,311 @@
+/**
+ * @file   video_rxtx/simulcast.cpp
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif // HAVE_CONFIG_H
+
+#include "video_rxtx/simulcast.h"
+
+#include <cstring>
+#include <string>
+
+#include "debug.h"
+#include "host.h"
+#include "lib_common.h"
+#include "ug_runtime_error.hpp"
+#include "utils/color_out.h"
+#include "utils/macros.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+#include "video_frame.h"
+
+#define MOD_NAME "[simulcast] "
+
+using std::map;
+using std::shared_ptr;
+using std::string;
+using std::to_string;
+
+static void usage() {
+        color_printf("Simulcast sends the captured video as multiple independently compressed streams.\n\n");
+        color_printf("Usage:\n\t" TBOLD("-x V:simulcast:<rung>[#<rung>...]") "\n");
+        color_printf("where " TBOLD("<rung>") " is:\n\t" TBOLD("[div=<n>,][port=<p>,]<compression>") "\n\n");
+        color_printf("\t" TBOLD("div") "  - downscale factor (power of 2, default 1); supported for UYVY, YUYV, RGB, RGBA and BGR input\n");
+        color_printf("\t" TBOLD("port") " - destination port (default base port + 2 * rung index)\n\n");
+        color_printf("Example:\n\t" TBOLD("uv -t testcard:size=3840x2160 -x 'V:simulcast:libavcodec:codec=HEVC#div=2,libavcodec:codec=H.264#div=4,libavcodec:codec=H.264' <host>") "\n\n");
+        color_printf("Option " TBOLD("-c") " is ignored in this mode.\n");
+}
+
+/// @returns copy of params with compression overridden (frames are passed raw to send_frame())
+static map<string, param_u> uncompressed_params(map<string, param_u> const &params) {
+        auto ret = params;
+        ret["compression"].str = "none";
+        return ret;
+}
+
+simulcast_video_rxtx::simulcast_video_rxtx(map<string, param_u> const &params)
+        : video_rxtx(uncompressed_params(params))
+{
+        const char *opts = params.at("opts").str;
+        if (strcmp(opts, "help") == 0) {
+                usage();
+                throw ug_no_error();
+        }
+        if (strlen(opts) == 0) {
+                usage();
+                throw ug_runtime_error(MOD_NAME "No rung given!");
+        }
+
+        int base_port = params.at("tx_port").i;
+        string cfg = opts;
+        size_t pos = 0;
+        for (int idx = 0; pos != string::npos; ++idx) {
+                size_t end = cfg.find('#', pos);
+                string item = cfg.substr(pos, end == string::npos ? string::npos : end - pos);
+                pos = end == string::npos ? end : end + 1;
+
+                int div = 1;
+                int port = base_port + 2 * idx;
+                for (bool key_found = true; key_found; ) {
+                        key_found = false;
+                        for (const char *key : {"div=", "port="}) {
+                                if (item.compare(0, strlen(key), key) != 0) {
+                                        continue;
+                                }
+                                size_t comma = item.find(',');
+                                int val = stoi(item.substr(strlen(key), comma - strlen(key)));
+                                (strcmp(key, "div=") == 0 ? div : port) = val;
+                                item = comma == string::npos ? string() : item.substr(comma + 1);
+                                key_found = true;
+                        }
+                }
+                if (div < 1 || (div & (div - 1)) != 0) {
+                        throw ug_runtime_error(MOD_NAME "Scale denominator must be a power of 2, got " + to_string(div));
+                }
+                if (item.empty()) {
+                        throw ug_runtime_error(MOD_NAME "Missing compression for rung " + to_string(idx));
+                }
+
+                auto rung_params = params;
+                rung_params["compression"].str = item.c_str(); // copied by compress_init()
+                rung_params["rxtx_mode"].i = MODE_SENDER;
+                rung_params["tx_port"].i = port;
+                rung_params["rx_port"].i = port;
+                rung_params["display_device"].ptr = nullptr;
+                rung_params["opts"].str = "";
+                video_rxtx *rxtx = video_rxtx::create("ultragrid_rtp", rung_params);
+                if (rxtx == nullptr) {
+                        throw ug_runtime_error(MOD_NAME "Cannot create sender for rung " + to_string(idx));
+                }
+                string host = params.at("receiver").str;
+                rxtx->m_port_id = (host.find(':') != string::npos ? "[" + host + "]" : host) + ":" + to_string(port);
+                m_rungs.push_back({div, std::unique_ptr<video_rxtx>(rxtx)});
+                LOG(LOG_LEVEL_INFO) << MOD_NAME "Rung " << idx << ": " << item << ", scale 1/" << div << " -> " << rxtx->m_port_id << "\n";
+
+                int levels = 0;
+                while ((1 << levels) < div) {
+                        levels += 1;
+                }
+                if ((int) m_pyramid.size() < levels) {
+                        m_pyramid.resize(levels);
+                }
+        }
+}
+
+simulcast_video_rxtx::~simulcast_video_rxtx()
+{
+        join();
+}
+
+void simulcast_video_rxtx::join()
+{
+        video_rxtx::join(); // no more send_frame() calls after this
+        for (auto &r : m_rungs) {
+                r.rxtx->join();
+        }
+}
+
+/**
+ * Halves both dimensions by averaging 2x2 pixel blocks.
+ *
+ * 4:2:2 formats are processed in 2-pixel macropixels - each output macropixel
+ * is computed from 2 input macropixels on 2 lines.
+ */
+static bool downscale_half(const struct video_frame *in, struct video_frame *out)
+{
+        codec_t c = in->color_spec;
+        const int in_linesize = vc_get_linesize(in->tiles[0].width, c);
+        const int out_linesize = vc_get_linesize(out->tiles[0].width, c);
+        const unsigned char *src = (const unsigned char *) in->tiles[0].data;
+        unsigned char *dst = (unsigned char *) out->tiles[0].data;
+
+        if (c == UYVY || c == YUYV) {
+                const int y_off = c == UYVY ? 1 : 0;
+                const int uv_off = 1 - y_off;
+                for (unsigned y = 0; y < out->tiles[0].height; ++y) {
+                        const unsigned char *l0 = src + 2 * y * in_linesize;
+                        const unsigned char *l1 = l0 + in_linesize;
+                        unsigned char *d = dst + y * out_linesize;
+                        for (unsigned x = 0; x < out->tiles[0].width / 2; ++x) {
+                                const unsigned char *a0 = l0 + 8 * x;
+                                const unsigned char *a1 = l1 + 8 * x;
+                                d[uv_off] = (a0[uv_off] + a0[uv_off + 4] + a1[uv_off] + a1[uv_off + 4] + 2) / 4;
+                                d[uv_off + 2] = (a0[uv_off + 2] + a0[uv_off + 6] + a1[uv_off + 2] + a1[uv_off + 6] + 2) / 4;
+                                d[y_off] = (a0[y_off] + a0[y_off + 2] + a1[y_off] + a1[y_off + 2] + 2) / 4;
+                                d[y_off + 2] = (a0[y_off + 4] + a0[y_off + 6] + a1[y_off + 4] + a1[y_off + 6] + 2) / 4;
+                                d += 4;
+                        }
+                }
+                return true;
+        }
+        if (c == RGB || c == RGBA || c == BGR) {
+                const int bpp = get_pf_block_bytes(c);
+                for (unsigned y = 0; y < out->tiles[0].height; ++y) {
+                        const unsigned char *l0 = src + 2 * y * in_linesize;
+                        const unsigned char *l1 = l0 + in_linesize;
+                        unsigned char *d = dst + y * out_linesize;
+                        for (unsigned x = 0; x < out->tiles[0].width; ++x) {
+                                for (int i = 0; i < bpp; ++i) {
+                                        *d++ = (l0[i] + l0[bpp + i] + l1[i] + l1[bpp + i] + 2) / 4;
+                                }
+                                l0 += 2 * bpp;
+                                l1 += 2 * bpp;
+                        }
+                }
+                return true;
+        }
+        return false;
+}
+
+/**
+ * @returns frame downscaled to 1/div, computed from the next larger pyramid level
+ * (levels are computed lazily once per frame), nullptr if unsupported
+ */
+shared_ptr<video_frame> simulcast_video_rxtx::get_scaled(shared_ptr<video_frame> const &frame, int div)
+{
+        if (div == 1) {
+                return frame;
+        }
+        int level = 0;
+        while ((2 << level) < div) {
+                level += 1;
+        }
+        auto &l = m_pyramid.at(level);
+        if (l.frame) {
+                return l.frame;
+        }
+        auto parent = get_scaled(frame, div / 2);
+        if (!parent) {
+                return {};
+        }
+        struct video_desc desc = video_desc_from_frame(parent.get());
+        desc.width = desc.width / 2;
+        if (get_pf_block_pixels(desc.color_spec) == 2) {
+                desc.width &= ~1U;
+        }
+        desc.height /= 2;
+        if (desc.tile_count != 1 || desc.width == 0 || desc.height == 0) {
+                return {};
+        }
+        if (!video_desc_eq(l.desc, desc)) {
+                l.pool->reconfigure(desc, vc_get_linesize(desc.width, desc.color_spec) * desc.height);
+                l.desc = desc;
+        }
+        auto out = l.pool->get_frame();
+        if (!downscale_half(parent.get(), out.get())) {
+                return {};
+        }
+        vf_copy_metadata(out.get(), parent.get());
+        l.frame = out;
+        return out;
+}
+
+namespace {
+struct rung_send_data {
+        video_rxtx *rxtx;
+        shared_ptr<video_frame> frame;
+};
+}
+
+static void *rung_send(void *arg) {
+        auto *d = static_cast<rung_send_data *>(arg);
+        d->rxtx->send(std::move(d->frame));
+        return d;
+}
+
+void simulcast_video_rxtx::send_frame(shared_ptr<video_frame> frame)
+{
+        for (auto &l : m_pyramid) {
+                l.frame = nullptr;
+        }
+
+        // compression of the rungs may be synchronous, run them concurrently
+        std::vector<rung_send_data> data(m_rungs.size());
+        std::vector<task_result_handle_t> handles(m_rungs.size());
+        for (unsigned i = 0; i < m_rungs.size(); ++i) {
+                data[i].rxtx = m_rungs[i].rxtx.get();
+                data[i].frame = get_scaled(frame, m_rungs[i].div);
+                if (!data[i].frame) {
+                        log_msg_once(LOG_LEVEL_ERROR, to_fourcc('S', 'I', 'M', 'C'), MOD_NAME "Cannot downscale %s frame (%u tile(s)), "
+                                        "rung %u not sent!\n", get_codec_name(frame->color_spec), frame->tile_count, i);
+                        continue;
+                }
+                handles[i] = task_run_async(rung_send, &data[i]);
+        }
+        for (unsigned i = 0; i < m_rungs.size(); ++i) {
+                if (handles[i] != nullptr) {
+                        wait_task(handles[i]);
+                }
+        }
+        for (auto &l : m_pyramid) {
+                l.frame = nullptr;
+        }
+}
+
+static video_rxtx *create_video_rxtx_simulcast(map<string, param_u> const &params)
+{
+        return new simulcast_video_rxtx(params);
+}
+
+static const struct video_rxtx_info simulcast_video_rxtx_info = {
+        "Simulcast (multiple compressions over UltraGrid RTP)",
+        create_video_rxtx_simulcast
+};
+
+REGISTER_MODULE(simulcast, &simulcast_video_rxtx_info, LIBRARY_CLASS_VIDEO_RXTX, VIDEO_RXTX_ABI_VERSION);
@@ -0,0 +1,78 @@
+/**
+ * @file   video_rxtx/simulcast.h
+ */
+/*
+ * Copyright (c) 2026 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef VIDEO_RXTX_SIMULCAST_H_
+#define VIDEO_RXTX_SIMULCAST_H_
+
+#include <memory>
+#include <vector>
+
+#include "utils/video_frame_pool.h"
+#include "video_rxtx.h"
+
+/**
+ * Sends one captured stream as several independently compressed renditions
+ * ("rungs"), each with own compression, scale and UltraGrid RTP session.
+ * Downscaled frames are computed once per frame as a pyramid of 1/2 steps
+ * shared by all rungs.
+ */
+class simulcast_video_rxtx : public video_rxtx {
+public:
+        simulcast_video_rxtx(std::map<std::string, param_u> const &);
+        virtual ~simulcast_video_rxtx();
+        virtual void join() override;
+
+private:
+        struct rung {
+                int div; ///< scale denominator, power of 2
+                std::unique_ptr<video_rxtx> rxtx;
+        };
+        virtual void send_frame(std::shared_ptr<video_frame>) override;
+        virtual void *(*get_receiver_thread())(void *arg) override {
+                return nullptr;
+        }
+        struct pyramid_level {
+                std::unique_ptr<video_frame_pool> pool{std::make_unique<video_frame_pool>()};
+                struct video_desc desc{};
+                std::shared_ptr<video_frame> frame; ///< current frame scaled to 1/2^(level+1)
+        };
+        std::shared_ptr<video_frame> get_scaled(std::shared_ptr<video_frame> const &frame, int div);
+
+        std::vector<pyramid_level> m_pyramid; ///< destroyed after m_rungs (may hold pool frames)
+        std::vector<rung> m_rungs;
+};
+
+#endif // VIDEO_RXTX_SIMULCAST_H_
@@ -64,6 +64,9 @@
 #include "tfrc.h"
 #include "transmit.h"
 #include "tv.h"
+#include "utils/alloc_stats.h"
+#include "utils/av_sync.h"
+#include "utils/pipeline_stats.h"
 #include "utils/thread.h"
 #include "utils/vf_split.h"
 #include "video.h"
@@ -75,12 +78,22 @@
 #include "ug_runtime_error.hpp"
 #include "utils/worker.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <sstream>
 #include <utility>
 
+#define MAX_AUTO_RECV_BUF_SIZE (512 * 1024 * 1024)
+#define MAX_SEND_QUEUE_DEPTH 16
+
 using namespace std;
 
+ADD_TO_PARAM("tx-queue", "* tx-queue=<n>\n"
+                "  Video frames that may be in flight between compression and network (default 1 - compression\n"
+                "  waits until the previous frame is sent), oversized frames (keyframes) are then paced over up to <n>\n"
+                "  frame intervals\n");
+
 ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &params) :
         rtp_video_rxtx(params), m_send_bytes_total(0)
 {
@@ -88,6 +101,13 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         m_display_device = (struct display *) params.at("display_device").ptr;
         m_requested_encryption = (const char *) params.at("encryption").ptr;
         m_async_sending = false;
+        if (const char *depth = get_commandline_param("tx-queue")) {
+                m_send_queue_depth = atoi(depth);
+                if (m_send_queue_depth < 1 || m_send_queue_depth > MAX_SEND_QUEUE_DEPTH) {
+                        throw ug_runtime_error("tx-queue must be in range 1-" + to_string(MAX_SEND_QUEUE_DEPTH), EXIT_FAIL_USAGE);
+                }
+                tx_set_max_frame_spread(m_tx, m_send_queue_depth);
+        }
 
         if (get_commandline_param("decoder-use-codec") != nullptr && "help"s == get_commandline_param("decoder-use-codec")) {
                 destroy_video_decoder(new_video_decoder(m_display_device));
@@ -95,6 +115,8 @@ ultragrid_rtp_video_rxtx::ultragrid_rtp_video_rxtx(const map<string, param_u> &p
         }
 
         m_control = (struct control_state *) get_module(get_root_module(static_cast<struct module *>(params.at("parent").ptr)), "control");
+        m_fec_stage = pipeline_stage_get(static_cast<struct module *>(params.at("parent").ptr), "fec_encode");
+        m_tx_stage = pipeline_stage_get(static_cast<struct module *>(params.at("parent").ptr), "tx");
 }
 
 ultragrid_rtp_video_rxtx::~ultragrid_rtp_video_rxtx()
@@ -123,24 +145,38 @@ void *(*ultragrid_rtp_video_rxtx::get_receiver_thread())(void *arg) {
 void ultragrid_rtp_video_rxtx::send_frame(shared_ptr<video_frame> tx_frame)
 {
         m_video_desc = video_desc_from_frame(tx_frame.get());
+        apply_pending_fec();
         if (m_fec_state) {
+                pipeline_stage_timer busy(m_fec_stage);
                 tx_frame = m_fec_state->encode(tx_frame);
         }
 
-        auto data = new pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>>(this, tx_frame);
-
         unique_lock<mutex> lk(m_async_sending_lock);
-        m_async_sending_cv.wait(lk, [this]{return !m_async_sending;});
-        m_async_sending = true;
-        task_run_async_detached(ultragrid_rtp_video_rxtx::send_frame_async_callback,
-                        (void *) data);
+        m_async_sending_cv.wait(lk, [this]{return m_send_in_flight < m_send_queue_depth;});
+        m_send_queue.push_back(std::move(tx_frame));
+        m_send_in_flight += 1;
+        if (!m_async_sending) {
+                m_async_sending = true;
+                task_run_async_detached(ultragrid_rtp_video_rxtx::send_frame_async_callback,
+                                (void *) this);
+        }
 }
 
+/// sends the queued frames in order until the queue is drained
 void *ultragrid_rtp_video_rxtx::send_frame_async_callback(void *arg) {
-        auto data = (pair<ultragrid_rtp_video_rxtx *, shared_ptr<video_frame>> *) arg;
-
-        data->first->send_frame_async(data->second);
-        delete data;
+        auto *s = (ultragrid_rtp_video_rxtx *) arg;
+
+        unique_lock<mutex> lk(s->m_async_sending_lock);
+        while (!s->m_send_queue.empty()) {
+                shared_ptr<video_frame> frame = std::move(s->m_send_queue.front());
+                s->m_send_queue.pop_front();
+                lk.unlock();
+                s->send_frame_async(std::move(frame));
+                lk.lock();
+        }
+        s->m_async_sending = false;
+        lk.unlock();
+        s->m_async_sending_cv.notify_all();
 
         return NULL;
 }
@@ -149,6 +185,7 @@ void *ultragrid_rtp_video_rxtx::send_frame_async_callback(void *arg) {
 void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame)
 {
         lock_guard<mutex> lock(m_network_devices_lock);
+        pipeline_stage_timer busy(m_tx_stage);
 
         if (m_paused) {
                 goto after_send;
@@ -171,9 +208,16 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                 vf_free(split_frames);
         }
 
+        if (tx_frame->compress_start != 0 && tx_frame->compress_end != 0) {
+                m_compress_latency.add((time_ns_t) (tx_frame->compress_end - tx_frame->compress_start) * NS_IN_MS);
+                m_compress_latency.report(m_control);
+                m_tx_latency.add(get_time_in_ns() - (time_ns_t) tx_frame->compress_end * NS_IN_MS);
+                m_tx_latency.report(m_control);
+        }
+
         if ((m_rxtx_mode & MODE_RECEIVER) == 0) { // otherwise receiver thread does the stuff...
                 time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (curr_time - m_start_time) / 100'000 * 9; // at 90000 Hz
+                uint32_t ts = get_local_mediatime(); // same clock as RTP data
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
 
@@ -183,15 +227,130 @@ void ultragrid_rtp_video_rxtx::send_frame_async(shared_ptr<video_frame> tx_frame
                         struct timeval timeout { 0, 0 };
                         rc = rtcp_recv_r(m_network_devices[0], &timeout, ts);
                 } while (!m_should_exit && rc == TRUE);
+                rtp_retransmit_nacked(m_network_devices[0]);
         }
+        handle_keyframe_requests(tx_frame->color_spec);
+        handle_viewport_reports();
 
 after_send:
+        busy.done();
         m_async_sending_lock.lock();
-        m_async_sending = false;
+        m_send_in_flight -= 1;
         m_async_sending_lock.unlock();
         m_async_sending_cv.notify_all();
 }
 
+/**
+ * Asks the compression for a keyframe if a receiver requested it with RTCP
+ * PLI (eg. its decoder has just started). Requests are coalesced so that
+ * multiple receivers do not trigger a flood of keyframes.
+ *
+ * Called with m_network_devices_lock held.
+ */
+void ultragrid_rtp_video_rxtx::handle_keyframe_requests(codec_t compressed_codec)
+{
+        constexpr time_ns_t MIN_KEYFRAME_INTERVAL = 100 * NS_IN_MS;
+        bool requested = false;
+        for (int i = 0; i < m_connections_count; ++i) {
+                requested = rtp_pli_received(m_network_devices[i]) || requested;
+        }
+        const time_ns_t now = get_time_in_ns();
+        if (!requested || !is_codec_interframe(compressed_codec)
+                        || now - m_last_keyframe_request < MIN_KEYFRAME_INTERVAL) {
+                return;
+        }
+        m_last_keyframe_request = now;
+        auto *msg = (struct msg_change_compress_data *)
+                new_message(sizeof(struct msg_change_compress_data));
+        msg->what = CHANGE_PARAMS;
+        snprintf(msg->config_string, sizeof msg->config_string, "keyframe");
+        free_response(send_message(get_root_module(&m_sender_mod), "sender.compress", (struct message *) msg));
+        log_msg(LOG_LEVEL_VERBOSE, "[video rxtx] Receiver requested a keyframe.\n");
+}
+
+/**
+ * Forwards the viewport reported by a 360° receiver to the capture filter
+ * viewport that encodes the tiles outside of it in lower quality. If more
+ * receivers report, the last one wins.
+ *
+ * Called with m_network_devices_lock held.
+ */
+void ultragrid_rtp_video_rxtx::handle_viewport_reports()
+{
+        struct video_viewport viewport{};
+        bool received = false;
+        for (int i = 0; i < m_connections_count; ++i) {
+                received = rtp_viewport_received(m_network_devices[i], &viewport) || received;
+        }
+        if (!received) {
+                return;
+        }
+        auto *msg = (struct msg_universal *) new_message(sizeof(struct msg_universal));
+        snprintf(msg->text, sizeof msg->text, "viewport %f %f %f %f", viewport.yaw, viewport.pitch,
+                        viewport.fov_h, viewport.fov_v);
+        struct response *r = send_message(get_root_module(&m_sender_mod), "capture.filter.data[viewport]", (struct message *) msg);
+        if (response_get_status(r) == RESPONSE_NOT_FOUND && !m_viewport_warned) {
+                log_msg(LOG_LEVEL_WARNING, "[video rxtx] Receiver reports its viewport but capture filter viewport is not used.\n");
+                m_viewport_warned = true;
+        }
+        free_response(r);
+}
+
+/**
+ * Sends the viewport of a 360° display to the sender if it has changed and
+ * periodically, so that a lost report is eventually recovered.
+ *
+ * Called from the receiver thread.
+ */
+void ultragrid_rtp_video_rxtx::report_viewport(struct state_video_decoder *decoder, uint32_t ssrc, time_ns_t now)
+{
+        constexpr time_ns_t MIN_INTERVAL = 50 * NS_IN_MS;
+        constexpr time_ns_t REFRESH_INTERVAL = NS_IN_SEC;
+        constexpr float MIN_CHANGE = 1.0F; // degrees
+        struct video_viewport viewport{};
+        if (now - m_viewport_sent < MIN_INTERVAL || !video_decoder_get_viewport(decoder, &viewport)) {
+                return;
+        }
+        const bool changed = fabsf(viewport.yaw - m_viewport.yaw) >= MIN_CHANGE
+                || fabsf(viewport.pitch - m_viewport.pitch) >= MIN_CHANGE
+                || fabsf(viewport.fov_h - m_viewport.fov_h) >= MIN_CHANGE
+                || fabsf(viewport.fov_v - m_viewport.fov_v) >= MIN_CHANGE;
+        if (!changed && now - m_viewport_sent < REFRESH_INTERVAL) {
+                return;
+        }
+        rtp_send_viewport(m_network_devices[0], ssrc, &viewport);
+        m_viewport = viewport;
+        m_viewport_sent = now;
+}
+
+/**
+ * Applies "<key> <value>" received by the control socket command
+ * "set-param receiver". Called from receiver thread with
+ * m_network_devices_lock held.
+ */
+struct response *ultragrid_rtp_video_rxtx::set_receiver_param(const char *param)
+{
+        char key[64];
+        char val[1024];
+        if (sscanf(param, "%63s %1023[^\n]", key, val) != 2) {
+                return new_response(RESPONSE_BAD_REQUEST, "expected <key> <value>");
+        }
+        if (strcmp(key, "playout-delay") == 0) {
+                m_playout_delay = atof(val) / 1000.0;
+                pdb_iter_t it;
+                struct pdb_e *cp = pdb_iter_init(m_participants, &it);
+                while (cp) {
+                        pbuf_set_playout_delay(cp->playout_buffer, m_playout_delay);
+                        cp = pdb_iter_next(&it);
+                }
+                pdb_iter_done(&it);
+                log_msg(LOG_LEVEL_NOTICE, "[control] Playout delay set to %s ms.\n", val);
+                return new_response(RESPONSE_OK, nullptr);
+        }
+        struct response *r = set_network_param(key, val);
+        return r != nullptr ? r : new_response(RESPONSE_NOT_FOUND, "unknown receiver parameter");
+}
+
 void ultragrid_rtp_video_rxtx::receiver_process_messages()
 {
         struct msg_receiver *msg;
@@ -217,23 +376,29 @@ void ultragrid_rtp_video_rxtx::receiver_process_messages()
                                         m_recv_port_number = old_port;
                                 } else {
                                         log_msg(LOG_LEVEL_NOTICE, "[control] Changed RX port to %d\n", msg->new_rx_port);
+                                        set_decoders_direct_recv(m_network_devices[0]);
                                         destroy_rtp_devices(old_devices);
                                 }
                                 break;
                         }
                 case RECEIVER_MSG_VIDEO_PROP_CHANGED:
                         {
+                                m_stream_fps = msg->new_desc.fps;
                                 pdb_iter_t it;
                                 /// @todo should be set only to relevant participant, not all
                                 struct pdb_e *cp = pdb_iter_init(m_participants, &it);
                                 while (cp) {
                                         pbuf_set_playout_delay(cp->playout_buffer,
-                                                        1.0 / msg->new_desc.fps);
+                                                        m_playout_delay >= 0.0 ? m_playout_delay : 1.0 / msg->new_desc.fps);
 
                                         cp = pdb_iter_next(&it);
                                 }
+                                pdb_iter_done(&it);
                         }
                         break;
+                case RECEIVER_MSG_SET_PARAM:
+                        r = set_receiver_param(msg->param);
+                        break;
                 default:
                         assert(0 && "Wrong message passed to ultragrid_rtp_video_rxtx::receiver_process_messages()");
                 }
@@ -242,6 +407,26 @@ void ultragrid_rtp_video_rxtx::receiver_process_messages()
         }
 }
 
+/**
+ * Moves direct reception to framebuffer of decoders to session (NULL to
+ * disable it).
+ */
+void ultragrid_rtp_video_rxtx::set_decoders_direct_recv(struct rtp *session) {
+        if (m_participants == NULL) {
+                return;
+        }
+        pdb_iter_t it;
+        struct pdb_e *cp = pdb_iter_init(m_participants, &it);
+        while (cp != NULL) {
+                if (cp->decoder_state != NULL && cp->decoder_state_deleter == destroy_video_decoder) {
+                        video_decoder_set_direct_recv(((struct vcodec_state *) cp->decoder_state)->decoder,
+                                        session, cp->ssrc);
+                }
+                cp = pdb_iter_next(&it);
+        }
+        pdb_iter_done(&it);
+}
+
 /**
  * Removes display from decoders and effectively kills them. They cannot be used
  * until new display assigned.
@@ -292,6 +477,20 @@ struct vcodec_state *ultragrid_rtp_video_rxtx::new_video_decoder(struct display
         return state;
 }
 
+/**
+ * Socket receive buffer needed for the stream - the largest (key)frame
+ * arriving as a burst plus the data received during the playout delay
+ * (the receiver thread may be busy that long with the frame completion).
+ */
+int ultragrid_rtp_video_rxtx::recv_buf_size(unsigned int max_frame_size) const
+{
+        double frames = 1.0;
+        if (m_playout_delay >= 0.0 && m_stream_fps > 0.0) {
+                frames = max(m_playout_delay * m_stream_fps, 1.0);
+        }
+        return min<double>(max_frame_size * (1.0 + frames), MAX_AUTO_RECV_BUF_SIZE);
+}
+
 void *ultragrid_rtp_video_rxtx::receiver_loop()
 {
         set_thread_name(__func__);
@@ -313,12 +512,16 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         fr = 1;
 
         time_ns_t last_not_timeout = 0;
+        const bool send_nack = get_commandline_param("rtp-nack") != nullptr;
+        // RTP/NTP mapping is needed for network latency stats and A/V sync
+        const bool use_sr = get_commandline_param("udp-rx-timestamp") != nullptr || av_sync_enabled();
+        const int rtp_recv_tag = alloc_stats_tag("rtp_recv");
 
         while (!m_should_exit) {
                 struct timeval timeout;
                 /* Housekeeping and RTCP... */
                 time_ns_t curr_time = get_time_in_ns();
-                uint32_t ts = (m_start_time - curr_time) / 100'000 * 9; // at 90000 Hz
+                uint32_t ts = get_local_mediatime(); // same clock as RTP data, see send_frame_async()
 
                 rtp_update(m_network_devices[0], curr_time);
                 rtp_send_ctrl(m_network_devices[0], ts, 0, curr_time);
@@ -339,7 +542,9 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 } else {
                         timeout.tv_usec = 1000;
                 }
+                alloc_stats_push_tag(rtp_recv_tag);
                 bool ret = rtp_recv_r(m_network_devices[0], &timeout, ts);
+                alloc_stats_pop_tag();
 
                 // timeout
                 if (!ret) {
@@ -354,6 +559,20 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                 pdb_iter_t it;
                 cp = pdb_iter_init(m_participants, &it);
                 while (cp != NULL) {
+                        if (cp->decoder_state != NULL && cp->decoder_state_deleter == destroy_video_decoder
+                                        && video_decoder_keyframe_requested(((struct vcodec_state *) cp->decoder_state)->decoder)) {
+                                rtp_send_pli(m_network_devices[0], cp->ssrc);
+                        }
+                        if (cp->decoder_state != NULL && cp->decoder_state_deleter == destroy_video_decoder) {
+                                report_viewport(((struct vcodec_state *) cp->decoder_state)->decoder, cp->ssrc, curr_time);
+                        }
+                        if (send_nack) {
+                                uint16_t seqs[256];
+                                int count = pbuf_get_nack(cp->playout_buffer, seqs, sizeof seqs / sizeof seqs[0]);
+                                if (count > 0) {
+                                        rtp_send_nack(m_network_devices[0], cp->ssrc, seqs, count);
+                                }
+                        }
                         if (tfrc_feedback_is_due(cp->tfrc_state, curr_time)) {
                                 debug_msg("tfrc rate %f\n",
                                           tfrc_feedback_txrate(cp->tfrc_state,
@@ -394,10 +613,21 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                         exit_uv(1);
                                         break;
                                 }
+                                video_decoder_set_direct_recv(((struct vcodec_state *) cp->decoder_state)->decoder,
+                                                m_network_devices[0], cp->ssrc);
 #endif // SHARED_DECODER
                         }
 
                         struct vcodec_state *vdecoder_state = (struct vcodec_state *) cp->decoder_state;
+                        if (use_sr && vdecoder_state != nullptr) {
+                                const rtcp_sr *sr = rtp_get_sr(m_network_devices[0], cp->ssrc);
+                                vdecoder_state->sr.valid = sr != nullptr;
+                                if (sr != nullptr) {
+                                        vdecoder_state->sr.ntp_sec = sr->ntp_sec;
+                                        vdecoder_state->sr.ntp_frac = sr->ntp_frac;
+                                        vdecoder_state->sr.rtp_ts = sr->rtp_ts;
+                                }
+                        }
 
                         /* Decode and render video... */
                         if (pbuf_decode
@@ -434,9 +664,10 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
                                 last_tile_received = curr_time;
                         }
 
-                        if(vdecoder_state && vdecoder_state->decoded % 100 == 99) {
-                                int new_size = vdecoder_state->max_frame_size * 110ull / 100;
-                                if(new_size > last_buf_size) {
+                        // grow in 25 % steps at least not to retry on every slightly bigger frame
+                        if (vdecoder_state && vdecoder_state->decoded > 0) {
+                                int new_size = recv_buf_size(vdecoder_state->max_frame_size);
+                                if (new_size > last_buf_size + last_buf_size / 4) {
                                         struct rtp **device = m_network_devices;
                                         while(*device) {
                                                 int ret = rtp_set_recv_buf(*device, new_size);
@@ -462,6 +693,8 @@ void *ultragrid_rtp_video_rxtx::receiver_loop()
         /* Because decoders work asynchronously we need to make sure
          * that display won't be called */
         remove_display_from_decoders();
+        // network devices are destroyed before the decoders
+        set_decoders_direct_recv(NULL);
 #endif //  SHARED_DECODER
 
         // pass posioned pill to display
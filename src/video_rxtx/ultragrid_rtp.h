@@ -38,16 +38,19 @@
 #ifndef VIDEO_RXTX_ULTRAGRID_RTP_H_
 #define VIDEO_RXTX_ULTRAGRID_RTP_H_
 
+#include "utils/latency_histogram.hpp"
 #include "video_rxtx.h"
 #include "video_rxtx/rtp.h"
 
 #include <condition_variable>
+#include <deque>
 #include <list>
 #include <map>
 #include <mutex>
 #include <string>
 
 struct control_state;
+struct pipeline_stage;
 
 class ultragrid_rtp_video_rxtx : public rtp_video_rxtx {
 public:
@@ -67,7 +70,12 @@ private:
         virtual void *(*get_receiver_thread())(void *arg);
 
         void receiver_process_messages();
+        struct response *set_receiver_param(const char *param);
         void remove_display_from_decoders();
+        void set_decoders_direct_recv(struct rtp *session);
+        void handle_keyframe_requests(codec_t compressed_codec);
+        void handle_viewport_reports();
+        void report_viewport(struct state_video_decoder *decoder, uint32_t ssrc, time_ns_t now);
         struct vcodec_state *new_video_decoder(struct display *d);
         static void destroy_video_decoder(void *state);
 
@@ -80,9 +88,13 @@ private:
         const char      *m_requested_encryption;
 
         /**
-         * This variables serve as a notification when asynchronous sending exits
+         * Frames queued for asynchronous sending - send_frame() blocks only
+         * if m_send_queue_depth frames are already in flight.
          * @{ */
-        bool             m_async_sending;
+        bool             m_async_sending;     ///< sending task is running
+        std::deque<std::shared_ptr<video_frame>> m_send_queue;
+        int              m_send_in_flight = 0; ///< frames queued or being sent
+        int              m_send_queue_depth = 1;
         std::condition_variable m_async_sending_cv;
         std::mutex       m_async_sending_lock;
         /// @}
@@ -93,6 +105,20 @@ private:
         long long int m_nano_per_frame_actual_cumul = 0;
         long long int m_nano_per_frame_expected_cumul = 0;
         long long int m_compress_millis_cumul = 0;
+        time_ns_t m_last_keyframe_request = 0; ///< last keyframe requested from compression on receiver PLI
+        bool m_viewport_warned = false;        ///< viewport reported but not used by capture filter
+        struct video_viewport m_viewport{};    ///< last viewport reported to the sender (receiver thread)
+        time_ns_t m_viewport_sent = 0;
+        /// @name per-stage latencies, used from send_frame_async() only
+        /// @{
+        latency_histogram m_compress_latency{"SEND_LATENCY", "compress"}; ///< compress_start to compress_end
+        latency_histogram m_tx_latency{"SEND_LATENCY", "tx"};             ///< compress_end to the frame being sent
+        /// @}
+        struct pipeline_stage *m_fec_stage; ///< FEC encoding in send_frame()
+        struct pipeline_stage *m_tx_stage;  ///< send_frame_async()
+        double m_playout_delay = -1.0; ///< [s] set by control socket, -1 - derived from frame rate
+        double m_stream_fps = 0.0;     ///< frame rate of the received stream (receiver thread)
+        int recv_buf_size(unsigned int max_frame_size) const;
 };
 
 #endif // VIDEO_RXTX_ULTRAGRID_RTP_H_
@@ -46,6 +46,7 @@
 #include "lib_common.h"
 #include "utils/color_out.h"
 #include "utils/macros.h"
+#include "utils/video_frame_pool.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
@@ -60,6 +61,7 @@ struct state_crop {
         struct video_desc in_desc;
         struct video_desc out_desc;
         struct video_frame *in;
+        struct video_frame_pool *pool; ///< capture filter only
 };
 
 static bool crop_get_property(void *state, int property, void *val, size_t *len)
@@ -147,6 +149,16 @@ static struct video_frame * crop_getf(void *state)
         return s->in;
 }
 
+/// @returns offset of the cropped area in the input tile (in bytes)
+static size_t crop_offset(const struct state_crop *s, const struct tile *in, codec_t codec, unsigned width, unsigned height)
+{
+        int xoff = s->xoff + width > in->width ? in->width - width : (unsigned) s->xoff;
+        int xoff_bytes = (int) (xoff * get_bpp(codec)) / get_pf_block_bytes(codec)
+                * get_pf_block_bytes(codec);
+        int yoff = s->yoff + height > in->height ? in->height - height : (unsigned) s->yoff;
+        return (size_t) yoff * vc_get_linesize(in->width, codec) + xoff_bytes;
+}
+
 static bool crop_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         assert(in->tile_count == 1);
@@ -154,15 +166,11 @@ static bool crop_postprocess(void *state, struct video_frame *in, struct video_f
 
         struct state_crop *s = state;
         int src_linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        int xoff = s->xoff + out->tiles[0].width > in->tiles[0].width ? in->tiles[0].width - out->tiles[0].width : (unsigned) s->xoff;
-        int xoff_bytes = (int) (xoff * get_bpp(in->color_spec)) / get_pf_block_bytes(in->color_spec)
-                * get_pf_block_bytes(in->color_spec);
-        int yoff = s->yoff + out->tiles[0].height > in->tiles[0].height ? in->tiles[0].height - out->tiles[0].height : (unsigned) s->yoff;
+        const char *src = in->tiles[0].data + crop_offset(s, &in->tiles[0], in->color_spec,
+                        out->tiles[0].width, out->tiles[0].height);
 
         for (int y = 0 ; y < (int) out->tiles[0].height; y++) {
-                memcpy(out->tiles[0].data + y * req_pitch,
-                                in->tiles[0].data + (yoff + y) * src_linesize + xoff_bytes,
-                                req_pitch);
+                memcpy(out->tiles[0].data + y * req_pitch, src + (size_t) y * src_linesize, req_pitch);
         }
 
         return true;
@@ -173,6 +181,7 @@ static void crop_done(void *state)
         struct state_crop *s = state;
 
         vf_free(s->in);
+        video_frame_pool_destroy(s->pool);
         free(s);
 }
 
@@ -195,10 +204,16 @@ static int cf_crop_init(struct module *parent, const char *cfg, void **state)
         if (!s) {
                 return -1;
         }
+        ((struct state_crop *) s)->pool = video_frame_pool_init((struct video_desc) { 0 }, 0);
         *state = s;
         return 0;
 }
 
+static void dispose_view(struct video_frame *f) {
+        VIDEO_FRAME_DISPOSE((struct video_frame *) f->callbacks.dispose_udata);
+        vf_free(f);
+}
+
 static struct video_frame *cf_crop_filter(void *state, struct video_frame *f)
 {
         struct state_crop *s = state;
@@ -209,13 +224,23 @@ static struct video_frame *cf_crop_filter(void *state, struct video_frame *f)
                 }
         }
 
-        struct video_frame *out = vf_alloc_desc_data(s->out_desc);
-        out->callbacks.dispose = vf_free;
-        if (!crop_postprocess(state, f, out, vc_get_linesize(s->out_desc.width, f->color_spec))) {
-                VIDEO_FRAME_DISPOSE(f);
-                vf_free(out);
-                return NULL;
+        // full-width crop is a contiguous range of lines - pass a view of
+        // the input frame instead of copying (the tile has no stride so
+        // this is not possible for horizontal crops)
+        size_t offset = crop_offset(s, &f->tiles[0], f->color_spec, s->out_desc.width, s->out_desc.height);
+        if (s->out_desc.width == f->tiles[0].width && offset % 4 == 0) {
+                struct video_frame *out = vf_alloc_desc(s->out_desc);
+                vf_copy_metadata(out, f);
+                out->tiles[0].data = f->tiles[0].data + offset;
+                out->tiles[0].data_len = vc_get_linesize(out->tiles[0].width, f->color_spec) * out->tiles[0].height;
+                out->callbacks.dispose = dispose_view;
+                out->callbacks.dispose_udata = f;
+                return out;
         }
+
+        struct video_frame *out = video_frame_pool_get_disposable_frame_desc(s->pool, s->out_desc);
+        vf_copy_metadata(out, f);
+        crop_postprocess(state, f, out, vc_get_linesize(s->out_desc.width, f->color_spec));
         VIDEO_FRAME_DISPOSE(f);
         return out;
 }
@@ -233,7 +258,10 @@ static const struct vo_postprocess_info vo_pp_crop_info = {
 static const struct capture_filter_info capture_filter_crop_info = {
         cf_crop_init,
         crop_done,
-        cf_crop_filter
+        cf_crop_filter,
+        false,
+        NULL,
+        NULL,
 };
 
 REGISTER_MODULE(crop, &vo_pp_crop_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
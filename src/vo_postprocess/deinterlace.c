@@ -50,6 +50,7 @@
 #include "debug.h"
 #include "lib_common.h"
 #include "utils/color_out.h"
+#include "utils/deinterlace_adaptive.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
@@ -57,7 +58,10 @@
 #define MOD_NAME "[deinterlace_blend] "
 
 struct state_deinterlace {
-        struct video_frame *out; ///< for postprocess only
+        struct video_frame *out[2]; ///< for postprocess only (second used only if adaptive)
+        int out_idx;                ///< index of the frame returned by last getf
+        _Bool have_prev;            ///< the other frame contains previous input
+        _Bool adaptive;             ///< use motion-adaptive deinterlacing if the codec is supported
         _Bool force;
 };
 
@@ -101,9 +105,13 @@ static void * deinterlace_init(const char *config) {
                 return NULL;
         }
 
-        log_msg(LOG_LEVEL_INFO, MOD_NAME "\"-p deinterlace\" is equivalent to \"-p deinterlace_blend\", you can choose different implementations as well.\n");
+        log_msg(LOG_LEVEL_INFO, MOD_NAME "\"-p deinterlace\" uses motion-adaptive deinterlacing (blending for unsupported pixel formats), you can choose different implementations as well.\n");
 
-        return deinterlace_blend_init(config);
+        struct state_deinterlace *s = deinterlace_blend_init(config);
+        if (s != NULL) {
+                s->adaptive = 1;
+        }
+        return s;
 }
 
 static int cf_deinterlace_init(struct module *parent, const char *cfg, void **state)
@@ -135,9 +143,13 @@ static int deinterlace_reconfigure(void *state, struct video_desc desc)
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
 
-        vf_free(s->out);
+        vf_free(s->out[0]);
+        vf_free(s->out[1]);
         assert(desc.tile_count == 1);
-        s->out = vf_alloc_desc_data(desc);
+        s->out[0] = vf_alloc_desc_data(desc);
+        s->out[1] = s->adaptive ? vf_alloc_desc_data(desc) : NULL;
+        s->out_idx = 0;
+        s->have_prev = 0;
 
         return TRUE;
 }
@@ -146,7 +158,10 @@ static struct video_frame * deinterlace_getf(void *state)
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
 
-        return s->out;
+        if (s->adaptive) {
+                s->out_idx = 1 - s->out_idx;
+        }
+        return s->out[s->out_idx];
 }
 
 static bool deinterlace_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
@@ -162,6 +177,15 @@ static bool deinterlace_postprocess(void *state, struct video_frame *in, struct
                 return true;
         }
 
+        if (s->adaptive && in == s->out[s->out_idx] && deinterlace_adaptive_supports(in->color_spec)) {
+                // keeps the top field, the bottom one is interpolated from the previous and current frame
+                const char *prev = s->have_prev ? s->out[1 - s->out_idx]->tiles[0].data : in->tiles[0].data;
+                deinterlace_adaptive(in->color_spec, in->tiles[0].width, in->tiles[0].height,
+                                prev, in->tiles[0].data, in->tiles[0].data, 0, out->tiles[0].data, req_pitch);
+                s->have_prev = 1;
+                return true;
+        }
+
         if (!vc_deinterlace_ex(in->color_spec, (unsigned char *) in->tiles[0].data, vc_get_linesize(in->tiles[0].width, in->color_spec),
                                 (unsigned char *) out->tiles[0].data, vc_get_linesize(out->tiles[0].width, in->color_spec),
                                 in->tiles[0].height)) {
@@ -191,7 +215,8 @@ static void deinterlace_done(void *state)
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
         
-        vf_free(s->out);
+        vf_free(s->out[0]);
+        vf_free(s->out[1]);
         free(s);
 }
 
@@ -199,7 +224,7 @@ static void deinterlace_get_out_desc(void *state, struct video_desc *out, int *i
 {
         struct state_deinterlace *s = (struct state_deinterlace *) state;
 
-        *out = video_desc_from_frame(s->out);
+        *out = video_desc_from_frame(s->out[0]);
 
         UNUSED(in_display_mode);
         //*in_display_mode = DISPLAY_PROPERTY_VIDEO_MERGED;
@@ -229,7 +254,10 @@ static const struct vo_postprocess_info vo_pp_deinterlace_info = {
 static const struct capture_filter_info capture_filter_deinterlace_info = {
         cf_deinterlace_init,
         deinterlace_done,
-        cf_deinterlace_filter
+        cf_deinterlace_filter,
+        false,
+        NULL,
+        NULL,
 };
 
 REGISTER_MODULE(deinterlace_blend, &vo_pp_deinterlace_blend_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
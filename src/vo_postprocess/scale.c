@@ -3,7 +3,7 @@
  * @author Martin Pulec     <pulec@cesnet.cz>
  */
 /*
- * Copyright (c) 2012-2019 CESNET z.s.p.o.
+ * Copyright (c) 2012-2024 CESNET z.s.p.o.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -42,29 +42,25 @@
 #endif
 
 #include <stdlib.h>
-#include <pthread.h>
 
 #include "debug.h"
 #include "lib_common.h"
-#include "gl_context.h"
+#include "utils/video_scaler.h"
 #include "video.h"
 #include "video_display.h"
 #include "vo_postprocess.h"
 
 struct state_scale {
         struct video_frame *in;
-        struct gl_context context;
+        struct video_scaler *scaler;
 
         int scaled_width, scaled_height;
-        GLuint tex_input;
-        GLuint tex_output;
-        GLuint fbo;
 };
 
 static bool scale_get_property(void *state, int property, void *val, size_t *len)
 {
         bool ret = false;
-        codec_t supported[] = {UYVY, RGBA};
+        codec_t supported[] = {UYVY, RGBA, RGB, v210};
 
         UNUSED(state);
 
@@ -87,12 +83,14 @@ static bool scale_get_property(void *state, int property, void *val, size_t *len
 static void usage()
 {
         printf("Scale postprocessor settings:\n");
-        printf("\t-p scale:width:height\n");
+        printf("\t-p scale:width:height[:bilinear|bicubic|lanczos]\n");
+        printf("\t\tdefault filter is bicubic\n");
 }
 
 static void * scale_init(const char *config) {
         char *save_ptr = NULL;
         char *ptr;
+        enum video_scaler_filter filter = VIDEO_SCALER_BICUBIC;
 
         if (strcmp(config, "help") == 0) {
                 usage();
@@ -114,6 +112,14 @@ static void * scale_init(const char *config) {
         if (ptr != NULL) {
                 s->scaled_height = atoi(ptr);
         }
+        ptr = strtok_r(NULL, ":", &save_ptr);
+        if (ptr != NULL && !video_scaler_parse_filter(ptr, &filter)) {
+                fprintf(stderr, "Scale postprocessor unknown filter: %s\n", ptr);
+                usage();
+                free(s);
+                free(tmp);
+                return NULL;
+        }
         if (s->scaled_width <= 0 || s->scaled_height <= 0) {
                 fprintf(stderr, "Scale postprocessor incorrect usage.\n");
                 usage();
@@ -125,45 +131,30 @@ static void * scale_init(const char *config) {
         free(tmp);
 
         s->in = NULL;
-
-        init_gl_context(&s->context, GL_CONTEXT_LEGACY);
-        gl_context_make_current(&s->context);
-
-        glEnable(GL_TEXTURE_2D);
-
-        glGenTextures(1, &s->tex_input);
-        glBindTexture(GL_TEXTURE_2D, s->tex_input);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        glGenTextures(1, &s->tex_output);
-        glBindTexture(GL_TEXTURE_2D, s->tex_input);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        glGenFramebuffers(1, &s->fbo);
+        s->scaler = video_scaler_create(filter);
 
         return s;
 }
 
+static void free_in_frame(struct state_scale *s)
+{
+        if (s->in == NULL) {
+                return;
+        }
+        for (int i = 0; i < (int) s->in->tile_count; ++i) {
+                free(s->in->tiles[i].data);
+        }
+        vf_free(s->in);
+        s->in = NULL;
+}
+
 static int scale_reconfigure(void *state, struct video_desc desc)
 {
         struct state_scale *s = (struct state_scale *) state;
         struct tile *in_tile;
         int i;
-        int width, height;
 
-        if(s->in) {
-                int i;
-                for(i = 0; i < (int) s->in->tile_count; ++i) {
-                        free(s->in->tiles[i].data);
-                }
-                vf_free(s->in);
-        }
+        free_in_frame(s);
 
         s->in = vf_alloc(desc.tile_count);
 
@@ -183,40 +174,8 @@ static int scale_reconfigure(void *state, struct video_desc desc)
         }
 
         assert(desc.tile_count >= 1);
-        in_tile = vf_get_tile(s->in, 0);
-
-        gl_context_make_current(&s->context);
-
-        glBindTexture(GL_TEXTURE_2D, s->tex_input);
-        width = in_tile->width;
-        height = in_tile->height;
-        if(s->in->color_spec == UYVY) {
-                width /= 2;
-        }
-        if(s->in->interlacing == INTERLACED_MERGED) {
-                width *= 2;
-                height /= 2;
-        }
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
-                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
-
-
-        glBindTexture(GL_TEXTURE_2D, s->tex_output);
-        width = s->scaled_width;
-        height = s->scaled_height;
-        if(s->in->color_spec == UYVY) {
-                width /= 2;
-        }
-        if(s->in->interlacing == INTERLACED_MERGED) {
-                width *= 2;
-                height /= 2;
-        }
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
-                        0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-
-        return TRUE;
+        return video_scaler_supports(desc.color_spec);
 }
 
 static struct video_frame * scale_getf(void *state)
@@ -229,79 +188,24 @@ static struct video_frame * scale_getf(void *state)
 static bool scale_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         struct state_scale *s = (struct state_scale *) state;
-        int i;
-        int width, height;
-
-        int src_linesize = vc_get_linesize(out->tiles[0].width, out->color_spec);
-
-        char *tmp_data = NULL;
-
-        if(req_pitch != src_linesize) {
-                tmp_data = malloc(src_linesize *
-                                out->tiles[0].height);
-        }
-
-        gl_context_make_current(&s->context);
 
-        for(i = 0; i < (int) in->tile_count; ++i) {
-                struct tile *in_tile = vf_get_tile(s->in, i);
-
-                glBindTexture(GL_TEXTURE_2D, s->tex_input);
-                width = in_tile->width;
-                height = in_tile->height;
-                if(s->in->color_spec == UYVY) {
-                        width /= 2;
-                }
-                if(s->in->interlacing == INTERLACED_MERGED) {
-                        width *= 2;
-                        height /= 2;
-                }
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
-                                GL_RGBA, GL_UNSIGNED_BYTE, in_tile->data); 
-
-                glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, s->tex_output, 0);
-
-                width = s->scaled_width;
-                height = s->scaled_height;
-                if(s->in->color_spec == UYVY) {
-                        width /= 2;
-                }
-                if(s->in->interlacing == INTERLACED_MERGED) {
-                        width *= 2;
-                        height /= 2;
-                }
-                glViewport(0, 0, width, height);
-                glBindTexture(GL_TEXTURE_2D, s->tex_input);
-
-                glClearColor(1,0,0,1);
-                glClear(GL_COLOR_BUFFER_BIT);
-
-                glBegin(GL_QUADS);
-                glTexCoord2f(0.0, 0.0); glVertex2f(-1.0, -1.0);
-                glTexCoord2f(1.0, 0.0); glVertex2f(1.0, -1.0);
-                glTexCoord2f(1.0, 1.0); glVertex2f(1.0, 1.0);
-                glTexCoord2f(0.0, 1.0); glVertex2f(-1.0, 1.0);
-                glEnd();
-
-                glBindTexture(GL_TEXTURE_2D, s->tex_output);
-                if(tmp_data) { /* we need to change pitch */
-                        int y;
-                        glReadPixels(0, 0, width , height, GL_RGBA, GL_UNSIGNED_BYTE, tmp_data);
-                        char *src = tmp_data;
-                        char *dst = out->tiles[i].data;
-                        for (y = 0; y < (int) out->tiles[i].height; y += 1) {
-                                memcpy(dst, src, src_linesize);
-                                dst += req_pitch;
-                                src += src_linesize;
+        int src_linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        // fields of a merged interlaced frame are scaled separately
+        int fields = in->interlacing == INTERLACED_MERGED ? 2 : 1;
+
+        for (int i = 0; i < (int) in->tile_count; ++i) {
+                struct tile *in_tile = vf_get_tile(in, i);
+                for (int field = 0; field < fields; ++field) {
+                        if (!video_scaler_scale(s->scaler, in->color_spec,
+                                                in_tile->data + field * src_linesize, src_linesize * fields,
+                                                in_tile->width, in_tile->height / fields,
+                                                out->tiles[i].data + field * req_pitch, req_pitch * fields,
+                                                s->scaled_width, s->scaled_height / fields)) {
+                                return false;
                         }
-                } else {
-                        glReadPixels(0, 0, width , height, GL_RGBA, GL_UNSIGNED_BYTE, out->tiles[i].data);
                 }
         }
 
-        free(tmp_data);
-
         return true;
 }
 
@@ -309,15 +213,8 @@ static void scale_done(void *state)
 {
         struct state_scale *s = (struct state_scale *) state;
 
-        glDeleteTextures(1, &s->tex_input);
-        glDeleteTextures(1, &s->tex_output);
-        glDeleteFramebuffers(1, &s->fbo);
-
-        free(s->in->tiles[0].data);
-
-        vf_free(s->in);
-
-        destroy_gl_context(&s->context);
+        free_in_frame(s);
+        video_scaler_destroy(s->scaler);
 
         free(state);
 }
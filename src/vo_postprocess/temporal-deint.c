@@ -52,6 +52,7 @@
 #include "lib_common.h"
 #include "tv.h"
 #include "utils/color_out.h"
+#include "utils/deinterlace_adaptive.h"
 #include "utils/text.h" // indent_paragraph
 #include "video.h"
 #include "video_display.h"
@@ -61,13 +62,14 @@
 #define TIMEOUT "20ms"
 #define DFR_DEINTERLACE_IMPOSSIBLE_MSG_ID 0x27ff0a78
 
-enum algo { DF, BOB, LINEAR };
+enum algo { DF, BOB, LINEAR, YADIF };
 
 struct state_df {
         enum algo algo;
         struct video_frame *in;
         char *buffers[2];
         int buffer_current;
+        bool have_prev; ///< the other buffer contains the previous frame (YADIF)
         bool deinterlace;
         bool nodelay;
         bool force;
@@ -160,6 +162,20 @@ static void * linear_init(const char *config) {
         return init_common(LINEAR, config);
 }
 
+static void * yadif_init(const char *config) {
+        if (strcmp(config, "help") == 0) {
+                color_printf(TBOLD("Yadif") "-like deinterlacer outputs every field "
+                                "in full resolution. Missing lines are interpolated "
+                                "in moving areas and taken from the neighbouring "
+                                "fields in static ones (motion adaptivity). Output "
+                                "is delayed by one field.\n\n");
+                color_printf("Usage:\n");
+                color_printf("\t" TBOLD(TRED("-p deinterlace_yadif") "[:force]") "\n");
+                return NULL;
+        }
+        return init_common(YADIF, config);
+}
+
 static bool common_get_property(void *state, int property, void *val, size_t *len)
 {
         UNUSED(state);
@@ -196,6 +212,12 @@ static int common_postprocess_reconfigure(void *state, struct video_desc desc)
         s->buffers[0] = (char *) malloc(in_tile->data_len);
         s->buffers[1] = (char *) malloc(in_tile->data_len);
         in_tile->data = s->buffers[s->buffer_current];
+        s->have_prev = false;
+
+        if (s->algo == YADIF && !deinterlace_adaptive_supports(desc.color_spec)) {
+                log_msg(LOG_LEVEL_WARNING, MOD_NAME "Pixel format %s is not supported by yadif, using linear.\n",
+                                get_codec_name(desc.color_spec));
+        }
         
         return TRUE;
 }
@@ -424,6 +446,28 @@ static void perform_linear(struct state_df *s, struct video_frame *in, struct vi
         }
 }
 
+/**
+ * With the frames F(n-1) and F(n) the bottom field of F(n-1) and then the top
+ * field of F(n) are output - this way both temporal neighbours of the fields
+ * are available without waiting for another frame.
+ */
+static void perform_yadif(struct state_df *s, struct video_frame *in, struct video_frame *out, int pitch)
+{
+        char *cur = s->buffers[s->buffer_current];
+        char *prev = s->have_prev ? s->buffers[(s->buffer_current + 1) % 2] : cur;
+        int width = s->in->tiles[0].width;
+        int height = s->in->tiles[0].height;
+        bool ret = in != NULL
+                ? deinterlace_adaptive(s->in->color_spec, width, height, prev, prev, cur, 1, out->tiles[0].data, pitch)
+                : deinterlace_adaptive(s->in->color_spec, width, height, prev, cur, cur, 0, out->tiles[0].data, pitch);
+        if (!ret) {
+                perform_linear(s, in, out, pitch);
+        }
+        if (in == NULL) {
+                s->have_prev = true;
+        }
+}
+
 /// @param in  may be NULL
 static bool common_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
@@ -440,6 +484,9 @@ static bool common_postprocess(void *state, struct video_frame *in, struct video
                         case LINEAR:
                                 perform_linear(s, in, out, req_pitch);
                                 break;
+                        case YADIF:
+                                perform_yadif(s, in, out, req_pitch);
+                                break;
                 }
         } else {
                 s->in->tiles[0].data = s->buffers[0]; // always write to first buffer
@@ -519,7 +566,18 @@ static const struct vo_postprocess_info vo_pp_linear_info = {
         common_done,
 };
 
+static const struct vo_postprocess_info vo_pp_yadif_info = {
+        yadif_init,
+        common_postprocess_reconfigure,
+        common_getf,
+        common_get_out_desc,
+        common_get_property,
+        common_postprocess,
+        common_done,
+};
+
 REGISTER_MODULE(double_framerate, &vo_pp_df_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
 REGISTER_MODULE(deinterlace_bob, &vo_pp_bob_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
 REGISTER_MODULE(deinterlace_linear, &vo_pp_linear_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
+REGISTER_MODULE(deinterlace_yadif, &vo_pp_yadif_info, LIBRARY_CLASS_VIDEO_POSTPROCESS, VO_PP_ABI_VERSION);
 
@@ -67,6 +67,7 @@
 #include "utils/macros.h"
 #include "utils/string.h" // replace_all
 #include "utils/text.h"
+#include "utils/video_overlay.h"
 
 struct state_text {
         struct video_frame *in;
@@ -77,8 +78,7 @@ struct state_text {
         int margin_x, margin_y, text_h;
         struct video_desc saved_desc;
 
-        DrawingWand *dw;
-        MagickWand *wand;
+        struct video_overlay *overlay; ///< prerendered text, recreated on format change only
 };
 
 static bool text_get_property(void *state, int property, void *val, size_t *len)
@@ -169,13 +169,9 @@ static int text_postprocess_reconfigure(void *state, struct video_desc desc)
         struct state_text *s = (struct state_text *) state;
 
         vf_free(s->in);
-        if (s->wand)
-                DestroyMagickWand(s->wand);
-        if (s->dw)
-                DestroyDrawingWand(s->dw);
+        video_overlay_destroy(s->overlay);
         s->in = 0;
-        s->wand = 0;
-        s->dw = 0;
+        s->overlay = 0;
 
         s->in = vf_alloc_desc_data(desc);
 
@@ -185,63 +181,53 @@ static int text_postprocess_reconfigure(void *state, struct video_desc desc)
         s->width = MIN(s->margin_x + strlen(s->text) * s->text_h, desc.width);
         s->height = MIN(s->margin_y + s->text_h, (int) desc.height);
 
-        const char *color;
-        const char *color_outline;
-        const char *colorspace;
-        if (desc.color_spec == RGBA) {
-                color = "#333333FF";
-                color_outline = "#FFFFFFFF";
-                colorspace = "rgba";
-        } else if (desc.color_spec == RGB) {
-                color = "#333333FF";
-                color_outline = "#FFFFFFFF";
-                colorspace = "rgb";
-        } else if (desc.color_spec == UYVY) {
-                color = "#228080FF";
-                color_outline = "#EB8080FF";
-                colorspace = "UYVY";
-        } else {
+        if (!video_overlay_supports(desc.color_spec)) {
                 log_msg(LOG_LEVEL_ERROR, "[text vo_pp.] Codec not supported! Please report to "
                                 PACKAGE_BUGREPORT ".\n");
                 return FALSE;
         }
 
-        s->dw = NewDrawingWand();
-        DrawSetFontSize(s->dw, s->text_h);
-        MagickBooleanType status = DrawSetFont(s->dw, "helvetica");
-        if(status != MagickTrue) {
+        // the text is rasterized once to RGBA over a transparent background
+        // and converted to the video codec, frames are then only blended
+        DrawingWand *dw = NewDrawingWand();
+        MagickWand *wand = NewMagickWand();
+        PixelWand *pw = NewPixelWand();
+        unsigned char *rgba = NULL;
+        bool ret = false;
+
+        DrawSetFontSize(dw, s->text_h);
+        if (DrawSetFont(dw, "helvetica") != MagickTrue) {
                 log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] DraweSetFont failed!\n");
-                return FALSE;
+                goto cleanup;
         }
-        {
-               PixelWand *pw = NewPixelWand();
-               PixelSetColor(pw, color);
-               DrawSetFillColor(s->dw, pw);
-               PixelSetColor(pw, color_outline);
-               DrawSetStrokeColor(s->dw, pw);
-               DestroyPixelWand(pw);
+        PixelSetColor(pw, "#333333FF");
+        DrawSetFillColor(dw, pw);
+        PixelSetColor(pw, "#FFFFFFFF");
+        DrawSetStrokeColor(dw, pw);
+
+        PixelSetColor(pw, "none");
+        if (MagickNewImage(wand, s->width, s->height, pw) != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickNewImage failed!\n");
+                goto cleanup;
         }
-
-        s->wand = NewMagickWand();
-        status = MagickSetFormat(s->wand, colorspace);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetFormat failed!\n");
-                return FALSE;
-        }
-
-        status = MagickSetSize(s->wand, s->width, s->height);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetSize failed!\n");
-                return FALSE;
+        if (MagickAnnotateImage(wand, dw, s->margin_x, s->margin_y + s->text_h, 0, s->text) != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickAnnotateImage failed!\n");
+                goto cleanup;
         }
-
-        status = MagickSetDepth(s->wand, 8);
-        if(status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickSetDepth failed!\n");
-                return FALSE;
+        rgba = malloc((size_t) s->width * s->height * 4);
+        if (MagickExportImagePixels(wand, 0, 0, s->width, s->height, "RGBA", CharPixel, rgba) != MagickTrue) {
+                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickExportImagePixels failed!\n");
+                goto cleanup;
         }
-
-        return TRUE;
+        s->overlay = video_overlay_create(rgba, s->width, s->height, desc.color_spec);
+        ret = s->overlay != NULL;
+
+cleanup:
+        free(rgba);
+        DestroyPixelWand(pw);
+        DestroyMagickWand(wand);
+        DestroyDrawingWand(dw);
+        return ret;
 }
 
 static struct video_frame * text_getf(void *state)
@@ -251,58 +237,25 @@ static struct video_frame * text_getf(void *state)
         return s->in;
 }
 
-/**
- * @todo
- * Rendering of the text is a bit slow. Since the text doesn't change at all, it should be
- * prerendered and then only alpha blended.
- */
 static bool text_postprocess(void *state, struct video_frame *in, struct video_frame *out, int req_pitch)
 {
         struct state_text *s = (struct state_text *) state;
 
-        int dstlinesize = vc_get_linesize(s->width, in->color_spec);
-        int srclinesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
-        char *tmp = malloc((size_t) s->height * dstlinesize);
-        for (ptrdiff_t y = 0; y < s->height; y++) {
-                memcpy(tmp + y * dstlinesize, in->tiles[0].data + y * srclinesize, dstlinesize);
-        }
-
-        MagickRemoveImage(s->wand);
-        MagickBooleanType status = MagickReadImageBlob(s->wand, tmp, s->height * dstlinesize);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickReadImageBlob failed!\n");
-                return false;
-        }
-        //double *ret = MagickQueryFontMetrics(wand, dw, s->text.c_str());
-        //fprintf(stderr, "%f %f %f %f %f\n", ret[0], ret[1], ret[2], ret[3], ret[4]);
-        unsigned char *data;
-        size_t data_len;
-        status = MagickAnnotateImage(s->wand, s->dw, s->margin_x, s->margin_y + s->text_h, 0, s->text);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickAnnotateImage failed!\n");
-                return false;
-        }
-        status = MagickDrawImage(s->wand, s->dw);
-        if (status != MagickTrue) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickDrawImage failed!\n");
-                return false;
-        }
-        data = MagickGetImageBlob(s->wand, &data_len);
-        if (!data) {
-                log_msg(LOG_LEVEL_WARNING, "[text vo_pp.] MagickGetImageBlob failed!\n");
+        if (!s->overlay) {
                 return false;
         }
 
-        memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
-
-        if ((int) data_len == s->height * dstlinesize) {
-                for (int y = 0; y < s->height; y++) {
-                        memcpy(out->tiles[0].data + y * req_pitch, data + y * dstlinesize, dstlinesize);
+        int src_linesize = vc_get_linesize(in->tiles[0].width, in->color_spec);
+        if (req_pitch == src_linesize) {
+                memcpy(out->tiles[0].data, in->tiles[0].data, in->tiles[0].data_len);
+        } else {
+                for (unsigned y = 0; y < in->tiles[0].height; y++) {
+                        memcpy(out->tiles[0].data + (size_t) y * req_pitch,
+                                        in->tiles[0].data + (size_t) y * src_linesize, src_linesize);
                 }
         }
-
-        free(data);
-        free(tmp);
+        video_overlay_blend(s->overlay, out->tiles[0].data, req_pitch, in->tiles[0].width,
+                        in->tiles[0].height, 0, 0);
 
         return true;
 }
@@ -337,9 +290,7 @@ static void text_done(void *state)
         struct state_text *s = (struct state_text *) state;
 
         vf_free(s->in);
-
-        DestroyMagickWand(s->wand);
-        DestroyDrawingWand(s->dw);
+        video_overlay_destroy(s->overlay);
 
         free(s->data);
         free(s->text);
@@ -369,7 +320,10 @@ static const struct vo_postprocess_info vo_pp_text_info = {
 static const struct capture_filter_info capture_filter_text_info = {
         cf_text_init,
         text_done,
-        cf_text_filter
+        cf_text_filter,
+        false,
+        NULL,
+        NULL,
 };
 
 
@@ -8,12 +8,14 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <random>
 #include <string>
 #include <vector>
 
+#include "host.h"
 #include "libavcodec/from_lavc_vid_conv.h"
 #include "libavcodec/to_lavc_vid_conv.h"
 #include "tv.h"
@@ -44,6 +46,9 @@ extern "C" {
         int ff_codec_conversions_test_yuv444p16le_from_to_rg48();
         int ff_codec_conversions_test_yuv444p16le_from_to_rg48_out_of_range();
         int ff_codec_conversions_test_pX10_from_to_v210();
+        int ff_codec_conversions_test_simd_from_lavc();
+        int ff_codec_conversions_test_simd_to_lavc();
+        int ff_codec_conversions_test_to_lavc_zero_copy();
 }
 
 #define CHECK(res) if ((res) != 0) { return res; }
@@ -388,4 +393,141 @@ int ff_codec_conversions_test_pX10_from_to_v210()
         return 0;
 }
 
+/**
+ * Checks that the SIMD variants of the conversions from AVFrame produce the
+ * same output as the scalar ones. Width is not divisible by the lane width,
+ * so that the scalar tail is exercised as well.
+ */
+int ff_codec_conversions_test_simd_from_lavc()
+{
+        struct {
+                enum AVPixelFormat av_codec;
+                codec_t uv_codec;
+                int depth;
+                int shift; // MSB-aligned formats
+        } const convs[] = {
+                { AV_PIX_FMT_YUV420P10LE, v210, 10, 0 },
+                { AV_PIX_FMT_YUV422P10LE, v210, 10, 0 },
+                { AV_PIX_FMT_P010LE, v210, 10, 6 },
+#if P210_PRESENT
+                { AV_PIX_FMT_P210LE, v210, 10, 6 },
+#endif
+                { AV_PIX_FMT_YUV444P10LE, Y416, 10, 0 },
+                { AV_PIX_FMT_YUV444P12LE, Y416, 12, 0 },
+                { AV_PIX_FMT_YUV444P16LE, Y416, 16, 0 },
+                { AV_PIX_FMT_GBRP10LE, R10k, 10, 0 },
+                { AV_PIX_FMT_GBRP12LE, R10k, 12, 0 },
+                { AV_PIX_FMT_GBRP16LE, R10k, 16, 0 },
+        };
+        constexpr int width = 1918;
+        constexpr int height = 6;
+        default_random_engine rand_gen;
+
+        for (const auto &c : convs) {
+                AVFrame *frame = av_frame_alloc();
+                frame->format = c.av_codec;
+                frame->width = width;
+                frame->height = height;
+                ASSERT(av_frame_get_buffer(frame, 0) == 0);
+                uniform_int_distribution<uint16_t> dist(0, (1 << c.depth) - 1);
+                for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i] != nullptr; ++i) {
+                        auto *data = reinterpret_cast<uint16_t *>(frame->buf[i]->data);
+                        std::generate(data, data + frame->buf[i]->size / 2, [&]() { return dist(rand_gen) << c.shift; });
+                }
+
+                const int pitch = vc_get_linesize(width, c.uv_codec);
+                vector<char> scalar(static_cast<size_t>(pitch) * height);
+                auto conv = get_av_to_uv_conversion_impl(c.av_codec, c.uv_codec, "scalar");
+                ASSERT(conv.valid);
+                av_to_uv_convert(&conv, scalar.data(), frame, width, height, pitch, nullptr);
+
+                for (const char *impl : { "sse4", "avx2", "avx512", "neon" }) {
+                        vector<char> out(scalar.size());
+                        conv = get_av_to_uv_conversion_impl(c.av_codec, c.uv_codec, impl);
+                        ASSERT(conv.valid);
+                        av_to_uv_convert(&conv, out.data(), frame, width, height, pitch, nullptr);
+                        ASSERT_MESSAGE("SIMD conversion from "s + av_get_pix_fmt_name(c.av_codec) + " (" + impl + ") differs from scalar", out == scalar);
+                }
+                av_frame_free(&frame);
+        }
+        return 0;
+}
+
+/**
+ * Compares SIMD variants of the conversions to AVFrame with the scalar ones.
+ */
+int ff_codec_conversions_test_simd_to_lavc()
+{
+        struct {
+                codec_t in;
+                enum AVPixelFormat out;
+        } const convs[] = {
+                { v210, AV_PIX_FMT_YUV422P10LE },
+                { UYVY, AV_PIX_FMT_NV12 },
+                { UYVY, AV_PIX_FMT_YUV420P },
+                { R10k, AV_PIX_FMT_GBRP10LE },
+                { R10k, AV_PIX_FMT_GBRP16LE },
+        };
+        constexpr int width = 1926; // not divisible by the lane widths (in pixels) of all of the conversions
+        constexpr int height = 6;
+        default_random_engine rand_gen;
+        uniform_int_distribution<int> dist(0, 255);
+
+        for (const auto &c : convs) {
+                vector<unsigned char> in(vc_get_datalen(width, height, c.in));
+                std::generate(in.begin(), in.end(), [&]() { return dist(rand_gen); });
+                const int out_size = av_image_get_buffer_size(c.out, width, height, 1);
+                vector<unsigned char> scalar(out_size);
+                for (const char *impl : { "scalar", "sse4", "avx2", "avx512", "neon" }) {
+                        set_commandline_param("pixfmt-conv-impl", impl);
+                        struct to_lavc_vid_conv *conv = to_lavc_vid_conv_init(c.in, width, height, c.out, 1);
+                        ASSERT(conv != nullptr);
+                        AVFrame *frame = to_lavc_vid_conv(conv, reinterpret_cast<char *>(in.data()));
+                        ASSERT(frame != nullptr);
+                        vector<unsigned char> out(out_size);
+                        av_image_copy_to_buffer(out.data(), out_size, frame->data, frame->linesize, c.out, width, height, 1);
+                        to_lavc_vid_conv_destroy(&conv);
+                        if (strcmp(impl, "scalar") == 0) {
+                                scalar = out;
+                        } else {
+                                ASSERT_MESSAGE("SIMD conversion to "s + av_get_pix_fmt_name(c.out) + " (" + impl + ") differs from scalar", out == scalar);
+                        }
+                }
+        }
+        set_commandline_param("pixfmt-conv-impl", "auto");
+        return 0;
+}
+
+/**
+ * Checks that frame not needing conversion is passed to the encoder without
+ * a copy and the input is released only after the last reference is dropped.
+ */
+int ff_codec_conversions_test_to_lavc_zero_copy()
+{
+        constexpr int width = 1920;
+        constexpr int height = 2;
+        alignas(32) static char in[width * height * 2];
+        bool released = false;
+        auto release = [](void *flag) { *static_cast<bool *>(flag) = true; };
+
+        struct to_lavc_vid_conv *conv = to_lavc_vid_conv_init(UYVY, width, height, AV_PIX_FMT_UYVY422, 1);
+        ASSERT(conv != nullptr);
+        AVFrame *frame = to_lavc_vid_conv_zero_copy(conv, in, 0, release, &released);
+        ASSERT(frame != nullptr);
+        ASSERT(frame->data[0] == reinterpret_cast<uint8_t *>(in));
+        AVFrame *encoder_ref = av_frame_clone(frame); // as kept by the encoder
+        to_lavc_vid_conv_release_input(conv);
+        ASSERT(!released);
+        av_frame_free(&encoder_ref);
+        ASSERT(released);
+
+        released = false; // unaligned input is copied and released immediately
+        frame = to_lavc_vid_conv_zero_copy(conv, in + 4, 0, release, &released);
+        ASSERT(frame != nullptr);
+        ASSERT(frame->data[0] != reinterpret_cast<uint8_t *>(in + 4));
+        ASSERT(released);
+        to_lavc_vid_conv_destroy(&conv);
+        return 0;
+}
+
 #endif // HAVE_LAVC
@@ -4,22 +4,443 @@
 #include "config_win32.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <list>
+#include <memory>
+#include <vector>
 #include <sstream>
+#include <thread>
 
+#include "host.h"
+#include "pixfmt_conv.h"
+#include "rtp/ldgm.h"
+#include "rtp/received_ranges.h"
+#include "rtp/rlc.h"
+#include "rtp/rtp_callback.h"
+#include "rtp/rtp_hdrext.h"
+#include "rtp/rtp_trace.h"
 #include "types.h"
+#include "utils/fs.h"
+#include "utils/gf256.h"
+#include "utils/spsc_queue.h"
 #include "utils/string.h"
+#include "utils/ulw.h"
+#include "utils/vf_split.h"
+#include "utils/worker.h"
 #include "unit_common.h"
 #include "video.h"
+#include "video_codec.h"
 #include "video_frame.h"
 
 extern "C" {
+        int misc_test_gf256_kernels();
+        int misc_test_ldgm_parallel_encode();
+        int misc_test_parallel_range();
+        int misc_test_pixfmt_conv_simd();
+        int misc_test_received_ranges();
         int misc_test_replace_all();
+        int misc_test_rlc_recovery();
+        int misc_test_rtp_trace();
+        int misc_test_spsc_queue();
+        int misc_test_ulw_roundtrip();
         int misc_test_video_desc_io_op_symmetry();
 }
 
 using namespace std;
 
+/// checks SIMD GF(2^8) dot product kernels against the scalar one
+int misc_test_gf256_kernels()
+{
+        ASSERT_EQUAL(0x1d, (int) gf256_mul(0x80, 2)); // 0x11D polynomial (zfec)
+        ASSERT_EQUAL(1, (int) gf256_mul(0x8e, 2)); // 0x8e = 2^-1
+
+        const int count = 23;
+        const size_t len = 1000 + 13; // not a multiple of vector size
+        vector<unsigned char> data(count * len);
+        vector<unsigned char> coeffs(count);
+        const unsigned char *src[count];
+        srand(1);
+        for (auto &b : data) {
+                b = rand();
+        }
+        for (int j = 0; j < count; ++j) {
+                coeffs[j] = j == 0 ? 0 : j == 1 ? 1 : rand();
+                src[j] = data.data() + j * len;
+        }
+        vector<unsigned char> ref(len);
+        gf256_get_impl("generic")->dot(ref.data(), src, coeffs.data(), count, len);
+        for (size_t i = 0; i < len; i += 97) {
+                unsigned char acc = 0;
+                for (int j = 0; j < count; ++j) {
+                        acc ^= gf256_mul(coeffs[j], src[j][i]);
+                }
+                ASSERT_EQUAL((int) acc, (int) ref[i]);
+        }
+
+        for (const struct gf256_impl *it = gf256_get_impls(); it->name != NULL; ++it) {
+                if (!it->available()) {
+                        continue;
+                }
+                vector<unsigned char> out(len + 1, 0xAA);
+                it->dot(out.data() + 1, src, coeffs.data(), count, len); // unaligned dst
+                ASSERT_MESSAGE(it->name, memcmp(out.data() + 1, ref.data(), len) == 0);
+                ASSERT_MESSAGE(it->name, out[0] == 0xAA);
+        }
+        return 0;
+}
+
+/// checks that the tile/parity-range parallel LDGM encoding matches the serial one
+int misc_test_ldgm_parallel_encode()
+{
+        struct video_desc desc{1024, 512, UYVY, 30, PROGRESSIVE, 2};
+        shared_ptr<video_frame> in(vf_alloc_desc_data(desc), vf_free);
+        srand(0);
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                for (unsigned j = 0; j < in->tiles[i].data_len; ++j) {
+                        in->tiles[i].data[j] = rand();
+                }
+        }
+
+        set_commandline_param("ldgm-threads", "1");
+        ldgm serial(256, 192, 5, 1);
+        set_commandline_param("ldgm-threads", "7");
+        ldgm parallel(256, 192, 5, 1);
+        commandline_params.erase("ldgm-threads");
+
+        shared_ptr<video_frame> ref = serial.encode(in);
+        shared_ptr<video_frame> out = parallel.encode(in);
+        ASSERT_EQUAL(ref->fec_params.symbol_size, out->fec_params.symbol_size);
+        for (unsigned i = 0; i < in->tile_count; ++i) {
+                ASSERT_EQUAL(ref->tiles[i].data_len, out->tiles[i].data_len);
+                ASSERT(memcmp(ref->tiles[i].data, out->tiles[i].data, ref->tiles[i].data_len) == 0);
+        }
+        return 0;
+}
+
+/// checks sliding-window FEC recovery of lost source symbols
+int misc_test_rlc_recovery()
+{
+        struct video_desc desc{256, 64, UYVY, 30, PROGRESSIVE, 1};
+        shared_ptr<video_frame> in(vf_alloc_desc_data(desc), vf_free);
+        srand(0);
+        for (unsigned j = 0; j < in->tiles[0].data_len; ++j) {
+                in->tiles[0].data[j] = rand();
+        }
+
+        rlc enc("1000:16:8:2");
+        shared_ptr<video_frame> out = enc.encode(in);
+        const struct fec_desc &fd = out->fec_params;
+        ASSERT_EQUAL(FEC_RLC, fd.type);
+        const int ss = fd.symbol_size;
+        const int n = out->tiles[0].data_len / ss;
+        // 33 source symbols in 5 groups (last one shortened), 2 repairs each
+        ASSERT_EQUAL(33 + 5 * 2, n);
+
+        auto try_decode = [&](vector<int> const &lost, bool expected) {
+                vector<char> buf(out->tiles[0].data, out->tiles[0].data + out->tiles[0].data_len);
+                received_ranges r;
+                for (int i = 0; i < n; ++i) {
+                        if (find(lost.begin(), lost.end(), i) == lost.end()) {
+                                r.add(i * ss, ss);
+                        } else {
+                                memset(buf.data() + i * ss, 0xAA, ss);
+                        }
+                }
+                rlc dec(fd.k, fd.m, fd.c, fd.seed);
+                char *data = nullptr;
+                int len = 0;
+                bool ret = dec.decode(buf.data(), buf.size(), &data, &len, r);
+                if (ret != expected) {
+                        return false;
+                }
+                return !expected || (len == (int) (sizeof(video_payload_hdr_t) + in->tiles[0].data_len) &&
+                                memcmp(data + sizeof(video_payload_hdr_t), in->tiles[0].data, in->tiles[0].data_len) == 0);
+        };
+        ASSERT(try_decode({}, true));
+        ASSERT(try_decode({0, 3}, true)); // first symbol carries length
+        ASSERT(try_decode({9, 10, 11, 15, 30}, true)); // 9 is a repair symbol
+        ASSERT(try_decode({41, 42}, true)); // last repairs only
+        ASSERT(try_decode({0, 1, 2, 3, 4}, false)); // 5 losses, only 4 covering repairs
+        return 0;
+}
+
+static void parallel_range_mark(void *udata, int begin, int end)
+{
+        auto *marks = static_cast<vector<atomic<int>> *>(udata);
+        for (int i = begin; i < end; ++i) {
+                (*marks)[i] += 1;
+        }
+}
+
+/// each item of the range must be processed exactly once, also with concurrent callers
+int misc_test_parallel_range()
+{
+        for (int count : { 0, 1, 7, 1080, 2161 }) {
+                for (int chunk : { 1, 2, 16, 5000 }) {
+                        vector<atomic<int>> marks(count);
+                        task_run_parallel_range(parallel_range_mark, &marks, count, chunk, 8);
+                        ASSERT(all_of(marks.begin(), marks.end(), [](const atomic<int> &m) { return m == 1; }));
+                }
+        }
+        atomic<bool> ok{true};
+        vector<thread> callers;
+        for (int i = 0; i < 3; ++i) {
+                callers.emplace_back([&ok] {
+                        for (int j = 0; j < 100; ++j) {
+                                vector<atomic<int>> marks(1080);
+                                task_run_parallel_range(parallel_range_mark, &marks, 1080, 14, 4);
+                                if (!all_of(marks.begin(), marks.end(), [](const atomic<int> &m) { return m == 1; })) {
+                                        ok = false;
+                                }
+                        }
+                });
+        }
+        for (auto &t : callers) {
+                t.join();
+        }
+        ASSERT(ok);
+
+        // nested parallel_for inside group tasks
+        atomic<int> sum{0};
+        struct task_group *g = task_group_create();
+        for (int i = 0; i < 16; ++i) {
+                task_group_run(g, [](void *arg) -> void * {
+                        parallel_for(100, 3, 4, [arg](int begin, int end) {
+                                *static_cast<atomic<int> *>(arg) += end - begin;
+                        });
+                        return nullptr;
+                }, &sum);
+        }
+        task_group_wait(g);
+        task_group_destroy(g);
+        ASSERT_EQUAL(1600, sum);
+        return 0;
+}
+
+/// checks that SIMD line converters output the same as scalar ones (including the bytes past dst_len)
+int misc_test_pixfmt_conv_simd()
+{
+        const codec_t pairs[][2] = {
+                { v210, UYVY }, { UYVY, v210 }, { v210, Y216 }, { v210, Y416 }, { Y216, v210 },
+                { Y216, UYVY }, { UYVY, Y216 }, { R10k, RG48 }, { RG48, R10k },
+                { R12L, RG48 }, { RG48, R12L }, { RGBA, UYVY },
+        };
+        const int widths[] = { 1, 2, 6, 8, 47, 48, 96, 250, 1920 };
+        srand(1);
+        for (const auto &p : pairs) {
+                decoder_t scalar = get_decoder_from_to_impl(p[0], p[1], "scalar");
+                ASSERT(scalar != nullptr);
+                for (const char *impl : { "sse4", "avx2", "avx512", "neon" }) {
+                        decoder_t simd = get_decoder_from_to_impl(p[0], p[1], impl);
+                        if (simd == nullptr) {
+                                continue;
+                        }
+                        for (int width : widths) {
+                                const int dst_len = vc_get_linesize(width, p[1]);
+                                vector<unsigned char> src(vc_get_linesize(width, p[0]) + MAX_PADDING);
+                                for (auto &b : src) {
+                                        b = rand();
+                                }
+                                vector<unsigned char> ref(dst_len + MAX_PADDING, 0xAA);
+                                vector<unsigned char> out(dst_len + MAX_PADDING, 0xAA);
+                                scalar(ref.data(), src.data(), dst_len, 0, 8, 16);
+                                simd(out.data(), src.data(), dst_len, 0, 8, 16);
+                                if (ref != out) {
+                                        fprintf(stderr, "%s %s->%s width %d differs\n", impl,
+                                                        get_codec_name(p[0]), get_codec_name(p[1]), width);
+                                        return -1;
+                                }
+                        }
+                }
+        }
+        return 0;
+}
+
+int misc_test_received_ranges()
+{
+        received_ranges r;
+        r.add(0, 100);
+        r.add(100, 100);
+        ASSERT_EQUAL(1, (int) r.size());
+        r.add(300, 100); // gap
+        r.add(500, 100);
+        r.add(150, 100); // duplicate overlapping first range
+        ASSERT_EQUAL(3, (int) r.size());
+        ASSERT_EQUAL(250, r.length_at(0));
+        ASSERT(r.contains(0, 250));
+        ASSERT(r.contains(520, 80));
+        ASSERT(!r.contains(200, 100)); // spans the gap
+        ASSERT(!r.contains(400, 10));
+        r.add(250, 250); // fills both gaps
+        ASSERT_EQUAL(1, (int) r.size());
+        ASSERT_EQUAL(600, r.length_at(0));
+        ASSERT_EQUAL(600, r.total());
+        r.clear();
+        ASSERT(r.empty() && !r.contains(0, 1));
+        return 0;
+}
+
+/// capture time written by the sender is parsed back (with a preceding foreign element)
+int misc_test_rtp_hdrext()
+{
+        const time_ns_t capture_time = 1'760'000'000'123'456'789LL;
+        uint32_t ext[RTP_HDREXT_ABS_CAPTURE_TIME_WORDS];
+        rtp_hdrext_write_abs_capture_time(ext, capture_time);
+
+        unsigned char wire[4 + 4 + sizeof ext] = { 0xBE, 0xDE, 0, 1 + RTP_HDREXT_ABS_CAPTURE_TIME_WORDS,
+                2U << 4U | 1U, 0xAA, 0xBB, 0 };
+        memcpy(wire + 8, ext, sizeof ext);
+        rtp_packet pckt{};
+        pckt.extn = wire;
+        pckt.extn_type = RTP_HDREXT_ONE_BYTE;
+        pckt.extn_len = 1 + RTP_HDREXT_ABS_CAPTURE_TIME_WORDS;
+        time_ns_t parsed = 0;
+        ASSERT(rtp_hdrext_parse_abs_capture_time(&pckt, &parsed));
+        ASSERT(llabs(parsed - capture_time) <= 1);
+
+        pckt.extn_type = 0x1000; // two-byte header form is not used
+        ASSERT(!rtp_hdrext_parse_abs_capture_time(&pckt, &parsed));
+        pckt.extn = nullptr;
+        ASSERT(!rtp_hdrext_parse_abs_capture_time(&pckt, &parsed));
+        return 0;
+}
+
+/// writes a trace and reads it back
+int misc_test_rtp_trace()
+{
+        const char *tmp_name = nullptr;
+        FILE *f = get_temp_file(&tmp_name);
+        ASSERT(f != nullptr);
+        fclose(f);
+        const string filename = tmp_name;
+        struct rtp_trace *t = rtp_trace_create(filename.c_str());
+        ASSERT(t != nullptr);
+        char data[1500];
+        for (unsigned i = 0; i < sizeof data; ++i) {
+                data[i] = (char) i;
+        }
+        for (int i = 1; i <= 10; ++i) {
+                ASSERT(rtp_trace_write(t, i * 1000000LL, 5004, 5006, data, i * 100));
+        }
+        rtp_trace_close(t);
+
+        t = rtp_trace_open(filename.c_str());
+        ASSERT(t != nullptr);
+        char buf[1500];
+        time_ns_t ts = 0;
+        uint16_t src_port = 0;
+        uint16_t dst_port = 0;
+        bool ok = true;
+        for (int i = 1; i <= 10; ++i) {
+                ok = ok && rtp_trace_read(t, &ts, &src_port, &dst_port, buf, sizeof buf) == i * 100
+                        && ts == i * 1000000LL && src_port == 5004 && dst_port == 5006
+                        && memcmp(buf, data, i * 100) == 0;
+        }
+        ok = ok && rtp_trace_read(t, &ts, &src_port, &dst_port, buf, sizeof buf) == 0;
+        rtp_trace_rewind(t);
+        ok = ok && rtp_trace_read(t, &ts, nullptr, nullptr, buf, 50) == 50; // truncated
+        rtp_trace_close(t);
+        remove(filename.c_str());
+        ASSERT(ok);
+        return 0;
+}
+
+/// passes items through a short queue with both sides blocking alternately
+int misc_test_spsc_queue()
+{
+        constexpr int count = 100000;
+        for (int spin : { 0, 1000 }) {
+                spsc_queue<unique_ptr<int>, 2> q;
+                q.set_spin_count(spin);
+                ASSERT(!q.pop(true));
+                thread producer([&q] {
+                        for (int i = 1; i <= count; ++i) {
+                                q.push(make_unique<int>(i));
+                        }
+                });
+                int expected = 1;
+                bool in_order = true;
+                while (expected <= count) {
+                        unique_ptr<int> item = q.pop();
+                        in_order = in_order && item && *item == expected;
+                        expected += 1;
+                }
+                producer.join();
+                ASSERT(in_order);
+                ASSERT_EQUAL(0, q.size());
+        }
+        return 0;
+}
+
+/// view tiles must have the same content as the tiles copied by vf_split()
+int misc_test_vf_split_view()
+{
+        struct video_desc desc = { 64, 32, UYVY, 30, PROGRESSIVE, 1 };
+        struct video_frame *src = vf_alloc_desc_data(desc);
+        for (unsigned i = 0; i < src->tiles[0].data_len; ++i) {
+                src->tiles[0].data[i] = (char) (i * 7);
+        }
+        for (unsigned x_count : { 1, 4 }) {
+                const unsigned y_count = 2;
+                struct video_desc tile_desc = desc;
+                tile_desc.width /= x_count;
+                tile_desc.height /= y_count;
+                tile_desc.tile_count = x_count * y_count;
+                struct video_frame *copy = vf_alloc_desc_data(tile_desc);
+                vf_split(copy, src, x_count, y_count, 0);
+                struct video_frame *view = vf_split_view(src, x_count, y_count);
+                ASSERT(view != nullptr);
+                for (unsigned t = 0; t < tile_desc.tile_count; ++t) {
+                        ASSERT(x_count != 1 || view->tiles[t].linesize == 0);
+                        int linesize = tile_get_linesize(&view->tiles[t], UYVY);
+                        int tile_linesize = vc_get_linesize(tile_desc.width, UYVY);
+                        for (unsigned y = 0; y < tile_desc.height; ++y) {
+                                ASSERT(memcmp(view->tiles[t].data + y * linesize,
+                                                        copy->tiles[t].data + y * tile_linesize, tile_linesize) == 0);
+                        }
+                }
+                view->callbacks.dispose_udata = nullptr; // keep src
+                VIDEO_FRAME_DISPOSE(view);
+                vf_free(copy);
+        }
+        vf_free(src);
+        return 0;
+}
+
+/// stripes complete when all their bytes are reported, in any order
+int misc_test_vf_stripes()
+{
+        struct video_desc desc = { 16, 10, RGBA, 30, PROGRESSIVE, 1 };
+        struct video_frame *f = vf_alloc_desc(desc);
+        const int linesize = vc_get_linesize(desc.width, RGBA);
+        ASSERT(vf_stripes_enable(f, 4));
+        ASSERT_EQUAL(3, vf_stripes_count(f));
+        ASSERT_EQUAL(8, (int) vf_stripe_first_row(f, 2));
+        ASSERT_EQUAL(10, (int) vf_stripe_first_row(f, 3));
+
+        // packets not aligned to the rows, received out of order
+        vf_stripes_add(f, linesize, 5 * linesize - 10, 3 * linesize);
+        ASSERT(!vf_stripe_is_complete(f, 0) && !vf_stripe_is_complete(f, 1));
+        vf_stripes_add(f, linesize, 0, 5 * linesize - 10);
+        ASSERT(vf_stripe_is_complete(f, 0) && !vf_stripe_is_complete(f, 1));
+        std::thread waiter([f] { vf_stripe_wait(f, 2); });
+        vf_stripes_add(f, linesize, 8 * linesize - 10, 2 * linesize + 10);
+        waiter.join();
+        ASSERT(vf_stripe_is_complete(f, 1) && vf_stripe_is_complete(f, 2));
+
+        vf_stripes_reset(f);
+        ASSERT(!vf_stripe_is_complete(f, 0));
+        vf_stripes_complete(f);
+        for (int i = 0; i < vf_stripes_count(f); ++i) {
+                ASSERT(vf_stripe_is_complete(f, i));
+        }
+        vf_free(f);
+        return 0;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wstring-concatenation"
 #endif
@@ -36,6 +457,38 @@ int misc_test_replace_all()
         return 0;
 }
 
+/// ULW - q 0 is lossless, rate-controlled frame fits the budget
+int misc_test_ulw_roundtrip()
+{
+        const int width = 258; // not a multiple of the group/decomposition size
+        const int height = 37;
+        const int linesize = vc_get_linesize(width, Y216);
+        vector<unsigned char> src(linesize * height);
+        vector<unsigned char> dst(src.size());
+        for (int y = 0; y < height; ++y) {
+                auto *line = (uint16_t *)(void *) (src.data() + y * linesize);
+                for (int x = 0; x < 2 * width; ++x) {
+                        line[x] = ((x * 13 + y * 7 + (x * y) % 11) & 0x3FF) << 6;
+                }
+        }
+
+        vector<unsigned char> out(ulw_max_size(width, height, ULW_DEFAULT_SLICE_HEIGHT, 0));
+        size_t len = ulw_encode(src.data(), linesize, ULW_Y216, width, height, 10,
+                        ULW_DEFAULT_SLICE_HEIGHT, 0, 0, out.data());
+        ASSERT(len <= out.size());
+        ASSERT(ulw_decode(out.data(), len, dst.data(), linesize, ULW_Y216));
+        ASSERT(src == dst);
+
+        const double bpp = 4;
+        out.resize(ulw_max_size(width, height, ULW_DEFAULT_SLICE_HEIGHT, bpp));
+        len = ulw_encode(src.data(), linesize, ULW_Y216, width, height, 10,
+                        ULW_DEFAULT_SLICE_HEIGHT, bpp, 0, out.data());
+        ASSERT(len <= out.size());
+        ASSERT(ulw_decode(out.data(), len, dst.data(), linesize, ULW_Y216));
+        ASSERT(!ulw_decode(out.data(), len / 2, dst.data(), linesize, ULW_Y216));
+        return 0;
+}
+
 int misc_test_video_desc_io_op_symmetry()
 {
         const std::list<video_desc> test_desc = {
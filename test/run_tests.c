@@ -81,12 +81,27 @@ DECLARE_TEST(ff_codec_conversions_test_yuv444pXXle_from_to_r12l);
 DECLARE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48);
 DECLARE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48_out_of_range);
 DECLARE_TEST(ff_codec_conversions_test_pX10_from_to_v210);
+DECLARE_TEST(ff_codec_conversions_test_simd_from_lavc);
+DECLARE_TEST(ff_codec_conversions_test_simd_to_lavc);
+DECLARE_TEST(ff_codec_conversions_test_to_lavc_zero_copy);
 DECLARE_TEST(get_framerate_test_2997);
 DECLARE_TEST(get_framerate_test_3000);
 DECLARE_TEST(get_framerate_test_free);
 DECLARE_TEST(gpujpeg_test_simple);
 DECLARE_TEST(libavcodec_test_get_decoder_from_uv_to_uv);
+DECLARE_TEST(misc_test_gf256_kernels);
+DECLARE_TEST(misc_test_ldgm_parallel_encode);
+DECLARE_TEST(misc_test_parallel_range);
+DECLARE_TEST(misc_test_pixfmt_conv_simd);
+DECLARE_TEST(misc_test_received_ranges);
 DECLARE_TEST(misc_test_replace_all);
+DECLARE_TEST(misc_test_rlc_recovery);
+DECLARE_TEST(misc_test_rtp_hdrext);
+DECLARE_TEST(misc_test_rtp_trace);
+DECLARE_TEST(misc_test_spsc_queue);
+DECLARE_TEST(misc_test_ulw_roundtrip);
+DECLARE_TEST(misc_test_vf_split_view);
+DECLARE_TEST(misc_test_vf_stripes);
 DECLARE_TEST(misc_test_video_desc_io_op_symmetry);
 
 struct {
@@ -112,12 +127,27 @@ struct {
         DEFINE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48),
         DEFINE_TEST(ff_codec_conversions_test_yuv444p16le_from_to_rg48_out_of_range),
         DEFINE_TEST(ff_codec_conversions_test_pX10_from_to_v210),
+        DEFINE_TEST(ff_codec_conversions_test_simd_from_lavc),
+        DEFINE_TEST(ff_codec_conversions_test_simd_to_lavc),
+        DEFINE_TEST(ff_codec_conversions_test_to_lavc_zero_copy),
         DEFINE_TEST(get_framerate_test_2997),
         DEFINE_TEST(get_framerate_test_3000),
         DEFINE_TEST(get_framerate_test_free),
         DEFINE_TEST(gpujpeg_test_simple),
         DEFINE_TEST(libavcodec_test_get_decoder_from_uv_to_uv),
+        DEFINE_TEST(misc_test_gf256_kernels),
+        DEFINE_TEST(misc_test_ldgm_parallel_encode),
+        DEFINE_TEST(misc_test_parallel_range),
+        DEFINE_TEST(misc_test_pixfmt_conv_simd),
+        DEFINE_TEST(misc_test_received_ranges),
         DEFINE_TEST(misc_test_replace_all),
+        DEFINE_TEST(misc_test_rlc_recovery),
+        DEFINE_TEST(misc_test_rtp_hdrext),
+        DEFINE_TEST(misc_test_rtp_trace),
+        DEFINE_TEST(misc_test_spsc_queue),
+        DEFINE_TEST(misc_test_ulw_roundtrip),
+        DEFINE_TEST(misc_test_vf_split_view),
+        DEFINE_TEST(misc_test_vf_stripes),
         DEFINE_TEST(misc_test_video_desc_io_op_symmetry),
 };
 
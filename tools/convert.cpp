@@ -1,22 +1,35 @@
 #include <cassert>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "../src/config_unix.h"
+#include "../src/utils/misc.h"
+#include "../src/utils/parallel_conv.h"
 #include "../src/video_codec.h"
 
+using std::chrono::duration;
 using std::chrono::duration_cast;
 using std::chrono::high_resolution_clock;
+using std::chrono::steady_clock;
 using std::chrono::microseconds;
 using std::cout;
 using std::cerr;
 using std::exception;
 using std::ifstream;
 using std::ofstream;
+using std::runtime_error;
 using std::stoi;
 using std::string;
 using std::vector;
@@ -59,7 +72,132 @@ static void print_conversions() {
         }
 }
 
+/**
+ * memory-mapped file, output is created (truncated) with the given size
+ */
+struct mapped_file {
+        mapped_file(const char *path, size_t out_size = 0) {
+                bool output = out_size > 0;
+                fd = open(path, output ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+                if (fd == -1) {
+                        throw runtime_error(string("open ") + path);
+                }
+                if (output) {
+                        if (ftruncate(fd, out_size) == -1) {
+                                close(fd);
+                                throw runtime_error(string("ftruncate ") + path);
+                        }
+                        size = out_size;
+                } else {
+                        struct stat st{};
+                        fstat(fd, &st);
+                        size = st.st_size;
+                }
+                if (size == 0) {
+                        return;
+                }
+                data = static_cast<char *>(mmap(nullptr, size, output ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0));
+                if (data == MAP_FAILED) {
+                        close(fd);
+                        throw runtime_error(string("mmap ") + path);
+                }
+                madvise(data, size, MADV_SEQUENTIAL);
+        }
+        ~mapped_file() {
+                if (data != nullptr && data != MAP_FAILED) {
+                        munmap(data, size);
+                }
+                close(fd);
+        }
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        int fd = -1;
+        char *data = nullptr;
+        size_t size = 0;
+};
+
+/**
+ * Converts a sequence of raw frames (concatenated in the file) with
+ * parallel_pix_conv() - the same row-parallel conversion the pipeline uses.
+ * Without an output file, frames are converted into a scratch buffer only
+ * (a benchmark of the conversion incl. reading the input).
+ */
+static int batch(int argc, char *argv[]) {
+        int threads = get_cpu_core_count();
+        int repeat = 1;
+        int opt = 0;
+        while ((opt = getopt(argc, argv, "j:n:")) != -1) {
+                switch (opt) {
+                case 'j': threads = stoi(optarg); break;
+                case 'n': repeat = stoi(optarg); break;
+                default: return 1;
+                }
+        }
+        if (argc - optind < 5) {
+                cerr << "Usage: batch [-j <threads>] [-n <repeat>] <width> <height> <in_codec> <out_codec> <in_file> [<out_file>]\n";
+                return 1;
+        }
+        int width = stoi(argv[optind]);
+        int height = stoi(argv[optind + 1]);
+        codec_t in_codec = get_codec_from_name(argv[optind + 2]);
+        codec_t out_codec = get_codec_from_name(argv[optind + 3]);
+        if (width <= 0 || height <= 0 || in_codec == VIDEO_CODEC_NONE || out_codec == VIDEO_CODEC_NONE || threads <= 0 || repeat <= 0) {
+                cerr << "Wrong parameters!\n";
+                return 1;
+        }
+        auto *decode = get_decoder_from_to(in_codec, out_codec);
+        if (decode == nullptr) {
+                cerr << "Cannot find decoder from " << argv[optind + 2] << " to " << argv[optind + 3] << "!\n";
+                return 1;
+        }
+        const int in_linesize = vc_get_linesize(width, in_codec);
+        const int out_linesize = vc_get_linesize(width, out_codec);
+        const size_t in_frame_len = vc_get_datalen(width, height, in_codec);
+        const size_t out_frame_len = vc_get_datalen(width, height, out_codec);
+
+        mapped_file in(argv[optind + 4]);
+        const size_t frames = in.size / in_frame_len;
+        if (frames == 0) {
+                cerr << "Input file doesn't contain a whole frame!\n";
+                return 1;
+        }
+        if (in.size % in_frame_len != 0) {
+                cerr << "Warning: " << in.size % in_frame_len << " trailing bytes ignored\n";
+        }
+        std::unique_ptr<mapped_file> out;
+        vector<char> scratch;
+        if (argc - optind > 5) {
+                out = std::make_unique<mapped_file>(argv[optind + 5], frames * out_frame_len);
+        } else {
+                scratch.resize(out_frame_len + MAX_PADDING);
+        }
+
+        auto t0 = steady_clock::now();
+        for (int r = 0; r < repeat; ++r) {
+                for (size_t i = 0; i < frames; ++i) {
+                        char *dst = out ? out->data + i * out_frame_len : scratch.data();
+                        parallel_pix_conv(height, dst, out_linesize, in.data + i * in_frame_len, in_linesize, decode, threads);
+                }
+        }
+        double secs = duration<double>(steady_clock::now() - t0).count();
+        double total = static_cast<double>(frames) * repeat;
+        printf("%s->%s %dx%d, %d threads: %zu frames x %d in %.3f s, %.1f fps, %.1f ms/frame, "
+                        "in %.1f MB/s, out %.1f MB/s\n", get_codec_name(in_codec), get_codec_name(out_codec),
+                        width, height, threads, frames, repeat, secs, total / secs, 1000.0 * secs / total,
+                        total * in_frame_len / secs / 1e6, total * out_frame_len / secs / 1e6);
+        return 0;
+}
+
 int main(int argc, char *argv[]) {
+        if (argc >= 2 && string("batch") == argv[1]) {
+                try {
+                        return batch(argc - 1, argv + 1);
+                } catch (exception &e) {
+                        cerr << "ERROR: " << e.what() << ": " << strerror(errno) << "\n";
+                        return 1;
+                }
+        }
         if (argc == 2 && string("list-conversions") == argv[1]) {
                 print_conversions();
                 return 0;
@@ -71,9 +209,12 @@ int main(int argc, char *argv[]) {
         if (argc < 7) {
                 cout << "Tool to convert between UltraGrid raw pixel format with supported conversions.\n\n"
                         "Usage:\n"
-                        "\t" << argv[0] << " <width> <height> <in_codec> <out_codec> <in_file> <out_file> | benchmark | help | list-conversions\n"
+                        "\t" << argv[0] << " <width> <height> <in_codec> <out_codec> <in_file> <out_file> | batch <opts> | benchmark | help | list-conversions\n"
                         "\n"
                         "where\n"
+                        "\t" << "batch [-j <threads>] [-n <repeat>] <width> <height> <in_codec> <out_codec> <in_file> [<out_file>]\n"
+                        "\t" << "                 - convert all frames of a raw file in parallel, print throughput\n"
+                        "\t" << "                   (without <out_file> only a benchmark)\n"
                         "\t" << "benchmark        - benchmark conversions\n"
                         "\t" << "help             - show this help\n"
                         "\t" << "list-conversions - prints valid conversion pairs\n";
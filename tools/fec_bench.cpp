@@ -0,0 +1,363 @@
+/**
+ * @file   tools/fec_bench.cpp
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  in-process benchmark of the RTP/FEC path over an impaired loopback
+ *
+ * Sends uncompressed frames with tx_send() (FEC encoded as the sender does)
+ * to a receiving RTP session on the loopback, whose socket impairs the
+ * received packets (udp-impair), and decodes them with pbuf and the video
+ * decoder to the dummy display. For each FEC configuration, goodput, the
+ * ratio of frames that were displayed and the CPU usage per Gbps of goodput
+ * are printed as JSON.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "messaging.h"
+#include "module.h"
+#include "pdb.h"
+#include "rtp/fec.h"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "rtp/rtp_callback.h"
+#include "rtp/video_decoders.h"
+#include "transmit.h"
+#include "tv.h"
+#include "utils/metrics.h"
+#include "video.h"
+#include "video_display.h"
+
+using std::cout;
+using std::string;
+using std::vector;
+
+#define RECV_BUF_SIZE (64 * 1024 * 1024)
+
+struct bench_opts {
+        vector<string> fecs{"none", "mult:2", "ldgm", "rs"};
+        string impair = "loss=1:burst=2:jitter=1:delay=1";
+        int width = 1920;
+        int height = 1080;
+        double fps = 30;
+        double duration = 5; ///< sending time per FEC configuration [s]
+        int mtu = 1500;
+        int port = 15004;
+};
+
+struct bench_result {
+        string fec;
+        unsigned long long sent;
+        unsigned long long displayed;
+        unsigned long long corrupted;
+        double seconds;
+        double goodput_bps;
+        double wire_bps;
+        double cpu_seconds;
+};
+
+/// @returns sum of the values of all samples of the series (name with labels)
+static unsigned long long metric_value(const string &series)
+{
+        char *scrape = metrics_scrape();
+        unsigned long long ret = 0;
+        for (const char *line = scrape; line != nullptr && *line != '\0'; ) {
+                if (strncmp(line, series.c_str(), series.size()) == 0 && line[series.size()] == ' ') {
+                        ret += strtoull(line + series.size() + 1, nullptr, 10);
+                }
+                line = strchr(line, '\n');
+                line = line != nullptr ? line + 1 : nullptr;
+        }
+        free(scrape);
+        return ret;
+}
+
+static double cpu_time()
+{
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1E6;
+}
+
+/// creates the FEC encoder the same way as the sender does - from the tx message
+static fec *get_fec_state(struct module *sender_mod)
+{
+        fec *ret = nullptr;
+        struct message *msg = nullptr;
+        while ((msg = check_message(sender_mod)) != nullptr) {
+                auto *data = reinterpret_cast<struct msg_sender *>(msg);
+                if (data->type == SENDER_MSG_CHANGE_FEC && strcmp(data->fec_cfg, "flush") != 0) {
+                        delete ret;
+                        ret = fec::create_from_config(data->fec_cfg);
+                }
+                free_message(msg, nullptr);
+        }
+        return ret;
+}
+
+static void receiver_loop(struct rtp *session, struct pdb *participants, struct vcodec_state *vdecoder,
+                std::atomic<bool> *should_exit)
+{
+        while (!*should_exit) {
+                struct timeval timeout { 0, 1000 };
+                rtp_recv_r(session, &timeout, 0);
+                time_ns_t curr_time = get_time_in_ns();
+                pdb_iter_t it;
+                struct pdb_e *cp = pdb_iter_init(participants, &it);
+                while (cp != nullptr) {
+                        cp->decoder_state = vdecoder;
+                        pbuf_decode(cp->playout_buffer, curr_time, decode_video_frame, vdecoder);
+                        pbuf_remove(cp->playout_buffer, curr_time);
+                        cp = pdb_iter_next(&it);
+                }
+                pdb_iter_done(&it);
+        }
+}
+
+static bool bench_fec(const bench_opts &opts, struct module *root, const string &fec_cfg, bench_result *res)
+{
+        struct module sender_mod;
+        module_init_default(&sender_mod);
+        sender_mod.cls = MODULE_CLASS_SENDER;
+        module_register(&sender_mod, root);
+
+        volatile int delay_ms = 0;
+        struct pdb *participants = pdb_init(&delay_ms);
+        struct rtp *rx = rtp_init_if("127.0.0.1", nullptr, opts.port, opts.port, 255, 1000, false,
+                        rtp_recv_callback, (uint8_t *) participants, 0, true);
+        struct rtp *tx_session = rtp_init_if("127.0.0.1", nullptr, opts.port + 2, opts.port, 255, 1000, false,
+                        rtp_recv_callback, nullptr, 0, false);
+        struct display *display = nullptr;
+        struct tx *tx = nullptr;
+        struct vcodec_state vdecoder{};
+        fec *fec_state = nullptr;
+        bool ret = false;
+        if (rx == nullptr || tx_session == nullptr
+                        || initialize_video_display(root, "dummy", "", 0, nullptr, &display) != 0
+                        || (vdecoder.decoder = video_decoder_init(root, VIDEO_NORMAL, display, nullptr)) == nullptr
+                        || (tx = tx_init(&sender_mod, opts.mtu, TX_MEDIA_VIDEO, fec_cfg.c_str(), nullptr, RATE_UNLIMITED)) == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, "Unable to initialize benchmark for FEC %s!\n", fec_cfg.c_str());
+                goto cleanup;
+        }
+        {
+                rtp_set_option(rx, RTP_OPT_WEAK_VALIDATION, true);
+                rtp_set_option(rx, RTP_OPT_PROMISC, true);
+                rtp_set_recv_buf(rx, RECV_BUF_SIZE);
+                rtp_set_send_buf(tx_session, RECV_BUF_SIZE);
+                fec_state = get_fec_state(&sender_mod);
+
+                struct video_desc desc { (unsigned) opts.width, (unsigned) opts.height, UYVY, opts.fps, PROGRESSIVE, 1 };
+                std::shared_ptr<video_frame> frame(vf_alloc_desc_data(desc), vf_free);
+                std::minstd_rand gen(0);
+                for (unsigned i = 0; i < frame->tiles[0].data_len; ++i) {
+                        frame->tiles[0].data[i] = gen();
+                }
+
+                std::atomic<bool> should_exit{false};
+                std::thread receiver(receiver_loop, rx, participants, &vdecoder, &should_exit);
+
+                const string displayed_series = "ug_video_decoder_frames_total{result=\"displayed\"}";
+                const string corrupted_series = "ug_video_decoder_frames_total{result=\"corrupted\"}";
+                unsigned long long displayed_start = metric_value(displayed_series);
+                unsigned long long corrupted_start = metric_value(corrupted_series);
+                unsigned long long wire_start = metric_value("ug_rtp_tx_bytes_total");
+                double cpu_start = cpu_time();
+                time_ns_t start = get_time_in_ns();
+
+                long long count = (long long) (opts.duration * opts.fps);
+                for (long long i = 0; i < count; ++i) {
+                        std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::nanoseconds(
+                                                start + (time_ns_t) (i * NS_IN_SEC_DBL / opts.fps) - get_time_in_ns()));
+                        auto tx_frame = fec_state != nullptr ? fec_state->encode(frame) : frame;
+                        tx_send(tx, tx_frame.get(), tx_session);
+                }
+                time_ns_t end = get_time_in_ns();
+                std::this_thread::sleep_for(std::chrono::seconds(1)); // let the impaired and queued packets arrive
+                should_exit = true;
+                receiver.join();
+
+                res->fec = fec_cfg;
+                res->sent = count;
+                res->displayed = metric_value(displayed_series) - displayed_start;
+                res->corrupted = metric_value(corrupted_series) - corrupted_start;
+                res->seconds = (end - start) / NS_IN_SEC_DBL;
+                res->goodput_bps = res->displayed * frame->tiles[0].data_len * 8.0 / res->seconds;
+                res->wire_bps = (metric_value("ug_rtp_tx_bytes_total") - wire_start) * 8.0 / res->seconds;
+                res->cpu_seconds = cpu_time() - cpu_start;
+                ret = true;
+        }
+cleanup:
+        delete fec_state;
+        if (tx != nullptr) {
+                module_done(CAST_MODULE(tx));
+        }
+        if (vdecoder.decoder != nullptr) {
+                video_decoder_destroy(vdecoder.decoder);
+        }
+        if (display != nullptr) {
+                display_done(display);
+        }
+        if (tx_session != nullptr) {
+                rtp_done(tx_session);
+        }
+        if (rx != nullptr) {
+                rtp_done(rx);
+        }
+        pdb_destroy(&participants);
+        module_done(&sender_mod);
+        return ret;
+}
+
+static void print_json(const bench_opts &opts, const vector<bench_result> &results)
+{
+        cout << "{\n\t\"version\": \"" << PACKAGE_VERSION << "\",\n"
+                << "\t\"impair\": \"" << opts.impair << "\",\n"
+                << "\t\"width\": " << opts.width << ",\n"
+                << "\t\"height\": " << opts.height << ",\n"
+                << "\t\"fps\": " << opts.fps << ",\n"
+                << "\t\"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+                const auto &r = results[i];
+                double goodput_gbps = r.goodput_bps / 1E9;
+                char line[1024];
+                snprintf(line, sizeof line, "\t\t{\"fec\": \"%s\", \"frames_sent\": %llu, \"frames_displayed\": %llu, "
+                                "\"frames_corrupted\": %llu, \"recovered_ratio\": %.4f, \"goodput_gbps\": %.3f, "
+                                "\"wire_gbps\": %.3f, \"cpu_cores\": %.3f, \"cpu_cores_per_gbps\": %.3f}%s\n",
+                                r.fec.c_str(), r.sent, r.displayed, r.corrupted,
+                                r.sent > 0 ? (double) r.displayed / r.sent : 0.0,
+                                goodput_gbps, r.wire_bps / 1E9, r.cpu_seconds / r.seconds,
+                                goodput_gbps > 0 ? r.cpu_seconds / r.seconds / goodput_gbps : 0.0,
+                                i + 1 < results.size() ? "," : "");
+                cout << line;
+        }
+        cout << "\t]\n}\n";
+}
+
+static void usage(const char *progname)
+{
+        cout << "Benchmarks UltraGrid RTP/FEC path on an impaired loopback, results are printed as JSON.\n\n"
+                "Usage:\n\t" << progname << " [-f <fec>[,<fec>...]] [-i <impair>] [-s <W>x<H>] [-r <fps>] [-d <seconds>] [-m <mtu>] [-p <port>]\n\n"
+                "where\n"
+                "\t-f - FEC configurations in -f syntax (default none,mult:2,ldgm,rs)\n"
+                "\t-i - network impairment, see \"--param udp-impair=help\" (default loss=1:burst=2:jitter=1:delay=1)\n"
+                "\t-s - frame size (default 1920x1080 UYVY)\n"
+                "\t-r - frame rate (default 30)\n"
+                "\t-d - sending duration per FEC configuration (default 5)\n"
+                "\t-m - MTU (default 1500)\n"
+                "\t-p - base UDP port (default 15004, port + 2 is used as well)\n";
+}
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        for (int i = 1; i < argc; ++i) {
+                string opt = argv[i];
+                if (opt == "-h" || opt == "--help" || i + 1 == argc) {
+                        usage(argv[0]);
+                        return opt == "-h" || opt == "--help" ? 0 : 1;
+                }
+                const char *val = argv[++i];
+                if (opt == "-f") {
+                        opts.fecs.clear();
+                        string list = val;
+                        for (size_t pos = 0; pos != string::npos; ) {
+                                size_t next = list.find(',', pos);
+                                opts.fecs.push_back(list.substr(pos, next == string::npos ? next : next - pos));
+                                pos = next == string::npos ? next : next + 1;
+                        }
+                } else if (opt == "-i") {
+                        opts.impair = val;
+                } else if (opt == "-s") {
+                        if (sscanf(val, "%dx%d", &opts.width, &opts.height) != 2) {
+                                usage(argv[0]);
+                                return 1;
+                        }
+                } else if (opt == "-r") {
+                        opts.fps = atof(val);
+                } else if (opt == "-d") {
+                        opts.duration = atof(val);
+                } else if (opt == "-m") {
+                        opts.mtu = atoi(val);
+                } else if (opt == "-p") {
+                        opts.port = atoi(val);
+                } else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        log_level = LOG_LEVEL_ERROR;
+        struct init_data *init = common_preinit(1, argv);
+        if (init == nullptr) {
+                return 2;
+        }
+        if (!opts.impair.empty()) {
+                set_commandline_param("udp-impair", opts.impair.c_str());
+        }
+        struct module root;
+        init_root_module(&root);
+
+        vector<bench_result> results;
+        for (const auto &fec_cfg : opts.fecs) {
+                bench_result res{};
+                if (bench_fec(opts, &root, fec_cfg, &res)) {
+                        results.push_back(res);
+                }
+        }
+        print_json(opts, results);
+
+        module_done(&root);
+        common_cleanup(init);
+        return results.size() == opts.fecs.size() ? 0 : 1;
+}
@@ -18,12 +18,19 @@ struct Ipc_frame_header{
         int height;
         int data_len;
         enum Ipc_frame_color_spec color_spec;
+
+        /* Shared memory transport (see ipc_frame_unix.h), zero for frames
+         * whose data follow the header */
+        int shm_slot; ///< 1-based index of the shared memory slot containing the data
+        int shm_ring; ///< id of the shared memory ring the slot belongs to
+        int shm_slot_size;
 };
 
 struct Ipc_frame{
         Ipc_frame_header header;
-        char *data;
+        char *data; ///< points either to buf or to memory owned by Ipc_frame_reader
 
+        char *buf;
         size_t alloc_size;
 };
 
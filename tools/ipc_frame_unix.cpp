@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <algorithm>
 #include <array>
 #include <string>
 
@@ -11,6 +12,12 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define IPC_FRAME_SHM
+#endif
 #define CLOSESOCKET close
 #define INVALID_SOCKET -1
 #define UNLINK unlink
@@ -30,6 +37,22 @@ typedef SOCKET fd_t;
 #define MSG_NOSIGNAL 0
 #endif
 
+/*
+ * Shared memory transport (Linux only)
+ *
+ * The reader announces the support by sending IPC_FRAME_MSG_SHM_HELLO
+ * after accepting the connection. The writer then places frame data to a
+ * ring of SHM_SLOTS slots in a sealed memfd and sends only the header
+ * (with shm_slot set) over the socket. The memfd is passed (SCM_RIGHTS)
+ * along with the first header referring to it. The reader maps it and
+ * returns the frame in place, the slot is handed back to the writer
+ * (release message with ring id and slot) on next read. If no slot is
+ * free or the peer doesn't support it, data are sent inline as before.
+ */
+#define IPC_FRAME_MSG_LEN 8
+#define IPC_FRAME_MSG_SHM_HELLO (-1)
+#define SHM_SLOTS 3
+
 namespace{
 struct Wsa_guard{
         Wsa_guard(){
@@ -53,8 +76,54 @@ struct Ipc_frame_reader{
         fd_t listen_fd;
         fd_t data_fd;
         std::string path;
+
+        char *shm_map = nullptr;
+        size_t shm_map_size = 0;
+        int shm_ring = 0; ///< ring currently mapped
+        int held_ring = 0; ///< slot passed to the user by last read
+        int held_slot = 0;
 };
 
+namespace{
+void send_msg(fd_t fd, int a, int b){
+        char msg[IPC_FRAME_MSG_LEN];
+        memcpy(msg, &a, sizeof a);
+        memcpy(msg + sizeof a, &b, sizeof b);
+        send(fd, msg, sizeof msg, MSG_NOSIGNAL);
+}
+
+#ifdef IPC_FRAME_SHM
+void reader_unmap(Ipc_frame_reader *reader){
+        if(reader->shm_map)
+                munmap(reader->shm_map, reader->shm_map_size);
+        reader->shm_map = nullptr;
+        reader->shm_map_size = 0;
+        reader->shm_ring = 0;
+}
+
+bool reader_map(Ipc_frame_reader *reader, int memfd, int ring){
+        reader_unmap(reader);
+
+        int seals = fcntl(memfd, F_GET_SEALS);
+        struct stat st;
+        if(seals == -1 || (seals & F_SEAL_SHRINK) == 0 || fstat(memfd, &st) == -1){
+                close(memfd);
+                return false;
+        }
+
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, memfd, 0);
+        close(memfd);
+        if(map == MAP_FAILED)
+                return false;
+
+        reader->shm_map = static_cast<char *>(map);
+        reader->shm_map_size = st.st_size;
+        reader->shm_ring = ring;
+        return true;
+}
+#endif
+} //anon namespace
+
 Ipc_frame_reader *ipc_frame_reader_new(const char *path){
         auto reader = new Ipc_frame_reader();
         reader->path = path;
@@ -99,12 +168,51 @@ void ipc_frame_reader_free(struct Ipc_frame_reader *reader){
 
         UNLINK(reader->path.c_str());
 
+#ifdef IPC_FRAME_SHM
+        reader_unmap(reader);
+#endif
         delete reader;
 }
 
-static size_t blocking_read(fd_t fd, char *dst, size_t size){
+/**
+ * @param[out] passed_fd  if not NULL, file descriptor received as an
+ *                        ancillary data (or -1)
+ */
+static size_t blocking_read(fd_t fd, char *dst, size_t size, int *passed_fd = nullptr){
         size_t bytes_read = 0;
 
+#ifdef IPC_FRAME_SHM
+        if(passed_fd){
+                *passed_fd = -1;
+                while(bytes_read < size){
+                        struct iovec iov = { dst + bytes_read, size - bytes_read };
+                        alignas(struct cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))];
+                        struct msghdr msg{};
+                        msg.msg_iov = &iov;
+                        msg.msg_iovlen = 1;
+                        msg.msg_control = cbuf;
+                        msg.msg_controllen = sizeof cbuf;
+
+                        ssize_t read_now = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+                        if(read_now <= 0)
+                                break;
+
+                        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+                        if(cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+                                if(*passed_fd != -1)
+                                        close(*passed_fd);
+                                memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+                        }
+
+                        bytes_read += read_now;
+                }
+                return bytes_read;
+        }
+#else
+        if(passed_fd)
+                *passed_fd = -1;
+#endif
+
         while(bytes_read < size){
                 int read_now = recv(fd, dst + bytes_read, size - bytes_read, 0);
                 if(read_now <= 0)
@@ -138,6 +246,10 @@ static bool try_accept(struct Ipc_frame_reader *reader){
                 return false;
 
         reader->data_fd = accept(reader->listen_fd, nullptr, 0);
+#ifdef IPC_FRAME_SHM
+        if(reader->data_fd != INVALID_SOCKET)
+                send_msg(reader->data_fd, IPC_FRAME_MSG_SHM_HELLO, 0);
+#endif
         return true;
 }
 
@@ -154,13 +266,44 @@ bool ipc_frame_reader_is_connected(struct Ipc_frame_reader *reader){
 
 static bool do_frame_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         char header_buf[IPC_FRAME_HEADER_LEN];
+        int passed_fd = -1;
+
+        // previously returned frame is no longer used by the caller
+        if(reader->held_slot != 0){
+                send_msg(reader->data_fd, reader->held_ring, reader->held_slot);
+                reader->held_slot = 0;
+        }
 
-        if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN) != IPC_FRAME_HEADER_LEN)
+        if(blocking_read(reader->data_fd, header_buf, IPC_FRAME_HEADER_LEN, &passed_fd) != IPC_FRAME_HEADER_LEN){
+                if(passed_fd != -1)
+                        close(passed_fd);
                 return false;
+        }
 
         if(!ipc_frame_parse_header(&dst->header, header_buf))
                 return false;
 
+        if(dst->header.shm_slot != 0){
+#ifdef IPC_FRAME_SHM
+                if(passed_fd != -1 && !reader_map(reader, passed_fd, dst->header.shm_ring))
+                        return false;
+                size_t offset = (size_t) (dst->header.shm_slot - 1) * dst->header.shm_slot_size;
+                if(dst->header.shm_ring != reader->shm_ring || dst->header.data_len > dst->header.shm_slot_size
+                                || offset + dst->header.data_len > reader->shm_map_size)
+                        return false;
+
+                dst->data = reader->shm_map + offset;
+                reader->held_ring = dst->header.shm_ring;
+                reader->held_slot = dst->header.shm_slot;
+                return true;
+#else
+                return false;
+#endif
+        }
+
+        if(passed_fd != -1)
+                close(passed_fd);
+
         if(!ipc_frame_reserve(dst, dst->header.data_len))
                 return false;
 
@@ -174,6 +317,10 @@ bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
         if(!ret){
                 CLOSESOCKET(reader->data_fd);
                 reader->data_fd = INVALID_SOCKET;
+                reader->held_slot = 0;
+#ifdef IPC_FRAME_SHM
+                reader_unmap(reader);
+#endif
         }
 
         return ret;
@@ -181,6 +328,16 @@ bool ipc_frame_reader_read(Ipc_frame_reader *reader, Ipc_frame *dst){
 
 struct Ipc_frame_writer{
         fd_t data_fd;
+
+        char msg[IPC_FRAME_MSG_LEN]; ///< partially received message from reader
+        size_t msg_len = 0;
+
+        bool shm_supported = false;
+        int memfd = -1;
+        char *shm_map = nullptr;
+        size_t slot_size = 0;
+        int ring = 0;
+        std::array<bool, SHM_SLOTS> slot_busy{};
 };
 
 Ipc_frame_writer *ipc_frame_writer_new(const char *path){
@@ -209,10 +366,53 @@ Ipc_frame_writer *ipc_frame_writer_new(const char *path){
         return writer;
 }
 
+#ifdef IPC_FRAME_SHM
+static void writer_unmap(Ipc_frame_writer *writer){
+        if(writer->shm_map)
+                munmap(writer->shm_map, writer->slot_size * SHM_SLOTS);
+        if(writer->memfd != -1)
+                close(writer->memfd);
+        writer->shm_map = nullptr;
+        writer->memfd = -1;
+        writer->slot_size = 0;
+}
+
+static bool writer_alloc_ring(Ipc_frame_writer *writer, size_t data_len){
+        writer_unmap(writer);
+
+        long page_size = sysconf(_SC_PAGESIZE);
+        size_t slot_size = (data_len + page_size - 1) / page_size * page_size;
+
+        int fd = memfd_create("ug_ipc_frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if(fd == -1)
+                return false;
+        if(ftruncate(fd, slot_size * SHM_SLOTS) == -1
+                        || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1){
+                close(fd);
+                return false;
+        }
+        void *map = mmap(nullptr, slot_size * SHM_SLOTS, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED){
+                close(fd);
+                return false;
+        }
+
+        writer->memfd = fd;
+        writer->shm_map = static_cast<char *>(map);
+        writer->slot_size = slot_size;
+        writer->ring += 1;
+        writer->slot_busy.fill(false);
+        return true;
+}
+#endif
+
 void ipc_frame_writer_free(struct Ipc_frame_writer *writer){
         if(writer->data_fd != INVALID_SOCKET)
                 CLOSESOCKET(writer->data_fd);
 
+#ifdef IPC_FRAME_SHM
+        writer_unmap(writer);
+#endif
         delete writer;
 }
 
@@ -230,12 +430,94 @@ void block_write(fd_t fd, void *buf, size_t size){
         }
 }
 
+#ifdef IPC_FRAME_SHM
+/// processes shm support announcement and slot releases sent by the reader
+void process_reader_msgs(Ipc_frame_writer *writer){
+        while(true){
+                int ret = recv(writer->data_fd, writer->msg + writer->msg_len,
+                                IPC_FRAME_MSG_LEN - writer->msg_len, MSG_DONTWAIT);
+                if(ret <= 0)
+                        return;
+                writer->msg_len += ret;
+                if(writer->msg_len < IPC_FRAME_MSG_LEN)
+                        continue;
+                writer->msg_len = 0;
+
+                int ring = 0;
+                int slot = 0;
+                memcpy(&ring, writer->msg, sizeof ring);
+                memcpy(&slot, writer->msg + sizeof ring, sizeof slot);
+                if(ring == IPC_FRAME_MSG_SHM_HELLO){
+                        writer->shm_supported = true;
+                } else if(ring == writer->ring && slot >= 1 && slot <= SHM_SLOTS){
+                        writer->slot_busy[slot - 1] = false;
+                }
+        }
+}
+
+/// @returns false if the frame cannot be passed in shared memory
+bool shm_write(Ipc_frame_writer *writer, const Ipc_frame *f){
+        int new_ring_fd = -1;
+        if(writer->slot_size < (size_t) f->header.data_len){
+                if(!writer_alloc_ring(writer, f->header.data_len))
+                        return false;
+                new_ring_fd = writer->memfd;
+        }
+
+        auto it = std::find(writer->slot_busy.begin(), writer->slot_busy.end(), false);
+        if(it == writer->slot_busy.end())
+                return false;
+        int slot = it - writer->slot_busy.begin();
+
+        memcpy(writer->shm_map + slot * writer->slot_size, f->data, f->header.data_len);
+
+        Ipc_frame_header hdr = f->header;
+        hdr.shm_slot = slot + 1;
+        hdr.shm_ring = writer->ring;
+        hdr.shm_slot_size = writer->slot_size;
+        std::array<char, IPC_FRAME_HEADER_LEN> header;
+        ipc_frame_write_header(&hdr, header.data());
+
+        struct iovec iov = { header.data(), header.size() };
+        alignas(struct cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))];
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if(new_ring_fd != -1){
+                msg.msg_control = cbuf;
+                msg.msg_controllen = sizeof cbuf;
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+                memcpy(CMSG_DATA(cmsg), &new_ring_fd, sizeof(int));
+        }
+
+        errno = 0;
+        ssize_t ret = sendmsg(writer->data_fd, &msg, MSG_NOSIGNAL);
+        if(ret == -1)
+                return true; // errno set, do not fall back
+        writer->slot_busy[slot] = true;
+        if((size_t) ret < header.size())
+                block_write(writer->data_fd, header.data() + ret, header.size() - ret);
+        return true;
+}
+#endif
+
 } //anon namespace
 
 bool ipc_frame_writer_write(struct Ipc_frame_writer *writer, const struct Ipc_frame *f){
+#ifdef IPC_FRAME_SHM
+        process_reader_msgs(writer);
+        if(writer->shm_supported && shm_write(writer, f))
+                return errno == 0;
+#endif
+
         std::array<char, IPC_FRAME_HEADER_LEN> header;
 
-        ipc_frame_write_header(&f->header, header.data());
+        Ipc_frame_header hdr = f->header;
+        hdr.shm_slot = 0;
+        ipc_frame_write_header(&hdr, header.data());
 
         errno = 0;
         block_write(writer->data_fd, header.data(), header.size());
@@ -10,6 +10,11 @@ void ipc_frame_reader_free(struct Ipc_frame_reader *reader);
 
 bool ipc_frame_reader_has_frame(struct Ipc_frame_reader *reader);
 bool ipc_frame_reader_is_connected(struct Ipc_frame_reader *reader);
+/**
+ * If the frame was passed in shared memory (Linux), dst->data points to
+ * memory owned by reader, valid until the next call of this function or
+ * ipc_frame_reader_free(). Otherwise data are copied to dst->buf.
+ */
 bool ipc_frame_reader_read(struct Ipc_frame_reader *reader, struct Ipc_frame *dst);
 
 struct Ipc_frame_writer;
@@ -0,0 +1,378 @@
+/**
+ * @file   tools/pixfmt_bench.cpp
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  benchmark of all pixel format conversions with JSON output
+ *
+ * Measures every get_decoder_from_to() pair (each available SIMD
+ * implementation single-threaded, the best one also with
+ * parallel_pix_conv()) and the conversions from/to libavcodec pixel
+ * formats. Run with "make bench".
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "pixfmt_conv.h"
+#include "utils/misc.h"
+#include "utils/parallel_conv.h"
+#include "video_codec.h"
+#ifdef HAVE_LAVC
+#include "libavcodec/from_lavc_vid_conv.h"
+#include "libavcodec/to_lavc_vid_conv.h"
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#endif
+
+using std::cerr;
+using std::cout;
+using std::string;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+static const char *const impls[] = { "scalar", "sse4", "avx2", "avx512", "neon" };
+
+struct bench_opts {
+        vector<std::pair<int, int>> sizes{{1920, 1080}, {3840, 2160}, {7680, 4320}};
+        int threads = get_cpu_core_count();
+        double min_time = 0.2; ///< minimal measured duration per conversion [s]
+        string filter; ///< substring of "<from>-><to>" to be benchmarked
+};
+
+struct bench_result {
+        string kind; ///< "uv", "from_lavc" or "to_lavc"
+        string from;
+        string to;
+        string impl;
+        int width;
+        int height;
+        int threads;
+        double seconds; ///< per frame
+        size_t bytes;   ///< input + output bytes per frame
+};
+
+/// runs fn repeatedly (after a warm-up run) for at least min_time
+/// @returns average duration of one run in seconds
+template<typename F>
+static double measure(const bench_opts &opts, F fn)
+{
+        fn();
+        int iterations = 0;
+        auto t0 = steady_clock::now();
+        double elapsed = 0;
+        do {
+                fn();
+                iterations += 1;
+                elapsed = duration<double>(steady_clock::now() - t0).count();
+        } while (elapsed < opts.min_time);
+        return elapsed / iterations;
+}
+
+static void fill_random(unsigned char *data, size_t len)
+{
+        std::minstd_rand gen(0);
+        for (size_t i = 0; i < len; ++i) {
+                data[i] = gen();
+        }
+}
+
+static bool filtered(const bench_opts &opts, const string &from, const string &to)
+{
+        return !opts.filter.empty() && (from + "->" + to).find(opts.filter) == string::npos;
+}
+
+static void bench_uv(const bench_opts &opts, vector<bench_result> &results)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_END; ++i) {
+                for (int j = VIDEO_CODEC_FIRST; j < VIDEO_CODEC_END; ++j) {
+                        auto in = static_cast<codec_t>(i);
+                        auto out = static_cast<codec_t>(j);
+                        if (i == j || get_decoder_from_to(in, out) == nullptr
+                                        || codec_is_planar(in) || codec_is_planar(out)
+                                        || filtered(opts, get_codec_name(in), get_codec_name(out))) {
+                                continue;
+                        }
+                        for (auto [width, height] : opts.sizes) {
+                                int in_linesize = vc_get_linesize(width, in);
+                                int out_linesize = vc_get_linesize(width, out);
+                                vector<unsigned char> in_data((size_t) in_linesize * height + MAX_PADDING);
+                                vector<unsigned char> out_data((size_t) out_linesize * height + MAX_PADDING);
+                                fill_random(in_data.data(), in_data.size());
+                                size_t bytes = (size_t) (in_linesize + out_linesize) * height;
+
+                                vector<decoder_t> seen;
+                                for (const char *impl : impls) {
+                                        decoder_t dec = get_decoder_from_to_impl(in, out, impl);
+                                        if (dec == nullptr || std::find(seen.begin(), seen.end(), dec) != seen.end()) {
+                                                continue;
+                                        }
+                                        seen.push_back(dec);
+                                        double t = measure(opts, [&] {
+                                                for (int y = 0; y < height; ++y) {
+                                                        dec(out_data.data() + (size_t) y * out_linesize,
+                                                                        in_data.data() + (size_t) y * in_linesize, out_linesize,
+                                                                        DEFAULT_R_SHIFT, DEFAULT_G_SHIFT, DEFAULT_B_SHIFT);
+                                                }
+                                        });
+                                        results.push_back({"uv", get_codec_name(in), get_codec_name(out), impl,
+                                                        width, height, 1, t, bytes});
+                                }
+
+                                decoder_t best = get_decoder_from_to(in, out);
+                                double t = measure(opts, [&] {
+                                        parallel_pix_conv(height, (char *) out_data.data(), out_linesize,
+                                                        (const char *) in_data.data(), in_linesize, best, opts.threads);
+                                });
+                                results.push_back({"uv", get_codec_name(in), get_codec_name(out), "auto",
+                                                width, height, opts.threads, t, bytes});
+                        }
+                }
+        }
+}
+
+#ifdef HAVE_LAVC
+static size_t av_frame_bytes(const AVFrame *frame)
+{
+        size_t ret = 0;
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((enum AVPixelFormat) frame->format);
+        for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->data[p] != nullptr; ++p) {
+                int h = p == 0 || p == 3 ? frame->height : AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+                ret += (size_t) frame->linesize[p] * h;
+        }
+        return ret;
+}
+
+static void bench_from_lavc(const bench_opts &opts, vector<bench_result> &results)
+{
+        for (const AVPixFmtDescriptor *desc = av_pix_fmt_desc_next(nullptr); desc != nullptr;
+                        desc = av_pix_fmt_desc_next(desc)) {
+                enum AVPixelFormat av_fmt = av_pix_fmt_desc_get_id(desc);
+                if ((desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)) != 0) {
+                        continue;
+                }
+                for (int j = VIDEO_CODEC_FIRST; j < VIDEO_CODEC_END; ++j) {
+                        auto out = static_cast<codec_t>(j);
+                        if (codec_is_planar(out) || filtered(opts, desc->name, get_codec_name(out))) {
+                                continue;
+                        }
+                        av_to_uv_convert_t conv = get_av_to_uv_conversion(av_fmt, out);
+                        if (!conv.valid) {
+                                continue;
+                        }
+                        for (auto [width, height] : opts.sizes) {
+                                AVFrame *frame = av_frame_alloc();
+                                frame->format = av_fmt;
+                                frame->width = width;
+                                frame->height = height;
+                                if (av_frame_get_buffer(frame, 0) != 0) {
+                                        av_frame_free(&frame);
+                                        continue;
+                                }
+                                for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->buf[p] != nullptr; ++p) {
+                                        fill_random(frame->buf[p]->data, frame->buf[p]->size);
+                                }
+                                int out_linesize = vc_get_linesize(width, out);
+                                vector<char> out_data((size_t) out_linesize * height + MAX_PADDING);
+                                const int rgb_shift[] = DEFAULT_RGB_SHIFT_INIT;
+                                double t = measure(opts, [&] {
+                                        av_to_uv_convert(&conv, out_data.data(), frame, width, height, out_linesize, rgb_shift);
+                                });
+                                results.push_back({"from_lavc", desc->name, get_codec_name(out), "auto", width, height, 1, t,
+                                                av_frame_bytes(frame) + (size_t) out_linesize * height});
+                                av_frame_free(&frame);
+                        }
+                }
+        }
+}
+
+static void bench_to_lavc(const bench_opts &opts, vector<bench_result> &results)
+{
+        for (int i = VIDEO_CODEC_FIRST; i < VIDEO_CODEC_END; ++i) {
+                auto in = static_cast<codec_t>(i);
+                if (is_codec_opaque(in)) {
+                        continue;
+                }
+                enum AVPixelFormat fmts[AV_PIX_FMT_NB];
+                struct to_lavc_req_prop req_prop = { 0, 0, -1, VIDEO_CODEC_NONE };
+                int count = get_available_pix_fmts(in, req_prop, fmts);
+                for (int f = 0; f < count; ++f) {
+                        const char *av_name = av_get_pix_fmt_name(fmts[f]);
+                        if (filtered(opts, get_codec_name(in), av_name)) {
+                                continue;
+                        }
+                        for (auto [width, height] : opts.sizes) {
+                                size_t in_len = vc_get_datalen(width, height, in);
+                                vector<char> in_data(in_len + MAX_PADDING);
+                                fill_random((unsigned char *) in_data.data(), in_data.size());
+                                for (int threads : { 1, opts.threads }) {
+                                        struct to_lavc_vid_conv *conv = to_lavc_vid_conv_init(in, width, height, fmts[f], threads);
+                                        if (conv == nullptr) {
+                                                break;
+                                        }
+                                        size_t out_len = 0;
+                                        double t = measure(opts, [&] {
+                                                AVFrame *out = to_lavc_vid_conv(conv, in_data.data());
+                                                if (out != nullptr && out_len == 0) {
+                                                        out_len = av_frame_bytes(out);
+                                                }
+                                        });
+                                        to_lavc_vid_conv_destroy(&conv);
+                                        results.push_back({"to_lavc", get_codec_name(in), av_name, "auto", width, height, threads, t,
+                                                        in_len + out_len});
+                                        if (opts.threads == 1) {
+                                                break;
+                                        }
+                                }
+                        }
+                }
+        }
+}
+#endif // defined HAVE_LAVC
+
+static string get_cpu_name()
+{
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        string line;
+        while (std::getline(cpuinfo, line)) {
+                if (line.rfind("model name", 0) == 0 && line.find(':') != string::npos) {
+                        return line.substr(line.find(':') + 2);
+                }
+        }
+        return "unknown";
+}
+
+static string json_escape(const string &s)
+{
+        string ret;
+        for (char c : s) {
+                if (c == '"' || c == '\\') {
+                        ret += '\\';
+                }
+                ret += c;
+        }
+        return ret;
+}
+
+static void print_json(const bench_opts &opts, const vector<bench_result> &results)
+{
+        cout << "{\n\t\"version\": \"" << PACKAGE_VERSION << "\",\n"
+                << "\t\"cpu\": \"" << json_escape(get_cpu_name()) << "\",\n"
+                << "\t\"threads\": " << opts.threads << ",\n"
+                << "\t\"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+                const auto &r = results[i];
+                char line[1024];
+                snprintf(line, sizeof line, "\t\t{\"kind\": \"%s\", \"from\": \"%s\", \"to\": \"%s\", \"impl\": \"%s\", "
+                                "\"width\": %d, \"height\": %d, \"threads\": %d, "
+                                "\"ns_per_pixel\": %.4f, \"gb_per_s\": %.3f}%s\n",
+                                r.kind.c_str(), json_escape(r.from).c_str(), json_escape(r.to).c_str(), r.impl.c_str(),
+                                r.width, r.height, r.threads,
+                                r.seconds * 1E9 / ((double) r.width * r.height), r.bytes / r.seconds / 1E9,
+                                i + 1 < results.size() ? "," : "");
+                cout << line;
+        }
+        cout << "\t]\n}\n";
+}
+
+static void usage(const char *progname)
+{
+        cout << "Benchmarks UltraGrid pixel format conversions, results are printed as JSON.\n\n"
+                "Usage:\n\t" << progname << " [-s <W>x<H>[,<W>x<H>...]] [-t <threads>] [-m <seconds>] [-f <filter>]\n\n"
+                "where\n"
+                "\t-s - frame sizes (default 1920x1080,3840x2160,7680x4320)\n"
+                "\t-t - threads for the parallel conversions (default number of CPU cores)\n"
+                "\t-m - minimal measured time per conversion (default 0.2)\n"
+                "\t-f - benchmark only conversions whose \"<from>-><to>\" contains the filter\n";
+}
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        for (int i = 1; i < argc; ++i) {
+                string opt = argv[i];
+                if (opt == "-h" || opt == "--help" || i + 1 == argc) {
+                        usage(argv[0]);
+                        return opt == "-h" || opt == "--help" ? 0 : 1;
+                }
+                const char *val = argv[++i];
+                if (opt == "-s") {
+                        opts.sizes.clear();
+                        std::istringstream iss(val);
+                        string item;
+                        while (std::getline(iss, item, ',')) {
+                                int w = 0, h = 0;
+                                if (sscanf(item.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+                                        cerr << "Wrong size: " << item << "\n";
+                                        return 1;
+                                }
+                                opts.sizes.emplace_back(w, h);
+                        }
+                } else if (opt == "-t") {
+                        opts.threads = std::max(atoi(val), 1);
+                } else if (opt == "-m") {
+                        opts.min_time = atof(val);
+                } else if (opt == "-f") {
+                        opts.filter = val;
+                } else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        log_level = LOG_LEVEL_QUIET; // conversion lookups report unsupported combinations
+        vector<bench_result> results;
+        bench_uv(opts, results);
+#ifdef HAVE_LAVC
+        bench_from_lavc(opts, results);
+        bench_to_lavc(opts, results);
+#endif
+        print_json(opts, results);
+}
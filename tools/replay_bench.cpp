@@ -0,0 +1,359 @@
+/**
+ * @file   tools/replay_bench.cpp
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  receiver performance regression benchmark replaying recorded RTP traces
+ *
+ * Each trace (pcap, eg. recorded with "--param udp-record=<prefix>") is fed
+ * as fast as possible (udp-replay) to a receiving RTP session, decoded with
+ * pbuf and the video decoder (including decompression) and displayed by the
+ * dummy display. Frames per second, CPU time and heap allocations per frame
+ * are printed as JSON; with --min-fps, the exit code signals a regression.
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#include "debug.h"
+#include "host.h"
+#include "module.h"
+#include "pdb.h"
+#include "rtp/pbuf.h"
+#include "rtp/rtp.h"
+#include "rtp/rtp_callback.h"
+#include "rtp/rtp_trace.h"
+#include "rtp/video_decoders.h"
+#include "tv.h"
+#include "utils/alloc_stats.h"
+#include "utils/metrics.h"
+#include "video.h"
+#include "video_display.h"
+
+using std::cout;
+using std::string;
+using std::vector;
+
+#define RECV_BUF_SIZE (64 * 1024 * 1024)
+#define IDLE_TIMEOUT (2 * NS_IN_SEC) ///< no progress for this time ends the replay
+
+struct bench_result {
+        string trace;
+        unsigned long long packets;
+        unsigned long long received;
+        unsigned long long displayed;
+        unsigned long long corrupted;
+        unsigned long long dropped;
+        double seconds;
+        double cpu_seconds;
+        unsigned long long allocs;
+};
+
+/// @returns sum of the values of all samples of the series (name with labels)
+static unsigned long long metric_value(const string &series)
+{
+        char *scrape = metrics_scrape();
+        unsigned long long ret = 0;
+        for (const char *line = scrape; line != nullptr && *line != '\0'; ) {
+                if (strncmp(line, series.c_str(), series.size()) == 0 && line[series.size()] == ' ') {
+                        ret += strtoull(line + series.size() + 1, nullptr, 10);
+                }
+                line = strchr(line, '\n');
+                line = line != nullptr ? line + 1 : nullptr;
+        }
+        free(scrape);
+        return ret;
+}
+
+/// @returns number of heap allocations of all threads since the start
+static unsigned long long alloc_count()
+{
+        unsigned long long ret = 0;
+        for (int tag = 0; tag < alloc_stats_tag_count(); ++tag) {
+                uint64_t count = 0;
+                uint64_t bytes = 0;
+                alloc_stats_get(tag, &count, &bytes);
+                ret += count;
+        }
+        return ret;
+}
+
+static double cpu_time()
+{
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1E6;
+}
+
+/// @returns number of UDP datagrams in the trace, port is set to the destination port of the first one
+static unsigned long long trace_packets(const string &filename, uint16_t *port)
+{
+        struct rtp_trace *t = rtp_trace_open(filename.c_str());
+        if (t == nullptr) {
+                return 0;
+        }
+        vector<char> buf(RTP_MAX_PACKET_LEN);
+        unsigned long long count = 0;
+        time_ns_t ts = 0;
+        uint16_t dst_port = 0;
+        while (rtp_trace_read(t, &ts, nullptr, &dst_port, buf.data(), buf.size()) > 0) {
+                if (count++ == 0) {
+                        *port = dst_port;
+                }
+        }
+        rtp_trace_close(t);
+        return count;
+}
+
+static void receiver_loop(struct rtp *session, struct pdb *participants, struct vcodec_state *vdecoder,
+                std::atomic<bool> *should_exit)
+{
+        while (!*should_exit) {
+                struct timeval timeout { 0, 1000 };
+                rtp_recv_r(session, &timeout, 0);
+                time_ns_t curr_time = get_time_in_ns();
+                pdb_iter_t it;
+                struct pdb_e *cp = pdb_iter_init(participants, &it);
+                while (cp != nullptr) {
+                        cp->decoder_state = vdecoder;
+                        pbuf_decode(cp->playout_buffer, curr_time, decode_video_frame, vdecoder);
+                        pbuf_remove(cp->playout_buffer, curr_time);
+                        cp = pdb_iter_next(&it);
+                }
+                pdb_iter_done(&it);
+        }
+}
+
+/// waits until the value of all series stops changing for IDLE_TIMEOUT or reaches target
+/// @returns time of the last change
+static time_ns_t wait_progress(const vector<string> &series, unsigned long long target)
+{
+        unsigned long long last = 0;
+        time_ns_t last_change = get_time_in_ns();
+        while (get_time_in_ns() - last_change < IDLE_TIMEOUT) {
+                unsigned long long val = 0;
+                for (const auto &s : series) {
+                        val += metric_value(s);
+                }
+                if (val != last) {
+                        last = val;
+                        last_change = get_time_in_ns();
+                }
+                if (target > 0 && val >= target) {
+                        break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return last_change;
+}
+
+static bool bench_trace(struct module *root, const string &filename, bench_result *res)
+{
+        uint16_t port = 0;
+        unsigned long long packets = trace_packets(filename, &port);
+        if (packets == 0) {
+                log_msg(LOG_LEVEL_ERROR, "No UDP packets in trace %s!\n", filename.c_str());
+                return false;
+        }
+        set_commandline_param("udp-replay", filename.c_str());
+
+        volatile int delay_ms = 0;
+        struct pdb *participants = pdb_init(&delay_ms);
+        struct rtp *rx = nullptr;
+        struct display *display = nullptr;
+        struct vcodec_state vdecoder{};
+        bool ret = false;
+
+        const string rx_series = "ug_rtp_rx_packets_total";
+        const vector<string> frame_series{
+                "ug_video_decoder_frames_total{result=\"displayed\"}",
+                "ug_video_decoder_frames_total{result=\"corrupted\"}",
+                "ug_video_decoder_frames_total{result=\"dropped\"}",
+        };
+        unsigned long long rx_start = metric_value(rx_series);
+        unsigned long long frames_start[3];
+        for (int i = 0; i < 3; ++i) {
+                frames_start[i] = metric_value(frame_series[i]);
+        }
+        double cpu_start = cpu_time();
+        unsigned long long allocs_start = alloc_count();
+        time_ns_t start = get_time_in_ns();
+
+        if (initialize_video_display(root, "dummy", "", 0, nullptr, &display) != 0
+                        || (vdecoder.decoder = video_decoder_init(root, VIDEO_NORMAL, display, nullptr)) == nullptr
+                        || (rx = rtp_init_if("127.0.0.1", nullptr, port, port + 2, 255, 1000, false,
+                                        rtp_recv_callback, (uint8_t *) participants, 0, true)) == nullptr) {
+                log_msg(LOG_LEVEL_ERROR, "Unable to initialize benchmark for trace %s!\n", filename.c_str());
+                goto cleanup;
+        }
+        {
+                rtp_set_option(rx, RTP_OPT_WEAK_VALIDATION, true);
+                rtp_set_option(rx, RTP_OPT_PROMISC, true);
+                rtp_set_recv_buf(rx, RECV_BUF_SIZE);
+
+                std::atomic<bool> should_exit{false};
+                std::thread receiver(receiver_loop, rx, participants, &vdecoder, &should_exit);
+                wait_progress({rx_series}, rx_start + packets);
+                time_ns_t end = wait_progress(frame_series, 0); // let the decoder drain
+                should_exit = true;
+                receiver.join();
+
+                res->trace = filename;
+                res->packets = packets;
+                res->received = metric_value(rx_series) - rx_start;
+                res->displayed = metric_value(frame_series[0]) - frames_start[0];
+                res->corrupted = metric_value(frame_series[1]) - frames_start[1];
+                res->dropped = metric_value(frame_series[2]) - frames_start[2];
+                res->seconds = (end - start) / NS_IN_SEC_DBL;
+                res->cpu_seconds = cpu_time() - cpu_start;
+                res->allocs = alloc_count() - allocs_start;
+                ret = true;
+        }
+cleanup:
+        if (rx != nullptr) {
+                rtp_done(rx);
+        }
+        if (vdecoder.decoder != nullptr) {
+                video_decoder_destroy(vdecoder.decoder);
+        }
+        if (display != nullptr) {
+                display_done(display);
+        }
+        pdb_destroy(&participants);
+        return ret;
+}
+
+static void print_json(const vector<bench_result> &results, bool have_allocs)
+{
+        cout << "{\n\t\"version\": \"" << PACKAGE_VERSION << "\",\n"
+                << "\t\"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+                const auto &r = results[i];
+                const double frames = r.displayed + r.corrupted;
+                char line[2048];
+                snprintf(line, sizeof line, "\t\t{\"trace\": \"%s\", \"packets\": %llu, \"packets_received\": %llu, "
+                                "\"frames_displayed\": %llu, \"frames_corrupted\": %llu, \"frames_dropped\": %llu, "
+                                "\"fps\": %.2f, \"cpu_ms_per_frame\": %.3f, \"allocs_per_frame\": ",
+                                r.trace.c_str(), r.packets, r.received, r.displayed, r.corrupted, r.dropped,
+                                frames / r.seconds, frames > 0 ? r.cpu_seconds * 1000 / frames : 0.0);
+                cout << line;
+                if (have_allocs) {
+                        snprintf(line, sizeof line, "%.1f", frames > 0 ? r.allocs / frames : 0.0);
+                        cout << line;
+                } else {
+                        cout << "null";
+                }
+                cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        cout << "\t]\n}\n";
+}
+
+static void usage(const char *progname)
+{
+        cout << "Replays recorded RTP traces to the UltraGrid receiver as fast as possible, results are printed as JSON.\n\n"
+                "Usage:\n\t" << progname << " [--min-fps <fps>] <trace.pcap> [<trace.pcap>...]\n\n"
+                "where\n"
+                "\t--min-fps - fail (exit code 1) if any trace is decoded slower\n"
+                "\t<trace>   - pcap file with a single UltraGrid video stream, eg. recorded by\n"
+                "\t            the receiver with \"--param udp-record=<prefix>\"\n";
+}
+
+int main(int argc, char *argv[])
+{
+        double min_fps = 0;
+        vector<string> traces;
+        for (int i = 1; i < argc; ++i) {
+                string opt = argv[i];
+                if (opt == "-h" || opt == "--help") {
+                        usage(argv[0]);
+                        return 0;
+                }
+                if (opt == "--min-fps" && i + 1 < argc) {
+                        min_fps = atof(argv[++i]);
+                } else if (opt[0] == '-') {
+                        usage(argv[0]);
+                        return 1;
+                } else {
+                        traces.push_back(opt);
+                }
+        }
+        if (traces.empty()) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        log_level = LOG_LEVEL_ERROR;
+        struct init_data *init = common_preinit(1, argv);
+        if (init == nullptr) {
+                return 2;
+        }
+        const bool have_allocs = alloc_stats_enable(true);
+        struct module root;
+        init_root_module(&root);
+
+        vector<bench_result> results;
+        bool regression = false;
+        for (const auto &trace : traces) {
+                bench_result res{};
+                if (!bench_trace(&root, trace, &res)) {
+                        continue;
+                }
+                if ((res.displayed + res.corrupted) / res.seconds < min_fps) {
+                        log_msg(LOG_LEVEL_ERROR, "%s: %.2f fps is below %.2f!\n", trace.c_str(),
+                                        (res.displayed + res.corrupted) / res.seconds, min_fps);
+                        regression = true;
+                }
+                results.push_back(res);
+        }
+        print_json(results, have_allocs);
+
+        module_done(&root);
+        common_cleanup(init);
+        return results.size() == traces.size() && !regression ? 0 : 1;
+}
@@ -0,0 +1,504 @@
+/**
+ * @file   tools/sync_bench.cpp
+ * @author Martin Pulec     <martin.pulec@cesnet.cz>
+ * @brief  microbenchmark of the inter-thread primitives with JSON output
+ *
+ * Measures the primitives from src/utils carrying the frames between the
+ * threads - synchronized_queue (and its lock-free SPSC replacement
+ * spsc_queue), wait_obj, video_frame_pool, ring_buffer and the worker
+ * pool: SPSC and MPSC throughput, hand-off latency percentiles (from the
+ * push/notify to the wakeup of a blocked consumer) and throughput under
+ * contention of N threads. Run with "make bench-sync".
+ */
+/*
+ * Copyright (c) 2024 CESNET, z. s. p. o.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, is permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of CESNET nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#include "config_unix.h"
+#include "config_win32.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "debug.h"
+#include "utils/misc.h"
+#include "utils/ring_buffer.h"
+#include "utils/spsc_queue.h"
+#include "utils/synchronized_queue.h"
+#include "utils/video_frame_pool.h"
+#include "utils/wait_obj.h"
+#include "utils/worker.h"
+#include "video_codec.h"
+#include "video_frame.h"
+
+using std::atomic;
+using std::cerr;
+using std::cout;
+using std::function;
+using std::string;
+using std::thread;
+using std::vector;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct bench_opts {
+        vector<int> threads{1, 2, 4, 8}; ///< producer counts for the contended benchmarks
+        double min_time = 0.5;           ///< measured duration of throughput benchmarks [s]
+        int samples = 20000;             ///< hand-off latency samples
+        int chunk = 65536;               ///< ring buffer write size [B]
+        string filter;                   ///< substring of "<bench> <impl>" to be benchmarked
+};
+
+struct bench_result {
+        bench_result(string b, string i, int t, double ops, vector<long long> lat = {})
+                : bench(std::move(b)), impl(std::move(i)), threads(t), ops_per_s(ops), lat_ns(std::move(lat)) {}
+        string bench; ///< "spsc", "mpsc", "handoff", "contention" or "bytes"
+        string impl;
+        int threads;
+        double ops_per_s;
+        vector<long long> lat_ns; ///< p50, p99, p99.9, max (handoff only)
+        double gb_per_s = -1.0;   ///< bytes only
+};
+
+static bool selected(const bench_opts &opts, const string &bench, const string &impl)
+{
+        return (bench + " " + impl).find(opts.filter) != string::npos;
+}
+
+static double seconds_since(steady_clock::time_point t0)
+{
+        return duration<double>(steady_clock::now() - t0).count();
+}
+
+static long long now_ns()
+{
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// spins for ns nanoseconds so that the consumer goes to sleep before the next hand-off
+static void spin_for(long long ns)
+{
+        long long until = now_ns() + ns;
+        while (now_ns() < until) {
+        }
+}
+
+/**
+ * @defgroup sync_bench_queues queue adaptors
+ * Common push()/pop() interface, -1 is the end-of-stream mark.
+ * @{
+ */
+template<int len>
+struct sync_queue {
+        static string name() { return "synchronized_queue<" + (len == -1 ? string("unlimited") : std::to_string(len)) + ">"; }
+        static constexpr bool mpsc = true;
+        synchronized_queue<long long, len> q;
+        void push(long long v) { q.push(v); }
+        long long pop() { return q.pop(); }
+};
+
+template<unsigned len, int spin>
+struct lockfree_queue {
+        static string name() { return "spsc_queue<" + std::to_string(len) + ">" + (spin > 0 ? " spin " + std::to_string(spin) : string()); }
+        static constexpr bool mpsc = false;
+        spsc_queue<long long, len> q;
+        lockfree_queue() { q.set_spin_count(spin); }
+        void push(long long v) { q.push(v); }
+        long long pop() { return q.pop(); }
+};
+/// @}
+
+/// @returns items per second passed from producers to one consumer
+template<typename Q>
+static double queue_throughput(const bench_opts &opts, int producers)
+{
+        auto q = std::make_unique<Q>();
+        atomic<bool> stop{false};
+        vector<thread> threads;
+        for (int i = 0; i < producers; ++i) {
+                threads.emplace_back([&] {
+                        long long v = 0;
+                        while (!stop.load(std::memory_order_relaxed)) {
+                                q->push(v++);
+                        }
+                        q->push(-1);
+                });
+        }
+        long long count = 0;
+        auto t0 = steady_clock::now();
+        thread timer([&] {
+                std::this_thread::sleep_for(duration<double>(opts.min_time));
+                stop = true;
+        });
+        for (int finished = 0; finished < producers; ) {
+                if (q->pop() == -1) {
+                        finished += 1;
+                } else {
+                        count += 1;
+                }
+        }
+        double elapsed = seconds_since(t0);
+        timer.join();
+        for (auto &t : threads) {
+                t.join();
+        }
+        return count / elapsed;
+}
+
+static vector<long long> percentiles(vector<long long> &lat)
+{
+        if (lat.empty()) {
+                return {};
+        }
+        std::sort(lat.begin(), lat.end());
+        auto at = [&](double p) { return lat[std::min(lat.size() - 1, (size_t) (p * lat.size()))]; };
+        return { at(0.5), at(0.99), at(0.999), lat.back() };
+}
+
+/**
+ * Measures latency from the hand-off (done by handoff(timestamp)) to the
+ * wakeup of the consumer (receive() returning the timestamp).
+ */
+static bench_result measure_handoff(const bench_opts &opts, const string &impl,
+                const function<void(long long)> &handoff, const function<long long()> &receive)
+{
+        vector<long long> lat;
+        lat.reserve(opts.samples);
+        atomic<int> received{0};
+        thread consumer([&] {
+                for (int i = 0; i < opts.samples; ++i) {
+                        long long ts = receive();
+                        lat.push_back(now_ns() - ts);
+                        received.store(i + 1, std::memory_order_release);
+                }
+        });
+        auto t0 = steady_clock::now();
+        for (int i = 0; i < opts.samples; ++i) {
+                while (received.load(std::memory_order_acquire) < i) {
+                }
+                spin_for(20000);
+                handoff(now_ns());
+        }
+        consumer.join();
+        double elapsed = seconds_since(t0);
+        return { "handoff", impl, 1, opts.samples / elapsed, percentiles(lat) };
+}
+
+template<typename Q>
+static void bench_queue(const bench_opts &opts, vector<bench_result> &results)
+{
+        const string impl = Q::name();
+        if (selected(opts, "spsc", impl)) {
+                results.push_back({ "spsc", impl, 1, queue_throughput<Q>(opts, 1) });
+        }
+        if (Q::mpsc && selected(opts, "mpsc", impl)) {
+                for (int n : opts.threads) {
+                        if (n > 1) {
+                                results.push_back({ "mpsc", impl, n, queue_throughput<Q>(opts, n) });
+                        }
+                }
+        }
+        if (selected(opts, "handoff", impl)) {
+                auto q = std::make_unique<Q>();
+                results.push_back(measure_handoff(opts, impl,
+                                        [&](long long ts) { q->push(ts); },
+                                        [&] { return q->pop(); }));
+        }
+}
+
+static void bench_wait_obj(const bench_opts &opts, vector<bench_result> &results)
+{
+        if (!selected(opts, "handoff", "wait_obj")) {
+                return;
+        }
+        struct wait_obj *w = wait_obj_init();
+        atomic<long long> ts_slot{0};
+        results.push_back(measure_handoff(opts, "wait_obj",
+                                [&](long long ts) { ts_slot = ts; wait_obj_notify(w); },
+                                [&] { wait_obj_wait(w); wait_obj_reset(w); return ts_slot.load(); }));
+        wait_obj_done(w);
+}
+
+/// runs fn in n threads for min_time, @returns total calls per second
+static double contended(const bench_opts &opts, int n, const function<void()> &fn)
+{
+        atomic<bool> stop{false};
+        atomic<long long> total{0};
+        vector<thread> threads;
+        auto t0 = steady_clock::now();
+        for (int i = 0; i < n; ++i) {
+                threads.emplace_back([&] {
+                        long long count = 0;
+                        while (!stop.load(std::memory_order_relaxed)) {
+                                fn();
+                                count += 1;
+                        }
+                        total += count;
+                });
+        }
+        std::this_thread::sleep_for(duration<double>(opts.min_time));
+        stop = true;
+        for (auto &t : threads) {
+                t.join();
+        }
+        return total / seconds_since(t0);
+}
+
+static void bench_frame_pool(const bench_opts &opts, vector<bench_result> &results)
+{
+        const struct video_desc desc { 1920, 1080, UYVY, 30.0, PROGRESSIVE, 1 };
+        if (selected(opts, "contention", "video_frame_pool")) {
+                for (int n : opts.threads) {
+                        video_frame_pool pool(n);
+                        pool.reconfigure(desc);
+                        results.push_back({ "contention", "video_frame_pool", n,
+                                        contended(opts, n, [&] { pool.get_frame(); }) });
+                }
+        }
+        if (selected(opts, "spsc", "video_frame_pool")) {
+                // frames obtained by the producer, passed to and released by the consumer
+                video_frame_pool pool(4);
+                pool.reconfigure(desc);
+                auto q = std::make_unique<spsc_queue<std::shared_ptr<video_frame>, 2>>();
+                atomic<bool> stop{false};
+                thread producer([&] {
+                        while (!stop.load(std::memory_order_relaxed)) {
+                                q->push(pool.get_frame());
+                        }
+                        q->push(std::shared_ptr<video_frame>());
+                });
+                long long count = 0;
+                auto t0 = steady_clock::now();
+                while (q->pop()) {
+                        count += 1;
+                        if (count % 1024 == 0 && seconds_since(t0) > opts.min_time) {
+                                stop = true;
+                        }
+                }
+                producer.join();
+                results.push_back({ "spsc", "video_frame_pool", 1, count / seconds_since(t0) });
+        }
+}
+
+static void bench_worker(const bench_opts &opts, vector<bench_result> &results)
+{
+        auto nop = [](void *arg) -> void * { return arg; };
+        if (selected(opts, "contention", "task_run_async")) {
+                for (int n : opts.threads) {
+                        results.push_back({ "contention", "task_run_async", n,
+                                        contended(opts, n, [&] { wait_task(task_run_async(nop, nullptr)); }) });
+                }
+        }
+        if (selected(opts, "contention", "task_run_parallel")) {
+                for (int n : opts.threads) {
+                        vector<char> data(n);
+                        results.push_back({ "contention", "task_run_parallel", n,
+                                        contended(opts, 1, [&] { task_run_parallel(nop, n, data.data(), 1, nullptr); }) });
+                }
+        }
+        if (selected(opts, "handoff", "task_run_async")) {
+                static atomic<long long> ts_slot;
+                static atomic<long long> woken;
+                auto record = [](void *) -> void * { woken = now_ns() - ts_slot; return nullptr; };
+                vector<long long> lat;
+                lat.reserve(opts.samples);
+                auto t0 = steady_clock::now();
+                for (int i = 0; i < opts.samples; ++i) {
+                        spin_for(20000);
+                        ts_slot = now_ns();
+                        wait_task(task_run_async(record, nullptr));
+                        lat.push_back(woken);
+                }
+                results.push_back({ "handoff", "task_run_async", 1, opts.samples / seconds_since(t0), percentiles(lat) });
+        }
+}
+
+static void bench_ring_buffer(const bench_opts &opts, vector<bench_result> &results)
+{
+        if (!selected(opts, "bytes", "ring_buffer")) {
+                return;
+        }
+        struct ring_buffer *ring = ring_buffer_init(opts.chunk * 16);
+        vector<char> in(opts.chunk, 'x');
+        vector<char> out(opts.chunk);
+        atomic<bool> stop{false};
+        thread producer([&] {
+                while (!stop.load(std::memory_order_relaxed)) {
+                        if (ring_get_available_write_size(ring) >= opts.chunk) {
+                                ring_buffer_write(ring, in.data(), opts.chunk);
+                        } else {
+                                std::this_thread::yield();
+                        }
+                }
+        });
+        long long bytes = 0;
+        auto t0 = steady_clock::now();
+        while (seconds_since(t0) < opts.min_time) {
+                int ret = ring_buffer_read(ring, out.data(), opts.chunk);
+                if (ret == 0) {
+                        std::this_thread::yield();
+                }
+                bytes += ret;
+        }
+        double elapsed = seconds_since(t0);
+        stop = true;
+        producer.join();
+        ring_buffer_destroy(ring);
+        bench_result r{ "bytes", "ring_buffer", 1, bytes / (double) opts.chunk / elapsed };
+        r.gb_per_s = bytes / elapsed / 1E9;
+        results.push_back(r);
+}
+
+static string get_cpu_name()
+{
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        string line;
+        while (std::getline(cpuinfo, line)) {
+                if (line.rfind("model name", 0) == 0 && line.find(':') != string::npos) {
+                        return line.substr(line.find(':') + 2);
+                }
+        }
+        return "unknown";
+}
+
+static string json_escape(const string &s)
+{
+        string ret;
+        for (char c : s) {
+                if (c == '"' || c == '\\') {
+                        ret += '\\';
+                }
+                ret += c;
+        }
+        return ret;
+}
+
+static void print_json(const vector<bench_result> &results)
+{
+        cout << "{\n\t\"version\": \"" << PACKAGE_VERSION << "\",\n"
+                << "\t\"cpu\": \"" << json_escape(get_cpu_name()) << "\",\n"
+                << "\t\"cores\": " << get_cpu_core_count() << ",\n"
+                << "\t\"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+                const auto &r = results[i];
+                char line[1024];
+                int len = snprintf(line, sizeof line, "\t\t{\"bench\": \"%s\", \"impl\": \"%s\", \"threads\": %d, \"ops_per_s\": %.0f",
+                                r.bench.c_str(), r.impl.c_str(), r.threads, r.ops_per_s);
+                if (r.gb_per_s >= 0.0) {
+                        len += snprintf(line + len, sizeof line - len, ", \"gb_per_s\": %.3f", r.gb_per_s);
+                }
+                if (r.lat_ns.size() == 4) {
+                        len += snprintf(line + len, sizeof line - len, ", \"p50_ns\": %lld, \"p99_ns\": %lld, \"p999_ns\": %lld, \"max_ns\": %lld",
+                                        r.lat_ns[0], r.lat_ns[1], r.lat_ns[2], r.lat_ns[3]);
+                }
+                snprintf(line + len, sizeof line - len, "}%s\n", i + 1 < results.size() ? "," : "");
+                cout << line;
+        }
+        cout << "\t]\n}\n";
+}
+
+static void usage(const char *progname)
+{
+        cout << "Benchmarks UltraGrid inter-thread primitives, results are printed as JSON.\n\n"
+                "Usage:\n\t" << progname << " [-t <n>[,<n>...]] [-m <seconds>] [-n <samples>] [-c <bytes>] [-f <filter>]\n\n"
+                "where\n"
+                "\t-t - thread counts for the MPSC and contention benchmarks (default 1,2,4,8)\n"
+                "\t-m - measured time per throughput benchmark (default 0.5)\n"
+                "\t-n - number of hand-off latency samples (default 20000)\n"
+                "\t-c - ring buffer write size (default 65536)\n"
+                "\t-f - run only benchmarks whose \"<bench> <impl>\" contains the filter\n"
+                "\t     (bench is spsc, mpsc, handoff, contention or bytes)\n";
+}
+
+int main(int argc, char *argv[])
+{
+        bench_opts opts;
+        for (int i = 1; i < argc; ++i) {
+                string opt = argv[i];
+                if (opt == "-h" || opt == "--help" || i + 1 == argc) {
+                        usage(argv[0]);
+                        return opt == "-h" || opt == "--help" ? 0 : 1;
+                }
+                const char *val = argv[++i];
+                if (opt == "-t") {
+                        opts.threads.clear();
+                        std::istringstream iss(val);
+                        string item;
+                        while (std::getline(iss, item, ',')) {
+                                if (atoi(item.c_str()) <= 0) {
+                                        cerr << "Wrong thread count: " << item << "\n";
+                                        return 1;
+                                }
+                                opts.threads.push_back(atoi(item.c_str()));
+                        }
+                } else if (opt == "-m") {
+                        opts.min_time = atof(val);
+                } else if (opt == "-n") {
+                        opts.samples = std::max(atoi(val), 1);
+                } else if (opt == "-c") {
+                        opts.chunk = std::max(atoi(val), 1);
+                } else if (opt == "-f") {
+                        opts.filter = val;
+                } else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        vector<bench_result> results;
+        bench_queue<sync_queue<1>>(opts, results);
+        bench_queue<sync_queue<16>>(opts, results);
+        bench_queue<sync_queue<-1>>(opts, results);
+        bench_queue<lockfree_queue<1, 0>>(opts, results);
+        bench_queue<lockfree_queue<16, 0>>(opts, results);
+        bench_queue<lockfree_queue<16, 1000>>(opts, results);
+        bench_wait_obj(opts, results);
+        bench_frame_pool(opts, results);
+        bench_worker(opts, results);
+        bench_ring_buffer(opts, results);
+        print_json(results);
+}